@@ -36,19 +36,27 @@
 #include <errno.h>
 #include <getopt.h>
 #include <limits.h>
+#include <poll.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "command-line.h"
 #include "compiler.h"
 #include "daemon.h"
+#include "fabric.h"
 #include "fault.h"
+#include "hash.h"
+#include "hmap.h"
 #include "learning-switch.h"
+#include "mac-learning.h"
 #include "ofpbuf.h"
 #include "openflow/openflow.h"
 #include "poll-loop.h"
 #include "rconn.h"
+#include "socket-util.h"
 #include "timeval.h"
 #include "util.h"
 #include "vconn-ssl.h"
@@ -58,12 +66,52 @@
 #include "vlog.h"
 #define THIS_MODULE VLM_controller
 
-#define MAX_SWITCHES 16
+static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(5, 5);
+
 #define MAX_LISTENERS 16
 
+/* Maximum number of messages from one switch to process, and answer with one
+ * batch of replies, before moving on to the next switch. */
+#define SWITCH_BATCH 16
+
+/* With --max-handshakes, time allowed for an accepted connection to answer
+ * the features request before it is dropped to free its slot. */
+#define HANDSHAKE_TIMEOUT_MSEC 10000
+
 struct switch_ {
     struct lswitch *lswitch;
     struct rconn *rconn;
+    struct fabric_member *fabric_member; /* Null without --fabric. */
+
+    /* An accepted connection counts against --max-handshakes until its switch
+     * answers the features request. */
+    bool handshaking;
+    long long int handshake_deadline;
+};
+
+/* A connection handed to a worker but not yet taken over by it. */
+struct new_conn {
+    struct vconn *vconn;
+    const char *name;
+    bool handshaking;
+};
+
+/* A set of switches that share a poll loop.  With --threads=1, the main
+ * thread runs the only one.  Otherwise, each worker thread runs one, and the
+ * main thread only accepts connections and hands them out. */
+struct worker {
+    pthread_t thread;
+    int wakeup_pipe[2];         /* Written when 'new_conns' grows, or when a
+                                 * switch's fabric member has work to do. */
+
+    /* Connections waiting to be taken over, protected by 'mutex'. */
+    pthread_mutex_t mutex;
+    struct new_conn *new_conns;
+    size_t n_new_conns, allocated_new_conns;
+
+    /* Switches, owned by the thread that runs the worker. */
+    struct switch_ *switches;
+    size_t n_switches, allocated_switches;
 };
 
 /* Learn the ports on which MAC addresses appear? */
@@ -75,17 +123,70 @@ static bool setup_flows = true;
 /* --max-idle: Maximum idle time, in seconds, before flows expire. */
 static int max_idle = 60;
 
+/* --flow-mode: Kind of flows to set up for learned destinations. */
+static enum lswitch_flow_mode flow_mode = LSW_FLOW_EXACT;
+
+/* --max-macs, --max-vlan-macs: Limits on each switch's MAC learning table
+ * (0 for no per-VLAN limit). */
+static size_t max_macs = MAC_DEFAULT_MAX;
+static size_t max_vlan_macs = 0;
+
+/* --fabric: MAC location table shared by all switches, or null. */
+static struct fabric *fabric;
+
+/* --threads: Number of worker threads, or 1 to run switches in the main
+ * thread. */
+static int n_threads = 1;
+
+/* MAC learning entries of switches that disconnected, for restoring when the
+ * same switch reconnects, unless --no-resync.  Protected by 'saves_mutex',
+ * since a switch may reconnect to a different worker. */
+struct saved_switch {
+    struct hmap_node node;      /* In 'saves'. */
+    unsigned long long int dpid;
+    struct mac_learning_saved *entries;
+    size_t n_entries;
+    time_t expires;             /* When the last of 'entries' expires. */
+};
+static bool resync = true;
+static struct hmap saves = HMAP_INITIALIZER(&saves);
+static pthread_mutex_t saves_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* --max-handshakes: Maximum number of accepted connections that may be
+ * handshaking at once, or 0 for no limit. */
+static int max_handshakes = 0;
+
+/* Number of switches connected across all workers, used only with worker
+ * threads, and number of accepted connections still handshaking.  Both are
+ * protected by 'n_live_mutex'. */
+static int n_live;
+static int n_handshaking;
+static pthread_mutex_t n_live_mutex = PTHREAD_MUTEX_INITIALIZER;
+
 static int do_switching(struct switch_ *);
-static void new_switch(struct switch_ *, struct vconn *, const char *name);
+static void new_switch(struct switch_ *, struct vconn *, const char *name,
+                       bool handshaking, int wakeup_fd);
+static void add_switch(struct worker *, struct vconn *, const char *name,
+                       bool handshaking);
+static int run_switches(struct worker *);
+static void wait_switches(struct worker *);
+static void start_workers(struct worker *, int n);
+static void hand_off(struct worker *, struct vconn *, const char *name,
+                     bool handshaking);
+static int count_live(void);
+static bool admit_switch(void);
+static void end_handshake(struct switch_ *);
+static void save_switch(const struct lswitch *);
+static lswitch_resync_cb restore_switch;
 static void parse_options(int argc, char *argv[]);
 static void usage(void) NO_RETURN;
 
 int
 main(int argc, char *argv[])
 {
-    struct switch_ switches[MAX_SWITCHES];
     struct pvconn *listeners[MAX_LISTENERS];
-    int n_switches, n_listeners;
+    struct worker main_worker, *workers;
+    int n_listeners, next_worker;
     int retval;
     int i;
 
@@ -101,7 +202,12 @@ main(int argc, char *argv[])
                   "use --help for usage");
     }
 
-    n_switches = n_listeners = 0;
+    memset(&main_worker, 0, sizeof main_worker);
+    main_worker.wakeup_pipe[0] = main_worker.wakeup_pipe[1] = -1;
+    workers = n_threads > 1 ? xcalloc(n_threads, sizeof *workers) : NULL;
+    next_worker = 0;
+
+    n_listeners = 0;
     for (i = optind; i < argc; i++) {
         const char *name = argv[i];
         struct vconn *vconn;
@@ -109,10 +215,12 @@ main(int argc, char *argv[])
 
         retval = vconn_open(name, OFP_VERSION, &vconn);
         if (!retval) {
-            if (n_switches >= MAX_SWITCHES) {
-                ofp_fatal(0, "max %d switch connections", n_switches);
+            if (workers) {
+                hand_off(&workers[next_worker++ % n_threads], vconn, name,
+                         false);
+            } else {
+                add_switch(&main_worker, vconn, name, false);
             }
-            new_switch(&switches[n_switches++], vconn, name);
             continue;
         } else if (retval == EAFNOSUPPORT) {
             struct pvconn *pvconn;
@@ -128,31 +236,47 @@ main(int argc, char *argv[])
             VLOG_ERR("%s: connect: %s", name, strerror(retval));
         }
     }
-    if (n_switches == 0 && n_listeners == 0) {
+    if (main_worker.n_switches == 0 && next_worker == 0 && n_listeners == 0) {
         ofp_fatal(0, "no active or passive switch connections");
     }
 
     die_if_already_running();
     daemonize();
 
+    /* Start the workers after daemonize(), since threads do not survive the
+     * fork(). */
+    if (workers) {
+        start_workers(workers, n_threads);
+    }
+
     retval = vlog_server_listen(NULL, NULL);
     if (retval) {
         ofp_fatal(retval, "Could not listen for vlog connections");
     }
 
-    while (n_switches > 0 || n_listeners > 0) {
-        int iteration;
+    while (n_listeners > 0
+           || (workers ? count_live() > 0 : main_worker.n_switches > 0)) {
         int i;
 
         /* Accept connections on listening vconns. */
-        for (i = 0; i < n_listeners && n_switches < MAX_SWITCHES; ) {
+        for (i = 0; i < n_listeners; ) {
             struct vconn *new_vconn;
             int retval;
 
             retval = pvconn_accept(listeners[i], OFP_VERSION, &new_vconn);
-            if (!retval || retval == EAGAIN) {
+            if (!retval && !admit_switch()) {
+                /* Turning a connection away costs only the close, which the
+                 * switch takes as a failed attempt and backs off from, so keep
+                 * draining this listener. */
+                vconn_close(new_vconn);
+            } else if (!retval || retval == EAGAIN) {
                 if (!retval) {
-                    new_switch(&switches[n_switches++], new_vconn, "tcp");
+                    if (workers) {
+                        hand_off(&workers[next_worker++ % n_threads],
+                                 new_vconn, "tcp", true);
+                    } else {
+                        add_switch(&main_worker, new_vconn, "tcp", true);
+                    }
                 }
                 i++;
             } else {
@@ -161,57 +285,354 @@ main(int argc, char *argv[])
             }
         }
 
-        /* Do some switching work.  Limit the number of iterations so that
-         * callbacks registered with the poll loop don't starve. */
-        for (iteration = 0; iteration < 50; iteration++) {
-            bool progress = false;
-            for (i = 0; i < n_switches; ) {
-                struct switch_ *this = &switches[i];
-                int retval = do_switching(this);
-                if (!retval || retval == EAGAIN) {
-                    if (!retval) {
-                        progress = true;
-                    }
-                    i++;
-                } else {
-                    rconn_destroy(this->rconn);
-                    lswitch_destroy(this->lswitch);
-                    switches[i] = switches[--n_switches];
+        if (!workers) {
+            run_switches(&main_worker);
+        }
+
+        /* Wait for something to happen. */
+        for (i = 0; i < n_listeners; i++) {
+            pvconn_wait(listeners[i]);
+        }
+        if (!workers) {
+            wait_switches(&main_worker);
+        } else if (!n_listeners) {
+            /* Only the workers can tell when their switches disconnect. */
+            poll_timer_wait(1000);
+        }
+        poll_block();
+    }
+
+    return 0;
+}
+
+static void
+add_switch(struct worker *w, struct vconn *vconn, const char *name,
+           bool handshaking)
+{
+    if (w->n_switches >= w->allocated_switches) {
+        w->switches = x2nrealloc(w->switches, &w->allocated_switches,
+                                 sizeof *w->switches);
+    }
+    new_switch(&w->switches[w->n_switches++], vconn, name, handshaking,
+               w->wakeup_pipe[1]);
+}
+
+/* Does some switching work for each of 'w''s switches, and drops those that
+ * have disconnected.  Returns the number dropped. */
+static int
+run_switches(struct worker *w)
+{
+    int n_dropped = 0;
+    int iteration;
+    size_t i;
+
+    /* Limit the number of iterations so that callbacks registered with the
+     * poll loop don't starve. */
+    for (iteration = 0; iteration < 50; iteration++) {
+        bool progress = false;
+        for (i = 0; i < w->n_switches; ) {
+            struct switch_ *this = &w->switches[i];
+            int retval = do_switching(this);
+            if (this->handshaking) {
+                if (lswitch_get_datapath_id(this->lswitch)) {
+                    end_handshake(this);
+                } else if (max_handshakes
+                           && time_msec() >= this->handshake_deadline) {
+                    VLOG_WARN_RL(&rl, "%s: handshake timed out",
+                                 rconn_get_name(this->rconn));
+                    retval = ETIMEDOUT;
                 }
             }
-            if (!progress) {
-                break;
+            if (!retval || retval == EAGAIN) {
+                if (!retval) {
+                    progress = true;
+                }
+                i++;
+            } else {
+                if (resync) {
+                    save_switch(this->lswitch);
+                }
+                end_handshake(this);
+                fabric_leave(this->fabric_member);
+                rconn_destroy(this->rconn);
+                lswitch_destroy(this->lswitch);
+                w->switches[i] = w->switches[--w->n_switches];
+                n_dropped++;
             }
         }
-        for (i = 0; i < n_switches; i++) {
-            struct switch_ *this = &switches[i];
-            lswitch_run(this->lswitch, this->rconn);
+        if (!progress) {
+            break;
         }
+    }
+    for (i = 0; i < w->n_switches; i++) {
+        struct switch_ *this = &w->switches[i];
+        lswitch_run(this->lswitch, this->rconn);
+        if (this->fabric_member) {
+            fabric_run(this->fabric_member, this->rconn);
+        }
+    }
+    return n_dropped;
+}
 
-        /* Wait for something to happen. */
-        if (n_switches < MAX_SWITCHES) {
-            for (i = 0; i < n_listeners; i++) {
-                pvconn_wait(listeners[i]);
-            }
+static void
+wait_switches(struct worker *w)
+{
+    size_t i;
+
+    for (i = 0; i < w->n_switches; i++) {
+        struct switch_ *sw = &w->switches[i];
+        rconn_run_wait(sw->rconn);
+        rconn_recv_wait(sw->rconn);
+        lswitch_wait(sw->lswitch);
+        if (sw->fabric_member) {
+            fabric_wait(sw->fabric_member);
         }
-        for (i = 0; i < n_switches; i++) {
-            struct switch_ *sw = &switches[i];
-            rconn_run_wait(sw->rconn);
-            rconn_recv_wait(sw->rconn);
-            lswitch_wait(sw->lswitch);
+        if (sw->handshaking && max_handshakes) {
+            poll_timer_wait(sw->handshake_deadline - time_msec());
         }
+    }
+}
+
+/* Passes 'vconn' to worker thread 'w', which will take it over the next time
+ * it wakes up. */
+static void
+hand_off(struct worker *w, struct vconn *vconn, const char *name,
+         bool handshaking)
+{
+    struct new_conn *nc;
+
+    pthread_mutex_lock(&n_live_mutex);
+    n_live++;
+    pthread_mutex_unlock(&n_live_mutex);
+
+    pthread_mutex_lock(&w->mutex);
+    if (w->n_new_conns >= w->allocated_new_conns) {
+        w->new_conns = x2nrealloc(w->new_conns, &w->allocated_new_conns,
+                                  sizeof *w->new_conns);
+    }
+    nc = &w->new_conns[w->n_new_conns++];
+    nc->vconn = vconn;
+    nc->name = name;
+    nc->handshaking = handshaking;
+    pthread_mutex_unlock(&w->mutex);
+
+    if (write(w->wakeup_pipe[1], "", 1) < 0 && errno != EAGAIN) {
+        VLOG_WARN_RL(&rl, "failed to wake worker thread: %s",
+                     strerror(errno));
+    }
+}
+
+static int
+count_live(void)
+{
+    int n;
+
+    pthread_mutex_lock(&n_live_mutex);
+    n = n_live;
+    pthread_mutex_unlock(&n_live_mutex);
+    return n;
+}
+
+/* Counts a newly accepted connection as handshaking and returns true, or, if
+ * --max-handshakes connections are already handshaking, returns false to turn
+ * it away. */
+static bool
+admit_switch(void)
+{
+    bool admit;
+    int n;
+
+    pthread_mutex_lock(&n_live_mutex);
+    n = n_handshaking;
+    admit = !max_handshakes || n < max_handshakes;
+    if (admit) {
+        n_handshaking++;
+    }
+    pthread_mutex_unlock(&n_live_mutex);
+
+    if (!admit) {
+        VLOG_WARN_RL(&rl, "turning away connection: %d handshakes in "
+                     "progress", n);
+    }
+    return admit;
+}
+
+/* Stops counting 'sw' as handshaking, if it was. */
+static void
+end_handshake(struct switch_ *sw)
+{
+    if (sw->handshaking) {
+        sw->handshaking = false;
+        pthread_mutex_lock(&n_live_mutex);
+        n_handshaking--;
+        pthread_mutex_unlock(&n_live_mutex);
+    }
+}
+
+static void *
+worker_main(void *w_)
+{
+    struct worker *w = w_;
+
+    for (;;) {
+        char buf[64];
+        size_t i;
+        int n_dropped;
+
+        /* Take over new connections. */
+        while (read(w->wakeup_pipe[0], buf, sizeof buf) > 0) {
+            continue;
+        }
+        pthread_mutex_lock(&w->mutex);
+        for (i = 0; i < w->n_new_conns; i++) {
+            add_switch(w, w->new_conns[i].vconn, w->new_conns[i].name,
+                       w->new_conns[i].handshaking);
+        }
+        w->n_new_conns = 0;
+        pthread_mutex_unlock(&w->mutex);
+
+        n_dropped = run_switches(w);
+        if (n_dropped) {
+            pthread_mutex_lock(&n_live_mutex);
+            n_live -= n_dropped;
+            pthread_mutex_unlock(&n_live_mutex);
+        }
+
+        wait_switches(w);
+        poll_fd_wait(w->wakeup_pipe[0], POLLIN);
         poll_block();
     }
 
-    return 0;
+    return NULL;
 }
 
 static void
-new_switch(struct switch_ *sw, struct vconn *vconn, const char *name)
+start_workers(struct worker *workers, int n)
 {
+    int i;
+
+    for (i = 0; i < n; i++) {
+        struct worker *w = &workers[i];
+        int error;
+
+        if (pipe(w->wakeup_pipe) < 0) {
+            ofp_fatal(errno, "pipe failed");
+        }
+        set_nonblocking(w->wakeup_pipe[0]);
+        set_nonblocking(w->wakeup_pipe[1]);
+        pthread_mutex_init(&w->mutex, NULL);
+
+        error = pthread_create(&w->thread, NULL, worker_main, w);
+        if (error) {
+            ofp_fatal(error, "failed to create worker thread");
+        }
+    }
+}
+
+/* Sets up 'sw' to control the switch on 'vconn'.  'handshaking' is true if
+ * 'vconn' was accepted by admit_switch().  'wakeup_fd' wakes the thread that
+ * runs 'sw', or it is -1 for the main thread. */
+static void
+new_switch(struct switch_ *sw, struct vconn *vconn, const char *name,
+           bool handshaking, int wakeup_fd)
+{
+    sw->handshaking = handshaking;
+    sw->handshake_deadline = time_msec() + HANDSHAKE_TIMEOUT_MSEC;
     sw->rconn = rconn_new_from_vconn(name, vconn);
     sw->lswitch = lswitch_create(sw->rconn, learn_macs,
                                  setup_flows ? max_idle : -1);
+    lswitch_set_mac_limits(sw->lswitch, max_macs, max_vlan_macs);
+    lswitch_set_flow_mode(sw->lswitch, flow_mode);
+    if (resync) {
+        lswitch_set_resync_cb(sw->lswitch, restore_switch, NULL);
+    }
+    sw->fabric_member = (fabric && learn_macs
+                         ? fabric_join(fabric, sw->lswitch, wakeup_fd)
+                         : NULL);
+}
+
+static uint32_t
+hash_dpid(unsigned long long int dpid)
+{
+    return hash_bytes(&dpid, sizeof dpid, 0);
+}
+
+/* Removes and returns the saved entries for 'dpid', or a null pointer if there
+ * are none.  The caller must hold 'saves_mutex'. */
+static struct saved_switch *
+take_saved_switch(unsigned long long int dpid)
+{
+    struct saved_switch *s;
+
+    HMAP_FOR_EACH_WITH_HASH (s, struct saved_switch, node, hash_dpid(dpid),
+                             &saves) {
+        if (s->dpid == dpid) {
+            hmap_remove(&saves, &s->node);
+            return s;
+        }
+    }
+    return NULL;
+}
+
+/* Saves the MAC learning entries of 'sw', whose switch has disconnected,
+ * replacing any saved earlier for the same switch, and discards saved entries
+ * that have all expired. */
+static void
+save_switch(const struct lswitch *sw)
+{
+    struct saved_switch *s, *next, *old;
+    time_t now = time_now();
+    size_t i;
+
+    s = xmalloc(sizeof *s);
+    s->n_entries = lswitch_save_macs(sw, &s->entries);
+    if (!s->n_entries) {
+        free(s);
+        return;
+    }
+    s->dpid = lswitch_get_datapath_id(sw);
+    s->expires = now;
+    for (i = 0; i < s->n_entries; i++) {
+        s->expires = MAX(s->expires, s->entries[i].expires);
+    }
+
+    pthread_mutex_lock(&saves_mutex);
+    HMAP_FOR_EACH_SAFE (old, next, struct saved_switch, node, &saves) {
+        if (old->expires <= now) {
+            hmap_remove(&saves, &old->node);
+            free(old->entries);
+            free(old);
+        }
+    }
+    old = take_saved_switch(s->dpid);
+    if (old) {
+        free(old->entries);
+        free(old);
+    }
+    hmap_insert(&saves, &s->node, hash_dpid(s->dpid));
+    pthread_mutex_unlock(&saves_mutex);
+}
+
+/* lswitch_resync_cb that hands a reconnecting switch the entries that
+ * save_switch() saved for it. */
+static size_t
+restore_switch(unsigned long long int dpid, struct mac_learning_saved **saved,
+               void *aux UNUSED)
+{
+    struct saved_switch *s;
+    size_t n = 0;
+
+    pthread_mutex_lock(&saves_mutex);
+    s = take_saved_switch(dpid);
+    pthread_mutex_unlock(&saves_mutex);
+
+    *saved = NULL;
+    if (s) {
+        *saved = s->entries;
+        n = s->n_entries;
+        free(s);
+    }
+    return n;
 }
 
 static int
@@ -219,14 +640,21 @@ do_switching(struct switch_ *sw)
 {
     unsigned int packets_sent;
     struct ofpbuf *msg;
+    int i;
 
     packets_sent = rconn_packets_sent(sw->rconn);
 
-    msg = rconn_recv(sw->rconn);
-    if (msg) {
+    /* Answer a burst of messages with a single batch of replies. */
+    lswitch_start_batch(sw->lswitch, sw->rconn);
+    for (i = 0; i < SWITCH_BATCH; i++) {
+        msg = rconn_recv(sw->rconn);
+        if (!msg) {
+            break;
+        }
         lswitch_process_packet(sw->lswitch, sw->rconn, msg);
         ofpbuf_delete(msg);
     }
+    lswitch_flush_batch(sw->lswitch, sw->rconn);
     rconn_run(sw->rconn);
 
     return (!rconn_is_alive(sw->rconn) ? EOF
@@ -240,12 +668,26 @@ parse_options(int argc, char *argv[])
     enum {
         OPT_MAX_IDLE = UCHAR_MAX + 1,
         OPT_PEER_CA_CERT,
+        OPT_THREADS,
+        OPT_MAX_MACS,
+        OPT_MAX_VLAN_MACS,
+        OPT_FLOW_MODE,
+        OPT_FABRIC,
+        OPT_NO_RESYNC,
+        OPT_MAX_HANDSHAKES,
         VLOG_OPTION_ENUMS
     };
     static struct option long_options[] = {
         {"hub",         no_argument, 0, 'H'},
         {"noflow",      no_argument, 0, 'n'},
         {"max-idle",    required_argument, 0, OPT_MAX_IDLE},
+        {"threads",     required_argument, 0, OPT_THREADS},
+        {"max-macs",    required_argument, 0, OPT_MAX_MACS},
+        {"max-vlan-macs", required_argument, 0, OPT_MAX_VLAN_MACS},
+        {"flow-mode",   required_argument, 0, OPT_FLOW_MODE},
+        {"fabric",      no_argument, 0, OPT_FABRIC},
+        {"no-resync",   no_argument, 0, OPT_NO_RESYNC},
+        {"max-handshakes", required_argument, 0, OPT_MAX_HANDSHAKES},
         {"help",        no_argument, 0, 'h'},
         {"version",     no_argument, 0, 'V'},
         DAEMON_LONG_OPTIONS,
@@ -288,6 +730,56 @@ parse_options(int argc, char *argv[])
             }
             break;
 
+        case OPT_THREADS:
+            n_threads = atoi(optarg);
+            if (n_threads < 1) {
+                ofp_fatal(0, "--threads argument must be at least 1");
+            }
+            break;
+
+        case OPT_MAX_MACS:
+            if (atoi(optarg) < 1) {
+                ofp_fatal(0, "--max-macs argument must be at least 1");
+            }
+            max_macs = atoi(optarg);
+            break;
+
+        case OPT_MAX_VLAN_MACS:
+            if (atoi(optarg) < 0) {
+                ofp_fatal(0, "--max-vlan-macs argument must not be negative");
+            }
+            max_vlan_macs = atoi(optarg);
+            break;
+
+        case OPT_FLOW_MODE:
+            if (!strcmp(optarg, "exact")) {
+                flow_mode = LSW_FLOW_EXACT;
+            } else if (!strcmp(optarg, "l2")) {
+                flow_mode = LSW_FLOW_L2;
+            } else if (!strcmp(optarg, "proactive")) {
+                flow_mode = LSW_FLOW_PROACTIVE;
+            } else {
+                ofp_fatal(0, "--flow-mode argument must be 'exact', 'l2' or "
+                          "'proactive'");
+            }
+            break;
+
+        case OPT_FABRIC:
+            fabric = fabric_create();
+            break;
+
+        case OPT_NO_RESYNC:
+            resync = false;
+            break;
+
+        case OPT_MAX_HANDSHAKES:
+            max_handshakes = atoi(optarg);
+            if (max_handshakes < 0) {
+                ofp_fatal(0, "--max-handshakes argument must not be "
+                          "negative");
+            }
+            break;
+
         case 'h':
             usage();
 
@@ -330,6 +822,15 @@ usage(void)
            "  -H, --hub               act as hub instead of learning switch\n"
            "  -n, --noflow            pass traffic, but don't add flows\n"
            "  --max-idle=SECS         max idle time for new flows\n"
+           "  --threads=N             run switches in N worker threads\n"
+           "  --max-handshakes=N      turn away connections beyond N "
+           "handshaking\n"
+           "  --max-macs=N            learn up to N MACs per switch\n"
+           "  --max-vlan-macs=N       learn up to N MACs per VLAN\n"
+           "  --flow-mode=MODE        set up 'exact', 'l2' or 'proactive' "
+           "flows\n"
+           "  --fabric                share learned MACs among all switches\n"
+           "  --no-resync             forget learned MACs on disconnection\n"
            "  -h, --help              display this help message\n"
            "  -V, --version           display version information\n");
     exit(EXIT_SUCCESS);
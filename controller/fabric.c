@@ -0,0 +1,445 @@
+/* Copyright (c) 2008 The Board of Trustees of The Leland Stanford
+ * Junior University
+ * 
+ * We are making the OpenFlow specification and associated documentation
+ * (Software) available for public use and benefit with the expectation
+ * that others will use, modify and enhance the Software and contribute
+ * those enhancements back to the community. However, since we would
+ * like to make the Software available for broadest use, with as few
+ * restrictions as possible permission is hereby granted, free of
+ * charge, to any person obtaining a copy of this Software to deal in
+ * the Software under the copyrights without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ * The name and trademarks of copyright holder(s) may NOT be used in
+ * advertising or publicity pertaining to the Software or any
+ * derivatives without specific, written prior permission.
+ */
+
+
+#include <config.h>
+#include "fabric.h"
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "hash.h"
+#include "hmap.h"
+#include "learning-switch.h"
+#include "list.h"
+#include "mac-learning.h"
+#include "poll-loop.h"
+#include "timeval.h"
+#include "util.h"
+
+#define THIS_MODULE VLM_controller
+#include "vlog.h"
+
+/* Time, in ms, that a MAC address stays homed on a switch without being
+ * learned there again.  Switches forget addresses after MAC_ENTRY_IDLE_TIME,
+ * so a live address is relearned well within this time. */
+#define FABRIC_ENTRY_IDLE_MSEC (2 * MAC_ENTRY_IDLE_TIME * 1000)
+
+/* Maximum number of MAC addresses that a fabric tracks. */
+#define FABRIC_MAX_ENTRIES 65536
+
+/* Maximum number of announcements waiting for one member. */
+#define FABRIC_MAX_PENDING 4096
+
+/* Where a MAC address is attached to the fabric. */
+struct fabric_entry {
+    struct hmap_node node;      /* In struct fabric's 'entries'. */
+    struct list lru_node;       /* In struct fabric's 'lru'. */
+    uint8_t mac[ETH_ADDR_LEN];
+    uint16_t vlan;
+    unsigned long long int home; /* Datapath ID of the switch it is on. */
+    uint16_t port;              /* Port on 'home'. */
+    long long int expires;      /* time_msec() at which to forget it. */
+};
+
+/* A member's port that leads toward another switch. */
+struct fabric_trunk {
+    unsigned long long int dpid; /* Datapath ID of the other switch. */
+    uint16_t port;
+};
+
+/* A MAC address homed on another switch, for a member to act on. */
+struct fabric_announce {
+    uint8_t mac[ETH_ADDR_LEN];
+    uint16_t vlan;
+    unsigned long long int home;
+    uint16_t port;              /* Port toward 'home', set by fabric_run(). */
+};
+
+struct fabric {
+    pthread_mutex_t mutex;      /* Protects everything below. */
+    struct hmap entries;        /* Contains "struct fabric_entry"s. */
+    struct list lru;            /* Entries, least recently learned first. */
+    struct list members;        /* Contains "struct fabric_member"s. */
+};
+
+struct fabric_member {
+    struct list node;           /* In struct fabric's 'members'. */
+    struct fabric *fabric;
+    struct lswitch *lswitch;    /* Used only by the member's own thread. */
+    int wakeup_fd;              /* Written to wake the member, or -1. */
+
+    /* Everything below is protected by the fabric's mutex. */
+    unsigned long long int dpid; /* Switch's datapath ID, 0 if unknown. */
+
+    /* Ports that lead toward other switches. */
+    struct fabric_trunk *trunks;
+    size_t n_trunks, allocated_trunks;
+
+    /* Addresses homed elsewhere, not yet acted on by fabric_run(). */
+    struct fabric_announce *pending;
+    size_t n_pending, allocated_pending;
+};
+
+static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(5, 5);
+
+static lswitch_learn_cb fabric_learned;
+
+/* Creates and returns a new, empty fabric. */
+struct fabric *
+fabric_create(void)
+{
+    struct fabric *f = xmalloc(sizeof *f);
+    pthread_mutex_init(&f->mutex, NULL);
+    hmap_init(&f->entries);
+    list_init(&f->lru);
+    list_init(&f->members);
+    return f;
+}
+
+/* Adds 'sw' to fabric 'f' and returns the new member.  'wakeup_fd' is written
+ * to wake the thread that runs 'sw' when the member has work to do, or it is
+ * -1 if every member of 'f' is run by the same thread. */
+struct fabric_member *
+fabric_join(struct fabric *f, struct lswitch *sw, int wakeup_fd)
+{
+    struct fabric_member *m = xcalloc(1, sizeof *m);
+
+    m->fabric = f;
+    m->lswitch = sw;
+    m->wakeup_fd = wakeup_fd;
+    lswitch_set_learn_cb(sw, fabric_learned, m);
+
+    pthread_mutex_lock(&f->mutex);
+    list_push_back(&f->members, &m->node);
+    pthread_mutex_unlock(&f->mutex);
+    return m;
+}
+
+/* Removes 'm' from its fabric and frees it.  The addresses homed on its
+ * switch are forgotten as they expire. */
+void
+fabric_leave(struct fabric_member *m)
+{
+    if (m) {
+        struct fabric *f = m->fabric;
+
+        lswitch_set_learn_cb(m->lswitch, NULL, NULL);
+        pthread_mutex_lock(&f->mutex);
+        list_remove(&m->node);
+        pthread_mutex_unlock(&f->mutex);
+        free(m->trunks);
+        free(m->pending);
+        free(m);
+    }
+}
+
+static uint32_t
+entry_hash(const uint8_t mac[ETH_ADDR_LEN], uint16_t vlan)
+{
+    return hash_bytes(mac, ETH_ADDR_LEN, vlan);
+}
+
+static void
+remove_entry(struct fabric *f, struct fabric_entry *e)
+{
+    hmap_remove(&f->entries, &e->node);
+    list_remove(&e->lru_node);
+    free(e);
+}
+
+/* Forgets the entries in 'f' that have expired by 'now'. */
+static void
+expire_entries(struct fabric *f, long long int now)
+{
+    while (!list_is_empty(&f->lru)) {
+        struct fabric_entry *e = CONTAINER_OF(f->lru.next,
+                                              struct fabric_entry, lru_node);
+        if (e->expires > now) {
+            break;
+        }
+        remove_entry(f, e);
+    }
+}
+
+static struct fabric_entry *
+lookup_entry(const struct fabric *f, const uint8_t mac[ETH_ADDR_LEN],
+             uint16_t vlan)
+{
+    struct fabric_entry *e;
+
+    HMAP_FOR_EACH_WITH_HASH (e, struct fabric_entry, node,
+                             entry_hash(mac, vlan), &f->entries) {
+        if (e->vlan == vlan && eth_addr_equals(e->mac, mac)) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+static struct fabric_member *
+find_member(const struct fabric *f, unsigned long long int dpid)
+{
+    struct fabric_member *m;
+
+    LIST_FOR_EACH (m, struct fabric_member, node, &f->members) {
+        if (m->dpid == dpid) {
+            return m;
+        }
+    }
+    return NULL;
+}
+
+static struct fabric_trunk *
+find_trunk(const struct fabric_member *m, unsigned long long int dpid)
+{
+    size_t i;
+
+    for (i = 0; i < m->n_trunks; i++) {
+        if (m->trunks[i].dpid == dpid) {
+            return &m->trunks[i];
+        }
+    }
+    return NULL;
+}
+
+static bool
+is_trunk_port(const struct fabric_member *m, uint16_t port)
+{
+    size_t i;
+
+    for (i = 0; i < m->n_trunks; i++) {
+        if (m->trunks[i].port == port) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void
+wake_member(const struct fabric_member *m)
+{
+    if (m->wakeup_fd < 0) {
+        poll_immediate_wake();
+    } else if (write(m->wakeup_fd, "", 1) < 0 && errno != EAGAIN) {
+        VLOG_WARN("failed to wake fabric member: %s", strerror(errno));
+    }
+}
+
+/* Queues 'e' for 'm' to act on in fabric_run(). */
+static void
+announce(struct fabric_member *m, const struct fabric_entry *e)
+{
+    struct fabric_announce *a;
+
+    if (m->n_pending >= FABRIC_MAX_PENDING) {
+        VLOG_WARN_RL(&rl, "%012llx: too many fabric announcements pending, "
+                     "dropping some", m->dpid);
+        return;
+    }
+    if (m->n_pending >= m->allocated_pending) {
+        m->pending = x2nrealloc(m->pending, &m->allocated_pending,
+                                sizeof *m->pending);
+    }
+    a = &m->pending[m->n_pending++];
+    memcpy(a->mac, e->mac, ETH_ADDR_LEN);
+    a->vlan = e->vlan;
+    a->home = e->home;
+    if (m->n_pending == 1) {
+        wake_member(m);
+    }
+}
+
+/* Records that 'port' on 'm' leads toward the switch with datapath ID
+ * 'dpid'.  If that is news, queues every address homed on that switch for
+ * 'm', which until now had no way to reach them. */
+static void
+learn_trunk(struct fabric *f, struct fabric_member *m,
+            unsigned long long int dpid, uint16_t port)
+{
+    struct fabric_trunk *t = find_trunk(m, dpid);
+    struct fabric_entry *e;
+
+    if (t) {
+        if (t->port == port) {
+            return;
+        }
+    } else {
+        if (m->n_trunks >= m->allocated_trunks) {
+            m->trunks = x2nrealloc(m->trunks, &m->allocated_trunks,
+                                   sizeof *m->trunks);
+        }
+        t = &m->trunks[m->n_trunks++];
+        t->dpid = dpid;
+    }
+    t->port = port;
+    VLOG_DBG("%012llx: port %"PRIu16" leads to %012llx", m->dpid, port, dpid);
+
+    HMAP_FOR_EACH (e, struct fabric_entry, node, &f->entries) {
+        if (e->home == dpid) {
+            announce(m, e);
+        }
+    }
+}
+
+/* Makes 'port' on 'm''s switch the home of 'mac' on 'vlan', whose entry in
+ * 'f' is 'e' (or null if it has none), and tells the other members about
+ * it. */
+static void
+set_home(struct fabric *f, struct fabric_member *m, struct fabric_entry *e,
+         const uint8_t mac[ETH_ADDR_LEN], uint16_t vlan, uint16_t port,
+         long long int now)
+{
+    struct fabric_member *other;
+
+    if (!e) {
+        if (hmap_count(&f->entries) >= FABRIC_MAX_ENTRIES) {
+            remove_entry(f, CONTAINER_OF(f->lru.next, struct fabric_entry,
+                                         lru_node));
+        }
+        e = xmalloc(sizeof *e);
+        memcpy(e->mac, mac, ETH_ADDR_LEN);
+        e->vlan = vlan;
+        hmap_insert(&f->entries, &e->node, entry_hash(mac, vlan));
+    } else {
+        list_remove(&e->lru_node);
+    }
+    list_push_back(&f->lru, &e->lru_node);
+    e->home = m->dpid;
+    e->port = port;
+    e->expires = now + FABRIC_ENTRY_IDLE_MSEC;
+
+    LIST_FOR_EACH (other, struct fabric_member, node, &f->members) {
+        if (other != m) {
+            announce(other, e);
+        }
+    }
+}
+
+/* Called by a member's learning switch 'sw' when it learns from a packet_in
+ * that 'mac' on 'vlan' is on 'port'.
+ *
+ * The first switch to report an address is normally the one that it is
+ * attached to, since a switch floods a packet from an unknown source only
+ * after it has seen it.  A later report from another switch then reveals
+ * which of that switch's ports leads toward the first one.  A report on a
+ * port already known to lead to another switch never claims an address, and
+ * an address claimed through such a port is claimed anew by the next
+ * switch to report it, which corrects the occasional race between
+ * switches. */
+static void
+fabric_learned(struct lswitch *sw, uint16_t vlan,
+               const uint8_t mac[ETH_ADDR_LEN], uint16_t port, void *m_)
+{
+    struct fabric_member *m = m_;
+    struct fabric *f = m->fabric;
+    unsigned long long int dpid = lswitch_get_datapath_id(sw);
+    long long int now = time_msec();
+    struct fabric_entry *e;
+
+    if (!dpid) {
+        return;
+    }
+
+    pthread_mutex_lock(&f->mutex);
+    m->dpid = dpid;
+    expire_entries(f, now);
+    e = lookup_entry(f, mac, vlan);
+    if (e && e->home != dpid) {
+        struct fabric_member *home = find_member(f, e->home);
+        if (home && !is_trunk_port(home, e->port)) {
+            learn_trunk(f, m, e->home, port);
+        } else if (!is_trunk_port(m, port)) {
+            set_home(f, m, e, mac, vlan, port, now);
+        }
+    } else if (!is_trunk_port(m, port)) {
+        set_home(f, m, e, mac, vlan, port, now);
+    }
+    pthread_mutex_unlock(&f->mutex);
+}
+
+/* Installs flows on 'rconn', the connection to 'm''s switch, toward the
+ * addresses that other switches have learned since the last call, through
+ * the ports that lead to those switches. */
+void
+fabric_run(struct fabric_member *m, struct rconn *rconn)
+{
+    struct fabric *f = m->fabric;
+    struct fabric_announce *pending;
+    size_t n_pending, n_prefetched;
+    size_t i;
+
+    pthread_mutex_lock(&f->mutex);
+    if (!m->n_pending) {
+        pthread_mutex_unlock(&f->mutex);
+        return;
+    }
+    pending = m->pending;
+    n_pending = m->n_pending;
+    m->pending = NULL;
+    m->n_pending = m->allocated_pending = 0;
+
+    /* Find the port toward each announcement's home, dropping those that 'm'
+     * does not know the way to yet.  learn_trunk() announces them again when
+     * it finds out. */
+    n_prefetched = 0;
+    for (i = 0; i < n_pending; i++) {
+        const struct fabric_trunk *t = find_trunk(m, pending[i].home);
+        if (t) {
+            pending[n_prefetched] = pending[i];
+            pending[n_prefetched].port = t->port;
+            n_prefetched++;
+        }
+    }
+    pthread_mutex_unlock(&f->mutex);
+
+    for (i = 0; i < n_prefetched; i++) {
+        lswitch_prefetch(m->lswitch, rconn, pending[i].vlan, pending[i].mac,
+                         pending[i].port);
+    }
+    free(pending);
+}
+
+void
+fabric_wait(struct fabric_member *m)
+{
+    struct fabric *f = m->fabric;
+
+    pthread_mutex_lock(&f->mutex);
+    if (m->n_pending) {
+        poll_immediate_wake();
+    }
+    pthread_mutex_unlock(&f->mutex);
+}
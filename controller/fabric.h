@@ -0,0 +1,65 @@
+/* Copyright (c) 2008 The Board of Trustees of The Leland Stanford
+ * Junior University
+ * 
+ * We are making the OpenFlow specification and associated documentation
+ * (Software) available for public use and benefit with the expectation
+ * that others will use, modify and enhance the Software and contribute
+ * those enhancements back to the community. However, since we would
+ * like to make the Software available for broadest use, with as few
+ * restrictions as possible permission is hereby granted, free of
+ * charge, to any person obtaining a copy of this Software to deal in
+ * the Software under the copyrights without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ * The name and trademarks of copyright holder(s) may NOT be used in
+ * advertising or publicity pertaining to the Software or any
+ * derivatives without specific, written prior permission.
+ */
+
+
+#ifndef FABRIC_H
+#define FABRIC_H 1
+
+/* A MAC location table shared by the learning switches of one controller.
+ *
+ * When a switch learns where a MAC address is, the fabric remembers that
+ * switch as the address's home and tells the other switches about it.  Each
+ * switch in turn learns which of its ports leads toward each other switch,
+ * from the addresses homed elsewhere that arrive on it, and installs flows
+ * toward the other switches' addresses through that port ahead of any
+ * traffic, so that only the first switch on a path sees a packet_in for a
+ * new destination.
+ *
+ * The fabric may be shared by switches run by different threads.  Each
+ * member is run by one thread, which must be the one that runs its learning
+ * switch. */
+
+struct fabric;
+struct fabric_member;
+struct lswitch;
+struct rconn;
+
+struct fabric *fabric_create(void);
+
+struct fabric_member *fabric_join(struct fabric *, struct lswitch *,
+                                  int wakeup_fd);
+void fabric_leave(struct fabric_member *);
+void fabric_run(struct fabric_member *, struct rconn *);
+void fabric_wait(struct fabric_member *);
+
+#endif /* fabric.h */
@@ -20,7 +20,8 @@ ofdatapath_sources = \
 	forward.c \
 	private-msg.c \
 	table-hash.c \
-	table-linear.c
+	table-linear.c \
+	table-tss.c
 
 ofdatapath_headers = \
 	chain.h \
@@ -28,6 +29,7 @@ ofdatapath_headers = \
 	crc32.h \
 	datapath.h \
 	dp_dev.h \
+	dp_trace.h \
 	flow.h \
 	forward.h \
 	dp_act.h \
@@ -9,6 +9,7 @@
 #include "flow.h"
 #include "table.h"
 #include <linux/module.h>
+#include <linux/percpu.h>
 #include <linux/rcupdate.h>
 #include <linux/slab.h>
 #include <linux/spinlock.h>
@@ -45,6 +46,9 @@ struct sw_chain *chain_create(struct datapath *dp)
 	if (chain == NULL)
 		goto error;
 	chain->dp = dp;
+	chain->counters = alloc_percpu(struct sw_chain_counters);
+	if (chain->counters == NULL)
+		goto error;
 	chain->owner = try_module_get(hw_table_owner) ? hw_table_owner : NULL;
 	if (chain->owner && create_hw_table_hook) {
 		struct sw_table *hwtable = create_hw_table_hook();
@@ -55,7 +59,7 @@ struct sw_chain *chain_create(struct datapath *dp)
 	if (add_table(chain, table_hash2_create(0x1EDC6F41, TABLE_HASH_MAX_FLOWS,
 						0x741B8CD7, TABLE_HASH_MAX_FLOWS),
 		      0)
-	    || add_table(chain, table_linear_create(TABLE_LINEAR_MAX_FLOWS), 0)
+	    || add_table(chain, table_tss_create(TABLE_TSS_MAX_FLOWS), 0)
 	    || add_table(chain, table_linear_create(TABLE_LINEAR_MAX_FLOWS), 1))
 		goto error;
 	return chain;
@@ -69,33 +73,56 @@ error:
 /* Searches 'chain' for a flow matching 'key', which must not have any wildcard
  * fields.  Returns the flow if successful, otherwise a null pointer.
  *
+ * The lookup is counted in this CPU's copy of the chain's counters.  Like the
+ * shared counters they replace, these are not updated atomically, so a lookup
+ * from process context that a softirq interrupts may go uncounted.
+ *
  * Caller must hold rcu_read_lock or dp_mutex. */
 struct sw_flow *chain_lookup(struct sw_chain *chain,
 			     const struct sw_flow_key *key, int emerg)
 {
+	struct sw_chain_counters *counters;
+	struct sw_flow *flow = NULL;
 	int i;
 
 	BUG_ON(key->wildcards);
+	counters = per_cpu_ptr(chain->counters, get_cpu());
 	if (emerg) {
 		struct sw_table *t = chain->emerg_table;
-		struct sw_flow *flow = t->lookup(t, key);
-		t->n_lookup++;
-		if (flow) {
-			t->n_matched++;
-			return flow;
-		}
+		flow = t->lookup(t, key);
+		counters->n_lookup[CHAIN_MAX_TABLES]++;
+		if (flow)
+			counters->n_matched[CHAIN_MAX_TABLES]++;
 	} else {
 		for (i = 0; i < chain->n_tables; i++) {
 			struct sw_table *t = chain->tables[i];
-			struct sw_flow *flow = t->lookup(t, key);
-			t->n_lookup++;
+			flow = t->lookup(t, key);
+			counters->n_lookup[i]++;
 			if (flow) {
-				t->n_matched++;
-				return flow;
+				counters->n_matched[i]++;
+				break;
 			}
 		}
 	}
-	return NULL;
+	put_cpu();
+	return flow;
+}
+
+/* Adds the lookups counted by chain_lookup() for the table with index
+ * 'table_idx' in 'chain' (or CHAIN_MAX_TABLES for the emergency table),
+ * summed over all CPUs, to '*n_lookup' and '*n_matched'. */
+void chain_get_lookup_counts(struct sw_chain *chain, int table_idx,
+			     unsigned long int *n_lookup,
+			     unsigned long int *n_matched)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		const struct sw_chain_counters *counters
+			= per_cpu_ptr(chain->counters, cpu);
+		*n_lookup += counters->n_lookup[table_idx];
+		*n_matched += counters->n_matched[table_idx];
+	}
 }
 
 /* Inserts 'flow' into 'chain', replacing any duplicate flow.  Returns 0 if
@@ -205,11 +232,28 @@ int chain_delete(struct sw_chain *chain, const struct sw_flow_key *key,
 	return count;
 }
 
+/* Returns the number of flows in 'chain''s working tables. */
+unsigned int chain_n_flows(struct sw_chain *chain)
+{
+	unsigned int n_flows = 0;
+	int i;
+
+	for (i = 0; i < chain->n_tables; i++) {
+		struct sw_table *t = chain->tables[i];
+		struct sw_table_stats stats;
+
+		t->stats(t, &stats);
+		n_flows += stats.n_flows;
+	}
+	return n_flows;
+}
+
 /* Performs timeout processing on all the tables in 'chain'.  Returns the
  * number of flow entries deleted through expiration.
  *
- * Expensive as currently implemented, since it iterates through the entire
- * contents of each table.
+ * Hash tables keep their flows on a timer wheel and only look at the flows
+ * that may have expired.  The linear table, which is small, still iterates
+ * through all of its contents.
  *
  * Caller must not hold dp_mutex, because individual tables take and release it
  * as necessary. */
@@ -239,9 +283,10 @@ void chain_destroy(struct sw_chain *chain)
 			t->destroy(t);
 	}
 	t = chain->emerg_table;
-	if (t->destroy)
+	if (t && t->destroy)
 		t->destroy(t);
 	module_put(chain->owner);
+	free_percpu(chain->counters);
 	kfree(chain);
 }
 
@@ -10,14 +10,29 @@ struct datapath;
 
 
 #define TABLE_LINEAR_MAX_FLOWS  100
-#define TABLE_HASH_MAX_FLOWS	65536
+#define TABLE_TSS_MAX_FLOWS     65536
+
+/* Most buckets in each of the hash tables.  The tables start out small and
+ * grow and shrink with the number of flows, so this only bounds memory. */
+#define TABLE_HASH_MAX_FLOWS	1048576
 
 /* Set of tables chained together in sequence from cheap to expensive. */
 #define CHAIN_MAX_TABLES 4
+
+/* Lookup counters for the tables in a chain, indexed like 'tables' in struct
+ * sw_chain with the emergency table at index CHAIN_MAX_TABLES.  Each CPU has
+ * its own copy, so that CPUs forwarding packets in parallel do not bounce
+ * shared cache lines for every lookup. */
+struct sw_chain_counters {
+	uint64_t n_lookup[CHAIN_MAX_TABLES + 1];
+	uint64_t n_matched[CHAIN_MAX_TABLES + 1];
+};
+
 struct sw_chain {
 	int n_tables;
 	struct sw_table *tables[CHAIN_MAX_TABLES];
 	struct sw_table *emerg_table;
+	struct sw_chain_counters *counters; /* Per-CPU. */
 
 	struct datapath *dp;
 	struct module *owner;
@@ -26,6 +41,9 @@ struct sw_chain {
 struct sw_chain *chain_create(struct datapath *);
 struct sw_flow *chain_lookup(struct sw_chain *, const struct sw_flow_key *,
 			     int);
+void chain_get_lookup_counts(struct sw_chain *, int table_idx,
+			     unsigned long int *n_lookup,
+			     unsigned long int *n_matched);
 int chain_insert(struct sw_chain *, struct sw_flow *, int);
 int chain_modify(struct sw_chain *, const struct sw_flow_key *,
 		 uint16_t, int, const struct ofp_action_header *, size_t, int);
@@ -33,6 +51,7 @@ int chain_has_conflict(struct sw_chain *, const struct sw_flow_key *,
 		       uint16_t, int);
 int chain_delete(struct sw_chain *, const struct sw_flow_key *, uint16_t,
 		 uint16_t, int, int);
+unsigned int chain_n_flows(struct sw_chain *);
 int chain_timeout(struct sw_chain *);
 void chain_destroy(struct sw_chain *);
 
@@ -37,6 +37,7 @@
 #include <linux/dmi.h>
 
 #include "openflow/nicira-ext.h"
+#include "openflow/openflow-ext.h"
 #include "openflow/openflow-netlink.h"
 #include "datapath.h"
 #include "table.h"
@@ -44,9 +45,13 @@
 #include "dp_dev.h"
 #include "forward.h"
 #include "flow.h"
+#include "openflow-ext.h"
 
 #include "compat.h"
 
+#define CREATE_TRACE_POINTS
+#include "dp_trace.h"
+
 /* Strings to describe the manufacturer, hardware, and software.  This data
  * is queriable through the switch description stats message. */
 static char mfr_desc[DESC_STR_LEN] = "Stanford University";
@@ -59,6 +64,13 @@ module_param_string(hw_desc, hw_desc, sizeof hw_desc, 0444);
 module_param_string(sw_desc, sw_desc, sizeof sw_desc, 0444);
 module_param_string(serial_num, serial_num, sizeof serial_num, 0444);
 
+/* Packet-ins per second that may be sent for each reason on behalf of each
+ * port, or 0 for no limit, and how many may be sent at once. */
+static unsigned int pin_rate;
+static unsigned int pin_burst = 1;
+module_param(pin_rate, uint, 0644);
+module_param(pin_burst, uint, 0644);
+
 int (*dp_ioctl_hook)(struct net_device *dev, struct ifreq *rq, int cmd);
 EXPORT_SYMBOL(dp_ioctl_hook);
 
@@ -193,6 +205,48 @@ resize_openflow_skb(struct sk_buff *skb,
 	nlmsg_end(skb, (struct nlmsghdr *)skb->data);
 }
 
+/* Appends 'payload' to OpenFlow message 'oh', which must be at the tail end of
+ * 'skb', without copying its data: 'payload' is chained onto 'skb''s
+ * frag_list, followed if necessary by a few bytes of zero padding to keep the
+ * Netlink attribute aligned.  Takes ownership of 'payload' on success.
+ *
+ * Returns 0 if successful, otherwise a negative errno value. */
+static int
+append_openflow_payload(struct sk_buff *skb, struct ofp_header *oh,
+						struct sk_buff *payload)
+{
+	struct nlattr *attr = ((void *)oh) - NLA_HDRLEN;
+	size_t old_len = ntohs(oh->length);
+	size_t new_len = old_len + payload->len;
+	size_t pad = NLA_ALIGN(new_len) - new_len;
+	struct sk_buff *pad_skb = NULL;
+
+	if (new_len > UINT16_MAX || skb_shinfo(skb)->frag_list)
+		return -EMSGSIZE;
+	if (pad)
+	{
+		pad_skb = alloc_skb(NLA_ALIGNTO, GFP_ATOMIC);
+		if (!pad_skb)
+			return -ENOMEM;
+		memset(skb_put(pad_skb, pad), 0, pad);
+	}
+
+	/* Drop the attribute padding after 'oh' so that the payload follows
+	 * it directly. */
+	skb_trim(skb, skb->len - (NLA_ALIGN(old_len) - old_len));
+
+	payload->next = pad_skb;
+	skb_shinfo(skb)->frag_list = payload;
+	skb->len += payload->len + pad;
+	skb->data_len += payload->len + pad;
+	skb->truesize += payload->truesize + (pad_skb ? pad_skb->truesize : 0);
+
+	attr->nla_len = nla_attr_size(new_len);
+	oh->length = htons(new_len);
+	((struct nlmsghdr *)skb->data)->nlmsg_len = skb->len;
+	return 0;
+}
+
 /* Allocates a new skb to contain an OpenFlow message 'openflow_len' bytes in
  * length.  Returns a null pointer if memory is unavailable, otherwise returns
  * the OpenFlow header and stores a pointer to the skb in '*pskb'.
@@ -252,6 +306,34 @@ send_openflow_skb(const struct datapath *dp,
 				: genlmsg_multicast(skb, 0, dp_mc_group(dp), GFP_ATOMIC));
 }
 
+/* Sends packet-in 'skb' to the upcall socket that 'dp' has registered for the
+ * current CPU, or multicasts it to all listeners if there is none. */
+static int
+send_packet_in_skb(struct datapath *dp, struct sk_buff *skb)
+{
+	struct dp_upcall_pids *up;
+	u32 pid = 0;
+	int err;
+
+	rcu_read_lock();
+	up = rcu_dereference(dp->upcall_pids);
+	if (up && !atomic_read(&up->dead))
+		pid = up->pids[raw_smp_processor_id() % up->n_pids];
+	if (!pid)
+	{
+		rcu_read_unlock();
+		return send_openflow_skb(dp, skb, NULL);
+	}
+
+	/* If the process that registered the socket has exited, go back to
+	 * multicasting rather than losing every later packet-in. */
+	err = genlmsg_unicast(skb, pid);
+	if (err == -ECONNREFUSED)
+		atomic_set(&up->dead, 1);
+	rcu_read_unlock();
+	return err;
+}
+
 /* Retrieves the datapath id, which is the MAC address of the "of" device. */
 static uint64_t get_datapath_id(struct net_device *dev)
 {
@@ -337,6 +419,7 @@ static int new_dp(int dp_idx, const char *dp_name)
 
 	dp->flags = 0;
 	dp->miss_send_len = OFP_DEFAULT_MISS_SEND_LEN;
+	dp->proc_start = jiffies;
 
 	dp->dp_task = kthread_run(dp_maint_func, dp, "dp%d", dp_idx);
 	if (IS_ERR(dp->dp_task))
@@ -367,6 +450,47 @@ err_unlock:
 	return err;
 }
 
+static void free_port_set_rcu(struct rcu_head *rcu)
+{
+	kfree(container_of(rcu, struct dp_port_set, rcu));
+}
+
+/* Rebuilds 'dp''s sets of ports for OFPP_ALL and OFPP_FLOOD from its port
+ * list and the ports' configuration.  Ports with OFPPC_NO_FWD are left out
+ * of both, as dp_output_port() would drop what they are sent.  If memory
+ * runs out, a set is left NULL and output_all() walks the port list.
+ * Called with dp_mutex. */
+static void update_fanout(struct datapath *dp)
+{
+	struct net_bridge_port *p;
+	unsigned int n_ports = 0;
+	int flood;
+
+	list_for_each_entry(p, &dp->port_list, node)
+		n_ports++;
+
+	for (flood = 0; flood < 2; flood++)
+	{
+		u32 disable = OFPPC_NO_FWD | (flood ? OFPPC_NO_FLOOD : 0);
+		struct dp_port_set *new, *old;
+
+		new = kmalloc(sizeof *new + n_ports * sizeof *new->ports,
+					  GFP_KERNEL);
+		if (new)
+		{
+			new->n_ports = 0;
+			list_for_each_entry(p, &dp->port_list, node)
+				if (!(p->config & disable))
+					new->ports[new->n_ports++] = p;
+		}
+
+		old = dp->fanout[flood];
+		rcu_assign_pointer(dp->fanout[flood], new);
+		if (old)
+			call_rcu(&old->rcu, free_port_set_rcu);
+	}
+}
+
 /* Find and return a free port number under 'dp'. */
 static int find_portno(struct datapath *dp)
 {
@@ -401,6 +525,7 @@ static struct net_bridge_port *new_nbp(struct datapath *dp,
 	if (port_no < DP_MAX_PORTS)
 		rcu_assign_pointer(dp->ports[port_no], p);
 	list_add_rcu(&p->node, &dp->port_list);
+	update_fanout(dp);
 
 	return p;
 }
@@ -449,6 +574,7 @@ int dp_del_switch_port(struct net_bridge_port *p)
 	if (p->port_no != OFPP_LOCAL)
 		rcu_assign_pointer(p->dp->ports[p->port_no], NULL);
 	rcu_assign_pointer(p->dev->br_port, NULL);
+	update_fanout(p->dp);
 
 	/* Then wait until no one is still using it, and destroy it. */
 	synchronize_rcu();
@@ -497,6 +623,9 @@ static void del_dp(struct datapath *dp)
 	/* Wait until no longer in use, then destroy it. */
 	synchronize_rcu();
 	chain_destroy(dp->chain);
+	kfree(dp->upcall_pids);
+	kfree(dp->fanout[0]);
+	kfree(dp->fanout[1]);
 	kfree(dp);
 	module_put(THIS_MODULE);
 }
@@ -509,7 +638,7 @@ static int dp_maint_func(void *data)
 	while (!signal_pending(current))
 	{
 		/* Timeout old entries */
-		chain_timeout(dp->chain);
+		trace_ofdp_chain_timeout(chain_timeout(dp->chain));
 		msleep_interruptible(MAINT_SLEEP_MSECS);
 	}
 	while (!kthread_should_stop())
@@ -531,7 +660,10 @@ do_port_input(struct net_bridge_port *p, struct sk_buff *skb)
 	if (!skb)
 		return;
 
-	/* Push the Ethernet header back on. */
+	/* Push the Ethernet header back on.  If the device does GRO, 'skb'
+	 * may be an aggregate of several TCP segments; it is looked up and
+	 * forwarded as one packet, and execute_actions() only splits it up
+	 * if its actions require that. */
 	skb_push(skb, ETH_HLEN);
 	skb_reset_mac_header(skb);
 	fwd_port_input(p->dp->chain, skb, p);
@@ -568,19 +700,95 @@ static inline unsigned packet_length(const struct sk_buff *skb)
 	return length;
 }
 
+/* Transmits 'skb' on 'p' for output_all(), as dp_output_port() would for
+ * 'p''s port number, without the checks that update_fanout() has already
+ * made. */
+static void fanout_xmit(struct datapath *dp, struct sk_buff *skb,
+						struct net_bridge_port *p)
+{
+	if (p->port_no == OFPP_LOCAL)
+		dp_dev_recv(dp->netdev, skb);
+	else
+	{
+		skb->dev = p->dev;
+		dp_xmit_skb(skb);
+	}
+}
+
 /* Send packets out all the ports except the originating one.  If the
  * "flood" argument is set, only send along the minimum spanning tree.
+ *
+ * Each port but the last gets a clone, since transmitting consumes the skb
+ * and changes its device.  The clones are all made before any is sent, so
+ * that an allocation failure drops the packet on every port instead of on
+ * the ports that happen to come last, and so that the transmit loop runs
+ * without interruption.
  */
 static int
 output_all(struct datapath *dp, struct sk_buff *skb, int flood)
 {
 	u32 disable = flood ? OFPPC_NO_FLOOD : 0;
+	struct net_device *in_dev = skb->dev;
+	struct dp_port_set *set;
 	struct net_bridge_port *p;
 	int prev_port = -1;
 
+	set = rcu_dereference(dp->fanout[flood != 0]);
+	if (set)
+	{
+		struct sk_buff *clones = NULL, *clone;
+		unsigned int i, n = 0;
+
+		for (i = 0; i < set->n_ports; i++)
+			if (set->ports[i]->dev != in_dev)
+				n++;
+		if (!n)
+		{
+			kfree_skb(skb);
+			return 0;
+		}
+
+		/* The clones wait in a list linked through 'next'. */
+		while (--n > 0)
+		{
+			clone = skb_clone(skb, GFP_ATOMIC);
+			if (!clone)
+			{
+				while (clones)
+				{
+					clone = clones;
+					clones = clone->next;
+					clone->next = NULL;
+					kfree_skb(clone);
+				}
+				kfree_skb(skb);
+				return -ENOMEM;
+			}
+			clone->next = clones;
+			clones = clone;
+		}
+
+		for (i = 0; i < set->n_ports; i++)
+		{
+			p = set->ports[i];
+			if (p->dev == in_dev)
+				continue;
+			if (clones)
+			{
+				clone = clones;
+				clones = clone->next;
+				clone->next = NULL;
+			}
+			else
+				clone = skb;
+			fanout_xmit(dp, clone, p);
+		}
+		return 0;
+	}
+
 	list_for_each_entry_rcu(p, &dp->port_list, node)
 	{
-		if (skb->dev == p->dev || p->config & disable)
+		if (in_dev == p->dev || p->config & disable)
 			continue;
 		if (prev_port != -1)
 		{
@@ -717,15 +925,44 @@ bad_port:
 	return -ENOENT;
 }
 
+/* Returns true if a packet-in for 'reason' may be sent on behalf of 'p',
+ * taking a token from its meter for 'reason', or false if the meter is
+ * empty. */
+static bool pin_meter_admit(struct net_bridge_port *p, int reason)
+{
+	struct pin_meter *m = &p->pin_meters[reason == OFPR_ACTION];
+	unsigned int rate = pin_rate;
+	u64 depth = (u64)max(pin_burst, 1U) * HZ;
+	unsigned long now = jiffies;
+	unsigned long flags;
+	bool ok;
+
+	if (!rate)
+		return true;
+
+	/* A meter that has never been used has a 'last_fill' of 0, which is
+	 * long enough ago to fill it. */
+	spin_lock_irqsave(&p->lock, flags);
+	m->tokens = min(m->tokens + (u64)min(now - m->last_fill, 3600UL * HZ)
+			* rate, depth);
+	m->last_fill = now;
+	ok = m->tokens >= HZ;
+	if (ok)
+		m->tokens -= HZ;
+	spin_unlock_irqrestore(&p->lock, flags);
+	return ok;
+}
+
 /* Takes ownership of 'skb' and transmits it to 'dp''s control path.  'reason'
  * indicates why 'skb' is being sent. 'max_len' sets the maximum number of
- * bytes that the caller wants to be sent.
+ * bytes that the caller wants to be sent.  If the packet-in is above the
+ * 'pin_rate' for its input port and 'reason', it is dropped before the
+ * packet is buffered.
  */
 int dp_output_control(struct datapath *dp, struct sk_buff *skb,
 					  size_t max_len, int reason)
 {
-	/* FIXME?  Can we avoid creating a new skbuff in the case where we
-	 * forward the whole packet? */
+	struct net_bridge_port *p;
 	struct sk_buff *f_skb;
 	struct ofp_packet_in *opi;
 	size_t fwd_len, opi_len;
@@ -734,13 +971,25 @@ int dp_output_control(struct datapath *dp, struct sk_buff *skb,
 
 	WARN_ON_ONCE(skb_shared(skb));
 
+	p = skb->dev && skb->dev->br_port ? skb->dev->br_port : dp->local_port;
+	if (p && !pin_meter_admit(p, reason)) {
+		err = -ENOBUFS;
+		goto out;
+	}
+
 	buffer_id = fwd_save_skb(skb);
+	trace_ofdp_output_control(skb->dev && skb->dev->br_port
+				  ? skb->dev->br_port->port_no : OFPP_LOCAL,
+				  skb, reason, buffer_id);
 
 	fwd_len = skb->len;
 	if (buffer_id != (uint32_t)-1)
 		fwd_len = min(fwd_len, max_len);
 
-	opi_len = offsetof(struct ofp_packet_in, data) + fwd_len;
+	/* Only the headers go in the new skb.  The packet itself, which we
+	 * own, is trimmed to 'fwd_len' and chained on as the payload, so a
+	 * flow table miss costs no copies of the packet data. */
+	opi_len = offsetof(struct ofp_packet_in, data);
 	opi = alloc_openflow_skb(dp, opi_len, OFPT_PACKET_IN, NULL, &f_skb);
 	if (!opi)
 	{
@@ -754,8 +1003,17 @@ int dp_output_control(struct datapath *dp, struct sk_buff *skb,
 							 : OFPP_LOCAL);
 	opi->reason = reason;
 	opi->pad = 0;
-	skb_copy_bits(skb, 0, opi->data, fwd_len);
-	err = send_openflow_skb(dp, f_skb, NULL);
+
+	err = pskb_trim(skb, fwd_len);
+	if (!err)
+		err = append_openflow_payload(f_skb, &opi->header, skb);
+	if (err)
+	{
+		kfree_skb(f_skb);
+		goto out;
+	}
+	skb = NULL;
+	err = send_packet_in_skb(dp, f_skb);
 
 out:
 	kfree_skb(skb);
@@ -970,6 +1228,85 @@ int dp_send_barrier_reply(struct datapath *dp, const struct sender *sender,
 	return send_openflow_skb(dp, skb, sender);
 }
 
+/* Returns the nanoseconds since 'start'. */
+static u64 proc_nsec(ktime_t start)
+{
+	return ktime_to_ns(ktime_sub(ktime_get(), start));
+}
+
+/* Returns 0 if 'n' is 0, otherwise 1 plus the base-2 log of 'n', rounded
+ * down, but no more than 'max'. */
+static int proc_bucket(u64 n, int max)
+{
+	return min(fls64(n), max);
+}
+
+/* Counts a message of OFPT_* 'type' whose processing began at 'start'. */
+void dp_proc_record(struct datapath *dp, uint8_t type, ktime_t start)
+{
+	u64 nsec = proc_nsec(start);
+	u64 usec = nsec;
+	struct private_proc_type *t;
+
+	if (type >= PRIVATE_PROC_N_TYPES)
+		return;
+	t = &dp->proc_stats.types[type];
+	t->n_msgs++;
+	t->total_nsec += nsec;
+	if (nsec > t->max_nsec)
+		t->max_nsec = nsec;
+	do_div(usec, 1000);
+	t->buckets[proc_bucket(usec, PRIVATE_PROC_BUCKETS - 1)]++;
+}
+
+/* Counts a flow addition, if 'add' is nonzero, or modification, that began
+ * at 'start' when the flow tables held 'n_flows' flows. */
+void dp_proc_record_flow(struct datapath *dp, int add, unsigned int n_flows,
+			 ktime_t start)
+{
+	u64 nsec = proc_nsec(start);
+	struct private_proc_size *size;
+
+	size = &dp->proc_stats.sizes[proc_bucket(n_flows,
+						 PRIVATE_PROC_SIZES - 1)];
+	if (add) {
+		size->n_adds++;
+		size->add_nsec += nsec;
+	} else {
+		size->n_mods++;
+		size->mod_nsec += nsec;
+	}
+}
+
+/* Sends 'dp''s message processing statistics to 'sender' in reply to a
+ * PRIVATEOPT_PROCESSING_STATS_REQUEST. */
+int dp_send_processing_stats(struct datapath *dp, const struct sender *sender)
+{
+	const u64 *src = (const u64 *) &dp->proc_stats;
+	struct private_proc_stats *pps;
+	struct private_vxhdr *vxhdr;
+	struct private_vxopt *vxopt;
+	struct sk_buff *skb;
+	u64 *dst;
+	size_t i;
+
+	vxhdr = alloc_openflow_skb(dp, sizeof *vxhdr + sizeof *vxopt
+				   + sizeof *pps, OFPT_VENDOR, sender, &skb);
+	if (!vxhdr)
+		return -ENOMEM;
+	vxhdr->ofp_vxid = htonl(PRIVATE_VENDOR_ID);
+	vxopt = (struct private_vxopt *) (vxhdr + 1);
+	vxopt->pvo_type = htons(PRIVATEOPT_PROCESSING_STATS_REPLY);
+	vxopt->pvo_len = htons(sizeof *pps);
+	pps = (struct private_proc_stats *) (vxopt + 1);
+	dst = (u64 *) pps;
+	for (i = 0; i < sizeof *pps / sizeof *dst; i++)
+		dst[i] = cpu_to_be64(src[i]);
+	pps->duration_msec = cpu_to_be64(jiffies_to_msecs(jiffies
+							  - dp->proc_start));
+	return send_openflow_skb(dp, skb, sender);
+}
+
 int dp_update_port_flags(struct datapath *dp, const struct ofp_port_mod *opm)
 {
 	unsigned long int flags;
@@ -991,6 +1328,7 @@ int dp_update_port_flags(struct datapath *dp, const struct ofp_port_mod *opm)
 		p->config |= ntohl(opm->config) & config_mask;
 	}
 	spin_unlock_irqrestore(&p->lock, flags);
+	update_fanout(dp);
 
 	return 0;
 }
@@ -1054,6 +1392,7 @@ int dp_send_flow_end(struct datapath *dp, struct sw_flow *flow,
 {
 	struct sk_buff *skb;
 	struct ofp_flow_removed *ofr;
+	uint64_t packet_count, byte_count;
 
 	if (!flow->send_flow_rem)
 		return 0;
@@ -1074,8 +1413,9 @@ int dp_send_flow_end(struct datapath *dp, struct sw_flow *flow,
 	ofr->duration_nsec = htonl(jiffies_64_to_nsecs(get_jiffies_64() - flow->created));
 	ofr->idle_timeout = htons(flow->idle_timeout);
 
-	ofr->packet_count = cpu_to_be64(flow->packet_count);
-	ofr->byte_count = cpu_to_be64(flow->byte_count);
+	flow_get_stats(flow, &packet_count, &byte_count);
+	ofr->packet_count = cpu_to_be64(packet_count);
+	ofr->byte_count = cpu_to_be64(byte_count);
 
 	return send_openflow_skb(dp, skb, NULL);
 }
@@ -1360,12 +1700,73 @@ static struct genl_ops dp_genl_ops_del_port = {
 	.dumpit = NULL,
 };
 
+static void free_upcall_pids_rcu(struct rcu_head *rcu)
+{
+	kfree(container_of(rcu, struct dp_upcall_pids, rcu));
+}
+
+/* Directs a datapath's packet-ins to the Netlink sockets whose pids are in
+ * DP_GENL_A_UPCALL_PIDS, so that each CPU's misses can be read from a
+ * separate socket.  An empty or missing attribute restores multicast. */
+static int dp_genl_set_upcall_pids(struct sk_buff *skb, struct genl_info *info)
+{
+	struct nlattr *pids_attr = info->attrs[DP_GENL_A_UPCALL_PIDS];
+	struct dp_upcall_pids *new = NULL, *old;
+	unsigned int n_pids = 0;
+	struct datapath *dp;
+	int err = 0;
+
+	if (pids_attr)
+	{
+		if (nla_len(pids_attr) % sizeof(u32))
+			return -EINVAL;
+		n_pids = nla_len(pids_attr) / sizeof(u32);
+		if (n_pids > DP_MAX_UPCALL_PIDS)
+			return -EINVAL;
+	}
+	if (n_pids)
+	{
+		new = kmalloc(sizeof *new + n_pids * sizeof(u32), GFP_KERNEL);
+		if (!new)
+			return -ENOMEM;
+		atomic_set(&new->dead, 0);
+		new->n_pids = n_pids;
+		memcpy(new->pids, nla_data(pids_attr), n_pids * sizeof(u32));
+	}
+
+	mutex_lock(&dp_mutex);
+	dp = lookup_dp(info);
+	if (IS_ERR(dp))
+	{
+		err = PTR_ERR(dp);
+		mutex_unlock(&dp_mutex);
+		kfree(new);
+		return err;
+	}
+	old = dp->upcall_pids;
+	rcu_assign_pointer(dp->upcall_pids, new);
+	mutex_unlock(&dp_mutex);
+
+	if (old)
+		call_rcu(&old->rcu, free_upcall_pids_rcu);
+	return 0;
+}
+
+static struct genl_ops dp_genl_ops_set_upcall_pids = {
+	.cmd = DP_GENL_C_SET_UPCALL_PIDS,
+	.flags = GENL_ADMIN_PERM, /* Requires CAP_NET_ADMIN privilege. */
+	.policy = dp_genl_policy,
+	.doit = dp_genl_set_upcall_pids,
+	.dumpit = NULL,
+};
+
 static int dp_genl_openflow(struct sk_buff *skb, struct genl_info *info)
 {
 	struct nlattr *va = info->attrs[DP_GENL_A_OPENFLOW];
 	struct datapath *dp;
 	struct ofp_header *oh;
 	struct sender sender;
+	ktime_t start;
 	int err;
 
 	if (!info->attrs[DP_GENL_A_DP_IDX] || !va)
@@ -1382,10 +1783,13 @@ static int dp_genl_openflow(struct sk_buff *skb, struct genl_info *info)
 	sender.xid = oh->xid;
 	sender.pid = info->snd_pid;
 	sender.seq = info->snd_seq;
+	sender.skb = skb;
 
 	mutex_lock(&dp_mutex);
+	start = ktime_get();
 	err = fwd_control_input(dp->chain, &sender,
 							nla_data(va), nla_len(va));
+	dp_proc_record(dp, oh->type, start);
 	mutex_unlock(&dp_mutex);
 	return err;
 }
@@ -1420,6 +1824,7 @@ struct flow_stats_state
 	int table_idx;
 	struct sw_table_position position;
 	const struct ofp_flow_stats_request *rq;
+	struct sw_flow_key match_key;	/* rq->match, extracted once. */
 
 	void *body;
 	int bytes_used, bytes_allocated;
@@ -1437,6 +1842,7 @@ static int flow_stats_init(struct datapath *dp, const void *body, int body_len,
 	s->table_idx = fsr->table_id == 0xff ? 0 : fsr->table_id;
 	memset(&s->position, 0, sizeof s->position);
 	s->rq = fsr;
+	flow_extract_match(&s->match_key, &fsr->match);
 	*state = s;
 	return 0;
 }
@@ -1448,6 +1854,7 @@ static int flow_stats_dump_callback(struct sw_flow *flow, void *private)
 	struct ofp_flow_stats *ofs;
 	int length;
 	uint64_t duration;
+	uint64_t packet_count, byte_count;
 
 	length = sizeof *ofs + sf_acts->actions_len;
 	if (length + s->bytes_used > s->bytes_allocated)
@@ -1483,8 +1890,9 @@ static int flow_stats_dump_callback(struct sw_flow *flow, void *private)
 	ofs->idle_timeout = htons(flow->idle_timeout);
 	ofs->hard_timeout = htons(flow->hard_timeout);
 	memset(&ofs->pad2, 0, sizeof ofs->pad2);
-	ofs->packet_count = cpu_to_be64(flow->packet_count);
-	ofs->byte_count = cpu_to_be64(flow->byte_count);
+	flow_get_stats(flow, &packet_count, &byte_count);
+	ofs->packet_count = cpu_to_be64(packet_count);
+	ofs->byte_count = cpu_to_be64(byte_count);
 	memcpy(ofs->actions, sf_acts->actions, sf_acts->actions_len);
 
 	s->bytes_used += length;
@@ -1495,19 +1903,17 @@ static int flow_stats_dump(struct datapath *dp, void *state,
 						   void *body, int *body_len)
 {
 	struct flow_stats_state *s = state;
-	struct sw_flow_key match_key;
 	int error = 0;
 
 	s->bytes_used = 0;
 	s->bytes_allocated = *body_len;
 	s->body = body;
 
-	flow_extract_match(&match_key, &s->rq->match);
 	if (s->rq->table_id == EMERG_TABLE_ID_FOR_STATS)
 	{
 		struct sw_table *table = dp->chain->emerg_table;
 
-		error = table->iterate(table, &match_key, s->rq->out_port,
+		error = table->iterate(table, &s->match_key, s->rq->out_port,
 							   &s->position, flow_stats_dump_callback,
 							   s);
 	}
@@ -1517,7 +1923,7 @@ static int flow_stats_dump(struct datapath *dp, void *state,
 		{
 			struct sw_table *table = dp->chain->tables[s->table_idx];
 
-			error = table->iterate(table, &match_key,
+			error = table->iterate(table, &s->match_key,
 								   s->rq->out_port, &s->position,
 								   flow_stats_dump_callback, s);
 			if (error)
@@ -1554,18 +1960,50 @@ static int aggregate_stats_init(struct datapath *dp,
 static int aggregate_stats_dump_callback(struct sw_flow *flow, void *private)
 {
 	struct ofp_aggregate_stats_reply *rpy = private;
-	rpy->packet_count += flow->packet_count;
-	rpy->byte_count += flow->byte_count;
+	uint64_t packet_count, byte_count;
+
+	flow_get_stats(flow, &packet_count, &byte_count);
+	rpy->packet_count += packet_count;
+	rpy->byte_count += byte_count;
 	rpy->flow_count++;
 	return 0;
 }
 
+/* Adds the counters of the flows in 'table' that match 'key' and 'out_port'
+ * to 'rpy', with the table's 'aggregate' function if it has one, which may
+ * spread the scan over several CPUs. */
+static int aggregate_table(struct sw_table *table,
+						   const struct sw_flow_key *key, uint16_t out_port,
+						   struct ofp_aggregate_stats_reply *rpy)
+{
+	struct sw_table_position position;
+
+	if (table->aggregate)
+	{
+		struct sw_table_totals totals;
+
+		memset(&totals, 0, sizeof totals);
+		if (mutex_lock_interruptible(&dp_mutex))
+			return -EINTR;
+		table->aggregate(table, key, out_port, &totals);
+		mutex_unlock(&dp_mutex);
+
+		rpy->packet_count += totals.packet_count;
+		rpy->byte_count += totals.byte_count;
+		rpy->flow_count += totals.flow_count;
+		return 0;
+	}
+
+	memset(&position, 0, sizeof position);
+	return table->iterate(table, key, out_port, &position,
+						  aggregate_stats_dump_callback, rpy);
+}
+
 static int aggregate_stats_dump(struct datapath *dp, void *state,
 								void *body, int *body_len)
 {
 	struct ofp_aggregate_stats_request *rq = state;
 	struct ofp_aggregate_stats_reply *rpy;
-	struct sw_table_position position;
 	struct sw_flow_key match_key;
 	int table_idx;
 	int error = 0;
@@ -1579,15 +2017,11 @@ static int aggregate_stats_dump(struct datapath *dp, void *state,
 
 	flow_extract_match(&match_key, &rq->match);
 	table_idx = rq->table_id == 0xff ? 0 : rq->table_id;
-	memset(&position, 0, sizeof position);
 
 	if (rq->table_id == EMERG_TABLE_ID_FOR_STATS)
 	{
-		struct sw_table *table = dp->chain->emerg_table;
-
-		error = table->iterate(table, &match_key, rq->out_port,
-							   &position,
-							   aggregate_stats_dump_callback, rpy);
+		error = aggregate_table(dp->chain->emerg_table, &match_key,
+								rq->out_port, rpy);
 		if (error)
 			return error;
 	}
@@ -1595,17 +2029,12 @@ static int aggregate_stats_dump(struct datapath *dp, void *state,
 	{
 		while (table_idx < dp->chain->n_tables && (rq->table_id == 0xff || rq->table_id == table_idx))
 		{
-			struct sw_table *table = dp->chain->tables[table_idx];
-
-			error = table->iterate(table, &match_key, rq->out_port,
-								   &position,
-								   aggregate_stats_dump_callback,
-								   rpy);
+			error = aggregate_table(dp->chain->tables[table_idx],
+									&match_key, rq->out_port, rpy);
 			if (error)
 				return error;
 
 			table_idx++;
-			memset(&position, 0, sizeof position);
 		}
 	}
 
@@ -1628,6 +2057,8 @@ static int table_stats_dump(struct datapath *dp, void *state,
 	{
 		struct sw_table_stats stats;
 		dp->chain->tables[i]->stats(dp->chain->tables[i], &stats);
+		chain_get_lookup_counts(dp->chain, i, &stats.n_lookup,
+					&stats.n_matched);
 		strncpy(ots->name, stats.name, sizeof ots->name);
 		ots->table_id = i;
 		ots->wildcards = htonl(stats.wildcards);
@@ -1772,6 +2203,9 @@ static int vendor_stats_init(struct datapath *dp, const void *body,
 
 	switch (vendor)
 	{
+	case OPENFLOW_VENDOR_ID:
+		err = openflow_ext_stats_init(dp, body, body_len, state);
+		break;
 	default:
 		err = -EINVAL;
 	}
@@ -1787,6 +2221,9 @@ static int vendor_stats_dump(struct datapath *dp, void *state, void *body,
 
 	switch (vendor)
 	{
+	case OPENFLOW_VENDOR_ID:
+		newbuf = openflow_ext_stats_dump(dp, state, body, body_len);
+		break;
 	default:
 		/* Should never happen */
 		newbuf = 0;
@@ -1801,6 +2238,9 @@ static void vendor_stats_done(void *state)
 
 	switch (vendor)
 	{
+	case OPENFLOW_VENDOR_ID:
+		openflow_ext_stats_done(state);
+		break;
 	default:
 		/* Should never happen */
 		kfree(state);
@@ -1875,6 +2315,7 @@ dp_genl_openflow_dumpit(struct sk_buff *skb, struct netlink_callback *cb)
 
 	sender.pid = NETLINK_CB(cb->skb).pid;
 	sender.seq = cb->nlh->nlmsg_seq;
+	sender.skb = NULL;
 	if (!cb->args[0])
 	{
 		struct nlattr *attrs[DP_GENL_A_MAX + 1];
@@ -2033,6 +2474,7 @@ static struct genl_ops *dp_genl_all_ops[] = {
 	&dp_genl_ops_query_dp,
 	&dp_genl_ops_add_port,
 	&dp_genl_ops_del_port,
+	&dp_genl_ops_set_upcall_pids,
 };
 
 static int dp_init_netlink(void)
@@ -2116,6 +2558,8 @@ static int __init dp_init(void)
 		   "protocol 0x%02x\n",
 		   VERSION BUILDNR, OFP_VERSION);
 
+	fwd_init();
+
 	err = flow_init();
 	if (err)
 		goto error;
@@ -4,6 +4,7 @@
 #define DATAPATH_H 1
 
 #include <linux/kernel.h>
+#include <linux/ktime.h>
 #include <linux/mutex.h>
 #include <linux/netlink.h>
 #include <linux/netdevice.h>
@@ -11,6 +12,7 @@
 #include <linux/skbuff.h>
 #include "openflow/openflow.h"
 #include "openflow/nicira-ext.h"
+#include "openflow/private-ext.h"
 #include "flow.h"
 
 
@@ -58,6 +60,37 @@ struct datapath {
 	struct net_bridge_port *ports[DP_MAX_PORTS];
 	struct net_bridge_port *local_port; /* OFPP_LOCAL port. */
 	struct list_head port_list; /* All ports, including local_port. */
+
+	/* Unicast sockets for packet-ins, or NULL to multicast them. */
+	struct dp_upcall_pids *upcall_pids;
+
+	/* Ports that OFPP_ALL ([0]) and OFPP_FLOOD ([1]) output to, or NULL
+	 * to walk 'port_list' instead. */
+	struct dp_port_set *fanout[2];
+
+	/* Time spent processing OpenFlow messages, in host byte order, for
+	 * PRIVATEOPT_PROCESSING_STATS_REQUEST.  Protected by dp_mutex. */
+	struct private_proc_stats proc_stats;
+	unsigned long proc_start;	/* 'jiffies' when counting began. */
+};
+
+/* Netlink pids that receive a datapath's packet-ins, chosen by the CPU that
+ * handles each packet.  Replaced under dp_mutex, read under RCU. */
+struct dp_upcall_pids {
+	struct rcu_head rcu;
+	atomic_t dead;		/* Set once a pid's socket has gone away. */
+	unsigned int n_pids;
+	u32 pids[];
+};
+
+/* A datapath's ports that a packet output to OFPP_ALL or OFPP_FLOOD goes
+ * to, so that fanning a packet out needs no walk of the port list and no
+ * test of each port's configuration.  Rebuilt under dp_mutex whenever a port
+ * is added or deleted or its configuration changes, read under RCU. */
+struct dp_port_set {
+	struct rcu_head rcu;
+	unsigned int n_ports;
+	struct net_bridge_port *ports[];
 };
 
 /* Information necessary to reply to the sender of an OpenFlow message. */
@@ -65,6 +98,15 @@ struct sender {
 	uint32_t xid;		/* OpenFlow transaction ID of request. */
 	uint32_t pid;		/* Netlink process ID of sending socket. */
 	uint32_t seq;		/* Netlink sequence ID of request. */
+	struct sk_buff *skb;	/* Netlink message that carried the request,
+				 * or NULL. */
+};
+
+/* Token bucket that limits the packet-ins sent for one reason on behalf of
+ * one port, if the 'pin_rate' module parameter is set. */
+struct pin_meter {
+	unsigned long last_fill;	/* 'jiffies' when tokens were last added. */
+	u64 tokens;			/* HZ per packet-in. */
 };
 
 struct net_bridge_port {
@@ -72,6 +114,8 @@ struct net_bridge_port {
 	u32 config;		/* Some subset of OFPPC_* flags. */
 	u32 state;		/* Some subset of OFPPS_* flags. */
 	spinlock_t lock;
+	struct pin_meter pin_meters[2]; /* By OFPR_NO_MATCH, OFPR_ACTION.
+					 * Protected by 'lock'. */
 	struct datapath	*dp;
 	struct net_device *dev;
 	struct kobject kobj;
@@ -106,6 +150,10 @@ int dp_send_hello(struct datapath *, const struct sender *,
 		  const struct ofp_header *);
 int dp_send_barrier_reply(struct datapath *, const struct sender *,
 			  const struct ofp_header *);
+int dp_send_processing_stats(struct datapath *, const struct sender *);
+void dp_proc_record(struct datapath *, uint8_t type, ktime_t start);
+void dp_proc_record_flow(struct datapath *, int add, unsigned int n_flows,
+			 ktime_t start);
 
 /* Should hold at least RCU read lock when calling */
 struct datapath *dp_get_by_idx(int dp_idx);
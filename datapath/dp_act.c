@@ -6,7 +6,9 @@
 
 /* Functions for executing OpenFlow actions. */
 
+#include <linux/err.h>
 #include <linux/skbuff.h>
+#include <linux/netdevice.h>
 #include <linux/in.h>
 #include <linux/ip.h>
 #include <linux/tcp.h>
@@ -461,6 +463,82 @@ execute_vendor(struct sk_buff *skb, const struct sw_flow_key *key,
 }
 
 /* Execute a list of actions against 'skb'. */
+/* Returns nonzero if 'actions' can be applied to GSO packet 'skb' as a
+ * whole, so that it can be output without being split into segments first.
+ * Rewriting Ethernet addresses always works, since segmentation copies the
+ * headers into every segment.  Rewriting IP addresses, ToS and ports works
+ * too, as long as the TCP or UDP checksum is still left to be filled in per
+ * segment: the IP header checksum is recomputed for every segment anyway.
+ * Adding or removing a VLAN header moves the network header, which
+ * segmentation in older kernels does not cope with, and vendor actions are
+ * unknown quantities. */
+static int
+gso_actions_ok(const struct sk_buff *skb,
+	       const struct ofp_action_header *actions, size_t actions_len)
+{
+	const uint8_t *p = (const uint8_t *)actions;
+
+	while (actions_len > 0) {
+		const struct ofp_action_header *ah;
+		size_t len;
+
+		ah = (const struct ofp_action_header *)p;
+		len = ntohs(ah->len);
+		switch (ntohs(ah->type)) {
+		case OFPAT_OUTPUT:
+		case OFPAT_SET_DL_SRC:
+		case OFPAT_SET_DL_DST:
+			break;
+
+		case OFPAT_SET_NW_SRC:
+		case OFPAT_SET_NW_DST:
+		case OFPAT_SET_NW_TOS:
+		case OFPAT_SET_TP_SRC:
+		case OFPAT_SET_TP_DST:
+			if (skb->ip_summed != CHECKSUM_PARTIAL)
+				return 0;
+			break;
+
+		default:
+			return 0;
+		}
+		p += len;
+		actions_len -= len;
+	}
+	return 1;
+}
+
+/* Splits GSO packet 'skb' into segments in software and executes 'actions'
+ * on each of them in turn.  Consumes 'skb'. */
+static void
+execute_actions_segmented(struct datapath *dp, struct sk_buff *skb,
+			  const struct sw_flow_key *key,
+			  const struct ofp_action_header *actions,
+			  size_t actions_len, int ignore_no_fwd)
+{
+	struct sk_buff *segs;
+
+	segs = skb_gso_segment(skb, 0);
+	kfree_skb(skb);
+	if (IS_ERR(segs) || !segs) {
+		if (net_ratelimit())
+			printk(KERN_WARNING "%s: failed to segment GSO packet "
+			       "(%ld)\n", dp->netdev->name,
+			       IS_ERR(segs) ? PTR_ERR(segs) : 0L);
+		return;
+	}
+
+	while (segs) {
+		struct sk_buff *next = segs->next;
+		struct sw_flow_key seg_key = *key;
+
+		segs->next = NULL;
+		execute_actions(dp, segs, &seg_key, actions, actions_len,
+				ignore_no_fwd);
+		segs = next;
+	}
+}
+
 void execute_actions(struct datapath *dp, struct sk_buff *skb,
 		     struct sw_flow_key *key,
 		     const struct ofp_action_header *actions, size_t actions_len,
@@ -474,6 +552,15 @@ void execute_actions(struct datapath *dp, struct sk_buff *skb,
 	size_t max_len = UINT16_MAX;
 	uint8_t *p = (uint8_t *)actions;
 
+	/* A GRO aggregate was looked up once as a whole.  Keep it whole for
+	 * output too, unless the actions need to see each segment. */
+	if (unlikely(skb_is_gso(skb))
+	    && !gso_actions_ok(skb, actions, actions_len)) {
+		execute_actions_segmented(dp, skb, key, actions, actions_len,
+					  ignore_no_fwd);
+		return;
+	}
+
 	prev_port = -1;
 
 	/* The action list was already validated, so we can be a bit looser
@@ -521,23 +608,31 @@ void execute_actions(struct datapath *dp, struct sk_buff *skb,
 
 /* Utility functions. */
 
-/* Makes '*pskb' writable, possibly copying it and setting '*pskb' to point to
- * the copy.
+/* Makes the headers of '*pskb' writable, possibly setting '*pskb' to point to
+ * a new skb.  Actions only rewrite fields up to the transport header, so
+ * only the linear area needs to be private: a clone, such as the packet left
+ * over after outputting it to earlier ports, gets its own copy of the linear
+ * area while its paged data stays shared.
  * Returns 1 if successful, 0 on failure. */
 int
 make_writable(struct sk_buff **pskb)
 {
 	struct sk_buff *skb = *pskb;
-	if (skb_shared(skb) || skb_cloned(skb)) {
-		struct sk_buff *nskb = skb_copy(skb, GFP_ATOMIC);
+	unsigned int hdr_len;
+
+	if (skb_shared(skb)) {
+		struct sk_buff *nskb = skb_clone(skb, GFP_ATOMIC);
 		if (!nskb)
 			return 0;
 		kfree_skb(skb);
-		*pskb = nskb;
-		return 1;
-	} else {
-		unsigned int hdr_len = (skb_transport_offset(skb)
-					+ sizeof(struct tcphdr));
-		return pskb_may_pull(skb, min(hdr_len, skb->len));
+		*pskb = skb = nskb;
 	}
+
+	hdr_len = skb_transport_offset(skb) + sizeof(struct tcphdr);
+	if (!pskb_may_pull(skb, min(hdr_len, skb->len)))
+		return 0;
+
+	if (skb_cloned(skb) && pskb_expand_head(skb, 0, 0, GFP_ATOMIC))
+		return 0;
+	return 1;
 }
@@ -2,14 +2,17 @@
 #include <linux/netdevice.h>
 #include <linux/etherdevice.h>
 #include <linux/ethtool.h>
+#include <linux/interrupt.h>
 #include <linux/rcupdate.h>
 #include <linux/skbuff.h>
-#include <linux/workqueue.h>
 
 #include "datapath.h"
 #include "dp_dev.h"
 #include "forward.h"
 
+/* Maximum number of packets that dp_dev_do_xmit() pushes through the
+ * datapath in one run before yielding to other softirq work. */
+#define DP_DEV_XMIT_BUDGET 64
 
 static struct dp_dev *dp_dev_priv(struct net_device *netdev) 
 {
@@ -90,24 +93,37 @@ static int dp_dev_xmit(struct sk_buff *skb, struct net_device *netdev)
 	skb_queue_tail(&dp_dev->xmit_queue, skb);
 	dp->netdev->trans_start = jiffies;
 
-	schedule_work(&dp_dev->xmit_work);
+	tasklet_schedule(&dp_dev->xmit_tasklet);
 
 	return 0;
 }
 
-static void dp_dev_do_xmit(struct work_struct *work)
+/* Forwards packets queued by dp_dev_xmit() through the datapath.  Runs in
+ * softirq context, like input from any other port, so that packets from the
+ * host stack do not wait for a workqueue thread to be scheduled.  Handles at
+ * most DP_DEV_XMIT_BUDGET packets per run and reschedules itself if more are
+ * left, much as a NAPI poll function would. */
+static void dp_dev_do_xmit(unsigned long data)
 {
-	struct dp_dev *dp_dev = container_of(work, struct dp_dev, xmit_work);
+	struct dp_dev *dp_dev = (struct dp_dev *) data;
 	struct datapath *dp = dp_dev->dp;
 	struct sk_buff *skb;
+	int n;
 
-	while ((skb = skb_dequeue(&dp_dev->xmit_queue)) != NULL) {
+	rcu_read_lock();
+	for (n = 0; n < DP_DEV_XMIT_BUDGET; n++) {
+		skb = skb_dequeue(&dp_dev->xmit_queue);
+		if (!skb)
+			break;
 		skb_reset_mac_header(skb);
-		rcu_read_lock();
 		fwd_port_input(dp->chain, skb, dp->local_port);
-		rcu_read_unlock();
 	}
-	netif_wake_queue(dp->netdev);
+	rcu_read_unlock();
+
+	if (skb_queue_len(&dp_dev->xmit_queue) < dp->netdev->tx_queue_len)
+		netif_wake_queue(dp->netdev);
+	if (!skb_queue_empty(&dp_dev->xmit_queue))
+		tasklet_schedule(&dp_dev->xmit_tasklet);
 }
 
 static int dp_dev_open(struct net_device *netdev)
@@ -225,7 +241,8 @@ int dp_dev_setup(struct datapath *dp, const char *dp_name)
 	dp_dev = dp_dev_priv(netdev);
 	dp_dev->dp = dp;
 	skb_queue_head_init(&dp_dev->xmit_queue);
-	INIT_WORK(&dp_dev->xmit_work, dp_dev_do_xmit);
+	tasklet_init(&dp_dev->xmit_tasklet, dp_dev_do_xmit,
+		     (unsigned long) dp_dev);
 	dp->netdev = netdev;
 	return 0;
 }
@@ -237,6 +254,7 @@ void dp_dev_destroy(struct datapath *dp)
 
 	netif_tx_disable(dp->netdev);
 	synchronize_net();
+	tasklet_kill(&dp_dev->xmit_tasklet);
 	skb_queue_purge(&dp_dev->xmit_queue);
 	unregister_netdevice(dp->netdev);
 }
@@ -1,11 +1,13 @@
 #ifndef DP_DEV_H
 #define DP_DEV_H 1
 
+#include <linux/interrupt.h>
+
 struct dp_dev {
 	struct net_device_stats stats;
 	struct datapath *dp;
 	struct sk_buff_head xmit_queue;
-	struct work_struct xmit_work;
+	struct tasklet_struct xmit_tasklet;
 };
 
 int dp_dev_setup(struct datapath *, const char *);
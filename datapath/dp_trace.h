@@ -0,0 +1,139 @@
+/*
+ * Distributed under the terms of the GNU GPL version 2.
+ * Copyright (c) 2007, 2008, 2009 The Board of Trustees of The Leland
+ * Stanford Junior University
+ */
+
+/* Tracepoints on the forwarding path, in the "ofdatapath" trace system.
+ * They cost a not-taken branch each until enabled, e.g. with
+ * "perf record -e 'ofdatapath:*'" or through
+ * /sys/kernel/debug/tracing/events/ofdatapath.  On kernels older than
+ * 2.6.31, which lack TRACE_EVENT, they compile to nothing. */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM ofdatapath
+
+#if !defined(DP_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define DP_TRACE_H 1
+
+#include <linux/skbuff.h>
+#include <linux/version.h>
+
+struct sw_flow;
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(2,6,31)
+#include <linux/tracepoint.h>
+
+/* A packet of 'skb->len' bytes arrived on 'port'. */
+TRACE_EVENT(ofdp_port_input,
+	TP_PROTO(int port, const struct sk_buff *skb),
+	TP_ARGS(port, skb),
+	TP_STRUCT__entry(
+		__field(int, port)
+		__field(unsigned int, len)
+	),
+	TP_fast_assign(
+		__entry->port = port;
+		__entry->len = skb->len;
+	),
+	TP_printk("port=%d len=%u", __entry->port, __entry->len)
+);
+
+/* The flow table lookup for a packet from 'port' found 'flow', or a null
+ * pointer if nothing matched. */
+TRACE_EVENT(ofdp_lookup,
+	TP_PROTO(int port, const struct sw_flow *flow,
+		 const struct sk_buff *skb),
+	TP_ARGS(port, flow, skb),
+	TP_STRUCT__entry(
+		__field(int, port)
+		__field(const void *, flow)
+		__field(unsigned int, len)
+	),
+	TP_fast_assign(
+		__entry->port = port;
+		__entry->flow = flow;
+		__entry->len = skb->len;
+	),
+	TP_printk("port=%d flow=%p len=%u %s", __entry->port, __entry->flow,
+		  __entry->len, __entry->flow ? "hit" : "miss")
+);
+
+/* A packet from 'port' is going to the controller with packet_in 'reason',
+ * buffered as 'buffer_id'. */
+TRACE_EVENT(ofdp_output_control,
+	TP_PROTO(int port, const struct sk_buff *skb, int reason,
+		 uint32_t buffer_id),
+	TP_ARGS(port, skb, reason, buffer_id),
+	TP_STRUCT__entry(
+		__field(int, port)
+		__field(unsigned int, len)
+		__field(int, reason)
+		__field(uint32_t, buffer_id)
+	),
+	TP_fast_assign(
+		__entry->port = port;
+		__entry->len = skb->len;
+		__entry->reason = reason;
+		__entry->buffer_id = buffer_id;
+	),
+	TP_printk("port=%d len=%u reason=%d buffer_id=%#x", __entry->port,
+		  __entry->len, __entry->reason, __entry->buffer_id)
+);
+
+/* Inserting 'flow' with 'priority' into the chain returned 'error'. */
+TRACE_EVENT(ofdp_add_flow,
+	TP_PROTO(const struct sw_flow *flow, int priority, int error),
+	TP_ARGS(flow, priority, error),
+	TP_STRUCT__entry(
+		__field(const void *, flow)
+		__field(int, priority)
+		__field(int, error)
+	),
+	TP_fast_assign(
+		__entry->flow = flow;
+		__entry->priority = priority;
+		__entry->error = error;
+	),
+	TP_printk("flow=%p priority=%d error=%d", __entry->flow,
+		  __entry->priority, __entry->error)
+);
+
+/* A pass of timeout processing removed 'count' flows. */
+TRACE_EVENT(ofdp_chain_timeout,
+	TP_PROTO(int count),
+	TP_ARGS(count),
+	TP_STRUCT__entry(
+		__field(int, count)
+	),
+	TP_fast_assign(
+		__entry->count = count;
+	),
+	TP_printk("count=%d", __entry->count)
+);
+#else /* LINUX_VERSION_CODE < 2.6.31 */
+static inline void
+trace_ofdp_port_input(int port, const struct sk_buff *skb) { }
+static inline void
+trace_ofdp_lookup(int port, const struct sw_flow *flow,
+		  const struct sk_buff *skb) { }
+static inline void
+trace_ofdp_output_control(int port, const struct sk_buff *skb, int reason,
+			  uint32_t buffer_id) { }
+static inline void
+trace_ofdp_add_flow(const struct sw_flow *flow, int priority, int error) { }
+static inline void
+trace_ofdp_chain_timeout(int count) { }
+#endif
+
+#endif /* dp_trace.h */
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(2,6,31)
+/* Must be outside the header guard.  The datapath directory is on the
+ * include path, so "./dp_trace.h" finds this file. */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE dp_trace
+#include <trace/define_trace.h>
+#endif
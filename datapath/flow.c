@@ -23,6 +23,7 @@
 #include "compat.h"
 
 struct kmem_cache *flow_cache;
+static struct kmem_cache *sfa_cache;
 
 /* Internal function used to compare fields in flow. */
 static inline
@@ -139,13 +140,14 @@ void flow_extract_match(struct sw_flow_key* to, const struct ofp_match* from)
 		} else {
 			/* Transport layer fields are undefined.  Mark them as
 			 * exact-match to allow such flows to reside in
-			 * table-hash, instead of falling into table-linear. */
+			 * table-hash, instead of falling into the wildcard
+			 * table. */
 			to->wildcards &= ~OFPFW_TP;
 		}
 	} else {
 		/* Network and transport layer fields are undefined.  Mark them
 		 * as exact-match to allow such flows to reside in table-hash,
-		 * instead of falling into table-linear. */
+		 * instead of falling into the wildcard table. */
 		to->wildcards &= ~(OFPFW_NW | OFPFW_TP);
 	}
 
@@ -219,24 +221,62 @@ int flow_has_out_port(struct sw_flow *flow, uint16_t out_port)
 }
 EXPORT_SYMBOL(flow_has_out_port);
 
+/* Allocates a structure for 'actions_len' bytes of actions that is not part of
+ * a flow, using allocation flags 'flags'. */
+static struct sw_flow_actions *sfa_alloc(size_t actions_len, gfp_t flags)
+{
+	struct sw_flow_actions *sfa;
+
+	if (actions_len <= SFA_CACHE_LEN) {
+		sfa = kmem_cache_alloc(sfa_cache, flags);
+		if (likely(sfa))
+			sfa->alloc = SFA_CACHE;
+	} else {
+		sfa = kmalloc(sizeof *sfa + actions_len, flags);
+		if (likely(sfa))
+			sfa->alloc = SFA_KMALLOC;
+	}
+	if (likely(sfa))
+		sfa->actions_len = actions_len;
+	return sfa;
+}
+
+/* Frees 'sfa', unless it is stored inside a flow. */
+static void sfa_free(struct sw_flow_actions *sfa)
+{
+	if (sfa->alloc == SFA_CACHE)
+		kmem_cache_free(sfa_cache, sfa);
+	else if (sfa->alloc == SFA_KMALLOC)
+		kfree(sfa);
+}
+
 /* Allocates and returns a new flow with room for 'actions_len' actions, 
  * using allocation flags 'flags'.  Returns the new flow or a null pointer 
- * on failure. */
+ * on failure.
+ *
+ * Per-CPU statistics can only be allocated if 'flags' allow sleeping.  A
+ * flow allocated otherwise counts its packets in shared, locked counters. */
 struct sw_flow *flow_alloc(size_t actions_len, gfp_t flags)
 {
 	struct sw_flow_actions *sfa;
-	size_t size = sizeof *sfa + actions_len;
 	struct sw_flow *flow = kmem_cache_alloc(flow_cache, flags);
 	if (unlikely(!flow))
 		return NULL;
 
-	sfa = kmalloc(size, flags);
-	if (unlikely(!sfa)) {
-		kmem_cache_free(flow_cache, flow);
-		return NULL;
+	if (actions_len <= SFA_INLINE_LEN) {
+		sfa = &flow->inline_acts.acts;
+		sfa->alloc = SFA_INLINE;
+		sfa->actions_len = actions_len;
+	} else {
+		sfa = sfa_alloc(actions_len, flags);
+		if (unlikely(!sfa)) {
+			kmem_cache_free(flow_cache, flow);
+			return NULL;
+		}
 	}
-	sfa->actions_len = actions_len;
 	flow->sf_acts = sfa;
+	flow->stats = (flags & __GFP_WAIT
+		       ? alloc_percpu(struct sw_flow_stats) : NULL);
 
 	return flow;
 }
@@ -246,11 +286,37 @@ void flow_free(struct sw_flow *flow)
 {
 	if (unlikely(!flow))
 		return;
-	kfree(flow->sf_acts);
+	sfa_free(flow->sf_acts);
+	if (flow->stats)
+		free_percpu(flow->stats);
 	kmem_cache_free(flow_cache, flow);
 }
 EXPORT_SYMBOL(flow_free);
 
+/* Stores the number of packets and bytes that have matched 'flow' in
+ * '*packet_count' and '*byte_count', adding up the counts kept by each CPU. */
+void flow_get_stats(struct sw_flow *flow, uint64_t *packet_count,
+		    uint64_t *byte_count)
+{
+	unsigned long flags;
+	int cpu;
+
+	spin_lock_irqsave(&flow->lock, flags);
+	*packet_count = flow->packet_count;
+	*byte_count = flow->byte_count;
+	spin_unlock_irqrestore(&flow->lock, flags);
+
+	if (flow->stats) {
+		for_each_possible_cpu(cpu) {
+			const struct sw_flow_stats *stats
+				= per_cpu_ptr(flow->stats, cpu);
+			*packet_count += stats->packet_count;
+			*byte_count += stats->byte_count;
+		}
+	}
+}
+EXPORT_SYMBOL(flow_get_stats);
+
 /* RCU callback used by flow_deferred_free. */
 static void rcu_free_flow_callback(struct rcu_head *rcu)
 {
@@ -271,14 +337,16 @@ static void rcu_free_acts_callback(struct rcu_head *rcu)
 {
 	struct sw_flow_actions *sf_acts = container_of(rcu, 
 			struct sw_flow_actions, rcu);
-	kfree(sf_acts);
+	sfa_free(sf_acts);
 }
 
 /* Schedules 'sf_acts' to be freed after the next RCU grace period.
- * The caller must hold rcu_read_lock for this to be sensible. */
+ * The caller must hold rcu_read_lock for this to be sensible.  Actions stored
+ * inside a flow are freed along with the flow instead. */
 void flow_deferred_free_acts(struct sw_flow_actions *sf_acts)
 {
-	call_rcu(&sf_acts->rcu, rcu_free_acts_callback);
+	if (sf_acts->alloc != SFA_INLINE)
+		call_rcu(&sf_acts->rcu, rcu_free_acts_callback);
 }
 EXPORT_SYMBOL(flow_deferred_free_acts);
 
@@ -312,13 +380,11 @@ void flow_replace_acts(struct sw_flow *flow,
 {
 	struct sw_flow_actions *sfa;
 	struct sw_flow_actions *orig_sfa = flow->sf_acts;
-	size_t size = sizeof *sfa + actions_len;
 
-	sfa = kmalloc(size, GFP_ATOMIC);
+	sfa = sfa_alloc(actions_len, GFP_ATOMIC);
 	if (unlikely(!sfa))
 		return;
 
-	sfa->actions_len = actions_len;
 	memcpy(sfa->actions, actions, actions_len);
 
 	rcu_assign_pointer(flow->sf_acts, sfa);
@@ -493,12 +559,21 @@ int flow_init(void)
 	if (flow_cache == NULL)
 		return -ENOMEM;
 
+	sfa_cache = kmem_cache_create("sw_flow_actions",
+				      sizeof(struct sw_flow_actions)
+				      + SFA_CACHE_LEN, 0, 0, NULL);
+	if (sfa_cache == NULL) {
+		kmem_cache_destroy(flow_cache);
+		return -ENOMEM;
+	}
+
 	return 0;
 }
 
 /* Uninitializes the flow module. */
 void flow_exit(void)
 {
+	kmem_cache_destroy(sfa_cache);
 	kmem_cache_destroy(flow_cache);
 }
 
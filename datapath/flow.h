@@ -4,6 +4,7 @@
 #include <linux/kernel.h>
 #include <linux/spinlock.h>
 #include <linux/list.h>
+#include <linux/percpu.h>
 #include <linux/types.h>
 #include <linux/jiffies.h>
 #include <linux/rcupdate.h>
@@ -44,11 +45,14 @@ struct sw_flow_key {
 	uint8_t dl_vlan_pcp;	/* Input VLAN priority. */
 	uint8_t nw_tos;		/* IPv4 DSCP */
 	uint8_t nw_proto;	/* IP protocol. */
-	uint8_t pad[3];
+	uint8_t pad[7];		/* Always zero. */
 	uint32_t wildcards;	/* Wildcard fields (host byte order). */
 	uint32_t nw_src_mask;	/* 1-bit in each significant nw_src bit. */
 	uint32_t nw_dst_mask;	/* 1-bit in each significant nw_dst bit. */
-};
+} __attribute__((aligned(8)));
+
+/* Number of 64-bit words before 'wildcards' in a struct sw_flow_key. */
+#define FLOW_KEY_U64S (offsetof(struct sw_flow_key, wildcards) / sizeof(u64))
 
 /* The match fields for ICMP type and code use the transport source and 
  * destination port fields, respectively. */
@@ -60,16 +64,25 @@ struct sw_flow_key {
 static inline int flow_keys_equal(const struct sw_flow_key *a,
 				   const struct sw_flow_key *b) 
 {
-	return !memcmp(a, b, offsetof(struct sw_flow_key, wildcards));
+	const u64 *x = (const u64 *) a;
+	const u64 *y = (const u64 *) b;
+	u64 diff = 0;
+	int i;
+
+	for (i = 0; i < FLOW_KEY_U64S; i++)
+		diff |= x[i] ^ y[i];
+	return !diff;
 }
 
-/* We need to manually make sure that the structure is 32-bit aligned,
- * since we don't want garbage values in compiler-generated pads from
- * messing up hash matches.
+/* We need to manually make sure that the fields before 'wildcards' have no
+ * compiler-generated pads, since we don't want garbage values in them
+ * messing up hash matches, and that they fill a whole number of 64-bit
+ * words for flow_keys_equal().
  */
 static inline void check_key_align(void)
 {
-	BUILD_BUG_ON(sizeof(struct sw_flow_key) != 48);
+	BUILD_BUG_ON(offsetof(struct sw_flow_key, wildcards) != 40);
+	BUILD_BUG_ON(sizeof(struct sw_flow_key) != 56);
 }
 
 /* We keep actions as a separate structure because we need to be able to 
@@ -77,11 +90,31 @@ static inline void check_key_align(void)
  * Modify message. */
 struct sw_flow_actions {
 	size_t actions_len;
+	int alloc;		/* SFA_*: where this structure lives. */
 	struct rcu_head rcu;
 
 	struct ofp_action_header actions[0];
 };
 
+/* Where a struct sw_flow_actions was allocated. */
+enum {
+	SFA_INLINE,		/* In its flow's 'inline_acts'. */
+	SFA_CACHE,		/* From sw_flow_actions_cache. */
+	SFA_KMALLOC		/* With kmalloc(). */
+};
+
+/* Action lists up to this long are stored inside the flow itself, and those up
+ * to SFA_CACHE_LEN long come from a slab cache of their own.  A single output
+ * action is 8 bytes long. */
+#define SFA_INLINE_LEN 16
+#define SFA_CACHE_LEN 64
+
+/* Packet and byte counts for a flow, kept per CPU. */
+struct sw_flow_stats {
+	uint64_t packet_count;
+	uint64_t byte_count;
+};
+
 /* Locking:
  *
  * - Readers must take rcu_read_lock and hold it the entire time that the flow
@@ -109,10 +142,24 @@ struct sw_flow {
 
 	spinlock_t lock;         /* Lock this entry...mostly for stat updates */
 	uint64_t created;        /* When the flow was created (in jiffies_64). */
+
+	/* Counts updated by flow_used() on each CPU, or NULL if the flow was
+	 * allocated where per-CPU memory could not be, in which case
+	 * flow_used() updates 'packet_count' and 'byte_count' under 'lock'.
+	 * Use flow_get_stats() to read the totals. */
+	struct sw_flow_stats *stats;
 	uint64_t packet_count;   /* Number of packets associated with this entry */
 	uint64_t byte_count;     /* Number of bytes associated with this entry */
 
 	struct rcu_head rcu;
+
+	/* Storage for the flow's initial actions, if they are short enough.  Once
+	 * flow_replace_acts() moves the flow to other actions, this storage is
+	 * not reused, because readers may still be looking at it. */
+	union {
+		struct sw_flow_actions acts;
+		uint8_t space[sizeof(struct sw_flow_actions) + SFA_INLINE_LEN];
+	} inline_acts;
 };
 
 int flow_matches_1wild(const struct sw_flow_key *, const struct sw_flow_key *);
@@ -124,6 +171,8 @@ int flow_matches_2desc(const struct sw_flow_key *, const struct sw_flow_key *,
 int flow_has_out_port(struct sw_flow *, uint16_t);
 struct sw_flow *flow_alloc(size_t actions_len, gfp_t flags);
 void flow_free(struct sw_flow *);
+void flow_get_stats(struct sw_flow *, uint64_t *packet_count,
+		    uint64_t *byte_count);
 void flow_deferred_free(struct sw_flow *);
 void flow_deferred_free_acts(struct sw_flow_actions *);
 void flow_setup_actions(struct sw_flow *, const struct ofp_action_header *,
@@ -179,16 +228,38 @@ static inline struct ofp_tcphdr *ofp_tcp_hdr(const struct sk_buff *skb)
 	return (struct ofp_tcphdr *)skb_transport_header(skb);
 }
 
+/* Returns the number of packets on the wire that 'skb' stands for: one,
+ * unless GRO merged several segments into it. */
+static inline unsigned int flow_skb_packets(const struct sk_buff *skb)
+{
+	return skb_is_gso(skb) ? skb_shinfo(skb)->gso_segs : 1;
+}
+
 static inline void flow_used(struct sw_flow *flow, struct sk_buff *skb) 
 {
+	uint64_t now = get_jiffies_64();
+	unsigned int n_packets = flow_skb_packets(skb);
 	unsigned long flags;
 
-	flow->used = get_jiffies_64();
+	/* Only store to 'used' once per jiffy, so that CPUs sharing a flow
+	 * do not write its cache line for every packet. */
+	if (flow->used != now)
+		flow->used = now;
+
+	if (likely(flow->stats)) {
+		struct sw_flow_stats *stats;
 
-	spin_lock_irqsave(&flow->lock, flags);
-	flow->packet_count++;
-	flow->byte_count += skb->len;
-	spin_unlock_irqrestore(&flow->lock, flags);
+		local_irq_save(flags);
+		stats = per_cpu_ptr(flow->stats, smp_processor_id());
+		stats->packet_count += n_packets;
+		stats->byte_count += skb->len;
+		local_irq_restore(flags);
+	} else {
+		spin_lock_irqsave(&flow->lock, flags);
+		flow->packet_count += n_packets;
+		flow->byte_count += skb->len;
+		spin_unlock_irqrestore(&flow->lock, flags);
+	}
 }
 
 extern struct kmem_cache *flow_cache;
@@ -8,6 +8,8 @@
 #include <linux/etherdevice.h>
 #include <linux/if_ether.h>
 #include <linux/if_vlan.h>
+#include <linux/hash.h>
+#include <linux/version.h>
 #include <asm/uaccess.h>
 #include <linux/types.h>
 #include "forward.h"
@@ -19,6 +21,7 @@
 #include "openflow-ext.h"
 #include "chain.h"
 #include "flow.h"
+#include "dp_trace.h"
 
 /* FIXME: do we need to use GFP_ATOMIC everywhere here? */
 
@@ -26,6 +29,23 @@
 static struct sk_buff *retrieve_skb(uint32_t id);
 static void discard_skb(uint32_t id);
 
+/* On a device with several transmit queues, dev_queue_xmit() sends 'skb' to
+ * the queue matching the receive queue that it recorded, if any, which keeps
+ * a receive queue's packets on one CPU and one transmit queue.  Otherwise it
+ * hashes 'skb''s headers for every packet.  For packets that did not come
+ * from a multiqueue device, record a queue derived from 'flow' instead, so
+ * that each flow sticks to one transmit queue and different flows spread over
+ * all of them. */
+static inline void set_tx_queue_hint(struct sk_buff *skb,
+				     const struct sw_flow *flow)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(2,6,30)
+	/* skb_record_rx_queue() stores one more than its argument in 16 bits. */
+	if (!skb_rx_queue_recorded(skb))
+		skb_record_rx_queue(skb, hash_ptr((void *) flow, 15));
+#endif
+}
+
 /* 'skb' was received on port 'p', which may be a physical switch port, the
  * local port, or a null pointer.  Process it according to 'chain'.  Returns 0
  * if successful, in which case 'skb' is destroyed, or -ESRCH if there is no
@@ -53,9 +73,11 @@ int run_flow_through_tables(struct sw_chain *chain, struct sk_buff *skb,
 	}
 
 	flow = chain_lookup(chain, &key, 0);
+	trace_ofdp_lookup(p ? p->port_no : OFPP_NONE, flow, skb);
 	if (likely(flow != NULL)) {
 		struct sw_flow_actions *sf_acts = rcu_dereference(flow->sf_acts);
 		flow_used(flow, skb);
+		set_tx_queue_hint(skb, flow);
 		execute_actions(chain->dp, skb, &key,
 				sf_acts->actions, sf_acts->actions_len, 0);
 		return 0;
@@ -72,6 +94,7 @@ void fwd_port_input(struct sw_chain *chain, struct sk_buff *skb,
 {
 	WARN_ON_ONCE(skb_shared(skb));
 	WARN_ON_ONCE(skb->destructor);
+	trace_ofdp_port_input(p ? p->port_no : OFPP_NONE, skb);
 	if (run_flow_through_tables(chain, skb, p))
 		dp_output_control(chain->dp, skb, chain->dp->miss_send_len,
 				  OFPR_NO_MATCH);
@@ -142,20 +165,33 @@ recv_packet_out(struct sw_chain *chain, const struct sender *sender,
 	}
 
 	if (ntohl(opo->buffer_id) == (uint32_t) -1) {
+		uint8_t *data = (uint8_t *)opo->actions + actions_len;
 		int data_len = ntohs(opo->header.length) - sizeof *opo - actions_len;
 
-		/* FIXME: there is likely a way to reuse the data in msg. */
-		skb = alloc_skb(data_len, GFP_ATOMIC);
-		if (!skb)
-			return -ENOMEM;
-
-		/* FIXME?  We don't reserve NET_IP_ALIGN or NET_SKB_PAD since
-		 * we're just transmitting this raw without examining anything
-		 * at those layers. */
-		skb_put(skb, data_len);
-		skb_copy_to_linear_data(skb,
-					(uint8_t *)opo->actions + actions_len, 
-					data_len);
+		if (sender && sender->skb && data >= sender->skb->data
+		    && data + data_len <= skb_tail_pointer(sender->skb)) {
+			/* Transmit the packet where it lies in the Netlink
+			 * message.  The clone shares the message's data, and
+			 * make_writable() gives it private headers before
+			 * any action rewrites them, so the actions, which lie
+			 * in the same data, are never overwritten. */
+			skb = skb_clone(sender->skb, GFP_ATOMIC);
+			if (!skb)
+				return -ENOMEM;
+			memset(skb->cb, 0, sizeof skb->cb);
+			skb_pull(skb, data - skb->data);
+			skb_trim(skb, data_len);
+		} else {
+			skb = alloc_skb(data_len, GFP_ATOMIC);
+			if (!skb)
+				return -ENOMEM;
+
+			/* FIXME?  We don't reserve NET_IP_ALIGN or NET_SKB_PAD
+			 * since we're just transmitting this raw without
+			 * examining anything at those layers. */
+			skb_put(skb, data_len);
+			skb_copy_to_linear_data(skb, data, data_len);
+		}
 		skb_reset_mac_header(skb);
 	} else {
 		skb = retrieve_skb(ntohl(opo->buffer_id));
@@ -219,7 +255,7 @@ add_flow(struct sw_chain *chain, const struct sender *sender,
 	int overlap;
 
 	/* Allocate memory. */
-	flow = flow_alloc(actions_len, GFP_ATOMIC);
+	flow = flow_alloc(actions_len, GFP_KERNEL);
 	if (flow == NULL)
 		goto error;
 
@@ -268,6 +304,7 @@ add_flow(struct sw_chain *chain, const struct sender *sender,
 	/* Act. */
 	error = chain_insert(chain, flow,
 			     (ntohs(ofm->flags) & OFPFF_EMERG) ? 1 : 0);
+	trace_ofdp_add_flow(flow, flow->priority, error);
 	if (error == -ENOBUFS) {
 		dp_send_error_msg(chain->dp, sender, OFPET_FLOW_MOD_FAILED, 
 				OFPFMFC_ALL_TABLES_FULL, ofm, ntohs(ofm->header.length));
@@ -309,7 +346,7 @@ mod_flow(struct sw_chain *chain, const struct sender *sender,
 	int strict;
 
 	/* Allocate memory. */
-	flow = flow_alloc(actions_len,GFP_ATOMIC);
+	flow = flow_alloc(actions_len, GFP_KERNEL);
 	if (flow == NULL)
 		goto error;
 
@@ -378,10 +415,17 @@ recv_flow(struct sw_chain *chain, const struct sender *sender, const void *msg)
 	const struct ofp_flow_mod *ofm = msg;
 	uint16_t command = ntohs(ofm->command);
 
-	if (command == OFPFC_ADD) {
-		return add_flow(chain, sender, ofm);
-	} else if ((command == OFPFC_MODIFY) || (command == OFPFC_MODIFY_STRICT)) {
-		return mod_flow(chain, sender, ofm);
+	if (command == OFPFC_ADD || command == OFPFC_MODIFY
+	    || command == OFPFC_MODIFY_STRICT) {
+		unsigned int n_flows = chain_n_flows(chain);
+		ktime_t start = ktime_get();
+		int add = command == OFPFC_ADD;
+		int error;
+
+		error = (add ? add_flow(chain, sender, ofm)
+			 : mod_flow(chain, sender, ofm));
+		dp_proc_record_flow(chain->dp, add, n_flows, start);
+		return error;
 	}  else if (command == OFPFC_DELETE) {
 		struct sw_flow_key key;
 		flow_extract_match(&key, &ofm->match);
@@ -518,59 +562,103 @@ fwd_control_input(struct sw_chain *chain, const struct sender *sender,
 	return -EINVAL;
 }
 
-/* Packet buffering. */
+/* Packet buffering.
+ *
+ * The buffers are split into PKT_SHARDS shards, each with its own lock, so
+ * that CPUs sending packets to the controller at the same time do not all
+ * contend for one lock with interrupts disabled.  Buffer number 'idx' belongs
+ * to shard 'idx & PKT_SHARD_MASK', so a buffer ID still leads straight to its
+ * buffer and its shard, and the buffer ID and cookie layout seen by userspace
+ * is unchanged. */
 
 #define OVERWRITE_SECS	1
 #define OVERWRITE_JIFFIES (OVERWRITE_SECS * HZ)
 
+#define PKT_SHARD_BITS 3
+#define PKT_SHARDS (1 << PKT_SHARD_BITS)
+#define PKT_SHARD_MASK (PKT_SHARDS - 1)
+#define PKT_SHARD_BUFFERS (N_PKT_BUFFERS / PKT_SHARDS)
+
 struct packet_buffer {
 	struct sk_buff *skb;
 	uint32_t cookie;
 	unsigned long exp_jiffies;
 };
 
+struct packet_shard {
+	spinlock_t lock;
+	unsigned int next;	/* Next slot to use, 0...PKT_SHARD_BUFFERS-1. */
+} ____cacheline_aligned_in_smp;
+
 static struct packet_buffer buffers[N_PKT_BUFFERS];
-static unsigned int buffer_idx;
-static DEFINE_SPINLOCK(buffer_lock);
+static struct packet_shard shards[PKT_SHARDS];
+
+static struct packet_shard *shard_of(uint32_t id)
+{
+	return &shards[id & PKT_SHARD_MASK];
+}
+
+void fwd_init(void)
+{
+	int i;
+
+	for (i = 0; i < PKT_SHARDS; i++)
+		spin_lock_init(&shards[i].lock);
+}
 
 uint32_t fwd_save_skb(struct sk_buff *skb)
 {
 	struct sk_buff *old_skb = NULL;
+	unsigned int shard_idx;
+	unsigned int idx;
+	struct packet_shard *shard;
 	struct packet_buffer *p;
 	unsigned long int flags;
 	uint32_t id;
+	int i;
 
-	/* FIXME: Probably just need a skb_clone() here. */
-	skb = skb_copy(skb, GFP_ATOMIC);
+	/* A clone is enough: the buffered packet shares its data with the
+	 * caller's, and the actions that later modify it go through
+	 * make_writable(), which gives a cloned skb private headers first. */
+	skb = skb_clone(skb, GFP_ATOMIC);
 	if (!skb)
 		return -1;
 
-	spin_lock_irqsave(&buffer_lock, flags);
-	buffer_idx = (buffer_idx + 1) & PKT_BUFFER_MASK;
-	p = &buffers[buffer_idx];
-	if (p->skb) {
+	/* Start from this CPU's own shard.  If its next buffer is still too
+	 * young to overwrite, try the other shards, so that one busy CPU can
+	 * still use all N_PKT_BUFFERS buffers. */
+	shard_idx = raw_smp_processor_id() & PKT_SHARD_MASK;
+	for (i = 0; i < PKT_SHARDS; i++) {
+		shard = &shards[(shard_idx + i) & PKT_SHARD_MASK];
+		spin_lock_irqsave(&shard->lock, flags);
+		idx = (shard->next << PKT_SHARD_BITS) | (shard - shards);
+		p = &buffers[idx];
 		/* Don't buffer packet if existing entry is less than
 		 * OVERWRITE_SECS old. */
-		if (time_before(jiffies, p->exp_jiffies)) {
-			spin_unlock_irqrestore(&buffer_lock, flags);
-			kfree_skb(skb);
-			return -1;
-		} else {
-			/* Defer kfree_skb() until interrupts re-enabled.
-			 * FIXME: we only need to do that if it has a
-			 * destructor, but it never should since we orphan
-			 * sk_buffs on entry. */
-			old_skb = p->skb;
-		}
+		if (!p->skb || !time_before(jiffies, p->exp_jiffies))
+			goto found;
+		spin_unlock_irqrestore(&shard->lock, flags);
 	}
+	kfree_skb(skb);
+	return -1;
+
+found:
+	shard->next = (shard->next + 1) % PKT_SHARD_BUFFERS;
+
+	/* Defer kfree_skb() until interrupts re-enabled.
+	 * FIXME: we only need to do that if it has a
+	 * destructor, but it never should since we orphan
+	 * sk_buffs on entry. */
+	old_skb = p->skb;
+
 	/* Don't use maximum cookie value since the all-bits-1 id is
 	 * special. */
 	if (++p->cookie >= (1u << PKT_COOKIE_BITS) - 1)
 		p->cookie = 0;
 	p->skb = skb;
 	p->exp_jiffies = jiffies + OVERWRITE_JIFFIES;
-	id = buffer_idx | (p->cookie << PKT_BUFFER_BITS);
-	spin_unlock_irqrestore(&buffer_lock, flags);
+	id = idx | (p->cookie << PKT_BUFFER_BITS);
+	spin_unlock_irqrestore(&shard->lock, flags);
 
 	if (old_skb)
 		kfree_skb(old_skb);
@@ -580,11 +668,12 @@ uint32_t fwd_save_skb(struct sk_buff *skb)
 
 static struct sk_buff *retrieve_skb(uint32_t id)
 {
+	struct packet_shard *shard = shard_of(id);
 	unsigned long int flags;
 	struct sk_buff *skb = NULL;
 	struct packet_buffer *p;
 
-	spin_lock_irqsave(&buffer_lock, flags);
+	spin_lock_irqsave(&shard->lock, flags);
 	p = &buffers[id & PKT_BUFFER_MASK];
 	if (p->cookie == id >> PKT_BUFFER_BITS) {
 		skb = p->skb;
@@ -594,7 +683,7 @@ static struct sk_buff *retrieve_skb(uint32_t id)
 			printk(KERN_NOTICE "cookie mismatch: %x != %x\n",
 			       id >> PKT_BUFFER_BITS, p->cookie);
 	}
-	spin_unlock_irqrestore(&buffer_lock, flags);
+	spin_unlock_irqrestore(&shard->lock, flags);
 
 	return skb;
 }
@@ -604,14 +693,15 @@ void fwd_discard_all(void)
 	int i;
 
 	for (i = 0; i < N_PKT_BUFFERS; i++) {
+		struct packet_shard *shard = shard_of(i);
 		struct sk_buff *skb;
 		unsigned long int flags;
 
 		/* Defer kfree_skb() until interrupts re-enabled. */
-		spin_lock_irqsave(&buffer_lock, flags);
+		spin_lock_irqsave(&shard->lock, flags);
 		skb = buffers[i].skb;
 		buffers[i].skb = NULL;
-		spin_unlock_irqrestore(&buffer_lock, flags);
+		spin_unlock_irqrestore(&shard->lock, flags);
 
 		kfree_skb(skb);
 	}
@@ -619,18 +709,19 @@ void fwd_discard_all(void)
 
 static void discard_skb(uint32_t id)
 {
+	struct packet_shard *shard = shard_of(id);
 	struct sk_buff *old_skb = NULL;
 	unsigned long int flags;
 	struct packet_buffer *p;
 
-	spin_lock_irqsave(&buffer_lock, flags);
+	spin_lock_irqsave(&shard->lock, flags);
 	p = &buffers[id & PKT_BUFFER_MASK];
 	if (p->cookie == id >> PKT_BUFFER_BITS) {
 		/* Defer kfree_skb() until interrupts re-enabled. */
 		old_skb = p->skb;
 		p->skb = NULL;
 	}
-	spin_unlock_irqrestore(&buffer_lock, flags);
+	spin_unlock_irqrestore(&shard->lock, flags);
 
 	if (old_skb)
 		kfree_skb(old_skb);
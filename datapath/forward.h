@@ -31,6 +31,7 @@ int run_flow_through_tables(struct sw_chain *, struct sk_buff *,
 int fwd_control_input(struct sw_chain *, const struct sender *,
 		      const void *, size_t);
 
+void fwd_init(void);
 uint32_t fwd_save_skb(struct sk_buff *skb);
 void fwd_discard_all(void);
 void fwd_exit(void);
@@ -46,11 +46,53 @@
 /* Max number of flow entries supported by the hardware */
 #define TMPL_MAX_FLOWS	8192
 
-/* sw_flow private data for dummy table entries. */
-struct tmpl_flow {
-	struct list_head nodes;
-	/* XXX: If per-entry data is needed, define it here. */
-};
+/* This table does not drive any real hardware.  Instead it emulates the
+ * costs that a TCAM-based switch ASIC imposes on the offload path, so that
+ * flow placement, batched programming and counter synchronization can be
+ * exercised and benchmarked on ordinary machines:
+ *
+ *   - tcam_size bounds the number of entries, like the TCAM would.  Inserts
+ *     beyond it are rejected and fall back to the software tables.
+ *
+ *   - program_latency_us is charged for every entry written to or erased
+ *     from the "hardware" (insert, modify, delete, expiry).
+ *
+ *   - counter_latency_us is charged for every counter_batch entries whose
+ *     counters are read back by the periodic timeout scan.
+ *
+ * Lookups happen in software against the emulated entry list, so matching
+ * packets are counted by the normal datapath code. */
+static unsigned int tcam_size = TMPL_MAX_FLOWS;
+module_param(tcam_size, uint, 0444);
+MODULE_PARM_DESC(tcam_size, "Number of entries in the emulated TCAM");
+
+static unsigned int program_latency_us;
+module_param(program_latency_us, uint, 0644);
+MODULE_PARM_DESC(program_latency_us,
+		 "Microseconds to program or erase one entry");
+
+static unsigned int counter_latency_us;
+module_param(counter_latency_us, uint, 0644);
+MODULE_PARM_DESC(counter_latency_us,
+		 "Microseconds for one counter read transaction");
+
+static unsigned int counter_batch = 1;
+module_param(counter_batch, uint, 0644);
+MODULE_PARM_DESC(counter_batch,
+		 "Number of entries whose counters one read transaction returns");
+
+/* Operation counts, readable through sysfs to correlate with benchmarks. */
+static unsigned long n_programmed;
+module_param(n_programmed, ulong, 0444);
+MODULE_PARM_DESC(n_programmed, "Entries programmed or erased so far");
+
+static unsigned long n_rejected;
+module_param(n_rejected, ulong, 0444);
+MODULE_PARM_DESC(n_rejected, "Inserts rejected because the TCAM was full");
+
+static unsigned long n_counter_reads;
+module_param(n_counter_reads, ulong, 0444);
+MODULE_PARM_DESC(n_counter_reads, "Counter read transactions so far");
 
 struct tmpl_flowtable {
 	struct sw_table flowtab;
@@ -82,13 +124,31 @@ static struct sw_table *tmpl_create_flowtable(void);
 static int __init tmpl_startup(void);
 static void tmpl_cleanup(void);
 
+/* Busy-waits for 'usecs' microseconds, the way a driver polling a hardware
+ * command register would. */
+static void
+emul_delay(unsigned int usecs)
+{
+	if (usecs >= 1000)
+		mdelay(usecs / 1000);
+	if (usecs % 1000)
+		udelay(usecs % 1000);
+}
+
+static void
+emul_program(void)
+{
+	n_programmed++;
+	emul_delay(program_latency_us);
+}
+
 static struct sw_flow *
 tmpl_flowtable_lookup(struct sw_table *flowtab, const struct sw_flow_key *key)
 {
 	struct tmpl_flowtable *myflowtab = (struct tmpl_flowtable *)flowtab;
 	struct sw_flow *flow;
 
-	list_for_each_entry(flow, &myflowtab->flows, node) {
+	list_for_each_entry_rcu(flow, &myflowtab->flows, node) {
 		if (flow_matches_1wild(key, &flow->key)) {
 			return flow;
 		}
@@ -100,18 +160,38 @@ tmpl_flowtable_lookup(struct sw_table *flowtab, const struct sw_flow_key *key)
 static int
 tmpl_install_flow(struct sw_table *flowtab, struct sw_flow *flow)
 {
-	/* XXX: Use a data cache? */
-	flow->private = kzalloc(sizeof(struct tmpl_flow), GFP_ATOMIC);
-	if (flow->private == NULL)
+	struct tmpl_flowtable *myflowtab = (struct tmpl_flowtable *)flowtab;
+	struct sw_flow *f;
+
+	/* Entries are kept in priority order, as a TCAM would hold them.  An
+	 * entry identical to an existing one overwrites it in place. */
+	list_for_each_entry(f, &myflowtab->flows, node) {
+		if (f->priority == flow->priority
+		    && f->key.wildcards == flow->key.wildcards
+		    && flow_matches_2wild(&f->key, &flow->key)) {
+			emul_program();
+			flow->serial = f->serial;
+			list_replace_rcu(&f->node, &flow->node);
+			list_replace_rcu(&f->iter_node, &flow->iter_node);
+			flow_deferred_free(f);
+			return 1;
+		}
+
+		if (f->priority < flow->priority)
+			break;
+	}
+
+	if (atomic_read(&myflowtab->num_flows) >= myflowtab->max_flows) {
+		n_rejected++;
 		return 0;
+	}
 
-	/* XXX: Do whatever needs to be done to insert an entry in hardware.
-	 * If the entry can't be inserted, return 0.  This stub code doesn't
-	 * do anything yet, so we're going to return 0... you shouldn't (and
-	 * you should update n_flows in struct tmpl_flowtable, too).
-	 */
-	kfree(flow->private);
-	return 0;
+	emul_program();
+	atomic_inc(&myflowtab->num_flows);
+	flow->serial = myflowtab->next_serial++;
+	list_add_tail_rcu(&flow->node, &f->node);
+	list_add_rcu(&flow->iter_node, &myflowtab->iter_flows);
+	return 1;
 }
 
 static int
@@ -127,9 +207,7 @@ tmpl_modify_flow(struct sw_table *flowtab, const struct sw_flow_key *key,
 		if (flow_matches_desc(&flow->key, key, strict)
 		    && (!strict || (flow->priority == priority))) {
 			flow_replace_acts(flow, actions, actions_len);
-			/* XXX: Do whatever is necessary to modify the entry
-			 * in hardware
-			 */
+			emul_program();
 			count++;
 		}
 	}
@@ -141,9 +219,7 @@ static int
 do_uninstall(struct datapath *dpinst, struct sw_table *flowtab,
 	     struct sw_flow *flow, enum ofp_flow_removed_reason reason)
 {
-	/* XXX: Remove the entry from hardware.  If you need to do any other
-	 * clean-up associated with the entry, do it here.
-	 */
+	emul_program();
 	dp_send_flow_end(dpinst, flow, reason);
 	list_del_rcu(&flow->node);
 	list_del_rcu(&flow->iter_node);
@@ -162,7 +238,8 @@ tmpl_uninstall_flow(struct datapath *dpinst, struct sw_table *flowtab,
 
 	list_for_each_entry(flow, &myflowtab->flows, node) {
 		if (flow_matches_desc(&flow->key, key, strict)
-		    && (!strict || (flow->priority == priority)))
+		    && (!strict || (flow->priority == priority))
+		    && flow_has_out_port(flow, out_port))
 			count += do_uninstall(dpinst, flowtab,
 					      flow, OFPRR_DELETE);
 	}
@@ -177,26 +254,22 @@ tmpl_flow_timeout(struct datapath *dpinst, struct sw_table *flowtab)
 {
 	struct tmpl_flowtable *myflowtab = (struct tmpl_flowtable *)flowtab;
 	struct sw_flow *flow;
+	unsigned int batch = max(counter_batch, 1U);
+	unsigned int n_read = 0;
 	int num_uninst_flows = 0;
-	uint64_t num_forw_packets = 0;
-	uint64_t num_forw_bytes = 0;
 	int reason;
 
 	mutex_lock(&dp_mutex);
 	list_for_each_entry(flow, &myflowtab->flows, node) {
-		/* XXX: Retrieve the packet and byte counts associated with this
-		 * entry and store them in "packet_count" and "byte_count".
-		 */
-#if 0
-		num_forw_pakcets = flow->packet_count + get_hwmib(...);
-		num_forw_bytes = flow->byte_count + get_hwmib(...);
-#endif
-		if (num_forw_packets > flow->packet_count
-		    && flow->idle_timeout != OFP_FLOW_PERMANENT) {
-			flow->packet_count = num_forw_packets;
-			flow->byte_count = num_forw_bytes;
-			flow->used = get_jiffies_64();
+		/* Packets that hit this entry were already counted in 'flow'
+		 * by the software lookup path, so all that is left to emulate
+		 * is the cost of reading the counters back from hardware, one
+		 * transaction per 'counter_batch' entries. */
+		if (n_read++ % batch == 0) {
+			n_counter_reads++;
+			emul_delay(counter_latency_us);
 		}
+
 		reason = flow_timeout(flow);
 		if (reason >= 0) {
 			num_uninst_flows += do_uninstall(dpinst, flowtab,
@@ -219,9 +292,6 @@ tmpl_destroy_flowtable(struct sw_table *flowtab)
 		return;
 	}
 
-	/* XXX: This table is being destroyed, so free any data that you
-	 * don't want to leak.
-	 */
 	while (!list_empty(&myflowtab->flows)) {
 		struct sw_flow *flow = list_entry(myflowtab->flows.next,
 						  struct sw_flow, node);
@@ -263,8 +333,8 @@ tmpl_get_flowstats(struct sw_table *flowtab, struct sw_table_stats *stats)
 {
 	struct tmpl_flowtable *myflowtab = (struct tmpl_flowtable *)flowtab;
 
-	stats->name = "template";
-	stats->wildcards = OFPFW_ALL;	/* XXX: Set this appropriately */
+	stats->name = "hw-emul";
+	stats->wildcards = OFPFW_ALL;
 	stats->n_flows = atomic_read(&myflowtab->num_flows);
 	stats->max_flows = myflowtab->max_flows;
 	stats->n_matched = flowtab->n_matched;
@@ -290,7 +360,7 @@ tmpl_create_flowtable(void)
 	flowtab->iterate = tmpl_iterate_flowtable;
 	flowtab->stats = tmpl_get_flowstats;
 
-	myflowtab->max_flows = TMPL_MAX_FLOWS;
+	myflowtab->max_flows = tcam_size;
 	atomic_set(&myflowtab->num_flows, 0);
 	INIT_LIST_HEAD(&myflowtab->flows);
 	INIT_LIST_HEAD(&myflowtab->iter_flows);
@@ -314,7 +384,7 @@ tmpl_cleanup(void)
 module_init(tmpl_startup);
 module_exit(tmpl_cleanup);
 
-MODULE_DESCRIPTION("Fastpath Extension Template for OpenFlow Switch");
+MODULE_DESCRIPTION("Emulated TCAM Fastpath for OpenFlow Switch");
 MODULE_AUTHOR("Copyright (c) 2008, 2009 "
 	      "The Board of Trustees of The Leland Stanford Junior University");
 MODULE_LICENSE("GPL");
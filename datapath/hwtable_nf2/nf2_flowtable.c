@@ -37,6 +37,8 @@
 #include <linux/list.h>
 #include <linux/delay.h>
 #include <linux/if_arp.h>
+#include <linux/jhash.h>
+#include <linux/vmalloc.h>
 
 #include "chain.h"
 #include "table.h"
@@ -49,12 +51,35 @@
 #include "hwtable_nf2/nf2_lib.h"
 #include "hwtable_nf2/nf2_procfs.h"
 
+/* Software shadow of the flows in hardware, so that lookups and strict
+ * deletes do not have to compare against every installed flow.  Flows are
+ * grouped by their wildcards, which determine the mask that they apply to a
+ * packet, and each group hashes its flows, linked through 'node', on their
+ * masked keys.  The exact-match group always exists and comes first; groups
+ * of wildcarded flows come and go with their flows.  Lookups walk groups
+ * and buckets under RCU; changes are made with dp_mutex held. */
+#define NF2_EXACT_BUCKETS 4096
+#define NF2_WILDCARD_BUCKETS 8
+
+/* The fields of struct sw_flow_key that a packet is matched on. */
+#define NF2_KEY_LEN offsetof(struct sw_flow_key, wildcards)
+
+struct nf2_shadow_group {
+	struct list_head node;		/* In nf2_flowtable's 'groups'. */
+	struct rcu_head rcu;
+	uint32_t wildcards;		/* Wildcards of every flow here. */
+	struct sw_flow_key mask;	/* Significant bits of the key. */
+	unsigned int n_flows;
+	unsigned int bucket_mask;	/* Number of buckets, minus 1. */
+	struct list_head buckets[0];
+};
+
 struct nf2_flowtable {
 	struct sw_table flowtab;
 	spinlock_t lock;
 	unsigned int max_flows;
 	atomic_t num_flows;
-	struct list_head flows;
+	struct list_head groups;	/* nf2_shadow_groups. */
 	struct list_head iter_flows;
 	unsigned long int next_serial;
 };
@@ -87,45 +112,198 @@ static struct sw_table *nf2_create_flowtable(void);
 static int __init nf2_startup(void);
 static void nf2_cleanup(void);
 
+static void
+make_mask(const struct sw_flow_key *key, struct sw_flow_key *mask)
+{
+	uint32_t w = key->wildcards;
+
+	memset(mask, 0, sizeof *mask);
+	if (!(w & OFPFW_IN_PORT))
+		mask->in_port = 0xffff;
+	if (!(w & OFPFW_DL_VLAN))
+		mask->dl_vlan = 0xffff;
+	if (!(w & OFPFW_DL_VLAN_PCP))
+		mask->dl_vlan_pcp = 0xff;
+	if (!(w & OFPFW_DL_SRC))
+		memset(mask->dl_src, 0xff, sizeof mask->dl_src);
+	if (!(w & OFPFW_DL_DST))
+		memset(mask->dl_dst, 0xff, sizeof mask->dl_dst);
+	if (!(w & OFPFW_DL_TYPE))
+		mask->dl_type = 0xffff;
+	if (!(w & OFPFW_NW_TOS))
+		mask->nw_tos = 0xff;
+	if (!(w & OFPFW_NW_PROTO))
+		mask->nw_proto = 0xff;
+	mask->nw_src = key->nw_src_mask;
+	mask->nw_dst = key->nw_dst_mask;
+	if (!(w & OFPFW_TP_SRC))
+		mask->tp_src = 0xffff;
+	if (!(w & OFPFW_TP_DST))
+		mask->tp_dst = 0xffff;
+}
+
+static struct nf2_shadow_group *
+shadow_group_create(const struct sw_flow_key *key, unsigned int n_buckets)
+{
+	struct nf2_shadow_group *group;
+	size_t size;
+	unsigned int i;
+
+	size = sizeof *group + n_buckets * sizeof *group->buckets;
+	if (n_buckets > NF2_WILDCARD_BUCKETS)
+		group = vmalloc(size);
+	else
+		group = kmalloc(size, GFP_ATOMIC);
+	if (group == NULL)
+		return NULL;
+	group->wildcards = key->wildcards;
+	make_mask(key, &group->mask);
+	group->n_flows = 0;
+	group->bucket_mask = n_buckets - 1;
+	for (i = 0; i < n_buckets; i++)
+		INIT_LIST_HEAD(&group->buckets[i]);
+	return group;
+}
+
+static void
+shadow_group_free(struct nf2_shadow_group *group)
+{
+	if (group->bucket_mask + 1 > NF2_WILDCARD_BUCKETS)
+		vfree(group);
+	else
+		kfree(group);
+}
+
+static void
+shadow_group_free_rcu(struct rcu_head *rcu)
+{
+	shadow_group_free(container_of(rcu, struct nf2_shadow_group, rcu));
+}
+
+static struct nf2_shadow_group *
+shadow_find_group(struct nf2_flowtable *nf2flowtab, uint32_t wildcards)
+{
+	struct nf2_shadow_group *group;
+
+	list_for_each_entry_rcu(group, &nf2flowtab->groups, node) {
+		if (group->wildcards == wildcards)
+			return group;
+	}
+	return NULL;
+}
+
+/* Returns the bucket in 'group' that holds flows whose fields equal those of
+ * 'key' under the group's mask. */
+static struct list_head *
+shadow_bucket(struct nf2_shadow_group *group, const struct sw_flow_key *key)
+{
+	const uint8_t *src = (const uint8_t *)key;
+	const uint8_t *mask = (const uint8_t *)&group->mask;
+	uint8_t masked[NF2_KEY_LEN];
+	int i;
+
+	for (i = 0; i < NF2_KEY_LEN; i++)
+		masked[i] = src[i] & mask[i];
+	return &group->buckets[jhash(masked, NF2_KEY_LEN, 0)
+			       & group->bucket_mask];
+}
+
+/* Frees the groups of wildcarded flows that have become empty, once no
+ * lookup can still be walking them.  Done after a delete or timeout pass,
+ * rather than as each flow goes, so that the pass can walk a group's
+ * buckets while it empties it. */
+static void
+shadow_prune(struct nf2_flowtable *nf2flowtab)
+{
+	struct nf2_shadow_group *group, *next;
+
+	list_for_each_entry_safe(group, next, &nf2flowtab->groups, node) {
+		if (group->n_flows == 0 && group->wildcards != 0) {
+			list_del_rcu(&group->node);
+			call_rcu(&group->rcu, shadow_group_free_rcu);
+		}
+	}
+}
+
+/* An exact-match flow beats any wildcarded one.  Otherwise the highest
+ * priority wins, and among equals the most recently installed flow. */
 static struct sw_flow *
 nf2_lookup_flowtable(struct sw_table *flowtab, const struct sw_flow_key *key)
 {
 	struct nf2_flowtable *nf2flowtab = (struct nf2_flowtable *)flowtab;
+	struct nf2_shadow_group *group;
+	struct sw_flow *best = NULL;
 	struct sw_flow *flow;
 
-	list_for_each_entry(flow, &nf2flowtab->flows, node) {
-		if (flow_matches_1wild(key, &flow->key)) {
-			return flow;
+	list_for_each_entry_rcu(group, &nf2flowtab->groups, node) {
+		struct list_head *bucket = shadow_bucket(group, key);
+
+		list_for_each_entry_rcu(flow, bucket, node) {
+			if (flow_matches_1wild(key, &flow->key)
+			    && (best == NULL
+				|| flow->priority > best->priority))
+				best = flow;
 		}
+		if (best != NULL && group->wildcards == 0)
+			break;
 	}
 
-	return NULL;
+	return best;
 }
 
 static int
 nf2_install_flow(struct sw_table *flowtab, struct sw_flow *flow)
 {
 	struct nf2_flowtable *nf2flowtab = (struct nf2_flowtable *)flowtab;
+	struct nf2_shadow_group *group;
 
 	/* Delete flows that match exactly. */
 	nf2_uninstall_flow(NULL, flowtab, &flow->key, OFPP_NONE,
 			   flow->priority, true);
 
+	/* Get the flow's group before writing to hardware, since it is the
+	 * one step that can fail without hardware to undo. */
+	group = shadow_find_group(nf2flowtab, flow->key.wildcards);
+	if (group == NULL) {
+		group = shadow_group_create(&flow->key, NF2_WILDCARD_BUCKETS);
+		if (group == NULL)
+			return 0;
+		list_add_tail_rcu(&group->node, &nf2flowtab->groups);
+	}
+
 	if (nf2_are_actions_supported(flow)) {
 		if (nf2_build_and_write_flow(flow)) {
+			shadow_prune(nf2flowtab);
 			return 0;
 		}
 	} else {
 		/* Unsupported actions or no netdevice. */
+		shadow_prune(nf2flowtab);
 		return 0;
 	}
 
 	atomic_inc(&nf2flowtab->num_flows);
-	list_add_rcu(&flow->node, &nf2flowtab->flows);
+	flow->serial = nf2flowtab->next_serial++;
+	group->n_flows++;
+	list_add_rcu(&flow->node, shadow_bucket(group, &flow->key));
 	list_add_rcu(&flow->iter_node, &nf2flowtab->iter_flows);
 	return 1;
 }
 
+static unsigned int
+modify_one(struct sw_table *flowtab, struct sw_flow *flow,
+	   const struct sw_flow_key *key, uint16_t priority, int strict,
+	   const struct ofp_action_header *actions, size_t actions_len)
+{
+	if (flow_matches_desc(&flow->key, key, strict)
+	    && (!strict || flow->priority == priority)) {
+		flow_replace_acts(flow, actions, actions_len);
+		if (nf2_are_actions_supported(flow))
+			return nf2_modify_acts(flowtab, flow);
+	}
+	return 0;
+}
+
 static int
 nf2_modify_flow(struct sw_table *flowtab, const struct sw_flow_key *key,
 		uint16_t priority, int strict,
@@ -135,15 +313,22 @@ nf2_modify_flow(struct sw_table *flowtab, const struct sw_flow_key *key,
 	struct sw_flow *flow;
 	unsigned int count = 0;
 
-	list_for_each_entry(flow, &nf2flowtab->flows, node) {
-		if (flow_matches_desc(&flow->key, key, strict)
-		    && (!strict || flow->priority == priority)) {
-			flow_replace_acts(flow, actions, actions_len);
-			if (nf2_are_actions_supported(flow)) {
-				count += nf2_modify_acts(flowtab, flow);
+	if (strict) {
+		struct nf2_shadow_group *group;
+
+		group = shadow_find_group(nf2flowtab, key->wildcards);
+		if (group != NULL) {
+			list_for_each_entry(flow, shadow_bucket(group, key),
+					    node) {
+				count += modify_one(flowtab, flow, key,
+						    priority, strict,
+						    actions, actions_len);
 			}
-		} else {
-			return 0;
+		}
+	} else {
+		list_for_each_entry(flow, &nf2flowtab->iter_flows, iter_node) {
+			count += modify_one(flowtab, flow, key, priority,
+					    strict, actions, actions_len);
 		}
 	}
 
@@ -157,7 +342,7 @@ nf2_has_conflict(struct sw_table *flowtab, const struct sw_flow_key *key,
 	struct nf2_flowtable *nf2flowtab = (struct nf2_flowtable *)flowtab;
 	struct sw_flow *flow;
 
-	list_for_each_entry(flow, &nf2flowtab->flows, node) {
+	list_for_each_entry(flow, &nf2flowtab->iter_flows, iter_node) {
 		if (flow_matches_desc(&flow->key, key, strict)
 		    && (flow->priority == priority)) {
 			return true;
@@ -184,9 +369,12 @@ static int
 do_uninstall(struct datapath *dpinst, struct sw_table *flowtab,
 	     struct sw_flow *flow, enum ofp_flow_removed_reason reason)
 {
+	struct nf2_flowtable *nf2flowtab = (struct nf2_flowtable *)flowtab;
+
 	if (flow != NULL && flow->private != NULL) {
 		if (dpinst != NULL)
 			dp_send_flow_end(dpinst, flow, reason);
+		shadow_find_group(nf2flowtab, flow->key.wildcards)->n_flows--;
 		list_del_rcu(&flow->node);
 		list_del_rcu(&flow->iter_node);
 		nf2_delete_private(flow->private);
@@ -197,6 +385,30 @@ do_uninstall(struct datapath *dpinst, struct sw_table *flowtab,
 	return 0;
 }
 
+/* If 'flow' matches the flow_mod described by 'key', 'out_port', 'priority'
+ * and 'strict', collects its counters from 'netdev', uninstalls it and
+ * returns 1.  Otherwise returns 0. */
+static int
+uninstall_one(struct datapath *dpinst, struct sw_table *flowtab,
+	      struct net_device *netdev, struct sw_flow *flow,
+	      const struct sw_flow_key *key, uint16_t out_port,
+	      uint16_t priority, int strict)
+{
+	struct nf2_flow *nf2flow;
+
+	if (!flow_matches_desc(&flow->key, key, strict)
+	    || (strict && flow->priority != priority)
+	    || !flow_has_out_port(flow, out_port))
+		return 0;
+
+	nf2flow = flow->private;
+	if (nf2flow != NULL) {
+		flow->packet_count += nf2_get_packet_count(netdev, nf2flow);
+		flow->byte_count += nf2_get_byte_count(netdev, nf2flow);
+	}
+	return do_uninstall(dpinst, flowtab, flow, OFPRR_DELETE);
+}
+
 static int
 nf2_uninstall_flow(struct datapath *dpinst, struct sw_table *flowtab,
 		   const struct sw_flow_key *key, uint16_t out_port,
@@ -204,32 +416,38 @@ nf2_uninstall_flow(struct datapath *dpinst, struct sw_table *flowtab,
 {
 	struct net_device *netdev;
 	struct nf2_flowtable *nf2flowtab = (struct nf2_flowtable *)flowtab;
-	struct sw_flow *flow;
-	struct nf2_flow *nf2flow;
+	struct sw_flow *flow, *n;
 	unsigned int count = 0;
 
 	netdev = nf2_get_net_device();
 	if (netdev == NULL)
 		return 0;
 
-	list_for_each_entry(flow, &nf2flowtab->flows, node) {
-		if (flow_matches_desc(&flow->key, key, strict)
-		    && (!strict || flow->priority == priority)
-		    && flow_has_out_port(flow, out_port)) {
-			nf2flow = flow->private;
-			if (nf2flow != NULL) {
-				flow->packet_count
-					+= nf2_get_packet_count(netdev,
-								nf2flow);
-				flow->byte_count += nf2_get_byte_count(netdev,
-								       nf2flow);
+	if (strict) {
+		/* Only flows with the same wildcards and the same fields under
+		 * them can match, and those all share a bucket. */
+		struct nf2_shadow_group *group;
+
+		group = shadow_find_group(nf2flowtab, key->wildcards);
+		if (group != NULL) {
+			list_for_each_entry_safe(flow, n,
+						 shadow_bucket(group, key),
+						 node) {
+				count += uninstall_one(dpinst, flowtab, netdev,
+						       flow, key, out_port,
+						       priority, strict);
 			}
-			count += do_uninstall(dpinst, flowtab,
-					      flow, OFPRR_DELETE);
+		}
+	} else {
+		list_for_each_entry_safe(flow, n, &nf2flowtab->iter_flows,
+					 iter_node) {
+			count += uninstall_one(dpinst, flowtab, netdev, flow,
+					       key, out_port, priority, strict);
 		}
 	}
 	if (count != 0)
 		atomic_sub(count, &nf2flowtab->num_flows);
+	shadow_prune(nf2flowtab);
 
 	nf2_free_net_device(netdev);
 
@@ -241,7 +459,7 @@ nf2_flow_timeout(struct datapath *dpinst, struct sw_table *flowtab)
 {
 	struct net_device *netdev;
 	struct nf2_flowtable *nf2flowtab = (struct nf2_flowtable *)flowtab;
-	struct sw_flow *flow;
+	struct sw_flow *flow, *n;
 	struct nf2_flow *nf2flow;
 	int num_uninst_flows = 0;
 	uint64_t num_forw_packets = 0;
@@ -252,7 +470,7 @@ nf2_flow_timeout(struct datapath *dpinst, struct sw_table *flowtab)
 		return num_uninst_flows;
 
 	mutex_lock(&dp_mutex);
-	list_for_each_entry(flow, &nf2flowtab->flows, node) {
+	list_for_each_entry_safe(flow, n, &nf2flowtab->iter_flows, iter_node) {
 		nf2flow = flow->private;
 		if (nf2flow != NULL) {
 			num_forw_packets = flow->packet_count
@@ -270,6 +488,7 @@ nf2_flow_timeout(struct datapath *dpinst, struct sw_table *flowtab)
 							 flow, reason);
 		}
 	}
+	shadow_prune(nf2flowtab);
 	mutex_unlock(&dp_mutex);
 
 	nf2_clear_watchdog(netdev);
@@ -290,10 +509,11 @@ nf2_destroy_flowtable(struct sw_table *flowtab)
 	if (nf2flowtab == NULL)
 		return;
 
-	while (!list_empty(&nf2flowtab->flows)) {
-		struct sw_flow *flow = list_entry(nf2flowtab->flows.next,
-						  struct sw_flow, node);
+	while (!list_empty(&nf2flowtab->iter_flows)) {
+		struct sw_flow *flow = list_entry(nf2flowtab->iter_flows.next,
+						  struct sw_flow, iter_node);
 
+		list_del(&flow->iter_node);
 		list_del(&flow->node);
 		if (flow->private) {
 			nf2flow = (struct nf2_flow *)flow->private;
@@ -307,6 +527,14 @@ nf2_destroy_flowtable(struct sw_table *flowtab)
 		}
 		flow_free(flow);
 	}
+	while (!list_empty(&nf2flowtab->groups)) {
+		struct nf2_shadow_group *group
+			= list_entry(nf2flowtab->groups.next,
+				     struct nf2_shadow_group, node);
+
+		list_del(&group->node);
+		shadow_group_free(group);
+	}
 	kfree(nf2flowtab);
 
 	nf2_destroy_exact_freelist();
@@ -385,6 +613,8 @@ nf2_get_flowstats(struct sw_table *flowtab, struct sw_table_stats *stats)
 static struct sw_table *
 nf2_create_flowtable(void)
 {
+	struct nf2_shadow_group *exact_group;
+	struct sw_flow_key exact_key;
 	struct net_device *netdev;
 	struct nf2_flowtable *nf2flowtab;
 	struct sw_table *flowtab;
@@ -418,10 +648,19 @@ nf2_create_flowtable(void)
 	nf2flowtab->max_flows = OPENFLOW_NF2_EXACT_TABLE_SIZE
 		+ OPENFLOW_WILDCARD_TABLE_SIZE - RESERVED_FOR_CPU2NETFPGA;
 	atomic_set(&nf2flowtab->num_flows, 0);
-	INIT_LIST_HEAD(&nf2flowtab->flows);
+	INIT_LIST_HEAD(&nf2flowtab->groups);
 	INIT_LIST_HEAD(&nf2flowtab->iter_flows);
 	nf2flowtab->next_serial = 0;
 
+	memset(&exact_key, 0, sizeof exact_key);
+	exact_key.nw_src_mask = exact_key.nw_dst_mask = 0xffffffff;
+	exact_group = shadow_group_create(&exact_key, NF2_EXACT_BUCKETS);
+	if (exact_group == NULL) {
+		kfree(nf2flowtab);
+		return NULL;
+	}
+	list_add(&exact_group->node, &nf2flowtab->groups);
+
 	nf2_init_wildcard_freelist();
 	nf2_write_static_wildcard();
 	nf2_init_exact_freelist();
@@ -39,4 +39,10 @@
 #define cancel_work_sync(_work) flush_scheduled_work()
 #endif
 
+#if LINUX_VERSION_CODE < KERNEL_VERSION(2,6,27)
+/* Work cannot be aimed at a particular CPU, so it runs wherever keventd picks
+ * it up.  That is still correct, just not parallel. */
+#define schedule_work_on(_cpu, _work) schedule_work(_work)
+#endif
+
 #endif
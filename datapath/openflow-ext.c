@@ -30,12 +30,17 @@
  * without specific, written prior permission.
  */
 
+#include <linux/jiffies.h>
+#include <linux/slab.h>
 #include "openflow/openflow-ext.h"
 
 #include "chain.h"
 #include "datapath.h"
+#include "dp_act.h"
+#include "flow.h"
 #include "table.h"
 #include "private-msg.h"
+#include "openflow-ext.h"
 
 /***
  * Copy the new dp_desc out of the passed message
@@ -52,6 +57,217 @@ recv_of_set_dp_desc(struct datapath *dp, const struct sender * sender,
     return 0;
 }
 
+/* Returns the number of milliseconds from 'then' to 'now', both in
+ * jiffies. */
+static uint64_t
+age_msecs(uint64_t now, uint64_t then)
+{
+	return now > then ? jiffies_to_msecs(now - then) : 0;
+}
+
+/* Returns the time 'age_be' milliseconds before 'now', in jiffies. */
+static uint64_t
+age_to_jiffies(uint64_t now, uint64_t age_be)
+{
+	uint64_t age = msecs_to_jiffies(min_t(uint64_t, be64_to_cpu(age_be),
+					      UINT_MAX));
+	return now - min(age, now);
+}
+
+/* Installs the flow in 'rec', whose actions are 'actions_len' bytes long, in
+ * 'chain'.  Returns 0 if successful, -EINVAL if the actions are not valid,
+ * -ENOBUFS if no table has room for the flow, otherwise a negative errno
+ * value. */
+static int
+import_flow(struct sw_chain *chain, const struct ofp_ext_flow_record *rec,
+	    size_t actions_len, uint64_t now)
+{
+	struct sw_flow *flow;
+	int error;
+
+	flow = flow_alloc(actions_len, GFP_KERNEL);
+	if (!flow)
+		return -ENOMEM;
+
+	flow_extract_match(&flow->key, &rec->match);
+	if (validate_actions(chain->dp, &flow->key, rec->actions, actions_len)
+	    != ACT_VALIDATION_OK) {
+		flow_free(flow);
+		return -EINVAL;
+	}
+
+	flow->priority = flow->key.wildcards ? ntohs(rec->priority) : -1;
+	flow->idle_timeout = ntohs(rec->idle_timeout);
+	flow->hard_timeout = ntohs(rec->hard_timeout);
+	flow->send_flow_rem = rec->send_flow_rem != 0;
+	flow->emerg_flow = rec->emerg != 0;
+	flow_setup_actions(flow, rec->actions, actions_len);
+
+	/* flow_setup_actions() resets these, so restore them afterward. */
+	flow->created = age_to_jiffies(now, rec->created_age);
+	flow->used = age_to_jiffies(now, rec->used_age);
+	flow->packet_count = be64_to_cpu(rec->packet_count);
+	flow->byte_count = be64_to_cpu(rec->byte_count);
+
+	error = chain_insert(chain, flow, flow->emerg_flow);
+	if (error)
+		flow_free(flow);
+	return error;
+}
+
+/***
+ * Install each flow record in an OFP_EXT_FLOW_IMPORT message, sending an
+ * error that carries the record for each one that cannot be installed
+ */
+static int
+recv_flow_import(struct sw_chain *chain, const struct sender *sender,
+		 const struct ofp_extension_header *exth)
+{
+	const struct ofp_ext_flow_import *ofi = (const void *) exth;
+	const uint8_t *p = (const uint8_t *) ofi->records;
+	const uint8_t *end = (const uint8_t *) ofi + ntohs(exth->header.length);
+	uint64_t now = get_jiffies_64();
+
+	while (p < end) {
+		const struct ofp_ext_flow_record *rec = (const void *) p;
+		size_t length = end - p >= sizeof *rec ? ntohs(rec->length) : 0;
+		int error;
+
+		if (length < sizeof *rec || length % 8 || length > end - p) {
+			dp_send_error_msg(chain->dp, sender, OFPET_BAD_REQUEST,
+					  OFPBRC_BAD_LEN, exth,
+					  ntohs(exth->header.length));
+			return -EINVAL;
+		}
+
+		error = import_flow(chain, rec, length - sizeof *rec, now);
+		if (error == -ENOBUFS)
+			dp_send_error_msg(chain->dp, sender,
+					  OFPET_FLOW_MOD_FAILED,
+					  OFPFMFC_ALL_TABLES_FULL, rec, length);
+		else if (error == -EINVAL)
+			dp_send_error_msg(chain->dp, sender, OFPET_BAD_ACTION,
+					  OFPBAC_BAD_ARGUMENT, rec, length);
+		else if (error)
+			dp_send_error_msg(chain->dp, sender,
+					  OFPET_FLOW_MOD_FAILED,
+					  OFPFMFC_EPERM, rec, length);
+		p += length;
+	}
+	return 0;
+}
+
+/* State of an OFP_EXT_STATS_FLOW_EXPORT dump. */
+struct flow_export_state {
+	uint32_t vendor;	/* OPENFLOW_VENDOR_ID, as vendor_stats_*()
+				 * require. */
+	int table_idx;		/* Chain table, or n_tables for emergency. */
+	struct sw_table_position position;
+	int emerg;
+
+	uint64_t now;
+	void *body;
+	int bytes_used, bytes_allocated;
+};
+
+int
+openflow_ext_stats_init(struct datapath *dp, const void *body, int body_len,
+			void **state)
+{
+	const struct ofp_extension_stats_header *esh = body;
+	struct flow_export_state *s;
+
+	if (ntohl(esh->subtype) != OFP_EXT_STATS_FLOW_EXPORT)
+		return -EINVAL;
+
+	s = kzalloc(sizeof *s, GFP_ATOMIC);
+	if (!s)
+		return -ENOMEM;
+	s->vendor = OPENFLOW_VENDOR_ID;
+	*state = s;
+	return 0;
+}
+
+static int
+flow_export_callback(struct sw_flow *flow, void *private)
+{
+	struct sw_flow_actions *sf_acts = rcu_dereference(flow->sf_acts);
+	struct flow_export_state *s = private;
+	struct ofp_ext_flow_record *rec;
+	uint64_t packet_count, byte_count;
+	int length;
+
+	length = sizeof *rec + ALIGN(sf_acts->actions_len, 8);
+	if (length + s->bytes_used > s->bytes_allocated)
+		return 1;
+
+	rec = s->body + s->bytes_used;
+	memset(rec, 0, length);
+	rec->length = htons(length);
+	rec->emerg = s->emerg;
+	rec->send_flow_rem = flow->send_flow_rem;
+	rec->priority = htons(flow->priority);
+	rec->idle_timeout = htons(flow->idle_timeout);
+	rec->hard_timeout = htons(flow->hard_timeout);
+	rec->created_age = cpu_to_be64(age_msecs(s->now, flow->created));
+	rec->used_age = cpu_to_be64(age_msecs(s->now, flow->used));
+	flow_get_stats(flow, &packet_count, &byte_count);
+	rec->packet_count = cpu_to_be64(packet_count);
+	rec->byte_count = cpu_to_be64(byte_count);
+	flow_fill_match(&rec->match, &flow->key);
+	memcpy(rec->actions, sf_acts->actions, sf_acts->actions_len);
+
+	s->bytes_used += length;
+	return 0;
+}
+
+int
+openflow_ext_stats_dump(struct datapath *dp, void *state, void *body,
+			int *body_len)
+{
+	struct flow_export_state *s = state;
+	struct ofp_ext_flow_export *ofe = body;
+	struct sw_chain *chain = dp->chain;
+	struct sw_flow_key match_key;
+	int error = 0;
+
+	if (*body_len < sizeof *ofe)
+		return -ENOMEM;
+	ofe->header.vendor = htonl(OPENFLOW_VENDOR_ID);
+	ofe->header.subtype = htonl(OFP_EXT_STATS_FLOW_EXPORT);
+
+	s->body = body;
+	s->bytes_used = sizeof *ofe;
+	s->bytes_allocated = *body_len;
+	s->now = get_jiffies_64();
+
+	memset(&match_key, 0, sizeof match_key);
+	match_key.wildcards = OFPFW_ALL;
+	while (s->table_idx <= chain->n_tables) {
+		struct sw_table *table = (s->table_idx < chain->n_tables
+					  ? chain->tables[s->table_idx]
+					  : chain->emerg_table);
+
+		s->emerg = table == chain->emerg_table;
+		error = table->iterate(table, &match_key, htons(OFPP_NONE),
+				       &s->position, flow_export_callback, s);
+		if (error)
+			break;
+
+		s->table_idx++;
+		memset(&s->position, 0, sizeof s->position);
+	}
+	*body_len = s->bytes_used;
+
+	/* As in flow_stats_dump(), give up if not even one flow fit. */
+	return !error ? 0 : s->bytes_used > sizeof *ofe ? 1 : -ENOMEM;
+}
+
+void
+openflow_ext_stats_done(void *state)
+{
+	kfree(state);
+}
 
 int
 openflow_ext_recv_msg(struct sw_chain *chain, const struct sender *sender,
@@ -73,6 +289,8 @@ openflow_ext_recv_msg(struct sw_chain *chain, const struct sender *sender,
          */
         case OFP_EXT_SET_DESC:
             return recv_of_set_dp_desc(chain->dp,sender,ofexth);
+        case OFP_EXT_FLOW_IMPORT:
+            return recv_flow_import(chain, sender, &ofexth->header);
         default:
            VLOG_ERR("Received unknown command of type %d",
                    ntohl(ofexth->header.subtype));
@@ -35,4 +35,10 @@
 
 int openflow_ext_recv_msg(struct sw_chain *, const struct sender *, const void *);
 
+int openflow_ext_stats_init(struct datapath *, const void *body, int body_len,
+			    void **state);
+int openflow_ext_stats_dump(struct datapath *, void *state, void *body,
+			    int *body_len);
+void openflow_ext_stats_done(void *state);
+
 #endif
@@ -121,6 +121,9 @@ private_recv_msg(struct sw_chain *chain, const struct sender *sender,
 	case PRIVATEOPT_PROTOCOL_STATS_REQUEST:
 	case PRIVATEOPT_PROTOCOL_STATS_REPLY:
 		break;
+	case PRIVATEOPT_PROCESSING_STATS_REQUEST:
+		error = dp_send_processing_stats(chain->dp, sender);
+		break;
 	case PRIVATEOPT_EMERG_FLOW_PROTECTION:
 		flush_working(chain);
 		do_protection(chain);
@@ -13,27 +13,204 @@
 #include <linux/vmalloc.h>
 #include <linux/mm.h>
 #include <linux/highmem.h>
+#include <linux/completion.h>
+#include <linux/cpumask.h>
+#include <linux/workqueue.h>
+#include <linux/bitops.h>
+#include <asm/atomic.h>
+#include <asm/div64.h>
 #include <asm/pgtable.h>
 
 static void *kmem_alloc(size_t);
 static void *kmem_zalloc(size_t);
 static void kmem_free(void *, size_t);
 
+/* Flows that can time out are kept on a hashed timer wheel, so that timeout
+ * processing only has to look at the flows that might have expired instead of
+ * every bucket.  Slot 'tick & EXPIRY_MASK' holds the flows whose earliest
+ * possible expiration falls in second 'tick' (counting seconds as jiffies_64 /
+ * HZ), or in some later second that maps to the same slot.  The wheel is
+ * protected by dp_mutex and linked through each flow's 'node'. */
+#define EXPIRY_SLOTS 256	/* Must be power of 2. */
+#define EXPIRY_MASK (EXPIRY_SLOTS - 1)
+
+/* Hash tables start out with this many buckets (or their maximum, if that is
+ * smaller), grow as flows are added and shrink again as they go away. */
+#define HASH_MIN_BUCKETS 1024
+
+/* Aggregate statistics scan a table with one worker per online CPU, each
+ * taking a contiguous range of buckets, but give each worker at least this
+ * many buckets, so that small tables are scanned by the caller alone. */
+#define SCAN_MIN_BUCKETS 16384
+
+/* A table's array of buckets.  Resizing a table builds a new array and then
+ * replaces the old one with rcu_assign_pointer(), so that readers always see
+ * one complete array or the other.
+ *
+ * 'live' has a 1-bit for each nonnull bucket, so that scans of the whole
+ * table, such as flow stats dumps, can skip from one flow to the next with
+ * find_next_bit() instead of reading every empty bucket.  A bit is set after
+ * its bucket is filled and cleared after it is emptied, so a reader that
+ * finds a bit set must still check the bucket. */
+struct hash_buckets {
+	unsigned int mask;	/* Number of buckets minus 1. */
+	unsigned long *live;	/* Occupancy bitmap, stored after 'flows'. */
+	struct sw_flow *flows[0];
+};
+
+/* Iterates 'I' over the indexes of the buckets in 'B', starting from 'START'
+ * and stopping before 'END', whose bits in B->live are set. */
+#define FOR_EACH_LIVE_BUCKET(I, B, START, END)				\
+	for ((I) = find_next_bit((B)->live, (END), (START)); (I) < (END);	\
+	     (I) = find_next_bit((B)->live, (END), (I) + 1))
+
 struct sw_table_hash {
 	struct sw_table swt;
 	struct crc32 crc32;
 	unsigned int n_flows;
-	unsigned int bucket_mask; /* Number of buckets minus 1. */
-	struct sw_flow **buckets;
+	unsigned int max_buckets; /* Most buckets that the table may grow to. */
+	struct hash_buckets *buckets; /* RCU-protected. */
+
+	struct list_head expiry[EXPIRY_SLOTS];
+	uint64_t expiry_clock;	/* Next tick to process. */
 };
 
+static uint64_t expiry_tick(uint64_t j)
+{
+	do_div(j, HZ);
+	return j;
+}
+
+/* Puts 'flow' on the timer wheel of 'th' according to the earliest time at
+ * which it could expire, or leaves it off the wheel if it never expires. */
+static void expiry_schedule(struct sw_table_hash *th, struct sw_flow *flow)
+{
+	uint64_t deadline = 0;
+	uint64_t tick;
+
+	if (flow->idle_timeout != OFP_FLOW_PERMANENT)
+		deadline = flow->used + flow->idle_timeout * HZ + 1;
+	if (flow->hard_timeout != OFP_FLOW_PERMANENT) {
+		uint64_t hard = flow->created + flow->hard_timeout * HZ + 1;
+		if (!deadline || time_before64(hard, deadline))
+			deadline = hard;
+	}
+	if (!deadline) {
+		INIT_LIST_HEAD(&flow->node);
+		return;
+	}
+
+	tick = expiry_tick(deadline);
+	if (tick < th->expiry_clock)
+		tick = th->expiry_clock;
+	list_add_tail(&flow->node, &th->expiry[tick & EXPIRY_MASK]);
+}
+
 static struct sw_flow **find_bucket(struct sw_table *swt,
 									const struct sw_flow_key *key)
 {
 	struct sw_table_hash *th = (struct sw_table_hash *) swt;
+	struct hash_buckets *b = rcu_dereference(th->buckets);
 	unsigned int crc = crc32_calculate(&th->crc32, key, 
 				offsetof(struct sw_flow_key, wildcards));
-	return &th->buckets[crc & th->bucket_mask];
+	return &b->flows[crc & b->mask];
+}
+
+static size_t buckets_size(unsigned int n_buckets)
+{
+	return (sizeof(struct hash_buckets) + n_buckets * sizeof(struct sw_flow *)
+		+ BITS_TO_LONGS(n_buckets) * sizeof(unsigned long));
+}
+
+static struct hash_buckets *buckets_alloc(unsigned int n_buckets)
+{
+	struct hash_buckets *b = kmem_zalloc(buckets_size(n_buckets));
+	if (b) {
+		b->mask = n_buckets - 1;
+		b->live = (unsigned long *) &b->flows[n_buckets];
+	}
+	return b;
+}
+
+/* Stores 'flow', which may be null, in 'bucket', one of the buckets in 'th''s
+ * current array, and updates the array's occupancy bitmap to match.  Caller
+ * must hold dp_mutex. */
+static void bucket_set(struct sw_table_hash *th, struct sw_flow **bucket,
+		       struct sw_flow *flow)
+{
+	struct hash_buckets *b = th->buckets;
+	unsigned int idx = bucket - b->flows;
+
+	rcu_assign_pointer(*bucket, flow);
+	if (flow)
+		__set_bit(idx, b->live);
+	else
+		__clear_bit(idx, b->live);
+}
+
+static void buckets_free(struct hash_buckets *b)
+{
+	kmem_free(b, buckets_size(b->mask + 1));
+}
+
+/* Moves all the flows in 'th' into a new array of 'n_buckets' buckets.  Fails,
+ * leaving 'th' unchanged, if memory is short or if two flows would fall into
+ * the same bucket, which can happen only when shrinking.  Returns 1 if
+ * successful, 0 on failure.
+ *
+ * Lookups proceed in parallel, in the old array until the new one is in
+ * place.  Caller must hold dp_mutex, which keeps the flows in 'th' from
+ * changing, and must be able to sleep. */
+static int table_hash_resize(struct sw_table_hash *th, unsigned int n_buckets)
+{
+	struct hash_buckets *old = th->buckets;
+	struct hash_buckets *new;
+	unsigned int i;
+
+	new = buckets_alloc(n_buckets);
+	if (!new)
+		return 0;
+	FOR_EACH_LIVE_BUCKET (i, old, 0, old->mask + 1) {
+		struct sw_flow *flow = old->flows[i];
+		if (flow) {
+			unsigned int crc = crc32_calculate(&th->crc32, &flow->key,
+					offsetof(struct sw_flow_key, wildcards));
+			unsigned int idx = crc & new->mask;
+			if (new->flows[idx]) {
+				buckets_free(new);
+				return 0;
+			}
+			new->flows[idx] = flow;
+			__set_bit(idx, new->live);
+		}
+	}
+
+	rcu_assign_pointer(th->buckets, new);
+	synchronize_rcu();
+	buckets_free(old);
+	return 1;
+}
+
+/* Doubles the number of buckets in 'th', which never puts two flows in one
+ * bucket because each old bucket splits into two new ones.  Returns 1 if
+ * successful, 0 if 'th' is already at its maximum size or memory is short. */
+static int table_hash_grow(struct sw_table_hash *th)
+{
+	unsigned int n_buckets = th->buckets->mask + 1;
+
+	if (n_buckets >= th->max_buckets)
+		return 0;
+	return table_hash_resize(th, n_buckets * 2);
+}
+
+/* Halves the number of buckets in 'th' if it is less than 1/8 full and the
+ * flows still fit. */
+static void table_hash_maybe_shrink(struct sw_table_hash *th)
+{
+	unsigned int n_buckets = th->buckets->mask + 1;
+
+	if (n_buckets > HASH_MIN_BUCKETS && th->n_flows < n_buckets / 8)
+		table_hash_resize(th, n_buckets / 2);
 }
 
 static struct sw_flow *table_hash_lookup(struct sw_table *swt,
@@ -43,24 +220,24 @@ static struct sw_flow *table_hash_lookup(struct sw_table *swt,
 	return flow && flow_keys_equal(&flow->key, key) ? flow : NULL;
 }
 
-static int table_hash_insert(struct sw_table *swt, struct sw_flow *flow)
+static int table_hash_try_insert(struct sw_table *swt, struct sw_flow *flow)
 {
 	struct sw_table_hash *th = (struct sw_table_hash *) swt;
 	struct sw_flow **bucket;
 	int retval;
 
-	if (flow->key.wildcards != 0)
-		return 0;
-
 	bucket = find_bucket(swt, &flow->key);
 	if (*bucket == NULL) {
 		th->n_flows++;
-		rcu_assign_pointer(*bucket, flow);
+		bucket_set(th, bucket, flow);
+		expiry_schedule(th, flow);
 		retval = 1;
 	} else {
 		struct sw_flow *old_flow = *bucket;
 		if (flow_keys_equal(&old_flow->key, &flow->key)) {
-			rcu_assign_pointer(*bucket, flow);
+			bucket_set(th, bucket, flow);
+			list_del(&old_flow->node);
+			expiry_schedule(th, flow);
 			flow_deferred_free(old_flow);
 			retval = 1;
 		} else {
@@ -70,6 +247,29 @@ static int table_hash_insert(struct sw_table *swt, struct sw_flow *flow)
 	return retval;
 }
 
+/* Grows 'th' ahead of time once it is half full, since with one flow per
+ * bucket collisions become common beyond that. */
+static void table_hash_make_room(struct sw_table_hash *th)
+{
+	if (th->n_flows >= (th->buckets->mask + 1) / 2)
+		table_hash_grow(th);
+}
+
+static int table_hash_insert(struct sw_table *swt, struct sw_flow *flow)
+{
+	struct sw_table_hash *th = (struct sw_table_hash *) swt;
+
+	if (flow->key.wildcards != 0)
+		return 0;
+
+	table_hash_make_room(th);
+	do {
+		if (table_hash_try_insert(swt, flow))
+			return 1;
+	} while (table_hash_grow(th));
+	return 0;
+}
+
 static int table_hash_modify(struct sw_table *swt, 
 		const struct sw_flow_key *key, uint16_t priority, int strict,
 		const struct ofp_action_header *actions, size_t actions_len) 
@@ -88,8 +288,8 @@ static int table_hash_modify(struct sw_table *swt,
 	} else {
 		unsigned int i;
 
-		for (i = 0; i <= th->bucket_mask; i++) {
-			struct sw_flow **bucket = &th->buckets[i];
+		FOR_EACH_LIVE_BUCKET (i, th->buckets, 0, th->buckets->mask + 1) {
+			struct sw_flow **bucket = &th->buckets->flows[i];
 			struct sw_flow *flow = *bucket;
 			if (flow && flow_matches_desc(&flow->key, key, strict)
 					&& (!strict || (flow->priority == priority))) {
@@ -117,8 +317,8 @@ static int table_hash_has_conflict(struct sw_table *swt,
 	} else {
 		unsigned int i;
 
-		for (i = 0; i <= th->bucket_mask; i++) {
-			struct sw_flow **bucket = &th->buckets[i];
+		FOR_EACH_LIVE_BUCKET (i, th->buckets, 0, th->buckets->mask + 1) {
+			struct sw_flow **bucket = &th->buckets->flows[i];
 			struct sw_flow *flow = *bucket;
 			if (flow && flow_matches_2desc(&flow->key, key, strict)
 			    && (flow->priority == priority)) {
@@ -130,11 +330,13 @@ static int table_hash_has_conflict(struct sw_table *swt,
 }
 
 /* Caller must update n_flows. */
-static int do_delete(struct datapath *dp, struct sw_flow **bucket, 
-			struct sw_flow *flow, enum ofp_flow_removed_reason reason)
+static int do_delete(struct datapath *dp, struct sw_table_hash *th,
+			struct sw_flow **bucket, struct sw_flow *flow,
+			enum ofp_flow_removed_reason reason)
 {
 	dp_send_flow_end(dp, flow, reason);
-	rcu_assign_pointer(*bucket, NULL);
+	bucket_set(th, bucket, NULL);
+	list_del(&flow->node);
 	flow_deferred_free(flow);
 	return 1;
 }
@@ -154,54 +356,218 @@ static int table_hash_delete(struct datapath *dp, struct sw_table *swt,
 		struct sw_flow *flow = *bucket;
 		if (flow && flow_keys_equal(&flow->key, key)
 				&& flow_has_out_port(flow, out_port)) 
-			count = do_delete(dp, bucket, flow, OFPRR_DELETE);
+			count = do_delete(dp, th, bucket, flow, OFPRR_DELETE);
 	} else {
 		unsigned int i;
 
-		for (i = 0; i <= th->bucket_mask; i++) {
-			struct sw_flow **bucket = &th->buckets[i];
+		FOR_EACH_LIVE_BUCKET (i, th->buckets, 0, th->buckets->mask + 1) {
+			struct sw_flow **bucket = &th->buckets->flows[i];
 			struct sw_flow *flow = *bucket;
 			if (flow && flow_matches_desc(&flow->key, key, strict)
 					&& flow_has_out_port(flow, out_port))
-				count += do_delete(dp, bucket, flow, OFPRR_DELETE);
+				count += do_delete(dp, th, bucket, flow,
+						   OFPRR_DELETE);
 		}
 	}
 	th->n_flows -= count;
 	return count;
 }
 
+/* Expires the flows in each timer wheel slot whose time has come, and moves
+ * the ones that turn out not to have expired (because they were used since
+ * they were scheduled, or because their deadline is a later lap of the wheel)
+ * to the slot for their new deadline.  dp_mutex is taken separately for each
+ * slot, so that flow table modifications can get in between. */
 static int table_hash_timeout(struct datapath *dp, struct sw_table *swt)
 {
 	struct sw_table_hash *th = (struct sw_table_hash *) swt;
-	unsigned int i;
+	uint64_t now = expiry_tick(get_jiffies_64());
 	int count = 0;
 
-	if (mutex_lock_interruptible(&dp_mutex))
-		return 0;
-	for (i = 0; i <= th->bucket_mask; i++) {
-		struct sw_flow **bucket = &th->buckets[i];
-		struct sw_flow *flow = *bucket;
-		if (flow) {
+	for (;;) {
+		LIST_HEAD(due);
+
+		if (mutex_lock_interruptible(&dp_mutex))
+			break;
+		if (th->expiry_clock > now) {
+			table_hash_maybe_shrink(th);
+			mutex_unlock(&dp_mutex);
+			break;
+		}
+		if (now - th->expiry_clock >= EXPIRY_SLOTS) {
+			/* We fell more than a lap behind.  One lap visits every
+			 * slot, which is enough. */
+			th->expiry_clock = now - EXPIRY_SLOTS + 1;
+		}
+
+		list_splice_init(&th->expiry[th->expiry_clock & EXPIRY_MASK],
+				 &due);
+		th->expiry_clock++;
+		while (!list_empty(&due)) {
+			struct sw_flow *flow = list_entry(due.next,
+							  struct sw_flow, node);
 			int reason = flow_timeout(flow);
 			if (reason >= 0) {
-				count += do_delete(dp, bucket, flow, reason); 
+				struct sw_flow **bucket;
+
+				bucket = find_bucket(swt, &flow->key);
+				count += do_delete(dp, th, bucket, flow, reason);
+				th->n_flows--;
+			} else {
+				list_del(&flow->node);
+				expiry_schedule(th, flow);
 			}
 		}
+		mutex_unlock(&dp_mutex);
+
+		cond_resched();
 	}
-	th->n_flows -= count;
-	mutex_unlock(&dp_mutex);
 
 	return count;
 }
 
+/* Adds the counters of the flows in buckets 'start' through 'end - 1' of 'b'
+ * that match 'key' and output to 'out_port' to 'totals'. */
+static void aggregate_range(struct hash_buckets *b, unsigned int start,
+			    unsigned int end, const struct sw_flow_key *key,
+			    uint16_t out_port, struct sw_table_totals *totals)
+{
+	unsigned int i;
+
+	FOR_EACH_LIVE_BUCKET (i, b, start, end) {
+		struct sw_flow *flow = rcu_dereference(b->flows[i]);
+		if (flow && flow_matches_1wild(&flow->key, key)
+				&& flow_has_out_port(flow, out_port)) {
+			uint64_t packet_count, byte_count;
+
+			flow_get_stats(flow, &packet_count, &byte_count);
+			totals->packet_count += packet_count;
+			totals->byte_count += byte_count;
+			totals->flow_count++;
+		}
+	}
+}
+
+/* A parallel aggregate scan of a table, shared by its workers. */
+struct hash_scan {
+	struct hash_buckets *buckets;
+	const struct sw_flow_key *key;
+	uint16_t out_port;
+	atomic_t pending;		/* Workers not yet finished. */
+	struct completion done;		/* Completed by the last worker. */
+};
+
+/* One worker's share of a 'struct hash_scan'. */
+struct hash_scan_worker {
+	struct work_struct work;
+	struct hash_scan *scan;
+	unsigned int start, end;	/* Range of buckets to scan. */
+	struct sw_table_totals totals;	/* This worker's sums. */
+};
+
+static void hash_scan_work(struct work_struct *work)
+{
+	struct hash_scan_worker *w = container_of(work, struct hash_scan_worker,
+						  work);
+	struct hash_scan *scan = w->scan;
+
+	rcu_read_lock();
+	aggregate_range(scan->buckets, w->start, w->end, scan->key,
+			scan->out_port, &w->totals);
+	rcu_read_unlock();
+	if (atomic_dec_and_test(&scan->pending))
+		complete(&scan->done);
+}
+
+/* Sums the matching flows' counters with one keventd worker per online CPU,
+ * each scanning its own range of buckets, and then merges the workers'
+ * totals.  The caller's dp_mutex keeps the bucket array from being resized
+ * out from under the workers.  No work queued on keventd by this module
+ * takes dp_mutex, so waiting for the workers while holding it is safe. */
+static void table_hash_aggregate(struct sw_table *swt,
+				 const struct sw_flow_key *key,
+				 uint16_t out_port,
+				 struct sw_table_totals *totals)
+{
+	struct sw_table_hash *th = (struct sw_table_hash *) swt;
+	struct hash_buckets *b = th->buckets;
+	unsigned int n_buckets = b->mask + 1;
+	struct hash_scan_worker *workers;
+	struct hash_scan scan;
+	unsigned int n_workers, per_worker, i;
+	int cpu;
+
+	if (key->wildcards == 0) {
+		struct sw_flow *flow;
+
+		rcu_read_lock();
+		flow = table_hash_lookup(swt, key);
+		if (flow && flow_has_out_port(flow, out_port)) {
+			uint64_t packet_count, byte_count;
+
+			flow_get_stats(flow, &packet_count, &byte_count);
+			totals->packet_count += packet_count;
+			totals->byte_count += byte_count;
+			totals->flow_count++;
+		}
+		rcu_read_unlock();
+		return;
+	}
+
+	n_workers = min_t(unsigned int, num_online_cpus(),
+			  n_buckets / SCAN_MIN_BUCKETS);
+	workers = (n_workers > 1
+		   ? kcalloc(n_workers, sizeof *workers, GFP_KERNEL)
+		   : NULL);
+	if (!workers) {
+		rcu_read_lock();
+		aggregate_range(b, 0, n_buckets, key, out_port, totals);
+		rcu_read_unlock();
+		return;
+	}
+
+	scan.buckets = b;
+	scan.key = key;
+	scan.out_port = out_port;
+	atomic_set(&scan.pending, n_workers);
+	init_completion(&scan.done);
+
+	per_worker = n_buckets / n_workers;
+	for (i = 0; i < n_workers; i++) {
+		struct hash_scan_worker *w = &workers[i];
+		w->scan = &scan;
+		w->start = i * per_worker;
+		w->end = i == n_workers - 1 ? n_buckets : w->start + per_worker;
+		INIT_WORK(&w->work, hash_scan_work);
+	}
+
+	i = 0;
+	for_each_online_cpu(cpu) {
+		if (i >= n_workers)
+			break;
+		schedule_work_on(cpu, &workers[i++].work);
+	}
+	/* CPUs may have gone offline since they were counted.  Do the
+	 * leftover ranges here. */
+	while (i < n_workers)
+		hash_scan_work(&workers[i++].work);
+	wait_for_completion(&scan.done);
+
+	for (i = 0; i < n_workers; i++) {
+		totals->packet_count += workers[i].totals.packet_count;
+		totals->byte_count += workers[i].totals.byte_count;
+		totals->flow_count += workers[i].totals.flow_count;
+	}
+	kfree(workers);
+}
+
 static void table_hash_destroy(struct sw_table *swt)
 {
 	struct sw_table_hash *th = (struct sw_table_hash *) swt;
 	unsigned int i;
-	for (i = 0; i <= th->bucket_mask; i++)
-	if (th->buckets[i])
-		flow_free(th->buckets[i]);
-	kmem_free(th->buckets, (th->bucket_mask + 1) * sizeof *th->buckets);
+	FOR_EACH_LIVE_BUCKET (i, th->buckets, 0, th->buckets->mask + 1)
+		flow_free(th->buckets->flows[i]);
+	buckets_free(th->buckets);
 	kfree(th);
 }
 
@@ -212,8 +578,11 @@ static int table_hash_iterate(struct sw_table *swt,
 			      void *private) 
 {
 	struct sw_table_hash *th = (struct sw_table_hash *) swt;
+	struct hash_buckets *b = rcu_dereference(th->buckets);
 
-	if (position->private[0] > th->bucket_mask)
+	/* If the table is resized between calls, 'position' refers to a bucket
+	 * in the new array, so some flows may be visited twice or not at all. */
+	if (position->private[0] > b->mask)
 		return 0;
 
 	if (key->wildcards == 0) {
@@ -229,10 +598,10 @@ static int table_hash_iterate(struct sw_table *swt,
 			position->private[0] = -1;
 		return error;
 	} else {
-		int i;
+		unsigned int i;
 
-		for (i = position->private[0]; i <= th->bucket_mask; i++) {
-			struct sw_flow *flow = th->buckets[i];
+		FOR_EACH_LIVE_BUCKET (i, b, position->private[0], b->mask + 1) {
+			struct sw_flow *flow = rcu_dereference(b->flows[i]);
 			if (flow && flow_matches_1wild(&flow->key, key)
 					&& flow_has_out_port(flow, out_port)) {
 				int error = callback(flow, private);
@@ -252,7 +621,7 @@ static void table_hash_stats(struct sw_table *swt,
 	stats->name = "hash";
 	stats->wildcards = 0;          /* No wildcards are supported. */
 	stats->n_flows   = th->n_flows;
-	stats->max_flows = th->bucket_mask + 1;
+	stats->max_flows = th->max_buckets;
 	stats->n_lookup  = swt->n_lookup;
 	stats->n_matched = swt->n_matched;
 }
@@ -262,20 +631,25 @@ struct sw_table *table_hash_create(unsigned int polynomial,
 {
 	struct sw_table_hash *th;
 	struct sw_table *swt;
+	int i;
 
 	th = kzalloc(sizeof *th, GFP_KERNEL);
 	if (th == NULL)
 		return NULL;
 
 	BUG_ON(n_buckets & (n_buckets - 1));
-	th->buckets = kmem_zalloc(n_buckets * sizeof *th->buckets);
+	th->max_buckets = n_buckets;
+	n_buckets = min(n_buckets, (unsigned int) HASH_MIN_BUCKETS);
+	th->buckets = buckets_alloc(n_buckets);
 	if (th->buckets == NULL) {
 		printk(KERN_EMERG "failed to allocate %u buckets\n",
 		       n_buckets);
 		kfree(th);
 		return NULL;
 	}
-	th->bucket_mask = n_buckets - 1;
+	for (i = 0; i < EXPIRY_SLOTS; i++)
+		INIT_LIST_HEAD(&th->expiry[i]);
+	th->expiry_clock = expiry_tick(get_jiffies_64());
 
 	swt = &th->swt;
 	swt->lookup = table_hash_lookup;
@@ -285,6 +659,7 @@ struct sw_table *table_hash_create(unsigned int polynomial,
 	swt->timeout = table_hash_timeout;
 	swt->destroy = table_hash_destroy;
 	swt->iterate = table_hash_iterate;
+	swt->aggregate = table_hash_aggregate;
 	swt->stats = table_hash_stats;
 
 	crc32_init(&th->crc32, polynomial);
@@ -317,10 +692,34 @@ static struct sw_flow *table_hash2_lookup(struct sw_table *swt,
 static int table_hash2_insert(struct sw_table *swt, struct sw_flow *flow)
 {
 	struct sw_table_hash2 *t2 = (struct sw_table_hash2 *) swt;
+	struct sw_table_hash *th[2];
+	int i;
 
-	if (table_hash_insert(t2->subtable[0], flow))
-		return 1;
-	return table_hash_insert(t2->subtable[1], flow);
+	if (flow->key.wildcards != 0)
+		return 0;
+
+	for (i = 0; i < 2; i++) {
+		th[i] = (struct sw_table_hash *) t2->subtable[i];
+		table_hash_make_room(th[i]);
+	}
+
+	/* A flow with the same key is replaced wherever it is. */
+	for (i = 0; i < 2; i++) {
+		struct sw_flow *old_flow = *find_bucket(t2->subtable[i], &flow->key);
+		if (old_flow && flow_keys_equal(&old_flow->key, &flow->key))
+			return table_hash_try_insert(t2->subtable[i], flow);
+	}
+
+	/* If the flow collides in both subtables, grow the smaller one, which
+	 * splits the colliding bucket in two, and try again. */
+	for (;;) {
+		if (table_hash_try_insert(t2->subtable[0], flow)
+		    || table_hash_try_insert(t2->subtable[1], flow))
+			return 1;
+		i = th[1]->buckets->mask < th[0]->buckets->mask;
+		if (!table_hash_grow(th[i]) && !table_hash_grow(th[!i]))
+			return 0;
+	}
 }
 
 static int table_hash2_modify(struct sw_table *swt, 
@@ -362,6 +761,16 @@ static int table_hash2_timeout(struct datapath *dp, struct sw_table *swt)
 			+ table_hash_timeout(dp, t2->subtable[1]));
 }
 
+static void table_hash2_aggregate(struct sw_table *swt,
+				  const struct sw_flow_key *key,
+				  uint16_t out_port,
+				  struct sw_table_totals *totals)
+{
+	struct sw_table_hash2 *t2 = (struct sw_table_hash2 *) swt;
+	table_hash_aggregate(t2->subtable[0], key, out_port, totals);
+	table_hash_aggregate(t2->subtable[1], key, out_port, totals);
+}
+
 static void table_hash2_destroy(struct sw_table *swt)
 {
 	struct sw_table_hash2 *t2 = (struct sw_table_hash2 *) swt;
@@ -436,6 +845,7 @@ struct sw_table *table_hash2_create(unsigned int poly0, unsigned int buckets0,
 	swt->timeout = table_hash2_timeout;
 	swt->destroy = table_hash2_destroy;
 	swt->iterate = table_hash2_iterate;
+	swt->aggregate = table_hash2_aggregate;
 	swt->stats = table_hash2_stats;
 
 	return swt;
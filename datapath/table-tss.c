@@ -0,0 +1,601 @@
+/*
+ * Distributed under the terms of the GNU GPL version 2.
+ * Copyright (c) 2007, 2008, 2009 The Board of Trustees of The Leland
+ * Stanford Junior University
+ */
+
+/* Tuple space search table.
+ *
+ * Flows are grouped into subtables by their wildcards, which determine a mask
+ * over the flow key.  Each subtable is an open-addressed hash table of
+ * pointers to its flows, keyed on the masked key, so a lookup costs one hash
+ * probe per distinct set of wildcards rather than one comparison per flow.
+ *
+ * Readers run in softirq context under rcu_read_lock, so nothing that they
+ * can reach is ever modified in a way that could confuse a lookup in
+ * progress:
+ *
+ *   - Deleting a flow overwrites its slot with TSS_DELETED rather than
+ *     shifting other flows, and a subtable only grows by building a new slot
+ *     array, publishing it, and freeing the old one after a grace period.
+ *
+ *   - The subtables are listed in an array sorted by decreasing priority of
+ *     the flows that they hold, so that a lookup can stop as soon as no
+ *     remaining subtable could hold a better match.  The array is also
+ *     replaced as a whole, and it records each subtable's maximum priority
+ *     as of when it was built.
+ *
+ * Writers hold dp_mutex. */
+
+#include "table.h"
+#include "flow.h"
+#include "datapath.h"
+
+#include <linux/jhash.h>
+#include <linux/rcupdate.h>
+#include <linux/rculist.h>
+#include <linux/slab.h>
+
+/* Marks a slot whose flow was deleted.  Lookups probe past it. */
+#define TSS_DELETED ((struct sw_flow *) 1)
+
+/* Fewest slots in a subtable.  A subtable is rebuilt when more than half of
+ * its slots are in use, so that every probe sequence ends at a null slot, and
+ * is then sized to be at most a quarter full. */
+#define TSS_MIN_SLOTS 16
+
+struct tss_slots {
+	struct rcu_head rcu;
+	unsigned int mask;		/* Number of slots, minus 1. */
+	struct sw_flow *slots[];
+};
+
+struct tss_subtable {
+	struct rcu_head rcu;
+	uint32_t wildcards;		/* Wildcards of every flow here. */
+	struct sw_flow_key mask;	/* 1-bits in each significant key bit. */
+	struct tss_slots *slots;	/* RCU-protected. */
+	unsigned int n_flows;
+	unsigned int n_used;		/* Slots holding flows or TSS_DELETED. */
+	uint16_t max_priority;		/* Highest priority of any flow here. */
+	int max_stale;			/* Might 'max_priority' be too high? */
+};
+
+/* Snapshot of the subtables, in decreasing order of 'max_priority'. */
+struct tss_index {
+	struct rcu_head rcu;
+	unsigned int n;
+	struct tss_entry {
+		uint16_t max_priority;
+		struct tss_subtable *st;
+	} entries[];
+};
+
+struct sw_table_tss {
+	struct sw_table swt;
+
+	unsigned int max_flows;
+	unsigned int n_flows;
+	struct tss_index *index;	/* RCU-protected, or NULL if no flows. */
+	int dirty;			/* Does 'index' need to be rebuilt? */
+	struct list_head iter_flows;
+	unsigned long int next_serial;
+};
+
+static void tss_make_mask(const struct sw_flow_key *key,
+			  struct sw_flow_key *mask)
+{
+	uint32_t w = key->wildcards;
+
+	memset(mask, 0, sizeof *mask);
+	mask->nw_src = key->nw_src_mask;
+	mask->nw_dst = key->nw_dst_mask;
+	if (!(w & OFPFW_IN_PORT))
+		mask->in_port = 0xffff;
+	if (!(w & OFPFW_DL_VLAN))
+		mask->dl_vlan = 0xffff;
+	if (!(w & OFPFW_DL_TYPE))
+		mask->dl_type = 0xffff;
+	if (!(w & OFPFW_TP_SRC))
+		mask->tp_src = 0xffff;
+	if (!(w & OFPFW_TP_DST))
+		mask->tp_dst = 0xffff;
+	if (!(w & OFPFW_DL_SRC))
+		memset(mask->dl_src, 0xff, ETH_ALEN);
+	if (!(w & OFPFW_DL_DST))
+		memset(mask->dl_dst, 0xff, ETH_ALEN);
+	if (!(w & OFPFW_DL_VLAN_PCP))
+		mask->dl_vlan_pcp = 0xff;
+	if (!(w & OFPFW_NW_TOS))
+		mask->nw_tos = 0xff;
+	if (!(w & OFPFW_NW_PROTO))
+		mask->nw_proto = 0xff;
+}
+
+/* Hashes the fields of 'key' that are significant under 'mask'. */
+static u32 tss_hash(const struct sw_flow_key *key,
+		    const struct sw_flow_key *mask)
+{
+	const u32 *k = (const u32 *) key;
+	const u32 *m = (const u32 *) mask;
+	u32 words[FLOW_KEY_U64S * 2];
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(words); i++)
+		words[i] = k[i] & m[i];
+	return jhash2(words, ARRAY_SIZE(words), 0);
+}
+
+static struct tss_slots *tss_slots_alloc(unsigned int n_slots)
+{
+	struct tss_slots *s;
+
+	s = kzalloc(sizeof *s + n_slots * sizeof *s->slots, GFP_ATOMIC);
+	if (s)
+		s->mask = n_slots - 1;
+	return s;
+}
+
+static void tss_slots_free_rcu(struct rcu_head *rcu)
+{
+	kfree(container_of(rcu, struct tss_slots, rcu));
+}
+
+static void tss_subtable_free(struct tss_subtable *st)
+{
+	kfree(st->slots);
+	kfree(st);
+}
+
+static void tss_subtable_free_rcu(struct rcu_head *rcu)
+{
+	tss_subtable_free(container_of(rcu, struct tss_subtable, rcu));
+}
+
+static void tss_index_free_rcu(struct rcu_head *rcu)
+{
+	kfree(container_of(rcu, struct tss_index, rcu));
+}
+
+/* Stores 'flow' in the first free or deleted slot of its probe sequence in
+ * 's'.  The caller must ensure that 's' has room. */
+static void tss_slots_insert(struct tss_subtable *st, struct tss_slots *s,
+			     struct sw_flow *flow)
+{
+	u32 h = tss_hash(&flow->key, &st->mask);
+
+	for (;; h++) {
+		struct sw_flow **slot = &s->slots[h & s->mask];
+		if (!*slot || *slot == TSS_DELETED) {
+			if (!*slot)
+				st->n_used++;
+			rcu_assign_pointer(*slot, flow);
+			return;
+		}
+	}
+}
+
+/* Replaces 'st''s slots by a new array large enough for 'n_flows' flows
+ * without any deleted slots.  Returns 0 if successful, otherwise -ENOMEM, in
+ * which case 'st' is unchanged. */
+static int tss_subtable_rehash(struct tss_subtable *st, unsigned int n_flows)
+{
+	struct tss_slots *old = st->slots;
+	struct tss_slots *new;
+	unsigned int n_slots;
+	unsigned int i;
+
+	n_slots = TSS_MIN_SLOTS;
+	while (n_slots < n_flows * 4)
+		n_slots *= 2;
+	new = tss_slots_alloc(n_slots);
+	if (!new)
+		return -ENOMEM;
+
+	st->n_used = 0;
+	if (old) {
+		for (i = 0; i <= old->mask; i++) {
+			struct sw_flow *flow = old->slots[i];
+			if (flow && flow != TSS_DELETED)
+				tss_slots_insert(st, new, flow);
+		}
+	}
+	rcu_assign_pointer(st->slots, new);
+	if (old)
+		call_rcu(&old->rcu, tss_slots_free_rcu);
+	return 0;
+}
+
+static struct tss_subtable *tss_subtable_create(const struct sw_flow_key *key)
+{
+	struct tss_subtable *st;
+
+	st = kzalloc(sizeof *st, GFP_ATOMIC);
+	if (!st)
+		return NULL;
+	st->wildcards = key->wildcards;
+	tss_make_mask(key, &st->mask);
+	if (tss_subtable_rehash(st, 1)) {
+		kfree(st);
+		return NULL;
+	}
+	return st;
+}
+
+/* Recomputes 'st''s 'max_priority' from the flows that it holds. */
+static void tss_subtable_update_max(struct tss_subtable *st)
+{
+	struct tss_slots *s = st->slots;
+	unsigned int i;
+
+	st->max_priority = 0;
+	for (i = 0; i <= s->mask; i++) {
+		struct sw_flow *flow = s->slots[i];
+		if (flow && flow != TSS_DELETED
+		    && flow->priority > st->max_priority)
+			st->max_priority = flow->priority;
+	}
+	st->max_stale = 0;
+}
+
+/* Publishes a new index of 'tt''s subtables, plus 'new_st' if it is nonnull,
+ * in decreasing order of priority.  Subtables that have become empty are
+ * dropped from the index and freed once readers are done with them.
+ *
+ * Returns 0 if successful, otherwise -ENOMEM, in which case the old index
+ * remains in use. */
+static int tss_publish(struct sw_table_tss *tt, struct tss_subtable *new_st)
+{
+	struct tss_index *old = tt->index;
+	unsigned int n_old = old ? old->n : 0;
+	struct tss_index *index;
+	unsigned int i, n;
+
+	index = kmalloc(sizeof *index + (n_old + 1) * sizeof *index->entries,
+			GFP_ATOMIC);
+	if (!index)
+		return -ENOMEM;
+
+	n = 0;
+	for (i = 0; i < n_old; i++) {
+		struct tss_subtable *st = old->entries[i].st;
+		if (st->n_flows)
+			index->entries[n++].st = st;
+	}
+	if (new_st)
+		index->entries[n++].st = new_st;
+
+	/* Insertion sort, since the order rarely changes much. */
+	for (i = 0; i < n; i++) {
+		struct tss_subtable *st = index->entries[i].st;
+		unsigned int j;
+
+		if (st->max_stale)
+			tss_subtable_update_max(st);
+		for (j = i; j > 0; j--) {
+			if (index->entries[j - 1].max_priority >= st->max_priority)
+				break;
+			index->entries[j] = index->entries[j - 1];
+		}
+		index->entries[j].st = st;
+		index->entries[j].max_priority = st->max_priority;
+	}
+	index->n = n;
+
+	rcu_assign_pointer(tt->index, index);
+	tt->dirty = 0;
+	if (old) {
+		for (i = 0; i < n_old; i++) {
+			struct tss_subtable *st = old->entries[i].st;
+			if (!st->n_flows)
+				call_rcu(&st->rcu, tss_subtable_free_rcu);
+		}
+		call_rcu(&old->rcu, tss_index_free_rcu);
+	}
+	return 0;
+}
+
+/* Removes 'flow' from its subtable and from 'tt''s iteration list, without
+ * freeing it.  The caller must call tss_publish() afterward if 'tt->dirty'
+ * is set. */
+static void tss_remove_flow(struct sw_table_tss *tt, struct sw_flow *flow)
+{
+	struct tss_subtable *st = flow->private;
+	struct tss_slots *s = st->slots;
+	u32 h = tss_hash(&flow->key, &st->mask);
+
+	while (s->slots[h & s->mask] != flow)
+		h++;
+	s->slots[h & s->mask] = TSS_DELETED;
+	list_del_rcu(&flow->iter_node);
+	tt->n_flows--;
+
+	if (!--st->n_flows) {
+		tt->dirty = 1;
+	} else if (flow->priority == st->max_priority) {
+		st->max_stale = 1;
+		tt->dirty = 1;
+	}
+}
+
+static struct sw_flow *table_tss_lookup(struct sw_table *swt,
+					const struct sw_flow_key *key)
+{
+	struct sw_table_tss *tt = (struct sw_table_tss *) swt;
+	struct tss_index *index = rcu_dereference(tt->index);
+	struct sw_flow *best = NULL;
+	unsigned int i;
+
+	if (!index)
+		return NULL;
+	for (i = 0; i < index->n; i++) {
+		const struct tss_entry *e = &index->entries[i];
+		struct tss_slots *s;
+		u32 h;
+
+		if (best && e->max_priority <= best->priority)
+			break;
+		s = rcu_dereference(e->st->slots);
+		for (h = tss_hash(key, &e->st->mask); ; h++) {
+			struct sw_flow *flow;
+
+			flow = rcu_dereference(s->slots[h & s->mask]);
+			if (!flow)
+				break;
+			if (flow != TSS_DELETED
+			    && (!best || flow->priority > best->priority)
+			    && flow_matches_1wild(key, &flow->key))
+				best = flow;
+		}
+	}
+	return best;
+}
+
+static int table_tss_insert(struct sw_table *swt, struct sw_flow *flow)
+{
+	struct sw_table_tss *tt = (struct sw_table_tss *) swt;
+	struct tss_subtable *st = NULL;
+	unsigned int i;
+
+	/* Skip a subtable that lost its last flow, since the next
+	 * tss_publish() will free it. */
+	if (tt->index) {
+		for (i = 0; i < tt->index->n; i++) {
+			struct tss_subtable *t = tt->index->entries[i].st;
+			if (t->wildcards == flow->key.wildcards && t->n_flows) {
+				st = t;
+				break;
+			}
+		}
+	}
+
+	if (st) {
+		struct tss_slots *s = st->slots;
+		uint16_t old_max;
+		u32 h;
+
+		/* Just replace any flow that matches exactly. */
+		for (h = tss_hash(&flow->key, &st->mask); ; h++) {
+			struct sw_flow **slot = &s->slots[h & s->mask];
+			struct sw_flow *f = *slot;
+
+			if (!f)
+				break;
+			if (f != TSS_DELETED && f->priority == flow->priority
+			    && flow_matches_1wild(&flow->key, &f->key)) {
+				flow->serial = f->serial;
+				flow->private = st;
+				rcu_assign_pointer(*slot, flow);
+				list_replace_rcu(&f->iter_node, &flow->iter_node);
+				flow_deferred_free(f);
+				return 1;
+			}
+		}
+
+		/* Make sure there's room in the table. */
+		if (tt->n_flows >= tt->max_flows)
+			return 0;
+		if ((st->n_used + 1) * 2 > st->slots->mask + 1
+		    && tss_subtable_rehash(st, st->n_flows + 1))
+			return 0;
+
+		/* Readers must see the higher priority before the flow, or
+		 * they could stop searching before reaching it. */
+		if (flow->priority > st->max_priority) {
+			old_max = st->max_priority;
+			st->max_priority = flow->priority;
+			if (tss_publish(tt, NULL)) {
+				st->max_priority = old_max;
+				return 0;
+			}
+		}
+		flow->private = st;
+		tss_slots_insert(st, st->slots, flow);
+		st->n_flows++;
+	} else {
+		if (tt->n_flows >= tt->max_flows)
+			return 0;
+		st = tss_subtable_create(&flow->key);
+		if (!st)
+			return 0;
+		flow->private = st;
+		tss_slots_insert(st, st->slots, flow);
+		st->n_flows = 1;
+		st->max_priority = flow->priority;
+		if (tss_publish(tt, st)) {
+			tss_subtable_free(st);
+			return 0;
+		}
+	}
+	tt->n_flows++;
+
+	flow->serial = tt->next_serial++;
+	list_add_rcu(&flow->iter_node, &tt->iter_flows);
+	return 1;
+}
+
+static int table_tss_modify(struct sw_table *swt,
+			    const struct sw_flow_key *key, uint16_t priority,
+			    int strict, const struct ofp_action_header *actions,
+			    size_t actions_len)
+{
+	struct sw_table_tss *tt = (struct sw_table_tss *) swt;
+	struct sw_flow *flow;
+	unsigned int count = 0;
+
+	list_for_each_entry (flow, &tt->iter_flows, iter_node) {
+		if (flow_matches_desc(&flow->key, key, strict)
+				&& (!strict || (flow->priority == priority))) {
+			flow_replace_acts(flow, actions, actions_len);
+			count++;
+		}
+	}
+	return count;
+}
+
+static int table_tss_has_conflict(struct sw_table *swt,
+		const struct sw_flow_key *key, uint16_t priority, int strict)
+{
+	struct sw_table_tss *tt = (struct sw_table_tss *) swt;
+	struct sw_flow *flow;
+
+	list_for_each_entry (flow, &tt->iter_flows, iter_node) {
+		if (flow_matches_2desc(&flow->key, key, strict)
+				&& (flow->priority == priority))
+			return true;
+	}
+	return false;
+}
+
+static int do_delete(struct datapath *dp, struct sw_table_tss *tt,
+		     struct sw_flow *flow, enum ofp_flow_removed_reason reason)
+{
+	dp_send_flow_end(dp, flow, reason);
+	tss_remove_flow(tt, flow);
+	flow_deferred_free(flow);
+	return 1;
+}
+
+static int table_tss_delete(struct datapath *dp, struct sw_table *swt,
+			    const struct sw_flow_key *key, uint16_t out_port,
+			    uint16_t priority, int strict)
+{
+	struct sw_table_tss *tt = (struct sw_table_tss *) swt;
+	struct sw_flow *flow, *n;
+	unsigned int count = 0;
+
+	list_for_each_entry_safe (flow, n, &tt->iter_flows, iter_node) {
+		if (flow_matches_desc(&flow->key, key, strict)
+				&& flow_has_out_port(flow, out_port)
+				&& (!strict || (flow->priority == priority)))
+			count += do_delete(dp, tt, flow, OFPRR_DELETE);
+	}
+	if (tt->dirty)
+		tss_publish(tt, NULL);
+	return count;
+}
+
+static int table_tss_timeout(struct datapath *dp, struct sw_table *swt)
+{
+	struct sw_table_tss *tt = (struct sw_table_tss *) swt;
+	struct sw_flow *flow, *n;
+	int count = 0;
+
+	if (mutex_lock_interruptible(&dp_mutex))
+		return 0;
+	list_for_each_entry_safe (flow, n, &tt->iter_flows, iter_node) {
+		int reason = flow_timeout(flow);
+		if (reason >= 0)
+			count += do_delete(dp, tt, flow, reason);
+	}
+	if (tt->dirty)
+		tss_publish(tt, NULL);
+	mutex_unlock(&dp_mutex);
+	return count;
+}
+
+static void table_tss_destroy(struct sw_table *swt)
+{
+	struct sw_table_tss *tt = (struct sw_table_tss *) swt;
+	unsigned int i;
+
+	while (!list_empty(&tt->iter_flows)) {
+		struct sw_flow *flow = list_entry(tt->iter_flows.next,
+						  struct sw_flow, iter_node);
+		list_del(&flow->iter_node);
+		flow_free(flow);
+	}
+	if (tt->index) {
+		for (i = 0; i < tt->index->n; i++)
+			tss_subtable_free(tt->index->entries[i].st);
+		kfree(tt->index);
+	}
+	kfree(tt);
+}
+
+static int table_tss_iterate(struct sw_table *swt,
+			     const struct sw_flow_key *key, uint16_t out_port,
+			     struct sw_table_position *position,
+			     int (*callback)(struct sw_flow *, void *),
+			     void *private)
+{
+	struct sw_table_tss *tt = (struct sw_table_tss *) swt;
+	struct sw_flow *flow;
+	unsigned long start;
+
+	start = position->private[0];
+	list_for_each_entry (flow, &tt->iter_flows, iter_node) {
+		if (flow->serial >= start
+				&& flow_matches_2wild(key, &flow->key)
+				&& flow_has_out_port(flow, out_port)) {
+			int error = callback(flow, private);
+			if (error) {
+				position->private[0] = flow->serial;
+				return error;
+			}
+		}
+	}
+	return 0;
+}
+
+static void table_tss_stats(struct sw_table *swt,
+			    struct sw_table_stats *stats)
+{
+	struct sw_table_tss *tt = (struct sw_table_tss *) swt;
+	stats->name = "tss";
+	stats->wildcards = OFPFW_ALL;
+	stats->n_flows   = tt->n_flows;
+	stats->max_flows = tt->max_flows;
+	stats->n_lookup  = swt->n_lookup;
+	stats->n_matched = swt->n_matched;
+}
+
+struct sw_table *table_tss_create(unsigned int max_flows)
+{
+	struct sw_table_tss *tt;
+	struct sw_table *swt;
+
+	tt = kzalloc(sizeof *tt, GFP_KERNEL);
+	if (tt == NULL)
+		return NULL;
+
+	swt = &tt->swt;
+	swt->lookup = table_tss_lookup;
+	swt->insert = table_tss_insert;
+	swt->modify = table_tss_modify;
+	swt->has_conflict = table_tss_has_conflict;
+	swt->delete = table_tss_delete;
+	swt->timeout = table_tss_timeout;
+	swt->destroy = table_tss_destroy;
+	swt->iterate = table_tss_iterate;
+	swt->stats = table_tss_stats;
+
+	tt->max_flows = max_flows;
+	tt->n_flows = 0;
+	tt->index = NULL;
+	tt->dirty = 0;
+	INIT_LIST_HEAD(&tt->iter_flows);
+	tt->next_serial = 0;
+
+	return swt;
+}
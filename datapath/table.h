@@ -22,6 +22,13 @@ struct sw_table_stats {
 	unsigned long int n_matched; /* Number of packets that have hit. */
 };
 
+/* Counters summed over a set of flows, for OFPST_AGGREGATE. */
+struct sw_table_totals {
+	uint64_t packet_count;
+	uint64_t byte_count;
+	uint32_t flow_count;
+};
+
 /* Position within an iteration of a sw_table.
  *
  * The contents are private to the table implementation, except that a position
@@ -32,7 +39,7 @@ struct sw_table_position {
 
 /* A single table of flows.
  *
- * All functions, except destroy, must be called holding the
+ * All functions, except destroy and aggregate, must be called holding the
  * rcu_read_lock.  destroy must be fully serialized.
  */
 struct sw_table {
@@ -106,6 +113,17 @@ struct sw_table {
 		       int (*callback)(struct sw_flow *flow, void *private),
 		       void *private);
 
+	/* Adds the counters of each flow in 'table' that matches 'key' and
+	 * has an output action to 'out_port' (or any flow, if 'out_port' is
+	 * OFPP_NONE) to 'totals'.  May split the work among several CPUs and
+	 * sleep until they finish, so it must be called holding dp_mutex,
+	 * which keeps the table from changing, and not the rcu_read_lock.
+	 *
+	 * May be null, in which case callers use 'iterate' instead. */
+	void (*aggregate)(struct sw_table *table,
+			  const struct sw_flow_key *key, uint16_t out_port,
+			  struct sw_table_totals *totals);
+
 	/* Dumps statistics for 'table' into 'stats'. */
 	void (*stats)(struct sw_table *table, struct sw_table_stats *stats);
 };
@@ -115,5 +133,6 @@ struct sw_table *table_hash_create(unsigned int polynomial,
 struct sw_table *table_hash2_create(unsigned int poly0, unsigned int buckets0,
 		unsigned int poly1, unsigned int buckets1);
 struct sw_table *table_linear_create(unsigned int max_flows);
+struct sw_table *table_tss_create(unsigned int max_flows);
 
 #endif /* table.h */
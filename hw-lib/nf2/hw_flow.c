@@ -31,6 +31,7 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 
 #include <openflow/of_hw_api.h>
 #include "list.h"
@@ -43,22 +44,47 @@
 #include "nf2_lib.h"
 #include "debug.h"
 
+/* Software shadow of the flows in hardware, so that lookups and strict
+ * deletes do not have to compare against every installed flow.  Flows are
+ * grouped by their wildcards, which determine the mask that they apply to a
+ * packet, and each group hashes its flows, linked through 'node', on their
+ * masked keys.  The exact-match group always exists and comes first; groups
+ * of wildcarded flows come and go with their flows. */
+#define NF2_EXACT_BUCKETS 4096
+#define NF2_WILDCARD_BUCKETS 8
+
+struct nf2_shadow_group {
+	struct list node;		/* In nf2_flowtable's 'groups'. */
+	uint32_t wildcards;		/* Wildcards of every flow here. */
+	struct flow mask;		/* Significant bits of 'struct flow'. */
+	unsigned int n_flows;
+	unsigned int bucket_mask;	/* Number of buckets, minus 1. */
+	struct list buckets[];
+};
+
 struct nf2_flowtable {
 	struct of_hw_driver hw_driver;
 	unsigned int max_flows;
 	unsigned int num_flows;
-	struct list flows;
+	struct list groups;		/* nf2_shadow_groups. */
 	struct list iter_flows;
 	unsigned long int next_serial;
+	struct nf2_port_info ports[NF2_PORT_NUM]; /* As of 'synced'. */
+	long long int synced;		/* When counters were last synced. */
 };
 
+/* Flow and port counters are read from hardware in one pass, at most this
+ * often, and stats requests in between are served from the last pass. */
+#define NF2_COUNTER_SYNC_MSEC 1000
+
 static struct sw_flow *nf2_lookup_flowtable(struct sw_table *,
 					    const struct sw_flow_key *);
 static int nf2_install_flow(struct sw_table *, struct sw_flow *);
 static int nf2_modify_flow(struct sw_table *, const struct sw_flow_key *,
 			   uint16_t, int, const struct ofp_action_header *,
 			   size_t);
-static int do_uninstall(struct sw_flow *, struct list *);
+static int do_uninstall(struct nf2_flowtable *, struct sw_flow *,
+			struct list *);
 static int nf2_has_conflict(struct sw_table *, const struct sw_flow_key *,
 			    uint16_t, int);
 static int nf2_uninstall_flow_wrap(struct datapath *, struct sw_table *,
@@ -76,6 +102,8 @@ static int nf2_iterate_flowtable(struct sw_table *,
 				 int (*)(struct sw_flow *, void *), void *);
 static void nf2_get_flowstats(struct sw_table *, struct sw_table_stats *);
 static int nf2_get_portstats(of_hw_driver_t *, int, struct ofp_port_stats *);
+static int nf2_flow_batch_begin(of_hw_driver_t *);
+static int nf2_flow_batch_commit(of_hw_driver_t *);
 
 #if !defined(HWTABLE_NO_DEBUG)
 int of_hw_debug = DBG_LVL_WARN;
@@ -84,47 +112,176 @@ int of_hw_debug = DBG_LVL_WARN;
 #define DELETE_FLOW 0
 #define KEEP_FLOW 1
 
+static struct nf2_shadow_group *
+shadow_group_create(const struct sw_flow_key *key, unsigned int n_buckets)
+{
+	struct nf2_shadow_group *group;
+	unsigned int i;
+
+	group = malloc(sizeof *group + n_buckets * sizeof *group->buckets);
+	if (group == NULL) {
+		return NULL;
+	}
+	group->wildcards = key->wildcards;
+	flow_make_mask(key, &group->mask);
+	group->n_flows = 0;
+	group->bucket_mask = n_buckets - 1;
+	for (i = 0; i < n_buckets; i++) {
+		list_init(&group->buckets[i]);
+	}
+	return group;
+}
+
+static struct nf2_shadow_group *
+shadow_find_group(struct nf2_flowtable *nf2flowtab, uint32_t wildcards)
+{
+	struct nf2_shadow_group *group;
+
+	LIST_FOR_EACH(group, struct nf2_shadow_group, node,
+		      &nf2flowtab->groups) {
+		if (group->wildcards == wildcards) {
+			return group;
+		}
+	}
+	return NULL;
+}
+
+/* Returns the group for flows with 'key''s wildcards, creating it if
+ * necessary, or a null pointer if memory runs out. */
+static struct nf2_shadow_group *
+shadow_get_group(struct nf2_flowtable *nf2flowtab,
+		 const struct sw_flow_key *key)
+{
+	struct nf2_shadow_group *group;
+
+	group = shadow_find_group(nf2flowtab, key->wildcards);
+	if (group == NULL) {
+		group = shadow_group_create(key, NF2_WILDCARD_BUCKETS);
+		if (group != NULL) {
+			list_push_back(&nf2flowtab->groups, &group->node);
+		}
+	}
+	return group;
+}
+
+/* Returns the bucket in 'group' that holds flows whose fields equal those of
+ * 'flow' under the group's mask. */
+static struct list *
+shadow_bucket(struct nf2_shadow_group *group, const struct flow *flow)
+{
+	return &group->buckets[flow_hash_masked(flow, &group->mask)
+			       & group->bucket_mask];
+}
+
+static void
+shadow_remove(struct nf2_flowtable *nf2flowtab, struct sw_flow *flow)
+{
+	struct nf2_shadow_group *group;
+
+	group = shadow_find_group(nf2flowtab, flow->key.wildcards);
+	list_remove(&flow->node);
+	group->n_flows--;
+}
+
+/* Frees the groups of wildcarded flows that have become empty.  Done after
+ * a delete or timeout pass, rather than as each flow goes, so that those
+ * passes can walk a group's buckets while they empty it. */
+static void
+shadow_prune(struct nf2_flowtable *nf2flowtab)
+{
+	struct nf2_shadow_group *group, *next;
+
+	LIST_FOR_EACH_SAFE(group, next, struct nf2_shadow_group, node,
+			   &nf2flowtab->groups) {
+		if (group->n_flows == 0 && group->wildcards != 0) {
+			list_remove(&group->node);
+			free(group);
+		}
+	}
+}
+
+/* An exact-match flow beats any wildcarded one.  Otherwise the highest
+ * priority wins, and among equals the most recently installed flow. */
 static struct sw_flow *
 nf2_lookup_flowtable(struct sw_table *flowtab, const struct sw_flow_key *key)
 {
 	struct nf2_flowtable *nf2flowtab = (struct nf2_flowtable *)flowtab;
+	struct nf2_shadow_group *group;
+	struct sw_flow *best = NULL;
 	struct sw_flow *flow;
 
-	LIST_FOR_EACH(flow, struct sw_flow, node, &nf2flowtab->flows) {
-		if (flow_matches_1wild(key, &flow->key)) {
-			return flow;
+	LIST_FOR_EACH(group, struct nf2_shadow_group, node,
+		      &nf2flowtab->groups) {
+		struct list *bucket = shadow_bucket(group, &key->flow);
+
+		LIST_FOR_EACH(flow, struct sw_flow, node, bucket) {
+			if (flow_matches_1wild(key, &flow->key)
+			    && (best == NULL
+				|| flow->priority > best->priority)) {
+				best = flow;
+			}
+		}
+		if (best != NULL && group->wildcards == 0) {
+			break;
 		}
 	}
 
-	return NULL;
+	return best;
 }
 
 static int
 nf2_install_flow(struct sw_table *flowtab, struct sw_flow *flow)
 {
 	struct nf2_flowtable *nf2flowtab = (struct nf2_flowtable *)flowtab;
+	struct nf2_shadow_group *group;
 
 	/* Delete flows that match exactly. */
 	nf2_uninstall_flow(NULL, flowtab, &flow->key, OFPP_NONE,
 			   flow->priority, true, KEEP_FLOW);
 
+	/* Get the flow's group before writing to hardware, since it is the
+	 * one step that can fail without hardware to undo. */
+	group = shadow_get_group(nf2flowtab, &flow->key);
+	if (group == NULL) {
+		return 0;
+	}
+
 	if (nf2_are_actions_supported(flow)) {
 		if (nf2_build_and_write_flow(flow)) {
 			/* Not successful */
+			shadow_prune(nf2flowtab);
 			return 0;
 		}
 	} else {
 		/* Unsupported actions or no device. */
+		shadow_prune(nf2flowtab);
 		return 0;
 	}
 
 	nf2flowtab->num_flows++;
-	list_push_front(&nf2flowtab->flows, &flow->node);
+	list_push_front(shadow_bucket(group, &flow->key.flow), &flow->node);
+	group->n_flows++;
+	flow->serial = nf2flowtab->next_serial++;
 	list_push_front(&nf2flowtab->iter_flows, &flow->iter_node);
 
 	return 1;
 }
 
+static unsigned int
+modify_one(struct sw_flow *flow, const struct sw_flow_key *key,
+	   uint16_t priority, int strict,
+	   const struct ofp_action_header *actions, size_t actions_len)
+{
+	if (flow_matches_desc(&flow->key, key, strict)
+	    && (!strict || flow->priority == priority)) {
+		flow_replace_acts(flow, actions, actions_len);
+		if (nf2_are_actions_supported(flow)) {
+			return nf2_modify_acts(flow);
+		}
+	}
+	return 0;
+}
+
 static int
 nf2_modify_flow(struct sw_table *flowtab, const struct sw_flow_key *key,
 		uint16_t priority, int strict,
@@ -134,15 +291,22 @@ nf2_modify_flow(struct sw_table *flowtab, const struct sw_flow_key *key,
 	struct sw_flow *flow;
 	unsigned int count = 0;
 
-	LIST_FOR_EACH(flow, struct sw_flow, node, &nf2flowtab->flows) {
-		if (flow_matches_desc(&flow->key, key, strict)
-		    && (!strict || flow->priority == priority)) {
-			flow_replace_acts(flow, actions, actions_len);
-			if (nf2_are_actions_supported(flow)) {
-				count += nf2_modify_acts(flow);
+	if (strict) {
+		struct nf2_shadow_group *group;
+
+		group = shadow_find_group(nf2flowtab, key->wildcards);
+		if (group != NULL) {
+			LIST_FOR_EACH(flow, struct sw_flow, node,
+				      shadow_bucket(group, &key->flow)) {
+				count += modify_one(flow, key, priority, strict,
+						    actions, actions_len);
 			}
-		} else {
-			return 0;
+		}
+	} else {
+		LIST_FOR_EACH(flow, struct sw_flow, iter_node,
+			      &nf2flowtab->iter_flows) {
+			count += modify_one(flow, key, priority, strict,
+					    actions, actions_len);
 		}
 	}
 
@@ -156,7 +320,8 @@ nf2_has_conflict(struct sw_table *flowtab, const struct sw_flow_key *key,
 	struct nf2_flowtable *nf2flowtab = (struct nf2_flowtable *)flowtab;
 	struct sw_flow *flow;
 
-	LIST_FOR_EACH(flow, struct sw_flow, node, &nf2flowtab->flows) {
+	LIST_FOR_EACH(flow, struct sw_flow, iter_node,
+		      &nf2flowtab->iter_flows) {
 
 		if (flow_matches_2desc(&flow->key, key, strict)
 		    && (flow->priority == priority)) {
@@ -168,10 +333,11 @@ nf2_has_conflict(struct sw_table *flowtab, const struct sw_flow_key *key,
 }
 
 static int
-do_uninstall(struct sw_flow *flow, struct list *deleted)
+do_uninstall(struct nf2_flowtable *nf2flowtab, struct sw_flow *flow,
+	     struct list *deleted)
 {
 	if (flow != NULL && flow->private != NULL) {
-		list_remove(&flow->node);
+		shadow_remove(nf2flowtab, flow);
 		list_remove(&flow->iter_node);
 		list_push_back(deleted, &flow->node);
 		return 1;
@@ -189,6 +355,31 @@ nf2_uninstall_flow_wrap(struct datapath *dpinst, struct sw_table *flowtab,
 	                          priority, strict, DELETE_FLOW);
 }
 
+/* If 'flow' matches the flow_mod described by 'key', 'out_port', 'priority'
+ * and 'strict', collects its counters from 'dev', moves it to 'deleted' and
+ * returns 1.  Otherwise returns 0. */
+static int
+uninstall_one(struct nf2_flowtable *nf2flowtab, struct nf2device *dev,
+	      struct sw_flow *flow, const struct sw_flow_key *key,
+	      uint16_t out_port, uint16_t priority, int strict,
+	      struct list *deleted)
+{
+	struct nf2_flow *nf2flow;
+
+	if (!flow_matches_desc(&flow->key, key, strict)
+	    || (strict && flow->priority != priority)
+	    || !flow_has_out_port(flow, out_port)) {
+		return 0;
+	}
+
+	nf2flow = flow->private;
+	if (nf2flow != NULL) {
+		flow->packet_count += nf2_get_packet_count(dev, nf2flow);
+		flow->byte_count += nf2_get_byte_count(dev, nf2flow);
+	}
+	return do_uninstall(nf2flowtab, flow, deleted);
+}
+
 static int
 nf2_uninstall_flow(struct datapath *dpinst, struct sw_table *flowtab,
 		   const struct sw_flow_key *key, uint16_t out_port,
@@ -197,7 +388,6 @@ nf2_uninstall_flow(struct datapath *dpinst, struct sw_table *flowtab,
 	struct nf2device *dev;
 	struct nf2_flowtable *nf2flowtab = (struct nf2_flowtable *)flowtab;
 	struct sw_flow *flow, *n;
-	struct nf2_flow *nf2flow;
 	unsigned int count = 0;
 	struct list deleted;
 	list_init(&deleted);
@@ -206,53 +396,108 @@ nf2_uninstall_flow(struct datapath *dpinst, struct sw_table *flowtab,
 	if (dev == NULL)
 		return 0;
 
-	LIST_FOR_EACH_SAFE (flow, n, struct sw_flow, node, &nf2flowtab->flows) {
-		if (flow_matches_desc(&flow->key, key, strict)
-		    && (!strict || flow->priority == priority)
-		    && flow_has_out_port(flow, out_port)) {
-			nf2flow = flow->private;
-
-			if (nf2flow != NULL) {
-				flow->packet_count
-					+= nf2_get_packet_count(dev,
-								nf2flow);
-				flow->byte_count += nf2_get_byte_count(dev,
-								       nf2flow);
-			}
-			count += do_uninstall(flow, &deleted);
-			if (keep_flow == KEEP_FLOW) {
-				/* Delete private in sw_flow here */
-				nf2_delete_private(flow->private);
+	if (strict) {
+		/* Only flows with the same wildcards and the same fields under
+		 * them can match, and those all share a bucket. */
+		struct nf2_shadow_group *group;
+
+		group = shadow_find_group(nf2flowtab, key->wildcards);
+		if (group != NULL) {
+			struct list *bucket = shadow_bucket(group, &key->flow);
+
+			LIST_FOR_EACH_SAFE (flow, n, struct sw_flow, node,
+					    bucket) {
+				count += uninstall_one(nf2flowtab, dev, flow,
+						       key, out_port, priority,
+						       strict, &deleted);
 			}
 		}
+	} else {
+		LIST_FOR_EACH_SAFE (flow, n, struct sw_flow, iter_node,
+				    &nf2flowtab->iter_flows) {
+			count += uninstall_one(nf2flowtab, dev, flow, key,
+					       out_port, priority, strict,
+					       &deleted);
+		}
 	}
 	nf2flowtab->num_flows -= count;
+	shadow_prune(nf2flowtab);
 
 	nf2_free_net_device(dev);
 
-	if (keep_flow == DELETE_FLOW) {
-		/* Notify DP of deleted flows and delete the flow */
-		LIST_FOR_EACH_SAFE (flow, n, struct sw_flow, node, &deleted) {
+	/* Notify DP of deleted flows and delete the flow.  Flows replaced by
+	 * nf2_install_flow() are freed without a notification. */
+	LIST_FOR_EACH_SAFE (flow, n, struct sw_flow, node, &deleted) {
+		if (keep_flow == DELETE_FLOW) {
 			dp_send_flow_end(dpinst, flow, flow->reason);
-			list_remove(&flow->node);
-			nf2_delete_private(flow->private);
-			flow_free(flow);
-			}
+		}
+		list_remove(&flow->node);
+		nf2_delete_private(flow->private);
+		flow_free(flow);
 	}
 
 	return count;
 }
 
+/* Reads the counters of every installed flow and every port from 'dev' in
+ * one pass, adding the flows' new traffic to their software counters and
+ * keeping the port counters in 'nf2flowtab'. */
+static void
+nf2_sync_counters(struct nf2_flowtable *nf2flowtab, struct nf2device *dev)
+{
+	struct nf2_wildcard_counters wc;
+	struct sw_flow *flow;
+	long long int now = time_msec();
+
+	nf2_get_wildcard_counters(dev, &wc);
+	nf2_get_all_port_info(dev, nf2flowtab->ports);
+
+	LIST_FOR_EACH(flow, struct sw_flow, iter_node,
+		      &nf2flowtab->iter_flows) {
+		uint64_t packets = 0;
+		uint64_t bytes = 0;
+
+		if (flow->private == NULL) {
+			continue;
+		}
+		nf2_collect_counts(dev, flow->private, &wc, &packets, &bytes);
+		if (packets != 0) {
+			flow->packet_count += packets;
+			flow->used = now;
+		}
+		flow->byte_count += bytes;
+	}
+	nf2flowtab->synced = now;
+}
+
+/* Syncs counters unless that was done within NF2_COUNTER_SYNC_MSEC.
+ * Returns 0 if the counters in software are current, otherwise 1. */
+static int
+nf2_sync_counters_if_stale(struct nf2_flowtable *nf2flowtab)
+{
+	struct nf2device *dev;
+
+	if (time_msec() - nf2flowtab->synced < NF2_COUNTER_SYNC_MSEC) {
+		return 0;
+	}
+
+	dev = nf2_get_net_device();
+	if (dev == NULL) {
+		DBG_VERBOSE("Could not open NetFPGA device\n");
+		return 1;
+	}
+	nf2_sync_counters(nf2flowtab, dev);
+	nf2_free_net_device(dev);
+	return 0;
+}
+
 static void
 nf2_flow_timeout(struct sw_table *flowtab, struct list *deleted)
 {
 	struct nf2device *dev;
 	struct nf2_flowtable *nf2flowtab = (struct nf2_flowtable *)flowtab;
 	struct sw_flow *flow, *n;
-	struct nf2_flow *nf2flow;
 	int num_uninst_flows = 0;
-	uint64_t num_forw_packets = 0;
-	uint64_t now = time_msec();
 
 	dev = nf2_get_net_device();
 	if (dev == NULL) {
@@ -262,23 +507,16 @@ nf2_flow_timeout(struct sw_table *flowtab, struct list *deleted)
 
 	/* LOCK; */
 	/* FIXME */
-	LIST_FOR_EACH_SAFE (flow, n, struct sw_flow, node, &nf2flowtab->flows) {
-		nf2flow = flow->private;
-		if (nf2flow != NULL) {
-			num_forw_packets = flow->packet_count
-				+ nf2_get_packet_count(dev, nf2flow);
-			flow->byte_count += nf2_get_byte_count(dev, nf2flow);
-		}
-		if (num_forw_packets > flow->packet_count) {
-			flow->packet_count = num_forw_packets;
-			flow->used = now;
-		}
-
+	nf2_sync_counters(nf2flowtab, dev);
+	LIST_FOR_EACH_SAFE (flow, n, struct sw_flow, iter_node,
+			    &nf2flowtab->iter_flows) {
 		if (flow_timeout(flow)) {
-			num_uninst_flows += do_uninstall(flow, deleted);
+			num_uninst_flows += do_uninstall(nf2flowtab, flow,
+							 deleted);
 			nf2_delete_private(flow->private);
 		}
 	}
+	shadow_prune(nf2flowtab);
 
 	/* UNLOCK; */
 
@@ -297,11 +535,12 @@ nf2_destroy_flowtable(struct sw_table *flowtab)
 	if (nf2flowtab == NULL)
 		return;
 
-	while (!list_is_empty(&nf2flowtab->flows)) {
+	while (!list_is_empty(&nf2flowtab->iter_flows)) {
 		struct sw_flow *flow
-			= CONTAINER_OF(list_front(&nf2flowtab->flows),
-						  struct sw_flow, node);
-		list_remove(&flow->node);
+			= CONTAINER_OF(list_front(&nf2flowtab->iter_flows),
+						  struct sw_flow, iter_node);
+		list_remove(&flow->iter_node);
+		shadow_remove(nf2flowtab, flow);
 		if (flow->private) {
 			nf2flow = (struct nf2_flow *)flow->private;
 
@@ -314,6 +553,9 @@ nf2_destroy_flowtable(struct sw_table *flowtab)
 		}
 		flow_free(flow);
 	}
+	shadow_prune(nf2flowtab);
+	free(CONTAINER_OF(list_front(&nf2flowtab->groups),
+			  struct nf2_shadow_group, node));
 	free(nf2flowtab);
 
 	nf2_destroy_exact_freelist();
@@ -331,6 +573,8 @@ nf2_iterate_flowtable(struct sw_table *flowtab, const struct sw_flow_key *key,
 	struct sw_flow *flow;
 	int error = 0;
 
+	nf2_sync_counters_if_stale(nf2flowtab);
+
 	start = ~position->private[0];
 	LIST_FOR_EACH(flow, struct sw_flow, iter_node, &nf2flowtab->iter_flows) {
 		if (flow->serial <= start
@@ -377,31 +621,16 @@ static int
 nf2_get_portstats(of_hw_driver_t *hw_drv, int of_port,
 			struct ofp_port_stats *stats)
 {
-	int nf2_port;
-	struct nf2_port_info *nf2portinfo;
-	struct nf2device *dev;
+	struct nf2_flowtable *nf2flowtab = (struct nf2_flowtable *)hw_drv;
+	const struct nf2_port_info *nf2portinfo;
 
 	if ((of_port > NF2_PORT_NUM) || (of_port <= 0)) {
 		return 1;
 	}
-	nf2_port = of_port - 1;
-
-	nf2portinfo = calloc(1, sizeof(struct nf2_port_info));
-	if (nf2portinfo == NULL) {
-		return 1;
-	}
-
-	dev = nf2_get_net_device();
-	if (dev == NULL) {
-		free(nf2portinfo);
-		return 1;
-	}
-
-	if (nf2_get_port_info(dev, nf2_port, nf2portinfo)) {
-		nf2_free_net_device(dev);
-		free(nf2portinfo);
+	if (nf2_sync_counters_if_stale(nf2flowtab)) {
 		return 1;
 	}
+	nf2portinfo = &nf2flowtab->ports[of_port - 1];
 
 	stats->rx_packets = (uint64_t)(nf2portinfo->rx_q_num_pkts_stored);
 	stats->rx_dropped = (uint64_t)(nf2portinfo->rx_q_num_pkts_dropped_full
@@ -419,11 +648,50 @@ nf2_get_portstats(of_hw_driver_t *hw_drv, int of_port,
 	stats->rx_crc_err = -1;
 	stats->collisions = -1;
 
-	nf2_free_net_device(dev);
-	free(nf2portinfo);
 	return 0;
 }
 
+static int
+nf2_flow_remove(of_hw_driver_t *hw_drv, struct sw_flow *flow)
+{
+	struct nf2_flowtable *nf2flowtab = (struct nf2_flowtable *)hw_drv;
+	struct nf2device *dev;
+
+	if (flow->private == NULL) {
+		return OF_HW_ERROR;
+	}
+
+	dev = nf2_get_net_device();
+	if (dev == NULL) {
+		return OF_HW_ERROR;
+	}
+	flow->packet_count += nf2_get_packet_count(dev, flow->private);
+	flow->byte_count += nf2_get_byte_count(dev, flow->private);
+	nf2_free_net_device(dev);
+
+	shadow_remove(nf2flowtab, flow);
+	list_remove(&flow->iter_node);
+	nf2_delete_private(flow->private);
+	flow->private = NULL;
+	nf2flowtab->num_flows--;
+	shadow_prune(nf2flowtab);
+
+	return OF_HW_OKAY;
+}
+
+static int
+nf2_flow_batch_begin(of_hw_driver_t *hw_drv)
+{
+	return nf2_batch_begin() ? OF_HW_ERROR : OF_HW_OKAY;
+}
+
+static int
+nf2_flow_batch_commit(of_hw_driver_t *hw_drv)
+{
+	nf2_batch_commit();
+	return OF_HW_OKAY;
+}
+
 /*
  * Create and initialize a new hardware datapath object
  */
@@ -433,6 +701,8 @@ new_of_hw_driver(struct datapath *dp)
 {
 	struct sw_table *sw_tab;
 	of_hw_driver_t *hw_drv;
+	struct nf2_shadow_group *exact_group;
+	struct sw_flow_key exact_key;
 	struct nf2device *dev;
 	struct nf2_flowtable *nf2flowtab;
 
@@ -471,9 +741,10 @@ new_of_hw_driver(struct datapath *dp)
 	nf2flowtab->max_flows = OPENFLOW_NF2_EXACT_TABLE_SIZE
 	    + OPENFLOW_WILDCARD_TABLE_SIZE - RESERVED_FOR_CPU2NETFPGA;
 	nf2flowtab->num_flows = 0;
-	list_init(&nf2flowtab->flows);
+	list_init(&nf2flowtab->groups);
 	list_init(&nf2flowtab->iter_flows);
 	nf2flowtab->next_serial = 0;
+	nf2flowtab->synced = 0;
 
 	if (nf2_init_wildcard_freelist()) {
 		DBG_ERROR("Could not create wildcard freelist\n");
@@ -491,6 +762,14 @@ new_of_hw_driver(struct datapath *dp)
 		return NULL;
 	}
 
+	memset(&exact_key, 0, sizeof exact_key);
+	exact_group = shadow_group_create(&exact_key, NF2_EXACT_BUCKETS);
+	if (exact_group == NULL) {
+		free(nf2flowtab);
+		return NULL;
+	}
+	list_push_back(&nf2flowtab->groups, &exact_group->node);
+
 	hw_drv->table_stats_get = NULL;
 	hw_drv->port_stats_get = nf2_get_portstats;
 	hw_drv->flow_stats_get = NULL;
@@ -510,5 +789,9 @@ new_of_hw_driver(struct datapath *dp)
 
 	hw_drv->ioctl = NULL;
 
+	hw_drv->flow_batch_begin = nf2_flow_batch_begin;
+	hw_drv->flow_batch_commit = nf2_flow_batch_commit;
+	hw_drv->flow_remove = nf2_flow_remove;
+
 	return hw_drv;
 }
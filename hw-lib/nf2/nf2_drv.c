@@ -644,6 +644,49 @@ nf2_get_wildcard_byte_count(struct nf2device *dev, int row)
 	return val;
 }
 
+/* Reads both counter words of exact row 'row' into 'counters'.  The
+ * hardware clears them as they are read, so they hold the traffic since the
+ * previous read. */
+void
+nf2_get_exact_counters(struct nf2device *dev, int row,
+		       nf2_of_exact_counters_wrap *counters)
+{
+	unsigned int index = row << 7;
+	int i;
+
+	for (i = 0; i < NF2_OF_EXACT_COUNTERS_WORD_LEN; ++i) {
+		readReg(dev, SRAM_BASE_ADDR + index
+			       + sizeof(nf2_of_entry_wrap) + (4 * i),
+			       &counters->raw[i]);
+	}
+
+	DBG_VERBOSE
+	    ("** Exact match counters(delta) row: %i packets: %i bytes: %i time(msec): %llu\n",
+	     row, counters->counters.pkt_count, counters->counters.byte_count,
+	     time_msec());
+}
+
+/* Reads the hit counters of every wildcard row into 'counters', walking the
+ * byte and then the packet counter registers in address order. */
+void
+nf2_get_wildcard_counters(struct nf2device *dev,
+			  struct nf2_wildcard_counters *counters)
+{
+	int row;
+
+	for (row = 0; row < OPENFLOW_WILDCARD_TABLE_SIZE; ++row) {
+		readReg(dev, OPENFLOW_WILDCARD_LOOKUP_BYTES_HIT_0_REG
+			       + (4 * row), &counters->bytes[row]);
+	}
+	for (row = 0; row < OPENFLOW_WILDCARD_TABLE_SIZE; ++row) {
+		readReg(dev, OPENFLOW_WILDCARD_LOOKUP_PKTS_HIT_0_REG
+			       + (4 * row), &counters->pkts[row]);
+	}
+
+	DBG_VERBOSE("** Wildcard counters read time(msec): %llu\n",
+		    time_msec());
+}
+
 unsigned long int
 nf2_get_matched_count(struct nf2device *dev)
 {
@@ -845,3 +888,43 @@ nf2_get_port_info(struct nf2device *dev, int nf_port,
 	free(nf2addr);
 	return 0;
 }
+
+/* Reads the queue counters of all NF2_PORT_NUM ports into the array
+ * 'nf2portinfo', looking up the register addresses only once. */
+void
+nf2_get_all_port_info(struct nf2device *dev,
+		      struct nf2_port_info *nf2portinfo)
+{
+	struct nf2_all_ports_info_addr nf2addr;
+	int i;
+
+	nf2_get_all_ports_info_addr(&nf2addr);
+	for (i = 0; i < NF2_PORT_NUM; i++) {
+		struct nf2_port_info *info = &nf2portinfo[i];
+
+		readReg(dev, nf2addr.rx_q_num_pkts_stored_reg[i],
+			      &info->rx_q_num_pkts_stored);
+		readReg(dev, nf2addr.rx_q_num_pkts_dropped_full_reg[i],
+			      &info->rx_q_num_pkts_dropped_full);
+		readReg(dev, nf2addr.rx_q_num_pkts_dropped_bad_reg[i],
+			      &info->rx_q_num_pkts_dropped_bad);
+		readReg(dev, nf2addr.rx_q_num_words_pushed_reg[i],
+			      &info->rx_q_num_words_pushed);
+		readReg(dev, nf2addr.rx_q_num_bytes_pushed_reg[i],
+			      &info->rx_q_num_bytes_pushed);
+		readReg(dev, nf2addr.rx_q_num_pkts_dequeued_reg[i],
+			      &info->rx_q_num_pkts_dequeued);
+		readReg(dev, nf2addr.rx_q_num_pkts_in_queue_reg[i],
+			      &info->rx_q_num_pkts_in_queue);
+		readReg(dev, nf2addr.tx_q_num_pkts_in_queue_reg[i],
+			      &info->tx_q_num_pkts_in_queue);
+		readReg(dev, nf2addr.tx_q_num_pkts_sent_reg[i],
+			      &info->tx_q_num_pkts_sent);
+		readReg(dev, nf2addr.tx_q_num_words_pushed_reg[i],
+			      &info->tx_q_num_words_pushed);
+		readReg(dev, nf2addr.tx_q_num_bytes_pushed_reg[i],
+			      &info->tx_q_num_bytes_pushed);
+		readReg(dev, nf2addr.tx_q_num_pkts_enqueued_reg[i],
+			      &info->tx_q_num_pkts_enqueued);
+	}
+}
@@ -130,6 +130,13 @@ struct nf2_port_info {
 
 #pragma pack(pop)		/* XXX: Restore original alignment from stack */
 
+/* The running hit counters of every wildcard row, as read in one pass by
+ * nf2_get_wildcard_counters(). */
+struct nf2_wildcard_counters {
+	uint32_t pkts[OPENFLOW_WILDCARD_TABLE_SIZE];
+	uint32_t bytes[OPENFLOW_WILDCARD_TABLE_SIZE];
+};
+
 void nf2_reset_card(struct nf2device *);
 void nf2_clear_watchdog(struct nf2device *);
 int nf2_write_of_wildcard(struct nf2device *, int, nf2_of_entry_wrap *,
@@ -143,8 +150,13 @@ unsigned int nf2_get_exact_packet_count(struct nf2device *, int);
 unsigned int nf2_get_exact_byte_count(struct nf2device *, int);
 unsigned int nf2_get_wildcard_packet_count(struct nf2device *, int);
 unsigned int nf2_get_wildcard_byte_count(struct nf2device *, int);
+void nf2_get_exact_counters(struct nf2device *, int,
+			    nf2_of_exact_counters_wrap *);
+void nf2_get_wildcard_counters(struct nf2device *,
+			       struct nf2_wildcard_counters *);
 unsigned long int nf2_get_matched_count(struct nf2device *);
 unsigned long int nf2_get_missed_count(struct nf2device *);
 int nf2_get_port_info(struct nf2device *, int, struct nf2_port_info *);
+void nf2_get_all_port_info(struct nf2device *, struct nf2_port_info *);
 
 #endif
@@ -78,10 +78,18 @@ static void populate_action_strip_vlan(nf2_of_action_wrap *);
 int iface_chk_done = 0;
 int net_iface = 0;
 
+/* Device kept open between nf2_batch_begin() and nf2_batch_commit(), so that
+ * a batch of flow writes does not open and close it once per flow. */
+static struct nf2device *batch_dev;
+
 struct nf2device *
 nf2_get_net_device(void)
 {
 	struct nf2device *dev;
+
+	if (batch_dev) {
+		return batch_dev;
+	}
         dev = calloc(1, sizeof(struct nf2device));
         dev->device_name = DEFAULT_IFACE;
 
@@ -106,7 +114,7 @@ nf2_get_net_device(void)
 void
 nf2_free_net_device(struct nf2device *dev)
 {
-	if (dev == NULL){
+	if (dev == NULL || dev == batch_dev){
 		return;
 	}
 
@@ -114,6 +122,30 @@ nf2_free_net_device(struct nf2device *dev)
 	free(dev);
 }
 
+/* Opens the device for a batch of flow writes.  Until nf2_batch_commit(),
+ * nf2_get_net_device() returns the same device and nf2_free_net_device()
+ * leaves it open.  Returns 0 on success, 1 on failure.
+ */
+int
+nf2_batch_begin(void)
+{
+	if (batch_dev == NULL) {
+		batch_dev = nf2_get_net_device();
+	}
+	return batch_dev == NULL;
+}
+
+/* Closes the device opened by nf2_batch_begin().  Every register write is
+ * made as the flow is installed, so there is nothing left to flush. */
+void
+nf2_batch_commit(void)
+{
+	struct nf2device *dev = batch_dev;
+
+	batch_dev = NULL;
+	nf2_free_net_device(dev);
+}
+
 /* Checks to see if the actions requested by the flow are capable of being
  * done in the NF2 hardware. Returns 1 if yes, 0 for no.
  */
@@ -1047,3 +1079,45 @@ nf2_get_byte_count(struct nf2device *dev, struct nf2_flow *sfw)
 
 	return total;
 }
+
+/* Adds to '*packets' and '*bytes' what 'sfw' has forwarded since its
+ * counters were last collected.  Wildcard rows are taken from 'wc', a
+ * readout just made by nf2_get_wildcard_counters(); an exact row is read
+ * here, both words at once, since reading clears it. */
+void
+nf2_collect_counts(struct nf2device *dev, struct nf2_flow *sfw,
+		   const struct nf2_wildcard_counters *wc,
+		   uint64_t *packets, uint64_t *bytes)
+{
+	nf2_of_exact_counters_wrap counters;
+	struct nf2_flow *sfw_next = NULL;
+
+	switch (sfw->type) {
+	default:
+		break;
+
+	case NF2_TABLE_EXACT:
+		nf2_get_exact_counters(dev, sfw->pos, &counters);
+		*packets += counters.counters.pkt_count;
+		*bytes += counters.counters.byte_count;
+		break;
+
+	case NF2_TABLE_WILDCARD:
+		sfw_next = sfw;
+		do {
+			/* Unsigned subtraction also covers a wrapped sum. */
+			*packets += (uint32_t)(wc->pkts[sfw_next->pos]
+					       - sfw_next->hw_packet_count);
+			*bytes += (uint32_t)(wc->bytes[sfw_next->pos]
+					     - sfw_next->hw_byte_count);
+			sfw_next->hw_packet_count = wc->pkts[sfw_next->pos];
+			sfw_next->hw_byte_count = wc->bytes[sfw_next->pos];
+
+			if (!list_is_empty(&sfw_next->node)) {
+				sfw_next = CONTAINER_OF(list_front(&sfw_next->node),
+						      struct nf2_flow, node);
+			}
+		} while (sfw_next != sfw);
+		break;
+	}
+}
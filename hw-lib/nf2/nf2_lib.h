@@ -35,6 +35,8 @@
 
 struct nf2device *nf2_get_net_device(void);
 void nf2_free_net_device(struct nf2device *);
+int nf2_batch_begin(void);
+void nf2_batch_commit(void);
 int nf2_are_actions_supported(struct sw_flow *);
 void nf2_clear_of_exact(uint32_t);
 void nf2_clear_of_wildcard(uint32_t);
@@ -55,5 +57,8 @@ void nf2_delete_private(void *);
 int nf2_modify_acts(struct sw_flow *);
 uint64_t nf2_get_packet_count(struct nf2device *, struct nf2_flow *);
 uint64_t nf2_get_byte_count(struct nf2device *, struct nf2_flow *);
+void nf2_collect_counts(struct nf2device *, struct nf2_flow *,
+			const struct nf2_wildcard_counters *,
+			uint64_t *, uint64_t *);
 
 #endif
@@ -277,6 +277,10 @@ new_of_hw_driver(struct datapath *dp)
 
     hw_drv->ioctl = of_hw_ioctl;
 
+    hw_drv->flow_batch_begin = NULL;
+    hw_drv->flow_batch_commit = NULL;
+    hw_drv->flow_remove = NULL;
+
     ++of_hw_drv_instances;
 
     return hw_drv;
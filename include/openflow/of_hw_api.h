@@ -290,6 +290,39 @@ struct of_hw_driver {
     int (*ioctl)(of_hw_driver_t *hw_drv, uint32_t op, void **io_param,
                  int *io_len);
 
+    /* OPTIONAL
+     * flow_batch_begin(hw_drv)
+     * flow_batch_commit(hw_drv)
+     *
+     * Bracket a series of sw_table insert, modify and delete calls, such
+     * as a controller sends when it connects.  Between the two calls the
+     * driver may stage the changes and pipeline or coalesce its register
+     * or DMA writes, as long as every change has reached the hardware
+     * when flow_batch_commit returns.  Inserts staged in a batch must
+     * still report failure at the time they are made, so the driver
+     * should reserve hardware entries then and only defer the writes.
+     *
+     * Batches do not nest.  No lookups, stats requests or timeouts are
+     * made on the table during a batch.
+     *
+     * Return 0 on success, otherwise an of_hw_error_e value.
+     */
+    int (*flow_batch_begin)(of_hw_driver_t *hw_drv);
+    int (*flow_batch_commit)(of_hw_driver_t *hw_drv);
+
+    /* OPTIONAL
+     * flow_remove(hw_drv, flow)
+     *
+     * Remove 'flow', which must be in the hardware table, from it without
+     * freeing the flow or reporting it to the controller, after adding
+     * its last hardware counts to the flow's packet and byte counts.  The
+     * chain uses this to give hardware entries of little-used flows to
+     * busier ones.  If null, flows stay where they were first inserted.
+     *
+     * Return 0 on success, otherwise an of_hw_error_e value.
+     */
+    int (*flow_remove)(of_hw_driver_t *hw_drv, struct sw_flow *flow);
+
 };
 
 /**************** IOCTL values ****************/
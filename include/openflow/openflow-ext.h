@@ -24,6 +24,48 @@ enum ofp_extension_commands { /* Queue configuration commands */
     OFP_EXT_QUEUE_DELETE,  /* Remove a queue */
     OFP_EXT_SET_DESC,      /* Set ofp_desc_stat->dp_desc */
 
+    /* Several switch-to-controller messages sent as one, in the format of
+     * struct ofp_ext_bundle. */
+    OFP_EXT_BUNDLE,
+
+    /* Installs flows exported with OFP_EXT_STATS_FLOW_EXPORT, in the format
+     * of struct ofp_ext_flow_import. */
+    OFP_EXT_FLOW_IMPORT,
+
+    /* Modifies or deletes the flows whose cookies match, in the format of
+     * struct ofp_ext_cookie_flow_mod. */
+    OFP_EXT_COOKIE_FLOW_MOD,
+
+    /* Asks the switch to send this connection's packet_ins as UDP datagrams,
+     * in the format of struct ofp_ext_packet_in_udp. */
+    OFP_EXT_PACKET_IN_UDP,
+
+    /* Chooses the asynchronous messages that the switch sends on this
+     * connection, in the format of struct ofp_ext_set_async. */
+    OFP_EXT_SET_ASYNC,
+
+    /* Sends many packets, each with its own actions, in the format of
+     * struct ofp_ext_packet_out_batch. */
+    OFP_EXT_PACKET_OUT_BATCH,
+
+    /* Limits the messages that a monitor connection, or the connection that
+     * carried it, receives, in the format of struct
+     * ofp_ext_monitor_filter. */
+    OFP_EXT_MONITOR_FILTER,
+
+    /* Begins, commits or aborts the replacement of the whole flow table, in
+     * the format of struct ofp_ext_table_replace. */
+    OFP_EXT_TABLE_REPLACE,
+
+    /* Chooses the pipeline table that later flow_mods and flow statistics
+     * requests on this connection address, in the format of struct
+     * ofp_ext_set_table. */
+    OFP_EXT_SET_TABLE,
+
+    /* Sets what a pipeline table does with packets that match none of its
+     * flows, in the format of struct ofp_ext_table_miss. */
+    OFP_EXT_TABLE_MISS,
+
     OFP_EXT_COUNT
 };
 
@@ -34,6 +76,78 @@ struct ofp_extension_header {
 };
 OFP_ASSERT(sizeof(struct ofp_extension_header) == 16);
 
+/* Subtypes of OFPAT_VENDOR actions whose vendor is OPENFLOW_VENDOR_ID. */
+enum ofp_ext_action_subtype {
+    /* Polices the flow's packets with a token bucket, in the format of
+     * struct ofp_ext_action_police. */
+    OFP_EXT_ACT_POLICE,
+
+    /* Looks the packet up again in a later pipeline table, in the format of
+     * struct ofp_ext_action_goto_table. */
+    OFP_EXT_ACT_GOTO_TABLE
+};
+
+/* Header common to OPENFLOW_VENDOR_ID actions. */
+struct ofp_ext_action_header {
+    uint16_t type;              /* OFPAT_VENDOR. */
+    uint16_t len;               /* Length of the action, a multiple of 8. */
+    uint32_t vendor;            /* OPENFLOW_VENDOR_ID. */
+    uint16_t subtype;           /* One of OFP_EXT_ACT_*. */
+    uint8_t pad[6];
+};
+OFP_ASSERT(sizeof(struct ofp_ext_action_header) == 16);
+
+/* What OFP_EXT_ACT_POLICE does with a packet above the rate. */
+enum ofp_ext_police_exceed {
+    OFP_EXT_POLICE_DROP,        /* Drop it, skipping the actions after. */
+    OFP_EXT_POLICE_REMARK       /* Rewrite its IP ToS to 'nw_tos'. */
+};
+
+/* Token-bucket policer.  Every flow whose actions name the same 'meter_id'
+ * shares one bucket, which fills at 'rate' kbps up to 'burst' kbits.  A
+ * packet that finds enough tokens takes them and goes on to the next action;
+ * one that does not is dropped or remarked, as 'exceed' says.  The first
+ * action to name a meter sets its rate and burst, and an action that names
+ * it later with others is rejected with OFPBAC_BAD_ARGUMENT. */
+struct ofp_ext_action_police {
+    uint16_t type;              /* OFPAT_VENDOR. */
+    uint16_t len;               /* Length is 24. */
+    uint32_t vendor;            /* OPENFLOW_VENDOR_ID. */
+    uint16_t subtype;           /* OFP_EXT_ACT_POLICE. */
+    uint8_t exceed;             /* One of OFP_EXT_POLICE_*. */
+    uint8_t nw_tos;             /* IP ToS for OFP_EXT_POLICE_REMARK. */
+    uint32_t meter_id;          /* Bucket shared by actions with this ID. */
+    uint32_t rate;              /* Rate in kbps, nonzero. */
+    uint32_t burst;             /* Bucket size in kbits, 0 for a default. */
+};
+OFP_ASSERT(sizeof(struct ofp_ext_action_police) == 24);
+
+/* Number of tables in the switch's pipeline.  Table 0 is the flow table that
+ * OpenFlow 1.0 messages address; a packet reaches the others only through
+ * OFP_EXT_ACT_GOTO_TABLE or an OFP_EXT_MISS_CONTINUE miss. */
+#define OFP_EXT_PIPELINE_TABLES 8
+
+/* Ends a flow's actions by looking the packet, as those actions left it, up
+ * in pipeline table 'table_id' and applying the actions of the flow that it
+ * matches there, or the table's miss behavior if none does.  Splitting a
+ * policy into tables, such as an ACL table that goes to a forwarding table,
+ * takes one flow per rule in each table instead of one per combination of
+ * rules.
+ *
+ * The action must be the last in its list, and 'table_id' must be after the
+ * table that holds the flow, so that a packet can never loop; otherwise the
+ * flow_mod is rejected with OFPBAC_BAD_ARGUMENT.  A packet_out may go to any
+ * table but 0. */
+struct ofp_ext_action_goto_table {
+    uint16_t type;              /* OFPAT_VENDOR. */
+    uint16_t len;               /* Length is 16. */
+    uint32_t vendor;            /* OPENFLOW_VENDOR_ID. */
+    uint16_t subtype;           /* OFP_EXT_ACT_GOTO_TABLE. */
+    uint8_t table_id;           /* 1 to OFP_EXT_PIPELINE_TABLES - 1. */
+    uint8_t pad[5];
+};
+OFP_ASSERT(sizeof(struct ofp_ext_action_goto_table) == 16);
+
 /****************************************************************
  *
  * OpenFlow Queue Configuration Operations
@@ -87,9 +201,512 @@ struct openflow_ext_set_dp_desc {
 };
 OFP_ASSERT(sizeof(struct openflow_ext_set_dp_desc) == 272);
 
+/* A sequence of complete OpenFlow messages, each with its own header, packed
+ * into one message.  A datapath sends these only if configured to do so, for
+ * messages such as flow expirations that come in large bursts. */
+struct ofp_ext_bundle {
+    struct ofp_extension_header header;
+    /* Followed by OpenFlow messages, up to the end of the message. */
+};
+OFP_ASSERT(sizeof(struct ofp_ext_bundle) == 16);
+
+/* A flow as exported by OFP_EXT_STATS_FLOW_EXPORT and installed by
+ * OFP_EXT_FLOW_IMPORT.  Ages let the importer restore a flow's timeouts and
+ * duration without the two sides sharing a clock. */
+struct ofp_ext_flow_record {
+    uint16_t length;            /* Length of record, including actions; a
+                                 * multiple of 8. */
+    uint8_t emerg;              /* Nonzero for an emergency flow. */
+    uint8_t send_flow_rem;      /* Nonzero to send flow_removed. */
+    uint16_t priority;
+    uint16_t idle_timeout;
+    uint16_t hard_timeout;
+    uint8_t pad[6];
+    uint64_t created_age;       /* Milliseconds since the flow was added. */
+    uint64_t used_age;          /* Milliseconds since it was last used. */
+    uint64_t cookie;
+    uint64_t packet_count;
+    uint64_t byte_count;
+    struct ofp_match match;
+    struct ofp_action_header actions[0];
+};
+OFP_ASSERT(sizeof(struct ofp_ext_flow_record) == 96);
+
+/* OFP_EXT_FLOW_IMPORT message.  The switch installs each record as if by an
+ * OFPFC_ADD flow_mod, keeping its counters and ages, and sends an error for
+ * each record that it cannot install. */
+struct ofp_ext_flow_import {
+    struct ofp_extension_header header;
+    struct ofp_ext_flow_record records[0];
+};
+OFP_ASSERT(sizeof(struct ofp_ext_flow_import) == 16);
+
+/* OFP_EXT_COOKIE_FLOW_MOD message.  Selects every flow, emergency flows
+ * included, whose cookie equals 'cookie' in the bits set in 'cookie_mask'.
+ * OFPFC_MODIFY replaces the selected flows' actions by 'actions'.
+ * OFPFC_DELETE deletes those of them that have an output action to
+ * 'out_port', or all of them if 'out_port' is OFPP_NONE, sending
+ * flow_removed messages as an OFPFC_DELETE flow_mod would.  The switch
+ * indexes flows by cookie, so this takes time proportional to the number of
+ * flows selected if 'cookie_mask' has every bit set. */
+struct ofp_ext_cookie_flow_mod {
+    struct ofp_extension_header header;
+    uint64_t cookie;
+    uint64_t cookie_mask;
+    uint16_t command;           /* OFPFC_MODIFY or OFPFC_DELETE. */
+    uint16_t out_port;          /* For OFPFC_DELETE. */
+    uint8_t pad[4];
+    struct ofp_action_header actions[0]; /* For OFPFC_MODIFY. */
+};
+OFP_ASSERT(sizeof(struct ofp_ext_cookie_flow_mod) == 40);
+
+/* OFP_EXT_PACKET_IN_UDP message.  From then on, the switch sends packet_ins
+ * for the connection that carried this message as UDP datagrams to 'ip' and
+ * 'port', one OFPT_PACKET_IN per datagram, instead of over the connection.
+ * Datagrams are unreliable: when the controller falls behind, the switch
+ * drops the oldest packet_ins it has not sent yet, rather than queuing them
+ * ahead of its other messages.  An 'ip' of 0 means the connection's peer
+ * address (the loopback address for a Unix domain socket).  A 'port' of 0
+ * sends packet_ins over the connection again. */
+struct ofp_ext_packet_in_udp {
+    struct ofp_extension_header header;
+    uint32_t ip;                /* IPv4 address, or 0. */
+    uint16_t port;              /* UDP port, or 0 to stop. */
+    uint8_t pad[2];
+};
+OFP_ASSERT(sizeof(struct ofp_ext_packet_in_udp) == 24);
+
+/* OFP_EXT_SET_ASYNC message.  From then on, the switch sends a packet_in,
+ * port_status or flow_removed message on the connection that carried this
+ * message only if the bit for the message's reason is set in the matching
+ * mask: bit OFPR_NO_MATCH of 'packet_in_mask' for a packet_in with reason
+ * OFPR_NO_MATCH, and so on.  If 'ports' is not empty, packet_ins are also
+ * limited to packets received on the listed ports, and port_status
+ * messages to those ports.  A connection receives every asynchronous
+ * message until it sends this message.
+ *
+ * Connections that give a nonzero 'balance_id' share packet_ins: each
+ * packet_in that more than one of them would receive goes only to the one
+ * whose 'balance_id' ranks highest for a hash of the packet's flow.  A
+ * flow's packet_ins thus keep going to the same connection for as long as
+ * it stays up, and when it goes down, only its share moves to the others.
+ * Controllers that share packet_ins should each use a different
+ * 'balance_id', and the same one each time they reconnect. */
+struct ofp_ext_set_async {
+    struct ofp_extension_header header;
+    uint32_t packet_in_mask;    /* Bits for OFPR_* reasons. */
+    uint32_t port_status_mask;  /* Bits for OFPPR_* reasons. */
+    uint32_t flow_removed_mask; /* Bits for OFPRR_* reasons. */
+    uint32_t balance_id;        /* Nonzero to share packet_ins. */
+    uint16_t ports[0];          /* Ports of interest, up to the end of the
+                                 * message, or none for every port. */
+};
+OFP_ASSERT(sizeof(struct ofp_ext_set_async) == 32);
+
+/* One packet in an OFP_EXT_PACKET_OUT_BATCH message, followed by
+ * 'actions_len' bytes of actions, then 'data_len' bytes of packet data if
+ * 'buffer_id' is -1, then zeros up to 'length'.  An entry with no actions
+ * uses the actions of the entry before it, so that a batch of packets that
+ * go the same way carries, validates and compiles its actions only once;
+ * the first entry in a batch with no actions drops its packet. */
+struct ofp_ext_packet_out_entry {
+    uint16_t length;            /* Length of the entry, a multiple of 8. */
+    uint16_t in_port;           /* Packet's input port (OFPP_NONE if none). */
+    uint32_t buffer_id;         /* ID assigned by datapath (-1 if none). */
+    uint16_t actions_len;       /* Size of action array in bytes. */
+    uint16_t data_len;          /* Size of packet data in bytes. */
+    uint8_t pad[4];
+    struct ofp_action_header actions[0];
+};
+OFP_ASSERT(sizeof(struct ofp_ext_packet_out_entry) == 16);
+
+/* OFP_EXT_PACKET_OUT_BATCH message.  The switch handles each entry in turn
+ * as it would an OFPT_PACKET_OUT with the same fields.  An entry whose
+ * actions fail validation is skipped, with an OFPET_BAD_ACTION error, and an
+ * entry whose buffer is gone is skipped silently; the other entries are
+ * still sent.  A message whose entries do not fit exactly in its length is
+ * rejected as a whole. */
+struct ofp_ext_packet_out_batch {
+    struct ofp_extension_header header;
+    struct ofp_ext_packet_out_entry entries[0];
+};
+OFP_ASSERT(sizeof(struct ofp_ext_packet_out_batch) == 16);
+
+/* OFP_EXT_MONITOR_FILTER message.  Sent on a secure channel monitor
+ * connection ("ofprotocol --monitor"), it makes the secure channel copy to
+ * that connection only messages whose type has its bit set in 'types': bit
+ * OFPT_PACKET_IN for packet_ins, and so on.  Messages with types of 32 or
+ * more are always copied.
+ *
+ * Sent to a switch, it stops the switch from sending packet_in,
+ * port_status and flow_removed messages whose bits are clear on the
+ * connection that carried it, as an OFP_EXT_SET_ASYNC with all-zero or
+ * all-one masks would. */
+struct ofp_ext_monitor_filter {
+    struct ofp_extension_header header;
+    uint32_t types;             /* Bits for OFPT_* message types. */
+    uint8_t pad[4];
+};
+OFP_ASSERT(sizeof(struct ofp_ext_monitor_filter) == 24);
+
+/* Commands in struct ofp_ext_table_replace. */
+enum ofp_ext_table_replace_command {
+    OFP_EXT_REPLACE_BEGIN,      /* Start staging a new flow table. */
+    OFP_EXT_REPLACE_COMMIT,     /* Swap the staged table in. */
+    OFP_EXT_REPLACE_ABORT       /* Discard the staged table. */
+};
+
+/* OFP_EXT_TABLE_REPLACE message.  After OFP_EXT_REPLACE_BEGIN, flow_mods on
+ * the connection that sent it change a new, empty flow table instead of the
+ * one that forwards packets, which is left alone.  OFP_EXT_REPLACE_COMMIT
+ * then puts the new table in its place at once, with no flow_removed
+ * messages for the flows that go away.  A flow in the new table with the
+ * same match and priority as one in the old keeps that flow's counters and
+ * age, as if it had been modified in place.  OFP_EXT_REPLACE_ABORT, or
+ * closing the connection, discards the new table.  A second BEGIN starts
+ * over with an empty table. */
+struct ofp_ext_table_replace {
+    struct ofp_extension_header header;
+    uint16_t command;           /* One of OFP_EXT_REPLACE_*. */
+    uint8_t pad[6];
+};
+OFP_ASSERT(sizeof(struct ofp_ext_table_replace) == 24);
+
+/* OFP_EXT_SET_TABLE message.  Flow_mods, and flow and aggregate statistics
+ * requests, sent on the same connection after it address pipeline table
+ * 'table_id' instead of table 0, until another OFP_EXT_SET_TABLE.  Their
+ * OpenFlow 1.0 'table_id', if any, still selects among the tables that
+ * store the pipeline table's flows.  An OFP_EXT_TABLE_REPLACE transaction
+ * only replaces table 0, so the switch rejects one while 'table_id' is
+ * not 0, and rejects this message during one, with OFPBRC_EPERM. */
+struct ofp_ext_set_table {
+    struct ofp_extension_header header;
+    uint8_t table_id;           /* Less than OFP_EXT_PIPELINE_TABLES. */
+    uint8_t pad[7];
+};
+OFP_ASSERT(sizeof(struct ofp_ext_set_table) == 24);
+
+/* What a pipeline table does with a packet that matches none of its flows. */
+enum ofp_ext_table_miss_behavior {
+    OFP_EXT_MISS_CONTROLLER,    /* Send a packet_in (the default). */
+    OFP_EXT_MISS_CONTINUE,      /* Look it up in the next table. */
+    OFP_EXT_MISS_DROP           /* Drop it. */
+};
+
+/* OFP_EXT_TABLE_MISS message.  Sets pipeline table 'table_id''s miss
+ * behavior to 'miss', one of OFP_EXT_MISS_*.  OFP_EXT_MISS_CONTINUE in the
+ * last table acts as OFP_EXT_MISS_DROP. */
+struct ofp_ext_table_miss {
+    struct ofp_extension_header header;
+    uint8_t table_id;           /* Less than OFP_EXT_PIPELINE_TABLES. */
+    uint8_t miss;               /* One of OFP_EXT_MISS_*. */
+    uint8_t pad[6];
+};
+OFP_ASSERT(sizeof(struct ofp_ext_table_miss) == 24);
+
+/* Header of the file written by "dpctl save-flows" and "ofdatapath
+ * --flow-snapshot", followed by 'n_flows' struct ofp_ext_flow_record. */
+#define OFP_EXT_FLOW_FILE_MAGIC 0x4f465353 /* "OFSS". */
+#define OFP_EXT_FLOW_FILE_VERSION 1
+struct ofp_ext_flow_file_header {
+    uint32_t magic;             /* OFP_EXT_FLOW_FILE_MAGIC. */
+    uint32_t version;           /* OFP_EXT_FLOW_FILE_VERSION. */
+    uint64_t datapath_id;       /* Datapath whose flows were saved. */
+    uint32_t n_flows;           /* Number of records that follow. */
+    uint8_t pad[4];
+};
+OFP_ASSERT(sizeof(struct ofp_ext_flow_file_header) == 24);
+
 #define ofq_error_string(rv) (((rv) < OFQ_ERR_COUNT) && ((rv) >= 0) ? \
     openflow_queue_error_strings[rv] : "Unknown error code")
 
+/* Statistics (OFPST_VENDOR) whose request and reply bodies begin with
+ * struct ofp_extension_stats_header. */
+enum ofp_extension_stats_types {
+    /* Packet buffer occupancy.  The request body is just the header; the
+     * reply body is struct ofp_ext_buffer_stats. */
+    OFP_EXT_STATS_BUFFER,
+
+    /* Flows that matched a packet since an earlier poll.  The request body
+     * is struct ofp_ext_flow_delta_request; each reply body is struct
+     * ofp_ext_flow_delta_reply. */
+    OFP_EXT_STATS_FLOW_DELTA,
+
+    /* Time spent in each stage of forwarding a received packet.  The
+     * request body is just the header; the reply body is struct
+     * ofp_ext_latency_stats. */
+    OFP_EXT_STATS_LATENCY,
+
+    /* Every flow, in a form that OFP_EXT_FLOW_IMPORT can reinstall.  The
+     * request body is just the header; each reply body is struct
+     * ofp_ext_flow_export. */
+    OFP_EXT_STATS_FLOW_EXPORT,
+
+    /* Flows selected by cookie, as by OFP_EXT_COOKIE_FLOW_MOD.  The request
+     * body is struct ofp_ext_cookie_flow_request; each reply body is struct
+     * ofp_ext_cookie_flow_reply. */
+    OFP_EXT_STATS_COOKIE_FLOW,
+
+    /* Estimates of the flows that matched the most packets or bytes
+     * recently.  The request body is struct ofp_ext_top_flows_request; the
+     * reply body is struct ofp_ext_top_flows_reply. */
+    OFP_EXT_STATS_TOP_FLOWS,
+
+    /* How the switch would look up a flow or packet, without forwarding
+     * it.  The request body is struct ofp_ext_trace_request; the reply body
+     * is struct ofp_ext_trace_reply. */
+    OFP_EXT_STATS_TRACE,
+
+    /* Packets dropped, by port and reason.  The request body is struct
+     * ofp_ext_port_drops_request; each reply body is struct
+     * ofp_ext_port_drops_reply. */
+    OFP_EXT_STATS_PORT_DROPS,
+
+    OFP_EXT_STATS_COUNT
+};
+
+struct ofp_extension_stats_header {
+    uint32_t vendor;            /* OPENFLOW_VENDOR_ID. */
+    uint32_t subtype;           /* One of ofp_extension_stats_types. */
+};
+OFP_ASSERT(sizeof(struct ofp_extension_stats_header) == 8);
+
+/* Body of reply to OFP_EXT_STATS_BUFFER request. */
+struct ofp_ext_buffer_stats {
+    struct ofp_extension_stats_header header;
+    uint32_t n_buffers;         /* Number of packet buffers. */
+    uint32_t n_used;            /* Buffers currently holding a packet. */
+    uint64_t n_saved;           /* Packets buffered. */
+    uint64_t n_evicted;         /* Unclaimed packets dropped to make room. */
+    uint64_t n_full;            /* Packets sent unbuffered for lack of room. */
+};
+OFP_ASSERT(sizeof(struct ofp_ext_buffer_stats) == 40);
+
+/* Body of OFP_EXT_STATS_FLOW_DELTA request.  Selects flows as an OFPST_FLOW
+ * request does, but only those that have counted a packet, or that were
+ * added, since 'since'.  Passing the 'generation' from the reply to the
+ * previous request, or 0 the first time, gets just the flows whose counters
+ * changed in between. */
+struct ofp_ext_flow_delta_request {
+    struct ofp_extension_stats_header header;
+    uint64_t since;             /* Generation from an earlier reply, or 0. */
+    struct ofp_flow_stats_request flows;
+    uint8_t pad[4];             /* Align to 64 bits. */
+};
+OFP_ASSERT(sizeof(struct ofp_ext_flow_delta_request) == 64);
+
+/* Body of reply to OFP_EXT_STATS_FLOW_DELTA request.  Each reply message in a
+ * multipart reply carries the same 'generation'. */
+struct ofp_ext_flow_delta_reply {
+    struct ofp_extension_stats_header header;
+    uint64_t generation;        /* Value for 'since' in the next request. */
+    struct ofp_flow_stats stats[0];
+};
+OFP_ASSERT(sizeof(struct ofp_ext_flow_delta_reply) == 16);
+
+/* Forwarding stages timed for OFP_EXT_STATS_LATENCY.  The stages nest: a
+ * packet's time in OFP_EXT_LATENCY_PORT_INPUT includes its lookup, its
+ * actions and, on a miss, its trip to the controller. */
+enum ofp_ext_latency_stage {
+    OFP_EXT_LATENCY_PORT_INPUT, /* All processing of a received packet. */
+    OFP_EXT_LATENCY_LOOKUP,     /* Parsing and flow table lookup. */
+    OFP_EXT_LATENCY_ACTIONS,    /* Executing a matched flow's actions. */
+    OFP_EXT_LATENCY_CONTROL,    /* Building and queuing a packet_in. */
+    OFP_EXT_LATENCY_N_STAGES
+};
+
+/* Number of buckets in each latency histogram.  Bucket 0 counts times of 0
+ * ticks, and bucket i > 0 times from 2**(i-1) to 2**i - 1 ticks, except that
+ * the last bucket also counts all longer times. */
+#define OFP_EXT_LATENCY_BUCKETS 32
+
+/* Histogram of the time spent in one forwarding stage. */
+struct ofp_ext_latency_hist {
+    uint16_t stage;             /* One of OFP_EXT_LATENCY_*. */
+    uint8_t pad[6];             /* Align to 64 bits. */
+    uint64_t n_samples;         /* Number of times the stage was timed. */
+    uint64_t total_ticks;       /* Sum of those times. */
+    uint64_t buckets[OFP_EXT_LATENCY_BUCKETS];
+};
+OFP_ASSERT(sizeof(struct ofp_ext_latency_hist) == 280);
+
+/* Body of reply to OFP_EXT_STATS_LATENCY request.  Times are measured in
+ * ticks of a clock that runs at 'ticks_per_sec'. */
+struct ofp_ext_latency_stats {
+    struct ofp_extension_stats_header header;
+    uint64_t ticks_per_sec;     /* Clock rate, or 0 if unknown. */
+    struct ofp_ext_latency_hist stages[0];
+};
+OFP_ASSERT(sizeof(struct ofp_ext_latency_stats) == 16);
+
+/* Body of reply to OFP_EXT_STATS_FLOW_EXPORT request. */
+struct ofp_ext_flow_export {
+    struct ofp_extension_stats_header header;
+    struct ofp_ext_flow_record records[0];
+};
+OFP_ASSERT(sizeof(struct ofp_ext_flow_export) == 8);
+
+/* Body of OFP_EXT_STATS_COOKIE_FLOW request. */
+struct ofp_ext_cookie_flow_request {
+    struct ofp_extension_stats_header header;
+    uint64_t cookie;
+    uint64_t cookie_mask;
+    uint16_t out_port;          /* Require an output action to this port, or
+                                 * OFPP_NONE for any. */
+    uint8_t pad[6];
+};
+OFP_ASSERT(sizeof(struct ofp_ext_cookie_flow_request) == 32);
+
+/* Body of reply to OFP_EXT_STATS_COOKIE_FLOW request. */
+struct ofp_ext_cookie_flow_reply {
+    struct ofp_extension_stats_header header;
+    struct ofp_flow_stats stats[0];
+};
+OFP_ASSERT(sizeof(struct ofp_ext_cookie_flow_reply) == 8);
+
+/* Counters by which OFP_EXT_STATS_TOP_FLOWS ranks flows. */
+enum ofp_ext_top_flows_by {
+    OFP_EXT_TOP_BY_PACKETS,
+    OFP_EXT_TOP_BY_BYTES
+};
+
+/* Body of OFP_EXT_STATS_TOP_FLOWS request. */
+struct ofp_ext_top_flows_request {
+    struct ofp_extension_stats_header header;
+    uint16_t n_flows;           /* Maximum number of flows to report. */
+    uint8_t by;                 /* One of OFP_EXT_TOP_BY_*. */
+    uint8_t pad[5];
+};
+OFP_ASSERT(sizeof(struct ofp_ext_top_flows_request) == 16);
+
+/* One flow in a reply to OFP_EXT_STATS_TOP_FLOWS.  The counter that the
+ * request ranked by is an estimate that may exceed the true count by up to
+ * 'error'; the other counts only packets seen since the switch began
+ * tracking the flow, and so may fall short. */
+struct ofp_ext_top_flow {
+    struct ofp_match match;
+    uint64_t cookie;
+    uint64_t packet_count;
+    uint64_t byte_count;
+    uint64_t error;
+    uint16_t priority;
+    uint8_t pad[6];
+};
+OFP_ASSERT(sizeof(struct ofp_ext_top_flow) == 80);
+
+/* Body of reply to OFP_EXT_STATS_TOP_FLOWS request.  Flows are in decreasing
+ * order of the ranked counter, which counts the last 'window_msec'
+ * milliseconds.  The reply has no flows if the switch is not tracking
+ * heavy hitters. */
+struct ofp_ext_top_flows_reply {
+    struct ofp_extension_stats_header header;
+    uint32_t window_msec;
+    uint8_t by;                 /* One of OFP_EXT_TOP_BY_*. */
+    uint8_t pad[3];
+    struct ofp_ext_top_flow flows[0];
+};
+OFP_ASSERT(sizeof(struct ofp_ext_top_flows_reply) == 16);
+
+/* Body of OFP_EXT_STATS_TRACE request.  If 'data' is empty, the switch looks
+ * up the flow given by 'match', ignoring its wildcards, so that each field
+ * the match leaves out is taken to be 0.  Otherwise it looks up the flow
+ * that it extracts from the Ethernet frame in 'data', as if it had been
+ * received on port 'match.in_port'.  Either way, the switch forwards
+ * nothing and changes no counters. */
+struct ofp_ext_trace_request {
+    struct ofp_extension_stats_header header;
+    struct ofp_match match;
+    uint8_t data[0];            /* Ethernet frame, up to the end of the
+                                 * request. */
+};
+OFP_ASSERT(sizeof(struct ofp_ext_trace_request) == 48);
+
+/* One table searched for an OFP_EXT_STATS_TRACE request, in lookup order. */
+struct ofp_ext_trace_table {
+    uint8_t table_id;           /* As in flow stats: 0xfe for the emergency
+                                 * table. */
+    uint8_t matched;            /* Nonzero if the flow was found here. */
+    uint8_t pad[2];
+    uint32_t n_compares;        /* Flows the search compared with the packet,
+                                 * or UINT32_MAX if the table cannot tell. */
+    char name[OFP_MAX_TABLE_NAME_LEN];
+};
+OFP_ASSERT(sizeof(struct ofp_ext_trace_table) == 40);
+
+/* Body of reply to OFP_EXT_STATS_TRACE request.  'n_tables' instances of
+ * struct ofp_ext_trace_table follow, and then the matching flow's actions
+ * up to the end of the reply.  If no flow matched, 'table_id' is 0xff and
+ * 'priority', 'cookie' and 'match' are zero. */
+struct ofp_ext_trace_reply {
+    struct ofp_extension_stats_header header;
+    uint8_t table_id;           /* Table that matched, as in flow stats. */
+    uint8_t cached;             /* Nonzero if the switch's exact-match cache
+                                 * holds the result. */
+    uint8_t n_tables;           /* Number of tables searched. */
+    uint8_t pad;
+    uint16_t priority;          /* Matching flow's priority. */
+    uint8_t pad2[2];
+    uint64_t cookie;            /* Matching flow's cookie. */
+    struct ofp_match key;       /* Flow that was looked up. */
+    struct ofp_match match;     /* Matching flow's match. */
+    struct ofp_ext_trace_table tables[0];
+};
+OFP_ASSERT(sizeof(struct ofp_ext_trace_reply) == 104);
+
+/* Reasons for which OFP_EXT_STATS_PORT_DROPS counts packets.  A packet is
+ * counted against the port it was received on, except for OFP_EXT_DROP_TX
+ * and OFP_EXT_DROP_SHAPER_QUEUE, which count against the port it was being
+ * sent on. */
+enum ofp_ext_drop_reason {
+    OFP_EXT_DROP_FRAG,          /* IP fragment, with OFPC_FRAG_DROP. */
+    OFP_EXT_DROP_NO_RECV,       /* Port has OFPPC_NO_RECV or
+                                 * OFPPC_NO_RECV_STP. */
+    OFP_EXT_DROP_RX_QUEUE,      /* Receive thread's queue was full. */
+    OFP_EXT_DROP_MISS_QUEUE,    /* Flow table miss found the port's queue of
+                                 * packets for the controller full. */
+    OFP_EXT_DROP_UNBUFFERED,    /* Not a drop: a packet_in that carried the
+                                 * whole packet because no packet buffer was
+                                 * free. */
+    OFP_EXT_DROP_CONTROL_QUEUE, /* Packet_in found the send queue of one or
+                                 * more controller connections full. */
+    OFP_EXT_DROP_TX,            /* Transmission failed. */
+    OFP_EXT_DROP_SHAPER_QUEUE,  /* Userspace shaper's queue was full. */
+    OFP_EXT_DROP_HW_RING,       /* Hardware receive ring was full. */
+    OFP_EXT_DROP_PACKET_IN_RATE, /* Packet_in above the port's rate limit
+                                  * for its reason. */
+    OFP_EXT_DROP_TABLE_MISS,    /* Missed in a pipeline table whose miss
+                                 * behavior is OFP_EXT_MISS_DROP. */
+    OFP_EXT_DROP_N_REASONS
+};
+
+/* Body of OFP_EXT_STATS_PORT_DROPS request. */
+struct ofp_ext_port_drops_request {
+    struct ofp_extension_stats_header header;
+    uint16_t port_no;           /* Port to report, or OFPP_NONE for all
+                                 * ports. */
+    uint8_t pad[6];
+};
+OFP_ASSERT(sizeof(struct ofp_ext_port_drops_request) == 16);
+
+/* Drops counted for one port in reply to OFP_EXT_STATS_PORT_DROPS.  A
+ * 'port_no' of OFPP_NONE reports the drops that the switch cannot attribute
+ * to any port, such as those from a hardware receive ring. */
+struct ofp_ext_port_drops {
+    uint16_t port_no;
+    uint16_t length;            /* Length of this entry, in bytes. */
+    uint8_t pad[4];
+    uint64_t drops[0];          /* Indexed by OFP_EXT_DROP_*, up to
+                                 * 'length'. */
+};
+OFP_ASSERT(sizeof(struct ofp_ext_port_drops) == 8);
+
+/* Body of reply to OFP_EXT_STATS_PORT_DROPS request. */
+struct ofp_ext_port_drops_reply {
+    struct ofp_extension_stats_header header;
+    /* Followed by struct ofp_ext_port_drops, up to the end of the reply. */
+};
+OFP_ASSERT(sizeof(struct ofp_ext_port_drops_reply) == 8);
+
 /****************************************************************
  *
  * Unsupported, but potential extended queue properties
@@ -44,6 +44,7 @@ enum {
 	DP_GENL_A_MC_GROUP,	 /* Generic netlink multicast group. */
 	DP_GENL_A_OPENFLOW,  /* OpenFlow packet. */
 	DP_GENL_A_DP_NAME,	 /* Datapath device name. */
+	DP_GENL_A_UPCALL_PIDS, /* Array of u32 Netlink pids for packet-ins. */
 
 	__DP_GENL_A_MAX,
 	DP_GENL_A_MAX = __DP_GENL_A_MAX - 1
@@ -58,6 +59,7 @@ enum dp_genl_command {
 	DP_GENL_C_ADD_PORT,	 /* Add port to datapath. */
 	DP_GENL_C_DEL_PORT,	 /* Remove port from datapath. */
 	DP_GENL_C_OPENFLOW,  /* Encapsulated OpenFlow protocol. */
+	DP_GENL_C_SET_UPCALL_PIDS, /* Set sockets that receive packet-ins. */
 
 	__DP_GENL_C_MAX,
 	DP_GENL_C_MAX = __DP_GENL_C_MAX - 1
@@ -66,4 +68,7 @@ enum dp_genl_command {
 /* Maximum number of datapaths. */
 #define DP_MAX 256
 
+/* Maximum number of Netlink pids in DP_GENL_A_UPCALL_PIDS. */
+#define DP_MAX_UPCALL_PIDS 64
+
 #endif /* openflow/openflow-netlink.h */
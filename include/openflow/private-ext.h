@@ -51,6 +51,8 @@
 #define PRIVATEOPT_PROTOCOL_STATS_REPLY		0x0002
 #define PRIVATEOPT_EMERG_FLOW_PROTECTION	0x0003
 #define PRIVATEOPT_EMERG_FLOW_RESTORATION	0x0004
+#define PRIVATEOPT_PROCESSING_STATS_REQUEST	0x0005
+#define PRIVATEOPT_PROCESSING_STATS_REPLY	0x0006
 
 struct private_vxhdr {
 	struct ofp_header ofp_hdr;	/* protocol header */
@@ -65,4 +67,38 @@ struct private_vxopt {
 	/* uint8_t pvo_value[0]; */
 } __attribute__ ((__packed__));
 
+/* PRIVATEOPT_PROCESSING_STATS_REPLY value: how long the datapath took to
+ * process the OpenFlow messages it received, by message type, and how long
+ * flow additions and modifications took as the flow tables filled.  All
+ * times are in nanoseconds, except that the histogram buckets are powers of
+ * 2 microseconds: bucket 0 counts messages that took under 1 us, bucket i
+ * those that took from 2**(i-1) up to 2**i us, and the last bucket also
+ * everything slower. */
+#define PRIVATE_PROC_N_TYPES	32	/* Message types counted, by OFPT_*. */
+#define PRIVATE_PROC_BUCKETS	16	/* Time histogram buckets. */
+#define PRIVATE_PROC_SIZES	20	/* Flow count buckets. */
+
+struct private_proc_type {
+	uint64_t n_msgs;
+	uint64_t total_nsec;
+	uint64_t max_nsec;
+	uint64_t buckets[PRIVATE_PROC_BUCKETS];
+};
+
+/* Flow_mods that added or modified flows when the flow tables held, in all,
+ * no flows (size 0) or from 2**(i-1) up to 2**i - 1 flows (size i), with
+ * the last size also counting larger tables. */
+struct private_proc_size {
+	uint64_t n_adds;
+	uint64_t add_nsec;
+	uint64_t n_mods;
+	uint64_t mod_nsec;
+};
+
+struct private_proc_stats {
+	uint64_t duration_msec;	/* Time since counting began. */
+	struct private_proc_type types[PRIVATE_PROC_N_TYPES];
+	struct private_proc_size sizes[PRIVATE_PROC_SIZES];
+};
+
 #endif
@@ -25,12 +25,16 @@ lib_libopenflow_a_SOURCES = \
 	lib/fatal-signal.h \
 	lib/fault.c \
 	lib/fault.h \
+	lib/flow-file.c \
+	lib/flow-file.h \
 	lib/flow.c \
 	lib/flow.h \
 	lib/hash.c \
 	lib/hash.h \
 	lib/hmap.c \
 	lib/hmap.h \
+	lib/hugepage.c \
+	lib/hugepage.h \
 	lib/leak-checker.c \
 	lib/leak-checker.h \
 	lib/learning-switch.c \
@@ -39,8 +43,12 @@ lib_libopenflow_a_SOURCES = \
 	lib/list.h \
 	lib/mac-learning.c \
 	lib/mac-learning.h \
+	lib/metrics.c \
+	lib/metrics.h \
 	lib/netdev.c \
 	lib/netdev.h \
+	lib/ofp-parse.c \
+	lib/ofp-parse.h \
 	lib/ofp-print.c \
 	lib/ofp-print.h \
 	lib/ofpbuf.c \
@@ -69,6 +77,8 @@ lib_libopenflow_a_SOURCES = \
 	lib/signals.h \
 	lib/socket-util.c \
 	lib/socket-util.h \
+	lib/stats-file.c \
+	lib/stats-file.h \
 	lib/stp.c \
 	lib/stp.h \
 	lib/svec.c \
@@ -80,6 +90,7 @@ lib_libopenflow_a_SOURCES = \
 	lib/type-props.h \
 	lib/util.c \
 	lib/util.h \
+	lib/vconn-inproc.c \
 	lib/vconn-provider.h \
 	lib/vconn-ssl.h \
 	lib/vconn-stream.c \
@@ -105,6 +116,10 @@ lib_libopenflow_a_SOURCES += \
 	lib/vconn-netlink.c
 endif
 
+if HAVE_EVENTFD
+lib_libopenflow_a_SOURCES += lib/vconn-shm.c
+endif
+
 if HAVE_OPENSSL
 lib_libopenflow_a_SOURCES += \
 	lib/vconn-ssl.c 
@@ -60,6 +60,19 @@ static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(5, 60);
 /* The Generic Netlink family number used for OpenFlow. */
 static int openflow_family;
 
+/* Receive buffer size for datapath sockets.  It is large because we
+ * occasionally need to be able to retrieve large collections of flow records,
+ * and because a burst of packet-ins that overflows it is lost. */
+static size_t so_rcvbuf = 4 * 1024u * 1024;
+
+/* Number of Netlink messages that a socket subscribed to a datapath's
+ * asynchronous messages receives with each system call. */
+#define DPIF_RECV_BATCH 32
+
+/* Statistics for all datapath sockets, for dpif_get_stats().  Upcall sockets
+ * may be read from several threads, so the counters are updated atomically. */
+static struct dpif_stats stats;
+
 static int lookup_openflow_multicast_group(int dp_idx, int *multicast_group);
 static int send_mgmt_command(struct dpif *, int dp_idx, int command,
                              const char *netdev);
@@ -88,18 +101,88 @@ dpif_open(int subscribe_dp_idx, struct dpif *dp)
         }
     }
 
-    /* Specify a large so_rcvbuf size because we occasionally need to be able
-     * to retrieve large collections of flow records. */
-    retval = nl_sock_create(NETLINK_GENERIC, multicast_group, 0,
-                            4 * 1024u * 1024, &sock);
+    retval = nl_sock_create(NETLINK_GENERIC, multicast_group, 0, so_rcvbuf,
+                            &sock);
     if (retval) {
         return retval;
     }
+    if (multicast_group) {
+        nl_sock_set_recv_batch(sock, DPIF_RECV_BATCH);
+    }
 
     dp->sock = sock;
     return 0;
 }
 
+/* Opens a socket for receiving the packet-ins that a local datapath sends to
+ * it once it has been registered with dpif_set_upcall_socks(), initializing
+ * 'dp'.  Each upcall socket is meant to be read by its own thread. */
+int
+dpif_open_upcall(struct dpif *dp)
+{
+    int retval = dpif_open(-1, dp);
+    if (!retval) {
+        nl_sock_set_recv_batch(dp->sock, DPIF_RECV_BATCH);
+    }
+    return retval;
+}
+
+/* Directs the packet-ins of local datapath 'dp_idx' to the 'n_upcalls'
+ * sockets in 'upcalls', opened with dpif_open_upcall(), instead of to the
+ * datapath's multicast group.  The kernel sends each packet-in to the socket
+ * for the CPU that handled the packet, so that a flood of table misses on
+ * several CPUs is not funneled through a single socket receive queue.  If
+ * 'n_upcalls' is 0, packet-ins go back to the multicast group.
+ *
+ * Returns 0 if successful, otherwise a positive errno value. */
+int
+dpif_set_upcall_socks(struct dpif *dp, int dp_idx,
+                      const struct dpif upcalls[], size_t n_upcalls)
+{
+    struct ofpbuf request, *reply;
+    uint32_t *pids;
+    size_t i;
+    int retval;
+
+    if (n_upcalls > DP_MAX_UPCALL_PIDS) {
+        return EINVAL;
+    }
+
+    ofpbuf_init(&request, 0);
+    nl_msg_put_genlmsghdr(&request, dp->sock, 32, openflow_family,
+                          NLM_F_REQUEST | NLM_F_ACK,
+                          DP_GENL_C_SET_UPCALL_PIDS, 1);
+    nl_msg_put_u32(&request, DP_GENL_A_DP_IDX, dp_idx);
+    if (n_upcalls) {
+        pids = nl_msg_put_unspec_uninit(&request, DP_GENL_A_UPCALL_PIDS,
+                                        n_upcalls * sizeof *pids);
+        for (i = 0; i < n_upcalls; i++) {
+            pids[i] = nl_sock_pid(upcalls[i].sock);
+        }
+    }
+    retval = nl_sock_transact(dp->sock, &request, &reply);
+    ofpbuf_uninit(&request);
+    ofpbuf_delete(reply);
+
+    return retval;
+}
+
+/* Sets the receive buffer size for datapath sockets opened from now on to
+ * 'size' bytes. */
+void
+dpif_set_rcvbuf(size_t size)
+{
+    so_rcvbuf = size;
+}
+
+/* Stores statistics for all the datapath sockets in this process into
+ * '*s'. */
+void
+dpif_get_stats(struct dpif_stats *s)
+{
+    *s = stats;
+}
+
 /* Closes 'dp'. */
 void
 dpif_close(struct dpif *dp) 
@@ -145,6 +228,9 @@ dpif_recv_openflow(struct dpif *dp, int dp_idx, struct ofpbuf **bufferp,
         do {
             ofpbuf_delete(buffer);
             retval = nl_sock_recv(dp->sock, &buffer, wait);
+            if (retval == ENOBUFS) {
+                __sync_fetch_and_add(&stats.n_overflows, 1);
+            }
         } while (retval == ENOBUFS
                  || (!retval
                      && (nl_msg_nlmsghdr(buffer)->nlmsg_type == NLMSG_DONE
@@ -184,13 +270,104 @@ dpif_recv_openflow(struct dpif *dp, int dp_idx, struct ofpbuf **bufferp,
         buffer->size = MIN(ofp_len, buffer->size);
     }
     *bufferp = buffer;
+    __sync_fetch_and_add(&stats.n_received, 1);
     return 0;
 
 error:
+    __sync_fetch_and_add(&stats.n_errors, 1);
     ofpbuf_delete(buffer);
     return EPROTO;
 }
 
+/* Most OpenFlow messages that dpif_send_openflow_batch() passes to a single
+ * sendmsg(), and most bytes of OpenFlow messages in such a batch (after the
+ * first, which is always sent). */
+#define DPIF_MAX_BATCH 64
+#define DPIF_MAX_BATCH_BYTES 65536
+
+/* Encapsulates each of the 'n_msgs' OpenFlow messages in 'msgs' in a Netlink
+ * message and sends as many of them as possible, in order, to the OpenFlow
+ * local datapath numbered 'dp_idx' via 'sock' with a single system call.  The
+ * kernel module handles all the Netlink messages in the datagram in turn, as
+ * if they had been sent separately.  Stores the number of messages sent in
+ * '*n_sent'; the caller retains ownership of all of the messages.
+ *
+ * A stats request is always sent by itself, because the reply to it may be
+ * a multipart Netlink dump.
+ *
+ * Returns 0 if the messages were sent, otherwise a positive errno value (in
+ * which case '*n_sent' is 0).  Returns EAGAIN if the 'sock' send buffer is
+ * full.
+ *
+ * If the send is successful, then the kernel module will receive it, but there
+ * is no guarantee that any reply will not be dropped (see nl_sock_transact()
+ * for details). */
+int
+dpif_send_openflow_batch(struct dpif *dp, int dp_idx, struct ofpbuf **msgs,
+                         size_t n_msgs, size_t *n_sent)
+{
+    static char zeros[NLA_ALIGNTO];
+    uint32_t fixed_buffers[DPIF_MAX_BATCH][64 / 4];
+    struct iovec iov[DPIF_MAX_BATCH * 3];
+    size_t n_bytes;
+    size_t n_iov;
+    size_t i;
+    int retval;
+
+    *n_sent = 0;
+    n_iov = n_bytes = 0;
+    for (i = 0; i < n_msgs && i < DPIF_MAX_BATCH; i++) {
+        struct ofpbuf *buffer = msgs[i];
+        struct ofp_header *oh;
+        unsigned int dump_flag;
+        struct ofpbuf hdr;
+        struct nlattr *nla;
+        int pad_bytes;
+
+        /* The reply to OFPT_STATS_REQUEST may be multiple segments long, so we
+         * need to specify NLM_F_DUMP in the request. */
+        oh = ofpbuf_at_assert(buffer, 0, sizeof *oh);
+        dump_flag = oh->type == OFPT_STATS_REQUEST ? NLM_F_DUMP : 0;
+        if (i > 0 && (dump_flag
+                      || n_bytes + buffer->size > DPIF_MAX_BATCH_BYTES)) {
+            break;
+        }
+
+        ofpbuf_use(&hdr, fixed_buffers[i], sizeof fixed_buffers[i]);
+        nl_msg_put_genlmsghdr(&hdr, dp->sock, 32, openflow_family,
+                              NLM_F_REQUEST | dump_flag, DP_GENL_C_OPENFLOW,
+                              1);
+        nl_msg_put_u32(&hdr, DP_GENL_A_DP_IDX, dp_idx);
+        nla = ofpbuf_put_uninit(&hdr, sizeof *nla);
+        nla->nla_len = sizeof *nla + buffer->size;
+        nla->nla_type = DP_GENL_A_OPENFLOW;
+        pad_bytes = NLA_ALIGN(nla->nla_len) - nla->nla_len;
+        nl_msg_nlmsghdr(&hdr)->nlmsg_len = hdr.size + buffer->size + pad_bytes;
+        iov[n_iov].iov_base = hdr.data;
+        iov[n_iov++].iov_len = hdr.size;
+        iov[n_iov].iov_base = buffer->data;
+        iov[n_iov++].iov_len = buffer->size;
+        if (pad_bytes) {
+            iov[n_iov].iov_base = zeros;
+            iov[n_iov++].iov_len = pad_bytes;
+        }
+        n_bytes += buffer->size;
+
+        if (dump_flag) {
+            i++;
+            break;
+        }
+    }
+
+    retval = nl_sock_sendv(dp->sock, iov, n_iov, false);
+    if (!retval) {
+        *n_sent = i;
+    } else if (retval != EAGAIN) {
+        VLOG_WARN_RL(&rl, "dpif_send_openflow: %s", strerror(retval));
+    }
+    return retval;
+}
+
 /* Encapsulates 'msg', which must contain an OpenFlow message, in a Netlink
  * message, and sends it to the OpenFlow local datapath numbered 'dp_idx' via
  * 'sock'.
@@ -205,46 +382,9 @@ error:
 int
 dpif_send_openflow(struct dpif *dp, int dp_idx, struct ofpbuf *buffer)
 {
-    struct ofp_header *oh;
-    unsigned int dump_flag;
-    struct ofpbuf hdr;
-    struct nlattr *nla;
-    uint32_t fixed_buffer[64 / 4];
-    struct iovec iov[3];
-    int pad_bytes;
-    int n_iov;
-    int retval;
+    size_t n_sent;
 
-    /* The reply to OFPT_STATS_REQUEST may be multiple segments long, so we
-     * need to specify NLM_F_DUMP in the request. */
-    oh = ofpbuf_at_assert(buffer, 0, sizeof *oh);
-    dump_flag = oh->type == OFPT_STATS_REQUEST ? NLM_F_DUMP : 0;
-
-    ofpbuf_use(&hdr, fixed_buffer, sizeof fixed_buffer);
-    nl_msg_put_genlmsghdr(&hdr, dp->sock, 32, openflow_family,
-                          NLM_F_REQUEST | dump_flag, DP_GENL_C_OPENFLOW, 1);
-    nl_msg_put_u32(&hdr, DP_GENL_A_DP_IDX, dp_idx);
-    nla = ofpbuf_put_uninit(&hdr, sizeof *nla);
-    nla->nla_len = sizeof *nla + buffer->size;
-    nla->nla_type = DP_GENL_A_OPENFLOW;
-    pad_bytes = NLA_ALIGN(nla->nla_len) - nla->nla_len;
-    nl_msg_nlmsghdr(&hdr)->nlmsg_len = hdr.size + buffer->size + pad_bytes;
-    n_iov = 2;
-    iov[0].iov_base = hdr.data;
-    iov[0].iov_len = hdr.size;
-    iov[1].iov_base = buffer->data;
-    iov[1].iov_len = buffer->size;
-    if (pad_bytes) {
-        static char zeros[NLA_ALIGNTO];
-        n_iov++;
-        iov[2].iov_base = zeros;
-        iov[2].iov_len = pad_bytes; 
-    }
-    retval = nl_sock_sendv(dp->sock, iov, n_iov, false);
-    if (retval && retval != EAGAIN) {
-        VLOG_WARN_RL(&rl, "dpif_send_openflow: %s", strerror(retval));
-    }
-    return retval;
+    return dpif_send_openflow_batch(dp, dp_idx, &buffer, 1, &n_sent);
 }
 
 /* Creates local datapath numbered 'dp_idx' with the name 'dp_name'.  A
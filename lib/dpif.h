@@ -40,6 +40,7 @@
  * supports the openflow kernel module via netlink. */
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 struct ofpbuf;
@@ -51,12 +52,27 @@ struct dpif
     struct nl_sock *sock;
 };
 
+/* Statistics for the datapath sockets in a process. */
+struct dpif_stats {
+    unsigned long long int n_received;  /* OpenFlow messages received. */
+    unsigned long long int n_overflows; /* Socket buffer overflows (ENOBUFS),
+                                         * each losing one or more messages. */
+    unsigned long long int n_errors;    /* Malformed messages discarded. */
+};
+
 int dpif_open(int subscribe_dp_idx, struct dpif *);
+int dpif_open_upcall(struct dpif *);
+int dpif_set_upcall_socks(struct dpif *, int dp_idx,
+                          const struct dpif upcalls[], size_t n_upcalls);
 void dpif_close(struct dpif *);
+void dpif_set_rcvbuf(size_t);
+void dpif_get_stats(struct dpif_stats *);
 
 /* OpenFlow. */
 int dpif_recv_openflow(struct dpif *, int dp_idx, struct ofpbuf **, bool wait);
 int dpif_send_openflow(struct dpif *, int dp_idx, struct ofpbuf *);
+int dpif_send_openflow_batch(struct dpif *, int dp_idx, struct ofpbuf **,
+                             size_t n_msgs, size_t *n_sent);
 
 /* Management functions. */
 int dpif_add_dp(struct dpif *, int dp_idx, const char *dp_name);
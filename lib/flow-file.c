@@ -0,0 +1,310 @@
+/* Copyright (c) 2008 The Board of Trustees of The Leland Stanford
+ * Junior University
+ * 
+ * We are making the OpenFlow specification and associated documentation
+ * (Software) available for public use and benefit with the expectation
+ * that others will use, modify and enhance the Software and contribute
+ * those enhancements back to the community. However, since we would
+ * like to make the Software available for broadest use, with as few
+ * restrictions as possible permission is hereby granted, free of
+ * charge, to any person obtaining a copy of this Software to deal in
+ * the Software under the copyrights without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ * The name and trademarks of copyright holder(s) may NOT be used in
+ * advertising or publicity pertaining to the Software or any
+ * derivatives without specific, written prior permission.
+ */
+
+#include <config.h>
+#include "flow-file.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "dynamic-string.h"
+#include "ofp-parse.h"
+#include "ofp-print.h"
+#include "ofpbuf.h"
+#include "util.h"
+#include "vconn.h"
+#include "xtoxll.h"
+
+/* Returns true if 'stream' starts with a flow file header, false if it is
+ * presumably a text flow file.  Leaves 'stream' positioned at its start. */
+bool
+flow_file_is_binary(FILE *stream)
+{
+    uint32_t magic;
+    bool binary;
+
+    binary = (fread(&magic, sizeof magic, 1, stream) == 1
+              && ntohl(magic) == FLOW_FILE_MAGIC);
+    rewind(stream);
+    return binary;
+}
+
+/* Maps the flow file named 'file_name' into memory and initializes 'ff' for
+ * reading it with flow_file_next().  Returns 0 if successful, EINVAL if the
+ * file is not a version FLOW_FILE_VERSION flow file, otherwise a positive
+ * errno value. */
+int
+flow_file_open(const char *file_name, struct flow_file *ff)
+{
+    const struct flow_file_header *fh;
+    struct stat s;
+    int error;
+    int fd;
+
+    memset(ff, 0, sizeof *ff);
+    fd = open(file_name, O_RDONLY);
+    if (fd < 0) {
+        return errno;
+    }
+    if (fstat(fd, &s) < 0) {
+        error = errno;
+        close(fd);
+        return error;
+    }
+    if (s.st_size < sizeof *fh) {
+        close(fd);
+        return EINVAL;
+    }
+    ff->map = mmap(NULL, s.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    error = ff->map == MAP_FAILED ? errno : 0;
+    close(fd);
+    if (error) {
+        ff->map = NULL;
+        return error;
+    }
+    ff->size = s.st_size;
+    madvise(ff->map, ff->size, MADV_SEQUENTIAL);
+
+    fh = ff->map;
+    if (ntohl(fh->magic) != FLOW_FILE_MAGIC
+        || ntohl(fh->version) != FLOW_FILE_VERSION) {
+        flow_file_close(ff);
+        return EINVAL;
+    }
+    ff->pos = (const uint8_t *) (fh + 1);
+    ff->n_flows = ntohl(fh->n_flows);
+    ff->n_read = 0;
+    return 0;
+}
+
+/* Points '*ofmp' to the next flow_mod in 'ff', which stays valid until 'ff'
+ * is closed, and stores its length in '*lengthp'.  Returns 0 if successful,
+ * EOF after the last flow_mod, or EINVAL if the file is truncated or
+ * corrupt. */
+int
+flow_file_next(struct flow_file *ff, const struct ofp_flow_mod **ofmp,
+               size_t *lengthp)
+{
+    const uint8_t *end = (const uint8_t *) ff->map + ff->size;
+    const struct ofp_flow_mod *ofm;
+    size_t length;
+
+    if (ff->n_read >= ff->n_flows) {
+        return EOF;
+    }
+    ofm = (const struct ofp_flow_mod *) ff->pos;
+    if (end - ff->pos < sizeof *ofm) {
+        return EINVAL;
+    }
+    length = ntohs(ofm->header.length);
+    if (ofm->header.version != OFP_VERSION
+        || ofm->header.type != OFPT_FLOW_MOD
+        || length < sizeof *ofm || length % 8 || length > end - ff->pos) {
+        return EINVAL;
+    }
+
+    ff->pos += length;
+    ff->n_read++;
+    *ofmp = ofm;
+    *lengthp = length;
+    return 0;
+}
+
+/* Unmaps 'ff'. */
+void
+flow_file_close(struct flow_file *ff)
+{
+    if (ff->map) {
+        munmap(ff->map, ff->size);
+        ff->map = NULL;
+    }
+}
+
+/* Starts writing a new flow file that will be named 'file_name' once
+ * flow_file_commit() succeeds.  Returns 0 if successful, otherwise a positive
+ * errno value. */
+int
+flow_file_create(const char *file_name, struct flow_file_writer *w)
+{
+    struct flow_file_header fh;
+
+    w->file_name = xstrdup(file_name);
+    w->tmp_name = xasprintf("%s.tmp", file_name);
+    w->n_flows = 0;
+    w->stream = fopen(w->tmp_name, "wb");
+    if (!w->stream) {
+        int error = errno;
+        free(w->file_name);
+        free(w->tmp_name);
+        return error;
+    }
+
+    /* flow_file_commit() fills in the header. */
+    memset(&fh, 0, sizeof fh);
+    if (fwrite(&fh, sizeof fh, 1, w->stream) != 1) {
+        int error = errno;
+        flow_file_abort(w);
+        return error;
+    }
+    return 0;
+}
+
+/* Appends 'ofm', whose length must be in its header, to 'w'.  The flow_mod's
+ * transaction ID is written as 0, so that equal flow sets yield equal files.
+ * Returns 0 if successful, otherwise a positive errno value. */
+int
+flow_file_write(struct flow_file_writer *w, const struct ofp_flow_mod *ofm)
+{
+    size_t length = ntohs(ofm->header.length);
+    struct ofp_header oh;
+
+    oh = ofm->header;
+    oh.xid = 0;
+    if (fwrite(&oh, sizeof oh, 1, w->stream) != 1
+        || fwrite((const uint8_t *) ofm + sizeof oh, length - sizeof oh, 1,
+                  w->stream) != 1) {
+        return errno;
+    }
+    w->n_flows++;
+    return 0;
+}
+
+/* Completes the flow file being written by 'w', flushes it to disk, and
+ * renames it into place, then frees 'w''s resources.  Returns 0 if
+ * successful, otherwise a positive errno value, in which case nothing is left
+ * at the file's name. */
+int
+flow_file_commit(struct flow_file_writer *w)
+{
+    struct flow_file_header fh;
+    int error;
+
+    memset(&fh, 0, sizeof fh);
+    fh.magic = htonl(FLOW_FILE_MAGIC);
+    fh.version = htonl(FLOW_FILE_VERSION);
+    fh.n_flows = htonl(w->n_flows);
+    if (fseek(w->stream, 0, SEEK_SET)
+        || fwrite(&fh, sizeof fh, 1, w->stream) != 1
+        || fflush(w->stream) || fsync(fileno(w->stream))) {
+        error = errno;
+        flow_file_abort(w);
+        return error;
+    }
+    error = fclose(w->stream) ? errno : 0;
+    w->stream = NULL;
+    if (!error && rename(w->tmp_name, w->file_name)) {
+        error = errno;
+    }
+    if (error) {
+        flow_file_abort(w);
+        return error;
+    }
+    free(w->file_name);
+    free(w->tmp_name);
+    return 0;
+}
+
+/* Discards the flow file being written by 'w' and frees 'w''s resources. */
+void
+flow_file_abort(struct flow_file_writer *w)
+{
+    if (w->stream) {
+        fclose(w->stream);
+    }
+    unlink(w->tmp_name);
+    free(w->file_name);
+    free(w->tmp_name);
+}
+
+/* Returns an OFPFC_ADD flow_mod that would recreate the flow described by
+ * 'fs', whose length the caller has already checked. */
+struct ofpbuf *
+flow_stats_to_flow_mod(const struct ofp_flow_stats *fs)
+{
+    size_t actions_len = ntohs(fs->length) - sizeof *fs;
+    struct ofp_flow_mod *ofm;
+    struct ofpbuf *buffer;
+
+    ofm = make_openflow(sizeof *ofm + actions_len, OFPT_FLOW_MOD, &buffer);
+    ofm->match = fs->match;
+    ofm->cookie = fs->cookie;
+    ofm->command = htons(OFPFC_ADD);
+    ofm->idle_timeout = fs->idle_timeout;
+    ofm->hard_timeout = fs->hard_timeout;
+    ofm->priority = fs->priority;
+    ofm->buffer_id = htonl(UINT32_MAX);
+    ofm->out_port = htons(OFPP_NONE);
+    ofm->flags = htons(OFPFF_SEND_FLOW_REM);
+    if (fs->table_id == EMERG_TABLE_ID) {
+        ofm->flags |= htons(OFPFF_EMERG);
+    }
+    memcpy(ofm->actions, fs->actions, actions_len);
+    return buffer;
+}
+
+/* Returns 'ofm' as a line in the add-flows syntax described in dpctl(8),
+ * without a trailing new-line.  The caller must free the string. */
+char *
+flow_mod_to_string(const struct ofp_flow_mod *ofm)
+{
+    size_t actions_len = ntohs(ofm->header.length) - sizeof *ofm;
+    struct ds s = DS_EMPTY_INITIALIZER;
+    char *match, *actions;
+
+    if (ofm->flags & htons(OFPFF_EMERG)) {
+        ds_put_format(&s, "table=%d,", EMERG_TABLE_ID);
+    }
+    if (ofm->match.wildcards) {
+        ds_put_format(&s, "priority=%"PRIu16",", ntohs(ofm->priority));
+    }
+    ds_put_format(&s, "idle_timeout=%"PRIu16",hard_timeout=%"PRIu16",",
+                  ntohs(ofm->idle_timeout), ntohs(ofm->hard_timeout));
+    if (ofm->cookie) {
+        ds_put_format(&s, "cookie=%"PRIu64",", ntohll(ofm->cookie));
+    }
+
+    match = ofp_match_to_string(&ofm->match, 1);
+    ds_put_cstr(&s, match);
+    ds_chomp(&s, ',');
+    free(match);
+
+    actions = ofp_actions_to_string(ofm->actions, actions_len);
+    ds_put_format(&s, " %s", actions);
+    free(actions);
+    return ds_cstr(&s);
+}
@@ -0,0 +1,99 @@
+/* Copyright (c) 2008 The Board of Trustees of The Leland Stanford
+ * Junior University
+ * 
+ * We are making the OpenFlow specification and associated documentation
+ * (Software) available for public use and benefit with the expectation
+ * that others will use, modify and enhance the Software and contribute
+ * those enhancements back to the community. However, since we would
+ * like to make the Software available for broadest use, with as few
+ * restrictions as possible permission is hereby granted, free of
+ * charge, to any person obtaining a copy of this Software to deal in
+ * the Software under the copyrights without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ * The name and trademarks of copyright holder(s) may NOT be used in
+ * advertising or publicity pertaining to the Software or any
+ * derivatives without specific, written prior permission.
+ */
+
+/* Binary flow files, for loading and saving large flow sets quickly.
+ *
+ * A flow file is a struct flow_file_header followed by 'n_flows' complete
+ * OFPT_FLOW_MOD messages, back to back, each padded to a multiple of 8 bytes
+ * as OpenFlow already requires.  Everything is in network byte order, so a
+ * reader can map the file into memory and put its records on the wire as
+ * they are, with no parsing.  "dpctl add-flows" accepts flow files as well as
+ * text, "dpctl dump-flows-binary" writes one from a switch's flow table, and
+ * "dpctl flows-to-binary" and "dpctl binary-to-flows" convert between the
+ * two formats offline. */
+
+#ifndef FLOW_FILE_H
+#define FLOW_FILE_H 1
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "openflow/openflow.h"
+
+struct ofp_flow_stats;
+struct ofpbuf;
+
+#define FLOW_FILE_MAGIC 0x4f46464d  /* "OFFM". */
+#define FLOW_FILE_VERSION 1
+struct flow_file_header {
+    uint32_t magic;             /* FLOW_FILE_MAGIC. */
+    uint32_t version;           /* FLOW_FILE_VERSION. */
+    uint32_t n_flows;           /* Number of flow_mods that follow. */
+    uint8_t pad[4];
+};
+OFP_ASSERT(sizeof(struct flow_file_header) == 16);
+
+/* A flow file mapped into memory for reading. */
+struct flow_file {
+    void *map;                  /* Start of the mapping. */
+    size_t size;                /* Size of the mapping. */
+    const uint8_t *pos;         /* Next flow_mod to read. */
+    uint32_t n_flows;           /* Number of flow_mods in the file. */
+    uint32_t n_read;            /* Number of flow_mods read so far. */
+};
+
+bool flow_file_is_binary(FILE *);
+int flow_file_open(const char *file_name, struct flow_file *);
+int flow_file_next(struct flow_file *, const struct ofp_flow_mod **,
+                   size_t *length);
+void flow_file_close(struct flow_file *);
+
+/* A flow file being written.  The header is completed, and the file renamed
+ * into place, only by flow_file_commit(). */
+struct flow_file_writer {
+    FILE *stream;
+    char *file_name;
+    char *tmp_name;
+    uint32_t n_flows;
+};
+
+int flow_file_create(const char *file_name, struct flow_file_writer *);
+int flow_file_write(struct flow_file_writer *, const struct ofp_flow_mod *);
+int flow_file_commit(struct flow_file_writer *);
+void flow_file_abort(struct flow_file_writer *);
+
+struct ofpbuf *flow_stats_to_flow_mod(const struct ofp_flow_stats *);
+char *flow_mod_to_string(const struct ofp_flow_mod *);
+
+#endif /* flow-file.h */
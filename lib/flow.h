@@ -44,8 +44,10 @@ struct ofpbuf;
 
 /* Identification data for a flow.
    All fields are in network byte order.
-   In decreasing order by size, so that flow structures can be hashed or
-   compared bytewise. */
+   In decreasing order by size, so that there is no padding between fields,
+   and padded at the end to a multiple of 8 bytes, so that flow structures
+   can be hashed or compared as a fixed number of 64-bit words.  'pad' must
+   always be zero. */
 struct flow {
     uint32_t nw_src;            /* IP source address. */
     uint32_t nw_dst;            /* IP destination address. */
@@ -59,11 +61,29 @@ struct flow {
     uint8_t dl_vlan_pcp;        /* Input VLAN priority. */
     uint8_t nw_tos;             /* IPv4 DSCP. */
     uint8_t nw_proto;           /* IP protocol. */
-    uint8_t pad[3];
+    uint8_t pad[7];
+} __attribute__((aligned(8)));
+BUILD_ASSERT_DECL(sizeof(struct flow) == 40);
+
+/* Number of 64-bit words in a struct flow. */
+#define FLOW_U64S (sizeof(struct flow) / sizeof(uint64_t))
+BUILD_ASSERT_DECL(sizeof(struct flow) % sizeof(uint64_t) == 0);
+
+/* How far flow_extract_layers() parses a packet.  The network layer is not
+ * separate from the transport layer because 'nw_proto' is cleared when the
+ * transport header is truncated. */
+enum flow_layer {
+    FLOW_LAYER_NONE,            /* Not parsed at all. */
+    FLOW_LAYER_L2,              /* 'in_port' and 'dl_*' fields only. */
+    FLOW_LAYER_ALL              /* Every field. */
 };
-BUILD_ASSERT_DECL(sizeof(struct flow) == 36);
 
 int flow_extract(struct ofpbuf *, uint16_t in_port, struct flow *);
+int flow_extract_layers(struct ofpbuf *, uint16_t in_port, struct flow *,
+                        enum flow_layer);
+void flow_extract_finish(struct ofpbuf *, struct flow *);
+void flow_extract_batch(struct ofpbuf *packets[], size_t n, uint16_t in_port,
+                        enum flow_layer, struct flow *flows[], int frags[]);
 void flow_fill_match(struct ofp_match *, const struct flow *,
                      uint32_t wildcards);
 void flow_print(FILE *, const struct flow *);
@@ -77,16 +97,31 @@ flow_compare(const struct flow *a, const struct flow *b)
     return memcmp(a, b, sizeof *a);
 }
 
+/* Returns true if 'a' and 'b' are the same flow.  Cheaper than
+ * flow_compare() when only equality matters, because it ORs together the
+ * differences of FLOW_U64S words, a loop that the compiler unrolls, instead
+ * of stopping at the first differing byte. */
 static inline bool
 flow_equal(const struct flow *a, const struct flow *b)
 {
-    return !flow_compare(a, b);
+    const uint8_t *pa = (const uint8_t *) a;
+    const uint8_t *pb = (const uint8_t *) b;
+    uint64_t diff = 0;
+    size_t i;
+
+    for (i = 0; i < FLOW_U64S; i++) {
+        uint64_t x, y;
+
+        memcpy(&x, pa + i * sizeof x, sizeof x);
+        memcpy(&y, pb + i * sizeof y, sizeof y);
+        diff |= x ^ y;
+    }
+    return !diff;
 }
 
 static inline size_t
 flow_hash(const struct flow *flow, uint32_t basis)
 {
-    BUILD_ASSERT_DECL(!(sizeof *flow % sizeof(uint32_t)));
     return hash_words((const uint32_t *) flow,
                       sizeof *flow / sizeof(uint32_t), basis);
 }
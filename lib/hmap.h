@@ -35,6 +35,7 @@
 #define HMAP_H 1
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include "util.h"
 
@@ -79,13 +80,26 @@ static inline void hmap_insert_fast(struct hmap *,
 static inline void hmap_insert(struct hmap *, struct hmap_node *, size_t hash);
 static inline void hmap_remove(struct hmap *, struct hmap_node *);
 
+/* Returns the STRUCT that contains hmap_node 'POINTER' as MEMBER, or a null
+ * pointer if 'POINTER' is null.  The loops below test for null this way
+ * rather than with "&(NODE)->MEMBER != NULL", which a compiler may assume is
+ * always true when MEMBER is not at offset 0. */
+#define HMAP_CONTAINER__(POINTER, STRUCT, MEMBER)                       \
+    ((STRUCT *) hmap_container__(POINTER, offsetof(STRUCT, MEMBER)))
+
+static inline void *
+hmap_container__(const struct hmap_node *node, size_t offset)
+{
+    return node ? (char *) node - offset : NULL;
+}
+
 /* Search. */
 #define HMAP_FOR_EACH_WITH_HASH(NODE, STRUCT, MEMBER, HASH, HMAP)       \
-    for ((NODE) = CONTAINER_OF(hmap_first_with_hash(HMAP, HASH),        \
-                               STRUCT, MEMBER);                         \
-         &(NODE)->MEMBER != NULL;                                       \
-         (NODE) = CONTAINER_OF(hmap_next_with_hash(&(NODE)->MEMBER),    \
-                               STRUCT, MEMBER))
+    for ((NODE) = HMAP_CONTAINER__(hmap_first_with_hash(HMAP, HASH),    \
+                                   STRUCT, MEMBER);                     \
+         (NODE) != NULL;                                                \
+         (NODE) = HMAP_CONTAINER__(hmap_next_with_hash(&(NODE)->MEMBER), \
+                                   STRUCT, MEMBER))
 
 static inline struct hmap_node *hmap_first_with_hash(const struct hmap *,
                                                      size_t hash);
@@ -96,18 +110,18 @@ static inline struct hmap_node *hmap_next_with_hash(const struct hmap_node *);
  * The _SAFE version is needed when NODE may be freed.  It is not needed when
  * NODE may be removed from the hash map but its members remain accessible and
  * intact. */
-#define HMAP_FOR_EACH(NODE, STRUCT, MEMBER, HMAP)                   \
-    for ((NODE) = CONTAINER_OF(hmap_first(HMAP), STRUCT, MEMBER);   \
-         &(NODE)->MEMBER != NULL;                                   \
-         (NODE) = CONTAINER_OF(hmap_next(HMAP, &(NODE)->MEMBER),    \
-                               STRUCT, MEMBER))
-
-#define HMAP_FOR_EACH_SAFE(NODE, NEXT, STRUCT, MEMBER, HMAP)        \
-    for ((NODE) = CONTAINER_OF(hmap_first(HMAP), STRUCT, MEMBER);   \
-         (&(NODE)->MEMBER != NULL                                   \
-          ? (NEXT) = CONTAINER_OF(hmap_next(HMAP, &(NODE)->MEMBER), \
-                                  STRUCT, MEMBER), 1                \
-          : 0);                                                     \
+#define HMAP_FOR_EACH(NODE, STRUCT, MEMBER, HMAP)                       \
+    for ((NODE) = HMAP_CONTAINER__(hmap_first(HMAP), STRUCT, MEMBER);   \
+         (NODE) != NULL;                                                \
+         (NODE) = HMAP_CONTAINER__(hmap_next(HMAP, &(NODE)->MEMBER),    \
+                                   STRUCT, MEMBER))
+
+#define HMAP_FOR_EACH_SAFE(NODE, NEXT, STRUCT, MEMBER, HMAP)            \
+    for ((NODE) = HMAP_CONTAINER__(hmap_first(HMAP), STRUCT, MEMBER);   \
+         ((NODE) != NULL                                                \
+          ? (NEXT) = HMAP_CONTAINER__(hmap_next(HMAP, &(NODE)->MEMBER), \
+                                      STRUCT, MEMBER), 1                \
+          : 0);                                                         \
          (NODE) = (NEXT))
 
 static inline struct hmap_node *hmap_first(const struct hmap *);
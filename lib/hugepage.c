@@ -0,0 +1,206 @@
+/* Copyright (c) 2008 The Board of Trustees of The Leland Stanford
+ * Junior University
+ * 
+ * We are making the OpenFlow specification and associated documentation
+ * (Software) available for public use and benefit with the expectation
+ * that others will use, modify and enhance the Software and contribute
+ * those enhancements back to the community. However, since we would
+ * like to make the Software available for broadest use, with as few
+ * restrictions as possible permission is hereby granted, free of
+ * charge, to any person obtaining a copy of this Software to deal in
+ * the Software under the copyrights without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ * The name and trademarks of copyright holder(s) may NOT be used in
+ * advertising or publicity pertaining to the Software or any
+ * derivatives without specific, written prior permission.
+ */
+
+#include <config.h>
+#include "hugepage.h"
+#include <assert.h>
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "util.h"
+
+#define THIS_MODULE VLM_hugepage
+#include "vlog.h"
+
+/* Size of the huge pages that transparent huge pages use, and the default
+ * size of the ones that MAP_HUGETLB maps on the machines we run on. */
+#define HUGEPAGE_SIZE (2 * 1024 * 1024)
+
+/* From <linux/mempolicy.h>, which not every libc exposes. */
+#define HUGEPAGE_MPOL_PREFERRED 1
+
+static bool enabled;            /* Back new regions with huge pages? */
+static int numa_node = -1;      /* Node for new regions, or -1 for any. */
+static bool allocated;          /* Has hugepage_alloc() been called? */
+
+/* Sets whether hugepage_alloc() backs regions with huge pages and, if 'node'
+ * is nonnegative, the NUMA node on which it places them.  Must be called, if
+ * at all, before the first call to hugepage_alloc(), since hugepage_free()
+ * relies on the configuration in effect when each region was allocated. */
+void
+hugepage_configure(bool enable, int node)
+{
+    assert(!allocated);
+    enabled = enable;
+    numa_node = node;
+}
+
+/* Returns true if hugepage_alloc() backs regions with huge pages. */
+bool
+hugepage_enabled(void)
+{
+    return enabled;
+}
+
+/* Returns the number of bytes that hugepage_alloc() actually maps for a
+ * 'size'-byte region, all of which the caller may use. */
+size_t
+hugepage_alloc_size(size_t size)
+{
+    size_t page = enabled ? HUGEPAGE_SIZE : getpagesize();
+    return ROUND_UP(size, page);
+}
+
+/* Maps 'size' bytes, a multiple of HUGEPAGE_SIZE, at an address aligned to
+ * HUGEPAGE_SIZE so that transparent huge pages can back all of it.  Returns
+ * MAP_FAILED on failure. */
+static void *
+map_aligned(size_t size)
+{
+    size_t extra = HUGEPAGE_SIZE - getpagesize();
+    char *p, *aligned;
+
+    p = mmap(NULL, size + extra, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+        return MAP_FAILED;
+    }
+    aligned = (char *) ROUND_UP((uintptr_t) p, HUGEPAGE_SIZE);
+    if (aligned > p) {
+        munmap(p, aligned - p);
+    }
+    if (aligned + size < p + size + extra) {
+        munmap(aligned + size, p + size + extra - (aligned + size));
+    }
+    return aligned;
+}
+
+/* Asks the kernel to place the 'size' bytes at 'p' on the configured NUMA
+ * node, if any.  Must be called before the memory is first touched. */
+static void
+bind_to_node(void *p, size_t size)
+{
+    unsigned long mask;
+
+    if (numa_node < 0) {
+        return;
+    } else if (numa_node >= (int) (sizeof mask * CHAR_BIT)) {
+        VLOG_WARN("NUMA node %d is out of range", numa_node);
+        return;
+    }
+    mask = 1UL << numa_node;
+    if (syscall(SYS_mbind, p, size, HUGEPAGE_MPOL_PREFERRED, &mask,
+                sizeof mask * CHAR_BIT + 1, 0)) {
+        VLOG_WARN("could not bind memory to NUMA node %d (%s)",
+                  numa_node, strerror(errno));
+    }
+}
+
+/* Returns a new zeroed region of 'size' bytes, or a null pointer if memory
+ * is exhausted.  The region is aligned to a page boundary.  Release it with
+ * hugepage_free().
+ *
+ * If hugepage_configure() enabled huge pages, the region comes from the
+ * reserved huge page pool if possible, otherwise from ordinary memory that
+ * transparent huge pages may back.  Either way, it is rounded up to a whole
+ * number of huge pages, so this is only worthwhile for large regions. */
+void *
+hugepage_alloc(size_t size)
+{
+    size_t n = hugepage_alloc_size(size);
+    void *p;
+
+    allocated = true;
+    if (!enabled) {
+        p = mmap(NULL, n, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        return p != MAP_FAILED ? p : NULL;
+    }
+
+    p = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    p = mmap(NULL, n, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+    if (p == MAP_FAILED) {
+        /* No reserved huge pages, so fall back to transparent ones. */
+        p = map_aligned(n);
+        if (p == MAP_FAILED) {
+            return NULL;
+        }
+#ifdef MADV_HUGEPAGE
+        madvise(p, n, MADV_HUGEPAGE);
+#endif
+    }
+    bind_to_node(p, n);
+    return p;
+}
+
+/* Releases 'p', a 'size'-byte region obtained from hugepage_alloc(). */
+void
+hugepage_free(void *p, size_t size)
+{
+    if (p) {
+        munmap(p, hugepage_alloc_size(size));
+    }
+}
+
+/* Returns the NUMA node of 'cpu', or -1 if it cannot be determined. */
+int
+hugepage_cpu_node(int cpu)
+{
+    char dir_name[64];
+    struct dirent *de;
+    int node = -1;
+    DIR *dir;
+
+    sprintf(dir_name, "/sys/devices/system/cpu/cpu%d", cpu);
+    dir = opendir(dir_name);
+    if (!dir) {
+        return -1;
+    }
+    while ((de = readdir(dir)) != NULL) {
+        if (sscanf(de->d_name, "node%d", &node) == 1) {
+            break;
+        }
+        node = -1;
+    }
+    closedir(dir);
+    return node;
+}
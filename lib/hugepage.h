@@ -0,0 +1,58 @@
+/* Copyright (c) 2008 The Board of Trustees of The Leland Stanford
+ * Junior University
+ * 
+ * We are making the OpenFlow specification and associated documentation
+ * (Software) available for public use and benefit with the expectation
+ * that others will use, modify and enhance the Software and contribute
+ * those enhancements back to the community. However, since we would
+ * like to make the Software available for broadest use, with as few
+ * restrictions as possible permission is hereby granted, free of
+ * charge, to any person obtaining a copy of this Software to deal in
+ * the Software under the copyrights without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ * The name and trademarks of copyright holder(s) may NOT be used in
+ * advertising or publicity pertaining to the Software or any
+ * derivatives without specific, written prior permission.
+ */
+
+/* Allocation of large, long-lived memory regions, such as flow table bucket
+ * arrays and packet buffer pools.
+ *
+ * Such regions are touched at random by every packet, so they cost a TLB
+ * miss per access once they outgrow what ordinary pages can map, and on a
+ * multi-socket machine a remote memory access if they land on the wrong
+ * node.  hugepage_configure() asks for huge pages and a NUMA node for all of
+ * the regions allocated afterward. */
+
+#ifndef HUGEPAGE_H
+#define HUGEPAGE_H 1
+
+#include <stdbool.h>
+#include <stddef.h>
+
+void hugepage_configure(bool enable, int node);
+bool hugepage_enabled(void);
+
+void *hugepage_alloc(size_t size);
+size_t hugepage_alloc_size(size_t size);
+void hugepage_free(void *, size_t size);
+
+int hugepage_cpu_node(int cpu);
+
+#endif /* hugepage.h */
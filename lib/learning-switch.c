@@ -41,14 +41,18 @@
 #include <time.h>
 
 #include "flow.h"
+#include "hash.h"
+#include "hmap.h"
 #include "mac-learning.h"
 #include "ofpbuf.h"
 #include "ofp-print.h"
 #include "openflow/openflow.h"
+#include "openflow/openflow-ext.h"
 #include "poll-loop.h"
 #include "queue.h"
 #include "rconn.h"
 #include "stp.h"
+#include "tag.h"
 #include "timeval.h"
 #include "vconn.h"
 #include "xtoxll.h"
@@ -56,6 +60,23 @@
 #define THIS_MODULE VLM_learning_switch
 #include "vlog.h"
 
+/* Maximum number of flow setups that one batch remembers, to avoid setting
+ * up the same flow again for later packets in the same batch. */
+#define LSW_BATCH_FLOWS 32
+
+/* Interval between reports of switch buffer pressure, in ms. */
+#define BUFFER_REPORT_INTERVAL 10000
+
+/* A destination MAC toward which 'sw' has set up flows, with the tag of the
+ * MAC learning entry that the flows' output port came from.  The flows are
+ * deleted when that entry moves or expires, which changes its tag. */
+struct lswitch_dst {
+    struct hmap_node hmap_node; /* In struct lswitch's 'dsts'. */
+    uint8_t mac[ETH_ADDR_LEN];
+    uint16_t vlan;              /* As passed to mac_learning_learn(). */
+    tag_type tag;
+};
+
 enum port_state {
     P_DISABLED = 1 << 0,
     P_LISTENING = 1 << 1,
@@ -74,21 +95,42 @@ struct lswitch {
     uint32_t capabilities;
     time_t last_features_request;
     struct mac_learning *ml;    /* NULL to act as hub instead of switch. */
+    struct hmap dsts;           /* Contains "struct lswitch_dst"s. */
+    enum lswitch_flow_mode flow_mode; /* Shape of the flows set up. */
+
+    /* Called on learning a MAC, e.g. to share it with other switches. */
+    lswitch_learn_cb *learn_cb;
+    void *learn_aux;
+
+    /* Called on the first features reply, to restore saved MACs. */
+    lswitch_resync_cb *resync_cb;
+    void *resync_aux;
+    bool got_features;          /* Has a features reply arrived? */
 
     /* Number of outgoing queued packets on the rconn. */
     int n_queued;
 
+    /* Switch packet buffer pressure.  Packet_ins arrive unbuffered, with the
+     * whole packet, when the switch has run out of buffers. */
+    uint32_t n_buffers;         /* Number of buffers the switch has. */
+    unsigned long long int n_packet_ins;  /* Packet_ins received. */
+    unsigned long long int n_unbuffered;  /* Packet_ins without a buffer. */
+    unsigned long long int n_released;    /* Buffers freed by dropping. */
+    unsigned long long int last_packet_ins, last_unbuffered; /* At report. */
+    long long int next_buffer_report;     /* Time of next report, in ms. */
+
+    /* Batching (see lswitch_start_batch()). */
+    bool batching;              /* Between start and flush of a batch? */
+    int n_batched;              /* Messages queued during this batch. */
+    struct ofp_match batch_flows[LSW_BATCH_FLOWS]; /* Flows added in batch. */
+    size_t n_batch_flows;
+
     /* Spanning tree protocol implementation.
      *
-     * We implement STP states by, whenever a port's STP state changes,
-     * querying all the flows on the switch and then deleting any of them that
-     * are inappropriate for a port's STP state. */
-    long long int next_query;   /* Next time at which to query all flows. */
-    long long int last_query;   /* Last time we sent a query. */
-    long long int last_reply;   /* Last time we received a query reply. */
+     * We implement STP states by, whenever a port's STP state changes to one
+     * in which it may not forward, deleting the flows that match on that port
+     * as input port or that output to it (see revalidate_port()). */
     unsigned int port_states[STP_MAX_PORTS];
-    uint32_t query_xid;         /* XID used for query. */
-    int n_flows, n_no_recv, n_no_send;
 };
 
 /* The log messages here could actually be useful in debugging, so keep the
@@ -97,11 +139,12 @@ static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(30, 300);
 
 static void queue_tx(struct lswitch *, struct rconn *, struct ofpbuf *);
 static void send_features_request(struct lswitch *, struct rconn *);
-static void schedule_query(struct lswitch *, long long int delay);
 static bool may_learn(const struct lswitch *, uint16_t port_no);
 static bool may_recv(const struct lswitch *, uint16_t port_no,
                      bool any_actions);
 static bool may_send(const struct lswitch *, uint16_t port_no);
+static void update_port_state(struct lswitch *, struct rconn *,
+                              const struct ofp_phy_port *, bool force);
 
 typedef void packet_handler_func(struct lswitch *, struct rconn *, void *);
 static packet_handler_func process_switch_features;
@@ -109,7 +152,9 @@ static packet_handler_func process_packet_in;
 static packet_handler_func process_echo_request;
 static packet_handler_func process_port_status;
 static packet_handler_func process_phy_port;
-static packet_handler_func process_stats_reply;
+static packet_handler_func process_vendor;
+static void resync(struct lswitch *, struct rconn *,
+                   const struct mac_learning_saved *, size_t n);
 
 /* Creates and returns a new learning switch.
  *
@@ -132,9 +177,7 @@ lswitch_create(struct rconn *rconn, bool learn_macs, int max_idle)
     sw->datapath_id = 0;
     sw->last_features_request = time_now() - 1;
     sw->ml = learn_macs ? mac_learning_create() : NULL;
-    sw->next_query = LLONG_MIN;
-    sw->last_query = LLONG_MIN;
-    sw->last_reply = LLONG_MIN;
+    hmap_init(&sw->dsts);
     for (i = 0; i < STP_MAX_PORTS; i++) {
         sw->port_states[i] = P_DISABLED;
     }
@@ -142,16 +185,150 @@ lswitch_create(struct rconn *rconn, bool learn_macs, int max_idle)
     return sw;
 }
 
+/* Limits 'sw''s MAC learning table to 'max_macs' entries in total and, if
+ * 'max_vlan_macs' is nonzero, to that many entries in any one VLAN.  Has no
+ * effect if 'sw' acts as a hub. */
+void
+lswitch_set_mac_limits(struct lswitch *sw, size_t max_macs,
+                       size_t max_vlan_macs)
+{
+    if (sw->ml) {
+        mac_learning_set_max_entries(sw->ml, max_macs);
+        mac_learning_set_max_vlan_entries(sw->ml, max_vlan_macs);
+    }
+}
+
+/* Sets the kind of flows that 'sw' sets up for packets whose destination it
+ * has learned.  Has no effect if 'sw' acts as a hub or does not set up
+ * flows. */
+void
+lswitch_set_flow_mode(struct lswitch *sw, enum lswitch_flow_mode flow_mode)
+{
+    sw->flow_mode = flow_mode;
+}
+
+/* Arranges for 'cb' to be called, with 'aux', each time 'sw' learns where a
+ * MAC address is from a packet_in.  Addresses that 'sw' is told about with
+ * lswitch_prefetch() do not trigger 'cb'. */
+void
+lswitch_set_learn_cb(struct lswitch *sw, lswitch_learn_cb *cb, void *aux)
+{
+    sw->learn_cb = cb;
+    sw->learn_aux = aux;
+}
+
+/* Arranges for 'cb' to be called, with 'aux', when 'sw' learns the datapath ID
+ * of its switch, to restore the MAC learning entries that an earlier
+ * connection from the same switch saved with lswitch_save_macs().  'sw'
+ * relearns them and, if it sets up destination flows, installs flows toward
+ * all of them at once, so that a reconnecting switch does not have to send
+ * a packet_in for every destination again. */
+void
+lswitch_set_resync_cb(struct lswitch *sw, lswitch_resync_cb *cb, void *aux)
+{
+    sw->resync_cb = cb;
+    sw->resync_aux = aux;
+}
+
+/* Stores the MAC learning entries of 'sw' in '*saved', a newly allocated
+ * array that the caller must free, and returns their number, for a later
+ * connection from the same switch to restore.  Returns 0, with '*saved' set
+ * to null, if 'sw' has learned nothing or does not know its datapath ID. */
+size_t
+lswitch_save_macs(const struct lswitch *sw, struct mac_learning_saved **saved)
+{
+    size_t n;
+
+    *saved = NULL;
+    if (!sw->ml || !sw->datapath_id) {
+        return 0;
+    }
+    n = mac_learning_save(sw->ml, saved);
+    if (!n) {
+        free(*saved);
+        *saved = NULL;
+    }
+    return n;
+}
+
+/* Returns 'sw''s datapath ID, or 0 if it has not replied to the features
+ * request yet. */
+unsigned long long int
+lswitch_get_datapath_id(const struct lswitch *sw)
+{
+    return sw->datapath_id;
+}
+
+static bool use_dst_flows(const struct lswitch *);
+static void remember_dst(struct lswitch *, uint16_t vlan,
+                         const uint8_t mac[ETH_ADDR_LEN]);
+static void revalidate_dsts(struct lswitch *, struct rconn *,
+                            const struct tag_set *);
+static struct ofpbuf *make_dst_flow(const struct lswitch *, uint16_t dl_vlan,
+                                    const uint8_t dst_mac[ETH_ADDR_LEN],
+                                    uint32_t buffer_id, uint16_t out_port);
+
+/* Tells 'sw' that 'mac' on 'vlan' is reached through 'port', as learned by
+ * some other means than a packet_in on 'sw', e.g. by another switch in the
+ * same fabric.  If 'sw' does not already know where 'mac' is, it learns it
+ * and, if it sets up destination flows, installs one on 'rconn' so that
+ * traffic to 'mac' never reaches the controller.  Returns true if 'sw'
+ * learned 'mac', false if it already knew it or does not learn MACs. */
+bool
+lswitch_prefetch(struct lswitch *sw, struct rconn *rconn, uint16_t vlan,
+                 const uint8_t mac[ETH_ADDR_LEN], uint16_t port)
+{
+    if (!sw->ml || !may_send(sw, port) || eth_addr_is_multicast(mac)
+        || mac_learning_lookup(sw->ml, mac, vlan) != OFPP_FLOOD) {
+        return false;
+    }
+    mac_learning_learn(sw->ml, mac, vlan, port);
+    if (sw->max_idle >= 0 && use_dst_flows(sw)) {
+        queue_tx(sw, rconn, make_dst_flow(sw, htons(vlan), mac, UINT32_MAX,
+                                          port));
+        remember_dst(sw, vlan, mac);
+    }
+    return true;
+}
+
 /* Destroys 'sw'. */
 void
 lswitch_destroy(struct lswitch *sw)
 {
     if (sw) {
+        struct lswitch_dst *dst, *next;
+
+        HMAP_FOR_EACH_SAFE (dst, next, struct lswitch_dst, hmap_node,
+                            &sw->dsts) {
+            free(dst);
+        }
+        hmap_destroy(&sw->dsts);
         mac_learning_destroy(sw->ml);
         free(sw);
     }
 }
 
+/* Logs how many of the packet_ins since the last report arrived unbuffered,
+ * if any did although the switch has buffers, since that means the switch is
+ * short of them and is sending whole packets to the controller. */
+static void
+report_buffer_pressure(struct lswitch *sw)
+{
+    unsigned long long int n_packet_ins, n_unbuffered;
+
+    n_packet_ins = sw->n_packet_ins - sw->last_packet_ins;
+    n_unbuffered = sw->n_unbuffered - sw->last_unbuffered;
+    if (sw->n_buffers && n_unbuffered) {
+        VLOG_WARN("%012llx: %llu of %llu packet_ins in the last %d s arrived "
+                  "unbuffered (switch has %"PRIu32" buffers, %llu released "
+                  "by dropping so far)", sw->datapath_id, n_unbuffered,
+                  n_packet_ins, BUFFER_REPORT_INTERVAL / 1000, sw->n_buffers,
+                  sw->n_released);
+    }
+    sw->last_packet_ins = sw->n_packet_ins;
+    sw->last_unbuffered = sw->n_unbuffered;
+}
+
 /* Takes care of necessary 'sw' activity, except for receiving packets (which
  * the caller must do). */
 void
@@ -160,82 +337,18 @@ lswitch_run(struct lswitch *sw, struct rconn *rconn)
     long long int now = time_msec();
 
     if (sw->ml) {
-        mac_learning_run(sw->ml, NULL);
-    }
-
-    /* If we're waiting for more replies, keeping waiting for up to 10 s. */
-    if (sw->last_reply != LLONG_MIN) {
-        if (now - sw->last_reply > 10000) {
-            VLOG_ERR_RL(&rl, "%012llx: No more flow stat replies last 10 s",
-                        sw->datapath_id);
-            sw->last_reply = LLONG_MIN;
-            sw->last_query = LLONG_MIN;
-            schedule_query(sw, 0);
-        } else {
-            return;
-        }
-    }
+        struct tag_set expired;
 
-    /* If we're waiting for any reply at all, keep waiting for up to 10 s. */
-    if (sw->last_query != LLONG_MIN) {
-        if (now - sw->last_query > 10000) {
-            VLOG_ERR_RL(&rl, "%012llx: No flow stat replies in last 10 s",
-                        sw->datapath_id);
-            sw->last_query = LLONG_MIN;
-            schedule_query(sw, 0);
-        } else {
-            return;
+        tag_set_init(&expired);
+        mac_learning_run(sw->ml, &expired);
+        if (!tag_set_is_empty(&expired)) {
+            revalidate_dsts(sw, rconn, &expired);
         }
     }
 
-    /* If it's time to send another query, do so. */
-    if (sw->next_query != LLONG_MIN && now >= sw->next_query) {
-        sw->next_query = LLONG_MIN;
-        if (!rconn_is_connected(rconn)) {
-            schedule_query(sw, 1000);
-        } else {
-            struct ofp_stats_request *osr;
-            struct ofp_flow_stats_request *ofsr;
-            struct ofpbuf *b;
-            int error;
-
-            VLOG_DBG("%012llx: Sending flow stats request to implement STP",
-                     sw->datapath_id);
-
-            sw->last_query = now;
-            sw->query_xid = random_uint32();
-            sw->n_flows = 0;
-            sw->n_no_recv = 0;
-            sw->n_no_send = 0;
-            osr = make_openflow_xid(sizeof *osr + sizeof *ofsr,
-                                    OFPT_STATS_REQUEST, sw->query_xid, &b);
-            osr->type = htons(OFPST_FLOW);
-            osr->flags = htons(0);
-            ofsr = (struct ofp_flow_stats_request *) osr->body;
-            ofsr->match.wildcards = htonl(OFPFW_ALL);
-            ofsr->table_id = 0xff;
-            ofsr->out_port = htons(OFPP_NONE);
-
-            error = rconn_send(rconn, b, NULL);
-            if (error) {
-                VLOG_WARN_RL(&rl, "%012llx: sending flow stats request "
-                             "failed: %s", sw->datapath_id, strerror(error));
-                ofpbuf_delete(b);
-                schedule_query(sw, 1000);
-            }
-        }
-    }
-}
-
-static void
-wait_timeout(long long int started)
-{
-    long long int now = time_msec();
-    long long int timeout = 10000 - (now - started);
-    if (timeout <= 0) {
-        poll_immediate_wake();
-    } else {
-        poll_timer_wait(timeout);
+    if (now >= sw->next_buffer_report) {
+        report_buffer_pressure(sw);
+        sw->next_buffer_report = now + BUFFER_REPORT_INTERVAL;
     }
 }
 
@@ -245,12 +358,31 @@ lswitch_wait(struct lswitch *sw)
     if (sw->ml) {
         mac_learning_wait(sw->ml);
     }
+}
 
-    if (sw->last_reply != LLONG_MIN) {
-        wait_timeout(sw->last_reply);
-    } else if (sw->last_query != LLONG_MIN) {
-        wait_timeout(sw->last_query);
-    }
+/* Starts a batch: until lswitch_flush_batch() is called, the messages that
+ * 'sw' generates are queued on 'rconn' rather than sent one at a time, and
+ * flows that 'sw' has already set up within the batch are not set up again.
+ * The caller should process a burst of received messages between the two
+ * calls. */
+void
+lswitch_start_batch(struct lswitch *sw, struct rconn *rconn)
+{
+    sw->batching = true;
+    sw->n_batched = 0;
+    sw->n_batch_flows = 0;
+    rconn_cork(rconn);
+}
+
+/* Ends the batch started by lswitch_start_batch() and sends the messages
+ * that it generated to 'rconn' together. */
+void
+lswitch_flush_batch(struct lswitch *sw, struct rconn *rconn)
+{
+    sw->batching = false;
+    sw->n_batched = 0;
+    sw->n_batch_flows = 0;
+    rconn_uncork(rconn);
 }
 
 /* Processes 'msg', which should be an OpenFlow received on 'rconn', according
@@ -290,13 +422,18 @@ lswitch_process_packet(struct lswitch *sw, struct rconn *rconn,
         {
             OFPT_STATS_REPLY,
             offsetof(struct ofp_stats_reply, body),
-            process_stats_reply
+            NULL
         },
         {
             OFPT_FLOW_REMOVED,
             sizeof(struct ofp_flow_removed),
             NULL
         },
+        {
+            OFPT_VENDOR,
+            sizeof(struct ofp_vendor_header),
+            process_vendor
+        },
     };
     const size_t n_processors = ARRAY_SIZE(processors);
     const struct processor *p;
@@ -325,10 +462,9 @@ lswitch_process_packet(struct lswitch *sw, struct rconn *rconn,
             return;
         }
     }
-    if (VLOG_IS_DBG_ENABLED()) {
+    if (!VLOG_DROP_DBG(&rl)) {
         char *p = ofp_to_string(msg->data, msg->size, 2);
-        VLOG_DBG_RL(&rl, "%012llx: OpenFlow packet ignored: %s",
-                    sw->datapath_id, p);
+        VLOG_DBG("%012llx: OpenFlow packet ignored: %s", sw->datapath_id, p);
         free(p);
     }
 }
@@ -358,7 +494,13 @@ send_features_request(struct lswitch *sw, struct rconn *rconn)
 static void
 queue_tx(struct lswitch *sw, struct rconn *rconn, struct ofpbuf *b)
 {
-    int retval = rconn_send_with_limit(rconn, b, &sw->n_queued, 10);
+    /* Messages queued during a batch have not had a chance to be sent yet, so
+     * only the backlog from before the batch counts against the limit. */
+    int retval = rconn_send_with_limit(rconn, b, &sw->n_queued,
+                                       10 + sw->n_batched, RCONN_TXQ_CONTROL);
+    if (!retval && sw->batching) {
+        sw->n_batched++;
+    }
     if (retval && retval != ENOTCONN) {
         if (retval == EAGAIN) {
             VLOG_INFO_RL(&rl, "%012llx: %s: tx queue overflow",
@@ -371,15 +513,6 @@ queue_tx(struct lswitch *sw, struct rconn *rconn, struct ofpbuf *b)
     }
 }
 
-static void
-schedule_query(struct lswitch *sw, long long int delay)
-{
-    long long int now = time_msec();
-    if (sw->next_query == LLONG_MIN || sw->next_query > now + delay) {
-        sw->next_query = now + delay;
-    }
-}
-
 static void
 process_switch_features(struct lswitch *sw, struct rconn *rconn, void *osf_)
 {
@@ -391,14 +524,266 @@ process_switch_features(struct lswitch *sw, struct rconn *rconn, void *osf_)
 
     sw->datapath_id = ntohll(osf->datapath_id);
     sw->capabilities = ntohl(osf->capabilities);
+    sw->n_buffers = ntohl(osf->n_buffers);
     for (i = 0; i < n_ports; i++) {
-        process_phy_port(sw, rconn, &osf->ports[i]);
+        update_port_state(sw, rconn, &osf->ports[i], true);
     }
-    if (sw->capabilities & OFPC_STP) {
-        schedule_query(sw, 1000);
+
+    if (!sw->got_features) {
+        sw->got_features = true;
+        if (sw->resync_cb && sw->ml) {
+            struct mac_learning_saved *saved;
+            size_t n = sw->resync_cb(sw->datapath_id, &saved, sw->resync_aux);
+            if (n) {
+                resync(sw, rconn, saved, n);
+            }
+            free(saved);
+        }
     }
 }
 
+/* Relearns the 'n' MAC learning entries in 'saved', which an earlier
+ * connection from 'sw''s switch saved, and sets up destination flows toward
+ * them, if 'sw' uses such flows, in one batch.  Entries for ports that may
+ * not forward now are dropped. */
+static void
+resync(struct lswitch *sw, struct rconn *rconn,
+       const struct mac_learning_saved *saved, size_t n)
+{
+    struct mac_learning_saved *usable;
+    size_t n_usable, n_restored, n_flows;
+    size_t i;
+
+    usable = xmalloc(n * sizeof *usable);
+    n_usable = 0;
+    for (i = 0; i < n; i++) {
+        if (may_send(sw, saved[i].port)) {
+            usable[n_usable++] = saved[i];
+        }
+    }
+    n_restored = mac_learning_restore(sw->ml, usable, n_usable);
+
+    n_flows = 0;
+    if (n_restored && sw->max_idle >= 0 && use_dst_flows(sw)) {
+        for (i = 0; i < n_usable; i++) {
+            const struct mac_learning_saved *s = &usable[i];
+
+            if (mac_learning_lookup(sw->ml, s->mac, s->vlan) == s->port) {
+                queue_tx(sw, rconn, make_dst_flow(sw, htons(s->vlan), s->mac,
+                                                  UINT32_MAX, s->port));
+                remember_dst(sw, s->vlan, s->mac);
+                n_flows++;
+            }
+        }
+    }
+    free(usable);
+
+    VLOG_INFO("%012llx: restored %zu of %zu saved MACs, set up %zu flows",
+              sw->datapath_id, n_restored, n, n_flows);
+}
+
+/* Returns true if 'sw' should set up flows that match only on destination
+ * MAC and VLAN.  Such flows ignore the input port, so they cannot honor STP
+ * receive states, and 'sw' falls back to L2 flows if it runs STP. */
+static bool
+use_dst_flows(const struct lswitch *sw)
+{
+    return (sw->flow_mode == LSW_FLOW_PROACTIVE
+            && !(sw->capabilities & OFPC_STP));
+}
+
+/* Returns a flow_mod that adds a flow sending packets to 'dst_mac' on VLAN
+ * 'dl_vlan' (in network byte order) out 'out_port', from any input port. */
+static struct ofpbuf *
+make_dst_flow(const struct lswitch *sw, uint16_t dl_vlan,
+              const uint8_t dst_mac[ETH_ADDR_LEN], uint32_t buffer_id,
+              uint16_t out_port)
+{
+    struct ofp_flow_mod *ofm;
+    struct ofpbuf *b;
+    struct flow dst;
+
+    memset(&dst, 0, sizeof dst);
+    dst.dl_vlan = dl_vlan;
+    memcpy(dst.dl_dst, dst_mac, ETH_ADDR_LEN);
+    b = make_add_simple_flow(&dst, buffer_id, out_port, sw->max_idle);
+    ofm = b->data;
+    ofm->match.wildcards = htonl(OFPFW_ALL & ~(OFPFW_DL_VLAN | OFPFW_DL_DST));
+
+    /* Traffic that matches this flow never reaches the controller, so new
+     * sources sending to 'dst_mac' go unlearned.  Expire the flow along with
+     * the MAC learning entry that it was derived from, so that they are
+     * eventually learned. */
+    ofm->hard_timeout = htons(MAC_ENTRY_IDLE_TIME);
+    return b;
+}
+
+/* Returns a flow_mod that adds the flow that 'sw''s flow mode calls for to
+ * send packets like 'flow' out 'out_port'. */
+static struct ofpbuf *
+make_switch_flow(const struct lswitch *sw, const struct flow *flow,
+                 uint32_t buffer_id, uint16_t out_port)
+{
+    struct ofp_flow_mod *ofm;
+    struct ofpbuf *b;
+    struct flow l2;
+
+    if (!sw->ml || out_port == OFPP_FLOOD
+        || sw->flow_mode == LSW_FLOW_EXACT) {
+        return make_add_simple_flow(flow, buffer_id, out_port, sw->max_idle);
+    } else if (use_dst_flows(sw)) {
+        return make_dst_flow(sw, flow->dl_vlan, flow->dl_dst, buffer_id,
+                             out_port);
+    }
+
+    /* Match on the source MAC as well as the input port, so that every new
+     * source still reaches the controller once to be learned. */
+    memset(&l2, 0, sizeof l2);
+    l2.in_port = flow->in_port;
+    l2.dl_vlan = flow->dl_vlan;
+    memcpy(l2.dl_src, flow->dl_src, ETH_ADDR_LEN);
+    memcpy(l2.dl_dst, flow->dl_dst, ETH_ADDR_LEN);
+    b = make_add_simple_flow(&l2, buffer_id, out_port, sw->max_idle);
+    ofm = b->data;
+    ofm->match.wildcards = htonl(OFPFW_ALL & ~(OFPFW_IN_PORT | OFPFW_DL_VLAN
+                                               | OFPFW_DL_SRC
+                                               | OFPFW_DL_DST));
+    return b;
+}
+
+static struct lswitch_dst *
+lookup_dst(const struct lswitch *sw, uint16_t vlan,
+           const uint8_t mac[ETH_ADDR_LEN], uint32_t hash)
+{
+    struct lswitch_dst *dst;
+
+    HMAP_FOR_EACH_WITH_HASH (dst, struct lswitch_dst, hmap_node, hash,
+                             &sw->dsts) {
+        if (dst->vlan == vlan && eth_addr_equals(dst->mac, mac)) {
+            return dst;
+        }
+    }
+    return NULL;
+}
+
+/* Records that 'sw' has set up flows toward 'mac' on 'vlan', tagged with the
+ * tag of the MAC learning entry that they forward by. */
+static void
+remember_dst(struct lswitch *sw, uint16_t vlan,
+             const uint8_t mac[ETH_ADDR_LEN])
+{
+    uint32_t hash = hash_bytes(mac, ETH_ADDR_LEN, vlan);
+    struct lswitch_dst *dst = lookup_dst(sw, vlan, mac, hash);
+
+    if (!dst) {
+        dst = xmalloc(sizeof *dst);
+        hmap_insert(&sw->dsts, &dst->hmap_node, hash);
+        memcpy(dst->mac, mac, ETH_ADDR_LEN);
+        dst->vlan = vlan;
+    }
+    dst->tag = 0;
+    mac_learning_lookup_tag(sw->ml, mac, vlan, &dst->tag);
+}
+
+/* Deletes the flows on the switch that send to 'mac' on 'vlan', whatever
+ * their input port. */
+static void
+delete_dst_flows(struct lswitch *sw, struct rconn *rconn, uint16_t vlan,
+                 const uint8_t mac[ETH_ADDR_LEN])
+{
+    struct ofp_flow_mod *ofm;
+    struct ofpbuf *b;
+    struct flow dst;
+
+    memset(&dst, 0, sizeof dst);
+    dst.dl_vlan = htons(vlan);
+    memcpy(dst.dl_dst, mac, ETH_ADDR_LEN);
+    b = make_flow_mod(OFPFC_DELETE, &dst, 0);
+    ofm = b->data;
+    ofm->match.wildcards = htonl(OFPFW_ALL & ~(OFPFW_DL_VLAN | OFPFW_DL_DST));
+    ofm->out_port = htons(OFPP_NONE);
+    queue_tx(sw, rconn, b);
+}
+
+/* Deletes the flows toward each destination whose tag intersects 'changed',
+ * or whose MAC learning entry was evicted or replaced since 'sw' set them up,
+ * and forgets those destinations.  Only the destinations that 'sw' has set up
+ * flows toward are looked at, never the switch's flow table. */
+static void
+revalidate_dsts(struct lswitch *sw, struct rconn *rconn,
+                const struct tag_set *changed)
+{
+    struct lswitch_dst *dst, *next;
+
+    HMAP_FOR_EACH_SAFE (dst, next, struct lswitch_dst, hmap_node,
+                        &sw->dsts) {
+        tag_type tag = 0;
+
+        mac_learning_lookup_tag(sw->ml, dst->mac, dst->vlan, &tag);
+        if (tag != dst->tag || tag_set_intersects(changed, dst->tag)) {
+            delete_dst_flows(sw, rconn, dst->vlan, dst->mac);
+            hmap_remove(&sw->dsts, &dst->hmap_node);
+            free(dst);
+        }
+    }
+}
+
+/* Called when 'sw' learns that the source of 'flow' is on 'port', which
+ * changed the MAC learning entries with tag 'tag'.  Deletes the flows that
+ * were set up based on those entries, since they may use the MAC's old port,
+ * and in proactive mode installs a flow that sends it traffic from every port
+ * before any of that traffic reaches the controller. */
+static void
+update_dst_flows(struct lswitch *sw, struct rconn *rconn,
+                 const struct flow *flow, uint16_t port, tag_type tag)
+{
+    struct tag_set changed;
+
+    tag_set_init(&changed);
+    tag_set_add(&changed, tag);
+    revalidate_dsts(sw, rconn, &changed);
+
+    if (use_dst_flows(sw) && may_send(sw, port)) {
+        queue_tx(sw, rconn, make_dst_flow(sw, flow->dl_vlan, flow->dl_src,
+                                          UINT32_MAX, port));
+        remember_dst(sw, ntohs(flow->dl_vlan), flow->dl_src);
+    }
+}
+
+/* Returns true if the flow set up by flow_mod 'b' was already set up earlier
+ * in the current batch.  Otherwise, remembers it and returns false. */
+static bool
+batch_has_flow(struct lswitch *sw, const struct ofpbuf *b)
+{
+    const struct ofp_flow_mod *ofm = b->data;
+    size_t i;
+
+    if (!sw->batching) {
+        return false;
+    }
+    for (i = 0; i < sw->n_batch_flows; i++) {
+        if (!memcmp(&sw->batch_flows[i], &ofm->match, sizeof ofm->match)) {
+            return true;
+        }
+    }
+    if (sw->n_batch_flows < LSW_BATCH_FLOWS) {
+        sw->batch_flows[sw->n_batch_flows++] = ofm->match;
+    }
+    return false;
+}
+
+/* Returns a packet_out that sends 'pkt', which arrived on 'in_port' and was
+ * buffered by the switch as 'buffer_id' (or UINT32_MAX if unbuffered), out
+ * 'out_port'. */
+static struct ofpbuf *
+make_packet_out(const struct ofpbuf *pkt, uint32_t buffer_id,
+                uint16_t in_port, uint16_t out_port)
+{
+    return (buffer_id == UINT32_MAX
+            ? make_unbuffered_packet_out(pkt, in_port, out_port)
+            : make_buffered_packet_out(buffer_id, in_port, out_port));
+}
+
 static void
 process_packet_in(struct lswitch *sw, struct rconn *rconn, void *opi_)
 {
@@ -417,11 +802,25 @@ process_packet_in(struct lswitch *sw, struct rconn *rconn, void *opi_)
     pkt.size = pkt_len;
     flow_extract(&pkt, in_port, &flow);
 
+    sw->n_packet_ins++;
+    if (ntohl(opi->buffer_id) == UINT32_MAX) {
+        sw->n_unbuffered++;
+    }
+
     if (may_learn(sw, in_port) && sw->ml) {
-        if (mac_learning_learn(sw->ml, flow.dl_src, 0, in_port)) {
+        tag_type tag = mac_learning_learn(sw->ml, flow.dl_src,
+                                          ntohs(flow.dl_vlan), in_port);
+        if (tag) {
             VLOG_DBG_RL(&rl, "%012llx: learned that "ETH_ADDR_FMT" is on "
                         "port %"PRIu16, sw->datapath_id,
                         ETH_ADDR_ARGS(flow.dl_src), in_port);
+            if (sw->max_idle >= 0) {
+                update_dst_flows(sw, rconn, &flow, in_port, tag);
+            }
+            if (sw->learn_cb) {
+                sw->learn_cb(sw, ntohs(flow.dl_vlan), flow.dl_src, in_port,
+                             sw->learn_aux);
+            }
         }
     }
 
@@ -435,7 +834,8 @@ process_packet_in(struct lswitch *sw, struct rconn *rconn, void *opi_)
     }
 
     if (sw->ml) {
-        uint16_t learned_port = mac_learning_lookup(sw->ml, flow.dl_dst, 0);
+        uint16_t learned_port = mac_learning_lookup(sw->ml, flow.dl_dst,
+                                                    ntohs(flow.dl_vlan));
         if (may_send(sw, learned_port)) {
             out_port = learned_port;
         }
@@ -446,26 +846,34 @@ process_packet_in(struct lswitch *sw, struct rconn *rconn, void *opi_)
         goto drop_it;
     } else if (sw->max_idle >= 0 && (!sw->ml || out_port != OFPP_FLOOD)) {
         /* The output port is known, or we always flood everything, so add a
-         * new flow. */
-        queue_tx(sw, rconn, make_add_simple_flow(&flow, ntohl(opi->buffer_id),
-                                                 out_port, sw->max_idle));
-
-        /* If the switch didn't buffer the packet, we need to send a copy. */
-        if (ntohl(opi->buffer_id) == UINT32_MAX) {
-            queue_tx(sw, rconn,
-                     make_unbuffered_packet_out(&pkt, in_port, out_port));
+         * new flow.  The flow_mod carries the packet, if the switch buffered
+         * it. */
+        struct ofpbuf *b = make_switch_flow(sw, &flow, ntohl(opi->buffer_id),
+                                            out_port);
+        if (!batch_has_flow(sw, b)) {
+            queue_tx(sw, rconn, b);
+            if (sw->ml) {
+                remember_dst(sw, ntohs(flow.dl_vlan), flow.dl_dst);
+            }
+
+            /* If the switch didn't buffer the packet, we need to send a
+             * copy. */
+            if (ntohl(opi->buffer_id) == UINT32_MAX) {
+                queue_tx(sw, rconn,
+                         make_unbuffered_packet_out(&pkt, in_port, out_port));
+            }
+        } else {
+            /* An earlier packet in this batch already set up the flow, so
+             * just send this one along. */
+            ofpbuf_delete(b);
+            queue_tx(sw, rconn, make_packet_out(&pkt, ntohl(opi->buffer_id),
+                                                in_port, out_port));
         }
     } else {
         /* We don't know that MAC, or we don't set up flows.  Send along the
          * packet without setting up a flow. */
-        struct ofpbuf *b;
-        if (ntohl(opi->buffer_id) == UINT32_MAX) {
-            b = make_unbuffered_packet_out(&pkt, in_port, out_port);
-        } else {
-            b = make_buffered_packet_out(ntohl(opi->buffer_id),
-                                         in_port, out_port);
-        }
-        queue_tx(sw, rconn, b);
+        queue_tx(sw, rconn, make_packet_out(&pkt, ntohl(opi->buffer_id),
+                                            in_port, out_port));
     }
     return;
 
@@ -474,10 +882,14 @@ drop_it:
         /* Set up a flow to drop packets. */
         queue_tx(sw, rconn, make_add_flow(&flow, ntohl(opi->buffer_id),
                                           sw->max_idle, 0));
-    } else {
-        /* Just drop the packet, since we don't set up flows at all.
-         * XXX we should send a packet_out with no actions if buffer_id !=
-         * UINT32_MAX, to avoid clogging the kernel buffers. */
+    } else if (ntohl(opi->buffer_id) != UINT32_MAX) {
+        /* We don't set up flows at all, so free the packet's buffer with a
+         * packet_out that has no actions.  Otherwise the switch holds it
+         * until the buffer is recycled, and runs short of buffers for later
+         * packet_ins. */
+        queue_tx(sw, rconn, make_drop_packet_out(ntohl(opi->buffer_id),
+                                                 in_port));
+        sw->n_released++;
     }
     return;
 }
@@ -497,9 +909,49 @@ process_port_status(struct lswitch *sw, struct rconn *rconn, void *ops_)
 }
 
 static void
-process_phy_port(struct lswitch *sw, struct rconn *rconn UNUSED, void *opp_)
+process_phy_port(struct lswitch *sw, struct rconn *rconn, void *opp_)
+{
+    update_port_state(sw, rconn, opp_, false);
+}
+
+/* Sends 'sw' flow deletions for the flows that STP no longer allows on
+ * 'port_no': those that match on it as input port, and those that output to
+ * it.  A blocked port may still have flows that drop what it receives, but
+ * deleting them too is harmless, since they are set up again on demand. */
+static void
+revalidate_port(struct lswitch *sw, struct rconn *rconn, uint16_t port_no)
+{
+    struct ofp_flow_mod *ofm;
+    struct ofpbuf *b;
+    struct flow flow;
+
+    memset(&flow, 0, sizeof flow);
+    flow.in_port = htons(port_no);
+    b = make_flow_mod(OFPFC_DELETE, &flow, 0);
+    ofm = b->data;
+    ofm->match.wildcards = htonl(OFPFW_ALL & ~OFPFW_IN_PORT);
+    ofm->out_port = htons(OFPP_NONE);
+    queue_tx(sw, rconn, b);
+
+    memset(&flow, 0, sizeof flow);
+    b = make_flow_mod(OFPFC_DELETE, &flow, 0);
+    ofm = b->data;
+    ofm->match.wildcards = htonl(OFPFW_ALL);
+    ofm->out_port = htons(port_no);
+    queue_tx(sw, rconn, b);
+
+    VLOG_DBG("%012llx: deleted flows on port %"PRIu16" to implement STP",
+             sw->datapath_id, port_no);
+}
+
+/* Updates 'sw''s STP state for the port described by 'opp' and, if the port
+ * may no longer forward, deletes the flows that would let it.  If 'force' is
+ * true, as on (re)connection when flows set up before may still be on the
+ * switch, does so even if the state did not change. */
+static void
+update_port_state(struct lswitch *sw, struct rconn *rconn,
+                  const struct ofp_phy_port *opp, bool force)
 {
-    const struct ofp_phy_port *opp = opp_;
     uint16_t port_no = ntohs(opp->port_no);
     if (sw->capabilities & OFPC_STP && port_no < STP_MAX_PORTS) {
         uint32_t config = ntohl(opp->config);
@@ -530,9 +982,11 @@ process_phy_port(struct lswitch *sw, struct rconn *rconn UNUSED, void *opp_)
         } else {
             new_port_state = P_FORWARDING;
         }
-        if (*port_state != new_port_state) {
+        if (*port_state != new_port_state || force) {
             *port_state = new_port_state;
-            schedule_query(sw, 1000);
+            if (new_port_state != P_FORWARDING) {
+                revalidate_port(sw, rconn, port_no);
+            }
         }
     }
 }
@@ -566,94 +1020,35 @@ may_send(const struct lswitch *sw, uint16_t port_no)
     return get_port_state(sw, port_no) & P_FORWARDING;
 }
 
+/* Processes each of the messages in an OFP_EXT_BUNDLE as if it had arrived
+ * separately, and ignores other vendor messages. */
 static void
-process_flow_stats(struct lswitch *sw, struct rconn *rconn,
-                   const struct ofp_flow_stats *ofs)
-{
-    const char *end = (char *) ofs + ntohs(ofs->length);
-    bool delete = false;
-
-    /* Decide to delete the flow if it matches on an STP-disabled physical
-     * port.  But don't delete it if the flow just drops all received packets,
-     * because that's a perfectly reasonable thing to do for disabled physical
-     * ports. */
-    if (!(ofs->match.wildcards & htonl(OFPFW_IN_PORT))) {
-        if (!may_recv(sw, ntohs(ofs->match.in_port),
-                      end > (char *) ofs->actions)) {
-            delete = true;
-            sw->n_no_recv++;
-        }
-    }
-
-    /* Decide to delete the flow if it forwards to an STP-disabled physical
-     * port. */
-    if (!delete) {
-        const struct ofp_action_header *a;
-        size_t len;
-
-        for (a = ofs->actions; (char *) a < end; a += len / 8) {
-            len = ntohs(a->len);
-            if (len > end - (char *) a) {
-                VLOG_DBG_RL(&rl, "%012llx: action exceeds available space "
-                            "(%zu > %td)",
-                            sw->datapath_id, len, end - (char *) a);
-                break;
-            } else if (len % 8) {
-                VLOG_DBG_RL(&rl, "%012llx: action length (%zu) not multiple "
-                            "of 8 bytes", sw->datapath_id, len);
-                break;
-            }
-
-            if (a->type == htons(OFPAT_OUTPUT)) {
-                struct ofp_action_output *oao = (struct ofp_action_output *) a;
-                if (!may_send(sw, ntohs(oao->port))) {
-                    delete = true;
-                    sw->n_no_send++;
-                    break;
-                }
-            }
-        }
-    }
-
-    /* Delete the flow. */
-    if (delete) {
-        struct ofp_flow_mod *ofm;
-        struct ofpbuf *b;
-
-        ofm = make_openflow(offsetof(struct ofp_flow_mod, actions),
-                            OFPT_FLOW_MOD, &b);
-        ofm->match = ofs->match;
-        ofm->command = OFPFC_DELETE_STRICT;
-        rconn_send(rconn, b, NULL);
-    }
-}
-
-static void
-process_stats_reply(struct lswitch *sw, struct rconn *rconn, void *osr_)
+process_vendor(struct lswitch *sw, struct rconn *rconn, void *ob_)
 {
-    struct ofp_stats_reply *osr = osr_;
-    struct flow_stats_iterator i;
-    const struct ofp_flow_stats *fs;
+    struct ofp_ext_bundle *ob = ob_;
+    const uint8_t *pos, *end;
 
-    if (sw->last_query == LLONG_MIN
-        || osr->type != htons(OFPST_FLOW)
-        || osr->header.xid != sw->query_xid) {
+    end = (const uint8_t *) ob + ntohs(ob->header.header.length);
+    if (end - (const uint8_t *) ob < sizeof *ob
+        || ob->header.vendor != htonl(OPENFLOW_VENDOR_ID)
+        || ob->header.subtype != htonl(OFP_EXT_BUNDLE)) {
         return;
     }
-    for (fs = flow_stats_first(&i, osr); fs; fs = flow_stats_next(&i)) {
-        sw->n_flows++;
-        process_flow_stats(sw, rconn, fs);
-    }
-    if (!(osr->flags & htons(OFPSF_REPLY_MORE))) {
-        VLOG_DBG("%012llx: Deleted %d of %d received flows to "
-                 "implement STP, %d because of no-recv, %d because of "
-                 "no-send", sw->datapath_id,
-                 sw->n_no_recv + sw->n_no_send, sw->n_flows,
-                 sw->n_no_recv, sw->n_no_send);
-        sw->last_query = LLONG_MIN;
-        sw->last_reply = LLONG_MIN;
-    } else {
-        sw->last_reply = time_msec();
+
+    for (pos = (const uint8_t *) (ob + 1); pos < end; ) {
+        const struct ofp_header *oh = (const struct ofp_header *) pos;
+        struct ofpbuf msg;
+        size_t length;
+
+        length = (end - pos >= sizeof *oh ? ntohs(oh->length) : 0);
+        if (length < sizeof *oh || length > end - pos) {
+            VLOG_WARN_RL(&rl, "%012llx: %s: malformed bundle",
+                         sw->datapath_id, rconn_get_name(rconn));
+            return;
+        }
+        ofpbuf_use(&msg, (void *) pos, length);
+        msg.size = length;
+        lswitch_process_packet(sw, rconn, &msg);
+        pos += length;
     }
 }
-
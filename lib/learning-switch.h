@@ -35,14 +35,53 @@
 #define LEARNING_SWITCH_H 1
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "packets.h"
 
+struct mac_learning_saved;
 struct ofpbuf;
 struct rconn;
 
+/* Kinds of flows that a learning switch sets up for packets whose destination
+ * it has learned. */
+enum lswitch_flow_mode {
+    LSW_FLOW_EXACT,             /* Exact match on the whole packet. */
+    LSW_FLOW_L2,                /* Input port, VLAN, source and dest MAC. */
+    LSW_FLOW_PROACTIVE          /* VLAN and dest MAC, set up on learning. */
+};
+
 struct lswitch *lswitch_create(struct rconn *, bool learn_macs, int max_idle);
+void lswitch_set_mac_limits(struct lswitch *, size_t max_macs,
+                            size_t max_vlan_macs);
+void lswitch_set_flow_mode(struct lswitch *, enum lswitch_flow_mode);
+
+/* Called when a learning switch learns from a packet_in that 'mac' on 'vlan'
+ * is on 'port', where it was not before. */
+typedef void lswitch_learn_cb(struct lswitch *, uint16_t vlan,
+                              const uint8_t mac[ETH_ADDR_LEN], uint16_t port,
+                              void *aux);
+void lswitch_set_learn_cb(struct lswitch *, lswitch_learn_cb *, void *aux);
+
+/* Called when a learning switch learns its datapath ID 'dpid' from the
+ * switch's first features reply, to fetch what an earlier connection from
+ * the same switch learned (see lswitch_save_macs()).  Returns the number of
+ * MAC learning entries stored in '*saved', a newly allocated array that the
+ * learning switch frees, or 0 if there are none. */
+typedef size_t lswitch_resync_cb(unsigned long long int dpid,
+                                 struct mac_learning_saved **saved,
+                                 void *aux);
+void lswitch_set_resync_cb(struct lswitch *, lswitch_resync_cb *, void *aux);
+size_t lswitch_save_macs(const struct lswitch *,
+                         struct mac_learning_saved **);
+unsigned long long int lswitch_get_datapath_id(const struct lswitch *);
+bool lswitch_prefetch(struct lswitch *, struct rconn *, uint16_t vlan,
+                      const uint8_t mac[ETH_ADDR_LEN], uint16_t port);
 void lswitch_run(struct lswitch *, struct rconn *);
 void lswitch_wait(struct lswitch *);
 void lswitch_destroy(struct lswitch *);
+void lswitch_start_batch(struct lswitch *, struct rconn *);
+void lswitch_flush_batch(struct lswitch *, struct rconn *);
 void lswitch_process_packet(struct lswitch *, struct rconn *,
                             const struct ofpbuf *);
 
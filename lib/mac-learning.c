@@ -37,8 +37,10 @@
 #include <assert.h>
 #include <inttypes.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "hash.h"
+#include "hmap.h"
 #include "list.h"
 #include "openflow/openflow.h"
 #include "poll-loop.h"
@@ -49,16 +51,12 @@
 #define THIS_MODULE VLM_mac_learning
 #include "vlog.h"
 
-#define MAC_HASH_BITS 10
-#define MAC_HASH_MASK (MAC_HASH_SIZE - 1)
-#define MAC_HASH_SIZE (1u << MAC_HASH_BITS)
-
-#define MAC_MAX 1024
-
 /* A MAC learning table entry. */
 struct mac_entry {
-    struct list hash_node;      /* Element in a mac_learning 'table' list. */
-    struct list lru_node;       /* Element in 'lrus' or 'free' list. */
+    struct hmap_node hmap_node; /* Element in mac_learning 'table'. */
+    struct list lru_node;       /* Element in mac_learning 'lrus' list. */
+    struct list vlan_lru_node;  /* Element in mac_vlan 'lrus' list. */
+    struct mac_vlan *mv;        /* VLAN that this entry belongs to. */
     time_t expires;             /* Expiration time. */
     uint8_t mac[ETH_ADDR_LEN];  /* Known MAC address. */
     uint16_t vlan;              /* VLAN tag. */
@@ -66,14 +64,24 @@ struct mac_entry {
     tag_type tag;               /* Tag for this learning entry. */
 };
 
+/* Per-VLAN bookkeeping, so that one VLAN cannot evict another's entries once
+ * it reaches 'max_vlan_entries'. */
+struct mac_vlan {
+    struct hmap_node hmap_node; /* Element in mac_learning 'vlans'. */
+    uint16_t vlan;              /* VLAN tag. */
+    size_t n_entries;           /* Number of entries in 'lrus'. */
+    struct list lrus;           /* Entries in this VLAN, in LRU order. */
+};
+
 /* MAC learning table. */
 struct mac_learning {
-    struct list free;           /* Not-in-use entries. */
+    struct hmap table;          /* Contains "struct mac_entry"s. */
+    struct hmap vlans;          /* Contains "struct mac_vlan"s. */
     struct list lrus;           /* In-use entries, least recently used at the
                                    front, most recently used at the back. */
-    struct list table[MAC_HASH_SIZE]; /* Hash table. */
-    struct mac_entry entries[MAC_MAX]; /* All entries. */
-    uint32_t secret;            /* Secret for  */
+    size_t max_entries;         /* Maximum number of entries in 'table'. */
+    size_t max_vlan_entries;    /* Maximum entries per VLAN, 0 for none. */
+    uint32_t secret;            /* Secret for make_unknown_mac_tag(). */
 };
 
 static uint32_t
@@ -82,12 +90,24 @@ mac_table_hash(const uint8_t mac[ETH_ADDR_LEN], uint16_t vlan)
     return hash_bytes(mac, ETH_ADDR_LEN, vlan);
 }
 
+static uint32_t
+mac_vlan_hash(uint16_t vlan)
+{
+    return hash_bytes(&vlan, sizeof vlan, 0);
+}
+
 static struct mac_entry *
 mac_entry_from_lru_node(struct list *list)
 {
     return CONTAINER_OF(list, struct mac_entry, lru_node);
 }
 
+static struct mac_entry *
+mac_entry_from_vlan_lru_node(struct list *list)
+{
+    return CONTAINER_OF(list, struct mac_entry, vlan_lru_node);
+}
+
 /* Returns a tag that represents that 'mac' is on an unknown port in 'vlan'.
  * (When we learn where 'mac' is in 'vlan', this allows flows that were
  * flooded to be revalidated.) */
@@ -100,22 +120,13 @@ make_unknown_mac_tag(const struct mac_learning *ml,
     return tag_create_deterministic(h);
 }
 
-static struct list *
-mac_table_bucket(const struct mac_learning *ml,
-                 const uint8_t mac[ETH_ADDR_LEN],
-                 uint16_t vlan)
-{
-    uint32_t hash = mac_table_hash(mac, vlan);
-    const struct list *list = &ml->table[hash & MAC_HASH_BITS];
-    return (struct list *) list;
-}
-
 static struct mac_entry *
-search_bucket(struct list *bucket, const uint8_t mac[ETH_ADDR_LEN],
-              uint16_t vlan)
+search_table(const struct mac_learning *ml, const uint8_t mac[ETH_ADDR_LEN],
+             uint16_t vlan, uint32_t hash)
 {
     struct mac_entry *e;
-    LIST_FOR_EACH (e, struct mac_entry, hash_node, bucket) {
+    HMAP_FOR_EACH_WITH_HASH (e, struct mac_entry, hmap_node, hash,
+                             &ml->table) {
         if (eth_addr_equals(e->mac, mac) && e->vlan == vlan) {
             return e;
         }
@@ -123,6 +134,27 @@ search_bucket(struct list *bucket, const uint8_t mac[ETH_ADDR_LEN],
     return NULL;
 }
 
+/* Returns the bookkeeping for 'vlan' in 'ml', creating it if necessary. */
+static struct mac_vlan *
+get_vlan(struct mac_learning *ml, uint16_t vlan)
+{
+    struct mac_vlan *mv;
+
+    HMAP_FOR_EACH_WITH_HASH (mv, struct mac_vlan, hmap_node,
+                             mac_vlan_hash(vlan), &ml->vlans) {
+        if (mv->vlan == vlan) {
+            return mv;
+        }
+    }
+
+    mv = xmalloc(sizeof *mv);
+    hmap_insert(&ml->vlans, &mv->hmap_node, mac_vlan_hash(vlan));
+    mv->vlan = vlan;
+    mv->n_entries = 0;
+    list_init(&mv->lrus);
+    return mv;
+}
+
 /* If the LRU list is not empty, stores the least-recently-used entry in '*e'
  * and returns true.  Otherwise, if the LRU list is empty, stores NULL in '*e'
  * and return false. */
@@ -138,33 +170,48 @@ get_lru(struct mac_learning *ml, struct mac_entry **e)
     }
 }
 
-/* Removes 'e' from the 'ml' hash table.  'e' must not already be on the free
- * list. */
+/* Removes 'e' from 'ml' and frees it, along with its VLAN's bookkeeping if
+ * 'e' was that VLAN's last entry. */
 static void
 free_mac_entry(struct mac_learning *ml, struct mac_entry *e)
 {
-    list_remove(&e->hash_node);
+    struct mac_vlan *mv = e->mv;
+
+    hmap_remove(&ml->table, &e->hmap_node);
     list_remove(&e->lru_node);
-    list_push_front(&ml->free, &e->lru_node);
+    list_remove(&e->vlan_lru_node);
+    free(e);
+
+    if (!--mv->n_entries) {
+        hmap_remove(&ml->vlans, &mv->hmap_node);
+        free(mv);
+    }
+}
+
+/* Evicts least-recently-used entries from 'ml' until it holds no more than
+ * 'n' entries. */
+static void
+evict_to(struct mac_learning *ml, size_t n)
+{
+    struct mac_entry *e;
+    while (hmap_count(&ml->table) > n && get_lru(ml, &e)) {
+        free_mac_entry(ml, e);
+    }
 }
 
-/* Creates and returns a new MAC learning table. */
+/* Creates and returns a new MAC learning table that holds up to
+ * MAC_DEFAULT_MAX entries. */
 struct mac_learning *
 mac_learning_create(void)
 {
     struct mac_learning *ml;
-    int i;
 
     ml = xmalloc(sizeof *ml);
+    hmap_init(&ml->table);
+    hmap_init(&ml->vlans);
     list_init(&ml->lrus);
-    list_init(&ml->free);
-    for (i = 0; i < MAC_HASH_SIZE; i++) {
-        list_init(&ml->table[i]);
-    }
-    for (i = 0; i < MAC_MAX; i++) {
-        struct mac_entry *s = &ml->entries[i];
-        list_push_front(&ml->free, &s->lru_node);
-    }
+    ml->max_entries = MAC_DEFAULT_MAX;
+    ml->max_vlan_entries = 0;
     ml->secret = random_uint32();
     return ml;
 }
@@ -173,7 +220,36 @@ mac_learning_create(void)
 void
 mac_learning_destroy(struct mac_learning *ml)
 {
-    free(ml);
+    if (ml) {
+        mac_learning_flush(ml);
+        hmap_destroy(&ml->table);
+        hmap_destroy(&ml->vlans);
+        free(ml);
+    }
+}
+
+/* Changes the maximum number of entries in 'ml' to 'max_entries' (at least
+ * 1), evicting the least-recently-used entries if 'ml' now holds too many.
+ * The hash table grows as entries are learned, so a large limit costs
+ * nothing until it is used. */
+void
+mac_learning_set_max_entries(struct mac_learning *ml, size_t max_entries)
+{
+    ml->max_entries = MAX(max_entries, 1);
+    evict_to(ml, ml->max_entries);
+    hmap_shrink(&ml->table);
+}
+
+/* Limits each VLAN in 'ml' to 'max_vlan_entries' entries, or removes the
+ * limit if 'max_vlan_entries' is 0.  A VLAN at its limit recycles its own
+ * least-recently-used entry to learn a new one, instead of evicting entries
+ * from other VLANs.  Existing entries over the new limit are aged out
+ * normally. */
+void
+mac_learning_set_max_vlan_entries(struct mac_learning *ml,
+                                  size_t max_vlan_entries)
+{
+    ml->max_vlan_entries = max_vlan_entries;
 }
 
 /* Attempts to make 'ml' learn from the fact that a frame from 'src_mac' was
@@ -191,7 +267,7 @@ mac_learning_learn(struct mac_learning *ml,
                    uint16_t src_port)
 {
     struct mac_entry *e;
-    struct list *bucket;
+    uint32_t hash;
 
     if (eth_addr_is_multicast(src_mac)) {
         static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(30, 30);
@@ -200,17 +276,28 @@ mac_learning_learn(struct mac_learning *ml,
         return 0;
     }
 
-    bucket = mac_table_bucket(ml, src_mac, vlan);
-    e = search_bucket(bucket, src_mac, vlan);
+    hash = mac_table_hash(src_mac, vlan);
+    e = search_table(ml, src_mac, vlan, hash);
     if (!e) {
-        if (!list_is_empty(&ml->free)) {
-            e = mac_entry_from_lru_node(ml->free.next);
+        struct mac_vlan *mv = get_vlan(ml, vlan);
+
+        /* Make room, from this VLAN's own entries if it is at its limit.
+         * Either way 'mv' may be freed along with its last entry, so look
+         * it up again afterward. */
+        if (ml->max_vlan_entries && mv->n_entries >= ml->max_vlan_entries) {
+            free_mac_entry(ml, mac_entry_from_vlan_lru_node(mv->lrus.next));
         } else {
-            e = mac_entry_from_lru_node(ml->lrus.next);
-            list_remove(&e->hash_node);
+            evict_to(ml, ml->max_entries - 1);
         }
+        mv = get_vlan(ml, vlan);
+
+        e = xmalloc(sizeof *e);
+        hmap_insert(&ml->table, &e->hmap_node, hash);
+        list_push_back(&ml->lrus, &e->lru_node);
+        list_push_back(&mv->lrus, &e->vlan_lru_node);
+        mv->n_entries++;
+        e->mv = mv;
         memcpy(e->mac, src_mac, ETH_ADDR_LEN);
-        list_push_front(bucket, &e->hash_node);
         e->port = -1;
         e->vlan = vlan;
         e->tag = make_unknown_mac_tag(ml, src_mac, vlan);
@@ -219,7 +306,9 @@ mac_learning_learn(struct mac_learning *ml,
     /* Make the entry most-recently-used. */
     list_remove(&e->lru_node);
     list_push_back(&ml->lrus, &e->lru_node);
-    e->expires = time_now() + 60;
+    list_remove(&e->vlan_lru_node);
+    list_push_back(&e->mv->lrus, &e->vlan_lru_node);
+    e->expires = time_now() + MAC_ENTRY_IDLE_TIME;
 
     /* Did we learn something? */
     if (e->port != src_port) {
@@ -255,8 +344,8 @@ mac_learning_lookup_tag(const struct mac_learning *ml,
     if (eth_addr_is_multicast(dst)) {
         return OFPP_FLOOD;
     } else {
-        struct mac_entry *e = search_bucket(mac_table_bucket(ml, dst, vlan),
-                                            dst, vlan);
+        struct mac_entry *e = search_table(ml, dst, vlan,
+                                           mac_table_hash(dst, vlan));
         if (e) {
             *tag |= e->tag;
             return e->port;
@@ -277,6 +366,83 @@ mac_learning_flush(struct mac_learning *ml)
     while (get_lru(ml, &e)){
         free_mac_entry(ml, e);
     }
+    hmap_shrink(&ml->table);
+}
+
+/* Stores a copy of each entry in 'ml' in '*savedp', a newly allocated array
+ * that the caller must free, least recently used first.  Returns the number
+ * of entries. */
+size_t
+mac_learning_save(const struct mac_learning *ml,
+                  struct mac_learning_saved **savedp)
+{
+    struct mac_learning_saved *saved;
+    struct mac_entry *e;
+    size_t n = 0;
+
+    saved = xmalloc(hmap_count(&ml->table) * sizeof *saved);
+    LIST_FOR_EACH (e, struct mac_entry, lru_node, &ml->lrus) {
+        struct mac_learning_saved *s = &saved[n++];
+        memcpy(s->mac, e->mac, ETH_ADDR_LEN);
+        s->vlan = e->vlan;
+        s->port = e->port;
+        s->expires = e->expires;
+    }
+    *savedp = saved;
+    return n;
+}
+
+/* Adds to 'ml' the 'n' entries in 'saved', in the order that
+ * mac_learning_save() stored them, each to expire when it would have.
+ * Entries that have expired, that 'ml' already has, or that do not fit
+ * within 'ml''s limits are skipped, so that 'ml' loses nothing that it has
+ * learned itself.  Returns the number of entries added. */
+size_t
+mac_learning_restore(struct mac_learning *ml,
+                     const struct mac_learning_saved *saved, size_t n)
+{
+    struct list *pos = ml->lrus.next;
+    time_t now = time_now();
+    size_t n_restored = 0;
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        const struct mac_learning_saved *s = &saved[i];
+        uint32_t hash = mac_table_hash(s->mac, s->vlan);
+        struct mac_vlan *mv;
+        struct mac_entry *e;
+
+        if (s->expires <= now || eth_addr_is_multicast(s->mac)
+            || hmap_count(&ml->table) >= ml->max_entries
+            || search_table(ml, s->mac, s->vlan, hash)) {
+            continue;
+        }
+        mv = get_vlan(ml, s->vlan);
+        if (ml->max_vlan_entries && mv->n_entries >= ml->max_vlan_entries) {
+            continue;
+        }
+
+        /* mac_learning_run() expires entries from the front of 'lrus', so
+         * keep it in order of expiration. */
+        while (pos != &ml->lrus
+               && mac_entry_from_lru_node(pos)->expires <= s->expires) {
+            pos = pos->next;
+        }
+
+        e = xmalloc(sizeof *e);
+        hmap_insert(&ml->table, &e->hmap_node, hash);
+        list_insert(pos, &e->lru_node);
+        list_push_front(&mv->lrus, &e->vlan_lru_node);
+        mv->n_entries++;
+        e->mv = mv;
+        memcpy(e->mac, s->mac, ETH_ADDR_LEN);
+        e->vlan = s->vlan;
+        e->port = s->port;
+        e->expires = s->expires;
+        e->tag = tag_create_random();
+        n_restored++;
+    }
+    return n_restored;
 }
 
 void
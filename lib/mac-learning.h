@@ -34,11 +34,23 @@
 #ifndef MAC_LEARNING_H
 #define MAC_LEARNING_H 1
 
+#include <stddef.h>
+#include <time.h>
 #include "packets.h"
 #include "tag.h"
 
+/* Default maximum number of entries in a MAC learning table. */
+#define MAC_DEFAULT_MAX 1024
+
+/* Time, in seconds, that a MAC learning entry lasts without being
+ * relearned. */
+#define MAC_ENTRY_IDLE_TIME 60
+
 struct mac_learning *mac_learning_create(void);
 void mac_learning_destroy(struct mac_learning *);
+void mac_learning_set_max_entries(struct mac_learning *, size_t max_entries);
+void mac_learning_set_max_vlan_entries(struct mac_learning *,
+                                       size_t max_vlan_entries);
 tag_type mac_learning_learn(struct mac_learning *,
                             const uint8_t src[ETH_ADDR_LEN], uint16_t vlan,
                             uint16_t src_port);
@@ -48,6 +60,19 @@ uint16_t mac_learning_lookup_tag(const struct mac_learning *,
                                  const uint8_t dst[ETH_ADDR_LEN],
                                  uint16_t vlan, tag_type *tag);
 void mac_learning_flush(struct mac_learning *);
+
+/* A MAC learning table entry, as saved by mac_learning_save(). */
+struct mac_learning_saved {
+    uint8_t mac[ETH_ADDR_LEN];
+    uint16_t vlan;
+    uint16_t port;
+    time_t expires;             /* When the entry expires, as time_now(). */
+};
+size_t mac_learning_save(const struct mac_learning *,
+                         struct mac_learning_saved **);
+size_t mac_learning_restore(struct mac_learning *,
+                            const struct mac_learning_saved *, size_t n);
+
 void mac_learning_run(struct mac_learning *, struct tag_set *);
 void mac_learning_wait(struct mac_learning *);
 
@@ -0,0 +1,204 @@
+/* Copyright (c) 2008 The Board of Trustees of The Leland Stanford
+ * Junior University
+ * 
+ * We are making the OpenFlow specification and associated documentation
+ * (Software) available for public use and benefit with the expectation
+ * that others will use, modify and enhance the Software and contribute
+ * those enhancements back to the community. However, since we would
+ * like to make the Software available for broadest use, with as few
+ * restrictions as possible permission is hereby granted, free of
+ * charge, to any person obtaining a copy of this Software to deal in
+ * the Software under the copyrights without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ * The name and trademarks of copyright holder(s) may NOT be used in
+ * advertising or publicity pertaining to the Software or any
+ * derivatives without specific, written prior permission.
+ */
+
+#include <config.h>
+#include "metrics.h"
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "dynamic-string.h"
+#include "poll-loop.h"
+#include "socket-util.h"
+#include "timeval.h"
+#include "util.h"
+
+#define THIS_MODULE VLM_metrics
+#include "vlog.h"
+
+/* Largest datagram sent to the collector, small enough to avoid
+ * fragmentation on an Ethernet path. */
+#define METRICS_DATAGRAM_MAX 1400
+
+static char *target;            /* Collector, or null if not configured. */
+static int interval = METRICS_DEFAULT_INTERVAL * 1000; /* In ms. */
+static char *prefix;            /* Prepended to every key. */
+static int fd = -1;             /* UDP socket connected to 'target'. */
+static long long int next_export; /* time_msec() of next export. */
+
+/* Sets the collector to which metrics_init() sends metrics to 'target_',
+ * which has the form HOST[:PORT]. */
+void
+metrics_set_target(const char *target_)
+{
+    free(target);
+    target = xstrdup(target_);
+}
+
+/* Sets the number of seconds between exports to 'secs', a string given on
+ * the command line. */
+void
+metrics_set_interval(const char *secs)
+{
+    int n = atoi(secs);
+    if (n <= 0) {
+        ofp_fatal(0, "argument to --metrics-interval must be positive");
+    }
+    interval = n * 1000;
+}
+
+/* Opens the connection to the collector set with metrics_set_target(), if
+ * any, and prefixes every exported key with 'prefix_' and a period. */
+void
+metrics_init(const char *prefix_)
+{
+    int error;
+
+    if (!target) {
+        return;
+    }
+    error = udp_open_active(target, METRICS_DEFAULT_PORT, &fd);
+    if (error) {
+        ofp_fatal(error, "could not open metrics collector %s", target);
+    }
+    prefix = xstrdup(prefix_);
+    next_export = time_msec() + interval;
+}
+
+/* Returns true if it is time to export metrics with metrics_send(). */
+bool
+metrics_due(void)
+{
+    return fd >= 0 && time_msec() >= next_export;
+}
+
+static void
+send_datagram(struct ds *datagram)
+{
+    if (datagram->length) {
+        if (send(fd, datagram->string, datagram->length, 0) < 0) {
+            static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(1, 5);
+            VLOG_WARN_RL(&rl, "%s: send: %s", target, strerror(errno));
+        }
+        ds_clear(datagram);
+    }
+}
+
+/* Sends each "key=value" line in 'status' whose value is a number to the
+ * collector as a gauge, and schedules the next export.  Other lines, such
+ * as names and states, are skipped. */
+void
+metrics_send(const struct ds *status)
+{
+    struct ds datagram;
+    const char *line, *end;
+
+    if (fd < 0) {
+        return;
+    }
+
+    ds_init(&datagram);
+    end = status->string + status->length;
+    for (line = status->string; line < end; ) {
+        const char *eol = memchr(line, '\n', end - line);
+        const char *equals, *value, *p;
+        size_t key_len, value_len, old_length;
+        char *tail;
+
+        if (!eol) {
+            eol = end;
+        }
+        equals = memchr(line, '=', eol - line);
+        if (!equals || equals == line || equals + 1 == eol) {
+            goto next;
+        }
+        value = equals + 1;
+        value_len = eol - value;
+        if (!isdigit((unsigned char) *value) && *value != '-') {
+            goto next;
+        }
+        strtod(value, &tail);
+        if (tail != eol) {
+            goto next;
+        }
+
+        /* ':' and '|' delimit fields in the statsd format. */
+        old_length = datagram.length;
+        key_len = equals - line;
+        ds_put_format(&datagram, "%s.", prefix);
+        for (p = line; p < line + key_len; p++) {
+            ds_put_char(&datagram, *p == ':' || *p == '|' ? '_' : *p);
+        }
+        ds_put_char(&datagram, ':');
+        ds_put_buffer(&datagram, value, value_len);
+        ds_put_cstr(&datagram, "|g\n");
+        if (datagram.length > METRICS_DATAGRAM_MAX && old_length) {
+            char *metric = xmemdup0(&datagram.string[old_length],
+                                    datagram.length - old_length);
+            ds_truncate(&datagram, old_length);
+            send_datagram(&datagram);
+            ds_put_cstr(&datagram, metric);
+            free(metric);
+        }
+
+    next:
+        line = eol + 1;
+    }
+    send_datagram(&datagram);
+    ds_destroy(&datagram);
+
+    next_export = time_msec() + interval;
+}
+
+/* Causes the next call to poll_block() to wake up when metrics are next
+ * due. */
+void
+metrics_wait(void)
+{
+    if (fd >= 0) {
+        long long int now = time_msec();
+        poll_timer_wait(next_export > now ? next_export - now : 0);
+    }
+}
+
+void
+metrics_usage(void)
+{
+    printf("\nMetrics options:\n"
+           "  --metrics=HOST[:PORT]   send counters to statsd collector\n"
+           "  --metrics-interval=SECS seconds between exports (default: %d)\n",
+           METRICS_DEFAULT_INTERVAL);
+}
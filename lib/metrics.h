@@ -0,0 +1,79 @@
+/* Copyright (c) 2008 The Board of Trustees of The Leland Stanford
+ * Junior University
+ * 
+ * We are making the OpenFlow specification and associated documentation
+ * (Software) available for public use and benefit with the expectation
+ * that others will use, modify and enhance the Software and contribute
+ * those enhancements back to the community. However, since we would
+ * like to make the Software available for broadest use, with as few
+ * restrictions as possible permission is hereby granted, free of
+ * charge, to any person obtaining a copy of this Software to deal in
+ * the Software under the copyrights without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ * The name and trademarks of copyright holder(s) may NOT be used in
+ * advertising or publicity pertaining to the Software or any
+ * derivatives without specific, written prior permission.
+ */
+
+/* Periodic export of counters to a metrics collector.
+ *
+ * Each interval, the program formats its status, as "key=value" lines like
+ * those that "dpctl status" prints, and the lines whose values are numbers
+ * are sent to a collector over UDP in the statsd line format, as gauges:
+ *
+ *     PREFIX.KEY:VALUE|g
+ *
+ * This gives monitoring systems the program's counters without an OpenFlow
+ * connection of their own. */
+
+#ifndef METRICS_H
+#define METRICS_H 1
+
+#include <stdbool.h>
+
+struct ds;
+
+/* Default UDP port of the collector, the usual statsd port. */
+#define METRICS_DEFAULT_PORT 8125
+
+/* Default number of seconds between exports. */
+#define METRICS_DEFAULT_INTERVAL 10
+
+#define METRICS_OPTION_ENUMS OPT_METRICS, OPT_METRICS_INTERVAL
+#define METRICS_LONG_OPTIONS                                        \
+        {"metrics",     required_argument, 0, OPT_METRICS},         \
+        {"metrics-interval", required_argument, 0, OPT_METRICS_INTERVAL}
+#define METRICS_OPTION_HANDLERS                 \
+        case OPT_METRICS:                       \
+            metrics_set_target(optarg);         \
+            break;                              \
+        case OPT_METRICS_INTERVAL:              \
+            metrics_set_interval(optarg);       \
+            break;
+void metrics_usage(void);
+
+void metrics_set_target(const char *target);
+void metrics_set_interval(const char *secs);
+void metrics_init(const char *prefix);
+
+bool metrics_due(void);
+void metrics_send(const struct ds *status);
+void metrics_wait(void);
+
+#endif /* metrics.h */
@@ -39,6 +39,7 @@
 #include <fcntl.h>
 #include <arpa/inet.h>
 #include <inttypes.h>
+#include <limits.h>
 #include <linux/if_tun.h>
 
 /* Fix for some compile issues we were experiencing when setting up openwrt
@@ -58,6 +59,8 @@
 #endif
 
 #include <linux/ethtool.h>
+#include <linux/filter.h>
+#include <linux/pkt_sched.h>
 #include <linux/rtnetlink.h>
 #include <linux/sockios.h>
 #include <linux/version.h>
@@ -74,6 +77,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <sys/mman.h>
 
 #include "fatal-signal.h"
 #include "list.h"
@@ -84,6 +88,7 @@
 #include "poll-loop.h"
 #include "socket-util.h"
 #include "svec.h"
+#include "timeval.h"
 
 /* linux/if.h defines IFF_LOWER_UP, net/if.h doesn't.
  * net/if.h defines if_nameindex(), linux/if.h doesn't.
@@ -95,6 +100,89 @@
 #define THIS_MODULE VLM_netdev
 #include "vlog.h"
 
+#ifdef PACKET_TX_RING
+/* PACKET_TX_RING frame header and ring request, as in <linux/if_packet.h>,
+ * which cannot be included along with <netpacket/packet.h>. */
+struct netdev_tpacket_hdr {
+    volatile unsigned long tp_status;
+    unsigned int tp_len;
+    unsigned int tp_snaplen;
+    unsigned short tp_mac;
+    unsigned short tp_net;
+    unsigned int tp_sec;
+    unsigned int tp_usec;
+};
+
+struct netdev_tpacket_req {
+    unsigned int tp_block_size;
+    unsigned int tp_block_nr;
+    unsigned int tp_frame_size;
+    unsigned int tp_frame_nr;
+};
+
+#define NETDEV_TP_STATUS_SEND_REQUEST 0x1
+#define NETDEV_TP_STATUS_SENDING 0x2
+
+/* Offset of the frame data from the start of each TX ring frame. */
+#define NETDEV_TX_DATA_OFFSET ROUND_UP(sizeof(struct netdev_tpacket_hdr), 16)
+#endif
+
+#if defined(PACKET_RX_RING) && defined(PACKET_VERSION)
+#define NETDEV_HAVE_RX_RING 1
+
+/* TPACKET_V3 block and frame headers and ring request, as in
+ * <linux/if_packet.h>. */
+struct netdev_tpacket_req3 {
+    unsigned int tp_block_size;
+    unsigned int tp_block_nr;
+    unsigned int tp_frame_size;
+    unsigned int tp_frame_nr;
+    unsigned int tp_retire_blk_tov;
+    unsigned int tp_sizeof_priv;
+    unsigned int tp_feature_req_word;
+};
+
+struct netdev_tpacket_block_desc {
+    uint32_t version;
+    uint32_t offset_to_priv;
+    volatile uint32_t block_status;
+    uint32_t num_pkts;
+    uint32_t offset_to_first_pkt;
+    uint32_t blk_len;
+    uint64_t seq_num;
+    uint32_t ts_first_pkt[2];
+    uint32_t ts_last_pkt[2];
+};
+
+struct netdev_tpacket3_hdr {
+    uint32_t tp_next_offset;
+    uint32_t tp_sec;
+    uint32_t tp_nsec;
+    uint32_t tp_snaplen;
+    uint32_t tp_len;
+    uint32_t tp_status;
+    uint16_t tp_mac;
+    uint16_t tp_net;
+    uint32_t tp_rxhash;
+    uint32_t tp_vlan_tci;
+    uint16_t tp_vlan_tpid;
+    uint16_t tp_padding;
+    uint8_t tp_padding2[8];
+};
+
+#define NETDEV_TPACKET_V3 2
+#define NETDEV_TP_STATUS_KERNEL 0
+#define NETDEV_TP_STATUS_USER 0x1
+#define NETDEV_TP_FT_REQ_FILL_RXHASH 0x1
+
+/* Offset of the struct sockaddr_ll that follows each RX ring frame header. */
+#define NETDEV_RX_SLL_OFFSET ROUND_UP(sizeof(struct netdev_tpacket3_hdr), 16)
+
+/* Time, in ms, after which the kernel hands over a partly filled RX ring
+ * block, bounding the latency that the ring adds under light load. */
+#define NETDEV_RX_BLOCK_TOV 1
+#endif
+
 struct netdev {
     struct list node;
     char *name;
@@ -105,10 +193,40 @@ struct netdev {
     int tap_fd;                 /* TAP character device, if any, otherwise the
                                  * network device. */
 
+    /* File descriptors to receive from.  rx_fds[0] is 'tap_fd'.  The others
+     * are the extra queues of a multiqueue TAP device. */
+    int rx_fds[NETDEV_MAX_TAP_QUEUES];
+    int n_rx_fds;
+    int next_rx_fd;             /* Index in 'rx_fds' to read first. */
+
     /* one socket per queue.These are valid only for ordinary network devices*/
     int queue_fd[NETDEV_MAX_QUEUES + 1];
     uint16_t num_queues;
 
+    /* Memory-mapped PACKET_TX_RING on queue_fd[0], if enabled with
+     * netdev_setup_tx_ring(). */
+    char *tx_ring;              /* Start of mapping, or NULL if disabled. */
+    size_t tx_ring_size;        /* Size of mapping, in bytes. */
+    unsigned int tx_block_size; /* Size of each ring block, in bytes. */
+    unsigned int tx_frame_size; /* Size of each ring frame, in bytes. */
+    unsigned int tx_frames_per_block;
+    unsigned int tx_frame_nr;   /* Number of frames in the ring. */
+    unsigned int tx_head;       /* Next frame to fill. */
+    unsigned int tx_pending;    /* Frames filled since the last flush. */
+
+    /* Memory-mapped TPACKET_V3 PACKET_RX_RING, if enabled with
+     * netdev_setup_rx_ring().  The ring has a socket of its own, because a
+     * socket's rings share one frame format and the TX ring's is older. */
+    int rx_ring_fd;             /* Socket with the ring, or -1. */
+    char *rx_ring;              /* Start of mapping, or NULL if disabled. */
+    size_t rx_ring_size;        /* Size of mapping, in bytes. */
+    unsigned int rx_block_size; /* Size of each ring block, in bytes. */
+    unsigned int rx_block_nr;   /* Number of blocks in the ring. */
+    unsigned int rx_block;      /* Block being read, or to read next. */
+    unsigned int rx_frames_left; /* Frames not yet read in 'rx_block'. */
+    char *rx_frame;             /* Next frame to read in 'rx_block'. */
+    uint16_t protocol;          /* Ethertype bound, in network byte order. */
+
     /* Cached network device information. */
     int ifindex;
     uint8_t etheraddr[ETH_ADDR_LEN];
@@ -127,6 +245,11 @@ struct netdev {
 
     int save_flags;             /* Initial device flags. */
     int changed_flags;          /* Flags that we changed. */
+
+    /* Kernel counters, refreshed for all devices at once by
+     * netdev_refresh_stats(). */
+    struct netdev_stats stats;
+    long long int stats_time;   /* When 'stats' was fetched, or LLONG_MIN. */
 };
 
 /* All open network devices. */
@@ -194,37 +317,211 @@ get_ipv6_address(const char *name, struct in6_addr *in6)
  * without any bandwidth guarantees */
 #define TC_DEFAULT_CLASS 0xfffe
 #define TC_MIN_RATE 1
-/* This configures an HTB qdisc under the defined device. */
-#define COMMAND_ADD_DEV_QDISC "/sbin/tc qdisc add dev %s " \
-                              "root handle %x: htb default %x"
-#define COMMAND_DEL_DEV_QDISC "/sbin/tc qdisc del dev %s root"
-#define COMMAND_ADD_CLASS "/sbin/tc class add dev %s parent %x:%x " \
-                          "classid %x:%x htb rate %dkbit ceil %dkbit"
-#define COMMAND_CHANGE_CLASS "/sbin/tc class change dev %s parent %x:%x " \
-                             "classid %x:%x htb rate %dkbit ceil %dkbit"
-#define COMMAND_DEL_CLASS "/sbin/tc class del dev %s parent %x:%x classid %x:%x"
+
+/* Queue disciplines and classes are configured over rtnetlink, with the same
+ * requests that "tc qdisc" and "tc class" make, instead of running one tc
+ * process per change.  Requests for one port go to the kernel together. */
+#define TC_MAX_BATCH 4
+
+static struct nl_sock *rtnl_sock;
+
+/* Packet scheduler clock, from /proc/net/psched, which HTB rate tables and
+ * burst sizes are expressed in. */
+static double tc_ticks_per_s;
+static unsigned int tc_buffer_hz;
 
 static int
-netdev_setup_root_class(const struct netdev *netdev, uint16_t class_id,
-                        uint16_t rate)
+tc_init(void)
 {
-    char command[1024];
-    int actual_rate;
-
-    /* we need to translate from .1% to kbps */
-    actual_rate = rate*netdev->speed;
+    unsigned int a, b, c, d;
+    FILE *stream;
+    int error;
 
-    snprintf(command, sizeof(command), COMMAND_ADD_CLASS, netdev->name,
-             TC_QDISC,0,TC_QDISC, class_id, actual_rate, netdev->speed*1000);
-    if (system(command) != 0) {
-        VLOG_ERR("Problem configuring root class %d for device %s",
-                 class_id, netdev->name);
-        return -1;
+    if (rtnl_sock) {
+        return 0;
+    }
+    error = nl_sock_create(NETLINK_ROUTE, 0, 0, 0, &rtnl_sock);
+    if (error) {
+        VLOG_ERR("could not create rtnetlink socket: %s", strerror(error));
+        return error;
     }
 
+    /* Defaults for a kernel with high-resolution timers. */
+    a = 1000;
+    b = 64;
+    c = 1000000;
+    d = 1000000000;
+    stream = fopen("/proc/net/psched", "r");
+    if (stream) {
+        if (fscanf(stream, "%x %x %x %x", &a, &b, &c, &d) != 4 || !b) {
+            VLOG_WARN("/proc/net/psched: unexpected format, using defaults");
+            a = 1000;
+            b = 64;
+            c = 1000000;
+            d = 1000000000;
+        }
+        fclose(stream);
+    }
+    tc_ticks_per_s = (double) a * c / b;
+    tc_buffer_hz = c == 1000000 ? d : c;
     return 0;
 }
 
+/* Returns the number of scheduler ticks that sending 'size' bytes takes at
+ * 'Bps' bytes per second. */
+static unsigned int
+tc_bytes_to_ticks(unsigned int Bps, unsigned int size)
+{
+    return Bps ? tc_ticks_per_s * size / Bps : 0;
+}
+
+static void
+tc_fill_rate(struct tc_ratespec *rate, unsigned int kbps, unsigned int mtu)
+{
+    memset(rate, 0, sizeof *rate);
+    rate->cell_log = 0;
+    while (mtu > 255) {
+        mtu >>= 1;
+        rate->cell_log++;
+    }
+    rate->mpu = ETH_TOTAL_MIN;
+    rate->rate = kbps * 125;
+}
+
+/* Returns the burst, in ticks, that a bucket filling at 'Bps' needs to send
+ * at full rate between timer interrupts, as tc computes by default. */
+static unsigned int
+tc_calc_buffer(unsigned int Bps, unsigned int mtu)
+{
+    unsigned int min_burst = tc_buffer_hz ? Bps / tc_buffer_hz + mtu : mtu;
+    return tc_bytes_to_ticks(Bps, min_burst);
+}
+
+/* Appends the rate table that older kernels require alongside 'rate', as a
+ * Netlink attribute of the given 'type', to 'msg'. */
+static void
+tc_put_rtab(struct ofpbuf *msg, uint16_t type, const struct tc_ratespec *rate)
+{
+    uint32_t *rtab;
+    unsigned int i;
+
+    rtab = nl_msg_put_unspec_uninit(msg, type, 256 * sizeof *rtab);
+    for (i = 0; i < 256; i++) {
+        unsigned int packet_size = (i + 1) << rate->cell_log;
+        if (packet_size < rate->mpu) {
+            packet_size = rate->mpu;
+        }
+        rtab[i] = tc_bytes_to_ticks(rate->rate, packet_size);
+    }
+}
+
+static struct ofpbuf *
+tc_make_request(int type, unsigned int flags, int ifindex,
+                uint32_t handle, uint32_t parent)
+{
+    struct ofpbuf *msg = ofpbuf_new(2560);
+    struct tcmsg *tcmsg;
+
+    nl_msg_put_nlmsghdr(msg, rtnl_sock, sizeof *tcmsg, type,
+                        NLM_F_REQUEST | NLM_F_ACK | flags);
+    tcmsg = nl_msg_put_uninit(msg, sizeof *tcmsg);
+    memset(tcmsg, 0, sizeof *tcmsg);
+    tcmsg->tcm_family = AF_UNSPEC;
+    tcmsg->tcm_ifindex = ifindex;
+    tcmsg->tcm_handle = handle;
+    tcmsg->tcm_parent = parent;
+    return msg;
+}
+
+/* Returns a request that adds, if 'flags' includes NLM_F_CREATE, or else
+ * changes, HTB class 'class_id' under class 'parent' of 'netdev''s qdisc,
+ * with the given guaranteed and ceiling rates in kbps. */
+static struct ofpbuf *
+tc_make_htb_class(const struct netdev *netdev, unsigned int flags,
+                  uint16_t parent, uint16_t class_id,
+                  unsigned int rate, unsigned int ceil)
+{
+    unsigned int mtu = netdev->mtu > 0 ? netdev->mtu : ETH_PAYLOAD_MAX;
+    struct tc_htb_opt opt;
+    struct ofpbuf *msg;
+    size_t options;
+
+    memset(&opt, 0, sizeof opt);
+    tc_fill_rate(&opt.rate, rate, mtu);
+    tc_fill_rate(&opt.ceil, ceil, mtu);
+    opt.buffer = tc_calc_buffer(opt.rate.rate, mtu);
+    opt.cbuffer = tc_calc_buffer(opt.ceil.rate, mtu);
+
+    msg = tc_make_request(RTM_NEWTCLASS, flags, netdev->ifindex,
+                          TC_H_MAKE(TC_QDISC << 16, class_id),
+                          TC_H_MAKE(TC_QDISC << 16, parent));
+    nl_msg_put_string(msg, TCA_KIND, "htb");
+    options = nl_msg_start_nested(msg, TCA_OPTIONS);
+    nl_msg_put_unspec(msg, TCA_HTB_PARMS, &opt, sizeof opt);
+    tc_put_rtab(msg, TCA_HTB_RTAB, &opt.rate);
+    tc_put_rtab(msg, TCA_HTB_CTAB, &opt.ceil);
+    nl_msg_end_nested(msg, options);
+    return msg;
+}
+
+/* Sends the 'n' requests in 'msgs' to the kernel in a single system call and
+ * waits for their acknowledgements, storing the kernel's verdict on
+ * 'msgs[i]' into 'errors[i]' (0 or a positive errno value).  Frees 'msgs'.
+ * Returns 0 if every verdict was received, otherwise a positive errno
+ * value. */
+static int
+tc_transact(struct ofpbuf *msgs[], int errors[], size_t n)
+{
+    struct iovec iov[TC_MAX_BATCH];
+    size_t n_acked;
+    size_t i;
+    int error;
+
+    assert(n <= TC_MAX_BATCH);
+    for (i = 0; i < n; i++) {
+        nl_msg_nlmsghdr(msgs[i])->nlmsg_len = msgs[i]->size;
+        iov[i].iov_base = msgs[i]->data;
+        iov[i].iov_len = msgs[i]->size;
+        errors[i] = EPROTO;
+    }
+
+    error = nl_sock_sendv(rtnl_sock, iov, n, true);
+    for (n_acked = 0; !error && n_acked < n; ) {
+        struct ofpbuf *reply;
+
+        error = nl_sock_recv(rtnl_sock, &reply, true);
+        if (!error) {
+            uint32_t seq = nl_msg_nlmsghdr(reply)->nlmsg_seq;
+
+            for (i = 0; i < n; i++) {
+                if (nl_msg_nlmsghdr(msgs[i])->nlmsg_seq == seq) {
+                    if (nl_msg_nlmsgerr(reply, &errors[i])) {
+                        n_acked++;
+                    }
+                    break;
+                }
+            }
+            ofpbuf_delete(reply);
+        }
+    }
+
+    for (i = 0; i < n; i++) {
+        ofpbuf_delete(msgs[i]);
+    }
+    return error;
+}
+
+/* Sends the single request 'msg' and returns the kernel's verdict. */
+static int
+tc_transact_one(struct ofpbuf *msg)
+{
+    int reply_error;
+    int error;
+
+    error = tc_transact(&msg, &reply_error, 1);
+    return error ? error : reply_error;
+}
+
 /** Defines a class for the specific queue discipline. A class
  * represents an OpenFlow queue.
  *
@@ -232,7 +529,7 @@ netdev_setup_root_class(const struct netdev *netdev, uint16_t class_id,
  * @param class_id unique identifier for this queue. TC limits this to 16-bits,
  * so we need to keep an internal mapping between class_id and OpenFlow
  * queue_id
- * @param rate the minimum rate for this queue in kbps
+ * @param rate the minimum rate for this queue in .1% of the link speed
  * @return 0 on success, non-zero value when the configuration was not
  * successful.
  */
@@ -240,22 +537,21 @@ int
 netdev_setup_class(const struct netdev *netdev, uint16_t class_id,
                    uint16_t rate)
 {
-    char command[1024];
-    int actual_rate;
-
-    /* we need to translate from .1% to kbps */
-    actual_rate = rate*netdev->speed;
+    int error;
 
-    snprintf(command, sizeof(command), COMMAND_ADD_CLASS, netdev->name,
-             TC_QDISC, TC_ROOT_CLASS, TC_QDISC, class_id, actual_rate,
-             netdev->speed*1000);
-    if (system(command) != 0) {
-        VLOG_ERR("Problem configuring class %d for device %s",class_id,
-                 netdev->name);
-        return -1;
+    error = tc_init();
+    if (!error) {
+        /* we need to translate from .1% to kbps */
+        error = tc_transact_one(
+            tc_make_htb_class(netdev, NLM_F_CREATE | NLM_F_EXCL,
+                              TC_ROOT_CLASS, class_id, rate * netdev->speed,
+                              netdev->speed * 1000));
     }
-
-    return 0;
+    if (error) {
+        VLOG_ERR("Problem configuring class %d for device %s (%s)",
+                 class_id, netdev->name, strerror(error));
+    }
+    return error;
 }
 
 /** Changes a class already defined.
@@ -264,53 +560,53 @@ netdev_setup_class(const struct netdev *netdev, uint16_t class_id,
  * @param class_id unique identifier for this queue. TC limits this to 16-bits,
  * so we need to keep an internal mapping between class_id and OpenFlow
  * queue_id
- * @param rate the minimum rate for this queue in kbps
+ * @param rate the minimum rate for this queue in .1% of the link speed
  * @return 0 on success, non-zero value when the configuration was not
  * successful.
  */
 int
 netdev_change_class(const struct netdev *netdev, uint16_t class_id, uint16_t rate)
 {
-    char command[1024];
-    int actual_rate;
-
-    /* we need to translate from .1% to kbps */
-    actual_rate = rate*netdev->speed;
+    int error;
 
-    snprintf(command, sizeof(command), COMMAND_CHANGE_CLASS, netdev->name,
-             TC_QDISC, TC_ROOT_CLASS, TC_QDISC, class_id, actual_rate,
-             netdev->speed*1000 );
-    if (system(command) != 0) {
-        VLOG_ERR("Problem configuring class %d for device %s",
-                 class_id, netdev->name);
-        return -1;
+    error = tc_init();
+    if (!error) {
+        /* we need to translate from .1% to kbps */
+        error = tc_transact_one(
+            tc_make_htb_class(netdev, 0, TC_ROOT_CLASS, class_id,
+                              rate * netdev->speed, netdev->speed * 1000));
     }
-
-    return 0;
+    if (error) {
+        VLOG_ERR("Problem configuring class %d for device %s (%s)",
+                 class_id, netdev->name, strerror(error));
+    }
+    return error;
 }
 
 /** Deletes a class already defined to represent an OpenFlow queue.
  *
  * @param netdev the device under configuration
  * @param class_id unique identifier for this queue.
- * @param rate the minimum rate for this queue in kbps
  * @return 0 on success, non-zero value when the configuration was not
  * successful.
  */
 int
 netdev_delete_class(const struct netdev *netdev, uint16_t class_id)
 {
-    char command[1024];
+    int error;
 
-    snprintf(command, sizeof(command), COMMAND_DEL_CLASS, netdev->name,
-             TC_QDISC, TC_ROOT_CLASS, TC_QDISC, class_id);
-    if (system(command) != 0) {
-        VLOG_ERR("Problem deleting class %d for device %s",class_id,
-                 netdev->name);
-        return -1;
+    error = tc_init();
+    if (!error) {
+        error = tc_transact_one(
+            tc_make_request(RTM_DELTCLASS, 0, netdev->ifindex,
+                            TC_H_MAKE(TC_QDISC << 16, class_id),
+                            TC_H_MAKE(TC_QDISC << 16, TC_ROOT_CLASS)));
     }
-
-    return 0;
+    if (error) {
+        VLOG_ERR("Problem deleting class %d for device %s (%s)",
+                 class_id, netdev->name, strerror(error));
+    }
+    return error;
 }
 
 static int
@@ -381,47 +677,76 @@ open_queue_socket(const char * name, uint16_t class_id, int * fd)
  * A default queue/class is a queue  where "unclassified" traffic will fall to.
  * The default class has a best-effort behavior.
  *
+ * Any previous queue configuration on the device is removed first.  All of
+ * this goes to the kernel as one batch of rtnetlink requests.
+ *
  * More on Linux Traffic Control and Hierarchical Token Bucket at :
  * http://luxik.cdi.cz/~devik/qos/htb/
  * http://luxik.cdi.cz/~devik/qos/htb/manual/userg.htm
  *
- * @param netdev_name the device to be configured
+ * @param netdev the device to be configured
  * @return 0 on success, non-zero value when the configuration was not
  * successful.
  */
 static int
-do_setup_qdisc(const char *netdev_name)
+do_setup_qdisc(const struct netdev *netdev)
 {
-    char command[1024];
+    struct ofpbuf *msgs[TC_MAX_BATCH];
+    int errors[TC_MAX_BATCH];
+    struct tc_htb_glob glob;
+    struct ofpbuf *msg;
+    size_t options;
+    size_t i;
     int error;
 
-    snprintf(command, sizeof(command), COMMAND_ADD_DEV_QDISC, netdev_name,
-             TC_QDISC, TC_DEFAULT_CLASS);
-    error = system(command);
+    error = tc_init();
     if (error) {
-        VLOG_WARN("Problem configuring qdisc for device %s",netdev_name);
         return error;
     }
-    return 0;
-}
 
-/** Remove current queue disciplines from a net device
- * @param netdev_name the device under configuration
- */
-static int
-do_remove_qdisc(const char *netdev_name)
-{
-    char command[1024];
+    /* There is no need for a device to already be configured, so the result
+     * of removing the old qdisc is ignored. */
+    msgs[0] = tc_make_request(RTM_DELQDISC, 0, netdev->ifindex, 0, TC_H_ROOT);
 
-    snprintf(command, sizeof(command), COMMAND_DEL_DEV_QDISC, netdev_name);
-    system(command);
+    memset(&glob, 0, sizeof glob);
+    glob.version = TC_HTB_PROTOVER;
+    glob.rate2quantum = 10;
+    glob.defcls = TC_DEFAULT_CLASS;
+    msg = tc_make_request(RTM_NEWQDISC, NLM_F_CREATE | NLM_F_EXCL,
+                          netdev->ifindex, TC_H_MAKE(TC_QDISC << 16, 0),
+                          TC_H_ROOT);
+    nl_msg_put_string(msg, TCA_KIND, "htb");
+    options = nl_msg_start_nested(msg, TCA_OPTIONS);
+    nl_msg_put_unspec(msg, TCA_HTB_INIT, &glob, sizeof glob);
+    nl_msg_end_nested(msg, options);
+    msgs[1] = msg;
 
-    /* There is no need for a device to already be configured. Therefore no
-     * need to indicate any error */
-    return 0;
-}
+    /* This define a root class for the queue disc. In order to allow spare
+     * bandwidth to be used efficiently, we need all the classes under a root
+     * class. For details, refer to :
+     * http://luxik.cdi.cz/~devik/qos/htb/ */
+    msgs[2] = tc_make_htb_class(netdev, NLM_F_CREATE | NLM_F_EXCL, 0,
+                                TC_ROOT_CLASS, netdev->speed * 1000,
+                                netdev->speed * 1000);
 
+    /* we configure a default class. This would be the best-effort, getting
+     * everything that remains from the other queues.tc requires a min-rate
+     * to configure a class, we put a min_rate here */
+    msgs[3] = tc_make_htb_class(netdev, NLM_F_CREATE | NLM_F_EXCL,
+                                TC_ROOT_CLASS, TC_DEFAULT_CLASS,
+                                TC_MIN_RATE * netdev->speed,
+                                netdev->speed * 1000);
 
+    error = tc_transact(msgs, errors, 4);
+    for (i = 1; !error && i < 4; i++) {
+        error = errors[i];
+    }
+    if (error) {
+        VLOG_WARN("Problem configuring qdisc for device %s (%s)",
+                  netdev->name, strerror(error));
+    }
+    return error;
+}
 
 /** Configures a port to support slicing
  * @param netdev_name the device under configuration
@@ -436,30 +761,7 @@ netdev_setup_slicing(struct netdev *netdev, uint16_t num_queues)
 
     netdev->num_queues = num_queues;
 
-    /* remove any previous queue configuration for this device */
-    error = do_remove_qdisc(netdev->name);
-    if (error) {
-        return error;
-    }
-
-    /* Configure tc queue discipline to allow slicing queues */
-    error = do_setup_qdisc(netdev->name);
-    if (error) {
-        return error;
-    }
-
-    /* This define a root class for the queue disc. In order to allow spare
-     * bandwidth to be used efficiently, we need all the classes under a root
-     * class. For details, refer to :
-     * http://luxik.cdi.cz/~devik/qos/htb/ */
-    error = netdev_setup_root_class(netdev, TC_ROOT_CLASS,1000);
-    if (error) {
-        return error;
-    }
-    /* we configure a default class. This would be the best-effort, getting
-     * everything that remains from the other queues.tc requires a min-rate
-     * to configure a class, we put a min_rate here */
-    error = netdev_setup_class(netdev,TC_DEFAULT_CLASS,1);
+    error = do_setup_qdisc(netdev);
     if (error) {
         return error;
     }
@@ -634,50 +936,118 @@ netdev_open(const char *name, int ethertype, struct netdev **netdevp)
     }
 }
 
+/* Opens a queue of the TAP device described by 'ifr', with TUNSETIFF flags
+ * 'flags'.  On success, stores the new file descriptor in '*fdp' and the
+ * device's name in 'ifr->ifr_name', and returns 0.  Otherwise returns a
+ * positive errno value. */
+static int
+open_tap_queue(struct ifreq *ifr, int flags, int *fdp)
+{
+    static const char tap_dev[] = "/dev/net/tun";
+    int error;
+    int fd;
+
+    fd = open(tap_dev, O_RDWR);
+    if (fd < 0) {
+        error = errno;
+        ofp_error(error, "opening \"%s\" failed", tap_dev);
+        return error;
+    }
+
+    ifr->ifr_flags = flags;
+    if (ioctl(fd, TUNSETIFF, ifr) < 0) {
+        error = errno;
+        ofp_error(error, "ioctl(TUNSETIFF) on \"%s\" failed", tap_dev);
+        close(fd);
+        return error;
+    }
+
+    error = set_nonblocking(fd);
+    if (error) {
+        ofp_error(error, "set_nonblocking on \"%s\" failed", tap_dev);
+        close(fd);
+        return error;
+    }
+
+    *fdp = fd;
+    return 0;
+}
+
 /* Opens a TAP virtual network device.  If 'name' is a nonnull, non-empty
  * string, attempts to assign that name to the TAP device (failing if the name
  * is already in use); otherwise, a name is automatically assigned.  Returns
  * zero if successful, otherwise a positive errno value.  On success, sets
- * '*netdevp' to the new network device, otherwise to null.  */
+ * '*netdevp' to the new network device, otherwise to null.
+ *
+ * 'name' may end in "/N" to open the device with N queues (at most
+ * NETDEV_MAX_TAP_QUEUES).  The kernel spreads the frames that the host
+ * transmits on the device across the queues, so that a burst from the host
+ * stack does not overflow a single queue, and netdev_recv() reads from all of
+ * them. */
 int
 netdev_open_tap(const char *name, struct netdev **netdevp)
 {
-    static const char tap_dev[] = "/dev/net/tun";
+    struct netdev *netdev;
     struct ifreq ifr;
+    int n_queues = 1;
+    int flags;
     int error;
     int tap_fd;
+    int i;
 
-    tap_fd = open(tap_dev, O_RDWR);
-    if (tap_fd < 0) {
-        ofp_error(errno, "opening \"%s\" failed", tap_dev);
-        return errno;
-    }
+    *netdevp = NULL;
 
     memset(&ifr, 0, sizeof ifr);
-    ifr.ifr_flags = IFF_TAP | IFF_NO_PI;
     if (name) {
-        strncpy(ifr.ifr_name, name, sizeof ifr.ifr_name);
+        const char *slash = strchr(name, '/');
+        size_t len = slash ? slash - name : strlen(name);
+
+        if (slash) {
+            n_queues = atoi(slash + 1);
+            if (n_queues < 1 || n_queues > NETDEV_MAX_TAP_QUEUES) {
+                VLOG_ERR("tap:%s: number of queues must be between 1 and %d",
+                         name, NETDEV_MAX_TAP_QUEUES);
+                return EINVAL;
+            }
+        }
+        memcpy(ifr.ifr_name, name, MIN(len, sizeof ifr.ifr_name - 1));
     }
-    if (ioctl(tap_fd, TUNSETIFF, &ifr) < 0) {
-        int error = errno;
-        ofp_error(error, "ioctl(TUNSETIFF) on \"%s\" failed", tap_dev);
-        close(tap_fd);
-        return error;
+
+    flags = IFF_TAP | IFF_NO_PI;
+    if (n_queues > 1) {
+#ifdef IFF_MULTI_QUEUE
+        flags |= IFF_MULTI_QUEUE;
+#else
+        VLOG_ERR("tap:%s: multiqueue TAP devices are not supported", name);
+        return EOPNOTSUPP;
+#endif
     }
 
-    error = set_nonblocking(tap_fd);
+    error = open_tap_queue(&ifr, flags, &tap_fd);
     if (error) {
-        ofp_error(error, "set_nonblocking on \"%s\" failed", tap_dev);
-        close(tap_fd);
         return error;
     }
 
+    /* do_open_netdev() closes 'tap_fd' on failure. */
     error = do_open_netdev(ifr.ifr_name, NETDEV_ETH_TYPE_NONE, tap_fd,
-                           netdevp);
+                           &netdev);
     if (error) {
-        close(tap_fd);
+        return error;
     }
-    return error;
+
+    /* The first queue created the device and filled in its name in 'ifr', so
+     * the others attach to the same device. */
+    for (i = 1; i < n_queues; i++) {
+        error = open_tap_queue(&ifr, flags, &netdev->rx_fds[i]);
+        if (error) {
+            netdev_close(netdev);
+            return error;
+        }
+        netdev->n_rx_fds++;
+    }
+
+    *netdevp = netdev;
+    return 0;
 }
 
 static int
@@ -685,6 +1055,7 @@ do_open_netdev(const char *name, int ethertype, int tap_fd,
                struct netdev **netdev_)
 {
     int netdev_fd;
+    uint16_t protocol;
     struct sockaddr_ll sll;
     struct ifreq ifr;
     unsigned int ifindex;
@@ -700,11 +1071,11 @@ do_open_netdev(const char *name, int ethertype, int tap_fd,
     *netdev_ = NULL;
 
     /* Create raw socket. */
-    netdev_fd = socket(PF_PACKET, SOCK_RAW,
-                       htons(ethertype == NETDEV_ETH_TYPE_NONE ? 0
-                             : ethertype == NETDEV_ETH_TYPE_ANY ? ETH_P_ALL
-                             : ethertype == NETDEV_ETH_TYPE_802_2 ? ETH_P_802_2
-                             : ethertype));
+    protocol = htons(ethertype == NETDEV_ETH_TYPE_NONE ? 0
+                     : ethertype == NETDEV_ETH_TYPE_ANY ? ETH_P_ALL
+                     : ethertype == NETDEV_ETH_TYPE_802_2 ? ETH_P_802_2
+                     : ethertype);
+    netdev_fd = socket(PF_PACKET, SOCK_RAW, protocol);
     if (netdev_fd < 0) {
         return errno;
     }
@@ -784,10 +1155,18 @@ do_open_netdev(const char *name, int ethertype, int tap_fd,
     netdev->netdev_fd = netdev_fd;
     netdev->tap_fd = tap_fd < 0 ? netdev_fd : tap_fd;
     netdev->queue_fd[0] = netdev->tap_fd;
+    netdev->rx_fds[0] = netdev->tap_fd;
+    netdev->n_rx_fds = 1;
+    netdev->next_rx_fd = 0;
     memcpy(netdev->etheraddr, etheraddr, sizeof etheraddr);
     netdev->mtu = mtu;
     netdev->in6 = in6;
     netdev->num_queues = 0;
+    netdev->tx_ring = NULL;
+    netdev->tx_pending = 0;
+    netdev->rx_ring_fd = -1;
+    netdev->rx_ring = NULL;
+    netdev->protocol = protocol;
 
     /* Get speed, features. */
     do_ethtool(netdev);
@@ -798,6 +1177,7 @@ do_open_netdev(const char *name, int ethertype, int tap_fd,
         goto error_already_set;
     }
     netdev->changed_flags = 0;
+    netdev->stats_time = LLONG_MIN;
     fatal_signal_block();
     list_push_back(&netdev_list, &netdev->node);
     fatal_signal_unblock();
@@ -836,7 +1216,18 @@ netdev_close(struct netdev *netdev)
         }
 
         /* Free. */
+        if (netdev->tx_ring) {
+            munmap(netdev->tx_ring, netdev->tx_ring_size);
+        }
+        if (netdev->rx_ring) {
+            munmap(netdev->rx_ring, netdev->rx_ring_size);
+        }
+        if (netdev->rx_ring_fd >= 0) {
+            poll_fd_closing(netdev->rx_ring_fd);
+            close(netdev->rx_ring_fd);
+        }
         free(netdev->name);
+        poll_fd_closing(netdev->tap_fd);
         close(netdev->netdev_fd);
         if (netdev->netdev_fd != netdev->tap_fd) {
             close(netdev->tap_fd);
@@ -845,6 +1236,10 @@ netdev_close(struct netdev *netdev)
         for (i =1; i <= netdev->num_queues; i++) {
             close(netdev->queue_fd[i]);
         }
+        for (i = 1; i < netdev->n_rx_fds; i++) {
+            poll_fd_closing(netdev->rx_fds[i]);
+            close(netdev->rx_fds[i]);
+        }
         free(netdev);
     }
 }
@@ -859,6 +1254,116 @@ pad_to_minimum_length(struct ofpbuf *buffer)
     }
 }
 
+/* Returns true if 'netdev' is a TAP device that we opened, which we must read
+ * through its character device rather than a packet socket. */
+static bool
+is_tap_netdev(const struct netdev *netdev)
+{
+    return netdev->tap_fd != netdev->netdev_fd;
+}
+
+/* Reads one frame from the queue of TAP device 'netdev' with file descriptor
+ * 'fd' into 'buffer'.  Returns 0 if successful, otherwise a positive errno
+ * value. */
+static int
+recv_tap(struct netdev *netdev, int fd, struct ofpbuf *buffer)
+{
+    ssize_t n_bytes;
+
+    do {
+        n_bytes = read(fd, ofpbuf_tail(buffer), ofpbuf_tailroom(buffer));
+    } while (n_bytes < 0 && errno == EINTR);
+    if (n_bytes < 0) {
+        if (errno != EAGAIN) {
+            VLOG_WARN_RL(&rl, "error receiving Ethernet packet on %s: %s",
+                         netdev->name, strerror(errno));
+        }
+        return errno;
+    }
+
+    buffer->size += n_bytes;
+    pad_to_minimum_length(buffer);
+    return 0;
+}
+
+#ifdef NETDEV_HAVE_RX_RING
+static struct netdev_tpacket_block_desc *
+rx_ring_block(const struct netdev *netdev, unsigned int idx)
+{
+    return (struct netdev_tpacket_block_desc *)
+        (netdev->rx_ring + (size_t) idx * netdev->rx_block_size);
+}
+
+/* Hands 'netdev''s current RX ring block back to the kernel and moves on to
+ * the next one. */
+static void
+release_rx_block(struct netdev *netdev)
+{
+    struct netdev_tpacket_block_desc *bd = rx_ring_block(netdev,
+                                                         netdev->rx_block);
+
+    /* The packets must be copied out before the kernel may reuse the
+     * block. */
+    __sync_synchronize();
+    bd->block_status = NETDEV_TP_STATUS_KERNEL;
+    netdev->rx_block = (netdev->rx_block + 1) % netdev->rx_block_nr;
+    netdev->rx_frames_left = 0;
+}
+
+/* Copies up to 'n_buffers' packets out of 'netdev''s RX ring into 'buffers',
+ * each with the receive hash that the kernel computed for it.  Returns values
+ * as netdev_recv_batch() does. */
+static int
+recv_rx_ring(struct netdev *netdev, struct ofpbuf *buffers[], int n_buffers,
+             int *n_received)
+{
+    int n = 0;
+
+    while (n < n_buffers) {
+        const struct netdev_tpacket3_hdr *hdr;
+        const struct sockaddr_ll *sll;
+
+        if (!netdev->rx_frames_left) {
+            struct netdev_tpacket_block_desc *bd;
+
+            bd = rx_ring_block(netdev, netdev->rx_block);
+            if (!(bd->block_status & NETDEV_TP_STATUS_USER)) {
+                break;
+            }
+            __sync_synchronize();
+            if (!bd->num_pkts) {
+                release_rx_block(netdev);
+                continue;
+            }
+            netdev->rx_frames_left = bd->num_pkts;
+            netdev->rx_frame = (char *) bd + bd->offset_to_first_pkt;
+        }
+
+        hdr = (const struct netdev_tpacket3_hdr *) netdev->rx_frame;
+        sll = (const struct sockaddr_ll *) (netdev->rx_frame
+                                            + NETDEV_RX_SLL_OFFSET);
+
+        /* See netdev_recv() for why outgoing packets show up here. */
+        if (sll->sll_pkttype != PACKET_OUTGOING) {
+            struct ofpbuf *buffer = buffers[n++];
+            size_t len = MIN(hdr->tp_snaplen, ofpbuf_tailroom(buffer));
+
+            assert(buffer->size == 0);
+            ofpbuf_put(buffer, netdev->rx_frame + hdr->tp_mac, len);
+            pad_to_minimum_length(buffer);
+            buffer->rxhash = hdr->tp_rxhash;
+        }
+
+        netdev->rx_frame += hdr->tp_next_offset;
+        if (!--netdev->rx_frames_left) {
+            release_rx_block(netdev);
+        }
+    }
+    *n_received = n;
+    return n ? 0 : EAGAIN;
+}
+#endif
+
 /* Attempts to receive a packet from 'netdev' into 'buffer', which the caller
  * must have initialized with sufficient room for the packet.  The space
  * required to receive any packet is ETH_HEADER_LEN bytes, plus VLAN_HEADER_LEN
@@ -881,24 +1386,41 @@ netdev_recv(struct netdev *netdev, struct ofpbuf *buffer)
     assert(buffer->size == 0);
     assert(ofpbuf_tailroom(buffer) >= ETH_TOTAL_MIN);
 
+#ifdef NETDEV_HAVE_RX_RING
+    if (netdev->rx_ring) {
+        int n_received;
+        return recv_rx_ring(netdev, &buffer, 1, &n_received);
+    }
+#endif
+
+    buffer->rxhash = 0;
+
+    /* cannot execute recvfrom over a tap device */
+    if (is_tap_netdev(netdev)) {
+        int i;
+
+        /* Take turns among the queues, so that a busy one cannot starve the
+         * others. */
+        for (i = 0; i < netdev->n_rx_fds; i++) {
+            int idx = (netdev->next_rx_fd + i) % netdev->n_rx_fds;
+            int error = recv_tap(netdev, netdev->rx_fds[idx], buffer);
+            if (error != EAGAIN) {
+                netdev->next_rx_fd = (idx + 1) % netdev->n_rx_fds;
+                return error;
+            }
+        }
+        return EAGAIN;
+    }
+
     /* prepare to call recvfrom */
     memset(&sll,0,sizeof sll);
     sll_len = sizeof sll;
 
-    /* cannot execute recvfrom over a tap device */
-    if (!strncmp(netdev->name, "tap", 3)) {
-        do {
-            n_bytes = read(netdev->tap_fd, ofpbuf_tail(buffer),
-                           (ssize_t)ofpbuf_tailroom(buffer));
-        } while (n_bytes < 0 && errno == EINTR);
-    }
-    else {
-        do {
-            n_bytes = recvfrom(netdev->tap_fd, ofpbuf_tail(buffer),
-                               (ssize_t)ofpbuf_tailroom(buffer), 0,
-                               (struct sockaddr *)&sll, &sll_len);
-        } while (n_bytes < 0 && errno == EINTR);
-    }
+    do {
+        n_bytes = recvfrom(netdev->tap_fd, ofpbuf_tail(buffer),
+                           (ssize_t)ofpbuf_tailroom(buffer), 0,
+                           (struct sockaddr *)&sll, &sll_len);
+    } while (n_bytes < 0 && errno == EINTR);
     if (n_bytes < 0) {
         if (errno != EAGAIN) {
             VLOG_WARN_RL(&rl, "error receiving Ethernet packet on %s: %s",
@@ -926,24 +1448,457 @@ netdev_recv(struct netdev *netdev, struct ofpbuf *buffer)
     }
 }
 
+#ifdef HAVE_RECVMMSG
+/* Receives up to 'n_buffers' packets from 'netdev' with a single recvmmsg()
+ * call.  Packets that we sent ourselves are dropped and the received ones are
+ * moved to the front of 'buffers'. */
+static int
+netdev_recvmmsg(struct netdev *netdev, struct ofpbuf *buffers[], int n_buffers,
+                int *n_received)
+{
+    struct mmsghdr msgs[NETDEV_RECV_BATCH_MAX];
+    struct iovec iovs[NETDEV_RECV_BATCH_MAX];
+    struct sockaddr_ll slls[NETDEV_RECV_BATCH_MAX];
+    int retval;
+    int i, n;
+
+    memset(msgs, 0, n_buffers * sizeof *msgs);
+    memset(slls, 0, n_buffers * sizeof *slls);
+    for (i = 0; i < n_buffers; i++) {
+        struct ofpbuf *buffer = buffers[i];
+
+        assert(buffer->size == 0);
+        assert(ofpbuf_tailroom(buffer) >= ETH_TOTAL_MIN);
+        buffer->rxhash = 0;
+        iovs[i].iov_base = ofpbuf_tail(buffer);
+        iovs[i].iov_len = ofpbuf_tailroom(buffer);
+        msgs[i].msg_hdr.msg_name = &slls[i];
+        msgs[i].msg_hdr.msg_namelen = sizeof slls[i];
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    do {
+        retval = recvmmsg(netdev->tap_fd, msgs, n_buffers, MSG_DONTWAIT, NULL);
+    } while (retval < 0 && errno == EINTR);
+    if (retval < 0) {
+        if (errno != EAGAIN) {
+            VLOG_WARN_RL(&rl, "error receiving Ethernet packets on %s: %s",
+                         netdev->name, strerror(errno));
+        }
+        return errno;
+    }
+
+    n = 0;
+    for (i = 0; i < retval; i++) {
+        struct ofpbuf *buffer = buffers[i];
+
+        /* See netdev_recv() for why outgoing packets show up here. */
+        if (slls[i].sll_pkttype == PACKET_OUTGOING) {
+            continue;
+        }
+        buffer->size += msgs[i].msg_len;
+        pad_to_minimum_length(buffer);
+        if (i != n) {
+            buffers[i] = buffers[n];
+            buffers[n] = buffer;
+        }
+        n++;
+    }
+    *n_received = n;
+    return n ? 0 : EAGAIN;
+}
+#endif
+
+/* Attempts to receive up to 'n_buffers' packets from 'netdev' into the empty
+ * buffers in 'buffers', which must each have at least ETH_TOTAL_MIN bytes of
+ * tailroom.  'n_buffers' may not exceed NETDEV_RECV_BATCH_MAX.
+ *
+ * On success, returns 0 and stores the number of packets received in
+ * '*n_received'; the packets are in buffers[0] through
+ * buffers[*n_received - 1], which may be reordered relative to the caller's
+ * array.  Otherwise, returns a positive errno value and stores 0 in
+ * '*n_received'.  Returns EAGAIN immediately if no packet is ready to be
+ * returned. */
+int
+netdev_recv_batch(struct netdev *netdev, struct ofpbuf *buffers[],
+                  int n_buffers, int *n_received)
+{
+    int error = 0;
+    int n;
+
+    assert(n_buffers > 0 && n_buffers <= NETDEV_RECV_BATCH_MAX);
+    *n_received = 0;
+
+#ifdef NETDEV_HAVE_RX_RING
+    if (netdev->rx_ring) {
+        return recv_rx_ring(netdev, buffers, n_buffers, n_received);
+    }
+#endif
+
+#ifdef HAVE_RECVMMSG
+    /* Tap devices only support read(), so they take the slow path below. */
+    if (!is_tap_netdev(netdev)) {
+        return netdev_recvmmsg(netdev, buffers, n_buffers, n_received);
+    }
+#endif
+
+    for (n = 0; n < n_buffers; n++) {
+        error = netdev_recv(netdev, buffers[n]);
+        if (error) {
+            break;
+        }
+    }
+    *n_received = n;
+    return n ? 0 : error;
+}
+
+/* Returns the file descriptor on which packets are received from 'netdev',
+ * for code that waits for packets without using the poll loop.  A multiqueue
+ * TAP device has more than one; see netdev_get_rx_fds(). */
+int
+netdev_get_fd(const struct netdev *netdev)
+{
+    return netdev->tap_fd;
+}
+
+/* Stores in '*fdsp' the array of file descriptors on which packets are
+ * received from 'netdev', for code that waits for packets without using the
+ * poll loop, and returns the number of them. */
+int
+netdev_get_rx_fds(const struct netdev *netdev, const int **fdsp)
+{
+    *fdsp = netdev->rx_fds;
+    return netdev->n_rx_fds;
+}
+
 /* Registers with the poll loop to wake up from the next call to poll_block()
  * when a packet is ready to be received with netdev_recv() on 'netdev'. */
 void
 netdev_recv_wait(struct netdev *netdev)
 {
-    poll_fd_wait(netdev->tap_fd, POLLIN);
+    int i;
+
+    for (i = 0; i < netdev->n_rx_fds; i++) {
+        poll_fd_wait(netdev->rx_fds[i], POLLIN);
+    }
 }
 
 /* Discards all packets waiting to be received from 'netdev'. */
 int
 netdev_drain(struct netdev *netdev)
 {
-    if (netdev->tap_fd != netdev->netdev_fd) {
-        drain_fd(netdev->tap_fd, netdev->txqlen);
+    if (is_tap_netdev(netdev)) {
+        int i;
+
+        for (i = 0; i < netdev->n_rx_fds; i++) {
+            drain_fd(netdev->rx_fds[i], netdev->txqlen);
+        }
         return 0;
-    } else {
-        return drain_rcvbuf(netdev->netdev_fd);
     }
+#ifdef NETDEV_HAVE_RX_RING
+    if (netdev->rx_ring) {
+        struct netdev_tpacket_block_desc *bd;
+
+        if (netdev->rx_frames_left) {
+            release_rx_block(netdev);
+        }
+        while ((bd = rx_ring_block(netdev, netdev->rx_block))->block_status
+               & NETDEV_TP_STATUS_USER) {
+            release_rx_block(netdev);
+        }
+        return 0;
+    }
+#endif
+    return drain_rcvbuf(netdev->netdev_fd);
+}
+
+#ifdef PACKET_TX_RING
+static struct netdev_tpacket_hdr *
+tx_ring_frame(const struct netdev *netdev, unsigned int idx)
+{
+    unsigned int block = idx / netdev->tx_frames_per_block;
+    unsigned int frame = idx % netdev->tx_frames_per_block;
+    return (struct netdev_tpacket_hdr *) (netdev->tx_ring
+                                          + block * netdev->tx_block_size
+                                          + frame * netdev->tx_frame_size);
+}
+
+static bool
+tx_ring_frame_busy(const struct netdev_tpacket_hdr *hdr)
+{
+    return (hdr->tp_status & (NETDEV_TP_STATUS_SEND_REQUEST
+                              | NETDEV_TP_STATUS_SENDING)) != 0;
+}
+
+/* Copies 'buffer' into the next free frame of 'netdev''s TX ring.  The frame
+ * is handed to the kernel by the next netdev_send_flush(). */
+static int
+send_tx_ring(struct netdev *netdev, const struct ofpbuf *buffer)
+{
+    struct netdev_tpacket_hdr *hdr;
+
+    if (buffer->size > netdev->tx_frame_size - NETDEV_TX_DATA_OFFSET) {
+        VLOG_WARN_RL(&rl, "packet too big (%zu bytes) for TX ring on %s",
+                     buffer->size, netdev->name);
+        return EMSGSIZE;
+    }
+
+    hdr = tx_ring_frame(netdev, netdev->tx_head);
+    if (tx_ring_frame_busy(hdr)) {
+        /* The ring is full.  Kick the kernel and try once more. */
+        netdev_send_flush(netdev);
+        if (tx_ring_frame_busy(hdr)) {
+            return EAGAIN;
+        }
+    }
+
+    memcpy((char *) hdr + NETDEV_TX_DATA_OFFSET, buffer->data, buffer->size);
+    hdr->tp_len = buffer->size;
+    hdr->tp_status = NETDEV_TP_STATUS_SEND_REQUEST;
+    netdev->tx_head = (netdev->tx_head + 1) % netdev->tx_frame_nr;
+    netdev->tx_pending++;
+    return 0;
+}
+#endif
+
+/* Sets up a memory-mapped transmit ring of at least 'n_frames' frames on the
+ * default queue of 'netdev'.  Afterward, netdev_send() on the default queue
+ * copies packets into the ring instead of making a system call per packet,
+ * and the packets are handed to the kernel together by netdev_send_flush().
+ *
+ * Returns 0 if successful, otherwise a positive errno value.  Returns
+ * EOPNOTSUPP for tap devices and on systems without PACKET_TX_RING. */
+int
+netdev_setup_tx_ring(struct netdev *netdev, unsigned int n_frames)
+{
+#ifdef PACKET_TX_RING
+    struct netdev_tpacket_req req;
+    unsigned int frame_size, block_size;
+    int fd = netdev->queue_fd[0];
+    int loss = 1;
+    void *ring;
+
+    if (is_tap_netdev(netdev)) {
+        return EOPNOTSUPP;
+    }
+    if (netdev->tx_ring) {
+        return 0;
+    }
+
+    /* Each block is a whole number of pages holding a whole number of
+     * frames, and each frame holds the largest packet we may transmit. */
+    frame_size = ROUND_UP(NETDEV_TX_DATA_OFFSET + VLAN_ETH_HEADER_LEN
+                          + netdev->mtu, 16);
+    block_size = ROUND_UP(frame_size, getpagesize());
+    req.tp_block_size = block_size;
+    req.tp_frame_size = frame_size;
+    req.tp_block_nr = (MAX(n_frames, 1) + block_size / frame_size - 1)
+                      / (block_size / frame_size);
+    req.tp_frame_nr = req.tp_block_nr * (block_size / frame_size);
+
+    /* Skip malformed frames instead of stalling the ring on them. */
+    if (setsockopt(fd, SOL_PACKET, PACKET_LOSS, &loss, sizeof loss) < 0) {
+        VLOG_WARN("setsockopt(PACKET_LOSS) on %s failed: %s",
+                  netdev->name, strerror(errno));
+        return errno;
+    }
+    if (setsockopt(fd, SOL_PACKET, PACKET_TX_RING, &req, sizeof req) < 0) {
+        VLOG_WARN("setsockopt(PACKET_TX_RING) on %s failed: %s",
+                  netdev->name, strerror(errno));
+        return errno;
+    }
+    ring = mmap(NULL, (size_t) block_size * req.tp_block_nr,
+                PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (ring == MAP_FAILED) {
+        int error = errno;
+        VLOG_WARN("mmap of TX ring on %s failed: %s",
+                  netdev->name, strerror(error));
+        memset(&req, 0, sizeof req);
+        setsockopt(fd, SOL_PACKET, PACKET_TX_RING, &req, sizeof req);
+        return error;
+    }
+
+    netdev->tx_ring = ring;
+    netdev->tx_ring_size = (size_t) block_size * req.tp_block_nr;
+    netdev->tx_block_size = block_size;
+    netdev->tx_frame_size = frame_size;
+    netdev->tx_frames_per_block = block_size / frame_size;
+    netdev->tx_frame_nr = req.tp_frame_nr;
+    netdev->tx_head = 0;
+    netdev->tx_pending = 0;
+    VLOG_INFO("%s: using %u-frame TX ring", netdev->name, req.tp_frame_nr);
+    return 0;
+#else
+    return EOPNOTSUPP;
+#endif
+}
+
+/* Sets up a memory-mapped receive ring of at least 'n_frames' frames for
+ * 'netdev'.  Afterward, netdev_recv() and netdev_recv_batch() copy packets
+ * out of the ring instead of making a system call each, and give each packet
+ * the flow hash that the kernel or the NIC computed for it in its 'rxhash'.
+ * Under light load the ring adds up to NETDEV_RX_BLOCK_TOV ms of latency.
+ *
+ * Returns 0 if successful, otherwise a positive errno value.  Returns
+ * EOPNOTSUPP for tap devices and on systems without TPACKET_V3 rings. */
+int
+netdev_setup_rx_ring(struct netdev *netdev, unsigned int n_frames)
+{
+#ifdef NETDEV_HAVE_RX_RING
+    static const struct sock_filter drop_all = BPF_STMT(BPF_RET | BPF_K, 0);
+    const struct sock_fprog prog = { 1, (struct sock_filter *) &drop_all };
+    struct netdev_tpacket_req3 req;
+    unsigned int frame_size, block_size, frames_per_block;
+    int version = NETDEV_TPACKET_V3;
+    struct sockaddr_ll sll;
+    void *ring;
+    int error;
+    int fd;
+
+    if (is_tap_netdev(netdev)) {
+        return EOPNOTSUPP;
+    }
+    if (netdev->rx_ring) {
+        return 0;
+    }
+
+    /* Bind only after the ring is set up, so that no packet can be queued
+     * on the socket itself. */
+    fd = socket(PF_PACKET, SOCK_RAW, 0);
+    if (fd < 0) {
+        return errno;
+    }
+    error = set_nonblocking(fd);
+    if (error) {
+        goto error_already_set;
+    }
+    if (setsockopt(fd, SOL_PACKET, PACKET_VERSION, &version,
+                   sizeof version) < 0) {
+        VLOG_WARN("setsockopt(PACKET_VERSION) on %s failed: %s",
+                  netdev->name, strerror(errno));
+        goto error;
+    }
+
+    /* Blocks hold whole pages and, as for the TX ring, each frame is sized
+     * for the largest packet, although V3 packs frames more tightly. */
+    frame_size = ROUND_UP(NETDEV_RX_SLL_OFFSET + sizeof(struct sockaddr_ll)
+                          + VLAN_ETH_HEADER_LEN + netdev->mtu, 16);
+    block_size = ROUND_UP(frame_size * 16, getpagesize());
+    frames_per_block = block_size / frame_size;
+    memset(&req, 0, sizeof req);
+    req.tp_block_size = block_size;
+    req.tp_frame_size = frame_size;
+    req.tp_block_nr = ((MAX(n_frames, 1) + frames_per_block - 1)
+                       / frames_per_block);
+    req.tp_frame_nr = req.tp_block_nr * frames_per_block;
+    req.tp_retire_blk_tov = NETDEV_RX_BLOCK_TOV;
+    req.tp_feature_req_word = NETDEV_TP_FT_REQ_FILL_RXHASH;
+    if (setsockopt(fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof req) < 0) {
+        VLOG_WARN("setsockopt(PACKET_RX_RING) on %s failed: %s",
+                  netdev->name, strerror(errno));
+        goto error;
+    }
+    ring = mmap(NULL, (size_t) block_size * req.tp_block_nr,
+                PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (ring == MAP_FAILED) {
+        VLOG_WARN("mmap of RX ring on %s failed: %s",
+                  netdev->name, strerror(errno));
+        goto error;
+    }
+
+    memset(&sll, 0, sizeof sll);
+    sll.sll_family = AF_PACKET;
+    sll.sll_protocol = netdev->protocol;
+    sll.sll_ifindex = netdev->ifindex;
+    if (bind(fd, (struct sockaddr *) &sll, sizeof sll) < 0) {
+        VLOG_WARN("bind of RX ring socket to %s failed: %s",
+                  netdev->name, strerror(errno));
+        munmap(ring, (size_t) block_size * req.tp_block_nr);
+        goto error;
+    }
+
+    /* Stop receiving on the original socket, which stays in use for
+     * transmitting. */
+    if (setsockopt(netdev->netdev_fd, SOL_SOCKET, SO_ATTACH_FILTER, &prog,
+                   sizeof prog) < 0) {
+        VLOG_WARN("setsockopt(SO_ATTACH_FILTER) on %s failed: %s",
+                  netdev->name, strerror(errno));
+        munmap(ring, (size_t) block_size * req.tp_block_nr);
+        goto error;
+    }
+    drain_rcvbuf(netdev->netdev_fd);
+
+    poll_fd_closing(netdev->rx_fds[0]);
+    netdev->rx_ring_fd = fd;
+    netdev->rx_fds[0] = fd;
+    netdev->rx_ring = ring;
+    netdev->rx_ring_size = (size_t) block_size * req.tp_block_nr;
+    netdev->rx_block_size = block_size;
+    netdev->rx_block_nr = req.tp_block_nr;
+    netdev->rx_block = 0;
+    netdev->rx_frames_left = 0;
+    VLOG_INFO("%s: using %u-frame RX ring", netdev->name, req.tp_frame_nr);
+    return 0;
+
+error:
+    error = errno;
+error_already_set:
+    close(fd);
+    return error;
+#else
+    return EOPNOTSUPP;
+#endif
+}
+
+/* Asks the kernel to busy-poll the device driver's receive queue for up to
+ * 'usecs' microseconds when a receive on 'netdev' finds no packet waiting,
+ * instead of returning at once.  This trades CPU time for lower latency, so
+ * it only makes sense for a caller that polls 'netdev' in a tight loop.
+ * A 'usecs' of 0 disables busy polling.
+ *
+ * Returns 0 if successful, otherwise a positive errno value.  Returns
+ * EOPNOTSUPP for tap devices and on systems without SO_BUSY_POLL. */
+int
+netdev_set_busy_poll(struct netdev *netdev, unsigned int usecs)
+{
+#ifdef SO_BUSY_POLL
+    int value = usecs;
+
+    if (is_tap_netdev(netdev)) {
+        return EOPNOTSUPP;
+    }
+    if (setsockopt(netdev->rx_fds[0], SOL_SOCKET, SO_BUSY_POLL,
+                   &value, sizeof value) < 0) {
+        VLOG_WARN("setsockopt(SO_BUSY_POLL) on %s failed: %s",
+                  netdev->name, strerror(errno));
+        return errno;
+    }
+    return 0;
+#else
+    return EOPNOTSUPP;
+#endif
+}
+
+/* Hands any packets queued in 'netdev''s TX ring by netdev_send() to the
+ * kernel for transmission.  Does nothing if 'netdev' has no TX ring.
+ *
+ * Returns 0 if successful, otherwise a positive errno value. */
+int
+netdev_send_flush(struct netdev *netdev)
+{
+#ifdef PACKET_TX_RING
+    if (netdev->tx_ring && netdev->tx_pending) {
+        netdev->tx_pending = 0;
+        if (send(netdev->queue_fd[0], NULL, 0, MSG_DONTWAIT) < 0
+            && errno != EAGAIN && errno != ENOBUFS) {
+            VLOG_WARN_RL(&rl, "error flushing TX ring on %s: %s",
+                         netdev->name, strerror(errno));
+            return errno;
+        }
+    }
+#endif
+    return 0;
 }
 
 /* Sends 'buffer' on 'netdev'.  Returns 0 if successful, otherwise a positive
@@ -967,6 +1922,12 @@ netdev_send(struct netdev *netdev, const struct ofpbuf *buffer,
 
     assert(class_id <= NETDEV_MAX_QUEUES);
 
+#ifdef PACKET_TX_RING
+    if (netdev->tx_ring && class_id == 0) {
+        return send_tx_ring(netdev, buffer);
+    }
+#endif
+
     do {
         n_bytes = write(netdev->queue_fd[class_id], buffer->data, buffer->size);
     } while (n_bytes < 0 && errno == EINTR);
@@ -1002,7 +1963,7 @@ netdev_send(struct netdev *netdev, const struct ofpbuf *buffer,
 void
 netdev_send_wait(struct netdev *netdev)
 {
-    if (netdev->tap_fd == netdev->netdev_fd) {
+    if (!is_tap_netdev(netdev)) {
         poll_fd_wait(netdev->tap_fd, POLLOUT);
     } else {
         /* TAP device always accepts packets.*/
@@ -1055,6 +2016,168 @@ netdev_get_mtu(const struct netdev *netdev)
     return netdev->mtu;
 }
 
+/* Returns the link speed of 'netdev' in Mbps, or 1000 if it is unknown, as
+ * for TAP devices. */
+int
+netdev_get_speed(const struct netdev *netdev)
+{
+    return (netdev->speed > 0 && netdev->speed <= 100000
+            ? netdev->speed : SPEED_1000);
+}
+
+/* Kernel counters older than this, in milliseconds, are fetched again. */
+#define NETDEV_STATS_MAX_AGE 1000
+
+/* rtnetlink socket for RTM_GETLINK dumps, created on first use. */
+static struct nl_sock *stats_sock;
+
+#if HAVE_DECL_IFLA_STATS64
+#define NETDEV_IFLA_STATS IFLA_STATS64
+typedef struct rtnl_link_stats64 netdev_link_stats;
+#else
+#define NETDEV_IFLA_STATS IFLA_STATS
+typedef struct rtnl_link_stats netdev_link_stats;
+#endif
+
+/* Copies the counters in 'ifi', an RTM_NEWLINK message, into the open
+ * network device with the same ifindex, if there is one. */
+static void
+netdev_parse_link_stats(struct ofpbuf *ifi, long long int now)
+{
+    static const struct nl_policy policy[] = {
+        [NETDEV_IFLA_STATS] = { .type = NL_A_UNSPEC,
+                                .min_len = sizeof(netdev_link_stats) },
+    };
+    struct nlattr *attrs[ARRAY_SIZE(policy)];
+    const struct ifinfomsg *ifinfo;
+    const netdev_link_stats *ls;
+    struct netdev *netdev;
+
+    ifinfo = ofpbuf_at(ifi, NLMSG_HDRLEN, sizeof *ifinfo);
+    if (!ifinfo || !nl_policy_parse(ifi, NLMSG_HDRLEN + sizeof *ifinfo,
+                                    policy, attrs, ARRAY_SIZE(policy))) {
+        return;
+    }
+    ls = nl_attr_get(attrs[NETDEV_IFLA_STATS]);
+
+    LIST_FOR_EACH (netdev, struct netdev, node, &netdev_list) {
+        struct netdev_stats *s = &netdev->stats;
+
+        if (netdev->ifindex != ifinfo->ifi_index) {
+            continue;
+        }
+        s->rx_packets = ls->rx_packets;
+        s->tx_packets = ls->tx_packets;
+        s->rx_bytes = ls->rx_bytes;
+        s->tx_bytes = ls->tx_bytes;
+        s->rx_errors = ls->rx_errors;
+        s->tx_errors = ls->tx_errors;
+        s->rx_dropped = ls->rx_dropped + ls->rx_missed_errors;
+        s->tx_dropped = ls->tx_dropped;
+        s->rx_frame_errors = ls->rx_frame_errors;
+        s->rx_over_errors = ls->rx_over_errors;
+        s->rx_crc_errors = ls->rx_crc_errors;
+        s->collisions = ls->collisions;
+        netdev->stats_time = now;
+    }
+}
+
+/* Fetches the kernel counters of every network device with a single
+ * RTM_GETLINK dump and caches them in each open netdev. */
+static int
+netdev_refresh_stats(long long int now)
+{
+    struct ifinfomsg *ifinfo;
+    struct ofpbuf request;
+    bool done;
+    int error;
+
+    if (!stats_sock) {
+        error = nl_sock_create(NETLINK_ROUTE, 0, 0, 0, &stats_sock);
+        if (error) {
+            VLOG_WARN_RL(&rl, "could not create rtnetlink socket: %s",
+                         strerror(error));
+            return error;
+        }
+    }
+
+    ofpbuf_init(&request, 0);
+    nl_msg_put_nlmsghdr(&request, stats_sock, sizeof *ifinfo, RTM_GETLINK,
+                        NLM_F_REQUEST | NLM_F_DUMP);
+    ifinfo = ofpbuf_put_zeros(&request, sizeof *ifinfo);
+    ifinfo->ifi_family = AF_UNSPEC;
+    error = nl_sock_send(stats_sock, &request, true);
+    ofpbuf_uninit(&request);
+    if (error) {
+        VLOG_WARN_RL(&rl, "RTM_GETLINK request failed: %s", strerror(error));
+        return error;
+    }
+
+    /* Each datagram of the reply holds as many RTM_NEWLINK messages as fit,
+     * and the last one ends with NLMSG_DONE. */
+    for (done = false; !done; ) {
+        struct ofpbuf *reply;
+        struct ofpbuf msgs;
+
+        error = nl_sock_recv(stats_sock, &reply, true);
+        if (error) {
+            VLOG_WARN_RL(&rl, "RTM_GETLINK reply failed: %s",
+                         strerror(error));
+            return error;
+        }
+        msgs = *reply;
+        while (msgs.size >= NLMSG_HDRLEN) {
+            struct nlmsghdr *nlmsg = msgs.data;
+            struct ofpbuf msg;
+
+            if (nlmsg->nlmsg_len < NLMSG_HDRLEN
+                || nlmsg->nlmsg_len > msgs.size) {
+                break;
+            }
+            if (nlmsg->nlmsg_type == NLMSG_DONE
+                || nlmsg->nlmsg_type == NLMSG_ERROR) {
+                done = true;
+                break;
+            }
+            if (nlmsg->nlmsg_type == RTM_NEWLINK) {
+                ofpbuf_use(&msg, nlmsg, nlmsg->nlmsg_len);
+                msg.size = nlmsg->nlmsg_len;
+                netdev_parse_link_stats(&msg, now);
+            }
+            ofpbuf_pull(&msgs, MIN(NLMSG_ALIGN(nlmsg->nlmsg_len), msgs.size));
+        }
+        if (!(nl_msg_nlmsghdr(reply)->nlmsg_flags & NLM_F_MULTI)) {
+            done = true;
+        }
+        ofpbuf_delete(reply);
+    }
+    return 0;
+}
+
+/* Stores the kernel's counters for 'netdev' in '*stats'.  The counters for
+ * all open network devices are fetched together and cached for up to
+ * NETDEV_STATS_MAX_AGE ms, so that a port stats reply that covers every port
+ * costs one round trip to the kernel.  Returns 0 if successful, otherwise a
+ * positive errno value. */
+int
+netdev_get_stats(const struct netdev *netdev, struct netdev_stats *stats)
+{
+    long long int now = time_msec();
+
+    if (now >= netdev->stats_time + NETDEV_STATS_MAX_AGE) {
+        int error = netdev_refresh_stats(now);
+        if (error) {
+            return error;
+        }
+        if (now > netdev->stats_time) {
+            /* The kernel did not report this device. */
+            return ENODEV;
+        }
+    }
+    *stats = netdev->stats;
+    return 0;
+}
+
 /* Returns the features supported by 'netdev' of type 'type', as a bitmap
  * of bits from enum ofp_phy_features, in host byte order. */
 uint32_t
@@ -70,21 +70,53 @@ enum netdev_pseudo_ethertype {
 
 #define NETDEV_MAX_QUEUES 8
 
+/* Maximum number of queues for a multiqueue TAP device. */
+#define NETDEV_MAX_TAP_QUEUES 16
+
+/* Maximum number of packets that netdev_recv_batch() accepts at once. */
+#define NETDEV_RECV_BATCH_MAX 64
+
 struct netdev;
 
+/* Counters that the kernel keeps for a network device. */
+struct netdev_stats {
+    uint64_t rx_packets;
+    uint64_t tx_packets;
+    uint64_t rx_bytes;
+    uint64_t tx_bytes;
+    uint64_t rx_errors;
+    uint64_t tx_errors;
+    uint64_t rx_dropped;        /* Includes packets missed by the NIC. */
+    uint64_t tx_dropped;
+    uint64_t rx_frame_errors;
+    uint64_t rx_over_errors;
+    uint64_t rx_crc_errors;
+    uint64_t collisions;
+};
+
 int netdev_open(const char *name, int ethertype, struct netdev **);
 int netdev_open_tap(const char *name, struct netdev **);
 void netdev_close(struct netdev *);
 
 int netdev_recv(struct netdev *, struct ofpbuf *);
+int netdev_recv_batch(struct netdev *, struct ofpbuf *[], int n_buffers,
+                      int *n_received);
 void netdev_recv_wait(struct netdev *);
+int netdev_get_fd(const struct netdev *);
+int netdev_get_rx_fds(const struct netdev *, const int **fdsp);
 int netdev_drain(struct netdev *);
 int netdev_send(struct netdev *, const struct ofpbuf *, uint16_t class_id);
 void netdev_send_wait(struct netdev *);
+int netdev_setup_tx_ring(struct netdev *, unsigned int n_frames);
+int netdev_setup_rx_ring(struct netdev *, unsigned int n_frames);
+int netdev_set_busy_poll(struct netdev *, unsigned int usecs);
+int netdev_send_flush(struct netdev *);
 int netdev_set_etheraddr(struct netdev *, const uint8_t mac[6]);
 const uint8_t *netdev_get_etheraddr(const struct netdev *);
 const char *netdev_get_name(const struct netdev *);
 int netdev_get_mtu(const struct netdev *);
+int netdev_get_speed(const struct netdev *);
+int netdev_get_stats(const struct netdev *, struct netdev_stats *);
 uint32_t netdev_get_features(struct netdev *, int);
 bool netdev_get_in4(const struct netdev *, struct in_addr *);
 int netdev_set_in4(struct netdev *, struct in_addr addr, struct in_addr mask);
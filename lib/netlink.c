@@ -36,9 +36,11 @@
 #include <assert.h>
 #include <errno.h>
 #include <inttypes.h>
+#include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/socket.h>
 #include <time.h>
 #include <unistd.h>
 #include "dynamic-string.h"
@@ -70,8 +72,22 @@ struct nl_sock
 {
     int fd;
     uint32_t pid;
+
+    /* Batched receive, enabled by nl_sock_set_recv_batch().  'rx_n'
+     * datagrams were received into 'rx_msgs' by the last recvmmsg(), of which
+     * those starting at 'rx_head' have not yet been passed to the caller. */
+    size_t rx_batch;            /* Most datagrams per recvmmsg(), 0 if off. */
+    uint8_t *rx_buffers;        /* 'rx_batch' buffers of NL_RX_BUFSIZE. */
+    struct iovec *rx_iovs;
+    void *rx_msgs;              /* Array of 'rx_batch' struct mmsghdr. */
+    size_t rx_head, rx_n;
 };
 
+/* Size of each of the buffers used for batched receive.  This is large enough
+ * for any Generic Netlink message that carries an OpenFlow message, since an
+ * attribute can be no more than 64 kB long. */
+#define NL_RX_BUFSIZE (65536 + 1024)
+
 /* Next nlmsghdr sequence number.
  * 
  * This implementation uses sequence numbers that are unique process-wide, to
@@ -110,7 +126,7 @@ nl_sock_create(int protocol, int multicast_group,
     }
 
     *sockp = NULL;
-    sock = malloc(sizeof *sock);
+    sock = calloc(1, sizeof *sock);
     if (sock == NULL) {
         return ENOMEM;
     }
@@ -133,7 +149,15 @@ nl_sock_create(int protocol, int multicast_group,
         goto error_free_pid;
     }
 
+    /* SO_RCVBUF is silently capped at net.core.rmem_max, which is usually
+     * much smaller than we would like, so try SO_RCVBUFFORCE first.  It only
+     * works with CAP_NET_ADMIN, which we usually have when talking to the
+     * kernel datapath. */
     if (so_rcvbuf != 0
+#ifdef SO_RCVBUFFORCE
+        && setsockopt(sock->fd, SOL_SOCKET, SO_RCVBUFFORCE,
+                      &so_rcvbuf, sizeof so_rcvbuf) < 0
+#endif
         && setsockopt(sock->fd, SOL_SOCKET, SO_RCVBUF,
                       &so_rcvbuf, sizeof so_rcvbuf) < 0) {
         VLOG_ERR("setsockopt(SO_RCVBUF,%zu): %s", so_rcvbuf, strerror(errno));
@@ -204,12 +228,55 @@ void
 nl_sock_destroy(struct nl_sock *sock) 
 {
     if (sock) {
+        poll_fd_closing(sock->fd);
         close(sock->fd);
         free_pid(sock->pid);
+        free(sock->rx_buffers);
+        free(sock->rx_iovs);
+        free(sock->rx_msgs);
         free(sock);
     }
 }
 
+/* Returns the Netlink pid that the kernel uses to address 'sock'. */
+uint32_t
+nl_sock_pid(const struct nl_sock *sock)
+{
+    return sock->pid;
+}
+
+/* Makes nl_sock_recv() on 'sock' receive up to 'n' datagrams from the kernel
+ * at a time, then return them one by one, which saves a pair of system calls
+ * for all but the first.  This is worthwhile for sockets that receive a lot of
+ * unsolicited messages, such as multicast subscriptions, but it costs about
+ * 64 kB of memory per datagram.  Does nothing if the system does not support
+ * receiving datagrams in batches. */
+void
+nl_sock_set_recv_batch(struct nl_sock *sock, size_t n)
+{
+#if defined(HAVE_RECVMMSG) && defined(MSG_WAITFORONE)
+    struct mmsghdr *msgs;
+    size_t i;
+
+    if (sock->rx_batch || n < 2) {
+        return;
+    }
+    sock->rx_batch = n;
+    sock->rx_buffers = xmalloc(n * NL_RX_BUFSIZE);
+    sock->rx_iovs = xmalloc(n * sizeof *sock->rx_iovs);
+    sock->rx_msgs = msgs = xcalloc(n, sizeof *msgs);
+    for (i = 0; i < n; i++) {
+        sock->rx_iovs[i].iov_base = &sock->rx_buffers[i * NL_RX_BUFSIZE];
+        sock->rx_iovs[i].iov_len = NL_RX_BUFSIZE;
+        msgs[i].msg_hdr.msg_iov = &sock->rx_iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+#else
+    (void) sock;
+    (void) n;
+#endif
+}
+
 /* Tries to send 'msg', which must contain a Netlink message, to the kernel on
  * 'sock'.  nlmsg_len in 'msg' will be finalized to match msg->size before the
  * message is sent.
@@ -268,6 +335,45 @@ nl_sock_sendv(struct nl_sock *sock, const struct iovec iov[], size_t n_iov,
  *
  * If 'wait' is true, nl_sock_recv waits for a message to be ready; otherwise,
  * returns EAGAIN if the 'sock' receive buffer is empty. */
+#if defined(HAVE_RECVMMSG) && defined(MSG_WAITFORONE)
+static int
+nl_sock_recv_batched(struct nl_sock *sock, struct ofpbuf **bufp, bool wait)
+{
+    struct mmsghdr *msgs = sock->rx_msgs;
+    struct nlmsghdr *nlmsghdr;
+    struct mmsghdr *m;
+
+    *bufp = NULL;
+    if (sock->rx_head >= sock->rx_n) {
+        int retval;
+
+        do {
+            retval = recvmmsg(sock->fd, msgs, sock->rx_batch,
+                              wait ? MSG_WAITFORONE : MSG_DONTWAIT, NULL);
+        } while (retval < 0 && errno == EINTR);
+        if (retval < 0) {
+            /* ENOBUFS here means that the kernel dropped a message for us. */
+            return errno;
+        }
+        sock->rx_head = 0;
+        sock->rx_n = retval;
+    }
+
+    m = &msgs[sock->rx_head++];
+    nlmsghdr = m->msg_hdr.msg_iov->iov_base;
+    if (m->msg_hdr.msg_flags & MSG_TRUNC
+        || m->msg_len < sizeof *nlmsghdr
+        || nlmsghdr->nlmsg_len < sizeof *nlmsghdr
+        || nlmsghdr->nlmsg_len > m->msg_len) {
+        VLOG_ERR_RL(&rl, "received invalid nlmsg (%u bytes)", m->msg_len);
+        return EPROTO;
+    }
+    *bufp = ofpbuf_clone_data(nlmsghdr, m->msg_len);
+    log_nlmsg("nl_sock_recv", 0, (*bufp)->data, (*bufp)->size);
+    return 0;
+}
+#endif
+
 int
 nl_sock_recv(struct nl_sock *sock, struct ofpbuf **bufp, bool wait) 
 {
@@ -287,6 +393,12 @@ nl_sock_recv(struct nl_sock *sock, struct ofpbuf **bufp, bool wait)
         .msg_flags = 0
     };
 
+#if defined(HAVE_RECVMMSG) && defined(MSG_WAITFORONE)
+    if (sock->rx_batch) {
+        return nl_sock_recv_batched(sock, bufp, wait);
+    }
+#endif
+
     buf = ofpbuf_new(bufsize);
     *bufp = NULL;
 
@@ -431,6 +543,9 @@ recv:
 void
 nl_sock_wait(const struct nl_sock *sock, short int events)
 {
+    if (events & POLLIN && sock->rx_head < sock->rx_n) {
+        poll_immediate_wake();
+    }
     poll_fd_wait(sock->fd, events);
 }
 
@@ -655,6 +770,27 @@ nl_msg_put_string(struct ofpbuf *msg, uint16_t type, const char *value)
     nl_msg_put_unspec(msg, type, value, strlen(value) + 1);
 }
 
+/* Starts a Netlink attribute of the given 'type' in 'msg' that nests the
+ * attributes appended to 'msg' until the matching nl_msg_end_nested().
+ * Returns the offset to pass to nl_msg_end_nested(). */
+size_t
+nl_msg_start_nested(struct ofpbuf *msg, uint16_t type)
+{
+    size_t offset = msg->size;
+    nl_msg_put_unspec_uninit(msg, type, 0);
+    return offset;
+}
+
+/* Finishes the nested attribute that nl_msg_start_nested() started at
+ * 'offset' in 'msg', by setting its length to cover everything appended
+ * since. */
+void
+nl_msg_end_nested(struct ofpbuf *msg, size_t offset)
+{
+    struct nlattr *attr = ofpbuf_at_assert(msg, offset, sizeof *attr);
+    attr->nla_len = msg->size - offset;
+}
+
 /* Appends a Netlink attribute of the given 'type' and the given buffered
  * netlink message in 'nested_msg' to 'msg'.  The nlmsg_len field in
  * 'nested_msg' is finalized to match 'nested_msg->size'. */
@@ -57,6 +57,8 @@ int nl_sock_create(int protocol, int multicast_group,
                    size_t so_sndbuf, size_t so_rcvbuf,
                    struct nl_sock **);
 void nl_sock_destroy(struct nl_sock *);
+void nl_sock_set_recv_batch(struct nl_sock *, size_t n);
+uint32_t nl_sock_pid(const struct nl_sock *);
 
 int nl_sock_send(struct nl_sock *, const struct ofpbuf *, bool wait);
 int nl_sock_sendv(struct nl_sock *sock, const struct iovec iov[], size_t n_iov,
@@ -95,6 +97,8 @@ void nl_msg_put_u32(struct ofpbuf *, uint16_t type, uint32_t value);
 void nl_msg_put_u64(struct ofpbuf *, uint16_t type, uint64_t value);
 void nl_msg_put_string(struct ofpbuf *, uint16_t type, const char *value);
 void nl_msg_put_nested(struct ofpbuf *, uint16_t type, struct ofpbuf *);
+size_t nl_msg_start_nested(struct ofpbuf *, uint16_t type);
+void nl_msg_end_nested(struct ofpbuf *, size_t offset);
 
 /* Netlink attribute types. */
 enum nl_attr_type
@@ -0,0 +1,538 @@
+/* Copyright (c) 2008 The Board of Trustees of The Leland Stanford
+ * Junior University
+ * 
+ * We are making the OpenFlow specification and associated documentation
+ * (Software) available for public use and benefit with the expectation
+ * that others will use, modify and enhance the Software and contribute
+ * those enhancements back to the community. However, since we would
+ * like to make the Software available for broadest use, with as few
+ * restrictions as possible permission is hereby granted, free of
+ * charge, to any person obtaining a copy of this Software to deal in
+ * the Software under the copyrights without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ * The name and trademarks of copyright holder(s) may NOT be used in
+ * advertising or publicity pertaining to the Software or any
+ * derivatives without specific, written prior permission.
+ */
+
+#include <config.h>
+#include "ofp-parse.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <netinet/in.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ofpbuf.h"
+#include "openflow/openflow.h"
+#include "openflow/openflow-ext.h"
+#include "packets.h"
+#include "socket-util.h"
+#include "util.h"
+#include "vconn.h"
+#include "xtoxll.h"
+
+#define DEFAULT_IDLE_TIMEOUT 60
+
+/* Parses 'str' as a decimal, octal, or hexadecimal number and returns its
+ * value.  Exits with an error message if 'str' is not a valid number. */
+uint32_t
+str_to_u32(const char *str)
+{
+    char *tail;
+    uint32_t value;
+
+    errno = 0;
+    value = strtoul(str, &tail, 0);
+    if (errno == EINVAL || errno == ERANGE || *tail) {
+        ofp_fatal(0, "invalid numeric format %s", str);
+    }
+    return value;
+}
+
+static void
+str_to_mac(const char *str, uint8_t mac[6]) 
+{
+    if (sscanf(str, "%"SCNx8":%"SCNx8":%"SCNx8":%"SCNx8":%"SCNx8":%"SCNx8,
+               &mac[0], &mac[1], &mac[2], &mac[3], &mac[4], &mac[5]) != 6) {
+        ofp_fatal(0, "invalid mac address %s", str);
+    }
+}
+
+static uint32_t
+str_to_ip(const char *str_, uint32_t *ip)
+{
+    char *str = xstrdup(str_);
+    char *save_ptr = NULL;
+    const char *name, *netmask;
+    struct in_addr in_addr;
+    int n_wild, retval;
+
+    name = strtok_r(str, "//", &save_ptr);
+    retval = name ? lookup_ip(name, &in_addr) : EINVAL;
+    if (retval) {
+        ofp_fatal(0, "%s: could not convert to IP address", str);
+    }
+    *ip = in_addr.s_addr;
+
+    netmask = strtok_r(NULL, "//", &save_ptr);
+    if (netmask) {
+        uint8_t o[4];
+        if (sscanf(netmask, "%"SCNu8".%"SCNu8".%"SCNu8".%"SCNu8,
+                   &o[0], &o[1], &o[2], &o[3]) == 4) {
+            uint32_t nm = (o[0] << 24) | (o[1] << 16) | (o[2] << 8) | o[3];
+            int i;
+
+            /* Find first 1-bit. */
+            for (i = 0; i < 32; i++) {
+                if (nm & (1u << i)) {
+                    break;
+                }
+            }
+            n_wild = i;
+
+            /* Verify that the rest of the bits are 1-bits. */
+            for (; i < 32; i++) {
+                if (!(nm & (1u << i))) {
+                    ofp_fatal(0, "%s: %s is not a valid netmask",
+                              str, netmask);
+                }
+            }
+        } else {
+            int prefix = atoi(netmask);
+            if (prefix <= 0 || prefix > 32) {
+                ofp_fatal(0, "%s: network prefix bits not between 1 and 32",
+                          str);
+            }
+            n_wild = 32 - prefix;
+        }
+    } else {
+        n_wild = 0;
+    }
+
+    free(str);
+    return n_wild;
+}
+
+static void *
+put_action(struct ofpbuf *b, size_t size, uint16_t type)
+{
+    struct ofp_action_header *ah = ofpbuf_put_zeros(b, size);
+    ah->type = htons(type);
+    ah->len = htons(size);
+    return ah;
+}
+
+static struct ofp_action_output *
+put_output_action(struct ofpbuf *b, uint16_t port)
+{
+    struct ofp_action_output *oao = put_action(b, sizeof *oao, OFPAT_OUTPUT);
+    oao->port = htons(port);
+    return oao;
+}
+
+static struct ofp_action_enqueue *
+put_enqueue_action(struct ofpbuf *b, uint16_t port, uint32_t queue)
+{
+    struct ofp_action_enqueue *oao;
+
+    oao = put_action(b, sizeof *oao, OFPAT_ENQUEUE);
+    oao->len = htons(sizeof(*oao));
+    oao->port = htons(port);
+    oao->queue_id = htonl(queue);
+    return oao;
+}
+
+/* Appends to 'b' the actions described by 'str', in the syntax of the
+ * "actions" keyword of a flow.  'str' is modified. */
+void
+str_to_action(char *str, struct ofpbuf *b)
+{
+    char *act, *arg, *arg2;
+    char *saveptr = NULL;
+
+    for (act = strtok_r(str, ", \t\r\n", &saveptr); act;
+         act = strtok_r(NULL, ", \t\r\n", &saveptr)) 
+    {
+        /* Arguments are separated by colons */
+        arg = strchr(act, ':');
+        if (arg) {
+            *arg = '\0';
+            arg++;
+        }
+
+        if (!strcasecmp(act, "mod_nw_tos")) {
+            struct ofp_action_nw_tos *va;
+            va = put_action(b, sizeof *va, OFPAT_SET_NW_TOS);
+            va->nw_tos = str_to_u32(arg);
+        } else if (!strcasecmp(act, "mod_vlan_vid")) {
+            struct ofp_action_vlan_vid *va;
+            va = put_action(b, sizeof *va, OFPAT_SET_VLAN_VID);
+            va->vlan_vid = htons(str_to_u32(arg));
+        } else if (!strcasecmp(act, "mod_vlan_pcp")) {
+            struct ofp_action_vlan_pcp *va;
+            va = put_action(b, sizeof *va, OFPAT_SET_VLAN_PCP);
+            va->vlan_pcp = str_to_u32(arg);
+        } else if (!strcasecmp(act, "mod_dl_dst")) {
+            struct ofp_action_dl_addr *va;
+            va = put_action(b, sizeof *va, OFPAT_SET_DL_DST);
+            str_to_mac(arg, va->dl_addr);
+        } else if (!strcasecmp(act, "mod_dl_src")) {
+            struct ofp_action_dl_addr *va;
+            va = put_action(b, sizeof *va, OFPAT_SET_DL_SRC);
+            str_to_mac(arg, va->dl_addr);
+        } else if (!strcasecmp(act, "mod_nw_src")
+                   || !strcasecmp(act, "mod_nw_dst")) {
+            struct ofp_action_nw_addr *na;
+            na = put_action(b, sizeof *na,
+                            (!strcasecmp(act, "mod_nw_src")
+                             ? OFPAT_SET_NW_SRC : OFPAT_SET_NW_DST));
+            if (!arg || str_to_ip(arg, &na->nw_addr)) {
+                ofp_fatal(0, "%s requires a single IP address", act);
+            }
+        } else if (!strcasecmp(act, "mod_tp_src")
+                   || !strcasecmp(act, "mod_tp_dst")) {
+            struct ofp_action_tp_port *ta;
+            ta = put_action(b, sizeof *ta,
+                            (!strcasecmp(act, "mod_tp_src")
+                             ? OFPAT_SET_TP_SRC : OFPAT_SET_TP_DST));
+            ta->tp_port = htons(str_to_u32(arg));
+        } else if (!strcasecmp(act, "strip_vlan")) {
+            struct ofp_action_header *ah;
+            ah = put_action(b, sizeof *ah, OFPAT_STRIP_VLAN);
+            ah->type = htons(OFPAT_STRIP_VLAN);
+        } else if (!strcasecmp(act, "enqueue")) {
+            arg2 = strchr(arg, ':');
+            if (arg2) {
+                *arg2 = '\0';
+                arg2++;
+            }
+            put_enqueue_action(b, str_to_u32(arg), str_to_u32(arg2));
+        } else if (!strcasecmp(act, "police")) {
+            struct ofp_ext_action_police *pa;
+            char *meter, *rate, *burst, *tos;
+
+            meter = arg ? strtok_r(arg, ":", &arg2) : NULL;
+            rate = meter ? strtok_r(NULL, ":", &arg2) : NULL;
+            if (!rate) {
+                ofp_fatal(0, "police requires a meter ID and a rate");
+            }
+            burst = strtok_r(NULL, ":", &arg2);
+            tos = burst ? strtok_r(NULL, ":", &arg2) : NULL;
+
+            pa = put_action(b, sizeof *pa, OFPAT_VENDOR);
+            pa->vendor = htonl(OPENFLOW_VENDOR_ID);
+            pa->subtype = htons(OFP_EXT_ACT_POLICE);
+            pa->meter_id = htonl(str_to_u32(meter));
+            pa->rate = htonl(str_to_u32(rate));
+            pa->burst = htonl(burst ? str_to_u32(burst) : 0);
+            if (tos) {
+                pa->exceed = OFP_EXT_POLICE_REMARK;
+                pa->nw_tos = str_to_u32(tos);
+            } else {
+                pa->exceed = OFP_EXT_POLICE_DROP;
+            }
+        } else if (!strcasecmp(act, "goto_table")) {
+            struct ofp_ext_action_goto_table *ga;
+
+            if (!arg) {
+                ofp_fatal(0, "goto_table requires a table number");
+            }
+            ga = put_action(b, sizeof *ga, OFPAT_VENDOR);
+            ga->vendor = htonl(OPENFLOW_VENDOR_ID);
+            ga->subtype = htons(OFP_EXT_ACT_GOTO_TABLE);
+            ga->table_id = str_to_u32(arg);
+        } else if (!strcasecmp(act, "output")) {
+            put_output_action(b, str_to_u32(arg));
+        } else if (!strcasecmp(act, "IN_PORT")) {
+            put_output_action(b, OFPP_IN_PORT);
+        } else if (!strcasecmp(act, "TABLE")) {
+            put_output_action(b, OFPP_TABLE);
+        } else if (!strcasecmp(act, "NORMAL")) {
+            put_output_action(b, OFPP_NORMAL);
+        } else if (!strcasecmp(act, "FLOOD")) {
+            put_output_action(b, OFPP_FLOOD);
+        } else if (!strcasecmp(act, "ALL")) {
+            put_output_action(b, OFPP_ALL);
+        } else if (!strcasecmp(act, "CONTROLLER")) {
+            struct ofp_action_output *oao;
+            oao = put_output_action(b, OFPP_CONTROLLER);
+
+            /* Unless a numeric argument is specified, we send the whole
+             * packet to the controller. */
+            if (arg && (strspn(arg, "0123456789") == strlen(arg))) {
+               oao->max_len = htons(str_to_u32(arg));
+            }
+        } else if (!strcasecmp(act, "LOCAL")) {
+            put_output_action(b, OFPP_LOCAL);
+        } else if (strspn(act, "0123456789") == strlen(act)) {
+            put_output_action(b, str_to_u32(act));
+        } else {
+            ofp_fatal(0, "Unknown action: %s", act);
+        }
+    }
+}
+
+struct protocol {
+    const char *name;
+    uint16_t dl_type;
+    uint8_t nw_proto;
+};
+
+static bool
+parse_protocol(const char *name, const struct protocol **p_out)
+{
+    static const struct protocol protocols[] = {
+        { "ip", ETH_TYPE_IP, 0 },
+        { "arp", ETH_TYPE_ARP, 0 },
+        { "icmp", ETH_TYPE_IP, IP_TYPE_ICMP },
+        { "tcp", ETH_TYPE_IP, IP_TYPE_TCP },
+        { "udp", ETH_TYPE_IP, IP_TYPE_UDP },
+    };
+    const struct protocol *p;
+
+    for (p = protocols; p < &protocols[ARRAY_SIZE(protocols)]; p++) {
+        if (!strcmp(p->name, name)) {
+            *p_out = p;
+            return true;
+        }
+    }
+    *p_out = NULL;
+    return false;
+}
+
+struct field {
+    const char *name;
+    uint32_t wildcard;
+    enum { F_U8, F_U16, F_MAC, F_IP } type;
+    size_t offset, shift;
+};
+
+static bool
+parse_field(const char *name, const struct field **f_out)
+{
+#define F_OFS(MEMBER) offsetof(struct ofp_match, MEMBER)
+    static const struct field fields[] = {
+        { "in_port", OFPFW_IN_PORT, F_U16, F_OFS(in_port), 0 },
+        { "dl_vlan", OFPFW_DL_VLAN, F_U16, F_OFS(dl_vlan), 0 },
+        { "dl_vlan_pcp", OFPFW_DL_VLAN_PCP, F_U8, F_OFS(dl_vlan_pcp), 0 },
+        { "dl_src", OFPFW_DL_SRC, F_MAC, F_OFS(dl_src), 0 },
+        { "dl_dst", OFPFW_DL_DST, F_MAC, F_OFS(dl_dst), 0 },
+        { "dl_type", OFPFW_DL_TYPE, F_U16, F_OFS(dl_type), 0 },
+        { "nw_tos", OFPFW_NW_TOS, F_U8, F_OFS(nw_tos), 0 },
+        { "nw_proto", OFPFW_NW_PROTO, F_U8, F_OFS(nw_proto), 0 },
+        { "nw_src", OFPFW_NW_SRC_MASK, F_IP,
+          F_OFS(nw_src), OFPFW_NW_SRC_SHIFT },
+        { "nw_dst", OFPFW_NW_DST_MASK, F_IP,
+          F_OFS(nw_dst), OFPFW_NW_DST_SHIFT },
+        { "tp_src", OFPFW_TP_SRC, F_U16, F_OFS(tp_src), 0 },
+        { "tp_dst", OFPFW_TP_DST, F_U16, F_OFS(tp_dst), 0 },
+        { "icmp_type", OFPFW_ICMP_TYPE, F_U16, F_OFS(icmp_type), 0 },
+        { "icmp_code", OFPFW_ICMP_CODE, F_U16, F_OFS(icmp_code), 0 }
+    };
+    const struct field *f;
+
+    for (f = fields; f < &fields[ARRAY_SIZE(fields)]; f++) {
+        if (!strcmp(f->name, name)) {
+            *f_out = f;
+            return true;
+        }
+    }
+    *f_out = NULL;
+    return false;
+}
+
+/* Parses 'string' as a flow in the syntax described in dpctl(8) and stores
+ * the match in 'match'.  If 'actions' is nonnull, appends the flow's actions
+ * to it.  Each of the other output arguments that is nonnull receives the
+ * value of the corresponding keyword, or its default if 'string' lacks it.
+ * 'string' is modified.  Exits with an error message if 'string' is
+ * malformed. */
+void
+parse_ofp_str(char *string, struct ofp_match *match, struct ofpbuf *actions,
+              uint8_t *table_idx, uint16_t *out_port, uint16_t *priority,
+              uint16_t *idle_timeout, uint16_t *hard_timeout,
+              uint64_t *cookie)
+{
+    char *save_ptr = NULL;
+    char *name;
+    uint32_t wildcards;
+
+    if (table_idx) {
+        *table_idx = 0xff;
+    }
+    if (out_port) {
+        *out_port = OFPP_NONE;
+    }
+    if (priority) {
+        *priority = OFP_DEFAULT_PRIORITY;
+    }
+    if (idle_timeout) {
+        *idle_timeout = DEFAULT_IDLE_TIMEOUT;
+    }
+    if (hard_timeout) {
+        *hard_timeout = OFP_FLOW_PERMANENT;
+    }
+    if (cookie) {
+        *cookie = 0;
+    }
+    if (actions) {
+        char *act_str = strstr(string, "actions");
+        if (!act_str) {
+            ofp_fatal(0, "must specify an action");
+        }
+        *(act_str-1) = '\0';
+
+        act_str = strchr(act_str, '=');
+        if (!act_str) {
+            ofp_fatal(0, "must specify an action");
+        }
+
+        act_str++;
+
+        str_to_action(act_str, actions);
+    }
+    memset(match, 0, sizeof *match);
+    wildcards = OFPFW_ALL;
+    for (name = strtok_r(string, "=, \t\r\n", &save_ptr); name;
+         name = strtok_r(NULL, "=, \t\r\n", &save_ptr)) {
+        const struct protocol *p;
+
+        if (parse_protocol(name, &p)) {
+            wildcards &= ~OFPFW_DL_TYPE;
+            match->dl_type = htons(p->dl_type);
+            if (p->nw_proto) {
+                wildcards &= ~OFPFW_NW_PROTO;
+                match->nw_proto = p->nw_proto;
+            }
+        } else {
+            const struct field *f;
+            char *value;
+
+            value = strtok_r(NULL, ", \t\r\n", &save_ptr);
+            if (!value) {
+                ofp_fatal(0, "field %s missing value", name);
+            }
+
+            if (table_idx && !strcmp(name, "table")) {
+                *table_idx = atoi(value);
+            } else if (out_port && !strcmp(name, "out_port")) {
+                *out_port = atoi(value);
+            } else if (priority && !strcmp(name, "priority")) {
+                *priority = atoi(value);
+            } else if (idle_timeout && !strcmp(name, "idle_timeout")) {
+                *idle_timeout = atoi(value);
+            } else if (hard_timeout && !strcmp(name, "hard_timeout")) {
+                *hard_timeout = atoi(value);
+            } else if (cookie && !strcmp(name, "cookie")) {
+                *cookie = strtoull(value, NULL, 0);
+            } else if (parse_field(name, &f)) {
+                void *data = (char *) match + f->offset;
+                if (!strcmp(value, "*") || !strcmp(value, "ANY")) {
+                    wildcards |= f->wildcard;
+                } else {
+                    wildcards &= ~f->wildcard;
+                    if (f->type == F_U8) {
+                        *(uint8_t *) data = str_to_u32(value);
+                    } else if (f->type == F_U16) {
+                        *(uint16_t *) data = htons(str_to_u32(value));
+                    } else if (f->type == F_MAC) {
+                        str_to_mac(value, data);
+                    } else if (f->type == F_IP) {
+                        wildcards |= str_to_ip(value, data) << f->shift;
+                    } else {
+                        NOT_REACHED();
+                    }
+                }
+            } else {
+                ofp_fatal(0, "unknown keyword %s", name);
+            }
+        }
+    }
+    match->wildcards = htonl(wildcards);
+}
+
+/* Parses 'string' as described for add-flow in the dpctl(8) man page and
+ * returns an OFPFC_ADD flow_mod message for it. */
+struct ofpbuf *
+parse_ofp_add_flow_str(char *string)
+{
+    struct ofpbuf *buffer;
+    struct ofp_flow_mod *ofm;
+    uint16_t priority, idle_timeout, hard_timeout;
+    uint64_t cookie;
+    uint8_t table_id;
+    struct ofp_match match;
+
+    /* parse_ofp_str() will expand and reallocate the data in 'buffer', so we
+     * can't keep pointers to across the parse_ofp_str() call. */
+    make_openflow(sizeof *ofm, OFPT_FLOW_MOD, &buffer);
+    parse_ofp_str(string, &match, buffer,
+                  &table_id, NULL, &priority, &idle_timeout, &hard_timeout,
+                  &cookie);
+    ofm = buffer->data;
+    ofm->match = match;
+    ofm->command = htons(OFPFC_ADD);
+    ofm->cookie = htonll(cookie);
+    ofm->idle_timeout = table_id == EMERG_TABLE_ID ? 0 : htons(idle_timeout);
+    ofm->hard_timeout = table_id == EMERG_TABLE_ID ? 0 : htons(hard_timeout);
+    ofm->buffer_id = htonl(UINT32_MAX);
+    ofm->priority = htons(priority);
+    ofm->flags = htons(OFPFF_SEND_FLOW_REM);
+    if (table_id == EMERG_TABLE_ID)
+        ofm->flags |= htons(OFPFF_EMERG);
+
+    return buffer;
+}
+
+/* Reads the next flow from 'file', which has one flow per line as described
+ * for add-flows in the dpctl(8) man page, and returns an OFPFC_ADD flow_mod
+ * message for it.  Skips blank lines and comments.  Returns a null pointer at
+ * end of file.
+ *
+ * If 'line_number' is nonnull, it is incremented for each line read, so that
+ * when it starts out as 0 it ends up as the number of the flow's line. */
+struct ofpbuf *
+parse_ofp_add_flow_file(FILE *file, int *line_number)
+{
+    char line[1024];
+
+    while (fgets(line, sizeof line, file)) {
+        char *comment;
+
+        if (line_number) {
+            ++*line_number;
+        }
+
+        /* Delete comments. */
+        comment = strchr(line, '#');
+        if (comment) {
+            *comment = '\0';
+        }
+
+        /* Drop empty lines. */
+        if (line[strspn(line, " \t\n")] == '\0') {
+            continue;
+        }
+
+        return parse_ofp_add_flow_str(line);
+    }
+    return NULL;
+}
@@ -38,9 +38,10 @@
 #include <errno.h>
 #include <inttypes.h>
 #include <netinet/in.h>
-#include <sys/wait.h>
 #include <stdarg.h>
 #include <stdlib.h>
+#include <string.h>
+#include <strings.h>
 #include <ctype.h>
 
 #include "compiler.h"
@@ -49,70 +50,117 @@
 #include "ofpbuf.h"
 #include "openflow/openflow.h"
 #include "openflow/nicira-ext.h"
+#include "openflow/openflow-ext.h"
 #include "packets.h"
-#include "pcap.h"
 #include "util.h"
 
 static void ofp_print_port_name(struct ds *string, uint16_t port);
 static void ofp_print_match(struct ds *, const struct ofp_match *,
                             int verbosity);
 
+/* Appends to 'ds' the tcpdump-style flag letters for TCP control bits
+ * 'flags'. */
+static void
+ofp_print_tcp_flags(struct ds *ds, uint16_t flags)
+{
+    static const struct {
+        uint16_t bit;
+        char letter;
+    } tcp_flags[] = {
+        { TCP_SYN, 'S' }, { TCP_FIN, 'F' }, { TCP_RST, 'R' },
+        { TCP_PSH, 'P' }, { TCP_ACK, '.' }, { TCP_URG, 'U' },
+    };
+    size_t i;
+
+    ds_put_cstr(ds, "Flags [");
+    for (i = 0; i < ARRAY_SIZE(tcp_flags); i++) {
+        if (flags & tcp_flags[i].bit) {
+            ds_put_char(ds, tcp_flags[i].letter);
+        }
+    }
+    ds_put_char(ds, ']');
+}
+
 /* Returns a string that represents the contents of the Ethernet frame in the
- * 'len' bytes starting at 'data' to 'stream' as output by tcpdump.
- * 'total_len' specifies the full length of the Ethernet frame (of which 'len'
- * bytes were captured).
+ * 'len' bytes starting at 'data', in a one-line format modeled on the output
+ * of "tcpdump -e -n".  'total_len' specifies the full length of the Ethernet
+ * frame (of which 'len' bytes were captured).
  *
- * The caller must free the returned string.
+ * The frame is decoded in-process with flow_extract(), so this is cheap
+ * enough to call on a live switch.
  *
- * This starts and kills a tcpdump subprocess so it's quite expensive. */
+ * The caller must free the returned string. */
 char *
-ofp_packet_to_string(const void *data, size_t len, size_t total_len UNUSED)
+ofp_packet_to_string(const void *data, size_t len, size_t total_len)
 {
     struct ds ds = DS_EMPTY_INITIALIZER;
-    struct ofpbuf buf;
-
-    char command[128];
-    FILE *pcap;
-    FILE *tcpdump;
-    int status;
-    int c;
-
-    buf.data = (void *) data;
-    buf.size = len;
-
-    pcap = tmpfile();
-    if (!pcap) {
-        ofp_error(errno, "tmpfile");
-        return xstrdup("<error>");
-    }
-    pcap_write_header(pcap);
-    pcap_write(pcap, &buf);
-    fflush(pcap);
-    if (ferror(pcap)) {
-        ofp_error(errno, "error writing temporary file");
-    }
-    rewind(pcap);
-
-    snprintf(command, sizeof command, "/usr/sbin/tcpdump -e -n -r /dev/fd/%d 2>/dev/null",
-             fileno(pcap));
-    tcpdump = popen(command, "r");
-    fclose(pcap);
-    if (!tcpdump) {
-        ofp_error(errno, "exec(\"%s\")", command);
-        return xstrdup("<error>");
-    }
-
-    while ((c = getc(tcpdump)) != EOF) {
-        ds_put_char(&ds, c);
-    }
+    struct ofpbuf packet;
+    struct flow flow;
+
+    ofpbuf_use(&packet, (void *) data, len);
+    packet.size = len;
+    flow_extract(&packet, 0, &flow);
+    if (!packet.l3) {
+        ds_put_format(&ds, "truncated frame, length %zu (captured %zu)\n",
+                      total_len, len);
+        return ds_cstr(&ds);
+    }
+
+    ds_put_format(&ds, ETH_ADDR_FMT" > "ETH_ADDR_FMT", ",
+                  ETH_ADDR_ARGS(flow.dl_src), ETH_ADDR_ARGS(flow.dl_dst));
+    if (flow.dl_vlan != htons(OFP_VLAN_NONE)) {
+        ds_put_format(&ds, "vlan %"PRIu16", p %"PRIu8", ",
+                      ntohs(flow.dl_vlan), flow.dl_vlan_pcp);
+    }
+    ds_put_format(&ds, "ethertype 0x%04"PRIx16", length %zu",
+                  ntohs(flow.dl_type), total_len);
+    if (len < total_len) {
+        ds_put_format(&ds, " (captured %zu)", len);
+    }
+
+    if (flow.dl_type == htons(ETH_TYPE_IP) && packet.l4) {
+        ds_put_format(&ds, ": "IP_FMT, IP_ARGS(&flow.nw_src));
+        if (flow.nw_proto == IP_TYPE_TCP || flow.nw_proto == IP_TYPE_UDP) {
+            ds_put_format(&ds, ".%"PRIu16" > "IP_FMT".%"PRIu16": ",
+                          ntohs(flow.tp_src), IP_ARGS(&flow.nw_dst),
+                          ntohs(flow.tp_dst));
+        } else {
+            ds_put_format(&ds, " > "IP_FMT": ", IP_ARGS(&flow.nw_dst));
+        }
 
-    status = pclose(tcpdump);
-    if (WIFEXITED(status)) {
-        if (WEXITSTATUS(status))
-            ofp_error(0, "tcpdump exited with status %d", WEXITSTATUS(status));
-    } else if (WIFSIGNALED(status)) {
-        ofp_error(0, "tcpdump exited with signal %d", WTERMSIG(status)); 
+        if (flow.nw_proto == IP_TYPE_TCP) {
+            const struct tcp_header *tcp = packet.l4;
+            ofp_print_tcp_flags(&ds, TCP_FLAGS(tcp->tcp_ctl));
+            ds_put_format(&ds, ", seq %"PRIu32, ntohl(tcp->tcp_seq));
+            if (tcp->tcp_ctl & htons(TCP_ACK)) {
+                ds_put_format(&ds, ", ack %"PRIu32, ntohl(tcp->tcp_ack));
+            }
+            ds_put_format(&ds, ", win %"PRIu16, ntohs(tcp->tcp_winsz));
+        } else if (flow.nw_proto == IP_TYPE_UDP) {
+            ds_put_cstr(&ds, "UDP");
+        } else if (flow.nw_proto == IP_TYPE_ICMP) {
+            ds_put_format(&ds, "ICMP type %"PRIu16", code %"PRIu16,
+                          ntohs(flow.icmp_type), ntohs(flow.icmp_code));
+        } else {
+            ds_put_format(&ds, "ip-proto-%"PRIu8, flow.nw_proto);
+        }
+        if (flow.nw_tos) {
+            ds_put_format(&ds, ", tos 0x%"PRIx8, flow.nw_tos);
+        }
+    } else if (flow.dl_type == htons(ETH_TYPE_ARP) && flow.nw_proto) {
+        ds_put_cstr(&ds, ": ARP, ");
+        if (flow.nw_proto == ARP_OP_REQUEST) {
+            ds_put_format(&ds, "Request who-has "IP_FMT" tell "IP_FMT,
+                          IP_ARGS(&flow.nw_dst), IP_ARGS(&flow.nw_src));
+        } else if (flow.nw_proto == ARP_OP_REPLY) {
+            const struct arp_eth_header *arp = packet.l3;
+            ds_put_format(&ds, "Reply "IP_FMT" is-at "ETH_ADDR_FMT,
+                          IP_ARGS(&flow.nw_src), ETH_ADDR_ARGS(arp->ar_sha));
+        } else {
+            ds_put_format(&ds, "opcode %"PRIu8, flow.nw_proto);
+        }
     }
+    ds_put_char(&ds, '\n');
     return ds_cstr(&ds);
 }
 
@@ -400,8 +448,25 @@ ofp_print_action(struct ds *string, const struct ofp_action_header *ah,
             return -1;
         }
         /* Identify individual vendor actions */
-        if (1 == 0) {
-            /* Code to output vendor action */
+        if (avh->vendor == htonl(OPENFLOW_VENDOR_ID)
+            && len == sizeof(struct ofp_ext_action_police)
+            && ((struct ofp_ext_action_header *) ah)->subtype
+               == htons(OFP_EXT_ACT_POLICE)) {
+            struct ofp_ext_action_police *pa
+                    = (struct ofp_ext_action_police *) ah;
+            ds_put_format(string, "police:%"PRIu32":%"PRIu32":%"PRIu32,
+                          ntohl(pa->meter_id), ntohl(pa->rate),
+                          ntohl(pa->burst));
+            if (pa->exceed == OFP_EXT_POLICE_REMARK) {
+                ds_put_format(string, ":%"PRIu8, pa->nw_tos);
+            }
+        } else if (avh->vendor == htonl(OPENFLOW_VENDOR_ID)
+                   && len == sizeof(struct ofp_ext_action_goto_table)
+                   && ((struct ofp_ext_action_header *) ah)->subtype
+                      == htons(OFP_EXT_ACT_GOTO_TABLE)) {
+            struct ofp_ext_action_goto_table *ga
+                    = (struct ofp_ext_action_goto_table *) ah;
+            ds_put_format(string, "goto_table:%"PRIu8, ga->table_id);
         } else {
             ds_put_format(string, "vendor action:0x%x", ntohl(avh->vendor));
         }
@@ -419,11 +484,20 @@ ofp_print_action(struct ds *string, const struct ofp_action_header *ah,
 static void 
 ofp_print_actions(struct ds *string, const struct ofp_action_header *action,
                   size_t actions_len) 
+{
+    ds_put_cstr(string, "actions=");
+    ofp_put_actions(string, action, actions_len);
+}
+
+/* Appends the 'actions_len' bytes of actions at 'action' to 'string' as a
+ * comma-separated list, without the "actions=" prefix. */
+void
+ofp_put_actions(struct ds *string, const struct ofp_action_header *action,
+                size_t actions_len)
 {
     uint8_t *p = (uint8_t *)action;
     int len = 0;
 
-    ds_put_cstr(string, "actions=");
     while (actions_len > 0) {
         if (len) {
             ds_put_cstr(string, ",");
@@ -734,6 +808,19 @@ ofp_match_to_string(const struct ofp_match *om, int verbosity)
     return ds_cstr(&f);
 }
 
+/* Composes and returns a string representing the 'actions_len' bytes of
+ * actions at 'actions', in the "actions=..." syntax that dpctl(8) accepts.
+ * The caller is responsible for freeing the string. */
+char *
+ofp_actions_to_string(const struct ofp_action_header *actions,
+                      size_t actions_len)
+{
+    struct ds string = DS_EMPTY_INITIALIZER;
+
+    ofp_print_actions(&string, actions, actions_len);
+    return ds_cstr(&string);
+}
+
 /* Pretty-print the OFPT_FLOW_MOD packet of 'len' bytes at 'oh' to 'string'
  * at the given 'verbosity' level. */
 static void
@@ -1159,6 +1246,343 @@ ofp_table_stats_reply(struct ds *string, const void *body, size_t len,
      }
 }
 
+static void
+ext_buffer_stats_reply(struct ds *string, const void *body, size_t len)
+{
+    const struct ofp_ext_buffer_stats *obs = body;
+
+    if (len < sizeof *obs) {
+        ds_put_format(string, " ***buffer stats truncated***\n");
+        return;
+    }
+    ds_put_format(string, " buffers: used=%"PRIu32"/%"PRIu32", ",
+                  ntohl(obs->n_used), ntohl(obs->n_buffers));
+    ds_put_format(string, "saved=%"PRIu64", ", ntohll(obs->n_saved));
+    ds_put_format(string, "evicted=%"PRIu64", ", ntohll(obs->n_evicted));
+    ds_put_format(string, "full=%"PRIu64"\n", ntohll(obs->n_full));
+}
+
+static const char *
+ext_latency_stage_name(uint16_t stage)
+{
+    switch (stage) {
+    case OFP_EXT_LATENCY_PORT_INPUT: return "port input";
+    case OFP_EXT_LATENCY_LOOKUP: return "lookup";
+    case OFP_EXT_LATENCY_ACTIONS: return "actions";
+    case OFP_EXT_LATENCY_CONTROL: return "to controller";
+    default: return "unknown";
+    }
+}
+
+/* Appends to 'string' 'ticks' converted to a time at 'ticks_per_sec', or
+ * just 'ticks' if the rate is unknown. */
+static void
+ext_latency_put_time(struct ds *string, uint64_t ticks, uint64_t ticks_per_sec)
+{
+    double ns;
+
+    if (!ticks_per_sec) {
+        ds_put_format(string, "%"PRIu64" ticks", ticks);
+        return;
+    }
+    ns = ticks * 1e9 / ticks_per_sec;
+    if (ns < 1e4) {
+        ds_put_format(string, "%.0f ns", ns);
+    } else if (ns < 1e7) {
+        ds_put_format(string, "%.0f us", ns / 1e3);
+    } else {
+        ds_put_format(string, "%.0f ms", ns / 1e6);
+    }
+}
+
+static void
+ext_latency_stats_reply(struct ds *string, const void *body, size_t len)
+{
+    const struct ofp_ext_latency_stats *ols = body;
+    const struct ofp_ext_latency_hist *olh;
+    uint64_t ticks_per_sec;
+    size_t n, i;
+    int j;
+
+    if (len < sizeof *ols) {
+        ds_put_format(string, " ***latency stats truncated***\n");
+        return;
+    }
+    ticks_per_sec = ntohll(ols->ticks_per_sec);
+    ds_put_format(string, " latency: clock=%"PRIu64" Hz\n", ticks_per_sec);
+
+    n = (len - sizeof *ols) / sizeof *olh;
+    for (i = 0, olh = ols->stages; i < n; i++, olh++) {
+        uint64_t n_samples = ntohll(olh->n_samples);
+
+        ds_put_format(string, "  %s: n=%"PRIu64,
+                      ext_latency_stage_name(ntohs(olh->stage)), n_samples);
+        if (n_samples) {
+            ds_put_cstr(string, ", mean=");
+            ext_latency_put_time(string, ntohll(olh->total_ticks) / n_samples,
+                                 ticks_per_sec);
+        }
+        ds_put_char(string, '\n');
+
+        for (j = 0; j < OFP_EXT_LATENCY_BUCKETS; j++) {
+            uint64_t count = ntohll(olh->buckets[j]);
+            bool last = j == OFP_EXT_LATENCY_BUCKETS - 1;
+
+            if (count) {
+                ds_put_cstr(string, last ? "    >=" : "    <");
+                ext_latency_put_time(string, UINT64_C(1) << (last ? j - 1 : j),
+                                     ticks_per_sec);
+                ds_put_format(string, ": %"PRIu64" (%.1f%%)\n", count,
+                              100.0 * count / n_samples);
+            }
+        }
+    }
+}
+
+static void
+ext_flow_delta_request(struct ds *string, const void *body, size_t len,
+                       int verbosity)
+{
+    const struct ofp_ext_flow_delta_request *fdr = body;
+
+    if (len < sizeof *fdr) {
+        ds_put_format(string, " ***flow delta request truncated***\n");
+        return;
+    }
+    ds_put_format(string, " flow deltas since=%"PRIu64",",
+                  ntohll(fdr->since));
+    ofp_flow_stats_request(string, &fdr->flows, sizeof fdr->flows,
+                           verbosity);
+}
+
+static void
+ext_flow_delta_reply(struct ds *string, const void *body, size_t len,
+                     int verbosity)
+{
+    const struct ofp_ext_flow_delta_reply *fdr = body;
+
+    if (len < sizeof *fdr) {
+        ds_put_format(string, " ***flow delta reply truncated***\n");
+        return;
+    }
+    ds_put_format(string, " flow deltas generation=%"PRIu64"\n",
+                  ntohll(fdr->generation));
+    ofp_flow_stats_reply(string, fdr->stats, len - sizeof *fdr, verbosity);
+}
+
+static void
+ext_cookie_flow_request(struct ds *string, const void *body, size_t len)
+{
+    const struct ofp_ext_cookie_flow_request *req = body;
+
+    if (len < sizeof *req) {
+        ds_put_format(string, " ***cookie flow request truncated***\n");
+        return;
+    }
+    ds_put_format(string, " cookie flows cookie=0x%"PRIx64"/0x%"PRIx64,
+                  ntohll(req->cookie), ntohll(req->cookie_mask));
+    if (req->out_port != htons(OFPP_NONE)) {
+        ds_put_format(string, " out_port=%"PRIu16, ntohs(req->out_port));
+    }
+    ds_put_char(string, '\n');
+}
+
+static void
+ext_cookie_flow_reply(struct ds *string, const void *body, size_t len,
+                      int verbosity)
+{
+    const struct ofp_ext_cookie_flow_reply *ocr = body;
+
+    ds_put_cstr(string, " cookie flows\n");
+    ofp_flow_stats_reply(string, ocr->stats, len - sizeof *ocr, verbosity);
+}
+
+static const char *
+ext_top_flows_by_name(int by)
+{
+    return (by == OFP_EXT_TOP_BY_PACKETS ? "packets"
+            : by == OFP_EXT_TOP_BY_BYTES ? "bytes"
+            : "unknown");
+}
+
+static void
+ext_top_flows_request(struct ds *string, const void *body, size_t len)
+{
+    const struct ofp_ext_top_flows_request *req = body;
+
+    if (len < sizeof *req) {
+        ds_put_format(string, " ***top flows request truncated***\n");
+        return;
+    }
+    ds_put_format(string, " top flows n=%"PRIu16" by=%s\n",
+                  ntohs(req->n_flows), ext_top_flows_by_name(req->by));
+}
+
+static void
+ext_top_flows_reply(struct ds *string, const void *body, size_t len,
+                    int verbosity)
+{
+    const struct ofp_ext_top_flows_reply *reply = body;
+    const struct ofp_ext_top_flow *otf;
+    size_t n, i;
+
+    if (len < sizeof *reply) {
+        ds_put_format(string, " ***top flows reply truncated***\n");
+        return;
+    }
+    ds_put_format(string, " top flows by=%s window=%"PRIu32"ms\n",
+                  ext_top_flows_by_name(reply->by),
+                  ntohl(reply->window_msec));
+
+    n = (len - sizeof *reply) / sizeof *otf;
+    for (i = 0, otf = reply->flows; i < n; i++, otf++) {
+        ds_put_format(string, "  cookie=%"PRIu64", ", ntohll(otf->cookie));
+        ds_put_format(string, "priority=%"PRIu16", ",
+                      otf->match.wildcards ? ntohs(otf->priority)
+                      : (uint16_t) -1);
+        ds_put_format(string, "n_packets=%"PRIu64", ",
+                      ntohll(otf->packet_count));
+        ds_put_format(string, "n_bytes=%"PRIu64", ",
+                      ntohll(otf->byte_count));
+        ds_put_format(string, "error=%"PRIu64", ", ntohll(otf->error));
+        ofp_print_match(string, &otf->match, verbosity);
+        ds_put_char(string, '\n');
+    }
+}
+
+static void
+ext_trace_request(struct ds *string, const void *body, size_t len,
+                  int verbosity)
+{
+    const struct ofp_ext_trace_request *req = body;
+
+    if (len < sizeof *req) {
+        ds_put_format(string, " ***trace request truncated***\n");
+        return;
+    }
+    if (len > sizeof *req) {
+        ds_put_format(string, " trace %zu-byte packet in_port=%"PRIu16"\n",
+                      len - sizeof *req, ntohs(req->match.in_port));
+    } else {
+        ds_put_cstr(string, " trace ");
+        ofp_print_match(string, &req->match, verbosity);
+        ds_put_char(string, '\n');
+    }
+}
+
+static void
+ext_trace_reply(struct ds *string, const void *body, size_t len,
+                int verbosity)
+{
+    const struct ofp_ext_trace_reply *reply = body;
+    const struct ofp_ext_trace_table *ott;
+    size_t tables_len;
+    size_t i;
+
+    if (len < sizeof *reply) {
+        ds_put_format(string, " ***trace reply truncated***\n");
+        return;
+    }
+    tables_len = reply->n_tables * sizeof *ott;
+    if (len - sizeof *reply < tables_len) {
+        ds_put_format(string, " ***trace reply truncated***\n");
+        return;
+    }
+
+    ds_put_cstr(string, " trace ");
+    ofp_print_match(string, &reply->key, verbosity);
+    ds_put_char(string, '\n');
+    for (i = 0, ott = reply->tables; i < reply->n_tables; i++, ott++) {
+        ds_put_format(string, "  table %"PRIu8" (%.*s): ", ott->table_id,
+                      (int) sizeof ott->name, ott->name);
+        if (ott->n_compares == htonl(UINT32_MAX)) {
+            ds_put_cstr(string, "compares unknown");
+        } else {
+            ds_put_format(string, "%"PRIu32" compare%s",
+                          ntohl(ott->n_compares),
+                          ott->n_compares == htonl(1) ? "" : "s");
+        }
+        ds_put_cstr(string, ott->matched ? ", match\n" : ", no match\n");
+    }
+    if (reply->table_id == 0xff) {
+        ds_put_cstr(string, " no match\n");
+        return;
+    }
+    ds_put_format(string, " matched table=%"PRIu8", priority=%"PRIu16", "
+                  "cookie=0x%"PRIx64"%s, ", reply->table_id,
+                  ntohs(reply->priority), ntohll(reply->cookie),
+                  reply->cached ? " (cached)" : "");
+    ofp_print_match(string, &reply->match, verbosity);
+    ofp_print_actions(string, (const void *) (reply->tables + reply->n_tables),
+                      len - sizeof *reply - tables_len);
+    ds_put_char(string, '\n');
+}
+
+static void
+ext_port_drops_request(struct ds *string, const void *body, size_t len)
+{
+    const struct ofp_ext_port_drops_request *req = body;
+
+    if (len < sizeof *req) {
+        ds_put_format(string, " ***port drops request truncated***\n");
+        return;
+    }
+    ds_put_cstr(string, " port drops port_no=");
+    ofp_print_port_name(string, ntohs(req->port_no));
+    ds_put_char(string, '\n');
+}
+
+static void
+ext_port_drops_reply(struct ds *string, const void *body, size_t len)
+{
+    static const char *const reasons[OFP_EXT_DROP_N_REASONS] = {
+        [OFP_EXT_DROP_FRAG] = "frag",
+        [OFP_EXT_DROP_NO_RECV] = "no_recv",
+        [OFP_EXT_DROP_RX_QUEUE] = "rx_queue",
+        [OFP_EXT_DROP_MISS_QUEUE] = "miss_queue",
+        [OFP_EXT_DROP_UNBUFFERED] = "unbuffered",
+        [OFP_EXT_DROP_CONTROL_QUEUE] = "control_queue",
+        [OFP_EXT_DROP_TX] = "tx",
+        [OFP_EXT_DROP_SHAPER_QUEUE] = "shaper_queue",
+        [OFP_EXT_DROP_HW_RING] = "hw_ring",
+        [OFP_EXT_DROP_PACKET_IN_RATE] = "packet_in_rate",
+        [OFP_EXT_DROP_TABLE_MISS] = "table_miss",
+    };
+    const uint8_t *p = (const uint8_t *) body
+                       + sizeof(struct ofp_ext_port_drops_reply);
+    const uint8_t *end = (const uint8_t *) body + len;
+
+    while (p < end) {
+        const struct ofp_ext_port_drops *opd = (const void *) p;
+        size_t entry_len, i;
+
+        if (end - p < sizeof *opd
+            || (entry_len = ntohs(opd->length)) < sizeof *opd
+            || entry_len > end - p || entry_len % 8) {
+            ds_put_format(string, " ***port drops reply truncated***\n");
+            return;
+        }
+        ds_put_cstr(string, "  port ");
+        if (opd->port_no == htons(OFPP_NONE)) {
+            ds_put_cstr(string, "none");
+        } else {
+            ofp_print_port_name(string, ntohs(opd->port_no));
+        }
+        ds_put_char(string, ':');
+        for (i = 0; i < (entry_len - sizeof *opd) / sizeof(uint64_t); i++) {
+            if (i < OFP_EXT_DROP_N_REASONS) {
+                ds_put_format(string, " %s=%"PRIu64, reasons[i],
+                              ntohll(opd->drops[i]));
+            } else {
+                ds_put_format(string, " reason%zu=%"PRIu64, i,
+                              ntohll(opd->drops[i]));
+            }
+        }
+        ds_put_char(string, '\n');
+        p += entry_len;
+    }
+}
+
 static void
 vendor_stat(struct ds *string, const void *body, size_t len,
             int verbosity UNUSED)
@@ -1168,6 +1592,69 @@ vendor_stat(struct ds *string, const void *body, size_t len,
                   len - sizeof(uint32_t));
 }
 
+static void
+vendor_stats_request(struct ds *string, const void *body, size_t len,
+                     int verbosity)
+{
+    const struct ofp_extension_stats_header *esh = body;
+
+    if (len >= sizeof *esh
+        && esh->vendor == htonl(OPENFLOW_VENDOR_ID)
+        && esh->subtype == htonl(OFP_EXT_STATS_FLOW_DELTA)) {
+        ext_flow_delta_request(string, body, len, verbosity);
+    } else if (len >= sizeof *esh
+               && esh->vendor == htonl(OPENFLOW_VENDOR_ID)
+               && esh->subtype == htonl(OFP_EXT_STATS_COOKIE_FLOW)) {
+        ext_cookie_flow_request(string, body, len);
+    } else if (len >= sizeof *esh
+               && esh->vendor == htonl(OPENFLOW_VENDOR_ID)
+               && esh->subtype == htonl(OFP_EXT_STATS_TOP_FLOWS)) {
+        ext_top_flows_request(string, body, len);
+    } else if (len >= sizeof *esh
+               && esh->vendor == htonl(OPENFLOW_VENDOR_ID)
+               && esh->subtype == htonl(OFP_EXT_STATS_TRACE)) {
+        ext_trace_request(string, body, len, verbosity);
+    } else if (len >= sizeof *esh
+               && esh->vendor == htonl(OPENFLOW_VENDOR_ID)
+               && esh->subtype == htonl(OFP_EXT_STATS_PORT_DROPS)) {
+        ext_port_drops_request(string, body, len);
+    } else {
+        vendor_stat(string, body, len, verbosity);
+    }
+}
+
+static void
+vendor_stats_reply(struct ds *string, const void *body, size_t len,
+                   int verbosity)
+{
+    const struct ofp_extension_stats_header *esh = body;
+
+    if (len > sizeof *esh && esh->vendor == htonl(OPENFLOW_VENDOR_ID)
+        && esh->subtype == htonl(OFP_EXT_STATS_BUFFER)) {
+        ext_buffer_stats_reply(string, body, len);
+    } else if (len >= sizeof *esh && esh->vendor == htonl(OPENFLOW_VENDOR_ID)
+               && esh->subtype == htonl(OFP_EXT_STATS_FLOW_DELTA)) {
+        ext_flow_delta_reply(string, body, len, verbosity);
+    } else if (len >= sizeof *esh && esh->vendor == htonl(OPENFLOW_VENDOR_ID)
+               && esh->subtype == htonl(OFP_EXT_STATS_LATENCY)) {
+        ext_latency_stats_reply(string, body, len);
+    } else if (len >= sizeof *esh && esh->vendor == htonl(OPENFLOW_VENDOR_ID)
+               && esh->subtype == htonl(OFP_EXT_STATS_COOKIE_FLOW)) {
+        ext_cookie_flow_reply(string, body, len, verbosity);
+    } else if (len >= sizeof *esh && esh->vendor == htonl(OPENFLOW_VENDOR_ID)
+               && esh->subtype == htonl(OFP_EXT_STATS_TOP_FLOWS)) {
+        ext_top_flows_reply(string, body, len, verbosity);
+    } else if (len >= sizeof *esh && esh->vendor == htonl(OPENFLOW_VENDOR_ID)
+               && esh->subtype == htonl(OFP_EXT_STATS_TRACE)) {
+        ext_trace_reply(string, body, len, verbosity);
+    } else if (len >= sizeof *esh && esh->vendor == htonl(OPENFLOW_VENDOR_ID)
+               && esh->subtype == htonl(OFP_EXT_STATS_PORT_DROPS)) {
+        ext_port_drops_reply(string, body, len);
+    } else {
+        vendor_stat(string, body, len, verbosity);
+    }
+}
+
 enum stats_direction {
     REQUEST,
     REPLY
@@ -1235,8 +1722,8 @@ print_stats(struct ds *string, int type, const void *body, size_t body_len,
         {
             OFPST_VENDOR,
             "vendor-specific",
-            { sizeof(uint32_t), SIZE_MAX, vendor_stat },
-            { sizeof(uint32_t), SIZE_MAX, vendor_stat },
+            { sizeof(uint32_t), SIZE_MAX, vendor_stats_request },
+            { sizeof(uint32_t), SIZE_MAX, vendor_stats_reply },
         },
         {
             -1,
@@ -1249,15 +1736,15 @@ print_stats(struct ds *string, int type, const void *body, size_t body_len,
     const struct stats_type *s;
     const struct stats_msg *m;
 
-    if (type >= ARRAY_SIZE(stats_types) || !stats_types[type].name) {
-        ds_put_format(string, " ***unknown type %d***", type);
-        return;
-    }
     for (s = stats_types; s->type >= 0; s++) {
         if (s->type == type) {
             break;
         }
     }
+    if (s->type < 0) {
+        ds_put_format(string, " ***unknown type %d***", type);
+        return;
+    }
     ds_put_format(string, " type=%d(%s)\n", type, s->name);
 
     m = direction == REQUEST ? &s->request : &s->reply;
@@ -1322,12 +1809,183 @@ ofp_echo(struct ds *string, const void *oh, size_t len, int verbosity)
 }
 
 static void
-ofp_vendor(struct ds *string UNUSED, const void *oh, size_t len UNUSED, int verbosity UNUSED)
+ofp_ext_bundle(struct ds *string, const void *oh, size_t len, int verbosity)
+{
+    const struct ofp_ext_bundle *ob = oh;
+    const uint8_t *pos = (const uint8_t *) (ob + 1);
+    const uint8_t *end = (const uint8_t *) oh + len;
+
+    ds_put_cstr(string, " bundle:\n");
+    while (pos < end) {
+        const struct ofp_header *inner = (const struct ofp_header *) pos;
+        size_t length;
+        char *s;
+
+        length = end - pos >= sizeof *inner ? ntohs(inner->length) : 0;
+        if (length < sizeof *inner || length > end - pos) {
+            ds_put_format(string, " ***%td leftover bytes at end***\n",
+                          end - pos);
+            break;
+        }
+        s = ofp_to_string(inner, length, verbosity);
+        ds_put_format(string, "  %s", s);
+        free(s);
+        pos += length;
+    }
+}
+
+static void
+ofp_ext_set_async(struct ds *string, const void *oh, size_t len)
+{
+    const struct ofp_ext_set_async *osa = oh;
+    size_t n_ports = (len - sizeof *osa) / sizeof osa->ports[0];
+    size_t i;
+
+    ds_put_format(string, " set async packet_in=0x%"PRIx32
+                  " port_status=0x%"PRIx32" flow_removed=0x%"PRIx32,
+                  ntohl(osa->packet_in_mask), ntohl(osa->port_status_mask),
+                  ntohl(osa->flow_removed_mask));
+    if (osa->balance_id) {
+        ds_put_format(string, " balance=%"PRIu32, ntohl(osa->balance_id));
+    }
+    for (i = 0; i < n_ports; i++) {
+        ds_put_format(string, "%s%"PRIu16, i ? "," : " ports=",
+                      ntohs(osa->ports[i]));
+    }
+    ds_put_char(string, '\n');
+}
+
+static void
+ofp_ext_monitor_filter(struct ds *string, const void *oh)
+{
+    const struct ofp_ext_monitor_filter *mf = oh;
+    uint32_t types = ntohl(mf->types);
+    int type;
+
+    ds_put_cstr(string, " monitor filter types=");
+    if (types == UINT32_MAX) {
+        ds_put_cstr(string, "all");
+    } else if (!types) {
+        ds_put_cstr(string, "none");
+    } else {
+        const char *sep = "";
+        for (type = 0; type < 32; type++) {
+            if (types & (1u << type)) {
+                char *name = ofp_message_type_to_string(type);
+                ds_put_format(string, "%s%s", sep, name);
+                free(name);
+                sep = ",";
+            }
+        }
+    }
+    ds_put_char(string, '\n');
+}
+
+static void
+ofp_ext_table_replace(struct ds *string, const void *oh)
+{
+    const struct ofp_ext_table_replace *otr = oh;
+    uint16_t command = ntohs(otr->command);
+
+    ds_put_format(string, " table replace %s\n",
+                  (command == OFP_EXT_REPLACE_BEGIN ? "begin"
+                   : command == OFP_EXT_REPLACE_COMMIT ? "commit"
+                   : command == OFP_EXT_REPLACE_ABORT ? "abort"
+                   : "(unknown command)"));
+}
+
+static void
+ofp_ext_table_miss(struct ds *string, const void *oh)
+{
+    const struct ofp_ext_table_miss *otm = oh;
+
+    ds_put_format(string, " table %"PRIu8" miss %s\n", otm->table_id,
+                  (otm->miss == OFP_EXT_MISS_CONTROLLER ? "controller"
+                   : otm->miss == OFP_EXT_MISS_CONTINUE ? "continue"
+                   : otm->miss == OFP_EXT_MISS_DROP ? "drop"
+                   : "(unknown miss behavior)"));
+}
+
+static void
+ofp_ext_packet_out_batch(struct ds *string, const void *oh, size_t len,
+                         int verbosity)
+{
+    const struct ofp_ext_packet_out_batch *opb = oh;
+    const uint8_t *p = (const uint8_t *) opb->entries;
+    const uint8_t *end = (const uint8_t *) oh + len;
+    int n = 0;
+
+    ds_put_cstr(string, " packet_out batch\n");
+    while (end - p >= sizeof(struct ofp_ext_packet_out_entry)) {
+        const struct ofp_ext_packet_out_entry *e = (const void *) p;
+        size_t length = ntohs(e->length);
+        size_t actions_len = ntohs(e->actions_len);
+
+        if (length < sizeof *e || length > end - p
+            || actions_len > length - sizeof *e) {
+            ds_put_cstr(string, " ***bad entry length***\n");
+            return;
+        }
+        ds_put_format(string, " %d. in_port=", n++);
+        ofp_print_port_name(string, ntohs(e->in_port));
+        ds_put_char(string, ' ');
+        if (actions_len) {
+            ofp_print_actions(string, e->actions, actions_len);
+        } else {
+            ds_put_cstr(string, "actions=(previous)");
+        }
+        if (ntohl(e->buffer_id) == UINT32_MAX) {
+            size_t data_len = ntohs(e->data_len);
+            ds_put_format(string, " data_len=%zu", data_len);
+            if (verbosity > 0 && data_len <= length - sizeof *e - actions_len) {
+                char *packet = ofp_packet_to_string(
+                    (const uint8_t *) e->actions + actions_len,
+                    data_len, data_len);
+                ds_put_char(string, '\n');
+                ds_put_cstr(string, packet);
+                free(packet);
+            }
+        } else {
+            ds_put_format(string, " buffer=0x%08"PRIx32, ntohl(e->buffer_id));
+        }
+        ds_put_char(string, '\n');
+        p += length;
+    }
+}
+
+static void
+ofp_vendor(struct ds *string, const void *oh, size_t len, int verbosity)
 {
     const struct ofp_vendor_header *vh = oh;
 
     switch(ntohl(vh->vendor)) 
     {
+    case OPENFLOW_VENDOR_ID: {
+        const struct ofp_extension_header *eh = oh;
+        if (len >= sizeof(struct ofp_ext_bundle)
+            && eh->subtype == htonl(OFP_EXT_BUNDLE)) {
+            ofp_ext_bundle(string, oh, len, verbosity);
+        } else if (len >= sizeof(struct ofp_ext_set_async)
+                   && eh->subtype == htonl(OFP_EXT_SET_ASYNC)) {
+            ofp_ext_set_async(string, oh, len);
+        } else if (len >= sizeof(struct ofp_ext_monitor_filter)
+                   && eh->subtype == htonl(OFP_EXT_MONITOR_FILTER)) {
+            ofp_ext_monitor_filter(string, oh);
+        } else if (len >= sizeof(struct ofp_ext_table_replace)
+                   && eh->subtype == htonl(OFP_EXT_TABLE_REPLACE)) {
+            ofp_ext_table_replace(string, oh);
+        } else if (len >= sizeof(struct ofp_ext_set_table)
+                   && eh->subtype == htonl(OFP_EXT_SET_TABLE)) {
+            ds_put_format(string, " set table %"PRIu8"\n",
+                          ((const struct ofp_ext_set_table *) oh)->table_id);
+        } else if (len >= sizeof(struct ofp_ext_table_miss)
+                   && eh->subtype == htonl(OFP_EXT_TABLE_MISS)) {
+            ofp_ext_table_miss(string, oh);
+        } else if (eh->subtype == htonl(OFP_EXT_PACKET_OUT_BATCH)) {
+            ofp_ext_packet_out_batch(string, oh, len, verbosity);
+        }
+        break;
+    }
     }
 }
 
@@ -1629,12 +2287,31 @@ ofp_print(FILE *stream, const void *oh, size_t len, int verbosity)
 }
 
 /* Dumps the contents of the Ethernet frame in the 'len' bytes starting at
- * 'data' to 'stream' using tcpdump.  'total_len' specifies the full length of
- * the Ethernet frame (of which 'len' bytes were captured).
- *
- * This starts and kills a tcpdump subprocess so it's quite expensive. */
+ * 'data' to 'stream' in the format of ofp_packet_to_string().  'total_len'
+ * specifies the full length of the Ethernet frame (of which 'len' bytes were
+ * captured). */
 void
 ofp_print_packet(FILE *stream, const void *data, size_t len, size_t total_len)
 {
     print_and_free(stream, ofp_packet_to_string(data, len, total_len));
 }
+
+/* Returns the OpenFlow message type named 'name', which may be given as in
+ * the output of ofp_message_type_to_string(), e.g. "OFPT_PACKET_IN", or in
+ * lowercase without the "OFPT_" prefix, e.g. "packet_in", or -1 if 'name' is
+ * not a known type. */
+int
+ofp_message_type_from_string(const char *name)
+{
+    const struct openflow_packet *pkt;
+
+    if (!strncasecmp(name, "OFPT_", 5)) {
+        name += 5;
+    }
+    for (pkt = packets; pkt < &packets[ARRAY_SIZE(packets)]; pkt++) {
+        if (!strcasecmp(name, pkt->name)) {
+            return pkt->type;
+        }
+    }
+    return -1;
+}
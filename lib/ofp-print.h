@@ -39,6 +39,8 @@
 #include <stdint.h>
 #include <stdio.h>
 
+struct ds;
+struct ofp_action_header;
 struct ofp_flow_mod;
 struct ofp_match;
 
@@ -51,8 +53,13 @@ void ofp_print_packet(FILE *stream, const void *data, size_t len, size_t total_l
 
 char *ofp_to_string(const void *, size_t, int verbosity);
 char *ofp_match_to_string(const struct ofp_match *, int verbosity);
+char *ofp_actions_to_string(const struct ofp_action_header *,
+                            size_t actions_len);
+void ofp_put_actions(struct ds *, const struct ofp_action_header *,
+                     size_t actions_len);
 char *ofp_packet_to_string(const void *data, size_t len, size_t total_len);
 char *ofp_message_type_to_string(uint8_t type);
+int ofp_message_type_from_string(const char *);
 
 #ifdef  __cplusplus
 }
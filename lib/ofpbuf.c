@@ -34,8 +34,11 @@
 #include <config.h>
 #include "ofpbuf.h"
 #include <assert.h>
+#include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
+#include "compiler.h"
+#include "hugepage.h"
 #include "util.h"
 
 /* Initializes 'b' as an empty ofpbuf that contains the 'allocated' bytes of
@@ -52,8 +55,14 @@ ofpbuf_use(struct ofpbuf *b, void *base, size_t allocated)
     b->allocated = allocated;
     b->size = 0;
     b->l2 = b->l3 = b->l4 = b->l7 = NULL;
+    b->parsed_layer = 0;
     b->next = NULL;
     b->private = NULL;
+    b->rxhash = 0;
+    b->pool = NULL;
+    b->pooled = false;
+    b->shared = NULL;
+    b->n_refs = 0;
 }
 
 /* Initializes 'b' as an empty ofpbuf with an initial capacity of 'size'
@@ -64,12 +73,18 @@ ofpbuf_init(struct ofpbuf *b, size_t size)
     ofpbuf_use(b, size ? xmalloc(size) : NULL, size);
 }
 
+static void ofpbuf_release(struct ofpbuf *);
+
 /* Frees memory that 'b' points to. */
 void
 ofpbuf_uninit(struct ofpbuf *b) 
 {
     if (b) {
-        free(b->base);
+        if (b->shared) {
+            ofpbuf_release(b);
+        } else if (!b->pooled) {
+            free(b->base);
+        }
     }
 }
 
@@ -105,11 +120,145 @@ ofpbuf_clone_data(const void *data, size_t size)
     return b;
 }
 
-/* Frees memory that 'b' points to, as well as 'b' itself. */
+/* Returns a new ofpbuf whose data is the same memory as 'b''s data, instead
+ * of a copy.  'b' and every ofpbuf shared with it may have its own data
+ * pointer, size, headroom use, and 'next' and 'private' members, and each
+ * must be deleted separately; the memory is freed (or returned to its pool)
+ * along with the last of them.
+ *
+ * The shared bytes must not be modified while they are shared, unless the
+ * modifying ofpbuf first calls ofpbuf_unshare().  Growing a shared ofpbuf
+ * with ofpbuf_put() and related functions gives it its own copy of the data
+ * automatically.  Sharing is not thread-safe. */
+struct ofpbuf *
+ofpbuf_share(struct ofpbuf *b)
+{
+    struct ofpbuf *copy;
+
+    if (!b->shared) {
+        /* Move ownership of 'base' into a separate ofpbuf that lives as long
+         * as any of the buffers sharing it. */
+        struct ofpbuf *owner = xmalloc(sizeof *owner);
+        *owner = *b;
+        owner->next = NULL;
+        owner->private = NULL;
+        owner->n_refs = 1;
+        b->shared = owner;
+        b->pool = NULL;
+    }
+
+    copy = xmalloc(sizeof *copy);
+    *copy = *b;
+    copy->next = NULL;
+    copy->private = NULL;
+    b->shared->n_refs++;
+    return copy;
+}
+
+/* Returns a new ofpbuf that shares the first 'size' bytes of 'b''s data, as
+ * with ofpbuf_share(), and then pulls those bytes off the front of 'b'.  The
+ * new ofpbuf has no headroom or tailroom, so growing it in either direction
+ * gives it a private copy instead of touching the memory around it. */
+struct ofpbuf *
+ofpbuf_share_head(struct ofpbuf *b, size_t size)
+{
+    struct ofpbuf *head = ofpbuf_share(b);
+
+    assert(size <= b->size);
+    head->base = head->data;
+    head->allocated = head->size = size;
+    head->l2 = head->l3 = head->l4 = head->l7 = NULL;
+    ofpbuf_pull(b, size);
+    return head;
+}
+
+/* Returns true if some other ofpbuf currently shares 'b''s memory. */
+bool
+ofpbuf_is_shared(const struct ofpbuf *b)
+{
+    return b->shared && b->shared->n_refs > 1;
+}
+
+/* Drops 'b''s reference to the memory it shares, freeing the memory if 'b'
+ * was the last ofpbuf to use it. */
+static void
+ofpbuf_release(struct ofpbuf *b)
+{
+    struct ofpbuf *owner = b->shared;
+
+    b->shared = NULL;
+    if (!--owner->n_refs) {
+        ofpbuf_delete(owner);
+    }
+}
+
+/* Points 'b' at 'new_base', a 'new_allocated'-byte block obtained from
+ * malloc(), after copying 'b''s current contents into it 'shift' bytes from
+ * its start. */
+static void
+ofpbuf_rebase(struct ofpbuf *b, void *new_base, size_t new_allocated,
+              size_t shift)
+{
+    uintptr_t base_delta = (char*)new_base + shift - (char*)b->base;
+
+    memcpy((char*)new_base + shift, b->base, b->allocated);
+    if (b->shared) {
+        ofpbuf_release(b);
+    } else if (!b->pooled) {
+        free(b->base);
+    }
+    b->base = new_base;
+    b->pooled = false;
+    b->allocated = new_allocated;
+    b->data = (char*)b->data + base_delta;
+    if (b->l2) {
+        b->l2 = (char*)b->l2 + base_delta;
+    }
+    if (b->l3) {
+        b->l3 = (char*)b->l3 + base_delta;
+    }
+    if (b->l4) {
+        b->l4 = (char*)b->l4 + base_delta;
+    }
+    if (b->l7) {
+        b->l7 = (char*)b->l7 + base_delta;
+    }
+}
+
+/* Ensures that the data in 'b' is not shared with any other ofpbuf, copying
+ * it if necessary, so that the caller may modify it. */
+void
+ofpbuf_unshare(struct ofpbuf *b)
+{
+    struct ofpbuf *owner = b->shared;
+
+    if (!owner) {
+        return;
+    } else if (owner->n_refs == 1) {
+        /* 'b' is the only user left, so it can take the memory over.  'b'
+         * might cover only part of it (see ofpbuf_share_head()). */
+        b->base = owner->base;
+        b->allocated = owner->allocated;
+        b->pool = owner->pool;
+        b->pooled = owner->pooled;
+        b->shared = NULL;
+        free(owner);
+    } else {
+        ofpbuf_rebase(b, xmalloc(b->allocated), b->allocated, 0);
+    }
+}
+
+static bool ofpbuf_pool_put(struct ofpbuf_pool *, struct ofpbuf *);
+
+/* Frees memory that 'b' points to, as well as 'b' itself.  If 'b' came from
+ * an ofpbuf_pool, it is returned to the pool instead, if there is room. */
 void
 ofpbuf_delete(struct ofpbuf *b) 
 {
     if (b) {
+        if (b->pool && ofpbuf_pool_put(b->pool, b)) {
+            return;
+        }
         ofpbuf_uninit(b);
         free(b);
     }
@@ -140,32 +289,25 @@ ofpbuf_prealloc_tailroom(struct ofpbuf *b, size_t size)
 {
     if (size > ofpbuf_tailroom(b)) {
         size_t new_allocated = b->allocated + MAX(size, 64);
-        void *new_base = xmalloc(new_allocated);
-        uintptr_t base_delta = (char*)new_base - (char*)b->base;
-        memcpy(new_base, b->base, b->allocated);
-        free(b->base);
-        b->base = new_base;
-        b->allocated = new_allocated;
-        b->data = (char*)b->data + base_delta;
-        if (b->l2) {
-            b->l2 = (char*)b->l2 + base_delta;
-        }
-        if (b->l3) {
-            b->l3 = (char*)b->l3 + base_delta;
-        }
-        if (b->l4) {
-            b->l4 = (char*)b->l4 + base_delta;
-        }
-        if (b->l7) {
-            b->l7 = (char*)b->l7 + base_delta;
-        }
+        ofpbuf_rebase(b, xmalloc(new_allocated), new_allocated, 0);
+    } else if (b->shared) {
+        /* Appended bytes may overlap another ofpbuf's data. */
+        ofpbuf_unshare(b);
     }
 }
 
+/* Ensures that 'b' has room for at least 'size' bytes at its head end,
+ * reallocating and copying its data if necessary. */
 void
 ofpbuf_prealloc_headroom(struct ofpbuf *b, size_t size) 
 {
-    assert(size <= ofpbuf_headroom(b));
+    size_t headroom = ofpbuf_headroom(b);
+
+    if (size > headroom) {
+        size_t shift = MAX(size, 64) - headroom;
+        ofpbuf_rebase(b, xmalloc(b->allocated + shift), b->allocated + shift,
+                      shift);
+    }
 }
 
 /* Appends 'size' bytes of data to the tail end of 'b', reallocating and
@@ -290,3 +432,208 @@ ofpbuf_try_pull(struct ofpbuf *b, size_t size)
 {
     return b->size >= size ? ofpbuf_pull(b, size) : NULL;
 }
+
+/* A pool of recycled ofpbufs that all have the same capacity and headroom,
+ * e.g. for receiving packets from a network device with a given MTU.
+ *
+ * Not thread-safe: a pool and the buffers obtained from it must all be used
+ * from a single thread, except for the per-thread pools behind
+ * ofpbuf_new_msg(), which tolerate their buffers being deleted elsewhere. */
+struct ofpbuf_pool {
+    const void *owner;          /* Owning thread's 'thread_tag', or NULL. */
+    size_t headroom;            /* Headroom of each fresh buffer. */
+    size_t size;                /* Bytes allocated for each buffer. */
+    size_t max_free;            /* Maximum length of 'free_list'. */
+    size_t n_free;              /* Current length of 'free_list'. */
+    size_t n_live;              /* Buffers handed out and not yet returned. */
+    bool destroyed;             /* Free when 'n_live' drops to 0? */
+    struct ofpbuf *free_list;   /* Returned buffers, linked through 'next'. */
+
+    /* Memory carved into buffers by ofpbuf_pool_prealloc(), or NULL. */
+    void *slab;
+    size_t slab_size;
+};
+
+/* Creates and returns a new pool of buffers that each have 'size' bytes of
+ * capacity, 'headroom' of which is reserved in front of the data.  Up to
+ * 'max_free' buffers are kept for reuse once they are deleted. */
+struct ofpbuf_pool *
+ofpbuf_pool_create(size_t headroom, size_t size, size_t max_free)
+{
+    struct ofpbuf_pool *pool = xmalloc(sizeof *pool);
+
+    assert(headroom <= size);
+    pool->owner = NULL;
+    pool->headroom = headroom;
+    pool->size = size;
+    pool->max_free = max_free;
+    pool->n_free = 0;
+    pool->n_live = 0;
+    pool->destroyed = false;
+    pool->free_list = NULL;
+    pool->slab = NULL;
+    pool->slab_size = 0;
+    return pool;
+}
+
+static void
+ofpbuf_pool_free(struct ofpbuf_pool *pool)
+{
+    while (pool->free_list) {
+        struct ofpbuf *b = pool->free_list;
+        pool->free_list = b->next;
+        ofpbuf_uninit(b);
+        free(b);
+    }
+    hugepage_free(pool->slab, pool->slab_size);
+    free(pool);
+}
+
+/* Destroys 'pool'.  Buffers obtained from 'pool' that are still in use remain
+ * valid; the pool's memory is released when the last of them is deleted. */
+void
+ofpbuf_pool_destroy(struct ofpbuf_pool *pool)
+{
+    if (pool) {
+        if (pool->n_live) {
+            pool->destroyed = true;
+        } else {
+            ofpbuf_pool_free(pool);
+        }
+    }
+}
+
+/* Returns an empty buffer from 'pool', with the pool's headroom in front of
+ * its data.  ofpbuf_delete() returns the buffer to 'pool'. */
+struct ofpbuf *
+ofpbuf_pool_get(struct ofpbuf_pool *pool)
+{
+    struct ofpbuf *b;
+
+    if (pool->free_list) {
+        bool pooled;
+
+        b = pool->free_list;
+        pool->free_list = b->next;
+        pool->n_free--;
+        pooled = b->pooled;
+        ofpbuf_use(b, b->base, b->allocated);
+        b->pooled = pooled;
+    } else {
+        b = ofpbuf_new(pool->size);
+    }
+    b->data = (char*)b->data + pool->headroom;
+    b->pool = pool;
+    pool->n_live++;
+    return b;
+}
+
+/* Fills 'pool' with at least 'n_buffers' idle buffers whose memory comes from
+ * a single region obtained from hugepage_alloc(), so that it may be backed by
+ * huge pages on the NUMA node that hugepage_configure() selected.  The
+ * region is rounded up to a whole number of pages, and every buffer that
+ * fits in it is added.  Buffers from the region always return to 'pool',
+ * regardless of its 'max_free'.  Returns the number of buffers added, which
+ * is 0 if 'pool' already has a region or if memory is exhausted. */
+size_t
+ofpbuf_pool_prealloc(struct ofpbuf_pool *pool, size_t n_buffers)
+{
+    size_t stride = ROUND_UP(pool->size, 64);
+    size_t n, i;
+
+    if (pool->slab || !n_buffers) {
+        return 0;
+    }
+    pool->slab = hugepage_alloc(n_buffers * stride);
+    if (!pool->slab) {
+        return 0;
+    }
+    pool->slab_size = n_buffers * stride;
+
+    /* Use the rest of the last page too. */
+    n = hugepage_alloc_size(pool->slab_size) / stride;
+    for (i = 0; i < n; i++) {
+        struct ofpbuf *b = xmalloc(sizeof *b);
+
+        ofpbuf_use(b, (char *) pool->slab + i * stride, pool->size);
+        b->pooled = true;
+        b->next = pool->free_list;
+        pool->free_list = b;
+        pool->n_free++;
+    }
+    return n;
+}
+
+/* Each thread's 'thread_tag' has a distinct address, which identifies the
+ * thread that owns a pool without requiring pthreads in every program. */
+static THREAD_LOCAL char thread_tag;
+
+/* Takes 'b', which was obtained from 'pool', back into 'pool' if there is
+ * room for it.  Returns true if 'b' was taken, false if the caller should
+ * free it. */
+static bool
+ofpbuf_pool_put(struct ofpbuf_pool *pool, struct ofpbuf *b)
+{
+    if (pool->owner && pool->owner != &thread_tag) {
+        /* Deleted by a thread other than the owner: leave the pool alone.
+         * Per-thread pools are never destroyed, so 'n_live' may drift. */
+        b->pool = NULL;
+        return false;
+    }
+    assert(pool->n_live > 0);
+    pool->n_live--;
+    b->pool = NULL;
+    if (pool->destroyed) {
+        if (!pool->n_live) {
+            ofpbuf_pool_free(pool);
+        }
+        return false;
+    }
+    if (!b->pooled
+        && (pool->n_free >= pool->max_free || b->allocated < pool->size
+            || b->allocated > pool->size * 4)) {
+        /* Too small to reuse, or grown so large that caching it would pin a
+         * lot of memory. */
+        return false;
+    }
+    b->next = pool->free_list;
+    pool->free_list = b;
+    pool->n_free++;
+    return true;
+}
+
+/* Capacities of the buffers cached by ofpbuf_new_msg().  The smallest class
+ * covers echo, barrier, error, and flow-removed messages; the middle one
+ * packet-ins truncated to the default miss_send_len; the largest one full
+ * Ethernet frames. */
+static const size_t msg_size_classes[] = { 128, 512, 2048 };
+#define N_MSG_SIZE_CLASSES ARRAY_SIZE(msg_size_classes)
+#define MSG_POOL_MAX_FREE 64
+
+static THREAD_LOCAL struct ofpbuf_pool *msg_pools[N_MSG_SIZE_CLASSES];
+
+/* Returns a new, empty ofpbuf with a capacity of at least 'size' bytes, meant
+ * for a short-lived message that is deleted soon after it is sent.  Small
+ * buffers come from a per-thread freelist of the smallest fitting size class
+ * and ofpbuf_delete() returns them there, so steady-state traffic of small
+ * messages does not touch malloc.  Larger requests fall back to
+ * ofpbuf_new(). */
+struct ofpbuf *
+ofpbuf_new_msg(size_t size)
+{
+    size_t i;
+
+    for (i = 0; i < N_MSG_SIZE_CLASSES; i++) {
+        if (size <= msg_size_classes[i]) {
+            struct ofpbuf_pool *pool = msg_pools[i];
+            if (!pool) {
+                pool = ofpbuf_pool_create(0, msg_size_classes[i],
+                                          MSG_POOL_MAX_FREE);
+                pool->owner = &thread_tag;
+                msg_pools[i] = pool;
+            }
+            return ofpbuf_pool_get(pool);
+        }
+    }
+    return ofpbuf_new(size);
+}
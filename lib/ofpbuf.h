@@ -34,7 +34,11 @@
 #ifndef OFPBUF_H
 #define OFPBUF_H 1
 
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+
+struct ofpbuf_pool;
 
 /* Buffer for holding arbitrary data.  An ofpbuf is automatically reallocated
  * as necessary if it grows too large for the available memory. */
@@ -49,9 +53,20 @@ struct ofpbuf {
     void *l3;                   /* Network-level header. */
     void *l4;                   /* Transport-level header. */
     void *l7;                   /* Application data. */
+    int parsed_layer;           /* enum flow_layer that l2...l7 reflect. */
 
     struct ofpbuf *next;        /* Next in a list of ofpbufs. */
     void *private;              /* Private pointer for use by owner. */
+    uint32_t rxhash;            /* Flow hash from the kernel on receive, or 0
+                                 * if unknown (see netdev_setup_rx_ring()). */
+
+    struct ofpbuf_pool *pool;   /* Pool to return to on delete, or NULL. */
+    bool pooled;                /* 'base' is part of a pool's slab (see
+                                 * ofpbuf_pool_prealloc()), not malloc()'d. */
+
+    /* Sharing of 'base' among several ofpbufs (see ofpbuf_share()). */
+    struct ofpbuf *shared;      /* Owner of 'base' if shared, else NULL. */
+    unsigned int n_refs;        /* In an owner, ofpbufs sharing 'base'. */
 };
 
 void ofpbuf_use(struct ofpbuf *, void *, size_t);
@@ -65,6 +80,11 @@ struct ofpbuf *ofpbuf_clone(const struct ofpbuf *);
 struct ofpbuf *ofpbuf_clone_data(const void *, size_t);
 void ofpbuf_delete(struct ofpbuf *);
 
+struct ofpbuf *ofpbuf_share(struct ofpbuf *);
+struct ofpbuf *ofpbuf_share_head(struct ofpbuf *, size_t);
+bool ofpbuf_is_shared(const struct ofpbuf *);
+void ofpbuf_unshare(struct ofpbuf *);
+
 void *ofpbuf_at(const struct ofpbuf *, size_t offset, size_t size);
 void *ofpbuf_at_assert(const struct ofpbuf *, size_t offset, size_t size);
 void *ofpbuf_tail(const struct ofpbuf *);
@@ -86,4 +106,12 @@ void ofpbuf_clear(struct ofpbuf *);
 void *ofpbuf_pull(struct ofpbuf *, size_t);
 void *ofpbuf_try_pull(struct ofpbuf *, size_t);
 
+struct ofpbuf *ofpbuf_new_msg(size_t);
+
+struct ofpbuf_pool *ofpbuf_pool_create(size_t headroom, size_t size,
+                                       size_t max_free);
+void ofpbuf_pool_destroy(struct ofpbuf_pool *);
+struct ofpbuf *ofpbuf_pool_get(struct ofpbuf_pool *);
+size_t ofpbuf_pool_prealloc(struct ofpbuf_pool *, size_t n_buffers);
+
 #endif /* ofpbuf.h */
@@ -32,9 +32,14 @@
 
 #include <config.h>
 #include <netinet/in.h>
+#include <string.h>
+#include <time.h>
 
 #include "openflow/openflow.h"
 #include "ofpstat.h"
+#include "timeval.h"
+#include "util.h"
+#include "xtoxll.h"
 
 #define INC_IFP_STAT(ifps, tag) do {++(ifps)->tag;} while (0)
 
@@ -257,3 +262,83 @@ ofpstat_inc_protocol_stat(struct ofpstat *ifps, struct ofp_header *hdr)
 		break;
 	}
 }
+
+void
+ofpstat_proc_init(struct ofpstat_proc *proc)
+{
+	memset(&proc->stats, 0, sizeof proc->stats);
+	proc->start_msec = time_msec();
+}
+
+/* Returns the current time in nanoseconds, for passing as 'start' to
+ * ofpstat_proc_record() and ofpstat_proc_record_flow(). */
+uint64_t
+ofpstat_proc_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Returns 0 if 'n' is 0, otherwise 1 plus the base-2 log of 'n', rounded
+ * down, but no more than 'max'. */
+static int
+log2_bucket(uint64_t n, int max)
+{
+	int bucket = n ? 64 - __builtin_clzll(n) : 0;
+	return MIN(bucket, max);
+}
+
+/* Counts a message of OFPT_* 'type' whose processing began at 'start'. */
+void
+ofpstat_proc_record(struct ofpstat_proc *proc, uint8_t type, uint64_t start)
+{
+	uint64_t nsec = ofpstat_proc_now() - start;
+	struct private_proc_type *t;
+
+	if (type >= PRIVATE_PROC_N_TYPES) {
+		return;
+	}
+	t = &proc->stats.types[type];
+	t->n_msgs++;
+	t->total_nsec += nsec;
+	if (nsec > t->max_nsec) {
+		t->max_nsec = nsec;
+	}
+	t->buckets[log2_bucket(nsec / 1000, PRIVATE_PROC_BUCKETS - 1)]++;
+}
+
+/* Counts a flow addition, if 'add' is true, or modification, that began at
+ * 'start' when the flow tables held 'n_flows' flows. */
+void
+ofpstat_proc_record_flow(struct ofpstat_proc *proc, bool add,
+			 unsigned int n_flows, uint64_t start)
+{
+	uint64_t nsec = ofpstat_proc_now() - start;
+	struct private_proc_size *size;
+
+	size = &proc->stats.sizes[log2_bucket(n_flows, PRIVATE_PROC_SIZES - 1)];
+	if (add) {
+		size->n_adds++;
+		size->add_nsec += nsec;
+	} else {
+		size->n_mods++;
+		size->mod_nsec += nsec;
+	}
+}
+
+/* Stores 'proc' into 'stats' in network byte order. */
+void
+ofpstat_proc_to_net(const struct ofpstat_proc *proc,
+		    struct private_proc_stats *stats)
+{
+	const uint64_t *src = (const uint64_t *) &proc->stats;
+	uint64_t *dst = (uint64_t *) stats;
+	size_t i;
+
+	for (i = 0; i < sizeof *stats / sizeof *dst; i++) {
+		dst[i] = htonll(src[i]);
+	}
+	stats->duration_msec = htonll(time_msec() - proc->start_msec);
+}
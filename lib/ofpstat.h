@@ -33,6 +33,10 @@
 #ifndef OFPSTAT_H_
 #define OFPSTAT_H_
 
+#include <stdbool.h>
+#include <stdint.h>
+#include "openflow/private-ext.h"
+
 struct ofp_header;
 
 struct ofpstat {
@@ -99,4 +103,20 @@ struct ofpstat {
 
 void ofpstat_inc_protocol_stat(struct ofpstat *, struct ofp_header *);
 
+/* Time taken to process received messages, kept in host byte order in the
+ * form of the PRIVATEOPT_PROCESSING_STATS_REPLY value. */
+struct ofpstat_proc {
+	struct private_proc_stats stats;
+	long long int start_msec;	/* When counting began. */
+};
+
+void ofpstat_proc_init(struct ofpstat_proc *);
+uint64_t ofpstat_proc_now(void);
+void ofpstat_proc_record(struct ofpstat_proc *, uint8_t type,
+			 uint64_t start);
+void ofpstat_proc_record_flow(struct ofpstat_proc *, bool add,
+			      unsigned int n_flows, uint64_t start);
+void ofpstat_proc_to_net(const struct ofpstat_proc *,
+			 struct private_proc_stats *);
+
 #endif
@@ -37,8 +37,10 @@
 #include <errno.h>
 #include <inttypes.h>
 #include <string.h>
+#include <sys/time.h>
 #include "compiler.h"
 #include "ofpbuf.h"
+#include "util.h"
 
 #define THIS_MODULE VLM_pcap
 #include "vlog.h"
@@ -59,6 +61,10 @@ struct pcaprec_hdr {
     uint32_t incl_len;       /* number of octets of packet saved in file */
     uint32_t orig_len;       /* actual length of packet */
 } PACKED;
+BUILD_ASSERT_DECL(sizeof(struct pcaprec_hdr) == PCAP_RECORD_HEADER_LEN);
+
+/* Longest packet that pcap_write() and pcap_write_at() save in full. */
+#define PCAP_SNAPLEN 65535
 
 FILE *
 pcap_open(const char *file_name, const char *mode)
@@ -75,7 +81,7 @@ pcap_open(const char *file_name, const char *mode)
     }
 
     if (mode[0] == 'r') {
-        if (!pcap_read_header(file)) {
+        if (pcap_read_header(file)) {
             fclose(file);
             return NULL;
         }
@@ -114,7 +120,7 @@ pcap_write_header(FILE *file)
     ph.version_minor = 4;
     ph.thiszone = 0;
     ph.sigfigs = 0;
-    ph.snaplen = 1518;
+    ph.snaplen = PCAP_SNAPLEN;
     ph.network = 1;             /* Ethernet */
     fwrite(&ph, sizeof ph, 1, file);
 }
@@ -169,12 +175,21 @@ pcap_read(FILE *file, struct ofpbuf **bufp)
 
 void
 pcap_write(FILE *file, struct ofpbuf *buf)
+{
+    pcap_write_at(file, buf, NULL);
+}
+
+/* Writes 'buf' to 'file' as a packet captured at 'when', or at time 0 if
+ * 'when' is null.  Only the first PCAP_SNAPLEN bytes of a longer packet are
+ * saved, although the record still gives its full length. */
+void
+pcap_write_at(FILE *file, const struct ofpbuf *buf, const struct timeval *when)
 {
     struct pcaprec_hdr prh;
-    prh.ts_sec = 0;
-    prh.ts_usec = 0;
-    prh.incl_len = buf->size;
+    prh.ts_sec = when ? when->tv_sec : 0;
+    prh.ts_usec = when ? when->tv_usec : 0;
+    prh.incl_len = MIN(buf->size, PCAP_SNAPLEN);
     prh.orig_len = buf->size;
     fwrite(&prh, sizeof prh, 1, file);
-    fwrite(buf->data, buf->size, 1, file);
+    fwrite(buf->data, prh.incl_len, 1, file);
 }
@@ -37,11 +37,16 @@
 #include <stdio.h>
 
 struct ofpbuf;
+struct timeval;
+
+/* Bytes that pcap_write() and pcap_write_at() add before each packet. */
+#define PCAP_RECORD_HEADER_LEN 16
 
 FILE *pcap_open(const char *file_name, const char *mode);
 int pcap_read_header(FILE *);
 void pcap_write_header(FILE *);
 int pcap_read(FILE *, struct ofpbuf **);
 void pcap_write(FILE *, struct ofpbuf *);
+void pcap_write_at(FILE *, const struct ofpbuf *, const struct timeval *);
 
 #endif /* dhcp.h */
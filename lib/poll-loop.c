@@ -38,7 +38,11 @@
 #include <poll.h>
 #include <stdlib.h>
 #include <string.h>
+#ifdef HAVE_EPOLL_CREATE1
+#include <sys/epoll.h>
+#endif
 #include "backtrace.h"
+#include "compiler.h"
 #include "dynamic-string.h"
 #include "list.h"
 #include "timeval.h"
@@ -49,7 +53,7 @@
 /* An event that will wake the following call to poll_block(). */
 struct poll_waiter {
     /* Set when the waiter is created. */
-    struct list node;           /* Element in global waiters list. */
+    struct list node;           /* Element in thread's waiters list. */
     int fd;                     /* File descriptor. */
     short int events;           /* Events to wait for (POLLIN, POLLOUT). */
     poll_fd_func *function;     /* Callback function, if any, or null. */
@@ -57,29 +61,49 @@ struct poll_waiter {
     struct backtrace *backtrace; /* Optionally, event that created waiter. */
 
     /* Set only when poll_block() is called. */
-    struct pollfd *pollfd;      /* Pointer to element of the pollfds array
-                                   (null if added from a callback). */
+    short int revents;          /* Events that occurred (0 if added from a
+                                   callback). */
 };
 
-/* All active poll waiters. */
-static struct list waiters = LIST_INITIALIZER(&waiters);
+/* Each thread has a poll loop of its own, so all of the state below is
+ * thread-local.  A thread must cancel its own waiters; it may not touch
+ * another thread's. */
+
+/* All active poll waiters.  Initialized on first use by get_waiters(), since
+ * a thread-local variable cannot be initialized with its own address. */
+static THREAD_LOCAL struct list waiters;
 
 /* Number of elements in the waiters list. */
-static size_t n_waiters;
+static THREAD_LOCAL size_t n_waiters;
+
+/* Canceled poll waiters, kept for reuse by new_waiter().  Most programs
+ * register about the same set of waiters on every trip around their main
+ * loops, so after the first few trips this avoids a malloc() and free() per
+ * waiter.  Linked through 'node'. */
+static THREAD_LOCAL struct poll_waiter *free_waiters;
 
 /* Max time to wait in next call to poll_block(), in milliseconds, or -1 to
  * wait forever. */
-static int timeout = -1;
+static THREAD_LOCAL int timeout = -1;
 
 /* Backtrace of 'timeout''s registration, if debugging is enabled. */
-static struct backtrace timeout_backtrace;
+static THREAD_LOCAL struct backtrace timeout_backtrace;
 
 /* Callback currently running, to allow verifying that poll_cancel() is not
  * being called on a running callback. */
 #ifndef NDEBUG
-static struct poll_waiter *running_cb;
+static THREAD_LOCAL struct poll_waiter *running_cb;
 #endif
 
+static struct list *
+get_waiters(void)
+{
+    if (!waiters.next) {
+        list_init(&waiters);
+    }
+    return &waiters;
+}
+
 static struct poll_waiter *new_waiter(int fd, short int events);
 
 /* Registers 'fd' as waiting for the specified 'events' (which should be POLLIN
@@ -144,24 +168,19 @@ log_wakeup(const struct backtrace *backtrace, const char *format, ...)
     ds_destroy(&ds);
 }
 
-/* Blocks until one or more of the events registered with poll_fd_wait()
- * occurs, or until the minimum duration registered with poll_timer_wait()
- * elapses, or not at all if poll_immediate_wake() has been called.
- *
- * Also executes any autonomous subroutines registered with poll_fd_callback(),
- * if their file descriptors have become ready. */
-void
-poll_block(void)
+/* Waits with poll() for the events that 'waiters' wants, and stores the
+ * events that occurred in each waiter's 'revents'.  Returns the value returned
+ * by time_poll(). */
+static int
+block_poll(void)
 {
-    static struct pollfd *pollfds;
-    static size_t max_pollfds;
+    static THREAD_LOCAL struct pollfd *pollfds;
+    static THREAD_LOCAL size_t max_pollfds;
 
     struct poll_waiter *pw;
-    struct list *node;
     int n_pollfds;
     int retval;
 
-    assert(!running_cb);
     if (max_pollfds < n_waiters) {
         max_pollfds = n_waiters;
         pollfds = xrealloc(pollfds, max_pollfds * sizeof *pollfds);
@@ -169,7 +188,6 @@ poll_block(void)
 
     n_pollfds = 0;
     LIST_FOR_EACH (pw, struct poll_waiter, node, &waiters) {
-        pw->pollfd = &pollfds[n_pollfds];
         pollfds[n_pollfds].fd = pw->fd;
         pollfds[n_pollfds].events = pw->events;
         pollfds[n_pollfds].revents = 0;
@@ -177,6 +195,212 @@ poll_block(void)
     }
 
     retval = time_poll(pollfds, n_pollfds, timeout);
+
+    n_pollfds = 0;
+    LIST_FOR_EACH (pw, struct poll_waiter, node, &waiters) {
+        pw->revents = pollfds[n_pollfds++].revents;
+    }
+    return retval;
+}
+
+#ifdef HAVE_EPOLL_CREATE1
+/* epoll backend.
+ *
+ * Registrations made with poll_fd_wait() last for a single poll_block(), but
+ * most programs wait on the same file descriptors each time around their main
+ * loops.  Instead of passing the kernel every file descriptor on every call,
+ * as poll() must, this backend leaves each file descriptor registered with an
+ * epoll instance for as long as some waiter keeps asking for it, and only
+ * tells the kernel about changes.  The kernel's work per poll_block() is then
+ * proportional to the number of ready file descriptors.
+ *
+ * A file descriptor that is still registered when it is closed and then
+ * reused would stay silent, so code that closes file descriptors passed to
+ * poll_fd_wait() must call poll_fd_closing() first. */
+
+/* The poll() and epoll event bits are the same on Linux. */
+BUILD_ASSERT_DECL(POLLIN == EPOLLIN && POLLOUT == EPOLLOUT
+                  && POLLERR == EPOLLERR && POLLHUP == EPOLLHUP);
+
+/* State of a file descriptor, in 'fd_states' indexed by file descriptor. */
+struct fd_state {
+    unsigned int serial;        /* 'epoll_serial' when last waited on. */
+    short int events;           /* Events wanted by this poll_block(). */
+    short int registered;       /* Events registered with 'epoll_fd'. */
+    short int revents;          /* Events that occurred. */
+};
+
+/* A set of file descriptors. */
+struct fd_list {
+    int *fds;
+    size_t n, allocated;
+};
+
+static THREAD_LOCAL int epoll_fd = -2; /* -2 if not yet created, -1 if
+                                         * unusable. */
+static THREAD_LOCAL struct fd_state *fd_states;
+static THREAD_LOCAL size_t n_fd_states;
+static THREAD_LOCAL unsigned int epoll_serial;
+static THREAD_LOCAL struct fd_list cur_fds, prev_fds;
+static THREAD_LOCAL struct epoll_event *epoll_events;
+static THREAD_LOCAL size_t max_epoll_events;
+
+/* Returns true if the epoll backend is usable, creating its epoll instance
+ * on the first call. */
+static bool
+epoll_available(void)
+{
+    if (epoll_fd == -2) {
+        epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (epoll_fd < 0) {
+            VLOG_WARN("epoll_create1 failed (%s), falling back to poll",
+                      strerror(errno));
+        }
+    }
+    return epoll_fd >= 0;
+}
+
+static struct fd_state *
+get_fd_state(int fd)
+{
+    if (fd >= n_fd_states) {
+        size_t new_n = MAX(fd + 1, n_fd_states * 2);
+        fd_states = xrealloc(fd_states, new_n * sizeof *fd_states);
+        memset(&fd_states[n_fd_states], 0,
+               (new_n - n_fd_states) * sizeof *fd_states);
+        n_fd_states = new_n;
+    }
+    return &fd_states[fd];
+}
+
+/* Changes the kernel's registration of 'fd' to 'state->events'.  Returns
+ * false if 'fd' cannot be registered, in which case its 'revents' is set
+ * the way poll() would report it. */
+static bool
+update_registration(int fd, struct fd_state *state)
+{
+    struct epoll_event event;
+    int op = state->registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+    int retval;
+
+    memset(&event, 0, sizeof event);
+    event.events = state->events;
+    event.data.fd = fd;
+    retval = epoll_ctl(epoll_fd, op, fd, &event);
+    if (retval < 0 && (errno == ENOENT || errno == EEXIST)) {
+        /* Someone closed 'fd' without poll_fd_closing(), or registered it
+         * behind our back.  Try the other way. */
+        op = op == EPOLL_CTL_MOD ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+        retval = epoll_ctl(epoll_fd, op, fd, &event);
+    }
+    if (retval < 0) {
+        /* poll() reports regular files, which epoll refuses with EPERM, as
+         * always ready, and reports bad file descriptors with POLLNVAL. */
+        state->registered = 0;
+        state->revents = errno == EPERM ? state->events : POLLNVAL;
+        return false;
+    }
+    state->registered = state->events;
+    return true;
+}
+
+/* Waits with epoll for the events that 'waiters' wants, and stores the events
+ * that occurred in each waiter's 'revents'.  Returns the value returned by
+ * time_epoll_wait(). */
+static int
+block_epoll(void)
+{
+    struct poll_waiter *pw;
+    struct fd_list tmp;
+    bool immediate;
+    size_t i;
+    int retval;
+
+    /* Collect the events wanted on each file descriptor. */
+    epoll_serial++;
+    cur_fds.n = 0;
+    LIST_FOR_EACH (pw, struct poll_waiter, node, &waiters) {
+        struct fd_state *state = get_fd_state(pw->fd);
+        if (state->serial != epoll_serial) {
+            state->serial = epoll_serial;
+            state->events = 0;
+            state->revents = 0;
+            if (cur_fds.n >= cur_fds.allocated) {
+                cur_fds.fds = x2nrealloc(cur_fds.fds, &cur_fds.allocated,
+                                         sizeof *cur_fds.fds);
+            }
+            cur_fds.fds[cur_fds.n++] = pw->fd;
+        }
+        state->events |= pw->events;
+    }
+
+    /* Drop the registrations that nothing wants any longer, then bring the
+     * rest up to date. */
+    for (i = 0; i < prev_fds.n; i++) {
+        struct fd_state *state = &fd_states[prev_fds.fds[i]];
+        if (state->serial != epoll_serial && state->registered) {
+            epoll_ctl(epoll_fd, EPOLL_CTL_DEL, prev_fds.fds[i], NULL);
+            state->registered = 0;
+        }
+    }
+    immediate = false;
+    for (i = 0; i < cur_fds.n; i++) {
+        struct fd_state *state = &fd_states[cur_fds.fds[i]];
+        if (state->events != state->registered
+            && !update_registration(cur_fds.fds[i], state)) {
+            immediate = true;
+        }
+    }
+
+    if (max_epoll_events < cur_fds.n) {
+        max_epoll_events = cur_fds.n;
+        epoll_events = xrealloc(epoll_events,
+                                max_epoll_events * sizeof *epoll_events);
+    }
+    retval = time_epoll_wait(epoll_fd, epoll_events, MAX(cur_fds.n, 1),
+                             immediate ? 0 : timeout);
+    for (i = 0; retval > 0 && i < retval; i++) {
+        fd_states[epoll_events[i].data.fd].revents |= epoll_events[i].events;
+    }
+    if (immediate && retval >= 0) {
+        retval = 1;
+    }
+
+    LIST_FOR_EACH (pw, struct poll_waiter, node, &waiters) {
+        pw->revents = (fd_states[pw->fd].revents
+                       & (pw->events | POLLERR | POLLHUP | POLLNVAL));
+    }
+
+    tmp = prev_fds;
+    prev_fds = cur_fds;
+    cur_fds = tmp;
+    return retval;
+}
+#endif /* HAVE_EPOLL_CREATE1 */
+
+/* Blocks until one or more of the events registered with poll_fd_wait()
+ * occurs, or until the minimum duration registered with poll_timer_wait()
+ * elapses, or not at all if poll_immediate_wake() has been called.
+ *
+ * Also executes any autonomous subroutines registered with poll_fd_callback(),
+ * if their file descriptors have become ready. */
+void
+poll_block(void)
+{
+    struct poll_waiter *pw;
+    struct list *node;
+    int retval;
+
+    assert(!running_cb);
+    get_waiters();
+
+    /* Write out deferred log messages while there is time to spare. */
+    vlog_flush();
+#ifdef HAVE_EPOLL_CREATE1
+    retval = epoll_available() ? block_epoll() : block_poll();
+#else
+    retval = block_poll();
+#endif
     if (retval < 0) {
         static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(1, 5);
         VLOG_ERR_RL(&rl, "poll: %s", strerror(-retval));
@@ -186,7 +410,7 @@ poll_block(void)
 
     for (node = waiters.next; node != &waiters; ) {
         pw = CONTAINER_OF(node, struct poll_waiter, node);
-        if (!pw->pollfd || !pw->pollfd->revents) {
+        if (!pw->revents) {
             if (pw->function) {
                 node = node->next;
                 continue;
@@ -194,11 +418,11 @@ poll_block(void)
         } else {
             if (VLOG_IS_DBG_ENABLED()) {
                 log_wakeup(pw->backtrace, "%s%s%s%s%s on fd %d",
-                           pw->pollfd->revents & POLLIN ? "[POLLIN]" : "",
-                           pw->pollfd->revents & POLLOUT ? "[POLLOUT]" : "",
-                           pw->pollfd->revents & POLLERR ? "[POLLERR]" : "",
-                           pw->pollfd->revents & POLLHUP ? "[POLLHUP]" : "",
-                           pw->pollfd->revents & POLLNVAL ? "[POLLNVAL]" : "",
+                           pw->revents & POLLIN ? "[POLLIN]" : "",
+                           pw->revents & POLLOUT ? "[POLLOUT]" : "",
+                           pw->revents & POLLERR ? "[POLLERR]" : "",
+                           pw->revents & POLLHUP ? "[POLLHUP]" : "",
+                           pw->revents & POLLNVAL ? "[POLLNVAL]" : "",
                            pw->fd);
             }
 
@@ -206,7 +430,7 @@ poll_block(void)
 #ifndef NDEBUG
                 running_cb = pw;
 #endif
-                pw->function(pw->fd, pw->pollfd->revents, pw->aux);
+                pw->function(pw->fd, pw->revents, pw->aux);
 #ifndef NDEBUG
                 running_cb = NULL;
 #endif
@@ -220,6 +444,21 @@ poll_block(void)
     timeout_backtrace.n_frames = 0;
 }
 
+/* Tells the poll loop that 'fd' is about to be closed.  Code that closes a
+ * file descriptor that it has passed to poll_fd_wait() or poll_fd_callback()
+ * must call this first, so that a new file that reuses the same descriptor
+ * number is waited on properly. */
+void
+poll_fd_closing(int fd)
+{
+#ifdef HAVE_EPOLL_CREATE1
+    if (fd >= 0 && fd < n_fd_states && fd_states[fd].registered) {
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+        fd_states[fd].registered = 0;
+    }
+#endif
+}
+
 /* Registers 'function' to be called with argument 'aux' by poll_block() when
  * 'fd' becomes ready for one of the events in 'events', which should be POLLIN
  * or POLLOUT or POLLIN | POLLOUT.
@@ -243,37 +482,64 @@ poll_fd_callback(int fd, short int events, poll_fd_func *function, void *aux)
  *
  * An event registered with poll_fd_wait() may be canceled from its time of
  * registration until the next call to poll_block().  At that point, the event
- * is automatically canceled by the system and its poll_waiter is freed.
+ * is automatically canceled by the system and its poll_waiter is recycled.
  *
  * An event registered with poll_fd_callback() may be canceled from its time of
  * registration until its callback is actually called.  At that point, the
  * event is automatically canceled by the system and its poll_waiter is
- * freed. */
+ * recycled. */
 void
 poll_cancel(struct poll_waiter *pw)
 {
     if (pw) {
         assert(pw != running_cb);
         list_remove(&pw->node);
-        free(pw->backtrace);
-        free(pw);
         n_waiters--;
+
+        /* Keep 'pw', and its backtrace if any, for new_waiter() to reuse. */
+        pw->node.next = free_waiters ? &free_waiters->node : NULL;
+        free_waiters = pw;
     }
 }
 
-/* Creates and returns a new poll_waiter for 'fd' and 'events'. */
+/* Creates and returns a new poll_waiter for 'fd' and 'events', reusing a
+ * canceled one if there is any. */
 static struct poll_waiter *
 new_waiter(int fd, short int events)
 {
-    struct poll_waiter *waiter = xcalloc(1, sizeof *waiter);
+    struct poll_waiter *waiter;
+    struct backtrace *backtrace;
+
     assert(fd >= 0);
+    if (free_waiters) {
+        waiter = free_waiters;
+        free_waiters = (waiter->node.next
+                        ? CONTAINER_OF(waiter->node.next,
+                                       struct poll_waiter, node)
+                        : NULL);
+        backtrace = waiter->backtrace;
+    } else {
+        waiter = xmalloc(sizeof *waiter);
+        backtrace = NULL;
+    }
+
     waiter->fd = fd;
     waiter->events = events;
+    waiter->function = NULL;
+    waiter->aux = NULL;
+    waiter->revents = 0;
     if (VLOG_IS_DBG_ENABLED()) {
-        waiter->backtrace = xmalloc(sizeof *waiter->backtrace);
-        backtrace_capture(waiter->backtrace);
+        if (!backtrace) {
+            backtrace = xmalloc(sizeof *backtrace);
+        }
+        backtrace_capture(backtrace);
+    } else if (backtrace) {
+        free(backtrace);
+        backtrace = NULL;
     }
-    list_push_back(&waiters, &waiter->node);
+    waiter->backtrace = backtrace;
+
+    list_push_back(get_waiters(), &waiter->node);
     n_waiters++;
     return waiter;
 }
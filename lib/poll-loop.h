@@ -69,4 +69,6 @@ struct poll_waiter *poll_fd_callback(int fd, short int events,
 /* Cancel a file descriptor callback or event. */
 void poll_cancel(struct poll_waiter *);
 
+void poll_fd_closing(int fd);
+
 #endif /* poll-loop.h */
@@ -37,23 +37,36 @@
 #include <errno.h>
 #include <stdlib.h>
 #include <sys/time.h>
+#include <unistd.h>
 
 #include "util.h"
 
+static bool inited = false;
+
 void
 random_init(void)
 {
-    static bool inited = false;
     if (!inited) {
         struct timeval tv;
         inited = true;
         if (gettimeofday(&tv, NULL) < 0) {
             ofp_fatal(errno, "gettimeofday");
         }
-        srand(tv.tv_sec ^ tv.tv_usec);
+        /* Mix in the pid, so that processes started together, such as
+         * many emulated switches, do not draw the same numbers. */
+        srand(tv.tv_sec ^ tv.tv_usec ^ ((unsigned int) getpid() << 16));
     }
 }
 
+/* Seeds the generator with 'seed' instead of the time of day, so that a
+ * program that needs to can produce the same random numbers on every run. */
+void
+random_set_seed(uint32_t seed)
+{
+    inited = true;
+    srand(seed);
+}
+
 void
 random_bytes(void *p_, size_t n)
 {
@@ -34,13 +34,17 @@
 #include <config.h>
 #include "rconn.h"
 #include <assert.h>
+#include <arpa/inet.h>
 #include <errno.h>
+#include <inttypes.h>
 #include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 #include "ofpbuf.h"
 #include "openflow/openflow.h"
+#include "openflow/openflow-ext.h"
 #include "poll-loop.h"
+#include "random.h"
 #include "sat-math.h"
 #include "timeval.h"
 #include "util.h"
@@ -50,6 +54,18 @@
 #define THIS_MODULE VLM_rconn
 #include "vlog.h"
 
+/* Backoff after the first failure to connect, in milliseconds.  It doubles on
+ * each further failure, so a peer that is just slow to come up, such as a
+ * datapath or controller starting alongside us, is reached within a fraction
+ * of a second, while one that is down is retried only every 'max_backoff'
+ * seconds after a few attempts.
+ *
+ * The actual wait before each attempt is a random time between half the
+ * backoff and the full backoff, so that many switches that lose a controller
+ * at the same moment do not all come back to it in lockstep, attempt after
+ * attempt. */
+#define MIN_BACKOFF_MSEC 125
+
 #define STATES                                  \
     STATE(VOID, 1 << 0)                         \
     STATE(BACKOFF, 1 << 1)                      \
@@ -84,11 +100,17 @@ struct rconn {
     char *name;
     bool reliable;
 
-    struct ofp_queue txq;
-
-    int backoff;
-    int max_backoff;
-    time_t backoff_deadline;
+    /* Send queues, one per enum rconn_txq_class, in priority order. */
+    struct rconn_txq {
+        struct ofp_queue msgs;
+        size_t bytes;           /* Sum of the sizes of the messages. */
+    } txqs[RCONN_N_TXQ_CLASSES];
+    size_t n_txq;               /* Number of messages in all 'txqs'. */
+    bool corked;                /* Hold messages in txqs until uncorked? */
+
+    int backoff;                /* Current backoff, in msecs. */
+    int max_backoff;            /* Maximum backoff, in seconds. */
+    long long int backoff_deadline; /* time_msec() value. */
     time_t last_received;
     time_t last_connected;
     unsigned int packets_sent;
@@ -128,9 +150,12 @@ struct rconn {
      * a response. */
     int probe_interval;         /* Secs of inactivity before sending probe. */
 
-    /* Messages sent or received are copied to the monitor connections. */
+    /* Messages sent or received are copied to the monitor connections, if
+     * the bit for their type is set in the monitor's entry in
+     * 'monitor_types'. */
 #define MAX_MONITORS 8
     struct vconn *monitors[8];
+    uint32_t monitor_types[8];
     size_t n_monitors;
 
     /* Protocol statistical informaition. */
@@ -150,6 +175,8 @@ static void disconnect(struct rconn *, int error);
 static void flush_queue(struct rconn *);
 static void question_connectivity(struct rconn *);
 static void copy_to_monitor(struct rconn *, const struct ofpbuf *);
+static void run_monitors(struct rconn *);
+static void remove_monitor(struct rconn *, size_t);
 static bool is_connected_state(enum state);
 static bool is_admitted_msg(const struct ofpbuf *);
 
@@ -180,13 +207,15 @@ rconn_new_from_vconn(const char *name, struct vconn *vconn)
  * Setting 'probe_interval' to 0 disables this behavior.
  *
  * 'max_backoff' is the maximum number of seconds between attempts to connect
- * to the peer.  The actual interval starts at 1 second and doubles on each
- * failure until it reaches 'max_backoff'.  If 0 is specified, the default of
- * 60 seconds is used. */
+ * to the peer.  The interval starts at MIN_BACKOFF_MSEC milliseconds and
+ * doubles on each failure until it reaches 'max_backoff', and each actual
+ * wait is randomly shortened by up to half.  If 0 is specified, the default
+ * of 60 seconds is used. */
 struct rconn *
 rconn_create(int probe_interval, int max_backoff)
 {
     struct rconn *rc = xcalloc(1, sizeof *rc);
+    size_t i;
 
     rc->state = S_VOID;
     rc->state_entered = time_now();
@@ -195,11 +224,16 @@ rconn_create(int probe_interval, int max_backoff)
     rc->name = xstrdup("void");
     rc->reliable = false;
 
-    queue_init(&rc->txq);
+    for (i = 0; i < RCONN_N_TXQ_CLASSES; i++) {
+        queue_init(&rc->txqs[i].msgs);
+        rc->txqs[i].bytes = 0;
+    }
+    rc->n_txq = 0;
+    rc->corked = false;
 
     rc->backoff = 0;
     rc->max_backoff = max_backoff ? max_backoff : 60;
-    rc->backoff_deadline = TIME_MIN;
+    rc->backoff_deadline = LLONG_MIN;
     rc->last_received = time_now();
     rc->last_connected = time_now();
     rc->seqno = 0;
@@ -267,12 +301,50 @@ rconn_disconnect(struct rconn *rc)
         rc->reliable = false;
 
         rc->backoff = 0;
-        rc->backoff_deadline = TIME_MIN;
+        rc->backoff_deadline = LLONG_MIN;
 
         state_transition(rc, S_VOID);
     }
 }
 
+/* Exchanges the connections underlying 'a' and 'b': each takes over the
+ * other's vconn, name, send queue, and connection state (including backoff
+ * and probe timers), so that a connection established on one rconn can be
+ * handed to a caller that holds a pointer to the other without a new
+ * handshake.  Monitors and statistics stay with their rconns.  Both
+ * connection sequence numbers change, since each rconn now talks to a
+ * different peer. */
+void
+rconn_swap_connection(struct rconn *a, struct rconn *b)
+{
+    struct rconn tmp = *a;
+    size_t i;
+
+#define SWAP_FIELD(FIELD) (a->FIELD = b->FIELD, b->FIELD = tmp.FIELD)
+    SWAP_FIELD(state);
+    SWAP_FIELD(state_entered);
+    SWAP_FIELD(vconn);
+    SWAP_FIELD(name);
+    SWAP_FIELD(reliable);
+    for (i = 0; i < RCONN_N_TXQ_CLASSES; i++) {
+        SWAP_FIELD(txqs[i]);
+    }
+    SWAP_FIELD(n_txq);
+    SWAP_FIELD(backoff);
+    SWAP_FIELD(backoff_deadline);
+    SWAP_FIELD(last_received);
+    SWAP_FIELD(last_connected);
+    SWAP_FIELD(probably_admitted);
+    SWAP_FIELD(last_admitted);
+    SWAP_FIELD(questionable_connectivity);
+    SWAP_FIELD(last_questioned);
+    SWAP_FIELD(idle_echo_xid);
+#undef SWAP_FIELD
+
+    a->seqno++;
+    b->seqno++;
+}
+
 /* Disconnects 'rc' and frees the underlying storage. */
 void
 rconn_destroy(struct rconn *rc)
@@ -283,7 +355,9 @@ rconn_destroy(struct rconn *rc)
         free(rc->name);
         vconn_close(rc->vconn);
         flush_queue(rc);
-        queue_destroy(&rc->txq);
+        for (i = 0; i < RCONN_N_TXQ_CLASSES; i++) {
+            queue_destroy(&rc->txqs[i].msgs);
+        }
         for (i = 0; i < rc->n_monitors; i++) {
             vconn_close(rc->monitors[i]);
         }
@@ -315,26 +389,28 @@ reconnect(struct rconn *rc)
         if (!vconn_is_reconnectable(rc->vconn)) {
             rc->reliable = false;
         }
-        rc->backoff_deadline = time_now() + rc->backoff;
+        rc->backoff_deadline = time_msec() + rc->backoff;
         state_transition(rc, S_CONNECTING);
     } else {
         VLOG_WARN("%s: connection failed (%s)", rc->name, strerror(retval));
-        rc->backoff_deadline = TIME_MAX; /* Prevent resetting backoff. */
+        rc->backoff_deadline = LLONG_MAX; /* Prevent resetting backoff. */
         disconnect(rc, 0);
     }
     return retval;
 }
 
 static unsigned int
-timeout_BACKOFF(const struct rconn *rc)
+timeout_BACKOFF(const struct rconn *rc UNUSED)
 {
-    return rc->backoff;
+    /* The backoff is finer-grained than a second, so run_BACKOFF() and
+     * rconn_run_wait() use 'backoff_deadline' directly. */
+    return UINT_MAX;
 }
 
 static void
 run_BACKOFF(struct rconn *rc)
 {
-    if (timed_out(rc)) {
+    if (time_msec() >= rc->backoff_deadline) {
         reconnect(rc);
     }
 }
@@ -342,7 +418,7 @@ run_BACKOFF(struct rconn *rc)
 static unsigned int
 timeout_CONNECTING(const struct rconn *rc)
 {
-    return MAX(1, rc->backoff);
+    return MAX(1, DIV_ROUND_UP(rc->backoff, 1000));
 }
 
 static void
@@ -359,7 +435,7 @@ run_CONNECTING(struct rconn *rc)
         disconnect(rc, retval);
     } else if (timed_out(rc)) {
         VLOG_INFO("%s: connection timed out", rc->name);
-        rc->backoff_deadline = TIME_MAX; /* Prevent resetting backoff. */
+        rc->backoff_deadline = LLONG_MAX; /* Prevent resetting backoff. */
         disconnect(rc, 0);
     }
 }
@@ -367,16 +443,16 @@ run_CONNECTING(struct rconn *rc)
 static void
 do_tx_work(struct rconn *rc)
 {
-    if (!rc->txq.n) {
+    if (!rc->n_txq) {
         return;
     }
-    while (rc->txq.n > 0) {
+    while (rc->n_txq > 0) {
         int error = try_send(rc);
         if (error) {
             break;
         }
     }
-    if (!rc->txq.n) {
+    if (!rc->n_txq) {
         poll_immediate_wake();
     }
 }
@@ -438,6 +514,8 @@ void
 rconn_run(struct rconn *rc)
 {
     int old_state;
+
+    run_monitors(rc);
     do {
         old_state = rc->state;
         switch (rc->state) {
@@ -456,15 +534,22 @@ void
 rconn_run_wait(struct rconn *rc)
 {
     unsigned int timeo = timeout(rc);
+    size_t i;
+
     if (timeo != UINT_MAX) {
         unsigned int expires = sat_add(rc->state_entered, timeo);
         unsigned int remaining = sat_sub(expires, time_now());
         poll_timer_wait(sat_mul(remaining, 1000));
+    } else if (rc->state == S_BACKOFF) {
+        poll_timer_wait(rc->backoff_deadline - time_msec());
     }
 
-    if ((rc->state & (S_ACTIVE | S_IDLE)) && rc->txq.n) {
+    if ((rc->state & (S_ACTIVE | S_IDLE)) && rc->n_txq) {
         vconn_wait(rc->vconn, WAIT_SEND);
     }
+    for (i = 0; i < rc->n_monitors; i++) {
+        vconn_wait(rc->monitors[i], WAIT_RECV);
+    }
 }
 
 /* Attempts to receive a packet from 'rc'.  If successful, returns the packet;
@@ -519,10 +604,63 @@ rconn_recv_wait(struct rconn *rc)
     }
 }
 
+/* Returns the send queue class for OpenFlow message 'b': RCONN_TXQ_ASYNC for
+ * the asynchronous events that a switch sends on its own, RCONN_TXQ_CONTROL
+ * for everything else. */
+enum rconn_txq_class
+rconn_classify(const struct ofpbuf *b)
+{
+    const struct ofp_header *oh = b->data;
+
+    if (b->size >= sizeof *oh
+        && (oh->type == OFPT_PACKET_IN || oh->type == OFPT_FLOW_REMOVED
+            || oh->type == OFPT_PORT_STATUS)) {
+        return RCONN_TXQ_ASYNC;
+    }
+    return RCONN_TXQ_CONTROL;
+}
+
+/* Queues 'b' for sending on 'rc' in send queue 'class', as rconn_send()
+ * does. */
+static int
+rconn_send_in_class(struct rconn *rc, struct ofpbuf *b, int *n_queued,
+                    enum rconn_txq_class class)
+{
+    if (rconn_is_connected(rc)) {
+        copy_to_monitor(rc, b);
+        ofpstat_inc_protocol_stat(&rc->ofps_sent, b->data);
+        b->private = n_queued;
+        if (n_queued) {
+            ++*n_queued;
+        }
+        queue_push_tail(&rc->txqs[class].msgs, b);
+        rc->txqs[class].bytes += b->size;
+        rc->n_txq++;
+
+        /* If the queues were empty before we added 'b', try to send some
+         * packets.  (But if they had packets in them, it's because the vconn
+         * is backlogged and there's no point in stuffing more into it now.
+         * We'll get back to that in rconn_run().)  If 'rc' is corked,
+         * rconn_uncork() sends the whole queue at once instead. */
+        if (rc->n_txq == 1 && !rc->corked) {
+            try_send(rc);
+        }
+        return 0;
+    } else {
+        return ENOTCONN;
+    }
+}
+
 /* Sends 'b' on 'rc'.  Returns 0 if successful (in which case 'b' is
  * destroyed), or ENOTCONN if 'rc' is not currently connected (in which case
  * the caller retains ownership of 'b').
  *
+ * 'b' goes into the send queue class that rconn_classify() picks for it.
+ * Messages in RCONN_TXQ_CONTROL, such as echo and barrier replies, are sent
+ * ahead of any queued asynchronous events, so that a backlog of packet_ins
+ * cannot delay them long enough for the peer to give up on the connection.
+ * Messages within a class keep their order.
+ *
  * If 'n_queued' is non-null, then '*n_queued' will be incremented while the
  * packet is in flight, then decremented when it has been sent (or discarded
  * due to disconnection).  Because 'b' may be sent (or discarded) before this
@@ -535,32 +673,36 @@ rconn_recv_wait(struct rconn *rc)
 int
 rconn_send(struct rconn *rc, struct ofpbuf *b, int *n_queued)
 {
-    if (rconn_is_connected(rc)) {
-        copy_to_monitor(rc, b);
-        b->private = n_queued;
-        if (n_queued) {
-            ++*n_queued;
-        }
-        queue_push_tail(&rc->txq, b);
+    return rconn_send_in_class(rc, b, n_queued, rconn_classify(b));
+}
 
-        /* If the queue was empty before we added 'b', try to send some
-         * packets.  (But if the queue had packets in it, it's because the
-         * vconn is backlogged and there's no point in stuffing more into it
-         * now.  We'll get back to that in rconn_run().) */
-        if (rc->txq.n == 1) {
-            try_send(rc);
-        }
-        return 0;
-    } else {
-        return ENOTCONN;
+/* Corks 'rc': until rconn_uncork() is called, rconn_send() only queues
+ * messages, so that a caller that generates several messages in a row (for
+ * example, replies to a burst of packet_ins) hands them to the vconn in one
+ * batch instead of one write each.  rconn_run() still sends queued messages
+ * while 'rc' is corked. */
+void
+rconn_cork(struct rconn *rc)
+{
+    rc->corked = true;
+}
+
+/* Uncorks 'rc' and sends the messages queued while it was corked. */
+void
+rconn_uncork(struct rconn *rc)
+{
+    rc->corked = false;
+    if (rconn_is_connected(rc)) {
+        do_tx_work(rc);
     }
 }
 
-/* Sends 'b' on 'rc'.  Increments '*n_queued' while the packet is in flight; it
- * will be decremented when it has been sent (or discarded due to
- * disconnection).  Returns 0 if successful, EAGAIN if '*n_queued' is already
- * at least as large as 'queue_limit', or ENOTCONN if 'rc' is not currently
- * connected.  Regardless of return value, 'b' is destroyed.
+/* Sends 'b' on 'rc' in send queue 'class'.  Increments '*n_queued' while the
+ * packet is in flight; it will be decremented when it has been sent (or
+ * discarded due to disconnection).  Returns 0 if successful, EAGAIN if
+ * '*n_queued' is already at least as large as 'queue_limit', or ENOTCONN if
+ * 'rc' is not currently connected.  Regardless of return value, 'b' is
+ * destroyed.
  *
  * Because 'b' may be sent (or discarded) before this function returns, the
  * caller may not be able to observe any change in '*n_queued'.
@@ -570,16 +712,46 @@ rconn_send(struct rconn *rc, struct ofpbuf *b, int *n_queued)
  * effect of waking up poll_block(). */
 int
 rconn_send_with_limit(struct rconn *rc, struct ofpbuf *b,
-                      int *n_queued, int queue_limit)
+                      int *n_queued, int queue_limit,
+                      enum rconn_txq_class class)
 {
     int retval;
-    retval = *n_queued >= queue_limit ? EAGAIN : rconn_send(rc, b, n_queued);
+    retval = (*n_queued >= queue_limit ? EAGAIN
+              : rconn_send_in_class(rc, b, n_queued, class));
     if (retval) {
         ofpbuf_delete(b);
     }
     return retval;
 }
 
+/* Sends 'b' on 'rc' in send queue 'class', like rconn_send() with a null
+ * 'n_queued', unless the messages already in that queue add up to at least
+ * 'byte_limit' bytes, in which case it returns EAGAIN.  Counting bytes instead
+ * of messages treats a queue of small messages, such as flow expirations,
+ * differently from a queue of large ones, such as stats replies.  Regardless
+ * of return value, 'b' is destroyed. */
+int
+rconn_send_with_byte_limit(struct rconn *rc, struct ofpbuf *b,
+                           size_t byte_limit, enum rconn_txq_class class)
+{
+    int retval;
+    retval = (rc->txqs[class].bytes >= byte_limit ? EAGAIN
+              : rconn_send_in_class(rc, b, NULL, class));
+    if (retval) {
+        ofpbuf_delete(b);
+    }
+    return retval;
+}
+
+/* Returns the number of bytes in messages queued for sending on 'rc' in send
+ * queue 'class', not counting any message that the vconn has taken but not
+ * yet finished sending. */
+size_t
+rconn_queued_bytes(const struct rconn *rc, enum rconn_txq_class class)
+{
+    return rc->txqs[class].bytes;
+}
+
 /* Returns the total number of packets successfully sent on the underlying
  * vconn.  A packet is not counted as sent while it is still queued in the
  * rconn, only when it has been successfuly passed to the vconn.  */
@@ -596,6 +768,7 @@ rconn_add_monitor(struct rconn *rc, struct vconn *vconn)
 {
     if (rc->n_monitors < ARRAY_SIZE(rc->monitors)) {
         VLOG_INFO("new monitor connection from %s", vconn_get_name(vconn));
+        rc->monitor_types[rc->n_monitors] = UINT32_MAX;
         rc->monitors[rc->n_monitors++] = vconn;
     } else {
         VLOG_DBG("too many monitor connections, discarding %s",
@@ -715,12 +888,13 @@ rconn_get_total_time_connected(const struct rconn *rc)
             + (rconn_is_connected(rc) ? elapsed_in_this_state(rc) : 0));
 }
 
-/* Returns the current amount of backoff, in seconds.  This is the amount of
- * time after which the rconn will transition from BACKOFF to CONNECTING. */
+/* Returns the current amount of backoff, in seconds, rounded up.  This is the
+ * amount of time after which the rconn will transition from BACKOFF to
+ * CONNECTING. */
 int
 rconn_get_backoff(const struct rconn *rc)
 {
-    return rc->backoff;
+    return DIV_ROUND_UP(rc->backoff, 1000);
 }
 
 /* Returns the number of seconds spent in this state so far. */
@@ -771,18 +945,41 @@ rconn_update_protocol_stat(struct rconn *rconn,
     *ofps_sent = rconn->ofps_sent;
 }
 
-/* Tries to send a packet from 'rc''s send buffer.  Returns 0 if successful,
+/* Most messages that try_send() passes to the vconn at once. */
+#define TX_BATCH 64
+
+/* Tries to send packets from 'rc''s highest-priority nonempty send queue,
+ * passing up to TX_BATCH of them to the vconn at once so that it can coalesce
+ * them into fewer system calls.  Returns 0 if at least one packet was sent,
  * otherwise a positive errno value. */
 static int
 try_send(struct rconn *rc)
 {
-    int retval = 0;
-    struct ofpbuf *next = rc->txq.head->next;
-    struct ofp_header *h = rc->txq.head->data;
-    int *n_queued = rc->txq.head->private;
-    ofpstat_inc_protocol_stat(&rc->ofps_sent, h);
-    rc->idle_echo_xid = h->xid;
-    retval = vconn_send(rc->vconn, rc->txq.head);
+    struct rconn_txq *txq = rc->txqs;
+    struct ofpbuf *msgs[TX_BATCH];
+    int *n_queued[TX_BATCH];
+    size_t sizes[TX_BATCH];
+    uint32_t xids[TX_BATCH];
+    struct ofpbuf *b;
+    size_t n_msgs, n_sent, i;
+    int retval;
+
+    while (!txq->msgs.n) {
+        txq++;
+    }
+    n_msgs = 0;
+    for (b = txq->msgs.head; b && n_msgs < TX_BATCH; b = b->next) {
+        struct ofp_header *h = b->data;
+        msgs[n_msgs] = b;
+        n_queued[n_msgs] = b->private;
+        sizes[n_msgs] = b->size;
+        xids[n_msgs] = h->xid;
+        n_msgs++;
+    }
+
+    /* The vconn may free the messages it takes, so 'b' is the only link left
+     * to the rest of the queue. */
+    retval = vconn_send_batch(rc->vconn, msgs, n_msgs, &n_sent);
     if (retval) {
         rc->idle_echo_xid = 0;
         if (retval != EAGAIN) {
@@ -790,17 +987,30 @@ try_send(struct rconn *rc)
         }
         return retval;
     }
-    rc->packets_sent++;
-    if (n_queued) {
-        --*n_queued;
+    for (i = 0; i < n_sent; i++) {
+        rc->packets_sent++;
+        if (n_queued[i]) {
+            --*n_queued[i];
+        }
+        txq->bytes -= sizes[i];
+        rc->n_txq--;
+        queue_advance_head(&txq->msgs, i + 1 < n_msgs ? msgs[i + 1] : b);
     }
-    queue_advance_head(&rc->txq, next);
+    rc->idle_echo_xid = xids[n_sent - 1];
     return 0;
 }
 
 /* Disconnects 'rc'.  'error' is used only for logging purposes.  If it is
  * nonzero, then it should be EOF to indicate the connection was closed by the
  * peer in a normal fashion or a positive errno value. */
+/* Returns a random wait, in milliseconds, between half of 'backoff' and all of
+ * it. */
+static int
+jitter(int backoff)
+{
+    return backoff - random_range(backoff / 2 + 1);
+}
+
 static void
 disconnect(struct rconn *rc, int error)
 {
@@ -823,14 +1033,19 @@ disconnect(struct rconn *rc, int error)
             flush_queue(rc);
         }
 
-        if (now >= rc->backoff_deadline) {
-            rc->backoff = 1;
+        if (time_msec() >= rc->backoff_deadline) {
+            rc->backoff = MIN_BACKOFF_MSEC;
+            rc->backoff_deadline = time_msec() + jitter(rc->backoff);
         } else {
-            rc->backoff = MIN(rc->max_backoff, MAX(1, 2 * rc->backoff));
-            VLOG_INFO("%s: waiting %d seconds before reconnect",
-                      rc->name, rc->backoff);
+            int wait;
+
+            rc->backoff = MIN(rc->max_backoff * 1000,
+                              MAX(MIN_BACKOFF_MSEC, 2 * rc->backoff));
+            wait = jitter(rc->backoff);
+            VLOG_INFO("%s: waiting %d.%03d seconds before reconnect",
+                      rc->name, wait / 1000, wait % 1000);
+            rc->backoff_deadline = time_msec() + wait;
         }
-        rc->backoff_deadline = now + rc->backoff;
         state_transition(rc, S_BACKOFF);
         if (now - rc->last_connected > 60) {
             question_connectivity(rc);
@@ -845,17 +1060,24 @@ disconnect(struct rconn *rc, int error)
 static void
 flush_queue(struct rconn *rc)
 {
-    if (!rc->txq.n) {
+    size_t i;
+
+    if (!rc->n_txq) {
         return;
     }
-    while (rc->txq.n > 0) {
-        struct ofpbuf *b = queue_pop_head(&rc->txq);
-        int *n_queued = b->private;
-        if (n_queued) {
-            --*n_queued;
+    for (i = 0; i < RCONN_N_TXQ_CLASSES; i++) {
+        struct rconn_txq *txq = &rc->txqs[i];
+        while (txq->msgs.n > 0) {
+            struct ofpbuf *b = queue_pop_head(&txq->msgs);
+            int *n_queued = b->private;
+            if (n_queued) {
+                --*n_queued;
+            }
+            ofpbuf_delete(b);
         }
-        ofpbuf_delete(b);
+        txq->bytes = 0;
     }
+    rc->n_txq = 0;
     poll_immediate_wake();
 }
 
@@ -913,11 +1135,18 @@ copy_to_monitor(struct rconn *rc, const struct ofpbuf *b)
 {
     struct ofpbuf *clone = NULL;
     int retval;
+    uint8_t type;
     size_t i;
 
+    type = b->size >= sizeof(struct ofp_header)
+            ? ((const struct ofp_header *) b->data)->type : 0;
     for (i = 0; i < rc->n_monitors; ) {
         struct vconn *vconn = rc->monitors[i];
 
+        if (type < 32 && !(rc->monitor_types[i] & (1u << type))) {
+            i++;
+            continue;
+        }
         if (!clone) {
             clone = ofpbuf_clone(b);
         }
@@ -928,7 +1157,7 @@ copy_to_monitor(struct rconn *rc, const struct ofpbuf *b)
             VLOG_DBG("%s: closing monitor connection to %s: %s",
                      rconn_get_name(rc), vconn_get_name(vconn),
                      strerror(retval));
-            rc->monitors[i] = rc->monitors[--rc->n_monitors];
+            remove_monitor(rc, i);
             continue;
         }
         i++;
@@ -936,6 +1165,60 @@ copy_to_monitor(struct rconn *rc, const struct ofpbuf *b)
     ofpbuf_delete(clone);
 }
 
+/* Reads what the monitor connections have sent, applying any
+ * OFP_EXT_MONITOR_FILTER messages and discarding everything else, and closes
+ * those that have gone away. */
+static void
+run_monitors(struct rconn *rc)
+{
+    size_t i;
+
+    for (i = 0; i < rc->n_monitors; ) {
+        struct vconn *vconn = rc->monitors[i];
+        int n;
+
+        for (n = 0; n < 50; n++) {
+            const struct ofp_ext_monitor_filter *mf;
+            struct ofpbuf *msg;
+            int error;
+
+            error = vconn_recv(vconn, &msg);
+            if (error == EAGAIN) {
+                break;
+            } else if (error) {
+                VLOG_DBG("%s: closing monitor connection to %s: %s",
+                         rconn_get_name(rc), vconn_get_name(vconn),
+                         error == EOF ? "connection closed" : strerror(error));
+                remove_monitor(rc, i);
+                goto next;
+            }
+
+            mf = msg->data;
+            if (msg->size >= sizeof *mf
+                && mf->header.header.type == OFPT_VENDOR
+                && mf->header.vendor == htonl(OPENFLOW_VENDOR_ID)
+                && mf->header.subtype == htonl(OFP_EXT_MONITOR_FILTER)) {
+                rc->monitor_types[i] = ntohl(mf->types);
+                VLOG_DBG("%s: monitor connection to %s filters types %#"PRIx32,
+                         rconn_get_name(rc), vconn_get_name(vconn),
+                         rc->monitor_types[i]);
+            }
+            ofpbuf_delete(msg);
+        }
+        i++;
+    next:;
+    }
+}
+
+static void
+remove_monitor(struct rconn *rc, size_t i)
+{
+    vconn_close(rc->monitors[i]);
+    rc->n_monitors--;
+    rc->monitors[i] = rc->monitors[rc->n_monitors];
+    rc->monitor_types[i] = rc->monitor_types[rc->n_monitors];
+}
+
 static bool
 is_connected_state(enum state state) 
 {
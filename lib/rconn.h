@@ -36,6 +36,7 @@
 
 #include "queue.h"
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <time.h>
 
@@ -53,6 +54,15 @@
 
 struct vconn;
 struct ofpstat;
+struct ofpbuf;
+
+/* Send queue classes, in decreasing order of priority.  An rconn sends every
+ * message queued in one class before any message queued in a later class. */
+enum rconn_txq_class {
+    RCONN_TXQ_CONTROL,          /* Replies, echoes, errors, requests. */
+    RCONN_TXQ_ASYNC,            /* Packet_ins, flow_removeds, port_status. */
+    RCONN_N_TXQ_CLASSES
+};
 
 struct rconn *rconn_new(const char *name, 
                         int inactivity_probe_interval, int max_backoff);
@@ -62,15 +72,23 @@ int rconn_connect(struct rconn *, const char *name);
 void rconn_connect_unreliably(struct rconn *,
                               const char *name, struct vconn *vconn);
 void rconn_disconnect(struct rconn *);
+void rconn_swap_connection(struct rconn *, struct rconn *);
 void rconn_destroy(struct rconn *);
 
 void rconn_run(struct rconn *);
 void rconn_run_wait(struct rconn *);
 struct ofpbuf *rconn_recv(struct rconn *);
 void rconn_recv_wait(struct rconn *);
+enum rconn_txq_class rconn_classify(const struct ofpbuf *);
 int rconn_send(struct rconn *, struct ofpbuf *, int *n_queued);
+void rconn_cork(struct rconn *);
+void rconn_uncork(struct rconn *);
 int rconn_send_with_limit(struct rconn *, struct ofpbuf *,
-                          int *n_queued, int queue_limit);
+                          int *n_queued, int queue_limit,
+                          enum rconn_txq_class);
+int rconn_send_with_byte_limit(struct rconn *, struct ofpbuf *,
+                               size_t byte_limit, enum rconn_txq_class);
+size_t rconn_queued_bytes(const struct rconn *, enum rconn_txq_class);
 unsigned int rconn_packets_sent(const struct rconn *);
 unsigned int rconn_packets_received(const struct rconn *);
 
@@ -40,6 +40,7 @@
 #include <poll.h>
 #include <stddef.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/resource.h>
 #include <sys/un.h>
@@ -314,3 +315,55 @@ get_unix_name_len(socklen_t sun_len)
             ? sun_len - offsetof(struct sockaddr_un, sun_path)
             : 0);
 }
+
+/* Opens a nonblocking UDP socket connected to 'target', which has the form
+ * HOST[:PORT], using 'default_port' if 'target' has no port.  On success,
+ * stores the socket in '*fdp' and returns 0; on failure, stores -1 in
+ * '*fdp' and returns a positive errno value. */
+int
+udp_open_active(const char *target, uint16_t default_port, int *fdp)
+{
+    char *name, *save_ptr;
+    const char *host_name, *port_string;
+    struct sockaddr_in sin;
+    int error;
+    int fd;
+
+    *fdp = -1;
+
+    /* Glibc 2.7 has a bug in strtok_r when compiling with optimization that
+     * can cause segfaults here:
+     * http://sources.redhat.com/bugzilla/show_bug.cgi?id=5614.
+     * Using "::" instead of the obvious ":" works around it. */
+    name = xstrdup(target);
+    host_name = strtok_r(name, "::", &save_ptr);
+    port_string = strtok_r(NULL, "::", &save_ptr);
+    memset(&sin, 0, sizeof sin);
+    sin.sin_family = AF_INET;
+    if (!host_name || lookup_ip(host_name, &sin.sin_addr)) {
+        free(name);
+        return ENOENT;
+    }
+    sin.sin_port = htons(port_string ? atoi(port_string) : default_port);
+    free(name);
+
+    fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) {
+        error = errno;
+        VLOG_ERR("%s: socket: %s", target, strerror(error));
+        return error;
+    }
+    error = set_nonblocking(fd);
+    if (error) {
+        close(fd);
+        return error;
+    }
+    if (connect(fd, (struct sockaddr *) &sin, sizeof sin) < 0) {
+        error = errno;
+        VLOG_ERR("%s: connect: %s", target, strerror(error));
+        close(fd);
+        return error;
+    }
+    *fdp = fd;
+    return 0;
+}
@@ -37,6 +37,7 @@
 #include <sys/types.h>
 #include <netinet/in.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 int set_nonblocking(int fd);
 int set_socket_priority(int fd, int priority);
@@ -49,5 +50,6 @@ void drain_fd(int fd, size_t n_packets);
 int make_unix_socket(int style, bool nonblock, bool passcred,
                      const char *bind_path, const char *connect_path);
 int get_unix_name_len(socklen_t sun_len);
+int udp_open_active(const char *target, uint16_t default_port, int *fdp);
 
 #endif /* socket-util.h */
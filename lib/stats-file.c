@@ -0,0 +1,278 @@
+/* Copyright (c) 2008 The Board of Trustees of The Leland Stanford
+ * Junior University
+ * 
+ * We are making the OpenFlow specification and associated documentation
+ * (Software) available for public use and benefit with the expectation
+ * that others will use, modify and enhance the Software and contribute
+ * those enhancements back to the community. However, since we would
+ * like to make the Software available for broadest use, with as few
+ * restrictions as possible permission is hereby granted, free of
+ * charge, to any person obtaining a copy of this Software to deal in
+ * the Software under the copyrights without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ * The name and trademarks of copyright holder(s) may NOT be used in
+ * advertising or publicity pertaining to the Software or any
+ * derivatives without specific, written prior permission.
+ */
+
+#include <config.h>
+#include "stats-file.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "dirs.h"
+#include "dynamic-string.h"
+#include "fatal-signal.h"
+#include "poll-loop.h"
+#include "timeval.h"
+#include "util.h"
+
+#define THIS_MODULE VLM_stats_file
+#include "vlog.h"
+
+static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(1, 5);
+
+/* Orders the updates to the header and the text.  The writer's stores and
+ * the reader's loads must each stay on their side of the 'seq' accesses. */
+#define stats_file_barrier() __sync_synchronize()
+
+/* Number of times stats_file_read() tries for a snapshot before it decides
+ * that the writer died in the middle of an update. */
+#define STATS_FILE_MAX_TRIES 1000000
+
+static char *file_name;         /* File to publish to, or null. */
+static int interval = STATS_FILE_DEFAULT_INTERVAL; /* In ms. */
+static struct stats_file_header *region; /* Mapped file, or null. */
+static long long int next_update; /* time_msec() of next update. */
+
+/* Sets the file to which stats are published to 'name'.  A null 'name'
+ * selects the default, PROGRAM.stats in the run directory; a relative one is
+ * taken relative to the run directory, as for pidfiles. */
+void
+stats_file_set_name(const char *name)
+{
+    free(file_name);
+    file_name = (!name ? xasprintf("%s/%s.stats", ofp_rundir, program_name)
+                 : *name == '/' ? xstrdup(name)
+                 : xasprintf("%s/%s", ofp_rundir, name));
+}
+
+/* Sets the number of milliseconds between updates to 'msecs', a string given
+ * on the command line. */
+void
+stats_file_set_interval(const char *msecs)
+{
+    int n = atoi(msecs);
+    if (n <= 0) {
+        ofp_fatal(0, "argument to --stats-file-interval must be positive");
+    }
+    interval = n;
+}
+
+/* Creates and maps the file set with stats_file_set_name(), if any, and
+ * arranges for it to be removed when the program exits.  A file left behind
+ * by an earlier run is replaced rather than overwritten, so that readers
+ * that still have it mapped do not see a second writer. */
+void
+stats_file_init(void)
+{
+    void *p;
+    int fd;
+
+    if (!file_name) {
+        return;
+    }
+
+    if (unlink(file_name) && errno != ENOENT) {
+        ofp_fatal(errno, "%s: unlink failed", file_name);
+    }
+    fd = open(file_name, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0) {
+        ofp_fatal(errno, "%s: create failed", file_name);
+    }
+    fatal_signal_add_file_to_unlink(file_name);
+    if (ftruncate(fd, STATS_FILE_SIZE) < 0) {
+        ofp_fatal(errno, "%s: could not set size", file_name);
+    }
+    p = mmap(NULL, STATS_FILE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+        ofp_fatal(errno, "%s: mmap failed", file_name);
+    }
+    close(fd);
+
+    region = p;
+    region->version = STATS_FILE_VERSION;
+    region->seq = 0;
+    region->pid = getpid();
+    region->update_msec = 0;
+    region->capacity = STATS_FILE_SIZE - sizeof *region;
+    region->length = 0;
+    stats_file_barrier();
+    region->magic = STATS_FILE_MAGIC;
+    next_update = time_msec();
+}
+
+/* Returns true if it is time to publish with stats_file_publish(). */
+bool
+stats_file_due(void)
+{
+    return region && time_msec() >= next_update;
+}
+
+/* Replaces the text in the stats file by 'status', and schedules the next
+ * update.  If 'status' does not fit, it is cut off after the last line that
+ * does. */
+void
+stats_file_publish(const struct ds *status)
+{
+    size_t length = status->length;
+
+    if (!region) {
+        return;
+    }
+
+    if (length > region->capacity) {
+        const char *eol = status->string + region->capacity;
+
+        while (eol > status->string && eol[-1] != '\n') {
+            eol--;
+        }
+        length = eol - status->string;
+        VLOG_WARN_RL(&rl, "%s: %zu bytes of status do not fit, truncated "
+                     "to %zu", file_name, status->length, length);
+    }
+
+    region->seq++;
+    stats_file_barrier();
+    memcpy(region->text, status->string, length);
+    region->length = length;
+    region->update_msec = time_msec();
+    stats_file_barrier();
+    region->seq++;
+
+    next_update = time_msec() + interval;
+}
+
+/* Causes the next call to poll_block() to wake up when the stats file is
+ * next due for an update. */
+void
+stats_file_wait(void)
+{
+    if (region) {
+        long long int now = time_msec();
+        poll_timer_wait(next_update > now ? next_update - now : 0);
+    }
+}
+
+void
+stats_file_usage(void)
+{
+    printf("\nStats file options:\n"
+           "  --stats-file[=FILE]     publish counters in mmap'd FILE\n"
+           "                          (default: %s/%s.stats)\n"
+           "  --stats-file-interval=MSECS  ms between updates "
+           "(default: %d)\n",
+           ofp_rundir, program_name, STATS_FILE_DEFAULT_INTERVAL);
+}
+
+/* A stats file mapped for reading. */
+struct stats_file_reader {
+    const struct stats_file_header *region;
+};
+
+/* Maps the stats file 'name' for reading.  On success, stores a reader for
+ * it in '*readerp' and returns 0.  On failure, returns a positive errno
+ * value: EPROTO if 'name' is not a stats file that this code understands. */
+int
+stats_file_open(const char *name, struct stats_file_reader **readerp)
+{
+    const struct stats_file_header *h;
+    void *p;
+    int fd;
+
+    *readerp = NULL;
+    fd = open(name, O_RDONLY);
+    if (fd < 0) {
+        return errno;
+    }
+    p = mmap(NULL, STATS_FILE_SIZE, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        return errno;
+    }
+
+    h = p;
+    if (h->magic != STATS_FILE_MAGIC || h->version != STATS_FILE_VERSION
+        || h->capacity != STATS_FILE_SIZE - sizeof *h) {
+        munmap(p, STATS_FILE_SIZE);
+        return EPROTO;
+    }
+
+    *readerp = xmalloc(sizeof **readerp);
+    (*readerp)->region = h;
+    return 0;
+}
+
+/* Unmaps the file that 'reader' reads and frees 'reader'. */
+void
+stats_file_close(struct stats_file_reader *reader)
+{
+    if (reader) {
+        munmap((void *) reader->region, STATS_FILE_SIZE);
+        free(reader);
+    }
+}
+
+/* Replaces the contents of 'output' by a consistent snapshot of the text in
+ * the file that 'reader' reads, and stores the time at which the writer
+ * last updated it, in milliseconds since the epoch, in '*update_msec'.
+ * Makes no system calls.  Returns true if successful, false if the writer
+ * seems to have died while updating the file. */
+bool
+stats_file_read(const struct stats_file_reader *reader, struct ds *output,
+                uint64_t *update_msec)
+{
+    const struct stats_file_header *h = reader->region;
+    int i;
+
+    for (i = 0; i < STATS_FILE_MAX_TRIES; i++) {
+        uint32_t seq = h->seq;
+        uint32_t length;
+
+        if (seq & 1) {
+            continue;
+        }
+        stats_file_barrier();
+        length = h->length;
+        if (length > h->capacity) {
+            continue;
+        }
+        ds_clear(output);
+        ds_put_buffer(output, h->text, length);
+        *update_msec = h->update_msec;
+        stats_file_barrier();
+        if (h->seq == seq) {
+            return true;
+        }
+    }
+    return false;
+}
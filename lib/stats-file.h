@@ -0,0 +1,108 @@
+/* Copyright (c) 2008 The Board of Trustees of The Leland Stanford
+ * Junior University
+ * 
+ * We are making the OpenFlow specification and associated documentation
+ * (Software) available for public use and benefit with the expectation
+ * that others will use, modify and enhance the Software and contribute
+ * those enhancements back to the community. However, since we would
+ * like to make the Software available for broadest use, with as few
+ * restrictions as possible permission is hereby granted, free of
+ * charge, to any person obtaining a copy of this Software to deal in
+ * the Software under the copyrights without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ * The name and trademarks of copyright holder(s) may NOT be used in
+ * advertising or publicity pertaining to the Software or any
+ * derivatives without specific, written prior permission.
+ */
+
+/* Counters published in a memory-mapped file for local readers.
+ *
+ * Each interval, the program formats its status, as the "key=value" lines
+ * that "dpctl status" prints, into a file that it keeps mapped, by default
+ * PROGRAM.stats in the run directory.  A monitoring agent on the same host
+ * maps the file once and can then take a consistent snapshot of every
+ * counter with stats_file_read() without a system call and without sending
+ * the program a request that would compete with its controller.
+ *
+ * The file starts with a struct stats_file_header.  Its 'seq' is a sequence
+ * lock: the writer makes it odd before it changes the text and even again
+ * afterward, so a reader that sees the same even value before and after
+ * copying the text has a snapshot that no update tore. */
+
+#ifndef STATS_FILE_H
+#define STATS_FILE_H 1
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct ds;
+
+/* Identifies a file laid out as described here. */
+#define STATS_FILE_MAGIC 0x4f465354    /* "OFST". */
+#define STATS_FILE_VERSION 1
+
+/* Size of the whole file.  Only the pages that the text reaches use
+ * memory. */
+#define STATS_FILE_SIZE (1024 * 1024)
+
+/* Default number of milliseconds between updates. */
+#define STATS_FILE_DEFAULT_INTERVAL 1000
+
+struct stats_file_header {
+    uint32_t magic;             /* STATS_FILE_MAGIC. */
+    uint32_t version;           /* STATS_FILE_VERSION. */
+    volatile uint32_t seq;      /* Odd while an update is in progress. */
+    uint32_t pid;               /* Process that writes the file. */
+    uint64_t update_msec;       /* Wall-clock time of the last update. */
+    uint32_t capacity;          /* Bytes available for 'text'. */
+    uint32_t length;            /* Bytes of 'text' in use. */
+    char text[0];               /* "key=value" lines. */
+};
+
+#define STATS_FILE_OPTION_ENUMS OPT_STATS_FILE, OPT_STATS_FILE_INTERVAL
+#define STATS_FILE_LONG_OPTIONS                                         \
+        {"stats-file",  optional_argument, 0, OPT_STATS_FILE},          \
+        {"stats-file-interval", required_argument, 0,                   \
+         OPT_STATS_FILE_INTERVAL}
+#define STATS_FILE_OPTION_HANDLERS              \
+        case OPT_STATS_FILE:                    \
+            stats_file_set_name(optarg);        \
+            break;                              \
+        case OPT_STATS_FILE_INTERVAL:           \
+            stats_file_set_interval(optarg);    \
+            break;
+void stats_file_usage(void);
+
+/* Writing. */
+void stats_file_set_name(const char *name);
+void stats_file_set_interval(const char *msecs);
+void stats_file_init(void);
+
+bool stats_file_due(void);
+void stats_file_publish(const struct ds *status);
+void stats_file_wait(void);
+
+/* Reading. */
+struct stats_file_reader;
+int stats_file_open(const char *name, struct stats_file_reader **);
+void stats_file_close(struct stats_file_reader *);
+bool stats_file_read(const struct stats_file_reader *, struct ds *,
+                     uint64_t *update_msec);
+
+#endif /* stats-file.h */
@@ -39,6 +39,7 @@
 #include <assert.h>
 #include <inttypes.h>
 #include <stdlib.h>
+#include "list.h"
 #include "ofpbuf.h"
 #include "packets.h"
 #include "util.h"
@@ -94,6 +95,7 @@ struct stp_timer {
 
 struct stp_port {
     struct stp *stp;
+    int port_no;                    /* Index within 'stp->ports'. */
     int port_id;                    /* 8.5.5.1: Unique port identifier. */
     enum stp_state state;           /* 8.5.5.2: Current state. */
     int path_cost;                  /* 8.5.5.3: Cost of tx/rx on this port. */
@@ -108,6 +110,7 @@ struct stp_port {
     struct stp_timer message_age_timer; /* 8.5.6.1: Age of received info. */
     struct stp_timer forward_delay_timer; /* 8.5.6.2: State change timer. */
     struct stp_timer hold_timer;        /* 8.5.6.3: BPDU rate limit timer. */
+    struct list timer_node;             /* In stp->timer_ports, or empty. */
 
     bool state_changed;
 };
@@ -139,25 +142,29 @@ struct stp {
     struct stp_timer tcn_timer;     /* 8.5.4.2: Topology change timer. */
     struct stp_timer topology_change_timer; /* 8.5.4.3. */
 
-    /* Ports. */
-    struct stp_port ports[STP_MAX_PORTS];
+    /* Ports, allocated on demand by stp_get_port(). */
+    struct stp_port **ports;        /* Indexed by port number; may be null. */
+    int n_ports;                    /* Number of elements in 'ports'. */
+    struct list timer_ports;        /* Ports that may have a timer running. */
 
     /* Interface to client. */
-    struct stp_port *first_changed_port;
+    int first_changed_port;         /* Lowest port number that may have
+                                     * 'state_changed' set. */
     void (*send_bpdu)(struct ofpbuf *bpdu, int port_no, void *aux);
     void *aux;
 };
 
-#define FOR_EACH_ENABLED_PORT(PORT, STP)                        \
-    for ((PORT) = stp_next_enabled_port((STP), (STP)->ports);   \
-         (PORT);                                                \
-         (PORT) = stp_next_enabled_port((STP), (PORT) + 1))
+#define FOR_EACH_ENABLED_PORT(PORT, STP)                                \
+    for ((PORT) = stp_next_enabled_port((STP), 0);                      \
+         (PORT);                                                        \
+         (PORT) = stp_next_enabled_port((STP), (PORT)->port_no + 1))
 static struct stp_port *
-stp_next_enabled_port(const struct stp *stp, const struct stp_port *port)
+stp_next_enabled_port(const struct stp *stp, int port_no)
 {
-    for (; port < &stp->ports[ARRAY_SIZE(stp->ports)]; port++) {
-        if (port->state != STP_DISABLED) {
-            return (struct stp_port *) port;
+    for (; port_no < stp->n_ports; port_no++) {
+        struct stp_port *port = stp->ports[port_no];
+        if (port && port->state != STP_DISABLED) {
+            return port;
         }
     }
     return NULL;
@@ -207,6 +214,8 @@ static int ms_to_timer(int ms);
 static int ms_to_timer_remainder(int ms);
 static int timer_to_ms(int timer);
 static void stp_start_timer(struct stp_timer *, int value);
+static void stp_start_port_timer(struct stp_port *, struct stp_timer *,
+                                 int value);
 static void stp_stop_timer(struct stp_timer *);
 static bool stp_timer_expired(struct stp_timer *, int elapsed, int timeout);
 
@@ -229,7 +238,6 @@ stp_create(const char *name, stp_identifier bridge_id,
            void *aux)
 {
     struct stp *stp;
-    struct stp_port *p;
 
     stp = xcalloc(1, sizeof *stp);
     stp->name = xstrdup(name);
@@ -259,13 +267,10 @@ stp_create(const char *name, stp_identifier bridge_id,
     stp->send_bpdu = send_bpdu;
     stp->aux = aux;
 
-    stp->first_changed_port = &stp->ports[ARRAY_SIZE(stp->ports)];
-    for (p = stp->ports; p < &stp->ports[ARRAY_SIZE(stp->ports)]; p++) {
-        p->stp = stp;
-        p->port_id = (stp_port_no(p) + 1) | (STP_DEFAULT_PORT_PRIORITY << 8);
-        p->path_cost = 19;      /* Recommended default for 100 Mb/s link. */
-        stp_initialize_port(p, STP_DISABLED);
-    }
+    stp->ports = NULL;
+    stp->n_ports = 0;
+    list_init(&stp->timer_ports);
+    stp->first_changed_port = 0;
     return stp;
 }
 
@@ -273,14 +278,33 @@ stp_create(const char *name, stp_identifier bridge_id,
 void
 stp_destroy(struct stp *stp)
 {
-    free(stp);
+    if (stp) {
+        int i;
+
+        for (i = 0; i < stp->n_ports; i++) {
+            free(stp->ports[i]);
+        }
+        free(stp->ports);
+        free(stp->name);
+        free(stp);
+    }
+}
+
+/* Advances 'timer', one of 'p''s timers, by 'elapsed' ticks, and returns true
+ * if it ran out.  Timers on disabled ports do not run. */
+static bool
+stp_port_timer_expired(struct stp_port *p, struct stp_timer *timer,
+                       int elapsed, int timeout)
+{
+    return p->state != STP_DISABLED
+           && stp_timer_expired(timer, elapsed, timeout);
 }
 
 /* Runs 'stp' given that 'ms' milliseconds have passed. */
 void
 stp_tick(struct stp *stp, int ms)
 {
-    struct stp_port *p;
+    struct stp_port *p, *next;
     int elapsed;
 
     /* Convert 'ms' to STP timer ticks.  Preserve any leftover milliseconds
@@ -303,20 +327,34 @@ stp_tick(struct stp *stp, int ms)
                           stp->max_age + stp->forward_delay)) {
         stp_topology_change_timer_expiry(stp);
     }
-    FOR_EACH_ENABLED_PORT (p, stp) {
-        if (stp_timer_expired(&p->message_age_timer, elapsed, stp->max_age)) {
+
+    /* Only ports that have started a timer since they were last found idle
+     * are on 'timer_ports', so the cost here scales with the number of busy
+     * ports rather than the number of ports. */
+    LIST_FOR_EACH (p, struct stp_port, timer_node, &stp->timer_ports) {
+        if (stp_port_timer_expired(p, &p->message_age_timer, elapsed,
+                                   stp->max_age)) {
             stp_message_age_timer_expiry(p);
         }
     }
-    FOR_EACH_ENABLED_PORT (p, stp) {
-        if (stp_timer_expired(&p->forward_delay_timer, elapsed,
-                              stp->forward_delay)) {
+    LIST_FOR_EACH (p, struct stp_port, timer_node, &stp->timer_ports) {
+        if (stp_port_timer_expired(p, &p->forward_delay_timer, elapsed,
+                                   stp->forward_delay)) {
             stp_forward_delay_timer_expiry(p);
         }
-        if (stp_timer_expired(&p->hold_timer, elapsed, ms_to_timer(1000))) {
+        if (stp_port_timer_expired(p, &p->hold_timer, elapsed,
+                                   ms_to_timer(1000))) {
             stp_hold_timer_expiry(p);
         }
     }
+    LIST_FOR_EACH_SAFE (p, next, struct stp_port, timer_node,
+                        &stp->timer_ports) {
+        if (!p->message_age_timer.active && !p->forward_delay_timer.active
+            && !p->hold_timer.active) {
+            list_remove(&p->timer_node);
+            list_init(&p->timer_node);
+        }
+    }
 }
 
 static void
@@ -457,12 +495,33 @@ stp_get_forward_delay(const struct stp *stp)
 }
 
 /* Returns the port in 'stp' with index 'port_no', which must be between 0 and
- * STP_MAX_PORTS. */
+ * STP_MAX_PORTS - 1.  The port is created, initially disabled, the first time
+ * that it is requested. */
 struct stp_port *
 stp_get_port(struct stp *stp, int port_no)
 {
-    assert(port_no >= 0 && port_no < ARRAY_SIZE(stp->ports));
-    return &stp->ports[port_no];
+    struct stp_port *p;
+
+    assert(port_no >= 0 && port_no < STP_MAX_PORTS);
+    if (port_no >= stp->n_ports) {
+        int n_ports = MAX(port_no + 1, MIN(stp->n_ports * 2, STP_MAX_PORTS));
+        stp->ports = xrealloc(stp->ports, n_ports * sizeof *stp->ports);
+        memset(&stp->ports[stp->n_ports], 0,
+               (n_ports - stp->n_ports) * sizeof *stp->ports);
+        stp->n_ports = n_ports;
+    }
+
+    p = stp->ports[port_no];
+    if (!p) {
+        p = stp->ports[port_no] = xcalloc(1, sizeof *p);
+        p->stp = stp;
+        p->port_no = port_no;
+        p->port_id = (port_no + 1) | (STP_DEFAULT_PORT_PRIORITY & 0xf0) << 8;
+        p->path_cost = 19;      /* Recommended default for 100 Mb/s link. */
+        list_init(&p->timer_node);
+        stp_initialize_port(p, STP_DISABLED);
+    }
+    return p;
 }
 
 /* Returns the port connecting 'stp' to the root bridge, or a null pointer if
@@ -479,18 +538,18 @@ stp_get_root_port(struct stp *stp)
 bool
 stp_get_changed_port(struct stp *stp, struct stp_port **portp)
 {
-    struct stp_port *end = &stp->ports[ARRAY_SIZE(stp->ports)];
-    struct stp_port *p;
+    int i;
 
-    for (p = stp->first_changed_port; p < end; p++) {
-        if (p->state_changed) {
+    for (i = stp->first_changed_port; i < stp->n_ports; i++) {
+        struct stp_port *p = stp->ports[i];
+        if (p && p->state_changed) {
             p->state_changed = false;
-            stp->first_changed_port = p + 1;
+            stp->first_changed_port = i + 1;
             *portp = p;
             return true;
         }
     }
-    stp->first_changed_port = end;
+    stp->first_changed_port = stp->n_ports;
     *portp = NULL;
     return false;
 }
@@ -605,9 +664,7 @@ stp_port_get_stp(struct stp_port *p)
 int
 stp_port_no(const struct stp_port *p)
 {
-    struct stp *stp = p->stp;
-    assert(p >= stp->ports && p < &stp->ports[ARRAY_SIZE(stp->ports)]);
-    return p - stp->ports;
+    return p->port_no;
 }
 
 /* Returns the state of port 'p'. */
@@ -649,11 +706,14 @@ stp_port_enable(struct stp_port *p)
 }
 
 /* Sets the priority of port 'p' to 'new_priority'.  Lower numerical values
- * are interpreted as higher priorities. */
+ * are interpreted as higher priorities.  As in 802.1D-2004, only the top 4
+ * bits of the priority are significant, leaving 12 bits of the port
+ * identifier for the port number. */
 void
 stp_port_set_priority(struct stp_port *p, uint8_t new_priority)
 {
-    uint16_t new_port_id = (p->port_id & 0xff) | (new_priority << 8);
+    uint16_t new_port_id = ((p->port_id & STP_PORT_NUMBER_MASK)
+                            | (new_priority & 0xf0) << 8);
     if (p->port_id != new_port_id) {
         struct stp *stp = p->stp;
         if (stp_is_designated_port(p)) {
@@ -749,7 +809,7 @@ stp_transmit_config(struct stp_port *p)
             p->topology_change_ack = false;
             p->config_pending = false;
             stp_send_bpdu(p, &config, sizeof config);
-            stp_start_timer(&p->hold_timer, 0);
+            stp_start_port_timer(p, &p->hold_timer, 0);
         }
     }
 }
@@ -778,7 +838,8 @@ stp_record_config_information(struct stp_port *p,
     p->designated_cost = ntohl(config->root_path_cost);
     p->designated_bridge = ntohll(config->bridge_id);
     p->designated_port = ntohs(config->port_id);
-    stp_start_timer(&p->message_age_timer, ntohs(config->message_age));
+    stp_start_port_timer(p, &p->message_age_timer,
+                         ntohs(config->message_age));
 }
 
 static void
@@ -931,7 +992,7 @@ stp_make_forwarding(struct stp_port *p)
 {
     if (p->state == STP_BLOCKING) {
         stp_set_port_state(p, STP_LISTENING);
-        stp_start_timer(&p->forward_delay_timer, 0);
+        stp_start_port_timer(p, &p->forward_delay_timer, 0);
     }
 }
 
@@ -954,8 +1015,8 @@ stp_set_port_state(struct stp_port *p, enum stp_state state)
 {
     if (state != p->state && !p->state_changed) {
         p->state_changed = true;
-        if (p < p->stp->first_changed_port) {
-            p->stp->first_changed_port = p;
+        if (p->port_no < p->stp->first_changed_port) {
+            p->stp->first_changed_port = p->port_no;
         }
     }
     p->state = state;
@@ -1081,7 +1142,7 @@ stp_forward_delay_timer_expiry(struct stp_port *p)
 {
     if (p->state == STP_LISTENING) {
         stp_set_port_state(p, STP_LEARNING);
-        stp_start_timer(&p->forward_delay_timer, 0);
+        stp_start_port_timer(p, &p->forward_delay_timer, 0);
     } else if (p->state == STP_LEARNING) {
         stp_set_port_state(p, STP_FORWARDING);
         if (stp_is_designated_for_some_port(p->stp)) {
@@ -1147,6 +1208,17 @@ stp_start_timer(struct stp_timer *timer, int value)
     timer->active = true;
 }
 
+/* Starts 'timer', which must be one of 'p''s timers, and makes sure that
+ * stp_tick() will look at 'p'. */
+static void
+stp_start_port_timer(struct stp_port *p, struct stp_timer *timer, int value)
+{
+    stp_start_timer(timer, value);
+    if (list_is_empty(&p->timer_node)) {
+        list_push_back(&p->stp->timer_ports, &p->timer_node);
+    }
+}
+
 static void
 stp_stop_timer(struct stp_timer *timer)
 {
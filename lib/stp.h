@@ -60,8 +60,12 @@ extern const uint8_t stp_eth_addr[6];
  * values are higher priorities).  Bottom 48 bits are MAC address of bridge. */
 typedef uint64_t stp_identifier;
 
-/* Basic STP functionality. */
-#define STP_MAX_PORTS 255
+/* Basic STP functionality.
+ *
+ * Port identifiers use the 802.1D-2004 encoding, with a 4-bit priority and a
+ * 12-bit port number, so that bridges may have more than 255 ports. */
+#define STP_PORT_NUMBER_MASK 0xfff
+#define STP_MAX_PORTS STP_PORT_NUMBER_MASK
 struct stp *stp_create(const char *name, stp_identifier bridge_id,
                        void (*send_bpdu)(struct ofpbuf *bpdu, int port_no,
                                          void *aux),
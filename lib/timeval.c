@@ -39,22 +39,31 @@
 #include <signal.h>
 #include <string.h>
 #include <sys/time.h>
+#ifdef HAVE_EPOLL_CREATE1
+#include <sys/epoll.h>
+#endif
+#include "compiler.h"
 #include "fatal-signal.h"
 #include "util.h"
 
 /* Initialized? */
 static bool inited;
 
-/* Has a timer tick occurred? */
-static volatile sig_atomic_t tick;
+/* Number of timer ticks so far, modulo 2**30. */
+static volatile sig_atomic_t n_ticks;
 
-/* The current time, as of the last refresh. */
-static struct timeval now;
+/* Value of 'n_ticks' when this thread last refreshed 'now'.  -1 forces a
+ * refresh on a thread's first use. */
+static THREAD_LOCAL sig_atomic_t last_tick = -1;
+
+/* The current time, as of this thread's last refresh. */
+static THREAD_LOCAL struct timeval now;
 
 /* Time at which to die with SIGALRM (if not TIME_MIN). */
 static time_t deadline = TIME_MIN;
 
 static void sigalrm_handler(int);
+static void set_up_timer(void);
 static void refresh_if_ticked(void);
 static time_t time_add(time_t, time_t);
 static void block_sigalrm(sigset_t *);
@@ -65,15 +74,13 @@ void
 time_init(void)
 {
     struct sigaction sa;
-    struct itimerval itimer;
 
     if (inited) {
         return;
     }
 
     inited = true;
-    gettimeofday(&now, NULL);
-    tick = false;
+    time_refresh();
 
     /* Set up signal handler. */
     memset(&sa, 0, sizeof sa);
@@ -84,7 +91,25 @@ time_init(void)
         ofp_fatal(errno, "sigaction(SIGALRM) failed");
     }
 
-    /* Set up periodic timer. */
+    set_up_timer();
+}
+
+/* Restarts the periodic timer in the child of a fork(), which does not inherit
+ * it.  A deadline set with time_alarm() before the fork carries over. */
+void
+time_postfork(void)
+{
+    if (inited) {
+        time_refresh();
+        set_up_timer();
+    }
+}
+
+static void
+set_up_timer(void)
+{
+    struct itimerval itimer;
+
     itimer.it_interval.tv_sec = 0;
     itimer.it_interval.tv_usec = TIME_UPDATE_INTERVAL * 1000;
     itimer.it_value = itimer.it_interval;
@@ -100,7 +125,7 @@ void
 time_refresh(void)
 {
     gettimeofday(&now, NULL);
-    tick = false;
+    last_tick = n_ticks;
 }
 
 /* Returns the current time, in seconds. */
@@ -132,18 +157,9 @@ time_alarm(unsigned int secs)
     unblock_sigalrm(&oldsigs);
 }
 
-/* Like poll(), except:
- *
- *      - On error, returns a negative error code (instead of setting errno).
- *
- *      - If interrupted by a signal, retries automatically until the original
- *        'timeout' expires.  (Because of this property, this function will
- *        never return -EINTR.)
- *
- *      - As a side effect, refreshes the current time (like time_refresh()).
- */
-int
-time_poll(struct pollfd *pollfds, int n_pollfds, int timeout)
+/* Calls 'wait(aux, timeout)' the way time_poll() calls poll(). */
+static int
+time_wait(int (*wait)(void *aux, int timeout), void *aux, int timeout)
 {
     long long int start;
     sigset_t oldsigs;
@@ -162,7 +178,7 @@ time_poll(struct pollfd *pollfds, int n_pollfds, int timeout)
             time_left = timeout;
         }
 
-        retval = poll(pollfds, n_pollfds, time_left);
+        retval = wait(aux, time_left);
         if (retval < 0) {
             retval = -errno;
         }
@@ -182,6 +198,66 @@ time_poll(struct pollfd *pollfds, int n_pollfds, int timeout)
     return retval;
 }
 
+struct poll_args {
+    struct pollfd *pollfds;
+    int n_pollfds;
+};
+
+static int
+do_poll(void *args_, int timeout)
+{
+    struct poll_args *args = args_;
+    return poll(args->pollfds, args->n_pollfds, timeout);
+}
+
+/* Like poll(), except:
+ *
+ *      - On error, returns a negative error code (instead of setting errno).
+ *
+ *      - If interrupted by a signal, retries automatically until the original
+ *        'timeout' expires.  (Because of this property, this function will
+ *        never return -EINTR.)
+ *
+ *      - As a side effect, refreshes the current time (like time_refresh()).
+ */
+int
+time_poll(struct pollfd *pollfds, int n_pollfds, int timeout)
+{
+    struct poll_args args;
+
+    args.pollfds = pollfds;
+    args.n_pollfds = n_pollfds;
+    return time_wait(do_poll, &args, timeout);
+}
+
+#ifdef HAVE_EPOLL_CREATE1
+struct epoll_args {
+    int epfd;
+    struct epoll_event *events;
+    int max_events;
+};
+
+static int
+do_epoll_wait(void *args_, int timeout)
+{
+    struct epoll_args *args = args_;
+    return epoll_wait(args->epfd, args->events, args->max_events, timeout);
+}
+
+/* Like time_poll(), but for epoll_wait(). */
+int
+time_epoll_wait(int epfd, struct epoll_event *events, int max_events,
+                int timeout)
+{
+    struct epoll_args args;
+
+    args.epfd = epfd;
+    args.events = events;
+    args.max_events = max_events;
+    return time_wait(do_epoll_wait, &args, timeout);
+}
+#endif
+
 /* Returns the sum of 'a' and 'b', with saturation on overflow or underflow. */
 static time_t
 time_add(time_t a, time_t b)
@@ -194,7 +270,7 @@ time_add(time_t a, time_t b)
 static void
 sigalrm_handler(int sig_nr)
 {
-    tick = true;
+    n_ticks = (n_ticks + 1) & 0x3fffffff;
     if (deadline != TIME_MIN && time(0) > deadline) {
         fatal_signal_handler(sig_nr);
     }
@@ -204,7 +280,7 @@ static void
 refresh_if_ticked(void)
 {
     assert(inited);
-    if (tick) {
+    if (last_tick != n_ticks) {
         time_refresh();
     }
 }
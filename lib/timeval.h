@@ -38,6 +38,7 @@
 #include "type-props.h"
 #include "util.h"
 
+struct epoll_event;
 struct pollfd;
 
 /* POSIX allows floating-point time_t, but we don't support it. */
@@ -57,10 +58,15 @@ BUILD_ASSERT_DECL(TYPE_IS_SIGNED(time_t));
 #define TIME_UPDATE_INTERVAL 100
 
 void time_init(void);
+void time_postfork(void);
 void time_refresh(void);
 time_t time_now(void);
 long long int time_msec(void);
 void time_alarm(unsigned int secs);
 int time_poll(struct pollfd *, int n_pollfds, int timeout);
+#ifdef HAVE_EPOLL_CREATE1
+int time_epoll_wait(int epfd, struct epoll_event *, int max_events,
+                    int timeout);
+#endif
 
 #endif /* timeval.h */
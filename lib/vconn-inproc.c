@@ -0,0 +1,314 @@
+/* Copyright (c) 2008, 2009 The Board of Trustees of The Leland Stanford
+ * Junior University
+ *
+ * We are making the OpenFlow specification and associated documentation
+ * (Software) available for public use and benefit with the expectation
+ * that others will use, modify and enhance the Software and contribute
+ * those enhancements back to the community. However, since we would
+ * like to make the Software available for broadest use, with as few
+ * restrictions as possible permission is hereby granted, free of
+ * charge, to any person obtaining a copy of this Software to deal in
+ * the Software under the copyrights without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * The name and trademarks of copyright holder(s) may NOT be used in
+ * advertising or publicity pertaining to the Software or any
+ * derivatives without specific, written prior permission.
+ */
+
+/* In-process vconn, for an OpenFlow connection between two modules that run
+ * in the same process and poll loop, such as ofdatapath and the secure channel
+ * linked into it.  "pinproc:NAME" listens under NAME and "inproc:NAME"
+ * connects to that listener.  Messages pass from one end to the other as
+ * ofpbuf pointers, without being copied or serialized. */
+
+#include <config.h>
+#include "vconn.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include "list.h"
+#include "ofpbuf.h"
+#include "poll-loop.h"
+#include "queue.h"
+#include "util.h"
+#include "vconn-provider.h"
+
+#include "vlog.h"
+#define THIS_MODULE VLM_vconn_inproc
+
+/* Maximum number of messages queued toward one end.  Beyond this, sending
+ * fails with EAGAIN until the receiver catches up, as it would on a full
+ * socket. */
+#define INPROC_MAX_QUEUE 1024
+
+/* A connection.  Each end receives from its own queue and sends to the
+ * other's. */
+struct inproc_pipe {
+    struct ofp_queue queues[2]; /* Messages queued toward each end. */
+    bool closed[2];             /* Has each end been closed? */
+};
+
+/* Active in-process vconn: one end of a pipe. */
+
+struct inproc_vconn
+{
+    struct vconn vconn;
+    struct inproc_pipe *pipe;
+    int end;                    /* 0 or 1. */
+};
+
+static struct inproc_vconn *
+inproc_vconn_cast(struct vconn *vconn)
+{
+    vconn_assert_class(vconn, &inproc_vconn_class);
+    return CONTAINER_OF(vconn, struct inproc_vconn, vconn);
+}
+
+static struct inproc_vconn *
+new_inproc_vconn(const char *name, struct inproc_pipe *pipe, int end)
+{
+    struct inproc_vconn *v = xmalloc(sizeof *v);
+    vconn_init(&v->vconn, &inproc_vconn_class, 0, 0, name, true);
+    v->pipe = pipe;
+    v->end = end;
+    return v;
+}
+
+static void
+inproc_close(struct vconn *vconn)
+{
+    struct inproc_vconn *v = inproc_vconn_cast(vconn);
+    struct inproc_pipe *pipe = v->pipe;
+
+    queue_destroy(&pipe->queues[v->end]);
+    pipe->closed[v->end] = true;
+    if (pipe->closed[!v->end]) {
+        free(pipe);
+    }
+    free(v);
+}
+
+static int
+inproc_connect(struct vconn *vconn UNUSED)
+{
+    return 0;
+}
+
+static int
+inproc_recv(struct vconn *vconn, struct ofpbuf **bufferp)
+{
+    struct inproc_vconn *v = inproc_vconn_cast(vconn);
+    struct inproc_pipe *pipe = v->pipe;
+    struct ofp_queue *q = &pipe->queues[v->end];
+
+    if (q->n) {
+        *bufferp = queue_pop_head(q);
+        return 0;
+    }
+    return pipe->closed[!v->end] ? EOF : EAGAIN;
+}
+
+static int
+inproc_send(struct vconn *vconn, struct ofpbuf *buffer)
+{
+    struct inproc_vconn *v = inproc_vconn_cast(vconn);
+    struct inproc_pipe *pipe = v->pipe;
+    struct ofp_queue *q = &pipe->queues[!v->end];
+
+    if (pipe->closed[!v->end]) {
+        return EPIPE;
+    } else if (q->n >= INPROC_MAX_QUEUE) {
+        return EAGAIN;
+    }
+    queue_push_tail(q, buffer);
+    return 0;
+}
+
+static void
+inproc_wait(struct vconn *vconn, enum vconn_wait_type wait)
+{
+    struct inproc_vconn *v = inproc_vconn_cast(vconn);
+    struct inproc_pipe *pipe = v->pipe;
+
+    switch (wait) {
+    case WAIT_CONNECT:
+        poll_immediate_wake();
+        break;
+
+    case WAIT_SEND:
+        /* If the queue is full, the receiver has messages waiting for it, so
+         * its own WAIT_RECV keeps the poll loop spinning until it drains
+         * them. */
+        if (pipe->queues[!v->end].n < INPROC_MAX_QUEUE
+            || pipe->closed[!v->end]) {
+            poll_immediate_wake();
+        }
+        break;
+
+    case WAIT_RECV:
+        if (pipe->queues[v->end].n || pipe->closed[!v->end]) {
+            poll_immediate_wake();
+        }
+        break;
+
+    default:
+        NOT_REACHED();
+    }
+}
+
+/* Passive in-process vconn. */
+
+struct pinproc_pvconn
+{
+    struct pvconn pvconn;
+    struct list node;           /* In 'pinproc_listeners'. */
+    char *name;                 /* Name to connect to, without "pinproc:". */
+    struct list pending;        /* Ends not yet accepted, as
+                                 * 'struct pinproc_pending'. */
+};
+
+struct pinproc_pending {
+    struct list node;
+    struct inproc_vconn *vconn;
+};
+
+static struct list pinproc_listeners = LIST_INITIALIZER(&pinproc_listeners);
+
+static struct pinproc_pvconn *
+pinproc_pvconn_cast(struct pvconn *pvconn)
+{
+    pvconn_assert_class(pvconn, &pinproc_pvconn_class);
+    return CONTAINER_OF(pvconn, struct pinproc_pvconn, pvconn);
+}
+
+static struct pinproc_pvconn *
+pinproc_find(const char *name)
+{
+    struct pinproc_pvconn *p;
+
+    LIST_FOR_EACH (p, struct pinproc_pvconn, node, &pinproc_listeners) {
+        if (!strcmp(p->name, name)) {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+static int
+inproc_open(const char *name, char *suffix, struct vconn **vconnp)
+{
+    struct pinproc_pvconn *p = pinproc_find(suffix);
+    struct pinproc_pending *pending;
+    struct inproc_pipe *pipe;
+
+    if (!p) {
+        return ECONNREFUSED;
+    }
+
+    pipe = xmalloc(sizeof *pipe);
+    queue_init(&pipe->queues[0]);
+    queue_init(&pipe->queues[1]);
+    pipe->closed[0] = pipe->closed[1] = false;
+
+    pending = xmalloc(sizeof *pending);
+    pending->vconn = new_inproc_vconn(name, pipe, 1);
+    list_push_back(&p->pending, &pending->node);
+
+    *vconnp = &new_inproc_vconn(name, pipe, 0)->vconn;
+    return 0;
+}
+
+struct vconn_class inproc_vconn_class = {
+    "inproc",                   /* name */
+    inproc_open,                /* open */
+    inproc_close,               /* close */
+    inproc_connect,             /* connect */
+    inproc_recv,                /* recv */
+    inproc_send,                /* send */
+    NULL,                       /* send_batch */
+    inproc_wait,                /* wait */
+};
+
+static int
+pinproc_open(const char *name, char *suffix, struct pvconn **pvconnp)
+{
+    struct pinproc_pvconn *p;
+
+    if (pinproc_find(suffix)) {
+        return EADDRINUSE;
+    }
+
+    p = xmalloc(sizeof *p);
+    pvconn_init(&p->pvconn, &pinproc_pvconn_class, name);
+    p->name = xstrdup(suffix);
+    list_init(&p->pending);
+    list_push_back(&pinproc_listeners, &p->node);
+    *pvconnp = &p->pvconn;
+    return 0;
+}
+
+static void
+pinproc_close(struct pvconn *pvconn)
+{
+    struct pinproc_pvconn *p = pinproc_pvconn_cast(pvconn);
+    struct pinproc_pending *pending, *next;
+
+    LIST_FOR_EACH_SAFE (pending, next, struct pinproc_pending, node,
+                        &p->pending) {
+        vconn_close(&pending->vconn->vconn);
+        free(pending);
+    }
+    list_remove(&p->node);
+    free(p->name);
+    free(p);
+}
+
+static int
+pinproc_accept(struct pvconn *pvconn, struct vconn **new_vconnp)
+{
+    struct pinproc_pvconn *p = pinproc_pvconn_cast(pvconn);
+    struct pinproc_pending *pending;
+
+    if (list_is_empty(&p->pending)) {
+        return EAGAIN;
+    }
+    pending = CONTAINER_OF(list_pop_front(&p->pending),
+                           struct pinproc_pending, node);
+    *new_vconnp = &pending->vconn->vconn;
+    free(pending);
+    return 0;
+}
+
+static void
+pinproc_wait(struct pvconn *pvconn)
+{
+    struct pinproc_pvconn *p = pinproc_pvconn_cast(pvconn);
+
+    if (!list_is_empty(&p->pending)) {
+        poll_immediate_wake();
+    }
+}
+
+struct pvconn_class pinproc_pvconn_class = {
+    "pinproc",
+    pinproc_open,
+    pinproc_close,
+    pinproc_accept,
+    pinproc_wait
+};
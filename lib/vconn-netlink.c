@@ -123,6 +123,22 @@ netlink_send(struct vconn *vconn, struct ofpbuf *buffer)
     return retval;
 }
 
+static int
+netlink_send_batch(struct vconn *vconn, struct ofpbuf **msgs, size_t n_msgs,
+                   size_t *n_sentp)
+{
+    struct netlink_vconn *netlink = netlink_vconn_cast(vconn);
+    size_t i;
+    int retval;
+
+    retval = dpif_send_openflow_batch(&netlink->dp, netlink->dp_idx,
+                                      msgs, n_msgs, n_sentp);
+    for (i = 0; i < *n_sentp; i++) {
+        ofpbuf_delete(msgs[i]);
+    }
+    return retval;
+}
+
 static void
 netlink_wait(struct vconn *vconn, enum vconn_wait_type wait) 
 {
@@ -153,5 +169,6 @@ struct vconn_class netlink_vconn_class = {
     NULL,                       /* connect */
     netlink_recv,               /* recv */
     netlink_send,               /* send */
+    netlink_send_batch,         /* send_batch */
     netlink_wait,               /* wait */
 };
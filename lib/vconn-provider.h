@@ -123,6 +123,18 @@ struct vconn_class {
      * accepted for transmission, it should return EAGAIN. */
     int (*send)(struct vconn *vconn, struct ofpbuf *msg);
 
+    /* Tries to queue the 'n_msgs' messages in 'msgs', in order, for
+     * transmission on 'vconn', and stores the number that it queued in
+     * '*n_sentp'.  Ownership of those messages is transferred to the vconn;
+     * the caller retains the rest.  Returns 0 if at least one message was
+     * queued, otherwise a positive errno value (EAGAIN if none could be
+     * accepted immediately).
+     *
+     * This function may be null, in which case vconn_send_batch() calls the
+     * send function once per message instead. */
+    int (*send_batch)(struct vconn *vconn, struct ofpbuf **msgs,
+                      size_t n_msgs, size_t *n_sentp);
+
     /* Arranges for the poll loop to wake up when 'vconn' is ready to take an
      * action of the given 'type'. */
     void (*wait)(struct vconn *vconn, enum vconn_wait_type type);
@@ -190,5 +202,11 @@ extern struct pvconn_class pssl_pvconn_class;
 #ifdef HAVE_NETLINK
 extern struct vconn_class netlink_vconn_class;
 #endif
+extern struct vconn_class inproc_vconn_class;
+extern struct pvconn_class pinproc_pvconn_class;
+#ifdef HAVE_EVENTFD
+extern struct vconn_class shm_vconn_class;
+extern struct pvconn_class pshm_pvconn_class;
+#endif
 
 #endif /* vconn-provider.h */
@@ -0,0 +1,700 @@
+/* Copyright (c) 2008, 2009 The Board of Trustees of The Leland Stanford
+ * Junior University
+ *
+ * We are making the OpenFlow specification and associated documentation
+ * (Software) available for public use and benefit with the expectation
+ * that others will use, modify and enhance the Software and contribute
+ * those enhancements back to the community. However, since we would
+ * like to make the Software available for broadest use, with as few
+ * restrictions as possible permission is hereby granted, free of
+ * charge, to any person obtaining a copy of this Software to deal in
+ * the Software under the copyrights without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * The name and trademarks of copyright holder(s) may NOT be used in
+ * advertising or publicity pertaining to the Software or any
+ * derivatives without specific, written prior permission.
+ */
+
+/* Shared-memory vconn, for an OpenFlow connection between two processes on
+ * the same host, such as ofprotocol and ofdatapath.
+ *
+ * The peers rendezvous over a Unix domain socket: the passive side ("pshm:")
+ * listens on it and, for each connection it accepts, creates a shared memory
+ * region that holds a pair of byte rings, one per direction, plus an eventfd
+ * "doorbell" for each peer, and passes all three file descriptors to the
+ * active side ("shm:") with SCM_RIGHTS.  From then on messages are copied
+ * straight into and out of the rings, without a system call per message.  A
+ * peer rings the other's doorbell only when the other might be about to
+ * sleep: when it adds data to a ring that the other had emptied, or when it
+ * frees space in a ring that the other found full.
+ *
+ * The Unix socket stays open for the life of the connection but carries no
+ * data.  It reports the peer's exit as end of file. */
+
+#include <config.h>
+#include "vconn.h"
+#include <errno.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "ofpbuf.h"
+#include "openflow/openflow.h"
+#include "poll-loop.h"
+#include "socket-util.h"
+#include "util.h"
+#include "vconn-provider.h"
+#include "vconn-stream.h"
+
+#include "vlog.h"
+#define THIS_MODULE VLM_vconn_shm
+
+static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(10, 25);
+
+/* Bytes in each direction's ring.  Must be a power of 2 and hold at least one
+ * maximum-size OpenFlow message. */
+#define SHM_RING_SIZE (256 * 1024)
+BUILD_ASSERT_DECL(!(SHM_RING_SIZE & (SHM_RING_SIZE - 1)));
+BUILD_ASSERT_DECL(SHM_RING_SIZE >= 65536);
+
+/* Identifies a region laid out as in this file, so that peers built from
+ * different sources refuse to talk instead of misreading each other. */
+#define SHM_MAGIC 0x4f46534d    /* "OFSM". */
+
+/* Full memory barrier.  Each side publishes its own index and then reads the
+ * other side's, so a store-load barrier is needed. */
+#define shm_barrier() __sync_synchronize()
+
+/* One direction of a connection.  'head' and 'tail' count bytes ever written
+ * and read, so 'head - tail' is the number of bytes in the ring.  Messages are
+ * stored back to back, each one whole (the length in its ofp_header says
+ * where the next one starts), wrapping around the end of 'data'. */
+struct shm_ring {
+    /* Written only by the producer. */
+    volatile uint32_t head __attribute__((aligned(64)));
+
+    /* Written only by the consumer. */
+    volatile uint32_t tail __attribute__((aligned(64)));
+
+    /* Set by the producer when the ring is too full for its next message,
+     * cleared by the consumer when it makes room. */
+    volatile uint32_t tx_blocked __attribute__((aligned(64)));
+
+    uint8_t data[SHM_RING_SIZE] __attribute__((aligned(64)));
+};
+
+/* The shared memory region.  The passive side transmits on rings[0] and the
+ * active side on rings[1]. */
+struct shm_region {
+    uint32_t magic;
+    uint32_t ring_size;
+    struct shm_ring rings[2];
+};
+
+/* File descriptors passed from the passive to the active side. */
+enum {
+    SHM_FD_REGION,              /* The shm_region. */
+    SHM_FD_PASSIVE_DOORBELL,    /* Wakes up the passive side. */
+    SHM_FD_ACTIVE_DOORBELL,     /* Wakes up the active side. */
+    SHM_N_FDS
+};
+
+/* Active shared-memory vconn. */
+
+struct shm_vconn
+{
+    struct vconn vconn;
+    int sock;                   /* Rendezvous socket. */
+    bool sock_connected;        /* Has connect() on 'sock' completed? */
+    struct shm_region *region;  /* Null until the peers have rendezvoused. */
+    struct shm_ring *rx, *tx;
+    int doorbell;               /* Our eventfd. */
+    int peer_doorbell;          /* The peer's eventfd. */
+};
+
+static struct shm_vconn *
+shm_vconn_cast(struct vconn *vconn)
+{
+    vconn_assert_class(vconn, &shm_vconn_class);
+    return CONTAINER_OF(vconn, struct shm_vconn, vconn);
+}
+
+static struct shm_vconn *
+new_shm_vconn(const char *name, int sock, int connect_status)
+{
+    struct shm_vconn *s;
+
+    s = xmalloc(sizeof *s);
+    vconn_init(&s->vconn, &shm_vconn_class, connect_status, 0, name, true);
+    s->sock = sock;
+    s->sock_connected = false;
+    s->region = NULL;
+    s->rx = s->tx = NULL;
+    s->doorbell = s->peer_doorbell = -1;
+    return s;
+}
+
+/* Starts using 'region' for 's', as the active side if 'active', otherwise as
+ * the passive side.  Takes ownership of the doorbell fds. */
+static void
+shm_attach(struct shm_vconn *s, struct shm_region *region, bool active,
+           int passive_doorbell, int active_doorbell)
+{
+    s->region = region;
+    s->tx = &region->rings[active];
+    s->rx = &region->rings[!active];
+    s->doorbell = active ? active_doorbell : passive_doorbell;
+    s->peer_doorbell = active ? passive_doorbell : active_doorbell;
+}
+
+static void
+shm_close(struct vconn *vconn)
+{
+    struct shm_vconn *s = shm_vconn_cast(vconn);
+
+    if (s->region) {
+        munmap(s->region, sizeof *s->region);
+        poll_fd_closing(s->doorbell);
+        close(s->doorbell);
+        close(s->peer_doorbell);
+    }
+    poll_fd_closing(s->sock);
+    close(s->sock);
+    free(s);
+}
+
+/* Maps the region in 'fd'.  Returns the region, or a null pointer on
+ * failure. */
+static struct shm_region *
+shm_map_region(int fd)
+{
+    struct shm_region *region;
+
+    region = mmap(NULL, sizeof *region, PROT_READ | PROT_WRITE, MAP_SHARED,
+                  fd, 0);
+    if (region == MAP_FAILED) {
+        VLOG_ERR_RL(&rl, "mmap: %s", strerror(errno));
+        return NULL;
+    }
+    return region;
+}
+
+/* Receives the file descriptors sent by the passive side on 's''s socket and
+ * maps the region they name.  Returns 0 if successful, EAGAIN if they have not
+ * arrived yet, otherwise a positive errno value. */
+static int
+shm_recv_fds(struct shm_vconn *s)
+{
+    union {
+        struct cmsghdr cm;
+        char buf[CMSG_SPACE(SHM_N_FDS * sizeof(int))];
+    } control;
+    struct shm_region *region;
+    struct cmsghdr *cmsg;
+    struct msghdr msg;
+    struct iovec iov;
+    int fds[SHM_N_FDS];
+    size_t n_fds;
+    ssize_t retval;
+    size_t i;
+    char c;
+
+    iov.iov_base = &c;
+    iov.iov_len = 1;
+    memset(&msg, 0, sizeof msg);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = &control;
+    msg.msg_controllen = sizeof control;
+
+    retval = recvmsg(s->sock, &msg, MSG_DONTWAIT);
+    if (retval < 0) {
+        return errno;
+    } else if (retval == 0) {
+        return ECONNRESET;
+    }
+
+    n_fds = 0;
+    for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS
+            && !n_fds) {
+            n_fds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            n_fds = MIN(n_fds, SHM_N_FDS);
+            memcpy(fds, CMSG_DATA(cmsg), n_fds * sizeof(int));
+        }
+    }
+    if (n_fds != SHM_N_FDS || msg.msg_flags & MSG_CTRUNC) {
+        VLOG_ERR_RL(&rl, "%s: peer sent %zu file descriptors, expected %d",
+                    s->vconn.name, n_fds, SHM_N_FDS);
+        goto error;
+    }
+
+    region = shm_map_region(fds[SHM_FD_REGION]);
+    if (!region) {
+        goto error;
+    }
+    close(fds[SHM_FD_REGION]);
+    if (region->magic != SHM_MAGIC || region->ring_size != SHM_RING_SIZE) {
+        VLOG_ERR_RL(&rl, "%s: peer uses an incompatible shared memory layout",
+                    s->vconn.name);
+        munmap(region, sizeof *region);
+        close(fds[SHM_FD_PASSIVE_DOORBELL]);
+        close(fds[SHM_FD_ACTIVE_DOORBELL]);
+        return EPROTO;
+    }
+    shm_attach(s, region, true, fds[SHM_FD_PASSIVE_DOORBELL],
+               fds[SHM_FD_ACTIVE_DOORBELL]);
+    return 0;
+
+error:
+    for (i = 0; i < n_fds; i++) {
+        close(fds[i]);
+    }
+    return EPROTO;
+}
+
+static int
+shm_connect(struct vconn *vconn)
+{
+    struct shm_vconn *s = shm_vconn_cast(vconn);
+
+    if (!s->sock_connected) {
+        int retval = check_connection_completion(s->sock);
+        if (retval) {
+            return retval;
+        }
+        s->sock_connected = true;
+    }
+    return shm_recv_fds(s);
+}
+
+static void
+shm_ring_doorbell(int fd)
+{
+    static const uint64_t one = 1;
+
+    /* If the counter is full, the peer is already due to wake up. */
+    if (write(fd, &one, sizeof one) < 0 && errno != EAGAIN) {
+        VLOG_WARN_RL(&rl, "failed to wake shared memory peer: %s",
+                     strerror(errno));
+    }
+}
+
+/* Returns 0 if 's''s peer is still there, EOF if it has closed the
+ * connection, otherwise a positive errno value. */
+static int
+shm_check_peer(const struct shm_vconn *s)
+{
+    ssize_t retval;
+    char c;
+
+    retval = recv(s->sock, &c, 1, MSG_DONTWAIT | MSG_PEEK);
+    if (retval < 0) {
+        return errno == EAGAIN ? 0 : errno;
+    } else if (retval == 0) {
+        return EOF;
+    } else {
+        VLOG_ERR_RL(&rl, "%s: unexpected data on rendezvous socket",
+                    s->vconn.name);
+        return EPROTO;
+    }
+}
+
+static void
+shm_copy_in(struct shm_ring *ring, uint32_t pos, const void *data_,
+            size_t n)
+{
+    const uint8_t *data = data_;
+    size_t ofs = pos & (SHM_RING_SIZE - 1);
+    size_t chunk = MIN(n, SHM_RING_SIZE - ofs);
+
+    memcpy(&ring->data[ofs], data, chunk);
+    memcpy(&ring->data[0], data + chunk, n - chunk);
+}
+
+static void
+shm_copy_out(const struct shm_ring *ring, uint32_t pos, void *data_, size_t n)
+{
+    uint8_t *data = data_;
+    size_t ofs = pos & (SHM_RING_SIZE - 1);
+    size_t chunk = MIN(n, SHM_RING_SIZE - ofs);
+
+    memcpy(data, &ring->data[ofs], chunk);
+    memcpy(data + chunk, &ring->data[0], n - chunk);
+}
+
+static int
+shm_recv(struct vconn *vconn, struct ofpbuf **bufferp)
+{
+    struct shm_vconn *s = shm_vconn_cast(vconn);
+    struct shm_ring *ring = s->rx;
+    uint32_t tail = ring->tail;
+    uint32_t n_bytes = ring->head - tail;
+    struct ofp_header oh;
+    struct ofpbuf *buffer;
+    size_t length;
+
+    if (!n_bytes) {
+        uint64_t count;
+        int error;
+
+        /* Every wakeup so far is for data already taken.  One for data
+         * added after the check above makes shm_wait() wake immediately, so
+         * discarding it here is harmless. */
+        while (read(s->doorbell, &count, sizeof count) > 0) {
+            continue;
+        }
+        error = shm_check_peer(s);
+        return error ? error : EAGAIN;
+    }
+
+    shm_barrier();
+    if (n_bytes < sizeof oh) {
+        VLOG_ERR_RL(&rl, "%s: ring holds a partial header", vconn->name);
+        return EPROTO;
+    }
+    shm_copy_out(ring, tail, &oh, sizeof oh);
+    length = ntohs(oh.length);
+    if (length < sizeof oh || length > n_bytes) {
+        VLOG_ERR_RL(&rl, "%s: bad message length %zu in ring",
+                    vconn->name, length);
+        return EPROTO;
+    }
+
+    buffer = ofpbuf_new(length);
+    shm_copy_out(ring, tail, ofpbuf_put_uninit(buffer, length), length);
+    shm_barrier();
+    ring->tail = tail + length;
+    shm_barrier();
+    if (ring->tx_blocked) {
+        ring->tx_blocked = 0;
+        shm_ring_doorbell(s->peer_doorbell);
+    }
+
+    *bufferp = buffer;
+    return 0;
+}
+
+/* Copies as many of the 'n_msgs' messages in 'msgs' into 's''s transmit ring
+ * as fit, starting at 'head', and returns the number copied.  Updates '*headp'
+ * to just past the last one. */
+static size_t
+shm_fill_ring(struct shm_vconn *s, struct ofpbuf **msgs, size_t n_msgs,
+              uint32_t *headp)
+{
+    struct shm_ring *ring = s->tx;
+    uint32_t head = *headp;
+    uint32_t tail = ring->tail;
+    size_t i;
+
+    shm_barrier();
+    for (i = 0; i < n_msgs; i++) {
+        const struct ofpbuf *msg = msgs[i];
+
+        if (SHM_RING_SIZE - (head - tail) < msg->size) {
+            break;
+        }
+        shm_copy_in(ring, head, msg->data, msg->size);
+        head += msg->size;
+    }
+    *headp = head;
+    return i;
+}
+
+/* Copies as many messages as fit into the ring and publishes them together,
+ * so that a batch costs at most one doorbell. */
+static int
+shm_send_batch(struct vconn *vconn, struct ofpbuf **msgs, size_t n_msgs,
+               size_t *n_sentp)
+{
+    struct shm_vconn *s = shm_vconn_cast(vconn);
+    struct shm_ring *ring = s->tx;
+    uint32_t old_head = ring->head;
+    uint32_t head = old_head;
+    size_t n_sent, i;
+
+    n_sent = shm_fill_ring(s, msgs, n_msgs, &head);
+    if (n_sent < n_msgs) {
+        /* Ask the peer to ring our doorbell when it makes room, then check
+         * again in case it did so before it could see the request. */
+        ring->tx_blocked = 1;
+        shm_barrier();
+        n_sent += shm_fill_ring(s, msgs + n_sent, n_msgs - n_sent, &head);
+    }
+
+    if (n_sent) {
+        shm_barrier();
+        ring->head = head;
+        shm_barrier();
+
+        /* If the peer had already emptied the ring, it may be about to sleep,
+         * so wake it up.  Otherwise it will get to these messages before it
+         * checks for more. */
+        if (ring->tail == old_head) {
+            shm_ring_doorbell(s->peer_doorbell);
+        }
+        for (i = 0; i < n_sent; i++) {
+            ofpbuf_delete(msgs[i]);
+        }
+    } else {
+        int error = shm_check_peer(s);
+        if (error) {
+            return error == EOF ? EPIPE : error;
+        }
+    }
+
+    *n_sentp = n_sent;
+    return n_sent ? 0 : EAGAIN;
+}
+
+static int
+shm_send(struct vconn *vconn, struct ofpbuf *buffer)
+{
+    size_t n_sent;
+
+    return shm_send_batch(vconn, &buffer, 1, &n_sent);
+}
+
+static void
+shm_wait(struct vconn *vconn, enum vconn_wait_type wait)
+{
+    struct shm_vconn *s = shm_vconn_cast(vconn);
+
+    switch (wait) {
+    case WAIT_CONNECT:
+        poll_fd_wait(s->sock, s->sock_connected ? POLLIN : POLLOUT);
+        break;
+
+    case WAIT_SEND:
+        if (!s->tx->tx_blocked) {
+            poll_immediate_wake();
+        } else {
+            poll_fd_wait(s->doorbell, POLLIN);
+            poll_fd_wait(s->sock, POLLIN);
+        }
+        break;
+
+    case WAIT_RECV:
+        if (s->rx->head != s->rx->tail) {
+            poll_immediate_wake();
+        } else {
+            poll_fd_wait(s->doorbell, POLLIN);
+            poll_fd_wait(s->sock, POLLIN);
+        }
+        break;
+
+    default:
+        NOT_REACHED();
+    }
+}
+
+static int
+shm_vconn_open(const char *name, char *suffix, struct vconn **vconnp)
+{
+    int fd;
+
+    fd = make_unix_socket(SOCK_STREAM, true, false, NULL, suffix);
+    if (fd < 0) {
+        VLOG_ERR("%s: connection failed: %s", suffix, strerror(-fd));
+        return -fd;
+    }
+
+    *vconnp = &new_shm_vconn(name, fd, EAGAIN)->vconn;
+    return 0;
+}
+
+struct vconn_class shm_vconn_class = {
+    "shm",                      /* name */
+    shm_vconn_open,             /* open */
+    shm_close,                  /* close */
+    shm_connect,                /* connect */
+    shm_recv,                   /* recv */
+    shm_send,                   /* send */
+    shm_send_batch,             /* send_batch */
+    shm_wait,                   /* wait */
+};
+
+/* Passive shared-memory vconn. */
+
+/* Creates an unlinked file of 'size' bytes to back a shared memory region,
+ * preferring tmpfs.  Returns its fd, or a negative errno value. */
+static int
+create_region_file(size_t size)
+{
+    static const char *dirs[] = { "/dev/shm", "/tmp" };
+    int error = 0;
+    size_t i;
+
+    for (i = 0; i < ARRAY_SIZE(dirs); i++) {
+        char template[64];
+        int fd;
+
+        snprintf(template, sizeof template, "%s/vconn-shm.XXXXXX", dirs[i]);
+        fd = mkstemp(template);
+        if (fd < 0) {
+            error = errno;
+            continue;
+        }
+        unlink(template);
+        if (ftruncate(fd, size) < 0) {
+            error = errno;
+            close(fd);
+            continue;
+        }
+        return fd;
+    }
+    return -error;
+}
+
+/* Creates a nonblocking eventfd.  Returns it, or a negative errno value. */
+static int
+create_doorbell(void)
+{
+    int fd = eventfd(0, 0);
+    if (fd < 0) {
+        return -errno;
+    }
+    set_nonblocking(fd);
+    return fd;
+}
+
+static int
+send_fds(int sock, const int fds[SHM_N_FDS])
+{
+    union {
+        struct cmsghdr cm;
+        char buf[CMSG_SPACE(SHM_N_FDS * sizeof(int))];
+    } control;
+    struct cmsghdr *cmsg;
+    struct msghdr msg;
+    struct iovec iov;
+    char c = 0;
+
+    iov.iov_base = &c;
+    iov.iov_len = 1;
+    memset(&msg, 0, sizeof msg);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = &control;
+    msg.msg_controllen = sizeof control;
+
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(SHM_N_FDS * sizeof(int));
+    memcpy(CMSG_DATA(cmsg), fds, SHM_N_FDS * sizeof(int));
+
+    return sendmsg(sock, &msg, 0) < 0 ? errno : 0;
+}
+
+static int
+pshm_accept(int sock, const struct sockaddr *sa, size_t sa_len,
+            struct vconn **vconnp)
+{
+    const struct sockaddr_un *sun = (const struct sockaddr_un *) sa;
+    int name_len = get_unix_name_len(sa_len);
+    struct shm_region *region = NULL;
+    int fds[SHM_N_FDS];
+    struct shm_vconn *s;
+    char name[128];
+    int error;
+    size_t i;
+
+    fds[SHM_FD_REGION] = create_region_file(sizeof *region);
+    fds[SHM_FD_PASSIVE_DOORBELL] = create_doorbell();
+    fds[SHM_FD_ACTIVE_DOORBELL] = create_doorbell();
+    for (i = 0; i < SHM_N_FDS; i++) {
+        if (fds[i] < 0) {
+            error = -fds[i];
+            VLOG_ERR_RL(&rl, "creating shared memory connection failed: %s",
+                        strerror(error));
+            goto error;
+        }
+    }
+
+    region = shm_map_region(fds[SHM_FD_REGION]);
+    if (!region) {
+        error = ENOMEM;
+        goto error;
+    }
+    region->magic = SHM_MAGIC;
+    region->ring_size = SHM_RING_SIZE;
+
+    error = send_fds(sock, fds);
+    if (error) {
+        VLOG_ERR_RL(&rl, "passing shared memory to peer failed: %s",
+                    strerror(error));
+        goto error;
+    }
+    close(fds[SHM_FD_REGION]);
+
+    if (name_len > 0) {
+        snprintf(name, sizeof name, "shm:%.*s", name_len, sun->sun_path);
+    } else {
+        strcpy(name, "shm");
+    }
+    s = new_shm_vconn(name, sock, 0);
+    s->sock_connected = true;
+    shm_attach(s, region, false, fds[SHM_FD_PASSIVE_DOORBELL],
+               fds[SHM_FD_ACTIVE_DOORBELL]);
+    *vconnp = &s->vconn;
+    return 0;
+
+error:
+    if (region) {
+        munmap(region, sizeof *region);
+    }
+    for (i = 0; i < SHM_N_FDS; i++) {
+        if (fds[i] >= 0) {
+            close(fds[i]);
+        }
+    }
+    close(sock);
+    return error;
+}
+
+static int
+pshm_pvconn_open(const char *name UNUSED, char *suffix,
+                 struct pvconn **pvconnp)
+{
+    int fd;
+
+    fd = make_unix_socket(SOCK_STREAM, true, false, suffix, NULL);
+    if (fd < 0) {
+        VLOG_ERR("%s: binding failed: %s", suffix, strerror(-fd));
+        return -fd;
+    }
+
+    return new_pstream_pvconn("pshm", fd, pshm_accept, pvconnp);
+}
+
+struct pvconn_class pshm_pvconn_class = {
+    "pshm",
+    pshm_pvconn_open,
+    NULL,
+    NULL,
+    NULL
+};
@@ -44,6 +44,8 @@
 #include <openssl/ssl.h>
 #include <openssl/x509v3.h>
 #include <poll.h>
+#include <pthread.h>
+#include <signal.h>
 #include <sys/fcntl.h>
 #include <sys/stat.h>
 #include <unistd.h>
@@ -53,6 +55,7 @@
 #include "openflow/openflow.h"
 #include "packets.h"
 #include "poll-loop.h"
+#include "shash.h"
 #include "socket-util.h"
 #include "socket-util.h"
 #include "util.h"
@@ -143,14 +146,88 @@ struct ssl_vconn
      * deadlock and livelock situations above.
      */
     int rx_want, tx_want;
+
+    /* Crypto thread, if vconn_ssl_set_crypto_threads() enabled one, or a null
+     * pointer.  While it exists, it owns 'ssl' and 'fd' and the members above
+     * are unused. */
+    struct ssl_crypto *crypto;
+
+    /* Thread running the handshake, if vconn_ssl_set_handshake_threads()
+     * enabled one and it has not yet been reaped, or a null pointer.  While
+     * it exists, it owns 'ssl' and 'fd'. */
+    struct ssl_handshake *handshake;
 };
 
+/* A thread that runs the SSL handshake of a connection.  The thread writes
+ * 'error' and then a byte to 'notify_pipe' when the handshake completes or
+ * fails; the main thread reads 'error' only after joining it.  A byte written
+ * to 'wake_pipe' makes the thread give up early. */
+struct ssl_handshake {
+    pthread_t thread;
+    int error;                  /* 0, or EPROTO if the handshake failed. */
+    int wake_pipe[2];
+    int notify_pipe[2];
+};
+
+/* State shared between the main thread and the crypto thread of an SSL
+ * connection.  The crypto thread does all the SSL_read() and SSL_write() calls
+ * on the connection, so the main thread only copies plaintext into 'tx' and out
+ * of 'rx'.  'mutex' protects everything except 'thread' and the pipes. */
+struct ssl_crypto {
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    struct ofpbuf *rx;          /* Decrypted bytes not yet received. */
+    struct ofpbuf *tx;          /* Plaintext not yet handed to SSL_write(). */
+    int rx_error;               /* Once reading has stopped: error or EOF. */
+    int tx_error;               /* Once writing has stopped: error. */
+    bool exiting;               /* Set by ssl_close() to stop the thread. */
+
+    /* A byte is written to 'wake_pipe' to wake the crypto thread when the
+     * main thread makes room in 'rx', adds to an empty 'tx', or sets
+     * 'exiting', and to 'notify_pipe' to wake the main thread when the crypto
+     * thread adds to an empty 'rx', makes room in a full 'tx', or sets an
+     * error. */
+    int wake_pipe[2];
+    int notify_pipe[2];
+};
+
+/* The crypto thread stops reading from the peer while 'rx' holds this many
+ * bytes, and ssl_send_batch() refuses to queue more while 'tx' does. */
+#define SSL_CRYPTO_RX_MAX 65536
+#define SSL_CRYPTO_TX_MAX 65536
+
 /* SSL context created by ssl_init(). */
 static SSL_CTX *ctx;
 
+/* The most recent session negotiated with each peer that we connect to as a
+ * client, indexed by vconn name, so that reconnecting to a peer can resume
+ * the session instead of doing a full handshake.  (OpenSSL's own session
+ * cache only serves the server side.) */
+static struct shash client_sessions = SHASH_INITIALIZER(&client_sessions);
+
+/* Maximum number of entries in 'client_sessions'.  It normally has one entry
+ * per controller, so a limit only matters for a controller that connects
+ * actively to many switches. */
+#define MAX_CLIENT_SESSIONS 256
+
+/* Most data that ssl_send_batch() will copy into a single buffer, and
+ * therefore a single call to SSL_write(), which is the largest payload that
+ * fits in one TLS record. */
+#define SSL_BATCH_SIZE 16384
+
 /* Required configuration. */
 static bool has_private_key, has_certificate, has_ca_cert;
 
+/* Whether each connection gets a crypto thread once its handshake completes.
+ * See vconn_ssl_set_crypto_threads(). */
+static bool crypto_threads;
+
+/* Most handshakes run in threads at once, or 0 to run them in the main thread.
+ * See vconn_ssl_set_handshake_threads().  'n_handshakes' counts the threads
+ * not yet reaped. */
+static int max_handshakes;
+static int n_handshakes;
+
 /* Ordinarily, we require a CA certificate for the peer to be locally
  * available.  'has_ca_cert' is true when this is the case, and neither of the
  * following variables matter.
@@ -177,6 +254,17 @@ static int interpret_ssl_error(const char *function, int ret, int error,
 static void ssl_tx_poll_callback(int fd, short int revents, void *vconn_);
 static DH *tmp_dh_callback(SSL *ssl, int is_export UNUSED, int keylength);
 static void log_ca_cert(const char *file_name, X509 *cert);
+static void save_client_session(struct ssl_vconn *);
+static void forget_client_session(const char *name);
+static void ssl_crypto_start(struct ssl_vconn *);
+static void ssl_crypto_stop(struct ssl_vconn *);
+static int ssl_crypto_recv(struct ssl_vconn *, struct ofpbuf **);
+static int ssl_crypto_send_batch(struct ssl_vconn *, struct ofpbuf **,
+                                 size_t n_msgs, size_t *n_sentp);
+static void ssl_crypto_wait(struct ssl_vconn *, enum vconn_wait_type);
+static int ssl_handshake_step(struct ssl_vconn *);
+static int ssl_handshake_run(struct ssl_vconn *);
+static void ssl_handshake_stop(struct ssl_vconn *);
 
 static short int
 want_to_poll_events(int want)
@@ -246,6 +334,11 @@ new_ssl_vconn(const char *name, int fd, enum session_type type,
     }
     if (bootstrap_ca_cert && type == CLIENT) {
         SSL_set_verify(ssl, SSL_VERIFY_NONE, NULL);
+    } else if (type == CLIENT) {
+        SSL_SESSION *session = shash_find_data(&client_sessions, name);
+        if (session) {
+            SSL_set_session(ssl, session);
+        }
     }
 
     /* Create and return the ssl_vconn. */
@@ -260,6 +353,8 @@ new_ssl_vconn(const char *name, int fd, enum session_type type,
     sslv->txbuf = NULL;
     sslv->tx_waiter = NULL;
     sslv->rx_want = sslv->tx_want = SSL_NOTHING;
+    sslv->crypto = NULL;
+    sslv->handshake = NULL;
     *vconnp = &sslv->vconn;
     return 0;
 
@@ -443,19 +538,17 @@ ssl_connect(struct vconn *vconn)
         /* Fall through. */
 
     case STATE_SSL_CONNECTING:
-        retval = (sslv->type == CLIENT
-                   ? SSL_connect(sslv->ssl) : SSL_accept(sslv->ssl));
-        if (retval != 1) {
-            int error = SSL_get_error(sslv->ssl, retval);
-            if (retval < 0 && ssl_wants_io(error)) {
-                return EAGAIN;
-            } else {
-                int unused;
-                interpret_ssl_error((sslv->type == CLIENT ? "SSL_connect"
-                                     : "SSL_accept"), retval, error, &unused);
-                shutdown(sslv->fd, SHUT_RDWR);
-                return EPROTO;
+        retval = (max_handshakes
+                  ? ssl_handshake_run(sslv)
+                  : ssl_handshake_step(sslv));
+        if (retval == EAGAIN) {
+            return EAGAIN;
+        } else if (retval) {
+            shutdown(sslv->fd, SHUT_RDWR);
+            if (sslv->type == CLIENT) {
+                forget_client_session(vconn->name);
             }
+            return EPROTO;
         } else if (bootstrap_ca_cert) {
             return do_ca_cert_bootstrap(vconn);
         } else if ((SSL_get_verify_mode(sslv->ssl)
@@ -472,6 +565,14 @@ ssl_connect(struct vconn *vconn)
             VLOG_ERR("rejecting SSL connection during bootstrap race window");
             return EPROTO;
         } else {
+            VLOG_DBG("%s: %s SSL session", vconn->name,
+                     SSL_session_reused(sslv->ssl) ? "resumed" : "new");
+            if (sslv->type == CLIENT) {
+                save_client_session(sslv);
+            }
+            if (crypto_threads) {
+                ssl_crypto_start(sslv);
+            }
             return 0;
         }
     }
@@ -479,14 +580,54 @@ ssl_connect(struct vconn *vconn)
     NOT_REACHED();
 }
 
+/* Remembers the session negotiated on 'sslv', a client connection that has
+ * just completed its handshake, for resuming the next connection to the same
+ * peer. */
+static void
+save_client_session(struct ssl_vconn *sslv)
+{
+    SSL_SESSION *session = SSL_get1_session(sslv->ssl);
+    if (session) {
+        forget_client_session(sslv->vconn.name);
+        if (hmap_count(&client_sessions.map) >= MAX_CLIENT_SESSIONS) {
+            struct shash_node *node, *next;
+            HMAP_FOR_EACH_SAFE (node, next, struct shash_node, node,
+                                &client_sessions.map) {
+                SSL_SESSION_free(node->data);
+            }
+            shash_clear(&client_sessions);
+        }
+        shash_add(&client_sessions, sslv->vconn.name, session);
+    }
+}
+
+/* Drops the remembered session for peer 'name', if any, e.g. because the
+ * peer rejected a handshake that tried to resume it. */
+static void
+forget_client_session(const char *name)
+{
+    struct shash_node *node = shash_find(&client_sessions, name);
+    if (node) {
+        SSL_SESSION_free(node->data);
+        shash_delete(&client_sessions, node);
+    }
+}
+
 static void
 ssl_close(struct vconn *vconn)
 {
     struct ssl_vconn *sslv = ssl_vconn_cast(vconn);
+    if (sslv->handshake) {
+        ssl_handshake_stop(sslv);
+    }
+    if (sslv->crypto) {
+        ssl_crypto_stop(sslv);
+    }
     poll_cancel(sslv->tx_waiter);
     ssl_clear_txbuf(sslv);
     ofpbuf_delete(sslv->rxbuf);
     SSL_free(sslv->ssl);
+    poll_fd_closing(sslv->fd);
     close(sslv->fd);
     free(sslv);
 }
@@ -575,6 +716,9 @@ ssl_recv(struct vconn *vconn, struct ofpbuf **bufferp)
     int old_state;
     ssize_t ret;
 
+    if (sslv->crypto) {
+        return ssl_crypto_recv(sslv, bufferp);
+    }
     if (sslv->rxbuf == NULL) {
         sslv->rxbuf = ofpbuf_new(1564);
     }
@@ -689,6 +833,66 @@ ssl_do_tx(struct vconn *vconn)
     }
 }
 
+/* Sends as many of the 'n_msgs' messages in 'msgs' as fit in a single TLS
+ * record with one call to SSL_write(), instead of paying for a record, its
+ * MAC, and a system call per message. */
+static int
+ssl_send_batch(struct vconn *vconn, struct ofpbuf **msgs, size_t n_msgs,
+               size_t *n_sentp)
+{
+    struct ssl_vconn *sslv = ssl_vconn_cast(vconn);
+    struct ofpbuf *buffer;
+    size_t n, size, i;
+    int error;
+
+    if (sslv->crypto) {
+        return ssl_crypto_send_batch(sslv, msgs, n_msgs, n_sentp);
+    }
+    *n_sentp = 0;
+    if (sslv->txbuf) {
+        return EAGAIN;
+    }
+
+    size = msgs[0]->size;
+    for (n = 1; n < n_msgs && size + msgs[n]->size <= SSL_BATCH_SIZE; n++) {
+        size += msgs[n]->size;
+    }
+    if (n == 1) {
+        buffer = msgs[0];
+    } else {
+        buffer = ofpbuf_new(size);
+        for (i = 0; i < n; i++) {
+            ofpbuf_put(buffer, msgs[i]->data, msgs[i]->size);
+        }
+    }
+
+    sslv->txbuf = buffer;
+    error = ssl_do_tx(vconn);
+    switch (error) {
+    case 0:
+        ssl_clear_txbuf(sslv);
+        break;
+    case EAGAIN:
+        leak_checker_claim(buffer);
+        ssl_register_tx_waiter(vconn);
+        break;
+    default:
+        sslv->txbuf = NULL;
+        if (buffer != msgs[0]) {
+            ofpbuf_delete(buffer);
+        }
+        return error;
+    }
+
+    if (buffer != msgs[0]) {
+        for (i = 0; i < n; i++) {
+            ofpbuf_delete(msgs[i]);
+        }
+    }
+    *n_sentp = n;
+    return 0;
+}
+
 static void
 ssl_tx_poll_callback(int fd UNUSED, short int revents UNUSED, void *vconn_)
 {
@@ -705,28 +909,9 @@ ssl_tx_poll_callback(int fd UNUSED, short int revents UNUSED, void *vconn_)
 static int
 ssl_send(struct vconn *vconn, struct ofpbuf *buffer)
 {
-    struct ssl_vconn *sslv = ssl_vconn_cast(vconn);
-
-    if (sslv->txbuf) {
-        return EAGAIN;
-    } else {
-        int error;
+    size_t n_sent;
 
-        sslv->txbuf = buffer;
-        error = ssl_do_tx(vconn);
-        switch (error) {
-        case 0:
-            ssl_clear_txbuf(sslv);
-            return 0;
-        case EAGAIN:
-            leak_checker_claim(buffer);
-            ssl_register_tx_waiter(vconn);
-            return 0;
-        default:
-            sslv->txbuf = NULL;
-            return error;
-        }
-    }
+    return ssl_send_batch(vconn, &buffer, 1, &n_sent);
 }
 
 static void
@@ -734,6 +919,11 @@ ssl_wait(struct vconn *vconn, enum vconn_wait_type wait)
 {
     struct ssl_vconn *sslv = ssl_vconn_cast(vconn);
 
+    if (sslv->crypto && wait != WAIT_CONNECT) {
+        ssl_crypto_wait(sslv, wait);
+        return;
+    }
+
     switch (wait) {
     case WAIT_CONNECT:
         if (vconn_connect(vconn) != EAGAIN) {
@@ -745,10 +935,17 @@ ssl_wait(struct vconn *vconn, enum vconn_wait_type wait)
                 break;
 
             case STATE_SSL_CONNECTING:
-                /* ssl_connect() called SSL_accept() or SSL_connect(), which
-                 * set up the status that we test here. */
-                poll_fd_wait(sslv->fd,
-                             want_to_poll_events(SSL_want(sslv->ssl)));
+                if (sslv->handshake) {
+                    poll_fd_wait(sslv->handshake->notify_pipe[0], POLLIN);
+                } else if (max_handshakes && n_handshakes >= max_handshakes) {
+                    /* Waiting for a handshake thread to finish, which wakes
+                     * us up in ssl_handshake_run(). */
+                } else {
+                    /* ssl_connect() called SSL_accept() or SSL_connect(),
+                     * which set up the status that we test here. */
+                    poll_fd_wait(sslv->fd,
+                                 want_to_poll_events(SSL_want(sslv->ssl)));
+                }
                 break;
 
             default:
@@ -779,6 +976,518 @@ ssl_wait(struct vconn *vconn, enum vconn_wait_type wait)
     }
 }
 
+/* Crypto threads. */
+
+/* Appends the 'size' bytes in 'data' to 'b', first moving the data that 'b'
+ * already holds back to the start of its allocation if that makes the new
+ * bytes fit, so that a buffer used as a byte queue does not keep growing. */
+static void
+ssl_crypto_append(struct ofpbuf *b, const void *data, size_t size)
+{
+    if (size > ofpbuf_tailroom(b) && b->data != b->base) {
+        memmove(b->base, b->data, b->size);
+        b->data = b->base;
+    }
+    ofpbuf_put(b, data, size);
+}
+
+static void
+ssl_crypto_signal(int fd)
+{
+    if (write(fd, "", 1) < 0 && errno != EAGAIN) {
+        VLOG_WARN_RL(&rl, "failed to wake SSL thread: %s", strerror(errno));
+    }
+}
+
+static void
+ssl_crypto_drain(int fd)
+{
+    char buf[64];
+
+    while (read(fd, buf, sizeof buf) > 0) {
+        continue;
+    }
+}
+
+/* Records 'error' as the reason that the crypto thread of 'c' stopped reading
+ * (if 'rx') or writing (if '!rx'), and tells the main thread. */
+static void
+ssl_crypto_set_error(struct ssl_crypto *c, bool rx, int error)
+{
+    pthread_mutex_lock(&c->mutex);
+    if (rx) {
+        c->rx_error = error;
+    } else {
+        c->tx_error = error;
+    }
+    ssl_crypto_signal(c->notify_pipe[1]);
+    pthread_mutex_unlock(&c->mutex);
+}
+
+/* Calls SSL_read() once on 'sslv' from its crypto thread and appends what it
+ * decrypts to the shared receive queue.  Returns 0 if it read data, EAGAIN if
+ * it would block, with '*want' set to what it is waiting for, otherwise EOF or
+ * a positive errno value.  Sets '*state_changed' to true if the call made
+ * progress on an SSL renegotiation. */
+static int
+ssl_crypto_read(struct ssl_vconn *sslv, int *want, bool *state_changed)
+{
+    struct ssl_crypto *c = sslv->crypto;
+    char buf[SSL_BATCH_SIZE];
+    int old_state, error;
+    int ret;
+
+    old_state = SSL_get_state(sslv->ssl);
+    ret = SSL_read(sslv->ssl, buf, sizeof buf);
+    *state_changed = old_state != SSL_get_state(sslv->ssl);
+    *want = SSL_NOTHING;
+    if (ret > 0) {
+        pthread_mutex_lock(&c->mutex);
+        if (!c->rx->size) {
+            ssl_crypto_signal(c->notify_pipe[1]);
+        }
+        ssl_crypto_append(c->rx, buf, ret);
+        pthread_mutex_unlock(&c->mutex);
+        return 0;
+    }
+
+    error = SSL_get_error(sslv->ssl, ret);
+    return (error == SSL_ERROR_ZERO_RETURN ? EOF
+            : interpret_ssl_error("SSL_read", ret, error, want));
+}
+
+/* Calls SSL_write() on 'sslv' from its crypto thread until all of 'txbuf' has
+ * been sent.  Returns 0 if it was, EAGAIN if SSL_write() would block, with
+ * '*want' set to what it is waiting for, otherwise a positive errno value.
+ * Sets '*state_changed' to true if the calls made progress on an SSL
+ * renegotiation. */
+static int
+ssl_crypto_write(struct ssl_vconn *sslv, struct ofpbuf *txbuf, int *want,
+                 bool *state_changed)
+{
+    *state_changed = false;
+    for (;;) {
+        int old_state = SSL_get_state(sslv->ssl);
+        int ret = SSL_write(sslv->ssl, txbuf->data, txbuf->size);
+        if (old_state != SSL_get_state(sslv->ssl)) {
+            *state_changed = true;
+        }
+        *want = SSL_NOTHING;
+        if (ret > 0) {
+            ofpbuf_pull(txbuf, ret);
+            if (txbuf->size == 0) {
+                return 0;
+            }
+        } else {
+            int ssl_error = SSL_get_error(sslv->ssl, ret);
+            if (ssl_error == SSL_ERROR_ZERO_RETURN) {
+                VLOG_WARN_RL(&rl, "SSL_write: connection closed");
+                return EPIPE;
+            } else {
+                return interpret_ssl_error("SSL_write", ret, ssl_error, want);
+            }
+        }
+    }
+}
+
+static void *
+ssl_crypto_thread_main(void *sslv_)
+{
+    struct ssl_vconn *sslv = sslv_;
+    struct ssl_crypto *c = sslv->crypto;
+    struct ofpbuf *txbuf = NULL;
+    int rx_want = SSL_NOTHING;
+    int tx_want = SSL_NOTHING;
+
+    for (;;) {
+        bool can_read, progress, state_changed;
+        struct pollfd pfds[2];
+        int error;
+
+        /* Take the next record's worth of plaintext to send, if we are not
+         * still working on the last one, and check for room to receive. */
+        pthread_mutex_lock(&c->mutex);
+        if (c->exiting) {
+            pthread_mutex_unlock(&c->mutex);
+            break;
+        }
+        if (!txbuf && c->tx->size && !c->tx_error) {
+            size_t n = MIN(c->tx->size, SSL_BATCH_SIZE);
+            if (c->tx->size >= SSL_CRYPTO_TX_MAX) {
+                ssl_crypto_signal(c->notify_pipe[1]);
+            }
+            txbuf = ofpbuf_clone_data(c->tx->data, n);
+            ofpbuf_pull(c->tx, n);
+        }
+        can_read = !c->rx_error && c->rx->size < SSL_CRYPTO_RX_MAX;
+        pthread_mutex_unlock(&c->mutex);
+
+        /* Encrypt and decrypt without holding the mutex.  A renegotiation that
+         * makes progress in one direction may unblock the other, so in that
+         * case go around again instead of trusting the other's want (see the
+         * comment on rx_want and tx_want in struct ssl_vconn). */
+        progress = false;
+        if (txbuf) {
+            error = ssl_crypto_write(sslv, txbuf, &tx_want, &state_changed);
+            if (error != EAGAIN) {
+                if (error) {
+                    ssl_crypto_set_error(c, false, error);
+                }
+                ofpbuf_delete(txbuf);
+                txbuf = NULL;
+                progress = true;
+            }
+            progress = progress || state_changed;
+        }
+        if (can_read) {
+            error = ssl_crypto_read(sslv, &rx_want, &state_changed);
+            if (error != EAGAIN) {
+                if (error) {
+                    ssl_crypto_set_error(c, true, error);
+                }
+                progress = true;
+            }
+            progress = progress || state_changed;
+        }
+        if (progress) {
+            continue;
+        }
+
+        pfds[0].fd = c->wake_pipe[0];
+        pfds[0].events = POLLIN;
+        pfds[1].fd = sslv->fd;
+        pfds[1].events = ((txbuf ? want_to_poll_events(tx_want) : 0)
+                          | (can_read ? want_to_poll_events(rx_want) : 0));
+        if (poll(pfds, pfds[1].events ? 2 : 1, -1) < 0 && errno != EINTR) {
+            VLOG_WARN_RL(&rl, "%s: poll: %s",
+                         sslv->vconn.name, strerror(errno));
+        }
+        ssl_crypto_drain(c->wake_pipe[0]);
+    }
+
+    ofpbuf_delete(txbuf);
+    return NULL;
+}
+
+static void
+ssl_crypto_open_pipe(int fds[2])
+{
+    if (pipe(fds)) {
+        ofp_fatal(errno, "could not create pipe");
+    }
+    set_nonblocking(fds[0]);
+    set_nonblocking(fds[1]);
+}
+
+/* Hands SSL_read() and SSL_write() on 'sslv', whose handshake has just
+ * completed, to a new thread, so that the cost of encrypting and decrypting
+ * its records moves off the main thread.  If the thread cannot be created,
+ * 'sslv' carries on without one. */
+static void
+ssl_crypto_start(struct ssl_vconn *sslv)
+{
+    struct ssl_crypto *c = xmalloc(sizeof *c);
+    sigset_t all_signals, old_signals;
+    int retval;
+
+    pthread_mutex_init(&c->mutex, NULL);
+    c->rx = ofpbuf_new(SSL_CRYPTO_RX_MAX);
+    c->tx = ofpbuf_new(SSL_CRYPTO_TX_MAX);
+    c->rx_error = c->tx_error = 0;
+    c->exiting = false;
+    ssl_crypto_open_pipe(c->wake_pipe);
+    ssl_crypto_open_pipe(c->notify_pipe);
+
+    /* Start the thread with all signals blocked, so that signals such as the
+     * SIGALRM that timeval.c relies on keep going to the main thread. */
+    sslv->crypto = c;
+    sigfillset(&all_signals);
+    pthread_sigmask(SIG_SETMASK, &all_signals, &old_signals);
+    retval = pthread_create(&c->thread, NULL, ssl_crypto_thread_main, sslv);
+    pthread_sigmask(SIG_SETMASK, &old_signals, NULL);
+    if (retval) {
+        VLOG_WARN("%s: could not start SSL thread (%s), encrypting in the "
+                  "main thread", sslv->vconn.name, strerror(retval));
+        sslv->crypto = NULL;
+        close(c->wake_pipe[0]);
+        close(c->wake_pipe[1]);
+        close(c->notify_pipe[0]);
+        close(c->notify_pipe[1]);
+        ofpbuf_delete(c->rx);
+        ofpbuf_delete(c->tx);
+        pthread_mutex_destroy(&c->mutex);
+        free(c);
+    }
+}
+
+/* Stops the crypto thread of 'sslv' and frees its state.  Plaintext that the
+ * thread had not yet sent is discarded, as on a connection without one. */
+static void
+ssl_crypto_stop(struct ssl_vconn *sslv)
+{
+    struct ssl_crypto *c = sslv->crypto;
+
+    pthread_mutex_lock(&c->mutex);
+    c->exiting = true;
+    ssl_crypto_signal(c->wake_pipe[1]);
+    pthread_mutex_unlock(&c->mutex);
+    pthread_join(c->thread, NULL);
+
+    close(c->wake_pipe[0]);
+    close(c->wake_pipe[1]);
+    poll_fd_closing(c->notify_pipe[0]);
+    close(c->notify_pipe[0]);
+    close(c->notify_pipe[1]);
+    ofpbuf_delete(c->rx);
+    ofpbuf_delete(c->tx);
+    pthread_mutex_destroy(&c->mutex);
+    free(c);
+    sslv->crypto = NULL;
+}
+
+static int
+ssl_crypto_recv(struct ssl_vconn *sslv, struct ofpbuf **bufferp)
+{
+    struct ssl_crypto *c = sslv->crypto;
+    struct ofpbuf *rx;
+    bool was_full;
+    int error;
+
+    if (sslv->rxbuf == NULL) {
+        sslv->rxbuf = ofpbuf_new(1564);
+    }
+    rx = sslv->rxbuf;
+
+    pthread_mutex_lock(&c->mutex);
+    was_full = c->rx->size >= SSL_CRYPTO_RX_MAX;
+    for (;;) {
+        size_t want_bytes, n;
+
+        if (sizeof(struct ofp_header) > rx->size) {
+            want_bytes = sizeof(struct ofp_header) - rx->size;
+        } else {
+            struct ofp_header *oh = rx->data;
+            size_t length = ntohs(oh->length);
+            if (length < sizeof(struct ofp_header)) {
+                VLOG_ERR_RL(&rl, "received too-short ofp_header (%zu bytes)",
+                            length);
+                error = EPROTO;
+                break;
+            }
+            want_bytes = length - rx->size;
+            if (!want_bytes) {
+                *bufferp = rx;
+                sslv->rxbuf = NULL;
+                error = 0;
+                break;
+            }
+        }
+
+        n = MIN(want_bytes, c->rx->size);
+        if (!n) {
+            if (c->rx_error == EOF && rx->size) {
+                VLOG_WARN_RL(&rl, "SSL_read: unexpected connection close");
+                error = EPROTO;
+            } else {
+                error = c->rx_error ? c->rx_error : EAGAIN;
+            }
+            break;
+        }
+        ofpbuf_put(rx, c->rx->data, n);
+        ofpbuf_pull(c->rx, n);
+    }
+    if (was_full && c->rx->size < SSL_CRYPTO_RX_MAX) {
+        ssl_crypto_signal(c->wake_pipe[1]);
+    }
+    pthread_mutex_unlock(&c->mutex);
+
+    return error;
+}
+
+/* Queues as many of the 'n_msgs' messages in 'msgs' for the crypto thread of
+ * 'sslv' as fit below SSL_CRYPTO_TX_MAX.  The thread still packs them into as
+ * few TLS records as possible, like ssl_send_batch() does inline. */
+static int
+ssl_crypto_send_batch(struct ssl_vconn *sslv, struct ofpbuf **msgs,
+                      size_t n_msgs, size_t *n_sentp)
+{
+    struct ssl_crypto *c = sslv->crypto;
+    size_t n = 0;
+    int error;
+
+    pthread_mutex_lock(&c->mutex);
+    if (c->tx_error) {
+        error = c->tx_error;
+    } else if (c->tx->size >= SSL_CRYPTO_TX_MAX) {
+        error = EAGAIN;
+    } else {
+        if (!c->tx->size) {
+            ssl_crypto_signal(c->wake_pipe[1]);
+        }
+        for (; n < n_msgs && c->tx->size < SSL_CRYPTO_TX_MAX; n++) {
+            ssl_crypto_append(c->tx, msgs[n]->data, msgs[n]->size);
+            ofpbuf_delete(msgs[n]);
+        }
+        error = 0;
+    }
+    pthread_mutex_unlock(&c->mutex);
+
+    *n_sentp = n;
+    return error;
+}
+
+static void
+ssl_crypto_wait(struct ssl_vconn *sslv, enum vconn_wait_type wait)
+{
+    struct ssl_crypto *c = sslv->crypto;
+    bool ready;
+
+    /* Drain before checking, so that a change that the crypto thread makes
+     * after the check leaves a byte in the pipe to wake us. */
+    ssl_crypto_drain(c->notify_pipe[0]);
+    pthread_mutex_lock(&c->mutex);
+    if (wait == WAIT_RECV) {
+        ready = c->rx->size || c->rx_error;
+    } else {
+        ready = c->tx->size < SSL_CRYPTO_TX_MAX || c->tx_error;
+    }
+    pthread_mutex_unlock(&c->mutex);
+
+    if (ready) {
+        poll_immediate_wake();
+    } else {
+        poll_fd_wait(c->notify_pipe[0], POLLIN);
+    }
+}
+
+/* Calls SSL_accept() or SSL_connect() once on 'sslv'.  Returns 0 if the
+ * handshake is complete, EAGAIN if it must wait for the peer, otherwise
+ * EPROTO after logging the reason. */
+static int
+ssl_handshake_step(struct ssl_vconn *sslv)
+{
+    int retval = (sslv->type == CLIENT
+                  ? SSL_connect(sslv->ssl) : SSL_accept(sslv->ssl));
+    if (retval != 1) {
+        int error = SSL_get_error(sslv->ssl, retval);
+        if (retval < 0 && ssl_wants_io(error)) {
+            return EAGAIN;
+        } else {
+            int unused;
+            interpret_ssl_error((sslv->type == CLIENT ? "SSL_connect"
+                                 : "SSL_accept"), retval, error, &unused);
+            return EPROTO;
+        }
+    }
+    return 0;
+}
+
+static void *
+ssl_handshake_thread_main(void *sslv_)
+{
+    struct ssl_vconn *sslv = sslv_;
+    struct ssl_handshake *hs = sslv->handshake;
+    int error;
+
+    while ((error = ssl_handshake_step(sslv)) == EAGAIN) {
+        struct pollfd pfds[2];
+
+        pfds[0].fd = hs->wake_pipe[0];
+        pfds[0].events = POLLIN;
+        pfds[1].fd = sslv->fd;
+        pfds[1].events = want_to_poll_events(SSL_want(sslv->ssl));
+        if (poll(pfds, 2, -1) < 0 && errno != EINTR) {
+            VLOG_WARN_RL(&rl, "%s: poll: %s",
+                         sslv->vconn.name, strerror(errno));
+        }
+        if (pfds[0].revents) {
+            break;
+        }
+    }
+
+    hs->error = error;
+    ssl_crypto_signal(hs->notify_pipe[1]);
+    return NULL;
+}
+
+/* Reaps the handshake thread of 'sslv' and frees its state. */
+static void
+ssl_handshake_reap(struct ssl_vconn *sslv)
+{
+    struct ssl_handshake *hs = sslv->handshake;
+
+    pthread_join(hs->thread, NULL);
+    close(hs->wake_pipe[0]);
+    close(hs->wake_pipe[1]);
+    poll_fd_closing(hs->notify_pipe[0]);
+    close(hs->notify_pipe[0]);
+    close(hs->notify_pipe[1]);
+    free(hs);
+    sslv->handshake = NULL;
+
+    /* Let a connection waiting for a free thread have this one's. */
+    n_handshakes--;
+    poll_immediate_wake();
+}
+
+/* Runs the handshake of 'sslv' in a thread of its own, starting the thread if
+ * fewer than 'max_handshakes' are running.  Returns what ssl_handshake_step()
+ * returned when the thread finished, or EAGAIN while it has not started or
+ * not finished.  If the thread cannot be created, the handshake runs in the
+ * main thread instead. */
+static int
+ssl_handshake_run(struct ssl_vconn *sslv)
+{
+    struct ssl_handshake *hs = sslv->handshake;
+    sigset_t all_signals, old_signals;
+    char c;
+    int retval;
+
+    if (hs) {
+        if (read(hs->notify_pipe[0], &c, 1) != 1) {
+            return EAGAIN;
+        }
+        retval = hs->error;
+        ssl_handshake_reap(sslv);
+        return retval;
+    } else if (n_handshakes >= max_handshakes) {
+        return EAGAIN;
+    }
+
+    hs = sslv->handshake = xmalloc(sizeof *hs);
+    hs->error = EAGAIN;
+    ssl_crypto_open_pipe(hs->wake_pipe);
+    ssl_crypto_open_pipe(hs->notify_pipe);
+
+    /* Block all signals in the thread, as ssl_crypto_start() does. */
+    sigfillset(&all_signals);
+    pthread_sigmask(SIG_SETMASK, &all_signals, &old_signals);
+    retval = pthread_create(&hs->thread, NULL, ssl_handshake_thread_main, sslv);
+    pthread_sigmask(SIG_SETMASK, &old_signals, NULL);
+    if (retval) {
+        VLOG_WARN_RL(&rl, "%s: could not start SSL handshake thread (%s), "
+                     "handshaking in the main thread",
+                     sslv->vconn.name, strerror(retval));
+        close(hs->wake_pipe[0]);
+        close(hs->wake_pipe[1]);
+        close(hs->notify_pipe[0]);
+        close(hs->notify_pipe[1]);
+        free(hs);
+        sslv->handshake = NULL;
+        return ssl_handshake_step(sslv);
+    }
+    n_handshakes++;
+    return EAGAIN;
+}
+
+/* Stops the handshake thread of 'sslv', which is being closed. */
+static void
+ssl_handshake_stop(struct ssl_vconn *sslv)
+{
+    ssl_crypto_signal(sslv->handshake->wake_pipe[1]);
+    ssl_handshake_reap(sslv);
+}
+
 struct vconn_class ssl_vconn_class = {
     "ssl",                      /* name */
     ssl_open,                   /* open */
@@ -786,6 +1495,7 @@ struct vconn_class ssl_vconn_class = {
     ssl_connect,                /* connect */
     ssl_recv,                   /* recv */
     ssl_send,                   /* send */
+    ssl_send_batch,             /* send_batch */
     ssl_wait,                   /* wait */
 };
 
@@ -871,6 +1581,7 @@ static void
 pssl_close(struct pvconn *pvconn)
 {
     struct pssl_pvconn *pssl = pssl_pvconn_cast(pvconn);
+    poll_fd_closing(pssl->fd);
     close(pssl->fd);
     free(pssl);
 }
@@ -972,6 +1683,15 @@ do_ssl_init(void)
     SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER | SSL_VERIFY_FAIL_IF_NO_PEER_CERT,
                        NULL);
 
+    /* Let peers that reconnect resume their sessions, by session ID or by
+     * session ticket, instead of repeating the full handshake.  OpenSSL
+     * refuses to resume a session on a connection that verifies its peer
+     * unless a session ID context is set. */
+    SSL_CTX_set_session_id_context(ctx, (const unsigned char *) "openflow",
+                                   strlen("openflow"));
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+    SSL_CTX_set_timeout(ctx, 3600);
+
     return 0;
 }
 
@@ -1107,6 +1827,26 @@ read_cert_file(const char *file_name, X509 ***certs, size_t *n_certs)
 }
 
 
+/* Sets whether each SSL connection opened from now on moves its SSL_read()
+ * and SSL_write() calls, and thus the encryption and decryption of its
+ * records, to a thread of its own once its handshake completes. */
+void
+vconn_ssl_set_crypto_threads(bool enable)
+{
+    crypto_threads = enable;
+}
+
+/* Sets the number of SSL handshakes that may run at once in threads of their
+ * own, so that the public-key operations of many connections arriving
+ * together do not hold up the main thread.  Connections beyond 'max' wait
+ * for a running handshake to finish.  0, the default, runs each handshake in
+ * the main thread as its connection is serviced. */
+void
+vconn_ssl_set_handshake_threads(int max)
+{
+    max_handshakes = max;
+}
+
 /* Sets 'file_name' as the name of a file containing one or more X509
  * certificates to send to the peer.  Typical use in OpenFlow is to send the CA
  * certificate to the peer, which enables a switch to pick up the controller's
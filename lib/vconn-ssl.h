@@ -41,6 +41,8 @@ void vconn_ssl_set_private_key_file(const char *file_name);
 void vconn_ssl_set_certificate_file(const char *file_name);
 void vconn_ssl_set_ca_cert_file(const char *file_name, bool bootstrap);
 void vconn_ssl_set_peer_ca_cert_file(const char *file_name);
+void vconn_ssl_set_crypto_threads(bool enable);
+void vconn_ssl_set_handshake_threads(int max);
 
 #define VCONN_SSL_LONG_OPTIONS                      \
         {"private-key", required_argument, 0, 'p'}, \
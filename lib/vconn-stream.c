@@ -36,9 +36,11 @@
 #include <assert.h>
 #include <errno.h>
 #include <poll.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <unistd.h>
 #include "leak-checker.h"
 #include "ofpbuf.h"
@@ -100,6 +102,7 @@ stream_close(struct vconn *vconn)
     poll_cancel(s->tx_waiter);
     stream_clear_txbuf(s);
     ofpbuf_delete(s->rxbuf);
+    poll_fd_closing(s->fd);
     close(s->fd);
     free(s);
 }
@@ -111,61 +114,117 @@ stream_connect(struct vconn *vconn)
     return check_connection_completion(s->fd);
 }
 
+/* Size of the buffer that stream_recv() reads into.  Any OpenFlow message
+ * fits, since the length in ofp_header is 16 bits. */
+#define STREAM_RX_SIZE 65536
+
+/* Messages that start on a multiple of this many bytes in the receive buffer
+ * are handed out in place.  Others are copied, so that callers can access
+ * their 64-bit members directly. */
+#define STREAM_RX_ALIGN 8
+
+/* Makes sure that 's''s receive buffer has at least 'want_bytes' bytes of
+ * tailroom, moving what it holds to the front of the buffer when nothing
+ * else uses it, or into a new buffer otherwise. */
+static void
+stream_make_rx_room(struct stream_vconn *s, size_t want_bytes)
+{
+    struct ofpbuf *rx = s->rxbuf;
+    size_t tailroom = ofpbuf_tailroom(rx);
+
+    if (tailroom >= want_bytes && tailroom >= STREAM_RX_SIZE / 4) {
+        return;
+    }
+    if (!ofpbuf_is_shared(rx)) {
+        ofpbuf_unshare(rx);
+        if (rx->data != rx->base) {
+            memmove(rx->base, rx->data, rx->size);
+            rx->data = rx->base;
+        }
+    } else if (tailroom < want_bytes) {
+        /* Messages handed out of the old buffer still use it. */
+        s->rxbuf = ofpbuf_new(STREAM_RX_SIZE);
+        ofpbuf_put(s->rxbuf, rx->data, rx->size);
+        ofpbuf_delete(rx);
+    }
+}
+
+/* Reads as much as the socket has into a 64 kB buffer and hands out the
+ * messages in it one at a time, so that a burst of small messages costs one
+ * read() instead of two per message. */
 static int
 stream_recv(struct vconn *vconn, struct ofpbuf **bufferp)
 {
     struct stream_vconn *s = stream_vconn_cast(vconn);
-    struct ofpbuf *rx;
-    size_t want_bytes;
-    ssize_t retval;
+    bool drained = false;
 
     if (s->rxbuf == NULL) {
-        s->rxbuf = ofpbuf_new(1564);
+        s->rxbuf = ofpbuf_new(STREAM_RX_SIZE);
     }
-    rx = s->rxbuf;
 
-again:
-    if (sizeof(struct ofp_header) > rx->size) {
-        want_bytes = sizeof(struct ofp_header) - rx->size;
-    } else {
-        struct ofp_header *oh = rx->data;
-        size_t length = ntohs(oh->length);
-        if (length < sizeof(struct ofp_header)) {
-            VLOG_ERR_RL(&rl, "received too-short ofp_header (%zu bytes)",
-                        length);
-            return EPROTO;
+    for (;;) {
+        struct ofpbuf *rx = s->rxbuf;
+        size_t want_bytes, n_read;
+        ssize_t retval;
+
+        if (sizeof(struct ofp_header) > rx->size) {
+            want_bytes = sizeof(struct ofp_header) - rx->size;
+        } else {
+            struct ofp_header *oh = rx->data;
+            size_t length = ntohs(oh->length);
+            if (length < sizeof(struct ofp_header)) {
+                VLOG_ERR_RL(&rl, "received too-short ofp_header (%zu bytes)",
+                            length);
+                return EPROTO;
+            }
+            if (length <= rx->size) {
+                if (!((uintptr_t) rx->data % STREAM_RX_ALIGN)) {
+                    *bufferp = ofpbuf_share_head(rx, length);
+                } else {
+                    *bufferp = ofpbuf_clone_data(rx->data, length);
+                    ofpbuf_pull(rx, length);
+                }
+                return 0;
+            }
+            want_bytes = length - rx->size;
         }
-        want_bytes = length - rx->size;
-        if (!want_bytes) {
-            *bufferp = rx;
-            s->rxbuf = NULL;
-            return 0;
+        if (drained) {
+            return EAGAIN;
         }
-    }
-    ofpbuf_prealloc_tailroom(rx, want_bytes);
-
-    retval = read(s->fd, ofpbuf_tail(rx), want_bytes);
-    if (retval > 0) {
-        rx->size += retval;
-        if (retval == want_bytes) {
-            if (rx->size > sizeof(struct ofp_header)) {
-                *bufferp = rx;
-                s->rxbuf = NULL;
-                return 0;
+
+        stream_make_rx_room(s, want_bytes);
+        rx = s->rxbuf;
+        n_read = ofpbuf_tailroom(rx);
+        retval = read(s->fd, ofpbuf_tail(rx), n_read);
+        if (retval > 0) {
+            /* The shared part of 'rx' ends at its tail, so reading past it
+             * does not disturb messages already handed out. */
+            rx->size += retval;
+            drained = retval < n_read;
+        } else if (retval == 0) {
+            if (rx->size) {
+                VLOG_ERR_RL(&rl, "connection dropped mid-packet");
+                return EPROTO;
             } else {
-                goto again;
+                return EOF;
             }
-        }
-        return EAGAIN;
-    } else if (retval == 0) {
-        if (rx->size) {
-            VLOG_ERR_RL(&rl, "connection dropped mid-packet");
-            return EPROTO;
         } else {
-            return EOF;
+            return errno;
         }
+    }
+}
+
+/* Returns true if 's''s receive buffer already holds a complete message. */
+static bool
+stream_rx_ready(const struct stream_vconn *s)
+{
+    const struct ofpbuf *rx = s->rxbuf;
+
+    if (!rx || rx->size < sizeof(struct ofp_header)) {
+        return false;
     } else {
-        return errno;
+        const struct ofp_header *oh = rx->data;
+        return rx->size >= ntohs(oh->length);
     }
 }
 
@@ -199,31 +258,63 @@ stream_do_tx(int fd UNUSED, short int revents UNUSED, void *vconn_)
     s->tx_waiter = poll_fd_callback(s->fd, POLLOUT, stream_do_tx, vconn);
 }
 
+/* Most messages that stream_send_batch() passes to a single writev(). */
+#define STREAM_MAX_IOV 64
+
 static int
-stream_send(struct vconn *vconn, struct ofpbuf *buffer)
+stream_send_batch(struct vconn *vconn, struct ofpbuf **msgs, size_t n_msgs,
+                  size_t *n_sentp)
 {
     struct stream_vconn *s = stream_vconn_cast(vconn);
+    struct iovec iov[STREAM_MAX_IOV];
+    size_t n_iov, i;
     ssize_t retval;
 
+    *n_sentp = 0;
     if (s->txbuf) {
         return EAGAIN;
     }
 
-    retval = write(s->fd, buffer->data, buffer->size);
-    if (retval == buffer->size) {
-        ofpbuf_delete(buffer);
-        return 0;
-    } else if (retval >= 0 || errno == EAGAIN) {
+    n_iov = MIN(n_msgs, STREAM_MAX_IOV);
+    for (i = 0; i < n_iov; i++) {
+        iov[i].iov_base = msgs[i]->data;
+        iov[i].iov_len = msgs[i]->size;
+    }
+    retval = (n_iov == 1
+              ? write(s->fd, iov[0].iov_base, iov[0].iov_len)
+              : writev(s->fd, iov, n_iov));
+    if (retval < 0) {
+        if (errno != EAGAIN) {
+            return errno;
+        }
+        retval = 0;
+    }
+
+    /* Free the messages that went out completely.  A message that went out
+     * in part, or the first one if none went out at all, is finished in the
+     * background by stream_do_tx(). */
+    for (i = 0; i < n_iov && retval >= msgs[i]->size; i++) {
+        retval -= msgs[i]->size;
+        ofpbuf_delete(msgs[i]);
+    }
+    if (i < n_iov && (retval > 0 || i == 0)) {
+        struct ofpbuf *buffer = msgs[i++];
+
         leak_checker_claim(buffer);
         s->txbuf = buffer;
-        if (retval > 0) {
-            ofpbuf_pull(buffer, retval);
-        }
+        ofpbuf_pull(buffer, retval);
         s->tx_waiter = poll_fd_callback(s->fd, POLLOUT, stream_do_tx, vconn);
-        return 0;
-    } else {
-        return errno;
     }
+    *n_sentp = i;
+    return 0;
+}
+
+static int
+stream_send(struct vconn *vconn, struct ofpbuf *buffer)
+{
+    size_t n_sent;
+
+    return stream_send_batch(vconn, &buffer, 1, &n_sent);
 }
 
 static void
@@ -244,7 +335,11 @@ stream_wait(struct vconn *vconn, enum vconn_wait_type wait)
         break;
 
     case WAIT_RECV:
-        poll_fd_wait(s->fd, POLLIN);
+        if (stream_rx_ready(s)) {
+            poll_immediate_wake();
+        } else {
+            poll_fd_wait(s->fd, POLLIN);
+        }
         break;
 
     default:
@@ -259,6 +354,7 @@ static struct vconn_class stream_vconn_class = {
     stream_connect,             /* connect */
     stream_recv,                /* recv */
     stream_send,                /* send */
+    stream_send_batch,          /* send_batch */
     stream_wait,                /* wait */
 };
 
@@ -315,6 +411,7 @@ static void
 pstream_close(struct pvconn *pvconn)
 {
     struct pstream_pvconn *ps = pstream_pvconn_cast(pvconn);
+    poll_fd_closing(ps->fd);
     close(ps->fd);
     free(ps);
 }
@@ -133,6 +133,7 @@ struct vconn_class tcp_vconn_class = {
     NULL,                       /* connect */
     NULL,                       /* recv */
     NULL,                       /* send */
+    NULL,                       /* send_batch */
     NULL,                       /* wait */
 };
 
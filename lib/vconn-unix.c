@@ -87,6 +87,7 @@ struct vconn_class unix_vconn_class = {
     NULL,                       /* connect */
     NULL,                       /* recv */
     NULL,                       /* send */
+    NULL,                       /* send_batch */
     NULL,                       /* wait */
 };
 
@@ -68,9 +68,13 @@ enum vconn_state {
 static struct vconn_class *vconn_classes[] = {
     &tcp_vconn_class,
     &unix_vconn_class,
+    &inproc_vconn_class,
 #ifdef HAVE_NETLINK
     &netlink_vconn_class,
 #endif
+#ifdef HAVE_EVENTFD
+    &shm_vconn_class,
+#endif
 #ifdef HAVE_OPENSSL
     &ssl_vconn_class,
 #endif
@@ -79,6 +83,10 @@ static struct vconn_class *vconn_classes[] = {
 static struct pvconn_class *pvconn_classes[] = {
     &ptcp_pvconn_class,
     &punix_pvconn_class,
+    &pinproc_pvconn_class,
+#ifdef HAVE_EVENTFD
+    &pshm_pvconn_class,
+#endif
 #ifdef HAVE_OPENSSL
     &pssl_pvconn_class,
 #endif
@@ -152,6 +160,10 @@ vconn_usage(bool active, bool passive, bool bootstrap UNUSED)
                "SSL PORT (default: %d) on remote HOST\n", OFP_SSL_PORT);
 #endif
         printf("  unix:FILE               Unix domain socket named FILE\n");
+#ifdef HAVE_EVENTFD
+        printf("  shm:FILE                "
+               "shared memory, via Unix domain socket FILE\n");
+#endif
         printf("  fd:N                    File descriptor N\n");
     }
 
@@ -167,6 +179,10 @@ vconn_usage(bool active, bool passive, bool bootstrap UNUSED)
 #endif
         printf("  punix:FILE              "
                "listen on Unix domain socket FILE\n");
+#ifdef HAVE_EVENTFD
+        printf("  pshm:FILE               "
+               "listen for shared memory on Unix socket FILE\n");
+#endif
     }
 
 #ifdef HAVE_OPENSSL
@@ -360,10 +376,12 @@ vcs_recv_hello(struct vconn *vconn)
             ofpbuf_delete(b);
             return;
         } else {
-            char *s = ofp_to_string(b->data, b->size, 1);
-            VLOG_WARN_RL(&rl, "%s: received message while expecting hello: %s",
-                         vconn->name, s);
-            free(s);
+            if (!VLOG_DROP_WARN(&rl)) {
+                char *s = ofp_to_string(b->data, b->size, 1);
+                VLOG_WARN("%s: received message while expecting hello: %s",
+                          vconn->name, s);
+                free(s);
+            }
             retval = EPROTO;
             ofpbuf_delete(b);
         }
@@ -476,9 +494,9 @@ again:
     if (!retval) {
         struct ofp_header *oh;
 
-        if (VLOG_IS_DBG_ENABLED()) {
+        if (!VLOG_DROP_DBG(&rl)) {
             char *s = ofp_to_string((*msgp)->data, (*msgp)->size, 1);
-            VLOG_DBG_RL(&rl, "%s: received: %s", vconn->name, s);
+            VLOG_DBG("%s: received: %s", vconn->name, s);
             free(s);
         }
 
@@ -551,20 +569,62 @@ do_send(struct vconn *vconn, struct ofpbuf *msg)
 
     assert(msg->size >= sizeof(struct ofp_header));
     assert(((struct ofp_header *) msg->data)->length == htons(msg->size));
-    if (!VLOG_IS_DBG_ENABLED()) {
+    if (VLOG_DROP_DBG(&rl)) {
         retval = (vconn->class->send)(vconn, msg);
     } else {
         char *s = ofp_to_string(msg->data, msg->size, 1);
         retval = (vconn->class->send)(vconn, msg);
         if (retval != EAGAIN) {
-            VLOG_DBG_RL(&rl, "%s: sent (%s): %s",
-                        vconn->name, strerror(retval), s);
+            VLOG_DBG("%s: sent (%s): %s", vconn->name, strerror(retval), s);
         }
         free(s);
     }
     return retval;
 }
 
+/* Tries to queue the 'n_msgs' messages in 'msgs', in order, for transmission
+ * on 'vconn', which must be an active vconn, and stores the number queued in
+ * '*n_sent'.  Ownership of those messages is transferred to the vconn; the
+ * caller retains the others.  Where the vconn supports it, the messages are
+ * handed to the kernel together, which takes fewer system calls than sending
+ * them one by one with vconn_send().
+ *
+ * Returns 0 if at least one message was queued, otherwise a positive errno
+ * value.  Like vconn_send(), this function returns EAGAIN instead of
+ * blocking. */
+int
+vconn_send_batch(struct vconn *vconn, struct ofpbuf **msgs, size_t n_msgs,
+                 size_t *n_sent)
+{
+    int retval;
+    size_t i;
+
+    *n_sent = 0;
+    retval = vconn_connect(vconn);
+    if (retval) {
+        return retval;
+    }
+
+    if (!vconn->class->send_batch || VLOG_IS_DBG_ENABLED()) {
+        /* do_send() logs each message. */
+        while (*n_sent < n_msgs) {
+            retval = do_send(vconn, msgs[*n_sent]);
+            if (retval) {
+                break;
+            }
+            ++*n_sent;
+        }
+        return *n_sent ? 0 : retval;
+    }
+
+    for (i = 0; i < n_msgs; i++) {
+        assert(msgs[i]->size >= sizeof(struct ofp_header));
+        assert(((struct ofp_header *) msgs[i]->data)->length
+               == htons(msgs[i]->size));
+    }
+    return (vconn->class->send_batch)(vconn, msgs, n_msgs, n_sent);
+}
+
 /* Same as vconn_send, except that it waits until 'msg' can be transmitted. */
 int
 vconn_send_block(struct vconn *vconn, struct ofpbuf *msg)
@@ -778,8 +838,9 @@ alloc_xid(void)
  * an arbitrary transaction id.  Allocated bytes beyond the header, if any, are
  * zeroed.
  *
- * The caller is responsible for freeing '*bufferp' when it is no longer
- * needed.
+ * The caller is responsible for freeing '*bufferp' with ofpbuf_delete() when
+ * it is no longer needed.  Small messages come from ofpbuf_new_msg(), so
+ * deleting them after they are sent recycles their memory.
  *
  * The OpenFlow header length is initially set to 'openflow_len'; if the
  * message is later extended, the length should be updated with
@@ -789,7 +850,7 @@ alloc_xid(void)
 void *
 make_openflow(size_t openflow_len, uint8_t type, struct ofpbuf **bufferp)
 {
-    *bufferp = ofpbuf_new(openflow_len);
+    *bufferp = ofpbuf_new_msg(openflow_len);
     return put_openflow_xid(openflow_len, type, alloc_xid(), *bufferp);
 }
 
@@ -798,8 +859,9 @@ make_openflow(size_t openflow_len, uint8_t type, struct ofpbuf **bufferp)
  * transaction id 'xid'.  Allocated bytes beyond the header, if any, are
  * zeroed.
  *
- * The caller is responsible for freeing '*bufferp' when it is no longer
- * needed.
+ * The caller is responsible for freeing '*bufferp' with ofpbuf_delete() when
+ * it is no longer needed.  Small messages come from ofpbuf_new_msg(), so
+ * deleting them after they are sent recycles their memory.
  *
  * The OpenFlow header length is initially set to 'openflow_len'; if the
  * message is later extended, the length should be updated with
@@ -810,7 +872,7 @@ void *
 make_openflow_xid(size_t openflow_len, uint8_t type, uint32_t xid,
                   struct ofpbuf **bufferp)
 {
-    *bufferp = ofpbuf_new(openflow_len);
+    *bufferp = ofpbuf_new_msg(openflow_len);
     return put_openflow_xid(openflow_len, type, xid, *bufferp);
 }
 
@@ -980,6 +1042,21 @@ make_buffered_packet_out(uint32_t buffer_id,
     return out;
 }
 
+/* Creates and returns a packet_out with no actions, which makes the switch
+ * drop the packet in 'buffer_id' and free the buffer. */
+struct ofpbuf *
+make_drop_packet_out(uint32_t buffer_id, uint16_t in_port)
+{
+    struct ofp_packet_out *opo;
+    struct ofpbuf *out;
+
+    opo = make_openflow(sizeof *opo, OFPT_PACKET_OUT, &out);
+    opo->buffer_id = htonl(buffer_id);
+    opo->in_port = htons(in_port);
+    opo->actions_len = htons(0);
+    return out;
+}
+
 /* Creates and returns an OFPT_ECHO_REQUEST message with an empty payload. */
 struct ofpbuf *
 make_echo_request(void)
@@ -99,10 +99,45 @@ static long long int boot_time;
 static char *log_file_name;
 static FILE *log_file;
 
+/* Deferred logging (see vlog_set_async()).
+ *
+ * Messages are kept as fixed-size binary records in a ring that any thread
+ * may add to or drain without locking.  Each slot's 'seq' says whose turn it
+ * is: a producer may fill the slot for position 'pos' when 'seq' == 'pos', a
+ * consumer may empty it when 'seq' == 'pos' + 1, and emptying it sets 'seq' to
+ * 'pos' + ASYNC_RING_SIZE for the producer one lap later. */
+#define ASYNC_RING_SIZE 256     /* Must be a power of 2. */
+#define ASYNC_MSG_LEN 512       /* Longer messages are logged synchronously. */
+
+struct async_record {
+    volatile unsigned int seq;  /* See above. */
+    enum vlog_module module;
+    enum vlog_level level;
+    unsigned int msg_num;
+    long long int when;         /* time_msec() when the message was logged. */
+    bool too_long;              /* Message did not fit: skip this record. */
+    char message[ASYNC_MSG_LEN]; /* The message, already formatted. */
+};
+
+static struct async_record *async_ring; /* Null unless logging is deferred. */
+static volatile unsigned int async_head; /* Next position to fill. */
+static volatile unsigned int async_tail; /* Next position to empty. */
+static volatile unsigned int async_dropped; /* Messages lost to a full ring. */
+
 static void format_log_message(enum vlog_module, enum vlog_level,
                                enum vlog_facility, unsigned int msg_num,
+                               long long int when,
                                const char *message, va_list, struct ds *)
-    PRINTF_FORMAT(5, 0);
+    PRINTF_FORMAT(6, 0);
+static void output_log_message(enum vlog_module, enum vlog_level,
+                               unsigned int msg_num, long long int when,
+                               bool flush, const char *message, ...)
+    PRINTF_FORMAT(6, 7);
+static void output_log_message_valist(enum vlog_module, enum vlog_level,
+                                      unsigned int msg_num,
+                                      long long int when, bool flush,
+                                      const char *message, va_list)
+    PRINTF_FORMAT(6, 0);
 
 /* Searches the 'n_names' in 'names'.  Returns the index of a match for
  * 'target', or 'n_names' if no name matches. */
@@ -294,7 +329,9 @@ int vlog_set_log_file(const char *file_name)
     enum vlog_module module;
     int error;
 
-    /* Close old log file. */
+    /* Close old log file, after writing out any messages still bound for
+     * it. */
+    vlog_flush();
     if (log_file)
     {
         VLOG_INFO("closing log file");
@@ -517,6 +554,7 @@ fetch_braces(const char *p, const char *def, char *out, size_t out_size)
 static void
 format_log_message(enum vlog_module module, enum vlog_level level,
                    enum vlog_facility facility, unsigned int msg_num,
+                   long long int when,
                    const char *message, va_list args_, struct ds *s)
 {
     char tmp[128];
@@ -569,9 +607,14 @@ format_log_message(enum vlog_module module, enum vlog_level level,
             ds_put_cstr(s, vlog_get_module_name(module));
             break;
         case 'd':
+        {
+            time_t secs = when / 1000;
+            struct tm tm;
+
             p = fetch_braces(p, "%Y-%m-%d %H:%M:%S", tmp, sizeof tmp);
-            ds_put_strftime(s, tmp, NULL);
+            ds_put_strftime(s, tmp, localtime_r(&secs, &tm));
             break;
+        }
         case 'm':
             va_copy(args, args_);
             ds_put_format_valist(s, message, args);
@@ -590,7 +633,7 @@ format_log_message(enum vlog_module module, enum vlog_level level,
             ds_put_format(s, "%ld", (long int)getpid());
             break;
         case 'r':
-            ds_put_format(s, "%lld", time_msec() - boot_time);
+            ds_put_format(s, "%lld", when - boot_time);
             break;
         default:
             ds_put_char(s, p[-1]);
@@ -614,6 +657,204 @@ format_log_message(enum vlog_module module, enum vlog_level level,
     }
 }
 
+/* Writes 'message', logged at time 'when' as message number 'msg_num', to
+ * each facility enabled for 'module' and 'level'.  Flushes the log file only
+ * if 'flush' is true. */
+static void
+output_log_message_valist(enum vlog_module module, enum vlog_level level,
+                          unsigned int msg_num, long long int when,
+                          bool flush, const char *message, va_list args)
+{
+    bool log_to_console = levels[module][VLF_CONSOLE] >= level;
+    bool log_to_syslog = levels[module][VLF_SYSLOG] >= level;
+    bool log_to_file = levels[module][VLF_FILE] >= level && log_file;
+    struct ds s;
+
+    ds_init(&s);
+    ds_reserve(&s, 1024);
+
+    if (log_to_console)
+    {
+        format_log_message(module, level, VLF_CONSOLE, msg_num, when,
+                           message, args, &s);
+        ds_put_char(&s, '\n');
+        fputs(ds_cstr(&s), stderr);
+    }
+
+    if (log_to_syslog)
+    {
+        int syslog_level = syslog_levels[level];
+        char *save_ptr = NULL;
+        char *line;
+
+        format_log_message(module, level, VLF_SYSLOG, msg_num, when,
+                           message, args, &s);
+        for (line = strtok_r(s.string, "\n", &save_ptr); line;
+             line = strtok_r(NULL, "\n", &save_ptr))
+        {
+            syslog(syslog_level, "%s", line);
+        }
+    }
+
+    if (log_to_file)
+    {
+        format_log_message(module, level, VLF_FILE, msg_num, when,
+                           message, args, &s);
+        ds_put_char(&s, '\n');
+        fputs(ds_cstr(&s), log_file);
+        if (flush)
+        {
+            fflush(log_file);
+        }
+    }
+
+    ds_destroy(&s);
+}
+
+static void
+output_log_message(enum vlog_module module, enum vlog_level level,
+                   unsigned int msg_num, long long int when, bool flush,
+                   const char *message, ...)
+{
+    va_list args;
+
+    va_start(args, message);
+    output_log_message_valist(module, level, msg_num, when, flush,
+                              message, args);
+    va_end(args);
+}
+
+/* Makes logging asynchronous: from now on, vlog_valist() formats only the
+ * message itself into a slot in a ring buffer and returns, without writing
+ * anything.  The ring is drained and the messages are written out by
+ * vlog_flush(), which poll_block() calls before it waits, and at exit.  If
+ * messages arrive faster than they are drained, the ring fills and further
+ * messages are counted and discarded instead of stalling the caller.
+ *
+ * Messages still in the ring are lost if the program crashes. */
+void vlog_set_async(void)
+{
+    if (!async_ring)
+    {
+        unsigned int i;
+
+        async_ring = xmalloc(ASYNC_RING_SIZE * sizeof *async_ring);
+        for (i = 0; i < ASYNC_RING_SIZE; i++)
+        {
+            async_ring[i].seq = i;
+        }
+        atexit(vlog_flush);
+    }
+}
+
+/* Tries to add a message to the deferred logging ring.  Returns true if the
+ * message was added, or dropped because the ring is full; false if it is too
+ * long for a ring slot and must be written synchronously. */
+static bool
+defer_log_message(enum vlog_module module, enum vlog_level level,
+                  unsigned int msg_num, const char *message, va_list args_)
+{
+    struct async_record *r;
+    unsigned int pos;
+    va_list args;
+    int len;
+
+    for (pos = async_head;; pos = async_head)
+    {
+        int dif;
+
+        r = &async_ring[pos & (ASYNC_RING_SIZE - 1)];
+        dif = (int) (r->seq - pos);
+        if (!dif && __sync_bool_compare_and_swap(&async_head, pos, pos + 1))
+        {
+            break;
+        }
+        else if (dif < 0)
+        {
+            __sync_fetch_and_add(&async_dropped, 1);
+            return true;
+        }
+    }
+
+    r->module = module;
+    r->level = level;
+    r->msg_num = msg_num;
+    r->when = time_msec();
+    va_copy(args, args_);
+    len = vsnprintf(r->message, sizeof r->message, message, args);
+    va_end(args);
+
+    /* A message that did not fit still uses up its slot, but the consumer
+     * skips it rather than logging it truncated. */
+    r->too_long = len >= sizeof r->message;
+    __sync_synchronize();
+    r->seq = pos + 1;
+
+    return len < sizeof r->message;
+}
+
+/* Writes out the messages waiting in the deferred logging ring, if logging is
+ * asynchronous (see vlog_set_async()).  Any thread may call this. */
+void vlog_flush(void)
+{
+    unsigned int n_dropped;
+    bool wrote = false;
+
+    if (!async_ring)
+    {
+        return;
+    }
+
+    for (;;)
+    {
+        struct async_record rec;
+        struct async_record *r;
+        unsigned int pos;
+
+        for (pos = async_tail;; pos = async_tail)
+        {
+            int dif;
+
+            r = &async_ring[pos & (ASYNC_RING_SIZE - 1)];
+            dif = (int) (r->seq - (pos + 1));
+            if (!dif
+                && __sync_bool_compare_and_swap(&async_tail, pos, pos + 1))
+            {
+                break;
+            }
+            else if (dif < 0)
+            {
+                goto done;
+            }
+        }
+
+        memcpy(&rec, r, sizeof rec);
+        __sync_synchronize();
+        r->seq = pos + ASYNC_RING_SIZE;
+
+        if (!rec.too_long)
+        {
+            output_log_message(rec.module, rec.level, rec.msg_num, rec.when,
+                               false, "%s", rec.message);
+            wrote = true;
+        }
+    }
+
+done:
+    n_dropped = __sync_fetch_and_and(&async_dropped, 0);
+    if (n_dropped)
+    {
+        output_log_message(THIS_MODULE, VLL_WARN, 0, time_msec(), false,
+                           "dropped %u log messages because the deferred "
+                           "log buffer was full", n_dropped);
+        wrote = true;
+    }
+    if (wrote && log_file)
+    {
+        fflush(log_file);
+    }
+}
+
 /* Writes 'message' to the log at the given 'level' and as coming from the
  * given 'module'.
  *
@@ -627,46 +868,23 @@ void vlog_valist(enum vlog_module module, enum vlog_level level,
     if (log_to_console || log_to_syslog || log_to_file)
     {
         int save_errno = errno;
-        static unsigned int msg_num;
-        struct ds s;
-
-        ds_init(&s);
-        ds_reserve(&s, 1024);
-        msg_num++;
+        static unsigned int n_msgs;
+        unsigned int msg_num = __sync_add_and_fetch(&n_msgs, 1);
 
-        if (log_to_console)
+        if (async_ring)
         {
-            format_log_message(module, level, VLF_CONSOLE, msg_num,
-                               message, args, &s);
-            ds_put_char(&s, '\n');
-            fputs(ds_cstr(&s), stderr);
-        }
-
-        if (log_to_syslog)
-        {
-            int syslog_level = syslog_levels[level];
-            char *save_ptr = NULL;
-            char *line;
-
-            format_log_message(module, level, VLF_SYSLOG, msg_num,
-                               message, args, &s);
-            for (line = strtok_r(s.string, "\n", &save_ptr); line;
-                 line = strtok_r(NULL, "\n", &save_ptr))
+            if (defer_log_message(module, level, msg_num, message, args))
             {
-                syslog(syslog_level, "%s", line);
+                errno = save_errno;
+                return;
             }
-        }
 
-        if (log_to_file)
-        {
-            format_log_message(module, level, VLF_FILE, msg_num,
-                               message, args, &s);
-            ds_put_char(&s, '\n');
-            fputs(ds_cstr(&s), log_file);
-            fflush(log_file);
+            /* Too long to defer.  Write out what came before it first, to
+             * keep the log in order. */
+            vlog_flush();
         }
-
-        ds_destroy(&s);
+        output_log_message_valist(module, level, msg_num, time_msec(), true,
+                                  message, args);
         errno = save_errno;
     }
 }
@@ -680,14 +898,19 @@ void vlog(enum vlog_module module, enum vlog_level level, const char *message, .
     va_end(args);
 }
 
-void vlog_rate_limit(enum vlog_module module, enum vlog_level level,
-                     struct vlog_rate_limit *rl, const char *message, ...)
+/* Returns true if a message at 'level' from 'module' would be discarded,
+ * either because that level is disabled or because 'rl' is over its rate
+ * limit.  Otherwise, takes a token from 'rl' and returns false, and the
+ * caller should go on to log its message with VLOG (not VLOG_RL).
+ *
+ * This lets callers skip building expensive messages, such as ofp_to_string()
+ * output, that would only be thrown away. */
+bool vlog_should_drop(enum vlog_module module, enum vlog_level level,
+                      struct vlog_rate_limit *rl)
 {
-    va_list args;
-
     if (!vlog_is_enabled(module, level))
     {
-        return;
+        return true;
     }
 
     if (rl->tokens < VLOG_MSG_TOKENS)
@@ -713,15 +936,11 @@ void vlog_rate_limit(enum vlog_module module, enum vlog_level level,
                 rl->first_dropped = now;
             }
             rl->n_dropped++;
-            return;
+            return true;
         }
     }
     rl->tokens -= VLOG_MSG_TOKENS;
 
-    va_start(args, message);
-    vlog_valist(module, level, message, args);
-    va_end(args);
-
     if (rl->n_dropped)
     {
         vlog(module, level,
@@ -729,6 +948,22 @@ void vlog_rate_limit(enum vlog_module module, enum vlog_level level,
              rl->n_dropped, (unsigned int)(time_now() - rl->first_dropped));
         rl->n_dropped = 0;
     }
+    return false;
+}
+
+void vlog_rate_limit(enum vlog_module module, enum vlog_level level,
+                     struct vlog_rate_limit *rl, const char *message, ...)
+{
+    va_list args;
+
+    if (vlog_should_drop(module, level, rl))
+    {
+        return;
+    }
+
+    va_start(args, message);
+    vlog_valist(module, level, message, args);
+    va_end(args);
 }
 
 void vlog_usage(void)
@@ -737,6 +972,7 @@ void vlog_usage(void)
            "  -v, --verbose=MODULE[:FACILITY[:LEVEL]]  set logging levels\n"
            "  -v, --verbose           set maximum verbosity level\n"
            "  --log-file[=FILE]       enable logging to specified FILE\n"
-           "                          (default: %s/%s.log)\n",
+           "                          (default: %s/%s.log)\n"
+           "  --log-async             write log messages from the main loop\n",
            ofp_logdir, program_name);
 }
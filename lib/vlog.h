@@ -128,6 +128,8 @@ void vlog_set_pattern(enum vlog_facility, const char *pattern);
 const char *vlog_get_log_file(void);
 int vlog_set_log_file(const char *file_name);
 int vlog_reopen_log_file(void);
+void vlog_set_async(void);
+void vlog_flush(void);
 
 /* Function for actual logging. */
 void vlog_init(void);
@@ -136,6 +138,8 @@ void vlog(enum vlog_module, enum vlog_level, const char *format, ...)
     __attribute__((format(printf, 3, 4)));
 void vlog_valist(enum vlog_module, enum vlog_level, const char *, va_list)
     __attribute__((format(printf, 3, 0)));
+bool vlog_should_drop(enum vlog_module, enum vlog_level,
+                      struct vlog_rate_limit *);
 void vlog_rate_limit(enum vlog_module, enum vlog_level,
                      struct vlog_rate_limit *, const char *, ...)
     __attribute__((format(printf, 4, 5)));
@@ -172,17 +176,37 @@ void vlog_rate_limit(enum vlog_module, enum vlog_level,
 #define VLOG_INFO_RL(RL, ...) VLOG_RL(RL, VLL_INFO, __VA_ARGS__)
 #define VLOG_DBG_RL(RL, ...) VLOG_RL(RL, VLL_DBG, __VA_ARGS__)
 
+/* Macros for logging messages that are expensive to compose.  Each returns
+ * true if a message at the given level would be discarded, either because the
+ * level is disabled or because 'RL' is over its rate; otherwise, the caller
+ * should compose its message and log it with the plain VLOG_* macro, e.g.:
+ *
+ *      if (!VLOG_DROP_DBG(&rl)) {
+ *          char *s = ofp_to_string(msg->data, msg->size, 1);
+ *          VLOG_DBG("received: %s", s);
+ *          free(s);
+ *      }
+ */
+#define VLOG_DROP_ERR(RL) vlog_should_drop(THIS_MODULE, VLL_ERR, RL)
+#define VLOG_DROP_WARN(RL) vlog_should_drop(THIS_MODULE, VLL_WARN, RL)
+#define VLOG_DROP_INFO(RL) vlog_should_drop(THIS_MODULE, VLL_INFO, RL)
+#define VLOG_DROP_DBG(RL) vlog_should_drop(THIS_MODULE, VLL_DBG, RL)
+
 /* Command line processing. */
-#define VLOG_OPTION_ENUMS OPT_LOG_FILE
+#define VLOG_OPTION_ENUMS OPT_LOG_FILE, OPT_LOG_ASYNC
 #define VLOG_LONG_OPTIONS                                   \
         {"verbose",     optional_argument, 0, 'v'},         \
-        {"log-file",    optional_argument, 0, OPT_LOG_FILE}
+        {"log-file",    optional_argument, 0, OPT_LOG_FILE}, \
+        {"log-async",   no_argument, 0, OPT_LOG_ASYNC}
 #define VLOG_OPTION_HANDLERS                    \
         case 'v':                               \
             vlog_set_verbosity(optarg);         \
             break;                              \
         case OPT_LOG_FILE:                      \
             vlog_set_log_file(optarg);          \
+            break;                              \
+        case OPT_LOG_ASYNC:                     \
+            vlog_set_async();                   \
             break;
 void vlog_usage(void);
 
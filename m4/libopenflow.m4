@@ -96,6 +96,11 @@ AC_DEFUN([OFP_CHECK_FAULT_LIBS],
   [AC_CHECK_LIB([dl], [dladdr], [FAULT_LIBS=-ldl])
    AC_SUBST([FAULT_LIBS])])
 
+dnl Checks for the POSIX threads library needed by udatapath/rx-threads.c.
+AC_DEFUN([OFP_CHECK_PTHREAD],
+  [AC_CHECK_LIB([pthread], [pthread_create], [PTHREAD_LIBS=-lpthread])
+   AC_SUBST([PTHREAD_LIBS])])
+
 dnl Checks for libraries needed by lib/socket-util.c.
 AC_DEFUN([OFP_CHECK_SOCKET_LIBS],
   [AC_CHECK_LIB([socket], [connect])
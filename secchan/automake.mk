@@ -24,7 +24,18 @@ secchan_ofprotocol_SOURCES = \
 	secchan/status.h \
 	secchan/stp-secchan.c \
 	secchan/stp-secchan.h
-secchan_ofprotocol_LDADD = lib/libopenflow.a $(FAULT_LIBS) $(SSL_LIBS)
+if HAVE_NETLINK
+secchan_ofprotocol_SOURCES += \
+	secchan/upcall.c \
+	secchan/upcall.h
+endif
+secchan_ofprotocol_LDADD = lib/libopenflow.a $(FAULT_LIBS) $(SSL_LIBS) \
+	$(PTHREAD_LIBS)
+
+# The secure channel as a library, for ofdatapath's --secchan.
+noinst_LIBRARIES += secchan/libsecchan.a
+secchan_libsecchan_a_SOURCES = $(secchan_ofprotocol_SOURCES)
+secchan_libsecchan_a_CPPFLAGS = $(AM_CPPFLAGS) -DSECCHAN_AS_LIB
 
 EXTRA_DIST += secchan/ofprotocol.8.in
 DISTCLEANFILES += secchan/ofprotocol.8
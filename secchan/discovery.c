@@ -33,9 +33,12 @@
 
 #include <config.h>
 #include "discovery.h"
+#include <errno.h>
 #include <inttypes.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include "dhcp-client.h"
 #include "dhcp.h"
 #include "netdev.h"
@@ -53,10 +56,14 @@ struct discovery
     const struct settings *s;
     struct dhclient *dhcp;
     int n_changes;
+    char *cached_controller;    /* Last known controller, or NULL. */
 };
 
 static void modify_dhcp_request(struct dhcp_msg *, void *aux);
 static bool validate_dhcp_offer(const struct dhcp_msg *, void *aux);
+static bool accept_controller_name(const struct settings *, const char *);
+static char *read_discovery_cache(const struct settings *);
+static void write_discovery_cache(const struct settings *, const char *);
 
 static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(60, 60);
 
@@ -67,6 +74,9 @@ discovery_status_cb(struct status_reply *sr, void *d_)
 
     status_reply_put(sr, "accept-remote=%s", d->s->accept_controller_re);
     status_reply_put(sr, "n-changes=%d", d->n_changes);
+    if (d->cached_controller) {
+        status_reply_put(sr, "cached-remote=%s", d->cached_controller);
+    }
     if (d->dhcp) {
         status_reply_put(sr, "state=%s", dhclient_get_state(d->dhcp));
         status_reply_put(sr, "state-elapsed=%u",
@@ -167,6 +177,11 @@ discovery_init(const struct settings *s, struct port_watcher *pw,
     d->s = s;
     d->dhcp = NULL;
     d->n_changes = 0;
+    d->cached_controller = read_discovery_cache(s);
+    if (d->cached_controller) {
+        VLOG_INFO("%s: trying cached controller during discovery",
+                  d->cached_controller);
+    }
 
     switch_status_register_category(ss, "discovery", discovery_status_cb, d);
     port_watcher_register_local_port_callback(pw, discovery_local_port_cb, d);
@@ -182,11 +197,28 @@ discovery_question_connectivity(struct discovery *d)
     }
 }
 
+/* Returns the name of the last known controller, as a string that the caller
+ * must free, or a null pointer if there is none. */
+static char *
+last_known_controller(const struct discovery *d)
+{
+    return d->cached_controller ? xstrdup(d->cached_controller) : NULL;
+}
+
+/* Checks for a change in the controller to connect to.  If there is one,
+ * stores the new controller's name in '*controller_name', or a null pointer if
+ * there is none, and returns true; the caller must free the name.  Returns
+ * false if nothing has changed.
+ *
+ * Until DHCP binds, and after a binding is lost, the controller named in the
+ * discovery cache (if any) is reported, so that the caller can connect to it
+ * without waiting out DHCP.  Thus, the same name may be reported more than
+ * once in a row. */
 bool
 discovery_run(struct discovery *d, char **controller_name)
 {
     if (!d->dhcp) {
-        *controller_name = NULL;
+        *controller_name = last_known_controller(d);
         return true;
     }
 
@@ -205,8 +237,15 @@ discovery_run(struct discovery *d, char **controller_name)
                                                DHCP_CODE_OFP_CONTROLLER_VCONN);
         VLOG_INFO("%s: discovered controller", *controller_name);
         d->n_changes++;
+        if (d->s->discovery_cache
+            && (!d->cached_controller
+                || strcmp(d->cached_controller, *controller_name))) {
+            free(d->cached_controller);
+            d->cached_controller = xstrdup(*controller_name);
+            write_discovery_cache(d->s, d->cached_controller);
+        }
     } else {
-        *controller_name = NULL;
+        *controller_name = last_known_controller(d);
         if (d->n_changes) {
             VLOG_INFO("discovered controller no longer available");
             d->n_changes++;
@@ -241,11 +280,74 @@ validate_dhcp_offer(const struct dhcp_msg *msg, void *s_)
         VLOG_WARN_RL(&rl, "rejecting DHCP offer missing controller vconn");
         return false;
     }
-    accept = !regexec(&s->accept_controller_regex, vconn_name, 0, NULL, 0);
-    if (!accept) {
+    accept = accept_controller_name(s, vconn_name);
+    free(vconn_name);
+    return accept;
+}
+
+static bool
+accept_controller_name(const struct settings *s, const char *vconn_name)
+{
+    if (regexec(&s->accept_controller_regex, vconn_name, 0, NULL, 0)) {
         VLOG_WARN_RL(&rl, "rejecting controller vconn that fails to match %s",
                      s->accept_controller_re);
+        return false;
     }
-    free(vconn_name);
-    return accept;
+    return true;
+}
+
+/* Reads the controller vconn name saved by a previous run from the discovery
+ * cache file, if one is configured.  Returns the name, which the caller must
+ * free, or a null pointer if there is no usable cached name. */
+static char *
+read_discovery_cache(const struct settings *s)
+{
+    char line[256];
+    FILE *file;
+    char *name;
+
+    if (!s->discovery_cache) {
+        return NULL;
+    }
+
+    file = fopen(s->discovery_cache, "r");
+    if (!file) {
+        if (errno != ENOENT) {
+            VLOG_WARN("%s: open: %s", s->discovery_cache, strerror(errno));
+        }
+        return NULL;
+    }
+    name = NULL;
+    if (fgets(line, sizeof line, file)) {
+        line[strcspn(line, " \t\r\n")] = '\0';
+        if (line[0] && accept_controller_name(s, line)) {
+            name = xstrdup(line);
+        }
+    }
+    fclose(file);
+    return name;
+}
+
+/* Saves 'vconn_name' as the last known controller in the discovery cache
+ * file.  The file is replaced atomically, so that a crash cannot leave a
+ * truncated name behind for the next run. */
+static void
+write_discovery_cache(const struct settings *s, const char *vconn_name)
+{
+    char *tmp_name;
+    FILE *file;
+
+    tmp_name = xasprintf("%s.tmp%ld", s->discovery_cache, (long int) getpid());
+    file = fopen(tmp_name, "w");
+    if (!file) {
+        VLOG_WARN("%s: create: %s", tmp_name, strerror(errno));
+        free(tmp_name);
+        return;
+    }
+    fprintf(file, "%s\n", vconn_name);
+    if (fclose(file) || rename(tmp_name, s->discovery_cache)) {
+        VLOG_WARN("%s: write: %s", s->discovery_cache, strerror(errno));
+        unlink(tmp_name);
+    }
+    free(tmp_name);
 }
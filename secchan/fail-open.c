@@ -137,6 +137,8 @@ static struct hook_class fail_open_hook_class = {
     fail_open_periodic_cb,      /* periodic_cb */
     fail_open_wait_cb,          /* wait_cb */
     NULL,                       /* closing_cb */
+    0,                          /* local_types */
+    0,                          /* remote_types */
 };
 
 void
@@ -35,31 +35,54 @@
 #include <stddef.h>
 #include <string.h>
 
+#include "openflow/openflow.h"
+#include "ofpbuf.h"
+#include "queue.h"
 #include "util.h"
 #include "rconn.h"
 #include "secchan.h"
 #include "status.h"
 #include "timeval.h"
 #include "sat-math.h"
+#include "vconn.h"
 #include "failover.h"
 #define THIS_MODULE VLM_failover
 #include "vlog.h"
 
+/* Maximum number of messages held from a standby controller until it is
+ * promoted.  A controller normally sends only its features request and
+ * initial configuration before it hears from the switch. */
+#define FAILOVER_BACKLOG_MAX 64
+
 struct failover_peer {
 	time_t epoch;
+
+	/* In hot-standby mode, every controller other than the active one has a
+	 * connection of its own that is kept up and probed, along with the
+	 * messages the controller has sent on it so far.  'seqno' is the
+	 * connection seqno the backlog belongs to. */
+	struct rconn *standby;
+	struct ofp_queue backlog;
+	unsigned int seqno;
+	unsigned int n_dropped;
 };
 
 struct failover_context {
 	const struct settings *settings;
 	const struct secchan *secchan;
+	struct rconn *local_rconn;
 	struct rconn *remote_rconn;
 	int index;
 	struct failover_peer *peers[MAX_CONTROLLERS];
+	unsigned int n_switchovers;
 };
 
+static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(1, 5);
+
 static void failover_status_cb(struct status_reply *, void *);
 static bool is_timed_out(const struct failover_peer *, int);
 static void failover_periodic_cb(void *);
+static void failover_wait_cb(void *);
 
 static void
 failover_status_cb(struct status_reply *status_reply, void *context_)
@@ -71,11 +94,22 @@ failover_status_cb(struct status_reply *status_reply, void *context_)
 			 context->settings->num_controllers);
 
 	for (i = 0; i < MAX_CONTROLLERS; ++i) {
+		struct failover_peer *peer = context->peers[i];
+
 		if (context->settings->controller_names[i] == NULL)
 			continue;
 		status_reply_put(status_reply, "controller#%d=%s",
 				 i, context->settings->controller_names[i]);
+		if (peer->standby != NULL) {
+			status_reply_put(status_reply, "standby#%d=%s",
+					 i, rconn_get_state(peer->standby));
+			status_reply_put(status_reply, "standby#%d-dropped=%u",
+					 i, peer->n_dropped);
+		}
 	}
+	status_reply_put(status_reply, "active=%d", context->index);
+	status_reply_put(status_reply, "switchovers=%u",
+			 context->n_switchovers);
 }
 
 static bool
@@ -85,12 +119,110 @@ is_timed_out(const struct failover_peer *peer, int max_backoff)
 	return time_now() >= sat_value;
 }
 
+/* Services the standby connection of 'peer': answers the controller's echo
+ * requests, so that it does not give up on us, and holds everything else it
+ * sends until the peer is promoted. */
+static void
+standby_run(struct failover_peer *peer)
+{
+	int i;
+
+	rconn_run(peer->standby);
+	if (peer->seqno != rconn_get_connection_seqno(peer->standby)) {
+		/* A new connection starts a new handshake. */
+		peer->seqno = rconn_get_connection_seqno(peer->standby);
+		queue_clear(&peer->backlog);
+	}
+
+	for (i = 0; i < 50; i++) {
+		struct ofpbuf *msg = rconn_recv(peer->standby);
+		struct ofp_header *oh;
+
+		if (msg == NULL)
+			break;
+		oh = msg->data;
+		if (oh->type == OFPT_ECHO_REQUEST) {
+			rconn_send(peer->standby, make_echo_reply(oh), NULL);
+		} else if (oh->type == OFPT_ECHO_REPLY
+			   || oh->type == OFPT_HELLO) {
+			/* Inactivity probe answer or late hello: nothing to do. */
+		} else if (peer->backlog.n < FAILOVER_BACKLOG_MAX) {
+			queue_push_tail(&peer->backlog, msg);
+			continue;
+		} else {
+			peer->n_dropped++;
+			VLOG_WARN_RL(&rl, "%s: standby backlog full, dropping "
+				     "message type %d",
+				     rconn_get_name(peer->standby), oh->type);
+		}
+		ofpbuf_delete(msg);
+	}
+}
+
+/* Hands the remote half of the relay over to the first standby controller,
+ * in configuration order after the active one, whose connection is up.  The
+ * messages that controller has sent so far are replayed to the datapath, so
+ * that the replies reach it on the new active connection.  The failed
+ * connection moves to the old active peer's standby slot, where it keeps
+ * trying to reconnect in the background.  Returns true if a standby was
+ * promoted. */
+static bool
+promote_standby(struct failover_context *context)
+{
+	int n = context->settings->num_controllers;
+	int i;
+
+	for (i = 1; i < n; i++) {
+		int next = (context->index + i) % n;
+		struct failover_peer *peer = context->peers[next];
+		struct failover_peer *prev = context->peers[context->index];
+		struct ofpbuf *msg;
+
+		if (!rconn_is_connected(peer->standby))
+			continue;
+
+		rconn_swap_connection(context->remote_rconn, peer->standby);
+		prev->standby = peer->standby;
+		prev->seqno = rconn_get_connection_seqno(prev->standby);
+		queue_clear(&prev->backlog);
+		peer->standby = NULL;
+
+		while ((msg = queue_pop_head(&peer->backlog)) != NULL) {
+			if (rconn_send(context->local_rconn, msg, NULL))
+				ofpbuf_delete(msg);
+		}
+
+		VLOG_INFO("Switching over to standby %s, from %s",
+			  context->settings->controller_names[next],
+			  context->settings->controller_names[context->index]);
+		context->index = next;
+		peer->epoch = time_now();
+		context->n_switchovers++;
+		return true;
+	}
+	return false;
+}
+
 static void
 failover_periodic_cb(void *context_)
 {
 	struct failover_context *context = context_;
 	char *curr_peer = NULL;
 	char *prev_peer = NULL;
+	int i;
+
+	if (context->settings->hot_standby) {
+		for (i = 0; i < context->settings->num_controllers; i++) {
+			if (context->peers[i]->standby != NULL)
+				standby_run(context->peers[i]);
+		}
+		if (!rconn_is_connected(context->remote_rconn))
+			promote_standby(context);
+
+		/* Every controller already has a connection retrying on its
+		 * own, so there is nothing to rotate through. */
+		return;
+	}
 
 	if (rconn_is_connected(context->remote_rconn))
 		return;
@@ -111,9 +243,26 @@ failover_periodic_cb(void *context_)
 	VLOG_INFO("Switching over to %s, from %s", curr_peer, prev_peer);
 }
 
+static void
+failover_wait_cb(void *context_)
+{
+	struct failover_context *context = context_;
+	int i;
+
+	for (i = 0; i < context->settings->num_controllers; i++) {
+		struct rconn *standby = context->peers[i]->standby;
+
+		if (standby != NULL) {
+			rconn_run_wait(standby);
+			rconn_recv_wait(standby);
+		}
+	}
+}
+
 void
 failover_start(struct secchan *secchan, const struct settings *settings,
-	       struct switch_status *switch_status, struct rconn *remote_rconn)
+	       struct switch_status *switch_status, struct rconn *local_rconn,
+	       struct rconn *remote_rconn)
 {
 	struct failover_context *context = NULL;
 	int i;
@@ -121,21 +270,38 @@ failover_start(struct secchan *secchan, const struct settings *settings,
 		NULL,		/* local_packet_cb */
 		NULL,		/* remote_packet_cb */
 		failover_periodic_cb,	/* periodic_cb */
-		NULL,		/* wait_cb */
+		failover_wait_cb,	/* wait_cb */
 		NULL,		/* closing_cb */
+		0,	/* local_types */
+		0,	/* remote_types */
 	};
 
 	context = xmalloc(sizeof(*context));
 	context->settings = settings;
 	context->secchan = secchan;
+	context->local_rconn = local_rconn;
 	context->remote_rconn = remote_rconn;
 	context->index = 0;
+	context->n_switchovers = 0;
 	for (i = 0; i < MAX_CONTROLLERS; ++i) {
+		struct failover_peer *peer;
+
 		context->peers[i] = NULL;
 		if (settings->controller_names[i] == NULL)
 			continue;
-		context->peers[i] = xmalloc(sizeof(struct failover_peer));
-		context->peers[i]->epoch = time_now();
+		peer = context->peers[i] = xmalloc(sizeof(struct failover_peer));
+		peer->epoch = time_now();
+		peer->standby = NULL;
+		queue_init(&peer->backlog);
+		peer->seqno = 0;
+		peer->n_dropped = 0;
+		if (settings->hot_standby && i != context->index) {
+			peer->standby = rconn_create(settings->probe_interval,
+						     settings->max_backoff);
+			rconn_connect(peer->standby,
+				      settings->controller_names[i]);
+			peer->seqno = rconn_get_connection_seqno(peer->standby);
+		}
 	}
 
 	switch_status_register_category(switch_status, "failover",
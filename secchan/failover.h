@@ -39,6 +39,7 @@ struct settings;
 struct switch_status;
 
 void failover_start(struct secchan *, const struct settings *,
-		    struct switch_status *, struct rconn *);
+		    struct switch_status *, struct rconn *local,
+		    struct rconn *remote);
 
 #endif
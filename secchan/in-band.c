@@ -53,12 +53,32 @@
 #define THIS_MODULE VLM_in_band
 #include "vlog.h"
 
+/* Priority of the flows that in-band control sets up in the datapath.  They
+ * must win over any flow that the controller sets up. */
+#define IN_BAND_PRIORITY UINT16_MAX
+
 struct in_band_data {
     const struct settings *s;
     struct mac_learning *ml;
     struct netdev *of_device;
     struct rconn *controller;
+    struct rconn *local;        /* Connection to the datapath. */
     int n_queued;
+
+    /* Addresses refreshed by in_band_periodic_cb(), so that
+     * in_band_local_packet_cb() can turn away unrelated packets with a few
+     * compares.  All-zeros if unknown. */
+    uint8_t local_mac[ETH_ADDR_LEN];
+    uint8_t controller_mac[ETH_ADDR_LEN];
+    uint16_t controller_port;   /* OFPP_FLOOD if unknown. */
+
+    /* The addresses for which the datapath has in-band flows, so that
+     * controller traffic never reaches secchan.  Valid only if
+     * 'flows_valid'. */
+    bool flows_valid;
+    uint8_t flows_local_mac[ETH_ADDR_LEN];
+    uint8_t flows_controller_mac[ETH_ADDR_LEN];
+    uint16_t flows_controller_port;
 };
 
 static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(60, 60);
@@ -66,7 +86,7 @@ static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(60, 60);
 static void
 queue_tx(struct rconn *rc, struct in_band_data *in_band, struct ofpbuf *b)
 {
-    rconn_send_with_limit(rc, b, &in_band->n_queued, 10);
+    rconn_send_with_limit(rc, b, &in_band->n_queued, 10, RCONN_TXQ_CONTROL);
 }
 
 static const uint8_t *
@@ -122,8 +142,134 @@ static bool
 is_controller_mac(const uint8_t dl_addr[ETH_ADDR_LEN],
                   struct in_band_data *in_band)
 {
-    const uint8_t *mac = get_controller_mac(in_band);
-    return mac && eth_addr_equals(mac, dl_addr);
+    return (!eth_addr_is_zero(in_band->controller_mac)
+            && eth_addr_equals(in_band->controller_mac, dl_addr));
+}
+
+/* Returns a flow_mod for one of the datapath flows that carry in-band
+ * control traffic, matching 'flow' on the fields not in 'wildcards' and
+ * outputting to 'out_port', or dropping if 'out_port' is negative. */
+static struct ofpbuf *
+make_in_band_flow(uint16_t command, uint32_t wildcards,
+                  const struct flow *flow, int out_port)
+{
+    size_t actions_len = out_port >= 0 ? sizeof(struct ofp_action_output) : 0;
+    struct ofpbuf *b = make_flow_mod(command, flow, actions_len);
+    struct ofp_flow_mod *ofm = b->data;
+
+    ofm->match.wildcards = htonl(wildcards);
+    ofm->priority = htons(IN_BAND_PRIORITY);
+    ofm->buffer_id = htonl(UINT32_MAX);
+    ofm->idle_timeout = htons(OFP_FLOW_PERMANENT);
+    ofm->hard_timeout = htons(OFP_FLOW_PERMANENT);
+    ofm->out_port = htons(OFPP_NONE);
+    if (actions_len) {
+        struct ofp_action_output *oao = ofpbuf_put_zeros(b, sizeof *oao);
+        oao->type = htons(OFPAT_OUTPUT);
+        oao->len = htons(sizeof *oao);
+        oao->port = htons(out_port);
+    }
+    return b;
+}
+
+/* Sends 'command' for each of the datapath flows that switch in-band control
+ * traffic between the secure channel, at 'local_mac', and the controller, at
+ * 'controller_mac' on 'controller_port'.  These are the cases that
+ * in_band_local_packet_cb() would otherwise switch by hand. */
+static void
+send_in_band_flows(struct in_band_data *in_band, uint16_t command,
+                   const uint8_t local_mac[ETH_ADDR_LEN],
+                   const uint8_t controller_mac[ETH_ADDR_LEN],
+                   uint16_t controller_port)
+{
+    bool add = command == OFPFC_ADD;
+    struct flow flow;
+
+    /* Controller to secure channel. */
+    memset(&flow, 0, sizeof flow);
+    flow.in_port = htons(controller_port);
+    memcpy(flow.dl_src, controller_mac, ETH_ADDR_LEN);
+    memcpy(flow.dl_dst, local_mac, ETH_ADDR_LEN);
+    queue_tx(in_band->local, in_band,
+             make_in_band_flow(command, (OFPFW_ALL & ~(OFPFW_IN_PORT
+                                                       | OFPFW_DL_SRC
+                                                       | OFPFW_DL_DST)),
+                               &flow, add ? OFPP_LOCAL : -1));
+
+    /* Secure channel to controller. */
+    memset(&flow, 0, sizeof flow);
+    flow.in_port = htons(OFPP_LOCAL);
+    memcpy(flow.dl_src, local_mac, ETH_ADDR_LEN);
+    memcpy(flow.dl_dst, controller_mac, ETH_ADDR_LEN);
+    queue_tx(in_band->local, in_band,
+             make_in_band_flow(command, (OFPFW_ALL & ~(OFPFW_IN_PORT
+                                                       | OFPFW_DL_SRC
+                                                       | OFPFW_DL_DST)),
+                               &flow, add ? controller_port : -1));
+
+    /* ARP broadcast by the controller. */
+    memset(&flow, 0, sizeof flow);
+    flow.in_port = htons(controller_port);
+    memcpy(flow.dl_src, controller_mac, ETH_ADDR_LEN);
+    memset(flow.dl_dst, 0xff, ETH_ADDR_LEN);
+    flow.dl_type = htons(ETH_TYPE_ARP);
+    queue_tx(in_band->local, in_band,
+             make_in_band_flow(command, (OFPFW_ALL & ~(OFPFW_IN_PORT
+                                                       | OFPFW_DL_SRC
+                                                       | OFPFW_DL_DST
+                                                       | OFPFW_DL_TYPE)),
+                               &flow, add ? OFPP_FLOOD : -1));
+
+    /* Controller traffic that arrives on the controller's own port. */
+    memset(&flow, 0, sizeof flow);
+    flow.in_port = htons(controller_port);
+    memcpy(flow.dl_dst, controller_mac, ETH_ADDR_LEN);
+    queue_tx(in_band->local, in_band,
+             make_in_band_flow(command, (OFPFW_ALL & ~(OFPFW_IN_PORT
+                                                       | OFPFW_DL_DST)),
+                               &flow, -1));
+}
+
+/* Brings the datapath's in-band flows up to date with the addresses that
+ * in-band control currently knows. */
+static void
+update_in_band_flows(struct in_band_data *in_band)
+{
+    bool want = (!eth_addr_is_zero(in_band->local_mac)
+                 && !eth_addr_is_zero(in_band->controller_mac)
+                 && in_band->controller_port != OFPP_FLOOD
+                 && in_band->controller_port != OFPP_LOCAL);
+
+    if (!rconn_is_connected(in_band->local)) {
+        /* The datapath may come back without them. */
+        in_band->flows_valid = false;
+        return;
+    }
+
+    if (in_band->flows_valid
+        && (!want
+            || !eth_addr_equals(in_band->flows_local_mac, in_band->local_mac)
+            || !eth_addr_equals(in_band->flows_controller_mac,
+                                in_band->controller_mac)
+            || in_band->flows_controller_port != in_band->controller_port)) {
+        send_in_band_flows(in_band, OFPFC_DELETE_STRICT,
+                           in_band->flows_local_mac,
+                           in_band->flows_controller_mac,
+                           in_band->flows_controller_port);
+        in_band->flows_valid = false;
+    }
+    if (want && !in_band->flows_valid) {
+        send_in_band_flows(in_band, OFPFC_ADD, in_band->local_mac,
+                           in_band->controller_mac, in_band->controller_port);
+        memcpy(in_band->flows_local_mac, in_band->local_mac, ETH_ADDR_LEN);
+        memcpy(in_band->flows_controller_mac, in_band->controller_mac,
+               ETH_ADDR_LEN);
+        in_band->flows_controller_port = in_band->controller_port;
+        in_band->flows_valid = true;
+        VLOG_DBG("set up in-band flows for controller "ETH_ADDR_FMT
+                 " on port %"PRIu16, ETH_ADDR_ARGS(in_band->controller_mac),
+                 in_band->controller_port);
+    }
 }
 
 static void
@@ -136,6 +282,32 @@ in_band_learn_mac(struct in_band_data *in_band,
     }
 }
 
+/* Returns true if one of the datapath's in-band flows, as set up by
+ * send_in_band_flows(), matches a packet with Ethernet header 'eth' received
+ * on 'in_port'. */
+static bool
+in_band_flows_match(const struct in_band_data *in_band, uint16_t in_port,
+                    const struct eth_header *eth)
+{
+    const uint8_t *cmac = in_band->flows_controller_mac;
+
+    if (!in_band->flows_valid) {
+        return false;
+    } else if (in_port == OFPP_LOCAL) {
+        return (eth_addr_equals(eth->eth_src, in_band->flows_local_mac)
+                && eth_addr_equals(eth->eth_dst, cmac));
+    } else if (in_port == in_band->flows_controller_port) {
+        return (eth_addr_equals(eth->eth_dst, cmac)
+                || (eth_addr_equals(eth->eth_src, cmac)
+                    && (eth_addr_equals(eth->eth_dst,
+                                        in_band->flows_local_mac)
+                        || (eth_addr_is_broadcast(eth->eth_dst)
+                            && eth->eth_type == htons(ETH_TYPE_ARP)))));
+    } else {
+        return false;
+    }
+}
+
 static bool
 in_band_local_packet_cb(struct relay *r, void *in_band_)
 {
@@ -152,6 +324,21 @@ in_band_local_packet_cb(struct relay *r, void *in_band_)
         return false;
     }
     in_port = ntohs(opi->in_port);
+
+    /* Most packets have nothing to do with in-band control. */
+    if (in_port != OFPP_LOCAL
+        && !eth_addr_equals(eth->eth_dst, in_band->local_mac)
+        && !is_controller_mac(eth->eth_dst, in_band)
+        && !is_controller_mac(eth->eth_src, in_band)) {
+        return false;
+    }
+
+    if (in_band_flows_match(in_band, in_port, eth)) {
+        /* One of the in-band flows should have taken this packet, so they
+         * must have been deleted.  Set them up again. */
+        in_band->flows_valid = false;
+    }
+
     get_ofp_packet_payload(opi, &payload);
     flow_extract(&payload, in_port, &flow);
 
@@ -159,8 +346,7 @@ in_band_local_packet_cb(struct relay *r, void *in_band_)
     if (in_port == OFPP_LOCAL) {
         /* Sent by secure channel. */
         out_port = mac_learning_lookup(in_band->ml, eth->eth_dst, 0);
-    } else if (eth_addr_equals(eth->eth_dst,
-                               netdev_get_etheraddr(in_band->of_device))) {
+    } else if (eth_addr_equals(eth->eth_dst, in_band->local_mac)) {
         /* Sent to secure channel. */
         out_port = OFPP_LOCAL;
         in_band_learn_mac(in_band, in_port, eth->eth_src);
@@ -181,16 +367,9 @@ in_band_local_packet_cb(struct relay *r, void *in_band_)
         in_band_learn_mac(in_band, in_port, eth->eth_src);
         out_port = mac_learning_lookup(in_band->ml, eth->eth_dst, 0);
     } else {
-        const uint8_t *controller_mac;
-        controller_mac = get_controller_mac(in_band);
-        if (eth->eth_type == htons(ETH_TYPE_ARP)
-            && eth_addr_is_broadcast(eth->eth_dst)
-            && is_controller_mac(eth->eth_src, in_band)) {
-            /* ARP sent by controller. */
-            out_port = OFPP_FLOOD;
-        } else if (is_controller_mac(eth->eth_dst, in_band)
-                   && in_port == mac_learning_lookup(in_band->ml,
-                                                     controller_mac, 0)) {
+        if (is_controller_mac(eth->eth_dst, in_band)
+            && in_port == mac_learning_lookup(in_band->ml,
+                                              in_band->controller_mac, 0)) {
             /* Drop controller traffic that arrives on the controller port. */
             out_port = -1;
         } else {
@@ -294,7 +473,32 @@ static void
 in_band_periodic_cb(void *in_band_)
 {
     struct in_band_data *in_band = in_band_;
+    const uint8_t *controller_mac;
+
     mac_learning_run(in_band->ml, NULL);
+
+    if (in_band->of_device) {
+        memcpy(in_band->local_mac, netdev_get_etheraddr(in_band->of_device),
+               ETH_ADDR_LEN);
+    } else {
+        memset(in_band->local_mac, 0, ETH_ADDR_LEN);
+    }
+    controller_mac = get_controller_mac(in_band);
+    if (controller_mac) {
+        uint16_t port = mac_learning_lookup(in_band->ml, controller_mac, 0);
+
+        memcpy(in_band->controller_mac, controller_mac, ETH_ADDR_LEN);
+        /* Keep the last known port while the learning entry is expired:
+         * the in-band flows keep the controller's packets from refreshing
+         * it, and packets arriving on any other port relearn it. */
+        if (port != OFPP_FLOOD) {
+            in_band->controller_port = port;
+        }
+    } else {
+        memset(in_band->controller_mac, 0, ETH_ADDR_LEN);
+        in_band->controller_port = OFPP_FLOOD;
+    }
+    update_in_band_flows(in_band);
 }
 
 static void
@@ -310,12 +514,15 @@ static struct hook_class in_band_hook_class = {
     in_band_periodic_cb,        /* periodic_cb */
     in_band_wait_cb,            /* wait_cb */
     NULL,                       /* closing_cb */
+    HOOK_TYPE(OFPT_PACKET_IN),  /* local_types */
+    0,                          /* remote_types */
 };
 
 void
 in_band_start(struct secchan *secchan,
               const struct settings *s, struct switch_status *ss,
-              struct port_watcher *pw, struct rconn *remote)
+              struct port_watcher *pw, struct rconn *local,
+              struct rconn *remote)
 {
     struct in_band_data *in_band;
 
@@ -324,6 +531,8 @@ in_band_start(struct secchan *secchan,
     in_band->ml = mac_learning_create();
     in_band->of_device = NULL;
     in_band->controller = remote;
+    in_band->local = local;
+    in_band->controller_port = OFPP_FLOOD;
     switch_status_register_category(ss, "in-band", in_band_status_cb, in_band);
     port_watcher_register_local_port_callback(pw, in_band_local_port_cb,
                                               in_band);
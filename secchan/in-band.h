@@ -42,6 +42,6 @@ struct switch_status;
 
 void in_band_start(struct secchan *, const struct settings *,
                    struct switch_status *, struct port_watcher *,
-                   struct rconn *remote);
+                   struct rconn *local, struct rconn *remote);
 
 #endif /* in-band.h */
@@ -38,6 +38,9 @@
 #include <inttypes.h>
 #include <stdlib.h>
 #include "dynamic-string.h"
+#include "hash.h"
+#include "hmap.h"
+#include "list.h"
 #include "netdev.h"
 #include "ofpbuf.h"
 #include "openflow/openflow.h"
@@ -78,6 +81,22 @@ struct port_watcher {
     char local_port_name[OFP_MAX_PORT_NAME_LEN + 1];
     struct netdev_monitor *mon;
     struct shash port_by_name;
+
+    /* Network device changes waiting out 'flap_window' msecs, so that a port
+     * that flaps repeatedly within the window is checked, and reported if
+     * it changed, only once. */
+    int flap_window;
+    struct hmap pending;        /* "struct pending_port"s by port number. */
+    struct list pending_list;   /* Same "struct pending_port"s, in order of
+                                 * 'deadline'. */
+};
+
+/* A port whose network device changed, to be checked at 'deadline'. */
+struct pending_port {
+    struct hmap_node hmap_node; /* In 'pending'. */
+    struct list list_node;      /* In 'pending_list'. */
+    uint16_t port_no;
+    long long int deadline;     /* time_msec() at which to check. */
 };
 
 /* Returns the number of fields that differ from 'a' to 'b'. */
@@ -276,7 +295,7 @@ port_watcher_local_packet_cb(struct relay *r, void *pw_)
         if (ops->desc.port_no == htons(OFPP_LOCAL)) {
             call_local_port_changed_callbacks(pw);
         }
-        if (ops->reason == OFPPR_ADD || OFPPR_DELETE) {
+        if (ops->reason == OFPPR_ADD || ops->reason == OFPPR_DELETE) {
             update_netdev_monitor_devices(pw);
         }
     }
@@ -349,6 +368,92 @@ set_bit(uint32_t bit, bool value, uint32_t *word)
     }
 }
 
+/* Re-reads the flags of the network device for 'opp' and, if they changed
+ * its configuration or state, updates 'pw' and tells the controller. */
+static void
+refresh_port_from_netdev(struct port_watcher *pw, struct ofp_phy_port *opp)
+{
+    const char *name = (const char *) opp->name;
+    struct ofp_phy_port new_opp;
+    enum netdev_flags flags;
+    int retval;
+
+    retval = netdev_nodev_get_flags(name, &flags);
+    if (retval) {
+        static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(1, 5);
+        VLOG_WARN_RL(&rl, "could not get flags for %s", name);
+        return;
+    }
+
+    new_opp = *opp;
+    set_bit(htonl(OFPPC_PORT_DOWN), ~flags & NETDEV_UP, &new_opp.config);
+    set_bit(htonl(OFPPS_LINK_DOWN), ~flags & NETDEV_CARRIER, &new_opp.state);
+    if (opp->config != new_opp.config || opp->state != new_opp.state) {
+        struct ofp_port_status *ops;
+        struct ofpbuf *b;
+
+        /* Notify other secchan modules. */
+        update_phy_port(pw, &new_opp, OFPPR_MODIFY);
+        if (new_opp.port_no == htons(OFPP_LOCAL)) {
+            call_local_port_changed_callbacks(pw);
+        }
+
+        /* Notify the controller that the flags changed. */
+        ops = make_openflow(sizeof *ops, OFPT_PORT_STATUS, &b);
+        ops->reason = OFPPR_MODIFY;
+        ops->desc = new_opp;
+        rconn_send(pw->remote_rconn, b, NULL);
+    }
+}
+
+/* Arranges for the network device for 'port_no' to be checked once
+ * 'pw->flap_window' msecs from now, unless a check is already pending. */
+static void
+schedule_port_check(struct port_watcher *pw, uint16_t port_no)
+{
+    uint32_t hash = hash_bytes(&port_no, sizeof port_no, 0);
+    struct pending_port *pp;
+
+    HMAP_FOR_EACH_WITH_HASH (pp, struct pending_port, hmap_node, hash,
+                             &pw->pending) {
+        if (pp->port_no == port_no) {
+            return;
+        }
+    }
+
+    pp = xmalloc(sizeof *pp);
+    pp->port_no = port_no;
+    pp->deadline = time_msec() + pw->flap_window;
+    hmap_insert(&pw->pending, &pp->hmap_node, hash);
+    list_push_back(&pw->pending_list, &pp->list_node);
+}
+
+/* Checks each port whose pending check is due. */
+static void
+run_pending_port_checks(struct port_watcher *pw)
+{
+    long long int now = time_msec();
+
+    while (!list_is_empty(&pw->pending_list)) {
+        struct pending_port *pp = CONTAINER_OF(list_front(&pw->pending_list),
+                                               struct pending_port,
+                                               list_node);
+        struct ofp_phy_port *opp;
+
+        if (pp->deadline > now) {
+            break;
+        }
+        list_remove(&pp->list_node);
+        hmap_remove(&pw->pending, &pp->hmap_node);
+
+        opp = lookup_port(pw, pp->port_no);
+        if (opp) {
+            refresh_port_from_netdev(pw, opp);
+        }
+        free(pp);
+    }
+}
+
 static void
 port_watcher_periodic_cb(void *pw_)
 {
@@ -360,50 +465,23 @@ port_watcher_periodic_cb(void *pw_)
         && rconn_is_connected(pw->local_rconn)) {
         struct ofpbuf *b;
         make_openflow(sizeof(struct ofp_header), OFPT_FEATURES_REQUEST, &b);
-        rconn_send_with_limit(pw->local_rconn, b, &pw->n_txq, 1);
+        rconn_send_with_limit(pw->local_rconn, b, &pw->n_txq, 1,
+                              RCONN_TXQ_CONTROL);
         pw->last_feature_request = time_now();
     }
 
     netdev_monitor_run(pw->mon);
     while ((name = netdev_monitor_poll(pw->mon)) != NULL) {
-        struct ofp_phy_port *opp;
-        struct ofp_phy_port new_opp;
-        enum netdev_flags flags;
-        int retval;
-
-        opp = shash_find_data(&pw->port_by_name, name);
+        struct ofp_phy_port *opp = shash_find_data(&pw->port_by_name, name);
         if (!opp) {
             continue;
-        }
-
-        retval = netdev_nodev_get_flags(name, &flags);
-        if (retval) {
-            static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(1, 5);
-            VLOG_WARN_RL(&rl, "could not get flags for %s", name);
-            continue;
-        }
-
-        new_opp = *opp;
-        set_bit(htonl(OFPPC_PORT_DOWN), ~flags & NETDEV_UP, &new_opp.config);
-        set_bit(htonl(OFPPS_LINK_DOWN), ~flags & NETDEV_CARRIER,
-                &new_opp.state);
-        if (opp->config != new_opp.config || opp->state != new_opp.state) {
-            struct ofp_port_status *ops;
-            struct ofpbuf *b;
-
-            /* Notify other secchan modules. */
-            update_phy_port(pw, &new_opp, OFPPR_MODIFY);
-            if (new_opp.port_no == htons(OFPP_LOCAL)) {
-                call_local_port_changed_callbacks(pw);
-            }
-
-            /* Notify the controller that the flags changed. */
-            ops = make_openflow(sizeof *ops, OFPT_PORT_STATUS, &b);
-            ops->reason = OFPPR_MODIFY;
-            ops->desc = new_opp;
-            rconn_send(pw->remote_rconn, b, NULL);
+        } else if (pw->flap_window > 0) {
+            schedule_port_check(pw, ntohs(opp->port_no));
+        } else {
+            refresh_port_from_netdev(pw, opp);
         }
     }
+    run_pending_port_checks(pw);
 }
 
 static void
@@ -418,6 +496,12 @@ port_watcher_wait_cb(void *pw_)
         }
     }
     netdev_monitor_wait(pw->mon);
+    if (!list_is_empty(&pw->pending_list)) {
+        struct pending_port *pp = CONTAINER_OF(list_front(&pw->pending_list),
+                                               struct pending_port,
+                                               list_node);
+        poll_timer_wait(pp->deadline - time_msec());
+    }
 }
 
 static void
@@ -594,12 +678,19 @@ static struct hook_class port_watcher_hook_class = {
     port_watcher_periodic_cb,                            /* periodic_cb */
     port_watcher_wait_cb,                                /* wait_cb */
     NULL,                                                /* closing_cb */
+    (HOOK_TYPE(OFPT_FEATURES_REPLY)
+     | HOOK_TYPE(OFPT_PORT_STATUS)),                     /* local_types */
+    HOOK_TYPE(OFPT_PORT_MOD),                            /* remote_types */
 };
 
+/* Starts watching ports.  If 'flap_window' is positive, a port's network
+ * device is checked only once 'flap_window' msecs after it first changes, so
+ * that a burst of link flaps produces at most one port status message per
+ * port instead of one per flap. */
 void
 port_watcher_start(struct secchan *secchan,
                    struct rconn *local_rconn, struct rconn *remote_rconn,
-                   struct port_watcher **pwp)
+                   int flap_window, struct port_watcher **pwp)
 {
     struct port_watcher *pw;
     int retval;
@@ -615,6 +706,9 @@ port_watcher_start(struct secchan *secchan,
         ofp_fatal(retval, "failed to start network device monitoring");
     }
     shash_init(&pw->port_by_name);
+    pw->flap_window = flap_window;
+    hmap_init(&pw->pending);
+    list_init(&pw->pending_list);
     port_watcher_register_callback(pw, log_port_status, NULL);
     add_hook(secchan, &port_watcher_hook_class, pw);
 }
@@ -44,7 +44,7 @@ struct secchan;
 
 void port_watcher_start(struct secchan *,
                         struct rconn *local, struct rconn *remote,
-                        struct port_watcher **);
+                        int flap_window, struct port_watcher **);
 bool port_watcher_is_ready(const struct port_watcher *);
 uint32_t port_watcher_get_config(const struct port_watcher *,
                                  uint16_t port_no);
@@ -36,6 +36,7 @@
 #include <string.h>
 #include <netinet/in.h>
 #include <errno.h>
+#include <inttypes.h>
 
 #include "openflow/openflow.h"
 #include "openflow/private-ext.h"
@@ -125,7 +126,37 @@ struct protocol_stat_context {
 	struct ofpstat ofps_sent;
 };
 
+/* Message counters reported in the "protocol" status category. */
+static const struct {
+	const char *name;
+	size_t offset;
+} protocol_stat_fields[] = {
+#define PROTOCOL_STAT_FIELD(NAME, MEMBER) \
+	{ NAME, offsetof(struct ofpstat, MEMBER) }
+	PROTOCOL_STAT_FIELD("total", ofps_total),
+	PROTOCOL_STAT_FIELD("unknown", ofps_unknown),
+	PROTOCOL_STAT_FIELD("hello", ofps_hello),
+	PROTOCOL_STAT_FIELD("error", ofps_error),
+	PROTOCOL_STAT_FIELD("echo-request", ofps_echo_request),
+	PROTOCOL_STAT_FIELD("echo-reply", ofps_echo_reply),
+	PROTOCOL_STAT_FIELD("vendor", ofps_vendor),
+	PROTOCOL_STAT_FIELD("features-request", ofps_feats_request),
+	PROTOCOL_STAT_FIELD("features-reply", ofps_feats_reply),
+	PROTOCOL_STAT_FIELD("packet-in", ofps_packet_in),
+	PROTOCOL_STAT_FIELD("flow-removed", ofps_flow_removed),
+	PROTOCOL_STAT_FIELD("port-status", ofps_port_status),
+	PROTOCOL_STAT_FIELD("packet-out", ofps_packet_out),
+	PROTOCOL_STAT_FIELD("flow-mod", ofps_flow_mod),
+	PROTOCOL_STAT_FIELD("port-mod", ofps_port_mod),
+	PROTOCOL_STAT_FIELD("stats-request", ofps_stats_request),
+	PROTOCOL_STAT_FIELD("stats-reply", ofps_stats_reply),
+	PROTOCOL_STAT_FIELD("barrier-request", ofps_barrier_request),
+	PROTOCOL_STAT_FIELD("barrier-reply", ofps_barrier_reply),
+#undef PROTOCOL_STAT_FIELD
+};
+
 static bool protocol_stat_remote_packet_cb(struct relay *, void *);
+static void protocol_stat_status_cb(struct status_reply *, void *);
 
 static bool
 protocol_stat_remote_packet_cb(struct relay *relay, void *context_)
@@ -152,6 +183,10 @@ protocol_stat_remote_packet_cb(struct relay *relay, void *context_)
 		return false;
 	}
 	qvxopt = (struct private_vxopt *)(qvxhdr + 1);
+	if (ntohs(qvxopt->pvo_type) == PRIVATEOPT_PROCESSING_STATS_REQUEST) {
+		/* The datapath answers this one. */
+		return false;
+	}
 	if (ntohs(qvxopt->pvo_type) != PRIVATEOPT_PROTOCOL_STATS_REQUEST) {
 		return true;
 	}
@@ -179,9 +214,32 @@ protocol_stat_remote_packet_cb(struct relay *relay, void *context_)
 	return true;
 }
 
+static void
+protocol_stat_status_cb(struct status_reply *sr, void *context_)
+{
+	struct protocol_stat_context *context = context_;
+	struct ofpstat ofps_rcvd;
+	struct ofpstat ofps_sent;
+	size_t i;
+
+	rconn_update_protocol_stat(context->remote_rconn,
+				   &ofps_rcvd, &ofps_sent);
+	for (i = 0; i < ARRAY_SIZE(protocol_stat_fields); i++) {
+		size_t ofs = protocol_stat_fields[i].offset;
+
+		status_reply_put(sr, "rcvd.%s=%"PRIu64,
+				 protocol_stat_fields[i].name,
+				 *(uint64_t *)((char *)&ofps_rcvd + ofs));
+		status_reply_put(sr, "sent.%s=%"PRIu64,
+				 protocol_stat_fields[i].name,
+				 *(uint64_t *)((char *)&ofps_sent + ofs));
+	}
+}
+
 void
 protocol_stat_start(struct secchan *secchan, const struct settings *settings,
-		    struct rconn *local_rconn, struct rconn *remote_rconn)
+		    struct switch_status *ss, struct rconn *local_rconn,
+		    struct rconn *remote_rconn)
 {
 	struct protocol_stat_context *context = NULL;
 	static struct hook_class protocol_stat_hook_class = {
@@ -190,6 +248,8 @@ protocol_stat_start(struct secchan *secchan, const struct settings *settings,
 		NULL,		/* periodic_cb */
 		NULL,		/* wait_cb */
 		NULL,		/* closing_cb */
+		0,	/* local_types */
+		HOOK_TYPE(OFPT_VENDOR),	/* remote_types */
 	};
 
 	context = xmalloc(sizeof(*context));
@@ -200,5 +260,9 @@ protocol_stat_start(struct secchan *secchan, const struct settings *settings,
 	memset(&context->ofps_rcvd, 0, sizeof(context->ofps_rcvd));
 	memset(&context->ofps_sent, 0, sizeof(context->ofps_sent));
 
-	add_hook(secchan, &protocol_stat_hook_class, context);
+	switch_status_register_category(ss, "protocol",
+					protocol_stat_status_cb, context);
+	if (settings->n_listeners > 0) {
+		add_hook(secchan, &protocol_stat_hook_class, context);
+	}
 }
@@ -39,6 +39,6 @@ struct settings;
 struct switch_status;
 
 void protocol_stat_start(struct secchan *, const struct settings *,
-			 struct rconn *, struct rconn *);
+			 struct switch_status *, struct rconn *, struct rconn *);
 
 #endif
@@ -35,6 +35,9 @@
 #include "ratelimit.h"
 #include <arpa/inet.h>
 #include <stdlib.h>
+#include "hash.h"
+#include "hmap.h"
+#include "list.h"
 #include "ofpbuf.h"
 #include "openflow/openflow.h"
 #include "poll-loop.h"
@@ -45,14 +48,29 @@
 #include "timeval.h"
 #include "vconn.h"
 
-struct rate_limiter {
-    const struct settings *s;
-    struct rconn *remote_rconn;
+/* Packets queued from a single input port. */
+struct rl_queue {
+    struct hmap_node hmap_node; /* In rl_class's 'queues', by port. */
+    uint16_t port;
+    struct ofp_queue packets;
+    struct list active_node;    /* In rl_class's 'active', if nonempty. */
+    struct list len_node;       /* In rl_class's 'by_len[packets.n]'. */
+};
+
+/* Rate limiting for one kind of packet_in.  Table misses and packets sent
+ * up by the controller's own flows are limited separately, so that neither
+ * can flood the controller or starve the other. */
+struct rl_class {
+    const char *prefix;         /* For status reporting. */
 
-    /* One queue per physical port. */
-    struct ofp_queue queues[OFPP_MAX];
-    int n_queued;               /* Sum over queues[*].n. */
-    int next_tx_port;           /* Next port to check in round-robin. */
+    /* Per-port queues, created when a port first has a packet queued.
+     * Nonempty queues take turns on 'active', and each queue is also on the
+     * list in 'by_len' for its length, so that the longest is at hand. */
+    struct hmap queues;
+    struct list active;
+    struct list *by_len;        /* Indexed 0...burst_limit. */
+    int max_len;                /* Longest nonempty list in 'by_len'. */
+    int n_queued;               /* Sum over queues' packets.n. */
 
     /* Token bucket.
      *
@@ -63,9 +81,6 @@ struct rate_limiter {
     long long int last_fill;    /* Time at which we last added tokens. */
     int tokens;                 /* Current number of tokens. */
 
-    /* Transmission queue. */
-    int n_txq;                  /* No. of packets waiting in rconn for tx. */
-
     /* Statistics reporting. */
     unsigned long long n_normal;        /* # txed w/o rate limit queuing. */
     unsigned long long n_limited;       /* # queued for rate limiting. */
@@ -73,75 +88,153 @@ struct rate_limiter {
     unsigned long long n_tx_dropped;    /* # dropped due to tx overflow. */
 };
 
-/* Drop a packet from the longest queue in 'rl'. */
+enum {
+    RL_MISS,                    /* OFPR_NO_MATCH packet_ins. */
+    RL_ACTION,                  /* OFPR_ACTION packet_ins. */
+    RL_N_CLASSES
+};
+
+struct rate_limiter {
+    const struct settings *s;
+    struct rconn *remote_rconn;
+    struct rl_class classes[RL_N_CLASSES];
+    int next_class;             /* Class to drain first next time. */
+
+    /* Transmission queue. */
+    int n_txq;                  /* No. of packets waiting in rconn for tx. */
+};
+
 static void
-drop_packet(struct rate_limiter *rl)
+class_init(struct rl_class *c, const char *prefix, const struct settings *s)
 {
-    struct ofp_queue *longest;  /* Queue currently selected as longest. */
-    int n_longest;              /* # of queues of same length as 'longest'. */
-    struct ofp_queue *q;
-
-    longest = &rl->queues[0];
-    n_longest = 1;
-    for (q = &rl->queues[0]; q < &rl->queues[OFPP_MAX]; q++) {
-        if (longest->n < q->n) {
-            longest = q;
-            n_longest = 1;
-        } else if (longest->n == q->n) {
-            n_longest++;
-
-            /* Randomly select one of the longest queues, with a uniform
-             * distribution (Knuth algorithm 3.4.2R). */
-            if (!random_range(n_longest)) {
-                longest = q;
-            }
+    int i;
+
+    c->prefix = prefix;
+    hmap_init(&c->queues);
+    list_init(&c->active);
+    c->by_len = xmalloc((s->burst_limit + 1) * sizeof *c->by_len);
+    for (i = 0; i <= s->burst_limit; i++) {
+        list_init(&c->by_len[i]);
+    }
+    c->max_len = 0;
+    c->last_fill = time_msec();
+    c->tokens = s->rate_limit * 100;
+}
+
+/* Returns the queue in 'c' for packets from 'port', creating it if
+ * necessary. */
+static struct rl_queue *
+class_get_queue(struct rl_class *c, uint16_t port)
+{
+    uint32_t port32 = port;
+    uint32_t hash = hash_words(&port32, 1, 0);
+    struct rl_queue *q;
+
+    HMAP_FOR_EACH_WITH_HASH (q, struct rl_queue, hmap_node, hash,
+                             &c->queues) {
+        if (q->port == port) {
+            return q;
         }
     }
 
+    q = xmalloc(sizeof *q);
+    hmap_insert(&c->queues, &q->hmap_node, hash);
+    q->port = port;
+    queue_init(&q->packets);
+    list_push_back(&c->by_len[0], &q->len_node);
+    return q;
+}
+
+/* Moves 'q', whose length just changed, to the right list in 'c->by_len'
+ * and keeps 'c->max_len' up to date.  Lengths change by one at a time, so
+ * 'max_len' moves at most one step. */
+static void
+class_update_len(struct rl_class *c, struct rl_queue *q)
+{
+    list_remove(&q->len_node);
+    list_push_back(&c->by_len[q->packets.n], &q->len_node);
+    if (q->packets.n > c->max_len) {
+        c->max_len = q->packets.n;
+    } else if (c->max_len && list_is_empty(&c->by_len[c->max_len])) {
+        c->max_len--;
+    }
+}
+
+static void
+class_push(struct rl_class *c, struct rl_queue *q, struct ofpbuf *msg)
+{
+    if (!q->packets.n) {
+        list_push_back(&c->active, &q->active_node);
+    }
+    queue_push_tail(&q->packets, msg);
+    class_update_len(c, q);
+    c->n_queued++;
+}
+
+static struct ofpbuf *
+class_pop(struct rl_class *c, struct rl_queue *q)
+{
+    struct ofpbuf *msg = queue_pop_head(&q->packets);
+
+    if (!q->packets.n) {
+        list_remove(&q->active_node);
+    }
+    class_update_len(c, q);
+    c->n_queued--;
+    return msg;
+}
+
+/* Drop a packet from the longest queue in 'c'. */
+static void
+drop_packet(struct rl_class *c)
+{
+    struct rl_queue *longest;
+
+    longest = CONTAINER_OF(list_front(&c->by_len[c->max_len]),
+                           struct rl_queue, len_node);
+
     /* FIXME: do we want to pop the tail instead? */
-    ofpbuf_delete(queue_pop_head(longest));
-    rl->n_queued--;
+    ofpbuf_delete(class_pop(c, longest));
+    c->n_queue_dropped++;
 }
 
-/* Remove and return the next packet to transmit (in round-robin order). */
+/* Remove and return the next packet to transmit from 'c', taking the
+ * nonempty queues in round-robin order. */
 static struct ofpbuf *
-dequeue_packet(struct rate_limiter *rl)
+dequeue_packet(struct rl_class *c)
 {
-    unsigned int i;
-
-    for (i = 0; i < OFPP_MAX; i++) {
-        unsigned int port = (rl->next_tx_port + i) % OFPP_MAX;
-        struct ofp_queue *q = &rl->queues[port];
-        if (q->n) {
-            rl->next_tx_port = (port + 1) % OFPP_MAX;
-            rl->n_queued--;
-            return queue_pop_head(q);
-        }
+    struct rl_queue *q = CONTAINER_OF(list_front(&c->active),
+                                      struct rl_queue, active_node);
+    struct ofpbuf *msg = class_pop(c, q);
+
+    if (q->packets.n) {
+        /* Send it to the back of the line. */
+        list_remove(&q->active_node);
+        list_push_back(&c->active, &q->active_node);
     }
-    NOT_REACHED();
+    return msg;
 }
 
 /* Add tokens to the bucket based on elapsed time. */
 static void
-refill_bucket(struct rate_limiter *rl)
+refill_bucket(struct rl_class *c, const struct settings *s)
 {
-    const struct settings *s = rl->s;
     long long int now = time_msec();
-    long long int tokens = (now - rl->last_fill) * s->rate_limit + rl->tokens;
+    long long int tokens = (now - c->last_fill) * s->rate_limit + c->tokens;
     if (tokens >= 1000) {
-        rl->last_fill = now;
-        rl->tokens = MIN(tokens, s->burst_limit * 1000);
+        c->last_fill = now;
+        c->tokens = MIN(tokens, s->burst_limit * 1000);
     }
 }
 
-/* Attempts to remove enough tokens from 'rl' to transmit a packet.  Returns
+/* Attempts to remove enough tokens from 'c' to transmit a packet.  Returns
  * true if successful, false otherwise.  (In the latter case no tokens are
  * removed.) */
 static bool
-get_token(struct rate_limiter *rl)
+get_token(struct rl_class *c)
 {
-    if (rl->tokens >= 1000) {
-        rl->tokens -= 1000;
+    if (c->tokens >= 1000) {
+        c->tokens -= 1000;
         return true;
     } else {
         return false;
@@ -154,34 +247,30 @@ rate_limit_local_packet_cb(struct relay *r, void *rl_)
     struct rate_limiter *rl = rl_;
     const struct settings *s = rl->s;
     struct ofp_packet_in *opi;
+    struct rl_class *c;
 
     opi = get_ofp_packet_in(r);
     if (!opi) {
         return false;
     }
 
-    if (opi->reason == OFPR_ACTION) {
-        /* Don't rate-limit 'ofp-packet_in's generated by flows that the
-         * controller set up.  XXX we should really just rate-limit them
-         * *separately* so that no one can flood the controller this way. */
-        return false;
-    }
-
-    if (!rl->n_queued && get_token(rl)) {
+    /* Packets sent up by the controller's own flows get a bucket of their
+     * own, so that no one can flood the controller this way without also
+     * starving table misses. */
+    c = &rl->classes[opi->reason == OFPR_ACTION ? RL_ACTION : RL_MISS];
+    if (!c->n_queued && get_token(c)) {
         /* In the common case where we are not constrained by the rate limit,
          * let the packet take the normal path. */
-        rl->n_normal++;
+        c->n_normal++;
         return false;
     } else {
         /* Otherwise queue it up for the periodic callback to drain out. */
-        struct ofpbuf *msg = r->halves[HALF_LOCAL].rxbuf;
-        int port = ntohs(opi->in_port) % OFPP_MAX;
-        if (rl->n_queued >= s->burst_limit) {
-            drop_packet(rl);
+        struct rl_queue *q = class_get_queue(c, ntohs(opi->in_port));
+        if (c->n_queued >= s->burst_limit) {
+            drop_packet(c);
         }
-        queue_push_tail(&rl->queues[port], ofpbuf_clone(msg));
-        rl->n_queued++;
-        rl->n_limited++;
+        class_push(c, q, relay_take_rxbuf(r, HALF_LOCAL));
+        c->n_limited++;
         return true;
     }
 }
@@ -190,46 +279,68 @@ static void
 rate_limit_status_cb(struct status_reply *sr, void *rl_)
 {
     struct rate_limiter *rl = rl_;
+    int i;
 
-    status_reply_put(sr, "normal=%llu", rl->n_normal);
-    status_reply_put(sr, "limited=%llu", rl->n_limited);
-    status_reply_put(sr, "queue-dropped=%llu", rl->n_queue_dropped);
-    status_reply_put(sr, "tx-dropped=%llu", rl->n_tx_dropped);
+    for (i = 0; i < RL_N_CLASSES; i++) {
+        const struct rl_class *c = &rl->classes[i];
+
+        status_reply_put(sr, "%snormal=%llu", c->prefix, c->n_normal);
+        status_reply_put(sr, "%slimited=%llu", c->prefix, c->n_limited);
+        status_reply_put(sr, "%squeue-dropped=%llu",
+                         c->prefix, c->n_queue_dropped);
+        status_reply_put(sr, "%stx-dropped=%llu", c->prefix, c->n_tx_dropped);
+    }
 }
 
 static void
 rate_limit_periodic_cb(void *rl_)
 {
     struct rate_limiter *rl = rl_;
-    int i;
+    int i, j;
+
+    /* Drain some packets out of the buckets if possible, but limit the number
+     * of iterations to allow other code to get work done too.  The classes
+     * take turns going first. */
+    for (j = 0; j < RL_N_CLASSES; j++) {
+        struct rl_class *c = &rl->classes[(rl->next_class + j)
+                                          % RL_N_CLASSES];
 
-    /* Drain some packets out of the bucket if possible, but limit the number
-     * of iterations to allow other code to get work done too. */
-    refill_bucket(rl);
-    for (i = 0; rl->n_queued && get_token(rl) && i < 50; i++) {
-        /* Use a small, arbitrary limit for the amount of queuing to do here,
-         * because the TCP connection is responsible for buffering and there is
-         * no point in trying to transmit faster than the TCP connection can
-         * handle. */
-        struct ofpbuf *b = dequeue_packet(rl);
-        if (rconn_send_with_limit(rl->remote_rconn, b, &rl->n_txq, 10)) {
-            rl->n_tx_dropped++;
+        refill_bucket(c, rl->s);
+        for (i = 0; c->n_queued && get_token(c) && i < 50; i++) {
+            /* Use a small, arbitrary limit for the amount of queuing to do
+             * here, because the TCP connection is responsible for buffering
+             * and there is no point in trying to transmit faster than the TCP
+             * connection can handle. */
+            struct ofpbuf *b = dequeue_packet(c);
+            if (rconn_send_with_limit(rl->remote_rconn, b, &rl->n_txq, 10,
+                                      RCONN_TXQ_ASYNC)) {
+                c->n_tx_dropped++;
+            }
         }
     }
+    rl->next_class = (rl->next_class + 1) % RL_N_CLASSES;
 }
 
 static void
 rate_limit_wait_cb(void *rl_)
 {
     struct rate_limiter *rl = rl_;
-    if (rl->n_queued) {
-        if (rl->tokens >= 1000) {
-            /* We can transmit more packets as soon as we're called again. */
-            poll_immediate_wake();
-        } else {
-            /* We have to wait for the bucket to re-fill.  We could calculate
-             * the exact amount of time here for increased smoothness. */
-            poll_timer_wait(TIME_UPDATE_INTERVAL / 2);
+    int i;
+
+    for (i = 0; i < RL_N_CLASSES; i++) {
+        const struct rl_class *c = &rl->classes[i];
+
+        if (c->n_queued) {
+            if (c->tokens >= 1000) {
+                /* We can transmit more packets as soon as we're called
+                 * again. */
+                poll_immediate_wake();
+            } else {
+                /* We have to wait for the bucket to re-fill.  We could
+                 * calculate the exact amount of time here for increased
+                 * smoothness. */
+                poll_timer_wait(TIME_UPDATE_INTERVAL / 2);
+            }
         }
     }
 }
@@ -240,6 +351,8 @@ static struct hook_class rate_limit_hook_class = {
     rate_limit_periodic_cb,     /* periodic_cb */
     rate_limit_wait_cb,         /* wait_cb */
     NULL,                       /* closing_cb */
+    HOOK_TYPE(OFPT_PACKET_IN),  /* local_types */
+    0,                          /* remote_types */
 };
 
 void
@@ -247,16 +360,12 @@ rate_limit_start(struct secchan *secchan, const struct settings *s,
                  struct switch_status *ss, struct rconn *remote)
 {
     struct rate_limiter *rl;
-    size_t i;
 
     rl = xcalloc(1, sizeof *rl);
     rl->s = s;
     rl->remote_rconn = remote;
-    for (i = 0; i < ARRAY_SIZE(rl->queues); i++) {
-        queue_init(&rl->queues[i]);
-    }
-    rl->last_fill = time_msec();
-    rl->tokens = s->rate_limit * 100;
+    class_init(&rl->classes[RL_MISS], "", s);
+    class_init(&rl->classes[RL_ACTION], "action-", s);
     switch_status_register_category(ss, "rate-limit",
                                     rate_limit_status_cb, rl);
     add_hook(secchan, &rate_limit_hook_class, rl);
@@ -46,6 +46,7 @@
 #include "daemon.h"
 #include "dirs.h"
 #include "discovery.h"
+#include "dpif.h"
 #include "emerg-flow.h"
 #include "fail-open.h"
 #include "failover.h"
@@ -53,7 +54,9 @@
 #include "in-band.h"
 #include "leak-checker.h"
 #include "list.h"
+#include "metrics.h"
 #include "ofpbuf.h"
+#include "openflow/openflow-netlink.h"
 #include "openflow/openflow.h"
 #include "packets.h"
 #include "protocol-stat.h"
@@ -61,9 +64,11 @@
 #include "poll-loop.h"
 #include "ratelimit.h"
 #include "rconn.h"
+#include "stats-file.h"
 #include "stp-secchan.h"
 #include "status.h"
 #include "timeval.h"
+#include "upcall.h"
 #include "util.h"
 #include "vconn-ssl.h"
 #include "vconn.h"
@@ -80,6 +85,10 @@ struct hook {
 struct secchan {
     struct hook *hooks;
     size_t n_hooks, allocated_hooks;
+
+    /* Message types that some hook examines, as HOOK_TYPE() bitmaps. */
+    uint32_t local_types;
+    uint32_t remote_types;
 };
 
 static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(60, 60);
@@ -93,83 +102,127 @@ static struct vconn *accept_vconn(struct pvconn *pvconn);
 
 static struct relay *relay_create(struct rconn *async,
                                   struct rconn *local, struct rconn *remote,
-                                  bool is_mgmt_conn);
+                                  bool is_mgmt_conn, int max_txq);
 static struct relay *relay_accept(const struct settings *, struct pvconn *);
 static void relay_run(struct relay *, struct secchan *);
 static void relay_wait(struct relay *);
 static void relay_destroy(struct relay *);
 
+/* State of the secure channel, shared by secchan_start(), secchan_run(), and
+ * secchan_wait(). */
+static struct settings settings;
+static struct list relays = LIST_INITIALIZER(&relays);
+static struct secchan secchan;
+static struct pvconn *monitor;
+static struct pvconn *listeners[MAX_MGMT];
+static size_t n_listeners;
+static struct rconn *async_rconn, *local_rconn, *remote_rconn;
+static struct discovery *discovery;
+
+#if !defined(SECCHAN_AS_LIB)
 int
 main(int argc, char *argv[])
 {
-    struct settings s;
-
-    struct list relays = LIST_INITIALIZER(&relays);
-
-    struct secchan secchan;
-
-    struct pvconn *monitor;
+    set_program_name(argv[0]);
+    register_fault_handlers();
+    time_init();
+    vlog_init();
+    secchan_start(argc, argv, true);
+    while (secchan_run()) {
+        secchan_wait();
+        poll_block();
+    }
 
-    struct pvconn *listeners[MAX_MGMT];
-    size_t n_listeners;
+    return 0;
+}
+#endif
 
+/* Parses the secure channel command line in 'argc' and 'argv' and starts
+ * connecting to the datapath and the controller.  The strings in 'argv' must
+ * remain valid as long as the secure channel runs.
+ *
+ * If 'standalone' is true, the secure channel is the whole program: it
+ * daemonizes, if requested, and listens for vlog and metrics connections.
+ * Otherwise, it runs inside another program's poll loop, ofdatapath's with
+ * --secchan, which takes care of those itself. */
+void
+secchan_start(int argc, char *argv[], bool standalone)
+{
+    struct settings *s = &settings;
+    struct switch_status *switch_status;
     char *local_rconn_name;
-    struct rconn *async_rconn, *local_rconn, *remote_rconn;
     struct relay *controller_relay;
-    struct discovery *discovery;
-    struct switch_status *switch_status;
+    struct upcall_handler *upcalls = NULL;
     struct port_watcher *pw;
     int i;
     int retval;
 
-    set_program_name(argv[0]);
-    register_fault_handlers();
-    time_init();
-    vlog_init();
-    parse_options(argc, argv, &s);
+    parse_options(argc, argv, s);
     signal(SIGPIPE, SIG_IGN);
 
     secchan.hooks = NULL;
     secchan.n_hooks = 0;
     secchan.allocated_hooks = 0;
+    secchan.local_types = 0;
+    secchan.remote_types = 0;
 
     /* Start listening for management and monitoring connections. */
     n_listeners = 0;
-    for (i = 0; i < s.n_listeners; i++) {
-        listeners[n_listeners++] = open_passive_vconn(s.listener_names[i]);
+    for (i = 0; i < s->n_listeners; i++) {
+        listeners[n_listeners++] = open_passive_vconn(s->listener_names[i]);
     }
-    monitor = s.monitor_name ? open_passive_vconn(s.monitor_name) : NULL;
+    monitor = s->monitor_name ? open_passive_vconn(s->monitor_name) : NULL;
 
-    /* Initialize switch status hook. */
-    switch_status_start(&secchan, &s, &switch_status);
+    /* Initialize switch status hook, which also exports metrics. */
+    if (standalone) {
+        metrics_init("ofprotocol");
+    }
+    switch_status_start(&secchan, s, &switch_status);
 
-    die_if_already_running();
-    daemonize();
+    if (standalone) {
+        die_if_already_running();
+        daemonize();
+        stats_file_init();
 
-    /* Start listening for vlogconf requests. */
-    retval = vlog_server_listen(NULL, NULL);
-    if (retval) {
-        ofp_fatal(retval, "Could not listen for vlog connections");
-    }
+        /* Start listening for vlogconf requests. */
+        retval = vlog_server_listen(NULL, NULL);
+        if (retval) {
+            ofp_fatal(retval, "Could not listen for vlog connections");
+        }
 
-    VLOG_INFO("OpenFlow reference implementation version %s", VERSION BUILDNR);
-    VLOG_INFO("OpenFlow protocol version 0x%02x", OFP_VERSION);
+        VLOG_INFO("OpenFlow reference implementation version %s",
+                  VERSION BUILDNR);
+        VLOG_INFO("OpenFlow protocol version 0x%02x", OFP_VERSION);
+    }
 
     /* Check datapath name, to try to catch command-line invocation errors. */
-    if (strncmp(s.dp_name, "nl:", 3) && strncmp(s.dp_name, "unix:", 5)
-        && !s.controller_names[0]) {
-        VLOG_WARN("Controller not specified and datapath is not nl: or "
-                  "unix:.  (Did you forget to specify the datapath?)");
+    if (strncmp(s->dp_name, "nl:", 3) && strncmp(s->dp_name, "unix:", 5)
+        && strncmp(s->dp_name, "shm:", 4) && strncmp(s->dp_name, "inproc:", 7)
+        && !s->controller_names[0]) {
+        VLOG_WARN("Controller not specified and datapath is not nl:, unix: "
+                  "or shm:.  (Did you forget to specify the datapath?)");
     }
 
-    if (!strncmp(s.dp_name, "nl:", 3)) {
+    if (!strncmp(s->dp_name, "nl:", 3)) {
+#ifdef HAVE_NETLINK
+        if (s->netlink_rcvbuf) {
+            dpif_set_rcvbuf(s->netlink_rcvbuf);
+        }
+        switch_status_register_category(switch_status, "netlink",
+                                        dpif_status_cb, NULL);
+        if (s->upcall_threads) {
+            upcalls = upcall_start(s->dp_name, s->upcall_threads,
+                                   switch_status);
+        }
+#endif
+
         /* Connect to datapath with a subscription for asynchronous events.  By
          * separating the connection for asynchronous events from that for
          * request and replies we prevent the socket receive buffer from being
          * filled up by received packet data, which in turn would prevent
          * getting replies to any Netlink messages we send to the kernel. */
-        async_rconn = rconn_create(0, s.max_backoff);
-        rconn_connect(async_rconn, s.dp_name);
+        async_rconn = rconn_create(0, s->max_backoff);
+        rconn_connect(async_rconn, s->dp_name);
         switch_status_register_category(switch_status, "async",
                                         rconn_status_cb, async_rconn);
     } else {
@@ -183,19 +236,19 @@ main(int argc, char *argv[])
     }
 
     /* Connect to datapath without a subscription, for requests and replies. */
-    local_rconn_name = vconn_name_without_subscription(s.dp_name);
-    local_rconn = rconn_create(0, s.max_backoff);
+    local_rconn_name = vconn_name_without_subscription(s->dp_name);
+    local_rconn = rconn_create(0, s->max_backoff);
     rconn_connect(local_rconn, local_rconn_name);
     free(local_rconn_name);
     switch_status_register_category(switch_status, "local",
                                     rconn_status_cb, local_rconn);
 
     /* Connect to controller. */
-    remote_rconn = rconn_create(s.probe_interval, s.max_backoff);
-    if (s.controller_names[0]) {
-        retval = rconn_connect(remote_rconn, s.controller_names[0]);
+    remote_rconn = rconn_create(s->probe_interval, s->max_backoff);
+    if (s->controller_names[0]) {
+        retval = rconn_connect(remote_rconn, s->controller_names[0]);
         if (retval == EAFNOSUPPORT) {
-            ofp_fatal(0, "No support for %s vconn", s.controller_names[0]);
+            ofp_fatal(0, "No support for %s vconn", s->controller_names[0]);
         }
     }
     switch_status_register_category(switch_status, "remote",
@@ -203,101 +256,118 @@ main(int argc, char *argv[])
 
     /* Start relaying. */
     controller_relay = relay_create(async_rconn, local_rconn, remote_rconn,
-                                    false);
+                                    false, s->relay_depth);
+    controller_relay->upcalls = upcalls;
     list_push_back(&relays, &controller_relay->node);
 
     /* Set up hooks. */
-    port_watcher_start(&secchan, local_rconn, remote_rconn, &pw);
-    discovery = s.discovery ? discovery_init(&s, pw, switch_status) : NULL;
-    if (s.enable_stp) {
+    port_watcher_start(&secchan, local_rconn, remote_rconn,
+                       s->port_flap_window, &pw);
+    discovery = s->discovery ? discovery_init(s, pw, switch_status) : NULL;
+    if (s->enable_stp) {
         stp_start(&secchan, pw, local_rconn, remote_rconn);
     }
-    if (s.in_band) {
-        in_band_start(&secchan, &s, switch_status, pw, remote_rconn);
+    if (s->in_band) {
+        in_band_start(&secchan, s, switch_status, pw, local_rconn,
+                      remote_rconn);
     }
-    if (s.fail_mode == FAIL_OPEN) {
-        fail_open_start(&secchan, &s, switch_status,
+    if (s->fail_mode == FAIL_OPEN) {
+        fail_open_start(&secchan, s, switch_status,
                         local_rconn, remote_rconn);
     }
-    if (s.num_controllers > 1) {
-        failover_start(&secchan, &s, switch_status, remote_rconn);
+    if (s->num_controllers > 1) {
+        failover_start(&secchan, s, switch_status, local_rconn,
+                       remote_rconn);
     }
-    if (s.n_listeners > 0) {
-        protocol_stat_start(&secchan, &s, local_rconn, remote_rconn);
-    }
-    if (s.rate_limit) {
-        rate_limit_start(&secchan, &s, switch_status, remote_rconn);
+    protocol_stat_start(&secchan, s, switch_status, local_rconn, remote_rconn);
+    if (s->rate_limit) {
+        rate_limit_start(&secchan, s, switch_status, remote_rconn);
     }
-    if (s.emerg_flow) {
-        emerg_flow_start(&secchan, &s, switch_status, local_rconn, remote_rconn);
+    if (s->emerg_flow) {
+        emerg_flow_start(&secchan, s, switch_status, local_rconn, remote_rconn);
     }
+}
 
-    while (s.discovery || rconn_is_alive(remote_rconn)) {
-        struct relay *r, *n;
-        size_t i;
+/* Does one round of the secure channel's work.  Returns false once it is
+ * done, that is, when it does not perform discovery and its connection to
+ * the controller has failed for good. */
+bool
+secchan_run(void)
+{
+    struct settings *s = &settings;
+    struct relay *r, *n;
+    size_t i;
 
-        /* Do work. */
-        LIST_FOR_EACH_SAFE (r, n, struct relay, node, &relays) {
-            relay_run(r, &secchan);
-        }
-        for (i = 0; i < n_listeners; i++) {
-            for (;;) {
-                struct relay *r = relay_accept(&s, listeners[i]);
-                if (!r) {
-                    break;
-                }
-                list_push_back(&relays, &r->node);
+    /* Do work. */
+    LIST_FOR_EACH_SAFE (r, n, struct relay, node, &relays) {
+        relay_run(r, &secchan);
+    }
+    for (i = 0; i < n_listeners; i++) {
+        for (;;) {
+            struct relay *r = relay_accept(s, listeners[i]);
+            if (!r) {
+                break;
             }
+            list_push_back(&relays, &r->node);
         }
-        if (monitor) {
-            struct vconn *new = accept_vconn(monitor);
-            if (new) {
-                /* XXX should monitor async_rconn too but rconn_add_monitor()
-                 * takes ownership of the vconn passed in. */
-                rconn_add_monitor(local_rconn, new);
-            }
+    }
+    if (monitor) {
+        struct vconn *new = accept_vconn(monitor);
+        if (new) {
+            /* XXX should monitor async_rconn too but rconn_add_monitor()
+             * takes ownership of the vconn passed in. */
+            rconn_add_monitor(local_rconn, new);
         }
-        for (i = 0; i < secchan.n_hooks; i++) {
-            if (secchan.hooks[i].class->periodic_cb) {
-                secchan.hooks[i].class->periodic_cb(secchan.hooks[i].aux);
-            }
+    }
+    for (i = 0; i < secchan.n_hooks; i++) {
+        if (secchan.hooks[i].class->periodic_cb) {
+            secchan.hooks[i].class->periodic_cb(secchan.hooks[i].aux);
         }
-        if (s.discovery) {
-            char *controller_name;
-            if (rconn_is_connectivity_questionable(remote_rconn)) {
-                discovery_question_connectivity(discovery);
-            }
-            if (discovery_run(discovery, &controller_name)) {
-                if (controller_name) {
+    }
+    if (s->discovery) {
+        char *controller_name;
+        if (rconn_is_connectivity_questionable(remote_rconn)) {
+            discovery_question_connectivity(discovery);
+        }
+        if (discovery_run(discovery, &controller_name)) {
+            if (controller_name) {
+                if (strcmp(controller_name, rconn_get_name(remote_rconn))) {
                     rconn_connect(remote_rconn, controller_name);
-                } else {
-                    rconn_disconnect(remote_rconn);
                 }
+                free(controller_name);
+            } else {
+                rconn_disconnect(remote_rconn);
             }
         }
+    }
 
-        /* Wait for something to happen. */
-        LIST_FOR_EACH (r, struct relay, node, &relays) {
-            relay_wait(r);
-        }
-        for (i = 0; i < n_listeners; i++) {
-            pvconn_wait(listeners[i]);
-        }
-        if (monitor) {
-            pvconn_wait(monitor);
-        }
-        for (i = 0; i < secchan.n_hooks; i++) {
-            if (secchan.hooks[i].class->wait_cb) {
-                secchan.hooks[i].class->wait_cb(secchan.hooks[i].aux);
-            }
-        }
-        if (discovery) {
-            discovery_wait(discovery);
+    return s->discovery || rconn_is_alive(remote_rconn);
+}
+
+/* Arranges for the poll loop to wake up when secchan_run() has work to do. */
+void
+secchan_wait(void)
+{
+    struct relay *r;
+    size_t i;
+
+    LIST_FOR_EACH (r, struct relay, node, &relays) {
+        relay_wait(r);
+    }
+    for (i = 0; i < n_listeners; i++) {
+        pvconn_wait(listeners[i]);
+    }
+    if (monitor) {
+        pvconn_wait(monitor);
+    }
+    for (i = 0; i < secchan.n_hooks; i++) {
+        if (secchan.hooks[i].class->wait_cb) {
+            secchan.hooks[i].class->wait_cb(secchan.hooks[i].aux);
         }
-        poll_block();
     }
-
-    return 0;
+    if (discovery) {
+        discovery_wait(discovery);
+    }
 }
 
 static struct pvconn *
@@ -338,6 +408,23 @@ add_hook(struct secchan *secchan, const struct hook_class *class, void *aux)
     hook = &secchan->hooks[secchan->n_hooks++];
     hook->class = class;
     hook->aux = aux;
+
+    if (class->local_packet_cb) {
+        secchan->local_types |= (class->local_types ? class->local_types
+                                 : UINT32_MAX);
+    }
+    if (class->remote_packet_cb) {
+        secchan->remote_types |= (class->remote_types ? class->remote_types
+                                  : UINT32_MAX);
+    }
+}
+
+/* Returns true if a message of the given 'type' belongs to 'types', a bitmap
+ * of HOOK_TYPE() values. */
+static bool
+hook_type_matches(uint32_t types, uint8_t type)
+{
+    return type >= 32 || types & HOOK_TYPE(type);
 }
 
 struct ofp_packet_in *
@@ -426,28 +513,47 @@ relay_accept(const struct settings *s, struct pvconn *pvconn)
     r2 = rconn_create(0, 0);
     rconn_connect_unreliably(r2, "passive", new_remote);
 
-    return relay_create(NULL, r1, r2, true);
+    return relay_create(NULL, r1, r2, true, s->relay_depth);
 }
 
 static struct relay *
 relay_create(struct rconn *async, struct rconn *local, struct rconn *remote,
-             bool is_mgmt_conn)
+             bool is_mgmt_conn, int max_txq)
 {
     struct relay *r = xcalloc(1, sizeof *r);
     r->halves[HALF_LOCAL].rconn = local;
     r->halves[HALF_REMOTE].rconn = remote;
     r->is_mgmt_conn = is_mgmt_conn;
     r->async_rconn = async;
+    r->max_txq = max_txq;
     return r;
 }
 
+/* Returns the message just received on 'half' (HALF_LOCAL or HALF_REMOTE) of
+ * 'r', transferring ownership to the caller.  A packet callback that wants
+ * to keep the message, rather than a copy, calls this and returns true. */
+struct ofpbuf *
+relay_take_rxbuf(struct relay *r, int half)
+{
+    struct ofpbuf *msg = r->halves[half].rxbuf;
+    r->halves[half].rxbuf = NULL;
+    return msg;
+}
+
 static bool
 call_local_packet_cbs(struct secchan *secchan, struct relay *r)
 {
+    const struct ofp_header *oh = r->halves[HALF_LOCAL].rxbuf->data;
     const struct hook *h;
+
+    if (!hook_type_matches(secchan->local_types, oh->type)) {
+        return false;
+    }
     for (h = secchan->hooks; h < &secchan->hooks[secchan->n_hooks]; h++) {
         bool (*cb)(struct relay *, void *aux) = h->class->local_packet_cb;
-        if (cb && (cb)(r, h->aux)) {
+        if (cb && (!h->class->local_types
+                   || hook_type_matches(h->class->local_types, oh->type))
+            && (cb)(r, h->aux)) {
             return true;
         }
     }
@@ -457,10 +563,17 @@ call_local_packet_cbs(struct secchan *secchan, struct relay *r)
 static bool
 call_remote_packet_cbs(struct secchan *secchan, struct relay *r)
 {
+    const struct ofp_header *oh = r->halves[HALF_REMOTE].rxbuf->data;
     const struct hook *h;
+
+    if (!hook_type_matches(secchan->remote_types, oh->type)) {
+        return false;
+    }
     for (h = secchan->hooks; h < &secchan->hooks[secchan->n_hooks]; h++) {
         bool (*cb)(struct relay *, void *aux) = h->class->remote_packet_cb;
-        if (cb && (cb)(r, h->aux)) {
+        if (cb && (!h->class->remote_types
+                   || hook_type_matches(h->class->remote_types, oh->type))
+            && (cb)(r, h->aux)) {
             return true;
         }
     }
@@ -492,6 +605,11 @@ relay_run(struct relay *r, struct secchan *secchan)
                 if (!this->rxbuf && i == HALF_LOCAL && r->async_rconn) {
                     this->rxbuf = rconn_recv(r->async_rconn);
                 }
+#ifdef HAVE_NETLINK
+                if (!this->rxbuf && i == HALF_LOCAL && r->upcalls) {
+                    this->rxbuf = upcall_recv(r->upcalls);
+                }
+#endif
                 if (this->rxbuf && (i == HALF_REMOTE || !r->is_mgmt_conn)) {
                     if (i == HALF_LOCAL
                         ? call_local_packet_cbs(secchan, r)
@@ -505,7 +623,7 @@ relay_run(struct relay *r, struct secchan *secchan)
                 }
             }
 
-            if (this->rxbuf && !this->n_txq) {
+            if (this->rxbuf && this->n_txq < r->max_txq) {
                 int retval = rconn_send(peer->rconn, this->rxbuf,
                                         &this->n_txq);
                 if (retval != EAGAIN) {
@@ -551,6 +669,11 @@ relay_wait(struct relay *r)
             if (i == HALF_LOCAL && r->async_rconn) {
                 rconn_recv_wait(r->async_rconn);
             }
+#ifdef HAVE_NETLINK
+            if (i == HALF_LOCAL && r->upcalls) {
+                upcall_recv_wait(r->upcalls);
+            }
+#endif
         }
     }
 }
@@ -578,27 +701,41 @@ parse_options(int argc, char *argv[], struct settings *s)
     enum {
         OPT_ACCEPT_VCONN = UCHAR_MAX + 1,
         OPT_NO_RESOLV_CONF,
+        OPT_DISCOVERY_CACHE,
         OPT_INACTIVITY_PROBE,
         OPT_MAX_IDLE,
         OPT_MAX_BACKOFF,
+        OPT_RELAY_DEPTH,
+        OPT_NETLINK_RCVBUF,
+        OPT_UPCALL_THREADS,
+        OPT_PORT_FLAP_WINDOW,
         OPT_RATE_LIMIT,
         OPT_BURST_LIMIT,
         OPT_BOOTSTRAP_CA_CERT,
+        OPT_SSL_CRYPTO_THREADS,
         OPT_STP,
         OPT_NO_STP,
         OPT_OUT_OF_BAND,
         OPT_IN_BAND,
         OPT_EMERG_FLOW,
+        OPT_HOT_STANDBY,
         VLOG_OPTION_ENUMS,
+        METRICS_OPTION_ENUMS,
+        STATS_FILE_OPTION_ENUMS,
         LEAK_CHECKER_OPTION_ENUMS
     };
     static struct option long_options[] = {
         {"accept-vconn", required_argument, 0, OPT_ACCEPT_VCONN},
         {"no-resolv-conf", no_argument, 0, OPT_NO_RESOLV_CONF},
+        {"discovery-cache", required_argument, 0, OPT_DISCOVERY_CACHE},
         {"fail",        required_argument, 0, 'F'},
         {"inactivity-probe", required_argument, 0, OPT_INACTIVITY_PROBE},
         {"max-idle",    required_argument, 0, OPT_MAX_IDLE},
         {"max-backoff", required_argument, 0, OPT_MAX_BACKOFF},
+        {"relay-depth", required_argument, 0, OPT_RELAY_DEPTH},
+        {"netlink-rcvbuf", required_argument, 0, OPT_NETLINK_RCVBUF},
+        {"upcall-threads", required_argument, 0, OPT_UPCALL_THREADS},
+        {"port-flap-window", required_argument, 0, OPT_PORT_FLAP_WINDOW},
         {"listen",      required_argument, 0, 'l'},
         {"monitor",     required_argument, 0, 'm'},
         {"rate-limit",  optional_argument, 0, OPT_RATE_LIMIT},
@@ -608,15 +745,19 @@ parse_options(int argc, char *argv[], struct settings *s)
         {"out-of-band", no_argument, 0, OPT_OUT_OF_BAND},
         {"in-band",     no_argument, 0, OPT_IN_BAND},
         {"emerg-flow",  no_argument, 0, OPT_EMERG_FLOW},
+        {"hot-standby", no_argument, 0, OPT_HOT_STANDBY},
         {"verbose",     optional_argument, 0, 'v'},
         {"help",        no_argument, 0, 'h'},
         {"version",     no_argument, 0, 'V'},
         DAEMON_LONG_OPTIONS,
         VLOG_LONG_OPTIONS,
+        METRICS_LONG_OPTIONS,
+        STATS_FILE_LONG_OPTIONS,
         LEAK_CHECKER_LONG_OPTIONS,
 #ifdef HAVE_OPENSSL
         VCONN_SSL_LONG_OPTIONS
         {"bootstrap-ca-cert", required_argument, 0, OPT_BOOTSTRAP_CA_CERT},
+        {"ssl-crypto-threads", no_argument, 0, OPT_SSL_CRYPTO_THREADS},
 #endif
         {0, 0, 0, 0},
     };
@@ -631,12 +772,18 @@ parse_options(int argc, char *argv[], struct settings *s)
     s->max_idle = 15;
     s->probe_interval = 15;
     s->max_backoff = 15;
+    s->relay_depth = 32;
+    s->netlink_rcvbuf = 0;
+    s->upcall_threads = 0;
+    s->port_flap_window = 0;
     s->update_resolv_conf = true;
+    s->discovery_cache = NULL;
     s->rate_limit = 0;
     s->burst_limit = 0;
     s->enable_stp = false;
     s->in_band = true;
     s->emerg_flow = false;
+    s->hot_standby = false;
     for (;;) {
         int c;
 
@@ -654,6 +801,10 @@ parse_options(int argc, char *argv[], struct settings *s)
             s->update_resolv_conf = false;
             break;
 
+        case OPT_DISCOVERY_CACHE:
+            s->discovery_cache = optarg;
+            break;
+
         case 'F':
             if (!strcmp(optarg, "open")) {
                 s->fail_mode = FAIL_OPEN;
@@ -693,6 +844,38 @@ parse_options(int argc, char *argv[], struct settings *s)
             }
             break;
 
+        case OPT_RELAY_DEPTH:
+            s->relay_depth = atoi(optarg);
+            if (s->relay_depth < 1) {
+                ofp_fatal(0, "--relay-depth argument must be at least 1");
+            }
+            break;
+
+        case OPT_NETLINK_RCVBUF:
+            if (atoi(optarg) < 65536) {
+                ofp_fatal(0, "--netlink-rcvbuf argument must be at least "
+                          "65536");
+            }
+            s->netlink_rcvbuf = atoi(optarg);
+            break;
+
+        case OPT_UPCALL_THREADS:
+            s->upcall_threads = atoi(optarg);
+            if (s->upcall_threads < 0
+                || s->upcall_threads > DP_MAX_UPCALL_PIDS) {
+                ofp_fatal(0, "--upcall-threads argument must be between 0 "
+                          "and %d", DP_MAX_UPCALL_PIDS);
+            }
+            break;
+
+        case OPT_PORT_FLAP_WINDOW:
+            s->port_flap_window = atoi(optarg);
+            if (s->port_flap_window < 0) {
+                ofp_fatal(0, "--port-flap-window argument must not be "
+                          "negative");
+            }
+            break;
+
         case OPT_RATE_LIMIT:
             if (optarg) {
                 s->rate_limit = atoi(optarg);
@@ -731,6 +914,10 @@ parse_options(int argc, char *argv[], struct settings *s)
             s->emerg_flow = true;
             break;
 
+        case OPT_HOT_STANDBY:
+            s->hot_standby = true;
+            break;
+
         case 'l':
             if (s->n_listeners >= MAX_MGMT) {
                 ofp_fatal(0,
@@ -759,6 +946,10 @@ parse_options(int argc, char *argv[], struct settings *s)
 
         VLOG_OPTION_HANDLERS
 
+        METRICS_OPTION_HANDLERS
+
+        STATS_FILE_OPTION_HANDLERS
+
         LEAK_CHECKER_OPTION_HANDLERS
 
 #ifdef HAVE_OPENSSL
@@ -767,6 +958,10 @@ parse_options(int argc, char *argv[], struct settings *s)
         case OPT_BOOTSTRAP_CA_CERT:
             vconn_ssl_set_ca_cert_file(optarg, true);
             break;
+
+        case OPT_SSL_CRYPTO_THREADS:
+            vconn_ssl_set_crypto_threads(true);
+            break;
 #endif
 
         case '?':
@@ -849,9 +1044,15 @@ usage(void)
            "omitted, then secchan performs controller discovery.\n",
            program_name, program_name);
     vconn_usage(true, true, true);
+#ifdef HAVE_OPENSSL
+    printf("  --ssl-crypto-threads    encrypt and decrypt each SSL connection\n"
+           "                          on a thread of its own\n");
+#endif
     printf("\nController discovery options:\n"
            "  --accept-vconn=REGEX    accept matching discovered controllers\n"
            "  --no-resolv-conf        do not update /etc/resolv.conf\n"
+           "  --discovery-cache=FILE  save discovered controller in FILE and\n"
+           "                          try it first on the next startup\n"
            "\nNetworking options:\n"
            "  -F, --fail=open|closed  when controller connection fails:\n"
            "                            closed: drop all packets\n"
@@ -860,6 +1061,14 @@ usage(void)
            "  --max-idle=SECS         max idle for flows set up by secchan\n"
            "  --max-backoff=SECS      max time between controller connection\n"
            "                          attempts (default: 15 seconds)\n"
+           "  --relay-depth=N         max messages queued in each direction\n"
+           "                          (default: 32)\n"
+           "  --netlink-rcvbuf=BYTES  receive buffer size for nl: datapath\n"
+           "                          sockets (default: 4194304)\n"
+           "  --upcall-threads=N      read nl: datapath packet-ins on N\n"
+           "                          per-CPU sockets (default: 0, off)\n"
+           "  --port-flap-window=MS   report port link changes at most once\n"
+           "                          per MS milliseconds (default: 0)\n"
            "  -l, --listen=METHOD     allow management connections on METHOD\n"
            "                          (a passive OpenFlow connection method)\n"
            "  -m, --monitor=METHOD    copy traffic to/from kernel to METHOD\n"
@@ -868,12 +1077,16 @@ usage(void)
            "  --stp                   enable 802.1D Spanning Tree Protocol\n"
            "  --no-stp                disable 802.1D Spanning Tree Protocol\n"
            "  --emerg-flow            enable emergency flow protection/restoration\n"
+           "  --hot-standby           keep connections open to all controllers\n"
+           "                          and switch over without reconnecting\n"
            "\nRate-limiting of \"packet-in\" messages to the controller:\n"
            "  --rate-limit[=PACKETS]  max rate, in packets/s (default: 1000)\n"
            "  --burst-limit=BURST     limit on packet credit for idle time\n",
            ofp_pkgdatadir);
     daemon_usage();
     vlog_usage();
+    metrics_usage();
+    stats_file_usage();
     printf("\nOther options:\n"
            "  -h, --help              display this help message\n"
            "  -V, --version           display version information\n");
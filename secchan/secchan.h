@@ -37,6 +37,7 @@
 #include <regex.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include "list.h"
 #include "packets.h"
 
@@ -72,6 +73,11 @@ struct settings {
     int max_idle;             /* Idle time for flows in fail-open mode. */
     int probe_interval;       /* # seconds idle before sending echo request. */
     int max_backoff;          /* Max # seconds between connection attempts. */
+    int relay_depth;          /* Max # msgs queued per direction of a relay. */
+    bool hot_standby;         /* Keep standby controller connections up? */
+    size_t netlink_rcvbuf;    /* Kernel datapath socket SO_RCVBUF, or 0. */
+    int upcall_threads;       /* Kernel packet-in reader threads, or 0. */
+    int port_flap_window;     /* Msecs to coalesce port link changes. */
 
     /* Packet-in rate-limiting. */
     int rate_limit;           /* Tokens added to bucket per second. */
@@ -81,6 +87,7 @@ struct settings {
     regex_t accept_controller_regex;  /* Controller vconns to accept. */
     const char *accept_controller_re; /* String version of regex. */
     bool update_resolv_conf;          /* Update /etc/resolv.conf? */
+    const char *discovery_cache;      /* File to save discovered vconn. */
 
     /* Spanning tree protocol. */
     bool enable_stp;
@@ -114,18 +121,40 @@ struct relay {
      * events and thus have a null 'async_rconn'. */
     bool is_mgmt_conn;          /* Is this a management connection? */
     struct rconn *async_rconn;  /* For receiving asynchronous events. */
+    struct upcall_handler *upcalls; /* Kernel packet-in threads, or NULL. */
+
+    /* Each half stops receiving while it has this many messages queued for
+     * transmission on its peer, which pushes back on the sender instead of
+     * growing the queue without bound. */
+    int max_txq;
 };
 
+/* local_packet_cb and remote_packet_cb return true to consume the message in
+ * the relay's 'rxbuf', which secchan then frees, unless the callback took
+ * it with relay_take_rxbuf(). */
 struct hook_class {
     bool (*local_packet_cb)(struct relay *, void *aux);
     bool (*remote_packet_cb)(struct relay *, void *aux);
     void (*periodic_cb)(void *aux);
     void (*wait_cb)(void *aux);
     void (*closing_cb)(struct relay *, void *aux);
+
+    /* Message types that local_packet_cb and remote_packet_cb examine, as
+     * bitmaps of HOOK_TYPE(OFPT_*), or 0 to see every message.  Messages of
+     * other types are relayed without calling the callback; when no hook
+     * wants a message, secchan forwards it straight to the peer rconn. */
+    uint32_t local_types;
+    uint32_t remote_types;
 };
+#define HOOK_TYPE(TYPE) (1u << (TYPE))
 
 void add_hook(struct secchan *, const struct hook_class *, void *);
 
+void secchan_start(int argc, char *argv[], bool standalone);
+bool secchan_run(void);
+void secchan_wait(void);
+
+struct ofpbuf *relay_take_rxbuf(struct relay *, int half);
 struct ofp_packet_in *get_ofp_packet_in(struct relay *);
 bool get_ofp_packet_eth_header(struct relay *, struct ofp_packet_in **,
                                struct eth_header **);
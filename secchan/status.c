@@ -37,11 +37,14 @@
 #include <assert.h>
 #include <errno.h>
 #include <unistd.h>
+#include "dpif.h"
 #include "dynamic-string.h"
+#include "metrics.h"
 #include "openflow/nicira-ext.h"
 #include "ofpbuf.h"
 #include "openflow/openflow.h"
 #include "rconn.h"
+#include "stats-file.h"
 #include "timeval.h"
 #include "vconn.h"
 
@@ -67,16 +70,38 @@ struct status_reply {
     struct ds output;
 };
 
+/* Appends to 'output' the status lines of each category that begin with the
+ * 'request_len' bytes in 'request', which may be empty to select every
+ * line. */
+static void
+switch_status_format(struct switch_status *ss, const char *request,
+                     size_t request_len, struct ds *output)
+{
+    struct switch_status_category *c;
+    struct status_reply sr;
+
+    sr.request.string = (char *) request;
+    sr.request.length = request_len;
+    sr.output = *output;
+    for (c = ss->categories; c < &ss->categories[ss->n_categories]; c++) {
+        if (!memcmp(c->name, sr.request.string,
+                    MIN(strlen(c->name), sr.request.length))) {
+            sr.category = c;
+            c->cb(&sr, c->aux);
+        }
+    }
+    *output = sr.output;
+}
+
 static bool
 switch_status_remote_packet_cb(struct relay *r, void *ss_)
 {
     struct switch_status *ss = ss_;
     struct rconn *rc = r->halves[HALF_REMOTE].rconn;
     struct ofpbuf *msg = r->halves[HALF_REMOTE].rxbuf;
-    struct switch_status_category *c;
     struct nicira_header *request;
     struct nicira_header *reply;
-    struct status_reply sr;
+    struct ds output;
     struct ofpbuf *b;
     int retval;
 
@@ -90,29 +115,52 @@ switch_status_remote_packet_cb(struct relay *r, void *ss_)
         return false;
     }
 
-    sr.request.string = (void *) (request + 1);
-    sr.request.length = msg->size - sizeof *request;
-    ds_init(&sr.output);
-    for (c = ss->categories; c < &ss->categories[ss->n_categories]; c++) {
-        if (!memcmp(c->name, sr.request.string,
-                    MIN(strlen(c->name), sr.request.length))) {
-            sr.category = c;
-            c->cb(&sr, c->aux);
-        }
-    }
-    reply = make_openflow_xid(sizeof *reply + sr.output.length,
+    ds_init(&output);
+    switch_status_format(ss, (char *) (request + 1),
+                         msg->size - sizeof *request, &output);
+    reply = make_openflow_xid(sizeof *reply + output.length,
                               OFPT_VENDOR, request->header.xid, &b);
     reply->vendor = htonl(NX_VENDOR_ID);
     reply->subtype = htonl(NXT_STATUS_REPLY);
-    memcpy(reply + 1, sr.output.string, sr.output.length);
+    memcpy(reply + 1, output.string, output.length);
     retval = rconn_send(rc, b, NULL);
     if (retval && retval != EAGAIN) {
         VLOG_WARN("send failed (%s)", strerror(retval));
     }
-    ds_destroy(&sr.output);
+    ds_destroy(&output);
     return true;
 }
 
+/* Exports every category's numeric status lines to the metrics collector,
+ * and every status line to the stats file, for each that is configured and
+ * due. */
+static void
+switch_status_periodic_cb(void *ss_)
+{
+    struct switch_status *ss = ss_;
+
+    if (metrics_due() || stats_file_due()) {
+        struct ds output;
+
+        ds_init(&output);
+        switch_status_format(ss, "", 0, &output);
+        if (metrics_due()) {
+            metrics_send(&output);
+        }
+        if (stats_file_due()) {
+            stats_file_publish(&output);
+        }
+        ds_destroy(&output);
+    }
+}
+
+static void
+switch_status_wait_cb(void *ss_ UNUSED)
+{
+    metrics_wait();
+    stats_file_wait();
+}
+
 void
 rconn_status_cb(struct status_reply *sr, void *rconn_)
 {
@@ -137,6 +185,19 @@ rconn_status_cb(struct status_reply *sr, void *rconn_)
     status_reply_put(sr, "state-elapsed=%u", rconn_get_state_elapsed(rconn));
 }
 
+#ifdef HAVE_NETLINK
+void
+dpif_status_cb(struct status_reply *sr, void *aux UNUSED)
+{
+    struct dpif_stats stats;
+
+    dpif_get_stats(&stats);
+    status_reply_put(sr, "received-msgs=%llu", stats.n_received);
+    status_reply_put(sr, "overflows=%llu", stats.n_overflows);
+    status_reply_put(sr, "errors=%llu", stats.n_errors);
+}
+#endif
+
 static void
 config_status_cb(struct status_reply *sr, void *s_)
 {
@@ -168,9 +229,11 @@ switch_status_cb(struct status_reply *sr, void *ss_)
 static struct hook_class switch_status_hook_class = {
     NULL,                           /* local_packet_cb */
     switch_status_remote_packet_cb, /* remote_packet_cb */
-    NULL,                           /* periodic_cb */
-    NULL,                           /* wait_cb */
+    switch_status_periodic_cb,      /* periodic_cb */
+    switch_status_wait_cb,          /* wait_cb */
     NULL,                           /* closing_cb */
+    0,                              /* local_types */
+    HOOK_TYPE(OFPT_VENDOR),         /* remote_types */
 };
 
 void
@@ -52,5 +52,6 @@ void status_reply_put(struct status_reply *, const char *, ...)
     PRINTF_FORMAT(2, 3);
 
 void rconn_status_cb(struct status_reply *, void *rconn_);
+void dpif_status_cb(struct status_reply *, void *aux);
 
 #endif /* status.h */
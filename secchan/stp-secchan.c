@@ -60,6 +60,8 @@ struct stp_data {
 
 static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(60, 60);
 
+static bool stp_is_port_supported(uint16_t port_no);
+
 static bool
 stp_local_packet_cb(struct relay *r, void *stp_)
 {
@@ -87,8 +89,7 @@ stp_local_packet_cb(struct relay *r, void *stp_)
     }
 
     port_no = ntohs(opi->in_port);
-    if (port_no >= STP_MAX_PORTS) {
-        /* STP only supports 255 ports. */
+    if (!stp_is_port_supported(port_no)) {
         return false;
     }
     if (port_watcher_get_config(stp->pw, port_no) & OFPPC_NO_STP) {
@@ -207,7 +208,8 @@ send_bpdu(struct ofpbuf *pkt, int port_no, void *stp_)
         memcpy(eth->eth_src, port_mac, ETH_ADDR_LEN);
         opo = make_unbuffered_packet_out(pkt, OFPP_NONE, port_no);
 
-        rconn_send_with_limit(stp->local_rconn, opo, &stp->n_txq, OFPP_MAX);
+        rconn_send_with_limit(stp->local_rconn, opo, &stp->n_txq, OFPP_MAX,
+                              RCONN_TXQ_CONTROL);
     } else {
         VLOG_WARN_RL(&rl, "cannot send BPDU on missing port %d", port_no);
     }
@@ -269,6 +271,9 @@ static struct hook_class stp_hook_class = {
     stp_periodic_cb,            /* periodic_cb */
     stp_wait_cb,                /* wait_cb */
     NULL,                       /* closing_cb */
+    (HOOK_TYPE(OFPT_FEATURES_REPLY)
+     | HOOK_TYPE(OFPT_PACKET_IN)), /* local_types */
+    0,                          /* remote_types */
 };
 
 void
@@ -0,0 +1,240 @@
+/* Copyright (c) 2008 The Board of Trustees of The Leland Stanford
+ * Junior University
+ *
+ * We are making the OpenFlow specification and associated documentation
+ * (Software) available for public use and benefit with the expectation
+ * that others will use, modify and enhance the Software and contribute
+ * those enhancements back to the community. However, since we would
+ * like to make the Software available for broadest use, with as few
+ * restrictions as possible permission is hereby granted, free of
+ * charge, to any person obtaining a copy of this Software to deal in
+ * the Software under the copyrights without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * The name and trademarks of copyright holder(s) may NOT be used in
+ * advertising or publicity pertaining to the Software or any
+ * derivatives without specific, written prior permission.
+ */
+
+#include <config.h>
+#include "upcall.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "dpif.h"
+#include "ofpbuf.h"
+#include "poll-loop.h"
+#include "queue.h"
+#include "socket-util.h"
+#include "status.h"
+#include "util.h"
+
+#include "vlog.h"
+#define THIS_MODULE VLM_upcall
+
+/* Most packet-ins waiting for the main loop.  A reader thread that finds the
+ * queue full stops reading its socket until there is room, so that overload
+ * shows up as socket buffer overflows in the "netlink" status category. */
+#define UPCALL_MAX_QUEUE 1024
+
+struct upcall_thread {
+    struct upcall_handler *handler;
+    struct dpif dpif;           /* Upcall socket read by this thread. */
+    pthread_t thread;
+};
+
+struct upcall_handler {
+    int dp_idx;
+    struct upcall_thread *threads;
+    size_t n_threads;
+
+    /* Messages received by the threads, protected by 'mutex'.  A byte is
+     * written to 'wakeup_pipe' whenever 'queue' becomes nonempty. */
+    pthread_mutex_t mutex;
+    pthread_cond_t not_full;
+    struct ofp_queue queue;
+    int wakeup_pipe[2];
+    unsigned long long int n_queued;    /* Messages passed to the main loop. */
+    unsigned long long int n_waits;     /* Times a thread found it full. */
+};
+
+static void *upcall_thread_main(void *);
+static void upcall_status_cb(struct status_reply *, void *);
+
+/* Opens 'n_threads' upcall sockets for the kernel datapath named 'dp_name'
+ * ("nl:N"), directs its packet-ins to them, and starts a thread to read each
+ * one.  Returns the new handler, or a null pointer if the datapath does not
+ * support upcall sockets, in which case packet-ins keep arriving on the
+ * "async" connection. */
+struct upcall_handler *
+upcall_start(const char *dp_name, size_t n_threads,
+             struct switch_status *switch_status)
+{
+    struct upcall_handler *h;
+    struct dpif control;
+    struct dpif *socks;
+    size_t i;
+    int dp_idx;
+    int retval;
+
+    if (sscanf(dp_name, "nl:%d", &dp_idx) != 1) {
+        VLOG_WARN("%s: upcall threads require an nl: datapath", dp_name);
+        return NULL;
+    }
+
+    socks = xmalloc(n_threads * sizeof *socks);
+    for (i = 0; i < n_threads; i++) {
+        retval = dpif_open_upcall(&socks[i]);
+        if (retval) {
+            VLOG_ERR("could not open upcall socket: %s", strerror(retval));
+            goto error;
+        }
+    }
+
+    retval = dpif_open(-1, &control);
+    if (!retval) {
+        retval = dpif_set_upcall_socks(&control, dp_idx, socks, n_threads);
+        dpif_close(&control);
+    }
+    if (retval) {
+        VLOG_WARN("datapath %d does not accept upcall sockets (%s), "
+                  "receiving packet-ins by multicast", dp_idx,
+                  strerror(retval));
+        goto error;
+    }
+
+    h = xcalloc(1, sizeof *h);
+    h->dp_idx = dp_idx;
+    h->n_threads = n_threads;
+    pthread_mutex_init(&h->mutex, NULL);
+    pthread_cond_init(&h->not_full, NULL);
+    queue_init(&h->queue);
+    if (pipe(h->wakeup_pipe)) {
+        ofp_fatal(errno, "could not create pipe");
+    }
+    set_nonblocking(h->wakeup_pipe[0]);
+    set_nonblocking(h->wakeup_pipe[1]);
+
+    h->threads = xcalloc(n_threads, sizeof *h->threads);
+    for (i = 0; i < n_threads; i++) {
+        struct upcall_thread *t = &h->threads[i];
+
+        t->handler = h;
+        t->dpif = socks[i];
+        retval = pthread_create(&t->thread, NULL, upcall_thread_main, t);
+        if (retval) {
+            ofp_fatal(retval, "could not start upcall thread");
+        }
+    }
+    free(socks);
+
+    switch_status_register_category(switch_status, "upcall",
+                                    upcall_status_cb, h);
+    VLOG_INFO("reading packet-ins from datapath %d with %zu threads",
+              dp_idx, n_threads);
+    return h;
+
+error:
+    while (i-- > 0) {
+        dpif_close(&socks[i]);
+    }
+    free(socks);
+    return NULL;
+}
+
+/* Takes the next packet-in that the upcall threads have received from 'h', or
+ * returns a null pointer if there is none.  The caller must free it. */
+struct ofpbuf *
+upcall_recv(struct upcall_handler *h)
+{
+    struct ofpbuf *msg;
+
+    pthread_mutex_lock(&h->mutex);
+    msg = queue_pop_head(&h->queue);
+    if (msg) {
+        if (h->queue.n == UPCALL_MAX_QUEUE - 1) {
+            pthread_cond_broadcast(&h->not_full);
+        }
+    } else {
+        char buf[64];
+
+        /* Drain while holding the mutex, so that a thread that queues a
+         * message after this sees an empty queue and writes a new byte. */
+        while (read(h->wakeup_pipe[0], buf, sizeof buf) > 0) {
+            continue;
+        }
+    }
+    pthread_mutex_unlock(&h->mutex);
+    return msg;
+}
+
+/* Arranges for the poll loop to wake up when upcall_recv() has a message. */
+void
+upcall_recv_wait(struct upcall_handler *h)
+{
+    poll_fd_wait(h->wakeup_pipe[0], POLLIN);
+}
+
+static void *
+upcall_thread_main(void *t_)
+{
+    struct upcall_thread *t = t_;
+    struct upcall_handler *h = t->handler;
+
+    for (;;) {
+        struct ofpbuf *msg;
+        int retval;
+
+        retval = dpif_recv_openflow(&t->dpif, h->dp_idx, &msg, true);
+        if (retval) {
+            /* dpif_recv_openflow() has already counted and logged it. */
+            continue;
+        }
+
+        pthread_mutex_lock(&h->mutex);
+        if (h->queue.n >= UPCALL_MAX_QUEUE) {
+            h->n_waits++;
+            do {
+                pthread_cond_wait(&h->not_full, &h->mutex);
+            } while (h->queue.n >= UPCALL_MAX_QUEUE);
+        }
+        if (!h->queue.n
+            && write(h->wakeup_pipe[1], "", 1) < 0 && errno != EAGAIN) {
+            VLOG_WARN("failed to wake main thread: %s", strerror(errno));
+        }
+        queue_push_tail(&h->queue, msg);
+        h->n_queued++;
+        pthread_mutex_unlock(&h->mutex);
+    }
+    return NULL;
+}
+
+static void
+upcall_status_cb(struct status_reply *sr, void *h_)
+{
+    struct upcall_handler *h = h_;
+
+    pthread_mutex_lock(&h->mutex);
+    status_reply_put(sr, "threads=%zu", h->n_threads);
+    status_reply_put(sr, "queued=%d", h->queue.n);
+    status_reply_put(sr, "received-msgs=%llu", h->n_queued);
+    status_reply_put(sr, "queue-full=%llu", h->n_waits);
+    pthread_mutex_unlock(&h->mutex);
+}
@@ -0,0 +1,56 @@
+/* Copyright (c) 2008 The Board of Trustees of The Leland Stanford
+ * Junior University
+ *
+ * We are making the OpenFlow specification and associated documentation
+ * (Software) available for public use and benefit with the expectation
+ * that others will use, modify and enhance the Software and contribute
+ * those enhancements back to the community. However, since we would
+ * like to make the Software available for broadest use, with as few
+ * restrictions as possible permission is hereby granted, free of
+ * charge, to any person obtaining a copy of this Software to deal in
+ * the Software under the copyrights without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * The name and trademarks of copyright holder(s) may NOT be used in
+ * advertising or publicity pertaining to the Software or any
+ * derivatives without specific, written prior permission.
+ */
+
+#ifndef UPCALL_H
+#define UPCALL_H 1
+
+/* Per-CPU packet-in sockets for the kernel datapath.
+ *
+ * By default the kernel datapath multicasts every packet-in, so they all pass
+ * through the receive queue of the single "async" socket.  An upcall handler
+ * opens one unicast socket per thread, registers them with the datapath, which
+ * picks one by the CPU that handled each packet, and reads each socket in its
+ * own thread.  The threads hand the messages to the main loop through
+ * upcall_recv(). */
+
+#include <stddef.h>
+
+struct ofpbuf;
+struct switch_status;
+
+struct upcall_handler *upcall_start(const char *dp_name, size_t n_threads,
+                                    struct switch_status *);
+struct ofpbuf *upcall_recv(struct upcall_handler *);
+void upcall_recv_wait(struct upcall_handler *);
+
+#endif /* upcall.h */
@@ -44,3 +44,54 @@ stp_files = \
 TESTS_ENVIRONMENT += stp_files='$(stp_files)'
 
 EXTRA_DIST += $(stp_files)
+
+noinst_PROGRAMS += tests/test-flow-hash
+tests_test_flow_hash_SOURCES = tests/test-flow-hash.c udatapath/crc32.c
+tests_test_flow_hash_CPPFLAGS = $(AM_CPPFLAGS) -I $(srcdir)/udatapath
+tests_test_flow_hash_LDADD = lib/libopenflow.a
+
+noinst_PROGRAMS += tests/bench-tables
+tests_bench_tables_SOURCES = \
+	tests/bench-tables.c \
+	udatapath/crc32.c \
+	udatapath/dp_act.c \
+	udatapath/policer.c \
+	udatapath/slab.c \
+	udatapath/switch-flow.c \
+	udatapath/table-dtree.c \
+	udatapath/table-hash.c \
+	udatapath/table-linear.c \
+	udatapath/table-tss.c
+tests_bench_tables_CPPFLAGS = $(AM_CPPFLAGS) -I $(srcdir)/udatapath
+tests_bench_tables_LDADD = lib/libopenflow.a
+
+noinst_PROGRAMS += tests/bench-replay
+tests_bench_replay_SOURCES = \
+	tests/bench-replay.c \
+	$(udatapath_ofdatapath_SOURCES)
+tests_bench_replay_CPPFLAGS = $(AM_CPPFLAGS) -I $(srcdir)/udatapath \
+	-DUDATAPATH_AS_LIB
+tests_bench_replay_LDADD = lib/libopenflow.a $(SSL_LIBS) $(FAULT_LIBS) \
+	$(PTHREAD_LIBS)
+
+noinst_PROGRAMS += tests/bench-gen
+tests_bench_gen_SOURCES = tests/bench-gen.c
+tests_bench_gen_LDADD = lib/libopenflow.a -lm
+
+noinst_PROGRAMS += tests/bench-micro
+tests_bench_micro_SOURCES = \
+	tests/bench-micro.c \
+	$(udatapath_ofdatapath_SOURCES)
+tests_bench_micro_CPPFLAGS = $(AM_CPPFLAGS) -I $(srcdir)/udatapath \
+	-DUDATAPATH_AS_LIB
+tests_bench_micro_LDADD = lib/libopenflow.a $(SSL_LIBS) $(FAULT_LIBS) \
+	$(PTHREAD_LIBS)
+
+# "make bench" runs the microbenchmarks.  Save the output of one run and pass
+# it back with --baseline to have a later run flag regressions, e.g.:
+#     make bench > before.txt
+#     (change something)
+#     make bench BENCH_FLAGS=--baseline=before.txt
+bench: tests/bench-micro
+	tests/bench-micro $(BENCH_FLAGS)
+.PHONY: bench
@@ -0,0 +1,676 @@
+/* Rule set and traffic generator for the table and datapath benchmarks, in
+ * the style of ClassBench.  Writes a set of IPv4 5-tuple rules with a chosen
+ * mix of prefix lengths, protocols and ports, some of them nested inside
+ * others, and a packet trace that hits them in bursts, so that
+ * "bench-replay" and "ofdatapath" can be measured on realistic inputs that
+ * every run reproduces exactly.
+ *
+ * usage: bench-gen [OPTIONS] PREFIX
+ *
+ * Writes PREFIX.txt, the rules in the format accepted by "dpctl add-flows",
+ * PREFIX.bin, the same rules as a binary flow file, and PREFIX.pcap, the
+ * trace.  The same options and seed always give the same files.  For
+ * example, to time the default flow tables, with room for the rules,
+ * against 100,000 rules:
+ *
+ *     tests/bench-gen -r 100000 -p 1000000 /tmp/acl
+ *     tests/bench-replay -f /tmp/acl.bin -t cuckoo,tss:200000 /tmp/acl.pcap */
+
+#include <config.h>
+#include <errno.h>
+#include <getopt.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <sys/time.h>
+#include "bitmap.h"
+#include "csum.h"
+#include "flow-file.h"
+#include "hash.h"
+#include "hmap.h"
+#include "ofpbuf.h"
+#include "openflow/openflow.h"
+#include "packets.h"
+#include "pcap.h"
+#include "random.h"
+#include "util.h"
+
+/* The kind of rule that a profile generates, with the share of the rules
+ * that are of this kind.  A prefix length of 0 wildcards the address, a
+ * protocol of 0 wildcards the protocol and ports. */
+struct rule_shape {
+    int weight;                 /* Relative share of rules. */
+    uint8_t src_len, dst_len;   /* IP source and destination prefixes. */
+    uint8_t nw_proto;           /* IP_TYPE_TCP, IP_TYPE_UDP or 0. */
+    bool tp_src, tp_dst;        /* Match on transport ports? */
+};
+
+/* Rule mixes modeled on the three ClassBench seed families: access control
+ * lists match mostly specific destinations and services, firewalls mostly
+ * wide prefixes, and IP chains a mix of both. */
+static const struct rule_shape acl_shapes[] = {
+    { 30,  0, 32, IP_TYPE_TCP, false, true },
+    { 20, 24, 32, IP_TYPE_TCP, false, true },
+    { 15, 16, 24, IP_TYPE_TCP, false, true },
+    { 10, 32, 32, IP_TYPE_UDP, false, true },
+    { 10,  0, 24, IP_TYPE_UDP, false, true },
+    { 10,  8, 16, 0, false, false },
+    {  5, 32, 32, IP_TYPE_TCP, true, true },
+};
+
+static const struct rule_shape fw_shapes[] = {
+    { 30,  0,  8, IP_TYPE_TCP, false, true },
+    { 20, 24,  0, 0, false, false },
+    { 20,  0, 24, IP_TYPE_TCP, false, true },
+    { 15, 16, 16, IP_TYPE_UDP, false, true },
+    { 10, 32,  0, 0, false, false },
+    {  5,  8,  8, 0, false, false },
+};
+
+static const struct rule_shape ipc_shapes[] = {
+    { 25, 32, 32, IP_TYPE_TCP, true, true },
+    { 20, 24, 24, IP_TYPE_TCP, false, true },
+    { 20, 16, 32, IP_TYPE_UDP, false, true },
+    { 15, 32, 16, 0, false, false },
+    { 10,  8,  8, 0, false, false },
+    { 10,  0, 32, IP_TYPE_TCP, true, false },
+};
+
+struct profile {
+    const char *name;
+    const struct rule_shape *shapes;
+    size_t n_shapes;
+};
+
+static const struct profile profiles[] = {
+    { "acl", acl_shapes, ARRAY_SIZE(acl_shapes) },
+    { "fw",  fw_shapes,  ARRAY_SIZE(fw_shapes) },
+    { "ipc", ipc_shapes, ARRAY_SIZE(ipc_shapes) },
+};
+
+/* Well-known destination ports, which most port matches use. */
+static const uint16_t popular_ports[] = {
+    80, 443, 53, 22, 25, 110, 143, 123, 161, 389, 3306, 5060, 8080,
+};
+
+/* A generated rule.  Addresses and ports are in host byte order. */
+struct rule {
+    struct hmap_node node;      /* In 'rules_by_match'. */
+    uint32_t nw_src, nw_dst;    /* Addresses, with bits past the prefix 0. */
+    uint8_t src_len, dst_len;   /* Prefix lengths, 0 for any address. */
+    uint8_t nw_proto;           /* Protocol, 0 for any. */
+    bool has_tp_src, has_tp_dst;
+    uint16_t tp_src, tp_dst;    /* Ports, if 'has_tp_*'. */
+};
+
+static struct rule *rules;
+static unsigned int n_rules;
+static struct hmap rules_by_match = HMAP_INITIALIZER(&rules_by_match);
+
+/* /16 networks that addresses cluster in, as real rule sets' do. */
+static uint32_t *src_pools, *dst_pools;
+static unsigned int n_pools;
+
+static void
+usage(void)
+{
+    printf("%s: generate rules and traffic for the benchmarks\n"
+           "usage: %s [OPTIONS] PREFIX\n"
+           "Writes PREFIX.txt (dpctl add-flows), PREFIX.bin (binary flow\n"
+           "file) and PREFIX.pcap (trace).\n"
+           "  -r, --rules=N        number of rules (default: 10000)\n"
+           "  -p, --packets=N      number of packets (default: 100000)\n"
+           "  -P, --profile=NAME   acl, fw or ipc (default: acl)\n"
+           "  -o, --overlap=PCT    rules nested in another (default: 10)\n"
+           "  -m, --miss=PCT       packets aimed at no rule (default: 0)\n"
+           "  -a, --pareto-a=A     burst length shape (default: 1)\n"
+           "  -b, --pareto-b=B     burst length scale (default: 0.1)\n"
+           "  -s, --seed=N         random seed (default: 1)\n",
+           program_name, program_name);
+    exit(EXIT_SUCCESS);
+}
+
+static uint32_t
+prefix_mask(int len)
+{
+    return len ? UINT32_MAX << (32 - len) : 0;
+}
+
+static uint32_t
+random_addr(const uint32_t *pools)
+{
+    return pools[random_range(n_pools)] | random_uint16();
+}
+
+static uint16_t
+random_dst_port(void)
+{
+    return (random_range(10) < 7
+            ? popular_ports[random_range(ARRAY_SIZE(popular_ports))]
+            : 1 + random_range(UINT16_MAX));
+}
+
+static uint32_t
+hash_rule(const struct rule *r)
+{
+    uint32_t words[5];
+
+    words[0] = r->nw_src;
+    words[1] = r->nw_dst;
+    words[2] = (r->src_len << 24) | (r->dst_len << 16) | r->nw_proto;
+    words[3] = (r->has_tp_src << 16) | r->tp_src;
+    words[4] = (r->has_tp_dst << 16) | r->tp_dst;
+    return hash_words(words, ARRAY_SIZE(words), 0);
+}
+
+static bool
+rules_equal(const struct rule *a, const struct rule *b)
+{
+    return (a->nw_src == b->nw_src && a->nw_dst == b->nw_dst
+            && a->src_len == b->src_len && a->dst_len == b->dst_len
+            && a->nw_proto == b->nw_proto
+            && a->has_tp_src == b->has_tp_src && a->tp_src == b->tp_src
+            && a->has_tp_dst == b->has_tp_dst && a->tp_dst == b->tp_dst);
+}
+
+/* Adds 'r' to the rule set, unless an identical rule is already there.
+ * Returns true if it was added. */
+static bool
+add_rule(struct rule *r)
+{
+    uint32_t hash = hash_rule(r);
+    struct rule *other;
+
+    HMAP_FOR_EACH_WITH_HASH (other, struct rule, node, hash,
+                             &rules_by_match) {
+        if (rules_equal(r, other)) {
+            return false;
+        }
+    }
+    hmap_insert(&rules_by_match, &r->node, hash);
+    n_rules++;
+    return true;
+}
+
+static void
+make_fresh_rule(struct rule *r, const struct profile *profile)
+{
+    const struct rule_shape *shape;
+    int total, pick;
+    size_t i;
+
+    total = 0;
+    for (i = 0; i < profile->n_shapes; i++) {
+        total += profile->shapes[i].weight;
+    }
+    pick = random_range(total);
+    for (i = 0; pick >= profile->shapes[i].weight; i++) {
+        pick -= profile->shapes[i].weight;
+    }
+    shape = &profile->shapes[i];
+
+    memset(r, 0, sizeof *r);
+    r->src_len = shape->src_len;
+    r->dst_len = shape->dst_len;
+    r->nw_src = random_addr(src_pools) & prefix_mask(r->src_len);
+    r->nw_dst = random_addr(dst_pools) & prefix_mask(r->dst_len);
+    r->nw_proto = shape->nw_proto;
+    if (shape->tp_src) {
+        r->has_tp_src = true;
+        r->tp_src = 1024 + random_range(UINT16_MAX - 1024);
+    }
+    if (shape->tp_dst) {
+        r->has_tp_dst = true;
+        r->tp_dst = random_dst_port();
+    }
+}
+
+/* Returns a prefix length longer than 'len', preferring the octet
+ * boundaries that most real rules use. */
+static uint8_t
+longer_prefix(uint8_t len)
+{
+    return (random_range(4) ? ROUND_UP(len + 1, 8)
+            : len + 1 + random_range(32 - len));
+}
+
+/* Makes 'r' a rule that matches a subset of what 'parent' matches, by
+ * lengthening one of its prefixes or pinning down a field it leaves open. */
+static void
+make_nested_rule(struct rule *r, const struct rule *parent)
+{
+    *r = *parent;
+    switch (random_range(4)) {
+    case 0:
+        if (r->src_len < 32) {
+            r->src_len = longer_prefix(r->src_len);
+            r->nw_src |= random_uint32() & ~prefix_mask(parent->src_len);
+            r->nw_src &= prefix_mask(r->src_len);
+            return;
+        }
+        /* Fall through. */
+    case 1:
+        if (r->dst_len < 32) {
+            r->dst_len = longer_prefix(r->dst_len);
+            r->nw_dst |= random_uint32() & ~prefix_mask(parent->dst_len);
+            r->nw_dst &= prefix_mask(r->dst_len);
+            return;
+        }
+        /* Fall through. */
+    case 2:
+        if (!r->nw_proto) {
+            r->nw_proto = random_range(2) ? IP_TYPE_TCP : IP_TYPE_UDP;
+            return;
+        }
+        /* Fall through. */
+    case 3:
+        if (!r->has_tp_dst) {
+            r->has_tp_dst = true;
+            r->tp_dst = random_dst_port();
+        } else if (!r->has_tp_src) {
+            r->has_tp_src = true;
+            r->tp_src = 1024 + random_range(UINT16_MAX - 1024);
+        }
+        return;
+    }
+}
+
+static void
+generate_rules(unsigned int n, const struct profile *profile, int overlap)
+{
+    double root = sqrt(n);
+    unsigned int i;
+
+    n_pools = MAX(16, root);
+    src_pools = xmalloc(n_pools * sizeof *src_pools);
+    dst_pools = xmalloc(n_pools * sizeof *dst_pools);
+    for (i = 0; i < n_pools; i++) {
+        src_pools[i] = random_uint32() & 0xffff0000;
+        dst_pools[i] = random_uint32() & 0xffff0000;
+    }
+
+    rules = xmalloc(n * sizeof *rules);
+    hmap_reserve(&rules_by_match, n);
+    while (n_rules < n) {
+        unsigned int tries = 0;
+        struct rule *r;
+
+        do {
+            if (++tries > 1000) {
+                ofp_fatal(0, "could not generate %u distinct rules with "
+                          "profile %s (stopped at %u)",
+                          n, profile->name, n_rules);
+            }
+            r = &rules[n_rules];
+            if (n_rules && random_range(100) < overlap) {
+                make_nested_rule(r, &rules[random_range(n_rules)]);
+            } else {
+                make_fresh_rule(r, profile);
+            }
+        } while (!add_rule(r));
+    }
+}
+
+/* A rule's priority grows with how much it pins down, so that each nested
+ * rule takes precedence over the rule that it is nested in. */
+static uint16_t
+rule_priority(const struct rule *r)
+{
+    return (OFP_DEFAULT_PRIORITY + r->src_len + r->dst_len
+            + (r->nw_proto ? 8 : 0) + (r->has_tp_src ? 16 : 0)
+            + (r->has_tp_dst ? 16 : 0));
+}
+
+static struct ofpbuf *
+rule_to_flow_mod(const struct rule *r)
+{
+    struct ofp_action_output *oao;
+    struct ofp_flow_mod *ofm;
+    struct ofpbuf *buffer;
+    uint32_t wildcards;
+
+    buffer = ofpbuf_new(sizeof *ofm + sizeof *oao);
+    ofm = ofpbuf_put_zeros(buffer, sizeof *ofm);
+    ofm->header.version = OFP_VERSION;
+    ofm->header.type = OFPT_FLOW_MOD;
+    ofm->header.length = htons(sizeof *ofm + sizeof *oao);
+
+    wildcards = OFPFW_ALL & ~(OFPFW_DL_TYPE | OFPFW_NW_SRC_MASK
+                              | OFPFW_NW_DST_MASK);
+    wildcards |= (32 - r->src_len) << OFPFW_NW_SRC_SHIFT;
+    wildcards |= (32 - r->dst_len) << OFPFW_NW_DST_SHIFT;
+    if (r->nw_proto) {
+        wildcards &= ~OFPFW_NW_PROTO;
+        ofm->match.nw_proto = r->nw_proto;
+    }
+    if (r->has_tp_src) {
+        wildcards &= ~OFPFW_TP_SRC;
+        ofm->match.tp_src = htons(r->tp_src);
+    }
+    if (r->has_tp_dst) {
+        wildcards &= ~OFPFW_TP_DST;
+        ofm->match.tp_dst = htons(r->tp_dst);
+    }
+    ofm->match.wildcards = htonl(wildcards);
+    ofm->match.dl_type = htons(ETH_TYPE_IP);
+    ofm->match.nw_src = htonl(r->nw_src);
+    ofm->match.nw_dst = htonl(r->nw_dst);
+
+    ofm->command = htons(OFPFC_ADD);
+    ofm->priority = htons(rule_priority(r));
+    ofm->buffer_id = htonl(UINT32_MAX);
+    ofm->out_port = htons(OFPP_NONE);
+
+    oao = ofpbuf_put_zeros(buffer, sizeof *oao);
+    oao->type = htons(OFPAT_OUTPUT);
+    oao->len = htons(sizeof *oao);
+    oao->port = htons(2);
+    return buffer;
+}
+
+static void
+write_rules(const char *prefix)
+{
+    char *text_name = xasprintf("%s.txt", prefix);
+    char *bin_name = xasprintf("%s.bin", prefix);
+    struct flow_file_writer w;
+    FILE *text;
+    unsigned int i;
+    int error;
+
+    text = fopen(text_name, "w");
+    if (!text) {
+        ofp_fatal(errno, "%s: create", text_name);
+    }
+    error = flow_file_create(bin_name, &w);
+    if (error) {
+        ofp_fatal(error, "%s: create", bin_name);
+    }
+    for (i = 0; i < n_rules; i++) {
+        struct ofpbuf *buffer = rule_to_flow_mod(&rules[i]);
+        char *s = flow_mod_to_string(buffer->data);
+
+        fprintf(text, "%s\n", s);
+        free(s);
+        error = flow_file_write(&w, buffer->data);
+        if (error) {
+            flow_file_abort(&w);
+            ofp_fatal(error, "%s: write", bin_name);
+        }
+        ofpbuf_delete(buffer);
+    }
+    if (fclose(text)) {
+        ofp_fatal(errno, "%s: write", text_name);
+    }
+    error = flow_file_commit(&w);
+    if (error) {
+        ofp_fatal(error, "%s: write", bin_name);
+    }
+    free(text_name);
+    free(bin_name);
+}
+
+/* Composes in 'packet' a minimum-size TCP or UDP packet with the given
+ * header fields. */
+static void
+compose_packet(struct ofpbuf *packet, uint32_t nw_src, uint32_t nw_dst,
+               uint8_t nw_proto, uint16_t tp_src, uint16_t tp_dst)
+{
+    static const uint8_t eth_src[ETH_ADDR_LEN] = { 0x02, 0, 0, 0, 0, 1 };
+    static const uint8_t eth_dst[ETH_ADDR_LEN] = { 0x02, 0, 0, 0, 0, 2 };
+    struct eth_header *eth;
+    struct ip_header *ip;
+    size_t tp_len;
+
+    ofpbuf_clear(packet);
+    eth = ofpbuf_put_zeros(packet, ETH_HEADER_LEN);
+    memcpy(eth->eth_src, eth_src, ETH_ADDR_LEN);
+    memcpy(eth->eth_dst, eth_dst, ETH_ADDR_LEN);
+    eth->eth_type = htons(ETH_TYPE_IP);
+
+    tp_len = nw_proto == IP_TYPE_TCP ? TCP_HEADER_LEN : UDP_HEADER_LEN;
+    ip = ofpbuf_put_zeros(packet, IP_HEADER_LEN);
+    ip->ip_ihl_ver = IP_IHL_VER(5, IP_VERSION);
+    ip->ip_tot_len = htons(IP_HEADER_LEN + tp_len);
+    ip->ip_ttl = 64;
+    ip->ip_proto = nw_proto;
+    ip->ip_src = htonl(nw_src);
+    ip->ip_dst = htonl(nw_dst);
+    ip->ip_csum = csum(ip, IP_HEADER_LEN);
+
+    if (nw_proto == IP_TYPE_TCP) {
+        struct tcp_header *tcp = ofpbuf_put_zeros(packet, TCP_HEADER_LEN);
+        tcp->tcp_src = htons(tp_src);
+        tcp->tcp_dst = htons(tp_dst);
+        tcp->tcp_ctl = htons((TCP_HEADER_LEN / 4) << 12 | TCP_ACK);
+        tcp->tcp_winsz = htons(UINT16_MAX);
+    } else {
+        struct udp_header *udp = ofpbuf_put_zeros(packet, UDP_HEADER_LEN);
+        udp->udp_src = htons(tp_src);
+        udp->udp_dst = htons(tp_dst);
+        udp->udp_len = htons(UDP_HEADER_LEN);
+    }
+    if (packet->size < ETH_TOTAL_MIN) {
+        ofpbuf_put_zeros(packet, ETH_TOTAL_MIN - packet->size);
+    }
+}
+
+/* Composes in 'packet' a packet that 'r' matches, choosing the fields that
+ * 'r' leaves open at random. */
+static void
+compose_rule_packet(struct ofpbuf *packet, const struct rule *r)
+{
+    uint32_t nw_src = r->nw_src | (random_uint32() & ~prefix_mask(r->src_len));
+    uint32_t nw_dst = r->nw_dst | (random_uint32() & ~prefix_mask(r->dst_len));
+    uint8_t nw_proto = (r->nw_proto ? r->nw_proto
+                        : random_range(2) ? IP_TYPE_TCP : IP_TYPE_UDP);
+    uint16_t tp_src = (r->has_tp_src ? r->tp_src
+                       : 1024 + random_range(UINT16_MAX - 1024));
+    uint16_t tp_dst = r->has_tp_dst ? r->tp_dst : random_dst_port();
+
+    compose_packet(packet, nw_src, nw_dst, nw_proto, tp_src, tp_dst);
+}
+
+/* Composes in 'packet' a packet from outside the address pools that the
+ * rules are drawn from, which misses every rule that does not wildcard both
+ * addresses. */
+static void
+compose_miss_packet(struct ofpbuf *packet)
+{
+    compose_packet(packet, 0xac100000 | random_uint16(),
+                   0xc6120000 | random_uint16(),
+                   random_range(2) ? IP_TYPE_TCP : IP_TYPE_UDP,
+                   1024 + random_range(UINT16_MAX - 1024),
+                   random_dst_port());
+}
+
+/* Returns a burst length drawn from a Pareto distribution with shape 'a' and
+ * scale 'b', as ClassBench's trace generator does: with the defaults, most
+ * bursts are a single packet but a few are very long. */
+static unsigned int
+burst_length(double a, double b)
+{
+    double u = (random_uint32() + 1.0) / (UINT32_MAX + 2.0);
+    double x = ceil(b / pow(u, 1.0 / a));
+
+    return x < UINT16_MAX ? (unsigned int) x : UINT16_MAX;
+}
+
+static unsigned int
+write_trace(const char *prefix, unsigned int n_packets, int miss,
+            double pareto_a, double pareto_b)
+{
+    char *pcap_name = xasprintf("%s.pcap", prefix);
+    unsigned int n_bursts, i;
+    struct ofpbuf packet;
+    struct timeval tv;
+    FILE *pcap;
+
+    pcap = pcap_open(pcap_name, "wb");
+    if (!pcap) {
+        ofp_fatal(errno, "%s: create", pcap_name);
+    }
+
+    ofpbuf_init(&packet, ETH_TOTAL_MIN);
+    n_bursts = 0;
+    for (i = 0; i < n_packets; ) {
+        unsigned int n = MIN(burst_length(pareto_a, pareto_b),
+                             n_packets - i);
+
+        if (random_range(100) < miss) {
+            compose_miss_packet(&packet);
+        } else {
+            compose_rule_packet(&packet, &rules[random_range(n_rules)]);
+        }
+        for (; n > 0; n--, i++) {
+            /* A packet a microsecond, so that the trace replays in order. */
+            tv.tv_sec = i / 1000000;
+            tv.tv_usec = i % 1000000;
+            pcap_write_at(pcap, &packet, &tv);
+        }
+        n_bursts++;
+    }
+    ofpbuf_uninit(&packet);
+
+    if (fclose(pcap)) {
+        ofp_fatal(errno, "%s: write", pcap_name);
+    }
+    free(pcap_name);
+    return n_bursts;
+}
+
+/* Returns the number of distinct combinations of fields that the rules
+ * match on, which is the number of subtables that tuple space search
+ * needs. */
+static unsigned int
+count_tuples(void)
+{
+    unsigned long *seen = bitmap_allocate(33 * 33 * 2 * 2 * 2);
+    unsigned int n_tuples = 0;
+    unsigned int i;
+
+    for (i = 0; i < n_rules; i++) {
+        const struct rule *r = &rules[i];
+        size_t idx = ((((r->src_len * 33 + r->dst_len) * 2
+                        + (r->nw_proto != 0)) * 2 + r->has_tp_src) * 2
+                      + r->has_tp_dst);
+        if (!bitmap_is_set(seen, idx)) {
+            bitmap_set1(seen, idx);
+            n_tuples++;
+        }
+    }
+    bitmap_free(seen);
+    return n_tuples;
+}
+
+int
+main(int argc, char *argv[])
+{
+    static const struct option long_options[] = {
+        {"rules",    required_argument, 0, 'r'},
+        {"packets",  required_argument, 0, 'p'},
+        {"profile",  required_argument, 0, 'P'},
+        {"overlap",  required_argument, 0, 'o'},
+        {"miss",     required_argument, 0, 'm'},
+        {"pareto-a", required_argument, 0, 'a'},
+        {"pareto-b", required_argument, 0, 'b'},
+        {"seed",     required_argument, 0, 's'},
+        {"help",     no_argument, 0, 'h'},
+        {0, 0, 0, 0},
+    };
+    const struct profile *profile = &profiles[0];
+    unsigned int n = 10000, n_packets = 100000;
+    double pareto_a = 1.0, pareto_b = 0.1;
+    int overlap = 10, miss = 0;
+    uint32_t seed = 1;
+    unsigned int n_bursts;
+    const char *prefix;
+    size_t i;
+
+    set_program_name(argv[0]);
+    for (;;) {
+        int c = getopt_long(argc, argv, "r:p:P:o:m:a:b:s:h", long_options,
+                            NULL);
+        if (c == -1) {
+            break;
+        }
+        switch (c) {
+        case 'r':
+            if (atoi(optarg) <= 0) {
+                ofp_fatal(0, "number of rules must be positive");
+            }
+            n = atoi(optarg);
+            break;
+        case 'p':
+            if (atoi(optarg) <= 0) {
+                ofp_fatal(0, "number of packets must be positive");
+            }
+            n_packets = atoi(optarg);
+            break;
+        case 'P':
+            for (i = 0; i < ARRAY_SIZE(profiles); i++) {
+                if (!strcmp(optarg, profiles[i].name)) {
+                    break;
+                }
+            }
+            if (i >= ARRAY_SIZE(profiles)) {
+                ofp_fatal(0, "unknown profile %s (use acl, fw, or ipc)",
+                          optarg);
+            }
+            profile = &profiles[i];
+            break;
+        case 'o':
+            overlap = atoi(optarg);
+            if (overlap < 0 || overlap > 100) {
+                ofp_fatal(0, "overlap must be between 0 and 100");
+            }
+            break;
+        case 'm':
+            miss = atoi(optarg);
+            if (miss < 0 || miss > 100) {
+                ofp_fatal(0, "miss percentage must be between 0 and 100");
+            }
+            break;
+        case 'a':
+            pareto_a = atof(optarg);
+            if (pareto_a <= 0) {
+                ofp_fatal(0, "Pareto shape must be positive");
+            }
+            break;
+        case 'b':
+            pareto_b = atof(optarg);
+            if (pareto_b <= 0) {
+                ofp_fatal(0, "Pareto scale must be positive");
+            }
+            break;
+        case 's':
+            seed = strtoul(optarg, NULL, 10);
+            break;
+        case 'h':
+            usage();
+        case '?':
+            exit(EXIT_FAILURE);
+        default:
+            abort();
+        }
+    }
+    if (argc - optind != 1) {
+        ofp_fatal(0, "exactly one output file prefix required; "
+                  "use --help for usage");
+    }
+    prefix = argv[optind];
+
+    random_set_seed(seed);
+    generate_rules(n, profile, overlap);
+    write_rules(prefix);
+    n_bursts = write_trace(prefix, n_packets, miss, pareto_a, pareto_b);
+
+    printf("%u %s rules in %u tuples written to %s.txt and %s.bin\n",
+           n_rules, profile->name, count_tuples(), prefix, prefix);
+    printf("%u packets in %u bursts written to %s.pcap\n",
+           n_packets, n_bursts, prefix);
+    return 0;
+}
@@ -0,0 +1,583 @@
+/* Microbenchmarks for the forwarding and control paths' hot spots: packet
+ * parsing, hashing, flow lookup, action execution, buffer allocation, hash
+ * maps and the OpenFlow stream transport.
+ *
+ * Each benchmark runs several times and reports its fastest run, one line
+ * per benchmark:
+ *
+ *     NAME N_OPS NS_PER_OP
+ *
+ * Given a file saved from an earlier run with --baseline, it appends the
+ * baseline's ns/op and the relative change to each line, and exits with
+ * status 1 if any benchmark got slower by more than --tolerance percent.
+ *
+ * usage: bench-micro [OPTIONS] [BENCHMARK...] */
+
+#include <config.h>
+#include <errno.h>
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/time.h>
+#include "chain.h"
+#include "crc32.h"
+#include "datapath.h"
+#include "dp_act.h"
+#include "flow.h"
+#include "hash.h"
+#include "hmap.h"
+#include "ofpbuf.h"
+#include "openflow/openflow.h"
+#include "packets.h"
+#include "pktbuf.h"
+#include "random.h"
+#include "switch-flow.h"
+#include "timeval.h"
+#include "util.h"
+#include "vconn.h"
+
+struct benchmark {
+    const char *name;
+    unsigned int n_ops;         /* Operations per run. */
+    void (*run)(unsigned int n_ops);
+};
+
+/* Number of rules loaded for the chain-lookup benchmark and number of
+ * entries in the hmap benchmarks. */
+#define N_RULES 10000
+
+/* A UDP packet of typical size, built once by make_packet(). */
+static struct ofpbuf *packet;
+
+/* Keeps the compiler from discarding results that are otherwise unused. */
+static volatile unsigned int sink;
+
+static double
+now_ns(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1e9 + tv.tv_usec * 1e3;
+}
+
+static void
+make_packet(void)
+{
+    struct eth_header *eth;
+    struct ip_header *ip;
+    struct udp_header *udp;
+    size_t payload = 64;
+
+    packet = ofpbuf_new(DP_RX_HEADROOM + ETH_HEADER_LEN + IP_HEADER_LEN
+                        + UDP_HEADER_LEN + payload);
+    ofpbuf_reserve(packet, DP_RX_HEADROOM);
+
+    eth = ofpbuf_put_zeros(packet, sizeof *eth);
+    memcpy(eth->eth_dst, "\x00\x11\x22\x33\x44\x55", ETH_ADDR_LEN);
+    memcpy(eth->eth_src, "\x00\x66\x77\x88\x99\xaa", ETH_ADDR_LEN);
+    eth->eth_type = htons(ETH_TYPE_IP);
+
+    ip = ofpbuf_put_zeros(packet, sizeof *ip);
+    ip->ip_ihl_ver = IP_IHL_VER(5, IP_VERSION);
+    ip->ip_tot_len = htons(IP_HEADER_LEN + UDP_HEADER_LEN + payload);
+    ip->ip_ttl = 64;
+    ip->ip_proto = IP_TYPE_UDP;
+    ip->ip_src = htonl(0x0a000001);
+    ip->ip_dst = htonl(0xc0a80001);
+
+    udp = ofpbuf_put_zeros(packet, sizeof *udp);
+    udp->udp_src = htons(5000);
+    udp->udp_dst = htons(53);
+    udp->udp_len = htons(UDP_HEADER_LEN + payload);
+
+    ofpbuf_put_zeros(packet, payload);
+}
+
+static void
+bench_flow_extract(unsigned int n_ops)
+{
+    struct flow flow;
+    unsigned int i;
+
+    for (i = 0; i < n_ops; i++) {
+        flow_extract(packet, 1, &flow);
+        sink += flow.tp_dst;
+    }
+}
+
+static void
+bench_crc32(unsigned int n_ops)
+{
+    static struct crc32 crc;
+    unsigned int i;
+
+    crc32_init(&crc, CRC32C_POLYNOMIAL);
+    for (i = 0; i < n_ops; i++) {
+        sink += crc32_calculate(&crc, packet->data, packet->size);
+    }
+}
+
+/* Fields that wildcarded rules match on, as in bench-tables. */
+static const uint32_t rule_patterns[] = {
+    OFPFW_ALL & ~(OFPFW_DL_TYPE | OFPFW_NW_PROTO | OFPFW_NW_SRC_MASK
+                  | OFPFW_NW_DST_MASK | OFPFW_TP_SRC | OFPFW_TP_DST),
+    OFPFW_ALL & ~(OFPFW_DL_SRC | OFPFW_DL_DST),
+    OFPFW_ALL & ~(OFPFW_IN_PORT | OFPFW_DL_VLAN),
+    (OFPFW_ALL & ~(OFPFW_DL_TYPE | OFPFW_NW_DST_MASK))
+    | (8 << OFPFW_NW_DST_SHIFT),
+};
+
+static void
+random_match(struct ofp_match *m)
+{
+    memset(m, 0, sizeof *m);
+    m->in_port = htons(1 + random_range(48));
+    random_bytes(m->dl_src, sizeof m->dl_src);
+    m->dl_src[0] &= ~1;
+    random_bytes(m->dl_dst, sizeof m->dl_dst);
+    m->dl_dst[0] &= ~1;
+    m->dl_vlan = htons(OFP_VLAN_NONE);
+    m->dl_type = htons(ETH_TYPE_IP);
+    m->nw_proto = random_range(2) ? IP_TYPE_TCP : IP_TYPE_UDP;
+    m->nw_src = htonl(0x0a000000 | random_range(1 << 24));
+    m->nw_dst = htonl(0xc0000000 | random_range(1 << 24));
+    m->tp_src = htons(1024 + random_range(60000));
+    m->tp_dst = htons(random_range(1024));
+}
+
+/* Loads N_RULES rules into the default tables of a datapath, three quarters
+ * exact-match and the rest spread over the wildcard patterns above, then
+ * looks up packets that hit them in random order.  The rules are loaded on
+ * the first run only, so that later runs time just the lookups. */
+static void
+bench_chain_lookup(unsigned int n_ops)
+{
+    static struct sw_flow_key *keys;
+    static struct datapath *dp;
+    unsigned int i;
+
+    if (!dp) {
+        int error = dp_new(&dp, 1, NULL, PKTBUF_DEFAULT_BUFFERS);
+        if (error) {
+            ofp_fatal(error, "could not create datapath");
+        }
+
+        keys = xmalloc(N_RULES * sizeof *keys);
+        for (i = 0; i < N_RULES; i++) {
+            struct ofp_match m;
+            struct sw_flow *flow;
+
+            random_match(&m);
+            flow_extract_match(&keys[i], &m);
+
+            flow = flow_alloc(0);
+            if (i % 4) {
+                flow->key = keys[i];
+                flow->priority = -1;
+            } else {
+                size_t pattern = i / 4 % ARRAY_SIZE(rule_patterns);
+
+                m.wildcards = htonl(rule_patterns[pattern]);
+                flow_extract_match(&flow->key, &m);
+                flow->priority = OFP_DEFAULT_PRIORITY;
+            }
+            flow_setup_actions(flow, NULL, 0);
+            if (chain_insert(dp->chain, flow, 0)) {
+                flow_free(flow);
+            }
+        }
+    }
+
+    for (i = 0; i < n_ops; i++) {
+        sink += chain_lookup(dp->chain, &keys[random_range(N_RULES)], 0, 0)
+                != NULL;
+    }
+}
+
+/* Actions that rewrite the Ethernet, IP and transport headers. */
+static struct ofpbuf *
+make_rewrite_actions(void)
+{
+    struct ofp_action_dl_addr *dl;
+    struct ofp_action_nw_addr *nw;
+    struct ofp_action_tp_port *tp;
+    struct ofpbuf *actions = ofpbuf_new(64);
+
+    dl = ofpbuf_put_zeros(actions, sizeof *dl);
+    dl->type = htons(OFPAT_SET_DL_DST);
+    dl->len = htons(sizeof *dl);
+    memcpy(dl->dl_addr, "\x00\x01\x02\x03\x04\x05", ETH_ADDR_LEN);
+
+    nw = ofpbuf_put_zeros(actions, sizeof *nw);
+    nw->type = htons(OFPAT_SET_NW_DST);
+    nw->len = htons(sizeof *nw);
+    nw->nw_addr = htonl(0xc0a80002);
+
+    tp = ofpbuf_put_zeros(actions, sizeof *tp);
+    tp->type = htons(OFPAT_SET_TP_DST);
+    tp->len = htons(sizeof *tp);
+    tp->tp_port = htons(5353);
+
+    return actions;
+}
+
+/* Both action benchmarks include copying the packet, since executing
+ * actions consumes it. */
+static void
+bench_execute_actions(unsigned int n_ops)
+{
+    struct ofpbuf *actions = make_rewrite_actions();
+    struct sw_flow_key key;
+    unsigned int i;
+
+    key.wildcards = 0;
+    flow_extract(packet, 1, &key.flow);
+    for (i = 0; i < n_ops; i++) {
+        struct ofpbuf *buffer = ofpbuf_clone(packet);
+        flow_extract(buffer, 1, &key.flow);
+        execute_actions(NULL, buffer, &key, actions->data, actions->size,
+                        false);
+    }
+    ofpbuf_delete(actions);
+}
+
+static void
+bench_execute_compiled(unsigned int n_ops)
+{
+    struct ofpbuf *actions = make_rewrite_actions();
+    struct sw_flow_key key;
+    struct sw_flow *flow;
+    unsigned int i;
+
+    flow = flow_alloc(actions->size);
+    flow_setup_actions(flow, actions->data, actions->size);
+    key.wildcards = 0;
+    for (i = 0; i < n_ops; i++) {
+        struct ofpbuf *buffer = ofpbuf_clone(packet);
+        flow_extract(buffer, 1, &key.flow);
+        execute_flow_actions(NULL, buffer, &key, flow->sf_acts, false);
+    }
+    flow_free(flow);
+    ofpbuf_delete(actions);
+}
+
+static void
+bench_ofpbuf(unsigned int n_ops)
+{
+    unsigned int i;
+
+    for (i = 0; i < n_ops; i++) {
+        struct ofpbuf *buffer = ofpbuf_new(DP_RX_HEADROOM + ETH_TOTAL_MAX);
+        ofpbuf_reserve(buffer, DP_RX_HEADROOM);
+        ofpbuf_put(buffer, packet->data, packet->size);
+        sink += buffer->size;
+        ofpbuf_delete(buffer);
+    }
+}
+
+struct bench_node {
+    struct hmap_node node;
+    uint32_t value;
+};
+
+static struct bench_node *
+make_nodes(void)
+{
+    struct bench_node *nodes = xmalloc(N_RULES * sizeof *nodes);
+    unsigned int i;
+
+    for (i = 0; i < N_RULES; i++) {
+        nodes[i].value = random_uint32();
+    }
+    return nodes;
+}
+
+static void
+bench_hmap_insert(unsigned int n_ops)
+{
+    struct bench_node *nodes = make_nodes();
+    unsigned int i;
+
+    for (i = 0; i < n_ops; i += N_RULES) {
+        struct hmap map;
+        unsigned int j;
+
+        hmap_init(&map);
+        for (j = 0; j < N_RULES; j++) {
+            hmap_insert(&map, &nodes[j].node,
+                        hash_words(&nodes[j].value, 1, 0));
+        }
+        sink += hmap_count(&map);
+        hmap_destroy(&map);
+    }
+    free(nodes);
+}
+
+static void
+bench_hmap_lookup(unsigned int n_ops)
+{
+    struct bench_node *nodes = make_nodes();
+    struct hmap map;
+    unsigned int i;
+
+    hmap_init(&map);
+    for (i = 0; i < N_RULES; i++) {
+        hmap_insert(&map, &nodes[i].node, hash_words(&nodes[i].value, 1, 0));
+    }
+    for (i = 0; i < n_ops; i++) {
+        uint32_t value = nodes[random_range(N_RULES)].value;
+        struct bench_node *node;
+
+        HMAP_FOR_EACH_WITH_HASH (node, struct bench_node, node,
+                                 hash_words(&value, 1, 0), &map) {
+            if (node->value == value) {
+                sink++;
+                break;
+            }
+        }
+    }
+    hmap_destroy(&map);
+    free(nodes);
+}
+
+/* Sends an echo request from one end of a connected pair of Unix domain
+ * stream vconns and receives it at the other. */
+static void
+bench_vconn_stream(unsigned int n_ops)
+{
+    struct vconn *vconns[2];
+    struct pvconn *pvconn;
+    char *path, *name;
+    unsigned int i;
+    int error;
+
+    path = xasprintf("/tmp/bench-micro.%ld", (long int) getpid());
+    name = xasprintf("punix:%s", path);
+    error = pvconn_open(name, &pvconn);
+    if (error) {
+        ofp_fatal(error, "%s: listen failed", name);
+    }
+    error = vconn_open(name + 1, OFP_VERSION, &vconns[0]);
+    if (error) {
+        ofp_fatal(error, "%s: connect failed", name + 1);
+    }
+    do {
+        error = pvconn_accept(pvconn, OFP_VERSION, &vconns[1]);
+    } while (error == EAGAIN);
+    if (error) {
+        ofp_fatal(error, "%s: accept failed", name);
+    }
+    pvconn_close(pvconn);
+    unlink(path);
+
+    /* Exchange hellos. */
+    do {
+        error = vconn_connect(vconns[0]);
+        if (!error || error == EAGAIN) {
+            int error1 = vconn_connect(vconns[1]);
+            if (!error) {
+                error = error1;
+            }
+        }
+    } while (error == EAGAIN);
+    if (error) {
+        ofp_fatal(error, "could not connect stream vconns");
+    }
+
+    for (i = 0; i < n_ops; i++) {
+        struct ofpbuf *msg = make_echo_request();
+
+        error = vconn_send(vconns[0], msg);
+        if (error) {
+            ofp_fatal(error, "send failed");
+        }
+        do {
+            error = vconn_recv(vconns[1], &msg);
+        } while (error == EAGAIN);
+        if (error) {
+            ofp_fatal(error, "receive failed");
+        }
+        ofpbuf_delete(msg);
+    }
+    vconn_close(vconns[0]);
+    vconn_close(vconns[1]);
+    free(name);
+    free(path);
+}
+
+static const struct benchmark benchmarks[] = {
+    { "flow-extract",     10000000, bench_flow_extract },
+    { "crc32",            10000000, bench_crc32 },
+    { "chain-lookup",      5000000, bench_chain_lookup },
+    { "execute-actions",   5000000, bench_execute_actions },
+    { "execute-compiled",  5000000, bench_execute_compiled },
+    { "ofpbuf",           10000000, bench_ofpbuf },
+    { "hmap-insert",       5000000, bench_hmap_insert },
+    { "hmap-lookup",      10000000, bench_hmap_lookup },
+    { "vconn-stream",      1000000, bench_vconn_stream },
+};
+
+/* Returns the ns/op recorded for 'name' in baseline file 'file_name', or a
+ * negative number if it has none. */
+static double
+baseline_ns(const char *file_name, const char *name)
+{
+    char line[256];
+    double result = -1;
+    FILE *file;
+
+    file = fopen(file_name, "r");
+    if (!file) {
+        ofp_fatal(errno, "%s: open", file_name);
+    }
+    while (fgets(line, sizeof line, file)) {
+        char base_name[64];
+        unsigned int n_ops;
+        double ns;
+
+        if (line[0] != '#'
+            && sscanf(line, "%63s %u %lf", base_name, &n_ops, &ns) == 3
+            && !strcmp(base_name, name)) {
+            result = ns;
+            break;
+        }
+    }
+    fclose(file);
+    return result;
+}
+
+static bool
+is_selected(const char *name, char *argv[], int argc)
+{
+    int i;
+
+    if (!argc) {
+        return true;
+    }
+    for (i = 0; i < argc; i++) {
+        if (!strcmp(argv[i], name)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void
+usage(void)
+{
+    size_t i;
+
+    printf("%s: microbenchmarks for OpenFlow hot paths\n"
+           "usage: %s [OPTIONS] [BENCHMARK...]\n"
+           "  -b, --baseline=FILE  compare against results saved in FILE\n"
+           "  -t, --tolerance=PCT  slowdown that counts as a regression "
+           "(default: 10)\n"
+           "  -r, --runs=N         run each benchmark N times (default: 3)\n"
+           "  -s, --scale=FACTOR   multiply operation counts by FACTOR\n"
+           "Benchmarks:",
+           program_name, program_name);
+    for (i = 0; i < ARRAY_SIZE(benchmarks); i++) {
+        printf(" %s", benchmarks[i].name);
+    }
+    putchar('\n');
+    exit(EXIT_SUCCESS);
+}
+
+int
+main(int argc, char *argv[])
+{
+    static const struct option long_options[] = {
+        {"baseline",  required_argument, 0, 'b'},
+        {"tolerance", required_argument, 0, 't'},
+        {"runs",      required_argument, 0, 'r'},
+        {"scale",     required_argument, 0, 's'},
+        {"help",      no_argument, 0, 'h'},
+        {0, 0, 0, 0},
+    };
+    const char *baseline = NULL;
+    double tolerance = 10;
+    double scale = 1;
+    int n_runs = 3;
+    int n_regressions;
+    size_t i;
+
+    set_program_name(argv[0]);
+    time_init();
+    for (;;) {
+        int c = getopt_long(argc, argv, "b:t:r:s:h", long_options, NULL);
+        if (c == -1) {
+            break;
+        }
+        switch (c) {
+        case 'b':
+            baseline = optarg;
+            break;
+        case 't':
+            tolerance = atof(optarg);
+            break;
+        case 'r':
+            n_runs = atoi(optarg);
+            if (n_runs <= 0) {
+                ofp_fatal(0, "number of runs must be positive");
+            }
+            break;
+        case 's':
+            scale = atof(optarg);
+            if (scale <= 0) {
+                ofp_fatal(0, "scale must be positive");
+            }
+            break;
+        case 'h':
+            usage();
+        case '?':
+            exit(EXIT_FAILURE);
+        default:
+            abort();
+        }
+    }
+
+    make_packet();
+    printf("# name ops ns/op%s\n", baseline ? " baseline-ns/op change" : "");
+    n_regressions = 0;
+    for (i = 0; i < ARRAY_SIZE(benchmarks); i++) {
+        const struct benchmark *b = &benchmarks[i];
+        unsigned int n_ops = MAX(b->n_ops * scale, 1);
+        double best = 0;
+        int j;
+
+        if (!is_selected(b->name, argv + optind, argc - optind)) {
+            continue;
+        }
+        for (j = 0; j < n_runs; j++) {
+            double start = now_ns();
+            double ns;
+
+            b->run(n_ops);
+            ns = (now_ns() - start) / n_ops;
+            if (!j || ns < best) {
+                best = ns;
+            }
+        }
+
+        printf("%s %u %.2f", b->name, n_ops, best);
+        if (baseline) {
+            double base = baseline_ns(baseline, b->name);
+            if (base > 0) {
+                double change = (best - base) / base * 100;
+                printf(" %.2f %+.1f%%", base, change);
+                if (change > tolerance) {
+                    printf(" REGRESSION");
+                    n_regressions++;
+                }
+            }
+        }
+        putchar('\n');
+        fflush(stdout);
+    }
+    return n_regressions ? 1 : 0;
+}
@@ -0,0 +1,319 @@
+/* End-to-end forwarding benchmark for udatapath.  Creates a datapath,
+ * preloads it with flows, and then replays the packets in a pcap file through
+ * it as if they had arrived on a port, the same way fwd_port_input() handles
+ * them.  Prints the overall packet rate and the average cost of each stage of
+ * the forwarding path.
+ *
+ * usage: bench-replay [-f FLOWS] [-i PORT] [-r ROUNDS] [-t TABLES] PCAP
+ *
+ * FLOWS is a file of flows in the format accepted by "dpctl add-flows", or a
+ * binary flow file such as "dpctl flows-to-binary" and "bench-gen" write.
+ * TABLES is a flow table list in the format accepted by "ofdatapath
+ * --tables".  There are no real ports, so output actions go as far as
+ * looking up the port and stop short of a system call. */
+
+#include <config.h>
+#include <errno.h>
+#include <getopt.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include "chain.h"
+#include "datapath.h"
+#include "dp_act.h"
+#include "flow.h"
+#include "flow-file.h"
+#include "ofp-parse.h"
+#include "ofpbuf.h"
+#include "pcap.h"
+#include "pktbuf.h"
+#include "switch-flow.h"
+#include "timeval.h"
+#include "util.h"
+#include "vconn.h"
+
+/* Stages of the forwarding path, timed separately. */
+enum stage {
+    STAGE_EXTRACT,              /* flow_extract_layers(). */
+    STAGE_LOOKUP,               /* chain_lookup(). */
+    STAGE_ACTIONS,              /* Actions, including output, for a hit. */
+    STAGE_MISS,                 /* dp_output_control(), for a miss. */
+    N_STAGES
+};
+
+static const char *stage_names[N_STAGES] = {
+    "extract", "lookup", "actions", "miss"
+};
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CYCLE_UNIT "cycles"
+static inline uint64_t
+read_cycles(void)
+{
+    uint32_t lo, hi;
+
+    asm volatile("rdtsc" : "=a" (lo), "=d" (hi));
+    return ((uint64_t) hi << 32) | lo;
+}
+#else
+#define CYCLE_UNIT "us"
+static inline uint64_t
+read_cycles(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000000ULL + tv.tv_usec;
+}
+#endif
+
+static void
+usage(void)
+{
+    printf("%s: replay a pcap file through udatapath's forwarding path\n"
+           "usage: %s [OPTIONS] PCAP\n"
+           "  -f, --flows=FILE     preload flows from FILE (dpctl syntax)\n"
+           "  -i, --in-port=PORT   input port for every packet (default: 1)\n"
+           "  -r, --rounds=N       replay the file N times (default: 100)\n"
+           "  -t, --tables=LIST    flow tables as for ofdatapath --tables\n",
+           program_name, program_name);
+    exit(EXIT_SUCCESS);
+}
+
+static void
+load_flows(struct datapath *dp, const char *file_name)
+{
+    struct ofpbuf *msg;
+    int n_flows, n_errors;
+    FILE *file;
+
+    file = fopen(file_name, "r");
+    if (!file) {
+        ofp_fatal(errno, "%s: open", file_name);
+    }
+    n_flows = n_errors = 0;
+    if (flow_file_is_binary(file)) {
+        const struct ofp_flow_mod *ofm;
+        struct flow_file ff;
+        size_t length;
+        int error;
+
+        error = flow_file_open(file_name, &ff);
+        if (error) {
+            ofp_fatal(error, "%s: could not read flow file", file_name);
+        }
+        while (!(error = flow_file_next(&ff, &ofm, &length))) {
+            if (fwd_control_input(dp, NULL, ofm, length)) {
+                n_errors++;
+            }
+            n_flows++;
+        }
+        if (error != EOF) {
+            ofp_fatal(0, "%s: flow file is truncated or corrupt", file_name);
+        }
+        flow_file_close(&ff);
+    } else {
+        while ((msg = parse_ofp_add_flow_file(file, NULL)) != NULL) {
+            update_openflow_length(msg);
+            if (fwd_control_input(dp, NULL, msg->data, msg->size)) {
+                n_errors++;
+            }
+            n_flows++;
+            ofpbuf_delete(msg);
+        }
+    }
+    fclose(file);
+    printf("loaded %d flows from %s", n_flows, file_name);
+    if (n_errors) {
+        printf(" (%d rejected)", n_errors);
+    }
+    putchar('\n');
+}
+
+static struct ofpbuf **
+load_packets(const char *file_name, int *n_packetsp)
+{
+    struct ofpbuf **packets;
+    int n_packets, allocated;
+    FILE *pcap;
+    int error;
+
+    pcap = pcap_open(file_name, "rb");
+    if (!pcap) {
+        ofp_fatal(errno, "%s: open", file_name);
+    }
+
+    packets = NULL;
+    n_packets = allocated = 0;
+    for (;;) {
+        struct ofpbuf *packet;
+
+        error = pcap_read(pcap, &packet);
+        if (error) {
+            break;
+        }
+        if (n_packets >= allocated) {
+            allocated = allocated ? allocated * 2 : 64;
+            packets = xrealloc(packets, allocated * sizeof *packets);
+        }
+        packets[n_packets++] = packet;
+    }
+    if (error != EOF) {
+        ofp_fatal(error, "%s: read failed", file_name);
+    }
+    fclose(pcap);
+    if (!n_packets) {
+        ofp_fatal(0, "%s: no packets", file_name);
+    }
+
+    *n_packetsp = n_packets;
+    return packets;
+}
+
+int
+main(int argc, char *argv[])
+{
+    static const struct option long_options[] = {
+        {"flows",   required_argument, 0, 'f'},
+        {"in-port", required_argument, 0, 'i'},
+        {"rounds",  required_argument, 0, 'r'},
+        {"tables",  required_argument, 0, 't'},
+        {"help",    no_argument, 0, 'h'},
+        {0, 0, 0, 0},
+    };
+    const char *flow_file = NULL;
+    const char *tables = NULL;
+    uint16_t in_port = 1;
+    int n_rounds = 100;
+
+    uint64_t stage_cycles[N_STAGES], stage_count[N_STAGES];
+    struct ofpbuf **packets;
+    struct timeval start, end;
+    struct datapath *dp;
+    enum flow_layer layer;
+    unsigned long long int n_bytes;
+    double elapsed;
+    int n_packets, n_total;
+    int error;
+    int i, j;
+
+    set_program_name(argv[0]);
+    time_init();
+    for (;;) {
+        int c = getopt_long(argc, argv, "f:i:r:t:h", long_options, NULL);
+        if (c == -1) {
+            break;
+        }
+        switch (c) {
+        case 'f':
+            flow_file = optarg;
+            break;
+        case 'i':
+            in_port = atoi(optarg);
+            break;
+        case 'r':
+            n_rounds = atoi(optarg);
+            if (n_rounds <= 0) {
+                ofp_fatal(0, "number of rounds must be positive");
+            }
+            break;
+        case 't':
+            tables = optarg;
+            break;
+        case 'h':
+            usage();
+        case '?':
+            exit(EXIT_FAILURE);
+        default:
+            abort();
+        }
+    }
+    if (argc - optind != 1) {
+        ofp_fatal(0, "exactly one pcap file argument required; "
+                  "use --help for usage");
+    }
+
+    error = dp_new(&dp, 1, tables, PKTBUF_DEFAULT_BUFFERS);
+    if (error) {
+        ofp_fatal(error, "could not create datapath");
+    }
+    if (flow_file) {
+        load_flows(dp, flow_file);
+    }
+    packets = load_packets(argv[optind], &n_packets);
+
+    memset(stage_cycles, 0, sizeof stage_cycles);
+    memset(stage_count, 0, sizeof stage_count);
+    n_bytes = 0;
+    gettimeofday(&start, NULL);
+    for (i = 0; i < n_rounds; i++) {
+        for (j = 0; j < n_packets; j++) {
+            const struct ofpbuf *packet = packets[j];
+            struct sw_flow_key key;
+            struct sw_flow *flow;
+            struct ofpbuf *buffer;
+            uint64_t t0, t1, t2, t3;
+
+            /* Copy the packet into a buffer laid out like one from a port's
+             * receive path, since forwarding modifies and frees it. */
+            buffer = ofpbuf_new(DP_RX_HEADROOM + packet->size);
+            ofpbuf_reserve(buffer, DP_RX_HEADROOM);
+            ofpbuf_put(buffer, packet->data, packet->size);
+            n_bytes += packet->size;
+
+            /* This follows run_flow_through_tables() and fwd_port_input(),
+             * minus the fragment and port configuration checks. */
+            t0 = read_cycles();
+            layer = chain_flow_layer(dp->chain);
+            key.wildcards = 0;
+            flow_extract_layers(buffer, in_port, &key.flow, layer);
+            t1 = read_cycles();
+            flow = chain_lookup(dp->chain, &key, 0, 0);
+            t2 = read_cycles();
+            if (flow) {
+                flow_used(flow, buffer);
+                execute_flow_actions(dp, buffer, &key, flow->sf_acts, false);
+                t3 = read_cycles();
+                stage_cycles[STAGE_ACTIONS] += t3 - t2;
+                stage_count[STAGE_ACTIONS]++;
+            } else {
+                dp_output_control(dp, buffer, in_port, dp->miss_send_len,
+                                  OFPR_NO_MATCH);
+                t3 = read_cycles();
+                stage_cycles[STAGE_MISS] += t3 - t2;
+                stage_count[STAGE_MISS]++;
+            }
+            stage_cycles[STAGE_EXTRACT] += t1 - t0;
+            stage_cycles[STAGE_LOOKUP] += t2 - t1;
+        }
+    }
+    gettimeofday(&end, NULL);
+    stage_count[STAGE_EXTRACT] = stage_count[STAGE_LOOKUP]
+        = (uint64_t) n_rounds * n_packets;
+
+    n_total = n_rounds * n_packets;
+    elapsed = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec)
+              / 1e6;
+    printf("%d packets (%llu bytes) in %.3f s: %.0f packets/s, %.1f Mb/s\n",
+           n_total, n_bytes, elapsed, n_total / elapsed,
+           n_bytes * 8 / elapsed / 1e6);
+    printf("%llu (%.1f%%) matched a flow\n",
+           (unsigned long long int) stage_count[STAGE_ACTIONS],
+           100.0 * stage_count[STAGE_ACTIONS] / n_total);
+    for (i = 0; i < N_STAGES; i++) {
+        if (stage_count[i]) {
+            printf("  %-8s %9.1f %s/packet over %llu packets\n",
+                   stage_names[i],
+                   (double) stage_cycles[i] / stage_count[i], CYCLE_UNIT,
+                   (unsigned long long int) stage_count[i]);
+        }
+    }
+
+    for (j = 0; j < n_packets; j++) {
+        ofpbuf_delete(packets[j]);
+    }
+    free(packets);
+    return 0;
+}
@@ -0,0 +1,362 @@
+/* Microbenchmark for udatapath's flow table implementations.  Loads a rule
+ * set into each kind of sw_table, then times inserting the rules, looking up
+ * packets that hit and miss them, and deleting them again.  Prints the
+ * average cost of each operation and, where the kernel lets us count them,
+ * the number of cache misses per operation.
+ *
+ * usage: bench-tables [N_FLOWS [N_LOOKUPS]] */
+
+#include <config.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#endif
+#include "datapath.h"
+#include "random.h"
+#include "switch-flow.h"
+#include "table.h"
+#include "timeval.h"
+#include "util.h"
+
+/* The tables free and report flows through the datapath.  Nothing here has a
+ * datapath, so these do nothing. */
+void
+dp_output_port(struct datapath *dp UNUSED, struct ofpbuf *buffer UNUSED,
+               int in_port UNUSED, int out_port UNUSED,
+               uint32_t queue_id UNUSED, bool ignore_no_fwd UNUSED)
+{
+}
+
+void
+dp_output_port_shared(struct datapath *dp UNUSED,
+                      const struct ofpbuf *buffer UNUSED, int in_port UNUSED,
+                      int out_port UNUSED, uint32_t queue_id UNUSED,
+                      bool ignore_no_fwd UNUSED)
+{
+}
+
+void
+dp_output_control(struct datapath *dp UNUSED, struct ofpbuf *buffer UNUSED,
+                  int in_port UNUSED, size_t max_len UNUSED,
+                  int reason UNUSED)
+{
+}
+
+void
+dp_send_flow_end(struct datapath *dp UNUSED, struct sw_flow *flow UNUSED,
+                 enum ofp_flow_removed_reason reason UNUSED)
+{
+}
+
+void
+dp_goto_table(struct datapath *dp UNUSED, struct ofpbuf *buffer UNUSED,
+              struct sw_flow_key *key UNUSED, uint8_t table_id UNUSED,
+              bool ignore_no_fwd UNUSED)
+{
+}
+
+struct table_type {
+    const char *name;
+    struct sw_table *(*create)(unsigned int n_flows);
+    bool exact;                 /* Accepts only exact-match flows? */
+    bool linear;                /* Lookup cost grows with the flow count? */
+};
+
+static unsigned int
+round_up_pow2(unsigned int n)
+{
+    unsigned int p = 1;
+    while (p < n) {
+        p <<= 1;
+    }
+    return p;
+}
+
+static struct sw_table *
+create_hash(unsigned int n_flows)
+{
+    return table_hash_create(0x1EDC6F41, round_up_pow2(n_flows * 2));
+}
+
+static struct sw_table *
+create_hash2(unsigned int n_flows)
+{
+    unsigned int n_buckets = round_up_pow2(n_flows);
+    return table_hash2_create(0x1EDC6F41, n_buckets, 0x741B8CD7, n_buckets);
+}
+
+static struct sw_table *
+create_cuckoo(unsigned int n_flows)
+{
+    return table_cuckoo_create(0x1EDC6F41, n_flows * 2);
+}
+
+static struct sw_table *
+create_linear(unsigned int n_flows)
+{
+    return table_linear_create(n_flows);
+}
+
+static struct sw_table *
+create_tss(unsigned int n_flows)
+{
+    return table_tss_create(n_flows);
+}
+
+static struct sw_table *
+create_dtree(unsigned int n_flows)
+{
+    return table_dtree_create(n_flows);
+}
+
+static const struct table_type table_types[] = {
+    { "hash",   create_hash,   true,  false },
+    { "hash2",  create_hash2,  true,  false },
+    { "cuckoo", create_cuckoo, true,  false },
+    { "linear", create_linear, false, true },
+    { "tss",    create_tss,    false, false },
+    { "dtree",  create_dtree,  false, false },
+};
+
+/* Fields that wildcarded rules match on.  Rule i uses pattern i % N, so that
+ * a tuple space search table ends up with one subtable per pattern. */
+static const uint32_t rule_patterns[] = {
+    /* 5-tuple. */
+    OFPFW_ALL & ~(OFPFW_DL_TYPE | OFPFW_NW_PROTO | OFPFW_NW_SRC_MASK
+                  | OFPFW_NW_DST_MASK | OFPFW_TP_SRC | OFPFW_TP_DST),
+    /* Ethernet addresses. */
+    OFPFW_ALL & ~(OFPFW_DL_SRC | OFPFW_DL_DST),
+    /* Input port and VLAN. */
+    OFPFW_ALL & ~(OFPFW_IN_PORT | OFPFW_DL_VLAN),
+    /* IP destination /24. */
+    (OFPFW_ALL & ~(OFPFW_DL_TYPE | OFPFW_NW_DST_MASK))
+    | (8 << OFPFW_NW_DST_SHIFT),
+};
+
+/* Hit and miss packets, and the exact and wildcarded rules derived from the
+ * hit packets. */
+static struct ofp_match *packets, *misses;
+static struct sw_flow_key *hit_keys, *miss_keys, *exact_rules, *wild_rules;
+
+/* Index into 'hit_keys' for each lookup. */
+static unsigned int *lookup_order;
+
+static double
+now_ns(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1e9 + tv.tv_usec * 1e3;
+}
+
+/* Returns a file descriptor that counts cache misses for this process, or -1
+ * if the kernel or the hardware won't count them for us. */
+static int
+open_cache_miss_counter(void)
+{
+#if defined(__linux__) && defined(__NR_perf_event_open)
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof attr;
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+    return -1;
+#endif
+}
+
+static int counter_fd = -1;
+static double phase_start;
+
+static void
+start_phase(void)
+{
+#ifdef __linux__
+    if (counter_fd >= 0) {
+        ioctl(counter_fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(counter_fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+    phase_start = now_ns();
+}
+
+static void
+end_phase(const char *table, const char *phase, unsigned int n_ops,
+          unsigned int n_failed, const char *failure)
+{
+    double ns = (now_ns() - phase_start) / n_ops;
+
+    printf("%-8s %-12s %9u ops %9.1f ns/op", table, phase, n_ops, ns);
+#ifdef __linux__
+    if (counter_fd >= 0) {
+        uint64_t misses;
+
+        ioctl(counter_fd, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(counter_fd, &misses, sizeof misses) == sizeof misses) {
+            printf(" %7.2f misses/op", (double) misses / n_ops);
+        }
+    }
+#endif
+    if (n_failed) {
+        printf(" (%u %s)", n_failed, failure);
+    }
+    putchar('\n');
+}
+
+static void
+random_packet(struct ofp_match *m)
+{
+    memset(m, 0, sizeof *m);
+    m->in_port = htons(1 + random_range(48));
+    random_bytes(m->dl_src, sizeof m->dl_src);
+    m->dl_src[0] &= ~1;         /* Unicast. */
+    random_bytes(m->dl_dst, sizeof m->dl_dst);
+    m->dl_dst[0] &= ~1;
+    m->dl_vlan = htons(random_range(4096));
+    m->dl_type = htons(0x0800);
+    m->nw_proto = random_range(2) ? 6 : 17;
+    m->nw_src = htonl(0x0a000000 | random_range(1 << 24));
+    m->nw_dst = htonl(0xc0000000 | random_range(1 << 24));
+    m->tp_src = htons(1024 + random_range(60000));
+    m->tp_dst = htons(random_range(1024));
+}
+
+static void
+make_key(struct sw_flow_key *key, const struct ofp_match *packet,
+         uint32_t wildcards)
+{
+    struct ofp_match m = *packet;
+
+    m.wildcards = htonl(wildcards);
+    flow_extract_match(key, &m);
+}
+
+static void
+generate(unsigned int n_flows, unsigned int n_lookups)
+{
+    unsigned int i;
+
+    packets = xmalloc(n_flows * sizeof *packets);
+    misses = xmalloc(n_flows * sizeof *misses);
+    hit_keys = xmalloc(n_flows * sizeof *hit_keys);
+    miss_keys = xmalloc(n_flows * sizeof *miss_keys);
+    exact_rules = xmalloc(n_flows * sizeof *exact_rules);
+    wild_rules = xmalloc(n_flows * sizeof *wild_rules);
+    for (i = 0; i < n_flows; i++) {
+        random_packet(&packets[i]);
+        random_packet(&misses[i]);
+        make_key(&hit_keys[i], &packets[i], 0);
+        make_key(&miss_keys[i], &misses[i], 0);
+        exact_rules[i] = hit_keys[i];
+        make_key(&wild_rules[i], &packets[i],
+                 rule_patterns[i % ARRAY_SIZE(rule_patterns)]);
+    }
+
+    lookup_order = xmalloc(n_lookups * sizeof *lookup_order);
+    for (i = 0; i < n_lookups; i++) {
+        lookup_order[i] = random_range(n_flows);
+    }
+}
+
+static void
+bench_table(const struct table_type *type, unsigned int n_flows,
+            unsigned int n_lookups)
+{
+    const struct sw_flow_key *rules = type->exact ? exact_rules : wild_rules;
+    struct sw_table *table = type->create(n_flows);
+    unsigned int n_failed;
+    unsigned int i;
+
+    if (type->linear && n_lookups > 200000000 / n_flows) {
+        /* Keep the run time of an O(n) lookup reasonable. */
+        n_lookups = MAX(200000000 / n_flows, 1000);
+    }
+
+    n_failed = 0;
+    start_phase();
+    for (i = 0; i < n_flows; i++) {
+        struct sw_flow *flow = flow_alloc(0);
+
+        flow->key = rules[i];
+        flow->priority = OFP_DEFAULT_PRIORITY;
+        if (!table->insert(table, flow)) {
+            flow_free(flow);
+            n_failed++;
+        }
+    }
+    end_phase(type->name, "insert", n_flows, n_failed, "rejected");
+
+    if (table->run) {
+        start_phase();
+        table->run(table);
+        end_phase(type->name, "run", 1, 0, NULL);
+    }
+
+    n_failed = 0;
+    start_phase();
+    for (i = 0; i < n_lookups; i++) {
+        if (!table->lookup(table, &hit_keys[lookup_order[i]])) {
+            n_failed++;
+        }
+    }
+    end_phase(type->name, "lookup-hit", n_lookups, n_failed, "missed");
+
+    n_failed = 0;
+    start_phase();
+    for (i = 0; i < n_lookups; i++) {
+        if (table->lookup(table, &miss_keys[lookup_order[i]])) {
+            n_failed++;
+        }
+    }
+    end_phase(type->name, "lookup-miss", n_lookups, n_failed, "hit");
+
+    n_failed = 0;
+    start_phase();
+    for (i = 0; i < n_flows; i++) {
+        if (!table->delete(NULL, table, &rules[i], OFPP_NONE,
+                           OFP_DEFAULT_PRIORITY, 1)) {
+            n_failed++;
+        }
+    }
+    end_phase(type->name, "delete", n_flows, n_failed, "not found");
+
+    table->destroy(table);
+}
+
+int
+main(int argc, char *argv[])
+{
+    unsigned int n_flows = argc > 1 ? atoi(argv[1]) : 10000;
+    unsigned int n_lookups = argc > 2 ? atoi(argv[2]) : 1000000;
+    size_t i;
+
+    set_program_name(argv[0]);
+    time_init();
+    if (!n_flows || !n_lookups) {
+        ofp_fatal(0, "usage: %s [N_FLOWS [N_LOOKUPS]]", program_name);
+    }
+
+    generate(n_flows, n_lookups);
+    counter_fd = open_cache_miss_counter();
+    if (counter_fd < 0) {
+        printf("(cache miss counter unavailable)\n");
+    }
+    for (i = 0; i < ARRAY_SIZE(table_types); i++) {
+        bench_table(&table_types[i], n_flows, n_lookups);
+    }
+    return 0;
+}
@@ -0,0 +1,89 @@
+/* Microbenchmark for the hash functions that udatapath's table-hash can use
+ * to pick a bucket for a flow.  Prints the average cost of hashing one
+ * 'struct flow' with each of them. */
+
+#include <config.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include "crc32.h"
+#include "flow.h"
+#include "random.h"
+
+#define N_FLOWS 1024
+#define N_ROUNDS 4096
+
+static struct flow flows[N_FLOWS];
+
+static double
+now_ns(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1e9 + tv.tv_usec * 1e3;
+}
+
+static uint32_t
+hash_crc32_table(const struct flow *flow, const struct crc32 *crc)
+{
+    return crc32_calculate(crc, flow, sizeof *flow);
+}
+
+static void
+report(const char *name, double start, uint32_t sum)
+{
+    double ns = (now_ns() - start) / ((double) N_FLOWS * N_ROUNDS);
+    printf("%-28s %6.2f ns/hash (checksum %08x)\n", name, ns, sum);
+}
+
+int
+main(void)
+{
+    struct crc32 crc;
+    uint32_t sum;
+    double start;
+    int i, j;
+
+    for (i = 0; i < N_FLOWS; i++) {
+        random_bytes(&flows[i], sizeof flows[i]);
+        memset(flows[i].pad, 0, sizeof flows[i].pad);
+    }
+    crc32_init(&crc, CRC32C_POLYNOMIAL);
+
+    sum = 0;
+    start = now_ns();
+    for (j = 0; j < N_ROUNDS; j++) {
+        for (i = 0; i < N_FLOWS; i++) {
+            sum = sum * 31 + hash_crc32_table(&flows[i], &crc);
+        }
+    }
+    report("crc32 (table, byte-wise)", start, sum);
+
+    sum = 0;
+    start = now_ns();
+    for (j = 0; j < N_ROUNDS; j++) {
+        for (i = 0; i < N_FLOWS; i++) {
+            sum = sum * 31 + flow_hash(&flows[i], 0x741B8CD7);
+        }
+    }
+    report("hash_words (word-wise)", start, sum);
+
+    if (crc32c_hw_supported()) {
+        sum = 0;
+        start = now_ns();
+        for (j = 0; j < N_ROUNDS; j++) {
+            for (i = 0; i < N_FLOWS; i++) {
+                const uint32_t *words = (const uint32_t *) &flows[i];
+                sum = sum * 31 + crc32c_hw_words(words, sizeof flows[i] / 4,
+                                                 0);
+            }
+        }
+        report("crc32c (SSE4.2)", start, sum);
+    } else {
+        printf("crc32c (SSE4.2)              not supported on this CPU\n");
+    }
+
+    return 0;
+}
@@ -14,19 +14,45 @@ udatapath_ofdatapath_SOURCES = \
 	udatapath/datapath.h \
 	udatapath/dp_act.c \
 	udatapath/dp_act.h \
+	udatapath/dp-trace.h \
+	udatapath/latency.c \
+	udatapath/latency.h \
 	udatapath/of_ext_msg.c \
 	udatapath/of_ext_msg.h \
+	udatapath/pending-miss.c \
+	udatapath/pending-miss.h \
+	udatapath/pkt-ring.c \
+	udatapath/pkt-ring.h \
+	udatapath/pktbuf.c \
+	udatapath/pktbuf.h \
+	udatapath/policer.c \
+	udatapath/policer.h \
 	udatapath/udatapath.c \
 	udatapath/private-msg.c \
 	udatapath/private-msg.h \
+	udatapath/rx-threads.c \
+	udatapath/rx-threads.h \
+	udatapath/sampler.c \
+	udatapath/sampler.h \
+	udatapath/shaper.c \
+	udatapath/shaper.h \
+	udatapath/slab.c \
+	udatapath/slab.h \
+	udatapath/snapshot.c \
+	udatapath/snapshot.h \
 	udatapath/switch-flow.c \
 	udatapath/switch-flow.h \
 	udatapath/table.h \
+	udatapath/table-dtree.c \
 	udatapath/table-hash.c \
-	udatapath/table-linear.c
+	udatapath/table-linear.c \
+	udatapath/table-tss.c \
+	udatapath/topk.c \
+	udatapath/topk.h
 
-udatapath_ofdatapath_LDADD = lib/libopenflow.a $(SSL_LIBS) $(FAULT_LIBS)
-udatapath_ofdatapath_CPPFLAGS = $(AM_CPPFLAGS)
+udatapath_ofdatapath_LDADD = secchan/libsecchan.a lib/libopenflow.a \
+	$(SSL_LIBS) $(FAULT_LIBS) $(PTHREAD_LIBS)
+udatapath_ofdatapath_CPPFLAGS = $(AM_CPPFLAGS) -I $(top_srcdir)
 
 EXTRA_DIST += udatapath/ofdatapath.8.in
 DISTCLEANFILES += udatapath/ofdatapath.8
@@ -58,16 +84,41 @@ udatapath_libudatapath_a_SOURCES = \
 	udatapath/datapath.h \
 	udatapath/dp_act.c \
 	udatapath/dp_act.h \
+	udatapath/dp-trace.h \
+	udatapath/latency.c \
+	udatapath/latency.h \
 	udatapath/of_ext_msg.c \
 	udatapath/of_ext_msg.h \
+	udatapath/pending-miss.c \
+	udatapath/pending-miss.h \
+	udatapath/pkt-ring.c \
+	udatapath/pkt-ring.h \
+	udatapath/pktbuf.c \
+	udatapath/pktbuf.h \
+	udatapath/policer.c \
+	udatapath/policer.h \
 	udatapath/udatapath.c \
 	udatapath/private-msg.c \
 	udatapath/private-msg.h \
+	udatapath/rx-threads.c \
+	udatapath/rx-threads.h \
+	udatapath/sampler.c \
+	udatapath/sampler.h \
+	udatapath/shaper.c \
+	udatapath/shaper.h \
+	udatapath/slab.c \
+	udatapath/slab.h \
+	udatapath/snapshot.c \
+	udatapath/snapshot.h \
 	udatapath/switch-flow.c \
 	udatapath/switch-flow.h \
 	udatapath/table.h \
+	udatapath/table-dtree.c \
 	udatapath/table-hash.c \
-	udatapath/table-linear.c
+	udatapath/table-linear.c \
+	udatapath/table-tss.c \
+	udatapath/topk.c \
+	udatapath/topk.h
 
 udatapath_libudatapath_a_CPPFLAGS = $(AM_CPPFLAGS)
 udatapath_libudatapath_a_CPPFLAGS += -DOF_HW_PLAT -DUDATAPATH_AS_LIB -g
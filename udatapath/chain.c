@@ -33,12 +33,22 @@
 
 #include <config.h>
 #include "chain.h"
+#include <arpa/inet.h>
 #include <assert.h>
 #include <errno.h>
+#include <inttypes.h>
+#include <limits.h>
 #include <stdlib.h>
+#include <string.h>
+#include "hash.h"
+#include "packets.h"
 #include "switch-flow.h"
 #include "table.h"
+#include "timeval.h"
 #include "datapath.h"
+#include "dp_act.h"
+#include "dp-trace.h"
+#include "util.h"
 
 #if defined(OF_HW_PLAT)
 #include <openflow/of_hw_api.h>
@@ -66,15 +76,256 @@ static int add_table(struct sw_chain *chain, struct sw_table *table, int emerg)
     return 0;
 }
 
-/* Creates and returns a new chain.  Returns NULL if the chain cannot be
- * created. */
-struct sw_chain *chain_create(struct datapath *dp)
+/* Invalidates every entry in 'chain''s microflow cache.  Must be called
+ * whenever a flow is added to, changed in, or removed from 'chain'. */
+static void
+chain_cache_flush(struct sw_chain *chain)
 {
-    struct sw_chain *chain = calloc(1, sizeof *chain);
+    if (!++chain->mf_serial) {
+        /* The serial number wrapped around, so old entries could look valid
+         * again. */
+        memset(chain->mf_cache, 0, sizeof chain->mf_cache);
+    }
+}
+
+/* Returns the tick (second) at which 'flow' may first have expired, or 0 if
+ * it never expires. */
+static uint64_t
+flow_expiry_tick(const struct sw_flow *flow)
+{
+    uint64_t deadline = UINT64_MAX;
+
+    if (flow->idle_timeout != OFP_FLOW_PERMANENT) {
+        deadline = flow->used + flow->idle_timeout * 1000;
+    }
+    if (flow->hard_timeout != OFP_FLOW_PERMANENT) {
+        deadline = MIN(deadline, flow->created + flow->hard_timeout * 1000);
+    }
+    return deadline == UINT64_MAX ? 0 : deadline / 1000 + 1;
+}
+
+/* Schedules 'flow' to be checked for expiration at 'tick', or as close to it
+ * as the wheel can represent. */
+static void
+wheel_insert(struct sw_chain *chain, struct sw_flow *flow, uint64_t tick)
+{
+    uint64_t max_tick = (chain->next_tick
+                         + (CHAIN_WHEEL_SIZE - 1) * CHAIN_WHEEL_SIZE);
+    struct list *slot;
+
+    if (tick < chain->next_tick) {
+        tick = chain->next_tick;
+    } else if (tick > max_tick) {
+        /* Checking early is harmless: the flow just gets rescheduled. */
+        tick = max_tick;
+    }
+
+    if (tick - chain->next_tick < CHAIN_WHEEL_SIZE) {
+        slot = &chain->wheel[0][tick & CHAIN_WHEEL_MASK];
+    } else {
+        slot = &chain->wheel[1][(tick >> CHAIN_WHEEL_BITS) & CHAIN_WHEEL_MASK];
+    }
+    list_push_back(slot, &flow->timer_node);
+    flow->timer_tick = tick;
+}
+
+/* If 'flow', which was just added to 'chain', matches on any field beyond
+ * layer 2, counts it in 'chain''s 'n_deep_flows' until it is freed.
+ *
+ * flow_extract_match() makes the network and transport fields exact-match
+ * zeros for frame types that do not have them, and a packet parsed only
+ * through layer 2 has zeros there too, so only IP and ARP flows count. */
+static void
+count_deep_flow(struct sw_chain *chain, struct sw_flow *flow)
+{
+    const struct sw_flow_key *key = &flow->key;
+    uint32_t fields;
+
+    if (key->wildcards & OFPFW_DL_TYPE) {
+        return;
+    } else if (key->flow.dl_type == htons(ETH_TYPE_IP)) {
+        fields = (OFPFW_NW_TOS | OFPFW_NW_PROTO
+                  | OFPFW_TP_SRC | OFPFW_TP_DST);
+    } else if (key->flow.dl_type == htons(ETH_TYPE_ARP)) {
+        fields = OFPFW_NW_TOS | OFPFW_NW_PROTO;
+    } else {
+        return;
+    }
+
+    if ((key->wildcards & fields) != fields
+        || key->mask.nw_src || key->mask.nw_dst) {
+        chain->n_deep_flows++;
+        flow->deep_ref = &chain->n_deep_flows;
+    }
+}
+
+/* Makes 'chain''s 'n_complex_flows' count 'flow', which was just added to
+ * 'chain', for as long as its actions do more than output the packet. */
+static void
+count_complex_flow(struct sw_chain *chain, struct sw_flow *flow)
+{
+    flow->complex_ref = &chain->n_complex_flows;
+    if (!act_prog_forward_only(flow->sf_acts->prog)) {
+        chain->n_complex_flows++;
+    }
+}
+
+/* Creates the table described by 'spec', a string of the form
+ * "TYPE[:ARG]...", and stores it in '*tablep'.  '*emergp' is set to 1 if the
+ * table is the emergency table, otherwise to 0.  Returns 0 if successful,
+ * otherwise a negative errno value. */
+static int
+create_table(const char *spec, struct sw_table **tablep, int *emergp)
+{
+    unsigned long int args[3];
+    char *copy, *type, *arg, *save_ptr;
+    int n_args;
+    int error;
+
+    *tablep = NULL;
+    *emergp = 0;
+
+    copy = xstrdup(spec);
+    type = strtok_r(copy, ":", &save_ptr);
+    if (!type) {
+        VLOG_ERR("empty table specification");
+        error = -EINVAL;
+        goto out;
+    }
+    for (n_args = 0; (arg = strtok_r(NULL, ":", &save_ptr)) != NULL;
+         n_args++) {
+        char *tail;
+
+        if (n_args >= ARRAY_SIZE(args)) {
+            VLOG_ERR("%s: too many arguments", spec);
+            error = -EINVAL;
+            goto out;
+        }
+        errno = 0;
+        args[n_args] = strtoul(arg, &tail, 0);
+        if (errno || *tail || !args[n_args] || args[n_args] > UINT_MAX) {
+            VLOG_ERR("%s: \"%s\" is not a positive integer", spec, arg);
+            error = -EINVAL;
+            goto out;
+        }
+    }
+
+    error = 0;
+    if (!strcmp(type, "linear")) {
+        if (n_args > 1) {
+            goto bad_args;
+        }
+        *tablep = table_linear_create(n_args > 0 ? args[0]
+                                      : TABLE_LINEAR_MAX_FLOWS);
+    } else if (!strcmp(type, "emerg")) {
+        if (n_args > 1) {
+            goto bad_args;
+        }
+        *tablep = table_dtree_create(n_args > 0 ? args[0]
+                                     : TABLE_EMERG_MAX_FLOWS);
+        *emergp = 1;
+    } else if (!strcmp(type, "tss")) {
+        if (n_args > 1) {
+            goto bad_args;
+        }
+        *tablep = table_tss_create(n_args > 0 ? args[0]
+                                   : TABLE_TSS_MAX_FLOWS);
+    } else if (!strcmp(type, "dtree")) {
+        if (n_args > 1) {
+            goto bad_args;
+        }
+        *tablep = table_dtree_create(n_args > 0 ? args[0]
+                                     : TABLE_DTREE_MAX_FLOWS);
+    } else if (!strcmp(type, "cuckoo")) {
+        if (n_args > 2) {
+            goto bad_args;
+        }
+        *tablep = table_cuckoo_create(n_args > 1 ? args[1] : 0x1EDC6F41,
+                                      n_args > 0 ? args[0]
+                                      : TABLE_CUCKOO_MAX_FLOWS);
+    } else if (!strcmp(type, "hash") || !strcmp(type, "hash2")) {
+        unsigned int n_buckets = n_args > 0 ? args[0] : TABLE_HASH_MAX_FLOWS;
+
+        if (n_buckets & (n_buckets - 1)) {
+            VLOG_ERR("%s: number of buckets must be a power of 2", spec);
+            error = -EINVAL;
+        } else if (!strcmp(type, "hash")) {
+            if (n_args > 2) {
+                goto bad_args;
+            }
+            *tablep = table_hash_create(n_args > 1 ? args[1] : 0x1EDC6F41,
+                                        n_buckets);
+        } else {
+            *tablep = table_hash2_create(n_args > 1 ? args[1] : 0x1EDC6F41,
+                                         n_buckets,
+                                         n_args > 2 ? args[2] : 0x741B8CD7,
+                                         n_buckets);
+        }
+    } else {
+        VLOG_ERR("%s: unknown table type \"%s\"", spec, type);
+        error = -EINVAL;
+    }
+    if (!error && !*tablep) {
+        error = -ENOMEM;
+    }
+
+out:
+    free(copy);
+    return error;
+
+bad_args:
+    VLOG_ERR("%s: too many arguments for table type \"%s\"", spec, type);
+    free(copy);
+    return -EINVAL;
+}
+
+/* Creates a new chain whose tables are described by 'tables', a
+ * comma-separated list of table specifications in the order in which the
+ * tables should be searched, or CHAIN_DEFAULT_TABLES if 'tables' is null.
+ * Each specification is one of:
+ *
+ *      linear[:MAX_FLOWS]
+ *      tss[:MAX_FLOWS]
+ *      dtree[:MAX_FLOWS]
+ *      cuckoo[:MAX_FLOWS[:POLYNOMIAL]]
+ *      hash[:N_BUCKETS[:POLYNOMIAL]]
+ *      hash2[:N_BUCKETS[:POLYNOMIAL0[:POLYNOMIAL1]]]
+ *      emerg[:MAX_FLOWS]
+ *
+ * "emerg" sets up the decision tree table used for emergency flows; if it
+ * is omitted, a default-sized one is created.
+ *
+ * 'dp' may be null for a chain that is being staged to replace another (see
+ * chain_adopt()).  Such a chain has no hardware table and sends no
+ * flow_removed messages.
+ *
+ * Returns 0 and stores the new chain in '*chainp' if successful, otherwise
+ * returns a negative errno value and stores NULL in '*chainp'. */
+int chain_create(struct datapath *dp, const char *tables,
+                 struct sw_chain **chainp)
+{
+    struct sw_chain *chain;
+    char *copy, *spec, *save_ptr;
+    int error;
+    int i;
+
+    *chainp = NULL;
+    chain = calloc(1, sizeof *chain);
     if (chain == NULL)
-        return NULL;
+        return -ENOMEM;
 
     chain->dp = dp;
+    for (i = 0; i < CHAIN_WHEEL_SIZE; i++) {
+        list_init(&chain->wheel[0][i]);
+        list_init(&chain->wheel[1][i]);
+    }
+    chain->next_tick = chain->last_scan = time_msec() / 1000;
+    hmap_init(&chain->cookies);
+    hmap_init(&chain->out_ports);
+    hmap_init(&chain->overlaps);
+    for (i = 0; i < CHAIN_MAX_TABLES; i++) {
+        list_init(&chain->lru[i]);
+    }
 #if defined(OF_HW_PLAT)
     if (dp && dp->hw_drv) {
         if (add_table(chain, (struct sw_table *)dp->hw_drv, 0) != 0) {
@@ -82,22 +333,102 @@ struct sw_chain *chain_create(struct datapath *dp)
         }
     }
 #endif
-    if (add_table(chain, table_hash2_create(0x1EDC6F41, TABLE_HASH_MAX_FLOWS,
-                                            0x741B8CD7, TABLE_HASH_MAX_FLOWS),
-                                            0)
-        || add_table(chain, table_linear_create(TABLE_LINEAR_MAX_FLOWS), 0)
-        || add_table(chain, table_linear_create(TABLE_LINEAR_MAX_FLOWS), 1)) {
+
+    copy = xstrdup(tables ? tables : CHAIN_DEFAULT_TABLES);
+    error = 0;
+    for (spec = strtok_r(copy, ",", &save_ptr); spec && !error;
+         spec = strtok_r(NULL, ",", &save_ptr)) {
+        struct sw_table *table;
+        int emerg;
+
+        error = create_table(spec, &table, &emerg);
+        if (!error) {
+            if (emerg && chain->emerg_table) {
+                VLOG_ERR("%s: only one emergency table is allowed", spec);
+                table->destroy(table);
+                error = -EINVAL;
+            } else {
+                error = add_table(chain, table, emerg);
+            }
+        }
+    }
+    free(copy);
+
+    if (!error && !chain->emerg_table) {
+        error = add_table(chain, table_dtree_create(TABLE_EMERG_MAX_FLOWS),
+                          1);
+    }
+    if (error) {
         chain_destroy(chain);
-        return NULL;
+        return error;
     }
 
-    return chain;
+    *chainp = chain;
+    return 0;
+}
+
+/* Returns the microflow cache entry for 'key' in 'chain', indexed by
+ * 'rxhash' if it is nonzero (see chain_lookup()). */
+static struct chain_mf_entry *
+mf_entry(struct sw_chain *chain, const struct sw_flow_key *key,
+         uint32_t rxhash)
+{
+    return &chain->mf_cache[(rxhash ? rxhash : flow_hash(&key->flow, 0))
+                            & (CHAIN_MF_CACHE_SIZE - 1)];
+}
+
+/* If 'e' holds a valid result for 'key', counts a hit and returns the flow
+ * that it caches.  Otherwise counts a miss and returns a null pointer. */
+static struct sw_flow *
+mf_lookup(struct sw_chain *chain, const struct chain_mf_entry *e,
+          const struct sw_flow_key *key)
+{
+    if (e->sw_flow && e->serial == chain->mf_serial
+        && flow_equal(&e->flow, &key->flow)) {
+        /* Keep the per-table counters as if we had searched them. */
+        struct sw_table *t;
+        int n = e->table_idx < 0 ? chain->n_tables : e->table_idx + 1;
+        int i;
+
+        for (i = 0; i < n; i++) {
+            chain->tables[i]->n_lookup++;
+        }
+        t = e->table_idx < 0 ? chain->emerg_table
+                             : chain->tables[e->table_idx];
+        if (e->table_idx < 0) {
+            t->n_lookup++;
+        }
+        t->n_matched++;
+        chain->mf_hits++;
+        DP_TRACE3(chain_lookup_hit, e->table_idx, e->sw_flow, 1);
+        return e->sw_flow;
+    }
+    chain->mf_misses++;
+    return NULL;
+}
+
+/* Caches in 'e' that 'key' matched 'flow' in the table with index
+ * 'table_idx', or in the emergency table if 'table_idx' is -1. */
+static void
+mf_store(struct sw_chain *chain, struct chain_mf_entry *e,
+         const struct sw_flow_key *key, struct sw_flow *flow, int table_idx)
+{
+    e->flow = key->flow;
+    e->sw_flow = flow;
+    e->serial = chain->mf_serial;
+    e->table_idx = table_idx;
 }
 
 /* Searches 'chain' for a flow matching 'key', which must not have any wildcard
- * fields.  Returns the flow if successful, otherwise a null pointer. */
+ * fields.  Returns the flow if successful, otherwise a null pointer.
+ *
+ * If 'rxhash' is nonzero, it is a hash of the packet's headers that the
+ * kernel supplied on receive, and it picks the microflow cache entry instead
+ * of hashing 'key'.  The entry's full key is still compared, so a hash that
+ * covers fewer fields than 'key' only costs cache collisions. */
 struct sw_flow *
-chain_lookup(struct sw_chain *chain, const struct sw_flow_key *key, int emerg)
+chain_lookup(struct sw_chain *chain, const struct sw_flow_key *key,
+             uint32_t rxhash, int emerg)
 {
     int i;
 
@@ -109,26 +440,393 @@ chain_lookup(struct sw_chain *chain, const struct sw_flow_key *key, int emerg)
         t->n_lookup++;
         if (flow) {
             t->n_matched++;
+            DP_TRACE3(chain_lookup_hit, -1, flow, 0);
             return flow;
         }
     } else {
+        struct chain_mf_entry *e = mf_entry(chain, key, rxhash);
+        struct sw_flow *flow = mf_lookup(chain, e, key);
+
+        if (flow) {
+            return flow;
+        }
+
         for (i = 0; i < chain->n_tables; i++) {
             struct sw_table *t = chain->tables[i];
-            struct sw_flow *flow = t->lookup(t, key);
+            flow = t->lookup(t, key);
             t->n_lookup++;
             if (flow) {
                 t->n_matched++;
+                mf_store(chain, e, key, flow, i);
+                DP_TRACE3(chain_lookup_hit, i, flow, 0);
                 return flow;
             }
         }
+
+        if (chain->emerg_active) {
+            struct sw_table *t = chain->emerg_table;
+            flow = t->lookup(t, key);
+            t->n_lookup++;
+            if (flow) {
+                t->n_matched++;
+                mf_store(chain, e, key, flow, -1);
+                DP_TRACE3(chain_lookup_hit, -1, flow, 0);
+                return flow;
+            }
+        }
+    }
+
+    DP_TRACE1(chain_lookup_miss, ntohs(key->flow.in_port));
+    return NULL;
+}
+
+/* Looks up the keys still listed in 'keys' (the first '*n' of them) in 't',
+ * with index 'table_idx' in 'chain' or -1 for the emergency table.  Stores
+ * each match in 'flows' at the index given by the parallel 'idx' array, and
+ * in the microflow cache entry in the parallel 'entries' array, and removes
+ * the keys that matched from the lists. */
+static void
+lookup_batch_in_table(struct sw_chain *chain, struct sw_table *t,
+                      int table_idx, const struct sw_flow_key *keys[],
+                      struct chain_mf_entry *entries[], size_t idx[],
+                      size_t *n, struct sw_flow *flows[])
+{
+    struct sw_flow *found[TABLE_LOOKUP_BATCH];
+    size_t i, n_left;
+
+    if (t->lookup_batch) {
+        t->lookup_batch(t, keys, found, *n);
+    } else {
+        for (i = 0; i < *n; i++) {
+            found[i] = t->lookup(t, keys[i]);
+        }
+    }
+    t->n_lookup += *n;
+
+    n_left = 0;
+    for (i = 0; i < *n; i++) {
+        if (found[i]) {
+            t->n_matched++;
+            flows[idx[i]] = found[i];
+            mf_store(chain, entries[i], keys[i], found[i], table_idx);
+            DP_TRACE3(chain_lookup_hit, table_idx, found[i], 0);
+        } else {
+            keys[n_left] = keys[i];
+            entries[n_left] = entries[i];
+            idx[n_left] = idx[i];
+            n_left++;
+        }
+    }
+    *n = n_left;
+}
+
+/* Looks up each of the 'n' keys in 'keys', where 'n' is at most
+ * TABLE_LOOKUP_BATCH, in 'chain' and stores what chain_lookup() would return
+ * for 'keys[i]' and 'rxhashes[i]' in 'flows[i]'.  The keys that miss in the
+ * microflow cache are passed to each table as a batch, which lets tables
+ * that support it overlap their memory accesses across packets. */
+void
+chain_lookup_batch(struct sw_chain *chain, const struct sw_flow_key *keys[],
+                   const uint32_t rxhashes[], struct sw_flow *flows[],
+                   size_t n)
+{
+    const struct sw_flow_key *miss_keys[TABLE_LOOKUP_BATCH];
+    struct chain_mf_entry *entries[TABLE_LOOKUP_BATCH];
+    size_t idx[TABLE_LOOKUP_BATCH];
+    size_t i, n_miss;
+
+    assert(n <= TABLE_LOOKUP_BATCH);
+    n_miss = 0;
+    for (i = 0; i < n; i++) {
+        struct chain_mf_entry *e = mf_entry(chain, keys[i], rxhashes[i]);
+
+        assert(!keys[i]->wildcards);
+        flows[i] = mf_lookup(chain, e, keys[i]);
+        if (!flows[i]) {
+            miss_keys[n_miss] = keys[i];
+            entries[n_miss] = e;
+            idx[n_miss] = i;
+            n_miss++;
+        }
     }
 
+    for (i = 0; i < chain->n_tables && n_miss; i++) {
+        lookup_batch_in_table(chain, chain->tables[i], i, miss_keys, entries,
+                              idx, &n_miss, flows);
+    }
+    if (chain->emerg_active && n_miss) {
+        lookup_batch_in_table(chain, chain->emerg_table, -1, miss_keys,
+                              entries, idx, &n_miss, flows);
+    }
+    for (i = 0; i < n_miss; i++) {
+        DP_TRACE1(chain_lookup_miss, ntohs(miss_keys[i]->flow.in_port));
+    }
+}
+
+/* Appends to 'trace' a search of 't', with index 'table_idx' in 'chain' or -1
+ * for the emergency table, for 'key'.  Returns true if 't' holds a match,
+ * which is then stored in 'trace'. */
+static bool
+trace_table(struct sw_table *t, int table_idx, const struct sw_flow_key *key,
+            struct chain_trace *trace)
+{
+    struct chain_trace_step *step = &trace->steps[trace->n_steps++];
+    struct sw_flow *flow;
+
+    step->table_idx = table_idx;
+    if (t->lookup_trace) {
+        flow = t->lookup_trace(t, key, &step->n_compares);
+    } else {
+        flow = t->lookup(t, key);
+        step->n_compares = UINT_MAX;
+    }
+    step->matched = flow != NULL;
+    if (flow) {
+        trace->flow = flow;
+        trace->table_idx = table_idx;
+    }
+    return flow != NULL;
+}
+
+/* Stores in 'trace' the result of looking up 'key', which must not have any
+ * wildcard fields, in 'chain' as chain_lookup() would, together with the
+ * tables searched and how much work each did.  The microflow cache is
+ * consulted but not used, so that every table search is real, and neither
+ * it nor any table's statistics are updated. */
+void
+chain_trace(struct sw_chain *chain, const struct sw_flow_key *key,
+            struct chain_trace *trace)
+{
+    const struct chain_mf_entry *e = mf_entry(chain, key, 0);
+    int i;
+
+    assert(!key->wildcards);
+    trace->flow = NULL;
+    trace->table_idx = -1;
+    trace->cached = (e->sw_flow && e->serial == chain->mf_serial
+                     && flow_equal(&e->flow, &key->flow));
+    trace->n_steps = 0;
+
+    for (i = 0; i < chain->n_tables; i++) {
+        if (trace_table(chain->tables[i], i, key, trace)) {
+            return;
+        }
+    }
+    if (chain->emerg_active) {
+        trace_table(chain->emerg_table, -1, key, trace);
+    }
+}
+
+static uint32_t
+hash_cookie(uint64_t cookie)
+{
+    return hash_bytes(&cookie, sizeof cookie, 0);
+}
+
+static struct flow_cookie_group *
+find_cookie_group(const struct sw_chain *chain, uint64_t cookie)
+{
+    struct flow_cookie_group *group;
+
+    HMAP_FOR_EACH_WITH_HASH (group, struct flow_cookie_group, node,
+                             hash_cookie(cookie), &chain->cookies) {
+        if (group->cookie == cookie) {
+            return group;
+        }
+    }
     return NULL;
 }
 
+static uint32_t
+hash_priority(uint16_t priority)
+{
+    return hash_bytes(&priority, sizeof priority, 0);
+}
+
+/* Adds 'flow', which was just added to one of 'chain''s working tables, to
+ * 'chain''s index of overlap groups.  flow_free() takes it out again. */
+static void
+index_overlap(struct sw_chain *chain, struct sw_flow *flow)
+{
+    struct flow_overlap_group *group;
+
+    HMAP_FOR_EACH_WITH_HASH (group, struct flow_overlap_group, node,
+                             hash_priority(flow->priority), &chain->overlaps) {
+        if (group->priority == flow->priority
+            && group->wildcards == flow->key.wildcards) {
+            goto found;
+        }
+    }
+    group = xmalloc(sizeof *group);
+    group->map = &chain->overlaps;
+    group->priority = flow->priority;
+    group->wildcards = flow->key.wildcards;
+    flow_make_mask(&flow->key, &group->mask);
+    hmap_init(&group->flows);
+    hmap_insert(&chain->overlaps, &group->node, hash_priority(flow->priority));
+
+found:
+    hmap_insert(&group->flows, &flow->overlap_node,
+                flow_hash_masked(&flow->key.flow, &group->mask));
+    flow->overlap_group = group;
+}
+
+/* Adds 'flow', which was just added to 'chain', to 'chain''s indexes of
+ * cookies and output ports.  flow_free() takes it out again. */
+static void
+index_flow(struct sw_chain *chain, struct sw_flow *flow)
+{
+    struct flow_cookie_group *group = find_cookie_group(chain, flow->cookie);
+
+    if (!group) {
+        group = xmalloc(sizeof *group);
+        group->map = &chain->cookies;
+        group->cookie = flow->cookie;
+        list_init(&group->flows);
+        hmap_insert(&chain->cookies, &group->node, hash_cookie(flow->cookie));
+    }
+    list_push_back(&group->flows, &flow->cookie_node);
+    flow->cookie_group = group;
+
+    flow_index_out_ports(flow, &chain->out_ports);
+}
+
+/* Returns the index of 't' in 'chain''s working tables, or -1 if it is not
+ * one of them. */
+static int
+table_index(const struct sw_chain *chain, const struct sw_table *t)
+{
+    int i;
+
+    for (i = 0; i < chain->n_tables; i++) {
+        if (chain->tables[i] == t) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* Returns the running totals that 'chain' keeps for 't', one of its tables,
+ * or a null pointer for the hardware table, whose flows' counters come from
+ * the hardware instead of flow_used(). */
+static struct flow_totals *
+table_totals(const struct sw_chain *chain, const struct sw_table *t)
+{
+    int i;
+
+    if (t == chain->emerg_table) {
+        return (struct flow_totals *) &chain->emerg_totals;
+    }
+#if defined(OF_HW_PLAT)
+    if (chain->dp && chain->dp->hw_drv && t == &chain->dp->hw_drv->sw_table) {
+        return NULL;
+    }
+#endif
+    i = table_index(chain, t);
+    return i >= 0 ? (struct flow_totals *) &chain->totals[i] : NULL;
+}
+
+/* Puts 'flow', just inserted into 'chain''s working table 'idx', at the back
+ * of that table's eviction list, if the table can remove single flows. */
+static void
+lru_link(struct sw_chain *chain, struct sw_flow *flow, int idx)
+{
+    if (chain->tables[idx]->remove) {
+        flow->lru = &chain->lru[idx];
+        flow->lru_used = flow->used;
+        list_push_back(flow->lru, &flow->lru_node);
+    }
+}
+
+/* Tries to insert 'flow' into 'chain''s working table 'idx'.  Returns true
+ * if successful. */
+static bool
+insert_working(struct sw_chain *chain, struct sw_flow *flow, int idx)
+{
+    struct sw_table *t = chain->tables[idx];
+    uint64_t tick;
+
+    if (!t->insert(t, flow)) {
+        return false;
+    }
+
+    flow->table = t;
+    flow_totals_attach(flow, table_totals(chain, t));
+    tick = flow_expiry_tick(flow);
+    if (tick && t->remove) {
+        wheel_insert(chain, flow, tick);
+    }
+    lru_link(chain, flow, idx);
+    count_deep_flow(chain, flow);
+    count_complex_flow(chain, flow);
+    index_flow(chain, flow);
+    index_overlap(chain, flow);
+    chain_cache_flush(chain);
+    return true;
+}
+
+/* Removes up to 'chain->evict_batch' of the least recently used flows from
+ * 'chain''s working table 'idx', telling the controller about those that
+ * asked for it.  Returns the number of flows removed. */
+static unsigned int
+evict_flows(struct sw_chain *chain, int idx)
+{
+    struct sw_table *t = chain->tables[idx];
+    struct list *lru = &chain->lru[idx];
+    unsigned int n = 0;
+
+    while (n < chain->evict_batch && !list_is_empty(lru)) {
+        struct sw_flow *flow = CONTAINER_OF(list_front(lru), struct sw_flow,
+                                            lru_node);
+
+        if (flow->used != flow->lru_used) {
+            /* Used since it was queued: requeue it as of its last use.  It
+             * cannot be used again before the loop reaches it, so this
+             * terminates. */
+            list_remove(&flow->lru_node);
+            flow->lru_used = flow->used;
+            list_push_back(lru, &flow->lru_node);
+            continue;
+        }
+
+        dp_send_flow_end(chain->dp, flow, OFPRR_DELETE);
+        t->remove(t, flow);
+        flow_free(flow);
+        n++;
+    }
+    if (n) {
+        chain->n_evicted[idx] += n;
+        chain_cache_flush(chain);
+    }
+    return n;
+}
+
+/* Returns true if working table 'idx' in 'chain' is full and takes flows
+ * with 'flow''s wildcards, so that evicting flows from it would make room
+ * for 'flow'. */
+static bool
+evict_would_help(const struct sw_chain *chain, const struct sw_flow *flow,
+                 int idx)
+{
+    struct sw_table *t = chain->tables[idx];
+    struct sw_table_stats stats;
+
+    if (!t->remove || list_is_empty(&chain->lru[idx])) {
+        return false;
+    }
+    memset(&stats, 0, sizeof stats);
+    t->stats(t, &stats);
+    return (stats.n_flows >= stats.max_flows
+            && !(flow->key.wildcards & OFPFW_ALL & ~stats.wildcards));
+}
+
 /* Inserts 'flow' into 'chain', replacing any duplicate flow.  Returns 0 if
  * successful or a negative error.
  *
+ * If no working table has room for 'flow' and eviction is enabled, evicts
+ * flows from the first full table that would take 'flow' and tries that table
+ * again.
+ *
  * If successful, 'flow' becomes owned by the chain, otherwise it is retained
  * by the caller. */
 int
@@ -138,13 +836,28 @@ chain_insert(struct sw_chain *chain, struct sw_flow *flow, int emerg)
 
     if (emerg) {
         struct sw_table *t = chain->emerg_table;
-        if (t->insert(t, flow))
+        if (t->insert(t, flow)) {
+            flow_totals_attach(flow, &chain->emerg_totals);
+            count_deep_flow(chain, flow);
+            count_complex_flow(chain, flow);
+            index_flow(chain, flow);
+            chain_cache_flush(chain);
             return 0;
+        }
     } else {
         for (i = 0; i < chain->n_tables; i++) {
-            struct sw_table *t = chain->tables[i];
-            if (t->insert(t, flow))
+            if (insert_working(chain, flow, i)) {
                 return 0;
+            }
+        }
+        if (chain->evict_batch) {
+            for (i = 0; i < chain->n_tables; i++) {
+                if (evict_would_help(chain, flow, i)
+                    && evict_flows(chain, i)
+                    && insert_working(chain, flow, i)) {
+                    return 0;
+                }
+            }
         }
     }
 
@@ -175,24 +888,80 @@ chain_modify(struct sw_chain *chain, const struct sw_flow_key *key,
             count += t->modify(t, key, priority, strict, actions, actions_len);
         }
     }
+    if (count) {
+        chain_cache_flush(chain);
+    }
 
     return count;
 }
 
+/* Returns true if every 1-bit in 'b' is also a 1-bit in 'a'. */
+static bool
+mask_covers(const struct flow *a, const struct flow *b)
+{
+    const uint8_t *pa = (const uint8_t *) a;
+    const uint8_t *pb = (const uint8_t *) b;
+    size_t i;
+
+    for (i = 0; i < sizeof *a; i++) {
+        if (pb[i] & ~pa[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Returns true if a flow in 'group' overlaps 'key', whose flow_make_mask()
+ * is 'mask'. */
+static bool
+overlap_group_has_conflict(const struct flow_overlap_group *group,
+                           const struct sw_flow_key *key,
+                           const struct flow *mask, int strict)
+{
+    struct sw_flow *flow;
+
+    if (mask_covers(mask, &group->mask)) {
+        /* A flow in 'group' that overlaps 'key' agrees with it on every bit
+         * of the group's mask, so it has the same hash as 'key'. */
+        HMAP_FOR_EACH_WITH_HASH (flow, struct sw_flow, overlap_node,
+                                 flow_hash_masked(&key->flow, &group->mask),
+                                 &group->flows) {
+            if (flow_matches_2desc(&flow->key, key, strict)) {
+                return true;
+            }
+        }
+    } else {
+        HMAP_FOR_EACH (flow, struct sw_flow, overlap_node, &group->flows) {
+            if (flow_matches_2desc(&flow->key, key, strict)) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
 /* Checks whether the chain has an entry with the same priority which conflicts
  * with 'key'. If 'strict' set, wildcards should also match. If 'strict' is not 
  * set, comparison is done 'module wildcards'.
  *
- * Returns 'true' if such an entry exists, 'false' otherwise. */
+ * Returns 'true' if such an entry exists, 'false' otherwise.
+ *
+ * Only the flows in the working tables with 'priority' are examined, and
+ * among those, each group of flows with wildcards no broader than 'key''s
+ * costs a single hash probe. */
 int
 chain_has_conflict(struct sw_chain *chain, const struct sw_flow_key *key,
                    uint16_t priority, int strict)
 {
-    int i;
+    struct flow_overlap_group *group;
+    struct flow mask;
 
-    for (i = 0; i < chain->n_tables; i++) {
-        struct sw_table *t = chain->tables[i];
-        if (t->has_conflict(t, key, priority, strict)) {
+    flow_make_mask(key, &mask);
+    HMAP_FOR_EACH_WITH_HASH (group, struct flow_overlap_group, node,
+                             hash_priority(priority), &chain->overlaps) {
+        if (group->priority == priority
+            && (!strict || group->wildcards == key->wildcards)
+            && overlap_group_has_conflict(group, key, &mask, strict)) {
             return true;
         }
     }
@@ -200,6 +969,125 @@ chain_has_conflict(struct sw_chain *chain, const struct sw_flow_key *key,
     return false;
 }
 
+/* Returns the number of flows in 'chain''s working tables. */
+unsigned int
+chain_n_flows(const struct sw_chain *chain)
+{
+    unsigned int n_flows = 0;
+    int i;
+
+    for (i = 0; i < chain->n_tables; i++) {
+        n_flows += chain->totals[i].n_flows;
+    }
+    return n_flows;
+}
+
+/* Adds to 'sum' the counters of the flows in 't', one of 'chain''s tables,
+ * that match 'key' and, unless 'out_port' is OFPP_NONE, output to
+ * 'out_port' (in network byte order).  Returns false, without adding
+ * anything, if 't' must be iterated instead.
+ *
+ * A request that matches every flow is answered from the table's running
+ * totals, one with an 'out_port' from the flows that output to it. */
+bool
+chain_aggregate(const struct sw_chain *chain, const struct sw_table *t,
+                const struct sw_flow_key *key, uint16_t out_port,
+                struct flow_totals *sum)
+{
+    const struct flow_totals *totals = table_totals(chain, t);
+    struct flow_port_group *group;
+    struct flow_port_ref *ref;
+
+    if (!totals) {
+        return false;
+    }
+
+    if (out_port == htons(OFPP_NONE)) {
+        if ((key->wildcards & OFPFW_ALL) != OFPFW_ALL) {
+            return false;
+        }
+        sum->packet_count += totals->packet_count;
+        sum->byte_count += totals->byte_count;
+        sum->n_flows += totals->n_flows;
+        return true;
+    }
+
+    group = flow_port_group_find(&chain->out_ports, out_port);
+    if (group) {
+        LIST_FOR_EACH (ref, struct flow_port_ref, node, &group->refs) {
+            const struct sw_flow *flow = ref->flow;
+
+            if (flow->totals == totals
+                && flow_matches_1wild(&flow->key, key)) {
+                sum->packet_count += flow->packet_count;
+                sum->byte_count += flow->byte_count;
+                sum->n_flows++;
+            }
+        }
+    }
+    return true;
+}
+
+/* Deletes 'flow' from 'chain', in which it may be an emergency flow, and
+ * returns the number of flows deleted. */
+static int
+delete_flow(struct sw_chain *chain, struct sw_flow *flow, uint16_t out_port)
+{
+    struct sw_table *t = flow->table ? flow->table : chain->emerg_table;
+
+    if (t->remove) {
+        dp_send_flow_end(chain->dp, flow, OFPRR_DELETE);
+        t->remove(t, flow);
+        flow_free(flow);
+        return 1;
+    } else {
+        /* A strict delete of the flow's own key and priority deletes just
+         * that flow. */
+        return t->delete(chain->dp, t, &flow->key, out_port, flow->priority,
+                         true);
+    }
+}
+
+/* Deletes the flows in 'chain' that chain_delete() would, for an 'out_port'
+ * other than OFPP_NONE, looking only at the flows that output to 'out_port'
+ * instead of searching every table. */
+static int
+delete_out_port(struct sw_chain *chain, const struct sw_flow_key *key,
+                uint16_t out_port, uint16_t priority, int strict, int emerg)
+{
+    struct flow_port_group *group;
+    struct flow_port_ref *ref;
+    struct sw_flow **flows = NULL;
+    size_t n_flows = 0, allocated = 0;
+    size_t i;
+    int count = 0;
+
+    group = flow_port_group_find(&chain->out_ports, out_port);
+    if (!group) {
+        return 0;
+    }
+
+    /* Collects the flows first, because deleting them changes 'group'. */
+    LIST_FOR_EACH (ref, struct flow_port_ref, node, &group->refs) {
+        struct sw_flow *flow = ref->flow;
+
+        /* Emergency flows are the ones not in any working table. */
+        if ((flow->table == NULL) == (emerg != 0)
+            && flow_matches_desc(&flow->key, key, strict)
+            && (!strict || flow->priority == priority)) {
+            if (n_flows >= allocated) {
+                flows = x2nrealloc(flows, &allocated, sizeof *flows);
+            }
+            flows[n_flows++] = flow;
+        }
+    }
+    for (i = 0; i < n_flows; i++) {
+        count += delete_flow(chain, flows[i], out_port);
+    }
+    free(flows);
+    return count;
+}
+
 /* Deletes from 'chain' any and all flows that match 'key'.  If 'out_port' 
  * is not OFPP_NONE, then matching entries must have that port as an 
  * argument for an output action.  If 'strict" is set, then wildcards and 
@@ -207,7 +1095,8 @@ chain_has_conflict(struct sw_chain *chain, const struct sw_flow_key *key,
  *
  * Expensive in the general case as currently implemented, since it requires
  * iterating through the entire contents of each table for keys that contain
- * wildcards.  Relatively cheap for fully specified keys. */
+ * wildcards.  Relatively cheap for fully specified keys, or for any key with
+ * an 'out_port', which only looks at flows that output to that port. */
 int
 chain_delete(struct sw_chain *chain, const struct sw_flow_key *key,
              uint16_t out_port, uint16_t priority, int strict, int emerg)
@@ -215,7 +1104,10 @@ chain_delete(struct sw_chain *chain, const struct sw_flow_key *key,
     int count = 0;
     int i;
 
-    if (emerg) {
+    if (out_port != htons(OFPP_NONE)) {
+        count = delete_out_port(chain, key, out_port, priority, strict,
+                                emerg);
+    } else if (emerg) {
         struct sw_table *t = chain->emerg_table;
         count += t->delete(chain->dp, t, key, out_port, priority, strict);
     } else {
@@ -223,27 +1115,615 @@ chain_delete(struct sw_chain *chain, const struct sw_flow_key *key,
             struct sw_table *t = chain->tables[i];
             count += t->delete(chain->dp, t, key, out_port, priority, strict);
         }
+
+        /* A reconnected controller takes over from the emergency flows by
+         * flushing the working tables. */
+        if (chain->emerg_active && !strict && out_port == OFPP_NONE
+            && (key->wildcards & OFPFW_ALL) == OFPFW_ALL) {
+            chain_set_emergency(chain, false);
+        }
+    }
+    if (count) {
+        chain_cache_flush(chain);
     }
 
     return count;
 }
 
-/* Deletes timed-out flow entries from all the tables in 'chain' and appends
- * the deleted flows to 'deleted'.
+static void
+append_cookie_group(const struct flow_cookie_group *group,
+                    struct sw_flow ***flows, size_t *n_flows,
+                    size_t *allocated)
+{
+    struct sw_flow *flow;
+
+    LIST_FOR_EACH (flow, struct sw_flow, cookie_node, &group->flows) {
+        if (*n_flows >= *allocated) {
+            *flows = x2nrealloc(*flows, allocated, sizeof **flows);
+        }
+        (*flows)[(*n_flows)++] = flow;
+    }
+}
+
+/* Stores in '*flowsp' a newly allocated array of the flows in 'chain',
+ * including emergency flows, whose cookies equal 'cookie' in the bits set in
+ * 'mask', and returns the number of flows.  The caller must free the array.
  *
- * Expensive as currently implemented, since it iterates through the entire
- * contents of each table. */
+ * With every bit of 'mask' set, this takes time proportional to the number
+ * of flows found.  Otherwise, it examines each distinct cookie in 'chain'
+ * once. */
+size_t
+chain_find_cookie(const struct sw_chain *chain, uint64_t cookie,
+                  uint64_t mask, struct sw_flow ***flowsp)
+{
+    struct flow_cookie_group *group;
+    size_t n_flows = 0, allocated = 0;
+
+    *flowsp = NULL;
+    if (mask == UINT64_MAX) {
+        group = find_cookie_group(chain, cookie);
+        if (group) {
+            append_cookie_group(group, flowsp, &n_flows, &allocated);
+        }
+    } else {
+        HMAP_FOR_EACH (group, struct flow_cookie_group, node,
+                       &chain->cookies) {
+            if (!((group->cookie ^ cookie) & mask)) {
+                append_cookie_group(group, flowsp, &n_flows, &allocated);
+            }
+        }
+    }
+    return n_flows;
+}
+
+/* Replaces the actions of each flow in 'chain' whose cookie equals 'cookie'
+ * in the bits set in 'mask' by the 'actions_len' bytes of 'actions'.
+ * Returns the number of flows that were modified. */
+int
+chain_modify_cookie(struct sw_chain *chain, uint64_t cookie, uint64_t mask,
+                    const struct ofp_action_header *actions,
+                    size_t actions_len)
+{
+    struct sw_flow **flows;
+    size_t n_flows, i;
+
+    n_flows = chain_find_cookie(chain, cookie, mask, &flows);
+    for (i = 0; i < n_flows; i++) {
+        flow_replace_acts(flows[i], actions, actions_len);
+    }
+    free(flows);
+
+    if (n_flows) {
+        chain_cache_flush(chain);
+    }
+    return n_flows;
+}
+
+/* Deletes each flow in 'chain' whose cookie equals 'cookie' in the bits set
+ * in 'mask' and, unless 'out_port' is OFPP_NONE, that has an output action
+ * to 'out_port'.  Returns the number of flows that were deleted. */
+int
+chain_delete_cookie(struct sw_chain *chain, uint64_t cookie, uint64_t mask,
+                    uint16_t out_port)
+{
+    struct sw_flow **flows;
+    size_t n_flows, i;
+    int count = 0;
+
+    n_flows = chain_find_cookie(chain, cookie, mask, &flows);
+    for (i = 0; i < n_flows; i++) {
+        struct sw_flow *flow = flows[i];
+
+        if (flow_has_out_port(flow, out_port)) {
+            count += delete_flow(chain, flow, out_port);
+        }
+    }
+    free(flows);
+
+    if (count) {
+        chain_cache_flush(chain);
+    }
+    return count;
+}
+
+/* Returns the flow in 'group', one of 'chain''s overlap groups, with the same
+ * match as 'flow', or a null pointer if there is none. */
+static struct sw_flow *
+find_same_match(const struct flow_overlap_group *group,
+                const struct sw_flow *flow)
+{
+    struct sw_flow *f;
+
+    HMAP_FOR_EACH_WITH_HASH (f, struct sw_flow, overlap_node,
+                             hmap_node_hash(&flow->overlap_node),
+                             &group->flows) {
+        if (flow_matches_2desc(&f->key, &flow->key, true)) {
+            return f;
+        }
+    }
+    return NULL;
+}
+
+/* Gives 'flow', in 'chain', the counters, creation time and last use of
+ * 'old', and reschedules its expiration to match. */
+static void
+inherit_counters(struct sw_chain *chain, struct sw_flow *flow,
+                 const struct sw_flow *old)
+{
+    struct flow_totals *totals = flow->totals;
+
+    flow_totals_detach(flow);
+    flow->packet_count = old->packet_count;
+    flow->byte_count = old->byte_count;
+    flow->place_packets = old->place_packets;
+    flow->created = old->created;
+    flow->used = old->used;
+    flow_totals_attach(flow, totals);
+
+    if (flow->timer_tick) {
+        list_remove(&flow->timer_node);
+        wheel_insert(chain, flow, flow_expiry_tick(flow));
+    }
+}
+
+/* Prepares 'new', which was created with a null datapath and filled while
+ * 'old' kept forwarding, to take the place of 'old', which the caller then
+ * destroys without telling the controller about its flows.  'new' takes
+ * over 'old''s datapath, emergency mode and eviction settings.  Each flow in
+ * 'new''s working tables with the same match and priority as one in 'old''s
+ * keeps that flow's counters, as if it had been modified in place.  Returns
+ * the number of flows that kept their counters.
+ *
+ * 'old' must not have a hardware table, since 'new' cannot take it over. */
+unsigned int
+chain_adopt(struct sw_chain *new, const struct sw_chain *old)
+{
+    struct flow_overlap_group *group;
+    unsigned int n_kept = 0;
+
+    new->dp = old->dp;
+    new->emerg_active = old->emerg_active;
+    new->evict_batch = old->evict_batch;
+    memcpy(new->n_evicted, old->n_evicted, sizeof new->n_evicted);
+    new->mf_hits = old->mf_hits;
+    new->mf_misses = old->mf_misses;
+
+    HMAP_FOR_EACH (group, struct flow_overlap_group, node, &new->overlaps) {
+        const struct flow_overlap_group *old_group;
+        struct sw_flow *flow;
+
+        HMAP_FOR_EACH_WITH_HASH (old_group, struct flow_overlap_group, node,
+                                 hash_priority(group->priority),
+                                 &old->overlaps) {
+            if (old_group->priority == group->priority
+                && old_group->wildcards == group->wildcards) {
+                goto found;
+            }
+        }
+        continue;
+
+    found:
+        HMAP_FOR_EACH (flow, struct sw_flow, overlap_node, &group->flows) {
+            const struct sw_flow *old_flow = find_same_match(old_group, flow);
+            if (old_flow) {
+                inherit_counters(new, flow, old_flow);
+                n_kept++;
+            }
+        }
+    }
+    chain_cache_flush(new);
+    return n_kept;
+}
+
+/* Puts 'chain' into emergency mode if 'active' is true, so that packets that
+ * match no flow in the working tables are looked up in the emergency table,
+ * or takes it out of emergency mode if 'active' is false. */
 void
-chain_timeout(struct sw_chain *chain, struct list *deleted)
+chain_set_emergency(struct sw_chain *chain, bool active)
+{
+    if (chain->emerg_active != active) {
+        VLOG_INFO("%s emergency mode", active ? "entering" : "leaving");
+        chain->emerg_active = active;
+        chain_cache_flush(chain);
+    }
+}
+
+/* Tells the hardware table in 'chain', if there is one, that a series of
+ * chain_insert(), chain_modify() and chain_delete() calls follows, so that it
+ * may defer writing them to hardware until chain_batch_commit().  Nothing
+ * else may be done with 'chain' until then. */
+void
+chain_batch_begin(struct sw_chain *chain UNUSED)
+{
+#if defined(OF_HW_PLAT)
+    of_hw_driver_t *hw_drv = chain->dp ? chain->dp->hw_drv : NULL;
+
+    if (hw_drv && hw_drv->flow_batch_begin && hw_drv->flow_batch_commit
+        && hw_drv->flow_batch_begin(hw_drv)) {
+        VLOG_WARN("hardware table could not begin a flow batch");
+    }
+#endif
+}
+
+/* Ends the batch of flow changes begun by chain_batch_begin(), so that
+ * every change made since then has reached the hardware. */
+void
+chain_batch_commit(struct sw_chain *chain UNUSED)
+{
+#if defined(OF_HW_PLAT)
+    of_hw_driver_t *hw_drv = chain->dp ? chain->dp->hw_drv : NULL;
+
+    if (hw_drv && hw_drv->flow_batch_commit
+        && hw_drv->flow_batch_commit(hw_drv)) {
+        VLOG_WARN("hardware table failed to commit a flow batch");
+    }
+#endif
+}
+
+#if defined(OF_HW_PLAT)
+/* The flows seen by a placement scan with the highest (or lowest) rates,
+ * in order from most to least extreme. */
+struct place_scan {
+    bool hottest;               /* Keep the highest rates, not the lowest? */
+    int n;
+    struct sw_flow *flows[CHAIN_PLACE_BATCH];
+    uint64_t rates[CHAIN_PLACE_BATCH];
+};
+
+/* Adds 'flow', with 'rate', to 'scan' if it is among the most extreme. */
+static void
+place_consider(struct place_scan *scan, struct sw_flow *flow, uint64_t rate)
 {
     int i;
 
-    for (i = 0; i < chain->n_tables; i++) {
+    for (i = scan->n; i > 0; i--) {
+        if (scan->hottest ? rate <= scan->rates[i - 1]
+                          : rate >= scan->rates[i - 1]) {
+            break;
+        }
+        if (i < CHAIN_PLACE_BATCH) {
+            scan->flows[i] = scan->flows[i - 1];
+            scan->rates[i] = scan->rates[i - 1];
+        }
+    }
+    if (i < CHAIN_PLACE_BATCH) {
+        scan->flows[i] = flow;
+        scan->rates[i] = rate;
+        if (scan->n < CHAIN_PLACE_BATCH) {
+            scan->n++;
+        }
+    }
+}
+
+static int
+place_scan_cb(struct sw_flow *flow, void *scan_)
+{
+    struct place_scan *scan = scan_;
+    uint64_t rate = flow->packet_count - flow->place_packets;
+
+    flow->place_packets = flow->packet_count;
+    if (!scan->hottest
+        || (!flow->no_offload && rate >= CHAIN_PLACE_MIN_RATE)) {
+        place_consider(scan, flow, rate);
+    }
+    return 0;
+}
+
+/* Updates the packet rates of the flows in 'table' and adds the busiest or,
+ * according to 'scan''s 'hottest', the idlest of them to 'scan'. */
+static void
+place_scan(struct sw_table *table, struct place_scan *scan)
+{
+    struct sw_table_position position;
+    struct sw_flow_key all;
+
+    memset(&all, 0, sizeof all);
+    all.wildcards = OFPFW_ALL;
+    memset(&position, 0, sizeof position);
+    table->iterate(table, &all, OFPP_NONE, &position, place_scan_cb, scan);
+}
+
+static int
+place_overlap_cb(struct sw_flow *other, void *flow_)
+{
+    const struct sw_flow *flow = flow_;
+
+    return (other != flow
+            && (!other->key.wildcards || other->priority > flow->priority));
+}
+
+/* Returns true if moving 'flow' into the hardware table, which is searched
+ * before the software tables, would hide a flow that should win over it. */
+static bool
+place_would_shadow(const struct sw_chain *chain, struct sw_flow *flow)
+{
+    int i;
+
+    if (!flow->key.wildcards) {
+        return false;
+    }
+    for (i = 1; i < chain->n_tables; i++) {
         struct sw_table *t = chain->tables[i];
-        t->timeout(t, deleted);
+        struct sw_table_position position;
+
+        memset(&position, 0, sizeof position);
+        if (t->iterate(t, &flow->key, OFPP_NONE, &position,
+                       place_overlap_cb, flow)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Takes 'flow' out of its table and 'chain''s timeout wheel, without
+ * freeing it. */
+static void
+place_detach(struct sw_chain *chain, struct sw_flow *flow)
+{
+    of_hw_driver_t *hw_drv = chain->dp->hw_drv;
+
+    flow_totals_detach(flow);
+    if (flow->table == &hw_drv->sw_table) {
+        hw_drv->flow_remove(hw_drv, flow);
+    } else {
+        if (flow->timer_tick) {
+            list_remove(&flow->timer_node);
+            flow->timer_tick = 0;
+        }
+        if (flow->lru) {
+            list_remove(&flow->lru_node);
+            flow->lru = NULL;
+        }
+        flow->table->remove(flow->table, flow);
     }
 }
 
+/* Inserts 'flow' into 't', one of 'chain''s tables.  Returns true if
+ * successful. */
+static bool
+place_attach(struct sw_chain *chain, struct sw_flow *flow, struct sw_table *t)
+{
+    uint64_t tick;
+    int idx;
+
+    if (!t->insert(t, flow)) {
+        return false;
+    }
+    flow->table = t;
+    flow_totals_attach(flow, table_totals(chain, t));
+    tick = flow_expiry_tick(flow);
+    if (tick && t->remove) {
+        wheel_insert(chain, flow, tick);
+    }
+    idx = table_index(chain, t);
+    if (idx >= 0) {
+        lru_link(chain, flow, idx);
+    }
+    return true;
+}
+
+/* Inserts 'flow' into the first software table in 'chain' that accepts
+ * it.  Returns true if successful. */
+static bool
+place_attach_sw(struct sw_chain *chain, struct sw_flow *flow)
+{
+    int i;
+
+    for (i = 1; i < chain->n_tables; i++) {
+        if (place_attach(chain, flow, chain->tables[i])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Moves the busiest software flows in 'chain' into its hardware table,
+ * demoting idler hardware flows to make room as needed.  Relies on the
+ * hardware table's timeout pass, just made, for fresh hardware counts. */
+static void
+chain_place(struct sw_chain *chain)
+{
+    of_hw_driver_t *hw_drv = chain->dp ? chain->dp->hw_drv : NULL;
+    struct sw_table *hw_table;
+    struct place_scan hot, cold;
+    bool moved = false;
+    int i, j;
+
+    if (!hw_drv || !hw_drv->flow_remove || chain->n_tables < 2) {
+        return;
+    }
+    hw_table = &hw_drv->sw_table;
+
+    cold.hottest = false;
+    cold.n = 0;
+    place_scan(hw_table, &cold);
+    hot.hottest = true;
+    hot.n = 0;
+    for (i = 1; i < chain->n_tables; i++) {
+        place_scan(chain->tables[i], &hot);
+    }
+
+    for (i = j = 0; i < hot.n; i++) {
+        struct sw_flow *flow = hot.flows[i];
+        struct sw_table *from = flow->table;
+        struct sw_flow *victim;
+
+        if (place_would_shadow(chain, flow)) {
+            continue;
+        }
+
+        place_detach(chain, flow);
+        if (place_attach(chain, flow, hw_table)) {
+            moved = true;
+            continue;
+        }
+
+        /* The hardware table is full.  The remaining flows are no busier
+         * and the remaining victims no idler, so stop at the first flow
+         * not worth a swap. */
+        if (j >= cold.n || cold.rates[j] * 2 >= hot.rates[i]) {
+            place_attach(chain, flow, from);
+            break;
+        }
+        victim = cold.flows[j++];
+        place_detach(chain, victim);
+        if (!place_attach(chain, flow, hw_table)) {
+            /* It did not fit even with room made, so the hardware cannot
+             * express it. */
+            flow->no_offload = true;
+            place_attach(chain, victim, hw_table);
+            place_attach(chain, flow, from);
+            continue;
+        }
+        if (!place_attach_sw(chain, victim)) {
+            VLOG_WARN("no software table has room for a demoted flow");
+            place_detach(chain, flow);
+            place_attach(chain, victim, hw_table);
+            place_attach(chain, flow, from);
+            break;
+        }
+        moved = true;
+        VLOG_DBG("swapped a flow at %"PRIu64" packets/s into hardware for "
+                 "one at %"PRIu64, hot.rates[i], cold.rates[j - 1]);
+    }
+
+    if (moved) {
+        chain_cache_flush(chain);
+    }
+}
+#endif
+
+/* Moves the flows in the second-level wheel slot that comes due at 'tick',
+ * which must be the first tick of a block, down to the first level. */
+static void
+wheel_cascade(struct sw_chain *chain, uint64_t tick)
+{
+    struct list *slot;
+
+    slot = &chain->wheel[1][(tick >> CHAIN_WHEEL_BITS) & CHAIN_WHEEL_MASK];
+    while (!list_is_empty(slot)) {
+        struct sw_flow *flow = CONTAINER_OF(list_pop_front(slot),
+                                            struct sw_flow, timer_node);
+        wheel_insert(chain, flow, flow->timer_tick);
+    }
+}
+
+/* Performs timeout processing on the flows in 'chain' that are due.  Appends
+ * the flows removed from 'chain' to 'deleted' for the caller to free.
+ *
+ * Only flows whose scheduled time has come are examined, and no more than
+ * CHAIN_TIMEOUT_BATCH of them per call.  Returns true if more flows are due
+ * and the caller should call again soon, false otherwise. */
+bool
+chain_timeout(struct sw_chain *chain, struct list *deleted)
+{
+    uint64_t now_tick = time_msec() / 1000;
+    int budget = CHAIN_TIMEOUT_BATCH;
+    bool removed = false;
+    bool more = false;
+    int i;
+
+    if (now_tick != chain->last_scan) {
+        for (i = 0; i < chain->n_tables; i++) {
+            struct sw_table *t = chain->tables[i];
+            if (t->run) {
+                t->run(t);
+            }
+            if (!t->remove) {
+                size_t n_deleted = list_size(deleted);
+                t->timeout(t, deleted);
+                removed |= list_size(deleted) != n_deleted;
+            }
+        }
+        if (chain->emerg_table->run) {
+            chain->emerg_table->run(chain->emerg_table);
+        }
+#if defined(OF_HW_PLAT)
+        chain_place(chain);
+#endif
+        chain->last_scan = now_tick;
+    }
+
+    while (chain->next_tick <= now_tick) {
+        uint64_t tick = chain->next_tick;
+        struct list *slot = &chain->wheel[0][tick & CHAIN_WHEEL_MASK];
+
+        if (!(tick & CHAIN_WHEEL_MASK)) {
+            wheel_cascade(chain, tick);
+        }
+        while (!list_is_empty(slot)) {
+            struct sw_flow *flow;
+
+            if (!budget--) {
+                more = true;
+                goto out;
+            }
+            flow = CONTAINER_OF(list_pop_front(slot), struct sw_flow,
+                                timer_node);
+            flow->timer_tick = 0;
+            if (flow_timeout(flow)) {
+                DP_TRACE2(flow_timeout, flow, flow->priority);
+                flow->table->remove(flow->table, flow);
+                list_push_back(deleted, &flow->node);
+                removed = true;
+            } else {
+                /* Used since it was scheduled.  Never reschedule into the
+                 * slot being processed. */
+                wheel_insert(chain, flow,
+                             MAX(flow_expiry_tick(flow), tick + 1));
+            }
+        }
+        chain->next_tick++;
+    }
+
+out:
+    if (removed) {
+        chain_cache_flush(chain);
+    }
+    return more;
+}
+
+/* Reports statistics for 'chain''s microflow cache in 'stats', as if it were
+ * a table whose lookups are the packets looked up in 'chain' and whose
+ * matches are the cache hits. */
+void
+chain_cache_stats(const struct sw_chain *chain, struct sw_table_stats *stats)
+{
+    unsigned int n_valid = 0;
+    int i;
+
+    for (i = 0; i < CHAIN_MF_CACHE_SIZE; i++) {
+        const struct chain_mf_entry *e = &chain->mf_cache[i];
+        if (e->sw_flow && e->serial == chain->mf_serial) {
+            n_valid++;
+        }
+    }
+
+    stats->name = "microflow";
+    stats->wildcards = 0;
+    stats->n_flows = n_valid;
+    stats->max_flows = CHAIN_MF_CACHE_SIZE;
+    stats->n_lookup = chain->mf_hits + chain->mf_misses;
+    stats->n_insert_failed = 0;
+    stats->n_matched = chain->mf_hits;
+}
+
+/* Returns true if every flow in 'chain' does nothing but output the packets
+ * that it matches, so that they may be forwarded with
+ * execute_forward_actions(). */
+bool
+chain_forward_only(const struct sw_chain *chain)
+{
+    return !chain->n_complex_flows;
+}
+
+/* Returns how far packets must be parsed to be looked up in 'chain'. */
+enum flow_layer
+chain_flow_layer(const struct sw_chain *chain)
+{
+    return chain->n_deep_flows ? FLOW_LAYER_ALL : FLOW_LAYER_L2;
+}
+
 /* Destroys 'chain', which must not have any users. */
 void
 chain_destroy(struct sw_chain *chain)
@@ -256,6 +1736,11 @@ chain_destroy(struct sw_chain *chain)
         t->destroy(t);
     }
     t = chain->emerg_table;
-    t->destroy(t);
+    if (t) {
+        t->destroy(t);
+    }
+    hmap_destroy(&chain->cookies);
+    hmap_destroy(&chain->out_ports);
+    hmap_destroy(&chain->overlaps);
     free(chain);
 }
@@ -34,20 +34,69 @@
 #ifndef CHAIN_H
 #define CHAIN_H 1
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include "flow.h"
+#include "hmap.h"
+#include "list.h"
+#include "switch-flow.h"
 
-struct sw_flow;
-struct sw_flow_key;
 struct ofp_action_header;
-struct list;
 struct datapath;
+struct sw_table_stats;
 
 #define TABLE_LINEAR_MAX_FLOWS  100
+#define TABLE_TSS_MAX_FLOWS     65536
+#define TABLE_DTREE_MAX_FLOWS   65536
 #define TABLE_HASH_MAX_FLOWS    65536
+#define TABLE_CUCKOO_MAX_FLOWS  (TABLE_HASH_MAX_FLOWS * 2)
+#define TABLE_EMERG_MAX_FLOWS   16384
+/* Tables created by chain_create() if no other list is given.  See
+ * chain_create() for the syntax. */
+#define CHAIN_DEFAULT_TABLES "cuckoo,tss,emerg"
+
 #define TABLE_MAC_MAX_FLOWS      1024
 #define TABLE_MAC_NUM_BUCKETS   1024
 
+/* Exact-match cache of chain lookup results, indexed by flow hash.  Any
+ * change to the chain's flows bumps the chain's 'mf_serial', which
+ * invalidates every entry at once. */
+#define CHAIN_MF_CACHE_SIZE 4096
+BUILD_ASSERT_DECL(IS_POW2(CHAIN_MF_CACHE_SIZE));
+struct chain_mf_entry {
+    struct flow flow;            /* Key that was looked up. */
+    struct sw_flow *sw_flow;     /* Flow it matched, or null if unused. */
+    unsigned int serial;         /* Valid only if equal to 'mf_serial'. */
+    int table_idx;               /* Index of the table holding 'sw_flow', or
+                                  * -1 for the emergency table. */
+};
+
+/* Flows with timeouts are kept on a two-level timing wheel with one-second
+ * ticks.  The first level has a slot for each of the next CHAIN_WHEEL_SIZE
+ * seconds, the second level a slot for each following block of
+ * CHAIN_WHEEL_SIZE seconds, which is moved down a level when it comes up.
+ * That covers the longest possible OpenFlow timeout. */
+#define CHAIN_WHEEL_BITS 8
+#define CHAIN_WHEEL_SIZE (1 << CHAIN_WHEEL_BITS)
+#define CHAIN_WHEEL_MASK (CHAIN_WHEEL_SIZE - 1)
+BUILD_ASSERT_DECL(CHAIN_WHEEL_SIZE * CHAIN_WHEEL_SIZE > UINT16_MAX);
+
+/* Maximum number of flows that one call to chain_timeout() examines. */
+#define CHAIN_TIMEOUT_BATCH 1024
+
+/* Once a second, up to CHAIN_PLACE_BATCH of the busiest flows in software
+ * tables move into the hardware table, if it has room or holds flows that
+ * forwarded less than half as many packets in the last second, which move
+ * out to make room.  Flows below CHAIN_PLACE_MIN_RATE packets per second
+ * are left where they are. */
+#define CHAIN_PLACE_BATCH 8
+#define CHAIN_PLACE_MIN_RATE 10
+
+/* Default number of flows that one eviction removes from a full table, with
+ * eviction enabled (see 'evict_batch' in struct sw_chain). */
+#define CHAIN_EVICT_BATCH 16
+
 /* Set of tables chained together in sequence from cheap to expensive. */
 #define CHAIN_MAX_TABLES 4
 struct sw_chain {
@@ -56,11 +105,85 @@ struct sw_chain {
     struct sw_table *tables[CHAIN_MAX_TABLES];
     struct sw_table *emerg_table;
 
+    /* In emergency mode, lookups that miss every working table fall through
+     * to 'emerg_table'.  Entering and leaving the mode only flips this flag,
+     * however many emergency flows there are. */
+    bool emerg_active;
+
     struct datapath *dp;
+
+    /* Microflow cache in front of 'tables'. */
+    unsigned int mf_serial;
+    unsigned long int mf_hits, mf_misses;
+    struct chain_mf_entry mf_cache[CHAIN_MF_CACHE_SIZE];
+
+    /* Timeout wheel.  Ticks before 'next_tick' have been fully processed. */
+    struct list wheel[2][CHAIN_WHEEL_SIZE];
+    uint64_t next_tick;
+    uint64_t last_scan;          /* Last tick at which tables without a
+                                  * 'remove' function were scanned. */
+
+    /* Number of flows in the chain that match on fields beyond layer 2.
+     * While this is 0, packets need only be parsed through layer 2. */
+    unsigned int n_deep_flows;
+
+    /* Number of flows in the chain whose actions do anything but output the
+     * packet.  While this is 0, no action needs a packet's parsed flow. */
+    unsigned int n_complex_flows;
+
+    /* Index of flows by cookie: contains "struct flow_cookie_group"s. */
+    struct hmap cookies;
+
+    /* Index of flows by output port: contains "struct flow_port_group"s. */
+    struct hmap out_ports;
+
+    /* Index of flows in the working tables by priority and wildcards:
+     * contains "struct flow_overlap_group"s. */
+    struct hmap overlaps;
+
+    /* Counters summed over the flows in each software table, by index into
+     * 'tables', and in 'emerg_table'.  The hardware table has none. */
+    struct flow_totals totals[CHAIN_MAX_TABLES];
+    struct flow_totals emerg_totals;
+
+    /* When a new flow fits in no working table, up to 'evict_batch' of the
+     * least recently used flows in a full table that would take it are
+     * removed to make room, or none if 'evict_batch' is 0.  'lru' lists the
+     * flows in each table that has a 'remove' function, by index into
+     * 'tables', least recently used first as of their 'lru_used'; a flow
+     * used since then gets a second chance at the back instead of being
+     * evicted, so that flow_used() need not move it. */
+    unsigned int evict_batch;
+    struct list lru[CHAIN_MAX_TABLES];
+    unsigned long int n_evicted[CHAIN_MAX_TABLES];
+};
+
+/* How chain_lookup() would look up a key, as found by chain_trace(). */
+struct chain_trace {
+    struct sw_flow *flow;        /* Flow found, or null. */
+    int table_idx;               /* Index of the table holding 'flow', or -1
+                                  * for the emergency table. */
+    bool cached;                 /* Whether the microflow cache holds the
+                                  * result, for a packet without an rxhash. */
+
+    /* The tables searched, in order, ending with the one that matched. */
+    size_t n_steps;
+    struct chain_trace_step {
+        int table_idx;           /* Index into 'tables', or -1. */
+        bool matched;            /* Whether 'flow' was found here. */
+        unsigned int n_compares; /* Flows compared with the key, or UINT_MAX
+                                  * if the table cannot count them. */
+    } steps[CHAIN_MAX_TABLES + 1];
 };
 
-struct sw_chain *chain_create(struct datapath *);
-struct sw_flow *chain_lookup(struct sw_chain *, const struct sw_flow_key *, int);
+int chain_create(struct datapath *, const char *tables, struct sw_chain **);
+struct sw_flow *chain_lookup(struct sw_chain *, const struct sw_flow_key *,
+                             uint32_t rxhash, int emerg);
+void chain_lookup_batch(struct sw_chain *, const struct sw_flow_key *[],
+                        const uint32_t rxhashes[], struct sw_flow *[],
+                        size_t n);
+void chain_trace(struct sw_chain *, const struct sw_flow_key *,
+                 struct chain_trace *);
 int chain_insert(struct sw_chain *, struct sw_flow *, int);
 int chain_modify(struct sw_chain *, const struct sw_flow_key *,
                  uint16_t, int, const struct ofp_action_header *, size_t, int);
@@ -68,7 +191,24 @@ int chain_has_conflict(struct sw_chain *, const struct sw_flow_key *,
                        uint16_t, int);
 int chain_delete(struct sw_chain *, const struct sw_flow_key *, uint16_t,
                  uint16_t, int, int);
-void chain_timeout(struct sw_chain *, struct list *deleted);
+size_t chain_find_cookie(const struct sw_chain *, uint64_t cookie,
+                         uint64_t mask, struct sw_flow ***flowsp);
+int chain_modify_cookie(struct sw_chain *, uint64_t cookie, uint64_t mask,
+                        const struct ofp_action_header *, size_t);
+int chain_delete_cookie(struct sw_chain *, uint64_t cookie, uint64_t mask,
+                        uint16_t out_port);
+void chain_set_emergency(struct sw_chain *, bool active);
+unsigned int chain_adopt(struct sw_chain *new, const struct sw_chain *old);
+void chain_batch_begin(struct sw_chain *);
+void chain_batch_commit(struct sw_chain *);
+bool chain_timeout(struct sw_chain *, struct list *deleted);
+bool chain_aggregate(const struct sw_chain *, const struct sw_table *,
+                     const struct sw_flow_key *, uint16_t out_port,
+                     struct flow_totals *);
+unsigned int chain_n_flows(const struct sw_chain *);
+void chain_cache_stats(const struct sw_chain *, struct sw_table_stats *);
+enum flow_layer chain_flow_layer(const struct sw_chain *);
+bool chain_forward_only(const struct sw_chain *);
 void chain_destroy(struct sw_chain *);
 
 #endif /* chain.h */
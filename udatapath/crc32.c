@@ -33,6 +33,12 @@
 
 #include <config.h>
 #include "crc32.h"
+#include <stdlib.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <cpuid.h>
+#define HAVE_CRC32C_HW 1
+#endif
 
 void
 crc32_init(struct crc32 *crc, unsigned int polynomial)
@@ -66,3 +72,36 @@ crc32_calculate(const struct crc32 *crc, const void *data_, size_t n_bytes)
     }
     return result;
 }
+
+/* Returns true if the CPU can compute CRC32C with crc32c_hw_words(). */
+bool
+crc32c_hw_supported(void)
+{
+#ifdef HAVE_CRC32C_HW
+    unsigned int eax, ebx, ecx, edx;
+    return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_SSE4_2);
+#else
+    return false;
+#endif
+}
+
+/* Computes the CRC32C of the 'n_words' 32-bit words starting at 'p', with
+ * 'basis' as the initial value, using the SSE4.2 "crc32" instruction.  This
+ * is the bit-reflected CRC used by iSCSI, so it differs from what
+ * crc32_calculate() computes for CRC32C_POLYNOMIAL.  May only be called if
+ * crc32c_hw_supported() returns true. */
+uint32_t
+crc32c_hw_words(const uint32_t *p, size_t n_words, uint32_t basis)
+{
+#ifdef HAVE_CRC32C_HW
+    uint32_t crc = basis;
+    size_t i;
+
+    for (i = 0; i < n_words; i++) {
+        __asm__("crc32l %1, %0" : "+r" (crc) : "rm" (p[i]));
+    }
+    return crc;
+#else
+    abort();
+#endif
+}
@@ -34,6 +34,7 @@
 #ifndef CRC32_H
 #define CRC32_H 1
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <stddef.h>
 
@@ -47,4 +48,10 @@ struct crc32 {
 void crc32_init(struct crc32 *, unsigned int polynomial);
 unsigned int crc32_calculate(const struct crc32 *, const void *, size_t);
 
+/* The Castagnoli polynomial, which the SSE4.2 "crc32" instruction uses. */
+#define CRC32C_POLYNOMIAL 0x1EDC6F41
+
+bool crc32c_hw_supported(void);
+uint32_t crc32c_hw_words(const uint32_t *, size_t n_words, uint32_t basis);
+
 #endif /* crc32.h */
@@ -36,21 +36,36 @@
 #include <assert.h>
 #include <errno.h>
 #include <inttypes.h>
+#include <limits.h>
+#include <poll.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include "bitmap.h"
 #include "chain.h"
 #include "csum.h"
+#include "dynamic-string.h"
 #include "flow.h"
+#include "hash.h"
+#include "hugepage.h"
+#include "mac-learning.h"
+#include "metrics.h"
 #include "ofpbuf.h"
 #include "openflow/openflow.h"
 #include "openflow/nicira-ext.h"
 #include "openflow/private-ext.h"
 #include "openflow/openflow-ext.h"
 #include "packets.h"
+#include "pending-miss.h"
+#include "policer.h"
+#include "pkt-ring.h"
+#include "pktbuf.h"
 #include "poll-loop.h"
 #include "rconn.h"
 #include "stp.h"
+#include "svec.h"
 #include "switch-flow.h"
 #include "table.h"
 #include "vconn.h"
@@ -58,6 +73,14 @@
 #include "private-msg.h"
 #include "of_ext_msg.h"
 #include "dp_act.h"
+#include "dp-trace.h"
+#include "rx-threads.h"
+#include "sampler.h"
+#include "shaper.h"
+#include "snapshot.h"
+#include "socket-util.h"
+#include "stats-file.h"
+#include "topk.h"
 
 #define THIS_MODULE VLM_datapath
 #include "vlog.h"
@@ -68,65 +91,9 @@
 #endif
 
 #if defined(OF_HW_PLAT) && !defined(USE_NETDEV)
-/* Queue to decouple receive packet thread from rconn control thread */
-/* Could make mutex per-DP */
-static pthread_mutex_t pkt_q_mutex = PTHREAD_MUTEX_INITIALIZER;
-#define PKT_Q_LOCK pthread_mutex_lock(&pkt_q_mutex)
-#define PKT_Q_UNLOCK pthread_mutex_unlock(&pkt_q_mutex)
-
-static void
-enqueue_pkt(struct datapath *dp, struct ofpbuf *buffer, of_port_t port_no,
-            int reason)
-{
-    struct hw_pkt_q_entry *q_entry;
-
-    if ((q_entry = xmalloc(sizeof(*q_entry))) == NULL) {
-        VLOG_WARN("Could not alloc q entry\n");
-        /* FIXME: Dealloc buffer */
-        return;
-    }
-    q_entry->buffer = buffer;
-    q_entry->next = NULL;
-    q_entry->port_no = port_no;
-    q_entry->reason = reason;
-    pthread_mutex_lock(&pkt_q_mutex);
-    if (dp->hw_pkt_list_head == NULL) {
-        dp->hw_pkt_list_head = q_entry;
-    } else {
-        dp->hw_pkt_list_tail->next = q_entry;
-    }
-    dp->hw_pkt_list_tail = q_entry;
-    pthread_mutex_unlock(&pkt_q_mutex);
-}
-
-/* If queue non-empty, fill out params and return 1; else return 0 */
-static int
-dequeue_pkt(struct datapath *dp, struct ofpbuf **buffer, of_port_t *port_no,
-            int *reason)
-{
-    struct hw_pkt_q_entry *q_entry;
-    int rv = 0;
-
-    pthread_mutex_lock(&pkt_q_mutex);
-    q_entry = dp->hw_pkt_list_head;
-    if (dp->hw_pkt_list_head != NULL) {
-        dp->hw_pkt_list_head = dp->hw_pkt_list_head->next;
-        if (dp->hw_pkt_list_head == NULL) {
-            dp->hw_pkt_list_tail = NULL;
-        }
-    }
-    pthread_mutex_unlock(&pkt_q_mutex);
-
-    if (q_entry != NULL) {
-        rv = 1;
-        *buffer = q_entry->buffer;
-        *port_no = q_entry->port_no;
-        *reason = q_entry->reason;
-        free(q_entry);
-    }
-
-    return rv;
-}
+/* Number of packets that the ring between the driver's receive callback
+ * thread and dp_run() can hold. */
+#define HW_PKT_RING_SIZE 4096
 #endif
 
 extern char mfr_desc;
@@ -159,14 +126,29 @@ extern char serial_num;
 struct sender {
     struct remote *remote;      /* The device that sent the message. */
     uint32_t xid;               /* The OpenFlow transaction ID. */
+
+    /* The buffer that holds the message, which a handler may share with
+     * ofpbuf_share() instead of copying data out of it, or NULL. */
+    struct ofpbuf *buffer;
 };
 
 /* A connection to a secure channel. */
 struct remote {
     struct list node;
     struct rconn *rconn;
-#define TXQ_LIMIT 128           /* Max number of packets to queue for tx. */
-    int n_txq;                  /* Number of packets queued for tx on rconn. */
+#define TXQ_LIMIT (1024 * 1024) /* Max bytes to queue for tx of replies. */
+#define ASYNC_TXQ_LIMIT (256 * 1024) /* Max bytes of queued async events. */
+
+/* With adaptive miss lengths, the fill levels of a controller's queue of
+ * asynchronous events between which packet_ins for misses shrink from
+ * 'miss_send_len' to MISS_LEN_MIN bytes, enough for Ethernet, VLAN, IPv4,
+ * and TCP headers without options. */
+#define MISS_LEN_LOW_WATER (ASYNC_TXQ_LIMIT / 4)
+#define MISS_LEN_HIGH_WATER (ASYNC_TXQ_LIMIT * 3 / 4)
+#define MISS_LEN_MIN 64
+
+    /* OFP_EXT_BUNDLE of messages not yet sent, or NULL. */
+    struct ofpbuf *bundle;
 
     /* Support for reliable, multi-message replies to requests.
      *
@@ -176,38 +158,105 @@ struct remote {
     int (*cb_dump)(struct datapath *, void *aux);
     void (*cb_done)(void *aux);
     void *cb_aux;
+
+    /* New-flow setup time: from sending a packet_in for a buffered packet to
+     * this remote's flow_mod or packet_out that releases it. */
+    struct latency_hist setup_latency;
+    unsigned long long int n_stale_buffers; /* Buffer IDs no longer valid. */
+
+    /* Datagram channel for packet_ins, set up by OFP_EXT_PACKET_IN_UDP.
+     * Packet_ins that the socket cannot take right away wait in a small
+     * ring; when it is full, the oldest one is dropped to make room, so that
+     * the controller always gets the freshest packets and a slow controller
+     * never delays the replies on 'rconn'. */
+    int pin_fd;                 /* Connected UDP socket, or -1. */
+#define PIN_QUEUE_LEN 64
+    struct ofpbuf *pin_queue[PIN_QUEUE_LEN];
+    unsigned int pin_head;      /* Index of oldest queued packet_in. */
+    unsigned int pin_n;         /* Number of queued packet_ins. */
+    unsigned long long int n_pin_sent;    /* Datagrams sent. */
+    unsigned long long int n_pin_dropped; /* Packet_ins dropped. */
+
+    /* Asynchronous messages chosen by OFP_EXT_SET_ASYNC.  Bit R of each mask
+     * selects the message with reason R.  'async_ports', if nonnull, further
+     * limits packet_ins and port_status messages to the ports whose bits are
+     * set, with OFPP_LOCAL as bit DP_MAX_PORTS. */
+    bool async_all;             /* Send everything, ignoring the rest? */
+    uint32_t packet_in_mask;
+    uint32_t port_status_mask;
+    uint32_t flow_removed_mask;
+    unsigned long *async_ports;
+
+    /* Nonzero if this remote shares packet_ins with the other remotes that
+     * have a 'balance_id' (see struct ofp_ext_set_async). */
+    uint32_t balance_id;
+
+    /* Flow table being staged by OFP_EXT_TABLE_REPLACE, which this remote's
+     * flow_mods change instead of the datapath's, or null. */
+    struct sw_chain *staged;
+
+    /* Pipeline table that this remote's flow_mods and flow statistics
+     * requests address, as set by OFP_EXT_SET_TABLE. */
+    uint8_t table_id;
 };
 
+/* Maximum number of replies that the dumps on all remotes together compose in
+ * one call to dp_run().  A flow stats reply holds a few dozen flows, so this
+ * lets a dump of a large table proceed in slices between rounds of packet
+ * forwarding instead of holding up the loop for a whole message budget of
+ * replies at a time. */
+#define DP_DUMP_BUDGET 4
+
+/* A dump stops making progress while its remote has this many bytes of
+ * replies queued for transmission, which bounds the memory that a dump to a
+ * slow reader can tie up and leaves the rest of the queue for other
+ * replies. */
+#define DUMP_TXQ_LIMIT (TXQ_LIMIT / 2)
+
+/* Maximum number of ports queued with dp_add_port_later() that one call to
+ * dp_run() brings up.  Opening a port and configuring its queues takes a
+ * number of system calls, so bringing up hundreds of them at once would keep
+ * the datapath from accepting and answering its controller. */
+#define DP_PORT_INIT_BUDGET 4
+
+/* A port queued by dp_add_port_later(). */
+struct pending_port {
+    struct list node;           /* In datapath's 'pending_ports'. */
+    char *name;                 /* Network device name. */
+    uint16_t num_queues;
+};
+
+/* Largest OFP_EXT_BUNDLE message that the datapath composes. */
+#define BUNDLE_MAX_BYTES 16384
+
 static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(60, 60);
 
 static struct remote *remote_create(struct datapath *, struct rconn *);
-static void remote_run(struct datapath *, struct remote *);
+static bool remote_run(struct datapath *, struct remote *, int *dump_budget);
+static void run_misses(struct datapath *);
+static void run_held_misses(struct datapath *, struct pending_miss *,
+                            const struct ofp_action_header *, size_t);
 static void remote_wait(struct remote *);
 static void remote_destroy(struct remote *);
+static void remote_flush_bundle(struct remote *);
+static void remote_close_packet_in_udp(struct remote *);
+static void remote_flush_packet_ins(struct remote *);
 
 static void update_port_flags(struct datapath *, const struct ofp_port_mod *);
+static void update_flood_ports(struct datapath *);
 static void send_port_status(struct sw_port *p, uint8_t status);
-
-/* Buffers are identified by a 31-bit opaque ID.  We divide the ID
- * into a buffer number (low bits) and a cookie (high bits).  The buffer number
- * is an index into an array of buffers.  The cookie distinguishes between
- * different packets that have occupied a single buffer.  Thus, the more
- * buffers we have, the lower-quality the cookie... */
-#define PKT_BUFFER_BITS 8
-#define N_PKT_BUFFERS (1 << PKT_BUFFER_BITS)
-#define PKT_BUFFER_MASK (N_PKT_BUFFERS - 1)
-
-#define PKT_COOKIE_BITS (32 - PKT_BUFFER_BITS)
+static void dp_status(struct datapath *, struct ds *,
+                      const char *request, size_t request_len);
 
 int run_flow_through_tables(struct datapath *, struct ofpbuf *,
-                            struct sw_port *);
+                            struct sw_port *, struct sw_flow_key *);
 void fwd_port_input(struct datapath *, struct ofpbuf *, struct sw_port *);
-int fwd_control_input(struct datapath *, const struct sender *,
-                      const void *, size_t);
-
-uint32_t save_buffer(struct ofpbuf *);
-static struct ofpbuf *retrieve_buffer(uint32_t id);
-static void discard_buffer(uint32_t id);
+static void fwd_port_input_batch(struct datapath *, struct ofpbuf *[], size_t,
+                                 struct sw_port *);
+static enum flow_layer rx_flow_layer(const struct datapath *);
+static int run_extracted_flow(struct datapath *, struct ofpbuf *,
+                              struct sw_port *, struct sw_flow_key *,
+                              int is_frag, uint64_t start);
 
 struct sw_port *
 dp_lookup_port(struct datapath *dp, uint16_t port_no)
@@ -217,17 +266,75 @@ dp_lookup_port(struct datapath *dp, uint16_t port_no)
             : NULL);
 }
 
+/* Counts a packet dropped for OFP_EXT_DROP_* 'reason' against 'p', or
+ * against 'dp' as a whole if 'p' is null. */
+static void
+count_drop(struct datapath *dp, struct sw_port *p, int reason)
+{
+    (p ? p->drops : dp->drops)[reason]++;
+}
+
+/* Counts a packet dropped for OFP_EXT_DROP_* 'reason' against the port
+ * numbered 'port_no', if 'dp' has one, otherwise against 'dp'. */
+static void
+count_port_no_drop(struct datapath *dp, uint16_t port_no, int reason)
+{
+    struct sw_port *p = dp_lookup_port(dp, port_no);
+    count_drop(dp, PORT_IN_USE(p) ? p : NULL, reason);
+}
+
+/* Returns the number of packets that failed transmission on 'p', including
+ * those that its shaper queued before failing to send them. */
+static unsigned long long int
+port_tx_dropped(const struct sw_port *p)
+{
+    return (p->drops[OFP_EXT_DROP_TX]
+            + (p->shaper ? shaper_n_dropped(p->shaper) : 0));
+}
+
+static unsigned int
+queue_index_hash(uint32_t queue_id)
+{
+    return hash_words(&queue_id, 1, 0) & (DP_QUEUE_INDEX_SIZE - 1);
+}
+
+/* Returns the queue on 'p' with the given 'queue_id', or a null pointer if
+ * there is none.  Runs for every OFPAT_ENQUEUE'd packet, so it probes
+ * 'p->queue_index' rather than walking 'p->queue_list'. */
 struct sw_queue *
 dp_lookup_queue(struct sw_port *p, uint32_t queue_id)
+{
+    unsigned int slot = queue_index_hash(queue_id);
+    int i;
+
+    for (i = 0; i < DP_QUEUE_INDEX_SIZE; i++) {
+        uint8_t class_id = p->queue_index[slot];
+        if (!class_id) {
+            return NULL;
+        } else if (p->queues[class_id].queue_id == queue_id) {
+            return &p->queues[class_id];
+        }
+        slot = (slot + 1) & (DP_QUEUE_INDEX_SIZE - 1);
+    }
+    return NULL;
+}
+
+/* Rebuilds 'p->queue_index' from 'p->queue_list'.  Must be called after
+ * every queue addition or deletion on 'p'.  Rebuilding from scratch keeps
+ * deletion simple, and queue configuration changes are rare. */
+void
+dp_index_queues(struct sw_port *p)
 {
     struct sw_queue *q;
 
+    memset(p->queue_index, 0, sizeof p->queue_index);
     LIST_FOR_EACH(q, struct sw_queue, node, &p->queue_list) {
-        if ((q != NULL) && (q->queue_id == queue_id)) {
-            return q;
+        unsigned int slot = queue_index_hash(q->queue_id);
+        while (p->queue_index[slot]) {
+            slot = (slot + 1) & (DP_QUEUE_INDEX_SIZE - 1);
         }
+        p->queue_index[slot] = q->class_id;
     }
-    return NULL;
 }
 
 /* Generates and returns a random datapath id. */
@@ -258,7 +365,7 @@ hw_packet_in(of_port_t port_no, of_packet_t *packet, int reason,
     struct sw_port *port;
     struct ofpbuf *buffer = NULL;
     struct datapath *dp = (struct datapath *)cookie;
-    const int headroom = 128 + 2;
+    const int headroom = DP_RX_HEADROOM;
     const int hard_header = VLAN_ETH_HEADER_LEN;
     const int tail_room = sizeof(uint32_t);  /* For crc if needed later */
 
@@ -293,8 +400,9 @@ hw_packet_in(of_port_t port_no, of_packet_t *packet, int reason,
         buffer->data = (char*)buffer->data + headroom;
         buffer->size = packet->length;
         memcpy(buffer->data, packet->data, packet->length);
-        enqueue_pkt(dp, buffer, port_no, reason);
-        poll_immediate_wake();
+        /* FIXME:  We're throwing away the reason that came from HW */
+        buffer->private = port;
+        pkt_ring_put(dp->hw_pkt_ring, buffer);
     }
 
     return 0;
@@ -305,15 +413,13 @@ hw_packet_in(of_port_t port_no, of_packet_t *packet, int reason,
 static int
 dp_hw_drv_init(struct datapath *dp)
 {
-    dp->hw_pkt_list_head = NULL;
-    dp->hw_pkt_list_tail = NULL;
-
     dp->hw_drv = new_of_hw_driver(dp);
     if (dp->hw_drv == NULL) {
         VLOG_ERR("Could not create HW driver");
         return -1;
     }
 #if !defined(USE_NETDEV)
+    dp->hw_pkt_ring = pkt_ring_create(HW_PKT_RING_SIZE);
     if (dp->hw_drv->packet_receive_register(dp->hw_drv,
                                             hw_packet_in, dp) < 0) {
         VLOG_ERR("Could not register with HW driver to receive pkts");
@@ -325,18 +431,27 @@ dp_hw_drv_init(struct datapath *dp)
 
 #endif
 
+/* Creates a new datapath with the given 'dpid' and stores it in '*dp_'.
+ * 'tables' describes the flow tables to create, in the format accepted by
+ * chain_create(), or it may be null to use the default tables.  Up to
+ * 'n_buffers' packets sent to the controller are buffered at a time (see
+ * pktbuf_create()).  Returns 0 if successful, otherwise a positive errno
+ * value. */
 int
-dp_new(struct datapath **dp_, uint64_t dpid)
+dp_new(struct datapath **dp_, uint64_t dpid, const char *tables,
+       unsigned int n_buffers)
 {
     struct datapath *dp;
+    int error;
 
     dp = calloc(1, sizeof *dp);
     if (!dp) {
         return ENOMEM;
     }
 
-    dp->last_timeout = time_now();
     list_init(&dp->remotes);
+    latency_init(&dp->latency);
+    ofpstat_proc_init(&dp->proc_stats);
     dp->listeners = NULL;
     dp->n_listeners = 0;
     dp->id = dpid <= UINT64_C(0xffffffffffff) ? dpid : gen_datapath_id();
@@ -344,16 +459,31 @@ dp_new(struct datapath **dp_, uint64_t dpid)
 #if defined(OF_HW_PLAT) && (defined(UDATAPATH_AS_LIB) || defined(USE_NETDEV))
     dp_hw_drv_init(dp);
 #endif
-    dp->chain = chain_create(dp);
-    if (!dp->chain) {
+    error = chain_create(dp, tables, &dp->chain);
+    if (error) {
         VLOG_ERR("could not create chain");
         free(dp);
+        return -error;
+    }
+    dp->tables = tables ? xstrdup(tables) : NULL;
+    dp->pktbuf = pktbuf_create(n_buffers);
+    if (!dp->pktbuf) {
+        VLOG_ERR("could not create packet buffers");
+        chain_destroy(dp->chain);
+        free(dp);
         return ENOMEM;
     }
 
+    dp->ml = mac_learning_create();
+
     list_init(&dp->port_list);
+    list_init(&dp->pending_ports);
+    list_init(&dp->miss_ports);
     dp->flags = 0;
     dp->miss_send_len = OFP_DEFAULT_MISS_SEND_LEN;
+    dp->rx_budget = DP_DEFAULT_RX_BUDGET;
+    dp->msg_budget = DP_DEFAULT_MSG_BUDGET;
+    dp->rx_weight = dp->msg_weight = 1;
 
     if(strlen(&dp_desc) > 0)	/* use the comment, if specified */
 	    strncpy(dp->dp_desc, &dp_desc, sizeof dp->dp_desc);
@@ -368,6 +498,63 @@ dp_new(struct datapath **dp_, uint64_t dpid)
     return 0;
 }
 
+/* Number of idle receive buffers kept for reuse by each port. */
+#define RX_POOL_FREE (DP_RX_BATCH * 2)
+
+/* Points 'dp''s port monitor, creating it if necessary, at the network
+ * devices of all of 'dp''s ports.  If the monitor cannot be created, port
+ * descriptions are not cached. */
+static void
+update_port_monitor(struct datapath *dp)
+{
+    struct svec names;
+    struct sw_port *p;
+
+    if (!dp->port_monitor && netdev_monitor_create(&dp->port_monitor)) {
+        return;
+    }
+
+    svec_init(&names);
+    LIST_FOR_EACH (p, struct sw_port, node, &dp->port_list) {
+        if (p->netdev) {
+            svec_add(&names, netdev_get_name(p->netdev));
+        }
+    }
+    netdev_monitor_set_devices(dp->port_monitor, names.names, names.n);
+    svec_destroy(&names);
+}
+
+/* Forgets the cached descriptions of the ports whose network devices have
+ * changed, so that the next features reply or port status message reads them
+ * again. */
+static void
+run_port_monitor(struct datapath *dp)
+{
+    const char *name;
+
+    if (!dp->port_monitor) {
+        return;
+    }
+    netdev_monitor_run(dp->port_monitor);
+    while ((name = netdev_monitor_poll(dp->port_monitor)) != NULL) {
+        struct sw_port *p;
+
+        LIST_FOR_EACH (p, struct sw_port, node, &dp->port_list) {
+            if (p->netdev && !strcmp(netdev_get_name(p->netdev), name)) {
+                p->desc_valid = false;
+            }
+        }
+    }
+}
+
+/* Returns the number of bytes of tailroom that a receive buffer for 'p' must
+ * have. */
+static int
+rx_buffer_room(const struct sw_port *p)
+{
+    return VLAN_ETH_HEADER_LEN + netdev_get_mtu(p->netdev);
+}
+
 static int
 new_port(struct datapath *dp, struct sw_port *port, uint16_t port_no,
          const char *netdev_name, const uint8_t *new_mac, uint16_t num_queues)
@@ -410,7 +597,31 @@ new_port(struct datapath *dp, struct sw_port *port, uint16_t port_no,
                  netdev_name, in6_name);
     }
 
-    if (num_queues > 0) {
+    if (dp->tx_ring_frames) {
+        error = netdev_setup_tx_ring(netdev, dp->tx_ring_frames);
+        if (error) {
+            VLOG_WARN("failed to set up TX ring on %s device (%s), "
+                      "sending packets one at a time", netdev_name,
+                      strerror(error));
+        }
+    }
+    if (dp->rx_ring_frames) {
+        error = netdev_setup_rx_ring(netdev, dp->rx_ring_frames);
+        if (error) {
+            VLOG_WARN("failed to set up RX ring on %s device (%s), "
+                      "receiving packets with system calls", netdev_name,
+                      strerror(error));
+        }
+    }
+    if (dp->busy_poll_usecs) {
+        error = netdev_set_busy_poll(netdev, dp->busy_poll_usecs);
+        if (error && error != EOPNOTSUPP) {
+            VLOG_WARN("failed to enable busy polling on %s device (%s)",
+                      netdev_name, strerror(error));
+        }
+    }
+
+    if (num_queues > 0 && !dp->use_shaper) {
         error = netdev_setup_slicing(netdev, num_queues);
         if (error) {
             VLOG_ERR("failed to configure slicing on %s device: "\
@@ -430,7 +641,18 @@ new_port(struct datapath *dp, struct sw_port *port, uint16_t port_no,
     port->netdev = netdev;
     port->port_no = port_no;
     port->num_queues = num_queues;
+    if (num_queues > 0 && dp->use_shaper) {
+        port->shaper = shaper_create(netdev, num_queues);
+    }
+    port->rx_pool = ofpbuf_pool_create(DP_RX_HEADROOM,
+                                       DP_RX_HEADROOM + rx_buffer_room(port),
+                                       RX_POOL_FREE);
+    if (hugepage_enabled()) {
+        ofpbuf_pool_prealloc(port->rx_pool, RX_POOL_FREE);
+    }
     list_push_back(&dp->port_list, &port->node);
+    update_flood_ports(dp);
+    update_port_monitor(dp);
 
     /* Notify the ctlpath that this port has been added */
     send_port_status(port, OFPPR_ADD);
@@ -463,9 +685,11 @@ dp_add_port(struct datapath *dp, const char *port_name, uint16_t num_queues)
                 port->dp = dp;
                 port->port_no = port_no;
                 list_init(&port->queue_list);
+                dp_index_queues(port);
                 port->num_queues = num_queues;
                 strncpy(port->hw_name, port_name, sizeof(port->hw_name));
                 list_push_back(&dp->port_list, &port->node);
+                update_flood_ports(dp);
                 send_port_status(port, OFPPR_ADD);
             }
         } else {
@@ -516,6 +740,66 @@ dp_add_local_port(struct datapath *dp, const char *netdev, uint16_t num_queues)
     }
 }
 
+/* Arranges for dp_run() to add 'netdev' as a switch port with 'num_queues'
+ * queues, as dp_add_port() would.  Ports are brought up a few at a time in
+ * the order queued, so they get the same port numbers as if they had been
+ * added directly, and each one is announced to controllers with a port status
+ * message, and included in features replies, only once it is up. */
+void
+dp_add_port_later(struct datapath *dp, const char *netdev,
+                  uint16_t num_queues)
+{
+    struct pending_port *pp = xmalloc(sizeof *pp);
+    pp->name = xstrdup(netdev);
+    pp->num_queues = num_queues;
+    list_push_back(&dp->pending_ports, &pp->node);
+}
+
+/* Returns true if some port queued with dp_add_port_later() is not yet up. */
+bool
+dp_ports_pending(const struct datapath *dp)
+{
+    return !list_is_empty(&dp->pending_ports);
+}
+
+static void
+run_pending_ports(struct datapath *dp)
+{
+    int budget;
+
+    for (budget = DP_PORT_INIT_BUDGET;
+         budget > 0 && !list_is_empty(&dp->pending_ports); budget--) {
+        struct pending_port *pp;
+        int error;
+
+        pp = CONTAINER_OF(list_pop_front(&dp->pending_ports),
+                          struct pending_port, node);
+        error = dp_add_port(dp, pp->name, pp->num_queues);
+        if (error) {
+            VLOG_ERR("failed to add port %s: %s", pp->name,
+                     error > 0 ? strerror(error) : "unknown error");
+        }
+        free(pp->name);
+        free(pp);
+    }
+}
+
+/* Makes 'dp' save packets for its controllers in the same buffers as
+ * 'other', instead of in buffers of its own (see pktbuf_share()).  Should be
+ * called before 'dp' sends any packet to a controller.  Returns 0 if
+ * successful, otherwise a positive errno value. */
+int
+dp_share_buffers(struct datapath *dp, const struct datapath *other)
+{
+    struct pktbuf *pktbuf = pktbuf_share(other->pktbuf);
+    if (!pktbuf) {
+        return ENOMEM;
+    }
+    pktbuf_destroy(dp->pktbuf);
+    dp->pktbuf = pktbuf;
+    return 0;
+}
+
 void
 dp_add_pvconn(struct datapath *dp, struct pvconn *pvconn)
 {
@@ -524,103 +808,285 @@ dp_add_pvconn(struct datapath *dp, struct pvconn *pvconn)
     dp->listeners[dp->n_listeners++] = pvconn;
 }
 
+/* Hands packets queued in 'dp''s TX rings and shapers to the kernel. */
+static void
+flush_ports(struct datapath *dp)
+{
+    struct sw_port *p;
+
+    LIST_FOR_EACH (p, struct sw_port, node, &dp->port_list) {
+        if (!IS_HW_PORT(p) && p->netdev != NULL) {
+            if (p->shaper) {
+                shaper_run(p->shaper);
+            }
+            netdev_send_flush(p->netdev);
+        }
+    }
+}
+
+/* Receives and forwards up to 'budget' packets from software port 'p', in
+ * batches of up to DP_RX_BATCH.  Returns true if 'p' may have more packets
+ * waiting, that is, if the whole budget was used. */
+static bool
+poll_port(struct datapath *dp, struct sw_port *p, unsigned int budget)
+{
+    unsigned int n_total = 0;
+    size_t i;
+
+    while (n_total < budget) {
+        struct ofpbuf *batch[DP_RX_BATCH];
+        int n = MIN(budget - n_total, DP_RX_BATCH);
+        int n_rx;
+        int error;
+
+        for (i = 0; i < n; i++) {
+            struct ofpbuf *buffer = dp->rx_batch[i];
+            if (buffer && ofpbuf_tailroom(buffer) < rx_buffer_room(p)) {
+                ofpbuf_delete(buffer);
+                buffer = NULL;
+            }
+            if (!buffer) {
+                dp->rx_batch[i] = ofpbuf_pool_get(p->rx_pool);
+            }
+        }
+
+        error = netdev_recv_batch(p->netdev, dp->rx_batch, n, &n_rx);
+        if (n_rx > 0) {
+            for (i = 0; i < n_rx; i++) {
+                batch[i] = dp->rx_batch[i];
+                dp->rx_batch[i] = NULL;
+                p->rx_packets++;
+                p->rx_bytes += batch[i]->size;
+            }
+            fwd_port_input_batch(dp, batch, n_rx, p);
+            n_total += n_rx;
+        }
+        if (error && error != EAGAIN) {
+            VLOG_ERR_RL(&rl, "error receiving data from %s: %s",
+                        netdev_get_name(p->netdev), strerror(error));
+        }
+        if (n_rx < n) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Receives and forwards packets from each of 'dp''s software ports, up to
+ * the current receive budget per port, then transmits what that queued.
+ * dp_run() does this along with all of its other work; a busy-polling main
+ * loop may call it by itself in between calls to dp_run().
+ *
+ * Returns true if any port used its whole budget, and so may have more
+ * packets waiting. */
+bool
+dp_poll_ports(struct datapath *dp)
+{
+    unsigned int budget = dp->rx_budget * dp->rx_weight;
+    struct sw_port *p, *pn;
+    bool backlog = false;
+
+    if (dp->rx_threads) {
+        struct ofpbuf *buffer, *next;
+
+        for (buffer = rx_threads_take(dp->rx_threads); buffer; buffer = next) {
+            next = buffer->next;
+            buffer->next = NULL;
+            p = buffer->private;
+            buffer->private = NULL;
+            p->rx_packets++;
+            p->rx_bytes += buffer->size;
+
+            /* The receive threads may be shared with other datapaths. */
+            fwd_port_input(p->dp, buffer, p);
+        }
+    }
+
+    LIST_FOR_EACH_SAFE (p, pn, struct sw_port, node, &dp->port_list) {
+        if (IS_HW_PORT(p) || p->flags & SWP_RX_THREAD) {
+            continue;
+        }
+        if (poll_port(dp, p, budget)) {
+            backlog = true;
+        }
+    }
+
+    flush_ports(dp);
+    return backlog;
+}
+
+/* Shifts weight toward whichever of forwarding and OpenFlow message
+ * processing had work left over in the last dp_run(), if only one of them
+ * did.  When both or neither did, each goes back to its configured budget,
+ * so that the configured ratio decides under load on both planes. */
+static void
+adjust_weights(struct datapath *dp, bool rx_backlog, bool msg_backlog)
+{
+    if (rx_backlog && !msg_backlog) {
+        dp->rx_weight = MIN(dp->rx_weight * 2, DP_MAX_WEIGHT);
+        dp->msg_weight = 1;
+    } else if (msg_backlog && !rx_backlog) {
+        dp->msg_weight = MIN(dp->msg_weight * 2, DP_MAX_WEIGHT);
+        dp->rx_weight = 1;
+    } else {
+        dp->rx_weight = dp->msg_weight = 1;
+    }
+}
+
 void
 dp_run(struct datapath *dp)
 {
-    time_t now = time_now();
-    struct sw_port *p, *pn;
+    struct list deleted = LIST_INITIALIZER(&deleted);
     struct remote *r, *rn;
-    struct ofpbuf *buffer = NULL;
+    struct sw_flow *f, *n;
+    bool rx_backlog, msg_backlog;
+    int dump_budget;
     size_t i;
 
-    if (now != dp->last_timeout) {
-        struct list deleted = LIST_INITIALIZER(&deleted);
-        struct sw_flow *f, *n;
-
-        chain_timeout(dp->chain, &deleted);
-        LIST_FOR_EACH_SAFE (f, n, struct sw_flow, node, &deleted) {
-            dp_send_flow_end(dp, f, f->reason);
-            list_remove(&f->node);
-            flow_free(f);
+    /* chain_timeout() only looks at flows that are due, so it is cheap to
+     * call on every pass. */
+    if (chain_timeout(dp->chain, &deleted)) {
+        poll_immediate_wake();
+    }
+    for (i = 1; i < OFP_EXT_PIPELINE_TABLES; i++) {
+        if (dp->pipeline[i] && chain_timeout(dp->pipeline[i], &deleted)) {
+            poll_immediate_wake();
         }
-        dp->last_timeout = now;
+    }
+    LIST_FOR_EACH_SAFE (f, n, struct sw_flow, node, &deleted) {
+        dp_send_flow_end(dp, f, f->reason);
+        list_remove(&f->node);
+        flow_free(f);
     }
     poll_timer_wait(1000);
 
+    run_pending_ports(dp);
+    run_port_monitor(dp);
+
 #if defined(OF_HW_PLAT) && !defined(USE_NETDEV)
-    { /* Process packets received from callback thread */
+    /* Process packets received from callback thread */
+    if (dp->hw_pkt_ring) {
+        unsigned long long int n_dropped;
         struct ofpbuf *buffer;
-        of_port_t port_no;
-        int reason;
         struct sw_port *p;
 
-        while (dequeue_pkt(dp, &buffer, &port_no, &reason)) {
-            p = dp_lookup_port(dp, port_no);
-            /* FIXME:  We're throwing away the reason that came from HW */
+        while ((buffer = pkt_ring_get(dp->hw_pkt_ring)) != NULL) {
+            p = buffer->private;
+            buffer->private = NULL;
             fwd_port_input(dp, buffer, p);
         }
+
+        n_dropped = pkt_ring_n_dropped(dp->hw_pkt_ring);
+        if (n_dropped != dp->hw_pkt_n_dropped) {
+            VLOG_WARN_RL(&rl, "hardware receive ring full, dropped %llu "
+                         "packets", n_dropped - dp->hw_pkt_n_dropped);
+            dp->drops[OFP_EXT_DROP_HW_RING] += (n_dropped
+                                                - dp->hw_pkt_n_dropped);
+            dp->hw_pkt_n_dropped = n_dropped;
+        }
     }
 #endif
 
-    LIST_FOR_EACH_SAFE (p, pn, struct sw_port, node, &dp->port_list) {
-        int error;
+    mac_learning_run(dp->ml, NULL);
+    rx_backlog = dp_poll_ports(dp);
+    run_misses(dp);
+    if (dp->pending_misses) {
+        struct pending_miss *miss;
 
-        if (IS_HW_PORT(p)) {
-            continue;
-        }
-        if (!buffer) {
-            /* Allocate buffer with some headroom to add headers in forwarding
-             * to the controller or adding a vlan tag, plus an extra 2 bytes to
-             * allow IP headers to be aligned on a 4-byte boundary.  */
-            const int headroom = 128 + 2;
-            const int hard_header = VLAN_ETH_HEADER_LEN;
-            const int mtu = netdev_get_mtu(p->netdev);
-            buffer = ofpbuf_new(headroom + hard_header + mtu);
-            buffer->data = (char*)buffer->data + headroom;
-        }
-        error = netdev_recv(p->netdev, buffer);
-        if (!error) {
-            p->rx_packets++;
-            p->rx_bytes += buffer->size;
-            fwd_port_input(dp, buffer, p);
-            buffer = NULL;
-        } else if (error != EAGAIN) {
-            VLOG_ERR_RL(&rl, "error receiving data from %s: %s",
-                        netdev_get_name(p->netdev), strerror(error));
+        while ((miss = pending_misses_take_expired(dp->pending_misses))) {
+            run_held_misses(dp, miss, NULL, 0);
         }
     }
-    ofpbuf_delete(buffer);
 
     /* Talk to remotes. */
+    dump_budget = DP_DUMP_BUDGET;
+    msg_backlog = false;
     LIST_FOR_EACH_SAFE (r, rn, struct remote, node, &dp->remotes) {
-        remote_run(dp, r);
+        if (remote_run(dp, r, &dump_budget)) {
+            msg_backlog = true;
+        }
+    }
+    adjust_weights(dp, rx_backlog, msg_backlog);
+    LIST_FOR_EACH (r, struct remote, node, &dp->remotes) {
+        remote_flush_bundle(r);
+        remote_flush_packet_ins(r);
     }
 
+    /* Accept every connection waiting on each listener, so that a burst of
+     * reconnections does not take one pass per connection. */
     for (i = 0; i < dp->n_listeners; ) {
         struct pvconn *pvconn = dp->listeners[i];
         struct vconn *new_vconn;
-        int retval = pvconn_accept(pvconn, OFP_VERSION, &new_vconn);
-        if (!retval) {
+        int retval;
+
+        while (!(retval = pvconn_accept(pvconn, OFP_VERSION, &new_vconn))) {
             remote_create(dp, rconn_new_from_vconn("passive", new_vconn));
-        } else if (retval != EAGAIN) {
+        }
+        if (retval != EAGAIN) {
             VLOG_WARN_RL(&rl, "accept failed (%s)", strerror(retval));
             dp->listeners[i] = dp->listeners[--dp->n_listeners];
             continue;
         }
         i++;
     }
+
+    /* Hand packets queued in TX rings to the kernel. */
+    flush_ports(dp);
+
+    if (dp->sampler) {
+        sampler_run(dp->sampler);
+    }
+    if (dp->topk) {
+        topk_run(dp->topk);
+    }
+
+    if (metrics_due() || stats_file_due()) {
+        struct ds output;
+
+        ds_init(&output);
+        dp_status(dp, &output, "", 0);
+        if (metrics_due()) {
+            metrics_send(&output);
+        }
+        if (stats_file_due()) {
+            stats_file_publish(&output);
+        }
+        ds_destroy(&output);
+    }
 }
 
-static void
-remote_run(struct datapath *dp, struct remote *r)
+/* Maximum number of messages processed from one remote in a single call to
+ * remote_run(), at the default message budget, if all of those beyond the
+ * budget are flow_mods.  Scales with the budget. */
+#define REMOTE_MAX_FLOW_MODS 1024
+
+/* Runs 'r', including any dump in progress on it.  '*dump_budget' is the
+ * number of dump replies that may still be composed in this call to dp_run();
+ * it is decremented for each reply.
+ *
+ * Returns true if 'r' used its whole message budget, and so may have more
+ * messages waiting. */
+static bool
+remote_run(struct datapath *dp, struct remote *r, int *dump_budget)
 {
-    int i;
+    unsigned int max_msgs = dp->msg_budget * dp->msg_weight;
+    unsigned int max_flow_mods = MAX(max_msgs, (REMOTE_MAX_FLOW_MODS * max_msgs
+                                                / DP_DEFAULT_MSG_BUDGET));
+    bool flow_mods = false;
+    bool backlog;
+    unsigned int i;
 
     rconn_run(r->rconn);
 
     /* Do some remote processing, but cap it at a reasonable amount so that
-     * other processing doesn't starve. */
-    for (i = 0; i < 50; i++) {
+     * other processing doesn't starve.  A run of flow_mods, such as a
+     * controller installs when it connects, is processed as a batch of up to
+     * 'max_flow_mods' messages ending at the first other message (e.g. a
+     * barrier), so that the flow tables settle once per batch rather than
+     * once every 'max_msgs' messages.  A hardware table is told about
+     * the batch, so that it can write the flows out together, and the batch
+     * is committed before any other message is processed. */
+    for (i = 0; i < max_msgs || (flow_mods && i < max_flow_mods); i++) {
         if (!r->cb_dump) {
             struct ofpbuf *buffer;
             struct ofp_header *oh;
@@ -636,31 +1102,54 @@ remote_run(struct datapath *dp, struct remote *r)
                 oh = (struct ofp_header *)buffer->data;
                 sender.remote = r;
                 sender.xid = oh->xid;
+                sender.buffer = buffer;
+                if (flow_mods != (oh->type == OFPT_FLOW_MOD)) {
+                    flow_mods = !flow_mods;
+                    if (flow_mods) {
+                        chain_batch_begin(dp->chain);
+                    } else {
+                        chain_batch_commit(dp->chain);
+                    }
+                }
                 fwd_control_input(dp, &sender, buffer->data, buffer->size);
             } else {
                 VLOG_WARN_RL(&rl, "received too-short OpenFlow message");
             }
             ofpbuf_delete(buffer);
         } else {
-            if (r->n_txq < TXQ_LIMIT) {
-                int error = r->cb_dump(dp, r->cb_aux);
-                if (error <= 0) {
-                    if (error) {
-                        VLOG_WARN_RL(&rl, "dump callback error: %s",
-                                     strerror(-error));
-                    }
-                    r->cb_done(r->cb_aux);
-                    r->cb_dump = NULL;
-                }
-            } else {
+            int error;
+
+            if (flow_mods) {
+                flow_mods = false;
+                chain_batch_commit(dp->chain);
+            }
+            if (rconn_queued_bytes(r->rconn, RCONN_TXQ_CONTROL)
+                >= DUMP_TXQ_LIMIT
+                || *dump_budget <= 0) {
                 break;
             }
+            --*dump_budget;
+            error = r->cb_dump(dp, r->cb_aux);
+            if (error <= 0) {
+                if (error) {
+                    VLOG_WARN_RL(&rl, "dump callback error: %s",
+                                 strerror(-error));
+                }
+                r->cb_done(r->cb_aux);
+                r->cb_dump = NULL;
+            }
         }
     }
+    if (flow_mods) {
+        chain_batch_commit(dp->chain);
+    }
+    backlog = i >= max_msgs;
 
     if (!rconn_is_alive(r->rconn)) {
         remote_destroy(r);
+        return false;
     }
+    return backlog;
 }
 
 static void
@@ -668,6 +1157,15 @@ remote_wait(struct remote *r)
 {
     rconn_run_wait(r->rconn);
     rconn_recv_wait(r->rconn);
+    if (r->cb_dump
+        && rconn_queued_bytes(r->rconn, RCONN_TXQ_CONTROL) < DUMP_TXQ_LIMIT) {
+        /* remote_run() stopped at its dump budget with room left in the
+         * queue, so nothing else is going to wake us up to continue. */
+        poll_immediate_wake();
+    }
+    if (r->pin_n) {
+        poll_fd_wait(r->pin_fd, POLLOUT);
+    }
 }
 
 static void
@@ -678,6 +1176,12 @@ remote_destroy(struct remote *r)
             r->cb_done(r->cb_aux);
         }
         list_remove(&r->node);
+        ofpbuf_delete(r->bundle);
+        remote_close_packet_in_udp(r);
+        bitmap_free(r->async_ports);
+        if (r->staged) {
+            chain_destroy(r->staged);
+        }
         rconn_destroy(r->rconn);
         free(r);
     }
@@ -690,35 +1194,269 @@ remote_create(struct datapath *dp, struct rconn *rconn)
     list_push_back(&dp->remotes, &remote->node);
     remote->rconn = rconn;
     remote->cb_dump = NULL;
-    remote->n_txq = 0;
+    remote->bundle = NULL;
+    memset(&remote->setup_latency, 0, sizeof remote->setup_latency);
+    remote->n_stale_buffers = 0;
+    remote->pin_fd = -1;
+    remote->pin_head = remote->pin_n = 0;
+    remote->n_pin_sent = remote->n_pin_dropped = 0;
+    remote->async_all = true;
+    remote->async_ports = NULL;
+    remote->balance_id = 0;
+    remote->staged = NULL;
+    remote->table_id = 0;
     return remote;
 }
 
-/* Starts a callback-based, reliable, possibly multi-message reply to a
- * request made by 'remote'.
- *
- * 'dump' designates a function that will be called when the 'remote' send
- * queue has an empty slot.  It should compose a message and send it on
- * 'remote'.  On success, it should return 1 if it should be called again when
- * another send queue slot opens up, 0 if its transmissions are complete, or a
- * negative errno value on failure.
- *
- * 'done' designates a function to clean up any resources allocated for the
- * dump.  It must handle being called before the dump is complete (which will
- * happen if 'remote' is closed unexpectedly).
- *
- * 'aux' is passed to 'dump' and 'done'. */
+/* Closes 'r''s packet_in datagram channel, if it has one, dropping any
+ * packet_ins still queued for it. */
 static void
-remote_start_dump(struct remote *remote,
-                  int (*dump)(struct datapath *, void *),
-                  void (*done)(void *),
-                  void *aux)
+remote_close_packet_in_udp(struct remote *r)
 {
-    assert(!remote->cb_dump);
-    remote->cb_dump = dump;
-    remote->cb_done = done;
-    remote->cb_aux = aux;
-}
+    while (r->pin_n) {
+        ofpbuf_delete(r->pin_queue[r->pin_head]);
+        r->pin_head = (r->pin_head + 1) % PIN_QUEUE_LEN;
+        r->pin_n--;
+        r->n_pin_dropped++;
+    }
+    if (r->pin_fd >= 0) {
+        close(r->pin_fd);
+        r->pin_fd = -1;
+    }
+}
+
+/* Sends packet_ins for the remote that sent a message identified by 'sender'
+ * as UDP datagrams to 'ip' (in network byte order) and 'port', or over its
+ * connection again if 'port' is 0.  An 'ip' of 0 stands for the remote's own
+ * address.  Returns 0 if successful, otherwise a positive errno value. */
+int
+dp_set_packet_in_udp(struct datapath *dp UNUSED, const struct sender *sender,
+                     uint32_t ip, uint16_t port)
+{
+    struct remote *r = sender->remote;
+    char *target;
+    int error;
+
+    remote_close_packet_in_udp(r);
+    if (!port) {
+        VLOG_INFO("%s: sending packet_ins over the connection",
+                  rconn_get_name(r->rconn));
+        return 0;
+    }
+
+    if (!ip) {
+        ip = rconn_get_ip(r->rconn);
+        if (!ip) {
+            ip = htonl(INADDR_LOOPBACK);
+        }
+    }
+    target = xasprintf(IP_FMT":%"PRIu16, IP_ARGS(&ip), port);
+    error = udp_open_active(target, port, &r->pin_fd);
+    if (!error) {
+        VLOG_INFO("%s: sending packet_ins to udp:%s",
+                  rconn_get_name(r->rconn), target);
+    } else {
+        VLOG_WARN("%s: cannot send packet_ins to udp:%s (%s)",
+                  rconn_get_name(r->rconn), target, strerror(error));
+    }
+    free(target);
+    return error;
+}
+
+/* Maps 'port' to its bit in a remote's 'async_ports', or returns -1 if it
+ * has none. */
+static int
+async_port_bit(uint16_t port)
+{
+    return (port < DP_MAX_PORTS ? port
+            : port == OFPP_LOCAL ? DP_MAX_PORTS
+            : -1);
+}
+
+/* Has the remote that sent a message identified by 'sender' receive only the
+ * asynchronous messages selected by the OFPR_*, OFPPR_* and OFPRR_* bits in
+ * 'packet_in_mask', 'port_status_mask' and 'flow_removed_mask', and only
+ * packet_ins and port_status messages for the 'n_ports' ports in 'ports' (in
+ * network byte order), or for any port if 'n_ports' is 0.  A nonzero
+ * 'balance_id' has it share packet_ins with other remotes (see struct
+ * ofp_ext_set_async).  Returns 0 if successful, otherwise a positive errno
+ * value. */
+int
+dp_set_async(struct datapath *dp UNUSED, const struct sender *sender,
+             uint32_t packet_in_mask, uint32_t port_status_mask,
+             uint32_t flow_removed_mask, uint32_t balance_id,
+             const uint16_t *ports, size_t n_ports)
+{
+    struct remote *r = sender->remote;
+    unsigned long *async_ports = NULL;
+    size_t i;
+
+    if (n_ports) {
+        async_ports = bitmap_allocate(DP_MAX_PORTS + 1);
+        for (i = 0; i < n_ports; i++) {
+            int bit = async_port_bit(ntohs(ports[i]));
+            if (bit < 0) {
+                bitmap_free(async_ports);
+                return EINVAL;
+            }
+            bitmap_set1(async_ports, bit);
+        }
+    }
+
+    bitmap_free(r->async_ports);
+    r->async_all = false;
+    r->packet_in_mask = packet_in_mask;
+    r->port_status_mask = port_status_mask;
+    r->flow_removed_mask = flow_removed_mask;
+    r->async_ports = async_ports;
+    r->balance_id = balance_id;
+    if (balance_id) {
+        VLOG_INFO("%s: sharing packet_ins as balance id %"PRIu32,
+                  rconn_get_name(r->rconn), balance_id);
+    }
+    return 0;
+}
+
+/* Returns true if any of 'dp''s remotes shares packet_ins with others. */
+static bool
+dp_balances_packet_ins(const struct datapath *dp)
+{
+    const struct remote *r;
+
+    LIST_FOR_EACH (r, struct remote, node, &dp->remotes) {
+        if (r->balance_id) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Returns true if 'r' should receive 'msg', a complete OpenFlow message, when
+ * it is sent to every remote. */
+static bool
+remote_wants_async(const struct remote *r, const struct ofpbuf *msg)
+{
+    const struct ofp_header *oh = msg->data;
+    uint32_t mask;
+    uint8_t reason;
+    int bit = -1;
+
+    if (r->async_all) {
+        return true;
+    }
+
+    switch (oh->type) {
+    case OFPT_PACKET_IN: {
+        const struct ofp_packet_in *opi = msg->data;
+        mask = r->packet_in_mask;
+        reason = opi->reason;
+        bit = async_port_bit(ntohs(opi->in_port));
+        break;
+    }
+    case OFPT_PORT_STATUS: {
+        const struct ofp_port_status *ops = msg->data;
+        mask = r->port_status_mask;
+        reason = ops->reason;
+        bit = async_port_bit(ntohs(ops->desc.port_no));
+        break;
+    }
+    case OFPT_FLOW_REMOVED: {
+        const struct ofp_flow_removed *ofr = msg->data;
+        mask = r->flow_removed_mask;
+        reason = ofr->reason;
+        break;
+    }
+    default:
+        return true;
+    }
+
+    if (reason >= 32 || !(mask & (UINT32_C(1) << reason))) {
+        return false;
+    }
+    return !r->async_ports || bit < 0 || bitmap_is_set(r->async_ports, bit);
+}
+
+/* Tries to send 'msg' on 'r''s packet_in datagram channel.  Returns true if
+ * 'msg' is done with, whether it was sent or had to be discarded, false if
+ * the socket has no room for it right now. */
+static bool
+remote_send_packet_in(struct remote *r, const struct ofpbuf *msg)
+{
+    if (send(r->pin_fd, msg->data, msg->size, 0) >= 0) {
+        r->n_pin_sent++;
+        return true;
+    } else if (errno == EAGAIN || errno == ENOBUFS) {
+        return false;
+    } else {
+        /* E.g. ECONNREFUSED from an earlier datagram that nobody received. */
+        if (errno != ECONNREFUSED) {
+            VLOG_WARN_RL(&rl, "%s: packet_in send failed: %s",
+                         rconn_get_name(r->rconn), strerror(errno));
+        }
+        r->n_pin_dropped++;
+        return true;
+    }
+}
+
+/* Sends as many of the packet_ins queued for 'r' as its socket will take. */
+static void
+remote_flush_packet_ins(struct remote *r)
+{
+    while (r->pin_n) {
+        struct ofpbuf *msg = r->pin_queue[r->pin_head];
+        if (!remote_send_packet_in(r, msg)) {
+            break;
+        }
+        ofpbuf_delete(msg);
+        r->pin_head = (r->pin_head + 1) % PIN_QUEUE_LEN;
+        r->pin_n--;
+    }
+}
+
+/* Takes ownership of packet_in 'msg' and sends it on 'r''s datagram channel,
+ * queuing it if the socket is full.  If the queue is full too, the oldest
+ * packet_in in it is dropped instead. */
+static void
+remote_queue_packet_in(struct remote *r, struct ofpbuf *msg)
+{
+    if (!r->pin_n && remote_send_packet_in(r, msg)) {
+        ofpbuf_delete(msg);
+        return;
+    }
+    if (r->pin_n == PIN_QUEUE_LEN) {
+        ofpbuf_delete(r->pin_queue[r->pin_head]);
+        r->pin_head = (r->pin_head + 1) % PIN_QUEUE_LEN;
+        r->pin_n--;
+        r->n_pin_dropped++;
+    }
+    r->pin_queue[(r->pin_head + r->pin_n++) % PIN_QUEUE_LEN] = msg;
+}
+
+/* Starts a callback-based, reliable, possibly multi-message reply to a
+ * request made by 'remote'.
+ *
+ * 'dump' designates a function that will be called when the 'remote' send
+ * queue has an empty slot.  It should compose a message and send it on
+ * 'remote'.  On success, it should return 1 if it should be called again when
+ * another send queue slot opens up, 0 if its transmissions are complete, or a
+ * negative errno value on failure.
+ *
+ * 'done' designates a function to clean up any resources allocated for the
+ * dump.  It must handle being called before the dump is complete (which will
+ * happen if 'remote' is closed unexpectedly).
+ *
+ * 'aux' is passed to 'dump' and 'done'. */
+static void
+remote_start_dump(struct remote *remote,
+                  int (*dump)(struct datapath *, void *),
+                  void (*done)(void *),
+                  void *aux)
+{
+    assert(!remote->cb_dump);
+    remote->cb_dump = dump;
+    remote->cb_done = done;
+    remote->cb_aux = aux;
+}
 
 void
 dp_wait(struct datapath *dp)
@@ -728,46 +1466,126 @@ dp_wait(struct datapath *dp)
     size_t i;
 
     LIST_FOR_EACH (p, struct sw_port, node, &dp->port_list) {
-        if (IS_HW_PORT(p)) {
+        if (p->shaper) {
+            shaper_wait(p->shaper);
+        }
+        if (IS_HW_PORT(p) || p->flags & SWP_RX_THREAD) {
             continue;
         }
         netdev_recv_wait(p->netdev);
     }
+    if (dp->rx_threads) {
+        rx_threads_wait(dp->rx_threads);
+    }
+#if defined(OF_HW_PLAT) && !defined(USE_NETDEV)
+    if (dp->hw_pkt_ring) {
+        pkt_ring_wait(dp->hw_pkt_ring);
+    }
+#endif
     LIST_FOR_EACH (r, struct remote, node, &dp->remotes) {
         remote_wait(r);
     }
     for (i = 0; i < dp->n_listeners; i++) {
         pvconn_wait(dp->listeners[i]);
     }
+    if (dp_ports_pending(dp) || !list_is_empty(&dp->miss_ports)) {
+        poll_immediate_wake();
+    }
+    if (dp->pending_misses) {
+        pending_misses_wait(dp->pending_misses);
+    }
+    if (dp->port_monitor) {
+        netdev_monitor_wait(dp->port_monitor);
+    }
+    mac_learning_wait(dp->ml);
+    metrics_wait();
+    stats_file_wait();
+}
+
+/* Transmits 'buffer' on software port 'p' using the queue with 'queue_id'.
+ * The caller retains ownership of 'buffer'.  Returns 0 if successful or if
+ * the port is down, -ENOENT if the queue does not exist. */
+static int
+send_packet(struct sw_port *p, const struct ofpbuf *buffer, uint32_t queue_id)
+{
+    struct sw_queue *q = NULL;
+    uint16_t class_id = 0;
+    int error;
+
+    if (p->config & OFPPC_PORT_DOWN) {
+        return 0;
+    }
+
+    /* avoid the queue lookup for best-effort traffic */
+    if (queue_id != 0) {
+        /* silently drop the packet if queue doesn't exist */
+        q = dp_lookup_queue(p, queue_id);
+        if (!q) {
+            return -ENOENT;
+        }
+        class_id = q->class_id;
+    }
+
+    error = (p->shaper ? shaper_send(p->shaper, buffer, class_id)
+             : netdev_send(p->netdev, buffer, class_id));
+    if (!error) {
+        p->tx_packets++;
+        p->tx_bytes += buffer->size;
+        if (q) {
+            q->tx_packets++;
+            q->tx_bytes += buffer->size;
+        }
+    } else {
+        count_drop(p->dp, p, (p->shaper && error == ENOBUFS
+                              ? OFP_EXT_DROP_SHAPER_QUEUE
+                              : OFP_EXT_DROP_TX));
+    }
+    return 0;
+}
+
+/* Rebuilds 'dp''s arrays of ports for OFPP_ALL and OFPP_FLOOD from its port
+ * list and the ports' configuration. */
+static void
+update_flood_ports(struct datapath *dp)
+{
+    struct sw_port *p;
+
+    dp->n_all_ports = dp->n_flood_ports = 0;
+    LIST_FOR_EACH (p, struct sw_port, node, &dp->port_list) {
+        dp->all_ports[dp->n_all_ports++] = p;
+        if (!(p->config & OFPPC_NO_FLOOD)) {
+            dp->flood_ports[dp->n_flood_ports++] = p;
+        }
+    }
 }
 
 /* Send packets out all the ports except the originating one.  If the
  * "flood" argument is set, don't send out ports with flooding disabled.
+ * The caller retains ownership of 'buffer'.
  */
 static int
-output_all(struct datapath *dp, struct ofpbuf *buffer, int in_port, int flood)
+output_all(struct datapath *dp, const struct ofpbuf *buffer, int in_port,
+           int flood)
 {
-    struct sw_port *p;
-    int prev_port; /* Buffer is cloned for multiple transmits */
+    struct sw_port **ports = flood ? dp->flood_ports : dp->all_ports;
+    size_t n_ports = flood ? dp->n_flood_ports : dp->n_all_ports;
+    size_t i;
+
+    for (i = 0; i < n_ports; i++) {
+        struct sw_port *p = ports[i];
 
-    prev_port = -1;
-    LIST_FOR_EACH (p, struct sw_port, node, &dp->port_list) {
         if (p->port_no == in_port) {
             continue;
         }
-        if (flood && p->config & OFPPC_NO_FLOOD) {
-            continue;
-        }
-        if (prev_port != -1) {
-            dp_output_port(dp, ofpbuf_clone(buffer), in_port, prev_port,
-                           0,false);
+        if (IS_HW_PORT(p)) {
+            /* Hardware ports take ownership of what they transmit. */
+            dp_output_port(dp, ofpbuf_clone(buffer), in_port, p->port_no,
+                           0, false);
+        } else if (p->netdev != NULL) {
+            /* netdev_send() copies the packet, so no clone is needed. */
+            send_packet(p, buffer, 0);
         }
-        prev_port = p->port_no;
     }
-    if (prev_port != -1)
-        dp_output_port(dp, buffer, in_port, prev_port, 0, false);
-    else
-        ofpbuf_delete(buffer);
 
     return 0;
 }
@@ -776,11 +1594,8 @@ static void
 output_packet(struct datapath *dp, struct ofpbuf *buffer, uint16_t out_port,
               uint32_t queue_id)
 {
-    uint16_t class_id;
-    struct sw_queue * q;
     struct sw_port *p;
 
-    q = NULL;
     p = dp_lookup_port(dp, out_port);
 
 /* FIXME:  Needs update for queuing */
@@ -808,44 +1623,49 @@ output_packet(struct datapath *dp, struct ofpbuf *buffer, uint16_t out_port,
     /* Fall through to software controlled ports if not HW port */
 #endif
 
-    if (p && p->netdev != NULL) {
-        if (!(p->config & OFPPC_PORT_DOWN)) {
-            /* avoid the queue lookup for best-effort traffic */
-            if (queue_id == 0) {
-                class_id = 0;
-            }
-            else {
-                /* silently drop the packet if queue doesn't exist */
-                q = dp_lookup_queue(p, queue_id);
-                if (q) {
-                    class_id = q->class_id;
-                }
-                else {
-                    goto error;
-                }
-            }
-
-            if (!netdev_send(p->netdev, buffer, class_id)) {
-                p->tx_packets++;
-                p->tx_bytes += buffer->size;
-                if (q) {
-                    q->tx_packets++;
-                    q->tx_bytes += buffer->size;
-                }
-            } else {
-                p->tx_dropped++;
-            }
-        }
+    if (p && p->netdev != NULL && !send_packet(p, buffer, queue_id)) {
         ofpbuf_delete(buffer);
         return;
     }
 
- error:
     ofpbuf_delete(buffer);
     VLOG_DBG_RL(&rl, "can't forward to bad port:queue(%d:%d)\n", out_port,
                 queue_id);
 }
 
+/* Forwards 'buffer', received on 'in_port', as an ordinary learning switch
+ * would, for OFPP_NORMAL: learns that its source MAC is on 'in_port', then
+ * sends it to the port on which its destination MAC was learned, or floods it
+ * if that is not known.  The caller retains ownership of 'buffer'. */
+static void
+output_normal(struct datapath *dp, const struct ofpbuf *buffer, int in_port)
+{
+    const struct eth_header *eh = buffer->data;
+    uint16_t vlan = OFP_VLAN_NONE;
+    uint16_t out_port;
+
+    if (buffer->size < ETH_HEADER_LEN) {
+        return;
+    }
+    if (eh->eth_type == htons(ETH_TYPE_VLAN)
+        && buffer->size >= VLAN_ETH_HEADER_LEN) {
+        const struct vlan_eth_header *veh = buffer->data;
+        vlan = ntohs(veh->veth_tci) & VLAN_VID_MASK;
+    }
+
+    /* Packets injected by the controller have no real input port. */
+    if (in_port <= OFPP_MAX || in_port == OFPP_LOCAL) {
+        mac_learning_learn(dp->ml, eh->eth_src, vlan, in_port);
+    }
+
+    out_port = mac_learning_lookup(dp->ml, eh->eth_dst, vlan);
+    if (out_port == OFPP_FLOOD) {
+        output_all(dp, buffer, in_port, 1);
+    } else if (out_port != in_port) {
+        dp_output_port_shared(dp, buffer, in_port, out_port, 0, false);
+    }
+}
+
 /** Takes ownership of 'buffer' and transmits it to 'out_port' on 'dp'.
  */
 void
@@ -862,7 +1682,8 @@ dp_output_port(struct datapath *dp, struct ofpbuf *buffer,
 
     case OFPP_TABLE: {
         struct sw_port *p = dp_lookup_port(dp, in_port);
-        if (run_flow_through_tables(dp, buffer, p)) {
+        struct sw_flow_key key;
+        if (run_flow_through_tables(dp, buffer, p, &key)) {
             ofpbuf_delete(buffer);
         }
         break;
@@ -870,10 +1691,17 @@ dp_output_port(struct datapath *dp, struct ofpbuf *buffer,
 
     case OFPP_FLOOD:
         output_all(dp, buffer, in_port, 1);
+        ofpbuf_delete(buffer);
         break;
 
     case OFPP_ALL:
         output_all(dp, buffer, in_port, 0);
+        ofpbuf_delete(buffer);
+        break;
+
+    case OFPP_NORMAL:
+        output_normal(dp, buffer, in_port);
+        ofpbuf_delete(buffer);
         break;
 
     case OFPP_CONTROLLER:
@@ -891,6 +1719,59 @@ dp_output_port(struct datapath *dp, struct ofpbuf *buffer,
     }
 }
 
+/* Transmits 'buffer' to 'out_port' on 'dp' like dp_output_port(), except that
+ * the caller retains ownership of 'buffer'.  netdev_send() copies the packet,
+ * so software ports transmit straight from 'buffer'; only the destinations
+ * that keep or modify their packet (the flow table, the controller, hardware
+ * ports) are given a clone.
+ */
+void
+dp_output_port_shared(struct datapath *dp, const struct ofpbuf *buffer,
+                      int in_port, int out_port, uint32_t queue_id,
+                      bool ignore_no_fwd)
+{
+    struct sw_port *p;
+
+    switch (out_port) {
+    case OFPP_FLOOD:
+    case OFPP_ALL:
+        output_all(dp, buffer, in_port, out_port == OFPP_FLOOD);
+        return;
+
+    case OFPP_NORMAL:
+        output_normal(dp, buffer, in_port);
+        return;
+
+    case OFPP_IN_PORT:
+        p = dp_lookup_port(dp, in_port);
+        break;
+
+    case OFPP_TABLE:
+    case OFPP_CONTROLLER:
+        p = NULL;
+        break;
+
+    case OFPP_LOCAL:
+    default:
+        if (in_port == out_port) {
+            VLOG_DBG_RL(&rl, "can't directly forward to input port");
+            return;
+        }
+        p = dp_lookup_port(dp, out_port);
+        break;
+    }
+
+    if (p && p->netdev != NULL && !IS_HW_PORT(p)) {
+        if (send_packet(p, buffer, queue_id)) {
+            VLOG_DBG_RL(&rl, "can't forward to bad port:queue(%d:%d)\n",
+                        p->port_no, queue_id);
+        }
+    } else {
+        dp_output_port(dp, ofpbuf_clone(buffer), in_port, out_port, queue_id,
+                       ignore_no_fwd);
+    }
+}
+
 static void *
 make_openflow_reply(size_t openflow_len, uint8_t type,
                     const struct sender *sender, struct ofpbuf **bufferp)
@@ -899,11 +1780,19 @@ make_openflow_reply(size_t openflow_len, uint8_t type,
                              bufferp);
 }
 
+/* Sends 'buffer' to 'remote' in send queue 'class'.  Replies go out ahead of
+ * queued asynchronous events, and each class has its own limit, so that a
+ * backlog of packet_ins neither delays an echo reply nor crowds it out. */
 static int
-send_openflow_buffer_to_remote(struct ofpbuf *buffer, struct remote *remote)
+send_to_remote_in_class(struct ofpbuf *buffer, struct remote *remote,
+                        enum rconn_txq_class class)
 {
-    int retval = rconn_send_with_limit(remote->rconn, buffer, &remote->n_txq,
-                                       TXQ_LIMIT);
+    int retval;
+
+    retval = rconn_send_with_byte_limit(remote->rconn, buffer,
+                                        (class == RCONN_TXQ_ASYNC
+                                         ? ASYNC_TXQ_LIMIT : TXQ_LIMIT),
+                                        class);
     if (retval) {
         VLOG_WARN_RL(&rl, "send to %s failed: %s",
                      rconn_get_name(remote->rconn), strerror(retval));
@@ -911,6 +1800,54 @@ send_openflow_buffer_to_remote(struct ofpbuf *buffer, struct remote *remote)
     return retval;
 }
 
+static int
+send_openflow_buffer_to_remote(struct ofpbuf *buffer, struct remote *remote)
+{
+    /* Keep messages in order. */
+    remote_flush_bundle(remote);
+
+    return send_to_remote_in_class(buffer, remote, rconn_classify(buffer));
+}
+
+/* Sends packet_in 'buffer' to 'remote', on its datagram channel if it has
+ * one. */
+static int
+send_packet_in_to_remote(struct ofpbuf *buffer, struct remote *remote)
+{
+    if (remote->pin_fd >= 0) {
+        remote_queue_packet_in(remote, buffer);
+        return 0;
+    }
+    return send_openflow_buffer_to_remote(buffer, remote);
+}
+
+/* Passes 'buffer' to 'send' for each of 'dp''s remotes that wants it (see
+ * remote_wants_async()).  The remotes share a single copy of the message.
+ * Returns the number of remotes whose send queue was too full to take it. */
+static int
+broadcast_openflow_buffer(struct datapath *dp, struct ofpbuf *buffer,
+                          int (*send)(struct ofpbuf *, struct remote *))
+{
+    struct remote *r, *prev = NULL;
+    int n_full = 0;
+
+    LIST_FOR_EACH (r, struct remote, node, &dp->remotes) {
+        if (!remote_wants_async(r, buffer)) {
+            continue;
+        }
+        if (prev) {
+            n_full += send(ofpbuf_share(buffer), prev) == EAGAIN;
+        }
+        prev = r;
+    }
+    if (prev) {
+        n_full += send(buffer, prev) == EAGAIN;
+    } else {
+        ofpbuf_delete(buffer);
+    }
+    return n_full;
+}
+
 static int
 send_openflow_buffer(struct datapath *dp, struct ofpbuf *buffer,
                      const struct sender *sender)
@@ -921,39 +1858,230 @@ send_openflow_buffer(struct datapath *dp, struct ofpbuf *buffer,
         return send_openflow_buffer_to_remote(buffer, sender->remote);
     } else {
         /* Broadcast to all remotes. */
-        struct remote *r, *prev = NULL;
-        LIST_FOR_EACH (r, struct remote, node, &dp->remotes) {
-            if (prev) {
-                send_openflow_buffer_to_remote(ofpbuf_clone(buffer), prev);
+        broadcast_openflow_buffer(dp, buffer, send_openflow_buffer_to_remote);
+        return 0;
+    }
+}
+
+/* Passes packet_in 'buffer' to send_packet_in_to_remote() for each of 'dp''s
+ * remotes that wants it, as broadcast_openflow_buffer() does, except that
+ * of the connected remotes with a 'balance_id', only the one that ranks
+ * highest for 'flow_hash' gets it.  This is rendezvous hashing: each flow
+ * keeps going to the same remote, and when a remote goes away, only the
+ * flows that it had move, spread across the others. */
+static int
+balance_packet_in(struct datapath *dp, struct ofpbuf *buffer,
+                  uint32_t flow_hash)
+{
+    struct remote *r, *prev = NULL, *chosen = NULL;
+    uint32_t best = 0;
+    int n_full = 0;
+
+    LIST_FOR_EACH (r, struct remote, node, &dp->remotes) {
+        if (!remote_wants_async(r, buffer)) {
+            continue;
+        }
+        if (r->balance_id) {
+            uint32_t score = hash_words(&r->balance_id, 1, flow_hash);
+
+            if (rconn_is_connected(r->rconn) && (!chosen || score > best)) {
+                chosen = r;
+                best = score;
             }
-            prev = r;
+            continue;
         }
         if (prev) {
-            send_openflow_buffer_to_remote(buffer, prev);
-        } else {
-            ofpbuf_delete(buffer);
+            n_full += send_packet_in_to_remote(ofpbuf_share(buffer),
+                                               prev) == EAGAIN;
         }
-        return 0;
+        prev = r;
     }
+    if (chosen) {
+        if (prev) {
+            n_full += send_packet_in_to_remote(ofpbuf_share(buffer),
+                                               prev) == EAGAIN;
+        }
+        prev = chosen;
+    }
+    if (prev) {
+        n_full += send_packet_in_to_remote(buffer, prev) == EAGAIN;
+    } else {
+        ofpbuf_delete(buffer);
+    }
+    return n_full;
 }
 
-/* Takes ownership of 'buffer' and transmits it to 'dp''s controller.  If the
- * packet can be saved in a buffer, then only the first max_len bytes of
- * 'buffer' are sent; otherwise, all of 'buffer' is sent.  'reason' indicates
- * why 'buffer' is being sent. 'max_len' sets the maximum number of bytes that
- * the caller wants to be sent. */
-void
-dp_output_control(struct datapath *dp, struct ofpbuf *buffer, int in_port,
-                  size_t max_len, int reason)
+/* Sends the messages bundled for 'r', if any. */
+static void
+remote_flush_bundle(struct remote *r)
+{
+    struct ofpbuf *bundle = r->bundle;
+    if (bundle) {
+        r->bundle = NULL;
+        update_openflow_length(bundle);
+        /* A bundle carries flow expirations. */
+        send_to_remote_in_class(bundle, r, RCONN_TXQ_ASYNC);
+    }
+}
+
+/* Appends a copy of 'msg', a complete OpenFlow message, to the bundle that
+ * will next be sent to 'r'.  The bundle goes out when it fills up, when
+ * anything else is sent to 'r', or at the end of dp_run(), whichever comes
+ * first. */
+static void
+remote_bundle(struct remote *r, const struct ofpbuf *msg)
 {
+    if (r->bundle && r->bundle->size + msg->size > BUNDLE_MAX_BYTES) {
+        remote_flush_bundle(r);
+    }
+    if (!r->bundle) {
+        struct ofp_ext_bundle *ob;
+
+        r->bundle = ofpbuf_new(BUNDLE_MAX_BYTES);
+        ob = ofpbuf_put_zeros(r->bundle, sizeof *ob);
+        ob->header.header.version = OFP_VERSION;
+        ob->header.header.type = OFPT_VENDOR;
+        ob->header.vendor = htonl(OPENFLOW_VENDOR_ID);
+        ob->header.subtype = htonl(OFP_EXT_BUNDLE);
+    }
+    ofpbuf_put(r->bundle, msg->data, msg->size);
+}
+
+/* Returns true if a packet_in for 'reason' may be sent on behalf of
+ * 'in_port', taking a token from the meter for 'reason' of the port that
+ * 'in_port' names, or false if that meter is empty.  Packet_ins for packets
+ * that no port received, such as those of packet_outs, use the datapath's
+ * own meters. */
+static bool
+pin_meter_admit(struct datapath *dp, int in_port, int reason)
+{
+    struct sw_port *p = dp_lookup_port(dp, in_port);
+    struct pin_meter *m = ((PORT_IN_USE(p) ? p->pin_meters : dp->pin_meters)
+                           + (reason == OFPR_ACTION));
+    long long int now = time_msec();
+    long long int tokens;
+
+    /* A meter that has never been used has a 'last_fill' of 0, so it
+     * starts out full. */
+    tokens = (now - m->last_fill) * dp->pin_rate + m->tokens;
+    if (tokens >= 1000) {
+        m->last_fill = now;
+        m->tokens = MIN(tokens, (long long int) dp->pin_burst * 1000);
+    }
+
+    if (m->tokens >= 1000) {
+        m->tokens -= 1000;
+        return true;
+    } else {
+        return false;
+    }
+}
+
+/* Returns how many bytes of a buffered packet a packet_in for a table miss
+ * should carry, given that 'max_len' were asked for, under the current load
+ * on 'dp''s controller connections.  The fuller the most backed-up queue of
+ * asynchronous events, the less of each packet is sent, so that the queue
+ * holds more distinct misses before it has to drop any; the controller can
+ * still act on the whole packet through its buffer ID. */
+static size_t
+adapt_miss_len(const struct datapath *dp, size_t max_len)
+{
+    size_t queued = 0;
+    struct remote *r;
+
+    if (max_len <= MISS_LEN_MIN) {
+        return max_len;
+    }
+
+    LIST_FOR_EACH (r, struct remote, node, &dp->remotes) {
+        /* A datagram channel drops from its own ring instead. */
+        if (r->pin_fd < 0) {
+            queued = MAX(queued,
+                         rconn_queued_bytes(r->rconn, RCONN_TXQ_ASYNC));
+        }
+    }
+
+    if (queued <= MISS_LEN_LOW_WATER) {
+        return max_len;
+    } else if (queued >= MISS_LEN_HIGH_WATER) {
+        return MISS_LEN_MIN;
+    } else {
+        return max_len - ((max_len - MISS_LEN_MIN)
+                          * (queued - MISS_LEN_LOW_WATER)
+                          / (MISS_LEN_HIGH_WATER - MISS_LEN_LOW_WATER));
+    }
+}
+
+/* Takes ownership of 'buffer' and transmits it to 'dp''s controller, as
+ * dp_output_control() does.  If 'flow' is nonnull, it is the flow extracted
+ * from 'buffer', which is saved along with the packet for a later flow_mod to
+ * reuse.  Returns the ID of the buffer in which the packet was saved, or
+ * UINT32_MAX if it was not saved. */
+static uint32_t
+output_control(struct datapath *dp, struct ofpbuf *buffer, int in_port,
+               size_t max_len, int reason, const struct flow *flow)
+{
+    uint64_t start = latency_ticks();
     struct ofp_packet_in *opi;
-    size_t total_len;
+    bool balance = dp_balances_packet_ins(dp);
+    uint32_t hash = 0;
+    struct flow full;
+    size_t total_len, asked_len;
     uint32_t buffer_id;
 
-    buffer_id = save_buffer(buffer);
+    DP_TRACE3(output_control, in_port, buffer->size, reason);
+    if (dp->pin_rate && !pin_meter_admit(dp, in_port, reason)) {
+        /* Drop it before it costs a packet buffer or a message. */
+        count_port_no_drop(dp, in_port, OFP_EXT_DROP_PACKET_IN_RATE);
+        ofpbuf_delete(buffer);
+        return UINT32_MAX;
+    }
+    if (balance) {
+        /* Hash every field, even if the lookup parsed only some. */
+        if (flow) {
+            full = *flow;
+            flow_extract_finish(buffer, &full);
+        } else {
+            flow_extract(buffer, in_port, &full);
+        }
+        flow = &full;
+        hash = flow_hash(flow, 0);
+    }
+
     total_len = buffer->size;
-    if (buffer_id != UINT32_MAX && buffer->size > max_len) {
-        buffer->size = max_len;
+    asked_len = max_len;
+    if (reason == OFPR_NO_MATCH && dp->adaptive_miss_len) {
+        max_len = adapt_miss_len(dp, max_len);
+    }
+    if (ofpbuf_headroom(buffer) >= offsetof(struct ofp_packet_in, data)) {
+        /* The message header fits in the packet's headroom, so the message
+         * and the buffered packet can share one copy of the packet. */
+        struct ofpbuf *packet = ofpbuf_share(buffer);
+
+        buffer_id = pktbuf_save(dp->pktbuf, packet, flow, start);
+        if (buffer_id == UINT32_MAX) {
+            ofpbuf_delete(packet);
+            count_port_no_drop(dp, in_port, OFP_EXT_DROP_UNBUFFERED);
+        } else if (buffer->size > max_len) {
+            buffer->size = max_len;
+        }
+    } else {
+        buffer_id = pktbuf_save(dp->pktbuf, buffer, flow, start);
+        if (buffer_id != UINT32_MAX) {
+            /* The packet buffer store now owns 'buffer', so copy the part of
+             * it that the controller asked for into a new message. */
+            struct ofpbuf *packet = buffer;
+            size_t len = MIN(max_len, packet->size);
+
+            buffer = ofpbuf_new(offsetof(struct ofp_packet_in, data) + len);
+            ofpbuf_reserve(buffer, offsetof(struct ofp_packet_in, data));
+            ofpbuf_put(buffer, packet->data, len);
+        } else {
+            count_port_no_drop(dp, in_port, OFP_EXT_DROP_UNBUFFERED);
+        }
+    }
+    if (buffer_id != UINT32_MAX && max_len < MIN(asked_len, total_len)) {
+        dp->n_pin_shrunk++;
     }
 
     opi = ofpbuf_push_uninit(buffer, offsetof(struct ofp_packet_in, data));
@@ -966,7 +2094,28 @@ dp_output_control(struct datapath *dp, struct ofpbuf *buffer, int in_port,
     opi->in_port        = htons(in_port);
     opi->reason         = reason;
     opi->pad            = 0;
-    send_openflow_buffer(dp, buffer, NULL);
+    /* A packet_in that a controller's queue cannot take is lost to that
+     * controller.  (Packet_ins dropped from a datagram channel's ring are
+     * counted per remote, in 'n_pin_dropped', instead.) */
+    if (balance
+        ? balance_packet_in(dp, buffer, hash)
+        : broadcast_openflow_buffer(dp, buffer, send_packet_in_to_remote)) {
+        count_port_no_drop(dp, in_port, OFP_EXT_DROP_CONTROL_QUEUE);
+    }
+    latency_record(&dp->latency, OFP_EXT_LATENCY_CONTROL, start);
+    return buffer_id;
+}
+
+/* Takes ownership of 'buffer' and transmits it to 'dp''s controller.  If the
+ * packet can be saved in a buffer, then only the first max_len bytes of
+ * 'buffer' are sent; otherwise, all of 'buffer' is sent.  'reason' indicates
+ * why 'buffer' is being sent. 'max_len' sets the maximum number of bytes that
+ * the caller wants to be sent. */
+void
+dp_output_control(struct datapath *dp, struct ofpbuf *buffer, int in_port,
+                  size_t max_len, int reason)
+{
+    output_control(dp, buffer, in_port, max_len, reason, NULL);
 }
 
 static void
@@ -990,14 +2139,32 @@ fill_queue_desc(struct ofpbuf *buffer, struct sw_queue *q,
 }
 
 
+/* Reads the parts of the description of 'p', a port with a network device,
+ * that come from the device into 'desc'. */
+static void
+read_port_desc(struct sw_port *p, struct ofp_phy_port *desc)
+{
+    strncpy((char *) desc->name, netdev_get_name(p->netdev),
+            sizeof desc->name);
+    desc->name[sizeof desc->name - 1] = '\0';
+    memcpy(desc->hw_addr, netdev_get_etheraddr(p->netdev), ETH_ADDR_LEN);
+    desc->curr= htonl(netdev_get_features(p->netdev,
+        NETDEV_FEAT_CURRENT));
+    desc->supported = htonl(netdev_get_features(p->netdev,
+        NETDEV_FEAT_SUPPORTED));
+    desc->advertised = htonl(netdev_get_features(p->netdev,
+        NETDEV_FEAT_ADVERTISED));
+    desc->peer = htonl(netdev_get_features(p->netdev, NETDEV_FEAT_PEER));
+}
+
 static void
 fill_port_desc(struct sw_port *p, struct ofp_phy_port *desc)
 {
-    desc->port_no = htons(p->port_no);
     if (IS_HW_PORT(p)) {
 #if defined(OF_HW_PLAT) && !defined(USE_NETDEV)
         of_hw_driver_t *hw_drv;
 
+        desc->port_no = htons(p->port_no);
         hw_drv = p->dp->hw_drv;
         strncpy((char *) desc->name, p->hw_name, sizeof desc->name);
         desc->name[sizeof desc->name - 1] = '\0';
@@ -1015,17 +2182,17 @@ fill_port_desc(struct sw_port *p, struct ofp_phy_port *desc)
         /* FIXME:  Add current, supported and advertised features */
 #endif
     } else if (p->netdev) {
-        strncpy((char *) desc->name, netdev_get_name(p->netdev),
-                sizeof desc->name);
-        desc->name[sizeof desc->name - 1] = '\0';
-        memcpy(desc->hw_addr, netdev_get_etheraddr(p->netdev), ETH_ADDR_LEN);
-        desc->curr= htonl(netdev_get_features(p->netdev,
-            NETDEV_FEAT_CURRENT));
-        desc->supported = htonl(netdev_get_features(p->netdev,
-            NETDEV_FEAT_SUPPORTED));
-        desc->advertised = htonl(netdev_get_features(p->netdev,
-            NETDEV_FEAT_ADVERTISED));
-        desc->peer = htonl(netdev_get_features(p->netdev, NETDEV_FEAT_PEER));
+        /* Without a port monitor, a change to the device would go unseen,
+         * so read it afresh every time. */
+        if (!p->desc_valid) {
+            memset(&p->desc, 0, sizeof p->desc);
+            p->desc.port_no = htons(p->port_no);
+            read_port_desc(p, &p->desc);
+            p->desc_valid = p->dp->port_monitor != NULL;
+        }
+        memcpy(desc, &p->desc, sizeof *desc);
+    } else {
+        desc->port_no = htons(p->port_no);
     }
     desc->config = htonl(p->config);
     desc->state = htonl(p->state);
@@ -1042,7 +2209,7 @@ dp_send_features_reply(struct datapath *dp, const struct sender *sender)
                                sender, &buffer);
     ofr->datapath_id  = htonll(dp->id);
     ofr->n_tables     = dp->chain->n_tables;
-    ofr->n_buffers    = htonl(N_PKT_BUFFERS);
+    ofr->n_buffers    = htonl(pktbuf_capacity(dp->pktbuf));
     ofr->capabilities = htonl(OFP_SUPPORTED_CAPABILITIES);
     ofr->actions      = htonl(OFP_SUPPORTED_ACTIONS);
     LIST_FOR_EACH (p, struct sw_port, node, &dp->port_list) {
@@ -1069,6 +2236,7 @@ update_port_flags(struct datapath *dp, const struct ofp_port_mod *opm)
         uint32_t config_mask = ntohl(opm->mask);
         p->config &= ~config_mask;
         p->config |= ntohl(opm->config) & config_mask;
+        update_flood_ports(dp);
     }
 }
 
@@ -1094,7 +2262,8 @@ dp_send_flow_end(struct datapath *dp, struct sw_flow *flow,
     uint64_t tdiff = time_msec() - flow->created;
     uint32_t sec = tdiff / 1000;
 
-    if (!flow->send_flow_rem) {
+    if (!dp || !flow->send_flow_rem) {
+        /* A chain staged by OFP_EXT_TABLE_REPLACE has no datapath. */
         return;
     }
 
@@ -1120,90 +2289,369 @@ dp_send_flow_end(struct datapath *dp, struct sw_flow *flow,
     ofr->packet_count = htonll(flow->packet_count);
     ofr->byte_count   = htonll(flow->byte_count);
 
-    send_openflow_buffer(dp, buffer, NULL);
+    if (dp->bundle_flow_removed) {
+        struct remote *r;
+
+        update_openflow_length(buffer);
+        LIST_FOR_EACH (r, struct remote, node, &dp->remotes) {
+            if (remote_wants_async(r, buffer)) {
+                remote_bundle(r, buffer);
+            }
+        }
+        ofpbuf_delete(buffer);
+    } else {
+        send_openflow_buffer(dp, buffer, NULL);
+    }
+}
+
+void
+dp_send_error_msg(struct datapath *dp, const struct sender *sender,
+                  uint16_t type, uint16_t code, const void *data, size_t len)
+{
+    struct ofpbuf *buffer;
+    struct ofp_error_msg *oem;
+    oem = make_openflow_reply(sizeof(*oem)+len, OFPT_ERROR, sender, &buffer);
+    oem->type = htons(type);
+    oem->code = htons(code);
+    memcpy(oem->data, data, len);
+    send_openflow_buffer(dp, buffer, sender);
+}
+
+static void
+fill_flow_stats(struct ofpbuf *buffer, struct sw_flow *flow,
+                int table_idx, uint64_t now)
+{
+    struct ofp_flow_stats *ofs;
+    int length = sizeof *ofs + flow->sf_acts->actions_len;
+    uint64_t tdiff = now - flow->created;
+    uint32_t sec = tdiff / 1000;
+    ofs = ofpbuf_put_uninit(buffer, length);
+    ofs->length          = htons(length);
+    ofs->table_id        = table_idx;
+    ofs->pad             = 0;
+    ofs->match.wildcards = htonl(flow->key.wildcards);
+    ofs->match.in_port   = flow->key.flow.in_port;
+    memcpy(ofs->match.dl_src, flow->key.flow.dl_src, ETH_ADDR_LEN);
+    memcpy(ofs->match.dl_dst, flow->key.flow.dl_dst, ETH_ADDR_LEN);
+    ofs->match.dl_vlan   = flow->key.flow.dl_vlan;
+    ofs->match.dl_type   = flow->key.flow.dl_type;
+    ofs->match.nw_tos    = flow->key.flow.nw_tos;
+    ofs->match.nw_src    = flow->key.flow.nw_src;
+    ofs->match.nw_dst    = flow->key.flow.nw_dst;
+    ofs->match.nw_proto  = flow->key.flow.nw_proto;
+    ofs->match.dl_vlan_pcp = flow->key.flow.dl_vlan_pcp;
+    ofs->match.tp_src    = flow->key.flow.tp_src;
+    ofs->match.tp_dst    = flow->key.flow.tp_dst;
+    ofs->duration_sec    = htonl(sec);
+    ofs->duration_nsec   = htonl((tdiff - (sec * 1000)) * 1000000);
+    ofs->cookie          = htonll(flow->cookie);
+    ofs->priority        = htons(flow->priority);
+    ofs->idle_timeout    = htons(flow->idle_timeout);
+    ofs->hard_timeout    = htons(flow->hard_timeout);
+    memset(&ofs->pad2, 0, sizeof ofs->pad2);
+    ofs->packet_count    = htonll(flow->packet_count);
+    ofs->byte_count      = htonll(flow->byte_count);
+    memcpy(ofs->actions, flow->sf_acts->actions, flow->sf_acts->actions_len);
+}
+
+
+/* A packet that missed in the flow table, in a port's miss queue. */
+struct dp_miss {
+    struct ofpbuf *buffer;
+    struct flow flow;           /* Flow extracted from 'buffer'. */
+};
+
+/* Queues 'buffer', which was received on 'p' and missed in the flow table,
+ * for run_misses() to send to the controller, or drops it if 'p''s queue is
+ * full.  'flow' is the flow extracted from 'buffer'.  Takes ownership of
+ * 'buffer'.
+ *
+ * Buffering a missed packet and composing its packet_in costs much more than
+ * forwarding a packet, so doing it inline would let a storm of misses slow
+ * down forwarding for established flows.  The queues bound that work, and
+ * since each port has its own, a storm on one port cannot crowd out the
+ * misses on the others. */
+static void
+enqueue_miss(struct datapath *dp, struct ofpbuf *buffer, struct sw_port *p,
+             const struct flow *flow)
+{
+    struct dp_miss *miss;
+
+    if (p->n_misses >= DP_MISS_QUEUE_LEN) {
+        count_drop(dp, p, OFP_EXT_DROP_MISS_QUEUE);
+        ofpbuf_delete(buffer);
+        return;
+    }
+    if (!p->misses) {
+        p->misses = xmalloc(DP_MISS_QUEUE_LEN * sizeof *p->misses);
+    }
+    if (!p->n_misses) {
+        list_push_back(&dp->miss_ports, &p->miss_node);
+    }
+    miss = &p->misses[(p->miss_head + p->n_misses++) % DP_MISS_QUEUE_LEN];
+    miss->buffer = buffer;
+    miss->flow = *flow;
+}
+
+/* Sends 'buffer', which was received on 'p' with flow 'flow' and missed in
+ * the flow table, to the controller, unless a miss with the same flow is
+ * already waiting for the controller's answer, in which case 'buffer' is
+ * held behind it.  Takes ownership of 'buffer'. */
+static void
+send_miss(struct datapath *dp, struct ofpbuf *buffer, struct sw_port *p,
+          const struct flow *flow)
+{
+    struct flow full;
+    uint32_t buffer_id;
+
+    if (!dp->pending_misses) {
+        output_control(dp, buffer, p->port_no, dp->miss_send_len,
+                       OFPR_NO_MATCH, flow);
+        return;
+    }
+
+    /* Hold only packets that match exactly, in every field. */
+    full = *flow;
+    flow_extract_finish(buffer, &full);
+    if (!pending_misses_hold(dp->pending_misses, &full, buffer)) {
+        buffer_id = output_control(dp, buffer, p->port_no, dp->miss_send_len,
+                                   OFPR_NO_MATCH, &full);
+        if (buffer_id != UINT32_MAX) {
+            pending_misses_start(dp->pending_misses, &full, buffer_id);
+        }
+    }
+}
+
+/* The miss stage of dp_run(): sends up to DP_MISS_BUDGET queued misses to
+ * the controller, taking one from each port that has any in turn. */
+static void
+run_misses(struct datapath *dp)
+{
+    int budget;
+
+    for (budget = DP_MISS_BUDGET;
+         budget > 0 && !list_is_empty(&dp->miss_ports); budget--) {
+        struct sw_port *p = CONTAINER_OF(list_pop_front(&dp->miss_ports),
+                                         struct sw_port, miss_node);
+        struct dp_miss *miss = &p->misses[p->miss_head];
+
+        p->miss_head = (p->miss_head + 1) % DP_MISS_QUEUE_LEN;
+        if (--p->n_misses) {
+            list_push_back(&dp->miss_ports, &p->miss_node);
+        }
+        send_miss(dp, miss->buffer, p, &miss->flow);
+    }
+}
+
+/* Handles 'buffer', with flow '*key', which matched no flow in pipeline
+ * table 'table_id', according to that table's miss behavior.  'table_id'
+ * may be OFP_EXT_PIPELINE_TABLES for a packet that went on past the last
+ * table, which drops it.  A packet_in for a miss in table 0 of a packet
+ * received on 'p', if it is nonnull, waits in the port's miss queue as
+ * usual.  Takes ownership of 'buffer'. */
+static void
+table_miss(struct datapath *dp, struct ofpbuf *buffer, struct sw_port *p,
+           struct sw_flow_key *key, uint8_t table_id)
+{
+    uint16_t in_port = ntohs(key->flow.in_port);
+    uint8_t miss = (table_id < OFP_EXT_PIPELINE_TABLES
+                    ? dp->table_miss[table_id] : OFP_EXT_MISS_DROP);
+
+    if (miss == OFP_EXT_MISS_CONTINUE) {
+        dp_goto_table(dp, buffer, key, table_id + 1, false);
+    } else if (miss == OFP_EXT_MISS_DROP) {
+        count_port_no_drop(dp, in_port, OFP_EXT_DROP_TABLE_MISS);
+        ofpbuf_delete(buffer);
+    } else if (p && !table_id) {
+        enqueue_miss(dp, buffer, p, &key->flow);
+    } else {
+        output_control(dp, buffer, in_port, dp->miss_send_len,
+                       OFPR_NO_MATCH, &key->flow);
+    }
+}
+
+/* Looks up 'buffer', whose flow '*key' the actions applied so far may have
+ * changed, in pipeline table 'table_id' and applies the actions of the flow
+ * that it matches there, or the table's miss behavior if none does.  Takes
+ * ownership of 'buffer'.
+ *
+ * Validation only lets a flow go to a table after its own, so the packet
+ * cannot loop. */
+void
+dp_goto_table(struct datapath *dp, struct ofpbuf *buffer,
+              struct sw_flow_key *key, uint8_t table_id, bool ignore_no_fwd)
+{
+    /* Actions that rewrite Ethernet addresses do not update '*key', and
+     * table 0 may have parsed only as far as its own flows needed. */
+    key->wildcards = 0;
+    flow_extract(buffer, ntohs(key->flow.in_port), &key->flow);
+
+    for (; table_id < OFP_EXT_PIPELINE_TABLES; table_id++) {
+        struct sw_chain *chain = dp->pipeline[table_id];
+        struct sw_flow *flow = chain ? chain_lookup(chain, key, 0, 0) : NULL;
+
+        if (flow) {
+            flow_used(flow, buffer);
+            execute_flow_actions(dp, buffer, key, flow->sf_acts,
+                                 ignore_no_fwd);
+            return;
+        } else if (dp->table_miss[table_id] != OFP_EXT_MISS_CONTINUE) {
+            break;
+        }
+    }
+    table_miss(dp, buffer, NULL, key, table_id);
 }
 
-void
-dp_send_error_msg(struct datapath *dp, const struct sender *sender,
-                  uint16_t type, uint16_t code, const void *data, size_t len)
+/* Sends on the packets held in 'miss' and frees it.  If 'actions' is
+ * nonnull, the packets are treated with the 'actions_len' bytes of actions
+ * that the controller's packet_out applied to the packet they were held
+ * behind.  Otherwise, they go back through the flow table, and any that miss
+ * again are sent to the controller, each with a packet_in of its own. */
+static void
+run_held_misses(struct datapath *dp, struct pending_miss *miss,
+                const struct ofp_action_header *actions, size_t actions_len)
 {
-    struct ofpbuf *buffer;
-    struct ofp_error_msg *oem;
-    oem = make_openflow_reply(sizeof(*oem)+len, OFPT_ERROR, sender, &buffer);
-    oem->type = htons(type);
-    oem->code = htons(code);
-    memcpy(oem->data, data, len);
-    send_openflow_buffer(dp, buffer, sender);
+    uint16_t in_port = ntohs(miss->flow.in_port);
+    size_t i;
+
+    for (i = 0; i < miss->n_packets; i++) {
+        struct ofpbuf *buffer = miss->packets[i];
+        struct sw_flow_key key;
+
+        if (actions) {
+            key.wildcards = 0;
+            flow_extract(buffer, in_port, &key.flow);
+            execute_actions(dp, buffer, &key, actions, actions_len, true);
+        } else if (run_flow_through_tables(dp, buffer,
+                                           dp_lookup_port(dp, in_port),
+                                           &key)) {
+            table_miss(dp, buffer, NULL, &key, 0);
+        }
+    }
+    free(miss);
 }
 
+/* Sends on the packets held behind the miss that was buffered as
+ * 'buffer_id', if any, now that the controller has answered it, as
+ * run_held_misses() does. */
 static void
-fill_flow_stats(struct ofpbuf *buffer, struct sw_flow *flow,
-                int table_idx, uint64_t now)
+release_held_misses(struct datapath *dp, uint32_t buffer_id,
+                    const struct ofp_action_header *actions,
+                    size_t actions_len)
 {
-    struct ofp_flow_stats *ofs;
-    int length = sizeof *ofs + flow->sf_acts->actions_len;
-    uint64_t tdiff = now - flow->created;
-    uint32_t sec = tdiff / 1000;
-    ofs = ofpbuf_put_uninit(buffer, length);
-    ofs->length          = htons(length);
-    ofs->table_id        = table_idx;
-    ofs->pad             = 0;
-    ofs->match.wildcards = htonl(flow->key.wildcards);
-    ofs->match.in_port   = flow->key.flow.in_port;
-    memcpy(ofs->match.dl_src, flow->key.flow.dl_src, ETH_ADDR_LEN);
-    memcpy(ofs->match.dl_dst, flow->key.flow.dl_dst, ETH_ADDR_LEN);
-    ofs->match.dl_vlan   = flow->key.flow.dl_vlan;
-    ofs->match.dl_type   = flow->key.flow.dl_type;
-    ofs->match.nw_tos    = flow->key.flow.nw_tos;
-    ofs->match.nw_src    = flow->key.flow.nw_src;
-    ofs->match.nw_dst    = flow->key.flow.nw_dst;
-    ofs->match.nw_proto  = flow->key.flow.nw_proto;
-    ofs->match.dl_vlan_pcp = flow->key.flow.dl_vlan_pcp;
-    ofs->match.tp_src    = flow->key.flow.tp_src;
-    ofs->match.tp_dst    = flow->key.flow.tp_dst;
-    ofs->duration_sec    = htonl(sec);
-    ofs->duration_nsec   = htonl((tdiff - (sec * 1000)) * 1000000);
-    ofs->cookie          = htonll(flow->cookie);
-    ofs->priority        = htons(flow->priority);
-    ofs->idle_timeout    = htons(flow->idle_timeout);
-    ofs->hard_timeout    = htons(flow->hard_timeout);
-    memset(&ofs->pad2, 0, sizeof ofs->pad2);
-    ofs->packet_count    = htonll(flow->packet_count);
-    ofs->byte_count      = htonll(flow->byte_count);
-    memcpy(ofs->actions, flow->sf_acts->actions, flow->sf_acts->actions_len);
+    struct pending_miss *miss;
+
+    if (dp->pending_misses && buffer_id != UINT32_MAX) {
+        miss = pending_misses_take(dp->pending_misses, buffer_id);
+        if (miss) {
+            run_held_misses(dp, miss, actions, actions_len);
+        }
+    }
 }
 
-
 /* 'buffer' was received on 'p', which may be a a physical switch port or a
- * null pointer.  Process it according to 'dp''s flow table.  Returns 0 if
- * successful, in which case 'buffer' is destroyed, or -ESRCH if there is no
- * matching flow, in which case 'buffer' still belongs to the caller. */
+ * null pointer.  Process it according to 'dp''s flow table, using '*key' to
+ * hold its flow.  Returns 0 if successful, in which case 'buffer' is
+ * destroyed, or -ESRCH if there is no matching flow, in which case 'buffer'
+ * still belongs to the caller and '*key' holds the flow extracted from it. */
 int run_flow_through_tables(struct datapath *dp, struct ofpbuf *buffer,
-                            struct sw_port *p)
+                            struct sw_port *p, struct sw_flow_key *key)
 {
-    struct sw_flow_key key;
-    struct sw_flow *flow;
+    uint64_t start = latency_ticks();
+    int is_frag;
+
+    key->wildcards = 0;
+    is_frag = flow_extract_layers(buffer, p ? p->port_no : OFPP_NONE,
+                                  &key->flow, rx_flow_layer(dp));
+    return run_extracted_flow(dp, buffer, p, key, is_frag, start);
+}
 
-    key.wildcards = 0;
-    if (flow_extract(buffer, p ? p->port_no : OFPP_NONE, &key.flow)
-        && (dp->flags & OFPC_FRAG_MASK) == OFPC_FRAG_DROP) {
+/* Returns how far packets received by 'dp' must be parsed: only as far as
+ * some flow in the chain needs, unless fragments must be recognized. */
+static enum flow_layer
+rx_flow_layer(const struct datapath *dp)
+{
+    return ((dp->flags & OFPC_FRAG_MASK) != OFPC_FRAG_NORMAL
+            ? FLOW_LAYER_ALL
+            : chain_flow_layer(dp->chain));
+}
+
+/* Returns true, after destroying 'buffer', if 'buffer', received on 'p' with
+ * its flow extracted into '*key' and 'is_frag' as the return value of the
+ * extraction, must be dropped without looking it up in the flow table. */
+static bool
+drop_received_packet(struct datapath *dp, struct ofpbuf *buffer,
+                     struct sw_port *p, const struct sw_flow_key *key,
+                     int is_frag)
+{
+    if (is_frag && (dp->flags & OFPC_FRAG_MASK) == OFPC_FRAG_DROP) {
         /* Drop fragment. */
+        count_drop(dp, p, OFP_EXT_DROP_FRAG);
         ofpbuf_delete(buffer);
-        return 0;
+        return true;
     }
 
     if (p && p->config & (OFPPC_NO_RECV | OFPPC_NO_RECV_STP)
-        && p->config & (!eth_addr_equals(key.flow.dl_dst, stp_eth_addr)
+        && p->config & (!eth_addr_equals(key->flow.dl_dst, stp_eth_addr)
                        ? OFPPC_NO_RECV : OFPPC_NO_RECV_STP)) {
+        count_drop(dp, p, OFP_EXT_DROP_NO_RECV);
         ofpbuf_delete(buffer);
+        return true;
+    }
+    return false;
+}
+
+/* Applies 'flow', which matched 'buffer' with flow '*key', to 'buffer'.  If
+ * 'forward_only' is true, every flow in 'dp''s chain must satisfy
+ * act_prog_forward_only(), so that the flow's program can be run without
+ * looking at its opcodes or at '*key'; callers pass a constant so that the
+ * check disappears. */
+static ALWAYS_INLINE void
+execute_found_flow__(struct datapath *dp, struct ofpbuf *buffer,
+                     struct sw_flow_key *key, struct sw_flow *flow,
+                     bool forward_only)
+{
+    uint64_t start = latency_ticks();
+
+    flow_used(flow, buffer);
+    if (dp->topk) {
+        topk_count(dp->topk, flow, buffer->size);
+    }
+    if (forward_only) {
+        execute_forward_actions(dp, buffer, ntohs(key->flow.in_port),
+                                flow->sf_acts->prog);
+    } else {
+        execute_flow_actions(dp, buffer, key, flow->sf_acts, false);
+    }
+    latency_record(&dp->latency, OFP_EXT_LATENCY_ACTIONS, start);
+}
+
+static void
+execute_found_flow(struct datapath *dp, struct ofpbuf *buffer,
+                   struct sw_flow_key *key, struct sw_flow *flow)
+{
+    execute_found_flow__(dp, buffer, key, flow, false);
+}
+
+/* Does the work of run_flow_through_tables() for 'buffer', whose flow has
+ * already been extracted into '*key', with 'is_frag' as the return value of
+ * the extraction.  'start' is the latency_ticks() value when processing of
+ * 'buffer' began. */
+static int
+run_extracted_flow(struct datapath *dp, struct ofpbuf *buffer,
+                   struct sw_port *p, struct sw_flow_key *key, int is_frag,
+                   uint64_t start)
+{
+    struct sw_flow *flow;
+
+    if (drop_received_packet(dp, buffer, p, key, is_frag)) {
         return 0;
     }
 
-    flow = chain_lookup(dp->chain, &key, 0);
+    flow = chain_lookup(dp->chain, key, buffer->rxhash, 0);
+    latency_record(&dp->latency, OFP_EXT_LATENCY_LOOKUP, start);
     if (flow != NULL) {
-        flow_used(flow, buffer);
-        execute_actions(dp, buffer, &key, flow->sf_acts->actions,
-                        flow->sf_acts->actions_len, false);
+        execute_found_flow(dp, buffer, key, flow);
         return 0;
     } else {
         return -ESRCH;
@@ -1216,9 +2664,109 @@ int run_flow_through_tables(struct datapath *dp, struct ofpbuf *buffer,
 void fwd_port_input(struct datapath *dp, struct ofpbuf *buffer,
                     struct sw_port *p)
 {
-    if (run_flow_through_tables(dp, buffer, p)) {
-        dp_output_control(dp, buffer, p->port_no,
-                          dp->miss_send_len, OFPR_NO_MATCH);
+    uint64_t start = latency_ticks();
+    struct sw_flow_key key;
+
+    DP_TRACE2(port_input, p ? p->port_no : OFPP_NONE, buffer->size);
+    if (dp->sampler && --p->sample_skip <= 0) {
+        sampler_sample(dp->sampler, buffer, p);
+    }
+    if (run_flow_through_tables(dp, buffer, p, &key)) {
+        table_miss(dp, buffer, p, &key, 0);
+    }
+    latency_record(&dp->latency, OFP_EXT_LATENCY_PORT_INPUT, start);
+}
+
+/* Does the work of fwd_port_input_batch(), running the actions of the flows
+ * found as execute_found_flow__() does with 'forward_only'.  Callers pass
+ * constants for 'layer' and 'forward_only' to get a copy of the loop
+ * specialized for the features of the flows in the chain; see
+ * FWD_PORT_INPUT_BATCH. */
+BUILD_ASSERT_DECL(DP_RX_BATCH <= TABLE_LOOKUP_BATCH);
+
+static ALWAYS_INLINE void
+fwd_port_input_batch__(struct datapath *dp, struct ofpbuf *buffers[],
+                       size_t n, struct sw_port *p, enum flow_layer layer,
+                       bool forward_only)
+{
+    struct sw_flow_key keys[DP_RX_BATCH];
+    struct flow *flows[DP_RX_BATCH];
+    int frags[DP_RX_BATCH];
+    const struct sw_flow_key *lookup_keys[DP_RX_BATCH];
+    size_t lookup_idx[DP_RX_BATCH];
+    uint32_t rxhashes[DP_RX_BATCH];
+    struct sw_flow *found[DP_RX_BATCH];
+    uint64_t start = latency_ticks();
+    size_t i, n_lookup;
+
+    assert(n <= DP_RX_BATCH);
+    for (i = 0; i < n; i++) {
+        DP_TRACE2(port_input, p->port_no, buffers[i]->size);
+        if (dp->sampler && --p->sample_skip <= 0) {
+            sampler_sample(dp->sampler, buffers[i], p);
+        }
+        keys[i].wildcards = 0;
+        flows[i] = &keys[i].flow;
+    }
+    flow_extract_batch(buffers, n, p->port_no, layer, flows, frags);
+
+    n_lookup = 0;
+    for (i = 0; i < n; i++) {
+        if (!drop_received_packet(dp, buffers[i], p, &keys[i], frags[i])) {
+            lookup_idx[n_lookup] = i;
+            lookup_keys[n_lookup] = &keys[i];
+            rxhashes[n_lookup] = buffers[i]->rxhash;
+            n_lookup++;
+        }
+    }
+    chain_lookup_batch(dp->chain, lookup_keys, rxhashes, found, n_lookup);
+    latency_record(&dp->latency, OFP_EXT_LATENCY_LOOKUP, start);
+
+    for (i = 0; i < n_lookup; i++) {
+        size_t j = lookup_idx[i];
+
+        if (found[i]) {
+            execute_found_flow__(dp, buffers[j], &keys[j], found[i],
+                                 forward_only);
+        } else {
+            table_miss(dp, buffers[j], p, &keys[j], 0);
+        }
+    }
+    latency_record(&dp->latency, OFP_EXT_LATENCY_PORT_INPUT, start);
+}
+
+/* Defines NAME as a copy of fwd_port_input_batch__() specialized for packets
+ * parsed through LAYER and, if FORWARD_ONLY, for a chain of flows that only
+ * output packets. */
+#define FWD_PORT_INPUT_BATCH(NAME, LAYER, FORWARD_ONLY)                 \
+    static void                                                         \
+    NAME(struct datapath *dp, struct ofpbuf *buffers[], size_t n,       \
+         struct sw_port *p)                                             \
+    {                                                                   \
+        fwd_port_input_batch__(dp, buffers, n, p, LAYER, FORWARD_ONLY); \
+    }
+FWD_PORT_INPUT_BATCH(fwd_batch_l2_forward, FLOW_LAYER_L2, true)
+FWD_PORT_INPUT_BATCH(fwd_batch_all_forward, FLOW_LAYER_ALL, true)
+FWD_PORT_INPUT_BATCH(fwd_batch_l2, FLOW_LAYER_L2, false)
+FWD_PORT_INPUT_BATCH(fwd_batch_all, FLOW_LAYER_ALL, false)
+
+/* Processes the 'n' packets in 'buffers', all received on 'p', as
+ * fwd_port_input() would, but extracts their flows together with
+ * flow_extract_batch() and looks them up together with chain_lookup_batch(),
+ * to spread the cost of the cache misses on their headers and on the flow
+ * tables across the batch.  The loop that does so is picked from copies
+ * specialized for how deep the flows in the chain match and whether any of
+ * them does more than output packets.  Takes ownership of the buffers. */
+static void
+fwd_port_input_batch(struct datapath *dp, struct ofpbuf *buffers[], size_t n,
+                     struct sw_port *p)
+{
+    bool l2 = rx_flow_layer(dp) == FLOW_LAYER_L2;
+
+    if (chain_forward_only(dp->chain)) {
+        (l2 ? fwd_batch_l2_forward : fwd_batch_all_forward)(dp, buffers, n, p);
+    } else {
+        (l2 ? fwd_batch_l2 : fwd_batch_all)(dp, buffers, n, p);
     }
 }
 
@@ -1281,31 +2829,93 @@ recv_set_config(struct datapath *dp, const struct sender *sender UNUSED,
     return 0;
 }
 
+/* Takes the packet buffered as 'buffer_id' for a message from 'sender', as
+ * pktbuf_retrieve() does, and counts the time since its packet_in in the
+ * sender's setup latency, or the ID as stale if it is no longer valid. */
+static struct ofpbuf *
+retrieve_buffer(struct datapath *dp, const struct sender *sender,
+                uint32_t buffer_id)
+{
+    struct ofpbuf *buffer;
+    uint64_t saved;
+
+    buffer = pktbuf_retrieve(dp->pktbuf, buffer_id, &saved);
+    if (sender && sender->remote) {
+        if (buffer) {
+            latency_hist_record(&sender->remote->setup_latency, saved);
+        } else {
+            sender->remote->n_stale_buffers++;
+        }
+    }
+    return buffer;
+}
+
+/* Takes the packet buffered as 'buffer_id', as retrieve_buffer() does, and
+ * stores its flow in 'key'.  The flow saved with the packet when it missed in
+ * the flow table is used if there is one, so that the packet need not be
+ * parsed again; otherwise the packet is parsed with 'in_port' as its input
+ * port. */
+static struct ofpbuf *
+retrieve_buffer_key(struct datapath *dp, const struct sender *sender,
+                    uint32_t buffer_id, uint16_t in_port,
+                    struct sw_flow_key *key)
+{
+    bool has_flow = pktbuf_get_flow(dp->pktbuf, buffer_id, &key->flow);
+    struct ofpbuf *buffer = retrieve_buffer(dp, sender, buffer_id);
+
+    if (buffer) {
+        key->wildcards = 0;
+        if (!has_flow) {
+            flow_extract(buffer, in_port, &key->flow);
+        }
+    }
+    return buffer;
+}
+
 static int
 recv_packet_out(struct datapath *dp, const struct sender *sender,
                 const void *msg)
 {
     const struct ofp_packet_out *opo = msg;
+    const struct ofp_action_header *actions = opo->actions;
+    union {
+        uint64_t align;
+        uint8_t bytes[256];
+    } actions_stub;
+    void *actions_copy = NULL;
     struct sw_flow_key key;
     uint16_t v_code;
     struct ofpbuf *buffer;
     size_t actions_len = ntohs(opo->actions_len);
+    size_t data_ofs = sizeof *opo + actions_len;
 
     if (actions_len > (ntohs(opo->header.length) - sizeof *opo)) {
         VLOG_DBG_RL(&rl, "message too short for number of actions");
         return -EINVAL;
     }
 
-    if (ntohl(opo->buffer_id) == (uint32_t) -1) {
-        /* FIXME: can we avoid copying data here? */
-        int data_len = ntohs(opo->header.length) - sizeof *opo - actions_len;
-        buffer = ofpbuf_new(data_len);
-        ofpbuf_put(buffer, (uint8_t *)opo->actions + actions_len, data_len);
-    } else {
-        buffer = retrieve_buffer(ntohl(opo->buffer_id));
+    if (ntohl(opo->buffer_id) != (uint32_t) -1) {
+        buffer = retrieve_buffer(dp, sender, ntohl(opo->buffer_id));
         if (!buffer) {
             return -ESRCH;
         }
+    } else if (sender && sender->buffer && sender->buffer->data == msg) {
+        /* Forward the packet where it lies in the message, with the
+         * message's header and actions as its headroom.  Pushing a VLAN tag
+         * or a packet_in header into that headroom overwrites the actions,
+         * so execute a copy of them. */
+        if (actions_len <= sizeof actions_stub) {
+            actions = memcpy(&actions_stub, opo->actions, actions_len);
+        } else {
+            actions = actions_copy = xmemdup(opo->actions, actions_len);
+        }
+        buffer = ofpbuf_share(sender->buffer);
+        ofpbuf_pull(buffer, data_ofs);
+    } else {
+        int data_len = ntohs(opo->header.length) - data_ofs;
+        buffer = ofpbuf_new(DP_RX_HEADROOM + data_len);
+        ofpbuf_reserve(buffer, DP_RX_HEADROOM);
+        ofpbuf_put(buffer, (uint8_t *)opo->actions + actions_len, data_len);
     }
 
     flow_extract(buffer, ntohs(opo->in_port), &key.flow);
@@ -1317,15 +2927,153 @@ recv_packet_out(struct datapath *dp, const struct sender *sender,
         goto error;
     }
 
-    execute_actions(dp, buffer, &key, opo->actions, actions_len, true);
+    execute_actions(dp, buffer, &key, actions, actions_len, true);
+    release_held_misses(dp, ntohl(opo->buffer_id), actions, actions_len);
+    free(actions_copy);
 
     return 0;
 
 error:
+    release_held_misses(dp, ntohl(opo->buffer_id), NULL, 0);
+    free(actions_copy);
     ofpbuf_delete(buffer);
     return -EINVAL;
 }
 
+/* Returns true if the entries in 'opb' exactly fill its length. */
+static bool
+packet_out_batch_is_valid(const struct ofp_ext_packet_out_batch *opb)
+{
+    const uint8_t *p = (const uint8_t *) opb->entries;
+    const uint8_t *end = (const uint8_t *) opb + ntohs(opb->header.header.length);
+
+    if (p > end) {
+        return false;
+    }
+    while (p < end) {
+        const struct ofp_ext_packet_out_entry *e = (const void *) p;
+        size_t length, min_len;
+
+        if (end - p < sizeof *e) {
+            return false;
+        }
+        length = ntohs(e->length);
+        min_len = sizeof *e + ntohs(e->actions_len);
+        if (e->buffer_id == htonl(UINT32_MAX)) {
+            min_len += ntohs(e->data_len);
+        }
+        if (length % 8 || ntohs(e->actions_len) % 8
+            || length < min_len || length > end - p) {
+            return false;
+        }
+        p += length;
+    }
+    return true;
+}
+
+/* Sends the packets in 'opb', an OFP_EXT_PACKET_OUT_BATCH message received
+ * from 'sender'.  A run of entries with the same actions shares one copy of
+ * them, validated once per input port and compiled once, and packet data is
+ * sent from where it lies in the message when the message has a buffer of
+ * its own, as in recv_packet_out().  Returns 0 if successful, otherwise a
+ * negative errno value. */
+int
+dp_packet_out_batch(struct datapath *dp, const struct sender *sender,
+                    const struct ofp_ext_packet_out_batch *opb)
+{
+    size_t length = ntohs(opb->header.header.length);
+    const uint8_t *p = (const uint8_t *) opb->entries;
+    const uint8_t *end = (const uint8_t *) opb + length;
+    struct ofpbuf *msg_buf = NULL;
+    struct sw_flow_actions *sfa = NULL;
+    int checked_port = -1;      /* Input port 'sfa' was validated for. */
+    uint16_t v_code = ACT_VALIDATION_OK;
+
+    if (length < sizeof *opb || !packet_out_batch_is_valid(opb)) {
+        dp_send_error_msg(dp, sender, OFPET_BAD_REQUEST, OFPBRC_BAD_LEN,
+                          opb, length);
+        return -EINVAL;
+    }
+
+    if (sender && sender->buffer && sender->buffer->data == opb) {
+        msg_buf = ofpbuf_share(sender->buffer);
+    }
+
+    for (; p < end; p += ntohs(((const struct ofp_ext_packet_out_entry *)
+                                p)->length)) {
+        const struct ofp_ext_packet_out_entry *e = (const void *) p;
+        size_t actions_len = ntohs(e->actions_len);
+        uint16_t in_port = ntohs(e->in_port);
+        struct sw_flow_key key;
+        struct ofpbuf *buffer;
+
+        if (actions_len || !sfa) {
+            if (sfa) {
+                act_prog_unref(sfa->prog);
+                free(sfa);
+            }
+            sfa = xmalloc(sizeof *sfa + actions_len);
+            sfa->actions_len = actions_len;
+            sfa->prog = NULL;
+            memcpy(sfa->actions, e->actions, actions_len);
+            checked_port = -1;
+        }
+
+        if (e->buffer_id != htonl(UINT32_MAX)) {
+            buffer = retrieve_buffer_key(dp, sender, ntohl(e->buffer_id),
+                                         in_port, &key);
+            if (!buffer) {
+                continue;
+            }
+        } else {
+            const uint8_t *data = (const uint8_t *) e->actions + actions_len;
+            size_t data_len = ntohs(e->data_len);
+
+            if (msg_buf) {
+                /* Each packet gets exactly its own bytes of the message, so
+                 * that pushing a header onto one copies it rather than
+                 * overwriting the entry before it. */
+                ofpbuf_pull(msg_buf, data - (const uint8_t *) msg_buf->data);
+                buffer = ofpbuf_share_head(msg_buf, data_len);
+            } else {
+                buffer = ofpbuf_new(DP_RX_HEADROOM + data_len);
+                ofpbuf_reserve(buffer, DP_RX_HEADROOM);
+                ofpbuf_put(buffer, data, data_len);
+            }
+            key.wildcards = 0;
+            flow_extract(buffer, in_port, &key.flow);
+        }
+
+        if (checked_port != in_port) {
+            checked_port = in_port;
+            v_code = validate_actions(dp, &key, sfa->actions,
+                                      sfa->actions_len);
+            if (v_code != ACT_VALIDATION_OK) {
+                dp_send_error_msg(dp, sender, OFPET_BAD_ACTION, v_code,
+                                  opb, length);
+            } else if (!sfa->prog) {
+                sfa->prog = compile_actions(sfa->actions, sfa->actions_len);
+            }
+        }
+        if (v_code != ACT_VALIDATION_OK) {
+            ofpbuf_delete(buffer);
+            release_held_misses(dp, ntohl(e->buffer_id), NULL, 0);
+            continue;
+        }
+
+        execute_flow_actions(dp, buffer, &key, sfa, true);
+        release_held_misses(dp, ntohl(e->buffer_id),
+                            sfa->actions, sfa->actions_len);
+    }
+
+    if (sfa) {
+        act_prog_unref(sfa->prog);
+        free(sfa);
+    }
+    ofpbuf_delete(msg_buf);
+    return 0;
+}
+
 static int
 recv_port_mod(struct datapath *dp, const struct sender *sender UNUSED,
               const void *msg)
@@ -1337,10 +3085,172 @@ recv_port_mod(struct datapath *dp, const struct sender *sender UNUSED,
     return 0;
 }
 
+/* Returns the pipeline table that flow_mods and flow statistics requests
+ * from 'sender' address. */
+static uint8_t
+sender_table(const struct sender *sender)
+{
+    return sender && sender->remote ? sender->remote->table_id : 0;
+}
+
+/* Returns pipeline table 'table_id' of 'dp', which must exist. */
+static struct sw_chain *
+pipeline_chain(const struct datapath *dp, uint8_t table_id)
+{
+    return table_id ? dp->pipeline[table_id] : dp->chain;
+}
+
+/* Returns the chain that flow_mods from 'sender' change: the one that its
+ * OFP_EXT_TABLE_REPLACE transaction is staging, if any, otherwise the
+ * pipeline table that it addresses. */
+static struct sw_chain *
+sender_chain(const struct datapath *dp, const struct sender *sender)
+{
+    return (sender && sender->remote && sender->remote->staged
+            ? sender->remote->staged
+            : pipeline_chain(dp, sender_table(sender)));
+}
+
+/* Makes flow_mods and flow statistics requests from 'sender' address
+ * pipeline table 'table_id', creating the table if it does not exist yet.
+ * Returns 0 if successful, otherwise a positive errno value: EINVAL if
+ * 'table_id' is out of range, EPERM if 'sender' has an OFP_EXT_TABLE_REPLACE
+ * transaction open, or ENOMEM. */
+int
+dp_set_table(struct datapath *dp, const struct sender *sender,
+             uint8_t table_id)
+{
+    struct remote *r = sender->remote;
+
+    if (table_id >= OFP_EXT_PIPELINE_TABLES) {
+        return EINVAL;
+    } else if (r->staged) {
+        return EPERM;
+    }
+
+    if (table_id && !dp->pipeline[table_id]) {
+        struct sw_chain *chain;
+        int error;
+
+        /* A pipeline table is created without 'dp', so that it never takes
+         * table 0's hardware table, and then given 'dp' for its
+         * flow_removed messages, unless 'dp' has a hardware table, which
+         * chain_place() would move its flows into. */
+        error = chain_create(NULL, dp->tables, &chain);
+        if (error) {
+            return -error;
+        }
+#if defined(OF_HW_PLAT)
+        chain->dp = dp->hw_drv ? NULL : dp;
+#else
+        chain->dp = dp;
+#endif
+        chain->evict_batch = dp->chain->evict_batch;
+        dp->pipeline[table_id] = chain;
+    }
+    r->table_id = table_id;
+    return 0;
+}
+
+/* Sets the miss behavior of pipeline table 'table_id' to 'miss', one of
+ * OFP_EXT_MISS_*.  Returns 0 if successful, otherwise EINVAL. */
+int
+dp_set_table_miss(struct datapath *dp, uint8_t table_id, uint8_t miss)
+{
+    if (table_id >= OFP_EXT_PIPELINE_TABLES
+        || (miss != OFP_EXT_MISS_CONTROLLER
+            && miss != OFP_EXT_MISS_CONTINUE
+            && miss != OFP_EXT_MISS_DROP)) {
+        return EINVAL;
+    }
+    dp->table_miss[table_id] = miss;
+    return 0;
+}
+
+/* Validates 'actions' for a flow with 'key' that a flow_mod from 'sender'
+ * puts in the pipeline table that it addresses, where they may only go to a
+ * later table.  Returns ACT_VALIDATION_OK or an OFPET_BAD_ACTION code. */
+static uint16_t
+validate_flow_actions(struct datapath *dp, const struct sender *sender,
+                      const struct sw_flow_key *key,
+                      const struct ofp_action_header *actions,
+                      size_t actions_len)
+{
+    uint16_t v_code = validate_actions(dp, key, actions, actions_len);
+
+    if (v_code == ACT_VALIDATION_OK) {
+        uint8_t goto_table = actions_goto_table(actions, actions_len);
+        if (goto_table && goto_table <= sender_table(sender)) {
+            return OFPBAC_BAD_ARGUMENT;
+        }
+    }
+    return v_code;
+}
+
+/* Begins, commits or aborts an OFP_EXT_TABLE_REPLACE transaction on
+ * 'sender''s connection, according to 'command', one of OFP_EXT_REPLACE_*.
+ * Returns 0 if successful, otherwise a positive errno value: EINVAL for an
+ * unknown command, ENOENT for a commit or abort without a transaction, or
+ * EPERM if 'dp' has a hardware table, which a staged chain cannot take
+ * over, or if 'sender' addresses a pipeline table other than 0, which a
+ * transaction cannot replace. */
+int
+dp_replace_table(struct datapath *dp, const struct sender *sender,
+                 uint16_t command)
+{
+    struct remote *r = sender->remote;
+    struct sw_chain *old;
+    unsigned int n_kept;
+    int error;
+
+    switch (command) {
+    case OFP_EXT_REPLACE_BEGIN:
+#if defined(OF_HW_PLAT)
+        if (dp->hw_drv) {
+            return EPERM;
+        }
+#endif
+        if (r->table_id) {
+            return EPERM;
+        }
+        if (r->staged) {
+            chain_destroy(r->staged);
+            r->staged = NULL;
+        }
+        error = chain_create(NULL, dp->tables, &r->staged);
+        return -error;
+
+    case OFP_EXT_REPLACE_COMMIT:
+        if (!r->staged) {
+            return ENOENT;
+        }
+        old = dp->chain;
+        n_kept = chain_adopt(r->staged, old);
+        dp->chain = r->staged;
+        r->staged = NULL;
+        chain_destroy(old);
+        VLOG_INFO("replaced flow table: %u flows, %u with their counters",
+                  chain_n_flows(dp->chain), n_kept);
+        return 0;
+
+    case OFP_EXT_REPLACE_ABORT:
+        if (!r->staged) {
+            return ENOENT;
+        }
+        chain_destroy(r->staged);
+        r->staged = NULL;
+        return 0;
+
+    default:
+        return EINVAL;
+    }
+}
+
 static int
 add_flow(struct datapath *dp, const struct sender *sender,
         const struct ofp_flow_mod *ofm)
 {
+    struct sw_chain *chain = sender_chain(dp, sender);
     int error = -ENOMEM;
     uint16_t v_code;
     struct sw_flow *flow;
@@ -1354,7 +3264,8 @@ add_flow(struct datapath *dp, const struct sender *sender,
 
     flow_extract_match(&flow->key, &ofm->match);
 
-    v_code = validate_actions(dp, &flow->key, ofm->actions, actions_len);
+    v_code = validate_flow_actions(dp, sender, &flow->key, ofm->actions,
+                                   actions_len);
     if (v_code != ACT_VALIDATION_OK) {
         dp_send_error_msg(dp, sender, OFPET_BAD_ACTION, v_code,
                   ofm, ntohs(ofm->header.length));
@@ -1365,7 +3276,7 @@ add_flow(struct datapath *dp, const struct sender *sender,
 
     if (ntohs(ofm->flags) & OFPFF_CHECK_OVERLAP) {
         /* check whether there is any conflict */
-        overlap = chain_has_conflict(dp->chain, &flow->key, flow->priority,
+        overlap = chain_has_conflict(chain, &flow->key, flow->priority,
                                      false);
         if (overlap){
             dp_send_error_msg(dp, sender, OFPET_FLOW_MOD_FAILED,
@@ -1393,8 +3304,9 @@ add_flow(struct datapath *dp, const struct sender *sender,
     flow_setup_actions(flow, ofm->actions, actions_len);
 
     /* Act. */
-    error = chain_insert(dp->chain, flow,
+    error = chain_insert(chain, flow,
                          (ntohs(ofm->flags) & OFPFF_EMERG) ? 1 : 0);
+    DP_TRACE3(add_flow, flow, flow->priority, -error);
     if (error == -ENOBUFS) {
         dp_send_error_msg(dp, sender, OFPET_FLOW_MOD_FAILED,
                 OFPFMFC_ALL_TABLES_FULL, ofm, ntohs(ofm->header.length));
@@ -1405,14 +3317,17 @@ add_flow(struct datapath *dp, const struct sender *sender,
 
     error = 0;
     if (ntohl(ofm->buffer_id) != UINT32_MAX) {
-        struct ofpbuf *buffer = retrieve_buffer(ntohl(ofm->buffer_id));
+        struct sw_flow_key key;
+        struct ofpbuf *buffer;
+
+        buffer = retrieve_buffer_key(dp, sender, ntohl(ofm->buffer_id),
+                                     ntohs(ofm->match.in_port), &key);
         if (buffer) {
-            struct sw_flow_key key;
-            uint16_t in_port = ntohs(ofm->match.in_port);
-            flow_extract(buffer, in_port, &key.flow);
             flow_used(flow, buffer);
-            execute_actions(dp, buffer, &key,
-                    ofm->actions, actions_len, false);
+            if (dp->topk) {
+                topk_count(dp->topk, flow, buffer->size);
+            }
+            execute_flow_actions(dp, buffer, &key, flow->sf_acts, false);
         } else {
             error = -ESRCH;
         }
@@ -1423,7 +3338,7 @@ error_free_flow:
     flow_free(flow);
 error:
     if (ntohl(ofm->buffer_id) != (uint32_t) -1)
-        discard_buffer(ntohl(ofm->buffer_id));
+        pktbuf_discard(dp->pktbuf, ntohl(ofm->buffer_id));
     return error;
 }
 
@@ -1431,6 +3346,7 @@ static int
 mod_flow(struct datapath *dp, const struct sender *sender,
         const struct ofp_flow_mod *ofm)
 {
+    struct sw_chain *chain = sender_chain(dp, sender);
     int error = -ENOMEM;
     uint16_t v_code;
     size_t actions_len = ntohs(ofm->header.length) - sizeof *ofm;
@@ -1444,7 +3360,8 @@ mod_flow(struct datapath *dp, const struct sender *sender,
 
     flow_extract_match(&flow->key, &ofm->match);
 
-    v_code = validate_actions(dp, &flow->key, ofm->actions, actions_len);
+    v_code = validate_flow_actions(dp, sender, &flow->key, ofm->actions,
+                                   actions_len);
     if (v_code != ACT_VALIDATION_OK) {
         dp_send_error_msg(dp, sender, OFPET_BAD_ACTION, v_code,
                           ofm, ntohs(ofm->header.length));
@@ -1456,7 +3373,7 @@ mod_flow(struct datapath *dp, const struct sender *sender,
 
     /* First try to modify existing flows if any */
     /* if there is no matching flow, add it */
-    if (!chain_modify(dp->chain, &flow->key, flow->priority,
+    if (!chain_modify(chain, &flow->key, flow->priority,
                       strict, ofm->actions, actions_len,
                       (ntohs(ofm->flags) & OFPFF_EMERG) ? 1 : 0)) {
         /* Fill out flow. */
@@ -1466,7 +3383,7 @@ mod_flow(struct datapath *dp, const struct sender *sender,
         flow->send_flow_rem = (ntohs(ofm->flags) & OFPFF_SEND_FLOW_REM) ? 1 : 0;
         flow->emerg_flow = (ntohs(ofm->flags) & OFPFF_EMERG) ? 1 : 0;
         flow_setup_actions(flow, ofm->actions, actions_len);
-        error = chain_insert(dp->chain, flow,
+        error = chain_insert(chain, flow,
                              (ntohs(ofm->flags) & OFPFF_EMERG) ? 1 : 0);
         if (error == -ENOBUFS) {
             dp_send_error_msg(dp, sender, OFPET_FLOW_MOD_FAILED,
@@ -1480,11 +3397,12 @@ mod_flow(struct datapath *dp, const struct sender *sender,
 
     error = 0;
     if (ntohl(ofm->buffer_id) != UINT32_MAX) {
-      struct ofpbuf *buffer = retrieve_buffer(ntohl(ofm->buffer_id));
-      if (buffer) {
-            struct sw_flow_key skb_key;
-            uint16_t in_port = ntohs(ofm->match.in_port);
-            flow_extract(buffer, in_port, &skb_key.flow);
+        struct sw_flow_key skb_key;
+        struct ofpbuf *buffer;
+
+        buffer = retrieve_buffer_key(dp, sender, ntohl(ofm->buffer_id),
+                                     ntohs(ofm->match.in_port), &skb_key);
+        if (buffer) {
             execute_actions(dp, buffer, &skb_key,
                             ofm->actions, actions_len, false);
         } else {
@@ -1497,7 +3415,7 @@ error_free_flow:
     flow_free(flow);
 error:
     if (ntohl(ofm->buffer_id) != (uint32_t) -1)
-        discard_buffer(ntohl(ofm->buffer_id));
+        pktbuf_discard(dp->pktbuf, ntohl(ofm->buffer_id));
     return error;
 }
 
@@ -1507,15 +3425,23 @@ recv_flow(struct datapath *dp, const struct sender *sender,
 {
     const struct ofp_flow_mod *ofm = msg;
     uint16_t command = ntohs(ofm->command);
+    struct sw_chain *chain = sender_chain(dp, sender);
+
+    if (command == OFPFC_ADD || command == OFPFC_MODIFY
+        || command == OFPFC_MODIFY_STRICT) {
+        unsigned int n_flows = chain_n_flows(chain);
+        uint64_t start = ofpstat_proc_now();
+        bool add = command == OFPFC_ADD;
+        int error;
 
-    if (command == OFPFC_ADD) {
-        return add_flow(dp, sender, ofm);
-    } else if ((command == OFPFC_MODIFY) || (command == OFPFC_MODIFY_STRICT)) {
-        return mod_flow(dp, sender, ofm);
+        error = add ? add_flow(dp, sender, ofm) : mod_flow(dp, sender, ofm);
+        ofpstat_proc_record_flow(&dp->proc_stats, add, n_flows, start);
+        release_held_misses(dp, ntohl(ofm->buffer_id), NULL, 0);
+        return error;
     }  else if (command == OFPFC_DELETE) {
         struct sw_flow_key key;
         flow_extract_match(&key, &ofm->match);
-        return chain_delete(dp->chain, &key, ofm->out_port, 0, 0,
+        return chain_delete(chain, &key, ofm->out_port, 0, 0,
                             (ntohs(ofm->flags) & OFPFF_EMERG) ? 1 : 0)
                             ? 0 : -ESRCH;
     } else if (command == OFPFC_DELETE_STRICT) {
@@ -1523,7 +3449,7 @@ recv_flow(struct datapath *dp, const struct sender *sender,
         uint16_t priority;
         flow_extract_match(&key, &ofm->match);
         priority = key.wildcards ? ntohs(ofm->priority) : -1;
-        return chain_delete(dp->chain, &key, ofm->out_port, priority, 1,
+        return chain_delete(chain, &key, ofm->out_port, priority, 1,
                             (ntohs(ofm->flags) & OFPFF_EMERG) ? 1 : 0)
                             ? 0 : -ESRCH;
     } else {
@@ -1547,10 +3473,12 @@ desc_stats_dump(struct datapath *dp UNUSED, void *state UNUSED,
 }
 
 struct flow_stats_state {
+    uint8_t pipeline_table;        /* Pipeline table to dump. */
     int table_idx;
     struct sw_table_position position;
     struct ofp_flow_stats_request rq;
     uint64_t now;                  /* Current time in milliseconds */
+    uint64_t since;                /* Skip flows last used before this. */
 
     struct ofpbuf *buffer;
 };
@@ -1558,14 +3486,23 @@ struct flow_stats_state {
 #define MAX_FLOW_STATS_BYTES 4096
 #define EMERG_TABLE_ID_FOR_STATS 0xfe
 
-static int
-flow_stats_init(const void *body, int body_len UNUSED, void **state)
+static void
+init_flow_stats_state(struct flow_stats_state *s, uint8_t pipeline_table,
+                      const struct ofp_flow_stats_request *fsr, uint64_t since)
 {
-    const struct ofp_flow_stats_request *fsr = body;
-    struct flow_stats_state *s = xmalloc(sizeof *s);
+    s->pipeline_table = pipeline_table;
     s->table_idx = fsr->table_id == 0xff ? 0 : fsr->table_id;
     memset(&s->position, 0, sizeof s->position);
     s->rq = *fsr;
+    s->since = since;
+}
+
+static int
+flow_stats_init(const struct sender *sender, const void *body,
+                int body_len UNUSED, void **state)
+{
+    struct flow_stats_state *s = xmalloc(sizeof *s);
+    init_flow_stats_state(s, sender_table(sender), body, 0);
     *state = s;
     return 0;
 }
@@ -1573,6 +3510,9 @@ flow_stats_init(const void *body, int body_len UNUSED, void **state)
 static int flow_stats_dump_callback(struct sw_flow *flow, void *private)
 {
     struct flow_stats_state *s = private;
+    if (flow->used < s->since) {
+        return 0;
+    }
     fill_flow_stats(s->buffer, flow, s->table_idx, s->now);
     return s->buffer->size >= MAX_FLOW_STATS_BYTES;
 }
@@ -1581,6 +3521,7 @@ static int flow_stats_dump(struct datapath *dp, void *state,
                            struct ofpbuf *buffer)
 {
     struct flow_stats_state *s = state;
+    struct sw_chain *chain = pipeline_chain(dp, s->pipeline_table);
     struct sw_flow_key match_key;
 
     flow_extract_match(&match_key, &s->rq.match);
@@ -1588,15 +3529,15 @@ static int flow_stats_dump(struct datapath *dp, void *state,
     s->now = time_msec();
 
     if (s->rq.table_id == EMERG_TABLE_ID_FOR_STATS) {
-        struct sw_table *table = dp->chain->emerg_table;
+        struct sw_table *table = chain->emerg_table;
 
         table->iterate(table, &match_key, s->rq.out_port,
                        &s->position, flow_stats_dump_callback, s);
     } else {
-        while (s->table_idx < dp->chain->n_tables
+        while (s->table_idx < chain->n_tables
                && (s->rq.table_id == 0xff || s->rq.table_id == s->table_idx))
         {
-            struct sw_table *table = dp->chain->tables[s->table_idx];
+            struct sw_table *table = chain->tables[s->table_idx];
 
             if (table->iterate(table, &match_key, s->rq.out_port,
                                &s->position, flow_stats_dump_callback, s))
@@ -1615,14 +3556,17 @@ static void flow_stats_done(void *state)
 }
 
 struct aggregate_stats_state {
+    uint8_t pipeline_table;
     struct ofp_aggregate_stats_request rq;
 };
 
 static int
-aggregate_stats_init(const void *body, int body_len UNUSED, void **state)
+aggregate_stats_init(const struct sender *sender, const void *body,
+                     int body_len UNUSED, void **state)
 {
     const struct ofp_aggregate_stats_request *rq = body;
     struct aggregate_stats_state *s = xmalloc(sizeof *s);
+    s->pipeline_table = sender_table(sender);
     s->rq = *rq;
     *state = s;
     return 0;
@@ -1641,46 +3585,56 @@ static int aggregate_stats_dump(struct datapath *dp, void *state,
                                 struct ofpbuf *buffer)
 {
     struct aggregate_stats_state *s = state;
+    struct sw_chain *chain = pipeline_chain(dp, s->pipeline_table);
     struct ofp_aggregate_stats_request *rq = &s->rq;
     struct ofp_aggregate_stats_reply *rpy;
     struct sw_table_position position;
     struct sw_flow_key match_key;
+    struct flow_totals sum;
     int table_idx;
     int error;
 
     rpy = ofpbuf_put_uninit(buffer, sizeof *rpy);
     memset(rpy, 0, sizeof *rpy);
+    memset(&sum, 0, sizeof sum);
 
     flow_extract_match(&match_key, &rq->match);
     table_idx = rq->table_id == 0xff ? 0 : rq->table_id;
     memset(&position, 0, sizeof position);
 
     if (rq->table_id == EMERG_TABLE_ID_FOR_STATS) {
-        struct sw_table *table = dp->chain->emerg_table;
-
-        error = table->iterate(table, &match_key, rq->out_port, &position,
-                               aggregate_stats_dump_callback, rpy);
-        if (error)
-            return error;
-    } else {
-        while (table_idx < dp->chain->n_tables
-               && (rq->table_id == 0xff || rq->table_id == table_idx))
-        {
-            struct sw_table *table = dp->chain->tables[table_idx];
+        struct sw_table *table = chain->emerg_table;
 
-            error = table->iterate(table, &match_key, rq->out_port, &position,
-                                   aggregate_stats_dump_callback, rpy);
+        if (!chain_aggregate(chain, table, &match_key, rq->out_port, &sum)) {
+            error = table->iterate(table, &match_key, rq->out_port,
+                                   &position, aggregate_stats_dump_callback,
+                                   rpy);
             if (error)
                 return error;
+        }
+    } else {
+        while (table_idx < chain->n_tables
+               && (rq->table_id == 0xff || rq->table_id == table_idx))
+        {
+            struct sw_table *table = chain->tables[table_idx];
+
+            if (!chain_aggregate(chain, table, &match_key, rq->out_port,
+                                 &sum)) {
+                error = table->iterate(table, &match_key, rq->out_port,
+                                       &position,
+                                       aggregate_stats_dump_callback, rpy);
+                if (error)
+                    return error;
+            }
 
             table_idx++;
             memset(&position, 0, sizeof position);
         }
     }
 
-    rpy->packet_count = htonll(rpy->packet_count);
-    rpy->byte_count = htonll(rpy->byte_count);
-    rpy->flow_count = htonl(rpy->flow_count);
+    rpy->packet_count = htonll(rpy->packet_count + sum.packet_count);
+    rpy->byte_count = htonll(rpy->byte_count + sum.byte_count);
+    rpy->flow_count = htonl(rpy->flow_count + sum.n_flows);
     return 0;
 }
 
@@ -1689,24 +3643,38 @@ static void aggregate_stats_done(void *state)
     free(state);
 }
 
+static void
+put_table_stats(struct ofpbuf *buffer, uint8_t table_id,
+                const struct sw_table_stats *stats)
+{
+    struct ofp_table_stats *ots = ofpbuf_put_uninit(buffer, sizeof *ots);
+    strncpy(ots->name, stats->name, sizeof ots->name);
+    ots->table_id = table_id;
+    ots->wildcards = htonl(stats->wildcards);
+    memset(ots->pad, 0, sizeof ots->pad);
+    ots->max_entries = htonl(stats->max_flows);
+    ots->active_count = htonl(stats->n_flows);
+    ots->lookup_count = htonll(stats->n_lookup);
+    ots->matched_count = htonll(stats->n_matched);
+}
+
 static int
 table_stats_dump(struct datapath *dp, void *state UNUSED,
                  struct ofpbuf *buffer)
 {
+    struct sw_table_stats stats;
     int i;
+
     for (i = 0; i < dp->chain->n_tables; i++) {
-        struct ofp_table_stats *ots = ofpbuf_put_uninit(buffer, sizeof *ots);
-        struct sw_table_stats stats;
+        /* Not every table (e.g. hardware tables) fills in every member. */
+        memset(&stats, 0, sizeof stats);
         dp->chain->tables[i]->stats(dp->chain->tables[i], &stats);
-        strncpy(ots->name, stats.name, sizeof ots->name);
-        ots->table_id = i;
-        ots->wildcards = htonl(stats.wildcards);
-        memset(ots->pad, 0, sizeof ots->pad);
-        ots->max_entries = htonl(stats.max_flows);
-        ots->active_count = htonl(stats.n_flows);
-        ots->lookup_count = htonll(stats.n_lookup);
-        ots->matched_count = htonll(stats.n_matched);
+        put_table_stats(buffer, i, &stats);
     }
+
+    /* The microflow cache is reported after the real tables. */
+    chain_cache_stats(dp->chain, &stats);
+    put_table_stats(buffer, i, &stats);
     return 0;
 }
 
@@ -1721,7 +3689,8 @@ struct queue_stats_state {
 };
 
 static int
-port_stats_init(const void *body, int body_len UNUSED, void **state)
+port_stats_init(const struct sender *sender UNUSED, const void *body,
+                int body_len UNUSED, void **state)
 {
     struct port_stats_state *s = xmalloc(sizeof *s);
     const struct ofp_port_stats_request *psr = body;
@@ -1765,18 +3734,34 @@ dump_port_stats(struct datapath *dp, struct sw_port *port,
         ops->collisions   = htonll(stats.collisions);
 #endif
     } else {
+        struct netdev_stats stats;
+
         ops->rx_packets   = htonll(port->rx_packets);
         ops->tx_packets   = htonll(port->tx_packets);
         ops->rx_bytes     = htonll(port->rx_bytes);
         ops->tx_bytes     = htonll(port->tx_bytes);
-        ops->rx_dropped   = htonll(-1);
-        ops->tx_dropped   = htonll(port->tx_dropped);
-        ops->rx_errors    = htonll(-1);
-        ops->tx_errors    = htonll(-1);
-        ops->rx_frame_err = htonll(-1);
-        ops->rx_over_err  = htonll(-1);
-        ops->rx_crc_err   = htonll(-1);
-        ops->collisions   = htonll(-1);
+        if (port->netdev && !netdev_get_stats(port->netdev, &stats)) {
+            /* The datapath counts what it forwarded; the kernel counts what
+             * the device itself dropped or got wrong. */
+            ops->rx_dropped   = htonll(stats.rx_dropped);
+            ops->tx_dropped   = htonll(stats.tx_dropped
+                                       + port_tx_dropped(port));
+            ops->rx_errors    = htonll(stats.rx_errors);
+            ops->tx_errors    = htonll(stats.tx_errors);
+            ops->rx_frame_err = htonll(stats.rx_frame_errors);
+            ops->rx_over_err  = htonll(stats.rx_over_errors);
+            ops->rx_crc_err   = htonll(stats.rx_crc_errors);
+            ops->collisions   = htonll(stats.collisions);
+        } else {
+            ops->rx_dropped   = htonll(-1);
+            ops->tx_dropped   = htonll(port_tx_dropped(port));
+            ops->rx_errors    = htonll(-1);
+            ops->tx_errors    = htonll(-1);
+            ops->rx_frame_err = htonll(-1);
+            ops->rx_over_err  = htonll(-1);
+            ops->rx_crc_err   = htonll(-1);
+            ops->collisions   = htonll(-1);
+        }
     }
 }
 
@@ -1819,7 +3804,8 @@ static void port_stats_done(void *state)
 }
 
 static int
-queue_stats_init(const void *body, int body_len UNUSED, void **state)
+queue_stats_init(const struct sender *sender UNUSED, const void *body,
+                 int body_len UNUSED, void **state)
 {
     const struct ofp_queue_stats_request *qsr = body;
     struct queue_stats_state *s = xmalloc(sizeof *s);
@@ -1904,15 +3890,381 @@ queue_stats_done(void *state)
  * <...>                                  // Other stuff.
  * };
  */
+/* State for OFPST_VENDOR requests with OPENFLOW_VENDOR_ID. */
+struct ext_stats_state {
+    uint32_t vendor;            /* OPENFLOW_VENDOR_ID. */
+    uint32_t subtype;           /* One of OFP_EXT_STATS_*. */
+
+    /* OFP_EXT_STATS_FLOW_DELTA only. */
+    uint64_t generation;        /* Time at which the dump started. */
+    struct flow_stats_state flows;
+
+    /* OFP_EXT_STATS_FLOW_EXPORT only. */
+    struct snapshot_position export;
+
+    /* OFP_EXT_STATS_COOKIE_FLOW only. */
+    struct ofp_ext_cookie_flow_request cookie_rq;
+    size_t cookie_pos;          /* Selected flows already reported. */
+
+    /* OFP_EXT_STATS_TOP_FLOWS only. */
+    struct ofp_ext_top_flows_request top_rq;
+
+    /* OFP_EXT_STATS_TRACE only. */
+    struct ofp_match trace_match;
+    struct ofpbuf *trace_packet; /* Null to trace 'trace_match' instead. */
+
+    /* OFP_EXT_STATS_PORT_DROPS only. */
+    uint16_t drops_port_no;     /* Port to report, or OFPP_NONE for all. */
+};
+
+/* Flow exports are bulk transfers, so pack more into each reply than
+ * MAX_FLOW_STATS_BYTES. */
+#define MAX_FLOW_EXPORT_BYTES 32768
+
+static int
+ext_stats_init(const void *body, int body_len, void **state)
+{
+    const struct ofp_extension_stats_header *esh = body;
+    const struct ofp_ext_flow_delta_request *fdr = body;
+    struct ext_stats_state *s;
+
+    switch (ntohl(esh->subtype)) {
+    case OFP_EXT_STATS_BUFFER:
+    case OFP_EXT_STATS_LATENCY:
+    case OFP_EXT_STATS_FLOW_EXPORT:
+        break;
+    case OFP_EXT_STATS_FLOW_DELTA:
+        if (body_len < sizeof *fdr) {
+            return -EINVAL;
+        }
+        break;
+    case OFP_EXT_STATS_COOKIE_FLOW:
+        if (body_len < sizeof(struct ofp_ext_cookie_flow_request)) {
+            return -EINVAL;
+        }
+        break;
+    case OFP_EXT_STATS_TOP_FLOWS:
+        if (body_len < sizeof(struct ofp_ext_top_flows_request)) {
+            return -EINVAL;
+        }
+        break;
+    case OFP_EXT_STATS_TRACE:
+        if (body_len < sizeof(struct ofp_ext_trace_request)) {
+            return -EINVAL;
+        }
+        break;
+    case OFP_EXT_STATS_PORT_DROPS:
+        if (body_len < sizeof(struct ofp_ext_port_drops_request)) {
+            return -EINVAL;
+        }
+        break;
+    default:
+        return -EINVAL;
+    }
+
+    s = malloc(sizeof *s);
+    if (!s) {
+        return -ENOMEM;
+    }
+    s->vendor = OPENFLOW_VENDOR_ID;
+    s->subtype = ntohl(esh->subtype);
+    if (s->subtype == OFP_EXT_STATS_FLOW_DELTA) {
+        /* flow_used() stamps a flow with the same cached time that we read
+         * here, so a flow that counts a packet after we pass it in this
+         * dump is stamped no earlier than 'generation' and appears in the
+         * next one. */
+        s->generation = time_msec();
+        init_flow_stats_state(&s->flows, 0, &fdr->flows,
+                              ntohll(fdr->since));
+    }
+    memset(&s->export, 0, sizeof s->export);
+    if (s->subtype == OFP_EXT_STATS_COOKIE_FLOW) {
+        memcpy(&s->cookie_rq, body, sizeof s->cookie_rq);
+    }
+    s->cookie_pos = 0;
+    if (s->subtype == OFP_EXT_STATS_TOP_FLOWS) {
+        memcpy(&s->top_rq, body, sizeof s->top_rq);
+    }
+    s->trace_packet = NULL;
+    if (s->subtype == OFP_EXT_STATS_TRACE) {
+        const struct ofp_ext_trace_request *req = body;
+
+        s->trace_match = req->match;
+        if (body_len > sizeof *req) {
+            s->trace_packet = ofpbuf_clone_data(req->data,
+                                                body_len - sizeof *req);
+        }
+    }
+    if (s->subtype == OFP_EXT_STATS_PORT_DROPS) {
+        const struct ofp_ext_port_drops_request *req = body;
+
+        s->drops_port_no = ntohs(req->port_no);
+    }
+    *state = s;
+    return 0;
+}
+
+/* Returns the table_id that flow stats report for 'flow'. */
+static int
+flow_table_id(const struct sw_chain *chain, const struct sw_flow *flow)
+{
+    int i;
+
+    for (i = 0; i < chain->n_tables; i++) {
+        if (chain->tables[i] == flow->table) {
+            return i;
+        }
+    }
+    return EMERG_TABLE_ID_FOR_STATS;
+}
+
+/* Appends to 'buffer' the stats for the flows selected by 's''s
+ * OFP_EXT_STATS_COOKIE_FLOW request, resuming after those reported by
+ * earlier calls.  Returns true if there are more to report. */
+static bool
+cookie_flow_stats_dump(struct datapath *dp, struct ext_stats_state *s,
+                       struct ofpbuf *buffer)
+{
+    const struct ofp_ext_cookie_flow_request *rq = &s->cookie_rq;
+    uint64_t now = time_msec();
+    struct sw_flow **flows;
+    size_t n_flows;
+    bool more = false;
+
+    n_flows = chain_find_cookie(dp->chain, ntohll(rq->cookie),
+                                ntohll(rq->cookie_mask), &flows);
+    while (s->cookie_pos < n_flows) {
+        struct sw_flow *flow = flows[s->cookie_pos++];
+
+        if (flow_has_out_port(flow, rq->out_port)) {
+            fill_flow_stats(buffer, flow, flow_table_id(dp->chain, flow),
+                            now);
+            if (buffer->size >= MAX_FLOW_STATS_BYTES) {
+                more = s->cookie_pos < n_flows;
+                break;
+            }
+        }
+    }
+    free(flows);
+    return more;
+}
+
+/* Appends to 'buffer' the reply to 's''s OFP_EXT_STATS_TRACE request. */
+static void
+trace_stats_dump(struct datapath *dp, struct ext_stats_state *s,
+                 struct ofpbuf *buffer)
+{
+    struct ofp_ext_trace_reply *reply;
+    struct chain_trace trace;
+    struct sw_flow_key key;
+    size_t i;
+
+    if (s->trace_packet) {
+        key.wildcards = 0;
+        flow_extract(s->trace_packet, ntohs(s->trace_match.in_port),
+                     &key.flow);
+    } else {
+        struct ofp_match match = s->trace_match;
+
+        match.wildcards = htonl(0);
+        flow_extract_match(&key, &match);
+    }
+    chain_trace(dp->chain, &key, &trace);
+
+    reply = ofpbuf_put_zeros(buffer, sizeof *reply);
+    reply->header.vendor = htonl(OPENFLOW_VENDOR_ID);
+    reply->header.subtype = htonl(OFP_EXT_STATS_TRACE);
+    reply->table_id = 0xff;
+    reply->cached = trace.cached;
+    reply->n_tables = trace.n_steps;
+    flow_fill_match(&reply->key, &key.flow, 0);
+    if (trace.flow) {
+        struct sw_flow *flow = trace.flow;
+
+        reply->table_id = (trace.table_idx < 0 ? EMERG_TABLE_ID_FOR_STATS
+                           : trace.table_idx);
+        reply->priority = htons(flow->priority);
+        reply->cookie = htonll(flow->cookie);
+        flow_fill_match(&reply->match, &flow->key.flow, flow->key.wildcards);
+    }
+
+    for (i = 0; i < trace.n_steps; i++) {
+        const struct chain_trace_step *step = &trace.steps[i];
+        struct sw_table *t = (step->table_idx < 0 ? dp->chain->emerg_table
+                              : dp->chain->tables[step->table_idx]);
+        struct ofp_ext_trace_table *ott;
+        struct sw_table_stats stats;
+
+        t->stats(t, &stats);
+        ott = ofpbuf_put_zeros(buffer, sizeof *ott);
+        ott->table_id = (step->table_idx < 0 ? EMERG_TABLE_ID_FOR_STATS
+                         : step->table_idx);
+        ott->matched = step->matched;
+        ott->n_compares = htonl(step->n_compares == UINT_MAX ? UINT32_MAX
+                                : step->n_compares);
+        strncpy(ott->name, stats.name, sizeof ott->name - 1);
+    }
+
+    if (trace.flow) {
+        const struct sw_flow_actions *sf_acts = trace.flow->sf_acts;
+
+        ofpbuf_put(buffer, sf_acts->actions, sf_acts->actions_len);
+    }
+}
+
+/* Appends to 'buffer' an entry reporting 'drops', the counters for the port
+ * numbered 'port_no'. */
+static void
+put_port_drops(struct ofpbuf *buffer, uint16_t port_no,
+               const unsigned long long int drops[OFP_EXT_DROP_N_REASONS])
+{
+    struct ofp_ext_port_drops *opd;
+    int i;
+
+    opd = ofpbuf_put_zeros(buffer, (sizeof *opd
+                                    + OFP_EXT_DROP_N_REASONS * sizeof(uint64_t)));
+    opd->port_no = htons(port_no);
+    opd->length = htons(sizeof *opd
+                        + OFP_EXT_DROP_N_REASONS * sizeof(uint64_t));
+    for (i = 0; i < OFP_EXT_DROP_N_REASONS; i++) {
+        opd->drops[i] = htonll(drops[i]);
+    }
+}
+
+static void
+put_sw_port_drops(struct ofpbuf *buffer, const struct sw_port *p)
+{
+    unsigned long long int drops[OFP_EXT_DROP_N_REASONS];
+
+    memcpy(drops, p->drops, sizeof drops);
+    drops[OFP_EXT_DROP_TX] = port_tx_dropped(p);
+    put_port_drops(buffer, p->port_no, drops);
+}
+
+/* Appends to 'buffer' the reply to 's''s OFP_EXT_STATS_PORT_DROPS request:
+ * one entry per port, and for a request for all ports, one more for the
+ * drops that no port is to blame for. */
+static void
+port_drops_stats_dump(struct datapath *dp, struct ext_stats_state *s,
+                      struct ofpbuf *buffer)
+{
+    struct ofp_ext_port_drops_reply *reply;
+    struct sw_port *p;
+
+    reply = ofpbuf_put_zeros(buffer, sizeof *reply);
+    reply->header.vendor = htonl(OPENFLOW_VENDOR_ID);
+    reply->header.subtype = htonl(OFP_EXT_STATS_PORT_DROPS);
+
+    if (s->drops_port_no == OFPP_NONE) {
+        int i;
+
+        for (i = 0; i < DP_MAX_PORTS; i++) {
+            p = dp_lookup_port(dp, i);
+            if (PORT_IN_USE(p)) {
+                put_sw_port_drops(buffer, p);
+            }
+        }
+        if (dp->local_port) {
+            put_sw_port_drops(buffer, dp->local_port);
+        }
+        put_port_drops(buffer, OFPP_NONE, dp->drops);
+    } else {
+        p = dp_lookup_port(dp, s->drops_port_no);
+        if (PORT_IN_USE(p)) {
+            put_sw_port_drops(buffer, p);
+        }
+    }
+}
+
+static int
+ext_stats_dump(struct datapath *dp, struct ext_stats_state *s,
+               struct ofpbuf *buffer)
+{
+    switch (s->subtype) {
+    case OFP_EXT_STATS_BUFFER: {
+        struct ofp_ext_buffer_stats *obs;
+        struct pktbuf_stats stats;
+
+        pktbuf_get_stats(dp->pktbuf, &stats);
+        obs = ofpbuf_put_zeros(buffer, sizeof *obs);
+        obs->header.vendor = htonl(OPENFLOW_VENDOR_ID);
+        obs->header.subtype = htonl(OFP_EXT_STATS_BUFFER);
+        obs->n_buffers = htonl(stats.n_buffers);
+        obs->n_used = htonl(stats.n_used);
+        obs->n_saved = htonll(stats.n_saved);
+        obs->n_evicted = htonll(stats.n_evicted);
+        obs->n_full = htonll(stats.n_full);
+        break;
+    }
+
+    case OFP_EXT_STATS_FLOW_DELTA: {
+        struct ofp_ext_flow_delta_reply *fdr;
+
+        fdr = ofpbuf_put_zeros(buffer, sizeof *fdr);
+        fdr->header.vendor = htonl(OPENFLOW_VENDOR_ID);
+        fdr->header.subtype = htonl(OFP_EXT_STATS_FLOW_DELTA);
+        fdr->generation = htonll(s->generation);
+        return flow_stats_dump(dp, &s->flows, buffer);
+    }
+
+    case OFP_EXT_STATS_LATENCY:
+        latency_put_stats(&dp->latency, buffer);
+        break;
+
+    case OFP_EXT_STATS_FLOW_EXPORT: {
+        struct ofp_ext_flow_export *ofe;
+
+        ofe = ofpbuf_put_zeros(buffer, sizeof *ofe);
+        ofe->header.vendor = htonl(OPENFLOW_VENDOR_ID);
+        ofe->header.subtype = htonl(OFP_EXT_STATS_FLOW_EXPORT);
+        return snapshot_export(dp, &s->export, buffer,
+                               MAX_FLOW_EXPORT_BYTES);
+    }
+
+    case OFP_EXT_STATS_COOKIE_FLOW: {
+        struct ofp_ext_cookie_flow_reply *ocr;
+
+        ocr = ofpbuf_put_zeros(buffer, sizeof *ocr);
+        ocr->header.vendor = htonl(OPENFLOW_VENDOR_ID);
+        ocr->header.subtype = htonl(OFP_EXT_STATS_COOKIE_FLOW);
+        return cookie_flow_stats_dump(dp, s, buffer);
+    }
+
+    case OFP_EXT_STATS_TOP_FLOWS:
+        topk_put_report(dp->topk, s->top_rq.by, ntohs(s->top_rq.n_flows),
+                        buffer);
+        break;
+
+    case OFP_EXT_STATS_TRACE:
+        trace_stats_dump(dp, s, buffer);
+        break;
+
+    case OFP_EXT_STATS_PORT_DROPS:
+        port_drops_stats_dump(dp, s, buffer);
+        break;
+    }
+    return 0;
+}
+
+static void
+ext_stats_done(struct ext_stats_state *s)
+{
+    ofpbuf_delete(s->trace_packet);
+    free(s);
+}
+
 static int
-vendor_stats_init(const void *body, int body_len UNUSED,
-                  void **state UNUSED)
+vendor_stats_init(const struct sender *sender UNUSED, const void *body,
+                  int body_len, void **state)
 {
         /* min_body was checked, this should be safe */
         const uint32_t vendor = ntohl(*((uint32_t *)body));
         int err;
 
         switch (vendor) {
+        case OPENFLOW_VENDOR_ID:
+                err = ext_stats_init(body, body_len, state);
+                break;
         default:
                 err = -EINVAL;
         }
@@ -1921,13 +4273,16 @@ vendor_stats_init(const void *body, int body_len UNUSED,
 }
 
 static int
-vendor_stats_dump(struct datapath *dp UNUSED, void *state,
-                  struct ofpbuf *buffer UNUSED)
+vendor_stats_dump(struct datapath *dp, void *state,
+                  struct ofpbuf *buffer)
 {
         const uint32_t vendor = *((uint32_t *)state);
         int err;
 
         switch (vendor) {
+        case OPENFLOW_VENDOR_ID:
+                err = ext_stats_dump(dp, state, buffer);
+                break;
         default:
                 /* Should never happen */
                 err = 0;
@@ -1942,6 +4297,9 @@ vendor_stats_done(void *state)
         const uint32_t vendor = *((uint32_t *) state);
 
         switch (vendor) {
+        case OPENFLOW_VENDOR_ID:
+                ext_stats_done(state);
+                break;
         default:
                 /* Should never happen */
                 free(state);
@@ -1958,12 +4316,14 @@ struct stats_type {
      * struct ofp_stats_request. */
     size_t min_body, max_body;
 
-    /* Prepares to dump some kind of datapath statistics.  'body' and
-     * 'body_len' are the 'body' member of the struct ofp_stats_request.
+    /* Prepares to dump some kind of datapath statistics for 'sender'.
+     * 'body' and 'body_len' are the 'body' member of the struct
+     * ofp_stats_request.
      * Returns zero if successful, otherwise a negative error code.
      * May initialize '*state' to state information.  May be null if no
      * initialization is required.*/
-    int (*init)(const void *body, int body_len, void **state);
+    int (*init)(const struct sender *, const void *body, int body_len,
+                void **state);
 
     /* Appends statistics for 'dp' to 'buffer', which initially contains a
      * struct ofp_stats_reply.  On success, it should return 1 if it should be
@@ -2028,7 +4388,7 @@ static const struct stats_type stats[] = {
     {
         OFPST_VENDOR,
         8,             /* vendor + subtype */
-        32,            /* whatever */
+        UINT16_MAX,    /* struct ofp_ext_trace_request with a packet */
         vendor_stats_init,
         vendor_stats_dump,
         vendor_stats_done
@@ -2120,6 +4480,7 @@ recv_stats_request(struct datapath *dp UNUSED, const struct sender *sender,
     cb->done = false;
     cb->rq = xmemdup(rq, rq_len);
     cb->sender = *sender;
+    cb->sender.buffer = NULL;
     cb->s = st;
     cb->state = NULL;
 
@@ -2132,7 +4493,7 @@ recv_stats_request(struct datapath *dp UNUSED, const struct sender *sender,
     }
 
     if (cb->s->init) {
-        err = cb->s->init(rq->body, body_len, &cb->state);
+        err = cb->s->init(sender, rq->body, body_len, &cb->state);
         if (err) {
             VLOG_WARN_RL(&rl,
                          "failed initialization of stats request type %d: %s",
@@ -2205,6 +4566,314 @@ recv_queue_get_config_request(struct datapath *dp, const struct sender *sender,
     return 0;
 }
 
+/* Appends the status line formatted from 'format' to 'output', prefixed by
+ * 'category' and a period, if it begins with the 'request_len' bytes in
+ * 'request', as secchan's status_reply_put() does. */
+static void PRINTF_FORMAT(5, 6)
+status_put(struct ds *output, const char *request, size_t request_len,
+           const char *category, const char *format, ...)
+{
+    size_t old_length = output->length;
+    va_list args;
+
+    ds_put_format(output, "%s.", category);
+    va_start(args, format);
+    ds_put_format_valist(output, format, args);
+    va_end(args);
+    ds_put_char(output, '\n');
+
+    if (output->length - old_length < request_len
+        || memcmp(&output->string[old_length], request, request_len)) {
+        ds_truncate(output, old_length);
+    }
+}
+
+/* Reports, under "setup", each remote's histogram of new-flow setup times
+ * and the packets that were buffered for the controller but never
+ * claimed.  Histogram buckets are listed as "LIMIT:COUNT", where COUNT
+ * setups took less than LIMIT microseconds. */
+static void
+setup_status(struct datapath *dp, struct ds *output,
+             const char *request, size_t request_len)
+{
+    uint64_t ticks_per_sec = latency_ticks_per_sec(&dp->latency);
+    double usec_per_tick = ticks_per_sec ? 1e6 / ticks_per_sec : 0;
+    struct pktbuf_stats stats;
+    struct remote *r;
+    int i;
+
+    pktbuf_get_stats(dp->pktbuf, &stats);
+    status_put(output, request, request_len, "setup",
+               "orphaned-buffers=%"PRIu64, stats.n_evicted);
+    if (dp->pending_misses) {
+        const struct pending_misses *pm = dp->pending_misses;
+
+        status_put(output, request, request_len, "setup",
+                   "held-misses=%llu", pm->n_held);
+        status_put(output, request, request_len, "setup",
+                   "held-misses-answered=%llu", pm->n_answered);
+        status_put(output, request, request_len, "setup",
+                   "held-misses-expired=%llu", pm->n_expired);
+    }
+    if (dp->adaptive_miss_len) {
+        status_put(output, request, request_len, "setup",
+                   "shrunk-misses=%llu", dp->n_pin_shrunk);
+    }
+
+    i = 0;
+    LIST_FOR_EACH (r, struct remote, node, &dp->remotes) {
+        const struct latency_hist *h = &r->setup_latency;
+        struct ds hist;
+        int j;
+
+        ds_init(&hist);
+        for (j = 0; j < OFP_EXT_LATENCY_BUCKETS; j++) {
+            if (h->buckets[j]) {
+                ds_put_format(&hist, "%s%.3g:%"PRIu64, hist.length ? " " : "",
+                              (UINT64_C(1) << j) * usec_per_tick,
+                              h->buckets[j]);
+            }
+        }
+
+        status_put(output, request, request_len, "setup",
+                   "remote%d.name=%s", i, rconn_get_name(r->rconn));
+        status_put(output, request, request_len, "setup",
+                   "remote%d.samples=%"PRIu64, i, h->n_samples);
+        status_put(output, request, request_len, "setup",
+                   "remote%d.mean-usec=%.1f", i, h->n_samples
+                   ? h->total_ticks * usec_per_tick / h->n_samples : 0.0);
+        status_put(output, request, request_len, "setup",
+                   "remote%d.histogram-usec=%s", i, ds_cstr(&hist));
+        status_put(output, request, request_len, "setup",
+                   "remote%d.stale-buffers=%llu", i, r->n_stale_buffers);
+        if (r->pin_fd >= 0) {
+            status_put(output, request, request_len, "setup",
+                       "remote%d.udp-packet-ins-sent=%llu", i,
+                       r->n_pin_sent);
+            status_put(output, request, request_len, "setup",
+                       "remote%d.udp-packet-ins-dropped=%llu", i,
+                       r->n_pin_dropped);
+        }
+        ds_destroy(&hist);
+        i++;
+    }
+}
+
+/* Appends to 'output' the "port" status category: the traffic counters of
+ * each port, keyed by port number, and of each of its queues, keyed by queue
+ * ID. */
+static void
+port_status(struct datapath *dp, struct ds *output,
+            const char *request, size_t request_len)
+{
+    struct sw_port *p;
+
+    LIST_FOR_EACH (p, struct sw_port, node, &dp->port_list) {
+        struct sw_queue *q;
+
+        status_put(output, request, request_len, "port",
+                   "%"PRIu16".name=%s", p->port_no, p->hw_name);
+        status_put(output, request, request_len, "port",
+                   "%"PRIu16".rx-packets=%llu", p->port_no, p->rx_packets);
+        status_put(output, request, request_len, "port",
+                   "%"PRIu16".tx-packets=%llu", p->port_no, p->tx_packets);
+        status_put(output, request, request_len, "port",
+                   "%"PRIu16".rx-bytes=%llu", p->port_no, p->rx_bytes);
+        status_put(output, request, request_len, "port",
+                   "%"PRIu16".tx-bytes=%llu", p->port_no, p->tx_bytes);
+        status_put(output, request, request_len, "port",
+                   "%"PRIu16".tx-dropped=%llu", p->port_no,
+                   port_tx_dropped(p));
+        status_put(output, request, request_len, "port",
+                   "%"PRIu16".miss-queued=%u", p->port_no, p->n_misses);
+        status_put(output, request, request_len, "port",
+                   "%"PRIu16".miss-dropped=%llu", p->port_no,
+                   p->drops[OFP_EXT_DROP_MISS_QUEUE]);
+        LIST_FOR_EACH (q, struct sw_queue, node, &p->queue_list) {
+            status_put(output, request, request_len, "port",
+                       "%"PRIu16".queue%"PRIu32".tx-packets=%llu",
+                       p->port_no, q->queue_id, q->tx_packets);
+            status_put(output, request, request_len, "port",
+                       "%"PRIu16".queue%"PRIu32".tx-bytes=%llu",
+                       p->port_no, q->queue_id, q->tx_bytes);
+            status_put(output, request, request_len, "port",
+                       "%"PRIu16".queue%"PRIu32".tx-errors=%llu",
+                       p->port_no, q->queue_id, q->tx_errors);
+        }
+    }
+}
+
+/* Appends to 'output' the "table" status category: the same counters as
+ * the OFPST_TABLE reply, keyed by table index, with the microflow cache
+ * last.  Hash tables add occupancy, insert failures and collisions for each
+ * of their hash functions. */
+static void
+table_status(struct datapath *dp, struct ds *output,
+             const char *request, size_t request_len)
+{
+    struct sw_table_stats stats;
+    int i, j;
+
+    for (i = 0; i <= dp->chain->n_tables; i++) {
+        memset(&stats, 0, sizeof stats);
+        if (i < dp->chain->n_tables) {
+            dp->chain->tables[i]->stats(dp->chain->tables[i], &stats);
+        } else {
+            chain_cache_stats(dp->chain, &stats);
+        }
+        status_put(output, request, request_len, "table",
+                   "%d.name=%s", i, stats.name ? stats.name : "");
+        status_put(output, request, request_len, "table",
+                   "%d.active=%u", i, stats.n_flows);
+        status_put(output, request, request_len, "table",
+                   "%d.lookup=%lu", i, stats.n_lookup);
+        status_put(output, request, request_len, "table",
+                   "%d.matched=%lu", i, stats.n_matched);
+        status_put(output, request, request_len, "table",
+                   "%d.max=%u", i, stats.max_flows);
+        if (stats.capacity) {
+            status_put(output, request, request_len, "table",
+                       "%d.capacity=%u", i, stats.capacity);
+        }
+        status_put(output, request, request_len, "table",
+                   "%d.insert-failed=%lu", i, stats.n_insert_failed);
+        if (i < dp->chain->n_tables) {
+            status_put(output, request, request_len, "table",
+                       "%d.evicted=%lu", i, dp->chain->n_evicted[i]);
+        }
+        for (j = 0; j < stats.n_hashes; j++) {
+            const struct sw_hash_stats *h = &stats.hashes[j];
+
+            status_put(output, request, request_len, "table",
+                       "%d.hash%d.active=%u", i, j, h->n_flows);
+            status_put(output, request, request_len, "table",
+                       "%d.hash%d.max=%u", i, j, h->max_flows);
+            if (h->n_buckets) {
+                status_put(output, request, request_len, "table",
+                           "%d.hash%d.buckets=%u", i, j, h->n_buckets);
+            }
+            status_put(output, request, request_len, "table",
+                       "%d.hash%d.insert-failed=%lu",
+                       i, j, h->n_insert_failed);
+            status_put(output, request, request_len, "table",
+                       "%d.hash%d.collisions=%lu", i, j, h->n_collisions);
+        }
+    }
+
+    for (i = 0; i < OFP_EXT_PIPELINE_TABLES; i++) {
+        static const char *const misses[] = {
+            [OFP_EXT_MISS_CONTROLLER] = "controller",
+            [OFP_EXT_MISS_CONTINUE] = "continue",
+            [OFP_EXT_MISS_DROP] = "drop",
+        };
+        const struct sw_chain *chain = pipeline_chain(dp, i);
+
+        if (chain) {
+            status_put(output, request, request_len, "pipeline",
+                       "%d.flows=%u", i, chain_n_flows(chain));
+            status_put(output, request, request_len, "pipeline",
+                       "%d.miss=%s", i, misses[dp->table_miss[i]]);
+        }
+    }
+}
+
+static void
+put_slab_status(struct ds *output, const char *request, size_t request_len,
+                const char *name, const struct slab_stats *s)
+{
+    status_put(output, request, request_len, "alloc",
+               "%s.size=%zu", name, s->obj_size);
+    status_put(output, request, request_len, "alloc",
+               "%s.used=%zu", name, s->n_used);
+    status_put(output, request, request_len, "alloc",
+               "%s.free=%zu", name, s->n_free);
+    status_put(output, request, request_len, "alloc",
+               "%s.bytes=%zu", name, s->n_bytes);
+    status_put(output, request, request_len, "alloc",
+               "%s.allocs=%llu", name, s->n_allocs);
+}
+
+/* Reports the memory held by the slabs that flows and their actions come
+ * from, along with the action program cache and the policers. */
+static void
+alloc_status(struct ds *output, const char *request, size_t request_len)
+{
+    struct flow_mem_stats stats;
+    struct act_cache_stats acs;
+    struct policer_stats ps;
+    int i;
+
+    flow_get_mem_stats(&stats);
+    put_slab_status(output, request, request_len, "flow", &stats.flows);
+    for (i = 0; i < FLOW_ACTS_CLASSES; i++) {
+        char name[16];
+
+        snprintf(name, sizeof name, "acts%zu", stats.acts[i].obj_size);
+        put_slab_status(output, request, request_len, name, &stats.acts[i]);
+    }
+    status_put(output, request, request_len, "alloc",
+               "acts.inline=%zu", stats.n_inline_acts);
+    status_put(output, request, request_len, "alloc",
+               "acts.large=%zu", stats.n_large_acts);
+
+    act_cache_get_stats(&acs);
+    status_put(output, request, request_len, "alloc",
+               "acts.progs=%zu", acs.n_progs);
+    status_put(output, request, request_len, "alloc",
+               "acts.progs_idle=%zu", acs.n_idle);
+    status_put(output, request, request_len, "alloc",
+               "acts.validate_hits=%llu", acs.n_hits);
+    status_put(output, request, request_len, "alloc",
+               "acts.validate_misses=%llu", acs.n_misses);
+
+    policer_get_stats(&ps);
+    status_put(output, request, request_len, "alloc",
+               "acts.policers=%zu", ps.n_policers);
+    status_put(output, request, request_len, "alloc",
+               "acts.policed=%llu", ps.n_passed);
+    status_put(output, request, request_len, "alloc",
+               "acts.police_exceeded=%llu", ps.n_exceeded);
+}
+
+/* Appends to 'output' each of the datapath's status categories that matches
+ * the 'request_len' bytes in 'request', which may be empty to select them
+ * all. */
+static void
+dp_status(struct datapath *dp, struct ds *output,
+          const char *request, size_t request_len)
+{
+    port_status(dp, output, request, request_len);
+    table_status(dp, output, request, request_len);
+    alloc_status(output, request, request_len);
+    setup_status(dp, output, request, request_len);
+}
+
+/* Answers a Nicira status request, which "dpctl status" sends, with the
+ * datapath's own categories.  When the request passes through secchan,
+ * secchan answers it instead. */
+static int
+recv_status_request(struct datapath *dp, const struct sender *sender,
+                    const void *oh)
+{
+    const struct nicira_header *request = oh;
+    const char *request_string = (const char *) (request + 1);
+    size_t request_len = ntohs(request->header.length) - sizeof *request;
+    struct nicira_header *reply;
+    struct ofpbuf *buffer;
+    struct ds output;
+
+    ds_init(&output);
+    dp_status(dp, &output, request_string, request_len);
+
+    reply = make_openflow_reply(sizeof *reply + output.length, OFPT_VENDOR,
+                                sender, &buffer);
+    reply->vendor = htonl(NX_VENDOR_ID);
+    reply->subtype = htonl(NXT_STATUS_REPLY);
+    memcpy(reply + 1, output.string, output.length);
+    ds_destroy(&output);
+    return send_openflow_buffer(dp, buffer, sender);
+}
+
 static int
 recv_vendor(struct datapath *dp, const struct sender *sender,
                   const void *oh)
@@ -2216,6 +4885,17 @@ recv_vendor(struct datapath *dp, const struct sender *sender,
     case PRIVATE_VENDOR_ID:
         return private_recv_msg(dp, sender, oh);
 
+    case NX_VENDOR_ID: {
+        const struct nicira_header *nh = oh;
+        if (ntohs(ovh->header.length) >= sizeof *nh
+            && nh->subtype == htonl(NXT_STATUS_REQUEST)) {
+            return recv_status_request(dp, sender, oh);
+        }
+        dp_send_error_msg(dp, sender, OFPET_BAD_REQUEST,
+                          OFPBRC_BAD_SUBTYPE, oh, ntohs(ovh->header.length));
+        return -EINVAL;
+    }
+
     case OPENFLOW_VENDOR_ID:
         return of_ext_recv_msg(dp, sender, oh);
 
@@ -2236,6 +4916,9 @@ fwd_control_input(struct datapath *dp, const struct sender *sender,
     int (*handler)(struct datapath *, const struct sender *, const void *);
     struct ofp_header *oh;
     size_t min_size;
+    uint64_t start;
+    uint8_t type;
+    int error;
 
     /* Check encapsulated length. */
     oh = (struct ofp_header *) msg;
@@ -2300,76 +4983,35 @@ fwd_control_input(struct datapath *dp, const struct sender *sender,
         return -EINVAL;
     }
 
-    /* Handle it. */
+    /* Handle it.  The handler may overwrite 'msg' (see recv_packet_out()),
+     * so note its type first. */
     if (length < min_size)
         return -EFAULT;
-    return handler(dp, sender, msg);
-}
-
-/* Packet buffering. */
-
-#define OVERWRITE_SECS  1
-
-struct packet_buffer {
-    struct ofpbuf *buffer;
-    uint32_t cookie;
-    time_t timeout;
-};
-
-static struct packet_buffer buffers[N_PKT_BUFFERS];
-static unsigned int buffer_idx;
-
-uint32_t save_buffer(struct ofpbuf *buffer)
-{
-    struct packet_buffer *p;
-    uint32_t id;
-
-    buffer_idx = (buffer_idx + 1) & PKT_BUFFER_MASK;
-    p = &buffers[buffer_idx];
-    if (p->buffer) {
-        /* Don't buffer packet if existing entry is less than
-         * OVERWRITE_SECS old. */
-        if (time_now() < p->timeout) { /* FIXME */
-                return (uint32_t)-1;
-        } else {
-            ofpbuf_delete(p->buffer);
-        }
-    }
-    /* Don't use maximum cookie value since the all-bits-1 id is
-     * special. */
-    if (++p->cookie >= (1u << PKT_COOKIE_BITS) - 1)
-        p->cookie = 0;
-    p->buffer = ofpbuf_clone(buffer);      /* FIXME */
-    p->timeout = time_now() + OVERWRITE_SECS; /* FIXME */
-    id = buffer_idx | (p->cookie << PKT_BUFFER_BITS);
-
-    return id;
-}
-
-static struct ofpbuf *retrieve_buffer(uint32_t id)
-{
-    struct ofpbuf *buffer = NULL;
-    struct packet_buffer *p;
-
-    p = &buffers[id & PKT_BUFFER_MASK];
-    if (p->cookie == id >> PKT_BUFFER_BITS) {
-        buffer = p->buffer;
-        p->buffer = NULL;
-    } else {
-        printf("cookie mismatch: %x != %x\n",
-               id >> PKT_BUFFER_BITS, p->cookie);
-    }
-
-    return buffer;
+    type = oh->type;
+    start = ofpstat_proc_now();
+    error = handler(dp, sender, msg);
+    ofpstat_proc_record(&dp->proc_stats, type, start);
+    return error;
 }
 
-static void discard_buffer(uint32_t id)
+/* Sends 'dp''s message processing statistics to 'sender' in reply to a
+ * PRIVATEOPT_PROCESSING_STATS_REQUEST. */
+int
+dp_send_processing_stats(struct datapath *dp, const struct sender *sender)
 {
-    struct packet_buffer *p;
+    struct private_vxhdr *vxhdr;
+    struct private_vxopt *vxopt;
+    struct ofpbuf *buffer;
 
-    p = &buffers[id & PKT_BUFFER_MASK];
-    if (p->cookie == id >> PKT_BUFFER_BITS) {
-        ofpbuf_delete(p->buffer);
-        p->buffer = NULL;
-    }
+    vxhdr = make_openflow_reply(sizeof *vxhdr + sizeof *vxopt
+                                + sizeof(struct private_proc_stats),
+                                OFPT_VENDOR, sender, &buffer);
+    vxhdr->ofp_vxid = htonl(PRIVATE_VENDOR_ID);
+    vxopt = (struct private_vxopt *) (vxhdr + 1);
+    vxopt->pvo_type = htons(PRIVATEOPT_PROCESSING_STATS_REPLY);
+    vxopt->pvo_len = htons(sizeof(struct private_proc_stats));
+    ofpstat_proc_to_net(&dp->proc_stats,
+                        (struct private_proc_stats *) (vxopt + 1));
+    return send_openflow_buffer(dp, buffer, sender);
 }
+
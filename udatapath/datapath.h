@@ -39,20 +39,34 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include "openflow/nicira-ext.h"
+#include "latency.h"
 #include "ofpbuf.h"
 #include "timeval.h"
 #include "list.h"
 #include "netdev.h"
+#include "ofpstat.h"
 
 /* FIXME:  Can declare struct of_hw_driver instead */
 #if defined(OF_HW_PLAT)
 #include <openflow/of_hw_api.h>
 #endif
 
+struct mac_learning;
+struct ofp_ext_packet_out_batch;
+struct pending_misses;
 struct rconn;
+struct pktbuf;
 struct pvconn;
+struct sampler;
+struct shaper;
 struct sw_flow;
+struct sw_flow_key;
 struct sender;
+struct topk;
+
+/* Size of sw_port's queue_id index: a power of 2, at least twice
+ * NETDEV_MAX_QUEUES so that probe sequences stay short. */
+#define DP_QUEUE_INDEX_SIZE 16
 
 struct sw_queue {
     struct list node; /* element in port.queues */
@@ -71,6 +85,7 @@ struct sw_queue {
 enum sw_port_flags {
     SWP_USED             = 1 << 0,    /* Is port being used */
     SWP_HW_DRV_PORT      = 1 << 1,    /* Port controlled by HW driver */
+    SWP_RX_THREAD        = 1 << 2,    /* Port received on by rx-threads.c */
 };
 #if defined(OF_HW_PLAT) && !defined(USE_NETDEV)
 #define IS_HW_PORT(p) ((p)->flags & SWP_HW_DRV_PORT)
@@ -80,6 +95,13 @@ enum sw_port_flags {
 
 #define PORT_IN_USE(p) (((p) != NULL) && (p)->flags & SWP_USED)
 
+/* Token bucket that limits the packet_ins sent for one reason on behalf of
+ * one port, if the datapath has a 'pin_rate'. */
+struct pin_meter {
+    long long int last_fill;    /* Time at which tokens were last added. */
+    long long int tokens;       /* 1000 per packet_in. */
+};
+
 struct sw_port {
     uint32_t config;            /* Some subset of OFPPC_* flags. */
     uint32_t state;             /* Some subset of OFPPS_* flags. */
@@ -90,26 +112,81 @@ struct sw_port {
     struct list node; /* Element in datapath.ports. */
     unsigned long long int rx_packets, tx_packets;
     unsigned long long int rx_bytes, tx_bytes;
-    unsigned long long int tx_dropped;
+    unsigned long long int drops[OFP_EXT_DROP_N_REASONS]; /* By reason. */
     uint16_t port_no;
     /* port queues */
     uint16_t num_queues;
     struct sw_queue queues[NETDEV_MAX_QUEUES];
     struct list queue_list; /* list of all queues for this port */
-};
+    /* Open-addressed index from queue_id to class_id (offset in 'queues'),
+     * rebuilt by dp_index_queues() whenever the queue list changes.  A
+     * slot holding 0 is empty, since class_id 0 is never handed out. */
+    uint8_t queue_index[DP_QUEUE_INDEX_SIZE];
+    struct ofpbuf_pool *rx_pool; /* Receive buffers sized for 'netdev'. */
+    struct shaper *shaper;      /* Userspace queue shaper, if enabled. */
+    int sample_skip;            /* Packets to receive until next sample. */
 
-#if defined(OF_HW_PLAT)
-struct hw_pkt_q_entry {
-    struct ofpbuf *buffer;
-    struct hw_pkt_q_entry *next;
-    of_port_t port_no;
-    int reason;
+    /* Packets received on this port that missed in the flow table, waiting
+     * for dp_run()'s miss stage to send them to the controller.  A ring of
+     * DP_MISS_QUEUE_LEN entries, allocated on the first miss. */
+    struct dp_miss *misses;
+    unsigned int miss_head;     /* Index of the oldest entry in 'misses'. */
+    unsigned int n_misses;      /* Number of entries in 'misses'. */
+    struct list miss_node;      /* In datapath's 'miss_ports' while
+                                 * 'n_misses' is nonzero. */
+
+    /* Packet_in limits for packets received on this port, indexed by
+     * OFPR_NO_MATCH and OFPR_ACTION. */
+    struct pin_meter pin_meters[2];
+
+    /* Packets dropped on their way from a receive thread, protected by the
+     * receive threads' mutex until rx_threads_take() moves them into
+     * 'drops'. */
+    unsigned int rx_queue_dropped;
+
+    /* This port's description as last read from 'netdev', with 'config' and
+     * 'state' left to be filled in as each message is sent, since ethtool
+     * takes an ioctl per feature word.  Valid only if 'desc_valid', which
+     * dp_run() clears when the datapath's port monitor reports a change to
+     * the device. */
+    struct ofp_phy_port desc;
+    bool desc_valid;
 };
-#endif
 
 #define DP_MAX_PORTS 255
 BUILD_ASSERT_DECL(DP_MAX_PORTS <= OFPP_MAX);
 
+/* Receive buffers have some headroom to add headers in forwarding to the
+ * controller or adding a vlan tag, plus an extra 2 bytes to allow IP headers
+ * to be aligned on a 4-byte boundary.  Every buffer that actions run on,
+ * including packet_out data, is given this headroom, so that pushing a vlan
+ * tag never has to reallocate the packet. */
+#define DP_RX_HEADROOM (128 + 2)
+
+/* Maximum number of packets received from a port in one netdev_recv_batch()
+ * call. */
+#define DP_RX_BATCH 32
+BUILD_ASSERT_DECL(DP_RX_BATCH <= NETDEV_RECV_BATCH_MAX);
+
+/* Default budgets for one dp_run(): packets received from each port and
+ * OpenFlow messages processed from each remote.  Whichever of the two has
+ * work left over while the other does not has its budget multiplied by up
+ * to DP_MAX_WEIGHT on the following passes. */
+#define DP_DEFAULT_RX_BUDGET DP_RX_BATCH
+#define DP_DEFAULT_MSG_BUDGET 50
+#define DP_MAX_WEIGHT 4
+
+/* Number of packets that each port can have waiting for the miss stage, and
+ * the number of them that the miss stage sends to the controller per
+ * dp_run(), across all ports. */
+#define DP_MISS_QUEUE_LEN 64
+#define DP_MISS_BUDGET 64
+
+/* SO_BUSY_POLL time, in microseconds, for ports of a busy-polling datapath.
+ * Long enough to catch a packet that is already on its way through the
+ * driver, short enough not to hold up the other ports. */
+#define DP_BUSY_POLL_USECS 50
+
 struct datapath {
     /* Remote connections. */
     struct list remotes;        /* All connections (including controller). */
@@ -118,13 +195,19 @@ struct datapath {
     struct pvconn **listeners;
     size_t n_listeners;
 
-    time_t last_timeout;
-
     /* Unique identifier for this datapath */
     uint64_t  id;
     char dp_desc[DESC_STR_LEN];	/* human readible comment to ID this DP */
 
     struct sw_chain *chain;  /* Forwarding rules. */
+    char *tables;            /* Tables for chain_create(), or null. */
+
+    /* Pipeline tables, by OFP_EXT_PIPELINE_TABLES index.  Table 0 is
+     * 'chain', so pipeline[0] is unused; the others are created when a
+     * connection first addresses them. */
+    struct sw_chain *pipeline[OFP_EXT_PIPELINE_TABLES];
+    uint8_t table_miss[OFP_EXT_PIPELINE_TABLES]; /* OFP_EXT_MISS_*. */
+    struct pktbuf *pktbuf;   /* Packets buffered for the controller. */
 
     /* Configuration set from controller. */
     uint16_t flags;
@@ -134,6 +217,93 @@ struct datapath {
     struct sw_port ports[DP_MAX_PORTS];
     struct sw_port *local_port;  /* OFPP_LOCAL port, if any. */
     struct list port_list; /* All ports, including local_port. */
+    struct list pending_ports; /* Ports from dp_add_port_later() that are
+                                * not yet up. */
+    struct list miss_ports;    /* Ports with misses queued, in the order in
+                                * which the miss stage serves them. */
+    struct netdev_monitor *port_monitor; /* Watches the ports' devices, if
+                                          * possible, so port descriptions
+                                          * can be cached. */
+
+    /* The ports in 'port_list', as arrays for output to OFPP_ALL and
+     * OFPP_FLOOD, the latter without the ports with OFPPC_NO_FLOOD set.
+     * Rebuilt by update_flood_ports() whenever a port is added or its
+     * configuration changes. */
+    struct sw_port *all_ports[DP_MAX_PORTS + 1];
+    size_t n_all_ports;
+    struct sw_port *flood_ports[DP_MAX_PORTS + 1];
+    size_t n_flood_ports;
+
+    /* Receive buffers not yet handed to fwd_port_input(), kept across calls
+     * to dp_run() so that idle ports do not cost an allocation each time. */
+    struct ofpbuf *rx_batch[DP_RX_BATCH];
+
+    /* Receive threads, if enabled with rx_threads_start(). */
+    struct rx_threads *rx_threads;
+
+    /* Size of the TX ring to set up on new ports, or 0 to send packets with
+     * one system call each. */
+    unsigned int tx_ring_frames;
+
+    /* Size of the RX ring to set up on new ports, or 0 to receive packets
+     * with system calls.  An RX ring also supplies each packet's kernel flow
+     * hash, which indexes the microflow cache. */
+    unsigned int rx_ring_frames;
+
+    /* Per-pass budgets (see DP_DEFAULT_RX_BUDGET), and the current weight by
+     * which each is multiplied, between 1 and DP_MAX_WEIGHT. */
+    unsigned int rx_budget;     /* Packets per port. */
+    unsigned int msg_budget;    /* OpenFlow messages per remote. */
+    unsigned int rx_weight;
+    unsigned int msg_weight;
+
+    /* SO_BUSY_POLL time to set on new ports, in microseconds, or 0 to leave
+     * the kernel default. */
+    unsigned int busy_poll_usecs;
+
+    /* Shape new ports' queues in userspace (see shaper.h) instead of
+     * configuring kernel classes with tc? */
+    bool use_shaper;
+
+    /* Send flow expirations to each remote packed into OFP_EXT_BUNDLE
+     * messages, instead of one message each? */
+    bool bundle_flow_removed;
+
+    /* MAC learning table for the OFPP_NORMAL output action. */
+    struct mac_learning *ml;
+
+    /* Packet sampler, if enabled (see sampler.h). */
+    struct sampler *sampler;
+
+    /* Heaviest flows over a sliding window, if enabled (see topk.h). */
+    struct topk *topk;
+
+    /* Misses held behind a flow setup in progress, if enabled (see
+     * pending-miss.h). */
+    struct pending_misses *pending_misses;
+
+    /* Packet_ins per second that may be sent for each reason on behalf of
+     * each port, or 0 for no limit, and how many may be sent at once.
+     * Packet_ins for packets that no port received share 'pin_meters'. */
+    unsigned int pin_rate;
+    unsigned int pin_burst;
+    struct pin_meter pin_meters[2];
+
+    /* If true, packet_ins for table misses carry less of the packet, down to
+     * its headers, as the controllers' queues of asynchronous messages fill
+     * up.  'n_pin_shrunk' counts the packet_ins shortened this way. */
+    bool adaptive_miss_len;
+    unsigned long long int n_pin_shrunk;
+
+    /* Time spent in each forwarding stage. */
+    struct latency_stats latency;
+
+    /* Packets dropped that no port can be blamed for, by OFP_EXT_DROP_*
+     * reason.  Each port counts its own in its 'drops'. */
+    unsigned long long int drops[OFP_EXT_DROP_N_REASONS];
+
+    /* Time spent processing each type of OpenFlow message. */
+    struct ofpstat_proc proc_stats;
 
 #if defined(OF_HW_PLAT)
     /* Although the chain maintains the pointer to the HW driver
@@ -141,26 +311,57 @@ struct datapath {
      * in the driver structure
      */
     of_hw_driver_t *hw_drv;
-    struct hw_pkt_q_entry *hw_pkt_list_head, *hw_pkt_list_tail;
+
+    /* Packets received by the driver's callback thread, each with its
+     * sw_port in 'private', waiting for dp_run().  Null if the driver
+     * does not deliver packets that way. */
+    struct pkt_ring *hw_pkt_ring;
+    unsigned long long int hw_pkt_n_dropped; /* Drops already logged. */
 #endif
 };
 
-int dp_new(struct datapath **, uint64_t dpid);
+int dp_new(struct datapath **, uint64_t dpid, const char *tables,
+           unsigned int n_buffers);
 int dp_add_port(struct datapath *, const char *netdev, uint16_t);
 int dp_add_local_port(struct datapath *, const char *netdev, uint16_t);
+void dp_add_port_later(struct datapath *, const char *netdev, uint16_t);
+bool dp_ports_pending(const struct datapath *);
 void dp_add_pvconn(struct datapath *, struct pvconn *);
+int dp_share_buffers(struct datapath *, const struct datapath *other);
 void dp_run(struct datapath *);
+bool dp_poll_ports(struct datapath *);
 void dp_wait(struct datapath *);
+int fwd_control_input(struct datapath *, const struct sender *,
+                      const void *, size_t);
 void dp_send_error_msg(struct datapath *, const struct sender *,
                   uint16_t, uint16_t, const void *, size_t);
 void dp_send_flow_end(struct datapath *, struct sw_flow *,
                       enum ofp_flow_removed_reason);
 void dp_output_port(struct datapath *, struct ofpbuf *, int in_port, 
                     int out_port, uint32_t queue_id, bool ignore_no_fwd);
+void dp_output_port_shared(struct datapath *, const struct ofpbuf *,
+                           int in_port, int out_port, uint32_t queue_id,
+                           bool ignore_no_fwd);
+int dp_set_packet_in_udp(struct datapath *, const struct sender *,
+                         uint32_t ip, uint16_t port);
+int dp_set_async(struct datapath *, const struct sender *,
+                 uint32_t packet_in_mask, uint32_t port_status_mask,
+                 uint32_t flow_removed_mask, uint32_t balance_id,
+                 const uint16_t *ports, size_t n_ports);
 void dp_output_control(struct datapath *, struct ofpbuf *, int in_port,
         size_t max_len, int reason);
 struct sw_port * dp_lookup_port(struct datapath *, uint16_t);
+int dp_send_processing_stats(struct datapath *, const struct sender *);
+int dp_packet_out_batch(struct datapath *, const struct sender *,
+                        const struct ofp_ext_packet_out_batch *);
+int dp_replace_table(struct datapath *, const struct sender *,
+                     uint16_t command);
+int dp_set_table(struct datapath *, const struct sender *, uint8_t table_id);
+int dp_set_table_miss(struct datapath *, uint8_t table_id, uint8_t miss);
+void dp_goto_table(struct datapath *, struct ofpbuf *, struct sw_flow_key *,
+                   uint8_t table_id, bool ignore_no_fwd);
 struct sw_queue * dp_lookup_queue(struct sw_port *, uint32_t);
+void dp_index_queues(struct sw_port *);
 
 int udatapath_cmd(int argc, char *argv[]);
 
@@ -0,0 +1,89 @@
+/* Copyright (c) 2008 The Board of Trustees of The Leland Stanford
+ * Junior University
+ * 
+ * We are making the OpenFlow specification and associated documentation
+ * (Software) available for public use and benefit with the expectation
+ * that others will use, modify and enhance the Software and contribute
+ * those enhancements back to the community. However, since we would
+ * like to make the Software available for broadest use, with as few
+ * restrictions as possible permission is hereby granted, free of
+ * charge, to any person obtaining a copy of this Software to deal in
+ * the Software under the copyrights without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ * The name and trademarks of copyright holder(s) may NOT be used in
+ * advertising or publicity pertaining to the Software or any
+ * derivatives without specific, written prior permission.
+ */
+
+/* Static tracepoints on the forwarding path.
+ *
+ * When <sys/sdt.h> is available at build time, each DP_TRACE*() is a
+ * SystemTap/USDT probe in provider "ofdatapath": a single "nop" instruction
+ * plus an ELF note describing where its arguments live, so it costs
+ * essentially nothing until a tracer such as perf, bpftrace or SystemTap
+ * attaches to it, e.g.:
+ *
+ *     bpftrace -e 'usdt:./ofdatapath:ofdatapath:chain_lookup_miss
+ *                  { @[arg0] = count(); }'
+ *
+ * Without <sys/sdt.h> the probes compile to nothing.  Arguments must be
+ * integers or pointers.
+ *
+ * The probes are:
+ *
+ *     port_input(port, len): a packet of 'len' bytes arrived on 'port'.
+ *
+ *     chain_lookup_hit(table, flow, cached): the lookup matched 'flow' in
+ *         table index 'table', or -1 for the emergency table.  'cached' is
+ *         1 if the match came from the microflow cache.
+ *
+ *     chain_lookup_miss(in_port): a packet from 'in_port' matched no flow.
+ *
+ *     execute_actions(in_port, len, actions_len): applying 'actions_len'
+ *         bytes of actions to a packet of 'len' bytes from 'in_port'.
+ *
+ *     output_control(in_port, len, reason): sending a packet of 'len' bytes
+ *         to the controller with packet_in 'reason'.
+ *
+ *     save_buffer(buffer_id, len): buffered a packet of 'len' bytes as
+ *         'buffer_id' (UINT32_MAX if the buffer was full).
+ *
+ *     add_flow(flow, priority, error): inserting 'flow' with 'priority'
+ *         returned errno value 'error'.
+ *
+ *     flow_timeout(flow, priority): 'flow', with 'priority', expired off
+ *         the chain's timing wheel.
+ */
+
+#ifndef DP_TRACE_H
+#define DP_TRACE_H 1
+
+#ifdef HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+
+#define DP_TRACE1(NAME, A) DTRACE_PROBE1(ofdatapath, NAME, A)
+#define DP_TRACE2(NAME, A, B) DTRACE_PROBE2(ofdatapath, NAME, A, B)
+#define DP_TRACE3(NAME, A, B, C) DTRACE_PROBE3(ofdatapath, NAME, A, B, C)
+#else
+#define DP_TRACE1(NAME, A) ((void) 0)
+#define DP_TRACE2(NAME, A, B) ((void) 0)
+#define DP_TRACE3(NAME, A, B, C) ((void) 0)
+#endif
+
+#endif /* dp-trace.h */
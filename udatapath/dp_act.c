@@ -34,10 +34,17 @@
 /* Functions for executing OpenFlow actions. */
 
 #include <arpa/inet.h>
+#include <stdlib.h>
 #include "csum.h"
+#include "hash.h"
+#include "hmap.h"
+#include "list.h"
 #include "packets.h"
 #include "dp_act.h"
+#include "dp-trace.h"
+#include "policer.h"
 #include "openflow/nicira-ext.h"
+#include "openflow/openflow-ext.h"
 
 static uint16_t
 validate_output(struct datapath *dp UNUSED, const struct sw_flow_key *key, 
@@ -81,6 +88,22 @@ do_output(struct datapath *dp, struct ofpbuf *buffer, int in_port,
     }
 }
 
+/* Like do_output(), but the caller retains ownership of 'buffer', so that
+ * the actions that follow may go on modifying it. */
+static void
+do_output_shared(struct datapath *dp, const struct ofpbuf *buffer,
+                 int in_port, size_t max_len, int out_port,
+                 uint32_t queue_id, bool ignore_no_fwd)
+{
+    if (out_port != OFPP_CONTROLLER) {
+        dp_output_port_shared(dp, buffer, in_port, out_port, queue_id,
+                              ignore_no_fwd);
+    } else {
+        dp_output_control(dp, ofpbuf_clone(buffer), in_port, max_len,
+                          OFPR_ACTION);
+    }
+}
+
 /* Modify vlan tag control information (TCI).  Only sets the TCI bits
  * indicated by 'mask'.  If no vlan tag is present, one is added.
  */
@@ -96,17 +119,14 @@ modify_vlan_tci(struct ofpbuf *buffer, struct sw_flow_key *key,
         veh->veth_tci &= ~htons(mask);
         veh->veth_tci |= htons(tci);
     } else {
-        /* Insert new vlan id. */
-        struct eth_header *eh = buffer->l2;
-        struct vlan_eth_header tmp;
-        memcpy(tmp.veth_dst, eh->eth_dst, ETH_ADDR_LEN);
-        memcpy(tmp.veth_src, eh->eth_src, ETH_ADDR_LEN);
-        tmp.veth_type = htons(ETH_TYPE_VLAN);
-        tmp.veth_tci = htons(tci);
-        tmp.veth_next_type = eh->eth_type;
-
+        /* Insert new vlan id.  Every buffer source reserves DP_RX_HEADROOM,
+         * so this normally just slides the MAC addresses down into the
+         * headroom, leaving the old Ethernet type in place as the tag's
+         * 'veth_next_type'. */
         veh = ofpbuf_push_uninit(buffer, VLAN_HEADER_LEN);
-        memcpy(veh, &tmp, sizeof tmp);
+        memmove(veh, (char *) veh + VLAN_HEADER_LEN, 2 * ETH_ADDR_LEN);
+        veh->veth_type = htons(ETH_TYPE_VLAN);
+        veh->veth_tci = htons(tci);
         buffer->l2 = (char*)buffer->l2 - VLAN_HEADER_LEN;
     }
 
@@ -123,16 +143,12 @@ vlan_pull_tag(struct ofpbuf *buffer)
     struct vlan_eth_header *veh = buffer->l2;
 
     if (veh->veth_type == htons(ETH_TYPE_VLAN)) {
-        struct eth_header tmp;
-
-        memcpy(tmp.eth_dst, veh->veth_dst, ETH_ADDR_LEN);
-        memcpy(tmp.eth_src, veh->veth_src, ETH_ADDR_LEN);
-        tmp.eth_type = veh->veth_next_type;
-
+        /* Slide the MAC addresses up over the tag, so that
+         * 'veth_next_type' becomes the Ethernet type. */
+        memmove((char *) veh + VLAN_HEADER_LEN, veh, 2 * ETH_ADDR_LEN);
         buffer->size -= VLAN_HEADER_LEN;
         buffer->data = (char*)buffer->data + VLAN_HEADER_LEN;
         buffer->l2 = (char*)buffer->l2 + VLAN_HEADER_LEN;
-        memcpy(buffer->data, &tmp, sizeof tmp);
     }
 }
 
@@ -178,50 +194,98 @@ set_dl_addr(struct ofpbuf *buffer, struct sw_flow_key *key UNUSED,
     }
 }
 
+/* Returns the checksum that results from changing a 32-bit field that is
+ * covered by checksum 'old_csum' from 'old_u32' to a value whose
+ * csum_add32() sum is 'new_sum'.  See RFC 1624. */
+static uint16_t
+update_csum32(uint16_t old_csum, uint32_t old_u32, uint32_t new_sum)
+{
+    uint32_t sum = (uint16_t) ~old_csum + csum_add32(0, ~old_u32) + new_sum;
+    sum = (sum & 0xffff) + (sum >> 16);
+    return ~(sum + (sum >> 16));
+}
+
+/* Returns the checksum that results from changing fields covered by checksum
+ * 'old_csum', where 'delta' is the csum_add16() or csum_add32() sum of the
+ * one's complement of each changed field's old value and of its new value.
+ * See RFC 1624. */
+static uint16_t
+apply_csum_delta(uint16_t old_csum, uint32_t delta)
+{
+    uint32_t sum = (uint16_t) ~old_csum + delta;
+    sum = (sum & 0xffff) + (sum >> 16);
+    return ~(sum + (sum >> 16));
+}
+
+/* Returns true if 'buffer', an IP packet whose flow is 'flow', has a TCP or
+ * UDP header at 'buffer->l4' whose checksum covers the IP addresses.  An IP
+ * fragment does not: 'l4' in a fragment other than the first points into
+ * the middle of the payload, and even the first might be too short to hold
+ * the whole header. */
+static bool
+has_tcp_udp_header(const struct ofpbuf *buffer, const struct flow *flow)
+{
+    const struct ip_header *nh = buffer->l3;
+
+    return ((flow->nw_proto == IP_TYPE_TCP || flow->nw_proto == IP_TYPE_UDP)
+            && !IP_IS_FRAGMENT(nh->ip_frag_off));
+}
+
+/* Sets the IP source address (if 'src' is true) or destination address of
+ * 'buffer' to 'new', whose csum_add32() sum is 'new_sum', and fixes up the
+ * checksums. */
 static void
-set_nw_addr(struct ofpbuf *buffer, struct sw_flow_key *key, 
-        const struct ofp_action_header *ah)
+do_set_nw_addr(struct ofpbuf *buffer, struct sw_flow_key *key, bool src,
+               uint32_t new, uint32_t new_sum)
 {
-    struct ofp_action_nw_addr *na = (struct ofp_action_nw_addr *)ah;
-    uint16_t eth_proto = ntohs(key->flow.dl_type);
+    flow_extract_finish(buffer, &key->flow);
 
-    if (eth_proto == ETH_TYPE_IP) {
+    if (key->flow.dl_type == htons(ETH_TYPE_IP)) {
         struct ip_header *nh = buffer->l3;
         uint8_t nw_proto = key->flow.nw_proto;
-        uint32_t new, *field;
+        uint32_t *field = src ? &nh->ip_src : &nh->ip_dst;
 
-        new = na->nw_addr;
-        field = na->type == htons(OFPAT_SET_NW_SRC) ? &nh->ip_src : &nh->ip_dst;
-        if (nw_proto == IP_TYPE_TCP) {
+        if (!has_tcp_udp_header(buffer, &key->flow)) {
+            /* No transport checksum to fix up. */
+        } else if (nw_proto == IP_TYPE_TCP) {
             struct tcp_header *th = buffer->l4;
-            th->tcp_csum = recalc_csum32(th->tcp_csum, *field, new);
-        } else if (nw_proto == IP_TYPE_UDP) {
+            th->tcp_csum = update_csum32(th->tcp_csum, *field, new_sum);
+        } else {
             struct udp_header *th = buffer->l4;
             if (th->udp_csum) {
-                th->udp_csum = recalc_csum32(th->udp_csum, *field, new);
+                th->udp_csum = update_csum32(th->udp_csum, *field, new_sum);
                 if (!th->udp_csum) {
                     th->udp_csum = 0xffff;
                 }
             }
         }
-        nh->ip_csum = recalc_csum32(nh->ip_csum, *field, new);
+        nh->ip_csum = update_csum32(nh->ip_csum, *field, new_sum);
         *field = new;
     }
 }
 
 static void
-set_nw_tos(struct ofpbuf *buffer, struct sw_flow_key *key, 
-           const struct ofp_action_header *ah)
+set_nw_addr(struct ofpbuf *buffer, struct sw_flow_key *key, 
+        const struct ofp_action_header *ah)
 {
-    struct ofp_action_nw_tos *nt = (struct ofp_action_nw_tos *)ah;
-    uint16_t eth_proto = ntohs(key->flow.dl_type);
+    struct ofp_action_nw_addr *na = (struct ofp_action_nw_addr *)ah;
 
-   if (eth_proto == ETH_TYPE_IP) {
+    do_set_nw_addr(buffer, key, na->type == htons(OFPAT_SET_NW_SRC),
+                   na->nw_addr, csum_add32(0, na->nw_addr));
+}
+
+/* Sets the DSCP bits of 'buffer''s IP ToS to those in 'tos'. */
+static void
+do_set_nw_tos(struct ofpbuf *buffer, struct sw_flow_key *key, uint8_t tos)
+{
+    flow_extract_finish(buffer, &key->flow);
+
+   if (key->flow.dl_type == htons(ETH_TYPE_IP)) {
        struct ip_header *nh = buffer->l3;
        uint8_t new, *field;
 
        /* JeanII : Set only 6 bits, don't clobber ECN */
-       new = (nt->nw_tos & 0xFC) | (nh->ip_tos & 0x03);
+       new = (tos & 0xFC) | (nh->ip_tos & 0x03);
 
        /* Get address of field */
        field = &nh->ip_tos;
@@ -237,31 +301,56 @@ set_nw_tos(struct ofpbuf *buffer, struct sw_flow_key *key,
 }
 
 static void
-set_tp_port(struct ofpbuf *buffer, struct sw_flow_key *key, 
-        const struct ofp_action_header *ah)
+set_nw_tos(struct ofpbuf *buffer, struct sw_flow_key *key, 
+           const struct ofp_action_header *ah)
 {
-    struct ofp_action_tp_port *ta = (struct ofp_action_tp_port *)ah;
-    uint16_t eth_proto = ntohs(key->flow.dl_type);
+    struct ofp_action_nw_tos *nt = (struct ofp_action_nw_tos *)ah;
+
+    do_set_nw_tos(buffer, key, nt->nw_tos);
+}
+
+/* Sets the TCP or UDP source port (if 'src' is true) or destination port of
+ * 'buffer' to 'new' and fixes up the checksum. */
+static void
+do_set_tp_port(struct ofpbuf *buffer, struct sw_flow_key *key, bool src,
+               uint16_t new)
+{
+    flow_extract_finish(buffer, &key->flow);
 
-    if (eth_proto == ETH_TYPE_IP) {
+    if (key->flow.dl_type == htons(ETH_TYPE_IP)
+        && has_tcp_udp_header(buffer, &key->flow)) {
         uint8_t nw_proto = key->flow.nw_proto;
-        uint16_t new, *field;
+        uint16_t *field;
 
-        new = ta->tp_port;
         if (nw_proto == IP_TYPE_TCP) {
             struct tcp_header *th = buffer->l4;
-            field = ta->type == htons(OFPAT_SET_TP_SRC) ? &th->tcp_src : &th->tcp_dst;
+            field = src ? &th->tcp_src : &th->tcp_dst;
             th->tcp_csum = recalc_csum16(th->tcp_csum, *field, new);
             *field = new;
-        } else if (nw_proto == IP_TYPE_UDP) {
+        } else {
             struct udp_header *th = buffer->l4;
-            field = ta->type == htons(OFPAT_SET_TP_SRC) ? &th->udp_src : &th->udp_dst;
-            th->udp_csum = recalc_csum16(th->udp_csum, *field, new);
+            field = src ? &th->udp_src : &th->udp_dst;
+            if (th->udp_csum) {
+                th->udp_csum = recalc_csum16(th->udp_csum, *field, new);
+                if (!th->udp_csum) {
+                    th->udp_csum = 0xffff;
+                }
+            }
             *field = new;
         }
     }
 }
 
+static void
+set_tp_port(struct ofpbuf *buffer, struct sw_flow_key *key, 
+        const struct ofp_action_header *ah)
+{
+    struct ofp_action_tp_port *ta = (struct ofp_action_tp_port *)ah;
+
+    do_set_tp_port(buffer, key, ta->type == htons(OFPAT_SET_TP_SRC),
+                   ta->tp_port);
+}
+
 struct openflow_action {
     size_t min_size;
     size_t max_size;
@@ -369,6 +458,88 @@ validate_ofpat(struct datapath *dp, const struct sw_flow_key *key,
     return ret;
 }
 
+/* Validates an OFP_EXT_ACT_POLICE action, creating the policer that it
+ * names if there is none yet. */
+static uint16_t
+validate_police(const struct ofp_action_header *ah, uint16_t len)
+{
+    const struct ofp_ext_action_police *pa = (const void *) ah;
+    uint32_t meter_id, rate, burst;
+    struct policer *p;
+
+    if (len != sizeof *pa) {
+        return OFPBAC_BAD_LEN;
+    }
+    if (pa->exceed != OFP_EXT_POLICE_DROP
+        && pa->exceed != OFP_EXT_POLICE_REMARK) {
+        return OFPBAC_BAD_ARGUMENT;
+    }
+
+    meter_id = ntohl(pa->meter_id);
+    rate = ntohl(pa->rate);
+    burst = ntohl(pa->burst);
+    if (!rate) {
+        return OFPBAC_BAD_ARGUMENT;
+    }
+
+    p = policer_lookup(meter_id);
+    if (!p) {
+        return (policer_create(meter_id, rate, burst)
+                ? ACT_VALIDATION_OK : OFPBAC_TOO_MANY);
+    }
+    return (policer_has_config(p, rate, burst)
+            ? ACT_VALIDATION_OK : OFPBAC_BAD_ARGUMENT);
+}
+
+/* Validates an OFP_EXT_ACT_GOTO_TABLE action.  validate_actions__() checks
+ * that it comes last, and the caller that the table comes after the flow's
+ * own. */
+static uint16_t
+validate_goto_table(const struct ofp_action_header *ah, uint16_t len)
+{
+    const struct ofp_ext_action_goto_table *ga = (const void *) ah;
+
+    if (len != sizeof *ga) {
+        return OFPBAC_BAD_LEN;
+    }
+    return (ga->table_id && ga->table_id < OFP_EXT_PIPELINE_TABLES
+            ? ACT_VALIDATION_OK : OFPBAC_BAD_ARGUMENT);
+}
+
+/* Returns true if 'ah', which has passed validation, is an
+ * OFP_EXT_ACT_GOTO_TABLE action. */
+static bool
+is_goto_table(const struct ofp_action_header *ah)
+{
+    const struct ofp_ext_action_header *eah = (const void *) ah;
+
+    return (ah->type == htons(OFPAT_VENDOR)
+            && eah->vendor == htonl(OPENFLOW_VENDOR_ID)
+            && eah->subtype == htons(OFP_EXT_ACT_GOTO_TABLE));
+}
+
+/* Validates an action whose vendor is OPENFLOW_VENDOR_ID. */
+static uint16_t
+validate_ext_action(const struct ofp_action_header *ah, uint16_t len)
+{
+    const struct ofp_ext_action_header *eah = (const void *) ah;
+
+    if (len < sizeof *eah) {
+        return OFPBAC_BAD_LEN;
+    }
+
+    switch (ntohs(eah->subtype)) {
+    case OFP_EXT_ACT_POLICE:
+        return validate_police(ah, len);
+
+    case OFP_EXT_ACT_GOTO_TABLE:
+        return validate_goto_table(ah, len);
+
+    default:
+        return OFPBAC_BAD_VENDOR_TYPE;
+    }
+}
+
 /* Validate vendor-defined actions.  Either returns ACT_VALIDATION_OK
  * or an OFPET_BAD_ACTION error code. */
 static uint16_t 
@@ -385,6 +556,9 @@ validate_vendor(struct datapath *dp UNUSED, const struct sw_flow_key *key UNUSED
     avh = (struct ofp_action_vendor_header *)ah;
 
     switch(ntohl(avh->vendor)) {
+    case OPENFLOW_VENDOR_ID:
+        return validate_ext_action(ah, len);
+
     default:
         return OFPBAC_BAD_VENDOR;
     }
@@ -392,12 +566,14 @@ validate_vendor(struct datapath *dp UNUSED, const struct sw_flow_key *key UNUSED
     return ret;
 }
 
-/* Validates a list of actions.  If a problem is found, a code for the
- * OFPET_BAD_ACTION error type is returned.  If the action list validates, 
- * ACT_VALIDATION_OK is returned. */
-uint16_t 
-validate_actions(struct datapath *dp, const struct sw_flow_key *key,
-        const struct ofp_action_header *actions, size_t actions_len)
+/* Validates a list of actions without consulting the cache of action
+ * programs.  If a problem is found, a code for the OFPET_BAD_ACTION error
+ * type is returned.  If the action list validates, ACT_VALIDATION_OK is
+ * returned. */
+static uint16_t
+validate_actions__(struct datapath *dp, const struct sw_flow_key *key,
+                   const struct ofp_action_header *actions,
+                   size_t actions_len)
 {
     uint8_t *p = (uint8_t *)actions;
     int err;
@@ -424,6 +600,10 @@ validate_actions(struct datapath *dp, const struct sw_flow_key *key,
             if (err != ACT_VALIDATION_OK) {
                 return err;
             }
+            if (is_goto_table(ah) && actions_len != len) {
+                /* The packet belongs to the next table's flow. */
+                return OFPBAC_BAD_ARGUMENT;
+            }
         } else {
             return OFPBAC_BAD_TYPE;
         }
@@ -452,20 +632,49 @@ execute_ofpat(struct ofpbuf *buffer, struct sw_flow_key *key,
     }
 }
 
-/* Execute a vendor-defined action against 'buffer'. */
-static void
-execute_vendor(struct ofpbuf *buffer UNUSED, const struct sw_flow_key *key UNUSED, 
+/* Charges 'buffer' to 'policer'.  Returns false if 'buffer' is above the
+ * rate and 'exceed' is OFP_EXT_POLICE_DROP, otherwise true, after remarking
+ * 'buffer' with 'nw_tos' if it is above the rate. */
+static bool
+do_police(struct ofpbuf *buffer, struct sw_flow_key *key,
+          struct policer *policer, uint8_t exceed, uint8_t nw_tos)
+{
+    if (policer_admit(policer, buffer->size)) {
+        return true;
+    } else if (exceed == OFP_EXT_POLICE_DROP) {
+        return false;
+    } else {
+        do_set_nw_tos(buffer, key, nw_tos);
+        return true;
+    }
+}
+
+/* Execute a vendor-defined action against 'buffer'.  Returns false if the
+ * action dropped the packet, in which case the actions after it are not
+ * executed. */
+static bool
+execute_vendor(struct ofpbuf *buffer, struct sw_flow_key *key, 
         const struct ofp_action_header *ah)
 {
     struct ofp_action_vendor_header *avh 
             = (struct ofp_action_vendor_header *)ah;
 
     switch(ntohl(avh->vendor)) {
+    case OPENFLOW_VENDOR_ID: {
+        const struct ofp_ext_action_police *pa = (const void *) ah;
+        struct policer *policer = policer_lookup(ntohl(pa->meter_id));
+
+        /* Validation created the policer, and policers are never
+         * destroyed, so OFP_EXT_ACT_POLICE is the only possibility. */
+        return !policer || do_police(buffer, key, policer, pa->exceed,
+                                     pa->nw_tos);
+    }
+
     default:
         /* This should not be possible due to prior validation. */
         printf("attempt to execute action with unknown vendor: %#x\n", 
                 ntohl(avh->vendor));
-        break;
+        return true;
     }
 }
 
@@ -475,16 +684,17 @@ void execute_actions(struct datapath *dp, struct ofpbuf *buffer,
              const struct ofp_action_header *actions, size_t actions_len,
              int ignore_no_fwd)
 {
-    /* Every output action needs a separate clone of 'buffer', but the common
-     * case is just a single output action, so that doing a clone and then
-     * freeing the original buffer is wasteful.  So the following code is
-     * slightly obscure just to avoid that. */
+    /* Every output action but the last is sent with do_output_shared(),
+     * which only clones 'buffer' for destinations that keep their packet.
+     * The last one can hand over 'buffer' itself, so each output is deferred
+     * until we know whether another action follows it. */
     int prev_port;
     uint32_t prev_queue;
     size_t max_len = UINT16_MAX;
     uint16_t in_port = ntohs(key->flow.in_port);
     uint8_t *p = (uint8_t *)actions;
 
+    DP_TRACE3(execute_actions, in_port, buffer->size, actions_len);
     prev_port = -1;
     prev_queue = 0;
 
@@ -495,8 +705,8 @@ void execute_actions(struct datapath *dp, struct ofpbuf *buffer,
         size_t len = htons(ah->len);
 
         if (prev_port != -1) {
-            do_output(dp, ofpbuf_clone(buffer), in_port, max_len,
-                      prev_port, prev_queue, ignore_no_fwd);
+            do_output_shared(dp, buffer, in_port, max_len,
+                             prev_port, prev_queue, ignore_no_fwd);
             prev_port = -1;
         }
 
@@ -515,8 +725,15 @@ void execute_actions(struct datapath *dp, struct ofpbuf *buffer,
 
             if (type < ARRAY_SIZE(of_actions)) {
                 execute_ofpat(buffer, key, ah, type);
+            } else if (is_goto_table(ah)) {
+                const struct ofp_ext_action_goto_table *ga = (const void *) p;
+                dp_goto_table(dp, buffer, key, ga->table_id, ignore_no_fwd);
+                return;
             } else if (type == OFPAT_VENDOR) {
-                execute_vendor(buffer, key, ah);
+                if (!execute_vendor(buffer, key, ah)) {
+                    ofpbuf_delete(buffer);
+                    return;
+                }
             }
         }
 
@@ -529,3 +746,649 @@ void execute_actions(struct datapath *dp, struct ofpbuf *buffer,
         ofpbuf_delete(buffer);
     }
 }
+
+/* Compiled action programs.
+ *
+ * compile_actions() translates a validated action list into an array of
+ * act_ops whose arguments are already decoded, so that executing a flow's
+ * actions for a packet needs no length checks, byte swapping, or table
+ * dispatch. */
+
+enum act_opcode {
+    ACT_OUTPUT,                 /* Also used for OFPAT_ENQUEUE. */
+    ACT_SET_VLAN_TCI,
+    ACT_STRIP_VLAN,
+    ACT_SET_DL_SRC,
+    ACT_SET_DL_DST,
+    ACT_SET_NW_SRC,
+    ACT_SET_NW_DST,
+    ACT_SET_NW_TOS,
+    ACT_SET_TP_SRC,
+    ACT_SET_TP_DST,
+    ACT_SET_L3L4,               /* Two or more of ACT_SET_NW_SRC...DST. */
+    ACT_POLICE,
+    ACT_GOTO_TABLE
+};
+
+/* Bits for 'fields' in an ACT_SET_L3L4 op. */
+#define L3L4_NW_SRC (1 << 0)
+#define L3L4_NW_DST (1 << 1)
+#define L3L4_TP_SRC (1 << 2)
+#define L3L4_TP_DST (1 << 3)
+
+struct act_op {
+    enum act_opcode opcode;
+    union {
+        struct {
+            uint16_t port;      /* Host byte order. */
+            uint16_t max_len;   /* Host byte order. */
+            uint32_t queue_id;  /* Host byte order. */
+        } output;
+        struct {
+            uint16_t tci;       /* Host byte order. */
+            uint16_t mask;      /* Host byte order. */
+        } vlan;
+        uint8_t dl_addr[ETH_ADDR_LEN];
+        struct {
+            uint32_t addr;      /* Network byte order. */
+            uint32_t sum;       /* csum_add32(0, addr). */
+        } nw_addr;
+        uint8_t nw_tos;
+        uint16_t tp_port;       /* Network byte order. */
+        struct {
+            uint32_t nw_src, nw_dst;    /* Network byte order. */
+            uint16_t tp_src, tp_dst;    /* Network byte order. */
+            unsigned int fields;        /* L3L4_* for the fields to set. */
+        } l3l4;
+        struct {
+            struct policer *policer;
+            uint8_t exceed;     /* One of OFP_EXT_POLICE_*. */
+            uint8_t nw_tos;
+        } police;
+        uint8_t table_id;
+    } u;
+};
+
+/* A compiled action list.
+ *
+ * Action programs are hash-consed: compile_actions() hands every flow whose
+ * actions are byte-for-byte the same a reference to one shared program,
+ * found in 'act_cache' by the hash of the actions.  A program in the cache
+ * also stands for the knowledge that its actions passed validate_actions(),
+ * so that validating them again only needs the one check that depends on
+ * the flow's key.  Programs that no flow refers to stay in the cache, on
+ * 'act_idle', until ACT_CACHE_MAX programs are cached. */
+struct act_prog {
+    struct hmap_node node;      /* In 'act_cache', if 'cached'. */
+    struct list idle_node;      /* In 'act_idle', if cached and unused. */
+    bool cached;
+    unsigned int ref_cnt;       /* Number of flows using the program. */
+    uint64_t out_port_bits;     /* Bit (port % 64) for each OFPAT_OUTPUT. */
+    bool forward_only;          /* All 'ops' are ACT_OUTPUT? */
+    const uint8_t *actions;     /* Copy of the source actions. */
+    size_t actions_len;
+    size_t n_ops;
+    struct act_op ops[0];
+};
+
+#define ACT_CACHE_MAX 1024
+
+static struct hmap act_cache = HMAP_INITIALIZER(&act_cache);
+static struct list act_idle = LIST_INITIALIZER(&act_idle);
+static unsigned long long int act_cache_hits, act_cache_misses;
+
+/* Translates one action into 'op'.  Returns true if successful, false if
+ * the action has no compiled form. */
+static bool
+compile_action(const struct ofp_action_header *ah, struct act_op *op)
+{
+    switch (ntohs(ah->type)) {
+    case OFPAT_OUTPUT: {
+        const struct ofp_action_output *oa = (const void *) ah;
+        op->opcode = ACT_OUTPUT;
+        op->u.output.port = ntohs(oa->port);
+        op->u.output.max_len = ntohs(oa->max_len);
+        op->u.output.queue_id = 0; /* Default best-effort queue. */
+        return true;
+    }
+
+    case OFPAT_ENQUEUE: {
+        const struct ofp_action_enqueue *ea = (const void *) ah;
+        op->opcode = ACT_OUTPUT;
+        op->u.output.port = ntohs(ea->port);
+        op->u.output.max_len = 0; /* Never sent to the controller. */
+        op->u.output.queue_id = ntohl(ea->queue_id);
+        return true;
+    }
+
+    case OFPAT_SET_VLAN_VID: {
+        const struct ofp_action_vlan_vid *va = (const void *) ah;
+        op->opcode = ACT_SET_VLAN_TCI;
+        op->u.vlan.tci = ntohs(va->vlan_vid);
+        op->u.vlan.mask = VLAN_VID_MASK;
+        return true;
+    }
+
+    case OFPAT_SET_VLAN_PCP: {
+        const struct ofp_action_vlan_pcp *va = (const void *) ah;
+        op->opcode = ACT_SET_VLAN_TCI;
+        op->u.vlan.tci = (uint16_t) va->vlan_pcp << 13;
+        op->u.vlan.mask = VLAN_PCP_MASK;
+        return true;
+    }
+
+    case OFPAT_STRIP_VLAN:
+        op->opcode = ACT_STRIP_VLAN;
+        return true;
+
+    case OFPAT_SET_DL_SRC:
+    case OFPAT_SET_DL_DST: {
+        const struct ofp_action_dl_addr *da = (const void *) ah;
+        op->opcode = (ah->type == htons(OFPAT_SET_DL_SRC)
+                      ? ACT_SET_DL_SRC : ACT_SET_DL_DST);
+        memcpy(op->u.dl_addr, da->dl_addr, ETH_ADDR_LEN);
+        return true;
+    }
+
+    case OFPAT_SET_NW_SRC:
+    case OFPAT_SET_NW_DST: {
+        const struct ofp_action_nw_addr *na = (const void *) ah;
+        op->opcode = (ah->type == htons(OFPAT_SET_NW_SRC)
+                      ? ACT_SET_NW_SRC : ACT_SET_NW_DST);
+        op->u.nw_addr.addr = na->nw_addr;
+        op->u.nw_addr.sum = csum_add32(0, na->nw_addr);
+        return true;
+    }
+
+    case OFPAT_SET_NW_TOS: {
+        const struct ofp_action_nw_tos *nt = (const void *) ah;
+        op->opcode = ACT_SET_NW_TOS;
+        op->u.nw_tos = nt->nw_tos;
+        return true;
+    }
+
+    case OFPAT_SET_TP_SRC:
+    case OFPAT_SET_TP_DST: {
+        const struct ofp_action_tp_port *ta = (const void *) ah;
+        op->opcode = (ah->type == htons(OFPAT_SET_TP_SRC)
+                      ? ACT_SET_TP_SRC : ACT_SET_TP_DST);
+        op->u.tp_port = ta->tp_port;
+        return true;
+    }
+
+    case OFPAT_VENDOR: {
+        const struct ofp_ext_action_police *pa = (const void *) ah;
+
+        if (is_goto_table(ah)) {
+            const struct ofp_ext_action_goto_table *ga = (const void *) ah;
+            op->opcode = ACT_GOTO_TABLE;
+            op->u.table_id = ga->table_id;
+            return true;
+        }
+
+        /* OFP_EXT_ACT_POLICE is the only other vendor action that
+         * validates. */
+        op->opcode = ACT_POLICE;
+        op->u.police.policer = policer_lookup(ntohl(pa->meter_id));
+        op->u.police.exceed = pa->exceed;
+        op->u.police.nw_tos = pa->nw_tos;
+        return op->u.police.policer != NULL;
+    }
+
+    default:
+        return false;
+    }
+}
+
+static bool
+is_l3l4_rewrite(enum act_opcode opcode)
+{
+    return (opcode == ACT_SET_NW_SRC || opcode == ACT_SET_NW_DST
+            || opcode == ACT_SET_TP_SRC || opcode == ACT_SET_TP_DST);
+}
+
+/* Replaces each run of two or more consecutive address and port rewrites in
+ * 'prog', as a NAT flow would have, by a single ACT_SET_L3L4 op, so that
+ * executing the run adjusts each checksum once instead of once per field. */
+static void
+fuse_l3l4_rewrites(struct act_prog *prog)
+{
+    const struct act_op *in = prog->ops;
+    const struct act_op *end = prog->ops + prog->n_ops;
+    struct act_op *out = prog->ops;
+
+    while (in < end) {
+        if (in + 1 < end && is_l3l4_rewrite(in[0].opcode)
+            && is_l3l4_rewrite(in[1].opcode)) {
+            struct act_op fused;
+
+            memset(&fused, 0, sizeof fused);
+            fused.opcode = ACT_SET_L3L4;
+            for (; in < end && is_l3l4_rewrite(in->opcode); in++) {
+                if (in->opcode == ACT_SET_NW_SRC) {
+                    fused.u.l3l4.nw_src = in->u.nw_addr.addr;
+                    fused.u.l3l4.fields |= L3L4_NW_SRC;
+                } else if (in->opcode == ACT_SET_NW_DST) {
+                    fused.u.l3l4.nw_dst = in->u.nw_addr.addr;
+                    fused.u.l3l4.fields |= L3L4_NW_DST;
+                } else if (in->opcode == ACT_SET_TP_SRC) {
+                    fused.u.l3l4.tp_src = in->u.tp_port;
+                    fused.u.l3l4.fields |= L3L4_TP_SRC;
+                } else {
+                    fused.u.l3l4.tp_dst = in->u.tp_port;
+                    fused.u.l3l4.fields |= L3L4_TP_DST;
+                }
+            }
+            *out++ = fused;
+        } else {
+            *out++ = *in++;
+        }
+    }
+    prog->n_ops = out - prog->ops;
+}
+
+static inline uint64_t
+out_port_bit(uint16_t port)
+{
+    return UINT64_C(1) << (ntohs(port) & 63);
+}
+
+/* Compiles the 'actions_len' bytes of actions in 'actions' into a new
+ * program that is not in the cache and that has no references. */
+static struct act_prog *
+compile_actions__(const struct ofp_action_header *actions, size_t actions_len)
+{
+    const uint8_t *start = (const uint8_t *) actions;
+    const uint8_t *p;
+    struct act_prog *prog;
+    size_t n_ops;
+
+    n_ops = 0;
+    for (p = start; p < start + actions_len;
+         p += ntohs(((const struct ofp_action_header *) p)->len)) {
+        n_ops++;
+    }
+
+    prog = malloc(sizeof *prog + n_ops * sizeof *prog->ops + actions_len);
+    if (!prog) {
+        return NULL;
+    }
+    prog->cached = false;
+    prog->ref_cnt = 0;
+    prog->out_port_bits = 0;
+    prog->actions = (const uint8_t *) &prog->ops[n_ops];
+    prog->actions_len = actions_len;
+    memcpy(&prog->ops[n_ops], actions, actions_len);
+    prog->n_ops = n_ops;
+
+    n_ops = 0;
+    for (p = start; p < start + actions_len;
+         p += ntohs(((const struct ofp_action_header *) p)->len)) {
+        const struct ofp_action_header *ah = (const void *) p;
+
+        if (!compile_action(ah, &prog->ops[n_ops++])) {
+            free(prog);
+            return NULL;
+        }
+        if (ah->type == htons(OFPAT_OUTPUT)) {
+            const struct ofp_action_output *oa = (const void *) ah;
+            prog->out_port_bits |= out_port_bit(oa->port);
+        }
+    }
+    fuse_l3l4_rewrites(prog);
+
+    prog->forward_only = true;
+    for (n_ops = 0; n_ops < prog->n_ops; n_ops++) {
+        if (prog->ops[n_ops].opcode != ACT_OUTPUT) {
+            prog->forward_only = false;
+        }
+    }
+    return prog;
+}
+
+/* Returns the cached program for the 'actions_len' bytes in 'actions', whose
+ * hash is 'hash', or a null pointer if there is none. */
+static struct act_prog *
+act_cache_find(const struct ofp_action_header *actions, size_t actions_len,
+               uint32_t hash)
+{
+    struct act_prog *prog;
+
+    HMAP_FOR_EACH_WITH_HASH (prog, struct act_prog, node, hash, &act_cache) {
+        if (prog->actions_len == actions_len
+            && !memcmp(prog->actions, actions, actions_len)) {
+            return prog;
+        }
+    }
+    return NULL;
+}
+
+/* Adds 'prog', whose actions hash to 'hash', to the cache, first making room
+ * by evicting the least recently used program that no flow refers to.  If
+ * every cached program is in use, 'prog' stays out of the cache. */
+static void
+act_cache_insert(struct act_prog *prog, uint32_t hash)
+{
+    if (hmap_count(&act_cache) >= ACT_CACHE_MAX) {
+        struct act_prog *victim;
+
+        if (list_is_empty(&act_idle)) {
+            return;
+        }
+        victim = CONTAINER_OF(list_pop_front(&act_idle), struct act_prog,
+                              idle_node);
+        hmap_remove(&act_cache, &victim->node);
+        free(victim);
+    }
+    hmap_insert(&act_cache, &prog->node, hash);
+    prog->cached = true;
+    if (!prog->ref_cnt) {
+        list_push_back(&act_idle, &prog->idle_node);
+    }
+}
+
+/* Validates a list of actions.  If a problem is found, a code for the
+ * OFPET_BAD_ACTION error type is returned.  If the action list validates,
+ * ACT_VALIDATION_OK is returned.
+ *
+ * Action lists that validate are compiled into the cache of action programs,
+ * so that validating the same list again, or compiling it for a flow, is a
+ * hash lookup. */
+uint16_t
+validate_actions(struct datapath *dp, const struct sw_flow_key *key,
+                 const struct ofp_action_header *actions, size_t actions_len)
+{
+    uint32_t hash = hash_bytes(actions, actions_len, 0);
+    struct act_prog *prog = act_cache_find(actions, actions_len, hash);
+    uint16_t error;
+
+    /* Only validate_output()'s check against the key's input port depends
+     * on anything but the actions themselves. */
+    if (prog && ((key->wildcards & OFPFW_IN_PORT)
+                 || !(prog->out_port_bits & out_port_bit(key->flow.in_port)))) {
+        act_cache_hits++;
+        return ACT_VALIDATION_OK;
+    }
+
+    act_cache_misses++;
+    error = validate_actions__(dp, key, actions, actions_len);
+    if (error == ACT_VALIDATION_OK && !prog) {
+        prog = compile_actions__(actions, actions_len);
+        if (prog) {
+            act_cache_insert(prog, hash);
+            if (!prog->cached) {
+                free(prog);
+            }
+        }
+    }
+    return error;
+}
+
+/* Returns a compiled program for the 'actions_len' bytes of actions in
+ * 'actions', which must already have passed validate_actions().  The
+ * program is shared with every other flow that has the same actions; the
+ * caller must release it with act_prog_unref().  Returns a null pointer if
+ * the actions cannot be compiled, in which case execute_flow_actions() falls
+ * back to interpreting them. */
+struct act_prog *
+compile_actions(const struct ofp_action_header *actions, size_t actions_len)
+{
+    uint32_t hash = hash_bytes(actions, actions_len, 0);
+    struct act_prog *prog = act_cache_find(actions, actions_len, hash);
+
+    if (!prog) {
+        prog = compile_actions__(actions, actions_len);
+        if (!prog) {
+            return NULL;
+        }
+        act_cache_insert(prog, hash);
+    }
+    if (!prog->ref_cnt++ && prog->cached) {
+        list_remove(&prog->idle_node);
+    }
+    return prog;
+}
+
+/* Releases a reference to 'prog', which may be null, taken by
+ * compile_actions(). */
+void
+act_prog_unref(struct act_prog *prog)
+{
+    if (prog && !--prog->ref_cnt) {
+        if (prog->cached) {
+            list_push_back(&act_idle, &prog->idle_node);
+        } else {
+            free(prog);
+        }
+    }
+}
+
+/* Fills in 's' with statistics for the cache of action programs. */
+void
+act_cache_get_stats(struct act_cache_stats *s)
+{
+    s->n_progs = hmap_count(&act_cache);
+    s->n_idle = list_size(&act_idle);
+    s->n_hits = act_cache_hits;
+    s->n_misses = act_cache_misses;
+}
+
+/* Executes 'op', an ACT_SET_L3L4 op, against 'buffer'.  The changes to the
+ * fields are summed into one checksum delta per header, so that the IP and
+ * the TCP or UDP checksums are each adjusted just once. */
+static void
+do_set_l3l4(struct ofpbuf *buffer, struct sw_flow_key *key,
+            const struct act_op *op)
+{
+    unsigned int fields = op->u.l3l4.fields;
+    struct ip_header *nh;
+    uint32_t ip_delta, l4_delta;
+
+    flow_extract_finish(buffer, &key->flow);
+    if (key->flow.dl_type != htons(ETH_TYPE_IP) || !buffer->l4) {
+        /* Not IP, or the IP header is truncated. */
+        return;
+    }
+    nh = buffer->l3;
+
+    ip_delta = 0;
+    if (fields & L3L4_NW_SRC) {
+        ip_delta = csum_add32(ip_delta, ~nh->ip_src);
+        ip_delta = csum_add32(ip_delta, op->u.l3l4.nw_src);
+        nh->ip_src = op->u.l3l4.nw_src;
+    }
+    if (fields & L3L4_NW_DST) {
+        ip_delta = csum_add32(ip_delta, ~nh->ip_dst);
+        ip_delta = csum_add32(ip_delta, op->u.l3l4.nw_dst);
+        nh->ip_dst = op->u.l3l4.nw_dst;
+    }
+
+    if (has_tcp_udp_header(buffer, &key->flow)) {
+        /* TCP and UDP headers both start with the source and destination
+         * ports, and their checksums both cover the IP addresses. */
+        struct udp_header *ports = buffer->l4;
+        uint16_t *csum;
+
+        l4_delta = ip_delta;
+        if (fields & L3L4_TP_SRC) {
+            l4_delta = csum_add16(l4_delta, (uint16_t) ~ports->udp_src);
+            l4_delta = csum_add16(l4_delta, op->u.l3l4.tp_src);
+            ports->udp_src = op->u.l3l4.tp_src;
+        }
+        if (fields & L3L4_TP_DST) {
+            l4_delta = csum_add16(l4_delta, (uint16_t) ~ports->udp_dst);
+            l4_delta = csum_add16(l4_delta, op->u.l3l4.tp_dst);
+            ports->udp_dst = op->u.l3l4.tp_dst;
+        }
+
+        if (key->flow.nw_proto == IP_TYPE_TCP) {
+            csum = &((struct tcp_header *) buffer->l4)->tcp_csum;
+            *csum = apply_csum_delta(*csum, l4_delta);
+        } else if (ports->udp_csum) {
+            csum = &ports->udp_csum;
+            *csum = apply_csum_delta(*csum, l4_delta);
+            if (!*csum) {
+                *csum = 0xffff;
+            }
+        }
+    }
+
+    if (fields & (L3L4_NW_SRC | L3L4_NW_DST)) {
+        nh->ip_csum = apply_csum_delta(nh->ip_csum, ip_delta);
+    }
+}
+
+/* Returns the pipeline table that 'actions', which must have passed
+ * validate_actions(), end by going to with OFP_EXT_ACT_GOTO_TABLE, or 0 if
+ * they do not. */
+uint8_t
+actions_goto_table(const struct ofp_action_header *actions,
+                   size_t actions_len)
+{
+    const uint8_t *p = (const uint8_t *) actions;
+    const struct ofp_action_header *last = NULL;
+
+    while (actions_len > 0) {
+        size_t len = ntohs(((const struct ofp_action_header *) p)->len);
+
+        last = (const void *) p;
+        p += len;
+        actions_len -= len;
+    }
+    return (last && is_goto_table(last)
+            ? ((const struct ofp_ext_action_goto_table *) last)->table_id
+            : 0);
+}
+
+/* Returns true if 'prog', which may be null, does nothing but output the
+ * packet, so that execute_forward_actions() can run it. */
+bool
+act_prog_forward_only(const struct act_prog *prog)
+{
+    return prog && prog->forward_only;
+}
+
+/* Executes 'prog', for which act_prog_forward_only() must be true, against
+ * 'buffer', received on 'in_port'.  Since no action modifies the packet,
+ * there is no opcode to dispatch on and the packet's flow is not needed.
+ * Takes ownership of 'buffer'. */
+void
+execute_forward_actions(struct datapath *dp, struct ofpbuf *buffer,
+                        uint16_t in_port, const struct act_prog *prog)
+{
+    const struct act_op *op, *last;
+
+    if (!prog->n_ops) {
+        ofpbuf_delete(buffer);
+        return;
+    }
+
+    last = &prog->ops[prog->n_ops - 1];
+    for (op = prog->ops; op < last; op++) {
+        do_output_shared(dp, buffer, in_port, op->u.output.max_len,
+                         op->u.output.port, op->u.output.queue_id, false);
+    }
+    do_output(dp, buffer, in_port, last->u.output.max_len,
+              last->u.output.port, last->u.output.queue_id, false);
+}
+
+/* Executes the actions in 'sfa' against 'buffer', using their compiled form
+ * if there is one. */
+void
+execute_flow_actions(struct datapath *dp, struct ofpbuf *buffer,
+                     struct sw_flow_key *key,
+                     const struct sw_flow_actions *sfa, int ignore_no_fwd)
+{
+    const struct act_prog *prog = sfa->prog;
+    const struct act_op *op, *end;
+    const struct act_op *prev_output = NULL;
+    uint16_t in_port = ntohs(key->flow.in_port);
+
+    if (!prog) {
+        execute_actions(dp, buffer, key, sfa->actions, sfa->actions_len,
+                        ignore_no_fwd);
+        return;
+    } else if (prog->forward_only && !ignore_no_fwd) {
+        execute_forward_actions(dp, buffer, in_port, prog);
+        return;
+    }
+
+    /* As in execute_actions(), each output is deferred until the next action
+     * so that the last one can use 'buffer' itself. */
+    end = prog->ops + prog->n_ops;
+    for (op = prog->ops; op < end; op++) {
+        if (prev_output) {
+            do_output_shared(dp, buffer, in_port,
+                             prev_output->u.output.max_len,
+                             prev_output->u.output.port,
+                             prev_output->u.output.queue_id, ignore_no_fwd);
+            prev_output = NULL;
+        }
+
+        switch (op->opcode) {
+        case ACT_OUTPUT:
+            prev_output = op;
+            break;
+
+        case ACT_SET_VLAN_TCI:
+            modify_vlan_tci(buffer, key, op->u.vlan.tci, op->u.vlan.mask);
+            break;
+
+        case ACT_STRIP_VLAN:
+            vlan_pull_tag(buffer);
+            key->flow.dl_vlan = htons(OFP_VLAN_NONE);
+            break;
+
+        case ACT_SET_DL_SRC:
+            memcpy(((struct eth_header *) buffer->l2)->eth_src,
+                   op->u.dl_addr, ETH_ADDR_LEN);
+            break;
+
+        case ACT_SET_DL_DST:
+            memcpy(((struct eth_header *) buffer->l2)->eth_dst,
+                   op->u.dl_addr, ETH_ADDR_LEN);
+            break;
+
+        case ACT_SET_NW_SRC:
+        case ACT_SET_NW_DST:
+            do_set_nw_addr(buffer, key, op->opcode == ACT_SET_NW_SRC,
+                           op->u.nw_addr.addr, op->u.nw_addr.sum);
+            break;
+
+        case ACT_SET_NW_TOS:
+            do_set_nw_tos(buffer, key, op->u.nw_tos);
+            break;
+
+        case ACT_SET_TP_SRC:
+        case ACT_SET_TP_DST:
+            do_set_tp_port(buffer, key, op->opcode == ACT_SET_TP_SRC,
+                           op->u.tp_port);
+            break;
+
+        case ACT_SET_L3L4:
+            do_set_l3l4(buffer, key, op);
+            break;
+
+        case ACT_POLICE:
+            if (!do_police(buffer, key, op->u.police.policer,
+                           op->u.police.exceed, op->u.police.nw_tos)) {
+                ofpbuf_delete(buffer);
+                return;
+            }
+            break;
+
+        case ACT_GOTO_TABLE:
+            /* Validation made this the last op. */
+            dp_goto_table(dp, buffer, key, op->u.table_id, ignore_no_fwd);
+            return;
+        }
+    }
+
+    if (prev_output) {
+        do_output(dp, buffer, in_port, prev_output->u.output.max_len,
+                  prev_output->u.output.port, prev_output->u.output.queue_id,
+                  ignore_no_fwd);
+    } else {
+        ofpbuf_delete(buffer);
+    }
+}
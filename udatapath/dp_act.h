@@ -46,4 +46,26 @@ void execute_actions(struct datapath *, struct ofpbuf *,
 		struct sw_flow_key *, const struct ofp_action_header *, 
 		size_t action_len, int ignore_no_fwd);
 
+struct act_prog *compile_actions(const struct ofp_action_header *,
+                                 size_t actions_len);
+void act_prog_unref(struct act_prog *);
+bool act_prog_forward_only(const struct act_prog *);
+uint8_t actions_goto_table(const struct ofp_action_header *,
+                           size_t actions_len);
+
+/* Statistics for the cache of validated, compiled action lists. */
+struct act_cache_stats {
+    size_t n_progs;             /* Programs in the cache. */
+    size_t n_idle;              /* Cached programs that no flow uses. */
+    unsigned long long int n_hits;   /* Validations answered by the cache. */
+    unsigned long long int n_misses; /* Validations done in full. */
+};
+
+void act_cache_get_stats(struct act_cache_stats *);
+void execute_flow_actions(struct datapath *, struct ofpbuf *,
+                          struct sw_flow_key *,
+                          const struct sw_flow_actions *, int ignore_no_fwd);
+void execute_forward_actions(struct datapath *, struct ofpbuf *,
+                             uint16_t in_port, const struct act_prog *);
+
 #endif /* dp_act.h */
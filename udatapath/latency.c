@@ -0,0 +1,100 @@
+/* Copyright (c) 2008 The Board of Trustees of The Leland Stanford
+ * Junior University
+ * 
+ * We are making the OpenFlow specification and associated documentation
+ * (Software) available for public use and benefit with the expectation
+ * that others will use, modify and enhance the Software and contribute
+ * those enhancements back to the community. However, since we would
+ * like to make the Software available for broadest use, with as few
+ * restrictions as possible permission is hereby granted, free of
+ * charge, to any person obtaining a copy of this Software to deal in
+ * the Software under the copyrights without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ * The name and trademarks of copyright holder(s) may NOT be used in
+ * advertising or publicity pertaining to the Software or any
+ * derivatives without specific, written prior permission.
+ */
+
+#include <config.h>
+#include "latency.h"
+#include <arpa/inet.h>
+#include <string.h>
+#include "ofpbuf.h"
+#include "xtoxll.h"
+
+static long long int
+latency_nsec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long int) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void
+latency_init(struct latency_stats *ls)
+{
+    memset(ls, 0, sizeof *ls);
+    ls->start_ticks = latency_ticks();
+    ls->start_nsec = latency_nsec();
+}
+
+/* Returns the rate of latency_ticks(), in ticks per second, or 0 if it
+ * cannot yet be determined.
+ *
+ * The rate is measured over the whole time since latency_init(), so it is
+ * accurate without a calibration delay at startup. */
+uint64_t
+latency_ticks_per_sec(const struct latency_stats *ls)
+{
+    long long int elapsed_nsec = latency_nsec() - ls->start_nsec;
+    double ticks;
+
+    if (elapsed_nsec <= 0) {
+        return 0;
+    }
+    ticks = latency_ticks() - ls->start_ticks;
+    return ticks * 1e9 / elapsed_nsec + .5;
+}
+
+/* Appends a struct ofp_ext_latency_stats describing 'ls' to 'buffer'. */
+void
+latency_put_stats(const struct latency_stats *ls, struct ofpbuf *buffer)
+{
+    struct ofp_ext_latency_stats *ols;
+    int i, j;
+
+    ols = ofpbuf_put_zeros(buffer, sizeof *ols);
+    ols->header.vendor = htonl(OPENFLOW_VENDOR_ID);
+    ols->header.subtype = htonl(OFP_EXT_STATS_LATENCY);
+    ols->ticks_per_sec = htonll(latency_ticks_per_sec(ls));
+
+    for (i = 0; i < OFP_EXT_LATENCY_N_STAGES; i++) {
+        const struct latency_hist *h = &ls->stages[i];
+        struct ofp_ext_latency_hist *olh;
+
+        olh = ofpbuf_put_zeros(buffer, sizeof *olh);
+        olh->stage = htons(i);
+        olh->n_samples = htonll(h->n_samples);
+        olh->total_ticks = htonll(h->total_ticks);
+        for (j = 0; j < OFP_EXT_LATENCY_BUCKETS; j++) {
+            olh->buckets[j] = htonll(h->buckets[j]);
+        }
+    }
+}
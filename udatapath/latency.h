@@ -0,0 +1,110 @@
+/* Copyright (c) 2008 The Board of Trustees of The Leland Stanford
+ * Junior University
+ * 
+ * We are making the OpenFlow specification and associated documentation
+ * (Software) available for public use and benefit with the expectation
+ * that others will use, modify and enhance the Software and contribute
+ * those enhancements back to the community. However, since we would
+ * like to make the Software available for broadest use, with as few
+ * restrictions as possible permission is hereby granted, free of
+ * charge, to any person obtaining a copy of this Software to deal in
+ * the Software under the copyrights without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ * The name and trademarks of copyright holder(s) may NOT be used in
+ * advertising or publicity pertaining to the Software or any
+ * derivatives without specific, written prior permission.
+ */
+
+/* Per-stage latency histograms for the forwarding path.
+ *
+ * Each stage is timed with the CPU's time-stamp counter where there is
+ * one, so that taking a timestamp costs a few tens of cycles and no system
+ * call, and each time is counted in a log2 histogram bucket.  The
+ * histograms are reported through the OFP_EXT_STATS_LATENCY vendor
+ * statistics request. */
+
+#ifndef LATENCY_H
+#define LATENCY_H 1
+
+#include <stdint.h>
+#include <time.h>
+#include "openflow/openflow-ext.h"
+#include "util.h"
+
+struct ofpbuf;
+
+struct latency_hist {
+    uint64_t n_samples;
+    uint64_t total_ticks;
+    uint64_t buckets[OFP_EXT_LATENCY_BUCKETS];
+};
+
+struct latency_stats {
+    struct latency_hist stages[OFP_EXT_LATENCY_N_STAGES];
+
+    /* Clock readings when the histograms were created, for working out the
+     * tick rate. */
+    uint64_t start_ticks;
+    long long int start_nsec;
+};
+
+/* Returns the current time in ticks of an unspecified, fast clock. */
+static inline uint64_t
+latency_ticks(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+    uint32_t lo, hi;
+
+    __asm__ __volatile__("rdtsc" : "=a" (lo), "=d" (hi));
+    return ((uint64_t) hi << 32) | lo;
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+/* Counts the time since 'start', a value returned by latency_ticks(), in
+ * 'h'. */
+static inline void
+latency_hist_record(struct latency_hist *h, uint64_t start)
+{
+    uint64_t ticks = latency_ticks() - start;
+    int bucket = ticks ? 64 - __builtin_clzll(ticks) : 0;
+
+    h->n_samples++;
+    h->total_ticks += ticks;
+    h->buckets[MIN(bucket, OFP_EXT_LATENCY_BUCKETS - 1)]++;
+}
+
+/* Counts the time since 'start', a value returned by latency_ticks(), in the
+ * histogram for 'stage'. */
+static inline void
+latency_record(struct latency_stats *ls, enum ofp_ext_latency_stage stage,
+               uint64_t start)
+{
+    latency_hist_record(&ls->stages[stage], start);
+}
+
+void latency_init(struct latency_stats *);
+uint64_t latency_ticks_per_sec(const struct latency_stats *);
+void latency_put_stats(const struct latency_stats *, struct ofpbuf *);
+
+#endif /* latency.h */
@@ -36,7 +36,13 @@
 #include "openflow/openflow-ext.h"
 #include "of_ext_msg.h"
 #include "netdev.h"
+#include "chain.h"
 #include "datapath.h"
+#include "dp_act.h"
+#include "shaper.h"
+#include "snapshot.h"
+#include "timeval.h"
+#include "xtoxll.h"
 
 #define THIS_MODULE VLM_experimental
 #include "vlog.h"
@@ -59,6 +65,7 @@ new_queue(struct sw_port * port, struct sw_queue * queue,
     queue->min_rate = ntohs(mr->rate);
 
     list_push_back(&port->queue_list, &queue->node);
+    dp_index_queues(port);
 
     return 0;
 }
@@ -78,10 +85,11 @@ port_add_queue(struct sw_port *p, uint32_t queue_id,
 }
 
 static int
-port_delete_queue(struct sw_port *p UNUSED, struct sw_queue *q)
+port_delete_queue(struct sw_port *p, struct sw_queue *q)
 {
     list_remove(&q->node);
     memset(q,'\0', sizeof *q);
+    dp_index_queues(p);
     return 0;
 }
 
@@ -107,7 +115,11 @@ recv_of_exp_queue_delete(struct datapath *dp,
     if (p->netdev) {
         q = dp_lookup_queue(p,queue_id);
         if (q) {
-            netdev_delete_class(p->netdev,q->class_id);
+            if (p->shaper) {
+                shaper_set_rate(p->shaper, q->class_id, 0);
+            } else {
+                netdev_delete_class(p->netdev,q->class_id);
+            }
             port_delete_queue(p,q);
         }
         else {
@@ -171,7 +183,12 @@ recv_of_exp_queue_modify(struct datapath *dp,
         q = dp_lookup_queue(p, queue_id);
         if (q) {
             /* queue exists - modify it */
-            error = netdev_change_class(p->netdev,q->class_id, ntohs(mr->rate));
+            if (p->shaper) {
+                shaper_set_rate(p->shaper, q->class_id, ntohs(mr->rate));
+            } else {
+                error = netdev_change_class(p->netdev, q->class_id,
+                                            ntohs(mr->rate));
+            }
             if (error) {
                 VLOG_ERR("Failed to update queue %d", queue_id);
                 dp_send_error_msg(dp, sender, OFPET_QUEUE_OP_FAILED,
@@ -193,7 +210,12 @@ recv_of_exp_queue_modify(struct datapath *dp,
                 return;
             }
             q = dp_lookup_queue(p, queue_id);
-            error = netdev_setup_class(p->netdev,q->class_id, ntohs(mr->rate));
+            if (p->shaper) {
+                shaper_set_rate(p->shaper, q->class_id, ntohs(mr->rate));
+            } else {
+                error = netdev_setup_class(p->netdev, q->class_id,
+                                           ntohs(mr->rate));
+            }
             if (error) {
                 VLOG_ERR("Failed to configure queue %d", queue_id);
                 dp_send_error_msg(dp, sender, OFPET_QUEUE_OP_FAILED,
@@ -236,6 +258,253 @@ recv_of_set_dp_desc(struct datapath *dp,
     dp->dp_desc[DESC_STR_LEN-1] = 0;        // force null for safety
 }
 
+/**
+ * Installs each flow record in an OFP_EXT_FLOW_IMPORT message, sending an
+ * error that carries the record for each one that cannot be installed
+ */
+static void
+recv_of_flow_import(struct datapath *dp, const struct sender *sender,
+                    const struct ofp_extension_header *exth)
+{
+    const struct ofp_ext_flow_import *ofi = (const void *) exth;
+    const uint8_t *p = (const uint8_t *) ofi->records;
+    const uint8_t *end = (const uint8_t *) ofi + ntohs(exth->header.length);
+    uint64_t now = time_msec();
+
+    while (p < end) {
+        const struct ofp_ext_flow_record *rec = (const void *) p;
+        size_t length = snapshot_record_len(p, end - p);
+        int error;
+
+        if (!length) {
+            dp_send_error_msg(dp, sender, OFPET_BAD_REQUEST, OFPBRC_BAD_LEN,
+                              exth, ntohs(exth->header.length));
+            return;
+        }
+        error = snapshot_import_flow(dp, rec, now);
+        if (error == ENOBUFS) {
+            dp_send_error_msg(dp, sender, OFPET_FLOW_MOD_FAILED,
+                              OFPFMFC_ALL_TABLES_FULL, rec, length);
+        } else if (error == EINVAL) {
+            dp_send_error_msg(dp, sender, OFPET_BAD_ACTION,
+                              OFPBAC_BAD_ARGUMENT, rec, length);
+        } else if (error) {
+            dp_send_error_msg(dp, sender, OFPET_FLOW_MOD_FAILED,
+                              OFPFMFC_EPERM, rec, length);
+        }
+        p += length;
+    }
+}
+
+/**
+ * Modifies or deletes the flows selected by cookie in an
+ * OFP_EXT_COOKIE_FLOW_MOD message
+ */
+static int
+recv_of_cookie_flow_mod(struct datapath *dp, const struct sender *sender,
+                        const struct ofp_extension_header *exth)
+{
+    const struct ofp_ext_cookie_flow_mod *ocm = (const void *) exth;
+    size_t length = ntohs(exth->header.length);
+    uint64_t cookie, mask;
+
+    if (length < sizeof *ocm) {
+        dp_send_error_msg(dp, sender, OFPET_BAD_REQUEST, OFPBRC_BAD_LEN,
+                          exth, length);
+        return -EINVAL;
+    }
+    cookie = ntohll(ocm->cookie);
+    mask = ntohll(ocm->cookie_mask);
+
+    if (ocm->command == htons(OFPFC_MODIFY)) {
+        size_t actions_len = length - sizeof *ocm;
+        struct sw_flow_key key;
+        uint16_t v_code;
+
+        /* Validate against a fully wildcarded key, since the selected flows
+         * may match anything. */
+        memset(&key, 0, sizeof key);
+        key.wildcards = OFPFW_ALL;
+        v_code = validate_actions(dp, &key, ocm->actions, actions_len);
+        if (v_code != ACT_VALIDATION_OK) {
+            dp_send_error_msg(dp, sender, OFPET_BAD_ACTION, v_code,
+                              ocm, length);
+            return -EINVAL;
+        }
+        chain_modify_cookie(dp->chain, cookie, mask,
+                            ocm->actions, actions_len);
+    } else if (ocm->command == htons(OFPFC_DELETE)) {
+        chain_delete_cookie(dp->chain, cookie, mask, ocm->out_port);
+    } else {
+        dp_send_error_msg(dp, sender, OFPET_FLOW_MOD_FAILED,
+                          OFPFMFC_BAD_COMMAND, ocm, length);
+        return -EINVAL;
+    }
+    return 0;
+}
+
+/**
+ * Switches the packet_ins for the sender's connection to or from a UDP
+ * channel, as requested by an OFP_EXT_PACKET_IN_UDP message
+ */
+static int
+recv_of_packet_in_udp(struct datapath *dp, const struct sender *sender,
+                      const struct ofp_extension_header *exth)
+{
+    const struct ofp_ext_packet_in_udp *opiu = (const void *) exth;
+    size_t length = ntohs(exth->header.length);
+    int error;
+
+    if (length != sizeof *opiu) {
+        dp_send_error_msg(dp, sender, OFPET_BAD_REQUEST, OFPBRC_BAD_LEN,
+                          exth, length);
+        return -EINVAL;
+    }
+    error = dp_set_packet_in_udp(dp, sender, opiu->ip, ntohs(opiu->port));
+    if (error) {
+        dp_send_error_msg(dp, sender, OFPET_BAD_REQUEST, OFPBRC_EPERM,
+                          exth, length);
+        return -error;
+    }
+    return 0;
+}
+
+/**
+ * Chooses the asynchronous messages for the sender's connection, as
+ * requested by an OFP_EXT_SET_ASYNC message
+ */
+static int
+recv_of_set_async(struct datapath *dp, const struct sender *sender,
+                  const struct ofp_extension_header *exth)
+{
+    const struct ofp_ext_set_async *osa = (const void *) exth;
+    size_t length = ntohs(exth->header.length);
+    int error;
+
+    if (length < sizeof *osa || (length - sizeof *osa) % sizeof osa->ports[0]) {
+        dp_send_error_msg(dp, sender, OFPET_BAD_REQUEST, OFPBRC_BAD_LEN,
+                          exth, length);
+        return -EINVAL;
+    }
+    error = dp_set_async(dp, sender, ntohl(osa->packet_in_mask),
+                         ntohl(osa->port_status_mask),
+                         ntohl(osa->flow_removed_mask),
+                         ntohl(osa->balance_id), osa->ports,
+                         (length - sizeof *osa) / sizeof osa->ports[0]);
+    if (error) {
+        dp_send_error_msg(dp, sender, OFPET_PORT_MOD_FAILED,
+                          OFPPMFC_BAD_PORT, exth, length);
+        return -error;
+    }
+    return 0;
+}
+
+/**
+ * Stops the asynchronous messages whose types an OFP_EXT_MONITOR_FILTER
+ * message leaves out from going to the sender's connection
+ */
+static int
+recv_of_monitor_filter(struct datapath *dp, const struct sender *sender,
+                       const struct ofp_extension_header *exth)
+{
+    const struct ofp_ext_monitor_filter *mf = (const void *) exth;
+    size_t length = ntohs(exth->header.length);
+    uint32_t types;
+
+    if (length != sizeof *mf) {
+        dp_send_error_msg(dp, sender, OFPET_BAD_REQUEST, OFPBRC_BAD_LEN,
+                          exth, length);
+        return -EINVAL;
+    }
+    types = ntohl(mf->types);
+#define TYPE_MASK(TYPE) (types & (1u << (TYPE)) ? UINT32_MAX : 0)
+    dp_set_async(dp, sender, TYPE_MASK(OFPT_PACKET_IN),
+                 TYPE_MASK(OFPT_PORT_STATUS), TYPE_MASK(OFPT_FLOW_REMOVED),
+                 0, NULL, 0);
+#undef TYPE_MASK
+    return 0;
+}
+
+/**
+ * Begins, commits or aborts the replacement of the flow table requested by
+ * an OFP_EXT_TABLE_REPLACE message
+ */
+static int
+recv_of_table_replace(struct datapath *dp, const struct sender *sender,
+                      const struct ofp_extension_header *exth)
+{
+    const struct ofp_ext_table_replace *otr = (const void *) exth;
+    size_t length = ntohs(exth->header.length);
+    int error;
+
+    if (length != sizeof *otr) {
+        dp_send_error_msg(dp, sender, OFPET_BAD_REQUEST, OFPBRC_BAD_LEN,
+                          exth, length);
+        return -EINVAL;
+    }
+    error = dp_replace_table(dp, sender, ntohs(otr->command));
+    if (error) {
+        dp_send_error_msg(dp, sender, OFPET_BAD_REQUEST,
+                          error == EPERM ? OFPBRC_EPERM : OFPBRC_BAD_SUBTYPE,
+                          exth, length);
+        return -error;
+    }
+    return 0;
+}
+
+/**
+ * Chooses the pipeline table that later flow_mods on the connection address,
+ * as requested by an OFP_EXT_SET_TABLE message
+ */
+static int
+recv_of_set_table(struct datapath *dp, const struct sender *sender,
+                  const struct ofp_extension_header *exth)
+{
+    const struct ofp_ext_set_table *ost = (const void *) exth;
+    size_t length = ntohs(exth->header.length);
+    int error;
+
+    if (length != sizeof *ost) {
+        dp_send_error_msg(dp, sender, OFPET_BAD_REQUEST, OFPBRC_BAD_LEN,
+                          exth, length);
+        return -EINVAL;
+    }
+    error = dp_set_table(dp, sender, ost->table_id);
+    if (error) {
+        dp_send_error_msg(dp, sender, OFPET_BAD_REQUEST,
+                          error == EPERM ? OFPBRC_EPERM : OFPBRC_BAD_SUBTYPE,
+                          exth, length);
+        return -error;
+    }
+    return 0;
+}
+
+/**
+ * Sets a pipeline table's miss behavior, as requested by an
+ * OFP_EXT_TABLE_MISS message
+ */
+static int
+recv_of_table_miss(struct datapath *dp, const struct sender *sender,
+                   const struct ofp_extension_header *exth)
+{
+    const struct ofp_ext_table_miss *otm = (const void *) exth;
+    size_t length = ntohs(exth->header.length);
+    int error;
+
+    if (length != sizeof *otm) {
+        dp_send_error_msg(dp, sender, OFPET_BAD_REQUEST, OFPBRC_BAD_LEN,
+                          exth, length);
+        return -EINVAL;
+    }
+    error = dp_set_table_miss(dp, otm->table_id, otm->miss);
+    if (error) {
+        dp_send_error_msg(dp, sender, OFPET_BAD_REQUEST, OFPBRC_BAD_SUBTYPE,
+                          exth, length);
+        return -error;
+    }
+    return 0;
+}
+
 /**
  * Receives an experimental message and pass it
  * to the appropriate handler
@@ -257,6 +526,25 @@ int of_ext_recv_msg(struct datapath *dp, const struct sender *sender,
     case OFP_EXT_SET_DESC:
         recv_of_set_dp_desc(dp,sender,ofexth);
         return 0;
+    case OFP_EXT_FLOW_IMPORT:
+        recv_of_flow_import(dp, sender, ofexth);
+        return 0;
+    case OFP_EXT_COOKIE_FLOW_MOD:
+        return recv_of_cookie_flow_mod(dp, sender, ofexth);
+    case OFP_EXT_PACKET_IN_UDP:
+        return recv_of_packet_in_udp(dp, sender, ofexth);
+    case OFP_EXT_SET_ASYNC:
+        return recv_of_set_async(dp, sender, ofexth);
+    case OFP_EXT_MONITOR_FILTER:
+        return recv_of_monitor_filter(dp, sender, ofexth);
+    case OFP_EXT_PACKET_OUT_BATCH:
+        return dp_packet_out_batch(dp, sender, (const void *) ofexth);
+    case OFP_EXT_TABLE_REPLACE:
+        return recv_of_table_replace(dp, sender, ofexth);
+    case OFP_EXT_SET_TABLE:
+        return recv_of_set_table(dp, sender, ofexth);
+    case OFP_EXT_TABLE_MISS:
+        return recv_of_table_miss(dp, sender, ofexth);
     default:
         VLOG_ERR("Received unknown command of type %d",
                  ntohl(ofexth->subtype));
@@ -0,0 +1,194 @@
+/* Copyright (c) 2008 The Board of Trustees of The Leland Stanford
+ * Junior University
+ * 
+ * We are making the OpenFlow specification and associated documentation
+ * (Software) available for public use and benefit with the expectation
+ * that others will use, modify and enhance the Software and contribute
+ * those enhancements back to the community. However, since we would
+ * like to make the Software available for broadest use, with as few
+ * restrictions as possible permission is hereby granted, free of
+ * charge, to any person obtaining a copy of this Software to deal in
+ * the Software under the copyrights without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ * The name and trademarks of copyright holder(s) may NOT be used in
+ * advertising or publicity pertaining to the Software or any
+ * derivatives without specific, written prior permission.
+ */
+
+#include <config.h>
+#include "pending-miss.h"
+#include <stdlib.h>
+#include "hash.h"
+#include "ofpbuf.h"
+#include "poll-loop.h"
+#include "timeval.h"
+#include "util.h"
+
+/* Creates and returns a table that holds packets for 'hold_msec'
+ * milliseconds at most. */
+struct pending_misses *
+pending_misses_create(unsigned int hold_msec)
+{
+    struct pending_misses *pm = xcalloc(1, sizeof *pm);
+
+    pm->hold_msec = hold_msec;
+    hmap_init(&pm->flows);
+    hmap_init(&pm->ids);
+    list_init(&pm->by_age);
+    return pm;
+}
+
+static void
+remove_miss(struct pending_misses *pm, struct pending_miss *miss)
+{
+    hmap_remove(&pm->flows, &miss->flow_node);
+    hmap_remove(&pm->ids, &miss->id_node);
+    list_remove(&miss->age_node);
+}
+
+/* Destroys 'pm', which may be null, along with any packets it holds. */
+void
+pending_misses_destroy(struct pending_misses *pm)
+{
+    if (pm) {
+        struct pending_miss *miss, *next;
+
+        LIST_FOR_EACH_SAFE (miss, next, struct pending_miss, age_node,
+                            &pm->by_age) {
+            size_t i;
+
+            for (i = 0; i < miss->n_packets; i++) {
+                ofpbuf_delete(miss->packets[i]);
+            }
+            free(miss);
+        }
+        hmap_destroy(&pm->flows);
+        hmap_destroy(&pm->ids);
+        free(pm);
+    }
+}
+
+static struct pending_miss *
+find_flow(const struct pending_misses *pm, const struct flow *flow)
+{
+    struct pending_miss *miss;
+
+    HMAP_FOR_EACH_WITH_HASH (miss, struct pending_miss, flow_node,
+                             flow_hash(flow, 0), &pm->flows) {
+        if (flow_equal(&miss->flow, flow)) {
+            return miss;
+        }
+    }
+    return NULL;
+}
+
+/* If a miss with exactly 'flow' is waiting for the controller's answer and
+ * has room for another packet, takes ownership of 'buffer', holds it behind
+ * that miss, and returns true.  Otherwise, returns false, and the caller
+ * should send 'buffer' to the controller itself. */
+bool
+pending_misses_hold(struct pending_misses *pm, const struct flow *flow,
+                    struct ofpbuf *buffer)
+{
+    struct pending_miss *miss = find_flow(pm, flow);
+
+    if (!miss || miss->n_packets >= PENDING_MISS_MAX_PACKETS) {
+        return false;
+    }
+    miss->packets[miss->n_packets++] = buffer;
+    pm->n_held++;
+    return true;
+}
+
+/* Records that a miss with exactly 'flow' was sent to the controller with
+ * 'buffer_id', so that later misses with the same flow are held behind it.
+ * Does nothing if such a miss is already waiting. */
+void
+pending_misses_start(struct pending_misses *pm, const struct flow *flow,
+                     uint32_t buffer_id)
+{
+    struct pending_miss *miss;
+
+    if (find_flow(pm, flow)) {
+        return;
+    }
+    miss = xmalloc(sizeof *miss);
+    miss->flow = *flow;
+    miss->buffer_id = buffer_id;
+    miss->expires = time_msec() + pm->hold_msec;
+    miss->n_packets = 0;
+    hmap_insert(&pm->flows, &miss->flow_node, flow_hash(flow, 0));
+    hmap_insert(&pm->ids, &miss->id_node, hash_words(&buffer_id, 1, 0));
+    list_push_back(&pm->by_age, &miss->age_node);
+}
+
+/* Removes and returns the miss sent with 'buffer_id', if any, for the caller
+ * to treat its held packets as the controller's answer treats the packet it
+ * names.  The caller owns the packets and must free the miss with free(). */
+struct pending_miss *
+pending_misses_take(struct pending_misses *pm, uint32_t buffer_id)
+{
+    struct pending_miss *miss;
+
+    HMAP_FOR_EACH_WITH_HASH (miss, struct pending_miss, id_node,
+                             hash_words(&buffer_id, 1, 0), &pm->ids) {
+        if (miss->buffer_id == buffer_id) {
+            remove_miss(pm, miss);
+            pm->n_answered += miss->n_packets;
+            return miss;
+        }
+    }
+    return NULL;
+}
+
+/* Removes and returns a miss whose hold has ended, if any, for the caller to
+ * send its held packets back through the flow table.  The caller owns the
+ * packets and must free the miss with free(). */
+struct pending_miss *
+pending_misses_take_expired(struct pending_misses *pm)
+{
+    struct pending_miss *miss;
+
+    if (list_is_empty(&pm->by_age)) {
+        return NULL;
+    }
+    miss = CONTAINER_OF(list_front(&pm->by_age), struct pending_miss,
+                        age_node);
+    if (time_msec() < miss->expires) {
+        return NULL;
+    }
+    remove_miss(pm, miss);
+    pm->n_expired += miss->n_packets;
+    return miss;
+}
+
+/* Arranges for poll_block() to wake up when the oldest hold ends. */
+void
+pending_misses_wait(struct pending_misses *pm)
+{
+    if (!list_is_empty(&pm->by_age)) {
+        struct pending_miss *miss;
+        long long int delay;
+
+        miss = CONTAINER_OF(list_front(&pm->by_age), struct pending_miss,
+                            age_node);
+        delay = miss->expires - time_msec();
+        poll_timer_wait(delay > 0 ? delay : 0);
+    }
+}
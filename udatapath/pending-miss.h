@@ -0,0 +1,108 @@
+/* Copyright (c) 2008 The Board of Trustees of The Leland Stanford
+ * Junior University
+ * 
+ * We are making the OpenFlow specification and associated documentation
+ * (Software) available for public use and benefit with the expectation
+ * that others will use, modify and enhance the Software and contribute
+ * those enhancements back to the community. However, since we would
+ * like to make the Software available for broadest use, with as few
+ * restrictions as possible permission is hereby granted, free of
+ * charge, to any person obtaining a copy of this Software to deal in
+ * the Software under the copyrights without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ * The name and trademarks of copyright holder(s) may NOT be used in
+ * advertising or publicity pertaining to the Software or any
+ * derivatives without specific, written prior permission.
+ */
+
+/* Holding back repeated misses for a flow that the controller is setting up.
+ *
+ * Until a controller answers the packet_in for a flow's first packet, every
+ * later packet of the flow misses in the flow table too, and would cost a
+ * packet buffer and a packet_in of its own.  A short TCP burst can send the
+ * controller dozens of packet_ins for one flow, and its answers to the later
+ * ones may forward those packets ahead of the earlier ones.
+ *
+ * Instead, after a miss is sent to the controller with a buffer ID, later
+ * misses with the same exact flow are held in order behind it, up to
+ * PENDING_MISS_MAX_PACKETS of them.  When the controller answers the first
+ * packet_in, with a flow_mod or packet_out that names its buffer ID, the held
+ * packets are taken out to be treated the same way, right after the packet
+ * that was buffered.  If no answer comes within the hold time, they are
+ * taken out to go back through the flow table. */
+
+#ifndef PENDING_MISS_H
+#define PENDING_MISS_H 1
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "flow.h"
+#include "hmap.h"
+#include "list.h"
+
+struct ofpbuf;
+
+/* Most packets held behind one miss. */
+#define PENDING_MISS_MAX_PACKETS 32
+
+/* Default and greatest hold time, in milliseconds.  The greatest is less
+ * than the time for which a packet buffer's ID stays valid, so that an
+ * answer that names a buffer ID can only be for the miss that the packets
+ * are held behind. */
+#define PENDING_MISS_DEFAULT_MSEC 100
+#define PENDING_MISS_MAX_MSEC 900
+
+/* Packets held behind the miss sent as 'buffer_id'. */
+struct pending_miss {
+    struct hmap_node flow_node; /* In 'flows', hashed on 'flow'. */
+    struct hmap_node id_node;   /* In 'ids', hashed on 'buffer_id'. */
+    struct list age_node;       /* In 'by_age', oldest first. */
+    struct flow flow;
+    uint32_t buffer_id;
+    long long int expires;      /* time_msec() when the hold ends. */
+    size_t n_packets;
+    struct ofpbuf *packets[PENDING_MISS_MAX_PACKETS];
+};
+
+struct pending_misses {
+    unsigned int hold_msec;
+    struct hmap flows;
+    struct hmap ids;
+    struct list by_age;
+
+    /* Statistics. */
+    unsigned long long int n_held;     /* Packets held. */
+    unsigned long long int n_answered; /* Held packets taken on an answer. */
+    unsigned long long int n_expired;  /* Held packets whose hold ended. */
+};
+
+struct pending_misses *pending_misses_create(unsigned int hold_msec);
+void pending_misses_destroy(struct pending_misses *);
+
+bool pending_misses_hold(struct pending_misses *, const struct flow *,
+                         struct ofpbuf *);
+void pending_misses_start(struct pending_misses *, const struct flow *,
+                          uint32_t buffer_id);
+struct pending_miss *pending_misses_take(struct pending_misses *,
+                                         uint32_t buffer_id);
+struct pending_miss *pending_misses_take_expired(struct pending_misses *);
+void pending_misses_wait(struct pending_misses *);
+
+#endif /* pending-miss.h */
@@ -0,0 +1,222 @@
+/* Copyright (c) 2008 The Board of Trustees of The Leland Stanford
+ * Junior University
+ * 
+ * We are making the OpenFlow specification and associated documentation
+ * (Software) available for public use and benefit with the expectation
+ * that others will use, modify and enhance the Software and contribute
+ * those enhancements back to the community. However, since we would
+ * like to make the Software available for broadest use, with as few
+ * restrictions as possible permission is hereby granted, free of
+ * charge, to any person obtaining a copy of this Software to deal in
+ * the Software under the copyrights without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ * The name and trademarks of copyright holder(s) may NOT be used in
+ * advertising or publicity pertaining to the Software or any
+ * derivatives without specific, written prior permission.
+ */
+
+#include <config.h>
+#include "pkt-ring.h"
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef HAVE_EVENTFD
+#include <sys/eventfd.h>
+#endif
+#include "ofpbuf.h"
+#include "poll-loop.h"
+#include "socket-util.h"
+#include "util.h"
+
+#define THIS_MODULE VLM_datapath
+#include "vlog.h"
+
+static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(60, 60);
+
+/* Full memory barrier.  Each side publishes its own index and then reads the
+ * other side's, so a store-load barrier is needed, not just ordering of
+ * stores among themselves. */
+#define pkt_ring_barrier() __sync_synchronize()
+
+struct pkt_ring {
+    /* Written only by the producer.  'head' is the number of packets ever
+     * added to the ring. */
+    volatile unsigned int head;
+    unsigned long long int n_dropped;
+
+    /* Written only by the consumer.  'tail' is the number of packets ever
+     * taken from the ring.  Kept on a separate cache line from 'head', so
+     * that the two threads do not bounce a line back and forth. */
+    volatile unsigned int tail __attribute__((aligned(64)));
+
+    /* Read-only after creation. */
+    unsigned int mask __attribute__((aligned(64)));
+    int wake_fds[2];            /* Read, write ends; the same fd for an
+                                 * eventfd. */
+    struct ofpbuf *slots[];
+};
+
+/* Creates and returns a new ring that holds at least 'min_size' packets. */
+struct pkt_ring *
+pkt_ring_create(unsigned int min_size)
+{
+    struct pkt_ring *ring;
+    unsigned int size;
+
+    for (size = 1; size < min_size; size <<= 1) {
+        continue;
+    }
+    ring = xcalloc(1, sizeof *ring + size * sizeof *ring->slots);
+    ring->mask = size - 1;
+
+#ifdef HAVE_EVENTFD
+    ring->wake_fds[0] = ring->wake_fds[1] = eventfd(0, 0);
+    if (ring->wake_fds[0] < 0) {
+        ofp_fatal(errno, "eventfd failed");
+    }
+    set_nonblocking(ring->wake_fds[0]);
+#else
+    if (pipe(ring->wake_fds) < 0) {
+        ofp_fatal(errno, "pipe failed");
+    }
+    set_nonblocking(ring->wake_fds[0]);
+    set_nonblocking(ring->wake_fds[1]);
+#endif
+    return ring;
+}
+
+/* Destroys 'ring' and the packets still in it.  Neither side may be using
+ * 'ring' any longer. */
+void
+pkt_ring_destroy(struct pkt_ring *ring)
+{
+    if (ring) {
+        while (ring->tail != ring->head) {
+            ofpbuf_delete(ring->slots[ring->tail++ & ring->mask]);
+        }
+        close(ring->wake_fds[0]);
+        if (ring->wake_fds[1] != ring->wake_fds[0]) {
+            close(ring->wake_fds[1]);
+        }
+        free(ring);
+    }
+}
+
+static void
+pkt_ring_wake(struct pkt_ring *ring)
+{
+#ifdef HAVE_EVENTFD
+    static const uint64_t one = 1;
+    const void *data = &one;
+    size_t size = sizeof one;
+#else
+    const void *data = "";
+    size_t size = 1;
+#endif
+
+    /* If the eventfd counter or the pipe is full, the consumer is already
+     * due to wake up. */
+    if (write(ring->wake_fds[1], data, size) < 0 && errno != EAGAIN) {
+        VLOG_WARN_RL(&rl, "failed to wake packet ring consumer: %s",
+                     strerror(errno));
+    }
+}
+
+/* Adds 'buffer' to 'ring'.  Returns true if successful.  If 'ring' is full,
+ * deletes 'buffer', counts it as dropped, and returns false.
+ *
+ * Only a single thread may call this function on a given ring. */
+bool
+pkt_ring_put(struct pkt_ring *ring, struct ofpbuf *buffer)
+{
+    unsigned int head = ring->head;
+
+    if (head - ring->tail > ring->mask) {
+        ring->n_dropped++;
+        ofpbuf_delete(buffer);
+        return false;
+    }
+
+    ring->slots[head & ring->mask] = buffer;
+    pkt_ring_barrier();
+    ring->head = head + 1;
+    pkt_ring_barrier();
+
+    /* If the consumer had already emptied the ring, it may be about to
+     * sleep, so wake it up.  Otherwise it will get to this packet before it
+     * checks for more. */
+    if (ring->tail == head) {
+        pkt_ring_wake(ring);
+    }
+    return true;
+}
+
+/* Removes and returns the oldest packet in 'ring', or a null pointer if it
+ * is empty.
+ *
+ * Only a single thread may call this function, pkt_ring_wait(), or
+ * pkt_ring_n_dropped() on a given ring. */
+struct ofpbuf *
+pkt_ring_get(struct pkt_ring *ring)
+{
+    unsigned int tail = ring->tail;
+    struct ofpbuf *buffer;
+
+    if (tail == ring->head) {
+        char buf[64];
+
+        /* Every wakeup so far is for a packet already taken.  One for a
+         * packet added after the check above makes pkt_ring_wait() wake
+         * immediately, so discarding it here is harmless. */
+        while (read(ring->wake_fds[0], buf, sizeof buf) > 0) {
+            continue;
+        }
+        return NULL;
+    }
+
+    pkt_ring_barrier();
+    buffer = ring->slots[tail & ring->mask];
+    pkt_ring_barrier();
+    ring->tail = tail + 1;
+    pkt_ring_barrier();
+    return buffer;
+}
+
+/* Arranges for poll_block() to wake up when 'ring' has a packet to take. */
+void
+pkt_ring_wait(struct pkt_ring *ring)
+{
+    if (ring->tail != ring->head) {
+        poll_immediate_wake();
+    } else {
+        poll_fd_wait(ring->wake_fds[0], POLLIN);
+    }
+}
+
+/* Returns the number of packets dropped because 'ring' was full.  The count
+ * is updated by the producer without synchronization, so it may lag
+ * slightly. */
+unsigned long long int
+pkt_ring_n_dropped(const struct pkt_ring *ring)
+{
+    return ring->n_dropped;
+}
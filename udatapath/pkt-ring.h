@@ -0,0 +1,61 @@
+/* Copyright (c) 2008 The Board of Trustees of The Leland Stanford
+ * Junior University
+ * 
+ * We are making the OpenFlow specification and associated documentation
+ * (Software) available for public use and benefit with the expectation
+ * that others will use, modify and enhance the Software and contribute
+ * those enhancements back to the community. However, since we would
+ * like to make the Software available for broadest use, with as few
+ * restrictions as possible permission is hereby granted, free of
+ * charge, to any person obtaining a copy of this Software to deal in
+ * the Software under the copyrights without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ * The name and trademarks of copyright holder(s) may NOT be used in
+ * advertising or publicity pertaining to the Software or any
+ * derivatives without specific, written prior permission.
+ */
+
+/* Single-producer, single-consumer packet ring.
+ *
+ * A pkt_ring is a fixed-size circular queue of packets that one thread
+ * fills and another drains, without a lock and without allocating per
+ * packet.  A full ring drops packets and counts them.  The consumer side
+ * integrates with the poll loop: pkt_ring_wait() arranges for poll_block()
+ * to wake up when the producer adds a packet to an empty ring. */
+
+#ifndef PKT_RING_H
+#define PKT_RING_H 1
+
+#include <stdbool.h>
+
+struct ofpbuf;
+struct pkt_ring;
+
+struct pkt_ring *pkt_ring_create(unsigned int min_size);
+void pkt_ring_destroy(struct pkt_ring *);
+
+/* Producer. */
+bool pkt_ring_put(struct pkt_ring *, struct ofpbuf *);
+
+/* Consumer. */
+struct ofpbuf *pkt_ring_get(struct pkt_ring *);
+void pkt_ring_wait(struct pkt_ring *);
+unsigned long long int pkt_ring_n_dropped(const struct pkt_ring *);
+
+#endif /* pkt-ring.h */
@@ -0,0 +1,317 @@
+/* Copyright (c) 2008 The Board of Trustees of The Leland Stanford
+ * Junior University
+ * 
+ * We are making the OpenFlow specification and associated documentation
+ * (Software) available for public use and benefit with the expectation
+ * that others will use, modify and enhance the Software and contribute
+ * those enhancements back to the community. However, since we would
+ * like to make the Software available for broadest use, with as few
+ * restrictions as possible permission is hereby granted, free of
+ * charge, to any person obtaining a copy of this Software to deal in
+ * the Software under the copyrights without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ * The name and trademarks of copyright holder(s) may NOT be used in
+ * advertising or publicity pertaining to the Software or any
+ * derivatives without specific, written prior permission.
+ */
+
+#include <config.h>
+#include "pktbuf.h"
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include "flow.h"
+#include "ofpbuf.h"
+#include "timeval.h"
+#include "dp-trace.h"
+
+#define THIS_MODULE VLM_datapath
+#include "vlog.h"
+
+static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(60, 60);
+
+/* A saved packet is not overwritten by a newer one until it is at least this
+ * old. */
+#define OVERWRITE_SECS  1
+
+struct packet_buffer {
+    struct ofpbuf *buffer;
+    unsigned int owner;         /* 'owner' of the pktbuf that saved it. */
+    uint32_t cookie;
+    time_t timeout;
+    uint64_t saved;             /* Caller's timestamp from pktbuf_save(). */
+    bool has_flow;              /* Is 'flow' valid? */
+    struct flow flow;           /* Flow extracted from 'buffer'. */
+};
+
+/* The buffers themselves, which any number of pktbufs may share. */
+struct pktbuf_store {
+    struct packet_buffer *buffers;
+    unsigned int n_buffers;     /* Number of 'buffers', a power of 2. */
+    unsigned int buffer_bits;   /* log2(n_buffers). */
+    unsigned int buffer_idx;    /* Most recently used buffer. */
+    unsigned int n_refs;        /* Number of pktbufs using this store. */
+    unsigned int next_owner;    /* Owner ID for the next pktbuf_share(). */
+    struct pktbuf_stats stats;
+};
+
+struct pktbuf {
+    struct pktbuf_store *store;
+    unsigned int owner;         /* Distinguishes this pktbuf's packets from
+                                 * those of others sharing 'store'. */
+};
+
+/* Returns a new pktbuf that saves packets in 'store'. */
+static struct pktbuf *
+share_store(struct pktbuf_store *store)
+{
+    struct pktbuf *pb = malloc(sizeof *pb);
+    if (pb) {
+        pb->store = store;
+        pb->owner = store->next_owner++;
+        store->n_refs++;
+    }
+    return pb;
+}
+
+/* Creates and returns a new packet buffer store with room for at least
+ * 'n_buffers' packets (but at least 2 and no more than PKTBUF_MAX_BUFFERS),
+ * or a null pointer if memory could not be allocated. */
+struct pktbuf *
+pktbuf_create(unsigned int n_buffers)
+{
+    struct pktbuf_store *store;
+    struct pktbuf *pb;
+    unsigned int bits;
+
+    if (n_buffers > PKTBUF_MAX_BUFFERS) {
+        n_buffers = PKTBUF_MAX_BUFFERS;
+    }
+    for (bits = 1; (1u << bits) < n_buffers; bits++) {
+        continue;
+    }
+
+    store = malloc(sizeof *store);
+    if (!store) {
+        return NULL;
+    }
+    store->n_buffers = 1u << bits;
+    store->buffer_bits = bits;
+    store->buffer_idx = 0;
+    store->n_refs = 0;
+    store->next_owner = 0;
+    store->buffers = calloc(store->n_buffers, sizeof *store->buffers);
+    if (!store->buffers) {
+        free(store);
+        return NULL;
+    }
+    memset(&store->stats, 0, sizeof store->stats);
+    store->stats.n_buffers = store->n_buffers;
+
+    pb = share_store(store);
+    if (!pb) {
+        free(store->buffers);
+        free(store);
+    }
+    return pb;
+}
+
+/* Returns a new pktbuf that saves packets in the same buffers as 'pb', or a
+ * null pointer if memory could not be allocated.  This lets several
+ * datapaths in one process draw on one pool of buffers instead of sizing a
+ * pool for each.  A packet saved through one of the pktbufs can only be
+ * retrieved through that one, so that buffer IDs cannot cross from one
+ * datapath to another.  The statistics cover the whole pool. */
+struct pktbuf *
+pktbuf_share(struct pktbuf *pb)
+{
+    return share_store(pb->store);
+}
+
+/* Destroys 'pb' and frees all of the packets saved through it.  The buffers
+ * are freed along with the last pktbuf that shares them. */
+void
+pktbuf_destroy(struct pktbuf *pb)
+{
+    if (pb) {
+        struct pktbuf_store *store = pb->store;
+        unsigned int i;
+
+        for (i = 0; i < store->n_buffers; i++) {
+            struct packet_buffer *p = &store->buffers[i];
+            if (p->buffer && p->owner == pb->owner) {
+                ofpbuf_delete(p->buffer);
+                p->buffer = NULL;
+                store->stats.n_used--;
+            }
+        }
+        if (!--store->n_refs) {
+            free(store->buffers);
+            free(store);
+        }
+        free(pb);
+    }
+}
+
+/* Returns the number of packets that 'pb' can hold. */
+unsigned int
+pktbuf_capacity(const struct pktbuf *pb)
+{
+    return pb->store->n_buffers;
+}
+
+/* Attempts to save 'buffer' in 'pb'.  If successful, takes ownership of
+ * 'buffer' and returns its buffer ID.  Otherwise, returns UINT32_MAX and the
+ * caller retains ownership of 'buffer'.
+ *
+ * If 'flow' is nonnull, it must be the flow extracted from 'buffer' as it is
+ * now, and pktbuf_get_flow() hands it back so that a flow_mod that releases
+ * the packet need not parse it again.  'buffer''s layer pointers are kept
+ * along with it, so a flow extracted only as far as FLOW_LAYER_L2 can still
+ * be completed with flow_extract_finish().
+ *
+ * 'now' is a timestamp, in any unit, that pktbuf_retrieve() later hands back
+ * so that the caller can tell how long the packet waited. */
+uint32_t
+pktbuf_save(struct pktbuf *pb, struct ofpbuf *buffer, const struct flow *flow,
+            uint64_t now)
+{
+    struct pktbuf_store *store = pb->store;
+    struct packet_buffer *p;
+    unsigned int cookie_bits = 32 - store->buffer_bits;
+    uint32_t id;
+
+    store->buffer_idx = (store->buffer_idx + 1) & (store->n_buffers - 1);
+    p = &store->buffers[store->buffer_idx];
+    if (p->buffer) {
+        /* Don't buffer packet if existing entry is less than
+         * OVERWRITE_SECS old. */
+        if (time_now() < p->timeout) {
+            store->stats.n_full++;
+            DP_TRACE2(save_buffer, UINT32_MAX, buffer->size);
+            return UINT32_MAX;
+        }
+        ofpbuf_delete(p->buffer);
+        store->stats.n_evicted++;
+        store->stats.n_used--;
+    }
+
+    /* Don't use maximum cookie value since the all-bits-1 id is
+     * special. */
+    if (++p->cookie >= (1u << cookie_bits) - 1) {
+        p->cookie = 0;
+    }
+    p->buffer = buffer;
+    p->owner = pb->owner;
+    p->timeout = time_now() + OVERWRITE_SECS;
+    p->saved = now;
+    p->has_flow = flow != NULL;
+    if (flow) {
+        p->flow = *flow;
+    }
+    store->stats.n_saved++;
+    store->stats.n_used++;
+
+    id = store->buffer_idx | (p->cookie << store->buffer_bits);
+    DP_TRACE2(save_buffer, id, buffer->size);
+    return id;
+}
+
+/* If the packet with the given 'id' in 'pb' was saved along with its flow,
+ * copies the flow into '*flow' and returns true.  Otherwise, including when
+ * 'id' is not (or is no longer) valid, returns false.  This does not remove
+ * the packet from 'pb', so it should be called before pktbuf_retrieve(). */
+bool
+pktbuf_get_flow(const struct pktbuf *pb, uint32_t id, struct flow *flow)
+{
+    const struct pktbuf_store *store = pb->store;
+    const struct packet_buffer *p
+        = &store->buffers[id & (store->n_buffers - 1)];
+
+    if (p->cookie != id >> store->buffer_bits || !p->buffer
+        || p->owner != pb->owner || !p->has_flow) {
+        return false;
+    }
+    *flow = p->flow;
+    return true;
+}
+
+/* Removes the packet with the given 'id' from 'pb' and returns it, or returns
+ * a null pointer if 'id' is not (or is no longer) valid.  If 'saved' is
+ * nonnull and a packet is returned, stores its pktbuf_save() timestamp in
+ * '*saved'. */
+static struct ofpbuf *
+pktbuf_take(struct pktbuf *pb, uint32_t id, uint64_t *saved)
+{
+    struct pktbuf_store *store = pb->store;
+    struct packet_buffer *p = &store->buffers[id & (store->n_buffers - 1)];
+    struct ofpbuf *buffer;
+
+    if (p->cookie != id >> store->buffer_bits) {
+        VLOG_DBG_RL(&rl, "cookie mismatch: %x != %x",
+                    id >> store->buffer_bits, p->cookie);
+        return NULL;
+    }
+    if (p->buffer && p->owner != pb->owner) {
+        VLOG_DBG_RL(&rl, "buffer %"PRIx32" belongs to another datapath", id);
+        return NULL;
+    }
+
+    buffer = p->buffer;
+    if (buffer) {
+        p->buffer = NULL;
+        store->stats.n_used--;
+        if (saved) {
+            *saved = p->saved;
+        }
+    }
+    return buffer;
+}
+
+/* Looks up the buffer with the given 'id' in 'pb'.  Returns its packet and
+ * transfers ownership of it to the caller, or returns a null pointer if 'id'
+ * is not (or is no longer) valid.  If 'saved' is nonnull and a packet is
+ * returned, stores the timestamp passed to pktbuf_save() in '*saved'.
+ *
+ * A saved packet may share its memory with a packet-in message that is still
+ * queued for transmission, so the packet is unshared here before the caller
+ * can modify it.  That only copies it if the message has not yet been sent. */
+struct ofpbuf *
+pktbuf_retrieve(struct pktbuf *pb, uint32_t id, uint64_t *saved)
+{
+    struct ofpbuf *buffer = pktbuf_take(pb, id, saved);
+    if (buffer) {
+        ofpbuf_unshare(buffer);
+    }
+    return buffer;
+}
+
+/* Frees the packet with the given 'id' in 'pb', if 'id' is valid. */
+void
+pktbuf_discard(struct pktbuf *pb, uint32_t id)
+{
+    ofpbuf_delete(pktbuf_take(pb, id, NULL));
+}
+
+/* Stores statistics for 'pb''s buffers in 'stats'. */
+void
+pktbuf_get_stats(const struct pktbuf *pb, struct pktbuf_stats *stats)
+{
+    *stats = pb->store->stats;
+}
@@ -0,0 +1,81 @@
+/* Copyright (c) 2008 The Board of Trustees of The Leland Stanford
+ * Junior University
+ * 
+ * We are making the OpenFlow specification and associated documentation
+ * (Software) available for public use and benefit with the expectation
+ * that others will use, modify and enhance the Software and contribute
+ * those enhancements back to the community. However, since we would
+ * like to make the Software available for broadest use, with as few
+ * restrictions as possible permission is hereby granted, free of
+ * charge, to any person obtaining a copy of this Software to deal in
+ * the Software under the copyrights without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ * The name and trademarks of copyright holder(s) may NOT be used in
+ * advertising or publicity pertaining to the Software or any
+ * derivatives without specific, written prior permission.
+ */
+
+/* Packets held by the datapath on behalf of the controller.
+ *
+ * A packet sent to the controller in an OFPT_PACKET_IN message is saved in
+ * the store, so that the message need only carry the first few bytes of it
+ * and a buffer ID.  The controller later names the ID in an
+ * OFPT_PACKET_OUT or OFPT_FLOW_MOD to have the whole packet forwarded.
+ *
+ * A buffer ID is divided into a buffer number (low bits), which indexes the
+ * store's array of buffers, and a cookie (high bits), which distinguishes
+ * between different packets that have occupied a single buffer.  Thus, the
+ * more buffers there are, the lower-quality the cookie. */
+
+#ifndef PKTBUF_H
+#define PKTBUF_H 1
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct flow;
+struct ofpbuf;
+
+/* Default and maximum number of buffers in a store. */
+#define PKTBUF_DEFAULT_BUFFERS 256
+#define PKTBUF_MAX_BUFFERS (1u << 20)
+
+struct pktbuf_stats {
+    unsigned int n_buffers;     /* Number of buffers in the store. */
+    unsigned int n_used;        /* Buffers currently holding a packet. */
+    uint64_t n_saved;           /* Packets saved. */
+    uint64_t n_evicted;         /* Unclaimed packets dropped to make room. */
+    uint64_t n_full;            /* Packets not saved for lack of room. */
+};
+
+struct pktbuf *pktbuf_create(unsigned int n_buffers);
+struct pktbuf *pktbuf_share(struct pktbuf *);
+void pktbuf_destroy(struct pktbuf *);
+unsigned int pktbuf_capacity(const struct pktbuf *);
+
+uint32_t pktbuf_save(struct pktbuf *, struct ofpbuf *, const struct flow *,
+                     uint64_t now);
+bool pktbuf_get_flow(const struct pktbuf *, uint32_t id, struct flow *);
+struct ofpbuf *pktbuf_retrieve(struct pktbuf *, uint32_t id,
+                               uint64_t *saved);
+void pktbuf_discard(struct pktbuf *, uint32_t id);
+
+void pktbuf_get_stats(const struct pktbuf *, struct pktbuf_stats *);
+
+#endif /* pktbuf.h */
@@ -0,0 +1,161 @@
+/* Copyright (c) 2008 The Board of Trustees of The Leland Stanford
+ * Junior University
+ * 
+ * We are making the OpenFlow specification and associated documentation
+ * (Software) available for public use and benefit with the expectation
+ * that others will use, modify and enhance the Software and contribute
+ * those enhancements back to the community. However, since we would
+ * like to make the Software available for broadest use, with as few
+ * restrictions as possible permission is hereby granted, free of
+ * charge, to any person obtaining a copy of this Software to deal in
+ * the Software under the copyrights without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ * The name and trademarks of copyright holder(s) may NOT be used in
+ * advertising or publicity pertaining to the Software or any
+ * derivatives without specific, written prior permission.
+ */
+
+#include <config.h>
+#include "policer.h"
+#include <stdlib.h>
+#include <time.h>
+#include "hash.h"
+#include "hmap.h"
+#include "util.h"
+
+/* A bucket with a burst of 0 holds this much time's worth of tokens at its
+ * rate, but never less than POLICER_MIN_BURST bytes, so that a full-size
+ * frame always fits. */
+#define POLICER_BURST_USEC 2000
+#define POLICER_MIN_BURST (2 * 1522)
+
+/* Tokens are kept in millibits, the amount that a rate in kbps earns in a
+ * microsecond, as in the shaper. */
+#define POLICER_COST(BYTES) ((int64_t) (BYTES) * 8000)
+
+struct policer {
+    struct hmap_node node;      /* In 'policers'. */
+    uint32_t meter_id;
+    uint32_t rate;              /* Fill rate in kbps. */
+    uint32_t burst;             /* Configured burst in kbits, or 0. */
+    int64_t depth;              /* Maximum tokens, in millibits. */
+    int64_t tokens;             /* Current tokens, in millibits. */
+    long long int last_refill;  /* Microseconds, monotonic. */
+};
+
+static struct hmap policers = HMAP_INITIALIZER(&policers);
+static unsigned long long int n_passed, n_exceeded;
+
+static long long int
+policer_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long int) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static uint32_t
+policer_hash(uint32_t meter_id)
+{
+    return hash_words(&meter_id, 1, 0);
+}
+
+/* Returns the policer for 'meter_id', or a null pointer if there is none. */
+struct policer *
+policer_lookup(uint32_t meter_id)
+{
+    struct policer *p;
+
+    HMAP_FOR_EACH_WITH_HASH (p, struct policer, node, policer_hash(meter_id),
+                             &policers) {
+        if (p->meter_id == meter_id) {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+/* Creates and returns a policer for 'meter_id', which must not have one
+ * yet, that fills at 'rate' kbps up to 'burst' kbits, or a default size if
+ * 'burst' is 0.  The bucket starts full.  Returns a null pointer if there
+ * are already POLICER_MAX policers. */
+struct policer *
+policer_create(uint32_t meter_id, uint32_t rate, uint32_t burst)
+{
+    struct policer *p;
+
+    if (hmap_count(&policers) >= POLICER_MAX) {
+        return NULL;
+    }
+
+    p = xmalloc(sizeof *p);
+    p->meter_id = meter_id;
+    p->rate = rate;
+    p->burst = burst;
+    p->depth = (burst
+                ? (int64_t) burst * 1000000
+                : MAX((int64_t) rate * POLICER_BURST_USEC,
+                      POLICER_COST(POLICER_MIN_BURST)));
+    p->tokens = p->depth;
+    p->last_refill = policer_now();
+    hmap_insert(&policers, &p->node, policer_hash(meter_id));
+    return p;
+}
+
+/* Returns true if 'p' was created with 'rate' and 'burst'. */
+bool
+policer_has_config(const struct policer *p, uint32_t rate, uint32_t burst)
+{
+    return p->rate == rate && p->burst == burst;
+}
+
+/* Refills 'p' and charges it for a packet of 'bytes' bytes.  Returns true if
+ * the packet is within the rate, false if 'p' lacks the tokens for it, in
+ * which case it is not charged. */
+bool
+policer_admit(struct policer *p, size_t bytes)
+{
+    long long int now = policer_now();
+    int64_t cost = POLICER_COST(bytes);
+
+    if (now > p->last_refill) {
+        p->tokens = MIN(p->depth,
+                        p->tokens + (now - p->last_refill) * p->rate);
+        p->last_refill = now;
+    }
+
+    if (p->tokens >= cost) {
+        p->tokens -= cost;
+        n_passed++;
+        return true;
+    } else {
+        n_exceeded++;
+        return false;
+    }
+}
+
+/* Fills in 's' with statistics for all of the policers. */
+void
+policer_get_stats(struct policer_stats *s)
+{
+    s->n_policers = hmap_count(&policers);
+    s->n_passed = n_passed;
+    s->n_exceeded = n_exceeded;
+}
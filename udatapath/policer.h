@@ -0,0 +1,71 @@
+/* Copyright (c) 2008 The Board of Trustees of The Leland Stanford
+ * Junior University
+ * 
+ * We are making the OpenFlow specification and associated documentation
+ * (Software) available for public use and benefit with the expectation
+ * that others will use, modify and enhance the Software and contribute
+ * those enhancements back to the community. However, since we would
+ * like to make the Software available for broadest use, with as few
+ * restrictions as possible permission is hereby granted, free of
+ * charge, to any person obtaining a copy of this Software to deal in
+ * the Software under the copyrights without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ * The name and trademarks of copyright holder(s) may NOT be used in
+ * advertising or publicity pertaining to the Software or any
+ * derivatives without specific, written prior permission.
+ */
+
+/* Token-bucket policers for the OFP_EXT_ACT_POLICE action.
+ *
+ * A policer is named by a 32-bit meter ID.  The first action that names a
+ * meter creates its policer, with that action's rate and burst, and every
+ * flow whose actions name the same meter then shares its bucket, so that
+ * together they are held to the rate.  Policers last as long as the
+ * datapath, which lets compiled action programs point at them directly; at
+ * most POLICER_MAX of them exist at once. */
+
+#ifndef POLICER_H
+#define POLICER_H 1
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Maximum number of policers. */
+#define POLICER_MAX 4096
+
+struct policer;
+
+struct policer *policer_lookup(uint32_t meter_id);
+struct policer *policer_create(uint32_t meter_id, uint32_t rate,
+                               uint32_t burst);
+bool policer_has_config(const struct policer *, uint32_t rate,
+                        uint32_t burst);
+bool policer_admit(struct policer *, size_t bytes);
+
+/* Statistics for all of the policers together. */
+struct policer_stats {
+    size_t n_policers;
+    unsigned long long int n_passed;    /* Packets within their rate. */
+    unsigned long long int n_exceeded;  /* Packets above their rate. */
+};
+
+void policer_get_stats(struct policer_stats *);
+
+#endif /* policer.h */
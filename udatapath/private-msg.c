@@ -41,13 +41,7 @@
 #include "table.h"
 #include "private-msg.h"
 
-struct emerg_flow_context {
-	struct datapath *dp;
-};
-
 static void flush_working(struct datapath *);
-static int protection_callback(struct sw_flow *, void *);
-static void do_protection(struct datapath *);
 
 static void
 flush_working(struct datapath *dp)
@@ -60,60 +54,8 @@ flush_working(struct datapath *dp)
 	num_deleted = chain_delete(dp->chain, &key, OFPP_NONE, 0, 0, 0);
 }
 
-static int
-protection_callback(struct sw_flow *flow, void *private_)
-{
-	struct emerg_flow_context *private
-		= (struct emerg_flow_context *)private_;
-	struct sw_flow_actions *actions = flow->sf_acts;
-	struct ofp_match match;
-	struct sw_flow *tgtflow = NULL;
-	int error = 0;
-
-	tgtflow = flow_alloc(flow->sf_acts->actions_len);
-	if (tgtflow == NULL)
-		return -ENOBUFS;
-
-	/* Dup w/o idle and hard timeout. */
-	memset(&match, 0, sizeof(match));
-	flow_fill_match(&match, &flow->key.flow, flow->key.wildcards);
-	flow_extract_match(&tgtflow->key, &match);
-	/* Fill out flow. */
-	tgtflow->priority = flow->priority;
-	tgtflow->idle_timeout = OFP_FLOW_PERMANENT;
-	tgtflow->hard_timeout = OFP_FLOW_PERMANENT;
-	tgtflow->send_flow_rem = flow->send_flow_rem;
-	tgtflow->emerg_flow = 0;
-	flow_setup_actions(tgtflow, actions->actions, actions->actions_len);
-
-	error = chain_insert(private->dp->chain, tgtflow, 0);
-	if (error)
-		flow_free(tgtflow);
-
-	return error;
-}
-
-static void
-do_protection(struct datapath *dp)
-{
-	struct emerg_flow_context private;
-	struct sw_flow_key key;
-	struct sw_table_position position;
-	struct sw_table *table = dp->chain->emerg_table;
-	int error = 0;
-
-	memset(&private, 0, sizeof(private));
-	private.dp = dp;
-	memset(&key, 0, sizeof(key));
-	key.wildcards = OFPFW_ALL;
-	memset(&position, 0, sizeof(position));
-
-	error = table->iterate(table, &key, OFPP_NONE,
-			       &position, protection_callback, &private);
-}
-
 int
-private_recv_msg(struct datapath *dp, const struct sender *sender UNUSED,
+private_recv_msg(struct datapath *dp, const struct sender *sender,
 		 const void *ofph)
 {
 	struct private_vxhdr *vxhdr = (struct private_vxhdr *)ofph;
@@ -124,13 +66,19 @@ private_recv_msg(struct datapath *dp, const struct sender *sender UNUSED,
 	case PRIVATEOPT_PROTOCOL_STATS_REQUEST:
 	case PRIVATEOPT_PROTOCOL_STATS_REPLY:
 		break;
+	case PRIVATEOPT_PROCESSING_STATS_REQUEST:
+		error = dp_send_processing_stats(dp, sender);
+		break;
 	case PRIVATEOPT_EMERG_FLOW_PROTECTION:
+		/* Forwarding falls through to the emergency table in place,
+		 * instead of copying its flows into the working tables. */
 		flush_working(dp);
-		do_protection(dp);
+		chain_set_emergency(dp->chain, true);
 		break;
 	case PRIVATEOPT_EMERG_FLOW_RESTORATION:
 		/* Nothing to do because we assume that a re-connected
-		 * controller will do flush current working flow table. */
+		 * controller will do flush current working flow table, which
+		 * also ends emergency mode. */
 		break;
 	default:
 		error = -EINVAL;
@@ -0,0 +1,332 @@
+/* Copyright (c) 2008 The Board of Trustees of The Leland Stanford
+ * Junior University
+ * 
+ * We are making the OpenFlow specification and associated documentation
+ * (Software) available for public use and benefit with the expectation
+ * that others will use, modify and enhance the Software and contribute
+ * those enhancements back to the community. However, since we would
+ * like to make the Software available for broadest use, with as few
+ * restrictions as possible permission is hereby granted, free of
+ * charge, to any person obtaining a copy of this Software to deal in
+ * the Software under the copyrights without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ * The name and trademarks of copyright holder(s) may NOT be used in
+ * advertising or publicity pertaining to the Software or any
+ * derivatives without specific, written prior permission.
+ */
+
+#include <config.h>
+#include "rx-threads.h"
+#include <assert.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "datapath.h"
+#include "netdev.h"
+#include "ofpbuf.h"
+#include "packets.h"
+#include "poll-loop.h"
+#include "socket-util.h"
+#include "util.h"
+
+#define THIS_MODULE VLM_datapath
+#include "vlog.h"
+
+static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(60, 60);
+
+/* Maximum number of packets waiting for the main thread.  Packets received
+ * while the queue is full are dropped. */
+#define RX_QUEUE_MAX 4096
+
+struct rx_thread {
+    pthread_t thread;
+    struct rx_threads *rxt;
+    struct sw_port **ports;     /* Ports owned by this thread. */
+    size_t n_ports;
+};
+
+struct rx_threads {
+    pthread_mutex_t mutex;      /* Protects the members below. */
+    struct ofpbuf *head, *tail; /* Received packets, linked through 'next'. */
+    size_t n_queued;            /* Number of packets in the list. */
+    unsigned int n_dropped;     /* Packets dropped on a full queue since the
+                                 * last rx_threads_take(). */
+
+    int wakeup_pipe[2];         /* Wakes the main thread when a packet is
+                                 * queued to an empty queue. */
+
+    struct rx_thread *threads;
+    size_t n_threads;
+};
+
+static void *rx_thread_main(void *);
+
+/* Starts 'n_threads' receive threads shared by the 'n_dps' datapaths in
+ * 'dps' and divides their software ports among them.  The ports are then no
+ * longer polled by dp_run(), which instead forwards the packets the threads
+ * receive, each to the datapath of the port that received it.  Ports added
+ * afterward are still handled by dp_run().
+ *
+ * Returns 0 if successful, otherwise a positive errno value. */
+int
+rx_threads_start(struct datapath *dps[], size_t n_dps, int n_threads)
+{
+    struct rx_threads *rxt;
+    struct sw_port *p;
+    size_t n_ports, i, j;
+    int error;
+
+    assert(n_threads > 0);
+
+    n_ports = 0;
+    for (j = 0; j < n_dps; j++) {
+        assert(!dps[j]->rx_threads);
+        LIST_FOR_EACH (p, struct sw_port, node, &dps[j]->port_list) {
+            if (!IS_HW_PORT(p) && p->netdev != NULL) {
+                n_ports++;
+            }
+        }
+    }
+    if (n_threads > n_ports) {
+        n_threads = n_ports;
+    }
+    if (!n_threads) {
+        return 0;
+    }
+
+    rxt = xcalloc(1, sizeof *rxt);
+    pthread_mutex_init(&rxt->mutex, NULL);
+    if (pipe(rxt->wakeup_pipe) < 0) {
+        error = errno;
+        free(rxt);
+        return error;
+    }
+    set_nonblocking(rxt->wakeup_pipe[0]);
+    set_nonblocking(rxt->wakeup_pipe[1]);
+
+    rxt->n_threads = n_threads;
+    rxt->threads = xcalloc(n_threads, sizeof *rxt->threads);
+    for (i = 0; i < n_threads; i++) {
+        rxt->threads[i].rxt = rxt;
+        rxt->threads[i].ports = xmalloc(n_ports * sizeof(struct sw_port *));
+    }
+
+    i = 0;
+    for (j = 0; j < n_dps; j++) {
+        LIST_FOR_EACH (p, struct sw_port, node, &dps[j]->port_list) {
+            if (!IS_HW_PORT(p) && p->netdev != NULL) {
+                struct rx_thread *rxth = &rxt->threads[i++ % n_threads];
+                rxth->ports[rxth->n_ports++] = p;
+                p->flags |= SWP_RX_THREAD;
+            }
+        }
+        dps[j]->rx_threads = rxt;
+    }
+
+    for (i = 0; i < n_threads; i++) {
+        error = pthread_create(&rxt->threads[i].thread, NULL,
+                               rx_thread_main, &rxt->threads[i]);
+        if (error) {
+            ofp_fatal(error, "failed to create receive thread");
+        }
+    }
+    VLOG_INFO("receiving on %zu ports with %d threads", n_ports, n_threads);
+    return 0;
+}
+
+/* Takes every packet queued by the receive threads in 'rxt' and returns them
+ * as a list linked through their 'next' members, or a null pointer if there
+ * are none.  Each packet's 'private' member points to the sw_port on which
+ * it was received. */
+struct ofpbuf *
+rx_threads_take(struct rx_threads *rxt)
+{
+    struct ofpbuf *list;
+    unsigned int n_dropped;
+    char buf[64];
+
+    while (read(rxt->wakeup_pipe[0], buf, sizeof buf) > 0) {
+        continue;
+    }
+
+    pthread_mutex_lock(&rxt->mutex);
+    list = rxt->head;
+    rxt->head = rxt->tail = NULL;
+    rxt->n_queued = 0;
+    n_dropped = rxt->n_dropped;
+    rxt->n_dropped = 0;
+    if (n_dropped) {
+        size_t i, j;
+
+        for (i = 0; i < rxt->n_threads; i++) {
+            struct rx_thread *rxth = &rxt->threads[i];
+
+            for (j = 0; j < rxth->n_ports; j++) {
+                struct sw_port *p = rxth->ports[j];
+
+                p->drops[OFP_EXT_DROP_RX_QUEUE] += p->rx_queue_dropped;
+                p->rx_queue_dropped = 0;
+            }
+        }
+    }
+    pthread_mutex_unlock(&rxt->mutex);
+
+    if (n_dropped) {
+        VLOG_WARN_RL(&rl, "receive queue full, dropped %u packets",
+                     n_dropped);
+    }
+    return list;
+}
+
+/* Registers with the poll loop to wake up when the receive threads in 'rxt'
+ * queue a packet. */
+void
+rx_threads_wait(struct rx_threads *rxt)
+{
+    poll_fd_wait(rxt->wakeup_pipe[0], POLLIN);
+}
+
+/* Appends the 'n' packets in 'buffers', received on 'p', to the queue. */
+static void
+rx_thread_enqueue(struct rx_threads *rxt, struct sw_port *p,
+                  struct ofpbuf *buffers[], int n)
+{
+    bool was_empty;
+    int n_queued = 0;
+    int i;
+
+    pthread_mutex_lock(&rxt->mutex);
+    was_empty = rxt->head == NULL;
+    for (i = 0; i < n; i++) {
+        struct ofpbuf *buffer = buffers[i];
+
+        if (rxt->n_queued >= RX_QUEUE_MAX) {
+            ofpbuf_delete(buffer);
+            rxt->n_dropped++;
+            p->rx_queue_dropped++;
+            continue;
+        }
+        buffer->private = p;
+        buffer->next = NULL;
+        if (rxt->tail) {
+            rxt->tail->next = buffer;
+        } else {
+            rxt->head = buffer;
+        }
+        rxt->tail = buffer;
+        rxt->n_queued++;
+        n_queued++;
+    }
+    pthread_mutex_unlock(&rxt->mutex);
+
+    if (was_empty && n_queued) {
+        /* If the pipe is full, the main thread is already due to wake. */
+        if (write(rxt->wakeup_pipe[1], "", 1) < 0 && errno != EAGAIN) {
+            VLOG_WARN_RL(&rl, "failed to wake main thread: %s",
+                         strerror(errno));
+        }
+    }
+}
+
+static void *
+rx_thread_main(void *rxth_)
+{
+    struct rx_thread *rxth = rxth_;
+    struct ofpbuf *buffers[DP_RX_BATCH];
+    struct pollfd *pollfds;
+    size_t *pollfd_port;        /* Index in 'rxth->ports' for each pollfd. */
+    size_t n_pollfds;
+    size_t last_port;
+    size_t i;
+
+    /* A multiqueue TAP device has one file descriptor per queue. */
+    memset(buffers, 0, sizeof buffers);
+    n_pollfds = 0;
+    for (i = 0; i < rxth->n_ports; i++) {
+        const int *fds;
+        n_pollfds += netdev_get_rx_fds(rxth->ports[i]->netdev, &fds);
+    }
+    pollfds = xmalloc(n_pollfds * sizeof *pollfds);
+    pollfd_port = xmalloc(n_pollfds * sizeof *pollfd_port);
+    n_pollfds = 0;
+    for (i = 0; i < rxth->n_ports; i++) {
+        const int *fds;
+        int n_fds = netdev_get_rx_fds(rxth->ports[i]->netdev, &fds);
+        int j;
+
+        for (j = 0; j < n_fds; j++) {
+            pollfds[n_pollfds].fd = fds[j];
+            pollfds[n_pollfds].events = POLLIN;
+            pollfd_port[n_pollfds] = i;
+            n_pollfds++;
+        }
+    }
+
+    for (;;) {
+        if (poll(pollfds, n_pollfds, -1) < 0) {
+            if (errno != EINTR) {
+                VLOG_ERR_RL(&rl, "poll failed in receive thread: %s",
+                            strerror(errno));
+            }
+            continue;
+        }
+
+        last_port = SIZE_MAX;
+        for (i = 0; i < n_pollfds; i++) {
+            struct sw_port *p = rxth->ports[pollfd_port[i]];
+            size_t size;
+            int n_rx;
+            int j;
+
+            /* netdev_recv_batch() reads from all of a port's queues, whose
+             * pollfds are adjacent, so receive once per ready port. */
+            if (!pollfds[i].revents || pollfd_port[i] == last_port) {
+                continue;
+            }
+            last_port = pollfd_port[i];
+
+            /* The buffer pools are not thread-safe, so use plain ofpbufs
+             * here.  Buffers left over from another port may be too small. */
+            size = VLAN_ETH_HEADER_LEN + netdev_get_mtu(p->netdev);
+            for (j = 0; j < DP_RX_BATCH; j++) {
+                if (buffers[j] && ofpbuf_tailroom(buffers[j]) < size) {
+                    ofpbuf_delete(buffers[j]);
+                    buffers[j] = NULL;
+                }
+                if (!buffers[j]) {
+                    buffers[j] = ofpbuf_new(DP_RX_HEADROOM + size);
+                    ofpbuf_reserve(buffers[j], DP_RX_HEADROOM);
+                }
+            }
+
+            if (!netdev_recv_batch(p->netdev, buffers, DP_RX_BATCH, &n_rx)) {
+                rx_thread_enqueue(rxth->rxt, p, buffers, n_rx);
+                for (j = 0; j < n_rx; j++) {
+                    buffers[j] = NULL;
+                }
+            }
+        }
+    }
+
+    return NULL;
+}
@@ -0,0 +1,223 @@
+/* Copyright (c) 2008 The Board of Trustees of The Leland Stanford
+ * Junior University
+ * 
+ * We are making the OpenFlow specification and associated documentation
+ * (Software) available for public use and benefit with the expectation
+ * that others will use, modify and enhance the Software and contribute
+ * those enhancements back to the community. However, since we would
+ * like to make the Software available for broadest use, with as few
+ * restrictions as possible permission is hereby granted, free of
+ * charge, to any person obtaining a copy of this Software to deal in
+ * the Software under the copyrights without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ * The name and trademarks of copyright holder(s) may NOT be used in
+ * advertising or publicity pertaining to the Software or any
+ * derivatives without specific, written prior permission.
+ */
+
+#include <config.h>
+#include "sampler.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <limits.h>
+#include <netinet/in.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "datapath.h"
+#include "ofpbuf.h"
+#include "random.h"
+#include "socket-util.h"
+#include "timeval.h"
+#include "util.h"
+
+#define THIS_MODULE VLM_datapath
+#include "vlog.h"
+
+static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(1, 5);
+
+/* Number of bytes copied from the start of each sampled packet. */
+#define SAMPLER_HEADER_LEN 128
+
+/* Largest datagram sent to the collector, small enough to avoid
+ * fragmentation on an Ethernet path. */
+#define SAMPLER_DATAGRAM_MAX 1400
+
+/* sFlow version 5 constants. */
+#define SFLOW_VERSION 5
+#define SFLOW_ADDRESS_IP_V4 1
+#define SFLOW_FLOW_SAMPLE 1         /* Sample format: flow_sample. */
+#define SFLOW_FLOW_HEADER 1         /* Flow record format: sampled_header. */
+#define SFLOW_HEADER_ETHERNET 1     /* Header protocol: ISO 8802-3. */
+
+/* Size of the datagram header: version, agent address type and address,
+ * sub-agent ID, sequence number, uptime and sample count. */
+#define SFLOW_DATAGRAM_HEADER_LEN (7 * 4)
+
+/* Largest encoding of one flow sample: format and length, eight flow_sample
+ * fields, record format and length, four sampled_header fields, and the
+ * packet header itself. */
+#define SFLOW_SAMPLE_MAX_LEN (2 * 4 + 8 * 4 + 2 * 4 + 4 * 4 \
+                              + SAMPLER_HEADER_LEN)
+BUILD_ASSERT_DECL(SFLOW_DATAGRAM_HEADER_LEN + SFLOW_SAMPLE_MAX_LEN
+                  <= SAMPLER_DATAGRAM_MAX);
+
+struct sampler {
+    char *collector;            /* Collector name, for log messages. */
+    int fd;                     /* UDP socket connected to the collector. */
+    unsigned int rate;          /* Mean packets received per sample. */
+    uint32_t agent_ip;          /* Our address, in network byte order. */
+    long long int created;      /* time_msec() at creation, for uptime. */
+
+    uint32_t datagram_seq;      /* Datagrams sent so far. */
+    uint32_t sample_seq;        /* Samples taken so far. */
+
+    struct ofpbuf datagram;     /* Datagram under construction. */
+    uint32_t n_samples;         /* Samples in 'datagram'. */
+};
+
+static void
+put_be32(struct ofpbuf *b, uint32_t x)
+{
+    uint32_t be = htonl(x);
+    ofpbuf_put(b, &be, sizeof be);
+}
+
+/* Opens a sampler that sends about one in 'rate' packets to 'collector',
+ * which has the form HOST[:PORT].  On success, stores the new sampler in
+ * '*samplerp' and returns 0; on failure, returns a positive errno value. */
+int
+sampler_create(const char *collector, unsigned int rate,
+               struct sampler **samplerp)
+{
+    struct sockaddr_in sin;
+    socklen_t sin_len;
+    struct sampler *s;
+    int error;
+    int fd;
+
+    *samplerp = NULL;
+    if (!rate || rate > INT_MAX / 2) {
+        return EINVAL;
+    }
+    error = udp_open_active(collector, SAMPLER_DEFAULT_PORT, &fd);
+    if (error) {
+        return error;
+    }
+
+    s = xcalloc(1, sizeof *s);
+    s->collector = xstrdup(collector);
+    s->fd = fd;
+    s->rate = rate;
+    sin_len = sizeof sin;
+    if (!getsockname(fd, (struct sockaddr *) &sin, &sin_len)) {
+        s->agent_ip = sin.sin_addr.s_addr;
+    }
+    s->created = time_msec();
+    ofpbuf_init(&s->datagram, SAMPLER_DATAGRAM_MAX);
+    *samplerp = s;
+    return 0;
+}
+
+void
+sampler_destroy(struct sampler *s)
+{
+    if (s) {
+        close(s->fd);
+        ofpbuf_uninit(&s->datagram);
+        free(s->collector);
+        free(s);
+    }
+}
+
+/* Sends the samples gathered so far, if any, to the collector. */
+static void
+sampler_flush(struct sampler *s)
+{
+    uint32_t *header = s->datagram.data;
+
+    if (!s->n_samples) {
+        return;
+    }
+    header[4] = htonl(++s->datagram_seq);
+    header[5] = htonl(time_msec() - s->created);
+    header[6] = htonl(s->n_samples);
+    if (send(s->fd, s->datagram.data, s->datagram.size, 0) < 0) {
+        VLOG_WARN_RL(&rl, "%s: send: %s", s->collector, strerror(errno));
+    }
+    ofpbuf_clear(&s->datagram);
+    s->n_samples = 0;
+}
+
+/* Adds 'packet', just received on 'p', to the samples to send, and picks
+ * how many more packets 'p' receives before its next sample.  The caller
+ * decides when to sample, by counting 'p->sample_skip' down to 0. */
+void
+sampler_sample(struct sampler *s, const struct ofpbuf *packet,
+               struct sw_port *p)
+{
+    size_t header_len = MIN(packet->size, SAMPLER_HEADER_LEN);
+    size_t padded_len = ROUND_UP(header_len, 4);
+    struct ofpbuf *b = &s->datagram;
+
+    /* A skip drawn uniformly from [1, 2 * rate - 1] averages 'rate'. */
+    p->sample_skip = 1 + random_range(2 * s->rate - 1);
+
+    if (b->size + SFLOW_SAMPLE_MAX_LEN > SAMPLER_DATAGRAM_MAX) {
+        sampler_flush(s);
+    }
+    if (!s->n_samples) {
+        put_be32(b, SFLOW_VERSION);
+        put_be32(b, SFLOW_ADDRESS_IP_V4);
+        ofpbuf_put(b, &s->agent_ip, sizeof s->agent_ip);
+        put_be32(b, 0);         /* Sub-agent ID. */
+        ofpbuf_put_zeros(b, 3 * 4); /* Filled in by sampler_flush(). */
+    }
+    s->n_samples++;
+
+    put_be32(b, SFLOW_FLOW_SAMPLE);
+    put_be32(b, 8 * 4 + 2 * 4 + 4 * 4 + padded_len);
+    put_be32(b, ++s->sample_seq);
+    put_be32(b, p->port_no);    /* Source ID: ifIndex of the port. */
+    put_be32(b, s->rate);
+    put_be32(b, p->rx_packets); /* Sample pool. */
+    put_be32(b, 0);             /* Drops. */
+    put_be32(b, p->port_no);    /* Input interface. */
+    put_be32(b, 0);             /* Output interface, not yet known. */
+    put_be32(b, 1);             /* Number of flow records. */
+
+    put_be32(b, SFLOW_FLOW_HEADER);
+    put_be32(b, 4 * 4 + padded_len);
+    put_be32(b, SFLOW_HEADER_ETHERNET);
+    put_be32(b, packet->size);  /* Frame length. */
+    put_be32(b, 0);             /* Bytes stripped. */
+    put_be32(b, header_len);
+    ofpbuf_put(b, packet->data, header_len);
+    ofpbuf_put_zeros(b, padded_len - header_len);
+}
+
+/* Sends the samples taken since the last call.  Call once per pass of the
+ * main loop, so that each pass costs at most one datagram in the common
+ * case. */
+void
+sampler_run(struct sampler *s)
+{
+    sampler_flush(s);
+}
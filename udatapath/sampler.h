@@ -0,0 +1,66 @@
+/* Copyright (c) 2008 The Board of Trustees of The Leland Stanford
+ * Junior University
+ * 
+ * We are making the OpenFlow specification and associated documentation
+ * (Software) available for public use and benefit with the expectation
+ * that others will use, modify and enhance the Software and contribute
+ * those enhancements back to the community. However, since we would
+ * like to make the Software available for broadest use, with as few
+ * restrictions as possible permission is hereby granted, free of
+ * charge, to any person obtaining a copy of this Software to deal in
+ * the Software under the copyrights without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ * The name and trademarks of copyright holder(s) may NOT be used in
+ * advertising or publicity pertaining to the Software or any
+ * derivatives without specific, written prior permission.
+ */
+
+/* Statistical packet sampling, exported as sFlow version 5.
+ *
+ * The datapath hands the sampler about one in every 'rate' packets
+ * received on each port, chosen with a random skip so that periodic traffic
+ * cannot hide from it.  The sampler encodes the first bytes of each such
+ * packet, with its input port, the sampling rate and the port's packet
+ * count, as an sFlow flow sample, and sends the samples gathered during one
+ * pass of the main loop to a collector in a single UDP datagram. */
+
+#ifndef SAMPLER_H
+#define SAMPLER_H 1
+
+#include <stdint.h>
+
+struct ofpbuf;
+struct sampler;
+struct sw_port;
+
+/* Default mean number of packets received per sample. */
+#define SAMPLER_DEFAULT_RATE 1000
+
+/* UDP port to which samples are sent if the collector does not give one. */
+#define SAMPLER_DEFAULT_PORT 6343
+
+int sampler_create(const char *collector, unsigned int rate,
+                   struct sampler **);
+void sampler_destroy(struct sampler *);
+
+void sampler_sample(struct sampler *, const struct ofpbuf *,
+                    struct sw_port *);
+void sampler_run(struct sampler *);
+
+#endif /* sampler.h */
@@ -0,0 +1,307 @@
+/* Copyright (c) 2008 The Board of Trustees of The Leland Stanford
+ * Junior University
+ * 
+ * We are making the OpenFlow specification and associated documentation
+ * (Software) available for public use and benefit with the expectation
+ * that others will use, modify and enhance the Software and contribute
+ * those enhancements back to the community. However, since we would
+ * like to make the Software available for broadest use, with as few
+ * restrictions as possible permission is hereby granted, free of
+ * charge, to any person obtaining a copy of this Software to deal in
+ * the Software under the copyrights without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ * The name and trademarks of copyright holder(s) may NOT be used in
+ * advertising or publicity pertaining to the Software or any
+ * derivatives without specific, written prior permission.
+ */
+
+#include <config.h>
+#include "shaper.h"
+#include <assert.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "netdev.h"
+#include "ofpbuf.h"
+#include "poll-loop.h"
+#include "queue.h"
+#include "util.h"
+
+#define THIS_MODULE VLM_datapath
+#include "vlog.h"
+
+static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(60, 60);
+
+/* Maximum number of packets held for one queue. */
+#define SHAPER_QUEUE_MAX 256
+
+/* Each bucket holds this much time's worth of tokens at its rate, but never
+ * less than SHAPER_MIN_BURST bytes, so that a full-size frame always fits. */
+#define SHAPER_BURST_USEC 2000
+#define SHAPER_MIN_BURST (2 * 1522)
+
+/* Tokens are kept in millibits, the amount that a rate in kbps earns in a
+ * microsecond, so refilling loses no precision. */
+#define SHAPER_COST(BYTES) ((int64_t) (BYTES) * 8000)
+
+struct shaper_bucket {
+    uint32_t rate;              /* Fill rate in kbps, 0 for none. */
+    int64_t tokens;             /* Current tokens, in millibits. */
+    int64_t depth;              /* Maximum tokens, in millibits. */
+};
+
+struct shaper_queue {
+    struct ofp_queue pkts;      /* Packets waiting for transmission. */
+    struct shaper_bucket guarantee;
+};
+
+struct shaper {
+    struct netdev *netdev;
+    struct shaper_bucket link;
+    long long int last_refill;  /* Microseconds, monotonic. */
+    unsigned int n_backlog;     /* Packets held across all queues. */
+    unsigned int next;          /* Next queue for round-robin service. */
+    unsigned int n_queues;      /* Queues 0...n_queues are in use. */
+    unsigned long long int n_dropped; /* Queued packets that failed. */
+    struct shaper_queue queues[NETDEV_MAX_QUEUES + 1];
+};
+
+static long long int
+shaper_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long int) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void
+bucket_set_rate(struct shaper_bucket *b, uint32_t rate)
+{
+    b->rate = rate;
+    b->depth = MAX((int64_t) rate * SHAPER_BURST_USEC,
+                   SHAPER_COST(SHAPER_MIN_BURST));
+    b->tokens = rate ? MIN(b->tokens, b->depth) : 0;
+}
+
+static void
+bucket_refill(struct shaper_bucket *b, long long int elapsed)
+{
+    if (b->rate) {
+        b->tokens = MIN(b->depth, b->tokens + elapsed * b->rate);
+    }
+}
+
+static void
+shaper_refill(struct shaper *s)
+{
+    long long int now = shaper_now();
+    long long int elapsed = now - s->last_refill;
+    unsigned int i;
+
+    if (elapsed <= 0) {
+        return;
+    }
+    s->last_refill = now;
+    bucket_refill(&s->link, elapsed);
+    for (i = 0; i <= s->n_queues; i++) {
+        bucket_refill(&s->queues[i].guarantee, elapsed);
+    }
+}
+
+/* Creates a shaper for 'netdev' with queues 1 through 'n_queues', plus the
+ * best-effort queue 0.  Each queue starts with no guarantee. */
+struct shaper *
+shaper_create(struct netdev *netdev, uint16_t n_queues)
+{
+    struct shaper *s = xcalloc(1, sizeof *s);
+    unsigned int i;
+
+    s->netdev = netdev;
+    s->n_queues = MIN(n_queues, NETDEV_MAX_QUEUES);
+    bucket_set_rate(&s->link, netdev_get_speed(netdev) * 1000);
+    s->link.tokens = s->link.depth;
+    s->last_refill = shaper_now();
+    for (i = 0; i <= s->n_queues; i++) {
+        queue_init(&s->queues[i].pkts);
+    }
+    return s;
+}
+
+void
+shaper_destroy(struct shaper *s)
+{
+    if (s) {
+        unsigned int i;
+
+        for (i = 0; i <= s->n_queues; i++) {
+            queue_destroy(&s->queues[i].pkts);
+        }
+        free(s);
+    }
+}
+
+/* Sets the guarantee of queue 'class_id' in 's' to 'min_rate', in tenths of
+ * a percent of the link speed as in ofp_queue_prop_min_rate.  Rates above
+ * 1000 disable the guarantee. */
+void
+shaper_set_rate(struct shaper *s, uint16_t class_id, uint16_t min_rate)
+{
+    assert(class_id <= s->n_queues);
+    bucket_set_rate(&s->queues[class_id].guarantee,
+                    min_rate <= 1000 ? min_rate * (s->link.rate / 1000) : 0);
+}
+
+/* Returns the queue that should transmit next, or a null pointer if none can
+ * transmit now.  Queues within their guarantee come first. */
+static struct shaper_queue *
+shaper_pick(struct shaper *s)
+{
+    unsigned int n = s->n_queues + 1;
+    unsigned int i;
+
+    if (!s->n_backlog) {
+        return NULL;
+    }
+    for (i = 0; i < n; i++) {
+        struct shaper_queue *q = &s->queues[(s->next + i) % n];
+        if (q->pkts.n && q->guarantee.tokens >= SHAPER_COST(q->pkts.head->size)
+            && s->link.tokens >= SHAPER_COST(q->pkts.head->size)) {
+            s->next = (s->next + i + 1) % n;
+            return q;
+        }
+    }
+    for (i = 0; i < n; i++) {
+        struct shaper_queue *q = &s->queues[(s->next + i) % n];
+        if (q->pkts.n && s->link.tokens >= SHAPER_COST(q->pkts.head->size)) {
+            s->next = (s->next + i + 1) % n;
+            return q;
+        }
+    }
+    return NULL;
+}
+
+/* Charges 'bytes' to the link and, if it has the tokens, to the guarantee of
+ * 'q'.  Traffic beyond the guarantee is borrowed from spare link capacity
+ * and does not count against it. */
+static void
+shaper_charge(struct shaper *s, struct shaper_queue *q, size_t bytes)
+{
+    int64_t cost = SHAPER_COST(bytes);
+
+    s->link.tokens -= cost;
+    if (q->guarantee.tokens >= cost) {
+        q->guarantee.tokens -= cost;
+    }
+}
+
+/* Transmits 'buffer' on queue 'class_id' of 's' if the queue is empty and
+ * the link has room, otherwise queues a copy of it.  The caller retains
+ * ownership of 'buffer'.  Returns 0 if the packet was sent or queued,
+ * otherwise a positive errno value. */
+int
+shaper_send(struct shaper *s, const struct ofpbuf *buffer, uint16_t class_id)
+{
+    struct shaper_queue *q;
+    int error;
+
+    assert(class_id <= s->n_queues);
+    q = &s->queues[class_id];
+    shaper_refill(s);
+
+    if (!s->n_backlog && s->link.tokens >= SHAPER_COST(buffer->size)) {
+        error = netdev_send(s->netdev, buffer, 0);
+        if (error != EAGAIN) {
+            if (!error) {
+                shaper_charge(s, q, buffer->size);
+            }
+            return error;
+        }
+    }
+
+    if (q->pkts.n >= SHAPER_QUEUE_MAX) {
+        return ENOBUFS;
+    }
+    queue_push_tail(&q->pkts, ofpbuf_clone(buffer));
+    s->n_backlog++;
+    shaper_run(s);
+    return 0;
+}
+
+/* Transmits as many queued packets from 's' as its buckets allow. */
+void
+shaper_run(struct shaper *s)
+{
+    struct shaper_queue *q;
+
+    shaper_refill(s);
+    while ((q = shaper_pick(s)) != NULL) {
+        struct ofpbuf *buffer = q->pkts.head;
+        int error = netdev_send(s->netdev, buffer, 0);
+
+        if (error == EAGAIN) {
+            break;
+        } else if (error) {
+            VLOG_WARN_RL(&rl, "%s: shaper dropped packet (%s)",
+                         netdev_get_name(s->netdev), strerror(error));
+            s->n_dropped++;
+        } else {
+            shaper_charge(s, q, buffer->size);
+        }
+        ofpbuf_delete(queue_pop_head(&q->pkts));
+        s->n_backlog--;
+    }
+}
+
+/* Returns the number of packets that 's' queued but then failed to
+ * transmit.  (shaper_send() reports its own failures to its caller.) */
+unsigned long long int
+shaper_n_dropped(const struct shaper *s)
+{
+    return s->n_dropped;
+}
+
+/* Arranges for poll_block() to wake up when the link bucket of 's' has
+ * enough tokens for a queued packet. */
+void
+shaper_wait(struct shaper *s)
+{
+    int64_t need = INT64_MAX;
+    unsigned int i;
+
+    if (!s->n_backlog) {
+        return;
+    }
+    for (i = 0; i <= s->n_queues; i++) {
+        struct shaper_queue *q = &s->queues[i];
+        if (q->pkts.n) {
+            need = MIN(need, SHAPER_COST(q->pkts.head->size));
+        }
+    }
+    need -= s->link.tokens;
+    if (need <= 0) {
+        /* The device pushed back.  Try again shortly. */
+        poll_timer_wait(1);
+    } else {
+        long long int usec = need / s->link.rate + 1;
+        poll_timer_wait((usec + 999) / 1000);
+    }
+}
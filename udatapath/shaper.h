@@ -0,0 +1,63 @@
+/* Copyright (c) 2008 The Board of Trustees of The Leland Stanford
+ * Junior University
+ * 
+ * We are making the OpenFlow specification and associated documentation
+ * (Software) available for public use and benefit with the expectation
+ * that others will use, modify and enhance the Software and contribute
+ * those enhancements back to the community. However, since we would
+ * like to make the Software available for broadest use, with as few
+ * restrictions as possible permission is hereby granted, free of
+ * charge, to any person obtaining a copy of this Software to deal in
+ * the Software under the copyrights without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ * The name and trademarks of copyright holder(s) may NOT be used in
+ * advertising or publicity pertaining to the Software or any
+ * derivatives without specific, written prior permission.
+ */
+
+/* Userspace hierarchical shaper for a port's queues.
+ *
+ * As an alternative to the kernel HTB classes that netdev_setup_slicing()
+ * configures with tc, a shaper holds each queue's packets itself and sends
+ * them on the port's default socket.  A token bucket at the link rate
+ * bounds the port as a whole.  Each queue also has a token bucket at its
+ * min-rate guarantee: queues within their guarantee are served first, and
+ * link capacity left over is shared round-robin among all backlogged
+ * queues.  Rate changes only update the buckets, so they take effect at
+ * once, and the shaper works on any netdev, including TAP devices. */
+
+#ifndef SHAPER_H
+#define SHAPER_H 1
+
+#include <stdint.h>
+
+struct netdev;
+struct ofpbuf;
+struct shaper;
+
+struct shaper *shaper_create(struct netdev *, uint16_t n_queues);
+void shaper_destroy(struct shaper *);
+
+void shaper_set_rate(struct shaper *, uint16_t class_id, uint16_t min_rate);
+int shaper_send(struct shaper *, const struct ofpbuf *, uint16_t class_id);
+void shaper_run(struct shaper *);
+void shaper_wait(struct shaper *);
+unsigned long long int shaper_n_dropped(const struct shaper *);
+
+#endif /* shaper.h */
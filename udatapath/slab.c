@@ -0,0 +1,129 @@
+/* Copyright (c) 2008 The Board of Trustees of The Leland Stanford
+ * Junior University
+ * 
+ * We are making the OpenFlow specification and associated documentation
+ * (Software) available for public use and benefit with the expectation
+ * that others will use, modify and enhance the Software and contribute
+ * those enhancements back to the community. However, since we would
+ * like to make the Software available for broadest use, with as few
+ * restrictions as possible permission is hereby granted, free of
+ * charge, to any person obtaining a copy of this Software to deal in
+ * the Software under the copyrights without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ * The name and trademarks of copyright holder(s) may NOT be used in
+ * advertising or publicity pertaining to the Software or any
+ * derivatives without specific, written prior permission.
+ */
+
+#include <config.h>
+#include "slab.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "util.h"
+
+/* Size of each chunk.  Large enough that chunk allocations are rare and come
+ * from mmap() rather than the heap, small enough that a slab for a handful
+ * of objects does not waste much. */
+#define SLAB_CHUNK_SIZE (64 * 1024)
+
+/* Initializes 'slab' to allocate objects of 'obj_size' bytes, each aligned
+ * on an 'align'-byte boundary.  'align' must be a power of 2. */
+void
+slab_init(struct slab *slab, size_t obj_size, size_t align)
+{
+    assert(align && !(align & (align - 1)));
+    align = MAX(align, sizeof(void *));
+    memset(slab, 0, sizeof *slab);
+    slab->obj_size = ROUND_UP(MAX(obj_size, sizeof(void *)), align);
+    slab->align = align;
+    slab->n_per_chunk = MAX(SLAB_CHUNK_SIZE / slab->obj_size, 1);
+}
+
+/* Frees all of the memory held by 'slab', including any objects that are
+ * still allocated. */
+void
+slab_destroy(struct slab *slab)
+{
+    size_t i;
+
+    for (i = 0; i < slab->n_chunks; i++) {
+        free(slab->chunks[i]);
+    }
+    free(slab->chunks);
+    memset(slab, 0, sizeof *slab);
+}
+
+/* Returns a new object from 'slab', with unspecified contents, or a null
+ * pointer if memory is exhausted. */
+void *
+slab_alloc(struct slab *slab)
+{
+    void *obj;
+
+    if (slab->free_list) {
+        obj = slab->free_list;
+        slab->free_list = *(void **) obj;
+    } else {
+        if (slab->next == slab->end) {
+            size_t size = slab->n_per_chunk * slab->obj_size;
+            void **chunks;
+            void *chunk;
+
+            chunks = realloc(slab->chunks,
+                             (slab->n_chunks + 1) * sizeof *slab->chunks);
+            if (!chunks) {
+                return NULL;
+            }
+            slab->chunks = chunks;
+            if (posix_memalign(&chunk, slab->align, size)) {
+                return NULL;
+            }
+            slab->chunks[slab->n_chunks++] = chunk;
+            slab->next = chunk;
+            slab->end = slab->next + size;
+        }
+        obj = slab->next;
+        slab->next += slab->obj_size;
+    }
+    slab->n_used++;
+    slab->n_allocs++;
+    return obj;
+}
+
+/* Returns 'obj', which must have been allocated from 'slab', to 'slab'. */
+void
+slab_free(struct slab *slab, void *obj)
+{
+    if (obj) {
+        *(void **) obj = slab->free_list;
+        slab->free_list = obj;
+        slab->n_used--;
+    }
+}
+
+void
+slab_get_stats(const struct slab *slab, struct slab_stats *stats)
+{
+    stats->obj_size = slab->obj_size;
+    stats->n_used = slab->n_used;
+    stats->n_bytes = slab->n_chunks * slab->n_per_chunk * slab->obj_size;
+    stats->n_free = stats->n_bytes / slab->obj_size - slab->n_used;
+    stats->n_allocs = slab->n_allocs;
+}
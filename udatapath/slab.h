@@ -0,0 +1,78 @@
+/* Copyright (c) 2008 The Board of Trustees of The Leland Stanford
+ * Junior University
+ * 
+ * We are making the OpenFlow specification and associated documentation
+ * (Software) available for public use and benefit with the expectation
+ * that others will use, modify and enhance the Software and contribute
+ * those enhancements back to the community. However, since we would
+ * like to make the Software available for broadest use, with as few
+ * restrictions as possible permission is hereby granted, free of
+ * charge, to any person obtaining a copy of this Software to deal in
+ * the Software under the copyrights without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ * The name and trademarks of copyright holder(s) may NOT be used in
+ * advertising or publicity pertaining to the Software or any
+ * derivatives without specific, written prior permission.
+ */
+
+/* Fixed-size object allocator.
+ *
+ * A slab hands out objects of one size, carved from large chunks that it
+ * never returns to the system.  Freed objects go on a free list and are
+ * reused first, so a workload that keeps creating and deleting objects
+ * reuses the same memory instead of fragmenting the malloc() heap, and the
+ * process's footprint is bounded by the peak number of live objects.
+ *
+ * A slab is not thread-safe. */
+
+#ifndef SLAB_H
+#define SLAB_H 1
+
+#include <stddef.h>
+
+struct slab {
+    size_t obj_size;            /* Size of each object, rounded for 'align'. */
+    size_t align;               /* Alignment of each object. */
+    size_t n_per_chunk;         /* Objects carved from each chunk. */
+    void *free_list;            /* Freed objects, linked through their
+                                 * first bytes. */
+    char *next, *end;           /* Unused part of the newest chunk. */
+    void **chunks;              /* Every chunk, for slab_destroy(). */
+
+    /* Statistics. */
+    size_t n_chunks;            /* Chunks allocated. */
+    size_t n_used;              /* Objects currently allocated. */
+    unsigned long long n_allocs; /* Objects ever allocated. */
+};
+
+struct slab_stats {
+    size_t obj_size;            /* Size of each object. */
+    size_t n_used;              /* Objects currently allocated. */
+    size_t n_free;              /* Objects available without growing. */
+    size_t n_bytes;             /* Memory held by the slab. */
+    unsigned long long n_allocs; /* Objects ever allocated. */
+};
+
+void slab_init(struct slab *, size_t obj_size, size_t align);
+void slab_destroy(struct slab *);
+void *slab_alloc(struct slab *);
+void slab_free(struct slab *, void *);
+void slab_get_stats(const struct slab *, struct slab_stats *);
+
+#endif /* slab.h */
@@ -0,0 +1,359 @@
+/* Copyright (c) 2008 The Board of Trustees of The Leland Stanford
+ * Junior University
+ * 
+ * We are making the OpenFlow specification and associated documentation
+ * (Software) available for public use and benefit with the expectation
+ * that others will use, modify and enhance the Software and contribute
+ * those enhancements back to the community. However, since we would
+ * like to make the Software available for broadest use, with as few
+ * restrictions as possible permission is hereby granted, free of
+ * charge, to any person obtaining a copy of this Software to deal in
+ * the Software under the copyrights without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ * The name and trademarks of copyright holder(s) may NOT be used in
+ * advertising or publicity pertaining to the Software or any
+ * derivatives without specific, written prior permission.
+ */
+
+#include <config.h>
+#include "snapshot.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "chain.h"
+#include "datapath.h"
+#include "dp_act.h"
+#include "flow.h"
+#include "ofpbuf.h"
+#include "openflow/openflow.h"
+#include "openflow/openflow-ext.h"
+#include "switch-flow.h"
+#include "table.h"
+#include "timeval.h"
+#include "util.h"
+#include "xtoxll.h"
+
+#define THIS_MODULE VLM_datapath
+#include "vlog.h"
+
+struct export_ctx {
+    struct ofpbuf *buffer;
+    size_t max_size;
+    uint64_t now;
+    bool emerg;
+};
+
+static int
+export_flow(struct sw_flow *flow, void *ctx_)
+{
+    struct export_ctx *ctx = ctx_;
+    size_t actions_len = flow->sf_acts->actions_len;
+    size_t length = sizeof(struct ofp_ext_flow_record)
+                    + ROUND_UP(actions_len, 8);
+    struct ofp_ext_flow_record *rec;
+
+    rec = ofpbuf_put_zeros(ctx->buffer, length);
+    rec->length = htons(length);
+    rec->emerg = ctx->emerg;
+    rec->send_flow_rem = flow->send_flow_rem;
+    rec->priority = htons(flow->priority);
+    rec->idle_timeout = htons(flow->idle_timeout);
+    rec->hard_timeout = htons(flow->hard_timeout);
+    rec->created_age = htonll(ctx->now - MIN(flow->created, ctx->now));
+    rec->used_age = htonll(ctx->now - MIN(flow->used, ctx->now));
+    rec->cookie = htonll(flow->cookie);
+    rec->packet_count = htonll(flow->packet_count);
+    rec->byte_count = htonll(flow->byte_count);
+    flow_fill_match(&rec->match, &flow->key.flow, flow->key.wildcards);
+    memcpy(rec->actions, flow->sf_acts->actions, actions_len);
+    return ctx->buffer->size >= ctx->max_size;
+}
+
+/* Appends to 'buffer' a struct ofp_ext_flow_record for each flow in 'dp',
+ * starting from 'pos', until 'buffer' holds at least 'max_size' bytes.
+ * Returns true if flows remain, in which case 'pos' is updated so that
+ * another call continues where this one stopped, false if the export is
+ * complete. */
+bool
+snapshot_export(struct datapath *dp, struct snapshot_position *pos,
+                struct ofpbuf *buffer, size_t max_size)
+{
+    struct export_ctx ctx;
+    struct sw_flow_key all;
+
+    memset(&all, 0, sizeof all);
+    all.wildcards = OFPFW_ALL;
+
+    ctx.buffer = buffer;
+    ctx.max_size = max_size;
+    ctx.now = time_msec();
+    while (pos->table_idx <= dp->chain->n_tables) {
+        struct sw_table *table = (pos->table_idx < dp->chain->n_tables
+                                  ? dp->chain->tables[pos->table_idx]
+                                  : dp->chain->emerg_table);
+
+        ctx.emerg = table == dp->chain->emerg_table;
+        if (table->iterate(table, &all, htons(OFPP_NONE), &pos->position,
+                           export_flow, &ctx)) {
+            return true;
+        }
+        pos->table_idx++;
+        memset(&pos->position, 0, sizeof pos->position);
+    }
+    return false;
+}
+
+/* Returns the length of the struct ofp_ext_flow_record at the start of the
+ * 'size' bytes at 'p', or 0 if the record is truncated or malformed. */
+size_t
+snapshot_record_len(const void *p, size_t size)
+{
+    const struct ofp_ext_flow_record *rec = p;
+    size_t length;
+
+    if (size < sizeof *rec) {
+        return 0;
+    }
+    length = ntohs(rec->length);
+    return (length >= sizeof *rec && length % 8 == 0 && length <= size
+            ? length : 0);
+}
+
+/* Installs the flow in 'rec', whose length snapshot_record_len() has
+ * accepted, in 'dp'.  'now' is the time to which the record's ages are
+ * relative.  Returns 0 if successful, EINVAL if the flow's actions are not
+ * valid in 'dp', ENOBUFS if no table has room for it, or ENOMEM. */
+int
+snapshot_import_flow(struct datapath *dp,
+                     const struct ofp_ext_flow_record *rec, uint64_t now)
+{
+    size_t actions_len = ntohs(rec->length) - sizeof *rec;
+    struct sw_flow *flow;
+    uint64_t age;
+
+    flow = flow_alloc(actions_len);
+    if (!flow) {
+        return ENOMEM;
+    }
+    flow_extract_match(&flow->key, &rec->match);
+    if (validate_actions(dp, &flow->key, rec->actions, actions_len)
+        != ACT_VALIDATION_OK) {
+        flow_free(flow);
+        return EINVAL;
+    }
+
+    flow->priority = flow->key.wildcards ? ntohs(rec->priority) : -1;
+    flow->cookie = ntohll(rec->cookie);
+    flow->idle_timeout = ntohs(rec->idle_timeout);
+    flow->hard_timeout = ntohs(rec->hard_timeout);
+    flow->send_flow_rem = rec->send_flow_rem != 0;
+    flow->emerg_flow = rec->emerg != 0;
+    flow_setup_actions(flow, rec->actions, actions_len);
+
+    /* flow_setup_actions() resets these, so restore them afterward. */
+    age = ntohll(rec->created_age);
+    flow->created = now - MIN(age, now);
+    age = ntohll(rec->used_age);
+    flow->used = now - MIN(age, now);
+    flow->packet_count = ntohll(rec->packet_count);
+    flow->byte_count = ntohll(rec->byte_count);
+
+    if (chain_insert(dp->chain, flow, flow->emerg_flow)) {
+        flow_free(flow);
+        return ENOBUFS;
+    }
+    return 0;
+}
+
+/* Writes the contents of 'buffer' to a new file named 'file_name' and
+ * flushes it to disk.  Returns 0 if successful, otherwise a positive errno
+ * value. */
+static int
+write_file(const char *file_name, const struct ofpbuf *buffer)
+{
+    const uint8_t *p;
+    size_t left;
+    int error = 0;
+    int fd;
+
+    fd = open(file_name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return errno;
+    }
+    p = buffer->data;
+    left = buffer->size;
+    while (left > 0) {
+        ssize_t retval = write(fd, p, left);
+        if (retval < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            error = errno;
+            break;
+        }
+        p += retval;
+        left -= retval;
+    }
+    if (!error && fsync(fd)) {
+        error = errno;
+    }
+    if (close(fd) && !error) {
+        error = errno;
+    }
+    return error;
+}
+
+/* Writes every flow in 'dp' to 'file_name', replacing it atomically.
+ * Returns 0 if successful, otherwise a positive errno value. */
+int
+snapshot_save(struct datapath *dp, const char *file_name)
+{
+    struct ofp_ext_flow_file_header *fh;
+    struct snapshot_position pos;
+    struct ofpbuf *buffer;
+    uint32_t n_flows;
+    char *tmp_name;
+    const uint8_t *p;
+    int error;
+
+    buffer = ofpbuf_new(65536);
+    ofpbuf_put_zeros(buffer, sizeof *fh);
+    memset(&pos, 0, sizeof pos);
+    snapshot_export(dp, &pos, buffer, SIZE_MAX);
+
+    n_flows = 0;
+    for (p = (const uint8_t *) buffer->data + sizeof *fh;
+         p < (const uint8_t *) ofpbuf_tail(buffer);
+         p += ntohs(((const struct ofp_ext_flow_record *) p)->length)) {
+        n_flows++;
+    }
+
+    fh = buffer->data;
+    fh->magic = htonl(OFP_EXT_FLOW_FILE_MAGIC);
+    fh->version = htonl(OFP_EXT_FLOW_FILE_VERSION);
+    fh->datapath_id = htonll(dp->id);
+    fh->n_flows = htonl(n_flows);
+
+    tmp_name = xasprintf("%s.tmp", file_name);
+    error = write_file(tmp_name, buffer);
+    if (!error && rename(tmp_name, file_name)) {
+        error = errno;
+    }
+    if (error) {
+        VLOG_ERR("%s: could not write flow snapshot (%s)",
+                 file_name, strerror(error));
+        unlink(tmp_name);
+    } else {
+        VLOG_INFO("%s: saved %"PRIu32" flows", file_name, n_flows);
+    }
+    free(tmp_name);
+    ofpbuf_delete(buffer);
+    return error;
+}
+
+/* Installs in 'dp' the flows that snapshot_save() or "dpctl save-flows" wrote
+ * to 'file_name', and stores the number installed in '*n_flowsp'.  Returns 0
+ * if successful, ENOENT if 'file_name' does not exist, otherwise a positive
+ * errno value.  Flows that can no longer be installed, e.g. because the table
+ * layout changed, are skipped with a warning. */
+int
+snapshot_load(struct datapath *dp, const char *file_name,
+              unsigned int *n_flowsp)
+{
+    const struct ofp_ext_flow_file_header *fh;
+    unsigned int n_loaded, n_failed;
+    const uint8_t *p, *end;
+    struct stat s;
+    uint64_t now;
+    void *map;
+    uint32_t i;
+    int error;
+    int fd;
+
+    *n_flowsp = 0;
+    fd = open(file_name, O_RDONLY);
+    if (fd < 0) {
+        return errno;
+    }
+    if (fstat(fd, &s) < 0) {
+        error = errno;
+        close(fd);
+        return error;
+    }
+    if (s.st_size < sizeof *fh) {
+        close(fd);
+        VLOG_ERR("%s: flow snapshot is truncated", file_name);
+        return EINVAL;
+    }
+    map = mmap(NULL, s.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    error = map == MAP_FAILED ? errno : 0;
+    close(fd);
+    if (error) {
+        return error;
+    }
+
+    fh = map;
+    if (ntohl(fh->magic) != OFP_EXT_FLOW_FILE_MAGIC
+        || ntohl(fh->version) != OFP_EXT_FLOW_FILE_VERSION) {
+        VLOG_ERR("%s: not a version %d flow snapshot",
+                 file_name, OFP_EXT_FLOW_FILE_VERSION);
+        error = EINVAL;
+        goto exit;
+    }
+    if (ntohll(fh->datapath_id) != dp->id) {
+        VLOG_WARN("%s: snapshot was taken by datapath %012"PRIx64,
+                  file_name, ntohll(fh->datapath_id));
+    }
+
+    now = time_msec();
+    n_loaded = n_failed = 0;
+    p = (const uint8_t *) (fh + 1);
+    end = (const uint8_t *) map + s.st_size;
+    for (i = 0; i < ntohl(fh->n_flows); i++) {
+        size_t length = snapshot_record_len(p, end - p);
+
+        if (!length) {
+            VLOG_ERR("%s: flow snapshot is truncated or corrupt", file_name);
+            error = EINVAL;
+            break;
+        }
+        if (snapshot_import_flow(dp, (const struct ofp_ext_flow_record *) p,
+                                 now)) {
+            n_failed++;
+        } else {
+            n_loaded++;
+        }
+        p += length;
+    }
+    if (n_failed) {
+        VLOG_WARN("%s: %u flows could not be restored", file_name, n_failed);
+    }
+    VLOG_INFO("%s: restored %u flows", file_name, n_loaded);
+    *n_flowsp = n_loaded;
+
+exit:
+    munmap(map, s.st_size);
+    return error;
+}
@@ -0,0 +1,77 @@
+/* Copyright (c) 2008 The Board of Trustees of The Leland Stanford
+ * Junior University
+ * 
+ * We are making the OpenFlow specification and associated documentation
+ * (Software) available for public use and benefit with the expectation
+ * that others will use, modify and enhance the Software and contribute
+ * those enhancements back to the community. However, since we would
+ * like to make the Software available for broadest use, with as few
+ * restrictions as possible permission is hereby granted, free of
+ * charge, to any person obtaining a copy of this Software to deal in
+ * the Software under the copyrights without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ * The name and trademarks of copyright holder(s) may NOT be used in
+ * advertising or publicity pertaining to the Software or any
+ * derivatives without specific, written prior permission.
+ */
+
+/* Flow table snapshots, for restarting ofdatapath without losing its flows.
+ *
+ * snapshot_save() writes every flow in a datapath's chain, with its match,
+ * actions, timeouts, counters and ages, to a file, and snapshot_load()
+ * installs the flows from such a file in a datapath.  The file is a struct
+ * ofp_ext_flow_file_header followed by one struct ofp_ext_flow_record per
+ * flow, all in network byte order, so that it can be mapped into memory and
+ * walked in place.  The same records carry flows over OpenFlow in
+ * OFP_EXT_STATS_FLOW_EXPORT replies and OFP_EXT_FLOW_IMPORT messages, so
+ * "dpctl save-flows" writes files in this format too.
+ *
+ * Flow ages are relative to the moment of the snapshot: the time that the
+ * datapath is down does not count toward flows' idle or hard timeouts. */
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H 1
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "table.h"
+
+struct datapath;
+struct ofp_ext_flow_record;
+struct ofpbuf;
+
+/* Position of an export in progress.  Initialize to all-zero-bits to start
+ * from the first flow. */
+struct snapshot_position {
+    int table_idx;              /* Chain table, or n_tables for emergency. */
+    struct sw_table_position position;
+};
+
+int snapshot_save(struct datapath *, const char *file_name);
+int snapshot_load(struct datapath *, const char *file_name,
+                  unsigned int *n_flowsp);
+
+bool snapshot_export(struct datapath *, struct snapshot_position *,
+                     struct ofpbuf *, size_t max_size);
+size_t snapshot_record_len(const void *, size_t size);
+int snapshot_import_flow(struct datapath *,
+                         const struct ofp_ext_flow_record *, uint64_t now);
+
+#endif /* snapshot.h */
@@ -34,49 +34,179 @@
 #ifndef SWITCH_FLOW_H
 #define SWITCH_FLOW_H 1
 
+#include <stddef.h>
 #include <time.h>
 #include "openflow/openflow.h"
 #include "flow.h"
+#include "hmap.h"
 #include "list.h"
+#include "slab.h"
 
+struct act_prog;
 struct ofp_match;
+struct sw_table;
 
 /* Identification data for a flow. */
 struct sw_flow_key {
     struct flow flow;           /* Flow data (in network byte order). */
     uint32_t wildcards;         /* Wildcard fields (in host byte order). */
-    uint32_t nw_src_mask;       /* 1-bit in each significant nw_src bit. */
-    uint32_t nw_dst_mask;       /* 1-bit in each significant nw_dst bit. */
+    struct flow mask;           /* 1-bit in each significant bit of 'flow',
+                                 * from flow_make_mask().  All-zero (match
+                                 * anything) in a zeroed OFPFW_ALL key. */
 };
 
 struct sw_flow_actions {
     size_t actions_len;
+    struct act_prog *prog;      /* Compiled 'actions', or null. */
     struct ofp_action_header actions[0];
 };
 
+/* The flows in a chain that have a given cookie. */
+struct flow_cookie_group {
+    struct hmap_node node;      /* In 'map'. */
+    struct hmap *map;           /* The chain's index of cookies. */
+    uint64_t cookie;
+    struct list flows;          /* Contains struct sw_flow's 'cookie_node'. */
+};
+
+/* Running sums of the counters of a set of flows, such as those in one of a
+ * chain's tables, which flow_used() keeps current. */
+struct flow_totals {
+    uint64_t packet_count;
+    uint64_t byte_count;
+    unsigned int n_flows;
+};
+
+/* The flows in a chain's working tables that have a given priority and
+ * wildcards.  Only flows of the same priority can overlap. */
+struct flow_overlap_group {
+    struct hmap_node node;      /* In 'map', hashed on 'priority'. */
+    struct hmap *map;           /* The chain's index of overlap groups. */
+    uint16_t priority;
+    uint32_t wildcards;
+    struct flow mask;           /* flow_make_mask() for 'wildcards'. */
+    struct hmap flows;          /* Contains struct sw_flow's 'overlap_node',
+                                 * hashed by flow_hash_masked() on 'mask'. */
+};
+
+/* The flows in a chain that have an output action to a given port. */
+struct flow_port_group {
+    struct hmap_node node;      /* In the chain's index of output ports. */
+    uint16_t port;              /* In network byte order. */
+    struct list refs;           /* Contains struct flow_port_ref's 'node'. */
+};
+
+/* Links a flow into the flow_port_group for one of its output ports. */
+struct flow_port_ref {
+    struct list node;           /* Element in 'group''s 'refs'. */
+    struct flow_port_group *group;
+    struct sw_flow *flow;
+};
+
+/* Size of a CPU cache line, for keeping data written on every packet apart
+ * from data that is only read. */
+#define FLOW_CACHE_LINE 64
+
+/* Action lists up to this many bytes long are stored inside struct sw_flow
+ * instead of in a separate allocation.  A single output action is 8 bytes
+ * long. */
+#define SFA_INLINE_LEN 16
+
+/* Longer action lists are allocated from slabs of FLOW_ACTS_CLASSES size
+ * classes, the smallest holding FLOW_ACTS_MIN_SIZE bytes including struct
+ * sw_flow_actions and each one twice the size of the last.  Lists too long
+ * for the largest class come from malloc(). */
+#define FLOW_ACTS_CLASSES 5
+#define FLOW_ACTS_MIN_SIZE 64
+
+/* The members of struct sw_flow are grouped by when they are used, so that
+ * a packet touches as few cache lines as possible:
+ *
+ *   - The first two cache lines hold what table lookups read for every
+ *     flow that they examine: the key, with its match mask, and the
+ *     table's linkage.
+ *
+ *   - The third holds what only a matching flow needs: its actions and
+ *     the counters that flow_used() writes.  Keeping the counters off the
+ *     first line means that writing them does not evict keys that lookups
+ *     on other flows read.  Short action lists continue inline from here.
+ *
+ *   - Everything else, used only when flows are added, modified, dumped or
+ *     expired, comes last.
+ *
+ * flow_alloc() aligns each flow to FLOW_CACHE_LINE to make this hold. */
 struct sw_flow {
+    /* Read by lookups. */
     struct sw_flow_key key;
+    struct list node;           /* Private to table implementations. */
 
-    uint64_t cookie;            /* Opaque controller-issued identifier. */
+    /* Read or written for a matching flow. */
+    struct sw_flow_actions *sf_acts __attribute__((aligned(FLOW_CACHE_LINE)));
     uint16_t priority;          /* Only used on entries with wildcards. */
-    uint16_t idle_timeout;      /* Idle time before discarding (seconds). */
-    uint16_t hard_timeout;      /* Hard expiration time (seconds) */
-    uint64_t used;              /* Last used time. */
-    uint64_t created;           /* When the flow was created. */
-    uint64_t packet_count;      /* Number of packets seen. */
-    uint64_t byte_count;        /* Number of bytes seen. */
     uint8_t reason;             /* Reason flow removed (one of OFPRR_*). */
     uint8_t send_flow_rem;      /* Send a flow removed to the controller */
     uint8_t emerg_flow;         /* Emergency flow indicator */
+    bool no_offload;            /* Hardware table refused it even with room. */
+    uint64_t used;              /* Last used time. */
+    uint64_t packet_count;      /* Number of packets seen. */
+    uint64_t byte_count;        /* Number of bytes seen. */
+    struct flow_totals *totals; /* Sums that include this flow, or null. */
+
+    /* Storage for 'sf_acts' if the actions are no longer than
+     * SFA_INLINE_LEN bytes. */
+    union {
+        struct sw_flow_actions acts;
+        uint8_t space[sizeof(struct sw_flow_actions) + SFA_INLINE_LEN];
+    } inline_acts;
 
-    struct sw_flow_actions *sf_acts;
+    /* Cold. */
+    uint64_t cookie;            /* Opaque controller-issued identifier. */
+    uint64_t created;           /* When the flow was created. */
+    uint16_t idle_timeout;      /* Idle time before discarding (seconds). */
+    uint16_t hard_timeout;      /* Hard expiration time (seconds) */
+    uint8_t acts_class;         /* Where 'sf_acts' came from (private). */
 
     /* Private to table implementations. */
-    struct list node;
     struct list iter_node;
     unsigned long int serial;
-
     void *private;              /* Cookie for tables */
+
+    /* Private to the chain. */
+    struct sw_table *table;     /* Table that holds this flow. */
+    struct list timer_node;     /* Element in a timeout wheel slot. */
+    uint64_t timer_tick;        /* Second at which to check for expiration,
+                                 * or 0 if not on the timeout wheel. */
+    unsigned int *deep_ref;     /* Counter to decrement when freed, or null. */
+    unsigned int *complex_ref;  /* Counter of flows whose actions are not
+                                 * act_prog_forward_only(), or null. */
+    struct flow_cookie_group *cookie_group; /* Group holding 'cookie_node',
+                                             * or null. */
+    struct list cookie_node;    /* Element in 'cookie_group''s 'flows'. */
+    uint64_t out_port_bits;     /* Bit (port % 64) set for each output port. */
+    struct hmap *port_index;    /* Chain's index of output ports, or null. */
+    struct flow_port_ref *port_refs; /* 'n_port_refs' links into groups. */
+    unsigned int n_port_refs;
+    struct flow_port_ref port_ref; /* 'port_refs' if there is just one. */
+    struct flow_overlap_group *overlap_group; /* Group holding
+                                               * 'overlap_node', or null. */
+    struct hmap_node overlap_node; /* Element in 'overlap_group''s 'flows'. */
+    uint64_t place_packets;     /* 'packet_count' at last placement pass. */
+    struct list *lru;           /* Chain's eviction list holding 'lru_node',
+                                 * or null. */
+    struct list lru_node;       /* Element in 'lru'. */
+    uint64_t lru_used;          /* 'used' when put at the back of 'lru'. */
+};
+BUILD_ASSERT_DECL(offsetof(struct sw_flow, node) + sizeof(struct list)
+                  <= 2 * FLOW_CACHE_LINE);
+BUILD_ASSERT_DECL(offsetof(struct sw_flow, inline_acts)
+                  + sizeof(struct sw_flow_actions) <= 3 * FLOW_CACHE_LINE);
+
+/* Memory used by flows and their actions, for "dpctl status". */
+struct flow_mem_stats {
+    struct slab_stats flows;
+    struct slab_stats acts[FLOW_ACTS_CLASSES];
+    size_t n_inline_acts;       /* Action lists stored in their flow. */
+    size_t n_large_acts;        /* Action lists from malloc(). */
 };
 
 int flow_matches_1wild(const struct sw_flow_key *, const struct sw_flow_key *);
@@ -86,15 +216,22 @@ int flow_matches_desc(const struct sw_flow_key *, const struct sw_flow_key *,
 int flow_matches_2desc(const struct sw_flow_key *, const struct sw_flow_key *,
                      int);
 int flow_has_out_port(struct sw_flow *flow, uint16_t out_port);
+void flow_index_out_ports(struct sw_flow *, struct hmap *);
+struct flow_port_group *flow_port_group_find(const struct hmap *, uint16_t);
 struct sw_flow *flow_alloc(size_t);
 void flow_setup_actions(struct sw_flow *, const struct ofp_action_header *, int);
 void flow_free(struct sw_flow *);
+void flow_get_mem_stats(struct flow_mem_stats *);
 void flow_replace_acts(struct sw_flow *, const struct ofp_action_header *, 
         size_t);
 void flow_extract_match(struct sw_flow_key* to, const struct ofp_match* from);
+void flow_make_mask(const struct sw_flow_key *, struct flow *mask);
+uint32_t flow_hash_masked(const struct flow *, const struct flow *mask);
 
 void print_flow(const struct sw_flow_key *);
 bool flow_timeout(struct sw_flow *flow);
 void flow_used(struct sw_flow *flow, struct ofpbuf *buffer);
+void flow_totals_attach(struct sw_flow *, struct flow_totals *);
+void flow_totals_detach(struct sw_flow *);
 
 #endif /* switch-flow.h */
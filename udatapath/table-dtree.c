@@ -0,0 +1,926 @@
+/* Copyright (c) 2008 The Board of Trustees of The Leland Stanford
+ * Junior University
+ * 
+ * We are making the OpenFlow specification and associated documentation
+ * (Software) available for public use and benefit with the expectation
+ * that others will use, modify and enhance the Software and contribute
+ * those enhancements back to the community. However, since we would
+ * like to make the Software available for broadest use, with as few
+ * restrictions as possible permission is hereby granted, free of
+ * charge, to any person obtaining a copy of this Software to deal in
+ * the Software under the copyrights without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ * The name and trademarks of copyright holder(s) may NOT be used in
+ * advertising or publicity pertaining to the Software or any
+ * derivatives without specific, written prior permission.
+ */
+
+/* Decision tree table, for large sets of flows that rarely change, such as
+ * emergency flows and proactively installed ACLs.
+ *
+ * The table compiles its flows into a HiCuts-style decision tree.  Each
+ * interior node cuts the packets that reach it into 2**N parts on N bits of
+ * one header field, and each leaf holds the few flows that overlap its part,
+ * in decreasing order of priority.  A flow that wildcards some of the bits
+ * that a node cuts on goes into each child that it overlaps, so, to keep
+ * such copies few, flows that match on different sets of fields go into
+ * different trees, as in EffiCuts.  A lookup searches the trees in
+ * decreasing order of the highest priority in each, until no remaining tree
+ * could hold a better match.  A lookup takes one
+ * step per level, of which there are at most DT_MAX_DEPTH, in each tree,
+ * and then compares the packet against the flows in one leaf.
+ *
+ * Compiling is too slow to repeat for every flow_mod, so flows added since
+ * the last compile go into a tuple space search table that is searched
+ * along with the tree.  Once flows stop arriving, or enough of them pile up,
+ * table_dtree_run() compiles all of the flows into a new tree and swaps it
+ * in.  Deleting or replacing a flow edits the tree in place. */
+
+#include <config.h>
+#include "table.h"
+#include <arpa/inet.h>
+#include <stdlib.h>
+#include <string.h>
+#include "flow.h"
+#include "list.h"
+#include "openflow/openflow.h"
+#include "packets.h"
+#include "switch-flow.h"
+#include "datapath.h"
+#include "timeval.h"
+#include "util.h"
+
+/* A leaf is not cut further once it holds this many flows or fewer. */
+#define DT_LEAF_FLOWS 8
+
+/* Maximum number of levels of interior nodes. */
+#define DT_MAX_DEPTH 16
+
+/* Number of bits of a field that an interior node cuts on.  The candidate
+ * cuts are the aligned DT_CUT_BITS-bit windows of each field. */
+#define DT_CUT_BITS 4
+
+/* The tree may hold up to this many flow pointers per flow.  Flows that
+ * wildcard a field that a node cuts on go into more than one child. */
+#define DT_SPACE_FACTOR 8
+
+/* table_dtree_run() compiles once no flow has been added for DT_QUIET_MSEC
+ * and at least DT_COMPILE_MIN flows are waiting, or no flow has been added
+ * for DT_IDLE_MSEC; or right away once the waiting flows are as many as the
+ * compiled ones and at least DT_COMPILE_BULK. */
+#define DT_QUIET_MSEC 1000
+#define DT_COMPILE_MIN 16
+#define DT_IDLE_MSEC 10000
+#define DT_COMPILE_BULK 1024
+
+/* Header fields that nodes may cut on. */
+enum dt_field {
+    DT_IN_PORT,
+    DT_DL_VLAN,
+    DT_DL_SRC,
+    DT_DL_DST,
+    DT_DL_TYPE,
+    DT_NW_PROTO,
+    DT_NW_SRC,
+    DT_NW_DST,
+    DT_TP_SRC,
+    DT_TP_DST,
+    DT_N_FIELDS
+};
+
+/* Width of each dt_field, in bits. */
+static const int field_width[DT_N_FIELDS] = {
+    16, 16, 48, 48, 16, 8, 32, 32, 16, 16
+};
+
+struct dt_node {
+    struct dt_node **children;  /* 1 << 'n_bits' children, some possibly
+                                 * null, or null in a leaf. */
+    uint8_t field;              /* dt_field that the node cuts on. */
+    uint8_t shift;              /* Bits of 'field' below the ones cut on. */
+    uint8_t n_bits;             /* Bits of 'field' that pick the child. */
+    size_t n_flows;             /* In a leaf, 'flows' in decreasing order of */
+    struct sw_flow **flows;     /* priority, oldest first among equals. */
+};
+
+/* The tree for the flows that match on one set of fields. */
+struct dt_tree {
+    uint32_t fields;            /* Bitmap of the dt_fields matched on. */
+    uint16_t max_priority;      /* No flow in the tree has higher priority. */
+    struct dt_node *root;       /* Null if the tree is empty. */
+};
+
+struct sw_table_dtree {
+    struct sw_table swt;
+
+    unsigned int max_flows;
+    unsigned long int n_insert_failed;
+    unsigned int n_compiled;    /* Number of flows in 'trees'. */
+    struct list compiled;       /* Flows in 'trees', by 'iter_node', in
+                                 * decreasing order of 'serial'. */
+    struct dt_tree *trees;      /* In decreasing order of 'max_priority'. */
+    size_t n_trees;
+    struct sw_table *pending;   /* Flows added since the last compile. */
+    long long int last_insert;  /* time_msec() when a flow was last added. */
+};
+
+/* Returns the value of 'field' in 'flow', in host byte order. */
+static uint64_t
+field_value(const struct flow *flow, enum dt_field field)
+{
+    switch (field) {
+    case DT_IN_PORT:
+        return ntohs(flow->in_port);
+    case DT_DL_VLAN:
+        return ntohs(flow->dl_vlan);
+    case DT_DL_SRC:
+        return eth_addr_to_uint64(flow->dl_src);
+    case DT_DL_DST:
+        return eth_addr_to_uint64(flow->dl_dst);
+    case DT_DL_TYPE:
+        return ntohs(flow->dl_type);
+    case DT_NW_PROTO:
+        return flow->nw_proto;
+    case DT_NW_SRC:
+        return ntohl(flow->nw_src);
+    case DT_NW_DST:
+        return ntohl(flow->nw_dst);
+    case DT_TP_SRC:
+        return ntohs(flow->tp_src);
+    case DT_TP_DST:
+        return ntohs(flow->tp_dst);
+    case DT_N_FIELDS:
+        break;
+    }
+    NOT_REACHED();
+}
+
+/* Returns the number of leading 1-bits in 'mask', a network mask in network
+ * byte order. */
+static int
+prefix_len(uint32_t mask)
+{
+    mask = ntohl(mask);
+    return mask ? 32 - __builtin_ctz(mask) : 0;
+}
+
+/* Returns the number of leading bits of 'field' that 'key' matches on. */
+static int
+field_prefix_len(const struct sw_flow_key *key, enum dt_field field)
+{
+    switch (field) {
+    case DT_IN_PORT:
+        return key->mask.in_port ? 16 : 0;
+    case DT_DL_VLAN:
+        return key->mask.dl_vlan ? 16 : 0;
+    case DT_DL_SRC:
+        return key->mask.dl_src[0] ? 48 : 0;
+    case DT_DL_DST:
+        return key->mask.dl_dst[0] ? 48 : 0;
+    case DT_DL_TYPE:
+        return key->mask.dl_type ? 16 : 0;
+    case DT_NW_PROTO:
+        return key->mask.nw_proto ? 8 : 0;
+    case DT_NW_SRC:
+        return prefix_len(key->mask.nw_src);
+    case DT_NW_DST:
+        return prefix_len(key->mask.nw_dst);
+    case DT_TP_SRC:
+        return key->mask.tp_src ? 16 : 0;
+    case DT_TP_DST:
+        return key->mask.tp_dst ? 16 : 0;
+    case DT_N_FIELDS:
+        break;
+    }
+    NOT_REACHED();
+}
+
+/* Returns the bitmap of the dt_fields that 'key' matches on at all. */
+static uint32_t
+key_fields(const struct sw_flow_key *key)
+{
+    uint32_t fields = 0;
+    int f;
+
+    for (f = 0; f < DT_N_FIELDS; f++) {
+        if (field_prefix_len(key, f)) {
+            fields |= 1u << f;
+        }
+    }
+    return fields;
+}
+
+/* Computes the children that 'key' overlaps in a node that cuts on the
+ * 'n_bits' bits of 'field' above its lowest 'shift' bits.  They are '*count'
+ * consecutive children starting at '*first'. */
+static void
+child_range(const struct sw_flow_key *key, enum dt_field field, int shift,
+            int n_bits, unsigned int *first, unsigned int *count)
+{
+    int above = field_width[field] - shift - n_bits;
+    int len = field_prefix_len(key, field);
+    int m = len > above ? MIN(len - above, n_bits) : 0;
+    unsigned int bits = 0;
+
+    if (m) {
+        bits = ((field_value(&key->flow, field) >> (shift + n_bits - m))
+                & ((1u << m) - 1));
+    }
+    *first = bits << (n_bits - m);
+    *count = 1u << (n_bits - m);
+}
+
+/* State of a tree under construction. */
+struct dt_build {
+    size_t n_entries;           /* Flow pointers stored in leaves so far. */
+    size_t max_entries;         /* Cut no further beyond this many. */
+};
+
+/* Picks the window of bits on which to cut a node that holds the 'n' flows
+ * in 'flows'.  The best window is the one whose largest child is smallest,
+ * and then whose children hold the fewest flows in total.  Returns the field
+ * and stores the window's shift in '*shiftp', or returns -1 if no cut would
+ * separate the flows. */
+static int
+choose_cut(const struct dt_build *b, struct sw_flow **flows, size_t n,
+           int *shiftp)
+{
+    size_t best_max = n, best_total = 0;
+    int best = -1;
+    int f;
+
+    for (f = 0; f < DT_N_FIELDS; f++) {
+        int shift;
+
+        for (shift = 0; shift < field_width[f]; shift += DT_CUT_BITS) {
+            size_t sizes[1 << DT_CUT_BITS];
+            size_t max, total;
+            unsigned int c;
+            size_t i;
+
+            memset(sizes, 0, sizeof sizes);
+            total = 0;
+            for (i = 0; i < n; i++) {
+                unsigned int first, count;
+
+                child_range(&flows[i]->key, f, shift, DT_CUT_BITS,
+                            &first, &count);
+                for (c = first; c < first + count; c++) {
+                    sizes[c]++;
+                }
+                total += count;
+            }
+            max = 0;
+            for (c = 0; c < 1u << DT_CUT_BITS; c++) {
+                max = MAX(max, sizes[c]);
+            }
+            if (b->n_entries + total > b->max_entries) {
+                continue;
+            }
+            if (max < best_max || (max == best_max && best >= 0
+                                   && total < best_total)) {
+                best = f;
+                *shiftp = shift;
+                best_max = max;
+                best_total = total;
+            }
+        }
+    }
+    return best;
+}
+
+/* Builds and returns a subtree for the 'n' flows in 'flows', which are in
+ * decreasing order of priority, at 'depth' in the tree.  Returns a null
+ * pointer if 'n' is 0. */
+static struct dt_node *
+build_node(struct dt_build *b, struct sw_flow **flows, size_t n, int depth)
+{
+    struct dt_node *node;
+    int field, shift;
+
+    if (!n) {
+        return NULL;
+    }
+
+    node = xmalloc(sizeof *node);
+    field = (n > DT_LEAF_FLOWS && depth < DT_MAX_DEPTH
+             ? choose_cut(b, flows, n, &shift)
+             : -1);
+    if (field < 0) {
+        node->children = NULL;
+        node->n_flows = n;
+        node->flows = xmalloc(n * sizeof *node->flows);
+        memcpy(node->flows, flows, n * sizeof *node->flows);
+        b->n_entries += n;
+    } else {
+        struct sw_flow **subset;
+        unsigned int c;
+
+        node->field = field;
+        node->shift = shift;
+        node->n_bits = DT_CUT_BITS;
+        node->n_flows = 0;
+        node->flows = NULL;
+        node->children = xmalloc((1u << node->n_bits)
+                                 * sizeof *node->children);
+
+        subset = xmalloc(n * sizeof *subset);
+        for (c = 0; c < 1u << node->n_bits; c++) {
+            size_t i, n_subset = 0;
+
+            for (i = 0; i < n; i++) {
+                unsigned int first, count;
+
+                child_range(&flows[i]->key, field, node->shift, node->n_bits,
+                            &first, &count);
+                if (c >= first && c < first + count) {
+                    subset[n_subset++] = flows[i];
+                }
+            }
+            node->children[c] = build_node(b, subset, n_subset, depth + 1);
+        }
+        free(subset);
+    }
+    return node;
+}
+
+static void
+tree_destroy(struct dt_node *node)
+{
+    if (node) {
+        if (node->children) {
+            unsigned int c;
+
+            for (c = 0; c < 1u << node->n_bits; c++) {
+                tree_destroy(node->children[c]);
+            }
+            free(node->children);
+        }
+        free(node->flows);
+        free(node);
+    }
+}
+
+/* Returns the highest-priority flow in the tree rooted at 'node' that
+ * matches 'key', or a null pointer.  Adds the number of flows compared with
+ * 'key' to '*n_compares'. */
+static inline struct sw_flow *
+tree_lookup(const struct dt_node *node, const struct sw_flow_key *key,
+            unsigned int *n_compares)
+{
+    size_t i;
+
+    while (node && node->children) {
+        uint64_t value = field_value(&key->flow, node->field);
+        node = node->children[(value >> node->shift)
+                              & ((1u << node->n_bits) - 1)];
+    }
+    if (node) {
+        for (i = 0; i < node->n_flows; i++) {
+            ++*n_compares;
+            if (flow_matches_1wild(key, &node->flows[i]->key)) {
+                return node->flows[i];
+            }
+        }
+    }
+    return NULL;
+}
+
+/* Returns a flow in the tree rooted at 'node' that has the same match and
+ * priority as 'flow', or a null pointer. */
+static struct sw_flow *
+tree_find(const struct dt_node *node, const struct sw_flow *flow)
+{
+    size_t i;
+
+    /* An identical flow went into every child that 'flow' overlaps. */
+    while (node && node->children) {
+        unsigned int first, count;
+
+        child_range(&flow->key, node->field, node->shift, node->n_bits,
+                    &first, &count);
+        node = node->children[first];
+    }
+    if (node) {
+        for (i = 0; i < node->n_flows; i++) {
+            struct sw_flow *f = node->flows[i];
+            if (f->priority == flow->priority
+                && f->key.wildcards == flow->key.wildcards
+                && flow_matches_2wild(&f->key, &flow->key)) {
+                return f;
+            }
+        }
+    }
+    return NULL;
+}
+
+/* Replaces 'flow' by 'replacement' in every leaf of the tree rooted at
+ * '*nodep' that holds it, or removes it from them if 'replacement' is null.
+ * Leaves that become empty are freed. */
+static void
+tree_replace(struct dt_node **nodep, const struct sw_flow *flow,
+             struct sw_flow *replacement)
+{
+    struct dt_node *node = *nodep;
+
+    if (!node) {
+        return;
+    } else if (node->children) {
+        unsigned int first, count, c;
+
+        child_range(&flow->key, node->field, node->shift, node->n_bits,
+                    &first, &count);
+        for (c = first; c < first + count; c++) {
+            tree_replace(&node->children[c], flow, replacement);
+        }
+    } else {
+        size_t i;
+
+        for (i = 0; i < node->n_flows; i++) {
+            if (node->flows[i] == flow) {
+                if (replacement) {
+                    node->flows[i] = replacement;
+                } else {
+                    memmove(&node->flows[i], &node->flows[i + 1],
+                            (node->n_flows - i - 1) * sizeof *node->flows);
+                    if (!--node->n_flows) {
+                        tree_destroy(node);
+                        *nodep = NULL;
+                    }
+                }
+                break;
+            }
+        }
+    }
+}
+
+/* Returns the tree in 'dt' for flows that match on the same fields as
+ * 'flow', or a null pointer if there is none. */
+static struct dt_tree *
+find_tree(const struct sw_table_dtree *dt, const struct sw_flow *flow)
+{
+    uint32_t fields = key_fields(&flow->key);
+    size_t i;
+
+    for (i = 0; i < dt->n_trees; i++) {
+        if (dt->trees[i].fields == fields) {
+            return &dt->trees[i];
+        }
+    }
+    return NULL;
+}
+
+static void
+destroy_trees(struct dt_tree *trees, size_t n_trees)
+{
+    size_t i;
+
+    for (i = 0; i < n_trees; i++) {
+        tree_destroy(trees[i].root);
+    }
+    free(trees);
+}
+
+/* Removes 'flow', which must be compiled into one of 'dt''s trees, from the
+ * tree, without freeing it. */
+static void
+remove_compiled(struct sw_table_dtree *dt, struct sw_flow *flow)
+{
+    tree_replace(&find_tree(dt, flow)->root, flow, NULL);
+    list_remove(&flow->iter_node);
+    dt->n_compiled--;
+}
+
+static unsigned int
+n_pending(const struct sw_table_dtree *dt)
+{
+    struct sw_table_stats stats;
+
+    dt->pending->stats(dt->pending, &stats);
+    return stats.n_flows;
+}
+
+static int
+compare_priority(const void *a_, const void *b_)
+{
+    const struct sw_flow *a = *(struct sw_flow *const *) a_;
+    const struct sw_flow *b = *(struct sw_flow *const *) b_;
+
+    return (a->priority != b->priority ? (a->priority < b->priority ? 1 : -1)
+            : a->serial != b->serial ? (a->serial > b->serial ? 1 : -1)
+            : 0);
+}
+
+static int
+compare_tree_priority(const void *a_, const void *b_)
+{
+    const struct dt_tree *a = a_;
+    const struct dt_tree *b = b_;
+
+    return (a->max_priority < b->max_priority ? 1
+            : a->max_priority > b->max_priority ? -1
+            : 0);
+}
+
+static int
+compare_serial(const void *a_, const void *b_)
+{
+    const struct sw_flow *a = *(struct sw_flow *const *) a_;
+    const struct sw_flow *b = *(struct sw_flow *const *) b_;
+
+    return a->serial < b->serial ? 1 : a->serial > b->serial ? -1 : 0;
+}
+
+struct collect_aux {
+    struct sw_flow **flows;
+    size_t n;
+};
+
+static int
+collect_flow(struct sw_flow *flow, void *aux_)
+{
+    struct collect_aux *aux = aux_;
+    aux->flows[aux->n++] = flow;
+    return 0;
+}
+
+/* Compiles all of 'dt''s flows, including the pending ones, into new trees,
+ * and swaps them in for the old ones. */
+static void
+compile(struct sw_table_dtree *dt)
+{
+    struct sw_table_position position;
+    struct collect_aux aux;
+    struct sw_flow_key all;
+    struct sw_flow **subset;
+    struct dt_tree *trees;
+    size_t n_trees;
+    struct sw_flow *flow;
+    uint32_t *fields;
+    size_t n_old, i, j;
+
+    aux.flows = xmalloc((dt->n_compiled + n_pending(dt)) * sizeof *aux.flows);
+    aux.n = 0;
+    LIST_FOR_EACH (flow, struct sw_flow, iter_node, &dt->compiled) {
+        aux.flows[aux.n++] = flow;
+    }
+    n_old = aux.n;
+    memset(&all, 0, sizeof all);
+    all.wildcards = OFPFW_ALL;
+    memset(&position, 0, sizeof position);
+    dt->pending->iterate(dt->pending, &all, htons(OFPP_NONE), &position,
+                         collect_flow, &aux);
+    for (i = n_old; i < aux.n; i++) {
+        dt->pending->remove(dt->pending, aux.flows[i]);
+        aux.flows[i]->private = dt;
+    }
+
+    qsort(aux.flows, aux.n, sizeof *aux.flows, compare_serial);
+    list_init(&dt->compiled);
+    for (i = 0; i < aux.n; i++) {
+        list_push_back(&dt->compiled, &aux.flows[i]->iter_node);
+    }
+    dt->n_compiled = aux.n;
+
+    /* Build a tree for each set of fields, from a subset of the flows that
+     * stays in decreasing order of priority. */
+    qsort(aux.flows, aux.n, sizeof *aux.flows, compare_priority);
+    fields = xmalloc(aux.n * sizeof *fields);
+    for (i = 0; i < aux.n; i++) {
+        fields[i] = key_fields(&aux.flows[i]->key);
+    }
+    subset = xmalloc(aux.n * sizeof *subset);
+    trees = NULL;
+    n_trees = 0;
+    for (i = 0; i < aux.n; i++) {
+        struct dt_tree *tree;
+        struct dt_build b;
+        size_t n_subset;
+
+        for (j = 0; j < n_trees; j++) {
+            if (trees[j].fields == fields[i]) {
+                break;
+            }
+        }
+        if (j < n_trees) {
+            continue;
+        }
+
+        n_subset = 0;
+        for (j = i; j < aux.n; j++) {
+            if (fields[j] == fields[i]) {
+                subset[n_subset++] = aux.flows[j];
+            }
+        }
+        trees = xrealloc(trees, (n_trees + 1) * sizeof *trees);
+        tree = &trees[n_trees++];
+        tree->fields = fields[i];
+        tree->max_priority = aux.flows[i]->priority;
+        b.n_entries = 0;
+        b.max_entries = n_subset * DT_SPACE_FACTOR;
+        tree->root = build_node(&b, subset, n_subset, 0);
+    }
+    qsort(trees, n_trees, sizeof *trees, compare_tree_priority);
+    free(subset);
+    free(fields);
+    free(aux.flows);
+
+    destroy_trees(dt->trees, dt->n_trees);
+    dt->trees = trees;
+    dt->n_trees = n_trees;
+}
+
+/* Returns the highest-priority flow in 'dt' that matches 'key', if any,
+ * storing in '*n_compares' the number of flows compared with 'key'. */
+static inline struct sw_flow *
+dtree_lookup(struct sw_table_dtree *dt, const struct sw_flow_key *key,
+             unsigned int *n_compares)
+{
+    struct sw_flow *best = NULL;
+    struct sw_flow *newer;
+    unsigned int n_pending;
+    size_t i;
+
+    *n_compares = 0;
+    for (i = 0; i < dt->n_trees; i++) {
+        const struct dt_tree *tree = &dt->trees[i];
+        struct sw_flow *flow;
+
+        if (best && tree->max_priority <= best->priority) {
+            break;
+        }
+        flow = tree_lookup(tree->root, key, n_compares);
+        if (flow && (!best || flow->priority > best->priority)) {
+            best = flow;
+        }
+    }
+
+    /* Among flows of equal priority, the older one wins. */
+    newer = dt->pending->lookup_trace(dt->pending, key, &n_pending);
+    *n_compares += n_pending;
+    return newer && (!best || newer->priority > best->priority) ? newer : best;
+}
+
+static struct sw_flow *table_dtree_lookup(struct sw_table *swt,
+                                          const struct sw_flow_key *key)
+{
+    unsigned int n_compares;
+    return dtree_lookup((struct sw_table_dtree *) swt, key, &n_compares);
+}
+
+static struct sw_flow *table_dtree_lookup_trace(struct sw_table *swt,
+                                                const struct sw_flow_key *key,
+                                                unsigned int *n_compares)
+{
+    return dtree_lookup((struct sw_table_dtree *) swt, key, n_compares);
+}
+
+static int table_dtree_insert(struct sw_table *swt, struct sw_flow *flow)
+{
+    struct sw_table_dtree *dt = (struct sw_table_dtree *) swt;
+    struct dt_tree *tree = find_tree(dt, flow);
+    struct sw_flow *f;
+
+    /* Just replace any flow that matches exactly. */
+    f = tree ? tree_find(tree->root, flow) : NULL;
+    if (f) {
+        flow->serial = f->serial;
+        flow->private = dt;
+        tree_replace(&tree->root, f, flow);
+        list_replace(&flow->iter_node, &f->iter_node);
+        flow_free(f);
+        return 1;
+    }
+
+    /* Make sure there's room in the table. */
+    if (dt->n_compiled + n_pending(dt) >= dt->max_flows
+        && !dt->pending->has_conflict(dt->pending, &flow->key,
+                                      flow->priority, true)) {
+        dt->n_insert_failed++;
+        return 0;
+    }
+    if (!dt->pending->insert(dt->pending, flow)) {
+        dt->n_insert_failed++;
+        return 0;
+    }
+    dt->last_insert = time_msec();
+    return 1;
+}
+
+static int table_dtree_modify(struct sw_table *swt,
+                const struct sw_flow_key *key, uint16_t priority, int strict,
+                const struct ofp_action_header *actions, size_t actions_len)
+{
+    struct sw_table_dtree *dt = (struct sw_table_dtree *) swt;
+    struct sw_flow *flow;
+    unsigned int count = 0;
+
+    LIST_FOR_EACH (flow, struct sw_flow, iter_node, &dt->compiled) {
+        if (flow_matches_desc(&flow->key, key, strict)
+                && (!strict || (flow->priority == priority))) {
+            flow_replace_acts(flow, actions, actions_len);
+            count++;
+        }
+    }
+    return count + dt->pending->modify(dt->pending, key, priority, strict,
+                                       actions, actions_len);
+}
+
+static int table_dtree_has_conflict(struct sw_table *swt,
+                                    const struct sw_flow_key *key,
+                                    uint16_t priority, int strict)
+{
+    struct sw_table_dtree *dt = (struct sw_table_dtree *) swt;
+    struct sw_flow *flow;
+
+    LIST_FOR_EACH (flow, struct sw_flow, iter_node, &dt->compiled) {
+        if (flow_matches_2desc(&flow->key, key, strict)
+                && (flow->priority == priority)) {
+            return true;
+        }
+    }
+    return dt->pending->has_conflict(dt->pending, key, priority, strict);
+}
+
+static int table_dtree_delete(struct datapath *dp, struct sw_table *swt,
+                              const struct sw_flow_key *key,
+                              uint16_t out_port,
+                              uint16_t priority, int strict)
+{
+    struct sw_table_dtree *dt = (struct sw_table_dtree *) swt;
+    struct sw_flow *flow, *n;
+    unsigned int count = 0;
+
+    LIST_FOR_EACH_SAFE (flow, n, struct sw_flow, iter_node, &dt->compiled) {
+        if (flow_matches_desc(&flow->key, key, strict)
+                && flow_has_out_port(flow, out_port)
+                && (!strict || (flow->priority == priority))) {
+            dp_send_flow_end(dp, flow, OFPRR_DELETE);
+            remove_compiled(dt, flow);
+            flow_free(flow);
+            count++;
+        }
+    }
+    return count + dt->pending->delete(dp, dt->pending, key, out_port,
+                                       priority, strict);
+}
+
+static void table_dtree_timeout(struct sw_table *swt, struct list *deleted)
+{
+    struct sw_table_dtree *dt = (struct sw_table_dtree *) swt;
+    struct sw_flow *flow, *n;
+
+    LIST_FOR_EACH_SAFE (flow, n, struct sw_flow, iter_node, &dt->compiled) {
+        if (flow_timeout(flow)) {
+            remove_compiled(dt, flow);
+            list_push_back(deleted, &flow->node);
+        }
+    }
+    dt->pending->timeout(dt->pending, deleted);
+}
+
+static void table_dtree_remove(struct sw_table *swt, struct sw_flow *flow)
+{
+    struct sw_table_dtree *dt = (struct sw_table_dtree *) swt;
+
+    if (flow->private == dt) {
+        remove_compiled(dt, flow);
+    } else {
+        dt->pending->remove(dt->pending, flow);
+    }
+}
+
+static void table_dtree_destroy(struct sw_table *swt)
+{
+    struct sw_table_dtree *dt = (struct sw_table_dtree *) swt;
+
+    destroy_trees(dt->trees, dt->n_trees);
+    while (!list_is_empty(&dt->compiled)) {
+        struct sw_flow *flow = CONTAINER_OF(list_pop_front(&dt->compiled),
+                                            struct sw_flow, iter_node);
+        flow_free(flow);
+    }
+    dt->pending->destroy(dt->pending);
+    free(dt);
+}
+
+/* Iterates over the compiled flows, then the pending ones.  'private[0]'
+ * holds the position within the compiled flows, 'private[1]' is nonzero
+ * once they are done, and 'private[2]' holds the pending table's
+ * 'private[0]'. */
+static int table_dtree_iterate(struct sw_table *swt,
+                               const struct sw_flow_key *key,
+                               uint16_t out_port,
+                               struct sw_table_position *position,
+                               int (*callback)(struct sw_flow *, void *),
+                               void *private)
+{
+    struct sw_table_dtree *dt = (struct sw_table_dtree *) swt;
+    struct sw_table_position pending_position;
+    struct sw_flow *flow;
+    int error;
+
+    if (!position->private[1]) {
+        unsigned long start = ~position->private[0];
+
+        LIST_FOR_EACH (flow, struct sw_flow, iter_node, &dt->compiled) {
+            if (flow->serial <= start
+                    && flow_matches_2wild(key, &flow->key)
+                    && flow_has_out_port(flow, out_port)) {
+                error = callback(flow, private);
+                if (error) {
+                    position->private[0] = ~(flow->serial - 1);
+                    return error;
+                }
+            }
+        }
+        position->private[1] = 1;
+    }
+
+    memset(&pending_position, 0, sizeof pending_position);
+    pending_position.private[0] = position->private[2];
+    error = dt->pending->iterate(dt->pending, key, out_port,
+                                 &pending_position, callback, private);
+    position->private[2] = pending_position.private[0];
+    return error;
+}
+
+static void table_dtree_stats(struct sw_table *swt,
+                              struct sw_table_stats *stats)
+{
+    struct sw_table_dtree *dt = (struct sw_table_dtree *) swt;
+    stats->name = "dtree";
+    stats->wildcards = OFPFW_ALL;
+    stats->n_flows   = dt->n_compiled + n_pending(dt);
+    stats->max_flows = dt->max_flows;
+    stats->n_lookup  = swt->n_lookup;
+    stats->n_matched = swt->n_matched;
+    stats->n_insert_failed = dt->n_insert_failed;
+}
+
+static void table_dtree_run(struct sw_table *swt)
+{
+    struct sw_table_dtree *dt = (struct sw_table_dtree *) swt;
+    unsigned int n = n_pending(dt);
+    long long int quiet = time_msec() - dt->last_insert;
+
+    if (n && ((quiet >= DT_QUIET_MSEC && n >= DT_COMPILE_MIN)
+              || quiet >= DT_IDLE_MSEC
+              || n >= MAX(dt->n_compiled, DT_COMPILE_BULK))) {
+        compile(dt);
+    }
+}
+
+struct sw_table *table_dtree_create(unsigned int max_flows)
+{
+    struct sw_table_dtree *dt;
+    struct sw_table *swt;
+
+    dt = calloc(1, sizeof *dt);
+    if (dt == NULL)
+        return NULL;
+    dt->pending = table_tss_create(max_flows);
+    if (dt->pending == NULL) {
+        free(dt);
+        return NULL;
+    }
+
+    swt = &dt->swt;
+    swt->lookup = table_dtree_lookup;
+    swt->lookup_trace = table_dtree_lookup_trace;
+    swt->insert = table_dtree_insert;
+    swt->modify = table_dtree_modify;
+    swt->has_conflict = table_dtree_has_conflict;
+    swt->delete = table_dtree_delete;
+    swt->timeout = table_dtree_timeout;
+    swt->remove = table_dtree_remove;
+    swt->destroy = table_dtree_destroy;
+    swt->iterate = table_dtree_iterate;
+    swt->stats = table_dtree_stats;
+    swt->run = table_dtree_run;
+
+    dt->max_flows = max_flows;
+    dt->n_compiled = 0;
+    list_init(&dt->compiled);
+    dt->trees = NULL;
+    dt->n_trees = 0;
+    dt->last_insert = time_msec();
+
+    return swt;
+}
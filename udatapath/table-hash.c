@@ -34,56 +34,364 @@
 #include <config.h>
 #include "table.h"
 #include <assert.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 #include "openflow/nicira-ext.h"
 #include "crc32.h"
 #include "datapath.h"
 #include "flow.h"
+#include "hugepage.h"
+#include "random.h"
 #include "switch-flow.h"
 
+/* Index of the flows in an exact-match table.
+ *
+ * The tables in this file may grow to tens of thousands of buckets, most of
+ * them empty on a typical switch, so wildcarded modify, delete and stats
+ * requests do not visit the buckets.  Instead, each table also links its
+ * flows through 'iter_node' into one of FLOW_INDEX_LISTS lists, chosen by
+ * input port and ordered newest first, and walks those: the cost is then
+ * proportional to the flows in the table, and a request that names an input
+ * port walks only that port's list.  As in table-linear.c, each flow has a
+ * serial number so that iteration can resume after flows come and go. */
+#define FLOW_INDEX_LISTS 16
+
+struct flow_index {
+    struct list lists[FLOW_INDEX_LISTS];
+    unsigned long int next_serial;
+};
+
+static void
+flow_index_init(struct flow_index *fi)
+{
+    int i;
+
+    for (i = 0; i < FLOW_INDEX_LISTS; i++) {
+        list_init(&fi->lists[i]);
+    }
+    fi->next_serial = 1;
+}
+
+static struct list *
+flow_index_list(struct flow_index *fi, uint16_t in_port)
+{
+    return &fi->lists[in_port % FLOW_INDEX_LISTS];
+}
+
+static void
+flow_index_insert(struct flow_index *fi, struct sw_flow *flow)
+{
+    flow->serial = fi->next_serial++;
+    list_push_front(flow_index_list(fi, flow->key.flow.in_port),
+                    &flow->iter_node);
+}
+
+/* Puts 'new_flow' in the place of 'old_flow', which has the same key. */
+static void
+flow_index_replace(struct sw_flow *old_flow, struct sw_flow *new_flow)
+{
+    new_flow->serial = old_flow->serial;
+    list_replace(&new_flow->iter_node, &old_flow->iter_node);
+}
+
+static void
+flow_index_remove(struct sw_flow *flow)
+{
+    list_remove(&flow->iter_node);
+}
+
+/* Stores in '*first' and '*last' the range of lists in 'fi' that may hold
+ * flows matching 'key'. */
+static void
+flow_index_range(const struct sw_flow_key *key, int *first, int *last)
+{
+    if (key->wildcards & OFPFW_IN_PORT) {
+        *first = 0;
+        *last = FLOW_INDEX_LISTS - 1;
+    } else {
+        *first = *last = key->flow.in_port % FLOW_INDEX_LISTS;
+    }
+}
+
+/* Iterates FLOW through the flows in 'FI' that may match 'KEY', using 'I',
+ * 'FIRST', 'LAST' and 'NEXT' as temporaries.  FLOW may be removed from the
+ * index within the loop. */
+#define FLOW_INDEX_FOR_EACH(FLOW, NEXT, I, FIRST, LAST, KEY, FI)        \
+    for (flow_index_range(KEY, &FIRST, &LAST), I = FIRST; I <= LAST; I++) \
+        LIST_FOR_EACH_SAFE (FLOW, NEXT, struct sw_flow, iter_node,      \
+                            &(FI)->lists[I])
+
+/* Calls 'callback' for each flow in 'fi' that matches 'key' and has an
+ * action that outputs to 'out_port', resuming from 'position', in the
+ * manner of the iterate member of struct sw_table.  Uses
+ * 'position->private[0]' and 'position->private[2]'. */
+static int
+flow_index_iterate(struct flow_index *fi, const struct sw_flow_key *key,
+                   uint16_t out_port, struct sw_table_position *position,
+                   int (*callback)(struct sw_flow *, void *), void *private)
+{
+    struct sw_flow *flow;
+    int first, last;
+    int i;
+
+    flow_index_range(key, &first, &last);
+    for (i = MAX(first, position->private[2]); i <= last; i++) {
+        unsigned long start = ~position->private[0];
+
+        LIST_FOR_EACH (flow, struct sw_flow, iter_node, &fi->lists[i]) {
+            if (flow->serial <= start
+                    && flow_matches_1wild(&flow->key, key)
+                    && flow_has_out_port(flow, out_port)) {
+                int error = callback(flow, private);
+                if (error) {
+                    position->private[0] = ~(flow->serial - 1);
+                    position->private[2] = i;
+                    return error;
+                }
+            }
+        }
+        position->private[0] = 0;
+    }
+    position->private[2] = FLOW_INDEX_LISTS;
+    return 0;
+}
+
+/* Hash tables start out with this many buckets (or their maximum, if that is
+ * smaller), grow as flows are added and shrink again as they go away, as in
+ * the kernel datapath. */
+#define HASH_MIN_BUCKETS 1024
+
 struct sw_table_hash {
     struct sw_table swt;
-    struct crc32 crc32;
+    uint32_t (*hash)(const struct flow *, uint32_t basis);
+    uint32_t basis;
     unsigned int n_flows;
     unsigned int bucket_mask; /* Number of buckets minus 1. */
+    unsigned int max_buckets; /* Most buckets that the table may grow to. */
+    unsigned int shrink_below; /* Don't retry a failed shrink until n_flows
+                                * falls below this. */
+    unsigned long int n_insert_failed;
+    unsigned long int n_collisions;
     struct sw_flow **buckets;
+    struct flow_index index;
 };
 
+static uint32_t
+hash_flow_crc32c(const struct flow *flow, uint32_t basis)
+{
+    return crc32c_hw_words((const uint32_t *) flow,
+                           sizeof *flow / sizeof(uint32_t), basis);
+}
+
+static uint32_t
+hash_flow_words(const struct flow *flow, uint32_t basis)
+{
+    return flow_hash(flow, basis);
+}
+
 static struct sw_flow **find_bucket(struct sw_table *swt,
                                     const struct sw_flow_key *key)
 {
     struct sw_table_hash *th = (struct sw_table_hash *) swt;
-    unsigned int crc = crc32_calculate(&th->crc32, key, 
-            offsetof(struct sw_flow_key, wildcards));
-    return &th->buckets[crc & th->bucket_mask];
+    uint32_t hash = th->hash(&key->flow, th->basis);
+    return &th->buckets[hash & th->bucket_mask];
 }
 
+/* Returns the flow in 'swt' whose key is 'key', if any, counting a
+ * collision if 'key' hashes to a bucket that holds some other flow. */
 static struct sw_flow *table_hash_lookup(struct sw_table *swt,
                                          const struct sw_flow_key *key)
 {
     struct sw_flow *flow = *find_bucket(swt, key);
-    return flow && !flow_compare(&flow->key.flow, &key->flow) ? flow : NULL;
+    if (!flow) {
+        return NULL;
+    } else if (!flow_equal(&flow->key.flow, &key->flow)) {
+        ((struct sw_table_hash *) swt)->n_collisions++;
+        return NULL;
+    }
+    return flow;
 }
 
-static int table_hash_insert(struct sw_table *swt, struct sw_flow *flow)
+static struct sw_flow *table_hash_lookup_trace(struct sw_table *swt,
+                                               const struct sw_flow_key *key,
+                                               unsigned int *n_compares)
+{
+    struct sw_flow *flow = *find_bucket(swt, key);
+
+    *n_compares = flow != NULL;
+    return flow && flow_equal(&flow->key.flow, &key->flow) ? flow : NULL;
+}
+
+/* Looks up each of the 'n' keys in 'keys' in each of the 'n_subtables'
+ * (at most 2) hash tables in 'subtables' in turn, storing the first match in
+ * 'flows[i]', as table_hash_lookup() on each subtable would.  Every bucket is
+ * prefetched before any is read, and then every flow in those buckets before
+ * any is compared, so that the cache misses for the different keys overlap
+ * instead of each waiting for the one before. */
+static void hash_lookup_batch(struct sw_table *subtables[], int n_subtables,
+                              const struct sw_flow_key *keys[],
+                              struct sw_flow *flows[], size_t n)
+{
+    struct sw_flow **buckets[2][TABLE_LOOKUP_BATCH];
+    size_t i;
+    int j;
+
+    assert(n_subtables <= 2 && n <= TABLE_LOOKUP_BATCH);
+    for (j = 0; j < n_subtables; j++) {
+        for (i = 0; i < n; i++) {
+            buckets[j][i] = find_bucket(subtables[j], keys[i]);
+            __builtin_prefetch(buckets[j][i]);
+        }
+    }
+    for (j = 0; j < n_subtables; j++) {
+        for (i = 0; i < n; i++) {
+            struct sw_flow *flow = *buckets[j][i];
+            if (flow) {
+                __builtin_prefetch(&flow->key.flow);
+            }
+        }
+    }
+
+    for (i = 0; i < n; i++) {
+        flows[i] = NULL;
+        for (j = 0; j < n_subtables; j++) {
+            struct sw_flow *flow = *buckets[j][i];
+            if (!flow) {
+                continue;
+            } else if (flow_equal(&flow->key.flow, &keys[i]->flow)) {
+                flows[i] = flow;
+                break;
+            }
+            ((struct sw_table_hash *) subtables[j])->n_collisions++;
+        }
+    }
+}
+
+static void table_hash_lookup_batch(struct sw_table *swt,
+                                    const struct sw_flow_key *keys[],
+                                    struct sw_flow *flows[], size_t n)
+{
+    hash_lookup_batch(&swt, 1, keys, flows, n);
+}
+
+/* Returns a zeroed array of 'n_buckets' buckets, or a null pointer if memory
+ * is short.  An array much smaller than what hugepage_alloc() would map for
+ * it, as a new table's is when huge pages are enabled, comes from the heap
+ * instead. */
+static struct sw_flow **
+buckets_alloc(unsigned int n_buckets)
+{
+    size_t size = n_buckets * sizeof(struct sw_flow *);
+
+    return (hugepage_alloc_size(size) > 2 * size
+            ? calloc(n_buckets, sizeof(struct sw_flow *))
+            : hugepage_alloc(size));
+}
+
+static void
+buckets_free(struct sw_flow **buckets, unsigned int n_buckets)
+{
+    size_t size = n_buckets * sizeof *buckets;
+
+    if (hugepage_alloc_size(size) > 2 * size) {
+        free(buckets);
+    } else {
+        hugepage_free(buckets, size);
+    }
+}
+
+/* Moves all the flows in 'th' into a new array of 'n_buckets' buckets.
+ * Fails, leaving 'th' unchanged, if memory is short or if two flows would
+ * fall into the same bucket, which can happen only when shrinking.  Returns
+ * true if successful. */
+static bool
+table_hash_resize(struct sw_table_hash *th, unsigned int n_buckets)
+{
+    struct sw_flow **buckets = buckets_alloc(n_buckets);
+    struct sw_flow *flow;
+    int i;
+
+    if (!buckets) {
+        return false;
+    }
+    for (i = 0; i < FLOW_INDEX_LISTS; i++) {
+        LIST_FOR_EACH (flow, struct sw_flow, iter_node, &th->index.lists[i]) {
+            uint32_t hash = th->hash(&flow->key.flow, th->basis);
+            struct sw_flow **bucket = &buckets[hash & (n_buckets - 1)];
+
+            if (*bucket) {
+                buckets_free(buckets, n_buckets);
+                return false;
+            }
+            *bucket = flow;
+        }
+    }
+
+    buckets_free(th->buckets, th->bucket_mask + 1);
+    th->buckets = buckets;
+    th->bucket_mask = n_buckets - 1;
+    th->shrink_below = UINT_MAX;
+    return true;
+}
+
+/* Doubles the number of buckets in 'th', which never puts two flows in one
+ * bucket because each old bucket splits into two new ones.  Returns true if
+ * successful, false if 'th' is already at its maximum size or memory is
+ * short. */
+static bool
+table_hash_grow(struct sw_table_hash *th)
+{
+    unsigned int n_buckets = th->bucket_mask + 1;
+
+    return n_buckets < th->max_buckets && table_hash_resize(th, n_buckets * 2);
+}
+
+/* Grows 'th' ahead of time once it is half full, since with one flow per
+ * bucket collisions become common beyond that. */
+static void
+table_hash_make_room(struct sw_table_hash *th)
+{
+    if (th->n_flows >= (th->bucket_mask + 1) / 2) {
+        table_hash_grow(th);
+    }
+}
+
+/* Halves the number of buckets in 'th' for as long as it is less than 1/8
+ * full and the flows still fit.  A shrink that fails is not retried until
+ * half of the flows have gone, so that deleting flows one at a time does not
+ * rehash the table on every deletion. */
+static void
+table_hash_maybe_shrink(struct sw_table_hash *th)
+{
+    while (th->bucket_mask + 1 > HASH_MIN_BUCKETS
+           && th->n_flows < (th->bucket_mask + 1) / 8
+           && th->n_flows < th->shrink_below) {
+        if (!table_hash_resize(th, (th->bucket_mask + 1) / 2)) {
+            th->shrink_below = th->n_flows / 2;
+        }
+    }
+}
+
+/* Inserts 'flow' into 'th' without growing it.  Returns 1 if successful, 0
+ * if its bucket holds a different flow. */
+static int table_hash_try_insert(struct sw_table_hash *th,
+                                 struct sw_flow *flow)
 {
-    struct sw_table_hash *th = (struct sw_table_hash *) swt;
     struct sw_flow **bucket;
     int retval;
 
-    if (flow->key.wildcards != 0)
-        return 0;
-
-    bucket = find_bucket(swt, &flow->key);
+    bucket = find_bucket(&th->swt, &flow->key);
     if (*bucket == NULL) {
         th->n_flows++;
         *bucket = flow;
+        flow_index_insert(&th->index, flow);
         retval = 1;
     } else {
         struct sw_flow *old_flow = *bucket;
-        if (!flow_compare(&old_flow->key.flow, &flow->key.flow)) {
+        if (flow_equal(&old_flow->key.flow, &flow->key.flow)) {
             *bucket = flow;
+            flow_index_replace(old_flow, flow);
             flow_free(old_flow);
             retval = 1;
         } else {
@@ -93,6 +401,22 @@ static int table_hash_insert(struct sw_table *swt, struct sw_flow *flow)
     return retval;
 }
 
+static int table_hash_insert(struct sw_table *swt, struct sw_flow *flow)
+{
+    struct sw_table_hash *th = (struct sw_table_hash *) swt;
+
+    if (flow->key.wildcards != 0)
+        return 0;
+
+    table_hash_make_room(th);
+    do {
+        if (table_hash_try_insert(th, flow))
+            return 1;
+    } while (table_hash_grow(th));
+    th->n_insert_failed++;
+    return 0;
+}
+
 static int table_hash_modify(struct sw_table *swt, 
         const struct sw_flow_key *key, uint16_t priority, int strict,
         const struct ofp_action_header *actions, size_t actions_len) 
@@ -109,12 +433,11 @@ static int table_hash_modify(struct sw_table *swt,
             count = 1;
         }
     } else {
-        unsigned int i;
+        struct sw_flow *flow, *next;
+        int i, first, last;
 
-        for (i = 0; i <= th->bucket_mask; i++) {
-            struct sw_flow **bucket = &th->buckets[i];
-            struct sw_flow *flow = *bucket;
-            if (flow && flow_matches_desc(&flow->key, key, strict)
+        FLOW_INDEX_FOR_EACH (flow, next, i, first, last, key, &th->index) {
+            if (flow_matches_desc(&flow->key, key, strict)
                     && (!strict || (flow->priority == priority))) {
                 flow_replace_acts(flow, actions, actions_len);
                 count++;
@@ -138,12 +461,11 @@ static int table_hash_has_conflict(struct sw_table *swt,
             return true;
         }
     } else {
-        unsigned int i;
+        struct sw_flow *flow, *next;
+        int i, first, last;
 
-        for (i = 0; i <= th->bucket_mask; i++) {
-            struct sw_flow **bucket = &th->buckets[i];
-            struct sw_flow *flow = *bucket;
-            if (flow && flow_matches_2desc(&flow->key, key, strict)
+        FLOW_INDEX_FOR_EACH (flow, next, i, first, last, key, &th->index) {
+            if (flow_matches_2desc(&flow->key, key, strict)
                     && (flow->priority == priority)) {
                 return true;
             }
@@ -156,6 +478,7 @@ static int table_hash_has_conflict(struct sw_table *swt,
 static void
 do_delete(struct sw_flow **bucket)
 {
+    flow_index_remove(*bucket);
     flow_free(*bucket);
     *bucket = NULL;
 }
@@ -174,56 +497,72 @@ static int table_hash_delete(struct datapath *dp, struct sw_table *swt,
     if (key->wildcards == 0) {
         struct sw_flow **bucket = find_bucket(swt, key);
         struct sw_flow *flow = *bucket;
-        if (flow && !flow_compare(&flow->key.flow, &key->flow)
+        if (flow && flow_equal(&flow->key.flow, &key->flow)
                 && flow_has_out_port(flow, out_port)) {
             dp_send_flow_end(dp, flow, OFPRR_DELETE);
             do_delete(bucket);
             count = 1;
         }
     } else {
-        unsigned int i;
+        struct sw_flow *flow, *next;
+        int i, first, last;
 
-        for (i = 0; i <= th->bucket_mask; i++) {
-            struct sw_flow **bucket = &th->buckets[i];
-            struct sw_flow *flow = *bucket;
-            if (flow && flow_matches_desc(&flow->key, key, strict)
+        FLOW_INDEX_FOR_EACH (flow, next, i, first, last, key, &th->index) {
+            if (flow_matches_desc(&flow->key, key, strict)
                     && flow_has_out_port(flow, out_port)) {
                 dp_send_flow_end(dp, flow, OFPRR_DELETE);
-                do_delete(bucket);
+                do_delete(find_bucket(swt, &flow->key));
                 count++;
             }
         }
     }
     th->n_flows -= count;
+    table_hash_maybe_shrink(th);
     return count;
 }
 
+static void table_hash_remove(struct sw_table *swt, struct sw_flow *flow)
+{
+    struct sw_table_hash *th = (struct sw_table_hash *) swt;
+    struct sw_flow **bucket = find_bucket(swt, &flow->key);
+
+    assert(*bucket == flow);
+    flow_index_remove(flow);
+    *bucket = NULL;
+    th->n_flows--;
+}
+
 static void table_hash_timeout(struct sw_table *swt, struct list *deleted)
 {
     struct sw_table_hash *th = (struct sw_table_hash *) swt;
-    unsigned int i;
+    struct sw_flow *flow, *next;
+    int i;
 
-    for (i = 0; i <= th->bucket_mask; i++) {
-        struct sw_flow **bucket = &th->buckets[i];
-        struct sw_flow *flow = *bucket;
-        if (flow && flow_timeout(flow)) {
-            list_push_back(deleted, &flow->node);
-            *bucket = NULL;
-            th->n_flows--;
+    for (i = 0; i < FLOW_INDEX_LISTS; i++) {
+        LIST_FOR_EACH_SAFE (flow, next, struct sw_flow, iter_node,
+                            &th->index.lists[i]) {
+            if (flow_timeout(flow)) {
+                table_hash_remove(swt, flow);
+                list_push_back(deleted, &flow->node);
+            }
         }
     }
+    table_hash_maybe_shrink(th);
 }
 
 static void table_hash_destroy(struct sw_table *swt)
 {
     struct sw_table_hash *th = (struct sw_table_hash *) swt;
-    unsigned int i;
-    for (i = 0; i <= th->bucket_mask; i++) {
-        if (th->buckets[i]) {
-            flow_free(th->buckets[i]); 
+    struct sw_flow *flow, *next;
+    int i;
+
+    for (i = 0; i < FLOW_INDEX_LISTS; i++) {
+        LIST_FOR_EACH_SAFE (flow, next, struct sw_flow, iter_node,
+                            &th->index.lists[i]) {
+            flow_free(flow);
         }
     }
-    free(th->buckets);
+    buckets_free(th->buckets, th->bucket_mask + 1);
     free(th);
 }
 
@@ -235,31 +574,19 @@ static int table_hash_iterate(struct sw_table *swt,
 {
     struct sw_table_hash *th = (struct sw_table_hash *) swt;
 
-    if (position->private[0] > th->bucket_mask)
+    if (position->private[2] >= FLOW_INDEX_LISTS)
         return 0;
 
     if (key->wildcards == 0) {
         struct sw_flow *flow = table_hash_lookup(swt, key);
-        position->private[0] = -1;
+        position->private[2] = FLOW_INDEX_LISTS;
         if (!flow || !flow_has_out_port(flow, out_port)) {
             return 0;
         }
         return callback(flow, private);
     } else {
-        int i;
-
-        for (i = position->private[0]; i <= th->bucket_mask; i++) {
-            struct sw_flow *flow = th->buckets[i];
-            if (flow && flow_matches_1wild(&flow->key, key)
-                    && flow_has_out_port(flow, out_port)) {
-                int error = callback(flow, private);
-                if (error) {
-                    position->private[0] = i + 1;
-                    return error;
-                }
-            }
-        }
-        return 0;
+        return flow_index_iterate(&th->index, key, out_port, position,
+                                  callback, private);
     }
 }
 
@@ -270,9 +597,17 @@ static void table_hash_stats(struct sw_table *swt,
     stats->name = "hash";
     stats->wildcards = 0;        /* No wildcards are supported. */
     stats->n_flows   = th->n_flows;
-    stats->max_flows = th->bucket_mask + 1;
+    stats->max_flows = th->max_buckets;
+    stats->capacity  = th->bucket_mask + 1;
     stats->n_lookup  = swt->n_lookup;
     stats->n_matched = swt->n_matched;
+    stats->n_insert_failed = th->n_insert_failed;
+    stats->n_hashes = 1;
+    stats->hashes[0].n_flows = th->n_flows;
+    stats->hashes[0].max_flows = th->max_buckets;
+    stats->hashes[0].n_buckets = th->bucket_mask + 1;
+    stats->hashes[0].n_insert_failed = th->n_insert_failed;
+    stats->hashes[0].n_collisions = th->n_collisions;
 }
 
 struct sw_table *table_hash_create(unsigned int polynomial,
@@ -287,7 +622,9 @@ struct sw_table *table_hash_create(unsigned int polynomial,
     memset(th, '\0', sizeof *th);
 
     assert(!(n_buckets & (n_buckets - 1)));
-    th->buckets = calloc(n_buckets, sizeof *th->buckets);
+    th->max_buckets = n_buckets;
+    n_buckets = MIN(n_buckets, HASH_MIN_BUCKETS);
+    th->buckets = buckets_alloc(n_buckets);
     if (th->buckets == NULL) {
         printf("failed to allocate %u buckets\n", n_buckets);
         free(th);
@@ -295,19 +632,34 @@ struct sw_table *table_hash_create(unsigned int polynomial,
     }
     th->n_flows = 0;
     th->bucket_mask = n_buckets - 1;
+    th->shrink_below = UINT_MAX;
+    flow_index_init(&th->index);
 
     swt = &th->swt;
     swt->lookup = table_hash_lookup;
+    swt->lookup_batch = table_hash_lookup_batch;
+    swt->lookup_trace = table_hash_lookup_trace;
     swt->insert = table_hash_insert;
     swt->modify = table_hash_modify;
     swt->has_conflict = table_hash_has_conflict;
     swt->delete = table_hash_delete;
     swt->timeout = table_hash_timeout;
+    swt->remove = table_hash_remove;
     swt->destroy = table_hash_destroy;
     swt->iterate = table_hash_iterate;
     swt->stats = table_hash_stats;
 
-    crc32_init(&th->crc32, polynomial);
+    /* Use the CPU's CRC32C instruction if the caller asked for the
+     * Castagnoli polynomial and the CPU has one.  Otherwise use a
+     * word-at-a-time hash seeded with 'polynomial', so that the two halves
+     * of a table_hash2 still hash independently. */
+    if (polynomial == CRC32C_POLYNOMIAL && crc32c_hw_supported()) {
+        th->hash = hash_flow_crc32c;
+        th->basis = 0;
+    } else {
+        th->hash = hash_flow_words;
+        th->basis = polynomial;
+    }
 
     return swt;
 }
@@ -317,6 +669,7 @@ struct sw_table *table_hash_create(unsigned int polynomial,
 struct sw_table_hash2 {
     struct sw_table swt;
     struct sw_table *subtable[2];
+    unsigned long int n_insert_failed;
 };
 
 static struct sw_flow *table_hash2_lookup(struct sw_table *swt,
@@ -326,20 +679,68 @@ static struct sw_flow *table_hash2_lookup(struct sw_table *swt,
     int i;
         
     for (i = 0; i < 2; i++) {
-        struct sw_flow *flow = *find_bucket(t2->subtable[i], key);
-        if (flow && !flow_compare(&flow->key.flow, &key->flow))
+        struct sw_flow *flow = table_hash_lookup(t2->subtable[i], key);
+        if (flow)
             return flow;
     }
     return NULL;
 }
 
+static struct sw_flow *table_hash2_lookup_trace(struct sw_table *swt,
+                                                const struct sw_flow_key *key,
+                                                unsigned int *n_compares)
+{
+    struct sw_table_hash2 *t2 = (struct sw_table_hash2 *) swt;
+    int i;
+
+    *n_compares = 0;
+    for (i = 0; i < 2; i++) {
+        unsigned int n;
+        struct sw_flow *flow = table_hash_lookup_trace(t2->subtable[i], key,
+                                                       &n);
+        *n_compares += n;
+        if (flow) {
+            return flow;
+        }
+    }
+    return NULL;
+}
+
+static void table_hash2_lookup_batch(struct sw_table *swt,
+                                     const struct sw_flow_key *keys[],
+                                     struct sw_flow *flows[], size_t n)
+{
+    struct sw_table_hash2 *t2 = (struct sw_table_hash2 *) swt;
+    hash_lookup_batch(t2->subtable, 2, keys, flows, n);
+}
+
+/* Inserts 'flow' under the first hash if its bucket there is free, otherwise
+ * under the second.  Only if both buckets hold other flows do the subtables
+ * grow, so that the second hash still spares the first from growing for
+ * every collision. */
 static int table_hash2_insert(struct sw_table *swt, struct sw_flow *flow)
 {
     struct sw_table_hash2 *t2 = (struct sw_table_hash2 *) swt;
+    struct sw_table_hash *th0 = (struct sw_table_hash *) t2->subtable[0];
+    struct sw_table_hash *th1 = (struct sw_table_hash *) t2->subtable[1];
 
-    if (table_hash_insert(t2->subtable[0], flow))
-        return 1;
-    return table_hash_insert(t2->subtable[1], flow);
+    if (flow->key.wildcards != 0)
+        return 0;
+
+    table_hash_make_room(th0);
+    table_hash_make_room(th1);
+    do {
+        if (table_hash_try_insert(th0, flow))
+            return 1;
+        if (table_hash_try_insert(th1, flow)) {
+            th0->n_insert_failed++;
+            return 1;
+        }
+    } while (table_hash_grow(th0) | table_hash_grow(th1));
+    th0->n_insert_failed++;
+    th1->n_insert_failed++;
+    t2->n_insert_failed++;
+    return 0;
 }
 
 static int table_hash2_modify(struct sw_table *swt, 
@@ -381,6 +782,16 @@ static void table_hash2_timeout(struct sw_table *swt, struct list *deleted)
     table_hash_timeout(t2->subtable[1], deleted);
 }
 
+static void table_hash2_remove(struct sw_table *swt, struct sw_flow *flow)
+{
+    struct sw_table_hash2 *t2 = (struct sw_table_hash2 *) swt;
+    struct sw_table *sub = t2->subtable[0];
+
+    if (*find_bucket(sub, &flow->key) != flow)
+        sub = t2->subtable[1];
+    table_hash_remove(sub, flow);
+}
+
 static void table_hash2_destroy(struct sw_table *swt)
 {
     struct sw_table_hash2 *t2 = (struct sw_table_hash2 *) swt;
@@ -407,6 +818,7 @@ static int table_hash2_iterate(struct sw_table *swt,
         }
         position->private[0] = 0;
         position->private[1]++;
+        position->private[2] = 0;
     }
     return 0;
 }
@@ -424,8 +836,17 @@ static void table_hash2_stats(struct sw_table *swt,
     stats->wildcards = 0;        /* No wildcards are supported. */
     stats->n_flows   = substats[0].n_flows + substats[1].n_flows;
     stats->max_flows = substats[0].max_flows + substats[1].max_flows;
+    stats->capacity  = substats[0].capacity + substats[1].capacity;
     stats->n_lookup  = swt->n_lookup;
     stats->n_matched = swt->n_matched;
+    stats->n_insert_failed = t2->n_insert_failed;
+
+    /* An insert that fails under the first hash falls back to the second,
+     * so hashes[0].n_insert_failed counts flows displaced to the second hash
+     * and hashes[1].n_insert_failed those that fit under neither. */
+    stats->n_hashes = 2;
+    for (i = 0; i < 2; i++)
+        stats->hashes[i] = substats[i].hashes[0];
 }
 
 struct sw_table *table_hash2_create(unsigned int poly0, unsigned int buckets0,
@@ -450,11 +871,14 @@ struct sw_table *table_hash2_create(unsigned int poly0, unsigned int buckets0,
 
     swt = &t2->swt;
     swt->lookup = table_hash2_lookup;
+    swt->lookup_batch = table_hash2_lookup_batch;
+    swt->lookup_trace = table_hash2_lookup_trace;
     swt->insert = table_hash2_insert;
     swt->modify = table_hash2_modify;
     swt->has_conflict = table_hash2_has_conflict;
     swt->delete = table_hash2_delete;
     swt->timeout = table_hash2_timeout;
+    swt->remove = table_hash2_remove;
     swt->destroy = table_hash2_destroy;
     swt->iterate = table_hash2_iterate;
     swt->stats = table_hash2_stats;
@@ -467,3 +891,445 @@ out_free_t2:
     free(t2);
     return NULL;
 }
+
+/* Cuckoo hash table.
+ *
+ * Each flow may live in one of two buckets, and each bucket holds
+ * CUCKOO_WAYS flows.  When both of a new flow's buckets are full, a resident
+ * flow is evicted to its alternate bucket, and so on for at most
+ * CUCKOO_MAX_KICKS moves.  If that does not free a slot, the moves are
+ * undone and the insert fails.  With 4-way buckets this lets the table fill
+ * to well over 90% of its slots before inserts start to fail. */
+
+#define CUCKOO_WAYS 4
+#define CUCKOO_MAX_KICKS 128
+
+struct cuckoo_bucket {
+    struct sw_flow *flows[CUCKOO_WAYS];
+};
+
+struct sw_table_cuckoo {
+    struct sw_table swt;
+    uint32_t (*hash)(const struct flow *, uint32_t basis);
+    uint32_t basis;
+    unsigned int n_flows;
+    unsigned int max_flows;
+    unsigned int bucket_mask;   /* Number of buckets minus 1. */
+    unsigned long int n_insert_failed;
+    unsigned long int n_first_full; /* Inserts whose first bucket was full. */
+    unsigned long int n_both_full;  /* Inserts that had to evict a flow. */
+    struct cuckoo_bucket *buckets;
+    struct flow_index index;
+};
+
+/* Returns the value to XOR into a flow's bucket index, given the flow's hash
+ * 'hash', to get the index of its other bucket.  Because the result depends
+ * only on 'hash', either bucket can be derived from the other. */
+static unsigned int
+cuckoo_alt_mask(const struct sw_table_cuckoo *tc, uint32_t hash)
+{
+    uint32_t tag = ((hash >> 16) | (hash << 16)) * 0x9e3779b1;
+    return (tag | 1) & tc->bucket_mask;
+}
+
+static void
+cuckoo_buckets(const struct sw_table_cuckoo *tc, const struct flow *flow,
+               unsigned int b[2])
+{
+    uint32_t hash = tc->hash(flow, tc->basis);
+    b[0] = hash & tc->bucket_mask;
+    b[1] = b[0] ^ cuckoo_alt_mask(tc, hash);
+}
+
+/* Returns the slot in 'tc' that holds a flow exactly matching 'flow', or a
+ * null pointer if there is none.  Adds the number of flows compared with
+ * 'flow' to '*n_compares'. */
+static inline struct sw_flow **
+cuckoo_find__(struct sw_table_cuckoo *tc, const struct flow *flow,
+              unsigned int *n_compares)
+{
+    unsigned int b[2];
+    int i, j;
+
+    cuckoo_buckets(tc, flow, b);
+    for (i = 0; i < 2; i++) {
+        struct cuckoo_bucket *bucket = &tc->buckets[b[i]];
+        for (j = 0; j < CUCKOO_WAYS; j++) {
+            struct sw_flow *f = bucket->flows[j];
+            if (f) {
+                ++*n_compares;
+                if (flow_equal(&f->key.flow, flow)) {
+                    return &bucket->flows[j];
+                }
+            }
+        }
+    }
+    return NULL;
+}
+
+/* Returns the slot in 'tc' that holds a flow exactly matching 'flow', or a
+ * null pointer if there is none. */
+static struct sw_flow **
+cuckoo_find(struct sw_table_cuckoo *tc, const struct flow *flow)
+{
+    unsigned int n_compares = 0;
+    return cuckoo_find__(tc, flow, &n_compares);
+}
+
+/* Returns an empty slot in 'bucket', or a null pointer if it is full. */
+static struct sw_flow **
+cuckoo_empty_slot(struct cuckoo_bucket *bucket)
+{
+    int i;
+
+    for (i = 0; i < CUCKOO_WAYS; i++) {
+        if (!bucket->flows[i]) {
+            return &bucket->flows[i];
+        }
+    }
+    return NULL;
+}
+
+static struct sw_flow *table_cuckoo_lookup(struct sw_table *swt,
+                                           const struct sw_flow_key *key)
+{
+    struct sw_table_cuckoo *tc = (struct sw_table_cuckoo *) swt;
+    struct sw_flow **slot = cuckoo_find(tc, &key->flow);
+    return slot ? *slot : NULL;
+}
+
+static struct sw_flow *table_cuckoo_lookup_trace(struct sw_table *swt,
+                                                 const struct sw_flow_key *key,
+                                                 unsigned int *n_compares)
+{
+    struct sw_table_cuckoo *tc = (struct sw_table_cuckoo *) swt;
+    struct sw_flow **slot;
+
+    *n_compares = 0;
+    slot = cuckoo_find__(tc, &key->flow, n_compares);
+    return slot ? *slot : NULL;
+}
+
+static int table_cuckoo_insert(struct sw_table *swt, struct sw_flow *flow)
+{
+    struct sw_table_cuckoo *tc = (struct sw_table_cuckoo *) swt;
+    struct {
+        unsigned int bucket;
+        int way;
+    } path[CUCKOO_MAX_KICKS];
+    struct sw_flow **slot;
+    struct sw_flow *cur;
+    unsigned int b[2];
+    unsigned int bucket;
+    int i;
+
+    if (flow->key.wildcards != 0)
+        return 0;
+
+    slot = cuckoo_find(tc, &flow->key.flow);
+    if (slot) {
+        struct sw_flow *old_flow = *slot;
+        *slot = flow;
+        flow_index_replace(old_flow, flow);
+        flow_free(old_flow);
+        return 1;
+    }
+
+    if (tc->n_flows >= tc->max_flows)
+        goto fail;
+
+    cuckoo_buckets(tc, &flow->key.flow, b);
+    for (i = 0; i < 2; i++) {
+        slot = cuckoo_empty_slot(&tc->buckets[b[i]]);
+        if (slot) {
+            *slot = flow;
+            tc->n_flows++;
+            flow_index_insert(&tc->index, flow);
+            return 1;
+        } else if (i == 0) {
+            tc->n_first_full++;
+        }
+    }
+    tc->n_both_full++;
+
+    /* Both buckets are full.  Walk a random eviction path, remembering each
+     * move so that it can be undone if no empty slot turns up. */
+    cur = flow;
+    bucket = b[random_uint32() & 1];
+    for (i = 0; i < CUCKOO_MAX_KICKS; i++) {
+        struct sw_flow *victim;
+        uint32_t hash;
+
+        path[i].bucket = bucket;
+        path[i].way = random_range(CUCKOO_WAYS);
+        victim = tc->buckets[bucket].flows[path[i].way];
+        tc->buckets[bucket].flows[path[i].way] = cur;
+        cur = victim;
+
+        hash = tc->hash(&cur->key.flow, tc->basis);
+        bucket ^= cuckoo_alt_mask(tc, hash);
+        slot = cuckoo_empty_slot(&tc->buckets[bucket]);
+        if (slot) {
+            *slot = cur;
+            tc->n_flows++;
+            flow_index_insert(&tc->index, flow);
+            return 1;
+        }
+    }
+
+    while (--i >= 0) {
+        struct sw_flow **p = &tc->buckets[path[i].bucket].flows[path[i].way];
+        struct sw_flow *tmp = *p;
+        *p = cur;
+        cur = tmp;
+    }
+    assert(cur == flow);
+
+fail:
+    tc->n_insert_failed++;
+    return 0;
+}
+
+static int table_cuckoo_modify(struct sw_table *swt,
+        const struct sw_flow_key *key, uint16_t priority, int strict,
+        const struct ofp_action_header *actions, size_t actions_len)
+{
+    struct sw_table_cuckoo *tc = (struct sw_table_cuckoo *) swt;
+    unsigned int count = 0;
+
+    if (key->wildcards == 0) {
+        struct sw_flow **slot = cuckoo_find(tc, &key->flow);
+        if (slot && (!strict || ((*slot)->priority == priority))) {
+            flow_replace_acts(*slot, actions, actions_len);
+            count = 1;
+        }
+    } else {
+        struct sw_flow *flow, *next;
+        int i, first, last;
+
+        FLOW_INDEX_FOR_EACH (flow, next, i, first, last, key, &tc->index) {
+            if (flow_matches_desc(&flow->key, key, strict)
+                    && (!strict || (flow->priority == priority))) {
+                flow_replace_acts(flow, actions, actions_len);
+                count++;
+            }
+        }
+    }
+    return count;
+}
+
+static int table_cuckoo_has_conflict(struct sw_table *swt,
+                                     const struct sw_flow_key *key,
+                                     uint16_t priority, int strict)
+{
+    struct sw_table_cuckoo *tc = (struct sw_table_cuckoo *) swt;
+
+    if (key->wildcards == 0) {
+        struct sw_flow **slot = cuckoo_find(tc, &key->flow);
+        if (slot && (*slot)->priority == priority) {
+            return true;
+        }
+    } else {
+        struct sw_flow *flow, *next;
+        int i, first, last;
+
+        FLOW_INDEX_FOR_EACH (flow, next, i, first, last, key, &tc->index) {
+            if (flow_matches_2desc(&flow->key, key, strict)
+                    && (flow->priority == priority)) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+static int table_cuckoo_delete(struct datapath *dp, struct sw_table *swt,
+                               const struct sw_flow_key *key,
+                               uint16_t out_port,
+                               uint16_t priority UNUSED, int strict)
+{
+    struct sw_table_cuckoo *tc = (struct sw_table_cuckoo *) swt;
+    unsigned int count = 0;
+
+    if (key->wildcards == 0) {
+        struct sw_flow **slot = cuckoo_find(tc, &key->flow);
+        if (slot && flow_has_out_port(*slot, out_port)) {
+            dp_send_flow_end(dp, *slot, OFPRR_DELETE);
+            do_delete(slot);
+            count = 1;
+        }
+    } else {
+        struct sw_flow *flow, *next;
+        int i, first, last;
+
+        FLOW_INDEX_FOR_EACH (flow, next, i, first, last, key, &tc->index) {
+            if (flow_matches_desc(&flow->key, key, strict)
+                    && flow_has_out_port(flow, out_port)) {
+                dp_send_flow_end(dp, flow, OFPRR_DELETE);
+                do_delete(cuckoo_find(tc, &flow->key.flow));
+                count++;
+            }
+        }
+    }
+    tc->n_flows -= count;
+    return count;
+}
+
+static void table_cuckoo_remove(struct sw_table *swt, struct sw_flow *flow)
+{
+    struct sw_table_cuckoo *tc = (struct sw_table_cuckoo *) swt;
+    struct sw_flow **slot = cuckoo_find(tc, &flow->key.flow);
+
+    assert(slot && *slot == flow);
+    flow_index_remove(flow);
+    *slot = NULL;
+    tc->n_flows--;
+}
+
+static void table_cuckoo_timeout(struct sw_table *swt, struct list *deleted)
+{
+    struct sw_table_cuckoo *tc = (struct sw_table_cuckoo *) swt;
+    struct sw_flow *flow, *next;
+    int i;
+
+    for (i = 0; i < FLOW_INDEX_LISTS; i++) {
+        LIST_FOR_EACH_SAFE (flow, next, struct sw_flow, iter_node,
+                            &tc->index.lists[i]) {
+            if (flow_timeout(flow)) {
+                table_cuckoo_remove(swt, flow);
+                list_push_back(deleted, &flow->node);
+            }
+        }
+    }
+}
+
+static void table_cuckoo_destroy(struct sw_table *swt)
+{
+    struct sw_table_cuckoo *tc = (struct sw_table_cuckoo *) swt;
+    struct sw_flow *flow, *next;
+    int i;
+
+    for (i = 0; i < FLOW_INDEX_LISTS; i++) {
+        LIST_FOR_EACH_SAFE (flow, next, struct sw_flow, iter_node,
+                            &tc->index.lists[i]) {
+            flow_free(flow);
+        }
+    }
+    hugepage_free(tc->buckets, (tc->bucket_mask + 1) * sizeof *tc->buckets);
+    free(tc);
+}
+
+static int table_cuckoo_iterate(struct sw_table *swt,
+                                const struct sw_flow_key *key,
+                                uint16_t out_port,
+                                struct sw_table_position *position,
+                                int (*callback)(struct sw_flow *, void *),
+                                void *private)
+{
+    struct sw_table_cuckoo *tc = (struct sw_table_cuckoo *) swt;
+
+    if (position->private[2] >= FLOW_INDEX_LISTS)
+        return 0;
+
+    if (key->wildcards == 0) {
+        struct sw_flow *flow = table_cuckoo_lookup(swt, key);
+        position->private[2] = FLOW_INDEX_LISTS;
+        if (!flow || !flow_has_out_port(flow, out_port)) {
+            return 0;
+        }
+        return callback(flow, private);
+    }
+    return flow_index_iterate(&tc->index, key, out_port, position,
+                              callback, private);
+}
+
+static void table_cuckoo_stats(struct sw_table *swt,
+                               struct sw_table_stats *stats)
+{
+    struct sw_table_cuckoo *tc = (struct sw_table_cuckoo *) swt;
+    const struct sw_flow *flow;
+    int i, j;
+
+    stats->name = "cuckoo";
+    stats->wildcards = 0;        /* No wildcards are supported. */
+    stats->n_flows   = tc->n_flows;
+    stats->max_flows = tc->max_flows;
+    stats->n_lookup  = swt->n_lookup;
+    stats->n_matched = swt->n_matched;
+    stats->n_insert_failed = tc->n_insert_failed;
+
+    /* Count the flows that sit in their first bucket by rehashing each one,
+     * since evictions move flows between buckets without telling us. */
+    stats->n_hashes = 2;
+    stats->hashes[0].n_flows = 0;
+    for (i = 0; i < FLOW_INDEX_LISTS; i++) {
+        LIST_FOR_EACH (flow, struct sw_flow, iter_node, &tc->index.lists[i]) {
+            const struct cuckoo_bucket *bucket
+                = &tc->buckets[tc->hash(&flow->key.flow, tc->basis)
+                               & tc->bucket_mask];
+            for (j = 0; j < CUCKOO_WAYS; j++) {
+                if (bucket->flows[j] == flow) {
+                    stats->hashes[0].n_flows++;
+                }
+            }
+        }
+    }
+    stats->hashes[1].n_flows = tc->n_flows - stats->hashes[0].n_flows;
+    stats->hashes[0].max_flows = stats->hashes[1].max_flows
+        = (tc->bucket_mask + 1) * CUCKOO_WAYS;
+    stats->hashes[0].n_insert_failed = tc->n_first_full;
+    stats->hashes[1].n_insert_failed = tc->n_both_full;
+}
+
+/* Creates a cuckoo table with room for at least 'max_flows' exact-match
+ * flows.  'polynomial' selects the hash function, as for
+ * table_hash_create(). */
+struct sw_table *table_cuckoo_create(unsigned int polynomial,
+                                     unsigned int max_flows)
+{
+    struct sw_table_cuckoo *tc;
+    struct sw_table *swt;
+    unsigned int n_buckets;
+
+    tc = malloc(sizeof *tc);
+    if (tc == NULL)
+        return NULL;
+    memset(tc, '\0', sizeof *tc);
+
+    n_buckets = 1;
+    while (n_buckets * CUCKOO_WAYS < max_flows) {
+        n_buckets *= 2;
+    }
+    tc->buckets = hugepage_alloc(n_buckets * sizeof *tc->buckets);
+    if (tc->buckets == NULL) {
+        printf("failed to allocate %u buckets\n", n_buckets);
+        free(tc);
+        return NULL;
+    }
+    tc->bucket_mask = n_buckets - 1;
+    tc->max_flows = max_flows;
+    flow_index_init(&tc->index);
+
+    swt = &tc->swt;
+    swt->lookup = table_cuckoo_lookup;
+    swt->lookup_trace = table_cuckoo_lookup_trace;
+    swt->insert = table_cuckoo_insert;
+    swt->modify = table_cuckoo_modify;
+    swt->has_conflict = table_cuckoo_has_conflict;
+    swt->delete = table_cuckoo_delete;
+    swt->timeout = table_cuckoo_timeout;
+    swt->remove = table_cuckoo_remove;
+    swt->destroy = table_cuckoo_destroy;
+    swt->iterate = table_cuckoo_iterate;
+    swt->stats = table_cuckoo_stats;
+
+    if (polynomial == CRC32C_POLYNOMIAL && crc32c_hw_supported()) {
+        tc->hash = hash_flow_crc32c;
+        tc->basis = 0;
+    } else {
+        tc->hash = hash_flow_words;
+        tc->basis = polynomial;
+    }
+
+    return swt;
+}
@@ -45,24 +45,44 @@ struct sw_table_linear {
     struct sw_table swt;
 
     unsigned int max_flows;
+    unsigned long int n_insert_failed;
     unsigned int n_flows;
     struct list flows;
     struct list iter_flows;
     unsigned long int next_serial;
 };
 
-static struct sw_flow *table_linear_lookup(struct sw_table *swt,
-                                           const struct sw_flow_key *key)
+/* Returns the first flow in 'tl' that matches 'key', if any, storing in
+ * '*n_compares' the number of flows compared with 'key'. */
+static inline struct sw_flow *
+linear_lookup(struct sw_table_linear *tl, const struct sw_flow_key *key,
+              unsigned int *n_compares)
 {
-    struct sw_table_linear *tl = (struct sw_table_linear *) swt;
     struct sw_flow *flow;
+
+    *n_compares = 0;
     LIST_FOR_EACH (flow, struct sw_flow, node, &tl->flows) {
+        ++*n_compares;
         if (flow_matches_1wild(key, &flow->key))
             return flow;
     }
     return NULL;
 }
 
+static struct sw_flow *table_linear_lookup(struct sw_table *swt,
+                                           const struct sw_flow_key *key)
+{
+    unsigned int n_compares;
+    return linear_lookup((struct sw_table_linear *) swt, key, &n_compares);
+}
+
+static struct sw_flow *table_linear_lookup_trace(struct sw_table *swt,
+                                                 const struct sw_flow_key *key,
+                                                 unsigned int *n_compares)
+{
+    return linear_lookup((struct sw_table_linear *) swt, key, n_compares);
+}
+
 static int table_linear_insert(struct sw_table *swt, struct sw_flow *flow)
 {
     struct sw_table_linear *tl = (struct sw_table_linear *) swt;
@@ -89,6 +109,7 @@ static int table_linear_insert(struct sw_table *swt, struct sw_flow *flow)
 
     /* Make sure there's room in the table. */
     if (tl->n_flows >= tl->max_flows) {
+        tl->n_insert_failed++;
         return 0;
     }
     tl->n_flows++;
@@ -180,6 +201,15 @@ static void table_linear_timeout(struct sw_table *swt, struct list *deleted)
     }
 }
 
+static void table_linear_remove(struct sw_table *swt, struct sw_flow *flow)
+{
+    struct sw_table_linear *tl = (struct sw_table_linear *) swt;
+
+    list_remove(&flow->node);
+    list_remove(&flow->iter_node);
+    tl->n_flows--;
+}
+
 static void table_linear_destroy(struct sw_table *swt)
 {
     struct sw_table_linear *tl = (struct sw_table_linear *) swt;
@@ -229,6 +259,7 @@ static void table_linear_stats(struct sw_table *swt,
     stats->max_flows = tl->max_flows;
     stats->n_lookup  = swt->n_lookup;
     stats->n_matched = swt->n_matched;
+    stats->n_insert_failed = tl->n_insert_failed;
 }
 
 
@@ -243,11 +274,13 @@ struct sw_table *table_linear_create(unsigned int max_flows)
 
     swt = &tl->swt;
     swt->lookup = table_linear_lookup;
+    swt->lookup_trace = table_linear_lookup_trace;
     swt->insert = table_linear_insert;
     swt->modify = table_linear_modify;
     swt->has_conflict = table_linear_has_conflict;
     swt->delete = table_linear_delete;
     swt->timeout = table_linear_timeout;
+    swt->remove = table_linear_remove;
     swt->destroy = table_linear_destroy;
     swt->iterate = table_linear_iterate;
     swt->stats = table_linear_stats;
@@ -0,0 +1,694 @@
+/* Copyright (c) 2008 The Board of Trustees of The Leland Stanford
+ * Junior University
+ * 
+ * We are making the OpenFlow specification and associated documentation
+ * (Software) available for public use and benefit with the expectation
+ * that others will use, modify and enhance the Software and contribute
+ * those enhancements back to the community. However, since we would
+ * like to make the Software available for broadest use, with as few
+ * restrictions as possible permission is hereby granted, free of
+ * charge, to any person obtaining a copy of this Software to deal in
+ * the Software under the copyrights without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ * The name and trademarks of copyright holder(s) may NOT be used in
+ * advertising or publicity pertaining to the Software or any
+ * derivatives without specific, written prior permission.
+ */
+
+/* Tuple space search table.
+ *
+ * Flows are grouped into subtables by their wildcards, which determine a
+ * mask over 'struct flow'.  Each subtable is a hash table of its flows keyed
+ * on the masked flow, so a lookup costs one hash probe per distinct set of
+ * wildcards rather than one comparison per flow.  Subtables are kept in
+ * decreasing order of the highest priority flow that they hold, so that the
+ * search can stop as soon as no remaining subtable could hold a better
+ * match.  Restoring that order after insertions and deletions is put off
+ * until the next lookup, so that a burst of flow_mods pays for it once.
+ *
+ * Route-like rule sets, whose flows differ mostly in the lengths of their
+ * nw_src and nw_dst prefixes, make one subtable per combination of lengths.
+ * To avoid probing them all, the table also keeps a binary trie of the
+ * nw_src prefixes and one of the nw_dst prefixes of its flows.  A walk down
+ * each trie along a packet's address yields the prefix lengths that some
+ * flow's prefix matches, and the subtables for any other length are
+ * skipped without a probe. */
+
+#include <config.h>
+#include "table.h"
+#include <arpa/inet.h>
+#include <stdlib.h>
+#include <string.h>
+#include "flow.h"
+#include "list.h"
+#include "openflow/openflow.h"
+#include "switch-flow.h"
+#include "datapath.h"
+
+/* Initial number of buckets in a subtable.  A subtable doubles its number of
+ * buckets when it holds more than TSS_MAX_LOAD flows per bucket. */
+#define TSS_MIN_BUCKETS 16
+#define TSS_MAX_LOAD 2
+
+/* A node in a binary trie of IPv4 prefixes.  A node at depth N represents
+ * the N-bit prefix spelled by the path to it from the root. */
+struct tss_trie_node {
+    struct tss_trie_node *children[2];
+    unsigned int n_prefixes;    /* Number of flows with exactly this prefix. */
+};
+
+struct tss_subtable {
+    struct list node;           /* In sw_table_tss's 'subtables'. */
+    uint32_t wildcards;         /* Wildcards of every flow in the subtable. */
+    struct flow mask;           /* 1-bits in each significant field bit. */
+    uint8_t nw_src_len;         /* Prefix lengths that 'mask' implies. */
+    uint8_t nw_dst_len;
+    unsigned int n_flows;
+    uint16_t max_priority;      /* Highest priority of any flow here. */
+    bool max_stale;             /* Must 'max_priority' be recomputed? */
+    unsigned int bucket_mask;   /* Number of buckets, minus 1. */
+    struct list *buckets;       /* Flows linked through 'node', each bucket
+                                 * in decreasing order of priority. */
+};
+
+struct sw_table_tss {
+    struct sw_table swt;
+
+    unsigned int max_flows;
+    unsigned long int n_insert_failed;
+    unsigned int n_flows;
+    struct list subtables;      /* In decreasing order of 'max_priority',
+                                 * unless 'unsorted'. */
+    bool unsorted;              /* Must 'subtables' be sorted? */
+    struct list iter_flows;
+    unsigned long int next_serial;
+
+    /* Prefixes of the flows' nw_src and nw_dst fields, omitting the
+     * zero-length ones, which match any address. */
+    struct tss_trie_node *nw_src_trie;
+    struct tss_trie_node *nw_dst_trie;
+};
+
+/* Returns the number of leading 1-bits in 'mask', a network mask in network
+ * byte order. */
+static int
+prefix_len(uint32_t mask)
+{
+    mask = ntohl(mask);
+    return mask ? 32 - __builtin_ctz(mask) : 0;
+}
+
+/* Returns the bit of 'addr', in host byte order, that selects the child of a
+ * node at 'depth'. */
+static int
+trie_bit(uint32_t addr, int depth)
+{
+    return (addr >> (31 - depth)) & 1;
+}
+
+/* Adds the first 'len' bits of 'addr', in network byte order, to the trie
+ * rooted at '*rootp'.  'len' must be between 1 and 32.  Returns false if
+ * memory is exhausted. */
+static bool
+trie_insert(struct tss_trie_node **rootp, uint32_t addr, int len)
+{
+    struct tss_trie_node **np = rootp;
+    int depth;
+
+    addr = ntohl(addr);
+    for (depth = 0; ; depth++) {
+        if (!*np) {
+            *np = calloc(1, sizeof **np);
+            if (!*np) {
+                return false;
+            }
+        }
+        if (depth == len) {
+            break;
+        }
+        np = &(*np)->children[trie_bit(addr, depth)];
+    }
+    (*np)->n_prefixes++;
+    return true;
+}
+
+/* Removes one instance of the first 'len' bits of 'addr', in host byte
+ * order, from the subtrie rooted at '*np', at 'depth', freeing the nodes
+ * that no longer lead to any prefix. */
+static void
+trie_remove__(struct tss_trie_node **np, uint32_t addr, int len, int depth)
+{
+    struct tss_trie_node *node = *np;
+
+    if (depth == len) {
+        node->n_prefixes--;
+    } else {
+        trie_remove__(&node->children[trie_bit(addr, depth)],
+                      addr, len, depth + 1);
+    }
+    if (!node->n_prefixes && !node->children[0] && !node->children[1]) {
+        free(node);
+        *np = NULL;
+    }
+}
+
+/* Removes one instance of a prefix added with trie_insert(). */
+static void
+trie_remove(struct tss_trie_node **rootp, uint32_t addr, int len)
+{
+    trie_remove__(rootp, ntohl(addr), len, 0);
+}
+
+/* Frees the subtrie rooted at 'node'. */
+static void
+trie_destroy(struct tss_trie_node *node)
+{
+    if (node) {
+        trie_destroy(node->children[0]);
+        trie_destroy(node->children[1]);
+        free(node);
+    }
+}
+
+/* Returns a bitmap in which bit N is set if some prefix of length N in the
+ * trie rooted at 'node' matches 'addr', in network byte order.  Bit 0 is
+ * always set. */
+static uint64_t
+trie_match_lens(const struct tss_trie_node *node, uint32_t addr)
+{
+    uint64_t lens = 1;
+    int depth;
+
+    addr = ntohl(addr);
+    for (depth = 0; node; depth++) {
+        if (node->n_prefixes) {
+            lens |= UINT64_C(1) << depth;
+        }
+        if (depth == 32) {
+            break;
+        }
+        node = node->children[trie_bit(addr, depth)];
+    }
+    return lens;
+}
+
+/* Adds 'flow''s nw_src and nw_dst prefixes, whose lengths 'st' gives, to
+ * 'tt''s tries.  Returns false if memory is exhausted. */
+static bool
+add_prefixes(struct sw_table_tss *tt, const struct tss_subtable *st,
+             const struct sw_flow *flow)
+{
+    if (st->nw_src_len
+        && !trie_insert(&tt->nw_src_trie, flow->key.flow.nw_src,
+                        st->nw_src_len)) {
+        return false;
+    }
+    if (st->nw_dst_len
+        && !trie_insert(&tt->nw_dst_trie, flow->key.flow.nw_dst,
+                        st->nw_dst_len)) {
+        if (st->nw_src_len) {
+            trie_remove(&tt->nw_src_trie, flow->key.flow.nw_src,
+                        st->nw_src_len);
+        }
+        return false;
+    }
+    return true;
+}
+
+/* Removes the prefixes that add_prefixes() added for 'flow'. */
+static void
+remove_prefixes(struct sw_table_tss *tt, const struct tss_subtable *st,
+                const struct sw_flow *flow)
+{
+    if (st->nw_src_len) {
+        trie_remove(&tt->nw_src_trie, flow->key.flow.nw_src, st->nw_src_len);
+    }
+    if (st->nw_dst_len) {
+        trie_remove(&tt->nw_dst_trie, flow->key.flow.nw_dst, st->nw_dst_len);
+    }
+}
+
+/* Returns the bucket in 'st' for flows whose fields are equal to those of
+ * 'flow' once masked with the subtable's mask. */
+static struct list *
+find_bucket(const struct tss_subtable *st, const struct flow *flow)
+{
+    return &st->buckets[flow_hash_masked(flow, &st->mask) & st->bucket_mask];
+}
+
+/* Inserts 'flow' into 'bucket' behind any flows of higher or equal
+ * priority. */
+static void
+bucket_insert(struct list *bucket, struct sw_flow *flow)
+{
+    struct sw_flow *f;
+
+    LIST_FOR_EACH (f, struct sw_flow, node, bucket) {
+        if (f->priority < flow->priority) {
+            break;
+        }
+    }
+    list_insert(&f->node, &flow->node);
+}
+
+static struct tss_subtable *
+subtable_create(const struct sw_flow_key *key)
+{
+    struct tss_subtable *st;
+    unsigned int i;
+
+    st = malloc(sizeof *st);
+    if (st == NULL) {
+        return NULL;
+    }
+    st->buckets = malloc(TSS_MIN_BUCKETS * sizeof *st->buckets);
+    if (st->buckets == NULL) {
+        free(st);
+        return NULL;
+    }
+    for (i = 0; i < TSS_MIN_BUCKETS; i++) {
+        list_init(&st->buckets[i]);
+    }
+    st->bucket_mask = TSS_MIN_BUCKETS - 1;
+    st->wildcards = key->wildcards;
+    flow_make_mask(key, &st->mask);
+    st->nw_src_len = prefix_len(st->mask.nw_src);
+    st->nw_dst_len = prefix_len(st->mask.nw_dst);
+    st->n_flows = 0;
+    st->max_priority = 0;
+    st->max_stale = false;
+    return st;
+}
+
+static void
+subtable_destroy(struct tss_subtable *st)
+{
+    list_remove(&st->node);
+    free(st->buckets);
+    free(st);
+}
+
+/* Doubles the number of buckets in 'st'.  On allocation failure, 'st' is
+ * left as it was, since it works with any number of buckets. */
+static void
+subtable_expand(struct tss_subtable *st)
+{
+    unsigned int n_buckets = (st->bucket_mask + 1) * 2;
+    struct list *old_buckets = st->buckets;
+    unsigned int old_mask = st->bucket_mask;
+    struct list *buckets;
+    unsigned int i;
+
+    buckets = malloc(n_buckets * sizeof *buckets);
+    if (buckets == NULL) {
+        return;
+    }
+    for (i = 0; i < n_buckets; i++) {
+        list_init(&buckets[i]);
+    }
+    st->buckets = buckets;
+    st->bucket_mask = n_buckets - 1;
+
+    for (i = 0; i <= old_mask; i++) {
+        while (!list_is_empty(&old_buckets[i])) {
+            struct sw_flow *flow = CONTAINER_OF(list_front(&old_buckets[i]),
+                                                struct sw_flow, node);
+            list_remove(&flow->node);
+            bucket_insert(find_bucket(st, &flow->key.flow), flow);
+        }
+    }
+    free(old_buckets);
+}
+
+/* Recomputes 'st''s 'max_priority' from the first flow in each bucket. */
+static void
+subtable_update_max(struct tss_subtable *st)
+{
+    unsigned int i;
+
+    st->max_priority = 0;
+    for (i = 0; i <= st->bucket_mask; i++) {
+        if (!list_is_empty(&st->buckets[i])) {
+            struct sw_flow *f = CONTAINER_OF(list_front(&st->buckets[i]),
+                                             struct sw_flow, node);
+            if (f->priority > st->max_priority) {
+                st->max_priority = f->priority;
+            }
+        }
+    }
+    st->max_stale = false;
+}
+
+/* Puts 'tt''s subtables back in decreasing order of 'max_priority'.  The list
+ * is usually close to sorted already, so each subtable is inserted into the
+ * result by scanning from its back. */
+static void
+sort_subtables(struct sw_table_tss *tt)
+{
+    struct list sorted;
+
+    list_init(&sorted);
+    while (!list_is_empty(&tt->subtables)) {
+        struct tss_subtable *st, *s;
+
+        st = CONTAINER_OF(list_pop_front(&tt->subtables),
+                          struct tss_subtable, node);
+        if (st->max_stale) {
+            subtable_update_max(st);
+        }
+        LIST_FOR_EACH_REVERSE (s, struct tss_subtable, node, &sorted) {
+            if (s->max_priority >= st->max_priority) {
+                break;
+            }
+        }
+        list_insert(s->node.next, &st->node);
+    }
+    list_splice(&tt->subtables, sorted.next, &sorted);
+    tt->unsorted = false;
+}
+
+/* Removes 'flow' from its subtable and from 'tt''s iteration list, without
+ * freeing it, and destroys the subtable if it becomes empty. */
+static void
+remove_flow(struct sw_table_tss *tt, struct sw_flow *flow)
+{
+    struct tss_subtable *st = flow->private;
+
+    list_remove(&flow->node);
+    list_remove(&flow->iter_node);
+    remove_prefixes(tt, st, flow);
+    tt->n_flows--;
+
+    if (!--st->n_flows) {
+        subtable_destroy(st);
+    } else if (flow->priority == st->max_priority) {
+        st->max_stale = true;
+        tt->unsorted = true;
+    }
+}
+
+/* Returns the highest-priority flow in 'tt' that matches 'key', if any,
+ * storing in '*n_compares' the number of flows compared with 'key'. */
+static inline struct sw_flow *
+tss_lookup(struct sw_table_tss *tt, const struct sw_flow_key *key,
+           unsigned int *n_compares)
+{
+    struct tss_subtable *st;
+    struct sw_flow *best = NULL;
+    uint64_t src_lens, dst_lens;
+
+    if (tt->unsorted) {
+        sort_subtables(tt);
+    }
+    src_lens = trie_match_lens(tt->nw_src_trie, key->flow.nw_src);
+    dst_lens = trie_match_lens(tt->nw_dst_trie, key->flow.nw_dst);
+    *n_compares = 0;
+    LIST_FOR_EACH (st, struct tss_subtable, node, &tt->subtables) {
+        struct list *bucket;
+        struct sw_flow *flow;
+
+        if (best && st->max_priority <= best->priority) {
+            break;
+        }
+        if (!(src_lens & (UINT64_C(1) << st->nw_src_len))
+            || !(dst_lens & (UINT64_C(1) << st->nw_dst_len))) {
+            /* No flow has a prefix of this length that matches. */
+            continue;
+        }
+        bucket = find_bucket(st, &key->flow);
+        LIST_FOR_EACH (flow, struct sw_flow, node, bucket) {
+            ++*n_compares;
+            if (flow_matches_1wild(key, &flow->key)) {
+                if (!best || flow->priority > best->priority) {
+                    best = flow;
+                }
+                break;
+            }
+        }
+    }
+    return best;
+}
+
+static struct sw_flow *table_tss_lookup(struct sw_table *swt,
+                                        const struct sw_flow_key *key)
+{
+    unsigned int n_compares;
+    return tss_lookup((struct sw_table_tss *) swt, key, &n_compares);
+}
+
+static struct sw_flow *table_tss_lookup_trace(struct sw_table *swt,
+                                              const struct sw_flow_key *key,
+                                              unsigned int *n_compares)
+{
+    return tss_lookup((struct sw_table_tss *) swt, key, n_compares);
+}
+
+static int table_tss_insert(struct sw_table *swt, struct sw_flow *flow)
+{
+    struct sw_table_tss *tt = (struct sw_table_tss *) swt;
+    struct tss_subtable *st;
+    struct list *bucket;
+    struct sw_flow *f;
+
+    LIST_FOR_EACH (st, struct tss_subtable, node, &tt->subtables) {
+        if (st->wildcards == flow->key.wildcards) {
+            break;
+        }
+    }
+
+    if (&st->node != &tt->subtables) {
+        /* Just replace any flow that matches exactly. */
+        bucket = find_bucket(st, &flow->key.flow);
+        LIST_FOR_EACH (f, struct sw_flow, node, bucket) {
+            if (f->priority == flow->priority
+                && flow_matches_1wild(&flow->key, &f->key)) {
+                flow->serial = f->serial;
+                flow->private = st;
+                list_replace(&flow->node, &f->node);
+                list_replace(&flow->iter_node, &f->iter_node);
+                flow_free(f);
+                return 1;
+            }
+        }
+    } else {
+        st = NULL;
+    }
+
+    /* Make sure there's room in the table. */
+    if (tt->n_flows >= tt->max_flows) {
+        tt->n_insert_failed++;
+        return 0;
+    }
+
+    if (st == NULL) {
+        st = subtable_create(&flow->key);
+        if (st == NULL) {
+            return 0;
+        }
+        if (!add_prefixes(tt, st, flow)) {
+            free(st->buckets);
+            free(st);
+            return 0;
+        }
+        st->max_priority = flow->priority;
+        list_push_back(&tt->subtables, &st->node);
+        tt->unsorted = true;
+    } else {
+        if (!add_prefixes(tt, st, flow)) {
+            return 0;
+        }
+        if (flow->priority > st->max_priority) {
+            st->max_priority = flow->priority;
+            tt->unsorted = true;
+        }
+    }
+
+    if (st->n_flows >= (st->bucket_mask + 1) * TSS_MAX_LOAD) {
+        subtable_expand(st);
+    }
+    bucket_insert(find_bucket(st, &flow->key.flow), flow);
+    st->n_flows++;
+    tt->n_flows++;
+
+    flow->private = st;
+    flow->serial = tt->next_serial++;
+    list_push_front(&tt->iter_flows, &flow->iter_node);
+
+    return 1;
+}
+
+static int table_tss_modify(struct sw_table *swt,
+                const struct sw_flow_key *key, uint16_t priority, int strict,
+                const struct ofp_action_header *actions, size_t actions_len)
+{
+    struct sw_table_tss *tt = (struct sw_table_tss *) swt;
+    struct sw_flow *flow;
+    unsigned int count = 0;
+
+    LIST_FOR_EACH (flow, struct sw_flow, iter_node, &tt->iter_flows) {
+        if (flow_matches_desc(&flow->key, key, strict)
+                && (!strict || (flow->priority == priority))) {
+            flow_replace_acts(flow, actions, actions_len);
+            count++;
+        }
+    }
+    return count;
+}
+
+static int table_tss_has_conflict(struct sw_table *swt,
+                                  const struct sw_flow_key *key,
+                                  uint16_t priority, int strict)
+{
+    struct sw_table_tss *tt = (struct sw_table_tss *) swt;
+    struct sw_flow *flow;
+
+    LIST_FOR_EACH (flow, struct sw_flow, iter_node, &tt->iter_flows) {
+        if (flow_matches_2desc(&flow->key, key, strict)
+                && (flow->priority == priority)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static int table_tss_delete(struct datapath *dp, struct sw_table *swt,
+                            const struct sw_flow_key *key,
+                            uint16_t out_port,
+                            uint16_t priority, int strict)
+{
+    struct sw_table_tss *tt = (struct sw_table_tss *) swt;
+    struct sw_flow *flow, *n;
+    unsigned int count = 0;
+
+    LIST_FOR_EACH_SAFE (flow, n, struct sw_flow, iter_node, &tt->iter_flows) {
+        if (flow_matches_desc(&flow->key, key, strict)
+                && flow_has_out_port(flow, out_port)
+                && (!strict || (flow->priority == priority))) {
+            dp_send_flow_end(dp, flow, OFPRR_DELETE);
+            remove_flow(tt, flow);
+            flow_free(flow);
+            count++;
+        }
+    }
+    return count;
+}
+
+static void table_tss_timeout(struct sw_table *swt, struct list *deleted)
+{
+    struct sw_table_tss *tt = (struct sw_table_tss *) swt;
+    struct sw_flow *flow, *n;
+
+    LIST_FOR_EACH_SAFE (flow, n, struct sw_flow, iter_node, &tt->iter_flows) {
+        if (flow_timeout(flow)) {
+            remove_flow(tt, flow);
+            list_push_back(deleted, &flow->node);
+        }
+    }
+}
+
+static void table_tss_remove(struct sw_table *swt, struct sw_flow *flow)
+{
+    remove_flow((struct sw_table_tss *) swt, flow);
+}
+
+static void table_tss_destroy(struct sw_table *swt)
+{
+    struct sw_table_tss *tt = (struct sw_table_tss *) swt;
+
+    while (!list_is_empty(&tt->iter_flows)) {
+        struct sw_flow *flow = CONTAINER_OF(list_front(&tt->iter_flows),
+                                            struct sw_flow, iter_node);
+        remove_flow(tt, flow);
+        flow_free(flow);
+    }
+    trie_destroy(tt->nw_src_trie);
+    trie_destroy(tt->nw_dst_trie);
+    free(tt);
+}
+
+static int table_tss_iterate(struct sw_table *swt,
+                             const struct sw_flow_key *key,
+                             uint16_t out_port,
+                             struct sw_table_position *position,
+                             int (*callback)(struct sw_flow *, void *),
+                             void *private)
+{
+    struct sw_table_tss *tt = (struct sw_table_tss *) swt;
+    struct sw_flow *flow;
+    unsigned long start;
+
+    start = ~position->private[0];
+    LIST_FOR_EACH (flow, struct sw_flow, iter_node, &tt->iter_flows) {
+        if (flow->serial <= start
+                && flow_matches_2wild(key, &flow->key)
+                && flow_has_out_port(flow, out_port)) {
+            int error = callback(flow, private);
+            if (error) {
+                position->private[0] = ~(flow->serial - 1);
+                return error;
+            }
+        }
+    }
+    return 0;
+}
+
+static void table_tss_stats(struct sw_table *swt,
+                            struct sw_table_stats *stats)
+{
+    struct sw_table_tss *tt = (struct sw_table_tss *) swt;
+    stats->name = "tss";
+    stats->wildcards = OFPFW_ALL;
+    stats->n_flows   = tt->n_flows;
+    stats->max_flows = tt->max_flows;
+    stats->n_lookup  = swt->n_lookup;
+    stats->n_matched = swt->n_matched;
+    stats->n_insert_failed = tt->n_insert_failed;
+}
+
+struct sw_table *table_tss_create(unsigned int max_flows)
+{
+    struct sw_table_tss *tt;
+    struct sw_table *swt;
+
+    tt = calloc(1, sizeof *tt);
+    if (tt == NULL)
+        return NULL;
+
+    swt = &tt->swt;
+    swt->lookup = table_tss_lookup;
+    swt->lookup_trace = table_tss_lookup_trace;
+    swt->insert = table_tss_insert;
+    swt->modify = table_tss_modify;
+    swt->has_conflict = table_tss_has_conflict;
+    swt->delete = table_tss_delete;
+    swt->timeout = table_tss_timeout;
+    swt->remove = table_tss_remove;
+    swt->destroy = table_tss_destroy;
+    swt->iterate = table_tss_iterate;
+    swt->stats = table_tss_stats;
+
+    tt->max_flows = max_flows;
+    tt->n_flows = 0;
+    list_init(&tt->subtables);
+    tt->unsorted = false;
+    list_init(&tt->iter_flows);
+    tt->next_serial = 0;
+
+    return swt;
+}
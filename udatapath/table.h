@@ -46,6 +46,19 @@ struct sw_flow_key;
 struct ofp_action_header;
 struct list;
 
+/* Maximum number of hash functions whose statistics a table reports. */
+#define TABLE_MAX_HASHES 2
+
+/* Statistics for one of a hash table's hash functions. */
+struct sw_hash_stats {
+    unsigned int n_flows;        /* Flows stored under this hash. */
+    unsigned int max_flows;      /* Most buckets the table may grow to. */
+    unsigned int n_buckets;      /* Current number of buckets. */
+    unsigned long int n_insert_failed; /* Inserts whose bucket was taken. */
+    unsigned long int n_collisions; /* Lookups whose bucket held a different
+                                       flow (one flow per bucket only). */
+};
+
 /* Table statistics. */
 struct sw_table_stats {
     const char *name;            /* Human-readable name. */
@@ -53,8 +66,18 @@ struct sw_table_stats {
                                     supported by the table. */
     unsigned int n_flows;        /* Number of active flows. */
     unsigned int max_flows;      /* Flow capacity. */
+    unsigned int capacity;       /* For a table that grows toward
+                                    'max_flows', the flows that it can hold
+                                    at its current size; otherwise 0. */
     unsigned long int n_lookup;  /* Number of packets looked up. */
     unsigned long int n_matched; /* Number of packets that have hit. */
+    unsigned long int n_insert_failed; /* Number of flows that did not fit,
+                                          which the chain then offers to the
+                                          next table. */
+
+    /* Hash tables only: one entry per hash function, in probe order. */
+    int n_hashes;
+    struct sw_hash_stats hashes[TABLE_MAX_HASHES];
 };
 
 /* Position within an iteration of a sw_table.
@@ -65,6 +88,9 @@ struct sw_table_position {
     unsigned long private[4];
 };
 
+/* Maximum number of keys passed to a table's 'lookup_batch' at once. */
+#define TABLE_LOOKUP_BATCH 32
+
 /* A single table of flows.  */
 struct sw_table {
     /* The number of packets that have been looked up and matched,
@@ -79,6 +105,24 @@ struct sw_table {
     struct sw_flow *(*lookup)(struct sw_table *table,
                               const struct sw_flow_key *key);
 
+    /* Looks up each of the 'n' keys in 'keys', where 'n' is at most
+     * TABLE_LOOKUP_BATCH, storing in 'flows[i]' what 'lookup' would return
+     * for 'keys[i]'.  A table whose lookups are dominated by cache misses can
+     * overlap the misses for different keys.  May be null, in which case
+     * callers call 'lookup' for each key. */
+    void (*lookup_batch)(struct sw_table *table,
+                         const struct sw_flow_key *keys[],
+                         struct sw_flow *flows[], size_t n);
+
+    /* Searches 'table' for a flow matching 'key', as 'lookup' does, and
+     * stores in '*n_compares' the number of flows that the search compared
+     * against 'key'.  Does not update the table's statistics.  Used only to
+     * explain lookups to the user ("dpctl trace").  May be null if the table
+     * cannot count its comparisons. */
+    struct sw_flow *(*lookup_trace)(struct sw_table *table,
+                                    const struct sw_flow_key *key,
+                                    unsigned int *n_compares);
+
     /* Inserts 'flow' into 'table', replacing any duplicate flow.  Returns
      * 0 if successful or a negative error.  Error can be due to an
      * over-capacity table or because the flow is not one of the kind that
@@ -115,6 +159,16 @@ struct sw_table {
      * caller to free. */
     void (*timeout)(struct sw_table *table, struct list *deleted);
 
+    /* Removes 'flow', which must be in 'table', from 'table' without freeing
+     * it.  The chain uses this to expire flows found on its timeout wheel.
+     * May be null, in which case the chain expires the table's flows by
+     * calling 'timeout' once a second instead. */
+    void (*remove)(struct sw_table *table, struct sw_flow *flow);
+
+    /* Performs periodic maintenance on 'table'.  The chain calls this about
+     * once a second, between packets.  May be null. */
+    void (*run)(struct sw_table *table);
+
     /* Destroys 'table', which must not have any users. */
     void (*destroy)(struct sw_table *table);
 
@@ -145,6 +199,10 @@ struct sw_table *table_hash_create(unsigned int polynomial,
                                    unsigned int n_buckets);
 struct sw_table *table_hash2_create(unsigned int poly0, unsigned int buckets0,
                                     unsigned int poly1, unsigned int buckets1);
+struct sw_table *table_cuckoo_create(unsigned int polynomial,
+                                     unsigned int max_flows);
 struct sw_table *table_linear_create(unsigned int max_flows);
+struct sw_table *table_tss_create(unsigned int max_flows);
+struct sw_table *table_dtree_create(unsigned int max_flows);
 
 #endif /* table.h */
@@ -0,0 +1,362 @@
+/* Copyright (c) 2008 The Board of Trustees of The Leland Stanford
+ * Junior University
+ * 
+ * We are making the OpenFlow specification and associated documentation
+ * (Software) available for public use and benefit with the expectation
+ * that others will use, modify and enhance the Software and contribute
+ * those enhancements back to the community. However, since we would
+ * like to make the Software available for broadest use, with as few
+ * restrictions as possible permission is hereby granted, free of
+ * charge, to any person obtaining a copy of this Software to deal in
+ * the Software under the copyrights without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ * The name and trademarks of copyright holder(s) may NOT be used in
+ * advertising or publicity pertaining to the Software or any
+ * derivatives without specific, written prior permission.
+ */
+
+#include <config.h>
+#include "topk.h"
+#include <arpa/inet.h>
+#include <stdlib.h>
+#include <string.h>
+#include "flow.h"
+#include "hash.h"
+#include "hmap.h"
+#include "ofpbuf.h"
+#include "openflow/openflow-ext.h"
+#include "switch-flow.h"
+#include "timeval.h"
+#include "util.h"
+#include "xtoxll.h"
+
+/* A counter in a summary. */
+struct topk_entry {
+    struct hmap_node node;      /* In summary's 'index', hashed on 'flow'. */
+    size_t heap_idx;            /* Position in summary's 'heap'. */
+
+    /* The flow being counted.  'flow' is only compared, never followed: the
+     * flow may have been freed since, and 'created' tells it apart from a
+     * later flow allocated at the same address. */
+    const struct sw_flow *flow;
+    uint64_t created;
+
+    uint64_t count;             /* Estimate of the ranked counter. */
+    uint64_t error;             /* Most by which 'count' may be too high. */
+    uint64_t packets;           /* Packets since taking this counter. */
+    uint64_t bytes;             /* Bytes since taking this counter. */
+
+    /* Copied from the flow, so that reports need not follow 'flow'. */
+    struct flow key;
+    uint32_t wildcards;
+    uint64_t cookie;
+    uint16_t priority;
+};
+
+/* A space-saving summary over one epoch, ranked by one counter. */
+struct topk_summary {
+    struct topk_entry *entries; /* 'max' counters, the first 'n' in use. */
+    struct topk_entry **heap;   /* The 'n' in use, as a min-heap on count. */
+    size_t n, max;
+    struct hmap index;          /* Contains the 'n' in use. */
+};
+
+struct topk {
+    unsigned int window_msec;   /* Length of an epoch. */
+    long long int epoch_start;  /* When the current epoch began. */
+    int cur;                    /* Index of the current epoch in 'sums'. */
+    bool have_prev;             /* Does the other epoch hold the last one? */
+
+    /* Summaries for the current and previous epochs, each indexed by
+     * OFP_EXT_TOP_BY_*. */
+    struct topk_summary sums[2][2];
+};
+
+static uint32_t
+hash_flow_ptr(const struct sw_flow *flow)
+{
+    return hash_bytes(&flow, sizeof flow, 0);
+}
+
+static void
+summary_init(struct topk_summary *s, unsigned int max)
+{
+    s->entries = xmalloc(max * sizeof *s->entries);
+    s->heap = xmalloc(max * sizeof *s->heap);
+    s->n = 0;
+    s->max = max;
+    hmap_init(&s->index);
+    hmap_reserve(&s->index, max);
+}
+
+static void
+summary_destroy(struct topk_summary *s)
+{
+    free(s->entries);
+    free(s->heap);
+    hmap_destroy(&s->index);
+}
+
+static void
+summary_clear(struct topk_summary *s)
+{
+    size_t i;
+
+    for (i = 0; i < s->n; i++) {
+        hmap_remove(&s->index, &s->entries[i].node);
+    }
+    s->n = 0;
+}
+
+static struct topk_entry *
+summary_find(const struct topk_summary *s, const struct sw_flow *flow,
+             uint64_t created, uint32_t hash)
+{
+    struct topk_entry *e;
+
+    HMAP_FOR_EACH_WITH_HASH (e, struct topk_entry, node, hash, &s->index) {
+        if (e->flow == flow && e->created == created) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+static void
+heap_swap(struct topk_summary *s, size_t a, size_t b)
+{
+    struct topk_entry *tmp = s->heap[a];
+
+    s->heap[a] = s->heap[b];
+    s->heap[b] = tmp;
+    s->heap[a]->heap_idx = a;
+    s->heap[b]->heap_idx = b;
+}
+
+/* Restores the heap property around 'i', whose count has changed. */
+static void
+heap_fix(struct topk_summary *s, size_t i)
+{
+    while (i > 0 && s->heap[i]->count < s->heap[(i - 1) / 2]->count) {
+        heap_swap(s, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+    for (;;) {
+        size_t left = 2 * i + 1;
+        size_t right = left + 1;
+        size_t min = i;
+
+        if (left < s->n && s->heap[left]->count < s->heap[min]->count) {
+            min = left;
+        }
+        if (right < s->n && s->heap[right]->count < s->heap[min]->count) {
+            min = right;
+        }
+        if (min == i) {
+            break;
+        }
+        heap_swap(s, i, min);
+        i = min;
+    }
+}
+
+static void
+summary_count(struct topk_summary *s, const struct sw_flow *flow,
+              uint32_t hash, uint64_t weight, size_t n_bytes)
+{
+    struct topk_entry *e = summary_find(s, flow, flow->created, hash);
+
+    if (!e) {
+        if (s->n < s->max) {
+            e = &s->entries[s->n];
+            e->heap_idx = s->n;
+            e->count = e->error = 0;
+            s->heap[s->n++] = e;
+        } else {
+            /* Take over the smallest counter. */
+            e = s->heap[0];
+            hmap_remove(&s->index, &e->node);
+            e->error = e->count;
+        }
+        e->flow = flow;
+        e->created = flow->created;
+        e->packets = e->bytes = 0;
+        e->key = flow->key.flow;
+        e->wildcards = flow->key.wildcards;
+        e->cookie = flow->cookie;
+        e->priority = flow->priority;
+        hmap_insert_fast(&s->index, &e->node, hash);
+    }
+    e->count += weight;
+    e->packets++;
+    e->bytes += n_bytes;
+    heap_fix(s, e->heap_idx);
+}
+
+/* Creates and returns summaries that track up to 'n_flows' flows, at most
+ * TOPK_MAX_FLOWS, over a sliding window of 'window_msec' milliseconds. */
+struct topk *
+topk_create(unsigned int n_flows, unsigned int window_msec)
+{
+    struct topk *tk = xcalloc(1, sizeof *tk);
+    int i, j;
+
+    n_flows = MIN(MAX(n_flows, 1), TOPK_MAX_FLOWS);
+    tk->window_msec = MAX(window_msec, 1);
+    tk->epoch_start = time_msec();
+    for (i = 0; i < 2; i++) {
+        for (j = 0; j < 2; j++) {
+            summary_init(&tk->sums[i][j], n_flows);
+        }
+    }
+    return tk;
+}
+
+void
+topk_destroy(struct topk *tk)
+{
+    if (tk) {
+        int i, j;
+
+        for (i = 0; i < 2; i++) {
+            for (j = 0; j < 2; j++) {
+                summary_destroy(&tk->sums[i][j]);
+            }
+        }
+        free(tk);
+    }
+}
+
+/* Counts a packet of 'n_bytes' bytes that matched 'flow'. */
+void
+topk_count(struct topk *tk, const struct sw_flow *flow, size_t n_bytes)
+{
+    struct topk_summary *sums = tk->sums[tk->cur];
+    uint32_t hash = hash_flow_ptr(flow);
+
+    summary_count(&sums[OFP_EXT_TOP_BY_PACKETS], flow, hash, 1, n_bytes);
+    summary_count(&sums[OFP_EXT_TOP_BY_BYTES], flow, hash, n_bytes, n_bytes);
+}
+
+/* Starts a new epoch if the current one has run for a whole window. */
+void
+topk_run(struct topk *tk)
+{
+    long long int elapsed = time_msec() - tk->epoch_start;
+
+    if (elapsed >= tk->window_msec) {
+        int by;
+
+        /* After a gap of more than a window, such as while the process was
+         * stopped, the last epoch no longer adjoins the window. */
+        tk->have_prev = elapsed < 2 * (long long int) tk->window_msec;
+        tk->epoch_start = (tk->have_prev ? tk->epoch_start + tk->window_msec
+                           : time_msec());
+        tk->cur = !tk->cur;
+        for (by = 0; by < 2; by++) {
+            summary_clear(&tk->sums[tk->cur][by]);
+            if (!tk->have_prev) {
+                summary_clear(&tk->sums[!tk->cur][by]);
+            }
+        }
+    }
+}
+
+static int
+compare_entries_desc(const void *a_, const void *b_)
+{
+    const struct topk_entry *a = a_;
+    const struct topk_entry *b = b_;
+
+    return a->count > b->count ? -1 : a->count < b->count;
+}
+
+/* Appends to 'buffer' a struct ofp_ext_top_flows_reply that lists up to
+ * 'max_flows' of the flows with the highest estimated counts, ranked 'by'
+ * one of OFP_EXT_TOP_BY_*.  'tk' may be null, to report no flows. */
+void
+topk_put_report(struct topk *tk, int by, unsigned int max_flows,
+                struct ofpbuf *buffer)
+{
+    const struct topk_summary *cur, *prev;
+    struct ofp_ext_top_flows_reply *reply;
+    struct topk_entry *merged;
+    size_t n_merged, i;
+
+    reply = ofpbuf_put_zeros(buffer, sizeof *reply);
+    reply->header.vendor = htonl(OPENFLOW_VENDOR_ID);
+    reply->header.subtype = htonl(OFP_EXT_STATS_TOP_FLOWS);
+    reply->by = by;
+    if (!tk || (by != OFP_EXT_TOP_BY_PACKETS && by != OFP_EXT_TOP_BY_BYTES)) {
+        return;
+    }
+
+    topk_run(tk);
+    cur = &tk->sums[tk->cur][by];
+    prev = tk->have_prev ? &tk->sums[!tk->cur][by] : NULL;
+    reply->window_msec = htonl(time_msec() - tk->epoch_start
+                               + (prev ? tk->window_msec : 0));
+
+    /* Add together the two epochs' counters for each flow.  A flow that has
+     * a counter in only one epoch is reported with just that count. */
+    merged = xmalloc((cur->n + (prev ? prev->n : 0)) * sizeof *merged);
+    n_merged = 0;
+    for (i = 0; i < cur->n; i++) {
+        const struct topk_entry *e = &cur->entries[i];
+        struct topk_entry *m = &merged[n_merged++];
+
+        *m = *e;
+        if (prev) {
+            const struct topk_entry *p;
+
+            p = summary_find(prev, e->flow, e->created,
+                             hash_flow_ptr(e->flow));
+            if (p) {
+                m->count += p->count;
+                m->error += p->error;
+                m->packets += p->packets;
+                m->bytes += p->bytes;
+            }
+        }
+    }
+    for (i = 0; prev && i < prev->n; i++) {
+        const struct topk_entry *p = &prev->entries[i];
+
+        if (!summary_find(cur, p->flow, p->created, hash_flow_ptr(p->flow))) {
+            merged[n_merged++] = *p;
+        }
+    }
+    qsort(merged, n_merged, sizeof *merged, compare_entries_desc);
+
+    for (i = 0; i < n_merged && i < max_flows; i++) {
+        const struct topk_entry *m = &merged[i];
+        struct ofp_ext_top_flow *otf;
+
+        otf = ofpbuf_put_zeros(buffer, sizeof *otf);
+        flow_fill_match(&otf->match, &m->key, m->wildcards);
+        otf->cookie = htonll(m->cookie);
+        otf->packet_count = htonll(by == OFP_EXT_TOP_BY_PACKETS
+                                   ? m->count : m->packets);
+        otf->byte_count = htonll(by == OFP_EXT_TOP_BY_BYTES
+                                 ? m->count : m->bytes);
+        otf->error = htonll(m->error);
+        otf->priority = htons(m->priority);
+    }
+    free(merged);
+}
@@ -0,0 +1,76 @@
+/* Copyright (c) 2008 The Board of Trustees of The Leland Stanford
+ * Junior University
+ * 
+ * We are making the OpenFlow specification and associated documentation
+ * (Software) available for public use and benefit with the expectation
+ * that others will use, modify and enhance the Software and contribute
+ * those enhancements back to the community. However, since we would
+ * like to make the Software available for broadest use, with as few
+ * restrictions as possible permission is hereby granted, free of
+ * charge, to any person obtaining a copy of this Software to deal in
+ * the Software under the copyrights without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ * The name and trademarks of copyright holder(s) may NOT be used in
+ * advertising or publicity pertaining to the Software or any
+ * derivatives without specific, written prior permission.
+ */
+
+/* Heavy-hitter flow estimates for the OFP_EXT_STATS_TOP_FLOWS vendor
+ * statistics request.
+ *
+ * Finding the busiest flows by dumping every flow's counters takes time in
+ * proportion to the number of flows.  Instead, a "space-saving" summary
+ * keeps counters for just a fixed number of flows, ranked by packets in one
+ * summary and by bytes in another.  A packet for a flow that has a counter
+ * adds to it.  A packet for any other flow takes over the smallest counter,
+ * keeping its count as an overestimate of the newcomer's, so that every flow
+ * whose true count exceeds the smallest counter has a counter of its own.
+ * Counting a packet takes O(log n) time in the number of counters, however
+ * many flows the switch holds.
+ *
+ * The counts cover a sliding window.  Summaries are kept for epochs of one
+ * window each, and a report adds the current, partial epoch to the previous,
+ * complete one. */
+
+#ifndef TOPK_H
+#define TOPK_H 1
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct ofpbuf;
+struct sw_flow;
+struct topk;
+
+/* Most flows that a summary can track, chosen so that a report fits in one
+ * OpenFlow message. */
+#define TOPK_MAX_FLOWS 256
+
+/* Default length of the sliding window, in seconds. */
+#define TOPK_DEFAULT_WINDOW 10
+
+struct topk *topk_create(unsigned int n_flows, unsigned int window_msec);
+void topk_destroy(struct topk *);
+
+void topk_count(struct topk *, const struct sw_flow *, size_t n_bytes);
+void topk_run(struct topk *);
+void topk_put_report(struct topk *, int by, unsigned int max_flows,
+                     struct ofpbuf *);
+
+#endif /* topk.h */
@@ -34,22 +34,37 @@
 #include <config.h>
 #include <errno.h>
 #include <getopt.h>
+#include <inttypes.h>
 #include <limits.h>
+#include <sched.h>
 #include <signal.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "chain.h"
 #include "command-line.h"
 #include "daemon.h"
 #include "datapath.h"
+#include "dynamic-string.h"
 #include "fault.h"
+#include "hugepage.h"
+#include "metrics.h"
 #include "openflow/openflow.h"
+#include "pending-miss.h"
+#include "pktbuf.h"
 #include "poll-loop.h"
 #include "queue.h"
 #include "util.h"
 #include "rconn.h"
+#include "rx-threads.h"
+#include "sampler.h"
+#include "signals.h"
+#include "snapshot.h"
+#include "stats-file.h"
+#include "svec.h"
 #include "timeval.h"
+#include "topk.h"
 #include "vconn.h"
 #include "dirs.h"
 #include "vconn-ssl.h"
@@ -59,6 +74,10 @@
 #include <openflow/of_hw_api.h>
 #endif
 
+#if !defined(UDATAPATH_AS_LIB)
+#include "secchan/secchan.h"
+#endif
+
 #define THIS_MODULE VLM_udatapath
 #include "vlog.h"
 
@@ -75,11 +94,105 @@ static void usage(void) NO_RETURN;
 
 static struct datapath *dp;
 static uint64_t dpid = UINT64_MAX;
+
+/* --datapath: Additional datapaths to run in this process.  They share the
+ * main loop, receive threads and packet buffers with 'dp', which is always
+ * dps[0]. */
+struct extra_datapath {
+    uint64_t dpid;              /* UINT64_MAX to generate one. */
+    char *port_list;            /* Ports to add, or null. */
+    struct svec listeners;      /* Passive OpenFlow connection methods. */
+};
+static struct extra_datapath *extra_dps;
+static size_t n_extra_dps;
+static struct datapath **dps;
+static size_t n_dps;
+
 static char *port_list;
 static char *local_port = "tap:";
 static uint16_t num_queues = NETDEV_MAX_QUEUES;
+static unsigned int tx_ring_frames = 0;
+static unsigned int rx_ring_frames = 0;
+static bool use_shaper = false;
+
+/* --bundle-flow-removed: Pack flow expirations into OFP_EXT_BUNDLE
+ * messages? */
+static bool bundle_flow_removed = false;
+
+/* --evict: Number of flows to evict from a full table at once, or 0 to
+ * reject new flows instead. */
+static unsigned int evict_batch = 0;
+
+/* --hold-misses: Longest time, in milliseconds, to hold later misses for a
+ * flow behind the first one while the controller sets the flow up, or 0 to
+ * send every miss to the controller. */
+static unsigned int hold_misses_msec = 0;
+
+/* --packet-in-rate, --packet-in-burst: Packet_ins per second that may be
+ * sent for each reason on behalf of each port, or 0 for no limit, and how
+ * many may be sent at once (by default, a quarter of a second's worth). */
+static unsigned int pin_rate = 0;
+static unsigned int pin_burst = 0;
+
+/* --adaptive-miss-len: Shrink packet_ins for misses while the controller
+ * connection is congested? */
+static bool adaptive_miss_len = false;
+
+static int n_rx_threads = 0;
+
+/* --busy-poll: Longest time, in milliseconds, to spin receiving packets
+ * before servicing timers and OpenFlow connections, or 0 to sleep in
+ * poll_block() whenever there is nothing to do. */
+static int busy_poll_msec = 0;
+
+/* --rx-budget, --msg-budget: Packets received per port and OpenFlow messages
+ * processed per remote in each pass through the main loop. */
+static unsigned int rx_budget = DP_DEFAULT_RX_BUDGET;
+static unsigned int msg_budget = DP_DEFAULT_MSG_BUDGET;
+
+/* --cpu: CPU to which to pin the forwarding thread, or -1 to leave it to the
+ * scheduler. */
+static int forwarding_cpu = -1;
+
+/* --hugepages: Back flow tables and receive buffers with huge pages? */
+static bool use_hugepages = false;
+static char *tables;
+static unsigned int n_buffers = PKTBUF_DEFAULT_BUFFERS;
+
+/* --sflow, --sflow-rate: Collector for sampled packets, if any, and the
+ * mean number of packets received per sample. */
+static char *sflow_collector;
+static unsigned int sflow_rate = SAMPLER_DEFAULT_RATE;
+
+/* --flow-snapshot: File from which flows are restored at startup and to which
+ * they are saved on SIGTERM or SIGUSR1, if any. */
+static char *snapshot_file;
+
+/* --top-flows, --top-flows-window: Number of heavy-hitter flows to track, or
+ * 0 not to track them, and the sliding window over which to count, in
+ * seconds. */
+static unsigned int top_flows = 0;
+static unsigned int top_flows_window = TOPK_DEFAULT_WINDOW;
+
+#if !defined(UDATAPATH_AS_LIB)
+/* --secchan: Command-line arguments for a secure channel to run inside this
+ * process, if any. */
+static char *secchan_args;
+
+/* Name under which the datapath listens for the in-process secure channel. */
+#define SECCHAN_INPROC_NAME "secchan"
+
+static void start_secchan(const char *args);
+#endif
 
 static void add_ports(struct datapath *dp, char *port_list);
+static uint64_t parse_datapath_id(const char *);
+static void parse_extra_datapath(const char *args);
+static void configure_datapath(struct datapath *);
+static int start_extra_datapath(const struct extra_datapath *);
+static void pin_to_cpu(int cpu);
+static void busy_poll(void);
+static char *read_tables_file(const char *file_name);
 
 /* Need to treat this more generically */
 #if defined(UDATAPATH_AS_LIB)
@@ -102,6 +215,10 @@ main(int argc, char *argv[])
 int
 udatapath_cmd(int argc, char *argv[])
 {
+    struct signal *term_signal = NULL, *save_signal = NULL;
+#if !defined(UDATAPATH_AS_LIB)
+    bool secchan_running = false;
+#endif
     int n_listeners;
     int error;
     int i;
@@ -112,13 +229,40 @@ udatapath_cmd(int argc, char *argv[])
     vlog_init();
     parse_options(argc, argv);
     signal(SIGPIPE, SIG_IGN);
+    if (use_hugepages) {
+        /* The forwarding thread owns the tables and the receive buffer
+         * pools, so place them on its node. */
+        int node = forwarding_cpu >= 0 ? hugepage_cpu_node(forwarding_cpu)
+                                       : -1;
+        hugepage_configure(true, node);
+    }
 
+#if !defined(UDATAPATH_AS_LIB)
+    if (argc - optind < 1 && !secchan_args) {
+#else
     if (argc - optind < 1) {
+#endif
         OFP_FATAL(0, "at least one listener argument is required; "
           "use --help for usage");
     }
 
-    error = dp_new(&dp, dpid);
+    error = dp_new(&dp, dpid, tables, n_buffers);
+    if (error) {
+        OFP_FATAL(error, "could not create datapath");
+    }
+    configure_datapath(dp);
+    dps = xmalloc((n_extra_dps + 1) * sizeof *dps);
+    dps[n_dps++] = dp;
+    if (sflow_collector) {
+        error = sampler_create(sflow_collector, sflow_rate, &dp->sampler);
+        if (error) {
+            OFP_FATAL(error, "could not send samples to %s", sflow_collector);
+        }
+    }
+    if (top_flows) {
+        dp->topk = topk_create(top_flows, top_flows_window * 1000);
+    }
+    metrics_init("ofdatapath");
 
     n_listeners = 0;
     for (i = optind; i < argc; i++) {
@@ -134,6 +278,18 @@ udatapath_cmd(int argc, char *argv[])
             ofp_error(retval, "opening %s", pvconn_name);
         }
     }
+#if !defined(UDATAPATH_AS_LIB)
+    if (secchan_args) {
+        struct pvconn *pvconn;
+
+        error = pvconn_open("pinproc:" SECCHAN_INPROC_NAME, &pvconn);
+        if (error) {
+            OFP_FATAL(error, "could not listen for in-process secchan");
+        }
+        dp_add_pvconn(dp, pvconn);
+        n_listeners++;
+    }
+#endif
     if (!n_listeners) {
         OFP_FATAL(0, "could not listen for any connections");
     }
@@ -147,6 +303,23 @@ udatapath_cmd(int argc, char *argv[])
             OFP_FATAL(error, "failed to add local port %s", local_port);
         }
     }
+    for (i = 0; i < n_extra_dps; i++) {
+        if (start_extra_datapath(&extra_dps[i])) {
+            return -1;
+        }
+    }
+
+    if (snapshot_file) {
+        unsigned int n_flows;
+
+        /* Restore flows before any packet or controller connection is
+         * processed, so that a restart does not flush the flow tables. */
+        error = snapshot_load(dp, snapshot_file, &n_flows);
+        if (error && error != ENOENT) {
+            ofp_error(error, "could not restore flows from %s",
+                      snapshot_file);
+        }
+    }
 
     error = vlog_server_listen(NULL, NULL);
     if (error) {
@@ -155,16 +328,107 @@ udatapath_cmd(int argc, char *argv[])
 
     die_if_already_running();
     daemonize();
+    stats_file_init();
+
+    /* Register after daemonize(), which installs the fatal signal handlers
+     * that would otherwise replace ours. */
+    if (snapshot_file) {
+        term_signal = signal_register(SIGTERM);
+        save_signal = signal_register(SIGUSR1);
+    }
+
+#if !defined(UDATAPATH_AS_LIB)
+    if (secchan_args) {
+        start_secchan(secchan_args);
+        secchan_running = true;
+    }
+#endif
 
     for (;;) {
-        dp_run(dp);
-        dp_wait(dp);
+        /* Threads do not survive the fork() in daemonize(), so start them
+         * after it, once all the ports that they will serve are up. */
+        if (n_rx_threads) {
+            bool pending = false;
+
+            for (i = 0; i < n_dps; i++) {
+                pending = pending || dp_ports_pending(dps[i]);
+            }
+            if (!pending) {
+                error = rx_threads_start(dps, n_dps, n_rx_threads);
+                if (error) {
+                    OFP_FATAL(error, "failed to start receive threads");
+                }
+                n_rx_threads = 0;
+            }
+        }
+        /* Pin only once the receive threads exist, since they would
+         * otherwise inherit the forwarding thread's affinity. */
+        if (forwarding_cpu >= 0 && !n_rx_threads) {
+            pin_to_cpu(forwarding_cpu);
+            forwarding_cpu = -1;
+        }
+        if (term_signal && signal_poll(term_signal)) {
+            snapshot_save(dp, snapshot_file);
+            exit(EXIT_SUCCESS);
+        }
+        if (save_signal && signal_poll(save_signal)) {
+            snapshot_save(dp, snapshot_file);
+        }
+        for (i = 0; i < n_dps; i++) {
+            dp_run(dps[i]);
+        }
+#if !defined(UDATAPATH_AS_LIB)
+        if (secchan_running && !secchan_run()) {
+            VLOG_WARN("in-process secure channel has exited");
+            secchan_running = false;
+        }
+#endif
+        for (i = 0; i < n_dps; i++) {
+            dp_wait(dps[i]);
+        }
+#if !defined(UDATAPATH_AS_LIB)
+        if (secchan_running) {
+            secchan_wait();
+        }
+#endif
+        if (term_signal) {
+            signal_wait(term_signal);
+            signal_wait(save_signal);
+        }
+        if (busy_poll_msec) {
+            poll_immediate_wake();
+        }
         poll_block();
+        if (busy_poll_msec) {
+            busy_poll();
+        }
     }
 
     return 0;
 }
 
+#if !defined(UDATAPATH_AS_LIB)
+/* Starts the secure channel inside this process, with command-line arguments
+ * taken from the words in 'args', connected to the datapath through an
+ * in-process vconn.  OpenFlow messages then pass between the two as ofpbuf
+ * pointers, with no socket between them. */
+static void
+start_secchan(const char *args)
+{
+    struct svec argv;
+
+    svec_init(&argv);
+    svec_add(&argv, "ofprotocol");
+    svec_add(&argv, "inproc:" SECCHAN_INPROC_NAME);
+    svec_parse_words(&argv, args);
+    svec_terminate(&argv);
+
+    /* secchan keeps pointers into 'argv', so it is never freed. */
+    optind = 0;
+    secchan_start(argv.n, argv.names, false);
+}
+#endif
+
 static void
 add_ports(struct datapath *dp, char *port_list)
 {
@@ -176,10 +440,174 @@ add_ports(struct datapath *dp, char *port_list)
      * Using ",," instead of the obvious "," works around it. */
     for (port = strtok_r(port_list, ",,", &save_ptr); port;
          port = strtok_r(NULL, ",,", &save_ptr)) {
-        int error = dp_add_port(dp, port, num_queues);
-        if (error) {
-            ofp_fatal(error, "failed to add port %s", port);
+        dp_add_port_later(dp, port, num_queues);
+    }
+}
+
+/* Applies the settings from the command line that every datapath in this
+ * process shares to 'dp'. */
+static void
+configure_datapath(struct datapath *dp)
+{
+    dp->tx_ring_frames = tx_ring_frames;
+    dp->rx_ring_frames = rx_ring_frames;
+    dp->busy_poll_usecs = busy_poll_msec ? DP_BUSY_POLL_USECS : 0;
+    dp->rx_budget = rx_budget;
+    dp->msg_budget = msg_budget;
+    dp->use_shaper = use_shaper;
+    dp->bundle_flow_removed = bundle_flow_removed;
+    dp->chain->evict_batch = evict_batch;
+    if (hold_misses_msec) {
+        dp->pending_misses = pending_misses_create(hold_misses_msec);
+    }
+    dp->pin_rate = pin_rate;
+    dp->pin_burst = pin_burst ? pin_burst : MAX(pin_rate / 4, 1);
+    dp->adaptive_miss_len = adaptive_miss_len;
+}
+
+/* Creates the datapath that 'xdp' describes, alongside 'dp', and adds it to
+ * 'dps'.  Returns 0 if successful, otherwise -1 (if running as a library;
+ * otherwise, failure is fatal). */
+static int
+start_extra_datapath(const struct extra_datapath *xdp)
+{
+    struct datapath *extra;
+    size_t n_listeners;
+    size_t i;
+    int error;
+
+    error = dp_new(&extra, xdp->dpid, tables, n_buffers);
+    if (error) {
+        OFP_FATAL(error, "could not create datapath");
+    }
+    configure_datapath(extra);
+    error = dp_share_buffers(extra, dp);
+    if (error) {
+        OFP_FATAL(error, "could not share packet buffers");
+    }
+
+    n_listeners = 0;
+    for (i = 0; i < xdp->listeners.n; i++) {
+        const char *pvconn_name = xdp->listeners.names[i];
+        struct pvconn *pvconn;
+        int retval;
+
+        retval = pvconn_open(pvconn_name, &pvconn);
+        if (!retval || retval == EAGAIN) {
+            dp_add_pvconn(extra, pvconn);
+            n_listeners++;
+        } else {
+            ofp_error(retval, "opening %s", pvconn_name);
+        }
+    }
+    if (!n_listeners) {
+        OFP_FATAL(0, "datapath %012"PRIx64" could not listen for any "
+                  "connections", extra->id);
+    }
+    if (xdp->port_list) {
+        add_ports(extra, xdp->port_list);
+    }
+
+    dps[n_dps++] = extra;
+    VLOG_INFO("datapath %012"PRIx64" added", extra->id);
+    return 0;
+}
+
+/* Restricts the calling thread to run only on 'cpu'. */
+static void
+pin_to_cpu(int cpu)
+{
+    cpu_set_t cpus;
+
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu, &cpus);
+    if (sched_setaffinity(0, sizeof cpus, &cpus)) {
+        VLOG_WARN("could not pin forwarding thread to CPU %d (%s)",
+                  cpu, strerror(errno));
+    } else {
+        VLOG_INFO("forwarding thread pinned to CPU %d", cpu);
+    }
+}
+
+/* Receives and forwards packets from every datapath's ports in a tight loop,
+ * without ever sleeping, for --busy-poll's interval.  The caller services
+ * timers and OpenFlow connections in between calls, so their latency is
+ * bounded by the interval while packets never wait for the scheduler to wake
+ * us. */
+static void
+busy_poll(void)
+{
+    long long int deadline;
+    size_t i;
+
+    time_refresh();
+    deadline = time_msec() + busy_poll_msec;
+    do {
+        for (i = 0; i < n_dps; i++) {
+            dp_poll_ports(dps[i]);
         }
+        time_refresh();
+    } while (time_msec() < deadline);
+}
+
+/* Parses 's' as the argument to an option that gives a datapath ID, and
+ * returns the ID. */
+static uint64_t
+parse_datapath_id(const char *s)
+{
+    uint64_t id;
+
+    if (strlen(s) != 12 || strspn(s, "0123456789abcdefABCDEF") != 12) {
+        ofp_fatal(0, "argument to -d or --datapath-id must be "
+                  "exactly 12 hex digits");
+    }
+    id = strtoll(s, NULL, 16);
+    if (!id) {
+        ofp_fatal(0, "argument to -d or --datapath-id must be nonzero");
+    }
+    return id;
+}
+
+/* Parses 'args', the argument to --datapath, and adds the datapath that it
+ * describes to 'extra_dps'. */
+static void
+parse_extra_datapath(const char *args)
+{
+    struct extra_datapath *xdp;
+    struct svec words;
+    size_t i;
+
+    extra_dps = xrealloc(extra_dps, (n_extra_dps + 1) * sizeof *extra_dps);
+    xdp = &extra_dps[n_extra_dps++];
+    xdp->dpid = UINT64_MAX;
+    xdp->port_list = NULL;
+    svec_init(&xdp->listeners);
+
+    svec_init(&words);
+    svec_parse_words(&words, args);
+    for (i = 0; i < words.n; i++) {
+        const char *word = words.names[i];
+
+        if (!strcmp(word, "-d") || !strcmp(word, "-i")) {
+            if (i + 1 >= words.n) {
+                ofp_fatal(0, "--datapath: %s requires an argument", word);
+            }
+            if (word[1] == 'd') {
+                xdp->dpid = parse_datapath_id(words.names[++i]);
+            } else {
+                free(xdp->port_list);
+                xdp->port_list = xstrdup(words.names[++i]);
+            }
+        } else if (word[0] == '-') {
+            ofp_fatal(0, "--datapath: unknown option %s", word);
+        } else {
+            svec_add(&xdp->listeners, word);
+        }
+    }
+    svec_destroy(&words);
+
+    if (!xdp->listeners.n) {
+        ofp_fatal(0, "--datapath requires at least one listener argument");
     }
 }
 
@@ -193,8 +621,36 @@ parse_options(int argc, char *argv[])
 	OPT_DP_DESC,
         OPT_SERIAL_NUM,
         OPT_BOOTSTRAP_CA_CERT,
+        OPT_SSL_HANDSHAKE_THREADS,
         OPT_NO_LOCAL_PORT,
-        OPT_NO_SLICING
+        OPT_NO_SLICING,
+        OPT_TX_RING,
+        OPT_RX_RING,
+        OPT_SHAPER,
+        OPT_RX_THREADS,
+        OPT_BUSY_POLL,
+        OPT_RX_BUDGET,
+        OPT_DATAPATH,
+        OPT_MSG_BUDGET,
+        OPT_CPU,
+        OPT_HUGEPAGES,
+        OPT_TABLES,
+        OPT_TABLES_FILE,
+        OPT_BUFFERS,
+        OPT_BUNDLE_FLOW_REMOVED,
+        OPT_EVICT,
+        OPT_HOLD_MISSES,
+        OPT_PACKET_IN_RATE,
+        OPT_PACKET_IN_BURST,
+        OPT_ADAPTIVE_MISS_LEN,
+        OPT_SFLOW,
+        OPT_SFLOW_RATE,
+        OPT_FLOW_SNAPSHOT,
+        OPT_TOP_FLOWS,
+        OPT_TOP_FLOWS_WINDOW,
+        OPT_SECCHAN,
+        METRICS_OPTION_ENUMS,
+        STATS_FILE_OPTION_ENUMS
     };
 
     static struct option long_options[] = {
@@ -202,19 +658,50 @@ parse_options(int argc, char *argv[])
         {"local-port",  required_argument, 0, 'L'},
         {"no-local-port", no_argument, 0, OPT_NO_LOCAL_PORT},
         {"datapath-id", required_argument, 0, 'd'},
+        {"datapath",    required_argument, 0, OPT_DATAPATH},
         {"verbose",     optional_argument, 0, 'v'},
         {"help",        no_argument, 0, 'h'},
         {"version",     no_argument, 0, 'V'},
         {"no-slicing",  no_argument, 0, OPT_NO_SLICING},
+        {"tx-ring",     required_argument, 0, OPT_TX_RING},
+        {"rx-ring",     required_argument, 0, OPT_RX_RING},
+        {"shaper",      no_argument, 0, OPT_SHAPER},
+        {"rx-threads",  required_argument, 0, OPT_RX_THREADS},
+        {"busy-poll",   optional_argument, 0, OPT_BUSY_POLL},
+        {"rx-budget",   required_argument, 0, OPT_RX_BUDGET},
+        {"msg-budget",  required_argument, 0, OPT_MSG_BUDGET},
+        {"cpu",         required_argument, 0, OPT_CPU},
+        {"hugepages",   no_argument, 0, OPT_HUGEPAGES},
+        {"tables",      required_argument, 0, OPT_TABLES},
+        {"tables-file", required_argument, 0, OPT_TABLES_FILE},
+        {"buffers",     required_argument, 0, OPT_BUFFERS},
+        {"bundle-flow-removed", no_argument, 0, OPT_BUNDLE_FLOW_REMOVED},
+        {"evict",       optional_argument, 0, OPT_EVICT},
+        {"hold-misses", optional_argument, 0, OPT_HOLD_MISSES},
+        {"packet-in-rate", required_argument, 0, OPT_PACKET_IN_RATE},
+        {"packet-in-burst", required_argument, 0, OPT_PACKET_IN_BURST},
+        {"adaptive-miss-len", no_argument, 0, OPT_ADAPTIVE_MISS_LEN},
+        {"sflow",       required_argument, 0, OPT_SFLOW},
+        {"sflow-rate",  required_argument, 0, OPT_SFLOW_RATE},
+        {"flow-snapshot", required_argument, 0, OPT_FLOW_SNAPSHOT},
+        {"top-flows",   required_argument, 0, OPT_TOP_FLOWS},
+        {"top-flows-window", required_argument, 0, OPT_TOP_FLOWS_WINDOW},
+#if !defined(UDATAPATH_AS_LIB)
+        {"secchan",     required_argument, 0, OPT_SECCHAN},
+#endif
         {"mfr-desc",    required_argument, 0, OPT_MFR_DESC},
         {"hw-desc",     required_argument, 0, OPT_HW_DESC},
         {"sw-desc",     required_argument, 0, OPT_SW_DESC},
         {"dp_desc",  required_argument, 0, OPT_DP_DESC},
         {"serial_num",  required_argument, 0, OPT_SERIAL_NUM},
         DAEMON_LONG_OPTIONS,
+        METRICS_LONG_OPTIONS,
+        STATS_FILE_LONG_OPTIONS,
 #ifdef HAVE_OPENSSL
         VCONN_SSL_LONG_OPTIONS
         {"bootstrap-ca-cert", required_argument, 0, OPT_BOOTSTRAP_CA_CERT},
+        {"ssl-handshake-threads", required_argument, 0,
+         OPT_SSL_HANDSHAKE_THREADS},
 #endif
         {0, 0, 0, 0},
     };
@@ -231,16 +718,11 @@ parse_options(int argc, char *argv[])
 
         switch (c) {
         case 'd':
-            if (strlen(optarg) != 12
-                || strspn(optarg, "0123456789abcdefABCDEF") != 12) {
-                ofp_fatal(0, "argument to -d or --datapath-id must be "
-                          "exactly 12 hex digits");
-            }
-            dpid = strtoll(optarg, NULL, 16);
-            if (!dpid) {
-                ofp_fatal(0, "argument to -d or --datapath-id must "
-                          "be nonzero");
-            }
+            dpid = parse_datapath_id(optarg);
+            break;
+
+        case OPT_DATAPATH:
+            parse_extra_datapath(optarg);
             break;
 
         case 'h':
@@ -295,14 +777,203 @@ parse_options(int argc, char *argv[])
             num_queues = 0;
             break;
 
+        case OPT_TX_RING: {
+            int n_frames = atoi(optarg);
+            if (n_frames <= 0) {
+                ofp_fatal(0, "argument to --tx-ring must be positive");
+            }
+            tx_ring_frames = n_frames;
+            break;
+        }
+
+        case OPT_RX_RING: {
+            int n_frames = atoi(optarg);
+            if (n_frames <= 0) {
+                ofp_fatal(0, "argument to --rx-ring must be positive");
+            }
+            rx_ring_frames = n_frames;
+            break;
+        }
+
+        case OPT_SHAPER:
+            use_shaper = true;
+            break;
+
+        case OPT_BUNDLE_FLOW_REMOVED:
+            bundle_flow_removed = true;
+            break;
+
+        case OPT_EVICT: {
+            int n = optarg ? atoi(optarg) : CHAIN_EVICT_BATCH;
+            if (n <= 0) {
+                ofp_fatal(0, "argument to --evict must be positive");
+            }
+            evict_batch = n;
+            break;
+        }
+
+        case OPT_HOLD_MISSES: {
+            int msec = optarg ? atoi(optarg) : PENDING_MISS_DEFAULT_MSEC;
+            if (msec <= 0 || msec > PENDING_MISS_MAX_MSEC) {
+                ofp_fatal(0, "argument to --hold-misses must be between 1 "
+                          "and %d", PENDING_MISS_MAX_MSEC);
+            }
+            hold_misses_msec = msec;
+            break;
+        }
+
+        case OPT_PACKET_IN_RATE: {
+            int rate = atoi(optarg);
+            if (rate < 1 || rate > 1000000) {
+                ofp_fatal(0, "argument to --packet-in-rate must be between 1 "
+                          "and 1000000");
+            }
+            pin_rate = rate;
+            break;
+        }
+
+        case OPT_PACKET_IN_BURST: {
+            int burst = atoi(optarg);
+            if (burst < 1 || burst > 1000000) {
+                ofp_fatal(0, "argument to --packet-in-burst must be between "
+                          "1 and 1000000");
+            }
+            pin_burst = burst;
+            break;
+        }
+
+        case OPT_ADAPTIVE_MISS_LEN:
+            adaptive_miss_len = true;
+            break;
+
+        case OPT_SFLOW:
+            sflow_collector = optarg;
+            break;
+
+        case OPT_SFLOW_RATE: {
+            int rate = atoi(optarg);
+            if (rate <= 0 || rate > INT_MAX / 2) {
+                ofp_fatal(0, "argument to --sflow-rate must be between 1 "
+                          "and %d", INT_MAX / 2);
+            }
+            sflow_rate = rate;
+            break;
+        }
+
+        case OPT_FLOW_SNAPSHOT:
+            snapshot_file = optarg;
+            break;
+
+        case OPT_TOP_FLOWS: {
+            int n = atoi(optarg);
+            if (n <= 0 || n > TOPK_MAX_FLOWS) {
+                ofp_fatal(0, "argument to --top-flows must be between 1 "
+                          "and %d", TOPK_MAX_FLOWS);
+            }
+            top_flows = n;
+            break;
+        }
+
+        case OPT_TOP_FLOWS_WINDOW: {
+            int secs = atoi(optarg);
+            if (secs <= 0 || secs > 3600) {
+                ofp_fatal(0, "argument to --top-flows-window must be "
+                          "between 1 and 3600");
+            }
+            top_flows_window = secs;
+            break;
+        }
+
+#if !defined(UDATAPATH_AS_LIB)
+        case OPT_SECCHAN:
+            secchan_args = optarg;
+            break;
+#endif
+
+        case OPT_RX_THREADS:
+            n_rx_threads = atoi(optarg);
+            if (n_rx_threads <= 0) {
+                ofp_fatal(0, "argument to --rx-threads must be positive");
+            }
+            break;
+
+        case OPT_BUSY_POLL:
+            busy_poll_msec = optarg ? atoi(optarg) : 1;
+            if (busy_poll_msec <= 0) {
+                ofp_fatal(0, "argument to --busy-poll must be positive");
+            }
+            break;
+
+        case OPT_RX_BUDGET: {
+            int n = atoi(optarg);
+            if (n <= 0 || n > INT_MAX / DP_MAX_WEIGHT) {
+                ofp_fatal(0, "argument to --rx-budget must be positive");
+            }
+            rx_budget = n;
+            break;
+        }
+
+        case OPT_MSG_BUDGET: {
+            int n = atoi(optarg);
+            if (n <= 0 || n > INT_MAX / DP_MAX_WEIGHT) {
+                ofp_fatal(0, "argument to --msg-budget must be positive");
+            }
+            msg_budget = n;
+            break;
+        }
+
+        case OPT_CPU:
+            forwarding_cpu = atoi(optarg);
+            if (forwarding_cpu < 0 || forwarding_cpu >= CPU_SETSIZE) {
+                ofp_fatal(0, "argument to --cpu must be between 0 and %d",
+                          CPU_SETSIZE - 1);
+            }
+            break;
+
+        case OPT_HUGEPAGES:
+            use_hugepages = true;
+            break;
+
+        case OPT_TABLES:
+            tables = optarg;
+            break;
+
+        case OPT_BUFFERS: {
+            int n = atoi(optarg);
+            if (n <= 0 || (unsigned int) n > PKTBUF_MAX_BUFFERS) {
+                ofp_fatal(0, "argument to --buffers must be between 1 and %u",
+                          PKTBUF_MAX_BUFFERS);
+            }
+            n_buffers = n;
+            break;
+        }
+
+        case OPT_TABLES_FILE:
+            tables = read_tables_file(optarg);
+            break;
+
         DAEMON_OPTION_HANDLERS
 
+        METRICS_OPTION_HANDLERS
+
+        STATS_FILE_OPTION_HANDLERS
+
 #ifdef HAVE_OPENSSL
         VCONN_SSL_OPTION_HANDLERS
 
         case OPT_BOOTSTRAP_CA_CERT:
             vconn_ssl_set_ca_cert_file(optarg, true);
             break;
+
+        case OPT_SSL_HANDSHAKE_THREADS: {
+            int n = atoi(optarg);
+            if (n < 1 || n > 1024) {
+                ofp_fatal(0, "argument to --ssl-handshake-threads must be "
+                          "between 1 and 1024");
+            }
+            vconn_ssl_set_handshake_threads(n);
+            break;
+        }
 #endif
 
         case '?':
@@ -315,6 +986,57 @@ parse_options(int argc, char *argv[])
     free(short_options);
 }
 
+/* Reads the flow table specifications in 'file_name', one per line, and
+ * returns them as a comma-separated list suitable for chain_create().  Blank
+ * lines and text following '#' are ignored. */
+static char *
+read_tables_file(const char *file_name)
+{
+    struct svec specs;
+    struct ds line;
+    char *result;
+    FILE *file;
+
+    file = fopen(file_name, "r");
+    if (!file) {
+        ofp_fatal(errno, "could not open %s", file_name);
+    }
+
+    svec_init(&specs);
+    ds_init(&line);
+    while (!ds_get_line(&line, file)) {
+        char *s = ds_cstr(&line);
+        char *comment = strchr(s, '#');
+        size_t n;
+
+        if (comment) {
+            *comment = '\0';
+        }
+        s += strspn(s, " \t\r");
+        n = strcspn(s, " \t\r");
+        if (s[n + strspn(s + n, " \t\r")] != '\0') {
+            ofp_fatal(0, "%s: \"%s\": one table per line expected",
+                      file_name, s);
+        }
+        s[n] = '\0';
+        if (*s) {
+            svec_add(&specs, s);
+        }
+    }
+    if (ferror(file)) {
+        ofp_fatal(errno, "error reading %s", file_name);
+    }
+    fclose(file);
+    ds_destroy(&line);
+
+    if (!specs.n) {
+        ofp_fatal(0, "%s: no flow tables specified", file_name);
+    }
+    result = svec_join(&specs, ",");
+    svec_destroy(&specs);
+    return result;
+}
+
 static void
 usage(void)
 {
@@ -324,15 +1046,68 @@ usage(void)
        "to listen for incoming connections from the secure channel.\n",
            program_name, program_name);
     vconn_usage(false, true, false);
+#ifdef HAVE_OPENSSL
+    printf("  --ssl-handshake-threads=N\n"
+           "                          run up to N SSL handshakes at once,\n"
+           "                          each in a thread of its own\n");
+#endif
     printf("\nConfiguration options:\n"
            "  -i, --interfaces=NETDEV[,NETDEV]...\n"
            "                          add specified initial switch ports\n"
            "  -L, --local-port=NETDEV set network device for local port\n"
+           "                          (tap:[NAME][/QUEUES] creates a TAP)\n"
            "  --no-local-port         disable local port\n"
            "  -d, --datapath-id=ID    Use ID as the OpenFlow switch ID\n"
            "                          (ID must consist of 12 hex digits)\n"
+           "  --datapath=\"[-d ID] [-i NETDEV[,NETDEV]...] LISTEN...\"\n"
+           "                          also run another switch in this process\n"
            "  --no-slicing            disable slicing\n"
-           "\nOther options:\n"
+           "  --tx-ring=FRAMES        queue transmitted packets in a\n"
+           "                          memory-mapped ring of FRAMES frames\n"
+           "  --rx-ring=FRAMES        receive packets through a\n"
+           "                          memory-mapped ring of FRAMES frames\n"
+           "  --shaper                shape queues in userspace, not with tc\n"
+           "  --rx-threads=N          receive packets on N threads\n"
+           "  --busy-poll[=MSEC]      spin on the ports instead of sleeping,\n"
+           "                          servicing connections every MSEC ms\n"
+           "  --cpu=CPU               pin the forwarding thread to CPU\n"
+           "  --hugepages             put flow tables and receive buffers in\n"
+           "                          huge pages on the forwarding CPU's node\n"
+           "  --rx-budget=N           receive up to N packets per port per\n"
+           "                          pass (default: %d)\n"
+           "  --msg-budget=N          process up to N OpenFlow messages per\n"
+           "                          connection per pass (default: %d)\n"
+           "  --tables=TABLE[,TABLE]...\n"
+           "                          search the given flow tables, in order\n"
+           "  --tables-file=FILE      read --tables settings from FILE\n"
+           "  --buffers=N             buffer up to N packets for the controller\n"
+           "  --bundle-flow-removed   pack flow expirations into bundles\n"
+           "  --evict[=N]             make room in full tables by evicting\n"
+           "                          N least recently used flows at a time\n"
+           "                          (default: %d)\n"
+           "  --hold-misses[=MSEC]    hold later misses for a flow up to MSEC\n"
+           "                          ms behind the first (default: %d)\n"
+           "  --packet-in-rate=N      send at most N packet_ins per second\n"
+           "                          for each reason and port\n"
+           "  --packet-in-burst=N     allow bursts of N packet_ins\n"
+           "                          (default: a quarter of the rate)\n"
+           "  --adaptive-miss-len     send less of each missed packet while\n"
+           "                          the controller connection is congested\n"
+           "  --sflow=HOST[:PORT]     send sampled packets to sFlow collector\n"
+           "  --sflow-rate=N          sample 1 in N packets (default: %d)\n"
+           "  --flow-snapshot=FILE    restore flows from FILE at startup and\n"
+           "                          save them there on SIGTERM or SIGUSR1\n"
+           "  --top-flows=N           track the N heaviest flows\n"
+           "  --top-flows-window=SECS count them over SECS seconds\n"
+           "                          (default: %d)\n"
+           "  --secchan=\"ARGS\"       run the secure channel in this process,\n"
+           "                          with ofprotocol ARGS minus DATAPATH\n",
+           DP_DEFAULT_RX_BUDGET, DP_DEFAULT_MSG_BUDGET,
+           CHAIN_EVICT_BATCH, PENDING_MISS_DEFAULT_MSEC, SAMPLER_DEFAULT_RATE,
+           TOPK_DEFAULT_WINDOW);
+    metrics_usage();
+    stats_file_usage();
+    printf("\nOther options:\n"
            "  -D, --detach            run in background as daemon\n"
            "  -P, --pidfile[=FILE]    create pidfile (default: %s/ofdatapath.pid)\n"
            "  -f, --force             with -P, start even if already running\n"
@@ -340,6 +1115,6 @@ usage(void)
            "  -v, --verbose           set maximum verbosity level\n"
            "  -h, --help              display this help message\n"
            "  -V, --version           display version information\n",
-        ofp_rundir);
+           ofp_rundir);
     exit(EXIT_SUCCESS);
 }
@@ -2,7 +2,8 @@ bin_PROGRAMS += \
 	utilities/vlogconf \
 	utilities/dpctl \
 	utilities/ofp-discover \
-	utilities/ofp-kill
+	utilities/ofp-kill \
+	utilities/ofp-pktgen
 bin_SCRIPTS += utilities/ofp-pki
 noinst_SCRIPTS += utilities/ofp-pki-cgi utilities/ofp-parse-leaks
 
@@ -11,6 +12,7 @@ EXTRA_DIST += \
 	utilities/ofp-discover.8.in \
 	utilities/ofp-kill.8.in \
 	utilities/ofp-parse-leaks.in \
+	utilities/ofp-pktgen.8.in \
 	utilities/ofp-pki-cgi.in \
 	utilities/ofp-pki.8.in \
 	utilities/ofp-pki.in \
@@ -20,6 +22,7 @@ DISTCLEANFILES += \
 	utilities/ofp-discover.8 \
 	utilities/ofp-kill.8 \
 	utilities/ofp-parse-leaks \
+	utilities/ofp-pktgen.8 \
 	utilities/ofp-pki \
 	utilities/ofp-pki.8 \
 	utilities/ofp-pki-cgi \
@@ -29,11 +32,13 @@ man_MANS += \
 	utilities/dpctl.8 \
 	utilities/ofp-discover.8 \
 	utilities/ofp-kill.8 \
+	utilities/ofp-pktgen.8 \
 	utilities/ofp-pki.8 \
 	utilities/vlogconf.8
 
 utilities_dpctl_SOURCES = utilities/dpctl.c
-utilities_dpctl_LDADD = lib/libopenflow.a $(FAULT_LIBS) $(SSL_LIBS)
+utilities_dpctl_LDADD = lib/libopenflow.a $(FAULT_LIBS) $(SSL_LIBS) \
+	$(PTHREAD_LIBS)
 
 utilities_vlogconf_SOURCES = utilities/vlogconf.c
 utilities_vlogconf_LDADD = lib/libopenflow.a
@@ -43,3 +48,6 @@ utilities_ofp_discover_LDADD = lib/libopenflow.a
 
 utilities_ofp_kill_SOURCES = utilities/ofp-kill.c
 utilities_ofp_kill_LDADD = lib/libopenflow.a
+
+utilities_ofp_pktgen_SOURCES = utilities/ofp-pktgen.c
+utilities_ofp_pktgen_LDADD = lib/libopenflow.a -lm
@@ -33,16 +33,20 @@
 
 #include <config.h>
 #include <arpa/inet.h>
+#include <ctype.h>
 #include <errno.h>
 #include <getopt.h>
 #include <inttypes.h>
 #include <netinet/in.h>
+#include <poll.h>
 #include <signal.h>
 #include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <sys/socket.h>
 #include <sys/time.h>
+#include <sys/wait.h>
 
 #ifdef HAVE_NETLINK
 #include "netdev.h"
@@ -52,15 +56,26 @@
 
 #include "command-line.h"
 #include "compiler.h"
+#include "csum.h"
 #include "dpif.h"
+#include "dynamic-string.h"
+#include "flow.h"
+#include "flow-file.h"
 #include "openflow/nicira-ext.h"
 #include "openflow/openflow-ext.h"
+#include "ofp-parse.h"
 #include "ofp-print.h"
 #include "ofpbuf.h"
 #include "openflow/openflow.h"
 #include "packets.h"
+#include "pcap.h"
+#include "poll-loop.h"
+#include "process.h"
 #include "random.h"
+#include "rconn.h"
 #include "socket-util.h"
+#include "stats-file.h"
+#include "svec.h"
 #include "timeval.h"
 #include "util.h"
 #include "vconn-ssl.h"
@@ -73,8 +88,6 @@
 #include "vlog.h"
 #define THIS_MODULE VLM_dpctl
 
-#define DEFAULT_IDLE_TIMEOUT 60
-
 /* Maximum size of action buffer for adding and modify flows */
 #define MAX_ACT_LEN 60
 
@@ -85,8 +98,66 @@
 
 
 /* Settings that may be configured by the user. */
+/* Most targets that a command given several targets runs on at once. */
+#define MAX_PARALLEL_TARGETS 256
+
+/* Fields that dump-flows can print in CSV or JSON format, in their default
+ * order.  A field whose value is a string is quoted. */
+#define FLOW_FIELDS                                                     \
+    FLOW_FIELD(COOKIE,       "cookie",       false, 0)                  \
+    FLOW_FIELD(DURATION,     "duration",     false, 0)                  \
+    FLOW_FIELD(TABLE_ID,     "table_id",     false, 0)                  \
+    FLOW_FIELD(PRIORITY,     "priority",     false, 0)                  \
+    FLOW_FIELD(N_PACKETS,    "n_packets",    false, 0)                  \
+    FLOW_FIELD(N_BYTES,      "n_bytes",      false, 0)                  \
+    FLOW_FIELD(IDLE_TIMEOUT, "idle_timeout", false, 0)                  \
+    FLOW_FIELD(HARD_TIMEOUT, "hard_timeout", false, 0)                  \
+    FLOW_FIELD(IN_PORT,      "in_port",      false, OFPFW_IN_PORT)      \
+    FLOW_FIELD(DL_VLAN,      "dl_vlan",      false, OFPFW_DL_VLAN)      \
+    FLOW_FIELD(DL_VLAN_PCP,  "dl_vlan_pcp",  false, OFPFW_DL_VLAN_PCP)  \
+    FLOW_FIELD(DL_SRC,       "dl_src",       true,  OFPFW_DL_SRC)       \
+    FLOW_FIELD(DL_DST,       "dl_dst",       true,  OFPFW_DL_DST)       \
+    FLOW_FIELD(DL_TYPE,      "dl_type",      true,  OFPFW_DL_TYPE)      \
+    FLOW_FIELD(NW_SRC,       "nw_src",       true,  0)                  \
+    FLOW_FIELD(NW_DST,       "nw_dst",       true,  0)                  \
+    FLOW_FIELD(NW_TOS,       "nw_tos",       false, OFPFW_NW_TOS)       \
+    FLOW_FIELD(NW_PROTO,     "nw_proto",     false, OFPFW_NW_PROTO)     \
+    FLOW_FIELD(TP_SRC,       "tp_src",       false, OFPFW_TP_SRC)       \
+    FLOW_FIELD(TP_DST,       "tp_dst",       false, OFPFW_TP_DST)       \
+    FLOW_FIELD(ACTIONS,      "actions",      true,  0)
+
+enum flow_field {
+#define FLOW_FIELD(ENUM, NAME, IS_STRING, WILDCARD) FF_##ENUM,
+    FLOW_FIELDS
+#undef FLOW_FIELD
+    N_FLOW_FIELDS
+};
+
+/* Output format for dump-flows. */
+enum dump_format {
+    DUMP_TEXT,                  /* ofp_print() output. */
+    DUMP_CSV,                   /* Comma-separated values with a header. */
+    DUMP_JSON                   /* One JSON object per line. */
+};
+
 struct settings {
     bool strict;        /* Use strict matching for flow mod commands */
+    unsigned int timeout;       /* Seconds before giving up, 0 for never. */
+    uint8_t pipeline_table;     /* Pipeline table for flow commands. */
+
+    /* dump-flows output. */
+    enum dump_format format;
+    enum flow_field fields[N_FLOW_FIELDS]; /* Fields to print, in order. */
+    size_t n_fields;
+
+    /* monitor: asynchronous messages to ask for, or null for all. */
+    const char *async;
+
+    /* monitor: bits for the OFPT_* types to output, and where. */
+    uint32_t monitor_types;
+    const char *pcap_file;      /* pcap file to write, or null to print. */
+    off_t pcap_size;            /* Bytes per pcap file, 0 for no limit. */
+    unsigned int pcap_files;    /* pcap files to keep, including the last. */
 };
 
 struct command {
@@ -100,6 +171,15 @@ static struct command all_commands[];
 
 static void usage(void) NO_RETURN;
 static void parse_options(int argc, char *argv[], struct settings *);
+static bool command_takes_switch(const struct command *);
+static void parse_flow_fields(const char *, struct settings *);
+static uint32_t parse_monitor_types(const char *);
+static bool parse_targets(const char *, struct svec *);
+static void run_command(const struct command *, const struct settings *,
+                        int argc, char *argv[]) NO_RETURN;
+static void run_on_targets(const struct command *, const struct settings *,
+                           int argc, char *argv[], const struct svec *)
+    NO_RETURN;
 
 int main(int argc, char *argv[])
 {
@@ -127,14 +207,14 @@ int main(int argc, char *argv[])
                 ofp_fatal(0, "'%s' command takes at most %d arguments",
                           p->name, p->max_args);
             else {
-                p->handler(&s, argc, argv);
-                if (ferror(stdout)) {
-                    ofp_fatal(0, "write to stdout failed");
-                }
-                if (ferror(stderr)) {
-                    ofp_fatal(0, "write to stderr failed");
+                struct svec targets;
+
+                svec_init(&targets);
+                if (n_arg > 0 && command_takes_switch(p)
+                    && parse_targets(argv[1], &targets)) {
+                    run_on_targets(p, &s, argc, argv, &targets);
                 }
-                exit(0);
+                run_command(p, &s, argc, argv);
             }
         }
     }
@@ -143,16 +223,236 @@ int main(int argc, char *argv[])
     return 0;
 }
 
+static void
+run_command(const struct command *p, const struct settings *s,
+            int argc, char *argv[])
+{
+    p->handler(s, argc, argv);
+    if (ferror(stdout)) {
+        ofp_fatal(0, "write to stdout failed");
+    }
+    if (ferror(stderr)) {
+        ofp_fatal(0, "write to stderr failed");
+    }
+    exit(0);
+}
+
+/* If 'arg' names more than one target, that is, if it is a comma-separated
+ * list of targets or "@FILE" for a file that lists one target per line, adds
+ * each of them to 'targets' and returns true.  Otherwise, returns false. */
+static bool
+parse_targets(const char *arg, struct svec *targets)
+{
+    if (arg[0] == '@') {
+        const char *file_name = arg + 1;
+        struct ds line = DS_EMPTY_INITIALIZER;
+        FILE *file;
+
+        file = fopen(file_name, "r");
+        if (!file) {
+            ofp_fatal(errno, "%s: open", file_name);
+        }
+        while (!ds_get_line(&line, file)) {
+            char *target = ds_cstr(&line);
+            char *comment = strchr(target, '#');
+            if (comment) {
+                *comment = '\0';
+            }
+            target += strspn(target, " \t");
+            target[strcspn(target, " \t\r")] = '\0';
+            if (*target) {
+                svec_add(targets, target);
+            }
+        }
+        ds_destroy(&line);
+        fclose(file);
+        if (!targets->n) {
+            ofp_fatal(0, "%s: no targets listed", file_name);
+        }
+        return true;
+    } else if (strchr(arg, ',')) {
+        char *args = xstrdup(arg);
+        char *target, *save_ptr = NULL;
+
+        for (target = strtok_r(args, ",", &save_ptr); target;
+             target = strtok_r(NULL, ",", &save_ptr)) {
+            svec_add(targets, target);
+        }
+        free(args);
+        return targets->n > 0;
+    }
+    return false;
+}
+
+/* A command running on one of several targets, in a child process. */
+struct target_child {
+    const char *name;           /* Target. */
+    pid_t pid;                  /* Child process. */
+    int fd;                     /* Child's stdout and stderr, -1 at EOF. */
+    struct ds line;             /* Incomplete last line of output. */
+};
+
+static void
+start_target(struct target_child *c, const char *name,
+             const struct command *p, const struct settings *s,
+             int argc, char *argv[])
+{
+    int fds[2];
+
+    if (pipe(fds)) {
+        ofp_fatal(errno, "pipe failed");
+    }
+    c->name = name;
+    c->pid = fork();
+    if (c->pid < 0) {
+        ofp_fatal(errno, "could not fork");
+    } else if (!c->pid) {
+        close(fds[0]);
+        dup2(fds[1], STDOUT_FILENO);
+        dup2(fds[1], STDERR_FILENO);
+        close(fds[1]);
+        setvbuf(stdout, NULL, _IOLBF, 0);
+        time_postfork();
+        time_alarm(s->timeout);
+        argv[1] = (char *) name;
+        run_command(p, s, argc, argv);
+    }
+    close(fds[1]);
+    set_nonblocking(fds[0]);
+    c->fd = fds[0];
+    ds_init(&c->line);
+}
+
+/* Copies each complete line of output that 'c' has produced to stdout,
+ * prefixed by its target's name.  Returns false when 'c' closes its output,
+ * after copying any incomplete final line, true otherwise. */
+static bool
+read_target_output(struct target_child *c)
+{
+    for (;;) {
+        char buffer[4096];
+        ssize_t n = read(c->fd, buffer, sizeof buffer);
+        if (n > 0) {
+            ssize_t i;
+
+            for (i = 0; i < n; i++) {
+                if (buffer[i] == '\n') {
+                    printf("%s: %s\n", c->name, ds_cstr(&c->line));
+                    ds_clear(&c->line);
+                } else {
+                    ds_put_char(&c->line, buffer[i]);
+                }
+            }
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0 && errno == EAGAIN) {
+            return true;
+        } else {
+            if (c->line.length) {
+                printf("%s: %s\n", c->name, ds_cstr(&c->line));
+            }
+            return false;
+        }
+    }
+}
+
+/* Runs command 'p' on each of 'targets' in parallel, each in its own child
+ * process so that failures stay separate, and copies the children's output to
+ * stdout with each line prefixed by its target.  Exits with a failure status
+ * if the command failed on any target, after listing those targets. */
+static void
+run_on_targets(const struct command *p, const struct settings *s,
+               int argc, char *argv[], const struct svec *targets)
+{
+    struct target_child *children;
+    size_t n_started, n_running, n_failed;
+    size_t i;
+
+    /* Each child enforces --timeout for itself. */
+    time_alarm(0);
+    fflush(stdout);
+    fflush(stderr);
+
+    children = xcalloc(targets->n, sizeof *children);
+    n_started = n_running = n_failed = 0;
+    while (n_started < targets->n || n_running > 0) {
+        while (n_started < targets->n && n_running < MAX_PARALLEL_TARGETS) {
+            start_target(&children[n_started], targets->names[n_started],
+                         p, s, argc, argv);
+            n_started++;
+            n_running++;
+        }
+
+        for (i = 0; i < n_started; i++) {
+            struct target_child *c = &children[i];
+            int status;
+
+            if (c->fd < 0 || read_target_output(c)) {
+                continue;
+            }
+            close(c->fd);
+            c->fd = -1;
+            n_running--;
+            while (waitpid(c->pid, &status, 0) < 0 && errno == EINTR) {
+                continue;
+            }
+            if (!WIFEXITED(status) || WEXITSTATUS(status)) {
+                char *msg = process_status_msg(status);
+                fflush(stdout);
+                fprintf(stderr, "%s: %s: failed (%s)\n",
+                        program_name, c->name, msg);
+                free(msg);
+                n_failed++;
+            }
+            ds_destroy(&c->line);
+        }
+
+        if (n_running) {
+            for (i = 0; i < n_started; i++) {
+                if (children[i].fd >= 0) {
+                    poll_fd_wait(children[i].fd, POLLIN);
+                }
+            }
+            poll_block();
+        }
+    }
+    free(children);
+
+    if (n_failed) {
+        fflush(stdout);
+        fprintf(stderr, "%s: %s failed on %zu of %zu targets\n",
+                program_name, p->name, n_failed, targets->n);
+        exit(EXIT_FAILURE);
+    }
+    exit(0);
+}
+
 static void
 parse_options(int argc, char *argv[], struct settings *s)
 {
     enum {
-        OPT_STRICT = UCHAR_MAX + 1
+        OPT_STRICT = UCHAR_MAX + 1,
+        OPT_FORMAT,
+        OPT_FIELDS,
+        OPT_ASYNC,
+        OPT_TYPES,
+        OPT_PCAP,
+        OPT_PCAP_SIZE,
+        OPT_PCAP_FILES,
+        OPT_PIPELINE_TABLE
     };
     static struct option long_options[] = {
         {"timeout", required_argument, 0, 't'},
         {"verbose", optional_argument, 0, 'v'},
         {"strict", no_argument, 0, OPT_STRICT},
+        {"format", required_argument, 0, OPT_FORMAT},
+        {"fields", required_argument, 0, OPT_FIELDS},
+        {"async", required_argument, 0, OPT_ASYNC},
+        {"types", required_argument, 0, OPT_TYPES},
+        {"pcap", required_argument, 0, OPT_PCAP},
+        {"pcap-size", required_argument, 0, OPT_PCAP_SIZE},
+        {"pcap-files", required_argument, 0, OPT_PCAP_FILES},
+        {"pipeline-table", required_argument, 0, OPT_PIPELINE_TABLE},
         {"help", no_argument, 0, 'h'},
         {"version", no_argument, 0, 'V'},
         VCONN_SSL_LONG_OPTIONS
@@ -162,9 +462,19 @@ parse_options(int argc, char *argv[], struct settings *s)
 
     /* Set defaults that we can figure out before parsing options. */
     s->strict = false;
+    s->timeout = 0;
+    s->format = DUMP_TEXT;
+    s->n_fields = 0;
+    s->async = NULL;
+    s->monitor_types = UINT32_MAX;
+    s->pcap_file = NULL;
+    s->pcap_size = (off_t) 64 << 20;
+    s->pcap_files = 4;
+    s->pipeline_table = 0;
 
     for (;;) {
         unsigned long int timeout;
+        unsigned long int value;
         int c;
 
         c = getopt_long(argc, argv, short_options, long_options, NULL);
@@ -179,6 +489,7 @@ parse_options(int argc, char *argv[], struct settings *s)
                 ofp_fatal(0, "value %s on -t or --timeout is not at least 1",
                           optarg);
             } else {
+                s->timeout = timeout;
                 time_alarm(timeout);
             }
             break;
@@ -199,6 +510,62 @@ parse_options(int argc, char *argv[], struct settings *s)
             s->strict = true;
             break;
 
+        case OPT_FORMAT:
+            if (!strcmp(optarg, "text")) {
+                s->format = DUMP_TEXT;
+            } else if (!strcmp(optarg, "csv")) {
+                s->format = DUMP_CSV;
+            } else if (!strcmp(optarg, "json")) {
+                s->format = DUMP_JSON;
+            } else {
+                ofp_fatal(0, "unknown --format %s (use text, csv, or json)",
+                          optarg);
+            }
+            break;
+
+        case OPT_FIELDS:
+            parse_flow_fields(optarg, s);
+            break;
+
+        case OPT_ASYNC:
+            s->async = optarg;
+            break;
+
+        case OPT_TYPES:
+            s->monitor_types = parse_monitor_types(optarg);
+            break;
+
+        case OPT_PCAP:
+            s->pcap_file = optarg;
+            break;
+
+        case OPT_PCAP_SIZE:
+            value = strtoul(optarg, NULL, 10);
+            if (value > 1024 * 1024) {
+                ofp_fatal(0, "--pcap-size argument must be between 0 and "
+                          "1048576 (MB)");
+            }
+            s->pcap_size = (off_t) value << 20;
+            break;
+
+        case OPT_PCAP_FILES:
+            value = strtoul(optarg, NULL, 10);
+            if (value < 1 || value > 1000) {
+                ofp_fatal(0, "--pcap-files argument must be between 1 and "
+                          "1000");
+            }
+            s->pcap_files = value;
+            break;
+
+        case OPT_PIPELINE_TABLE:
+            value = strtoul(optarg, NULL, 10);
+            if (value >= OFP_EXT_PIPELINE_TABLES) {
+                ofp_fatal(0, "--pipeline-table argument must be between 0 "
+                          "and %d", OFP_EXT_PIPELINE_TABLES - 1);
+            }
+            s->pipeline_table = value;
+            break;
+
         VCONN_SSL_OPTION_HANDLERS
 
         case '?':
@@ -209,6 +576,84 @@ parse_options(int argc, char *argv[], struct settings *s)
         }
     }
     free(short_options);
+
+    if (!s->n_fields) {
+        enum flow_field f;
+
+        for (f = 0; f < N_FLOW_FIELDS; f++) {
+            s->fields[s->n_fields++] = f;
+        }
+    } else if (s->format == DUMP_TEXT) {
+        ofp_fatal(0, "--fields requires --format=csv or --format=json");
+    }
+}
+
+static const char *flow_field_names[N_FLOW_FIELDS] = {
+#define FLOW_FIELD(ENUM, NAME, IS_STRING, WILDCARD) NAME,
+    FLOW_FIELDS
+#undef FLOW_FIELD
+};
+
+static const bool flow_field_is_string[N_FLOW_FIELDS] = {
+#define FLOW_FIELD(ENUM, NAME, IS_STRING, WILDCARD) IS_STRING,
+    FLOW_FIELDS
+#undef FLOW_FIELD
+};
+
+static const uint32_t flow_field_wildcards[N_FLOW_FIELDS] = {
+#define FLOW_FIELD(ENUM, NAME, IS_STRING, WILDCARD) WILDCARD,
+    FLOW_FIELDS
+#undef FLOW_FIELD
+};
+
+/* Parses 'list', a comma-separated list of flow field names, into the fields
+ * that dump-flows prints in 's'. */
+static void
+parse_flow_fields(const char *list, struct settings *s)
+{
+    char *copy = xstrdup(list);
+    char *name, *save_ptr = NULL;
+
+    s->n_fields = 0;
+    for (name = strtok_r(copy, ",", &save_ptr); name;
+         name = strtok_r(NULL, ",", &save_ptr)) {
+        enum flow_field f;
+
+        for (f = 0; f < N_FLOW_FIELDS; f++) {
+            if (!strcmp(name, flow_field_names[f])) {
+                break;
+            }
+        }
+        if (f >= N_FLOW_FIELDS) {
+            ofp_fatal(0, "unknown flow field %s in --fields", name);
+        } else if (s->n_fields >= N_FLOW_FIELDS) {
+            ofp_fatal(0, "too many fields in --fields");
+        }
+        s->fields[s->n_fields++] = f;
+    }
+    free(copy);
+}
+
+/* Parses 'list', a comma-separated list of OpenFlow message type names such
+ * as "packet_in,flow_removed", into a bitmap for struct settings'
+ * 'monitor_types'. */
+static uint32_t
+parse_monitor_types(const char *list)
+{
+    char *copy = xstrdup(list);
+    char *name, *save_ptr = NULL;
+    uint32_t types = 0;
+
+    for (name = strtok_r(copy, ",", &save_ptr); name;
+         name = strtok_r(NULL, ",", &save_ptr)) {
+        int type = ofp_message_type_from_string(name);
+        if (type < 0 || type >= 32) {
+            ofp_fatal(0, "unknown message type %s in --types", name);
+        }
+        types |= 1u << type;
+    }
+    free(copy);
+    return types;
 }
 
 static void
@@ -227,21 +672,45 @@ usage(void)
            "\nFor local datapaths and remote switches:\n"
            "  show SWITCH                 show basic information\n"
            "  status SWITCH [KEY]         report statistics (about KEY)\n"
+           "  stats-file FILE [KEY]       print statistics published in FILE\n"
            "  show-protostat SWITCH       report protocol statistics\n"
            "  dump-desc SWITCH            print switch description\n"
            "  dump-tables SWITCH          print table stats\n"
+           "  dump-buffers SWITCH         print packet buffer stats\n"
+           "  show-latency SWITCH         print forwarding latency histograms\n"
+           "  top-flows SWITCH [N [packets|bytes]]\n"
+           "                              print the N busiest recent flows\n"
+           "  trace SWITCH FLOW [PACKET]  show how SWITCH would look up FLOW\n"
            "  mod-port SWITCH IFACE ACT   modify port behavior\n"
            "  dump-ports SWITCH [PORT]    print port statistics\n"
+           "  dump-drops SWITCH [PORT]    print packet drops by reason\n"
            "  desc SWITCH STRING          set switch description\n"
            "  dump-flows SWITCH           print all flow entries\n"
            "  dump-flows SWITCH FLOW      print matching FLOWs\n"
            "  dump-aggregate SWITCH       print aggregate flow statistics\n"
+           "  dump-flow-deltas SWITCH GEN [FLOW]  print flows used since GEN\n"
            "  dump-aggregate SWITCH FLOW  print aggregate stats for FLOWs\n"
            "  add-flow SWITCH FLOW        add flow described by FLOW\n"
            "  add-flows SWITCH FILE       add flows from FILE\n"
+           "  replace-flows SWITCH FILE   replace all flows with those in FILE\n"
+           "  save-flows SWITCH FILE      save all flows and counters to FILE\n"
+           "  restore-flows SWITCH FILE   reinstall flows saved in FILE\n"
+           "  dump-flows-binary SWITCH FILE [FLOW]\n"
+           "                              save (matching) flows to flow FILE\n"
+           "  flows-to-binary TEXT FILE   convert TEXT flows to flow FILE\n"
+           "  binary-to-flows FILE        print flow FILE as text flows\n"
            "  mod-flows SWITCH FLOW       modify actions of matching FLOWs\n"
            "  del-flows SWITCH [FLOW]     delete matching FLOWs\n"
+           "  set-table-miss SWITCH TABLE controller|continue|drop\n"
+           "                              set pipeline TABLE's miss behavior\n"
+           "  dump-cookie SWITCH COOKIE[/MASK] [PORT]\n"
+           "                              print flows with COOKIE\n"
+           "  mod-cookie SWITCH COOKIE[/MASK] ACTIONS\n"
+           "                              set actions of flows with COOKIE\n"
+           "  del-cookie SWITCH COOKIE[/MASK] [PORT]\n"
+           "                              delete flows with COOKIE\n"
            "  monitor SWITCH              print packets received from SWITCH\n"
+           "  monitor SWITCH UDP_PORT     ...with packet-ins sent to UDP_PORT\n"
            "  execute SWITCH CMD [ARG...] execute CMD with ARGS on SWITCH\n"
            "Queue Ops:  Q: queue-id; P: port-id; BW: perthousand bandwidth\n"
            "  add-queue SWITCH P Q [BW]   add queue (with min bandwidth)\n"
@@ -251,13 +720,33 @@ usage(void)
            "\nFor local datapaths, remote switches, and controllers:\n"
            "  probe VCONN                 probe whether VCONN is up\n"
            "  ping VCONN [N]              latency of N-byte echos\n"
-           "  benchmark VCONN N COUNT     bandwidth of COUNT N-byte echos\n"
-           "where each SWITCH is an active OpenFlow connection method.\n",
+           "  benchmark VCONN N COUNT [WINDOW [CONNS]]\n"
+           "                              bandwidth of COUNT N-byte echos\n"
+           "  benchmark-flows SWITCH N FLOW [BATCH]\n"
+           "                              time adding N flows like FLOW\n"
+           "  benchmark-controller CONTROLLER [N [SECS [WINDOW]]]\n"
+           "                              emulate N switches sending "
+           "packet_ins\n"
+           "  benchmark-install SWITCH TX RX PORT [N [WINDOW]]\n"
+           "                              time until N new flows forward\n"
+           "                              probes sent on TX to PORT, RX\n"
+           "where each SWITCH is an active OpenFlow connection method.\n"
+           "SWITCH may also be a comma-separated list of them, or @FILE\n"
+           "for a file that lists one per line, to run a command on each\n"
+           "SWITCH in parallel.\n",
            program_name, program_name);
     vconn_usage(true, false, false);
     vlog_usage();
     printf("\nOther options:\n"
            "  --strict                    use strict match for flow commands\n"
+           "  --format=text|csv|json      output format for dump-flows\n"
+           "  --fields=FIELD,...          fields for dump-flows in csv or json\n"
+           "  --async=TYPE[:REASON],...   messages for monitor to ask for\n"
+           "  --types=TYPE,...            message types for monitor to output\n"
+           "  --pcap=FILE                 monitor writes messages to pcap FILE\n"
+           "  --pcap-size=MB              rotate --pcap FILE after MB (64)\n"
+           "  --pcap-files=N              keep N rotated --pcap files (4)\n"
+           "  --pipeline-table=N          apply flow commands to table N (0)\n"
            "  -t, --timeout=SECS          give up after SECS seconds\n"
            "  -h, --help                  display this help message\n"
            "  -V, --version               display version information\n");
@@ -439,14 +928,41 @@ dump_trivial_transaction(const char *vconn_name, uint8_t request_type)
     dump_transaction(vconn_name, request);
 }
 
+/* Returns a new OFP_EXT_SET_TABLE message for pipeline table 'table_id'. */
+static struct ofpbuf *
+make_set_table(uint8_t table_id)
+{
+    struct ofp_ext_set_table *ost;
+    struct ofpbuf *buffer;
+
+    ost = make_openflow(sizeof *ost, OFPT_VENDOR, &buffer);
+    ost->header.vendor = htonl(OPENFLOW_VENDOR_ID);
+    ost->header.subtype = htonl(OFP_EXT_SET_TABLE);
+    ost->table_id = table_id;
+    memset(ost->pad, 0, sizeof ost->pad);
+    return buffer;
+}
+
+/* Opens 'name' as open_vconn() does, then makes the flow_mods and flow
+ * statistics requests sent on it address the pipeline table chosen with
+ * --pipeline-table. */
 static void
-dump_stats_transaction(const char *vconn_name, struct ofpbuf *request)
+open_table_vconn(const struct settings *s, const char *name,
+                 struct vconn **vconnp)
+{
+    open_vconn(name, vconnp);
+    if (s->pipeline_table) {
+        send_openflow_buffer(*vconnp, make_set_table(s->pipeline_table));
+    }
+}
+
+/* Sends 'request', a stats request, on 'vconn' and prints the replies. */
+static void
+dump_stats_transaction__(struct vconn *vconn, struct ofpbuf *request)
 {
     uint32_t send_xid = ((struct ofp_header *) request->data)->xid;
-    struct vconn *vconn;
     bool done = false;
-    
-    open_vconn(vconn_name, &vconn);
+
     send_openflow_buffer(vconn, request);
     while (!done) {
         uint32_t recv_xid;
@@ -468,6 +984,15 @@ dump_stats_transaction(const char *vconn_name, struct ofpbuf *request)
         }
         ofpbuf_delete(reply);
     }
+}
+
+static void
+dump_stats_transaction(const char *vconn_name, struct ofpbuf *request)
+{
+    struct vconn *vconn;
+
+    open_vconn(vconn_name, &vconn);
+    dump_stats_transaction__(vconn, request);
     vconn_close(vconn);
 }
 
@@ -520,6 +1045,7 @@ do_status(const struct settings *s UNUSED, int argc, char *argv[])
     request->subtype = htonl(NXT_STATUS_REQUEST);
     if (argc > 2) {
         ofpbuf_put(b, argv[2], strlen(argv[2]));
+        update_openflow_length(b);
     }
     open_vconn(argv[1], &vconn);
     run(vconn_transact(vconn, b, &b), "talking to %s", argv[1]);
@@ -536,7 +1062,42 @@ do_status(const struct settings *s UNUSED, int argc, char *argv[])
         ofp_fatal(0, "bad reply");
     }
 
-    fwrite(reply + 1, b->size, 1, stdout);
+    fwrite(reply + 1, b->size - sizeof *reply, 1, stdout);
+}
+
+/* Prints the lines of the stats file argv[1] whose keys begin with argv[2],
+ * or all of them if there is no argv[2]. */
+static void
+do_stats_file(const struct settings *s UNUSED, int argc, char *argv[])
+{
+    const char *key = argc > 2 ? argv[2] : "";
+    struct stats_file_reader *reader;
+    const char *line, *end;
+    uint64_t update_msec;
+    struct ds text;
+    int error;
+
+    error = stats_file_open(argv[1], &reader);
+    if (error) {
+        ofp_fatal(error, "%s: could not open stats file", argv[1]);
+    }
+    ds_init(&text);
+    if (!stats_file_read(reader, &text, &update_msec)) {
+        ofp_fatal(0, "%s: writer did not finish updating", argv[1]);
+    }
+    stats_file_close(reader);
+
+    end = text.string + text.length;
+    for (line = text.string; line < end; ) {
+        const char *eol = memchr(line, '\n', end - line);
+
+        eol = eol ? eol + 1 : end;
+        if (!strncmp(line, key, strlen(key))) {
+            fwrite(line, eol - line, 1, stdout);
+        }
+        line = eol;
+    }
+    ds_destroy(&text);
 }
 
 static void
@@ -681,25 +1242,96 @@ print_protocol_stat(struct ofpstat *ofps_rcvd, struct ofpstat *ofps_sent)
     fprintf(stdout, "\n");
 }
 
+/* Prints the average of 'total_nsec' over 'n', in microseconds. */
 static void
-do_protostat(const struct settings *s UNUSED, int argc UNUSED, char *argv[])
+print_avg_usec(uint64_t total_nsec, uint64_t n)
+{
+    printf("%.1f us", n ? total_nsec / 1000.0 / n : 0.0);
+}
+
+static void
+print_processing_stat(const struct private_proc_stats *pps)
+{
+    double secs = ntohll(pps->duration_msec) / 1000.0;
+    int i, j;
+
+    printf("Message processing (over %.3f s):\n", secs);
+    for (i = 0; i < PRIVATE_PROC_N_TYPES; i++) {
+        const struct private_proc_type *t = &pps->types[i];
+        uint64_t n = ntohll(t->n_msgs);
+        char *name;
+
+        if (!n) {
+            continue;
+        }
+        name = ofp_message_type_to_string(i);
+        printf(PREFIX_STR "%s: %"PRIu64" msgs (%.1f/s), avg ", name, n,
+               secs > 0 ? n / secs : 0.0);
+        free(name);
+        print_avg_usec(ntohll(t->total_nsec), n);
+        printf(", max %.1f us\n", ntohll(t->max_nsec) / 1000.0);
+        printf(PREFIX_STR "   ");
+        for (j = 0; j < PRIVATE_PROC_BUCKETS; j++) {
+            uint64_t count = ntohll(t->buckets[j]);
+
+            if (!count) {
+                continue;
+            } else if (!j) {
+                printf(" <1us:%"PRIu64, count);
+            } else if (j == PRIVATE_PROC_BUCKETS - 1) {
+                printf(" >=%dus:%"PRIu64, 1 << (j - 1), count);
+            } else {
+                printf(" %d-%dus:%"PRIu64, 1 << (j - 1), 1 << j, count);
+            }
+        }
+        printf("\n");
+    }
+    printf("\n");
+
+    printf("Flow add and modify time by flows in tables:\n");
+    for (i = 0; i < PRIVATE_PROC_SIZES; i++) {
+        const struct private_proc_size *size = &pps->sizes[i];
+        uint64_t n_adds = ntohll(size->n_adds);
+        uint64_t n_mods = ntohll(size->n_mods);
+
+        if (!n_adds && !n_mods) {
+            continue;
+        } else if (i <= 1) {
+            printf(PREFIX_STR "%d flow%s: ", i, i ? "" : "s");
+        } else if (i == PRIVATE_PROC_SIZES - 1) {
+            printf(PREFIX_STR ">=%u flows: ", 1u << (i - 1));
+        } else {
+            printf(PREFIX_STR "%u-%u flows: ", 1u << (i - 1), (1u << i) - 1);
+        }
+        printf("%"PRIu64" add, avg ", n_adds);
+        print_avg_usec(ntohll(size->add_nsec), n_adds);
+        printf("; %"PRIu64" modify, avg ", n_mods);
+        print_avg_usec(ntohll(size->mod_nsec), n_mods);
+        printf("\n");
+    }
+    printf("\n");
+}
+
+/* Sends a PRIVATE_VENDOR_ID request with option 'type' on 'vconn' and
+ * returns the value of the reply's option of type 'reply_type', which must be
+ * 'len' bytes long.  The caller must free '*replyp' afterward. */
+static void *
+private_transact(struct vconn *vconn, const char *name, uint16_t type,
+                 uint16_t reply_type, size_t len, struct ofpbuf **replyp)
 {
-    struct ofpbuf *buf;
     struct private_vxhdr *vxhdr;
     struct private_vxopt *vxopt;
-    struct vconn *vconn;
-    struct ofpstat* ofps;
+    struct ofpbuf *buf;
 
     vxhdr = make_openflow(sizeof(*vxhdr) + sizeof(*vxopt), OFPT_VENDOR, &buf);
     vxopt = (struct private_vxopt *)(vxhdr + 1);
     vxhdr->ofp_vxid = htonl(PRIVATE_VENDOR_ID);
-    vxopt->pvo_type = htons(PRIVATEOPT_PROTOCOL_STATS_REQUEST);
+    vxopt->pvo_type = htons(type);
     vxopt->pvo_len = 0;
 
-    open_vconn(argv[1], &vconn);
-    run(vconn_transact(vconn, buf, &buf), "talking to %s", argv[1]);
-    vconn_close(vconn);
-    if (buf->size < sizeof(*vxhdr)) {
+    run(vconn_transact(vconn, buf, &buf), "talking to %s", name);
+    if (buf->size < sizeof(*vxhdr) + sizeof(*vxopt) + len) {
+        ofp_print(stderr, buf->data, buf->size, 2);
         ofp_fatal(0, "short reply (%zu bytes)", buf->size);
     }
 
@@ -710,14 +1342,39 @@ do_protostat(const struct settings *s UNUSED, int argc UNUSED, char *argv[])
         ofp_fatal(0, "bad reply");
     }
     vxopt = (struct private_vxopt *)(vxhdr + 1);
-    if (ntohs(vxopt->pvo_type) != PRIVATEOPT_PROTOCOL_STATS_REPLY
-        || ntohs(vxopt->pvo_len) != (sizeof(*ofps) * 2)) {
+    if (ntohs(vxopt->pvo_type) != reply_type
+        || ntohs(vxopt->pvo_len) != len) {
         ofp_print(stderr, buf->data, buf->size, 2);
         ofp_fatal(0, "bad reply");
     }
 
-    ofps = (struct ofpstat *)(vxopt + 1);
+    *replyp = buf;
+    return vxopt + 1;
+}
+
+static void
+do_protostat(const struct settings *s UNUSED, int argc UNUSED, char *argv[])
+{
+    struct ofpbuf *protocol, *processing;
+    struct private_proc_stats *pps;
+    struct vconn *vconn;
+    struct ofpstat* ofps;
+
+    open_vconn(argv[1], &vconn);
+    ofps = private_transact(vconn, argv[1],
+                            PRIVATEOPT_PROTOCOL_STATS_REQUEST,
+                            PRIVATEOPT_PROTOCOL_STATS_REPLY,
+                            sizeof(*ofps) * 2, &protocol);
+    pps = private_transact(vconn, argv[1],
+                           PRIVATEOPT_PROCESSING_STATS_REQUEST,
+                           PRIVATEOPT_PROCESSING_STATS_REPLY,
+                           sizeof *pps, &processing);
+    vconn_close(vconn);
+
     print_protocol_stat(ofps, ofps + 1);
+    print_processing_stat(pps);
+    ofpbuf_delete(protocol);
+    ofpbuf_delete(processing);
 }
 
 static void
@@ -732,509 +1389,686 @@ do_dump_tables(const struct settings *s UNUSED, int argc UNUSED, char *argv[])
   dump_trivial_stats_transaction(argv[1], OFPST_TABLE);
 }
 
-static uint32_t
-str_to_u32(const char *str)
+static void
+do_dump_buffers(const struct settings *s UNUSED, int argc UNUSED,
+                char *argv[])
 {
-    char *tail;
-    uint32_t value;
+    struct ofp_extension_stats_header *esh;
+    struct ofpbuf *request;
 
-    errno = 0;
-    value = strtoul(str, &tail, 0);
-    if (errno == EINVAL || errno == ERANGE || *tail) {
-        ofp_fatal(0, "invalid numeric format %s", str);
-    }
-    return value;
+    esh = alloc_stats_request(sizeof *esh, OFPST_VENDOR, &request);
+    esh->vendor = htonl(OPENFLOW_VENDOR_ID);
+    esh->subtype = htonl(OFP_EXT_STATS_BUFFER);
+    dump_stats_transaction(argv[1], request);
 }
 
 static void
-str_to_mac(const char *str, uint8_t mac[6]) 
+do_show_latency(const struct settings *s UNUSED, int argc UNUSED,
+                char *argv[])
 {
-    if (sscanf(str, "%"SCNx8":%"SCNx8":%"SCNx8":%"SCNx8":%"SCNx8":%"SCNx8,
-               &mac[0], &mac[1], &mac[2], &mac[3], &mac[4], &mac[5]) != 6) {
-        ofp_fatal(0, "invalid mac address %s", str);
-    }
+    struct ofp_extension_stats_header *esh;
+    struct ofpbuf *request;
+
+    esh = alloc_stats_request(sizeof *esh, OFPST_VENDOR, &request);
+    esh->vendor = htonl(OPENFLOW_VENDOR_ID);
+    esh->subtype = htonl(OFP_EXT_STATS_LATENCY);
+    dump_stats_transaction(argv[1], request);
 }
 
-static uint32_t
-str_to_ip(const char *str_, uint32_t *ip)
+static void
+do_top_flows(const struct settings *s UNUSED, int argc, char *argv[])
 {
-    char *str = xstrdup(str_);
-    char *save_ptr = NULL;
-    const char *name, *netmask;
-    struct in_addr in_addr;
-    int n_wild, retval;
+    struct ofp_ext_top_flows_request *req;
+    struct ofpbuf *request;
+    uint8_t by = OFP_EXT_TOP_BY_BYTES;
+    uint16_t n_flows = 10;
 
-    name = strtok_r(str, "//", &save_ptr);
-    retval = name ? lookup_ip(name, &in_addr) : EINVAL;
-    if (retval) {
-        ofp_fatal(0, "%s: could not convert to IP address", str);
+    if (argc > 2) {
+        n_flows = str_to_u32(argv[2]);
     }
-    *ip = in_addr.s_addr;
-
-    netmask = strtok_r(NULL, "//", &save_ptr);
-    if (netmask) {
-        uint8_t o[4];
-        if (sscanf(netmask, "%"SCNu8".%"SCNu8".%"SCNu8".%"SCNu8,
-                   &o[0], &o[1], &o[2], &o[3]) == 4) {
-            uint32_t nm = (o[0] << 24) | (o[1] << 16) | (o[2] << 8) | o[3];
-            int i;
-
-            /* Find first 1-bit. */
-            for (i = 0; i < 32; i++) {
-                if (nm & (1u << i)) {
-                    break;
-                }
-            }
-            n_wild = i;
-
-            /* Verify that the rest of the bits are 1-bits. */
-            for (; i < 32; i++) {
-                if (!(nm & (1u << i))) {
-                    ofp_fatal(0, "%s: %s is not a valid netmask",
-                              str, netmask);
-                }
-            }
-        } else {
-            int prefix = atoi(netmask);
-            if (prefix <= 0 || prefix > 32) {
-                ofp_fatal(0, "%s: network prefix bits not between 1 and 32",
-                          str);
-            }
-            n_wild = 32 - prefix;
+    if (argc > 3) {
+        if (!strcmp(argv[3], "packets")) {
+            by = OFP_EXT_TOP_BY_PACKETS;
+        } else if (strcmp(argv[3], "bytes")) {
+            ofp_fatal(0, "%s: expected \"packets\" or \"bytes\"", argv[3]);
         }
-    } else {
-        n_wild = 0;
     }
 
-    free(str);
-    return n_wild;
+    req = alloc_stats_request(sizeof *req, OFPST_VENDOR, &request);
+    req->header.vendor = htonl(OPENFLOW_VENDOR_ID);
+    req->header.subtype = htonl(OFP_EXT_STATS_TOP_FLOWS);
+    req->n_flows = htons(n_flows);
+    req->by = by;
+    memset(req->pad, 0, sizeof req->pad);
+    dump_stats_transaction(argv[1], request);
 }
 
-static void *
-put_action(struct ofpbuf *b, size_t size, uint16_t type)
-{
-    struct ofp_action_header *ah = ofpbuf_put_zeros(b, size);
-    ah->type = htons(type);
-    ah->len = htons(size);
-    return ah;
-}
-
-static struct ofp_action_output *
-put_output_action(struct ofpbuf *b, uint16_t port)
-{
-    struct ofp_action_output *oao = put_action(b, sizeof *oao, OFPAT_OUTPUT);
-    oao->port = htons(port);
-    return oao;
-}
-
-static struct ofp_action_enqueue *
-put_enqueue_action(struct ofpbuf *b, uint16_t port, uint32_t queue)
-{
-    struct ofp_action_enqueue *oao;
-
-    oao = put_action(b, sizeof *oao, OFPAT_ENQUEUE);
-    oao->len = htons(sizeof(*oao));
-    oao->port = htons(port);
-    oao->queue_id = htonl(queue);
-    return oao;
-}
-
-static void
-str_to_action(char *str, struct ofpbuf *b)
-{
-    char *act, *arg, *arg2;
-    char *saveptr = NULL;
-
-    for (act = strtok_r(str, ", \t\r\n", &saveptr); act;
-         act = strtok_r(NULL, ", \t\r\n", &saveptr)) 
-    {
-        /* Arguments are separated by colons */
-        arg = strchr(act, ':');
-        if (arg) {
-            *arg = '\0';
-            arg++;
-        }
-
-        if (!strcasecmp(act, "mod_nw_tos")) {
-            struct ofp_action_nw_tos *va;
-            va = put_action(b, sizeof *va, OFPAT_SET_NW_TOS);
-            va->nw_tos = str_to_u32(arg);
-        } else if (!strcasecmp(act, "mod_vlan_vid")) {
-            struct ofp_action_vlan_vid *va;
-            va = put_action(b, sizeof *va, OFPAT_SET_VLAN_VID);
-            va->vlan_vid = htons(str_to_u32(arg));
-        } else if (!strcasecmp(act, "mod_vlan_pcp")) {
-            struct ofp_action_vlan_pcp *va;
-            va = put_action(b, sizeof *va, OFPAT_SET_VLAN_PCP);
-            va->vlan_pcp = str_to_u32(arg);
-        } else if (!strcasecmp(act, "mod_dl_dst")) {
-            struct ofp_action_dl_addr *va;
-            va = put_action(b, sizeof *va, OFPAT_SET_DL_DST);
-            str_to_mac(arg, va->dl_addr);
-        } else if (!strcasecmp(act, "mod_dl_src")) {
-            struct ofp_action_dl_addr *va;
-            va = put_action(b, sizeof *va, OFPAT_SET_DL_SRC);
-            str_to_mac(arg, va->dl_addr);
-        } else if (!strcasecmp(act, "strip_vlan")) {
-            struct ofp_action_header *ah;
-            ah = put_action(b, sizeof *ah, OFPAT_STRIP_VLAN);
-            ah->type = htons(OFPAT_STRIP_VLAN);
-        } else if (!strcasecmp(act, "enqueue")) {
-            arg2 = strchr(arg, ':');
-            if (arg2) {
-                *arg2 = '\0';
-                arg2++;
-            }
-            put_enqueue_action(b, str_to_u32(arg), str_to_u32(arg2));
-        } else if (!strcasecmp(act, "output")) {
-            put_output_action(b, str_to_u32(arg));
-        } else if (!strcasecmp(act, "TABLE")) {
-            put_output_action(b, OFPP_TABLE);
-        } else if (!strcasecmp(act, "NORMAL")) {
-            put_output_action(b, OFPP_NORMAL);
-        } else if (!strcasecmp(act, "FLOOD")) {
-            put_output_action(b, OFPP_FLOOD);
-        } else if (!strcasecmp(act, "ALL")) {
-            put_output_action(b, OFPP_ALL);
-        } else if (!strcasecmp(act, "CONTROLLER")) {
-            struct ofp_action_output *oao;
-            oao = put_output_action(b, OFPP_CONTROLLER);
+/* Appends to 'b' the bytes written in hexadecimal in 's', ignoring white
+ * space and colons between them. */
+static void
+put_hex_bytes(struct ofpbuf *b, const char *s)
+{
+    for (;;) {
+        unsigned int byte;
+        uint8_t octet;
 
-            /* Unless a numeric argument is specified, we send the whole
-             * packet to the controller. */
-            if (arg && (strspn(act, "0123456789") == strlen(act))) {
-               oao->max_len = htons(str_to_u32(arg));
-            }
-        } else if (!strcasecmp(act, "LOCAL")) {
-            put_output_action(b, OFPP_LOCAL);
-        } else if (strspn(act, "0123456789") == strlen(act)) {
-            put_output_action(b, str_to_u32(act));
-        } else {
-            ofp_fatal(0, "Unknown action: %s", act);
+        s += strspn(s, " \t\n:");
+        if (!*s) {
+            break;
         }
-    }
-}
-
-struct protocol {
-    const char *name;
-    uint16_t dl_type;
-    uint8_t nw_proto;
-};
-
-static bool
-parse_protocol(const char *name, const struct protocol **p_out)
-{
-    static const struct protocol protocols[] = {
-        { "ip", ETH_TYPE_IP, 0 },
-        { "arp", ETH_TYPE_ARP, 0 },
-        { "icmp", ETH_TYPE_IP, IP_TYPE_ICMP },
-        { "tcp", ETH_TYPE_IP, IP_TYPE_TCP },
-        { "udp", ETH_TYPE_IP, IP_TYPE_UDP },
-    };
-    const struct protocol *p;
-
-    for (p = protocols; p < &protocols[ARRAY_SIZE(protocols)]; p++) {
-        if (!strcmp(p->name, name)) {
-            *p_out = p;
-            return true;
+        if (!isxdigit((unsigned char) s[0])
+            || !isxdigit((unsigned char) s[1])) {
+            ofp_fatal(0, "%s: expected pairs of hexadecimal digits", s);
         }
+        sscanf(s, "%2x", &byte);
+        octet = byte;
+        ofpbuf_put(b, &octet, 1);
+        s += 2;
     }
-    *p_out = NULL;
-    return false;
 }
 
-struct field {
-    const char *name;
-    uint32_t wildcard;
-    enum { F_U8, F_U16, F_MAC, F_IP } type;
-    size_t offset, shift;
-};
-
-static bool
-parse_field(const char *name, const struct field **f_out)
-{
-#define F_OFS(MEMBER) offsetof(struct ofp_match, MEMBER)
-    static const struct field fields[] = {
-        { "in_port", OFPFW_IN_PORT, F_U16, F_OFS(in_port), 0 },
-        { "dl_vlan", OFPFW_DL_VLAN, F_U16, F_OFS(dl_vlan), 0 },
-        { "dl_vlan_pcp", OFPFW_DL_VLAN_PCP, F_U8, F_OFS(dl_vlan_pcp), 0 },
-        { "dl_src", OFPFW_DL_SRC, F_MAC, F_OFS(dl_src), 0 },
-        { "dl_dst", OFPFW_DL_DST, F_MAC, F_OFS(dl_dst), 0 },
-        { "dl_type", OFPFW_DL_TYPE, F_U16, F_OFS(dl_type), 0 },
-        { "nw_tos", OFPFW_NW_TOS, F_U8, F_OFS(nw_tos), 0 },
-        { "nw_proto", OFPFW_NW_PROTO, F_U8, F_OFS(nw_proto), 0 },
-        { "nw_src", OFPFW_NW_SRC_MASK, F_IP,
-          F_OFS(nw_src), OFPFW_NW_SRC_SHIFT },
-        { "nw_dst", OFPFW_NW_DST_MASK, F_IP,
-          F_OFS(nw_dst), OFPFW_NW_DST_SHIFT },
-        { "tp_src", OFPFW_TP_SRC, F_U16, F_OFS(tp_src), 0 },
-        { "tp_dst", OFPFW_TP_DST, F_U16, F_OFS(tp_dst), 0 },
-        { "icmp_type", OFPFW_ICMP_TYPE, F_U16, F_OFS(icmp_type), 0 },
-        { "icmp_code", OFPFW_ICMP_CODE, F_U16, F_OFS(icmp_code), 0 }
-    };
-    const struct field *f;
+static void
+do_trace(const struct settings *s UNUSED, int argc, char *argv[])
+{
+    struct ofp_ext_trace_request *req;
+    struct ofpbuf *request;
 
-    for (f = fields; f < &fields[ARRAY_SIZE(fields)]; f++) {
-        if (!strcmp(f->name, name)) {
-            *f_out = f;
-            return true;
-        }
+    req = alloc_stats_request(sizeof *req, OFPST_VENDOR, &request);
+    req->header.vendor = htonl(OPENFLOW_VENDOR_ID);
+    req->header.subtype = htonl(OFP_EXT_STATS_TRACE);
+    parse_ofp_str(argv[2], &req->match, NULL, NULL, NULL, NULL, NULL, NULL,
+                  NULL);
+    if (argc > 3) {
+        put_hex_bytes(request, argv[3]);
     }
-    *f_out = NULL;
-    return false;
+    dump_stats_transaction(argv[1], request);
 }
 
 static void
-str_to_flow(char *string, struct ofp_match *match, struct ofpbuf *actions,
-            uint8_t *table_idx, uint16_t *out_port, uint16_t *priority,
-            uint16_t *idle_timeout, uint16_t *hard_timeout,
-            uint64_t *cookie)
+do_desc(const struct settings *s UNUSED, int argc UNUSED, char *argv[])
 {
-    char *save_ptr = NULL;
-    char *name;
-    uint32_t wildcards;
+    struct vconn * vconn;
+    struct ofpbuf * msg;
+    struct openflow_ext_set_dp_desc * desc;
 
-    if (table_idx) {
-        *table_idx = 0xff;
-    }
-    if (out_port) {
-        *out_port = OFPP_NONE;
-    }
-    if (priority) {
-        *priority = OFP_DEFAULT_PRIORITY;
+    msg = ofpbuf_new(sizeof(*desc));
+    ofpbuf_put_uninit(msg, sizeof(*desc));
+    desc = ofpbuf_at_assert(msg, 0, sizeof(*desc));
+    desc->header.header.version = OFP_VERSION;
+    desc->header.header.type    = OFPT_VENDOR;
+    desc->header.header.length  = htons(sizeof(*desc));
+    desc->header.vendor         = htonl(OPENFLOW_VENDOR_ID);
+    desc->header.subtype        = htonl(OFP_EXT_SET_DESC);
+    strncpy(desc->dp_desc, argv[2], DESC_STR_LEN);
+
+    open_vconn(argv[1], &vconn);
+    send_openflow_buffer(vconn, msg);
+    vconn_close(vconn);
+}
+
+/* Appends 'x' to 'ds' in decimal. */
+static void
+put_uint(struct ds *ds, uint64_t x)
+{
+    char buf[20];
+    int i = sizeof buf;
+
+    do {
+        buf[--i] = '0' + x % 10;
+        x /= 10;
+    } while (x);
+    memcpy(ds_put_uninit(ds, sizeof buf - i), &buf[i], sizeof buf - i);
+}
+
+/* Appends 'ip', with a prefix length if 'wild_bits' is nonzero, to 'ds'.
+ * Returns false without appending anything if 'wild_bits' wildcards all of
+ * 'ip'. */
+static bool
+put_ip_field(struct ds *ds, uint32_t ip, uint32_t wild_bits)
+{
+    if (wild_bits >= 32) {
+        return false;
     }
-    if (idle_timeout) {
-        *idle_timeout = DEFAULT_IDLE_TIMEOUT;
+    ds_put_format(ds, IP_FMT, IP_ARGS(&ip));
+    if (wild_bits) {
+        ds_put_char(ds, '/');
+        put_uint(ds, 32 - wild_bits);
     }
-    if (hard_timeout) {
-        *hard_timeout = OFP_FLOW_PERMANENT;
+    return true;
+}
+
+/* Appends the value of field 'f' in 'fs' to 'ds'.  Returns false without
+ * appending anything if 'fs' wildcards the field. */
+static bool
+put_flow_field(struct ds *ds, enum flow_field f,
+               const struct ofp_flow_stats *fs)
+{
+    const struct ofp_match *m = &fs->match;
+    uint32_t w = ntohl(m->wildcards);
+
+    if (w & flow_field_wildcards[f]) {
+        return false;
     }
-    if (cookie) {
-        *cookie = 0;
+
+    switch (f) {
+    case FF_COOKIE:
+        put_uint(ds, ntohll(fs->cookie));
+        break;
+    case FF_DURATION:
+        ds_put_format(ds, "%"PRIu32".%09"PRIu32,
+                      ntohl(fs->duration_sec), ntohl(fs->duration_nsec));
+        break;
+    case FF_TABLE_ID:
+        put_uint(ds, fs->table_id);
+        break;
+    case FF_PRIORITY:
+        put_uint(ds, w ? ntohs(fs->priority) : UINT16_MAX);
+        break;
+    case FF_N_PACKETS:
+        put_uint(ds, ntohll(fs->packet_count));
+        break;
+    case FF_N_BYTES:
+        put_uint(ds, ntohll(fs->byte_count));
+        break;
+    case FF_IDLE_TIMEOUT:
+        put_uint(ds, ntohs(fs->idle_timeout));
+        break;
+    case FF_HARD_TIMEOUT:
+        put_uint(ds, ntohs(fs->hard_timeout));
+        break;
+    case FF_IN_PORT:
+        put_uint(ds, ntohs(m->in_port));
+        break;
+    case FF_DL_VLAN:
+        put_uint(ds, ntohs(m->dl_vlan));
+        break;
+    case FF_DL_VLAN_PCP:
+        put_uint(ds, m->dl_vlan_pcp);
+        break;
+    case FF_DL_SRC:
+        ds_put_format(ds, ETH_ADDR_FMT, ETH_ADDR_ARGS(m->dl_src));
+        break;
+    case FF_DL_DST:
+        ds_put_format(ds, ETH_ADDR_FMT, ETH_ADDR_ARGS(m->dl_dst));
+        break;
+    case FF_DL_TYPE:
+        ds_put_format(ds, "0x%04"PRIx16, ntohs(m->dl_type));
+        break;
+    case FF_NW_SRC:
+        return put_ip_field(ds, m->nw_src,
+                            (w & OFPFW_NW_SRC_MASK) >> OFPFW_NW_SRC_SHIFT);
+    case FF_NW_DST:
+        return put_ip_field(ds, m->nw_dst,
+                            (w & OFPFW_NW_DST_MASK) >> OFPFW_NW_DST_SHIFT);
+    case FF_NW_TOS:
+        put_uint(ds, m->nw_tos);
+        break;
+    case FF_NW_PROTO:
+        put_uint(ds, m->nw_proto);
+        break;
+    case FF_TP_SRC:
+        put_uint(ds, ntohs(m->tp_src));
+        break;
+    case FF_TP_DST:
+        put_uint(ds, ntohs(m->tp_dst));
+        break;
+    case FF_ACTIONS:
+        ofp_put_actions(ds, fs->actions, ntohs(fs->length) - sizeof *fs);
+        break;
+    case N_FLOW_FIELDS:
+        NOT_REACHED();
     }
-    if (actions) {
-        char *act_str = strstr(string, "actions");
-        if (!act_str) {
-            ofp_fatal(0, "must specify an action");
-        }
-        *(act_str-1) = '\0';
+    return true;
+}
 
-        act_str = strchr(act_str, '=');
-        if (!act_str) {
-            ofp_fatal(0, "must specify an action");
-        }
+/* Appends to 'line' the fields of 's' for 'fs' in 's''s format, as one line
+ * of output. */
+static void
+put_flow_line(struct ds *line, const struct settings *s,
+              const struct ofp_flow_stats *fs)
+{
+    size_t i;
 
-        act_str++;
+    for (i = 0; i < s->n_fields; i++) {
+        enum flow_field f = s->fields[i];
+        bool quote = flow_field_is_string[f];
 
-        str_to_action(act_str, actions);
-    }
-    memset(match, 0, sizeof *match);
-    wildcards = OFPFW_ALL;
-    for (name = strtok_r(string, "=, \t\r\n", &save_ptr); name;
-         name = strtok_r(NULL, "=, \t\r\n", &save_ptr)) {
-        const struct protocol *p;
+        if (s->format == DUMP_CSV) {
+            size_t start;
 
-        if (parse_protocol(name, &p)) {
-            wildcards &= ~OFPFW_DL_TYPE;
-            match->dl_type = htons(p->dl_type);
-            if (p->nw_proto) {
-                wildcards &= ~OFPFW_NW_PROTO;
-                match->nw_proto = p->nw_proto;
+            if (i) {
+                ds_put_char(line, ',');
             }
-        } else {
-            const struct field *f;
-            char *value;
-
-            value = strtok_r(NULL, ", \t\r\n", &save_ptr);
-            if (!value) {
-                ofp_fatal(0, "field %s missing value", name);
+            start = line->length;
+            if (quote) {
+                ds_put_char(line, '"');
             }
-
-            if (table_idx && !strcmp(name, "table")) {
-                *table_idx = atoi(value);
-            } else if (out_port && !strcmp(name, "out_port")) {
-                *out_port = atoi(value);
-            } else if (priority && !strcmp(name, "priority")) {
-                *priority = atoi(value);
-            } else if (idle_timeout && !strcmp(name, "idle_timeout")) {
-                *idle_timeout = atoi(value);
-            } else if (hard_timeout && !strcmp(name, "hard_timeout")) {
-                *hard_timeout = atoi(value);
-            } else if (cookie && !strcmp(name, "cookie")) {
-                *cookie = atoi(value);
-            } else if (parse_field(name, &f)) {
-                void *data = (char *) match + f->offset;
-                if (!strcmp(value, "*") || !strcmp(value, "ANY")) {
-                    wildcards |= f->wildcard;
-                } else {
-                    wildcards &= ~f->wildcard;
-                    if (f->type == F_U8) {
-                        *(uint8_t *) data = str_to_u32(value);
-                    } else if (f->type == F_U16) {
-                        *(uint16_t *) data = htons(str_to_u32(value));
-                    } else if (f->type == F_MAC) {
-                        str_to_mac(value, data);
-                    } else if (f->type == F_IP) {
-                        wildcards |= str_to_ip(value, data) << f->shift;
-                    } else {
-                        NOT_REACHED();
-                    }
-                }
-            } else {
-                ofp_fatal(0, "unknown keyword %s", name);
+            if (!put_flow_field(line, f, fs)) {
+                ds_truncate(line, start);
+            } else if (quote) {
+                ds_put_char(line, '"');
+            }
+        } else {
+            size_t start = line->length;
+
+            ds_put_format(line, "%s\"%s\":%s",
+                          line->length ? "," : "{", flow_field_names[f],
+                          quote ? "\"" : "");
+            if (!put_flow_field(line, f, fs)) {
+                ds_truncate(line, start);
+            } else if (quote) {
+                ds_put_char(line, '"');
             }
         }
     }
-    match->wildcards = htonl(wildcards);
+    if (s->format == DUMP_JSON) {
+        ds_put_cstr(line, line->length ? "}" : "{}");
+    }
+    ds_put_char(line, '\n');
 }
 
+/* Sends 'request', a flow stats request, to 'vconn_name' and writes each flow
+ * in the replies to stdout in 's''s CSV or JSON format as soon as it arrives,
+ * so that the memory used does not depend on the number of flows. */
 static void
-do_desc(const struct settings *s UNUSED, int argc UNUSED, char *argv[])
+dump_flows_streaming(const struct settings *s, const char *vconn_name,
+                     struct ofpbuf *request)
 {
-    struct vconn * vconn;
-    struct ofpbuf * msg;
-    struct openflow_ext_set_dp_desc * desc;
+    uint32_t send_xid = ((struct ofp_header *) request->data)->xid;
+    struct ds line = DS_EMPTY_INITIALIZER;
+    struct vconn *vconn;
+    bool done;
 
-    msg = ofpbuf_new(sizeof(*desc));
-    ofpbuf_put_uninit(msg, sizeof(*desc));
-    desc = ofpbuf_at_assert(msg, 0, sizeof(*desc));
-    desc->header.header.version = OFP_VERSION;
-    desc->header.header.type    = OFPT_VENDOR;
-    desc->header.header.length  = htons(sizeof(*desc));
-    desc->header.vendor         = htonl(OPENFLOW_VENDOR_ID);
-    desc->header.subtype        = htonl(OFP_EXT_SET_DESC);
-    strncpy(desc->dp_desc, argv[2], DESC_STR_LEN);
+    setvbuf(stdout, NULL, _IOFBF, 1024 * 1024);
+    if (s->format == DUMP_CSV) {
+        size_t i;
 
-    open_vconn(argv[1], &vconn);
-    send_openflow_buffer(vconn, msg);
+        for (i = 0; i < s->n_fields; i++) {
+            ds_put_format(&line, "%s%s", i ? "," : "",
+                          flow_field_names[s->fields[i]]);
+        }
+        ds_put_char(&line, '\n');
+        fwrite(line.string, line.length, 1, stdout);
+    }
+
+    open_table_vconn(s, vconn_name, &vconn);
+    send_openflow_buffer(vconn, request);
+    for (done = false; !done; ) {
+        const struct ofp_stats_reply *osr;
+        const uint8_t *p, *end;
+        struct ofp_header *oh;
+        struct ofpbuf *reply;
+
+        run(vconn_recv_block(vconn, &reply), "OpenFlow packet receive failed");
+        oh = reply->data;
+        if (oh->xid != send_xid) {
+            ofpbuf_delete(reply);
+            continue;
+        }
+        osr = ofpbuf_at(reply, 0, offsetof(struct ofp_stats_reply, body));
+        if (oh->type != OFPT_STATS_REPLY || !osr
+            || osr->type != htons(OFPST_FLOW)) {
+            ofp_print(stderr, reply->data, reply->size, 1);
+            ofp_fatal(0, "%s: unexpected reply to flow stats request",
+                      vconn_name);
+        }
+        done = !(ntohs(osr->flags) & OFPSF_REPLY_MORE);
+
+        p = osr->body;
+        end = (const uint8_t *) reply->data + reply->size;
+        while (p < end) {
+            const struct ofp_flow_stats *fs = (const void *) p;
+            size_t length;
+
+            length = end - p >= sizeof *fs ? ntohs(fs->length) : 0;
+            if (length < sizeof *fs || length > end - p
+                || (length - sizeof *fs) % sizeof fs->actions[0]) {
+                ofp_fatal(0, "%s: malformed flow stats reply", vconn_name);
+            }
+
+            ds_clear(&line);
+            put_flow_line(&line, s, fs);
+            fwrite(line.string, line.length, 1, stdout);
+            p += length;
+        }
+        ofpbuf_delete(reply);
+    }
     vconn_close(vconn);
+    ds_destroy(&line);
 }
 
 static void
-do_dump_flows(const struct settings *s UNUSED, int argc, char *argv[])
+do_dump_flows(const struct settings *s, int argc, char *argv[])
 {
     struct ofp_flow_stats_request *req;
     uint16_t out_port;
     struct ofpbuf *request;
 
     req = alloc_stats_request(sizeof *req, OFPST_FLOW, &request);
-    str_to_flow(argc > 2 ? argv[2] : "", &req->match, NULL,
-                &req->table_id, &out_port, NULL, NULL, NULL, NULL);
+    parse_ofp_str(argc > 2 ? argv[2] : "", &req->match, NULL,
+                  &req->table_id, &out_port, NULL, NULL, NULL, NULL);
     memset(&req->pad, 0, sizeof req->pad);
     req->out_port = htons(out_port);
 
+    if (s->format == DUMP_TEXT) {
+        struct vconn *vconn;
+
+        open_table_vconn(s, argv[1], &vconn);
+        dump_stats_transaction__(vconn, request);
+        vconn_close(vconn);
+    } else {
+        dump_flows_streaming(s, argv[1], request);
+    }
+}
+
+static void
+do_dump_flow_deltas(const struct settings *s UNUSED, int argc, char *argv[])
+{
+    struct ofp_ext_flow_delta_request *req;
+    struct ofpbuf *request;
+    uint16_t out_port;
+
+    req = alloc_stats_request(sizeof *req, OFPST_VENDOR, &request);
+    req->header.vendor = htonl(OPENFLOW_VENDOR_ID);
+    req->header.subtype = htonl(OFP_EXT_STATS_FLOW_DELTA);
+    req->since = htonll(strtoull(argv[2], NULL, 10));
+    parse_ofp_str(argc > 3 ? argv[3] : "", &req->flows.match, NULL,
+                  &req->flows.table_id, &out_port, NULL, NULL, NULL, NULL);
+    memset(&req->flows.pad, 0, sizeof req->flows.pad);
+    req->flows.out_port = htons(out_port);
+    memset(req->pad, 0, sizeof req->pad);
+
     dump_stats_transaction(argv[1], request);
 }
 
 static void
-do_dump_aggregate(const struct settings *s UNUSED, int argc, char *argv[])
+do_dump_aggregate(const struct settings *s, int argc, char *argv[])
 {
     struct ofp_aggregate_stats_request *req;
     struct ofpbuf *request;
+    struct vconn *vconn;
     uint16_t out_port;
 
     req = alloc_stats_request(sizeof *req, OFPST_AGGREGATE, &request);
-    str_to_flow(argc > 2 ? argv[2] : "", &req->match, NULL,
-                &req->table_id, &out_port, NULL, NULL, NULL, NULL);
+    parse_ofp_str(argc > 2 ? argv[2] : "", &req->match, NULL,
+                  &req->table_id, &out_port, NULL, NULL, NULL, NULL);
     memset(&req->pad, 0, sizeof req->pad);
     req->out_port = htons(out_port);
 
-    dump_stats_transaction(argv[1], request);
+    open_table_vconn(s, argv[1], &vconn);
+    dump_stats_transaction__(vconn, request);
+    vconn_close(vconn);
 }
 
-#define EMERG_TABLE_ID 0xfe
 
 static void
-do_add_flow(const struct settings *s UNUSED, int argc UNUSED, char *argv[])
+do_add_flow(const struct settings *s, int argc UNUSED, char *argv[])
 {
     struct vconn *vconn;
     struct ofpbuf *buffer;
-    struct ofp_flow_mod *ofm;
-    uint16_t priority, idle_timeout, hard_timeout;
-    uint64_t cookie;
-    uint8_t table_id;
-    struct ofp_match match;
-
-    /* Parse and send.  str_to_flow() will expand and reallocate the data in
-     * 'buffer', so we can't keep pointers to across the str_to_flow() call. */
-    make_openflow(sizeof *ofm, OFPT_FLOW_MOD, &buffer);
-    str_to_flow(argv[2], &match, buffer,
-                &table_id, NULL, &priority, &idle_timeout, &hard_timeout,
-                &cookie);
-    ofm = buffer->data;
-    ofm->match = match;
-    ofm->command = htons(OFPFC_ADD);
-    ofm->cookie = htonll(cookie);
-    ofm->idle_timeout = table_id == EMERG_TABLE_ID ? 0 : htons(idle_timeout);
-    ofm->hard_timeout = table_id == EMERG_TABLE_ID ? 0 : htons(hard_timeout);
-    ofm->buffer_id = htonl(UINT32_MAX);
-    ofm->priority = htons(priority);
-    ofm->flags = htons(OFPFF_SEND_FLOW_REM);
-    if (table_id == EMERG_TABLE_ID)
-        ofm->flags |= htons(OFPFF_EMERG);
 
-    open_vconn(argv[1], &vconn);
+    buffer = parse_ofp_add_flow_str(argv[2]);
+    open_table_vconn(s, argv[1], &vconn);
     send_openflow_buffer(vconn, buffer);
     vconn_close(vconn);
 }
 
+static double
+elapsed_ms(const struct timeval *start, const struct timeval *end)
+{
+    return (1000*(double)(end->tv_sec - start->tv_sec)
+            + .001*(end->tv_usec - start->tv_usec));
+}
+
+/* Most flow_mods that add-flows hands to the vconn at once.  A stream vconn
+ * writes them with a single writev(). */
+#define ADD_FLOWS_BATCH 64
+
+/* add-flows follows every ADD_FLOWS_PER_BARRIER flow_mods with a barrier and
+ * leaves at most ADD_FLOWS_MAX_BARRIERS of them unanswered.  This bounds the
+ * number of error replies that the switch may have queued for us, which it
+ * would start dropping, barrier replies included, once its transmit queue to
+ * us filled up. */
+#define ADD_FLOWS_PER_BARRIER 1000
+#define ADD_FLOWS_MAX_BARRIERS 8
+
+/* The flows for add-flows: either a text file, parsed a line at a time, or a
+ * binary flow file, whose flow_mods are sent as they are. */
+struct add_flows_source {
+    const char *name;
+    FILE *text;                 /* Text file, or null. */
+    struct flow_file binary;    /* Binary flow file, if 'text' is null. */
+    int position;               /* Current line or flow_mod number. */
+};
+
+static void
+add_flows_open(struct add_flows_source *src, const char *name)
+{
+    int error;
+
+    src->name = name;
+    src->position = 0;
+    src->text = fopen(name, "r");
+    if (src->text == NULL) {
+        ofp_fatal(errno, "%s: open", name);
+    }
+    if (flow_file_is_binary(src->text)) {
+        fclose(src->text);
+        src->text = NULL;
+        error = flow_file_open(name, &src->binary);
+        if (error) {
+            ofp_fatal(error, "%s: could not read flow file", name);
+        }
+    }
+}
+
+/* Returns the next flow_mod from 'src', or a null pointer at the end. */
+static struct ofpbuf *
+add_flows_next(struct add_flows_source *src)
+{
+    const struct ofp_flow_mod *ofm;
+    size_t length;
+    int error;
+
+    if (src->text) {
+        return parse_ofp_add_flow_file(src->text, &src->position);
+    }
+
+    error = flow_file_next(&src->binary, &ofm, &length);
+    if (error == EOF) {
+        return NULL;
+    } else if (error) {
+        ofp_fatal(0, "%s: flow file is truncated or corrupt", src->name);
+    }
+    src->position++;
+    return ofpbuf_clone_data(ofm, length);
+}
+
+static void
+add_flows_close(struct add_flows_source *src)
+{
+    if (src->text) {
+        fclose(src->text);
+    } else {
+        flow_file_close(&src->binary);
+    }
+}
+
+/* Returns a new OFP_EXT_TABLE_REPLACE message with 'command'. */
+static struct ofpbuf *
+make_table_replace(uint16_t command)
+{
+    struct ofp_ext_table_replace *otr;
+    struct ofpbuf *buffer;
+
+    otr = make_openflow(sizeof *otr, OFPT_VENDOR, &buffer);
+    otr->header.vendor = htonl(OPENFLOW_VENDOR_ID);
+    otr->header.subtype = htonl(OFP_EXT_TABLE_REPLACE);
+    otr->command = htons(command);
+    memset(otr->pad, 0, sizeof otr->pad);
+    return buffer;
+}
+
+/* Sends the flows in 'file' to 'switch_name', for the pipeline table chosen
+ * in 's'.  If 'replace' is true, they make up a new flow table that replaces
+ * the switch's whole table at once, or none of it if any flow fails. */
 static void
-do_add_flows(const struct settings *s UNUSED, int argc UNUSED, char *argv[])
+add_flows(const struct settings *s, const char *switch_name,
+          const char *file, bool replace)
 {
+    struct ofpbuf *batch[ADD_FLOWS_BATCH];
+    struct add_flows_source src;
+    size_t n_batch, batch_ofs;
+    struct timeval start, end;
     struct vconn *vconn;
-    FILE *file;
-    char line[1024];
+    int *positions;             /* 'src.position' of each flow, by xid. */
+    size_t allocated_flows;
+    int n_flows;
+    int since_barrier, n_barriers, n_errors;
+    double duration;
+    bool eof, finished;
 
-    file = fopen(argv[2], "r");
-    if (file == NULL) {
-        ofp_fatal(errno, "%s: open", argv[2]);
+    if (replace && s->pipeline_table) {
+        ofp_fatal(0, "replace-flows can only replace pipeline table 0");
+    }
+    add_flows_open(&src, file);
+    open_table_vconn(s, switch_name, &vconn);
+    gettimeofday(&start, NULL);
+    positions = NULL;
+    n_flows = allocated_flows = 0;
+    since_barrier = n_barriers = n_errors = 0;
+    n_batch = batch_ofs = 0;
+    eof = false;
+    finished = !replace;
+    if (replace) {
+        batch[n_batch++] = make_table_replace(OFP_EXT_REPLACE_BEGIN);
     }
+    for (;;) {
+        struct ofpbuf *reply;
+        int retval;
+
+        /* Parse more flows, as long as the switch is keeping up. */
+        while (!eof && n_batch < ADD_FLOWS_BATCH
+               && n_barriers < ADD_FLOWS_MAX_BARRIERS) {
+            struct ofpbuf *buffer;
+
+            if (since_barrier < ADD_FLOWS_PER_BARRIER) {
+                buffer = add_flows_next(&src);
+                if (buffer) {
+                    if (n_flows >= allocated_flows) {
+                        positions = x2nrealloc(positions, &allocated_flows,
+                                               sizeof *positions);
+                    }
+                    positions[n_flows] = src.position;
+                    ((struct ofp_header *) buffer->data)->xid = htonl(n_flows);
+                    n_flows++;
+                    since_barrier++;
+                } else {
+                    eof = true;
+                }
+            } else {
+                buffer = NULL;
+            }
+            if (!buffer) {
+                /* Time for a barrier, or the final one at end of file. */
+                make_openflow(sizeof(struct ofp_header), OFPT_BARRIER_REQUEST,
+                              &buffer);
+                since_barrier = 0;
+                n_barriers++;
+            }
+            update_openflow_length(buffer);
+            batch[n_batch++] = buffer;
+        }
 
-    open_vconn(argv[1], &vconn);
-    while (fgets(line, sizeof line, file)) {
-        struct ofpbuf *buffer;
-        struct ofp_flow_mod *ofm;
-        uint16_t priority, idle_timeout, hard_timeout;
-        uint64_t cookie;
-        uint8_t table_id;
-        struct ofp_match match;
+        /* Send as much as the connection will take without blocking. */
+        if (batch_ofs < n_batch) {
+            size_t n_sent;
+
+            retval = vconn_send_batch(vconn, &batch[batch_ofs],
+                                      n_batch - batch_ofs, &n_sent);
+            if (retval && retval != EAGAIN) {
+                ofp_fatal(retval, "failed to send flows to switch");
+            }
+            batch_ofs += n_sent;
+            if (batch_ofs == n_batch) {
+                batch_ofs = n_batch = 0;
+            }
+        }
 
-        char *comment;
+        /* Collect replies. */
+        while (!(retval = vconn_recv(vconn, &reply))) {
+            const struct ofp_header *oh = reply->data;
+            uint32_t xid = ntohl(oh->xid);
 
-        /* Delete comments. */
-        comment = strchr(line, '#');
-        if (comment) {
-            *comment = '\0';
+            if (oh->type == OFPT_ERROR) {
+                char *s = ofp_to_string(reply->data, reply->size, 1);
+                if (xid < n_flows) {
+                    fprintf(stderr, (src.text ? "%s:%d: " : "%s: flow %d: "),
+                            file, positions[xid]);
+                }
+                fputs(s, stderr);
+                free(s);
+                n_errors++;
+            } else if (oh->type == OFPT_BARRIER_REPLY) {
+                n_barriers--;
+            }
+            ofpbuf_delete(reply);
         }
+        if (retval != EAGAIN) {
+            ofp_fatal(retval, "OpenFlow packet receive failed");
+        }
+
+        if (eof && !n_batch && !n_barriers) {
+            if (finished) {
+                break;
+            }
 
-        /* Drop empty lines. */
-        if (line[strspn(line, " \t\n")] == '\0') {
+            /* Every flow has been staged and answered: swap the new table
+             * in, or throw it away if any flow failed. */
+            batch[n_batch++] = make_table_replace(n_errors
+                                                  ? OFP_EXT_REPLACE_ABORT
+                                                  : OFP_EXT_REPLACE_COMMIT);
+            make_openflow(sizeof(struct ofp_header), OFPT_BARRIER_REQUEST,
+                          &batch[n_batch++]);
+            n_barriers++;
+            finished = true;
             continue;
         }
 
-        /* Parse and send.  str_to_flow() will expand and reallocate the data
-         * in 'buffer', so we can't keep pointers to across the str_to_flow()
-         * call. */
-        ofm = make_openflow(sizeof *ofm, OFPT_FLOW_MOD, &buffer);
-        str_to_flow(line, &match, buffer,
-                    &table_id, NULL, &priority, &idle_timeout, &hard_timeout,
-                    &cookie);
-        ofm = buffer->data;
-        ofm->match = match;
-        ofm->command = htons(OFPFC_ADD);
-        ofm->cookie = htonll(cookie);
-        ofm->idle_timeout = table_id == EMERG_TABLE_ID ? 0 : htons(idle_timeout);
-        ofm->hard_timeout = table_id == EMERG_TABLE_ID ? 0 : htons(hard_timeout);
-        ofm->buffer_id = htonl(UINT32_MAX);
-        ofm->priority = htons(priority);
-        ofm->flags = htons(OFPFF_SEND_FLOW_REM);
-        if (table_id == EMERG_TABLE_ID)
-            ofm->flags |= htons(OFPFF_EMERG);
-
-        send_openflow_buffer(vconn, buffer);
+        vconn_recv_wait(vconn);
+        if (n_batch) {
+            vconn_send_wait(vconn);
+        } else if (!eof && n_barriers < ADD_FLOWS_MAX_BARRIERS) {
+            poll_immediate_wake();
+        }
+        poll_block();
     }
+    gettimeofday(&end, NULL);
     vconn_close(vconn);
-    fclose(file);
+    add_flows_close(&src);
+    free(positions);
+
+    duration = elapsed_ms(&start, &end);
+    printf("%s %d flows in %.1f ms (%.0f flows/s), %d errors\n",
+           !replace ? "Added" : n_errors ? "Did not replace table with"
+           : "Replaced table with",
+           n_flows, duration, n_flows / (MAX(duration, 1) / 1000.0),
+           n_errors);
+    if (n_errors) {
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void
+do_add_flows(const struct settings *s, int argc UNUSED, char *argv[])
+{
+    add_flows(s, argv[1], argv[2], false);
+}
+
+static void
+do_replace_flows(const struct settings *s, int argc UNUSED, char *argv[])
+{
+    add_flows(s, argv[1], argv[2], true);
 }
 
 static void
@@ -1249,9 +2083,9 @@ do_mod_flows(const struct settings *s, int argc UNUSED, char *argv[])
 
     /* Parse and send. */
     ofm = make_openflow(sizeof *ofm, OFPT_FLOW_MOD, &buffer);
-    str_to_flow(argv[2], &ofm->match, buffer,
-                &table_id, NULL, &priority, &idle_timeout, &hard_timeout,
-                &cookie);
+    parse_ofp_str(argv[2], &ofm->match, buffer,
+                  &table_id, NULL, &priority, &idle_timeout, &hard_timeout,
+                  &cookie);
     if (s->strict) {
         ofm->command = htons(OFPFC_MODIFY_STRICT);
     } else {
@@ -1265,7 +2099,7 @@ do_mod_flows(const struct settings *s, int argc UNUSED, char *argv[])
         ofm->flags = htons(OFPFF_EMERG);
     ofm->priority = htons(priority);
 
-    open_vconn(argv[1], &vconn);
+    open_table_vconn(s, argv[1], &vconn);
     send_openflow_buffer(vconn, buffer);
     vconn_close(vconn);
 }
@@ -1281,8 +2115,8 @@ static void do_del_flows(const struct settings *s, int argc, char *argv[])
 
     /* Parse and send. */
     ofm = make_openflow(sizeof *ofm, OFPT_FLOW_MOD, &buffer);
-    str_to_flow(argc > 2 ? argv[2] : "", &ofm->match, NULL,
-                &table_id, &out_port, &priority, NULL, NULL, NULL);
+    parse_ofp_str(argc > 2 ? argv[2] : "", &ofm->match, NULL,
+                  &table_id, &out_port, &priority, NULL, NULL, NULL);
     if (s->strict) {
         ofm->command = htons(OFPFC_DELETE_STRICT);
     } else {
@@ -1296,248 +2130,1956 @@ static void do_del_flows(const struct settings *s, int argc, char *argv[])
     ofm->out_port = htons(out_port);
     ofm->priority = htons(priority);
 
+    open_table_vconn(s, argv[1], &vconn);
+    send_openflow_buffer(vconn, buffer);
+    vconn_close(vconn);
+}
+
+static void
+do_set_table_miss(const struct settings *s UNUSED, int argc UNUSED,
+                  char *argv[])
+{
+    struct ofp_ext_table_miss *otm;
+    struct ofpbuf *buffer;
+    struct vconn *vconn;
+    unsigned long int table_id;
+
+    table_id = strtoul(argv[2], NULL, 10);
+    if (table_id >= OFP_EXT_PIPELINE_TABLES) {
+        ofp_fatal(0, "%s: pipeline table must be between 0 and %d",
+                  argv[2], OFP_EXT_PIPELINE_TABLES - 1);
+    }
+
+    otm = make_openflow(sizeof *otm, OFPT_VENDOR, &buffer);
+    otm->header.vendor = htonl(OPENFLOW_VENDOR_ID);
+    otm->header.subtype = htonl(OFP_EXT_TABLE_MISS);
+    otm->table_id = table_id;
+    if (!strcmp(argv[3], "controller")) {
+        otm->miss = OFP_EXT_MISS_CONTROLLER;
+    } else if (!strcmp(argv[3], "continue")) {
+        otm->miss = OFP_EXT_MISS_CONTINUE;
+    } else if (!strcmp(argv[3], "drop")) {
+        otm->miss = OFP_EXT_MISS_DROP;
+    } else {
+        ofp_fatal(0, "%s: unknown miss behavior (use controller, continue, "
+                  "or drop)", argv[3]);
+    }
+    memset(otm->pad, 0, sizeof otm->pad);
+
     open_vconn(argv[1], &vconn);
     send_openflow_buffer(vconn, buffer);
     vconn_close(vconn);
 }
 
-static void
-do_monitor(const struct settings *s UNUSED, int argc UNUSED, char *argv[])
-{
-    struct vconn *vconn;
-    const char *name;
+/* Parses 'string' as COOKIE[/MASK] into '*cookie' and '*mask', with a
+ * missing MASK selecting every bit. */
+static void
+parse_cookie(const char *string, uint64_t *cookie, uint64_t *mask)
+{
+    char *end;
+
+    *cookie = strtoull(string, &end, 0);
+    *mask = UINT64_MAX;
+    if (*end == '/') {
+        *mask = strtoull(end + 1, &end, 0);
+    }
+    if (end == string || *end) {
+        ofp_fatal(0, "%s: expected COOKIE[/MASK]", string);
+    }
+}
+
+static void
+do_dump_cookie(const struct settings *s UNUSED, int argc, char *argv[])
+{
+    struct ofp_ext_cookie_flow_request *req;
+    struct ofpbuf *request;
+    uint64_t cookie, mask;
+
+    parse_cookie(argv[2], &cookie, &mask);
+    req = alloc_stats_request(sizeof *req, OFPST_VENDOR, &request);
+    req->header.vendor = htonl(OPENFLOW_VENDOR_ID);
+    req->header.subtype = htonl(OFP_EXT_STATS_COOKIE_FLOW);
+    req->cookie = htonll(cookie);
+    req->cookie_mask = htonll(mask);
+    req->out_port = htons(argc > 3 ? str_to_u32(argv[3]) : OFPP_NONE);
+    memset(req->pad, 0, sizeof req->pad);
+
+    dump_stats_transaction(argv[1], request);
+}
+
+/* Sends an OFP_EXT_COOKIE_FLOW_MOD with 'command' to the switch in argv[1]
+ * for the flows with the cookie in argv[2], with the actions in 'actions'
+ * for OFPFC_MODIFY or the output port in 'out_port' for OFPFC_DELETE. */
+static void
+send_cookie_flow_mod(char *argv[], uint16_t command, char *actions,
+                     uint16_t out_port)
+{
+    struct ofp_ext_cookie_flow_mod *ocm;
+    struct ofpbuf *buffer;
+    struct vconn *vconn;
+    uint64_t cookie, mask;
+
+    parse_cookie(argv[2], &cookie, &mask);
+    ocm = make_openflow(sizeof *ocm, OFPT_VENDOR, &buffer);
+    ocm->header.vendor = htonl(OPENFLOW_VENDOR_ID);
+    ocm->header.subtype = htonl(OFP_EXT_COOKIE_FLOW_MOD);
+    ocm->cookie = htonll(cookie);
+    ocm->cookie_mask = htonll(mask);
+    ocm->command = htons(command);
+    ocm->out_port = htons(out_port);
+    if (actions) {
+        str_to_action(actions, buffer);
+    }
+
+    open_vconn(argv[1], &vconn);
+    send_openflow_buffer(vconn, buffer);
+    vconn_close(vconn);
+}
+
+static void
+do_mod_cookie(const struct settings *s UNUSED, int argc UNUSED, char *argv[])
+{
+    send_cookie_flow_mod(argv, OFPFC_MODIFY, argv[3], OFPP_NONE);
+}
+
+static void
+do_del_cookie(const struct settings *s UNUSED, int argc, char *argv[])
+{
+    send_cookie_flow_mod(argv, OFPFC_DELETE, NULL,
+                         argc > 3 ? str_to_u32(argv[3]) : OFPP_NONE);
+}
+
+/* Where "dpctl monitor" puts the messages that it receives. */
+struct monitor_output {
+    uint32_t types;             /* Bits for the OFPT_* types to output. */
+
+    /* A ring of pcap files, if 'file_name' is nonnull, otherwise stderr. */
+    const char *file_name;      /* Newest file; older ones add .1, .2, .... */
+    FILE *file;                 /* 'file_name', open for writing. */
+    off_t size;                 /* Bytes written to 'file'. */
+    unsigned int n_packets;     /* Packets written to 'file'. */
+    off_t max_size;             /* Rotate when 'size' would exceed this. */
+    unsigned int n_files;       /* Files in the ring. */
+    uint32_t tcp_seq;           /* Sequence number of the next message. */
+    struct ofpbuf frame;        /* Scratch buffer for a message's frame. */
+};
+
+static void
+monitor_open_pcap(struct monitor_output *mo)
+{
+    mo->file = pcap_open(mo->file_name, "wb");
+    if (!mo->file) {
+        ofp_fatal(errno, "%s: could not open pcap file", mo->file_name);
+    }
+    mo->size = ftello(mo->file);
+    mo->n_packets = 0;
+}
+
+static void
+monitor_output_init(struct monitor_output *mo, const struct settings *s)
+{
+    memset(mo, 0, sizeof *mo);
+    mo->types = s->monitor_types;
+    if (s->pcap_file) {
+        mo->file_name = s->pcap_file;
+        mo->max_size = s->pcap_size;
+        mo->n_files = s->pcap_files;
+        ofpbuf_init(&mo->frame, 65536 + ETH_HEADER_LEN + IP_HEADER_LEN
+                    + TCP_HEADER_LEN);
+        monitor_open_pcap(mo);
+    }
+}
+
+/* Closes the newest file in 'mo''s pcap ring, renames each file to the next
+ * older name, dropping the oldest, and starts a new newest file. */
+static void
+monitor_rotate_pcap(struct monitor_output *mo)
+{
+    unsigned int i;
+
+    fclose(mo->file);
+    for (i = mo->n_files - 1; i > 0; i--) {
+        char *old = (i > 1 ? xasprintf("%s.%u", mo->file_name, i - 1)
+                     : xstrdup(mo->file_name));
+        char *new = xasprintf("%s.%u", mo->file_name, i);
+        if (rename(old, new) && errno != ENOENT) {
+            ofp_error(errno, "rename %s to %s", old, new);
+        }
+        free(old);
+        free(new);
+    }
+    monitor_open_pcap(mo);
+}
+
+/* Outputs the OpenFlow message in the 'size' bytes at 'data' to 'mo', if
+ * 'mo' is interested in its type.
+ *
+ * A message written to a pcap file goes inside made-up Ethernet, IPv4, and
+ * TCP headers, from and to the OpenFlow port on 127.0.0.1, with TCP sequence
+ * numbers that make the messages one stream, so that protocol analyzers such
+ * as Wireshark with the OpenFlow dissector in utilities/wireshark_dissectors
+ * decode them as they would a live capture.  The message itself is copied
+ * as is, without being parsed or formatted. */
+static void
+monitor_output(struct monitor_output *mo, const void *data, size_t size)
+{
+    const struct ofp_header *oh = data;
+    struct eth_header *eth;
+    struct ip_header *ip;
+    struct tcp_header *tcp;
+    struct timeval now;
+
+    if (size >= sizeof *oh && oh->type < 32
+        && !(mo->types & (1u << oh->type))) {
+        return;
+    } else if (!mo->file) {
+        ofp_print(stderr, data, size, 2);
+        return;
+    }
+
+    ofpbuf_clear(&mo->frame);
+    eth = ofpbuf_put_zeros(&mo->frame, ETH_HEADER_LEN);
+    eth->eth_type = htons(ETH_TYPE_IP);
+
+    ip = ofpbuf_put_zeros(&mo->frame, IP_HEADER_LEN);
+    ip->ip_ihl_ver = IP_IHL_VER(5, IP_VERSION);
+    ip->ip_tot_len = htons(MIN(IP_HEADER_LEN + TCP_HEADER_LEN + size,
+                               UINT16_MAX));
+    ip->ip_ttl = 64;
+    ip->ip_proto = IP_TYPE_TCP;
+    ip->ip_src = ip->ip_dst = htonl(INADDR_LOOPBACK);
+    ip->ip_csum = csum(ip, IP_HEADER_LEN);
+
+    tcp = ofpbuf_put_zeros(&mo->frame, TCP_HEADER_LEN);
+    tcp->tcp_src = tcp->tcp_dst = htons(OFP_TCP_PORT);
+    tcp->tcp_seq = htonl(mo->tcp_seq);
+    tcp->tcp_ctl = htons((TCP_HEADER_LEN / 4) << 12 | TCP_PSH | TCP_ACK);
+    tcp->tcp_winsz = htons(UINT16_MAX);
+    mo->tcp_seq += size;
+
+    ofpbuf_put(&mo->frame, data, size);
+
+    if (mo->max_size && mo->n_packets
+        && mo->size + PCAP_RECORD_HEADER_LEN + mo->frame.size > mo->max_size) {
+        monitor_rotate_pcap(mo);
+    }
+    gettimeofday(&now, NULL);
+    pcap_write_at(mo->file, &mo->frame, &now);
+    mo->size += PCAP_RECORD_HEADER_LEN + mo->frame.size;
+    mo->n_packets++;
+}
+
+/* Writes out whatever 'mo' has buffered, so that a capture is complete up to
+ * the last message whenever "dpctl monitor" is idle. */
+static void
+monitor_flush(struct monitor_output *mo)
+{
+    if (mo->file) {
+        fflush(mo->file);
+    }
+}
+
+/* Asks the switch on 'vconn' to send its packet-ins as datagrams to UDP port
+ * 'port_string' on this host, then outputs the messages that arrive over
+ * either 'vconn' or UDP to 'mo'.  Does not return. */
+static void
+monitor_packet_in_udp(struct vconn *vconn, const char *port_string,
+                      struct monitor_output *mo)
+{
+    struct ofp_ext_packet_in_udp *opiu;
+    struct sockaddr_in sin;
+    struct ofpbuf *request;
+    int port = atoi(port_string);
+    int fd;
+
+    if (port <= 0 || port > UINT16_MAX) {
+        ofp_fatal(0, "%s: invalid UDP port", port_string);
+    }
+    fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) {
+        ofp_fatal(errno, "socket");
+    }
+    memset(&sin, 0, sizeof sin);
+    sin.sin_family = AF_INET;
+    sin.sin_addr.s_addr = htonl(INADDR_ANY);
+    sin.sin_port = htons(port);
+    if (bind(fd, (struct sockaddr *) &sin, sizeof sin) < 0) {
+        ofp_fatal(errno, "bind to UDP port %d", port);
+    }
+    run(set_nonblocking(fd), "set_nonblocking");
+
+    opiu = make_openflow(sizeof *opiu, OFPT_VENDOR, &request);
+    opiu->header.vendor = htonl(OPENFLOW_VENDOR_ID);
+    opiu->header.subtype = htonl(OFP_EXT_PACKET_IN_UDP);
+    opiu->port = htons(port);
+    send_openflow_buffer(vconn, request);
+
+    for (;;) {
+        char datagram[65536];
+        bool progress = false;
+        struct ofpbuf *b;
+        ssize_t n;
+        int error;
+
+        error = vconn_recv(vconn, &b);
+        if (!error) {
+            monitor_output(mo, b->data, b->size);
+            ofpbuf_delete(b);
+            progress = true;
+        } else if (error != EAGAIN) {
+            ofp_fatal(error, "vconn_recv");
+        }
+
+        n = recv(fd, datagram, sizeof datagram, 0);
+        if (n > 0) {
+            monitor_output(mo, datagram, n);
+            progress = true;
+        } else if (n < 0 && errno != EAGAIN) {
+            ofp_fatal(errno, "recv from UDP port %d", port);
+        }
+
+        if (!progress) {
+            monitor_flush(mo);
+            vconn_recv_wait(vconn);
+            poll_fd_wait(fd, POLLIN);
+            poll_block();
+        }
+    }
+}
+
+/* Returns an OFP_EXT_SET_ASYNC message that asks for the asynchronous
+ * messages listed in 'spec', e.g. "packet_in:no_match,port_status,port=1",
+ * sharing packet_ins if it includes "balance=ID". */
+static struct ofpbuf *
+make_set_async(const char *spec)
+{
+    static const struct {
+        const char *type;
+        const char *reasons[3];
+    } types[] = {
+        { "packet_in", { "no_match", "action", NULL } },
+        { "port_status", { "add", "delete", "modify" } },
+        { "flow_removed", { "idle", "hard", "delete" } },
+    };
+    uint32_t masks[ARRAY_SIZE(types)];
+    struct ofp_ext_set_async *osa;
+    uint32_t balance_id = 0;
+    struct ofpbuf *msg;
+    char *copy, *token, *save_ptr = NULL;
+
+    memset(masks, 0, sizeof masks);
+    msg = ofpbuf_new(sizeof *osa);
+    ofpbuf_put_zeros(msg, sizeof *osa);
+
+    copy = xstrdup(spec);
+    for (token = strtok_r(copy, ",", &save_ptr); token;
+         token = strtok_r(NULL, ",", &save_ptr)) {
+        char *reason = strchr(token, ':');
+        size_t i, j;
+
+        if (!strncmp(token, "port=", 5)) {
+            uint16_t port = (!strcmp(token + 5, "local") ? OFPP_LOCAL
+                             : str_to_u32(token + 5));
+            port = htons(port);
+            ofpbuf_put(msg, &port, sizeof port);
+            continue;
+        } else if (!strncmp(token, "balance=", 8)) {
+            balance_id = str_to_u32(token + 8);
+            continue;
+        }
+
+        if (reason) {
+            *reason++ = '\0';
+        }
+        for (i = 0; i < ARRAY_SIZE(types); i++) {
+            if (!strcmp(token, types[i].type)) {
+                break;
+            }
+        }
+        if (i >= ARRAY_SIZE(types)) {
+            ofp_fatal(0, "%s: unknown asynchronous message type", token);
+        }
+        if (!reason) {
+            masks[i] = UINT32_MAX;
+            continue;
+        }
+        for (j = 0; j < ARRAY_SIZE(types[i].reasons); j++) {
+            if (types[i].reasons[j] && !strcmp(reason, types[i].reasons[j])) {
+                masks[i] |= 1u << j;
+                break;
+            }
+        }
+        if (j >= ARRAY_SIZE(types[i].reasons)) {
+            ofp_fatal(0, "%s: unknown reason for %s", reason, token);
+        }
+    }
+    free(copy);
+
+    osa = msg->data;
+    osa->header.header.version = OFP_VERSION;
+    osa->header.header.type = OFPT_VENDOR;
+    osa->header.header.length = htons(msg->size);
+    osa->header.vendor = htonl(OPENFLOW_VENDOR_ID);
+    osa->header.subtype = htonl(OFP_EXT_SET_ASYNC);
+    osa->packet_in_mask = htonl(masks[0]);
+    osa->port_status_mask = htonl(masks[1]);
+    osa->flow_removed_mask = htonl(masks[2]);
+    osa->balance_id = htonl(balance_id);
+    return msg;
+}
+
+static void
+do_monitor(const struct settings *s, int argc, char *argv[])
+{
+    struct monitor_output mo;
+    struct vconn *vconn;
+    const char *name;
+
+    /* If the user specified, e.g., "nl:0", append ":1" to it to ensure that
+     * the connection will subscribe to listen for asynchronous messages, such
+     * as packet-in messages. */
+    if (!strncmp(argv[1], "nl:", 3) && strrchr(argv[1], ':') == &argv[1][2]) {
+        name = xasprintf("%s:1", argv[1]);
+    } else {
+        name = argv[1];
+    }
+    open_vconn(argv[1], &vconn);
+    monitor_output_init(&mo, s);
+    if (s->monitor_types != UINT32_MAX) {
+        struct ofp_ext_monitor_filter *mf;
+        struct ofpbuf *request;
+
+        mf = make_openflow(sizeof *mf, OFPT_VENDOR, &request);
+        mf->header.vendor = htonl(OPENFLOW_VENDOR_ID);
+        mf->header.subtype = htonl(OFP_EXT_MONITOR_FILTER);
+        mf->types = htonl(s->monitor_types);
+        send_openflow_buffer(vconn, request);
+    }
+    if (s->async) {
+        send_openflow_buffer(vconn, make_set_async(s->async));
+    }
+    if (argc > 2) {
+        monitor_packet_in_udp(vconn, argv[2], &mo);
+    }
+    for (;;) {
+        struct ofpbuf *b;
+        int error;
+
+        error = vconn_recv(vconn, &b);
+        if (error == EAGAIN) {
+            monitor_flush(&mo);
+            vconn_recv_wait(vconn);
+            poll_block();
+            continue;
+        }
+        run(error, "vconn_recv");
+        monitor_output(&mo, b->data, b->size);
+        ofpbuf_delete(b);
+    }
+}
+
+static void
+str_to_port(char *string, uint16_t *start_port)
+{
+    char *save_ptr = NULL;
+    char *value = NULL;
+
+    if (start_port) {
+        *start_port = OFPP_NONE;
+    }
+
+    value = strtok_r(string, ", \t\r\n", &save_ptr);
+    if (value && start_port) {
+        *start_port = atoi(value);
+    }
+}
+
+static void
+do_dump_ports(const struct settings *s UNUSED, int argc, char *argv[])
+{
+    struct ofp_port_stats_request *psr;
+    struct ofpbuf *buf;
+
+    psr = alloc_stats_request(sizeof(*psr), OFPST_PORT, &buf);
+    str_to_port(argc > 2 ? argv[2] : "", &psr->port_no);
+    psr->port_no = htons(psr->port_no);
+    memset(psr->pad, 0, sizeof(psr->pad));
+    dump_stats_transaction(argv[1], buf);
+}
+
+static void
+do_dump_drops(const struct settings *s UNUSED, int argc, char *argv[])
+{
+    struct ofp_ext_port_drops_request *req;
+    struct ofpbuf *buf;
+    uint16_t port_no;
+
+    req = alloc_stats_request(sizeof *req, OFPST_VENDOR, &buf);
+    req->header.vendor = htonl(OPENFLOW_VENDOR_ID);
+    req->header.subtype = htonl(OFP_EXT_STATS_PORT_DROPS);
+    str_to_port(argc > 2 ? argv[2] : "", &port_no);
+    req->port_no = htons(port_no);
+    dump_stats_transaction(argv[1], buf);
+}
+
+static void
+do_probe(const struct settings *s UNUSED, int argc UNUSED, char *argv[])
+{
+    struct ofpbuf *request;
+    struct vconn *vconn;
+    struct ofpbuf *reply;
+
+    make_openflow(sizeof(struct ofp_header), OFPT_ECHO_REQUEST, &request);
+    open_vconn(argv[1], &vconn);
+    run(vconn_transact(vconn, request, &reply), "talking to %s", argv[1]);
+    if (reply->size != sizeof(struct ofp_header)) {
+        ofp_fatal(0, "reply does not match request");
+    }
+    ofpbuf_delete(reply);
+    vconn_close(vconn);
+}
+
+static void
+do_mod_port(const struct settings *s UNUSED, int argc UNUSED, char *argv[])
+{
+    struct ofpbuf *request, *reply;
+    struct ofp_switch_features *osf;
+    struct ofp_port_mod *opm;
+    struct vconn *vconn;
+    char *endptr;
+    int n_ports;
+    int port_idx;
+    int port_no;
+    
+
+    /* Check if the argument is a port index.  Otherwise, treat it as
+     * the port name. */
+    port_no = strtol(argv[2], &endptr, 10);
+    if (port_no == 0 && endptr == argv[2]) {
+        port_no = -1;
+    }
+
+    /* Send a "Features Request" to get the information we need in order 
+     * to modify the port. */
+    make_openflow(sizeof(struct ofp_header), OFPT_FEATURES_REQUEST, &request);
+    open_vconn(argv[1], &vconn);
+    run(vconn_transact(vconn, request, &reply), "talking to %s", argv[1]);
+
+    osf = reply->data;
+    n_ports = (reply->size - sizeof *osf) / sizeof *osf->ports;
+
+    for (port_idx = 0; port_idx < n_ports; port_idx++) {
+        if (port_no != -1) {
+            /* Check argument as a port index */
+            if (osf->ports[port_idx].port_no == htons(port_no)) {
+                break;
+            }
+        } else {
+            /* Check argument as an interface name */
+            if (!strncmp((char *)osf->ports[port_idx].name, argv[2], 
+                        sizeof osf->ports[0].name)) {
+                break;
+            }
+
+        }
+    }
+    if (port_idx == n_ports) {
+        ofp_fatal(0, "couldn't find monitored port: %s", argv[2]);
+    }
+
+    opm = make_openflow(sizeof(struct ofp_port_mod), OFPT_PORT_MOD, &request);
+    opm->port_no = osf->ports[port_idx].port_no;
+    memcpy(opm->hw_addr, osf->ports[port_idx].hw_addr, sizeof opm->hw_addr);
+    opm->config = htonl(0);
+    opm->mask = htonl(0);
+    opm->advertise = htonl(0);
+
+    printf("modifying port: %s\n", osf->ports[port_idx].name);
+
+    if (!strncasecmp(argv[3], MOD_PORT_CMD_UP, sizeof MOD_PORT_CMD_UP)) {
+        opm->mask |= htonl(OFPPC_PORT_DOWN);
+    } else if (!strncasecmp(argv[3], MOD_PORT_CMD_DOWN, 
+                sizeof MOD_PORT_CMD_DOWN)) {
+        opm->mask |= htonl(OFPPC_PORT_DOWN);
+        opm->config |= htonl(OFPPC_PORT_DOWN);
+    } else if (!strncasecmp(argv[3], MOD_PORT_CMD_FLOOD, 
+                sizeof MOD_PORT_CMD_FLOOD)) {
+        opm->mask |= htonl(OFPPC_NO_FLOOD);
+    } else if (!strncasecmp(argv[3], MOD_PORT_CMD_NOFLOOD, 
+                sizeof MOD_PORT_CMD_NOFLOOD)) {
+        opm->mask |= htonl(OFPPC_NO_FLOOD);
+        opm->config |= htonl(OFPPC_NO_FLOOD);
+    } else {
+        ofp_fatal(0, "unknown mod-port command '%s'", argv[3]);
+    }
+
+    send_openflow_buffer(vconn, request);
+
+    ofpbuf_delete(reply);
+    vconn_close(vconn);
+}
+
+static void
+do_ping(const struct settings *s UNUSED, int argc, char *argv[])
+{
+    size_t max_payload = 65535 - sizeof(struct ofp_header);
+    unsigned int payload;
+    struct vconn *vconn;
+    int i;
+
+    payload = argc > 2 ? atoi(argv[2]) : 64;
+    if (payload > max_payload) {
+        ofp_fatal(0, "payload must be between 0 and %zu bytes", max_payload);
+    }
+
+    open_vconn(argv[1], &vconn);
+    for (i = 0; i < 10; i++) {
+        struct timeval start, end;
+        struct ofpbuf *request, *reply;
+        struct ofp_header *rq_hdr, *rpy_hdr;
+
+        rq_hdr = make_openflow(sizeof(struct ofp_header) + payload,
+                               OFPT_ECHO_REQUEST, &request);
+        random_bytes(rq_hdr + 1, payload);
+
+        gettimeofday(&start, NULL);
+        run(vconn_transact(vconn, ofpbuf_clone(request), &reply), "transact");
+        gettimeofday(&end, NULL);
+
+        rpy_hdr = reply->data;
+        if (reply->size != request->size
+            || memcmp(rpy_hdr + 1, rq_hdr + 1, payload)
+            || rpy_hdr->xid != rq_hdr->xid
+            || rpy_hdr->type != OFPT_ECHO_REPLY) {
+            printf("Reply does not match request.  Request:\n");
+            ofp_print(stdout, request, request->size, 2);
+            printf("Reply:\n");
+            ofp_print(stdout, reply, reply->size, 2);
+        }
+        printf("%d bytes from %s: xid=%08"PRIx32" time=%.1f ms\n",
+               reply->size - sizeof *rpy_hdr, argv[1], rpy_hdr->xid,
+                   (1000*(double)(end.tv_sec - start.tv_sec))
+                   + (.001*(end.tv_usec - start.tv_usec)));
+        ofpbuf_delete(request);
+        ofpbuf_delete(reply);
+    }
+    vconn_close(vconn);
+}
+
+/* Maximum number of barriers that benchmark-flows leaves unanswered before it
+ * waits for a reply.  The switch drops replies once its transmit queue to us
+ * is full, so this must stay well below the switch's queue limit. */
+#define BENCH_MAX_BARRIERS 8
+
+static int
+compare_doubles(const void *a_, const void *b_)
+{
+    const double *a = a_;
+    const double *b = b_;
+    return *a < *b ? -1 : *a > *b;
+}
+
+/* Receives messages from 'vconn' until the reply to the barrier with xid
+ * 'xid' arrives.  Increments '*n_errors' for each error message received. */
+static void
+wait_for_barrier(struct vconn *vconn, uint32_t xid, int *n_errors)
+{
+    for (;;) {
+        struct ofpbuf *reply;
+        struct ofp_header *oh;
+
+        run(vconn_recv_block(vconn, &reply), "OpenFlow packet receive failed");
+        oh = reply->data;
+        if (oh->type == OFPT_ERROR) {
+            (*n_errors)++;
+        } else if (oh->type == OFPT_BARRIER_REPLY && oh->xid == xid) {
+            ofpbuf_delete(reply);
+            return;
+        }
+        ofpbuf_delete(reply);
+    }
+}
+
+/* Returns a copy of flow_mod 'template' given its own Ethernet source
+ * address derived from 'j', so that even a template for a single exact-match
+ * flow yields distinct flows. */
+static struct ofpbuf *
+make_bench_flow(const struct ofpbuf *template, int j)
+{
+    struct ofpbuf *request = ofpbuf_clone(template);
+    struct ofp_flow_mod *ofm = request->data;
+
+    ofm->header.xid = htonl(j);
+    ofm->match.wildcards &= ~htonl(OFPFW_DL_SRC);
+    ofm->match.dl_src[0] = 0x02;
+    ofm->match.dl_src[1] = 0x00;
+    ofm->match.dl_src[2] = j >> 24;
+    ofm->match.dl_src[3] = j >> 16;
+    ofm->match.dl_src[4] = j >> 8;
+    ofm->match.dl_src[5] = j;
+    return request;
+}
+
+static void
+do_benchmark_flows(const struct settings *s UNUSED, int argc, char *argv[])
+{
+    struct timeval start, end, batch_start[BENCH_MAX_BARRIERS];
+    uint32_t barrier_xid[BENCH_MAX_BARRIERS];
+    struct ofpbuf *template, *request;
+    struct vconn *vconn;
+    double *latency;
+    uint32_t xid;
+    int n_flows, batch, n_batches, n_done, n_errors;
+    double duration;
+    int i;
+
+    n_flows = atoi(argv[2]);
+    if (n_flows <= 0) {
+        ofp_fatal(0, "number of flows must be positive");
+    }
+    batch = argc > 4 ? atoi(argv[4]) : 100;
+    if (batch <= 0) {
+        ofp_fatal(0, "batch size must be positive");
+    }
+    template = parse_ofp_add_flow_str(argv[3]);
+    n_batches = (n_flows + batch - 1) / batch;
+    latency = xmalloc(n_batches * sizeof *latency);
+    n_done = n_errors = 0;
+
+    open_vconn(argv[1], &vconn);
+
+    /* Install the first flow on its own before starting the clock.  Otherwise
+     * a template that the switch rejects produces an error per flow, and
+     * once the switch's transmit queue fills it drops the barrier replies
+     * too, leaving us waiting forever. */
+    send_openflow_buffer(vconn, make_bench_flow(template, 0));
+    make_openflow(sizeof(struct ofp_header), OFPT_BARRIER_REQUEST, &request);
+    xid = ((struct ofp_header *) request->data)->xid;
+    send_openflow_buffer(vconn, request);
+    wait_for_barrier(vconn, xid, &n_errors);
+    if (n_errors) {
+        ofp_fatal(0, "switch rejected the flow; check its match and actions");
+    }
+
+    gettimeofday(&start, NULL);
+    for (i = 0; i < n_batches; i++) {
+        int slot = i % BENCH_MAX_BARRIERS;
+        struct ofp_header *oh;
+        int j;
+
+        if (i >= BENCH_MAX_BARRIERS) {
+            wait_for_barrier(vconn, barrier_xid[slot], &n_errors);
+            gettimeofday(&end, NULL);
+            latency[n_done++] = elapsed_ms(&batch_start[slot], &end);
+        }
+
+        gettimeofday(&batch_start[slot], NULL);
+        for (j = i * batch; j < (i + 1) * batch && j < n_flows; j++) {
+            send_openflow_buffer(vconn, make_bench_flow(template, j));
+        }
+
+        oh = make_openflow(sizeof *oh, OFPT_BARRIER_REQUEST, &request);
+        barrier_xid[slot] = oh->xid;
+        send_openflow_buffer(vconn, request);
+    }
+    for (i = MAX(0, n_batches - BENCH_MAX_BARRIERS); i < n_batches; i++) {
+        int slot = i % BENCH_MAX_BARRIERS;
+
+        wait_for_barrier(vconn, barrier_xid[slot], &n_errors);
+        gettimeofday(&end, NULL);
+        latency[n_done++] = elapsed_ms(&batch_start[slot], &end);
+    }
+    vconn_close(vconn);
+    ofpbuf_delete(template);
+
+    duration = elapsed_ms(&start, &end);
+    printf("Added %d flows in %.1f ms (%.0f flows/s), %d errors\n",
+           n_flows, duration, n_flows / (duration / 1000.0), n_errors);
+
+    qsort(latency, n_done, sizeof *latency, compare_doubles);
+    printf("Latency of %d-flow batches in ms: min %.2f, median %.2f, "
+           "90%% %.2f, 99%% %.2f, max %.2f\n", batch, latency[0],
+           latency[n_done / 2], latency[n_done * 9 / 10],
+           latency[n_done * 99 / 100], latency[n_done - 1]);
+    free(latency);
+}
+
+/* benchmark-controller emulates BENCH_HOSTS hosts behind each switch, spread
+ * across BENCH_PORTS ports.  Every packet_in goes from one host to the next,
+ * so once a learning switch has seen each host once it answers with flow
+ * setups rather than floods. */
+#define BENCH_HOSTS 100
+#define BENCH_PORTS 4
+
+/* Maximum number of packet_ins that one emulated switch leaves unanswered.
+ * The slot that a packet_in occupies is encoded in the low 8 bits of its
+ * buffer_id, which the controller echoes back in its response. */
+#define BENCH_MAX_WINDOW 256
+
+/* The latency histogram has 1-microsecond buckets up to this value; slower
+ * responses are counted in the last bucket. */
+#define BENCH_MAX_LATENCY 100000
+
+/* A packet_in unanswered for this many microseconds is counted as lost and
+ * its slot reused, since the controller may drop messages under load. */
+#define BENCH_LOSS_USEC 1000000
+
+struct bench_switch {
+    struct rconn *rconn;
+    uint64_t dpid;
+    bool ready;                 /* Features request answered? */
+    uint32_t next_seq;          /* Sequence number of the next packet_in. */
+    int n_outstanding;          /* Number of slots in use. */
+    long long int sent[BENCH_MAX_WINDOW]; /* Send time or 0 if slot free. */
+    uint32_t buffer_id[BENCH_MAX_WINDOW];
+};
+
+struct bench_stats {
+    unsigned long long int n_packet_ins;
+    unsigned long long int n_flow_mods;
+    unsigned long long int n_packet_outs;
+    unsigned long long int n_responses; /* Responses matched to packet_ins. */
+    unsigned long long int n_lost;
+    unsigned int *latency;      /* Histogram of round trips in us. */
+};
+
+static long long int
+time_usec(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000000LL + tv.tv_usec;
+}
+
+static void
+bench_send(struct bench_switch *sw, struct ofpbuf *b)
+{
+    if (rconn_send(sw->rconn, b, NULL)) {
+        ofpbuf_delete(b);
+    }
+}
+
+static void
+bench_host_mac(const struct bench_switch *sw, int host,
+               uint8_t mac[ETH_ADDR_LEN])
+{
+    mac[0] = 0x02;
+    mac[1] = 0x00;
+    mac[2] = sw->dpid >> 16;
+    mac[3] = sw->dpid >> 8;
+    mac[4] = sw->dpid;
+    mac[5] = host;
+}
+
+static void
+bench_send_packet_in(struct bench_switch *sw, struct bench_stats *stats)
+{
+    size_t pkt_ofs = offsetof(struct ofp_packet_in, data);
+    struct ofp_packet_in *opi;
+    struct eth_header *eth;
+    struct ip_header *ip;
+    struct ofpbuf *b;
+    int src, dst, slot;
+
+    for (slot = 0; sw->sent[slot]; slot++) {
+        continue;
+    }
+    src = sw->next_seq % BENCH_HOSTS;
+    dst = (src + 1) % BENCH_HOSTS;
+
+    opi = make_openflow(pkt_ofs + ETH_TOTAL_MIN, OFPT_PACKET_IN, &b);
+    sw->buffer_id[slot] = ((sw->next_seq++ & 0x7fffff) << 8) | slot;
+    opi->buffer_id = htonl(sw->buffer_id[slot]);
+    opi->total_len = htons(ETH_TOTAL_MIN);
+    opi->in_port = htons(1 + src % BENCH_PORTS);
+    opi->reason = OFPR_NO_MATCH;
+
+    eth = (struct eth_header *) opi->data;
+    bench_host_mac(sw, dst, eth->eth_dst);
+    bench_host_mac(sw, src, eth->eth_src);
+    eth->eth_type = htons(ETH_TYPE_IP);
+    ip = (struct ip_header *) (eth + 1);
+    ip->ip_ihl_ver = IP_IHL_VER(5, IP_VERSION);
+    ip->ip_tot_len = htons(ETH_TOTAL_MIN - ETH_HEADER_LEN);
+    ip->ip_ttl = 64;
+    ip->ip_proto = IP_TYPE_UDP;
+    ip->ip_src = htonl(0x0a000000 | src);
+    ip->ip_dst = htonl(0x0a000000 | dst);
+
+    sw->sent[slot] = time_usec();
+    sw->n_outstanding++;
+    stats->n_packet_ins++;
+    bench_send(sw, b);
+}
+
+/* Matches a response carrying 'buffer_id' against the packet_ins that 'sw'
+ * has outstanding and records its latency. */
+static void
+bench_complete(struct bench_switch *sw, struct bench_stats *stats,
+               uint32_t buffer_id)
+{
+    int slot = buffer_id & (BENCH_MAX_WINDOW - 1);
+    long long int usec;
+
+    if (!sw->sent[slot] || sw->buffer_id[slot] != buffer_id) {
+        return;
+    }
+    usec = time_usec() - sw->sent[slot];
+    stats->latency[MIN(usec, BENCH_MAX_LATENCY)]++;
+    stats->n_responses++;
+    sw->sent[slot] = 0;
+    sw->n_outstanding--;
+}
+
+static void
+bench_expire(struct bench_switch *sw, struct bench_stats *stats,
+             long long int now)
+{
+    int slot;
+
+    for (slot = 0; sw->n_outstanding && slot < BENCH_MAX_WINDOW; slot++) {
+        if (sw->sent[slot] && now - sw->sent[slot] > BENCH_LOSS_USEC) {
+            sw->sent[slot] = 0;
+            sw->n_outstanding--;
+            stats->n_lost++;
+        }
+    }
+}
+
+static void
+bench_process(struct bench_switch *sw, struct bench_stats *stats,
+              const struct ofpbuf *msg)
+{
+    const struct ofp_header *oh = msg->data;
+    struct ofp_switch_features *osf;
+    struct ofpbuf *b;
+
+    switch (oh->type) {
+    case OFPT_FEATURES_REQUEST:
+        osf = make_openflow_xid(sizeof *osf, OFPT_FEATURES_REPLY, oh->xid,
+                                &b);
+        osf->datapath_id = htonll(sw->dpid);
+        osf->n_buffers = htonl(BENCH_MAX_WINDOW);
+        osf->n_tables = 1;
+        bench_send(sw, b);
+        sw->ready = true;
+        break;
+
+    case OFPT_ECHO_REQUEST:
+        bench_send(sw, make_echo_reply(oh));
+        break;
+
+    case OFPT_FLOW_MOD:
+        if (msg->size >= sizeof(struct ofp_flow_mod)) {
+            const struct ofp_flow_mod *ofm = msg->data;
+            stats->n_flow_mods++;
+            bench_complete(sw, stats, ntohl(ofm->buffer_id));
+        }
+        break;
+
+    case OFPT_PACKET_OUT:
+        if (msg->size >= sizeof(struct ofp_packet_out)) {
+            const struct ofp_packet_out *opo = msg->data;
+            stats->n_packet_outs++;
+            bench_complete(sw, stats, ntohl(opo->buffer_id));
+        }
+        break;
+    }
+}
+
+/* Returns the value at 'fraction' (between 0 and 1) of the way through the
+ * 'n' samples in latency histogram 'hist'. */
+static int
+bench_percentile(const unsigned int *hist, unsigned long long int n,
+                 double fraction)
+{
+    unsigned long long int rank = fraction * (n - 1);
+    unsigned long long int count = 0;
+    int i;
+
+    for (i = 0; i < BENCH_MAX_LATENCY; i++) {
+        count += hist[i];
+        if (count > rank) {
+            break;
+        }
+    }
+    return i;
+}
+
+static void
+do_benchmark_controller(const struct settings *s UNUSED,
+                        int argc, char *argv[])
+{
+    struct bench_switch *switches;
+    struct bench_stats stats;
+    unsigned long long int last_responses;
+    long long int start, end, now, next_report, last_report, next_expire;
+    int n_switches, secs, window;
+    double elapsed;
+    int i;
+
+    n_switches = argc > 2 ? atoi(argv[2]) : 16;
+    secs = argc > 3 ? atoi(argv[3]) : 10;
+    window = argc > 4 ? atoi(argv[4]) : 1;
+    if (n_switches <= 0 || n_switches > 0xffffff) {
+        ofp_fatal(0, "number of switches must be between 1 and %d",
+                  0xffffff);
+    } else if (secs <= 0) {
+        ofp_fatal(0, "duration must be positive");
+    } else if (window <= 0 || window > BENCH_MAX_WINDOW) {
+        ofp_fatal(0, "window must be between 1 and %d", BENCH_MAX_WINDOW);
+    }
+
+    memset(&stats, 0, sizeof stats);
+    stats.latency = xcalloc(BENCH_MAX_LATENCY + 1, sizeof *stats.latency);
+    switches = xcalloc(n_switches, sizeof *switches);
+    for (i = 0; i < n_switches; i++) {
+        struct vconn *vconn;
+
+        open_vconn(argv[1], &vconn);
+        switches[i].rconn = rconn_new_from_vconn(argv[1], vconn);
+        switches[i].dpid = i + 1;
+    }
+
+    start = last_report = time_usec();
+    end = start + secs * 1000000LL;
+    next_report = start + 1000000;
+    next_expire = start + BENCH_LOSS_USEC / 10;
+    last_responses = 0;
+    for (;;) {
+        for (i = 0; i < n_switches; i++) {
+            struct bench_switch *sw = &switches[i];
+            int j;
+
+            rconn_run(sw->rconn);
+            for (j = 0; j < 50; j++) {
+                struct ofpbuf *msg = rconn_recv(sw->rconn);
+                if (!msg) {
+                    break;
+                }
+                bench_process(sw, &stats, msg);
+                ofpbuf_delete(msg);
+            }
+            if (!rconn_is_alive(sw->rconn)) {
+                ofp_fatal(0, "%s: connection closed", argv[1]);
+            }
+            while (sw->ready && sw->n_outstanding < window) {
+                bench_send_packet_in(sw, &stats);
+            }
+        }
+
+        now = time_usec();
+        if (now >= next_expire) {
+            for (i = 0; i < n_switches; i++) {
+                bench_expire(&switches[i], &stats, now);
+            }
+            next_expire = now + BENCH_LOSS_USEC / 10;
+        }
+        if (now >= next_report) {
+            printf("%d switches: %.0f responses/s\n", n_switches,
+                   (stats.n_responses - last_responses)
+                   / ((now - last_report) / 1e6));
+            last_responses = stats.n_responses;
+            last_report = now;
+            next_report += 1000000;
+        }
+        if (now >= end) {
+            break;
+        }
+
+        for (i = 0; i < n_switches; i++) {
+            rconn_run_wait(switches[i].rconn);
+            rconn_recv_wait(switches[i].rconn);
+        }
+        poll_timer_wait((MIN(next_report, next_expire) - now) / 1000 + 1);
+        poll_block();
+    }
+
+    elapsed = (now - start) / 1e6;
+    printf("Sent %llu packet_ins in %.1f s; received %llu flow_mods and "
+           "%llu packet_outs (%.0f responses/s), %llu lost\n",
+           stats.n_packet_ins, elapsed, stats.n_flow_mods,
+           stats.n_packet_outs, stats.n_responses / elapsed, stats.n_lost);
+    if (stats.n_responses) {
+        printf("Latency in us: min %d, median %d, 90%% %d, 99%% %d, "
+               "max %d\n",
+               bench_percentile(stats.latency, stats.n_responses, 0),
+               bench_percentile(stats.latency, stats.n_responses, .5),
+               bench_percentile(stats.latency, stats.n_responses, .9),
+               bench_percentile(stats.latency, stats.n_responses, .99),
+               bench_percentile(stats.latency, stats.n_responses, 1));
+    }
+
+    for (i = 0; i < n_switches; i++) {
+        rconn_destroy(switches[i].rconn);
+    }
+    free(switches);
+    free(stats.latency);
+}
+
+/* Sends an echo request with 'payload_size' bytes of payload on 'conn', in
+ * the first free slot of its window.  The slot is encoded in the low 8 bits of
+ * the request's xid, which the echo reply carries back. */
+static void
+bench_send_echo(struct bench_switch *conn, unsigned int payload_size)
+{
+    struct ofp_header *oh;
+    struct ofpbuf *b;
+    int slot;
+
+    for (slot = 0; conn->sent[slot]; slot++) {
+        continue;
+    }
+    oh = make_openflow(sizeof *oh + payload_size, OFPT_ECHO_REQUEST, &b);
+    memset(oh + 1, 0, payload_size);
+    conn->buffer_id[slot] = ((conn->next_seq++ & 0xffffff) << 8) | slot;
+    oh->xid = htonl(conn->buffer_id[slot]);
+
+    conn->sent[slot] = time_usec();
+    conn->n_outstanding++;
+    bench_send(conn, b);
+}
+
+static void
+do_benchmark(const struct settings *s UNUSED, int argc, char *argv[])
+{
+    size_t max_payload = 65535 - sizeof(struct ofp_header);
+    unsigned int payload_size, message_size;
+    struct bench_switch *conns;
+    struct bench_stats stats;
+    unsigned long long int last_responses;
+    long long int start, now, next_report, last_report, next_expire;
+    int count, window, n_conns, n_sent;
+    double duration;
+    int i;
+
+    payload_size = atoi(argv[2]);
+    if (payload_size > max_payload) {
+        ofp_fatal(0, "payload must be between 0 and %zu bytes", max_payload);
+    }
+    message_size = sizeof(struct ofp_header) + payload_size;
+
+    count = atoi(argv[3]);
+    window = argc > 4 ? atoi(argv[4]) : 1;
+    n_conns = argc > 5 ? atoi(argv[5]) : 1;
+    if (count <= 0) {
+        ofp_fatal(0, "count must be positive");
+    } else if (window <= 0 || window > BENCH_MAX_WINDOW) {
+        ofp_fatal(0, "window must be between 1 and %d", BENCH_MAX_WINDOW);
+    } else if (n_conns <= 0) {
+        ofp_fatal(0, "number of connections must be positive");
+    }
+
+    printf("Sending %d packets * %u bytes (with header) = %u bytes total\n",
+           count, message_size, count * message_size);
+    if (window > 1 || n_conns > 1) {
+        printf("Using %d connection(s) with up to %d request(s) "
+               "outstanding on each\n", n_conns, window);
+    }
+
+    memset(&stats, 0, sizeof stats);
+    stats.latency = xcalloc(BENCH_MAX_LATENCY + 1, sizeof *stats.latency);
+    conns = xcalloc(n_conns, sizeof *conns);
+    for (i = 0; i < n_conns; i++) {
+        struct vconn *vconn;
+
+        open_vconn(argv[1], &vconn);
+        conns[i].rconn = rconn_new_from_vconn(argv[1], vconn);
+    }
+
+    start = last_report = time_usec();
+    next_report = start + 1000000;
+    next_expire = start + BENCH_LOSS_USEC / 10;
+    last_responses = 0;
+    n_sent = 0;
+    for (;;) {
+        for (i = 0; i < n_conns; i++) {
+            struct bench_switch *conn = &conns[i];
+            int j;
+
+            rconn_run(conn->rconn);
+            for (j = 0; j < 50; j++) {
+                struct ofpbuf *msg = rconn_recv(conn->rconn);
+                struct ofp_header *oh;
+
+                if (!msg) {
+                    break;
+                }
+                oh = msg->data;
+                if (oh->type == OFPT_ECHO_REPLY) {
+                    bench_complete(conn, &stats, ntohl(oh->xid));
+                } else if (oh->type == OFPT_ECHO_REQUEST) {
+                    bench_send(conn, make_echo_reply(oh));
+                }
+                ofpbuf_delete(msg);
+            }
+            if (!rconn_is_alive(conn->rconn)) {
+                ofp_fatal(0, "%s: connection closed", argv[1]);
+            }
+            while (conn->n_outstanding < window && n_sent < count) {
+                bench_send_echo(conn, payload_size);
+                n_sent++;
+            }
+        }
+
+        now = time_usec();
+        if (now >= next_expire) {
+            for (i = 0; i < n_conns; i++) {
+                bench_expire(&conns[i], &stats, now);
+            }
+            next_expire = now + BENCH_LOSS_USEC / 10;
+        }
+        if (stats.n_responses + stats.n_lost >= count) {
+            break;
+        }
+        if (now >= next_report) {
+            double rate = ((stats.n_responses - last_responses)
+                           / ((now - last_report) / 1e6));
+            printf("%.0f packets/s (%.0f bytes/s)\n",
+                   rate, rate * message_size);
+            last_responses = stats.n_responses;
+            last_report = now;
+            next_report += 1000000;
+        }
+
+        for (i = 0; i < n_conns; i++) {
+            rconn_run_wait(conns[i].rconn);
+            rconn_recv_wait(conns[i].rconn);
+        }
+        poll_timer_wait((MIN(next_report, next_expire) - now) / 1000 + 1);
+        poll_block();
+    }
+
+    duration = (now - start) / 1000.0;
+    printf("Finished in %.1f ms (%.0f packets/s) (%.0f bytes/s)\n",
+           duration, stats.n_responses / (duration / 1000.0),
+           stats.n_responses * message_size / (duration / 1000.0));
+    if (stats.n_lost) {
+        printf("%llu echo requests went unanswered\n", stats.n_lost);
+    }
+    if (stats.n_responses) {
+        printf("Latency in us: min %d, median %d, 90%% %d, 99%% %d, "
+               "max %d\n",
+               bench_percentile(stats.latency, stats.n_responses, 0),
+               bench_percentile(stats.latency, stats.n_responses, .5),
+               bench_percentile(stats.latency, stats.n_responses, .9),
+               bench_percentile(stats.latency, stats.n_responses, .99),
+               bench_percentile(stats.latency, stats.n_responses, 1));
+    }
+
+    for (i = 0; i < n_conns; i++) {
+        rconn_destroy(conns[i].rconn);
+    }
+    free(conns);
+    free(stats.latency);
+}
+
+/* benchmark-install sends its probes as UDP packets to this port.  Flow 'i'
+ * matches the probes to 198.18.0.0 + 'i', in the range that RFC 2544 sets
+ * aside for benchmarks. */
+#define BENCH_PROBE_PORT 9
+#define BENCH_PROBE_NET 0xc6120000
+#define BENCH_MAX_PROBE_FLOWS 131072
+
+/* Most probes that benchmark-install sends between checks for forwarded
+ * probes and barrier replies. */
+#define BENCH_PROBE_BURST 16
+
+/* benchmark-install gives up on flows that have not forwarded a probe after
+ * this many microseconds without progress. */
+#define BENCH_INSTALL_TIMEOUT_USEC 5000000
+
+/* A flow that benchmark-install adds.  Times are in microseconds, 0 if the
+ * event has not happened yet. */
+struct bench_probe_flow {
+    long long int sent;         /* Flow_mod sent. */
+    long long int acked;        /* Reply to the following barrier received. */
+    long long int forwarded;    /* First probe received on the output port. */
+    bool failed;                /* Switch replied with an error. */
+};
+
+/* A probe flow is done once the switch has rejected it, or has both
+ * acknowledged it and forwarded a probe with it. */
+static bool
+bench_probe_flow_done(const struct bench_probe_flow *f)
+{
+    return f->failed || (f->acked && f->forwarded);
+}
+
+/* Returns a flow_mod for the probe flows: flow 'i' if 'i' is nonnegative,
+ * otherwise a flow that matches every probe. */
+static struct ofpbuf *
+make_probe_flow_mod(uint16_t command, int i, size_t actions_len)
+{
+    uint32_t wildcards = OFPFW_ALL & ~(OFPFW_DL_TYPE | OFPFW_NW_PROTO
+                                       | OFPFW_TP_DST);
+    struct ofp_flow_mod *ofm;
+    struct ofpbuf *buffer;
+    struct flow flow;
+
+    memset(&flow, 0, sizeof flow);
+    flow.dl_type = htons(ETH_TYPE_IP);
+    flow.nw_proto = IP_TYPE_UDP;
+    flow.tp_dst = htons(BENCH_PROBE_PORT);
+    if (i >= 0) {
+        flow.nw_dst = htonl(BENCH_PROBE_NET + i);
+        wildcards &= ~OFPFW_NW_DST_MASK;
+    }
+
+    buffer = make_flow_mod(command, &flow, actions_len);
+    ofm = buffer->data;
+    ofm->match.wildcards = htonl(wildcards);
+    ofm->header.xid = htonl(i);
+    ofm->buffer_id = htonl(UINT32_MAX);
+    ofm->out_port = htons(OFPP_NONE);
+    ofm->hard_timeout = htons(OFP_FLOW_PERMANENT);
+    ofm->priority = htons(i >= 0 ? OFP_DEFAULT_PRIORITY : 1);
+    return buffer;
+}
+
+/* Sends a probe for flow 'i' on 'netdev', from 'netdev''s Ethernet address to
+ * 'dst_mac'. */
+static void
+bench_send_probe(struct netdev *netdev, const uint8_t dst_mac[ETH_ADDR_LEN],
+                 int i)
+{
+    struct eth_header *eth;
+    struct ip_header *ip;
+    struct udp_header *udp;
+    struct ofpbuf packet;
+    uint8_t data[ETH_TOTAL_MIN];
+    int retval;
+
+    memset(data, 0, sizeof data);
+    ofpbuf_use(&packet, data, sizeof data);
+    eth = ofpbuf_put_uninit(&packet, ETH_HEADER_LEN);
+    memcpy(eth->eth_dst, dst_mac, ETH_ADDR_LEN);
+    memcpy(eth->eth_src, netdev_get_etheraddr(netdev), ETH_ADDR_LEN);
+    eth->eth_type = htons(ETH_TYPE_IP);
+
+    ip = ofpbuf_put_zeros(&packet, IP_HEADER_LEN);
+    ip->ip_ihl_ver = IP_IHL_VER(5, IP_VERSION);
+    ip->ip_tot_len = htons(ETH_PAYLOAD_MIN);
+    ip->ip_ttl = 64;
+    ip->ip_proto = IP_TYPE_UDP;
+    ip->ip_src = htonl(BENCH_PROBE_NET | 0x1ffff);
+    ip->ip_dst = htonl(BENCH_PROBE_NET + i);
+    ip->ip_csum = csum(ip, IP_HEADER_LEN);
+
+    udp = ofpbuf_put_zeros(&packet, UDP_HEADER_LEN);
+    udp->udp_src = htons(BENCH_PROBE_PORT);
+    udp->udp_dst = htons(BENCH_PROBE_PORT);
+    udp->udp_len = htons(ETH_PAYLOAD_MIN - IP_HEADER_LEN);
+    packet.size = sizeof data;
+
+    retval = netdev_send(netdev, &packet, 0);
+    if (retval && retval != EAGAIN) {
+        ofp_fatal(retval, "%s: failed to send probe",
+                  netdev_get_name(netdev));
+    }
+}
+
+static void
+bench_print_percentiles(const char *title, const unsigned int *hist,
+                        unsigned long long int n)
+{
+    printf("%s in us: min %d, median %d, 90%% %d, 99%% %d, max %d\n", title,
+           bench_percentile(hist, n, 0), bench_percentile(hist, n, .5),
+           bench_percentile(hist, n, .9), bench_percentile(hist, n, .99),
+           bench_percentile(hist, n, 1));
+}
+
+static void
+do_benchmark_install(const struct settings *s UNUSED, int argc, char *argv[])
+{
+    struct bench_probe_flow *flows;
+    struct netdev *tx_netdev, *rx_netdev;
+    uint8_t dst_mac[ETH_ADDR_LEN];
+    unsigned int *ack_hist, *fwd_hist, *late_hist;
+    struct ofpbuf *request, *packet;
+    struct vconn *vconn;
+    long long int start, now, last_progress, next_report, first_sent;
+    long long int last_forwarded;
+    int n_flows, window, n_sent, n_open, n_done, n_acked, n_forwarded;
+    int n_failed, n_late, low, cursor;
+    uint16_t out_port;
+    uint32_t xid;
+    int retval;
+    int i;
+
+    str_to_port(argv[4], &out_port);
+    n_flows = argc > 5 ? atoi(argv[5]) : 100;
+    window = argc > 6 ? atoi(argv[6]) : 1;
+    if (n_flows <= 0 || n_flows > BENCH_MAX_PROBE_FLOWS) {
+        ofp_fatal(0, "number of flows must be between 1 and %d",
+                  BENCH_MAX_PROBE_FLOWS);
+    } else if (window <= 0) {
+        ofp_fatal(0, "window must be positive");
+    }
+
+    retval = netdev_open(argv[2], NETDEV_ETH_TYPE_NONE, &tx_netdev);
+    if (retval) {
+        ofp_fatal(retval, "%s: could not open network device", argv[2]);
+    }
+    retval = netdev_open(argv[3], NETDEV_ETH_TYPE_ANY, &rx_netdev);
+    if (retval) {
+        ofp_fatal(retval, "%s: could not open network device", argv[3]);
+    }
+    memcpy(dst_mac, netdev_get_etheraddr(rx_netdev), ETH_ADDR_LEN);
+    packet = ofpbuf_new(ETH_HEADER_LEN + VLAN_HEADER_LEN
+                        + netdev_get_mtu(rx_netdev));
+
+    /* Start from a table without probe flows, plus a low-priority flow that
+     * drops the probes that no probe flow matches yet, so that they do not go
+     * to the controller. */
+    open_vconn(argv[1], &vconn);
+    send_openflow_buffer(vconn, make_probe_flow_mod(OFPFC_DELETE, -1, 0));
+    send_openflow_buffer(vconn, make_probe_flow_mod(OFPFC_ADD, -1, 0));
+    make_openflow(sizeof(struct ofp_header), OFPT_BARRIER_REQUEST, &request);
+    xid = ((struct ofp_header *) request->data)->xid;
+    send_openflow_buffer(vconn, request);
+    n_failed = 0;
+    wait_for_barrier(vconn, xid, &n_failed);
+    if (n_failed) {
+        ofp_fatal(0, "switch rejected the flow that drops unmatched probes");
+    }
+    netdev_drain(rx_netdev);
+
+    flows = xcalloc(n_flows, sizeof *flows);
+    ack_hist = xcalloc(BENCH_MAX_LATENCY + 1, sizeof *ack_hist);
+    fwd_hist = xcalloc(BENCH_MAX_LATENCY + 1, sizeof *fwd_hist);
+    late_hist = xcalloc(BENCH_MAX_LATENCY + 1, sizeof *late_hist);
+    n_sent = n_open = n_done = n_acked = n_forwarded = n_late = 0;
+    low = cursor = 0;
+    start = last_progress = first_sent = last_forwarded = time_usec();
+    next_report = start + 1000000;
+    while (n_done < n_flows) {
+        struct ofpbuf *msg;
+
+        /* Add flows until 'window' of them have not both been acknowledged
+         * and forwarded a probe. */
+        while (n_sent < n_flows && n_open < window) {
+            struct ofp_action_output *oao;
+            struct ofpbuf *flow_mod;
+
+            flow_mod = make_probe_flow_mod(OFPFC_ADD, n_sent, sizeof *oao);
+            oao = ofpbuf_put_zeros(flow_mod, sizeof *oao);
+            oao->type = htons(OFPAT_OUTPUT);
+            oao->len = htons(sizeof *oao);
+            oao->port = htons(out_port);
+            make_openflow_xid(sizeof(struct ofp_header), OFPT_BARRIER_REQUEST,
+                              htonl(n_sent), &request);
+
+            flows[n_sent].sent = time_usec();
+            if (!n_sent) {
+                first_sent = flows[n_sent].sent;
+            }
+            send_openflow_buffer(vconn, flow_mod);
+            send_openflow_buffer(vconn, request);
+            n_sent++;
+            n_open++;
+        }
+
+        /* Probe the flows that have not forwarded anything yet, taking turns
+         * so that each gets probed about equally often. */
+        while (low < n_sent && (flows[low].forwarded || flows[low].failed)) {
+            low++;
+        }
+        if (cursor < low) {
+            cursor = low;
+        }
+        if (low < n_sent) {
+            int stop = cursor;
+            int n_probes = 0;
+
+            do {
+                const struct bench_probe_flow *f = &flows[cursor];
+                if (!f->forwarded && !f->failed) {
+                    bench_send_probe(tx_netdev, dst_mac, cursor);
+                    n_probes++;
+                }
+                if (++cursor >= n_sent) {
+                    cursor = low;
+                }
+            } while (n_probes < BENCH_PROBE_BURST && cursor != stop);
+        }
+
+        /* Note the probes that the flows forwarded. */
+        for (i = 0; i < 64; i++) {
+            struct flow flow;
+            uint32_t idx;
+
+            ofpbuf_clear(packet);
+            if (netdev_recv(rx_netdev, packet)) {
+                break;
+            }
+            flow_extract(packet, 0, &flow);
+            idx = ntohl(flow.nw_dst) - BENCH_PROBE_NET;
+            if (flow.dl_type == htons(ETH_TYPE_IP)
+                && flow.nw_proto == IP_TYPE_UDP
+                && flow.tp_dst == htons(BENCH_PROBE_PORT)
+                && idx < n_sent && !flows[idx].forwarded
+                && !flows[idx].failed) {
+                struct bench_probe_flow *f = &flows[idx];
+
+                f->forwarded = last_forwarded = time_usec();
+                fwd_hist[MIN(f->forwarded - f->sent, BENCH_MAX_LATENCY)]++;
+                n_forwarded++;
+                if (bench_probe_flow_done(f)) {
+                    n_open--;
+                    n_done++;
+                }
+                last_progress = f->forwarded;
+            }
+        }
+
+        /* Note the barrier replies and errors. */
+        while (!vconn_recv(vconn, &msg)) {
+            struct ofp_header *oh = msg->data;
+            uint32_t idx = ntohl(oh->xid);
+
+            if (oh->type == OFPT_ECHO_REQUEST) {
+                send_openflow_buffer(vconn, make_echo_reply(oh));
+            } else if (idx < n_sent && !flows[idx].acked
+                       && !flows[idx].failed
+                       && (oh->type == OFPT_BARRIER_REPLY
+                           || oh->type == OFPT_ERROR)) {
+                struct bench_probe_flow *f = &flows[idx];
+
+                last_progress = time_usec();
+                if (oh->type == OFPT_ERROR) {
+                    f->failed = true;
+                    n_failed++;
+                } else {
+                    f->acked = last_progress;
+                    ack_hist[MIN(f->acked - f->sent, BENCH_MAX_LATENCY)]++;
+                    n_acked++;
+                }
+                if (bench_probe_flow_done(f)) {
+                    n_open--;
+                    n_done++;
+                }
+            }
+            ofpbuf_delete(msg);
+        }
 
-    /* If the user specified, e.g., "nl:0", append ":1" to it to ensure that
-     * the connection will subscribe to listen for asynchronous messages, such
-     * as packet-in messages. */
-    if (!strncmp(argv[1], "nl:", 3) && strrchr(argv[1], ':') == &argv[1][2]) {
-        name = xasprintf("%s:1", argv[1]);
-    } else {
-        name = argv[1];
+        now = time_usec();
+        if (now - last_progress > BENCH_INSTALL_TIMEOUT_USEC) {
+            break;
+        }
+        if (now >= next_report) {
+            printf("%d of %d flows in effect\n", n_forwarded, n_flows);
+            next_report += 1000000;
+        }
     }
-    open_vconn(argv[1], &vconn);
-    for (;;) {
-        struct ofpbuf *b;
-        run(vconn_recv_block(vconn, &b), "vconn_recv");
-        ofp_print(stderr, b->data, b->size, 2);
-        ofpbuf_delete(b);
+    now = time_usec();
+
+    /* Flows that both forwarded a probe and were acknowledged count as late
+     * if the switch acknowledged them before the datapath used them. */
+    for (i = 0; i < n_sent; i++) {
+        const struct bench_probe_flow *f = &flows[i];
+        if (f->acked && f->forwarded > f->acked) {
+            late_hist[MIN(f->forwarded - f->acked, BENCH_MAX_LATENCY)]++;
+            n_late++;
+        }
     }
-}
-
-static void
-str_to_port(char *string, uint16_t *start_port)
-{
-    char *save_ptr = NULL;
-    char *value = NULL;
 
-    if (start_port) {
-        *start_port = OFPP_NONE;
+    printf("Added %d flows in %.1f ms", n_sent, (now - start) / 1000.0);
+    if (n_forwarded) {
+        double secs = MAX(last_forwarded - first_sent, 1) / 1e6;
+        printf(" (%.0f flows/s in effect)", n_forwarded / secs);
     }
-
-    value = strtok_r(string, ", \t\r\n", &save_ptr);
-    if (value && start_port) {
-        *start_port = atoi(value);
+    printf(", %d rejected, %d never forwarded a probe\n",
+           n_failed, n_sent - n_forwarded - n_failed);
+    if (n_acked) {
+        bench_print_percentiles("Flow_mod to barrier reply", ack_hist,
+                                n_acked);
+    }
+    if (n_forwarded) {
+        bench_print_percentiles("Flow_mod to first forwarded probe",
+                                fwd_hist, n_forwarded);
     }
+    printf("%d flows forwarded probes only after their barrier reply\n",
+           n_late);
+    if (n_late) {
+        bench_print_percentiles("Barrier reply to first forwarded probe",
+                                late_hist, n_late);
+    }
+
+    send_openflow_buffer(vconn, make_probe_flow_mod(OFPFC_DELETE, -1, 0));
+    make_openflow(sizeof(struct ofp_header), OFPT_BARRIER_REQUEST, &request);
+    xid = ((struct ofp_header *) request->data)->xid;
+    send_openflow_buffer(vconn, request);
+    wait_for_barrier(vconn, xid, &n_failed);
+
+    vconn_close(vconn);
+    netdev_close(tx_netdev);
+    netdev_close(rx_netdev);
+    ofpbuf_delete(packet);
+    free(flows);
+    free(ack_hist);
+    free(fwd_hist);
+    free(late_hist);
 }
 
-static void
-do_dump_ports(const struct settings *s UNUSED, int argc, char *argv[])
+/* Largest OFP_EXT_FLOW_IMPORT message that restore-flows sends. */
+#define MAX_FLOW_IMPORT_BYTES 60000
+
+/* Returns the length of the struct ofp_ext_flow_record at the start of the
+ * 'size' bytes at 'p', or 0 if it is truncated or malformed. */
+static size_t
+flow_record_len(const void *p, size_t size)
 {
-    struct ofp_port_stats_request *psr;
-    struct ofpbuf *buf;
+    const struct ofp_ext_flow_record *rec = p;
+    size_t length;
 
-    psr = alloc_stats_request(sizeof(*psr), OFPST_PORT, &buf);
-    str_to_port(argc > 2 ? argv[2] : "", &psr->port_no);
-    psr->port_no = htons(psr->port_no);
-    memset(psr->pad, 0, sizeof(psr->pad));
-    dump_stats_transaction(argv[1], buf);
+    if (size < sizeof *rec) {
+        return 0;
+    }
+    length = ntohs(rec->length);
+    return (length >= sizeof *rec && length % 8 == 0 && length <= size
+            ? length : 0);
 }
 
 static void
-do_probe(const struct settings *s UNUSED, int argc UNUSED, char *argv[])
+do_save_flows(const struct settings *s UNUSED, int argc UNUSED, char *argv[])
 {
-    struct ofpbuf *request;
+    struct ofp_extension_stats_header *esh;
+    struct ofp_ext_flow_file_header *fh;
+    struct ofp_switch_features *osf;
+    struct ofpbuf *request, *reply;
+    struct ofpbuf *records;
     struct vconn *vconn;
-    struct ofpbuf *reply;
+    uint32_t send_xid;
+    uint32_t n_flows;
+    char *tmp_name;
+    bool done;
+    FILE *file;
+
+    records = ofpbuf_new(65536);
+    fh = ofpbuf_put_zeros(records, sizeof *fh);
 
-    make_openflow(sizeof(struct ofp_header), OFPT_ECHO_REQUEST, &request);
     open_vconn(argv[1], &vconn);
+    make_openflow(sizeof(struct ofp_header), OFPT_FEATURES_REQUEST, &request);
     run(vconn_transact(vconn, request, &reply), "talking to %s", argv[1]);
-    if (reply->size != sizeof(struct ofp_header)) {
-        ofp_fatal(0, "reply does not match request");
-    }
+    osf = reply->data;
+    fh->datapath_id = osf->datapath_id;
     ofpbuf_delete(reply);
+
+    esh = alloc_stats_request(sizeof *esh, OFPST_VENDOR, &request);
+    esh->vendor = htonl(OPENFLOW_VENDOR_ID);
+    esh->subtype = htonl(OFP_EXT_STATS_FLOW_EXPORT);
+    send_xid = ((struct ofp_header *) request->data)->xid;
+    send_openflow_buffer(vconn, request);
+
+    n_flows = 0;
+    for (done = false; !done; ) {
+        struct ofp_header *oh;
+        struct ofp_stats_reply *osr;
+        const uint8_t *p, *end;
+
+        run(vconn_recv_block(vconn, &reply), "OpenFlow packet receive failed");
+        oh = reply->data;
+        if (oh->xid != send_xid) {
+            ofpbuf_delete(reply);
+            continue;
+        } else if (oh->type == OFPT_ERROR) {
+            ofp_print(stderr, reply->data, reply->size, 1);
+            ofp_fatal(0, "%s: switch does not support flow export", argv[1]);
+        }
+
+        osr = ofpbuf_at(reply, 0, (offsetof(struct ofp_stats_reply, body)
+                                   + sizeof(struct ofp_ext_flow_export)));
+        if (oh->type != OFPT_STATS_REPLY || !osr) {
+            ofp_fatal(0, "%s: unexpected reply to flow export", argv[1]);
+        }
+        done = !(ntohs(osr->flags) & OFPSF_REPLY_MORE);
+
+        p = osr->body + sizeof(struct ofp_ext_flow_export);
+        end = (const uint8_t *) reply->data + reply->size;
+        while (p < end) {
+            size_t length = flow_record_len(p, end - p);
+            if (!length) {
+                ofp_fatal(0, "%s: malformed flow export record", argv[1]);
+            }
+            ofpbuf_put(records, p, length);
+            p += length;
+            n_flows++;
+        }
+        ofpbuf_delete(reply);
+    }
     vconn_close(vconn);
+
+    fh = records->data;
+    fh->magic = htonl(OFP_EXT_FLOW_FILE_MAGIC);
+    fh->version = htonl(OFP_EXT_FLOW_FILE_VERSION);
+    fh->n_flows = htonl(n_flows);
+
+    /* Write to a temporary file and rename it into place, so that a failure
+     * never leaves a partial snapshot where restore-flows would find it. */
+    tmp_name = xasprintf("%s.tmp", argv[2]);
+    file = fopen(tmp_name, "wb");
+    if (!file) {
+        ofp_fatal(errno, "%s: open", tmp_name);
+    }
+    if (fwrite(records->data, records->size, 1, file) != 1
+        || fflush(file) || fsync(fileno(file)) || fclose(file)) {
+        ofp_fatal(errno, "%s: write", tmp_name);
+    }
+    if (rename(tmp_name, argv[2])) {
+        ofp_fatal(errno, "%s: rename", tmp_name);
+    }
+    free(tmp_name);
+    ofpbuf_delete(records);
+
+    printf("saved %"PRIu32" flows to %s\n", n_flows, argv[2]);
 }
 
+/* Sends the OFP_EXT_FLOW_IMPORT message in 'msg', if it holds any
+ * records, and starts a new one. */
 static void
-do_mod_port(const struct settings *s UNUSED, int argc UNUSED, char *argv[])
+send_flow_import(struct vconn *vconn, struct ofpbuf **msg)
 {
-    struct ofpbuf *request, *reply;
-    struct ofp_switch_features *osf;
-    struct ofp_port_mod *opm;
-    struct vconn *vconn;
-    char *endptr;
-    int n_ports;
-    int port_idx;
-    int port_no;
-    
+    struct ofp_ext_flow_import *ofi;
 
-    /* Check if the argument is a port index.  Otherwise, treat it as
-     * the port name. */
-    port_no = strtol(argv[2], &endptr, 10);
-    if (port_no == 0 && endptr == argv[2]) {
-        port_no = -1;
+    if (*msg && (*msg)->size > sizeof *ofi) {
+        send_openflow_buffer(vconn, *msg);
+    } else if (*msg) {
+        ofpbuf_delete(*msg);
     }
 
-    /* Send a "Features Request" to get the information we need in order 
-     * to modify the port. */
-    make_openflow(sizeof(struct ofp_header), OFPT_FEATURES_REQUEST, &request);
-    open_vconn(argv[1], &vconn);
-    run(vconn_transact(vconn, request, &reply), "talking to %s", argv[1]);
+    ofi = make_openflow(sizeof *ofi, OFPT_VENDOR, msg);
+    ofi->header.vendor = htonl(OPENFLOW_VENDOR_ID);
+    ofi->header.subtype = htonl(OFP_EXT_FLOW_IMPORT);
+}
 
-    osf = reply->data;
-    n_ports = (reply->size - sizeof *osf) / sizeof *osf->ports;
+static void
+do_restore_flows(const struct settings *s UNUSED, int argc UNUSED,
+                 char *argv[])
+{
+    const struct ofp_ext_flow_file_header *fh;
+    struct ofpbuf *contents, *msg, *request;
+    struct timeval start, end;
+    const uint8_t *p, *limit;
+    struct vconn *vconn;
+    uint32_t n_flows, i;
+    int n_errors;
+    FILE *file;
 
-    for (port_idx = 0; port_idx < n_ports; port_idx++) {
-        if (port_no != -1) {
-            /* Check argument as a port index */
-            if (osf->ports[port_idx].port_no == htons(port_no)) {
-                break;
-            }
-        } else {
-            /* Check argument as an interface name */
-            if (!strncmp((char *)osf->ports[port_idx].name, argv[2], 
-                        sizeof osf->ports[0].name)) {
-                break;
-            }
+    file = fopen(argv[2], "rb");
+    if (!file) {
+        ofp_fatal(errno, "%s: open", argv[2]);
+    }
+    contents = ofpbuf_new(65536);
+    for (;;) {
+        size_t n;
 
+        ofpbuf_prealloc_tailroom(contents, 65536);
+        n = fread(ofpbuf_tail(contents), 1, ofpbuf_tailroom(contents), file);
+        if (!n) {
+            break;
         }
+        contents->size += n;
     }
-    if (port_idx == n_ports) {
-        ofp_fatal(0, "couldn't find monitored port: %s", argv[2]);
+    if (ferror(file)) {
+        ofp_fatal(errno, "%s: read", argv[2]);
     }
+    fclose(file);
 
-    opm = make_openflow(sizeof(struct ofp_port_mod), OFPT_PORT_MOD, &request);
-    opm->port_no = osf->ports[port_idx].port_no;
-    memcpy(opm->hw_addr, osf->ports[port_idx].hw_addr, sizeof opm->hw_addr);
-    opm->config = htonl(0);
-    opm->mask = htonl(0);
-    opm->advertise = htonl(0);
-
-    printf("modifying port: %s\n", osf->ports[port_idx].name);
+    fh = ofpbuf_at(contents, 0, sizeof *fh);
+    if (!fh || ntohl(fh->magic) != OFP_EXT_FLOW_FILE_MAGIC
+        || ntohl(fh->version) != OFP_EXT_FLOW_FILE_VERSION) {
+        ofp_fatal(0, "%s: not a version %d flow snapshot",
+                  argv[2], OFP_EXT_FLOW_FILE_VERSION);
+    }
+    n_flows = ntohl(fh->n_flows);
 
-    if (!strncasecmp(argv[3], MOD_PORT_CMD_UP, sizeof MOD_PORT_CMD_UP)) {
-        opm->mask |= htonl(OFPPC_PORT_DOWN);
-    } else if (!strncasecmp(argv[3], MOD_PORT_CMD_DOWN, 
-                sizeof MOD_PORT_CMD_DOWN)) {
-        opm->mask |= htonl(OFPPC_PORT_DOWN);
-        opm->config |= htonl(OFPPC_PORT_DOWN);
-    } else if (!strncasecmp(argv[3], MOD_PORT_CMD_FLOOD, 
-                sizeof MOD_PORT_CMD_FLOOD)) {
-        opm->mask |= htonl(OFPPC_NO_FLOOD);
-    } else if (!strncasecmp(argv[3], MOD_PORT_CMD_NOFLOOD, 
-                sizeof MOD_PORT_CMD_NOFLOOD)) {
-        opm->mask |= htonl(OFPPC_NO_FLOOD);
-        opm->config |= htonl(OFPPC_NO_FLOOD);
-    } else {
-        ofp_fatal(0, "unknown mod-port command '%s'", argv[3]);
+    /* Pack the records into as few messages as possible, so that the
+     * switch installs them in bulk. */
+    open_vconn(argv[1], &vconn);
+    gettimeofday(&start, NULL);
+    msg = NULL;
+    send_flow_import(vconn, &msg);
+    p = (const uint8_t *) (fh + 1);
+    limit = (const uint8_t *) ofpbuf_tail(contents);
+    for (i = 0; i < n_flows; i++) {
+        size_t length = flow_record_len(p, limit - p);
+        if (!length) {
+            ofp_fatal(0, "%s: flow snapshot is truncated or corrupt",
+                      argv[2]);
+        }
+        if (msg->size + length > MAX_FLOW_IMPORT_BYTES) {
+            send_flow_import(vconn, &msg);
+        }
+        ofpbuf_put(msg, p, length);
+        p += length;
     }
+    send_flow_import(vconn, &msg);
+    ofpbuf_delete(msg);
 
+    make_openflow(sizeof(struct ofp_header), OFPT_BARRIER_REQUEST, &request);
+    i = ((struct ofp_header *) request->data)->xid;
     send_openflow_buffer(vconn, request);
-
-    ofpbuf_delete(reply);
+    n_errors = 0;
+    wait_for_barrier(vconn, i, &n_errors);
+    gettimeofday(&end, NULL);
     vconn_close(vconn);
+    ofpbuf_delete(contents);
+
+    printf("restored %"PRIu32" flows from %s in %.3f ms",
+           n_flows - MIN(n_errors, n_flows), argv[2],
+           ((end.tv_sec - start.tv_sec) * 1000.0
+            + (end.tv_usec - start.tv_usec) / 1000.0));
+    if (n_errors) {
+        printf(" (%d failed)", n_errors);
+    }
+    putchar('\n');
 }
 
 static void
-do_ping(const struct settings *s UNUSED, int argc, char *argv[])
+do_dump_flows_binary(const struct settings *s UNUSED, int argc, char *argv[])
 {
-    size_t max_payload = 65535 - sizeof(struct ofp_header);
-    unsigned int payload;
+    struct ofp_flow_stats_request *req;
+    struct flow_file_writer w;
+    struct ofpbuf *request;
     struct vconn *vconn;
-    int i;
+    uint32_t send_xid;
+    uint16_t out_port;
+    uint32_t n_flows;
+    bool done;
+    int error;
 
-    payload = argc > 2 ? atoi(argv[2]) : 64;
-    if (payload > max_payload) {
-        ofp_fatal(0, "payload must be between 0 and %zu bytes", max_payload);
+    req = alloc_stats_request(sizeof *req, OFPST_FLOW, &request);
+    parse_ofp_str(argc > 3 ? argv[3] : "", &req->match, NULL,
+                  &req->table_id, &out_port, NULL, NULL, NULL, NULL);
+    memset(&req->pad, 0, sizeof req->pad);
+    req->out_port = htons(out_port);
+    send_xid = ((struct ofp_header *) request->data)->xid;
+
+    error = flow_file_create(argv[2], &w);
+    if (error) {
+        ofp_fatal(error, "%s: create", argv[2]);
     }
 
     open_vconn(argv[1], &vconn);
-    for (i = 0; i < 10; i++) {
-        struct timeval start, end;
-        struct ofpbuf *request, *reply;
-        struct ofp_header *rq_hdr, *rpy_hdr;
-
-        rq_hdr = make_openflow(sizeof(struct ofp_header) + payload,
-                               OFPT_ECHO_REQUEST, &request);
-        random_bytes(rq_hdr + 1, payload);
+    send_openflow_buffer(vconn, request);
+    for (done = false; !done; ) {
+        const struct ofp_stats_reply *osr;
+        const uint8_t *p, *end;
+        struct ofp_header *oh;
+        struct ofpbuf *reply;
 
-        gettimeofday(&start, NULL);
-        run(vconn_transact(vconn, ofpbuf_clone(request), &reply), "transact");
-        gettimeofday(&end, NULL);
+        run(vconn_recv_block(vconn, &reply), "OpenFlow packet receive failed");
+        oh = reply->data;
+        if (oh->xid != send_xid) {
+            ofpbuf_delete(reply);
+            continue;
+        }
+        osr = ofpbuf_at(reply, 0, offsetof(struct ofp_stats_reply, body));
+        if (oh->type != OFPT_STATS_REPLY || !osr
+            || osr->type != htons(OFPST_FLOW)) {
+            flow_file_abort(&w);
+            ofp_print(stderr, reply->data, reply->size, 1);
+            ofp_fatal(0, "%s: unexpected reply to flow stats request",
+                      argv[1]);
+        }
+        done = !(ntohs(osr->flags) & OFPSF_REPLY_MORE);
+
+        p = osr->body;
+        end = (const uint8_t *) reply->data + reply->size;
+        while (p < end) {
+            const struct ofp_flow_stats *fs = (const void *) p;
+            struct ofpbuf *ofm;
+            size_t length;
+
+            length = end - p >= sizeof *fs ? ntohs(fs->length) : 0;
+            if (length < sizeof *fs || length > end - p
+                || (length - sizeof *fs) % sizeof fs->actions[0]) {
+                flow_file_abort(&w);
+                ofp_fatal(0, "%s: malformed flow stats reply", argv[1]);
+            }
 
-        rpy_hdr = reply->data;
-        if (reply->size != request->size
-            || memcmp(rpy_hdr + 1, rq_hdr + 1, payload)
-            || rpy_hdr->xid != rq_hdr->xid
-            || rpy_hdr->type != OFPT_ECHO_REPLY) {
-            printf("Reply does not match request.  Request:\n");
-            ofp_print(stdout, request, request->size, 2);
-            printf("Reply:\n");
-            ofp_print(stdout, reply, reply->size, 2);
+            ofm = flow_stats_to_flow_mod(fs);
+            error = flow_file_write(&w, ofm->data);
+            ofpbuf_delete(ofm);
+            if (error) {
+                flow_file_abort(&w);
+                ofp_fatal(error, "%s: write", argv[2]);
+            }
+            p += length;
         }
-        printf("%d bytes from %s: xid=%08"PRIx32" time=%.1f ms\n",
-               reply->size - sizeof *rpy_hdr, argv[1], rpy_hdr->xid,
-                   (1000*(double)(end.tv_sec - start.tv_sec))
-                   + (.001*(end.tv_usec - start.tv_usec)));
-        ofpbuf_delete(request);
         ofpbuf_delete(reply);
     }
     vconn_close(vconn);
+
+    n_flows = w.n_flows;
+    error = flow_file_commit(&w);
+    if (error) {
+        ofp_fatal(error, "%s: write", argv[2]);
+    }
+    printf("saved %"PRIu32" flows to %s\n", n_flows, argv[2]);
 }
 
 static void
-do_benchmark(const struct settings *s UNUSED, int argc UNUSED, char *argv[])
+do_flows_to_binary(const struct settings *s UNUSED, int argc UNUSED,
+                   char *argv[])
 {
-    size_t max_payload = 65535 - sizeof(struct ofp_header);
-    struct timeval start, end;
-    unsigned int payload_size, message_size;
-    struct vconn *vconn;
-    double duration;
-    int count;
-    int i;
+    struct flow_file_writer w;
+    struct ofpbuf *buffer;
+    int line_number;
+    FILE *file;
+    int error;
 
-    payload_size = atoi(argv[2]);
-    if (payload_size > max_payload) {
-        ofp_fatal(0, "payload must be between 0 and %zu bytes", max_payload);
+    file = fopen(argv[1], "r");
+    if (file == NULL) {
+        ofp_fatal(errno, "%s: open", argv[1]);
+    }
+    error = flow_file_create(argv[2], &w);
+    if (error) {
+        ofp_fatal(error, "%s: create", argv[2]);
     }
-    message_size = sizeof(struct ofp_header) + payload_size;
-
-    count = atoi(argv[3]);
-
-    printf("Sending %d packets * %u bytes (with header) = %u bytes total\n",
-           count, message_size, count * message_size);
 
-    open_vconn(argv[1], &vconn);
-    gettimeofday(&start, NULL);
-    for (i = 0; i < count; i++) {
-        struct ofpbuf *request, *reply;
-        struct ofp_header *rq_hdr;
+    line_number = 0;
+    while ((buffer = parse_ofp_add_flow_file(file, &line_number)) != NULL) {
+        update_openflow_length(buffer);
+        error = flow_file_write(&w, buffer->data);
+        ofpbuf_delete(buffer);
+        if (error) {
+            flow_file_abort(&w);
+            ofp_fatal(error, "%s: write", argv[2]);
+        }
+    }
+    fclose(file);
 
-        rq_hdr = make_openflow(message_size, OFPT_ECHO_REQUEST, &request);
-        memset(rq_hdr + 1, 0, payload_size);
-        run(vconn_transact(vconn, request, &reply), "transact");
-        ofpbuf_delete(reply);
+    error = flow_file_commit(&w);
+    if (error) {
+        ofp_fatal(error, "%s: write", argv[2]);
     }
-    gettimeofday(&end, NULL);
-    vconn_close(vconn);
+}
 
-    duration = ((1000*(double)(end.tv_sec - start.tv_sec))
-                + (.001*(end.tv_usec - start.tv_usec)));
-    printf("Finished in %.1f ms (%.0f packets/s) (%.0f bytes/s)\n",
-           duration, count / (duration / 1000.0),
-           count * message_size / (duration / 1000.0));
+static void
+do_binary_to_flows(const struct settings *s UNUSED, int argc UNUSED,
+                   char *argv[])
+{
+    const struct ofp_flow_mod *ofm;
+    struct flow_file ff;
+    size_t length;
+    int error;
+
+    error = flow_file_open(argv[1], &ff);
+    if (error) {
+        ofp_fatal(error, "%s: could not read flow file", argv[1]);
+    }
+    while (!(error = flow_file_next(&ff, &ofm, &length))) {
+        char *line = flow_mod_to_string(ofm);
+        puts(line);
+        free(line);
+    }
+    if (error != EOF) {
+        ofp_fatal(0, "%s: flow file is truncated or corrupt", argv[1]);
+    }
+    flow_file_close(&ff);
 }
 
 /****************************************************************
@@ -1745,21 +4287,38 @@ static struct command all_commands[] = {
 
     { "show", 1, 1, do_show },
     { "status", 1, 2, do_status },
+    { "stats-file", 1, 2, do_stats_file },
 
     { "show-protostat", 1, 1, do_protostat },
 
     { "help", 0, INT_MAX, do_help },
-    { "monitor", 1, 1, do_monitor },
+    { "monitor", 1, 2, do_monitor },
     { "dump-desc", 1, 1, do_dump_desc },
     { "dump-tables", 1, 1, do_dump_tables },
+    { "dump-buffers", 1, 1, do_dump_buffers },
+    { "show-latency", 1, 1, do_show_latency },
+    { "top-flows", 1, 3, do_top_flows },
+    { "trace", 2, 3, do_trace },
     { "desc", 2, 2, do_desc },
     { "dump-flows", 1, 2, do_dump_flows },
     { "dump-aggregate", 1, 2, do_dump_aggregate },
+    { "dump-flow-deltas", 2, 3, do_dump_flow_deltas },
     { "add-flow", 2, 2, do_add_flow },
     { "add-flows", 2, 2, do_add_flows },
+    { "replace-flows", 2, 2, do_replace_flows },
+    { "save-flows", 2, 2, do_save_flows },
+    { "restore-flows", 2, 2, do_restore_flows },
+    { "dump-flows-binary", 2, 3, do_dump_flows_binary },
+    { "flows-to-binary", 2, 2, do_flows_to_binary },
+    { "binary-to-flows", 1, 1, do_binary_to_flows },
     { "mod-flows", 2, 2, do_mod_flows },
     { "del-flows", 1, 2, do_del_flows },
+    { "set-table-miss", 3, 3, do_set_table_miss },
+    { "dump-cookie", 2, 3, do_dump_cookie },
+    { "mod-cookie", 3, 3, do_mod_cookie },
+    { "del-cookie", 2, 3, do_del_cookie },
     { "dump-ports", 1, 2, do_dump_ports },
+    { "dump-drops", 1, 2, do_dump_drops },
     { "mod-port", 3, 3, do_mod_port },
     { "add-queue", 3, 4, do_mod_queue },
     { "mod-queue", 3, 4, do_mod_queue },
@@ -1767,6 +4326,18 @@ static struct command all_commands[] = {
     { "dump-queue", 1, 3, do_dump_queue },
     { "probe", 1, 1, do_probe },
     { "ping", 1, 2, do_ping },
-    { "benchmark", 3, 3, do_benchmark },
+    { "benchmark", 3, 5, do_benchmark },
+    { "benchmark-flows", 3, 4, do_benchmark_flows },
+    { "benchmark-install", 4, 6, do_benchmark_install },
+    { "benchmark-controller", 1, 4, do_benchmark_controller },
     { NULL, 0, 0, NULL },
 };
+
+/* Returns true if 'p''s first argument is a SWITCH, false if it is a file
+ * name. */
+static bool
+command_takes_switch(const struct command *p)
+{
+    return (p->handler != do_flows_to_binary
+            && p->handler != do_binary_to_flows);
+}
@@ -0,0 +1,563 @@
+/* Copyright (c) 2008 The Board of Trustees of The Leland Stanford
+ * Junior University
+ *
+ * We are making the OpenFlow specification and associated documentation
+ * (Software) available for public use and benefit with the expectation
+ * that others will use, modify and enhance the Software and contribute
+ * those enhancements back to the community. However, since we would
+ * like to make the Software available for broadest use, with as few
+ * restrictions as possible permission is hereby granted, free of
+ * charge, to any person obtaining a copy of this Software to deal in
+ * the Software under the copyrights without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * The name and trademarks of copyright holder(s) may NOT be used in
+ * advertising or publicity pertaining to the Software or any
+ * derivatives without specific, written prior permission.
+ */
+
+#include <config.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "command-line.h"
+#include "csum.h"
+#include "netdev.h"
+#include "ofpbuf.h"
+#include "packets.h"
+#include "poll-loop.h"
+#include "random.h"
+#include "timeval.h"
+#include "util.h"
+#include "vlog.h"
+#define THIS_MODULE VLM_ofp_pktgen
+
+/* Every generated packet carries this payload, which lets the receiver
+ * recognize it and compute its latency. */
+struct pktgen_payload {
+    uint32_t magic;             /* PKTGEN_MAGIC. */
+    uint32_t seq;               /* Sequence number, counting from 0. */
+    uint64_t sent_nsec;         /* CLOCK_MONOTONIC time when sent. */
+};
+#define PKTGEN_MAGIC 0x506b7447
+
+/* Offset of the payload in a generated packet. */
+#define PKTGEN_PAYLOAD_OFS (ETH_HEADER_LEN + IP_HEADER_LEN + UDP_HEADER_LEN)
+
+/* The latency histogram has 1-microsecond buckets up to this value; slower
+ * packets are counted in the last bucket. */
+#define PKTGEN_MAX_LATENCY 100000
+
+/* --rate: packets per second to send, or 0 to send as fast as possible. */
+static double rate;
+
+/* --flows: number of distinct 5-tuples in use at any time. */
+static int n_flows = 1;
+
+/* --zipf: exponent of the Zipf distribution that picks among the flows, or 0
+ * to pick them uniformly. */
+static double zipf;
+
+/* --new-flows: rate per second at which new 5-tuples replace old ones. */
+static double new_flow_rate;
+
+/* --size: size of each packet, excluding the Ethernet FCS. */
+static int packet_size = ETH_TOTAL_MIN;
+
+/* --duration: number of seconds to send. */
+static int duration = 10;
+
+/* --dst-mac: Ethernet destination of the generated packets.  Defaults to the
+ * receiving network device's address. */
+static uint8_t dst_mac[ETH_ADDR_LEN];
+static bool dst_mac_set;
+
+/* --tx-ring, --batch: frames in the TX ring, 0 to send without one, and the
+ * number of packets queued in it between flushes. */
+static int tx_ring_frames = 1024;
+static int batch = 32;
+
+static void parse_options(int argc, char *argv[]);
+static void usage(void) NO_RETURN;
+
+/* Returns the current CLOCK_MONOTONIC time in nanoseconds. */
+static uint64_t
+time_nsec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Returns a cumulative distribution over 'n_flows' flow slots, with slot 'i'
+ * given weight 1 / (i + 1)**'zipf'. */
+static double *
+make_flow_cdf(void)
+{
+    double *cdf = xmalloc(n_flows * sizeof *cdf);
+    double sum = 0;
+    int i;
+
+    for (i = 0; i < n_flows; i++) {
+        sum += zipf ? pow(i + 1, -zipf) : 1;
+        cdf[i] = sum;
+    }
+    for (i = 0; i < n_flows; i++) {
+        cdf[i] /= sum;
+    }
+    return cdf;
+}
+
+/* Picks a flow slot at random according to 'cdf'. */
+static int
+pick_flow_slot(const double *cdf)
+{
+    double x = random_uint32() / 4294967296.0;
+    int low = 0, high = n_flows - 1;
+
+    while (low < high) {
+        int mid = low + (high - low) / 2;
+        if (cdf[mid] > x) {
+            high = mid;
+        } else {
+            low = mid + 1;
+        }
+    }
+    return low;
+}
+
+/* Initializes 'packet', which must have room for 'packet_size' bytes, as a
+ * UDP packet from 'src_mac' with the headers that all generated packets
+ * share. */
+static void
+make_packet_template(struct ofpbuf *packet, const uint8_t src_mac[])
+{
+    struct eth_header *eth;
+    struct ip_header *ip;
+    struct udp_header *udp;
+
+    eth = ofpbuf_put_zeros(packet, ETH_HEADER_LEN);
+    memcpy(eth->eth_dst, dst_mac, ETH_ADDR_LEN);
+    memcpy(eth->eth_src, src_mac, ETH_ADDR_LEN);
+    eth->eth_type = htons(ETH_TYPE_IP);
+
+    ip = ofpbuf_put_zeros(packet, IP_HEADER_LEN);
+    ip->ip_ihl_ver = IP_IHL_VER(5, IP_VERSION);
+    ip->ip_tot_len = htons(packet_size - ETH_HEADER_LEN);
+    ip->ip_ttl = 64;
+    ip->ip_proto = IP_TYPE_UDP;
+    ip->ip_dst = htonl(0x0a800001);
+
+    udp = ofpbuf_put_zeros(packet, UDP_HEADER_LEN);
+    udp->udp_dst = htons(9);
+    udp->udp_len = htons(packet_size - ETH_HEADER_LEN - IP_HEADER_LEN);
+
+    ofpbuf_put_zeros(packet, packet_size - packet->size);
+}
+
+/* Fills in the fields of 'packet' that identify flow number 'flow', which
+ * counts up as new flows arrive, and its payload. */
+static void
+set_packet_flow(struct ofpbuf *packet, uint32_t flow, uint32_t seq)
+{
+    struct ip_header *ip = ofpbuf_at_assert(packet, ETH_HEADER_LEN,
+                                            IP_HEADER_LEN);
+    struct udp_header *udp = ofpbuf_at_assert(packet, ETH_HEADER_LEN
+                                              + IP_HEADER_LEN,
+                                              UDP_HEADER_LEN);
+    struct pktgen_payload *pl = ofpbuf_at_assert(packet, PKTGEN_PAYLOAD_OFS,
+                                                 sizeof *pl);
+
+    ip->ip_src = htonl(0x0a000000 | (flow & 0x7fffff));
+    ip->ip_csum = 0;
+    ip->ip_csum = csum(ip, IP_HEADER_LEN);
+    udp->udp_src = htons(1024 + (flow >> 23));
+
+    pl->magic = htonl(PKTGEN_MAGIC);
+    pl->seq = htonl(seq);
+    pl->sent_nsec = time_nsec();
+}
+
+/* Returns the value at 'fraction' (between 0 and 1) of the way through the
+ * 'n' samples in latency histogram 'hist'. */
+static int
+percentile(const unsigned int *hist, unsigned long long int n,
+           double fraction)
+{
+    unsigned long long int rank = fraction * (n - 1);
+    unsigned long long int count = 0;
+    int i;
+
+    for (i = 0; i < PKTGEN_MAX_LATENCY; i++) {
+        count += hist[i];
+        if (count > rank) {
+            break;
+        }
+    }
+    return i;
+}
+
+int
+main(int argc, char *argv[])
+{
+    struct netdev *tx_netdev, *rx_netdev;
+    unsigned long long int n_sent, n_received, n_new_flows;
+    unsigned long long int last_sent, last_received;
+    unsigned int *latency;
+    uint32_t *slots, next_flow;
+    int next_replace;
+    struct ofpbuf *packet, *rx_packet;
+    uint64_t start, end, now, next_report, last_report;
+    double *cdf;
+    double elapsed;
+    int retval;
+
+    set_program_name(argv[0]);
+    time_init();
+    vlog_init();
+    random_init();
+    parse_options(argc, argv);
+
+    argc -= optind;
+    argv += optind;
+    if (argc < 1 || argc > 2) {
+        ofp_fatal(0, "need one or two non-option arguments; "
+                  "use --help for usage");
+    }
+
+    retval = netdev_open(argv[0], NETDEV_ETH_TYPE_NONE, &tx_netdev);
+    if (retval) {
+        ofp_fatal(retval, "%s: could not open network device", argv[0]);
+    }
+    if (tx_ring_frames) {
+        retval = netdev_setup_tx_ring(tx_netdev, tx_ring_frames);
+        if (retval) {
+            VLOG_WARN("%s: sending without TX ring (%s)",
+                      argv[0], strerror(retval));
+        }
+    }
+    rx_netdev = NULL;
+    rx_packet = NULL;
+    if (argc > 1) {
+        retval = netdev_open(argv[1], NETDEV_ETH_TYPE_ANY, &rx_netdev);
+        if (retval) {
+            ofp_fatal(retval, "%s: could not open network device", argv[1]);
+        }
+        rx_packet = ofpbuf_new(ETH_HEADER_LEN + VLAN_HEADER_LEN
+                               + netdev_get_mtu(rx_netdev));
+        if (!dst_mac_set) {
+            memcpy(dst_mac, netdev_get_etheraddr(rx_netdev), ETH_ADDR_LEN);
+        }
+    } else if (!dst_mac_set) {
+        ofp_fatal(0, "--dst-mac is required without a receiving device");
+    }
+
+    packet = ofpbuf_new(packet_size);
+    make_packet_template(packet, netdev_get_etheraddr(tx_netdev));
+    cdf = make_flow_cdf();
+    slots = xmalloc(n_flows * sizeof *slots);
+    for (next_flow = 0; next_flow < n_flows; next_flow++) {
+        slots[next_flow] = next_flow;
+    }
+    next_replace = 0;
+    latency = xcalloc(PKTGEN_MAX_LATENCY + 1, sizeof *latency);
+
+    n_sent = n_received = n_new_flows = last_sent = last_received = 0;
+    start = last_report = now = time_nsec();
+    end = start + duration * 1000000000ULL;
+    next_report = start + 1000000000ULL;
+    for (;;) {
+        unsigned long long int due;
+        int i;
+
+        /* Send the packets that are due by now, at most 'batch' at a time. */
+        due = rate ? (now - start) / 1e9 * rate + 1 : n_sent + batch;
+        if (new_flow_rate && now < end) {
+            unsigned long long int due_flows;
+
+            due_flows = (now - start) / 1e9 * new_flow_rate;
+            for (; n_new_flows < due_flows; n_new_flows++) {
+                slots[next_replace] = next_flow++;
+                next_replace = (next_replace + 1) % n_flows;
+            }
+        }
+        for (i = 0; i < batch && n_sent < due && now < end; i++) {
+            set_packet_flow(packet, slots[pick_flow_slot(cdf)], n_sent);
+            retval = netdev_send(tx_netdev, packet, 0);
+            if (retval == EAGAIN) {
+                break;
+            } else if (retval) {
+                ofp_fatal(retval, "%s: send failed", argv[0]);
+            }
+            n_sent++;
+        }
+        netdev_send_flush(tx_netdev);
+
+        /* Count the packets that came back and note their latency. */
+        for (i = 0; rx_netdev && i < batch * 2; i++) {
+            const struct pktgen_payload *pl;
+            const struct eth_header *eth;
+            uint64_t usec;
+
+            ofpbuf_clear(rx_packet);
+            if (netdev_recv(rx_netdev, rx_packet)) {
+                break;
+            }
+            eth = rx_packet->data;
+            pl = ofpbuf_at(rx_packet, PKTGEN_PAYLOAD_OFS, sizeof *pl);
+            if (eth->eth_type != htons(ETH_TYPE_IP)
+                || !pl || pl->magic != htonl(PKTGEN_MAGIC)) {
+                continue;
+            }
+            usec = (time_nsec() - pl->sent_nsec) / 1000;
+            latency[MIN(usec, PKTGEN_MAX_LATENCY)]++;
+            n_received++;
+        }
+
+        now = time_nsec();
+        if (now >= next_report) {
+            double secs = (now - last_report) / 1e9;
+            printf("sent %.0f pkts/s", (n_sent - last_sent) / secs);
+            if (rx_netdev) {
+                printf(", received %.0f pkts/s",
+                       (n_received - last_received) / secs);
+            }
+            if (new_flow_rate) {
+                printf(", %u flows so far", next_flow);
+            }
+            putchar('\n');
+            fflush(stdout);
+            last_sent = n_sent;
+            last_received = n_received;
+            last_report = now;
+            next_report += 1000000000ULL;
+        }
+
+        /* Keep receiving for a second after the last packet is sent. */
+        if (now >= end + (rx_netdev ? 1000000000ULL : 0)) {
+            break;
+        }
+
+        /* Sleep if the next packet is more than a millisecond away. */
+        if (now >= end
+            || (rate && n_sent >= due && 1e9 / rate > 1000000)) {
+            uint64_t wake = (now >= end ? end + 1000000000ULL
+                             : start + (n_sent / rate) * 1e9);
+            if (rx_netdev) {
+                netdev_recv_wait(rx_netdev);
+            }
+            poll_timer_wait(wake > now ? (wake - now) / 1000000 : 0);
+            poll_block();
+            now = time_nsec();
+        }
+    }
+
+    elapsed = (MIN(now, end) - start) / 1e9;
+    printf("Sent %llu packets to %u flows in %.1f s (%.0f pkts/s)",
+           n_sent, next_flow, elapsed, n_sent / elapsed);
+    if (rx_netdev) {
+        printf(", received %llu (%.1f%% lost)", n_received,
+               n_sent ? 100.0 * (n_sent - MIN(n_received, n_sent)) / n_sent
+               : 0.0);
+    }
+    putchar('\n');
+    if (n_received) {
+        printf("Latency in us: min %d, median %d, 90%% %d, 99%% %d, "
+               "max %d\n",
+               percentile(latency, n_received, 0),
+               percentile(latency, n_received, .5),
+               percentile(latency, n_received, .9),
+               percentile(latency, n_received, .99),
+               percentile(latency, n_received, 1));
+    }
+
+    netdev_close(tx_netdev);
+    if (rx_netdev) {
+        netdev_close(rx_netdev);
+    }
+    ofpbuf_delete(packet);
+    ofpbuf_delete(rx_packet);
+    free(cdf);
+    free(slots);
+    free(latency);
+    return 0;
+}
+
+static void
+parse_options(int argc, char *argv[])
+{
+    enum {
+        OPT_RATE = UCHAR_MAX + 1,
+        OPT_FLOWS,
+        OPT_ZIPF,
+        OPT_NEW_FLOWS,
+        OPT_SIZE,
+        OPT_DURATION,
+        OPT_DST_MAC,
+        OPT_TX_RING,
+        OPT_BATCH,
+        VLOG_OPTION_ENUMS
+    };
+    static struct option long_options[] = {
+        {"rate",        required_argument, 0, OPT_RATE},
+        {"flows",       required_argument, 0, OPT_FLOWS},
+        {"zipf",        required_argument, 0, OPT_ZIPF},
+        {"new-flows",   required_argument, 0, OPT_NEW_FLOWS},
+        {"size",        required_argument, 0, OPT_SIZE},
+        {"duration",    required_argument, 0, OPT_DURATION},
+        {"dst-mac",     required_argument, 0, OPT_DST_MAC},
+        {"tx-ring",     required_argument, 0, OPT_TX_RING},
+        {"batch",       required_argument, 0, OPT_BATCH},
+        VLOG_LONG_OPTIONS,
+        {"help",        no_argument, 0, 'h'},
+        {"version",     no_argument, 0, 'V'},
+        {0, 0, 0, 0},
+    };
+    char *short_options = long_options_to_short_options(long_options);
+
+    for (;;) {
+        int c;
+
+        c = getopt_long(argc, argv, short_options, long_options, NULL);
+        if (c == -1) {
+            break;
+        }
+
+        switch (c) {
+        case OPT_RATE:
+            rate = atof(optarg);
+            if (rate < 0) {
+                ofp_fatal(0, "--rate argument must not be negative");
+            }
+            break;
+
+        case OPT_FLOWS:
+            n_flows = atoi(optarg);
+            if (n_flows <= 0) {
+                ofp_fatal(0, "--flows argument must be positive");
+            }
+            break;
+
+        case OPT_ZIPF:
+            zipf = atof(optarg);
+            if (zipf < 0) {
+                ofp_fatal(0, "--zipf argument must not be negative");
+            }
+            break;
+
+        case OPT_NEW_FLOWS:
+            new_flow_rate = atof(optarg);
+            if (new_flow_rate < 0) {
+                ofp_fatal(0, "--new-flows argument must not be negative");
+            }
+            break;
+
+        case OPT_SIZE:
+            packet_size = atoi(optarg);
+            if (packet_size < ETH_TOTAL_MIN || packet_size > ETH_TOTAL_MAX) {
+                ofp_fatal(0, "--size argument must be between %d and %d",
+                          ETH_TOTAL_MIN, ETH_TOTAL_MAX);
+            }
+            break;
+
+        case OPT_DURATION:
+            duration = atoi(optarg);
+            if (duration <= 0) {
+                ofp_fatal(0, "--duration argument must be positive");
+            }
+            break;
+
+        case OPT_DST_MAC:
+            if (sscanf(optarg, "%"SCNx8":%"SCNx8":%"SCNx8":%"SCNx8":%"SCNx8
+                       ":%"SCNx8, &dst_mac[0], &dst_mac[1], &dst_mac[2],
+                       &dst_mac[3], &dst_mac[4], &dst_mac[5]) != 6) {
+                ofp_fatal(0, "%s: invalid Ethernet address", optarg);
+            }
+            dst_mac_set = true;
+            break;
+
+        case OPT_TX_RING:
+            tx_ring_frames = atoi(optarg);
+            if (tx_ring_frames < 0) {
+                ofp_fatal(0, "--tx-ring argument must not be negative");
+            }
+            break;
+
+        case OPT_BATCH:
+            batch = atoi(optarg);
+            if (batch <= 0) {
+                ofp_fatal(0, "--batch argument must be positive");
+            }
+            break;
+
+        case 'h':
+            usage();
+
+        case 'V':
+            printf("%s %s compiled "__DATE__" "__TIME__"\n",
+                   program_name, VERSION BUILDNR);
+            exit(EXIT_SUCCESS);
+
+        VLOG_OPTION_HANDLERS
+
+        case '?':
+            exit(EXIT_FAILURE);
+
+        default:
+            abort();
+        }
+    }
+    free(short_options);
+}
+
+static void
+usage(void)
+{
+    printf("%s: generates packets for load testing a switch\n"
+           "usage: %s [OPTIONS] TX [RX]\n"
+           "Sends UDP packets on network device TX and, if RX is given,\n"
+           "measures the rate and latency at which they arrive on RX.\n"
+           "\nTraffic options:\n"
+           "  --rate=PKTS             packets per second (default: as fast\n"
+           "                          as possible)\n"
+           "  --flows=N               number of distinct 5-tuples (default: 1)\n"
+           "  --zipf=S                pick flows with Zipf exponent S\n"
+           "                          (default: 0, uniformly)\n"
+           "  --new-flows=RATE        replace RATE flows per second with new\n"
+           "                          ones (default: 0)\n"
+           "  --size=BYTES            packet size without FCS (default: 60)\n"
+           "  --duration=SECS         seconds to send (default: 10)\n"
+           "  --dst-mac=MAC           Ethernet destination (default: RX's\n"
+           "                          address)\n"
+           "  --tx-ring=FRAMES        TX ring size, 0 for none (default: 1024)\n"
+           "  --batch=N               packets per TX ring flush (default: 32)\n",
+           program_name, program_name);
+    vlog_usage();
+    printf("\nOther options:\n"
+           "  -h, --help              display this help message\n"
+           "  -V, --version           display version information\n");
+    exit(EXIT_SUCCESS);
+}